@@ -9,6 +9,7 @@
 
 #include "xenia/app/emulator_window.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <functional>
 #include <memory>
@@ -23,11 +24,14 @@
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
+#include "xenia/base/lock_profiler.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/system.h"
 #include "xenia/base/threading.h"
+#include "xenia/apu/audio_system.h"
+#include "xenia/apu/xma_decoder.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/emulator.h"
 #include "xenia/gpu/command_processor.h"
@@ -138,6 +142,11 @@ DEFINE_bool(
     "depends on the 10bpc displaying capabilities of the actual display used.",
     "Display");
 
+DEFINE_bool(show_performance_hud, false,
+            "Show the overlay with the frame rate and the counters of the "
+            "emulator subsystems on startup (toggled with Ctrl+F3).",
+            "Display");
+
 DEFINE_int32(recent_titles_entry_amount, 10,
              "Allows user to define how many titles is saved in list of "
              "recently played titles.",
@@ -251,6 +260,9 @@ void EmulatorWindow::OnEmulatorInitialized() {
   if (cvars::fullscreen) {
     SetFullscreen(true);
   }
+  if (cvars::show_performance_hud && !performance_hud_dialog_) {
+    TogglePerformanceHud();
+  }
 
   if (IsUseNexusForGameBarEnabled()) {
     XELOGE(
@@ -280,6 +292,127 @@ void EmulatorWindow::DisplayConfigGameConfigLoadCallback::PostGameConfigLoad() {
   emulator_window_.ApplyDisplayConfigForCvars();
 }
 
+EmulatorWindow::PerformanceHudDialog::Sample
+EmulatorWindow::PerformanceHudDialog::TakeSample() const {
+  Emulator& emulator = *emulator_window_.emulator_;
+  Sample sample;
+  sample.time_ms = Clock::QueryHostUptimeMillis();
+  cpu::Processor* processor = emulator.processor();
+  if (processor) {
+    sample.translated_function_count =
+        processor->GetTranslationStatistics().translated_count;
+  }
+  gpu::GraphicsSystem* graphics_system = emulator.graphics_system();
+  if (graphics_system && graphics_system->command_processor()) {
+    sample.texture_load_bytes = graphics_system->command_processor()
+                                    ->GetLiveStatistics()
+                                    .texture_load_bytes;
+  }
+  apu::AudioSystem* audio_system = emulator.audio_system();
+  if (audio_system && audio_system->xma_decoder()) {
+    sample.xma_decode_time_us =
+        audio_system->xma_decoder()->GetStatistics().decode_time_us;
+  }
+  sample.global_lock_contended_count = lock_profiler::GetContendedCount();
+  return sample;
+}
+
+void EmulatorWindow::PerformanceHudDialog::UpdateRates() {
+  // Long enough for the rates not to flicker.
+  constexpr uint64_t kSampleIntervalMs = 500;
+  Sample sample = TakeSample();
+  if (!last_sample_valid_) {
+    last_sample_ = sample;
+    last_sample_valid_ = true;
+    return;
+  }
+  uint64_t interval_ms = sample.time_ms - last_sample_.time_ms;
+  if (interval_ms < kSampleIntervalMs) {
+    return;
+  }
+  double interval_s = double(interval_ms) * 0.001;
+  // The counters may have been reset by switching the title.
+  auto delta = [](uint64_t current, uint64_t last) {
+    return double(std::max(current, last) - last);
+  };
+  translated_functions_per_second_ =
+      delta(sample.translated_function_count,
+            last_sample_.translated_function_count) /
+      interval_s;
+  texture_load_mb_per_second_ =
+      delta(sample.texture_load_bytes, last_sample_.texture_load_bytes) /
+      (1024.0 * 1024.0) / interval_s;
+  uint32_t xma_thread_count = 1;
+  apu::AudioSystem* audio_system = emulator_window_.emulator_->audio_system();
+  if (audio_system && audio_system->xma_decoder()) {
+    xma_thread_count = std::max(
+        audio_system->xma_decoder()->GetStatistics().worker_thread_count, 1u);
+  }
+  xma_busy_percent_ =
+      delta(sample.xma_decode_time_us, last_sample_.xma_decode_time_us) /
+      (double(interval_ms) * 1000.0 * xma_thread_count) * 100.0;
+  global_lock_contentions_per_second_ =
+      delta(sample.global_lock_contended_count,
+            last_sample_.global_lock_contended_count) /
+      interval_s;
+  last_sample_ = sample;
+}
+
+void EmulatorWindow::PerformanceHudDialog::OnDraw(ImGuiIO& io) {
+  UpdateRates();
+
+  // In the top-right corner, not to overlap the post-processing settings.
+  ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 10.0f, 30.0f),
+                          ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+  // Alpha from the Dear ImGui overlay example.
+  ImGui::SetNextWindowBgAlpha(0.35f);
+  if (!ImGui::Begin("Performance", nullptr,
+                    ImGuiWindowFlags_NoDecoration |
+                        ImGuiWindowFlags_AlwaysAutoResize |
+                        ImGuiWindowFlags_NoSavedSettings |
+                        ImGuiWindowFlags_NoFocusOnAppearing |
+                        ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoInputs)) {
+    ImGui::End();
+    return;
+  }
+
+  gpu::GraphicsSystem* graphics_system =
+      emulator_window_.emulator_->graphics_system();
+  ui::Presenter* presenter =
+      graphics_system ? graphics_system->presenter() : nullptr;
+  if (presenter) {
+    ui::FramePacer::Statistics pacing_statistics =
+        presenter->GetFramePacingStatistics();
+    ImGui::Text("Guest: %.1f FPS",
+                pacing_statistics.guest_frame_time_mean_ms > 0.0
+                    ? 1000.0 / pacing_statistics.guest_frame_time_mean_ms
+                    : 0.0);
+    ImGui::Text("Host frame: p50 %.1f ms, p99 %.1f ms",
+                pacing_statistics.present_interval_p50_ms,
+                pacing_statistics.present_interval_p99_ms);
+  }
+  ImGui::Text("JIT: %.0f functions/s", translated_functions_per_second_);
+  gpu::CommandProcessor* command_processor =
+      graphics_system ? graphics_system->command_processor() : nullptr;
+  if (command_processor) {
+    gpu::CommandProcessor::LiveStatistics gpu_statistics =
+        command_processor->GetLiveStatistics();
+    ImGui::Text("Pipelines: %llu created, %u pending",
+                static_cast<unsigned long long>(
+                    gpu_statistics.pipeline_created_count),
+                gpu_statistics.pipeline_pending_count);
+    ImGui::Text("Texture loads: %.2f MB/s", texture_load_mb_per_second_);
+    ImGui::Text("Shared memory: %u invalidations/frame",
+                gpu_statistics.shared_memory_invalidation_count);
+    ImGui::Text("Culled draws: %u/frame", gpu_statistics.culled_draw_count);
+  }
+  ImGui::Text("XMA: %.0f%% busy", xma_busy_percent_);
+  ImGui::Text("Global lock: %.0f contentions/s",
+              global_lock_contentions_per_second_);
+
+  ImGui::End();
+}
+
 void EmulatorWindow::DisplayConfigDialog::OnDraw(ImGuiIO& io) {
   gpu::GraphicsSystem* graphics_system =
       emulator_window_.emulator_->graphics_system();
@@ -625,6 +758,9 @@ bool EmulatorWindow::Initialize() {
     display_menu->AddChild(MenuItem::Create(
         MenuItem::Type::kString, "&Post-processing settings", "F6",
         std::bind(&EmulatorWindow::ToggleDisplayConfigDialog, this)));
+    display_menu->AddChild(MenuItem::Create(
+        MenuItem::Type::kString, "Performance &HUD", "Ctrl+F3",
+        std::bind(&EmulatorWindow::TogglePerformanceHud, this)));
   }
   display_menu->AddChild(MenuItem::Create(MenuItem::Type::kSeparator));
   {
@@ -799,7 +935,11 @@ void EmulatorWindow::OnKeyDown(ui::KeyEvent& e) {
     } break;
 
     case ui::VirtualKey::kF3: {
-      Profiler::ToggleDisplay();
+      if (e.is_ctrl_pressed()) {
+        TogglePerformanceHud();
+      } else {
+        Profiler::ToggleDisplay();
+      }
     } break;
 
     case ui::VirtualKey::kF4: {
@@ -885,8 +1025,9 @@ void EmulatorWindow::FileOpen() {
   file_picker->set_multi_selection(false);
   file_picker->set_title("Select Content Package");
   file_picker->set_extensions({
-      {"Supported Files", "*.iso;*.xex;*.*"},
+      {"Supported Files", "*.iso;*.xcz;*.xex;*.*"},
       {"Disc Image (*.iso)", "*.iso"},
+      {"Compressed Disc Image (*.xcz)", "*.xcz"},
       {"Xbox Executable (*.xex)", "*.xex"},
       //{"Content Package (*.xcp)", "*.xcp" },
       {"All Files (*.*)", "*.*"},
@@ -1023,6 +1164,15 @@ void EmulatorWindow::ToggleDisplayConfigDialog() {
   }
 }
 
+void EmulatorWindow::TogglePerformanceHud() {
+  if (!performance_hud_dialog_) {
+    performance_hud_dialog_ = std::unique_ptr<PerformanceHudDialog>(
+        new PerformanceHudDialog(imgui_drawer_.get(), *this));
+  } else {
+    performance_hud_dialog_.reset();
+  }
+}
+
 void EmulatorWindow::ToggleControllerVibration() {
   auto input_sys = emulator()->input_system();
   if (input_sys) {
@@ -1380,7 +1530,7 @@ void EmulatorWindow::GamepadHotKeys() {
       auto input_lock = input_sys->lock();
 
       for (uint32_t user_index = 0; user_index < MAX_USERS; ++user_index) {
-        X_RESULT result = input_sys->GetState(user_index, &state);
+        X_RESULT result = input_sys->GetHostState(user_index, &state);
 
         // Release the lock before processing the hotkey
         input_lock.mutex()->unlock();
@@ -162,6 +162,37 @@ class EmulatorWindow {
     EmulatorWindow& emulator_window_;
   };
 
+  // A compact overlay of the counters published by the subsystems, with the
+  // rates calculated over the intervals between the samples of them.
+  class PerformanceHudDialog final : public ui::ImGuiDialog {
+   public:
+    PerformanceHudDialog(ui::ImGuiDrawer* imgui_drawer,
+                         EmulatorWindow& emulator_window)
+        : ui::ImGuiDialog(imgui_drawer), emulator_window_(emulator_window) {}
+
+   protected:
+    void OnDraw(ImGuiIO& io) override;
+
+   private:
+    struct Sample {
+      uint64_t time_ms = 0;
+      uint64_t translated_function_count = 0;
+      uint64_t texture_load_bytes = 0;
+      uint64_t xma_decode_time_us = 0;
+      uint64_t global_lock_contended_count = 0;
+    };
+    Sample TakeSample() const;
+    void UpdateRates();
+
+    EmulatorWindow& emulator_window_;
+    Sample last_sample_;
+    bool last_sample_valid_ = false;
+    double translated_functions_per_second_ = 0.0;
+    double texture_load_mb_per_second_ = 0.0;
+    double xma_busy_percent_ = 0.0;
+    double global_lock_contentions_per_second_ = 0.0;
+  };
+
   explicit EmulatorWindow(Emulator* emulator,
                           ui::WindowedAppContext& app_context);
 
@@ -197,6 +228,7 @@ class EmulatorWindow {
   void GpuTraceFrame();
   void GpuClearCaches();
   void ToggleDisplayConfigDialog();
+  void TogglePerformanceHud();
   void ToggleControllerVibration();
   void ShowCompatibility();
   void ShowFAQ();
@@ -233,6 +265,7 @@ class EmulatorWindow {
   bool initializing_shader_storage_ = false;
 
   std::unique_ptr<DisplayConfigDialog> display_config_dialog_;
+  std::unique_ptr<PerformanceHudDialog> performance_hud_dialog_;
 
   std::vector<RecentTitleEntry> recently_launched_titles_;
 };
@@ -133,3 +133,70 @@ project("xenia-app")
       debugargs({
       })
     end
+
+-- TODO(Triang3l): The emulator itself on Android.
+if not os.istarget("android") then
+  group("src")
+  project("xenia-bench")
+    uuid("5a1f0c5e-7b2d-4f43-9a8e-3c6d2e9b1f70")
+    kind("ConsoleApp")
+    language("C++")
+    links({
+      "xenia-apu",
+      "xenia-apu-nop",
+      "xenia-base",
+      "xenia-core",
+      "xenia-cpu",
+      "xenia-gpu",
+      "xenia-gpu-null",
+      "xenia-gpu-vulkan",
+      "xenia-hid",
+      "xenia-kernel",
+      "xenia-patcher",
+      "xenia-ui",
+      "xenia-ui-vulkan",
+      "xenia-vfs",
+    })
+    links({
+      "aes_128",
+      "capstone",
+      "fmt",
+      "dxbc",
+      "glslang-spirv",
+      "imgui",
+      "libavcodec",
+      "libavutil",
+      "mspack",
+      "snappy",
+      "xxhash",
+    })
+    defines({
+      "XBYAK_NO_OP_NAMES",
+      "XBYAK_ENABLE_OMITTED_OPERAND",
+    })
+    includedirs({
+      project_root.."/third_party/Vulkan-Headers/include",
+    })
+    files({
+      "xenia_bench_main.cc",
+      "../base/console_app_main_"..platform_suffix..".cc",
+    })
+
+    filter("architecture:x86_64")
+      links({
+        "xenia-cpu-backend-x64",
+      })
+
+    filter("platforms:Linux")
+      links({
+        "X11",
+        "xcb",
+        "X11-xcb",
+      })
+
+    filter("platforms:Windows")
+      links({
+        "xenia-gpu-d3d12",
+        "xenia-ui-d3d12",
+      })
+end
@@ -0,0 +1,574 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/apu/audio_system.h"
+#include "xenia/apu/nop/nop_audio_system.h"
+#include "xenia/apu/xma_decoder.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/string.h"
+#include "xenia/base/threading.h"
+#include "xenia/config.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/emulator.h"
+#include "xenia/gpu/command_processor.h"
+#include "xenia/gpu/graphics_system.h"
+#include "xenia/gpu/null/null_graphics_system.h"
+#include "xenia/gpu/vulkan/vulkan_graphics_system.h"
+#include "xenia/hid/input_driver.h"
+
+#if XE_PLATFORM_WIN32
+#include "xenia/base/platform_win.h"
+#include "xenia/gpu/d3d12/d3d12_graphics_system.h"
+
+#include <psapi.h>
+#elif XE_PLATFORM_LINUX
+#include <sys/resource.h>
+#endif  // XE_PLATFORM
+
+DEFINE_transient_path(bench_target, "",
+                      "Specifies the title to benchmark (.xex, disc image or "
+                      "STFS container).",
+                      "Benchmark");
+DEFINE_string(bench_gpu, "any",
+              "Graphics system. Use: [any, d3d12, vulkan, null]", "Benchmark");
+DEFINE_path(bench_storage_root, "",
+            "Root of the content and the cache directories, the directory of "
+            "the executable if not specified. The configuration file is not "
+            "loaded unless specified with --config.",
+            "Benchmark");
+DEFINE_path(bench_input_script, "",
+            "Controller input to replay for the first user. Each line is "
+            "`<guest frame> <buttons> [<left trigger> <right trigger> [<left "
+            "stick x> <left stick y> <right stick x> <right stick y>]]`, with "
+            "the state held until the next line, and `#` starting comments. "
+            "Without a script, an idle controller is connected.",
+            "Benchmark");
+DEFINE_uint32(bench_warmup_frames, 0,
+              "Guest frames to run before the measured ones.", "Benchmark");
+DEFINE_uint32(bench_frames, 600, "Guest frames to measure.", "Benchmark");
+DEFINE_uint32(bench_timeout, 600,
+              "Seconds to wait for all the frames before writing the results "
+              "of the ones measured so far.",
+              "Benchmark");
+DEFINE_path(bench_output_path, "",
+            "Path to write the JSON results to, <title file name>.bench.json "
+            "in the working directory if not specified.",
+            "Benchmark");
+
+namespace xe {
+namespace app {
+
+namespace {
+
+// Plays back the controller states from bench_input_script for the first user
+// by the guest frame being rendered, so the same script drives the same input
+// on every run regardless of the host speed.
+class ScriptedInputDriver final : public hid::InputDriver {
+ public:
+  struct Step {
+    uint32_t frame;
+    uint16_t buttons;
+    uint8_t left_trigger;
+    uint8_t right_trigger;
+    int16_t thumb_lx;
+    int16_t thumb_ly;
+    int16_t thumb_rx;
+    int16_t thumb_ry;
+  };
+
+  ScriptedInputDriver(const std::atomic<uint32_t>& frame_index,
+                      std::vector<Step> steps)
+      : InputDriver(nullptr, 0),
+        frame_index_(frame_index),
+        steps_(std::move(steps)) {}
+
+  static bool LoadScript(const std::filesystem::path& path,
+                         std::vector<Step>& steps_out);
+
+  X_STATUS Setup() override { return X_STATUS_SUCCESS; }
+
+  X_RESULT GetCapabilities(uint32_t user_index, uint32_t flags,
+                           hid::X_INPUT_CAPABILITIES* out_caps) override {
+    if (user_index) {
+      return X_ERROR_DEVICE_NOT_CONNECTED;
+    }
+    if (!out_caps) {
+      return X_ERROR_BAD_ARGUMENTS;
+    }
+    out_caps->type = 0x01;      // XINPUT_DEVTYPE_GAMEPAD
+    out_caps->sub_type = 0x01;  // XINPUT_DEVSUBTYPE_GAMEPAD
+    out_caps->flags = 0;
+    out_caps->gamepad.buttons = 0xFFFF;
+    out_caps->gamepad.left_trigger = 0xFF;
+    out_caps->gamepad.right_trigger = 0xFF;
+    out_caps->gamepad.thumb_lx = (int16_t)0xFFFFu;
+    out_caps->gamepad.thumb_ly = (int16_t)0xFFFFu;
+    out_caps->gamepad.thumb_rx = (int16_t)0xFFFFu;
+    out_caps->gamepad.thumb_ry = (int16_t)0xFFFFu;
+    out_caps->vibration.left_motor_speed = 0;
+    out_caps->vibration.right_motor_speed = 0;
+    return X_ERROR_SUCCESS;
+  }
+
+  X_RESULT GetState(uint32_t user_index,
+                    hid::X_INPUT_STATE* out_state) override {
+    if (user_index) {
+      return X_ERROR_DEVICE_NOT_CONNECTED;
+    }
+    if (!out_state) {
+      return X_ERROR_BAD_ARGUMENTS;
+    }
+    uint32_t frame = frame_index_.load(std::memory_order_relaxed);
+    auto step_it = std::upper_bound(
+        steps_.cbegin(), steps_.cend(), frame,
+        [](uint32_t frame, const Step& step) { return frame < step.frame; });
+    std::memset(out_state, 0, sizeof(*out_state));
+    if (step_it == steps_.cbegin()) {
+      return X_ERROR_SUCCESS;
+    }
+    --step_it;
+    // Changes only when the state changes, like on the real controllers.
+    out_state->packet_number = uint32_t(step_it - steps_.cbegin()) + 1;
+    out_state->gamepad.buttons = step_it->buttons;
+    out_state->gamepad.left_trigger = step_it->left_trigger;
+    out_state->gamepad.right_trigger = step_it->right_trigger;
+    out_state->gamepad.thumb_lx = step_it->thumb_lx;
+    out_state->gamepad.thumb_ly = step_it->thumb_ly;
+    out_state->gamepad.thumb_rx = step_it->thumb_rx;
+    out_state->gamepad.thumb_ry = step_it->thumb_ry;
+    return X_ERROR_SUCCESS;
+  }
+
+  X_RESULT SetState(uint32_t user_index,
+                    hid::X_INPUT_VIBRATION* vibration) override {
+    return user_index ? X_ERROR_DEVICE_NOT_CONNECTED : X_ERROR_SUCCESS;
+  }
+
+  X_RESULT GetKeystroke(uint32_t user_index, uint32_t flags,
+                        hid::X_INPUT_KEYSTROKE* out_keystroke) override {
+    return user_index ? X_ERROR_DEVICE_NOT_CONNECTED : X_ERROR_EMPTY;
+  }
+
+ private:
+  const std::atomic<uint32_t>& frame_index_;
+  // Sorted by the frame.
+  std::vector<Step> steps_;
+};
+
+bool ScriptedInputDriver::LoadScript(const std::filesystem::path& path,
+                                     std::vector<Step>& steps_out) {
+  steps_out.clear();
+  FILE* file = filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("Failed to open the input script {}", path_to_utf8(path));
+    return false;
+  }
+  char line[256];
+  uint32_t line_number = 0;
+  while (std::fgets(line, sizeof(line), file)) {
+    ++line_number;
+    char* comment = std::strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+    long long values[8] = {};
+    size_t value_count = 0;
+    char* position = line;
+    while (value_count < xe::countof(values)) {
+      char* value_end;
+      long long value = std::strtoll(position, &value_end, 0);
+      if (value_end == position) {
+        break;
+      }
+      values[value_count++] = value;
+      position = value_end;
+    }
+    if (!value_count) {
+      continue;
+    }
+    if (value_count == 1 || value_count == 3 ||
+        (value_count > 4 && value_count < 8) || values[0] < 0) {
+      XELOGE("Invalid input script line {} in {}", line_number,
+             path_to_utf8(path));
+      std::fclose(file);
+      return false;
+    }
+    Step step;
+    step.frame = uint32_t(values[0]);
+    step.buttons = uint16_t(values[1]);
+    step.left_trigger = uint8_t(std::clamp(values[2], 0ll, 255ll));
+    step.right_trigger = uint8_t(std::clamp(values[3], 0ll, 255ll));
+    step.thumb_lx = int16_t(std::clamp(values[4], -32768ll, 32767ll));
+    step.thumb_ly = int16_t(std::clamp(values[5], -32768ll, 32767ll));
+    step.thumb_rx = int16_t(std::clamp(values[6], -32768ll, 32767ll));
+    step.thumb_ry = int16_t(std::clamp(values[7], -32768ll, 32767ll));
+    steps_out.push_back(step);
+  }
+  std::fclose(file);
+  std::stable_sort(
+      steps_out.begin(), steps_out.end(),
+      [](const Step& a, const Step& b) { return a.frame < b.frame; });
+  return true;
+}
+
+std::string EscapeJson(const std::string_view value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (uint8_t(c) < 0x20) {
+      escaped += fmt::format("\\u{:04X}", uint8_t(c));
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+uint64_t GetHostPeakMemoryUsage() {
+#if XE_PLATFORM_WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return counters.PeakWorkingSetSize;
+  }
+#elif XE_PLATFORM_LINUX
+  struct rusage usage;
+  if (!getrusage(RUSAGE_SELF, &usage)) {
+    // In kilobytes.
+    return uint64_t(usage.ru_maxrss) << 10;
+  }
+#endif  // XE_PLATFORM
+  return 0;
+}
+
+class Benchmark {
+ public:
+  int Main(const std::vector<std::string>& args);
+
+ private:
+  struct FrameCounters {
+    uint64_t host_ticks;
+    cpu::Processor::TranslationStatistics translation;
+    uint64_t xma_decode_time_us;
+  };
+
+  struct Frame {
+    double frame_ms;
+    // Negative if not measured.
+    double gpu_ms;
+    double jit_ms;
+    uint64_t functions_translated;
+    double xma_decode_ms;
+    gpu::CommandProcessor::BenchmarkStatistics statistics;
+  };
+
+  std::unique_ptr<gpu::GraphicsSystem> CreateGraphicsSystem();
+  FrameCounters GetFrameCounters() const;
+  // On the command processor thread.
+  void OnSwap();
+  bool WriteResults(const std::filesystem::path& path, bool completed,
+                    double launch_ms);
+
+  std::unique_ptr<Emulator> emulator_;
+  std::vector<ScriptedInputDriver::Step> input_steps_;
+  // Guest frames swapped since the launch.
+  std::atomic<uint32_t> frame_index_{0};
+  std::unique_ptr<threading::Event> frames_done_event_;
+
+  // Only accessed on the command processor thread until frames_done_event_ is
+  // set or the command processor is shut down.
+  bool measuring_frame_ = false;
+  bool frames_done_ = false;
+  FrameCounters frame_start_counters_;
+  std::vector<Frame> frames_;
+};
+
+std::unique_ptr<gpu::GraphicsSystem> Benchmark::CreateGraphicsSystem() {
+  const std::string& name = cvars::bench_gpu;
+#if XE_PLATFORM_WIN32
+  if ((name == "any" || name == "d3d12") &&
+      gpu::d3d12::D3D12GraphicsSystem::IsAvailable()) {
+    return std::make_unique<gpu::d3d12::D3D12GraphicsSystem>();
+  }
+#endif  // XE_PLATFORM_WIN32
+  if (name == "any" || name == "vulkan") {
+    return std::make_unique<gpu::vulkan::VulkanGraphicsSystem>();
+  }
+  if (name == "null") {
+    return std::make_unique<gpu::null::NullGraphicsSystem>();
+  }
+  XELOGE("Unsupported or unavailable graphics system {}", name);
+  return nullptr;
+}
+
+Benchmark::FrameCounters Benchmark::GetFrameCounters() const {
+  FrameCounters counters;
+  counters.host_ticks = Clock::QueryHostTickCount();
+  counters.translation = emulator_->processor()->GetTranslationStatistics();
+  apu::AudioSystem* audio_system = emulator_->audio_system();
+  counters.xma_decode_time_us =
+      audio_system
+          ? audio_system->xma_decoder()->GetStatistics().decode_time_us
+          : 0;
+  return counters;
+}
+
+void Benchmark::OnSwap() {
+  // Excluding the wait for the GPU in EndBenchmarkStatistics from the frame.
+  FrameCounters end_counters = GetFrameCounters();
+  uint32_t frame_index =
+      frame_index_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (frames_done_) {
+    return;
+  }
+  gpu::CommandProcessor* command_processor =
+      emulator_->graphics_system()->command_processor();
+  if (measuring_frame_) {
+    double ms_per_tick = 1000.0 / double(Clock::QueryHostTickFrequency());
+    Frame frame;
+    frame.statistics = command_processor->EndBenchmarkStatistics();
+    frame.frame_ms = double(end_counters.host_ticks -
+                            frame_start_counters_.host_ticks) *
+                     ms_per_tick;
+    frame.gpu_ms = frame.statistics.gpu_timed_submission_count <
+                           frame.statistics.submission_count
+                       ? -1.0
+                       : double(frame.statistics.gpu_time_ns) / 1000000.0;
+    frame.jit_ms =
+        double(end_counters.translation.translation_host_ticks -
+               frame_start_counters_.translation.translation_host_ticks) *
+        ms_per_tick;
+    frame.functions_translated =
+        end_counters.translation.translated_count -
+        frame_start_counters_.translation.translated_count;
+    frame.xma_decode_ms = double(end_counters.xma_decode_time_us -
+                                 frame_start_counters_.xma_decode_time_us) /
+                          1000.0;
+    frames_.push_back(frame);
+    measuring_frame_ = false;
+  }
+  if (frames_.size() >= cvars::bench_frames) {
+    frames_done_ = true;
+    frames_done_event_->Set();
+    return;
+  }
+  if (frame_index >= cvars::bench_warmup_frames) {
+    command_processor->BeginBenchmarkStatistics();
+    frame_start_counters_ = GetFrameCounters();
+    measuring_frame_ = true;
+  }
+}
+
+bool Benchmark::WriteResults(const std::filesystem::path& path,
+                             bool completed, double launch_ms) {
+  std::string frames_json;
+  double total_frame_ms = 0.0, total_gpu_ms = 0.0, total_jit_ms = 0.0;
+  double total_xma_decode_ms = 0.0;
+  bool gpu_timed = true;
+  uint64_t total_functions_translated = 0, total_pipelines_created = 0;
+  uint64_t total_texture_load_bytes = 0;
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    const Frame& frame = frames_[i];
+    const gpu::CommandProcessor::BenchmarkStatistics& statistics =
+        frame.statistics;
+    total_frame_ms += frame.frame_ms;
+    if (frame.gpu_ms >= 0.0) {
+      total_gpu_ms += frame.gpu_ms;
+    } else {
+      gpu_timed = false;
+    }
+    total_jit_ms += frame.jit_ms;
+    total_functions_translated += frame.functions_translated;
+    total_pipelines_created += statistics.pipeline_miss_count;
+    total_texture_load_bytes += statistics.texture_load_bytes;
+    total_xma_decode_ms += frame.xma_decode_ms;
+    frames_json += fmt::format(
+        "    {{\"frame\": {}, \"frame_ms\": {:.6f}, \"gpu_ms\": {:.6f}, "
+        "\"submissions\": {}, \"jit_ms\": {:.6f}, \"functions_translated\": "
+        "{}, \"pipeline_lookups\": {}, \"pipelines_created\": {}, "
+        "\"texture_lookups\": {}, \"texture_load_bytes\": {}, "
+        "\"render_passes\": {}, \"barrier_batches\": {}, "
+        "\"memexport_bytes\": {}, \"xma_decode_ms\": {:.6f}}}{}\n",
+        i, frame.frame_ms, frame.gpu_ms, statistics.submission_count,
+        frame.jit_ms, frame.functions_translated,
+        statistics.pipeline_lookup_count, statistics.pipeline_miss_count,
+        statistics.texture_lookup_count, statistics.texture_load_bytes,
+        statistics.render_pass_count, statistics.barrier_batch_count,
+        statistics.memexport_bytes, frame.xma_decode_ms,
+        i + 1 < frames_.size() ? "," : "");
+  }
+  size_t frame_count = frames_.size();
+  double frame_ms_avg = frame_count ? total_frame_ms / frame_count : 0.0;
+  double gpu_ms_avg =
+      gpu_timed && frame_count ? total_gpu_ms / frame_count : -1.0;
+  uint64_t peak_memory_bytes = GetHostPeakMemoryUsage();
+  XELOGI(
+      "Benchmark: {} frames{}, frame {:.3f} ms, GPU {:.3f} ms on average, JIT "
+      "{:.3f} ms, {} pipelines created, {} texture bytes loaded, XMA decoding "
+      "{:.3f} ms, peak memory {} MB",
+      frame_count, completed ? "" : " (incomplete)", frame_ms_avg, gpu_ms_avg,
+      total_jit_ms, total_pipelines_created, total_texture_load_bytes,
+      total_xma_decode_ms, peak_memory_bytes >> 20);
+
+  FILE* json_file = filesystem::OpenFile(path, "wb");
+  if (!json_file) {
+    XELOGE("Failed to write the benchmark results to {}", path_to_utf8(path));
+    return false;
+  }
+  std::string gpu_name = emulator_->graphics_system()->name();
+  std::string title_name = emulator_->title_name();
+  fmt::print(json_file,
+             "{{\n  \"target\": \"{}\",\n  \"title_id\": \"{:08X}\",\n"
+             "  \"title_name\": \"{}\",\n  \"gpu\": \"{}\",\n"
+             "  \"completed\": {},\n  \"warmup_frames\": {},\n"
+             "  \"launch_ms\": {:.6f},\n  \"frames\": [\n{}  ],\n",
+             EscapeJson(path_to_utf8(cvars::bench_target.filename())),
+             emulator_->title_id(), EscapeJson(title_name),
+             EscapeJson(gpu_name), completed ? "true" : "false",
+             uint32_t(cvars::bench_warmup_frames), launch_ms, frames_json);
+  fmt::print(json_file,
+             "  \"total\": {{\"frames\": {}, \"frame_ms_avg\": {:.6f}, "
+             "\"gpu_ms_avg\": {:.6f}, \"jit_ms\": {:.6f}, "
+             "\"functions_translated\": {}, \"pipelines_created\": {}, "
+             "\"texture_load_bytes\": {}, \"xma_decode_ms\": {:.6f}, "
+             "\"peak_memory_bytes\": {}}}\n}}\n",
+             frame_count, frame_ms_avg, gpu_ms_avg, total_jit_ms,
+             total_functions_translated, total_pipelines_created,
+             total_texture_load_bytes, total_xma_decode_ms, peak_memory_bytes);
+  std::fclose(json_file);
+  XELOGI("Benchmark results written to {}", path_to_utf8(path));
+  return true;
+}
+
+int Benchmark::Main(const std::vector<std::string>& args) {
+  if (cvars::bench_target.empty()) {
+    XELOGE("No title to benchmark specified");
+    return 5;
+  }
+  std::filesystem::path target = std::filesystem::absolute(cvars::bench_target);
+  if (!cvars::bench_input_script.empty() &&
+      !ScriptedInputDriver::LoadScript(cvars::bench_input_script,
+                                       input_steps_)) {
+    return 5;
+  }
+
+  std::filesystem::path storage_root = cvars::bench_storage_root;
+  if (storage_root.empty()) {
+    storage_root = filesystem::GetExecutableFolder();
+  }
+  storage_root = std::filesystem::absolute(storage_root);
+  // Only the explicitly specified configuration file for reproducible runs.
+  config::SetupConfig(std::filesystem::path());
+
+  emulator_ = std::make_unique<Emulator>("", storage_root,
+                                         storage_root / "content",
+                                         storage_root / "cache");
+  X_STATUS result = emulator_->Setup(
+      nullptr, nullptr, true, apu::nop::NopAudioSystem::Create,
+      [this]() { return CreateGraphicsSystem(); },
+      [this](ui::Window* window) {
+        std::vector<std::unique_ptr<hid::InputDriver>> drivers;
+        drivers.push_back(std::make_unique<ScriptedInputDriver>(
+            frame_index_, input_steps_));
+        return drivers;
+      });
+  if (XFAILED(result)) {
+    XELOGE("Failed to setup emulator: {:08X}", result);
+    return 4;
+  }
+
+  frames_done_event_ = threading::Event::CreateManualResetEvent(false);
+  gpu::CommandProcessor* command_processor =
+      emulator_->graphics_system()->command_processor();
+  threading::Fence swap_callback_fence;
+  command_processor->CallInThread([this, command_processor,
+                                   &swap_callback_fence]() {
+    command_processor->set_swap_callback([this]() { OnSwap(); });
+    swap_callback_fence.Signal();
+  });
+  swap_callback_fence.Wait();
+
+  uint64_t launch_start_ticks = Clock::QueryHostTickCount();
+  result = emulator_->LaunchPath(target);
+  if (XFAILED(result)) {
+    XELOGE("Failed to launch {}: {:08X}", path_to_utf8(target), result);
+    emulator_.reset();
+    return 6;
+  }
+  double launch_ms = double(Clock::QueryHostTickCount() - launch_start_ticks) *
+                     1000.0 / double(Clock::QueryHostTickFrequency());
+
+  bool completed =
+      threading::Wait(frames_done_event_.get(), false,
+                      std::chrono::seconds(cvars::bench_timeout)) ==
+      threading::WaitResult::kSuccess;
+  if (!completed) {
+    XELOGW("Timed out after {} of {} frames", frames_.size(),
+           uint32_t(cvars::bench_frames));
+  }
+  // Stop recording before reading the results.
+  threading::Fence stop_fence;
+  command_processor->CallInThread([this, command_processor, &stop_fence]() {
+    command_processor->set_swap_callback(nullptr);
+    if (measuring_frame_) {
+      command_processor->EndBenchmarkStatistics();
+      measuring_frame_ = false;
+    }
+    stop_fence.Signal();
+  });
+  stop_fence.Wait();
+  emulator_->TerminateTitle();
+
+  std::filesystem::path output_path = cvars::bench_output_path;
+  if (output_path.empty()) {
+    output_path = target.filename();
+    output_path.replace_extension(".bench.json");
+  }
+  bool written = WriteResults(output_path, completed, launch_ms);
+
+  emulator_.reset();
+  if (!written) {
+    return 1;
+  }
+  return completed ? 0 : 2;
+}
+
+int bench_main(const std::vector<std::string>& args) {
+  Benchmark benchmark;
+  return benchmark.Main(args);
+}
+
+}  // namespace
+
+}  // namespace app
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-bench", xe::app::bench_main, "some.xex",
+                      "bench_target");
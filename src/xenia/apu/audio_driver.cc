@@ -9,6 +9,8 @@
 
 #include "xenia/apu/audio_driver.h"
 
+#include "xenia/base/profiling.h"
+
 namespace xe {
 namespace apu {
 
@@ -16,5 +18,30 @@ AudioDriver::AudioDriver(Memory* memory) : memory_(memory) {}
 
 AudioDriver::~AudioDriver() = default;
 
+AudioDriver::Statistics AudioDriver::GetStatistics() const {
+  Statistics statistics;
+  statistics.played_frame_count =
+      played_frame_count_.load(std::memory_order_relaxed);
+  statistics.underrun_count = underrun_count_.load(std::memory_order_relaxed);
+  statistics.latency_us = latency_us_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+void AudioDriver::OnFramePlayed(uint32_t latency_us) {
+  played_frame_count_.fetch_add(1, std::memory_order_relaxed);
+  latency_us_.store(latency_us, std::memory_order_relaxed);
+  COUNT_profile_set("apu/audio_latency_us", int64_t(latency_us));
+}
+
+void AudioDriver::OnUnderrun() {
+  // Not an underrun if the guest hasn't started playing anything yet.
+  if (!played_frame_count_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  uint64_t underrun_count =
+      underrun_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+  COUNT_profile_set("apu/audio_underrun_count", int64_t(underrun_count));
+}
+
 }  // namespace apu
 }  // namespace xe
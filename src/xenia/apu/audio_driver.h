@@ -10,6 +10,9 @@
 #ifndef XENIA_APU_AUDIO_DRIVER_H_
 #define XENIA_APU_AUDIO_DRIVER_H_
 
+#include <atomic>
+#include <cstdint>
+
 #include "xenia/memory.h"
 #include "xenia/xbox.h"
 
@@ -23,12 +26,32 @@ class AudioDriver {
 
   virtual void SubmitFrame(uint32_t samples_ptr) = 0;
 
+  struct Statistics {
+    uint64_t played_frame_count;
+    uint64_t underrun_count;
+    // Time from the submission of the latest played frame until the host
+    // started playing it.
+    uint32_t latency_us;
+  };
+  Statistics GetStatistics() const;
+
  protected:
+  // To be called by the implementations when the host starts playing a frame.
+  void OnFramePlayed(uint32_t latency_us);
+  // To be called by the implementations when the host needs samples, but none
+  // of the submitted frames are left to be played.
+  void OnUnderrun();
+
   inline uint8_t* TranslatePhysical(uint32_t guest_address) const {
     return memory_->TranslatePhysical(guest_address);
   }
 
   Memory* memory_ = nullptr;
+
+ private:
+  std::atomic<uint64_t> played_frame_count_ = {0};
+  std::atomic<uint64_t> underrun_count_ = {0};
+  std::atomic<uint32_t> latency_us_ = {0};
 };
 
 }  // namespace apu
@@ -0,0 +1,75 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/audio_frame_queue.h"
+
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+
+namespace xe {
+namespace apu {
+
+AudioFrameQueue::AudioFrameQueue(uint32_t frame_samples, uint32_t capacity)
+    : frame_samples_(frame_samples),
+      capacity_(capacity),
+      slot_count_(capacity + 1),
+      samples_(new float[size_t(frame_samples) * (capacity + 1)]),
+      push_host_ticks_(new uint64_t[capacity + 1]) {
+  assert_not_zero(capacity);
+}
+
+float* AudioFrameQueue::BeginPush() {
+  uint32_t write_index = write_index_.load(std::memory_order_relaxed);
+  uint32_t next_write_index = write_index + 1;
+  if (next_write_index == slot_count_) {
+    next_write_index = 0;
+  }
+  if (next_write_index == read_index_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return samples_.get() + size_t(frame_samples_) * write_index;
+}
+
+void AudioFrameQueue::EndPush() {
+  uint32_t write_index = write_index_.load(std::memory_order_relaxed);
+  push_host_ticks_[write_index] = Clock::QueryHostTickCount();
+  uint32_t next_write_index = write_index + 1;
+  if (next_write_index == slot_count_) {
+    next_write_index = 0;
+  }
+  write_index_.store(next_write_index, std::memory_order_release);
+}
+
+const float* AudioFrameQueue::BeginPop(uint64_t& push_host_tick_out) {
+  uint32_t read_index = read_index_.load(std::memory_order_relaxed);
+  if (read_index == write_index_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  push_host_tick_out = push_host_ticks_[read_index];
+  return samples_.get() + size_t(frame_samples_) * read_index;
+}
+
+void AudioFrameQueue::EndPop() {
+  uint32_t read_index = read_index_.load(std::memory_order_relaxed);
+  uint32_t next_read_index = read_index + 1;
+  if (next_read_index == slot_count_) {
+    next_read_index = 0;
+  }
+  read_index_.store(next_read_index, std::memory_order_release);
+}
+
+uint32_t AudioFrameQueue::size() const {
+  uint32_t write_index = write_index_.load(std::memory_order_acquire);
+  uint32_t read_index = read_index_.load(std::memory_order_acquire);
+  return write_index >= read_index ? write_index - read_index
+                                   : slot_count_ - read_index + write_index;
+}
+
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,65 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_AUDIO_FRAME_QUEUE_H_
+#define XENIA_APU_AUDIO_FRAME_QUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace xe {
+namespace apu {
+
+// Lock-free queue of fixed-size audio frames between a single producer (the
+// thread submitting the guest frames) and a single consumer (the host audio
+// callback), so neither has to wait for the other, which is important for the
+// audio callback that must return quickly.
+class AudioFrameQueue {
+ public:
+  AudioFrameQueue(uint32_t frame_samples, uint32_t capacity);
+
+  uint32_t frame_samples() const { return frame_samples_; }
+  uint32_t capacity() const { return capacity_; }
+
+  // Producer. Returns the frame to write the samples to, or nullptr if the
+  // queue is full.
+  float* BeginPush();
+  // Producer. Makes the frame returned by BeginPush available to the consumer.
+  void EndPush();
+
+  // Consumer. Returns the oldest frame, or nullptr if the queue is empty, and
+  // the host tick count when it was pushed.
+  const float* BeginPop(uint64_t& push_host_tick_out);
+  // Consumer. Releases the frame returned by BeginPop for reuse.
+  void EndPop();
+
+  // May be out of date immediately if called by one side while the other is
+  // working with the queue.
+  uint32_t size() const;
+
+ private:
+  uint32_t frame_samples_;
+  uint32_t capacity_;
+  // One slot more than the capacity to distinguish between full and empty.
+  uint32_t slot_count_;
+  std::unique_ptr<float[]> samples_;
+  std::unique_ptr<uint64_t[]> push_host_ticks_;
+
+  // Written only by the producer, separated from the read index to avoid false
+  // sharing between the threads.
+  alignas(64) std::atomic<uint32_t> write_index_ = {0};
+  // Written only by the consumer.
+  alignas(64) std::atomic<uint32_t> read_index_ = {0};
+};
+
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_AUDIO_FRAME_QUEUE_H_
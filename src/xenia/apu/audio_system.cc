@@ -9,6 +9,8 @@
 
 #include "xenia/apu/audio_system.h"
 
+#include <algorithm>
+
 #include "xenia/apu/apu_flags.h"
 #include "xenia/apu/audio_driver.h"
 #include "xenia/apu/xma_decoder.h"
@@ -36,7 +38,10 @@
 
 DEFINE_uint32(
     apu_max_queued_frames, 64,
-    "Allows changing max buffered audio frames to reduce audio delay. Minimum is 16.", "APU");
+    "Allows changing max buffered audio frames to reduce audio delay, with "
+    "each frame being 256 samples (5.33 ms). Lower values reduce the latency, "
+    "but may cause crackling if the host can't keep up. From 4 to 64.",
+    "APU");
 
 namespace xe {
 namespace apu {
@@ -46,7 +51,9 @@ AudioSystem::AudioSystem(cpu::Processor* processor)
       processor_(processor),
       worker_running_(false) {
   std::memset(clients_, 0, sizeof(clients_));
-  queued_frames_ = std::max(cvars::apu_max_queued_frames, (uint32_t)16);
+  queued_frames_ =
+      std::clamp(cvars::apu_max_queued_frames, uint32_t(kMinimumQueuedFrames),
+                 uint32_t(kMaximumQueuedFrames));
 
   for (size_t i = 0; i < kMaximumClientCount; ++i) {
     client_semaphores_[i] = xe::threading::Semaphore::Create(0, queued_frames_);
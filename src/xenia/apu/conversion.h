@@ -50,26 +50,119 @@ static void _movbe_sequential_6_BE_to_interleaved_6_LE(
     }
   }
 }
+#endif
+
+// Writes 4 interleaved 6-channel samples, with the first 4 channels of each
+// sample in sample_N, and the last 2 channels of samples 0 and 1 in
+// channels_45_01, and of samples 2 and 3 in channels_45_23.
+XE_FORCEINLINE
+static void _sse_store_4_interleaved_6(float* output, __m128 sample_0,
+                                       __m128 sample_1, __m128 sample_2,
+                                       __m128 sample_3, __m128 channels_45_01,
+                                       __m128 channels_45_23) {
+  _mm_storeu_ps(output, sample_0);
+  _mm_storel_pi(reinterpret_cast<__m64*>(output + 4), channels_45_01);
+  _mm_storeu_ps(output + 6, sample_1);
+  _mm_storeh_pi(reinterpret_cast<__m64*>(output + 10), channels_45_01);
+  _mm_storeu_ps(output + 12, sample_2);
+  _mm_storel_pi(reinterpret_cast<__m64*>(output + 16), channels_45_23);
+  _mm_storeu_ps(output + 18, sample_3);
+  _mm_storeh_pi(reinterpret_cast<__m64*>(output + 22), channels_45_23);
+}
+
+XE_NOINLINE
+static void _sse_sequential_6_BE_to_interleaved_6_LE(
+    float* XE_RESTRICT output, const float* XE_RESTRICT input,
+    unsigned ch_sample_count) {
+  assert_true(ch_sample_count % 4 == 0);
+  const __m128i byte_swap_shuffle =
+      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  for (unsigned sample = 0; sample < ch_sample_count; sample += 4) {
+    __m128 channels[6];
+    for (unsigned channel = 0; channel < 6; channel++) {
+      channels[channel] = _mm_castsi128_ps(_mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+              &input[channel * ch_sample_count + sample])),
+          byte_swap_shuffle));
+    }
+    // Transpose the first 4 channels as a 4x4 matrix, pair the last 2.
+    _MM_TRANSPOSE4_PS(channels[0], channels[1], channels[2], channels[3]);
+    _sse_store_4_interleaved_6(&output[sample * 6], channels[0], channels[1],
+                               channels[2], channels[3],
+                               _mm_unpacklo_ps(channels[4], channels[5]),
+                               _mm_unpackhi_ps(channels[4], channels[5]));
+  }
+}
+
+XE_NOINLINE
+static void _avx2_sequential_6_BE_to_interleaved_6_LE(
+    float* XE_RESTRICT output, const float* XE_RESTRICT input,
+    unsigned ch_sample_count) {
+  assert_true(ch_sample_count % 8 == 0);
+  const __m256i byte_swap_shuffle = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8,
+      9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  for (unsigned sample = 0; sample < ch_sample_count; sample += 8) {
+    __m256 channels[6];
+    for (unsigned channel = 0; channel < 6; channel++) {
+      channels[channel] = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+              &input[channel * ch_sample_count + sample])),
+          byte_swap_shuffle));
+    }
+    // Same as the SSE version, but with samples 0...3 in the lower lanes and
+    // 4...7 in the upper lanes, as the AVX unpacks and shuffles don't cross
+    // the 128-bit lanes.
+    __m256 channels_01_01 = _mm256_unpacklo_ps(channels[0], channels[1]);
+    __m256 channels_01_23 = _mm256_unpackhi_ps(channels[0], channels[1]);
+    __m256 channels_23_01 = _mm256_unpacklo_ps(channels[2], channels[3]);
+    __m256 channels_23_23 = _mm256_unpackhi_ps(channels[2], channels[3]);
+    __m256 sample_0 = _mm256_shuffle_ps(channels_01_01, channels_23_01,
+                                        _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 sample_1 = _mm256_shuffle_ps(channels_01_01, channels_23_01,
+                                        _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 sample_2 = _mm256_shuffle_ps(channels_01_23, channels_23_23,
+                                        _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 sample_3 = _mm256_shuffle_ps(channels_01_23, channels_23_23,
+                                        _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 channels_45_01 = _mm256_unpacklo_ps(channels[4], channels[5]);
+    __m256 channels_45_23 = _mm256_unpackhi_ps(channels[4], channels[5]);
+    _sse_store_4_interleaved_6(
+        &output[sample * 6], _mm256_castps256_ps128(sample_0),
+        _mm256_castps256_ps128(sample_1), _mm256_castps256_ps128(sample_2),
+        _mm256_castps256_ps128(sample_3),
+        _mm256_castps256_ps128(channels_45_01),
+        _mm256_castps256_ps128(channels_45_23));
+    _sse_store_4_interleaved_6(
+        &output[(sample + 4) * 6], _mm256_extractf128_ps(sample_0, 1),
+        _mm256_extractf128_ps(sample_1, 1), _mm256_extractf128_ps(sample_2, 1),
+        _mm256_extractf128_ps(sample_3, 1),
+        _mm256_extractf128_ps(channels_45_01, 1),
+        _mm256_extractf128_ps(channels_45_23, 1));
+  }
+}
 
 inline static void sequential_6_BE_to_interleaved_6_LE(
     float* output, const float* input, unsigned ch_sample_count) {
-  if (amd64::GetFeatureFlags() & amd64::kX64EmitMovbe) {
+  if ((amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) &&
+      !(ch_sample_count % 8)) {
+    _avx2_sequential_6_BE_to_interleaved_6_LE(output, input, ch_sample_count);
+  } else if (!(ch_sample_count % 4)) {
+    _sse_sequential_6_BE_to_interleaved_6_LE(output, input, ch_sample_count);
+#if XE_COMPILER_CLANG_CL != 1
+  } else if (amd64::GetFeatureFlags() & amd64::kX64EmitMovbe) {
     _movbe_sequential_6_BE_to_interleaved_6_LE(output, input, ch_sample_count);
+#endif
   } else {
     _generic_sequential_6_BE_to_interleaved_6_LE(output, input,
                                                  ch_sample_count);
   }
 }
-#else
-inline static void sequential_6_BE_to_interleaved_6_LE(
-    float* output, const float* input, unsigned ch_sample_count) {
-  _generic_sequential_6_BE_to_interleaved_6_LE(output, input, ch_sample_count);
-}
-#endif
 
-inline void sequential_6_BE_to_interleaved_2_LE(float* output,
-                                                const float* input,
-                                                size_t ch_sample_count) {
+XE_NOINLINE
+static void _sse_sequential_6_BE_to_interleaved_2_LE(
+    float* XE_RESTRICT output, const float* XE_RESTRICT input,
+    size_t ch_sample_count) {
   assert_true(ch_sample_count % 4 == 0);
   const __m128i byte_swap_shuffle =
       _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
@@ -105,6 +198,66 @@ inline void sequential_6_BE_to_interleaved_2_LE(float* output,
     _mm_storeu_ps(&output[(sample + 2) * 2], _mm_unpackhi_ps(left, right));
   }
 }
+
+XE_NOINLINE
+static void _avx2_sequential_6_BE_to_interleaved_2_LE(
+    float* XE_RESTRICT output, const float* XE_RESTRICT input,
+    size_t ch_sample_count) {
+  assert_true(ch_sample_count % 8 == 0);
+  const __m256i byte_swap_shuffle = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8,
+      9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 two_fifths = _mm256_set1_ps(1.0f / 2.5f);
+
+  // Same as the SSE version, with 8 samples per iteration.
+  for (size_t sample = 0; sample < ch_sample_count; sample += 8) {
+    __m256 fl = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[0 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+    __m256 fr = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[1 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+    __m256 fc = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[2 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+    __m256 bl = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[4 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+    __m256 br = _mm256_castsi256_ps(_mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            &input[5 * ch_sample_count + sample])),
+        byte_swap_shuffle));
+
+    __m256 center_halved = _mm256_mul_ps(fc, half);
+    __m256 left = _mm256_add_ps(_mm256_add_ps(fl, bl), center_halved);
+    __m256 right = _mm256_add_ps(_mm256_add_ps(fr, br), center_halved);
+    left = _mm256_mul_ps(left, two_fifths);
+    right = _mm256_mul_ps(right, two_fifths);
+    // The unpacks give samples 0, 1, 4, 5 and 2, 3, 6, 7.
+    __m256 samples_0145 = _mm256_unpacklo_ps(left, right);
+    __m256 samples_2367 = _mm256_unpackhi_ps(left, right);
+    _mm256_storeu_ps(&output[sample * 2],
+                     _mm256_permute2f128_ps(samples_0145, samples_2367, 0x20));
+    _mm256_storeu_ps(&output[(sample + 4) * 2],
+                     _mm256_permute2f128_ps(samples_0145, samples_2367, 0x31));
+  }
+}
+
+inline void sequential_6_BE_to_interleaved_2_LE(float* output,
+                                                const float* input,
+                                                size_t ch_sample_count) {
+  if ((amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) &&
+      !(ch_sample_count % 8)) {
+    _avx2_sequential_6_BE_to_interleaved_2_LE(output, input, ch_sample_count);
+  } else {
+    _sse_sequential_6_BE_to_interleaved_2_LE(output, input, ch_sample_count);
+  }
+}
 #else
 inline void sequential_6_BE_to_interleaved_6_LE(float* output,
                                                 const float* input,
@@ -135,6 +288,28 @@ inline void sequential_6_BE_to_interleaved_2_LE(float* output,
 }
 #endif
 
+// Adds the samples of a client to the output containing the samples of other
+// clients.
+inline void mix(float* XE_RESTRICT output, const float* XE_RESTRICT input,
+                size_t sample_count) {
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  if (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) {
+    for (; i + 8 <= sample_count; i += 8) {
+      _mm256_storeu_ps(&output[i], _mm256_add_ps(_mm256_loadu_ps(&output[i]),
+                                                 _mm256_loadu_ps(&input[i])));
+    }
+  }
+  for (; i + 4 <= sample_count; i += 4) {
+    _mm_storeu_ps(&output[i], _mm_add_ps(_mm_loadu_ps(&output[i]),
+                                         _mm_loadu_ps(&input[i])));
+  }
+#endif
+  for (; i < sample_count; ++i) {
+    output[i] += input[i];
+  }
+}
+
 }  // namespace conversion
 }  // namespace apu
 }  // namespace xe
@@ -10,12 +10,11 @@
 #ifndef XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 #define XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 
-#include <mutex>
-#include <queue>
-#include <stack>
+#include <array>
+#include <memory>
 
-#include "SDL.h"
 #include "xenia/apu/audio_driver.h"
+#include "xenia/apu/audio_frame_queue.h"
 #include "xenia/base/threading.h"
 
 namespace xe {
@@ -24,30 +23,33 @@ namespace sdl {
 
 class SDLAudioDriver : public AudioDriver {
  public:
-  SDLAudioDriver(Memory* memory, xe::threading::Semaphore* semaphore);
+  static const uint32_t frame_frequency_ = 48000;
+  static const uint32_t frame_channels_ = 6;
+  static const uint32_t channel_samples_ = 256;
+  static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
+  static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
+
+  // queue_depth is the maximum number of frames submitted, but not played yet,
+  // as limited by the semaphore.
+  SDLAudioDriver(Memory* memory, xe::threading::Semaphore* semaphore,
+                 uint32_t queue_depth);
   ~SDLAudioDriver() override;
 
-  bool Initialize();
   void SubmitFrame(uint32_t frame_ptr) override;
-  void Shutdown();
 
- protected:
-  static void SDLCallback(void* userdata, Uint8* stream, int len);
+  // Called by the mixer in the SDL callback. Takes the oldest submitted frame
+  // and writes it to the interleaved output with the device channel count, or
+  // adds it to the output if accumulate is true. Returns false if no frames
+  // are queued.
+  bool MixFrame(float* output, uint8_t device_channels, bool accumulate);
 
+ private:
   xe::threading::Semaphore* semaphore_ = nullptr;
 
-  SDL_AudioDeviceID sdl_device_id_ = -1;
-  bool sdl_initialized_ = false;
-  uint8_t sdl_device_channels_ = 0;
-
-  static const uint32_t frame_frequency_ = 48000;
-  static const uint32_t frame_channels_ = 6;
-  static const uint32_t channel_samples_ = 256;
-  static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
-  static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
-  std::queue<float*> frames_queued_ = {};
-  std::stack<float*> frames_unused_ = {};
-  std::mutex frames_mutex_ = {};
+  // Written by the guest submitting the frames, read by the SDL callback.
+  std::unique_ptr<AudioFrameQueue> frame_queue_;
+  // For converting the frame before adding it to the frames of other clients.
+  std::array<float, frame_samples_> mix_frame_;
 };
 
 }  // namespace sdl
@@ -0,0 +1,142 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/sdl/sdl_audio_mixer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/apu/sdl/sdl_audio_driver.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+#include "xenia/helper/sdl/sdl_helper.h"
+
+namespace xe {
+namespace apu {
+namespace sdl {
+
+SDLAudioMixer::~SDLAudioMixer() { CloseDevice(); }
+
+bool SDLAudioMixer::AddDriver(SDLAudioDriver* driver) {
+  if (!sdl_device_id_ && !OpenDevice()) {
+    CloseDevice();
+    return false;
+  }
+  SDL_LockAudioDevice(sdl_device_id_);
+  drivers_.push_back(driver);
+  SDL_UnlockAudioDevice(sdl_device_id_);
+  if (drivers_.size() == 1) {
+    SDL_PauseAudioDevice(sdl_device_id_, 0);
+  }
+  return true;
+}
+
+void SDLAudioMixer::RemoveDriver(SDLAudioDriver* driver) {
+  auto it = std::find(drivers_.begin(), drivers_.end(), driver);
+  assert_true(it != drivers_.end());
+  if (it == drivers_.end()) {
+    return;
+  }
+  SDL_LockAudioDevice(sdl_device_id_);
+  drivers_.erase(it);
+  SDL_UnlockAudioDevice(sdl_device_id_);
+  if (drivers_.empty()) {
+    CloseDevice();
+  }
+}
+
+bool SDLAudioMixer::OpenDevice() {
+  SDL_version ver = {};
+  SDL_GetVersion(&ver);
+  if ((ver.major < 2) || (ver.major == 2 && ver.minor == 0 && ver.patch < 8)) {
+    XELOGW(
+        "SDL library version {}.{}.{} is outdated. "
+        "You may experience choppy audio.",
+        ver.major, ver.minor, ver.patch);
+  }
+
+  if (!xe::helper::sdl::SDLHelper::Prepare()) {
+    return false;
+  }
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+    return false;
+  }
+  sdl_initialized_ = true;
+
+  SDL_AudioSpec desired_spec = {};
+  SDL_AudioSpec obtained_spec;
+  desired_spec.freq = SDLAudioDriver::frame_frequency_;
+  desired_spec.format = AUDIO_F32;
+  desired_spec.channels = SDLAudioDriver::frame_channels_;
+  desired_spec.samples = SDLAudioDriver::channel_samples_;
+  desired_spec.callback = SDLCallback;
+  desired_spec.userdata = this;
+  // Allow the hardware to decide between 5.1 and stereo
+  int allowed_change = SDL_AUDIO_ALLOW_CHANNELS_CHANGE;
+  for (int i = 0; i < 2; i++) {
+    sdl_device_id_ = SDL_OpenAudioDevice(nullptr, 0, &desired_spec,
+                                         &obtained_spec, allowed_change);
+    if (!sdl_device_id_) {
+      XELOGE("SDL_OpenAudioDevice() failed.");
+      return false;
+    }
+    if (obtained_spec.channels == 2 || obtained_spec.channels == 6) {
+      break;
+    }
+    // If the system is 4 or 7.1, let SDL convert
+    allowed_change = 0;
+    SDL_CloseAudioDevice(sdl_device_id_);
+    sdl_device_id_ = 0;
+  }
+  if (!sdl_device_id_) {
+    XELOGE("Failed to get a compatible SDL Audio Device.");
+    return false;
+  }
+  sdl_device_channels_ = obtained_spec.channels;
+  return true;
+}
+
+void SDLAudioMixer::CloseDevice() {
+  if (sdl_device_id_) {
+    SDL_CloseAudioDevice(sdl_device_id_);
+    sdl_device_id_ = 0;
+  }
+  if (sdl_initialized_) {
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    sdl_initialized_ = false;
+  }
+}
+
+void SDLAudioMixer::SDLCallback(void* userdata, Uint8* stream, int len) {
+  SCOPE_profile_cpu_f("apu");
+  if (!userdata || !stream) {
+    XELOGE("SDLAudioMixer::SDLCallback called with nullptr.");
+    return;
+  }
+  const auto mixer = static_cast<SDLAudioMixer*>(userdata);
+  assert_true(len == sizeof(float) * SDLAudioDriver::channel_samples_ *
+                         mixer->sdl_device_channels_);
+
+  auto output = reinterpret_cast<float*>(stream);
+  bool output_written = false;
+  for (SDLAudioDriver* driver : mixer->drivers_) {
+    if (driver->MixFrame(output, mixer->sdl_device_channels_,
+                         output_written)) {
+      output_written = true;
+    }
+  }
+  if (!output_written) {
+    std::memset(stream, 0, len);
+  }
+}
+
+}  // namespace sdl
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_SDL_SDL_AUDIO_MIXER_H_
+#define XENIA_APU_SDL_SDL_AUDIO_MIXER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "SDL.h"
+
+namespace xe {
+namespace apu {
+namespace sdl {
+
+class SDLAudioDriver;
+
+// Plays the frames of all the audio clients through a single SDL audio device,
+// adding them together in its callback, instead of opening a device for every
+// client. This way, the conversion to the host device format and sample rate
+// is done once for the whole output, and all the clients share the same device
+// latency.
+class SDLAudioMixer {
+ public:
+  SDLAudioMixer() = default;
+  SDLAudioMixer(const SDLAudioMixer& mixer) = delete;
+  SDLAudioMixer& operator=(const SDLAudioMixer& mixer) = delete;
+  ~SDLAudioMixer();
+
+  // Opens the device when the first driver is added.
+  bool AddDriver(SDLAudioDriver* driver);
+  // Closes the device when the last driver is removed.
+  void RemoveDriver(SDLAudioDriver* driver);
+
+ private:
+  bool OpenDevice();
+  void CloseDevice();
+
+  static void SDLCallback(void* userdata, Uint8* stream, int len);
+
+  SDL_AudioDeviceID sdl_device_id_ = 0;
+  bool sdl_initialized_ = false;
+  uint8_t sdl_device_channels_ = 0;
+
+  // Modified with the device locked, so the callback doesn't see the changes
+  // while it's mixing.
+  std::vector<SDLAudioDriver*> drivers_;
+};
+
+}  // namespace sdl
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_SDL_SDL_AUDIO_MIXER_H_
@@ -31,9 +31,9 @@ X_STATUS SDLAudioSystem::CreateDriver(size_t index,
                                       xe::threading::Semaphore* semaphore,
                                       AudioDriver** out_driver) {
   assert_not_null(out_driver);
-  auto driver = new SDLAudioDriver(memory_, semaphore);
-  if (!driver->Initialize()) {
-    driver->Shutdown();
+  auto driver = new SDLAudioDriver(memory_, semaphore, queued_frames_);
+  if (!mixer_.AddDriver(driver)) {
+    delete driver;
     return X_STATUS_UNSUCCESSFUL;
   }
 
@@ -45,7 +45,7 @@ void SDLAudioSystem::DestroyDriver(AudioDriver* driver) {
   assert_not_null(driver);
   auto sdldriver = dynamic_cast<SDLAudioDriver*>(driver);
   assert_not_null(sdldriver);
-  sdldriver->Shutdown();
+  mixer_.RemoveDriver(sdldriver);
   delete sdldriver;
 }
 
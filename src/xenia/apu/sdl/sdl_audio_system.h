@@ -11,6 +11,7 @@
 #define XENIA_APU_SDL_SDL_AUDIO_SYSTEM_H_
 
 #include "xenia/apu/audio_system.h"
+#include "xenia/apu/sdl/sdl_audio_mixer.h"
 
 namespace xe {
 namespace apu {
@@ -31,6 +32,9 @@ class SDLAudioSystem : public AudioSystem {
 
  protected:
   void Initialize() override;
+
+ private:
+  SDLAudioMixer mixer_;
 };
 
 }  // namespace sdl
@@ -24,8 +24,9 @@ namespace xaudio2 {
 
 class XAudio2AudioDriver::VoiceCallback : public api::IXAudio2VoiceCallback {
  public:
-  explicit VoiceCallback(xe::threading::Semaphore* semaphore)
-      : semaphore_(semaphore) {}
+  explicit VoiceCallback(XAudio2AudioDriver* driver,
+                         xe::threading::Semaphore* semaphore)
+      : driver_(driver), semaphore_(semaphore) {}
   ~VoiceCallback() {}
 
   void OnStreamEnd() noexcept {}
@@ -35,11 +36,18 @@ class XAudio2AudioDriver::VoiceCallback : public api::IXAudio2VoiceCallback {
     auto ret = semaphore_->Release(1, nullptr);
     assert_true(ret);
   }
-  void OnBufferStart(void* context) noexcept {}
+  void OnBufferStart(void* context) noexcept {
+    uint64_t submit_host_tick =
+        driver_->frame_submit_host_ticks_[reinterpret_cast<uintptr_t>(context)];
+    driver_->OnFramePlayed(
+        uint32_t((Clock::QueryHostTickCount() - submit_host_tick) * 1000000 /
+                 Clock::QueryHostTickFrequency()));
+  }
   void OnLoopEnd(void* context) noexcept {}
   void OnVoiceError(void* context, HRESULT result) noexcept {}
 
  private:
+  XAudio2AudioDriver* driver_ = nullptr;
   xe::threading::Semaphore* semaphore_ = nullptr;
 };
 
@@ -50,7 +58,7 @@ XAudio2AudioDriver::XAudio2AudioDriver(Memory* memory,
 XAudio2AudioDriver::~XAudio2AudioDriver() = default;
 
 bool XAudio2AudioDriver::Initialize() {
-  voice_callback_ = new VoiceCallback(semaphore_);
+  voice_callback_ = new VoiceCallback(this, semaphore_);
 
   // Load the XAudio2 DLL dynamically. Needed both for 2.7 and for
   // differentiating between 2.8 and later versions. Windows 8.1 SDK references
@@ -196,6 +204,9 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
     objects_.api_2_7.pcm_voice->GetState(&state);
   }
   assert_true(state.BuffersQueued < frame_count_);
+  if (!state.BuffersQueued) {
+    OnUnderrun();
+  }
 
   auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
   auto output_frame = reinterpret_cast<float*>(frames_[current_frame_]);
@@ -214,7 +225,8 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
   buffer.LoopBegin = api::XE_XAUDIO2_NO_LOOP_REGION;
   buffer.LoopLength = 0;
   buffer.LoopCount = 0;
-  buffer.pContext = 0;
+  buffer.pContext = reinterpret_cast<void*>(uintptr_t(current_frame_));
+  frame_submit_host_ticks_[current_frame_] = Clock::QueryHostTickCount();
   if (api_minor_version_ >= 8) {
     hr = objects_.api_2_8.pcm_voice->SubmitSourceBuffer(&buffer);
   } else {
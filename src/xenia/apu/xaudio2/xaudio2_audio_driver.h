@@ -100,6 +100,8 @@ class XAudio2AudioDriver : public AudioDriver {
   static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
   static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
   float frames_[frame_count_][frame_samples_];
+  // For the latency measurement in the voice callback.
+  uint64_t frame_submit_host_ticks_[frame_count_] = {};
   uint32_t current_frame_ = 0;
 };
 
@@ -54,9 +54,11 @@ XmaContext::~XmaContext() {
   //  }
 }
 
-int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr) {
+int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr,
+                      XmaSampleCache* sample_cache) {
   id_ = id;
   memory_ = memory;
+  sample_cache_ = sample_cache;
   guest_ptr_ = guest_ptr;
 
   // Allocate ffmpeg stuff:
@@ -92,7 +94,8 @@ int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr) {
   return 0;
 }
 
-bool XmaContext::Work() {
+bool XmaContext::Work(uint32_t& decoded_frame_count_out) {
+  decoded_frame_count_out = 0;
   if (!is_enabled() || !is_allocated()) {
     return false;
   }
@@ -102,8 +105,31 @@ bool XmaContext::Work() {
 
     auto context_ptr = memory()->TranslateVirtual(guest_ptr());
     XMA_CONTEXT_DATA data(context_ptr);
+    decoded_frame_count_ = 0;
+    if (sample_cache_entry_) {
+      bool input_buffer_valid = data.current_buffer
+                                    ? data.input_buffer_1_valid
+                                    : data.input_buffer_0_valid;
+      uint32_t input_buffer_ptr = data.current_buffer
+                                      ? data.input_buffer_1_ptr
+                                      : data.input_buffer_0_ptr;
+      if (!input_buffer_valid ||
+          input_buffer_ptr != sample_cache_entry_->key.physical_address ||
+          data.input_buffer_read_offset != sample_cache_read_offset_ ||
+          data.loop_count) {
+        EndSampleCacheEntry(false);
+      }
+    }
     Decode(&data);
+    if (sample_cache_entry_) {
+      if (is_stream_done_) {
+        EndSampleCacheEntry(true);
+      } else {
+        sample_cache_read_offset_ = data.input_buffer_read_offset;
+      }
+    }
     data.Store(context_ptr);
+    decoded_frame_count_out = decoded_frame_count_;
     return true;
   }
 }
@@ -155,6 +181,7 @@ void XmaContext::Clear() {
   split_frame_len_ = 0;
   split_frame_len_partial_ = 0;
   split_frame_padding_start_ = 0;
+  EndSampleCacheEntry(false);
 
   data.Store(context_ptr);
 }
@@ -171,11 +198,13 @@ void XmaContext::Release() {
   assert_true(is_allocated_ == true);
 
   set_is_allocated(false);
+  EndSampleCacheEntry(false);
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   std::memset(context_ptr, 0, sizeof(XMA_CONTEXT_DATA));  // Zero it.
 }
 
 void XmaContext::SwapInputBuffer(XMA_CONTEXT_DATA* data) {
+  EndSampleCacheEntry(true);
   // No more frames.
   if (data->current_buffer == 0) {
     data->input_buffer_0_valid = 0;
@@ -565,6 +594,11 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
 
       PrepareDecoder(packet, data->sample_rate, bool(data->is_stereo));
 
+      if (packet_idx == 0 && frame_idx == 0 && !sample_cache_entry_) {
+        BeginSampleCacheEntry(data, uint32_t(current_input_size),
+                              is_streaming);
+      }
+
       // Current frame is split to next packet:
       bool frame_is_split = frame_last_split && (frame_idx >= frame_count - 1);
 
@@ -647,28 +681,35 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
     split_frame_len_partial_ = 0;
     split_frame_padding_start_ = 0;
 
-    auto ret = avcodec_send_packet(av_context_, av_packet_);
-    if (ret < 0) {
-      XELOGE("XmaContext {}: Error - Sending packet for decoding failed", id());
-      // TODO bail out
-      assert_always();
-    }
-    ret = avcodec_receive_frame(av_context_, av_frame_);
-    /*
-    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-      // TODO AVERROR_EOF???
-      break;
-    else
-    */
-    if (ret < 0) {
-      XELOGE("XmaContext {}: Error - Decoding failed", id());
-      data->parser_error_status = 4;  // TODO(Gliniak): Find all parsing errors
-                                      // and create enumerator from them
-      SwapInputBuffer(data);
-      assert_always();
-      return;  // TODO bail out
+    auto byte_count = kBytesPerFrameChannel << data->is_stereo;
+    const uint8_t* cached_frame = GetSampleCacheFrame(byte_count);
+    if (!cached_frame) {
+      auto ret = avcodec_send_packet(av_context_, av_packet_);
+      if (ret < 0) {
+        XELOGE("XmaContext {}: Error - Sending packet for decoding failed",
+               id());
+        // TODO bail out
+        assert_always();
+      }
+      ret = avcodec_receive_frame(av_context_, av_frame_);
+      /*
+      if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        // TODO AVERROR_EOF???
+        break;
+      else
+      */
+      if (ret < 0) {
+        XELOGE("XmaContext {}: Error - Decoding failed", id());
+        // TODO(Gliniak): Find all parsing errors and create enumerator from
+        // them
+        data->parser_error_status = 4;
+        EndSampleCacheEntry(false);
+        SwapInputBuffer(data);
+        assert_always();
+        return;  // TODO bail out
+      }
+      assert_true(ret == 0);
     }
-    assert_true(ret == 0);
 
     {
       // copy over 1 frame
@@ -680,14 +721,29 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
       // assert_true(frame_is_split == (frame_idx == -1));
 
       //			dump_raw(av_frame_, id());
-      ConvertFrame((const uint8_t**)av_frame_->data,
-                   bool(av_frame_->channels > 1), raw_frame_.data());
       // decoded_consumed_samples_ += kSamplesPerFrame;
 
-      auto byte_count = kBytesPerFrameChannel << data->is_stereo;
       assert_true(output_remaining_bytes >= byte_count);
-      output_rb.Write(raw_frame_.data(), byte_count);
+      if (cached_frame) {
+        output_rb.Write(cached_frame, byte_count);
+      } else if (output_rb.write_offset() + byte_count <=
+                 output_rb.capacity()) {
+        // Convert directly into the guest output buffer, in its big-endian
+        // format, unless the frame wraps around its end.
+        auto frame_output =
+            reinterpret_cast<uint8_t*>(output_rb.write_ptr());
+        ConvertFrame((const uint8_t**)av_frame_->data,
+                     bool(av_frame_->channels > 1), frame_output);
+        RecordSampleCacheFrame(frame_output, byte_count);
+        output_rb.AdvanceWrite(byte_count);
+      } else {
+        ConvertFrame((const uint8_t**)av_frame_->data,
+                     bool(av_frame_->channels > 1), raw_frame_.data());
+        RecordSampleCacheFrame(raw_frame_.data(), byte_count);
+        output_rb.Write(raw_frame_.data(), byte_count);
+      }
       output_remaining_bytes -= byte_count;
+      ++decoded_frame_count_;
       data->output_buffer_write_offset = output_rb.write_offset() / 256;
 
       total_samples += id_ == 0 ? kSamplesPerFrame : 0;
@@ -934,6 +990,71 @@ std::tuple<int, bool> XmaContext::GetPacketFrameCount(uint8_t* packet) {
   }
 }
 
+void XmaContext::BeginSampleCacheEntry(const XMA_CONTEXT_DATA* data,
+                                       uint32_t input_buffer_size,
+                                       bool is_streaming) {
+  // Looping and streaming don't decode the buffer once from the start to the
+  // end.
+  if (!sample_cache_ || data->loop_count || is_streaming) {
+    return;
+  }
+  uint32_t input_buffer_ptr = data->current_buffer ? data->input_buffer_1_ptr
+                                                    : data->input_buffer_0_ptr;
+  bool is_complete;
+  sample_cache_entry_ = sample_cache_->Begin(
+      input_buffer_ptr, input_buffer_size,
+      data->sample_rate | (uint32_t(data->is_stereo) << 2), is_complete);
+  sample_cache_replaying_ = is_complete;
+  sample_cache_replay_offset_ = 0;
+}
+
+const uint8_t* XmaContext::GetSampleCacheFrame(uint32_t byte_count) {
+  if (!sample_cache_replaying_) {
+    return nullptr;
+  }
+  const std::vector<uint8_t>& samples = sample_cache_entry_->samples;
+  if (sample_cache_entry_->invalidated ||
+      sample_cache_replay_offset_ + byte_count > samples.size()) {
+    // Continue by decoding, though the decoder won't have the state from the
+    // previous frames.
+    EndSampleCacheEntry(false);
+    return nullptr;
+  }
+  const uint8_t* frame = samples.data() + sample_cache_replay_offset_;
+  sample_cache_replay_offset_ += byte_count;
+  return frame;
+}
+
+void XmaContext::RecordSampleCacheFrame(const uint8_t* samples,
+                                        uint32_t byte_count) {
+  if (!sample_cache_entry_) {
+    return;
+  }
+  std::vector<uint8_t>& entry_samples = sample_cache_entry_->samples;
+  if (sample_cache_entry_->invalidated ||
+      entry_samples.size() + byte_count > sample_cache_->max_entry_size()) {
+    EndSampleCacheEntry(false);
+    return;
+  }
+  entry_samples.insert(entry_samples.end(), samples, samples + byte_count);
+}
+
+void XmaContext::EndSampleCacheEntry(bool is_complete) {
+  if (!sample_cache_entry_) {
+    return;
+  }
+  if (!sample_cache_replaying_) {
+    if (is_complete) {
+      sample_cache_->Complete(std::move(sample_cache_entry_));
+    } else {
+      sample_cache_->Abort(sample_cache_entry_);
+    }
+  }
+  sample_cache_entry_.reset();
+  sample_cache_replaying_ = false;
+  sample_cache_replay_offset_ = 0;
+}
+
 int XmaContext::PrepareDecoder(uint8_t* packet, int sample_rate,
                                bool is_two_channel) {
   // Sanity check: Packet metadata is always 1 for XMA2/0 for XMA
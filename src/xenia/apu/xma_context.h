@@ -16,6 +16,8 @@
 #include <queue>
 //#include <vector>
 
+#include "xenia/apu/xma_sample_cache.h"
+#include "xenia/base/platform.h"
 #include "xenia/memory.h"
 #include "xenia/xbox.h"
 
@@ -130,7 +132,9 @@ struct Xma2ExtraData {
 static_assert_size(Xma2ExtraData, 34);
 #pragma pack(pop)
 
-class XmaContext {
+// Aligned to a cache line, so the worker threads decoding neighboring contexts
+// don't write to the same cache lines.
+class alignas(XE_HOST_CACHE_LINE_SIZE) XmaContext {
  public:
   static const uint32_t kBytesPerPacket = 2048;
   static const uint32_t kBitsPerPacket = kBytesPerPacket * 8;
@@ -150,8 +154,12 @@ class XmaContext {
   explicit XmaContext();
   ~XmaContext();
 
-  int Setup(uint32_t id, Memory* memory, uint32_t guest_ptr);
-  bool Work();
+  // sample_cache may be null if the sample cache is disabled.
+  int Setup(uint32_t id, Memory* memory, uint32_t guest_ptr,
+            XmaSampleCache* sample_cache);
+  // Returns whether the context was decoded, with the number of the frames
+  // written to the output buffer.
+  bool Work(uint32_t& decoded_frame_count_out);
 
   void Enable();
   bool Block(bool poll);
@@ -170,7 +178,7 @@ class XmaContext {
   void set_is_enabled(bool is_enabled) { is_enabled_ = is_enabled; }
 
  private:
-  static void SwapInputBuffer(XMA_CONTEXT_DATA* data);
+  void SwapInputBuffer(XMA_CONTEXT_DATA* data);
   static bool TrySetupNextLoop(XMA_CONTEXT_DATA* data,
                                bool ignore_input_buffer_offset);
   static void NextPacket(XMA_CONTEXT_DATA* data);
@@ -196,11 +204,23 @@ class XmaContext {
   void Decode(XMA_CONTEXT_DATA* data);
   int PrepareDecoder(uint8_t* packet, int sample_rate, bool is_two_channel);
 
+  // Called when starting to decode the current input buffer from its first
+  // frame.
+  void BeginSampleCacheEntry(const XMA_CONTEXT_DATA* data,
+                             uint32_t input_buffer_size, bool is_streaming);
+  // Returns the cached samples of the next frame if replaying an entry, or
+  // nullptr if the frame needs to be decoded.
+  const uint8_t* GetSampleCacheFrame(uint32_t byte_count);
+  void RecordSampleCacheFrame(const uint8_t* samples, uint32_t byte_count);
+  // is_complete is whether the whole buffer has been decoded.
+  void EndSampleCacheEntry(bool is_complete);
+
   // This method should be used ONLY when we're at the last packet of the stream
   // and we want to find offset in next buffer
   uint32_t GetPacketFirstFrameOffset(const XMA_CONTEXT_DATA* data);
 
   Memory* memory_ = nullptr;
+  XmaSampleCache* sample_cache_ = nullptr;
 
   uint32_t id_ = 0;
   uint32_t guest_ptr_ = 0;
@@ -236,6 +256,18 @@ class XmaContext {
   // uint8_t* current_frame_ = nullptr;
   // conversion buffer for 2 channel frame
   std::array<uint8_t, kBytesPerFrameChannel * 2> raw_frame_;
+  // Frames written to the output buffer by the current Work, protected by
+  // lock_.
+  uint32_t decoded_frame_count_ = 0;
+
+  // The sample cache entry of the input buffer being decoded, either being
+  // recorded, or complete to take the samples from instead of decoding.
+  std::shared_ptr<XmaSampleCache::Entry> sample_cache_entry_;
+  bool sample_cache_replaying_ = false;
+  size_t sample_cache_replay_offset_ = 0;
+  // Where the decoding has stopped in the previous Work, to stop using the
+  // entry if the guest has changed the position.
+  uint32_t sample_cache_read_offset_ = 0;
   // std::vector<uint8_t> current_frame_ = std::vector<uint8_t>(0);
 };
 
@@ -9,10 +9,15 @@
 
 #include "xenia/apu/xma_decoder.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
 #include "xenia/apu/xma_context.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/metrics.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/ring_buffer.h"
 #include "xenia/base/string_buffer.h"
@@ -50,10 +55,24 @@ extern "C" {
 
 DEFINE_bool(ffmpeg_verbose, false, "Verbose FFmpeg output (debug and above)",
             "APU");
+DEFINE_uint32(xma_decoder_threads, 0,
+              "Number of threads decoding the kicked XMA contexts in parallel "
+              "(each context is still decoded by one thread at a time). 0 to "
+              "choose based on the number of logical processors.",
+              "APU");
 
 namespace xe {
 namespace apu {
 
+namespace {
+metrics::Counter xma_decoded_frames_metric(
+    "xenia_apu_xma_decoded_frames_total", "XMA frames decoded.");
+metrics::Histogram xma_decode_time_metric(
+    "xenia_apu_xma_decode_time_microseconds",
+    "Host time of a decoding pass over an XMA context.",
+    {50, 100, 250, 500, 1000, 2500, 5000, 10000});
+}  // namespace
+
 XmaDecoder::XmaDecoder(cpu::Processor* processor)
     : memory_(processor->memory()), processor_(processor) {}
 
@@ -127,76 +146,181 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
   register_file_[XmaRegister::ContextArrayAddress] =
       memory()->GetPhysicalAddress(context_data_first_ptr_);
 
+  if (XmaSampleCache::IsEnabled()) {
+    sample_cache_ = std::make_unique<XmaSampleCache>(*memory());
+  }
+
   // Setup XMA contexts.
   for (int i = 0; i < kContextCount; ++i) {
     uint32_t guest_ptr = context_data_first_ptr_ + i * sizeof(XMA_CONTEXT_DATA);
     XmaContext& context = contexts_[i];
-    if (context.Setup(i, memory(), guest_ptr)) {
+    if (context.Setup(i, memory(), guest_ptr, sample_cache_.get())) {
       assert_always();
     }
   }
   register_file_[XmaRegister::NextContextIndex] = 1;
   context_bitmap_.Resize(kContextCount);
 
+  uint32_t worker_count = cvars::xma_decoder_threads;
+  if (!worker_count) {
+    worker_count =
+        std::clamp(xe::threading::logical_processor_count() / 4, 1u, 4u);
+  }
   worker_running_ = true;
-  work_event_ = xe::threading::Event::CreateAutoResetEvent(false);
-  assert_not_null(work_event_);
-  worker_thread_ = kernel::object_ref<kernel::XHostThread>(
-      new kernel::XHostThread(kernel_state, 128 * 1024, 0, [this]() {
-        WorkerThreadMain();
-        return 0;
-      }));
-  worker_thread_->set_name("XMA Decoder");
-  worker_thread_->set_can_debugger_suspend(true);
-  worker_thread_->Create();
+  worker_thread_count_ = worker_count;
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    auto worker_thread = kernel::object_ref<kernel::XHostThread>(
+        new kernel::XHostThread(kernel_state, 128 * 1024, 0, [this]() {
+          WorkerThreadMain();
+          return 0;
+        }));
+    worker_thread->set_name(worker_count > 1
+                                ? fmt::format("XMA Decoder {}", i)
+                                : std::string("XMA Decoder"));
+    worker_thread->set_can_debugger_suspend(true);
+    worker_thread->Create();
+    worker_threads_.push_back(std::move(worker_thread));
+  }
 
   return X_STATUS_SUCCESS;
 }
 
 void XmaDecoder::WorkerThreadMain() {
-  uint32_t idle_loop_count = 0;
-  while (worker_running_) {
-    // Okay, let's loop through XMA contexts to find ones we need to decode!
-    bool did_work = false;
-    for (uint32_t n = 0; n < kContextCount; n++) {
-      XmaContext& context = contexts_[n];
-      did_work = context.Work() || did_work;
-
-      // TODO: Need thread safety to do this.
-      // Probably not too important though.
-      // registers_.current_context = n;
-      // registers_.next_context = (n + 1) % kContextCount;
+  // Where to continue looking for pending contexts, so the frequently kicked
+  // contexts with lower indices don't delay the ones with higher indices.
+  uint32_t claim_position = 0;
+  while (true) {
+    uint32_t context_id;
+    if (!worker_running_ || paused_ ||
+        !ClaimPendingContext(claim_position, context_id)) {
+      std::unique_lock<std::mutex> lock(work_mutex_);
+      if (!worker_running_) {
+        return;
+      }
+      if (paused_) {
+        ++workers_paused_;
+        workers_paused_cond_.notify_all();
+        work_cond_.wait(lock,
+                        [this]() { return !paused_ || !worker_running_; });
+        --workers_paused_;
+        continue;
+      }
+      if (!HasPendingContexts()) {
+        work_cond_.wait(lock);
+      }
+      continue;
     }
-
-    if (paused_) {
-      pause_fence_.Signal();
-      resume_fence_.Wait();
+    claim_position = context_id + 1;
+    auto decode_start = std::chrono::steady_clock::now();
+    uint32_t decoded_frame_count;
+    if (!contexts_[context_id].Work(decoded_frame_count)) {
+      continue;
     }
+    uint64_t decode_time_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - decode_start)
+            .count();
+    xma_decoded_frames_metric.Add(decoded_frame_count);
+    xma_decode_time_metric.Observe(decode_time_us);
+    uint64_t decode_count_total =
+        decode_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t decoded_frame_count_total =
+        decoded_frame_count_.fetch_add(decoded_frame_count,
+                                       std::memory_order_relaxed) +
+        decoded_frame_count;
+    uint64_t decode_time_us_total =
+        decode_time_us_.fetch_add(decode_time_us, std::memory_order_relaxed) +
+        decode_time_us;
+    COUNT_profile_set("apu/xma_decode_count", int64_t(decode_count_total));
+    COUNT_profile_set("apu/xma_decoded_frame_count",
+                      int64_t(decoded_frame_count_total));
+    COUNT_profile_set("apu/xma_decode_time_us", int64_t(decode_time_us_total));
+  }
+}
 
-    if (!did_work) {
-      idle_loop_count++;
-    } else {
-      idle_loop_count = 0;
-    }
-    xe::threading::Wait(work_event_.get(), false);
+XmaDecoder::Statistics XmaDecoder::GetStatistics() const {
+  Statistics statistics;
+  statistics.decode_count = decode_count_.load(std::memory_order_relaxed);
+  statistics.decoded_frame_count =
+      decoded_frame_count_.load(std::memory_order_relaxed);
+  statistics.decode_time_us = decode_time_us_.load(std::memory_order_relaxed);
+  statistics.worker_thread_count = worker_thread_count_;
+  return statistics;
+}
+
+void XmaDecoder::QueueContexts(uint32_t base_context_id,
+                               uint32_t context_bits) {
+  if (!context_bits) {
+    return;
+  }
+  uint32_t newly_pending_bits =
+      context_bits & ~pending_contexts_[base_context_id / 32].fetch_or(
+                         context_bits, std::memory_order_acq_rel);
+  if (!newly_pending_bits) {
+    return;
+  }
+  // Make sure the workers that have found no pending contexts are already
+  // waiting.
+  { std::lock_guard<std::mutex> lock(work_mutex_); }
+  if (xe::bit_count(newly_pending_bits) > 1) {
+    work_cond_.notify_all();
+  } else {
+    work_cond_.notify_one();
   }
 }
 
-void XmaDecoder::Shutdown() {
-  worker_running_ = false;
+bool XmaDecoder::ClaimPendingContext(uint32_t start_context_id,
+                                     uint32_t& context_id_out) {
+  constexpr uint32_t kWordCount = uint32_t(xe::countof(pending_contexts_));
+  start_context_id %= kContextCount;
+  uint32_t start_word_index = start_context_id / 32;
+  // The start word is checked twice, from the start context first, and then
+  // the contexts before it in the end.
+  for (uint32_t i = 0; i <= kWordCount; ++i) {
+    uint32_t word_index = (start_word_index + i) % kWordCount;
+    std::atomic<uint32_t>& word = pending_contexts_[word_index];
+    uint32_t bits = word.load(std::memory_order_acquire);
+    if (!i) {
+      bits &= ~((uint32_t(1) << (start_context_id & 31)) - 1);
+    }
+    while (bits) {
+      uint32_t bit_index = xe::tzcnt(bits);
+      uint32_t bit = uint32_t(1) << bit_index;
+      // Another worker may have taken it already.
+      if (word.fetch_and(~bit, std::memory_order_acq_rel) & bit) {
+        context_id_out = word_index * 32 + bit_index;
+        return true;
+      }
+      bits &= ~bit;
+    }
+  }
+  return false;
+}
 
-  if (work_event_) {
-    work_event_->Set();
+bool XmaDecoder::HasPendingContexts() const {
+  for (const std::atomic<uint32_t>& word : pending_contexts_) {
+    if (word.load(std::memory_order_acquire)) {
+      return true;
+    }
   }
+  return false;
+}
 
-  if (paused_) {
-    Resume();
+void XmaDecoder::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    worker_running_ = false;
+    paused_ = false;
   }
+  work_cond_.notify_all();
 
-  if (worker_thread_) {
+  for (auto& worker_thread : worker_threads_) {
     // Wait for work thread.
-    xe::threading::Wait(worker_thread_->thread(), false);
-    worker_thread_.reset();
+    xe::threading::Wait(worker_thread->thread(), false);
+  }
+  worker_threads_.clear();
+  for (std::atomic<uint32_t>& word : pending_contexts_) {
+    word.store(0, std::memory_order_relaxed);
   }
 
   if (context_data_first_ptr_) {
@@ -302,6 +426,7 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
 
     // The context ID is a bit in the range of the entire context array.
     uint32_t base_context_id = (r - XmaRegister::Context0Kick) * 32;
+    uint32_t context_bits = value;
     for (int i = 0; value && i < 32; ++i, value >>= 1) {
       if (value & 1) {
         uint32_t context_id = base_context_id + i;
@@ -309,8 +434,8 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         context.Enable();
       }
     }
-    // Signal the decoder thread to start processing.
-    work_event_->SetBoostPriority();
+    // Let the decoder threads start processing.
+    QueueContexts(base_context_id, context_bits);
   } else if (r >= XmaRegister::Context0Lock && r <= XmaRegister::Context9Lock) {
     // Context lock command.
     // This requests a lock by flagging the context.
@@ -330,6 +455,9 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
     // Context clear command.
     // This will reset the given hardware contexts.
     uint32_t base_context_id = (r - XmaRegister::Context0Clear) * 32;
+    // Drop the pending decoding from kicks before the clear.
+    pending_contexts_[base_context_id / 32].fetch_and(
+        ~value, std::memory_order_acq_rel);
     for (int i = 0; value && i < 32; ++i, value >>= 1) {
       if (value & 1) {
         uint32_t context_id = base_context_id + i;
@@ -359,21 +487,27 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
 }
 
 void XmaDecoder::Pause() {
+  std::unique_lock<std::mutex> lock(work_mutex_);
   if (paused_) {
     return;
   }
   paused_ = true;
-
-  pause_fence_.Wait();
+  work_cond_.notify_all();
+  // Wait for the decoding currently done to finish.
+  workers_paused_cond_.wait(lock, [this]() {
+    return workers_paused_ >= worker_threads_.size() || !worker_running_;
+  });
 }
 
 void XmaDecoder::Resume() {
-  if (!paused_) {
-    return;
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    if (!paused_) {
+      return;
+    }
+    paused_ = false;
   }
-  paused_ = false;
-
-  resume_fence_.Signal();
+  work_cond_.notify_all();
 }
 
 }  // namespace apu
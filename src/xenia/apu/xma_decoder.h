@@ -11,11 +11,15 @@
 #define XENIA_APU_XMA_DECODER_H_
 
 #include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include "xenia/apu/xma_context.h"
 #include "xenia/apu/xma_register_file.h"
+#include "xenia/apu/xma_sample_cache.h"
 #include "xenia/base/bit_map.h"
 #include "xenia/kernel/xthread.h"
 #include "xenia/xbox.h"
@@ -47,6 +51,16 @@ class XmaDecoder {
   uint32_t ReadRegister(uint32_t addr);
   void WriteRegister(uint32_t addr, uint32_t value);
 
+  struct Statistics {
+    uint64_t decode_count;
+    uint64_t decoded_frame_count;
+    uint64_t decode_time_us;
+    // For the utilization from the decode time.
+    uint32_t worker_thread_count;
+  };
+  // Totals since the decoder was set up, for all the worker threads.
+  Statistics GetStatistics() const;
+
   bool is_paused() const { return paused_; }
   void Pause();
   void Resume();
@@ -56,6 +70,14 @@ class XmaDecoder {
 
  private:
   void WorkerThreadMain();
+  // Marks the contexts enabled by a kick, in the 32 contexts of the kick
+  // register starting from base_context_id, as pending decoding.
+  void QueueContexts(uint32_t base_context_id, uint32_t context_bits);
+  // Takes a pending context for decoding, starting the search from
+  // start_context_id. Returns false if no contexts are pending.
+  bool ClaimPendingContext(uint32_t start_context_id,
+                           uint32_t& context_id_out);
+  bool HasPendingContexts() const;
 
   static uint32_t MMIOReadRegisterThunk(void* ppc_context, XmaDecoder* as,
                                         uint32_t addr) {
@@ -70,18 +92,38 @@ class XmaDecoder {
   Memory* memory_ = nullptr;
   cpu::Processor* processor_ = nullptr;
 
+  // The contexts are decoded by a pool of worker threads taking them from the
+  // bit set of the kicked ones, without locking. A context is pending at most
+  // once at a time, and if it's kicked again while being decoded, the next
+  // decoding waits for the context lock, so the decoding of each context stays
+  // sequential.
   std::atomic<bool> worker_running_ = {false};
-  kernel::object_ref<kernel::XHostThread> worker_thread_;
-  std::unique_ptr<xe::threading::Event> work_event_ = nullptr;
-
-  bool paused_ = false;
-  xe::threading::Fence pause_fence_;   // Signaled when worker paused.
-  xe::threading::Fence resume_fence_;  // Signaled when resume requested.
+  std::vector<kernel::object_ref<kernel::XHostThread>> worker_threads_;
+  std::mutex work_mutex_;
+  // Notified, with work_mutex_ locked before to avoid missing the wake-up, when
+  // contexts become pending, or when pausing, resuming or shutting down.
+  std::condition_variable work_cond_;
+  std::atomic<uint64_t> decode_count_ = {0};
+  std::atomic<uint64_t> decoded_frame_count_ = {0};
+  std::atomic<uint64_t> decode_time_us_ = {0};
+  // Not cleared on shutdown unlike worker_threads_, for the statistics.
+  uint32_t worker_thread_count_ = 0;
+  // Modified with work_mutex_ locked, but also checked by the workers between
+  // the contexts without locking.
+  std::atomic<bool> paused_ = {false};
+  uint32_t workers_paused_ = 0;
+  // Notified when a worker has paused.
+  std::condition_variable workers_paused_cond_;
 
   XmaRegisterFile register_file_;
 
+  // Null if disabled. Destroyed after the contexts that may hold its entries.
+  std::unique_ptr<XmaSampleCache> sample_cache_;
+
   static const uint32_t kContextCount = 320;
   XmaContext contexts_[kContextCount];
+  // One bit per context, like in the kick and clear registers.
+  std::atomic<uint32_t> pending_contexts_[kContextCount / 32] = {};
   BitMap context_bitmap_;
 
   uint32_t context_data_first_ptr_ = 0;
@@ -0,0 +1,193 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_sample_cache.h"
+
+#include <algorithm>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/xxhash.h"
+
+DEFINE_uint32(xma_sample_cache_size_mb, 32,
+              "Size of the cache of the samples decoded from XMA buffers, in "
+              "megabytes, for playing short sounds repeatedly without "
+              "decoding them every time. 0 to disable the cache.",
+              "APU");
+
+namespace xe {
+namespace apu {
+
+namespace {
+// A single buffer may take up to this fraction of the cache, longer sounds are
+// usually streamed music or speech, not played repeatedly.
+constexpr size_t kMaxEntrySizeDivisor = 8;
+}  // namespace
+
+bool XmaSampleCache::IsEnabled() {
+  return cvars::xma_sample_cache_size_mb != 0;
+}
+
+XmaSampleCache::XmaSampleCache(Memory& memory)
+    : memory_(memory),
+      max_size_(size_t(cvars::xma_sample_cache_size_mb) << 20),
+      max_entry_size_(max_size_ / kMaxEntrySizeDivisor) {}
+
+XmaSampleCache::~XmaSampleCache() {
+  if (memory_invalidation_callback_handle_) {
+    memory_.UnregisterPhysicalMemoryInvalidationCallback(
+        memory_invalidation_callback_handle_);
+    memory_invalidation_callback_handle_ = nullptr;
+  }
+}
+
+std::shared_ptr<XmaSampleCache::Entry> XmaSampleCache::Begin(
+    uint32_t physical_address, uint32_t size, uint32_t format,
+    bool& is_complete_out) {
+  is_complete_out = false;
+  // The samples are always bigger than the compressed data.
+  if (!size || size > max_entry_size_) {
+    return nullptr;
+  }
+  const uint8_t* data = memory_.TranslatePhysical(physical_address);
+  Key key;
+  key.physical_address = physical_address;
+  key.size = size;
+  key.format = format;
+  key.hash = 0;
+
+  std::shared_ptr<Entry> existing_entry;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    auto entry_map_it = entry_map_.find(key);
+    if (entry_map_it != entry_map_.end()) {
+      existing_entry = *entry_map_it->second;
+    }
+  }
+  if (existing_entry) {
+    // An entry that's still in the cache is still watched, but the memory may
+    // have been modified without triggering the watches, such as by the GPU.
+    uint64_t hash = XXH3_64bits(data, size);
+    auto global_lock = global_critical_region_.Acquire();
+    auto entry_map_it = entry_map_.find(key);
+    if (entry_map_it != entry_map_.end() &&
+        *entry_map_it->second == existing_entry &&
+        existing_entry->key.hash == hash) {
+      entries_.splice(entries_.begin(), entries_, entry_map_it->second);
+      is_complete_out = true;
+      return existing_entry;
+    }
+  }
+
+  // Record a new entry. Start watching the buffer before reading it, so
+  // modifications while hashing or decoding invalidate the new entry.
+  auto entry = std::make_shared<Entry>();
+  entry->key = key;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    if (!memory_invalidation_callback_handle_) {
+      memory_invalidation_callback_handle_ =
+          memory_.RegisterPhysicalMemoryInvalidationCallback(
+              MemoryInvalidationCallbackThunk, this);
+    }
+    recording_entries_.push_back(entry);
+  }
+  memory_.EnablePhysicalMemoryAccessCallbacks(physical_address, size, true,
+                                              false);
+  entry->key.hash = XXH3_64bits(data, size);
+  return entry;
+}
+
+void XmaSampleCache::Complete(std::shared_ptr<Entry> entry) {
+  entry->samples.shrink_to_fit();
+  auto global_lock = global_critical_region_.Acquire();
+  RemoveRecordingEntry(entry.get());
+  if (entry->invalidated || entry->samples.empty()) {
+    return;
+  }
+  auto entry_map_it = entry_map_.find(entry->key);
+  if (entry_map_it != entry_map_.end()) {
+    // Replacing an entry with outdated contents.
+    entries_size_ -= (*entry_map_it->second)->samples.size();
+    entries_.erase(entry_map_it->second);
+    entry_map_.erase(entry_map_it);
+  }
+  entries_size_ += entry->samples.size();
+  entries_.push_front(entry);
+  entry_map_.emplace(entry->key, entries_.begin());
+  EvictLeastRecentlyUsed();
+}
+
+void XmaSampleCache::Abort(const std::shared_ptr<Entry>& entry) {
+  auto global_lock = global_critical_region_.Acquire();
+  RemoveRecordingEntry(entry.get());
+}
+
+void XmaSampleCache::RemoveRecordingEntry(const Entry* entry) {
+  auto it = std::find_if(
+      recording_entries_.begin(), recording_entries_.end(),
+      [entry](const std::shared_ptr<Entry>& recording_entry) {
+        return recording_entry.get() == entry;
+      });
+  if (it != recording_entries_.end()) {
+    *it = std::move(recording_entries_.back());
+    recording_entries_.pop_back();
+  }
+}
+
+void XmaSampleCache::EvictLeastRecentlyUsed() {
+  while (entries_size_ > max_size_ && !entries_.empty()) {
+    const std::shared_ptr<Entry>& entry = entries_.back();
+    entries_size_ -= entry->samples.size();
+    entry_map_.erase(entry->key);
+    entries_.pop_back();
+  }
+}
+
+std::pair<uint32_t, uint32_t> XmaSampleCache::MemoryInvalidationCallback(
+    uint32_t physical_address_start, uint32_t length, bool exact_range) {
+  uint64_t physical_address_end = uint64_t(physical_address_start) + length;
+  auto overlaps = [physical_address_start,
+                   physical_address_end](const Entry& entry) {
+    return entry.key.physical_address < physical_address_end &&
+           uint64_t(entry.key.physical_address) + entry.key.size >
+               physical_address_start;
+  };
+  auto global_lock = global_critical_region_.Acquire();
+  // The number of the entries is limited by the size of the cache, and writes
+  // to the watched buffers are rare, so a linear search is fine.
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    Entry& entry = **it;
+    if (!overlaps(entry)) {
+      ++it;
+      continue;
+    }
+    entry.invalidated = true;
+    entries_size_ -= entry.samples.size();
+    entry_map_.erase(entry.key);
+    it = entries_.erase(it);
+  }
+  for (const std::shared_ptr<Entry>& entry : recording_entries_) {
+    if (overlaps(*entry)) {
+      entry->invalidated = true;
+    }
+  }
+  // Everything in the range has been invalidated, but other entries may be
+  // outside it in the same pages.
+  return std::make_pair(physical_address_start, length);
+}
+
+std::pair<uint32_t, uint32_t> XmaSampleCache::MemoryInvalidationCallbackThunk(
+    void* context_ptr, uint32_t physical_address_start, uint32_t length,
+    bool exact_range) {
+  return reinterpret_cast<XmaSampleCache*>(context_ptr)
+      ->MemoryInvalidationCallback(physical_address_start, length, exact_range);
+}
+
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,128 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_XMA_SAMPLE_CACHE_H_
+#define XENIA_APU_XMA_SAMPLE_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace apu {
+
+// Bounded LRU cache of the PCM samples decoded from whole XMA input buffers,
+// so short sounds played many times (footsteps, gunfire, UI sounds) are decoded
+// only once.
+//
+// A context records the converted samples of every frame while decoding an
+// input buffer sequentially from its first frame to its end, and when the same
+// buffer (at the same physical address, with the same size, format and
+// contents) is played again from the start, the samples are taken from the
+// cache in the same order instead of being decoded, with the frame parsing
+// still done to update the guest state identically.
+//
+// The cached buffers are protected from writing with physical memory watches,
+// and an entry is dropped when the guest modifies its buffer.
+class XmaSampleCache {
+ public:
+  struct Key {
+    uint32_t physical_address;
+    uint32_t size;
+    // Sample rate index and stereo flag, the samples depend on both.
+    uint32_t format;
+    uint64_t hash;
+
+    struct Hasher {
+      size_t operator()(const Key& key) const {
+        return std::hash<uint64_t>{}(
+            (uint64_t(key.physical_address) << 32 | key.size) ^
+            (uint64_t(key.format) << 61));
+      }
+    };
+    // The hash is not a part of the identity - a buffer at the same location
+    // with different contents replaces the old entry.
+    bool operator==(const Key& other_key) const {
+      return physical_address == other_key.physical_address &&
+             size == other_key.size && format == other_key.format;
+    }
+  };
+
+  struct Entry {
+    Key key;
+    // Big-endian 16-bit samples of all the frames in the decoding order.
+    std::vector<uint8_t> samples;
+    // Set when the input buffer is written to, while recording or replaying.
+    std::atomic<bool> invalidated = {false};
+  };
+
+  static bool IsEnabled();
+
+  explicit XmaSampleCache(Memory& memory);
+  XmaSampleCache(const XmaSampleCache& cache) = delete;
+  XmaSampleCache& operator=(const XmaSampleCache& cache) = delete;
+  ~XmaSampleCache();
+
+  // Maximum size of the samples of a single buffer.
+  size_t max_entry_size() const { return max_entry_size_; }
+
+  // Called when starting to decode an input buffer from its first frame.
+  // Returns the complete entry to take the samples from, with is_complete_out
+  // set to true, or a new entry to record the samples to, or nullptr if the
+  // buffer can't be cached.
+  std::shared_ptr<Entry> Begin(uint32_t physical_address, uint32_t size,
+                               uint32_t format, bool& is_complete_out);
+  // Adds an entry with all the samples decoded from its buffer to the cache,
+  // or discards it if it has been invalidated while recording.
+  void Complete(std::shared_ptr<Entry> entry);
+  // Discards an entry that has been being recorded, if the decoding of its
+  // buffer has been interrupted.
+  void Abort(const std::shared_ptr<Entry>& entry);
+
+ private:
+  void RemoveRecordingEntry(const Entry* entry);
+  void EvictLeastRecentlyUsed();
+
+  std::pair<uint32_t, uint32_t> MemoryInvalidationCallback(
+      uint32_t physical_address_start, uint32_t length, bool exact_range);
+  static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
+      void* context_ptr, uint32_t physical_address_start, uint32_t length,
+      bool exact_range);
+
+  Memory& memory_;
+  size_t max_size_;
+  size_t max_entry_size_;
+
+  // Also locked by the memory invalidation callbacks.
+  xe::global_critical_region global_critical_region_;
+  void* memory_invalidation_callback_handle_ = nullptr;
+  // Complete entries, the most recently used first.
+  std::list<std::shared_ptr<Entry>> entries_;
+  std::unordered_map<Key, std::list<std::shared_ptr<Entry>>::iterator,
+                     Key::Hasher>
+      entry_map_;
+  size_t entries_size_ = 0;
+  // Entries being recorded, not available for replaying yet, but still need to
+  // be invalidated.
+  std::vector<std::shared_ptr<Entry>> recording_entries_;
+};
+
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_XMA_SAMPLE_CACHE_H_
@@ -37,6 +37,12 @@ class Arena {
   // allocation will be leaked
   void Rewind(size_t size);
 
+  // Bytes handed out since the last Reset, including alignment padding.
+  size_t CalculateSize();
+  // Bytes of chunks ever allocated from the heap, which only grows while the
+  // arena is warming up.
+  size_t chunk_bytes_allocated() const { return chunk_bytes_allocated_; }
+
   void* CloneContents();
   template <typename T>
   void CloneContents(std::vector<T>* buffer) {
@@ -57,14 +63,47 @@ class Arena {
     size_t offset;
   };
 
-  size_t CalculateSize();
   void CloneContents(void* buffer, size_t buffer_length);
 
   size_t chunk_size_;
+  size_t chunk_bytes_allocated_ = 0;
   Chunk* head_chunk_;
   Chunk* active_chunk_;
 };
 
+// Standard library allocator for containers that don't outlive the next Reset
+// of the arena, such as scratch lists built and consumed within one frame.
+// Memory is only reclaimed by the Reset, so growing containers should be
+// reserved beforehand where the size is known.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  explicit ArenaAllocator(Arena& arena) : arena_(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    return reinterpret_cast<T*>(arena_->Alloc(sizeof(T) * n, alignof(T)));
+  }
+  void deallocate(T* p, size_t n) {}
+
+  Arena* arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena_ == other.arena();
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena_ != other.arena();
+  }
+
+ private:
+  Arena* arena_;
+};
+
 }  // namespace xe
 
 #endif  // XENIA_BASE_ARENA_H_
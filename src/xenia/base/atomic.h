@@ -11,7 +11,9 @@
 #define XENIA_BASE_ATOMIC_H_
 
 #include <cstdint>
+#include <type_traits>
 
+#include "xenia/base/byte_order.h"
 #include "xenia/base/platform.h"
 
 namespace xe {
@@ -139,6 +141,25 @@ inline bool atomic_cas(uint64_t old_value, uint64_t new_value,
                     reinterpret_cast<volatile int64_t*>(value));
 }
 
+// Raises the big-endian value to new_value unless it's already later, treating
+// the values as wrapping around, so concurrent writers of a clock never move it
+// backwards. Returns the resulting value in the host byte order.
+template <typename T>
+inline T atomic_store_max_be(T new_value, volatile T* value) {
+  static_assert(std::is_unsigned_v<T>);
+  T old_value_be = *value;
+  while (true) {
+    T old_value = byte_swap(old_value_be);
+    if (std::make_signed_t<T>(new_value - old_value) <= 0) {
+      return old_value;
+    }
+    if (atomic_cas(old_value_be, byte_swap(new_value), value)) {
+      return new_value;
+    }
+    old_value_be = *value;
+  }
+}
+
 }  // namespace xe
 
 #endif  // XENIA_BASE_ATOMIC_H_
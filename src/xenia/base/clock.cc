@@ -10,8 +10,11 @@
 #include "xenia/base/clock.h"
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/math.h"
@@ -23,6 +26,10 @@
 
 #endif
 
+#if XE_CLOCK_RAW_AVAILABLE && XE_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
 DEFINE_bool(clock_no_scaling, false,
             "Disable scaling code. Time management and locking is bypassed. "
             "Guest system time is directly pulled from host.",
@@ -56,6 +63,65 @@ using tick_mutex_type = std::mutex;
 // std::mutex tick_mutex_;
 static tick_mutex_type tick_mutex_;
 
+#if XE_CLOCK_RAW_AVAILABLE
+// 1:1 like the initial guest_tick_ratio_, until the guest tick frequency is
+// set.
+static Clock::RawGuestTickScale initial_raw_guest_tick_scale_ = {
+    Clock::host_tick_count_raw(), 0, 1, 0};
+static std::atomic<const Clock::RawGuestTickScale*> raw_guest_tick_scale_{
+    &initial_raw_guest_tick_scale_};
+// All the scales ever published, as the generated code and other threads may
+// still be using the previous ones. Guarded by tick_mutex_.
+static std::vector<std::unique_ptr<Clock::RawGuestTickScale>>
+    raw_guest_tick_scales_;
+
+inline uint64_t ApplyRawGuestTickScale(const Clock::RawGuestTickScale& scale,
+                                       uint64_t raw_tick_count) {
+  // With the TSC slightly out of sync between the host cores, the count may be
+  // behind the base sampled on another core.
+  uint64_t raw_tick_delta = raw_tick_count > scale.host_tick_base
+                                ? raw_tick_count - scale.host_tick_base
+                                : 0;
+#if XE_COMPILER_MSVC
+  uint64_t product_high;
+  uint64_t product_low =
+      _umul128(raw_tick_delta, scale.multiplier, &product_high);
+  uint64_t guest_tick_delta =
+      __shiftright128(product_low, product_high, uint8_t(scale.shift));
+#else
+  uint64_t guest_tick_delta = uint64_t(
+      (static_cast<unsigned __int128>(raw_tick_delta) * scale.multiplier) >>
+      scale.shift);
+#endif
+  return scale.guest_tick_base + guest_tick_delta;
+}
+
+// Must be called with tick_mutex_ locked.
+void PublishRawGuestTickScale(const std::pair<uint64_t, uint64_t>& ratio) {
+  auto scale = std::make_unique<Clock::RawGuestTickScale>();
+  if (cvars::clock_no_scaling) {
+    // Absolute, like the ratio applied directly to the host tick count.
+    scale->host_tick_base = 0;
+    scale->guest_tick_base = 0;
+  } else {
+    uint64_t raw_tick_count = Clock::host_tick_count_raw();
+    scale->host_tick_base = raw_tick_count;
+    scale->guest_tick_base = ApplyRawGuestTickScale(
+        *raw_guest_tick_scale_.load(std::memory_order_relaxed),
+        raw_tick_count);
+  }
+  // The largest shift keeping the multiplier below 2^63 for the precision.
+  double ratio_value = double(ratio.first) / double(ratio.second);
+  int ratio_exponent;
+  std::frexp(ratio_value, &ratio_exponent);
+  int shift = std::min(std::max(63 - ratio_exponent, 0), 63);
+  scale->multiplier = uint64_t(std::ldexp(ratio_value, shift));
+  scale->shift = uint32_t(shift);
+  raw_guest_tick_scale_.store(scale.get(), std::memory_order_release);
+  raw_guest_tick_scales_.push_back(std::move(scale));
+}
+#endif  // XE_CLOCK_RAW_AVAILABLE
+
 void RecomputeGuestTickScalar() {
   // Create a rational number with numerator (first) and denominator (second)
   auto frac =
@@ -74,11 +140,29 @@ void RecomputeGuestTickScalar() {
 
   std::lock_guard<tick_mutex_type> lock(tick_mutex_);
   guest_tick_ratio_ = frac;
+#if XE_CLOCK_RAW_AVAILABLE
+  if (cvars::clock_source_raw) {
+    PublishRawGuestTickScale(frac);
+  }
+#endif
 }
 
 // Update the guest timer for all threads.
 // Return a copy of the value so locking is reduced.
 uint64_t UpdateGuestClock() {
+#if XE_CLOCK_RAW_AVAILABLE
+  if (cvars::clock_source_raw) {
+    // No locking needed, the scale already includes the time elapsed before
+    // the last ratio change.
+    uint64_t guest_tick_count = ApplyRawGuestTickScale(
+        *raw_guest_tick_scale_.load(std::memory_order_acquire),
+        Clock::host_tick_count_raw());
+    // For inline_loadclock.
+    last_guest_tick_count_ = guest_tick_count;
+    return guest_tick_count;
+  }
+#endif
+
   uint64_t host_tick_count = Clock::QueryHostTickCount();
 
   if (cvars::clock_no_scaling) {
@@ -170,6 +254,13 @@ uint64_t Clock::QueryGuestTickCount() {
 }
 
 uint64_t* Clock::GetGuestTickCountPointer() { return &last_guest_tick_count_; }
+
+#if XE_CLOCK_RAW_AVAILABLE
+const std::atomic<const Clock::RawGuestTickScale*>*
+Clock::GetRawGuestTickScalePointer() {
+  return &raw_guest_tick_scale_;
+}
+#endif
 uint64_t Clock::QueryGuestSystemTime() {
   if (cvars::clock_no_scaling) {
     return Clock::QueryHostSystemTime();
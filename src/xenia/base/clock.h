@@ -10,6 +10,7 @@
 #ifndef XENIA_BASE_CLOCK_H_
 #define XENIA_BASE_CLOCK_H_
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 
@@ -78,6 +79,23 @@ class Clock {
   static uint64_t QueryGuestTickCount();
 
   static uint64_t* GetGuestTickCountPointer();
+
+#if XE_CLOCK_RAW_AVAILABLE
+  // Conversion of raw host ticks to guest ticks with clock_source_raw, usable
+  // without locking, and inline in the generated code:
+  // guest_tick_base + ((max(raw, host_tick_base) - host_tick_base) *
+  //                    multiplier) >> shift, with a 128-bit product.
+  // Replaced as a whole when the ratio changes, continuing from the tick count
+  // at the time of the change, and never freed.
+  struct RawGuestTickScale {
+    uint64_t host_tick_base;
+    uint64_t guest_tick_base;
+    uint64_t multiplier;
+    uint32_t shift;
+  };
+  static const std::atomic<const RawGuestTickScale*>*
+  GetRawGuestTickScalePointer();
+#endif
   // Queries the guest time, in FILETIME format, accounting for scaling.
   static uint64_t QueryGuestSystemTime();
   // Queries the milliseconds since the guest began, accounting for scaling.
@@ -0,0 +1,417 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/crypto.h"
+
+#include "xenia/base/assert.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64
+#include <immintrin.h>
+
+#include "xenia/base/platform_amd64.h"
+#endif
+
+// The base instruction set of the build doesn't include the cryptography
+// extensions, which are enabled only for the functions using them.
+#if XE_ARCH_AMD64 && !XE_COMPILER_MSVC
+#define XE_CRYPTO_TARGET_AES __attribute__((target("aes,sse4.1")))
+#define XE_CRYPTO_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#else
+#define XE_CRYPTO_TARGET_AES
+#define XE_CRYPTO_TARGET_SHA
+#endif
+
+namespace xe {
+namespace crypto {
+
+bool IsAesAccelerated() {
+#if XE_ARCH_AMD64
+  return (amd64::GetFeatureFlags() & amd64::kX64EmitAES) != 0;
+#else
+  return false;
+#endif
+}
+
+bool IsShaAccelerated() {
+#if XE_ARCH_AMD64
+  return (amd64::GetFeatureFlags() & amd64::kX64EmitSHA) != 0;
+#else
+  return false;
+#endif
+}
+
+#if XE_ARCH_AMD64
+
+namespace {
+
+XE_CRYPTO_TARGET_AES __m128i Aes128ExpandKeyStep(__m128i key,
+                                                 __m128i key_generated) {
+  key_generated = _mm_shuffle_epi32(key_generated, _MM_SHUFFLE(3, 3, 3, 3));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, key_generated);
+}
+
+XE_CRYPTO_TARGET_AES void LoadAes128EncryptionKeys(const uint8_t* round_keys,
+                                                   __m128i* keys) {
+  for (uint32_t i = 0; i < 11; ++i) {
+    keys[i] = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(round_keys + kAesBlockSize * i));
+  }
+}
+
+XE_CRYPTO_TARGET_AES void LoadAes128DecryptionKeys(const uint8_t* round_keys,
+                                                   __m128i* keys) {
+  __m128i encryption_keys[11];
+  LoadAes128EncryptionKeys(round_keys, encryption_keys);
+  keys[0] = encryption_keys[10];
+  for (uint32_t i = 1; i < 10; ++i) {
+    keys[i] = _mm_aesimc_si128(encryption_keys[10 - i]);
+  }
+  keys[10] = encryption_keys[0];
+}
+
+XE_CRYPTO_TARGET_AES __m128i Aes128EncryptBlock(const __m128i* keys,
+                                                __m128i block) {
+  block = _mm_xor_si128(block, keys[0]);
+  for (uint32_t i = 1; i < 10; ++i) {
+    block = _mm_aesenc_si128(block, keys[i]);
+  }
+  return _mm_aesenclast_si128(block, keys[10]);
+}
+
+// Decryption of blocks doesn't depend on the previous ones even in CBC, so
+// multiple blocks are decrypted at once to hide the latency of the rounds.
+constexpr size_t kAesParallelBlocks = 4;
+
+XE_CRYPTO_TARGET_AES void Aes128DecryptBlocks(const __m128i* keys,
+                                              __m128i* blocks) {
+  for (size_t i = 0; i < kAesParallelBlocks; ++i) {
+    blocks[i] = _mm_xor_si128(blocks[i], keys[0]);
+  }
+  for (uint32_t round = 1; round < 10; ++round) {
+    for (size_t i = 0; i < kAesParallelBlocks; ++i) {
+      blocks[i] = _mm_aesdec_si128(blocks[i], keys[round]);
+    }
+  }
+  for (size_t i = 0; i < kAesParallelBlocks; ++i) {
+    blocks[i] = _mm_aesdeclast_si128(blocks[i], keys[10]);
+  }
+}
+
+XE_CRYPTO_TARGET_AES __m128i Aes128DecryptBlock(const __m128i* keys,
+                                                __m128i block) {
+  block = _mm_xor_si128(block, keys[0]);
+  for (uint32_t i = 1; i < 10; ++i) {
+    block = _mm_aesdec_si128(block, keys[i]);
+  }
+  return _mm_aesdeclast_si128(block, keys[10]);
+}
+
+__m128i LoadBlock(const uint8_t* data) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+void StoreBlock(uint8_t* data, __m128i block) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(data), block);
+}
+
+}  // namespace
+
+XE_CRYPTO_TARGET_AES void Aes128ExpandKey(const uint8_t* key,
+                                          uint8_t* round_keys_out) {
+  assert_true(IsAesAccelerated());
+  __m128i keys[11];
+  keys[0] = LoadBlock(key);
+  // The round constant must be an immediate.
+#define XE_AES_128_EXPAND_KEY(i, round_constant)     \
+  keys[i] = Aes128ExpandKeyStep(                     \
+      keys[i - 1], _mm_aeskeygenassist_si128(keys[i - 1], round_constant));
+  XE_AES_128_EXPAND_KEY(1, 0x01);
+  XE_AES_128_EXPAND_KEY(2, 0x02);
+  XE_AES_128_EXPAND_KEY(3, 0x04);
+  XE_AES_128_EXPAND_KEY(4, 0x08);
+  XE_AES_128_EXPAND_KEY(5, 0x10);
+  XE_AES_128_EXPAND_KEY(6, 0x20);
+  XE_AES_128_EXPAND_KEY(7, 0x40);
+  XE_AES_128_EXPAND_KEY(8, 0x80);
+  XE_AES_128_EXPAND_KEY(9, 0x1B);
+  XE_AES_128_EXPAND_KEY(10, 0x36);
+#undef XE_AES_128_EXPAND_KEY
+  for (uint32_t i = 0; i < 11; ++i) {
+    StoreBlock(round_keys_out + kAesBlockSize * i, keys[i]);
+  }
+}
+
+XE_CRYPTO_TARGET_AES void Aes128EncryptEcb(const uint8_t* round_keys,
+                                           const uint8_t* in, uint8_t* out,
+                                           size_t block_count) {
+  assert_true(IsAesAccelerated());
+  __m128i keys[11];
+  LoadAes128EncryptionKeys(round_keys, keys);
+  for (size_t i = 0; i < block_count; ++i) {
+    StoreBlock(out, Aes128EncryptBlock(keys, LoadBlock(in)));
+    in += kAesBlockSize;
+    out += kAesBlockSize;
+  }
+}
+
+XE_CRYPTO_TARGET_AES void Aes128DecryptEcb(const uint8_t* round_keys,
+                                           const uint8_t* in, uint8_t* out,
+                                           size_t block_count) {
+  assert_true(IsAesAccelerated());
+  __m128i keys[11];
+  LoadAes128DecryptionKeys(round_keys, keys);
+  for (; block_count >= kAesParallelBlocks;
+       block_count -= kAesParallelBlocks) {
+    __m128i blocks[kAesParallelBlocks];
+    for (size_t i = 0; i < kAesParallelBlocks; ++i) {
+      blocks[i] = LoadBlock(in + kAesBlockSize * i);
+    }
+    Aes128DecryptBlocks(keys, blocks);
+    for (size_t i = 0; i < kAesParallelBlocks; ++i) {
+      StoreBlock(out + kAesBlockSize * i, blocks[i]);
+    }
+    in += kAesBlockSize * kAesParallelBlocks;
+    out += kAesBlockSize * kAesParallelBlocks;
+  }
+  for (; block_count; --block_count) {
+    StoreBlock(out, Aes128DecryptBlock(keys, LoadBlock(in)));
+    in += kAesBlockSize;
+    out += kAesBlockSize;
+  }
+}
+
+XE_CRYPTO_TARGET_AES void Aes128EncryptCbc(const uint8_t* round_keys,
+                                           const uint8_t* in, uint8_t* out,
+                                           size_t block_count, uint8_t* feed) {
+  assert_true(IsAesAccelerated());
+  __m128i keys[11];
+  LoadAes128EncryptionKeys(round_keys, keys);
+  __m128i chain = LoadBlock(feed);
+  for (size_t i = 0; i < block_count; ++i) {
+    chain = Aes128EncryptBlock(keys, _mm_xor_si128(chain, LoadBlock(in)));
+    StoreBlock(out, chain);
+    in += kAesBlockSize;
+    out += kAesBlockSize;
+  }
+  StoreBlock(feed, chain);
+}
+
+XE_CRYPTO_TARGET_AES void Aes128DecryptCbc(const uint8_t* round_keys,
+                                           const uint8_t* in, uint8_t* out,
+                                           size_t block_count, uint8_t* feed) {
+  assert_true(IsAesAccelerated());
+  __m128i keys[11];
+  LoadAes128DecryptionKeys(round_keys, keys);
+  __m128i chain = LoadBlock(feed);
+  for (; block_count >= kAesParallelBlocks;
+       block_count -= kAesParallelBlocks) {
+    // Loading all the ciphertext before storing in case in == out.
+    __m128i ciphertext[kAesParallelBlocks], blocks[kAesParallelBlocks];
+    for (size_t i = 0; i < kAesParallelBlocks; ++i) {
+      ciphertext[i] = LoadBlock(in + kAesBlockSize * i);
+      blocks[i] = ciphertext[i];
+    }
+    Aes128DecryptBlocks(keys, blocks);
+    for (size_t i = 0; i < kAesParallelBlocks; ++i) {
+      StoreBlock(out + kAesBlockSize * i, _mm_xor_si128(blocks[i], chain));
+      chain = ciphertext[i];
+    }
+    in += kAesBlockSize * kAesParallelBlocks;
+    out += kAesBlockSize * kAesParallelBlocks;
+  }
+  for (; block_count; --block_count) {
+    __m128i ciphertext = LoadBlock(in);
+    StoreBlock(out,
+               _mm_xor_si128(Aes128DecryptBlock(keys, ciphertext), chain));
+    chain = ciphertext;
+    in += kAesBlockSize;
+    out += kAesBlockSize;
+  }
+  StoreBlock(feed, chain);
+}
+
+XE_CRYPTO_TARGET_SHA void Sha1ProcessBlocks(uint32_t* state,
+                                            const uint8_t* data,
+                                            size_t block_count) {
+  assert_true(IsShaAccelerated());
+  // Big-endian message words, in the reverse order like the state.
+  const __m128i byte_order_mask =
+      _mm_set_epi64x(0x0001020304050607, 0x08090A0B0C0D0E0F);
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+  __m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+  for (; block_count; --block_count) {
+    __m128i abcd_saved = abcd;
+    __m128i e0_saved = e0;
+    __m128i e1;
+    __m128i messages[4];
+    // Each group of 4 rounds consumes 4 message words, and prepares the
+    // following ones in parts over the next groups of rounds.
+#define XE_SHA1_ROUNDS(group, function, e_used, e_next)                       \
+  {                                                                           \
+    __m128i& message = messages[(group) % 4];                                 \
+    if ((group) < 4) {                                                        \
+      message = _mm_shuffle_epi8(                                             \
+          LoadBlock(data + sizeof(__m128i) * (group)), byte_order_mask);      \
+    }                                                                         \
+    if (group) {                                                              \
+      e_used = _mm_sha1nexte_epu32(e_used, message);                          \
+    } else {                                                                  \
+      e_used = _mm_add_epi32(e_used, message);                                \
+    }                                                                         \
+    e_next = abcd;                                                            \
+    if ((group) >= 3 && (group) <= 18) {                                      \
+      messages[((group) + 1) % 4] =                                           \
+          _mm_sha1msg2_epu32(messages[((group) + 1) % 4], message);           \
+    }                                                                         \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_used, function);                       \
+    if ((group) >= 1 && (group) <= 16) {                                      \
+      messages[((group) + 3) % 4] =                                           \
+          _mm_sha1msg1_epu32(messages[((group) + 3) % 4], message);           \
+    }                                                                         \
+    if ((group) >= 2 && (group) <= 17) {                                      \
+      messages[((group) + 2) % 4] =                                           \
+          _mm_xor_si128(messages[((group) + 2) % 4], message);                \
+    }                                                                         \
+  }
+    XE_SHA1_ROUNDS(0, 0, e0, e1);
+    XE_SHA1_ROUNDS(1, 0, e1, e0);
+    XE_SHA1_ROUNDS(2, 0, e0, e1);
+    XE_SHA1_ROUNDS(3, 0, e1, e0);
+    XE_SHA1_ROUNDS(4, 0, e0, e1);
+    XE_SHA1_ROUNDS(5, 1, e1, e0);
+    XE_SHA1_ROUNDS(6, 1, e0, e1);
+    XE_SHA1_ROUNDS(7, 1, e1, e0);
+    XE_SHA1_ROUNDS(8, 1, e0, e1);
+    XE_SHA1_ROUNDS(9, 1, e1, e0);
+    XE_SHA1_ROUNDS(10, 2, e0, e1);
+    XE_SHA1_ROUNDS(11, 2, e1, e0);
+    XE_SHA1_ROUNDS(12, 2, e0, e1);
+    XE_SHA1_ROUNDS(13, 2, e1, e0);
+    XE_SHA1_ROUNDS(14, 2, e0, e1);
+    XE_SHA1_ROUNDS(15, 3, e1, e0);
+    XE_SHA1_ROUNDS(16, 3, e0, e1);
+    XE_SHA1_ROUNDS(17, 3, e1, e0);
+    XE_SHA1_ROUNDS(18, 3, e0, e1);
+    XE_SHA1_ROUNDS(19, 3, e1, e0);
+#undef XE_SHA1_ROUNDS
+    e0 = _mm_sha1nexte_epu32(e0, e0_saved);
+    abcd = _mm_add_epi32(abcd, abcd_saved);
+    data += kShaBlockSize;
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = uint32_t(_mm_extract_epi32(e0, 3));
+}
+
+XE_CRYPTO_TARGET_SHA void Sha256ProcessBlocks(uint32_t* state,
+                                              const uint8_t* data,
+                                              size_t block_count) {
+  assert_true(IsShaAccelerated());
+  alignas(16) static const uint32_t kRoundConstants[64] = {
+      0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1,
+      0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+      0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786,
+      0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+      0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+      0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+      0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B,
+      0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+      0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A,
+      0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+      0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+  };
+  // Big-endian message words.
+  const __m128i byte_order_mask =
+      _mm_set_epi64x(0x0C0D0E0F08090A0B, 0x0405060700010203);
+  // The rounds instruction takes the state as ABEF and CDGH.
+  __m128i state_cdab = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+  __m128i state_efgh = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+  __m128i abef = _mm_alignr_epi8(state_cdab, state_efgh, 8);
+  __m128i cdgh = _mm_blend_epi16(state_efgh, state_cdab, 0xF0);
+  for (; block_count; --block_count) {
+    __m128i abef_saved = abef;
+    __m128i cdgh_saved = cdgh;
+    __m128i messages[4];
+    for (uint32_t group = 0; group < 16; ++group) {
+      __m128i& message = messages[group % 4];
+      if (group < 4) {
+        message = _mm_shuffle_epi8(LoadBlock(data + sizeof(__m128i) * group),
+                                   byte_order_mask);
+      }
+      __m128i message_constants = _mm_add_epi32(
+          message, _mm_load_si128(reinterpret_cast<const __m128i*>(
+                       kRoundConstants + 4 * group)));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message_constants);
+      if (group >= 3 && group <= 14) {
+        __m128i& message_next = messages[(group + 1) % 4];
+        message_next = _mm_add_epi32(
+            message_next,
+            _mm_alignr_epi8(message, messages[(group + 3) % 4], 4));
+        message_next = _mm_sha256msg2_epu32(message_next, message);
+      }
+      abef = _mm_sha256rnds2_epu32(
+          abef, cdgh, _mm_shuffle_epi32(message_constants, 0x0E));
+      if (group >= 1 && group <= 12) {
+        __m128i& message_previous = messages[(group + 3) % 4];
+        message_previous = _mm_sha256msg1_epu32(message_previous, message);
+      }
+    }
+    abef = _mm_add_epi32(abef, abef_saved);
+    cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+    data += kShaBlockSize;
+  }
+  __m128i state_feba = _mm_shuffle_epi32(abef, 0x1B);
+  __m128i state_dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_blend_epi16(state_feba, state_dchg, 0xF0));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4),
+                   _mm_alignr_epi8(state_dchg, state_feba, 8));
+}
+
+#else
+
+void Aes128ExpandKey(const uint8_t* key, uint8_t* round_keys_out) {
+  assert_always();
+}
+void Aes128EncryptEcb(const uint8_t* round_keys, const uint8_t* in,
+                      uint8_t* out, size_t block_count) {
+  assert_always();
+}
+void Aes128DecryptEcb(const uint8_t* round_keys, const uint8_t* in,
+                      uint8_t* out, size_t block_count) {
+  assert_always();
+}
+void Aes128EncryptCbc(const uint8_t* round_keys, const uint8_t* in,
+                      uint8_t* out, size_t block_count, uint8_t* feed) {
+  assert_always();
+}
+void Aes128DecryptCbc(const uint8_t* round_keys, const uint8_t* in,
+                      uint8_t* out, size_t block_count, uint8_t* feed) {
+  assert_always();
+}
+void Sha1ProcessBlocks(uint32_t* state, const uint8_t* data,
+                       size_t block_count) {
+  assert_always();
+}
+void Sha256ProcessBlocks(uint32_t* state, const uint8_t* data,
+                         size_t block_count) {
+  assert_always();
+}
+
+#endif  // XE_ARCH_AMD64
+
+}  // namespace crypto
+}  // namespace xe
@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_CRYPTO_H_
+#define XENIA_BASE_CRYPTO_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xe {
+namespace crypto {
+
+// Implementations of the cryptographic primitives using the host instructions
+// for them, for the hot paths of the guest cryptography functions, which keep
+// the portable implementations for the hosts without them. The functions for
+// an algorithm may be called only if it's reported as accelerated.
+
+// AES-NI on x86-64. Requires amd64::InitFeatureFlags to have been called.
+bool IsAesAccelerated();
+// SHA-1 and SHA-256 with the SHA extensions on x86-64. Requires
+// amd64::InitFeatureFlags to have been called.
+bool IsShaAccelerated();
+
+constexpr size_t kAesBlockSize = 16;
+constexpr size_t kAes128RoundKeysSize = kAesBlockSize * 11;
+
+// The round keys are the FIPS-197 key schedule for encryption, the decryption
+// round keys are derived from them internally. In and out may be the same, and
+// in CBC, the feed (initialization vector) is updated for continuing the chain.
+void Aes128ExpandKey(const uint8_t* key, uint8_t* round_keys_out);
+void Aes128EncryptEcb(const uint8_t* round_keys, const uint8_t* in,
+                      uint8_t* out, size_t block_count);
+void Aes128DecryptEcb(const uint8_t* round_keys, const uint8_t* in,
+                      uint8_t* out, size_t block_count);
+void Aes128EncryptCbc(const uint8_t* round_keys, const uint8_t* in,
+                      uint8_t* out, size_t block_count, uint8_t* feed);
+void Aes128DecryptCbc(const uint8_t* round_keys, const uint8_t* in,
+                      uint8_t* out, size_t block_count, uint8_t* feed);
+
+constexpr size_t kShaBlockSize = 64;
+
+// Update the host-endian hash state with whole 64-byte message blocks, without
+// the padding done on finalization.
+void Sha1ProcessBlocks(uint32_t* state, const uint8_t* data,
+                       size_t block_count);
+void Sha256ProcessBlocks(uint32_t* state, const uint8_t* data,
+                         size_t block_count);
+
+}  // namespace crypto
+}  // namespace xe
+
+#endif  // XENIA_BASE_CRYPTO_H_
@@ -0,0 +1,212 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/device_profile.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+
+#if XE_PLATFORM_WIN32
+#include "xenia/base/platform_win.h"
+#else
+#include <unistd.h>
+#endif
+
+#if XE_PLATFORM_ANDROID
+#include <dlfcn.h>
+
+#include "xenia/base/main_android.h"
+#endif
+
+DEFINE_string(device_profile, "auto",
+              "Resource budgets for the host device.\n"
+              " auto: low_memory if the physical memory is below "
+              "device_profile_low_memory_threshold_mb, desktop otherwise.\n"
+              " desktop: Use the configured limits as they are.\n"
+              " low_memory: Halve the texture cache memory limits, cap the "
+              "draw resolution scale at 2x, and create fewer worker threads "
+              "when their count is chosen automatically.",
+              "General");
+DEFINE_uint32(device_profile_low_memory_threshold_mb, 6144,
+              "Physical memory size (in megabytes) below which the auto "
+              "device_profile chooses low_memory.",
+              "General");
+DEFINE_bool(thermal_throttling, true,
+            "When the OS reports that the device is overheating (currently on "
+            "Android 11 and newer), pause some of the background worker "
+            "threads, and lower the draw resolution scale with "
+            "draw_resolution_scale_dynamic, before the OS throttles the whole "
+            "process.",
+            "General");
+
+namespace xe {
+namespace device_profile {
+
+namespace {
+std::atomic<ThermalStatus> thermal_status = {ThermalStatus::kNone};
+}  // namespace
+
+uint64_t GetPhysicalMemorySize() {
+#if XE_PLATFORM_WIN32
+  MEMORYSTATUSEX memory_status;
+  memory_status.dwLength = sizeof(memory_status);
+  if (!GlobalMemoryStatusEx(&memory_status)) {
+    return 0;
+  }
+  return memory_status.ullTotalPhys;
+#else
+  long page_count = sysconf(_SC_PHYS_PAGES);
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_count <= 0 || page_size <= 0) {
+    return 0;
+  }
+  return uint64_t(page_count) * uint64_t(page_size);
+#endif
+}
+
+bool IsLowMemory() {
+  static const bool is_low_memory = []() {
+    if (cvars::device_profile == "low_memory") {
+      return true;
+    }
+    if (cvars::device_profile != "auto") {
+      if (cvars::device_profile != "desktop") {
+        XELOGW("Unknown device_profile {}, using desktop",
+               cvars::device_profile);
+      }
+      return false;
+    }
+    uint64_t physical_memory_size = GetPhysicalMemorySize();
+    bool is_low = physical_memory_size &&
+                  physical_memory_size <
+                      (uint64_t(cvars::device_profile_low_memory_threshold_mb)
+                       << 20);
+    if (is_low) {
+      XELOGI("Using the low memory device profile with {} MB of memory",
+             physical_memory_size >> 20);
+    }
+    return is_low;
+  }();
+  return is_low_memory;
+}
+
+ThermalStatus GetThermalStatus() {
+  return thermal_status.load(std::memory_order_relaxed);
+}
+
+void SetThermalStatus(ThermalStatus status) {
+  ThermalStatus old_status =
+      thermal_status.exchange(status, std::memory_order_relaxed);
+  if (old_status != status) {
+    XELOGI("Host thermal status changed from {} to {}", uint32_t(old_status),
+           uint32_t(status));
+  }
+}
+
+uint32_t GetAllowedWorkerCount(uint32_t worker_count) {
+  if (!cvars::thermal_throttling) {
+    return worker_count;
+  }
+  ThermalStatus status = GetThermalStatus();
+  if (status >= ThermalStatus::kSevere) {
+    return std::min(worker_count, uint32_t(1));
+  }
+  if (status >= ThermalStatus::kModerate) {
+    return std::max(worker_count / 2, std::min(worker_count, uint32_t(1)));
+  }
+  return worker_count;
+}
+
+#if XE_PLATFORM_ANDROID
+namespace {
+// The thermal API of libandroid, API 30+, loaded dynamically as the minimum
+// supported API level is lower.
+struct AThermalManager;
+typedef void (*AThermal_StatusCallback)(void* data, int32_t status);
+void* libandroid_ = nullptr;
+AThermalManager* (*android_AThermal_acquireManager_)();
+void (*android_AThermal_releaseManager_)(AThermalManager* manager);
+int32_t (*android_AThermal_getCurrentThermalStatus_)(AThermalManager* manager);
+int (*android_AThermal_registerThermalStatusListener_)(
+    AThermalManager* manager, AThermal_StatusCallback callback, void* data);
+int (*android_AThermal_unregisterThermalStatusListener_)(
+    AThermalManager* manager, AThermal_StatusCallback callback, void* data);
+AThermalManager* android_thermal_manager_ = nullptr;
+
+void AndroidThermalStatusCallback(void* data, int32_t status) {
+  SetThermalStatus(ThermalStatus(
+      std::clamp(status, int32_t(ThermalStatus::kNone),
+                 int32_t(ThermalStatus::kShutdown))));
+}
+}  // namespace
+
+void AndroidInitialize() {
+  if (!cvars::thermal_throttling || xe::GetAndroidApiLevel() < 30) {
+    return;
+  }
+  libandroid_ = dlopen("libandroid.so", RTLD_NOW);
+  if (!libandroid_) {
+    return;
+  }
+  bool functions_loaded = true;
+#define XE_DEVICE_PROFILE_LOAD_ANDROID_FUNCTION(name)                  \
+  functions_loaded &= (android_##name##_ = reinterpret_cast<decltype( \
+                           android_##name##_)>(dlsym(libandroid_,     \
+                                                     #name))) != nullptr;
+  XE_DEVICE_PROFILE_LOAD_ANDROID_FUNCTION(AThermal_acquireManager);
+  XE_DEVICE_PROFILE_LOAD_ANDROID_FUNCTION(AThermal_releaseManager);
+  XE_DEVICE_PROFILE_LOAD_ANDROID_FUNCTION(AThermal_getCurrentThermalStatus);
+  XE_DEVICE_PROFILE_LOAD_ANDROID_FUNCTION(
+      AThermal_registerThermalStatusListener);
+  XE_DEVICE_PROFILE_LOAD_ANDROID_FUNCTION(
+      AThermal_unregisterThermalStatusListener);
+#undef XE_DEVICE_PROFILE_LOAD_ANDROID_FUNCTION
+  if (functions_loaded) {
+    android_thermal_manager_ = android_AThermal_acquireManager_();
+  }
+  if (!android_thermal_manager_) {
+    XELOGW("Failed to get the Android thermal manager");
+    AndroidShutdown();
+    return;
+  }
+  AndroidThermalStatusCallback(
+      nullptr,
+      android_AThermal_getCurrentThermalStatus_(android_thermal_manager_));
+  if (android_AThermal_registerThermalStatusListener_(
+          android_thermal_manager_, AndroidThermalStatusCallback, nullptr)) {
+    XELOGW("Failed to register the Android thermal status listener");
+    AndroidShutdown();
+  }
+}
+
+void AndroidShutdown() {
+  if (android_thermal_manager_) {
+    android_AThermal_unregisterThermalStatusListener_(
+        android_thermal_manager_, AndroidThermalStatusCallback, nullptr);
+    android_AThermal_releaseManager_(android_thermal_manager_);
+    android_thermal_manager_ = nullptr;
+  }
+  android_AThermal_acquireManager_ = nullptr;
+  android_AThermal_releaseManager_ = nullptr;
+  android_AThermal_getCurrentThermalStatus_ = nullptr;
+  android_AThermal_registerThermalStatusListener_ = nullptr;
+  android_AThermal_unregisterThermalStatusListener_ = nullptr;
+  if (libandroid_) {
+    dlclose(libandroid_);
+    libandroid_ = nullptr;
+  }
+  thermal_status.store(ThermalStatus::kNone, std::memory_order_relaxed);
+}
+#endif  // XE_PLATFORM_ANDROID
+
+}  // namespace device_profile
+}  // namespace xe
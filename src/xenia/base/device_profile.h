@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_DEVICE_PROFILE_H_
+#define XENIA_BASE_DEVICE_PROFILE_H_
+
+#include <cstdint>
+
+#include "xenia/base/platform.h"
+
+namespace xe {
+namespace device_profile {
+
+// Resource budgets for the host device, so the defaults sized for desktops
+// don't exhaust the memory of phones and other devices with little RAM, and
+// the background work reduced when the OS reports that the device is
+// overheating, before it throttles the whole process.
+
+// The values of the Android AThermalStatus.
+enum class ThermalStatus : uint32_t {
+  kNone,
+  kLight,
+  kModerate,
+  kSevere,
+  kCritical,
+  kEmergency,
+  kShutdown,
+};
+
+// 0 if unknown.
+uint64_t GetPhysicalMemorySize();
+
+// Whether the smaller memory budgets should be used, from the configuration or
+// the physical memory size.
+bool IsLowMemory();
+
+ThermalStatus GetThermalStatus();
+// Called by the platform thermal status listeners.
+void SetThermalStatus(ThermalStatus status);
+
+// Number of the background worker threads, out of worker_count created, that
+// may keep working with the current thermal status. Always at least 1 so the
+// queued work is completed.
+uint32_t GetAllowedWorkerCount(uint32_t worker_count);
+
+#if XE_PLATFORM_ANDROID
+void AndroidInitialize();
+void AndroidShutdown();
+#endif
+
+}  // namespace device_profile
+}  // namespace xe
+
+#endif  // XENIA_BASE_DEVICE_PROFILE_H_
@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_EPOCH_READERS_H_
+#define XENIA_BASE_EPOCH_READERS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "xenia/base/platform.h"
+
+namespace xe {
+
+// Tracking of the lock-free readers of a structure, so a writer can wait until
+// no reader may still be using what it has removed before freeing it. Readers
+// only increment and decrement a counter in a shard of their own, and the
+// writer advances the epoch and waits for the counters of the previous epoch
+// parity to drain. The writers must be serialized externally.
+class EpochReaders {
+ public:
+  // Returns the token to pass to EndRead. The loads done before EndRead will
+  // not see anything removed before a WaitForReaders that returned, and
+  // WaitForReaders called after removing something doesn't return until the
+  // reads that may have seen it end.
+  uint32_t BeginRead() {
+    static std::atomic<uint32_t> next_shard_index = {0};
+    thread_local uint32_t shard_index =
+        next_shard_index.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+    std::atomic<uint32_t>* counts = shards_[shard_index].counts;
+    uint32_t epoch_parity = epoch_.load(std::memory_order_seq_cst) & 1;
+    while (true) {
+      counts[epoch_parity].fetch_add(1, std::memory_order_seq_cst);
+      // The writer may have advanced the epoch and checked the counter between
+      // loading the epoch and incrementing the counter, in which case the
+      // reader has not been waited for, and it has to be counted in the new
+      // epoch.
+      uint32_t new_epoch_parity = epoch_.load(std::memory_order_seq_cst) & 1;
+      if (new_epoch_parity == epoch_parity) {
+        break;
+      }
+      counts[epoch_parity].fetch_sub(1, std::memory_order_release);
+      epoch_parity = new_epoch_parity;
+    }
+    return (shard_index << 1) | epoch_parity;
+  }
+
+  void EndRead(uint32_t token) {
+    shards_[token >> 1].counts[token & 1].fetch_sub(1,
+                                                    std::memory_order_release);
+  }
+
+  // Waits for the reads that may have seen the state before the call.
+  void WaitForReaders() {
+    // The reads started after this will see the new epoch, and also what has
+    // been removed.
+    uint32_t old_epoch_parity =
+        epoch_.fetch_add(1, std::memory_order_seq_cst) & 1;
+    for (Shard& shard : shards_) {
+      while (shard.counts[old_epoch_parity].load(std::memory_order_seq_cst)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t kShardCount = 16;
+  struct alignas(XE_HOST_CACHE_LINE_SIZE) Shard {
+    std::atomic<uint32_t> counts[2] = {};
+  };
+
+  std::atomic<uint32_t> epoch_ = {0};
+  Shard shards_[kShardCount];
+};
+
+}  // namespace xe
+
+#endif  // XENIA_BASE_EPOCH_READERS_H_
@@ -226,6 +226,11 @@ class ExceptionHandler {
 
   // Uninstalls a previously-installed exception handler.
   static void Uninstall(Handler fn, void* data);
+
+  // Number of exceptions the installed handlers have been called for, whether
+  // handled or not, for finding frequent exceptions (such as from write
+  // watches or MMIO) slowing down the emulation.
+  static uint64_t invocation_count();
 };
 
 }  // namespace xe
@@ -11,6 +11,7 @@
 
 #include <signal.h>
 #include <ucontext.h>
+#include <atomic>
 #include <cstdint>
 
 #include "xenia/base/assert.h"
@@ -34,6 +35,8 @@ constexpr size_t kMaxHandlerCount = 8;
 // Executed in order.
 std::pair<ExceptionHandler::Handler, void*> handlers_[kMaxHandlerCount];
 
+std::atomic<uint64_t> invocation_count_{0};
+
 static void ExceptionHandlerCallback(int signal_number, siginfo_t* signal_info,
                                      void* signal_context) {
   mcontext_t& mcontext =
@@ -160,6 +163,7 @@ static void ExceptionHandlerCallback(int signal_number, siginfo_t* signal_info,
       assert_unhandled_case(signal_number);
   }
 
+  invocation_count_.fetch_add(1, std::memory_order_relaxed);
   for (size_t i = 0; i < xe::countof(handlers_) && handlers_[i].first; ++i) {
     if (handlers_[i].first(&ex, handlers_[i].second)) {
       // Exception handled.
@@ -224,6 +228,10 @@ static void ExceptionHandlerCallback(int signal_number, siginfo_t* signal_info,
   }
 }
 
+uint64_t ExceptionHandler::invocation_count() {
+  return invocation_count_.load(std::memory_order_relaxed);
+}
+
 void ExceptionHandler::Install(Handler fn, void* data) {
   if (!signal_handlers_installed_) {
     struct sigaction signal_handler;
@@ -9,6 +9,8 @@
 
 #include "xenia/base/exception_handler.h"
 
+#include <atomic>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/math.h"
 #include "xenia/base/platform_win.h"
@@ -29,6 +31,8 @@ constexpr size_t kMaxHandlerCount = 8;
 // Executed in order.
 std::pair<ExceptionHandler::Handler, void*> handlers_[kMaxHandlerCount];
 
+std::atomic<uint64_t> invocation_count_{0};
+
 LONG CALLBACK ExceptionHandlerCallback(PEXCEPTION_POINTERS ex_info) {
   // Visual Studio SetThreadName.
   if (ex_info->ExceptionRecord->ExceptionCode == 0x406D1388) {
@@ -75,6 +79,7 @@ LONG CALLBACK ExceptionHandlerCallback(PEXCEPTION_POINTERS ex_info) {
       return EXCEPTION_CONTINUE_SEARCH;
   }
 
+  invocation_count_.fetch_add(1, std::memory_order_relaxed);
   for (size_t i = 0; i < xe::countof(handlers_) && handlers_[i].first; ++i) {
     if (handlers_[i].first(&ex, handlers_[i].second)) {
       // Exception handled.
@@ -104,6 +109,10 @@ LONG CALLBACK ExceptionHandlerCallback(PEXCEPTION_POINTERS ex_info) {
   return EXCEPTION_CONTINUE_SEARCH;
 }
 
+uint64_t ExceptionHandler::invocation_count() {
+  return invocation_count_.load(std::memory_order_relaxed);
+}
+
 void ExceptionHandler::Install(Handler fn, void* data) {
   if (!veh_handle_) {
     veh_handle_ = AddVectoredExceptionHandler(1, ExceptionHandlerCallback);
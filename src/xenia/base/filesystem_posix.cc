@@ -189,6 +189,11 @@ std::unique_ptr<FileHandle> FileHandle::OpenExisting(
     // TODO(benvanik): pick correct response.
     return nullptr;
   }
+  if (!(open_access & (O_WRONLY | O_RDWR))) {
+    // Read-only files are mostly game data loaded in big chunks, let the OS
+    // read further ahead.
+    posix_fadvise(handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
   return std::make_unique<PosixFileHandle>(path, handle);
 }
 
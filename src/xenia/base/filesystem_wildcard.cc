@@ -100,7 +100,16 @@ void WildcardEngine::SetRule(const std::string_view pattern) {
 }
 
 bool WildcardEngine::Match(const std::string_view str) const {
-  std::string str_lc = utf8::lower_ascii(str);
+  // Match-all patterns such as * are common for enumerating directories.
+  if (rules_.empty()) {
+    return true;
+  }
+  // Reusing the buffer as this is done for every file in a directory.
+  thread_local std::string str_lc;
+  str_lc.assign(str);
+  std::transform(str_lc.begin(), str_lc.end(), str_lc.begin(), [](char c) {
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+  });
   std::string::size_type offset(0);
   for (const auto& rule : rules_) {
     if (!(rule.Check(str_lc, &offset))) {
@@ -193,9 +193,14 @@ std::unique_ptr<FileHandle> FileHandle::OpenExisting(
   DWORD share_mode = FILE_SHARE_READ | FILE_SHARE_WRITE;
   // We assume we've already created the file in the caller.
   DWORD creation_disposition = OPEN_EXISTING;
-  HANDLE handle = CreateFileW(
-      path.c_str(), open_access, share_mode, nullptr, creation_disposition,
-      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+  DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS;
+  if (!(open_access & (GENERIC_WRITE | FILE_WRITE_DATA | FILE_APPEND_DATA))) {
+    // Read-only files are mostly game data loaded in big chunks, let the OS
+    // read further ahead.
+    flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+  }
+  HANDLE handle = CreateFileW(path.c_str(), open_access, share_mode, nullptr,
+                              creation_disposition, flags, nullptr);
   if (handle == INVALID_HANDLE_VALUE) {
     // TODO(benvanik): pick correct response.
     return nullptr;
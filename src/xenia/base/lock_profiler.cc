@@ -0,0 +1,251 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/lock_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/metrics.h"
+#include "xenia/base/profiling.h"
+#include "xenia/base/threading.h"
+
+DEFINE_bool(profile_global_lock, false,
+            "Record the wait and the hold times of the global critical region "
+            "for every site acquiring it, logged as a table sorted by the wait "
+            "time on exit.",
+            "General");
+
+namespace xe {
+namespace lock_profiler {
+
+namespace internal {
+bool is_enabled = false;
+std::atomic<uint64_t> contended_count = {0};
+}  // namespace internal
+
+namespace {
+
+metrics::CounterFunction contended_metric(
+    "xenia_global_lock_contended_total",
+    "Acquisitions of the global critical region that waited for another "
+    "thread.",
+    GetContendedCount);
+
+// Up to this number of sites is logged.
+constexpr size_t kReportSiteCount = 32;
+
+struct SiteKey {
+  const char* file;
+  uint32_t line;
+  bool operator==(const SiteKey& other) const {
+    return file == other.file && line == other.line;
+  }
+  struct Hasher {
+    size_t operator()(const SiteKey& key) const {
+      return std::hash<const void*>()(key.file) ^ (size_t(key.line) << 1);
+    }
+  };
+};
+
+struct SiteStats {
+  uint64_t acquisition_count = 0;
+  uint64_t contended_count = 0;
+  uint64_t wait_ns = 0;
+  uint64_t max_wait_ns = 0;
+  uint64_t hold_ns = 0;
+  uint64_t max_hold_ns = 0;
+
+  void Add(const SiteStats& other) {
+    acquisition_count += other.acquisition_count;
+    contended_count += other.contended_count;
+    wait_ns += other.wait_ns;
+    max_wait_ns = std::max(max_wait_ns, other.max_wait_ns);
+    hold_ns += other.hold_ns;
+    max_hold_ns = std::max(max_hold_ns, other.max_hold_ns);
+  }
+};
+
+struct ThreadStats {
+  uint32_t thread_id = 0;
+
+  // Accessed only by the owning thread.
+  uint32_t lock_depth = 0;
+  SiteKey next_site = {};
+  SiteKey held_site = {};
+  uint64_t hold_start_ns = 0;
+
+  // Locked by the owning thread when updating, and by the report.
+  std::mutex sites_mutex;
+  std::unordered_map<SiteKey, SiteStats, SiteKey::Hasher> sites;
+};
+
+std::mutex threads_mutex;
+// Never freed, so the statistics of the threads that have exited are kept.
+std::vector<std::unique_ptr<ThreadStats>> threads;
+
+std::atomic<uint64_t> total_wait_ns = {0};
+std::atomic<uint64_t> total_hold_ns = {0};
+std::atomic<uint64_t> total_contended_count = {0};
+
+ThreadStats& GetThreadStats() {
+  thread_local ThreadStats* thread_stats = nullptr;
+  if (!thread_stats) {
+    auto new_thread_stats = std::make_unique<ThreadStats>();
+    new_thread_stats->thread_id = threading::current_thread_system_id();
+    thread_stats = new_thread_stats.get();
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    threads.push_back(std::move(new_thread_stats));
+  }
+  return *thread_stats;
+}
+
+}  // namespace
+
+void Initialize() { internal::is_enabled = cvars::profile_global_lock; }
+
+void internal::SetNextSite(const char* file, uint32_t line) {
+  ThreadStats& thread_stats = GetThreadStats();
+  // Only the outermost acquisition of the recursive lock is attributed.
+  if (!thread_stats.lock_depth) {
+    thread_stats.next_site = {file, line};
+  }
+}
+
+uint64_t GetTimeNs() {
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count());
+}
+
+void OnAcquired(uint64_t wait_ns, bool contended) {
+  ThreadStats& thread_stats = GetThreadStats();
+  if (thread_stats.lock_depth++) {
+    return;
+  }
+  thread_stats.held_site = thread_stats.next_site;
+  thread_stats.next_site = {};
+  thread_stats.hold_start_ns = GetTimeNs();
+  {
+    std::lock_guard<std::mutex> lock(thread_stats.sites_mutex);
+    SiteStats& site_stats = thread_stats.sites[thread_stats.held_site];
+    ++site_stats.acquisition_count;
+    if (contended) {
+      ++site_stats.contended_count;
+    }
+    site_stats.wait_ns += wait_ns;
+    site_stats.max_wait_ns = std::max(site_stats.max_wait_ns, wait_ns);
+  }
+  if (contended) {
+    COUNT_profile_set(
+        "base/global_lock_wait_us",
+        int64_t((total_wait_ns.fetch_add(wait_ns, std::memory_order_relaxed) +
+                 wait_ns) /
+                1000));
+    COUNT_profile_set(
+        "base/global_lock_contended_count",
+        int64_t(total_contended_count.fetch_add(1, std::memory_order_relaxed) +
+                1));
+  }
+}
+
+void OnReleasing() {
+  ThreadStats& thread_stats = GetThreadStats();
+  // May be unbalanced if the profiling was enabled while the lock was held.
+  if (!thread_stats.lock_depth || --thread_stats.lock_depth) {
+    return;
+  }
+  uint64_t hold_ns = GetTimeNs() - thread_stats.hold_start_ns;
+  {
+    std::lock_guard<std::mutex> lock(thread_stats.sites_mutex);
+    SiteStats& site_stats = thread_stats.sites[thread_stats.held_site];
+    site_stats.hold_ns += hold_ns;
+    site_stats.max_hold_ns = std::max(site_stats.max_hold_ns, hold_ns);
+  }
+  COUNT_profile_set(
+      "base/global_lock_hold_us",
+      int64_t((total_hold_ns.fetch_add(hold_ns, std::memory_order_relaxed) +
+               hold_ns) /
+              1000));
+}
+
+void LogReport() {
+  if (!IsEnabled()) {
+    return;
+  }
+
+  struct ReportSite {
+    std::string location;
+    SiteStats stats;
+    // The thread that has waited the longest at the site.
+    uint32_t top_thread_id = 0;
+    uint64_t top_thread_wait_ns = 0;
+  };
+  // The same file may have different name pointers in different translation
+  // units, so merging by the location string.
+  std::unordered_map<std::string, ReportSite> report_sites;
+  {
+    std::lock_guard<std::mutex> threads_lock(threads_mutex);
+    for (const std::unique_ptr<ThreadStats>& thread_stats : threads) {
+      std::lock_guard<std::mutex> sites_lock(thread_stats->sites_mutex);
+      for (const auto& site : thread_stats->sites) {
+        std::string location =
+            site.first.file
+                ? fmt::format("{}:{}", site.first.file, site.first.line)
+                : std::string("<unknown>");
+        ReportSite& report_site = report_sites[location];
+        report_site.stats.Add(site.second);
+        if (site.second.wait_ns >= report_site.top_thread_wait_ns) {
+          report_site.top_thread_id = thread_stats->thread_id;
+          report_site.top_thread_wait_ns = site.second.wait_ns;
+        }
+      }
+      thread_stats->sites.clear();
+    }
+  }
+
+  std::vector<ReportSite*> sorted_sites;
+  sorted_sites.reserve(report_sites.size());
+  for (auto& report_site : report_sites) {
+    report_site.second.location = report_site.first;
+    sorted_sites.push_back(&report_site.second);
+  }
+  std::sort(sorted_sites.begin(), sorted_sites.end(),
+            [](const ReportSite* a, const ReportSite* b) {
+              return a->stats.wait_ns > b->stats.wait_ns;
+            });
+
+  XELOGI("Global critical region contention ({} sites):", sorted_sites.size());
+  XELOGI(
+      "  wait ms  max wait us  hold ms  max hold us  acquisitions  contended  "
+      "top waiter  site");
+  for (size_t i = 0; i < std::min(sorted_sites.size(), kReportSiteCount);
+       ++i) {
+    const ReportSite& site = *sorted_sites[i];
+    XELOGI("{:9.3f} {:12} {:8.3f} {:12} {:13} {:10} {:11}  {}",
+           site.stats.wait_ns / 1000000.0, site.stats.max_wait_ns / 1000,
+           site.stats.hold_ns / 1000000.0, site.stats.max_hold_ns / 1000,
+           site.stats.acquisition_count, site.stats.contended_count,
+           site.top_thread_id, site.location);
+  }
+}
+
+}  // namespace lock_profiler
+}  // namespace xe
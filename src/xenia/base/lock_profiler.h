@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_LOCK_PROFILER_H_
+#define XENIA_BASE_LOCK_PROFILER_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "xenia/base/platform.h"
+
+// The location of the code acquiring a lock, captured by default arguments.
+#if defined(__clang__) || defined(__GNUC__) || \
+    (defined(_MSC_VER) && _MSC_VER >= 1926)
+#define XE_LOCK_SITE_PARAMETERS                  \
+  const char* lock_site_file = __builtin_FILE(), \
+  uint32_t lock_site_line = __builtin_LINE()
+#else
+#define XE_LOCK_SITE_PARAMETERS \
+  const char* lock_site_file = nullptr, uint32_t lock_site_line = 0
+#endif
+
+namespace xe {
+namespace lock_profiler {
+
+// Records how long the global critical region is waited for and held, for
+// every location where it's acquired and every thread acquiring it, to find
+// the sites limiting the scaling across the guest threads.
+namespace internal {
+extern bool is_enabled;
+extern std::atomic<uint64_t> contended_count;
+void SetNextSite(const char* file, uint32_t line);
+}  // namespace internal
+
+inline bool IsEnabled() { return internal::is_enabled; }
+
+// The acquisitions that had to wait for another thread are counted even with
+// the profiling disabled, as they're already on the slow path.
+inline void OnContended() {
+  internal::contended_count.fetch_add(1, std::memory_order_relaxed);
+}
+inline uint64_t GetContendedCount() {
+  return internal::contended_count.load(std::memory_order_relaxed);
+}
+
+// Enables the profiling if configured. Called once at startup.
+void Initialize();
+
+// Called before acquiring the lock, to attribute the wait and the hold to the
+// caller. The acquisitions without a site specified are attributed to an
+// unknown site.
+inline void SetNextSite(const char* file, uint32_t line) {
+  if (XE_UNLIKELY(IsEnabled())) {
+    internal::SetNextSite(file, line);
+  }
+}
+
+// Called by the profiled mutex, only when profiling is enabled. The wait time
+// is 0 if the lock was acquired without waiting.
+void OnAcquired(uint64_t wait_ns, bool contended);
+void OnReleasing();
+uint64_t GetTimeNs();
+
+// Logs the sites sorted by the total wait time, and resets the statistics.
+void LogReport();
+
+}  // namespace lock_profiler
+}  // namespace xe
+
+#endif  // XENIA_BASE_LOCK_PROFILER_H_
@@ -43,6 +43,7 @@
 #include "xenia/base/platform_win.h"
 #endif  // XE_PLATFORM
 
+#include "third_party/fmt/include/fmt/args.h"
 #include "third_party/fmt/include/fmt/format.h"
 
 #if XE_PLATFORM_ANDROID
@@ -56,6 +57,12 @@ DEFINE_bool(log_to_debugprint, false, "Dump the log to DebugPrint.", "Logging");
 DEFINE_bool(flush_log, true, "Flush log file after each log line batch.",
             "Logging");
 
+DEFINE_bool(log_deferred_formatting, false,
+            "Store the arguments of the log lines in the log buffer and format "
+            "them on the logging thread, making verbose logging cheaper for "
+            "the logging threads.",
+            "Logging");
+
 DEFINE_uint32(log_mask, 0,
               "Disables specific categorizes for more granular debug logging. "
               "Kernel = 1, Apu = 2, Cpu = 4.",
@@ -78,13 +85,107 @@ Logger* logger_ = nullptr;
 struct LogLine {
   size_t buffer_length;
   uint32_t thread_id;
-  uint16_t _pad_0;  // (2b) padding
+  // Whether the buffer is a deferred formatting record.
+  bool deferred;
+  uint8_t _pad_0;  // (1b) padding
   bool terminate;
   char prefix_char;
 };
 
 thread_local char thread_log_buffer_[64_KiB];
 
+namespace {
+
+class DeferredLogRecordReader {
+ public:
+  DeferredLogRecordReader(const uint8_t* data, size_t size)
+      : position_(data), end_(data + size) {}
+
+  template <typename T>
+  bool Read(T& value) {
+    if (size_t(end_ - position_) < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, position_, sizeof(T));
+    position_ += sizeof(T);
+    return true;
+  }
+  bool ReadString(std::string_view& str) {
+    uint32_t length;
+    if (!Read(length) || size_t(end_ - position_) < length) {
+      return false;
+    }
+    str = std::string_view(reinterpret_cast<const char*>(position_), length);
+    position_ += length;
+    return true;
+  }
+
+ private:
+  const uint8_t* position_;
+  const uint8_t* end_;
+};
+
+// Returns false if the record is malformed.
+bool FormatDeferredLogRecord(const uint8_t* data, size_t size,
+                             fmt::memory_buffer& out) {
+  using logging::internal::DeferredLogArgType;
+  DeferredLogRecordReader reader(data, size);
+  std::string_view format;
+  uint8_t arg_count;
+  if (!reader.ReadString(format) || !reader.Read(arg_count)) {
+    return false;
+  }
+  fmt::dynamic_format_arg_store<fmt::format_context> args;
+  args.reserve(arg_count, 0);
+  for (uint8_t i = 0; i < arg_count; ++i) {
+    DeferredLogArgType type;
+    if (!reader.Read(type)) {
+      return false;
+    }
+    bool read = false;
+    switch (type) {
+#define XE_DEFERRED_LOG_ARG(type_name, value_type) \
+  case DeferredLogArgType::type_name: {            \
+    value_type value;                              \
+    read = reader.Read(value);                     \
+    args.push_back(value);                         \
+  } break;
+      XE_DEFERRED_LOG_ARG(kBool, bool)
+      XE_DEFERRED_LOG_ARG(kChar, char)
+      XE_DEFERRED_LOG_ARG(kInt32, int32_t)
+      XE_DEFERRED_LOG_ARG(kUInt32, uint32_t)
+      XE_DEFERRED_LOG_ARG(kInt64, int64_t)
+      XE_DEFERRED_LOG_ARG(kUInt64, uint64_t)
+      XE_DEFERRED_LOG_ARG(kFloat, float)
+      XE_DEFERRED_LOG_ARG(kDouble, double)
+#undef XE_DEFERRED_LOG_ARG
+      case DeferredLogArgType::kPointer: {
+        uint64_t value;
+        read = reader.Read(value);
+        args.push_back(reinterpret_cast<const void*>(uintptr_t(value)));
+      } break;
+      case DeferredLogArgType::kString: {
+        // The string is in the record, which outlives the formatting.
+        std::string_view value;
+        read = reader.ReadString(value);
+        args.push_back(value);
+      } break;
+    }
+    if (!read) {
+      return false;
+    }
+  }
+  try {
+    fmt::vformat_to(std::back_inserter(out), format, args);
+  } catch (const fmt::format_error&) {
+    out.clear();
+    fmt::format_to(std::back_inserter(out), "Invalid log format: {}", format);
+  }
+  return true;
+}
+
+}  // namespace
+
 FileLogSink::~FileLogSink() {
   if (file_) {
     fflush(file_);
@@ -285,6 +386,8 @@ class Logger {
     dp::sequence_t last_sequence = -1;
 
     size_t desired_count = 1;
+    std::vector<uint8_t> deferred_record;
+    fmt::memory_buffer deferred_text;
     while (true) {
       // We want one block to find out how many blocks we need or we know how
       // many blocks needed for at least one log line.
@@ -336,7 +439,27 @@ class Logger {
             Write(prefix, sizeof(prefix) - 1);
           }
 
-          if (line.buffer_length) {
+          if (line.deferred) {
+            // Format into a contiguous buffer, the record may be split in the
+            // ring buffer.
+            deferred_record.resize(line.buffer_length);
+            rb.Read(deferred_record.data(), line.buffer_length);
+            deferred_text.clear();
+            if (!FormatDeferredLogRecord(deferred_record.data(),
+                                         deferred_record.size(),
+                                         deferred_text)) {
+              deferred_text.clear();
+              const char kMalformed[] = "Malformed deferred log record";
+              deferred_text.append(kMalformed,
+                                   kMalformed + sizeof(kMalformed) - 1);
+            }
+            Write(deferred_text.data(), deferred_text.size());
+            if (!deferred_text.size() ||
+                deferred_text.data()[deferred_text.size() - 1] != '\n') {
+              const char suffix[1] = {'\n'};
+              Write(suffix, 1);
+            }
+          } else if (line.buffer_length) {
             // Get access to the line data - which may be split in the ring
             // buffer - and write it out in parts.
             auto line_range = rb.BeginRead(line.buffer_length);
@@ -405,7 +528,7 @@ class Logger {
  public:
   void AppendLine(uint32_t thread_id, const char prefix_char,
                   const char* buffer_data, size_t buffer_length,
-                  bool terminate = false) {
+                  bool terminate = false, bool deferred = false) {
     size_t count = BlockCount(sizeof(LogLine) + buffer_length);
 
     auto range = claim_strategy_.claim(count);
@@ -420,6 +543,7 @@ class Logger {
     line.thread_id = thread_id;
     line.prefix_char = prefix_char;
     line.terminate = terminate;
+    line.deferred = deferred;
 
     rb.Write(&line, sizeof(LogLine));
     if (buffer_length) {
@@ -496,6 +620,21 @@ void logging::internal::AppendLogLine(LogLevel log_level,
                       thread_log_buffer_, written);
 }
 
+bool logging::internal::ShouldDeferFormatting() {
+  return cvars::log_deferred_formatting;
+}
+
+XE_NOALIAS
+void logging::internal::AppendDeferredLogLine(LogLevel log_level,
+                                              const char prefix_char,
+                                              size_t written) {
+  if (!logger_ || !ShouldLog(log_level) || !written) {
+    return;
+  }
+  logger_->AppendLine(xe::threading::current_thread_id(), prefix_char,
+                      thread_log_buffer_, written, false, true);
+}
+
 void logging::AppendLogLine(LogLevel log_level, const char prefix_char,
                             const std::string_view str, uint32_t log_mask) {
   if (!internal::ShouldLog(log_level, log_mask) || !str.size()) {
@@ -12,7 +12,10 @@
 
 #include <cstdarg>
 #include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/string.h"
@@ -90,6 +93,118 @@ std::pair<char*, size_t> GetThreadBuffer();
 XE_NOALIAS
 void AppendLogLine(LogLevel log_level, const char prefix_char, size_t written);
 
+// With log_deferred_formatting, lines with only arguments of the basic types
+// are stored in the log ring buffer as a binary record of the format string
+// and the raw arguments, and formatted by the logging writer thread:
+// uint32_t format length, format, uint8_t argument count, and for each
+// argument, a DeferredLogArgType followed by the value, or for strings, a
+// uint32_t length and the characters.
+enum class DeferredLogArgType : uint8_t {
+  kBool,
+  kChar,
+  kInt32,
+  kUInt32,
+  kInt64,
+  kUInt64,
+  kFloat,
+  kDouble,
+  kPointer,
+  kString,
+};
+
+template <typename T, typename D = std::decay_t<T>>
+constexpr bool kIsDeferredLogArg =
+    (std::is_arithmetic_v<D> && !std::is_same_v<D, long double>) ||
+    std::is_same_v<D, const char*> || std::is_same_v<D, char*> ||
+    std::is_same_v<D, const void*> || std::is_same_v<D, void*> ||
+    std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>;
+
+class DeferredLogRecordWriter {
+ public:
+  DeferredLogRecordWriter(char* buffer, size_t buffer_size)
+      : position_(buffer), end_(buffer + buffer_size) {}
+
+  // Returns 0 if the record doesn't fit in the buffer.
+  template <typename... Args>
+  size_t WriteRecord(const char* format, const Args&... args) {
+    char* begin = position_;
+    WriteString(format);
+    uint8_t arg_count = uint8_t(sizeof...(args));
+    WriteBytes(&arg_count, sizeof(arg_count));
+    (WriteArg(args), ...);
+    return overflow_ ? 0 : size_t(position_ - begin);
+  }
+
+ private:
+  void WriteBytes(const void* data, size_t size) {
+    if (overflow_ || size_t(end_ - position_) < size) {
+      overflow_ = true;
+      return;
+    }
+    std::memcpy(position_, data, size);
+    position_ += size;
+  }
+  template <typename T>
+  void WriteValue(DeferredLogArgType type, T value) {
+    WriteBytes(&type, sizeof(type));
+    WriteBytes(&value, sizeof(value));
+  }
+  void WriteString(std::string_view str) {
+    uint32_t length = uint32_t(str.size());
+    WriteBytes(&length, sizeof(length));
+    WriteBytes(str.data(), length);
+  }
+
+  template <typename T>
+  void WriteArg(const T& arg) {
+    using D = std::decay_t<T>;
+    if constexpr (std::is_same_v<D, bool>) {
+      WriteValue(DeferredLogArgType::kBool, arg);
+    } else if constexpr (std::is_same_v<D, char>) {
+      WriteValue(DeferredLogArgType::kChar, arg);
+    } else if constexpr (std::is_integral_v<D>) {
+      // Like {fmt}, formatting the narrower integers as 32-bit.
+      if constexpr (std::is_signed_v<D>) {
+        if constexpr (sizeof(D) <= sizeof(int32_t)) {
+          WriteValue(DeferredLogArgType::kInt32, int32_t(arg));
+        } else {
+          WriteValue(DeferredLogArgType::kInt64, int64_t(arg));
+        }
+      } else {
+        if constexpr (sizeof(D) <= sizeof(uint32_t)) {
+          WriteValue(DeferredLogArgType::kUInt32, uint32_t(arg));
+        } else {
+          WriteValue(DeferredLogArgType::kUInt64, uint64_t(arg));
+        }
+      }
+    } else if constexpr (std::is_same_v<D, float>) {
+      WriteValue(DeferredLogArgType::kFloat, arg);
+    } else if constexpr (std::is_same_v<D, double>) {
+      WriteValue(DeferredLogArgType::kDouble, arg);
+    } else if constexpr (std::is_same_v<D, const char*> ||
+                         std::is_same_v<D, char*>) {
+      DeferredLogArgType type = DeferredLogArgType::kString;
+      WriteBytes(&type, sizeof(type));
+      WriteString(arg ? std::string_view(arg) : std::string_view());
+    } else if constexpr (std::is_pointer_v<D>) {
+      WriteValue(DeferredLogArgType::kPointer, uint64_t(uintptr_t(arg)));
+    } else {
+      DeferredLogArgType type = DeferredLogArgType::kString;
+      WriteBytes(&type, sizeof(type));
+      WriteString(std::string_view(arg));
+    }
+  }
+
+  char* position_;
+  char* end_;
+  bool overflow_ = false;
+};
+
+bool ShouldDeferFormatting();
+XE_NOALIAS
+void AppendDeferredLogLine(LogLevel log_level, const char prefix_char,
+                           size_t written);
+
 }  // namespace internal
 // technically, noalias is incorrect here, these functions do in fact alias
 // global memory, but msvc will not optimize the calls away, and the global
@@ -100,6 +215,17 @@ XE_NOALIAS XE_NOINLINE XE_COLD static void AppendLogLineFormat_Impl(
     LogLevel log_level, const char prefix_char, const char* format,
     const Args&... args) {
   auto target = internal::GetThreadBuffer();
+  if constexpr ((internal::kIsDeferredLogArg<Args> && ...)) {
+    if (internal::ShouldDeferFormatting()) {
+      size_t written =
+          internal::DeferredLogRecordWriter(target.first, target.second)
+              .WriteRecord(format, args...);
+      if (written) {
+        internal::AppendDeferredLogLine(log_level, prefix_char, written);
+        return;
+      }
+    }
+  }
   auto result = fmt::format_to_n(target.first, target.second, format, args...);
   internal::AppendLogLine(log_level, prefix_char, result.size);
 }
@@ -16,6 +16,7 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/device_profile.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
@@ -112,6 +113,8 @@ void InitializeAndroidAppFromMainThread(int32_t api_level,
 
   xe::memory::AndroidInitialize();
 
+  xe::device_profile::AndroidInitialize();
+
   if (android_application_context_) {
     if (!xe::InitializeAndroidSystemForApplicationContext()) {
       __android_log_write(ANDROID_LOG_ERROR,
@@ -134,6 +137,8 @@ void ShutdownAndroidAppFromMainThread() {
 
   xe::ShutdownAndroidSystem();
 
+  xe::device_profile::AndroidShutdown();
+
   xe::memory::AndroidShutdown();
 
   xe::ShutdownLogging();
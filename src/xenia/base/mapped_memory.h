@@ -59,6 +59,10 @@ class MappedMemory {
   // Changes the offset inside the file. This will update data() and size()!
   virtual bool Remap(size_t offset, size_t length) { return false; }
 
+  // Asks the OS to start reading the range from the file in the background, so
+  // accessing it later doesn't have to wait for the storage device.
+  void Prefetch(size_t offset, size_t length);
+
  protected:
   void* data_;
   size_t size_;
@@ -13,9 +13,11 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <algorithm>
 #include <memory>
 
 #include "xenia/base/filesystem.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/platform.h"
 
 namespace xe {
@@ -87,6 +89,21 @@ class PosixMappedMemory : public MappedMemory {
   int file_descriptor_;
 };
 
+void MappedMemory::Prefetch(size_t offset, size_t length) {
+  if (!data_ || offset >= size_) {
+    return;
+  }
+  length = std::min(length, size_ - offset);
+  if (!length) {
+    return;
+  }
+  // madvise requires a page-aligned start.
+  uintptr_t page_mask = uintptr_t(memory::page_size()) - 1;
+  uintptr_t start = (uintptr_t(data_) + offset) & ~page_mask;
+  uintptr_t end = uintptr_t(data_) + offset + length;
+  madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+}
+
 std::unique_ptr<MappedMemory> MappedMemory::Open(
     const std::filesystem::path& path, Mode mode, size_t offset,
     size_t length) {
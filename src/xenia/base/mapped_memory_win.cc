@@ -7,6 +7,7 @@
  ******************************************************************************
  */
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -101,6 +102,20 @@ class Win32MappedMemory : public MappedMemory {
   DWORD view_access_ = 0;
 };
 
+void MappedMemory::Prefetch(size_t offset, size_t length) {
+  if (!data_ || offset >= size_) {
+    return;
+  }
+  length = std::min(length, size_ - offset);
+  if (!length) {
+    return;
+  }
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = data() + offset;
+  range.NumberOfBytes = length;
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
 std::unique_ptr<MappedMemory> MappedMemory::Open(
     const std::filesystem::path& path, Mode mode, size_t offset,
     size_t length) {
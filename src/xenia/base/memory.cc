@@ -10,6 +10,7 @@
 #include "xenia/base/memory.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/platform.h"
 
 #if XE_ARCH_ARM64
@@ -17,6 +18,7 @@
 #endif
 
 #include <algorithm>
+#include <cstring>
 
 DEFINE_bool(
     writable_executable_memory, true,
@@ -270,8 +272,17 @@ void copy_and_swap_16_unaligned(void* dest_ptr, const void* src_ptr,
       _mm_set_epi8(0x0E, 0x0F, 0x0C, 0x0D, 0x0A, 0x0B, 0x08, 0x09, 0x06, 0x07,
                    0x04, 0x05, 0x02, 0x03, 0x00, 0x01);
 
-  size_t i;
-  for (i = 0; i + 8 <= count; i += 8) {
+  size_t i = 0;
+  if (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) {
+    __m256i shufmask256 = _mm256_broadcastsi128_si256(shufmask);
+    for (; i + 16 <= count; i += 16) {
+      __m256i input =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+      __m256i output = _mm256_shuffle_epi8(input, shufmask256);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dest[i]), output);
+    }
+  }
+  for (; i + 8 <= count; i += 8) {
     __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output = _mm_shuffle_epi8(input, shufmask);
     _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i]), output);
@@ -405,8 +416,17 @@ void copy_and_swap_64_unaligned(void* dest_ptr, const void* src_ptr,
       _mm_set_epi8(0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x00, 0x01,
                    0x02, 0x03, 0x04, 0x05, 0x06, 0x07);
 
-  size_t i;
-  for (i = 0; i + 2 <= count; i += 2) {
+  size_t i = 0;
+  if (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) {
+    __m256i shufmask256 = _mm256_broadcastsi128_si256(shufmask);
+    for (; i + 4 <= count; i += 4) {
+      __m256i input =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+      __m256i output = _mm256_shuffle_epi8(input, shufmask256);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dest[i]), output);
+    }
+  }
+  for (; i + 2 <= count; i += 2) {
     __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
     __m128i output = _mm_shuffle_epi8(input, shufmask);
     _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i]), output);
@@ -637,4 +657,258 @@ void copy_and_swap_16_in_32_unaligned(void* dst_ptr, const void* src_ptr,
 
 #endif
 
+#if XE_ARCH_AMD64
+
+void fill_32(void* dest_ptr, uint32_t value, size_t count) {
+  auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
+  // 256-bit stores are available with AVX, which is the baseline.
+  __m256i pattern = _mm256_set1_epi32(int(value));
+  size_t i;
+  for (i = 0; i + 8 <= count; i += 8) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dest[i]), pattern);
+  }
+  for (; i < count; ++i) {
+    dest[i] = value;
+  }
+}
+
+size_t count_leading_equal_32(const void* src_ptr, uint32_t value,
+                              size_t count) {
+  auto src = reinterpret_cast<const uint32_t*>(src_ptr);
+  size_t i = 0;
+  if (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) {
+    __m256i pattern = _mm256_set1_epi32(int(value));
+    for (; i + 8 <= count; i += 8) {
+      uint32_t mask = uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(
+          _mm256_cmpeq_epi32(
+              _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i])),
+              pattern))));
+      if (mask != 0xFF) {
+        return i + xe::tzcnt(~mask);
+      }
+    }
+  }
+  __m128i pattern = _mm_set1_epi32(int(value));
+  for (; i + 4 <= count; i += 4) {
+    uint32_t mask = uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i])),
+        pattern))));
+    if (mask != 0xF) {
+      return i + xe::tzcnt(~mask);
+    }
+  }
+  for (; i < count && src[i] == value; ++i) {
+  }
+  return i;
+}
+
+size_t find_32(const void* src_ptr, size_t count, const uint32_t* values,
+               size_t value_count) {
+  if (!value_count || value_count > count) {
+    return count;
+  }
+  auto src = reinterpret_cast<const uint32_t*>(src_ptr);
+  // Candidates are found by the first value, then the rest is compared.
+  size_t start_count = count - value_count + 1;
+  auto matches_at = [&](size_t index) {
+    return !std::memcmp(&src[index + 1], &values[1],
+                        sizeof(uint32_t) * (value_count - 1));
+  };
+  size_t i = 0;
+  if (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) {
+    __m256i first = _mm256_set1_epi32(int(values[0]));
+    for (; i + 8 <= start_count; i += 8) {
+      uint32_t mask = uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(
+          _mm256_cmpeq_epi32(
+              _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i])),
+              first))));
+      for (; mask; mask &= mask - 1) {
+        size_t index = i + xe::tzcnt(mask);
+        if (matches_at(index)) {
+          return index;
+        }
+      }
+    }
+  }
+  __m128i first = _mm_set1_epi32(int(values[0]));
+  for (; i + 4 <= start_count; i += 4) {
+    uint32_t mask = uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i])), first))));
+    for (; mask; mask &= mask - 1) {
+      size_t index = i + xe::tzcnt(mask);
+      if (matches_at(index)) {
+        return index;
+      }
+    }
+  }
+  for (; i < start_count; ++i) {
+    if (src[i] == values[0] && matches_at(i)) {
+      return i;
+    }
+  }
+  return count;
+}
+
+size_t count_equal_bytes(const void* src1_ptr, const void* src2_ptr,
+                         size_t length) {
+  auto src1 = reinterpret_cast<const uint8_t*>(src1_ptr);
+  auto src2 = reinterpret_cast<const uint8_t*>(src2_ptr);
+  size_t equal_count = 0;
+  size_t i = 0;
+  if (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) {
+    for (; i + 32 <= length; i += 32) {
+      equal_count += xe::bit_count(uint32_t(_mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(
+              _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src1[i])),
+              _mm256_loadu_si256(
+                  reinterpret_cast<const __m256i*>(&src2[i]))))));
+    }
+  }
+  for (; i + 16 <= length; i += 16) {
+    equal_count += xe::bit_count(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src1[i])),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src2[i]))))));
+  }
+  for (; i < length; ++i) {
+    equal_count += src1[i] == src2[i];
+  }
+  return equal_count;
+}
+
+size_t find_zero_16(const void* src_ptr, size_t max_count) {
+  auto src = reinterpret_cast<const uint16_t*>(src_ptr);
+  size_t i = 0;
+  if (reinterpret_cast<uintptr_t>(src) & 1) {
+    for (; i < max_count && src[i]; ++i) {
+    }
+    return i;
+  }
+  // Aligned loads can't cross into the next page, which may be inaccessible,
+  // after the terminator.
+  for (; i < max_count && (reinterpret_cast<uintptr_t>(&src[i]) & 15); ++i) {
+    if (!src[i]) {
+      return i;
+    }
+  }
+  __m128i zero = _mm_setzero_si128();
+  for (; i < max_count; i += 8) {
+    uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi16(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(&src[i])), zero)));
+    if (mask) {
+      return std::min(i + (xe::tzcnt(mask) >> 1), max_count);
+    }
+  }
+  return max_count;
+}
+
+void widen_8_to_16_swapped(void* dest_ptr, const void* src_ptr, size_t count) {
+  auto dest = reinterpret_cast<uint16_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint8_t*>(src_ptr);
+  // Interleaving with zeros before each byte gives the big-endian values.
+  __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i]),
+                     _mm_unpacklo_epi8(zero, bytes));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i + 8]),
+                     _mm_unpackhi_epi8(zero, bytes));
+  }
+  for (; i < count; ++i) {
+    dest[i] = xe::byte_swap(uint16_t(src[i]));
+  }
+}
+
+void narrow_16_swapped_to_8(void* dest_ptr, const void* src_ptr, size_t count,
+                            uint8_t replacement) {
+  auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint16_t*>(src_ptr);
+  // Loaded as little-endian, the more significant byte of the big-endian value
+  // is in the lower 8 bits.
+  __m128i low_byte_mask = _mm_set1_epi16(0x00FF);
+  __m128i replacement_vector = _mm_set1_epi16(replacement);
+  auto narrow = [&](const uint16_t* values) {
+    __m128i swapped =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+    __m128i fits = _mm_cmpeq_epi16(_mm_and_si128(swapped, low_byte_mask),
+                                   _mm_setzero_si128());
+    return _mm_or_si128(_mm_and_si128(fits, _mm_srli_epi16(swapped, 8)),
+                        _mm_andnot_si128(fits, replacement_vector));
+  };
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&dest[i]),
+                     _mm_packus_epi16(narrow(&src[i]), narrow(&src[i + 8])));
+  }
+  for (; i < count; ++i) {
+    uint16_t value = xe::byte_swap(src[i]);
+    dest[i] = value <= 0xFF ? uint8_t(value) : replacement;
+  }
+}
+
+#else
+
+void fill_32(void* dest_ptr, uint32_t value, size_t count) {
+  auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
+  std::fill(dest, dest + count, value);
+}
+
+size_t count_leading_equal_32(const void* src_ptr, uint32_t value,
+                              size_t count) {
+  auto src = reinterpret_cast<const uint32_t*>(src_ptr);
+  size_t i = 0;
+  for (; i < count && src[i] == value; ++i) {
+  }
+  return i;
+}
+
+size_t find_32(const void* src_ptr, size_t count, const uint32_t* values,
+               size_t value_count) {
+  if (!value_count || value_count > count) {
+    return count;
+  }
+  auto src = reinterpret_cast<const uint32_t*>(src_ptr);
+  auto it = std::search(src, src + count, values, values + value_count);
+  return size_t(it - src);
+}
+
+size_t count_equal_bytes(const void* src1_ptr, const void* src2_ptr,
+                         size_t length) {
+  auto src1 = reinterpret_cast<const uint8_t*>(src1_ptr);
+  auto src2 = reinterpret_cast<const uint8_t*>(src2_ptr);
+  size_t equal_count = 0;
+  for (size_t i = 0; i < length; ++i) {
+    equal_count += src1[i] == src2[i];
+  }
+  return equal_count;
+}
+
+size_t find_zero_16(const void* src_ptr, size_t max_count) {
+  auto src = reinterpret_cast<const uint16_t*>(src_ptr);
+  size_t i = 0;
+  for (; i < max_count && src[i]; ++i) {
+  }
+  return i;
+}
+
+void widen_8_to_16_swapped(void* dest_ptr, const void* src_ptr, size_t count) {
+  auto dest = reinterpret_cast<uint16_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint8_t*>(src_ptr);
+  for (size_t i = 0; i < count; ++i) {
+    dest[i] = xe::byte_swap(uint16_t(src[i]));
+  }
+}
+
+void narrow_16_swapped_to_8(void* dest_ptr, const void* src_ptr, size_t count,
+                            uint8_t replacement) {
+  auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint16_t*>(src_ptr);
+  for (size_t i = 0; i < count; ++i) {
+    uint16_t value = xe::byte_swap(src[i]);
+    dest[i] = value <= 0xFF ? uint8_t(value) : replacement;
+  }
+}
+
+#endif
+
 }  // namespace xe
@@ -16,6 +16,8 @@
 #include <functional>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 
 #include "xenia/base/byte_order.h"
@@ -124,15 +126,42 @@ typedef int FileMappingHandle;
 constexpr FileMappingHandle kFileMappingHandleInvalid = -1;
 #endif
 
+// For no NUMA node preference.
+constexpr uint32_t kNumaNodeAny = UINT32_MAX;
+
+// If numa_node is not kNumaNodeAny, the pages of the mapping are preferably
+// allocated from the memory of that host NUMA node, if supported by the host.
 FileMappingHandle CreateFileMappingHandle(const std::filesystem::path& path,
                                           size_t length, PageAccess access,
-                                          bool commit);
+                                          bool commit,
+                                          uint32_t numa_node = kNumaNodeAny);
 void CloseFileMappingHandle(FileMappingHandle handle,
                             const std::filesystem::path& path);
 void* MapFileView(FileMappingHandle handle, void* base_address, size_t length,
                   PageAccess access, size_t file_offset);
 bool UnmapFileView(FileMappingHandle handle, void* base_address, size_t length);
 
+// Asks the host to back a mapped range with large pages where it can while
+// still allowing protection to be changed for individual pages. Returns false
+// if not supported for the range.
+bool AdviseHugePages(void* base_address, size_t length);
+
+// Tracking of writes to memory by the host, without an access violation on
+// every written page. Uses the asynchronous write protection of userfaultfd on
+// Linux, scanned and rearmed atomically with PAGEMAP_SCAN (Linux 6.7+). Not
+// available on Windows, where GetWriteWatch requires memory allocated with
+// MEM_WRITE_WATCH rather than file mapping views.
+bool IsWriteTrackingSupported();
+// Begins tracking writes to the range, which must be mapped, and marks it as
+// not written. The range must be tracked again if it's remapped.
+bool StartWriteTracking(void* base_address, size_t length);
+// Appends the ranges, as offsets from base_address and lengths, written since
+// the tracking was started or since the last call, and marks them as not
+// written again. Parts of the range where writes are not tracked are skipped.
+bool CollectWrittenRanges(
+    void* base_address, size_t length,
+    std::vector<std::pair<size_t, size_t>>& written_ranges_out);
+
 inline size_t hash_combine(size_t seed) { return seed; }
 
 template <typename T, typename... Ts>
@@ -201,6 +230,28 @@ void copy_and_swap(T* dest, const T* src, size_t count) {
   }
 }
 
+// Stores the value count times, for filling with a pattern.
+void fill_32(void* dest, uint32_t value, size_t count);
+// Returns how many of the values from the beginning are equal to the value.
+size_t count_leading_equal_32(const void* src, uint32_t value, size_t count);
+// Returns the index of the first occurrence of the sequence of values among the
+// count values, or count if there's none.
+size_t find_32(const void* src, size_t count, const uint32_t* values,
+               size_t value_count);
+// Returns how many bytes are equal at the same offsets in both buffers.
+size_t count_equal_bytes(const void* src1, const void* src2, size_t length);
+// Returns the index of the first zero 16-bit value, or max_count if there's
+// none among the first max_count values, for null-terminated UTF-16 strings of
+// either endianness. May read past the terminator, but only within the same
+// aligned 16 bytes.
+size_t find_zero_16(const void* src, size_t max_count);
+// Converts bytes to big-endian 16-bit values, such as Latin-1 to UTF-16BE.
+void widen_8_to_16_swapped(void* dest, const void* src, size_t count);
+// Converts big-endian 16-bit values to bytes, such as UTF-16BE to Latin-1,
+// storing the replacement for the values larger than 0xFF.
+void narrow_16_swapped_to_8(void* dest, const void* src, size_t count,
+                            uint8_t replacement);
+
 template <typename T>
 T load(const void* mem);
 template <>
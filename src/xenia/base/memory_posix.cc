@@ -13,6 +13,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <cstddef>
+#include <mutex>
 
 #include "xenia/base/math.h"
 #include "xenia/base/platform.h"
@@ -27,6 +28,17 @@
 #include "xenia/base/main_android.h"
 #endif
 
+#if XE_PLATFORM_LINUX
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#if defined(PAGEMAP_SCAN) && defined(UFFD_FEATURE_WP_ASYNC) && \
+    defined(__NR_userfaultfd)
+#define XE_MEMORY_WRITE_TRACKING 1
+#endif
+#endif
+
 namespace xe {
 namespace memory {
 
@@ -112,9 +124,35 @@ bool QueryProtect(void* base_address, size_t& length, PageAccess& access_out) {
   return false;
 }
 
+#if XE_PLATFORM_LINUX
+static bool BindFileMappingToNumaNode(int fd, size_t length,
+                                      uint32_t numa_node) {
+  // The policy set through any mapping of shared memory is stored in the
+  // shared memory object itself, so it applies to all views mapped later.
+  // Using the syscall directly not to depend on libnuma.
+  constexpr int kMpolPreferred = 1;
+  constexpr uint32_t kMaxNumaNodes = 1024;
+  constexpr size_t kBitsPerMaskWord = sizeof(unsigned long) * 8;
+  if (numa_node >= kMaxNumaNodes) {
+    return false;
+  }
+  unsigned long node_mask[kMaxNumaNodes / kBitsPerMaskWord] = {};
+  node_mask[numa_node / kBitsPerMaskWord] = 1ul
+                                            << (numa_node % kBitsPerMaskWord);
+  void* mapping = mmap(nullptr, length, PROT_NONE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  bool bound = syscall(SYS_mbind, mapping, length, kMpolPreferred, node_mask,
+                       kMaxNumaNodes + 1, 0) == 0;
+  munmap(mapping, length);
+  return bound;
+}
+#endif  // XE_PLATFORM_LINUX
+
 FileMappingHandle CreateFileMappingHandle(const std::filesystem::path& path,
                                           size_t length, PageAccess access,
-                                          bool commit) {
+                                          bool commit, uint32_t numa_node) {
 #if XE_PLATFORM_ANDROID
   // TODO(Triang3l): Check if memfd can be used instead on API 30+.
   if (android_ASharedMemory_create_) {
@@ -162,6 +200,12 @@ FileMappingHandle CreateFileMappingHandle(const std::filesystem::path& path,
     return kFileMappingHandleInvalid;
   }
   ftruncate64(ret, length);
+#if XE_PLATFORM_LINUX
+  // Not fatal if failed, the memory is allocated from any node then.
+  if (numa_node != kNumaNodeAny) {
+    BindFileMappingToNumaNode(ret, length, numa_node);
+  }
+#endif  // XE_PLATFORM_LINUX
   return ret;
 #endif
 }
@@ -187,5 +231,120 @@ bool UnmapFileView(FileMappingHandle handle, void* base_address,
   return munmap(base_address, length) == 0;
 }
 
+bool AdviseHugePages(void* base_address, size_t length) {
+#ifdef MADV_HUGEPAGE
+  // Views are private anonymous mappings, which can use transparent huge
+  // pages, split by the kernel where the protection differs within them.
+  return madvise(base_address, length, MADV_HUGEPAGE) == 0;
+#else
+  return false;
+#endif
+}
+
+#if XE_MEMORY_WRITE_TRACKING
+static std::once_flag write_tracking_initialized_;
+static int write_tracking_userfaultfd_ = -1;
+static int write_tracking_pagemap_ = -1;
+
+static void InitializeWriteTracking() {
+  int userfaultfd = int(syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+  if (userfaultfd < 0) {
+    return;
+  }
+  // With asynchronous write protection, writes to protected pages are resolved
+  // by the kernel, only clearing the write protection of the page, which is
+  // then reported as written by PAGEMAP_SCAN.
+  uffdio_api api = {};
+  api.api = UFFD_API;
+  api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+  if (ioctl(userfaultfd, UFFDIO_API, &api) < 0) {
+    close(userfaultfd);
+    return;
+  }
+  int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  if (pagemap < 0) {
+    close(userfaultfd);
+    return;
+  }
+  write_tracking_userfaultfd_ = userfaultfd;
+  write_tracking_pagemap_ = pagemap;
+}
+
+bool IsWriteTrackingSupported() {
+  std::call_once(write_tracking_initialized_, InitializeWriteTracking);
+  return write_tracking_userfaultfd_ >= 0;
+}
+
+bool StartWriteTracking(void* base_address, size_t length) {
+  if (!IsWriteTrackingSupported()) {
+    return false;
+  }
+  // Registering an already registered range again is allowed.
+  uffdio_register uffd_register = {};
+  uffd_register.range.start = uint64_t(base_address);
+  uffd_register.range.len = length;
+  uffd_register.mode = UFFDIO_REGISTER_MODE_WP;
+  if (ioctl(write_tracking_userfaultfd_, UFFDIO_REGISTER, &uffd_register) <
+      0) {
+    return false;
+  }
+  uffdio_writeprotect writeprotect = {};
+  writeprotect.range.start = uint64_t(base_address);
+  writeprotect.range.len = length;
+  writeprotect.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+  return ioctl(write_tracking_userfaultfd_, UFFDIO_WRITEPROTECT,
+               &writeprotect) >= 0;
+}
+
+bool CollectWrittenRanges(
+    void* base_address, size_t length,
+    std::vector<std::pair<size_t, size_t>>& written_ranges_out) {
+  if (!IsWriteTrackingSupported()) {
+    return false;
+  }
+  page_region regions[64];
+  uint64_t start = uint64_t(base_address);
+  uint64_t end = start + length;
+  while (start < end) {
+    pm_scan_arg scan = {};
+    scan.size = sizeof(scan);
+    // Write-protecting the reported pages again in the same operation, so
+    // writes done concurrently are not lost. Parts of the range not tracked
+    // are skipped.
+    scan.flags = PM_SCAN_WP_MATCHING;
+    scan.start = start;
+    scan.end = end;
+    scan.vec = uint64_t(regions);
+    scan.vec_len = xe::countof(regions);
+    scan.category_mask = PAGE_IS_WRITTEN;
+    scan.return_mask = PAGE_IS_WRITTEN;
+    int region_count = ioctl(write_tracking_pagemap_, PAGEMAP_SCAN, &scan);
+    if (region_count < 0) {
+      return false;
+    }
+    for (int i = 0; i < region_count; ++i) {
+      written_ranges_out.emplace_back(
+          size_t(regions[i].start - uint64_t(base_address)),
+          size_t(regions[i].end - regions[i].start));
+    }
+    if (scan.walk_end <= start) {
+      break;
+    }
+    start = scan.walk_end;
+  }
+  return true;
+}
+#else
+bool IsWriteTrackingSupported() { return false; }
+
+bool StartWriteTracking(void* base_address, size_t length) { return false; }
+
+bool CollectWrittenRanges(
+    void* base_address, size_t length,
+    std::vector<std::pair<size_t, size_t>>& written_ranges_out) {
+  return false;
+}
+#endif  // XE_MEMORY_WRITE_TRACKING
+
 }  // namespace memory
 }  // namespace xe
@@ -212,11 +212,17 @@ bool QueryProtect(void* base_address, size_t& length, PageAccess& access_out) {
 
 FileMappingHandle CreateFileMappingHandle(const std::filesystem::path& path,
                                           size_t length, PageAccess access,
-                                          bool commit) {
+                                          bool commit, uint32_t numa_node) {
   DWORD protect =
       ToWin32ProtectFlags(access) | (commit ? SEC_COMMIT : SEC_RESERVE);
   auto full_path = "Local" / path;
 #ifdef XE_BASE_MEMORY_WIN_USE_DESKTOP_FUNCTIONS
+  if (numa_node != kNumaNodeAny) {
+    return CreateFileMappingNumaW(INVALID_HANDLE_VALUE, nullptr, protect,
+                                  static_cast<DWORD>(length >> 32),
+                                  static_cast<DWORD>(length), full_path.c_str(),
+                                  DWORD(numa_node));
+  }
   return CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, protect,
                             static_cast<DWORD>(length >> 32),
                             static_cast<DWORD>(length), full_path.c_str());
@@ -283,5 +289,22 @@ bool UnmapFileView(FileMappingHandle handle, void* base_address,
   return UnmapViewOfFile(base_address) ? true : false;
 }
 
+bool IsWriteTrackingSupported() { return false; }
+
+bool StartWriteTracking(void* base_address, size_t length) { return false; }
+
+bool CollectWrittenRanges(
+    void* base_address, size_t length,
+    std::vector<std::pair<size_t, size_t>>& written_ranges_out) {
+  return false;
+}
+
+bool AdviseHugePages(void* base_address, size_t length) {
+  // Large page sections must be committed entirely and can't have the
+  // protection of individual 4 KB pages changed, and views of them must be
+  // aligned to large pages, which the 0xE0000000 view isn't.
+  return false;
+}
+
 }  // namespace memory
 }  // namespace xe
@@ -0,0 +1,492 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
+
+#ifdef XE_PLATFORM_WIN32
+// clang-format off
+#include "xenia/base/platform_win.h"
+#include <WS2tcpip.h>
+#include <WinSock2.h>
+// clang-format on
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+DEFINE_path(metrics_export_path, "",
+            "File to write the metrics of the emulator to periodically, in the "
+            "Prometheus text format, for example for the textfile collector of "
+            "the node exporter. Not written if empty.",
+            "General");
+DEFINE_int32(metrics_export_port, 0,
+             "Loopback TCP port to serve the metrics of the emulator on over "
+             "HTTP, in the Prometheus text format, for scraping. Not served if "
+             "0.",
+             "General");
+DEFINE_uint32(metrics_export_interval_ms, 5000,
+              "Interval of writing the metrics to metrics_export_path.",
+              "General");
+
+namespace xe {
+namespace metrics {
+
+namespace internal {
+size_t GetThreadShardIndex() {
+  static std::atomic<size_t> next_shard_index{0};
+  thread_local size_t shard_index =
+      next_shard_index.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+  return shard_index;
+}
+}  // namespace internal
+
+namespace {
+// The metrics are only registered during the static initialization, before
+// any of them can be read.
+Metric*& first_metric() {
+  static Metric* first = nullptr;
+  return first;
+}
+
+void AppendUint(std::string& out, uint64_t value) {
+  char buffer[24];
+  int length = std::snprintf(buffer, sizeof(buffer), "%llu",
+                             static_cast<unsigned long long>(value));
+  out.append(buffer, size_t(length));
+}
+
+void AppendInt(std::string& out, int64_t value) {
+  char buffer[24];
+  int length = std::snprintf(buffer, sizeof(buffer), "%lld",
+                             static_cast<long long>(value));
+  out.append(buffer, size_t(length));
+}
+
+// Backslashes and line breaks must be escaped in the help text.
+void AppendHelp(std::string& out, const char* help) {
+  for (const char* c = help; *c; ++c) {
+    if (*c == '\\') {
+      out.append("\\\\");
+    } else if (*c == '\n') {
+      out.append("\\n");
+    } else {
+      out.push_back(*c);
+    }
+  }
+}
+}  // namespace
+
+Metric::Metric(Type type, const char* name, const char* help)
+    : type_(type), name_(name), help_(help) {
+  Metric*& first = first_metric();
+  next_ = first;
+  first = this;
+}
+
+Metric::~Metric() {
+  // Static metrics are destroyed only on exit, but keep the list valid.
+  for (Metric** metric = &first_metric(); *metric;
+       metric = &(*metric)->next_) {
+    if (*metric == this) {
+      *metric = next_;
+      break;
+    }
+  }
+}
+
+const Metric* Metric::first() { return first_metric(); }
+
+uint64_t Counter::value() const {
+  uint64_t value = 0;
+  for (const Shard& shard : shards_) {
+    value += shard.value.load(std::memory_order_relaxed);
+  }
+  return value;
+}
+
+void Counter::FormatSamples(std::string& out) const {
+  out.append(name());
+  out.push_back(' ');
+  AppendUint(out, value());
+  out.push_back('\n');
+}
+
+void CounterFunction::FormatSamples(std::string& out) const {
+  out.append(name());
+  out.push_back(' ');
+  AppendUint(out, value());
+  out.push_back('\n');
+}
+
+void Gauge::FormatSamples(std::string& out) const {
+  out.append(name());
+  out.push_back(' ');
+  AppendInt(out, value());
+  out.push_back('\n');
+}
+
+Histogram::Histogram(const char* name, const char* help,
+                     std::initializer_list<uint64_t> upper_bounds)
+    : Metric(Type::kHistogram, name, help), upper_bounds_(upper_bounds) {
+  assert_true(std::is_sorted(upper_bounds_.begin(), upper_bounds_.end()));
+  shard_stride_ = xe::round_up(upper_bounds_.size() + 2,
+                               64 / sizeof(std::atomic<uint64_t>));
+  // Value-initialized to zeros.
+  shard_values_ =
+      std::make_unique<std::atomic<uint64_t>[]>(shard_stride_ * kShardCount);
+}
+
+void Histogram::Observe(uint64_t value) {
+  size_t bucket_index = size_t(
+      std::lower_bound(upper_bounds_.begin(), upper_bounds_.end(), value) -
+      upper_bounds_.begin());
+  std::atomic<uint64_t>* shard =
+      shard_values_.get() + shard_stride_ * internal::GetThreadShardIndex();
+  shard[bucket_index].fetch_add(1, std::memory_order_relaxed);
+  shard[upper_bounds_.size() + 1].fetch_add(value, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::GetSnapshot() const {
+  Snapshot snapshot;
+  size_t bucket_count = upper_bounds_.size() + 1;
+  snapshot.bucket_counts.resize(bucket_count);
+  for (size_t i = 0; i < kShardCount; ++i) {
+    const std::atomic<uint64_t>* shard =
+        shard_values_.get() + shard_stride_ * i;
+    for (size_t j = 0; j < bucket_count; ++j) {
+      snapshot.bucket_counts[j] += shard[j].load(std::memory_order_relaxed);
+    }
+    snapshot.sum += shard[bucket_count].load(std::memory_order_relaxed);
+  }
+  for (uint64_t bucket_count : snapshot.bucket_counts) {
+    snapshot.count += bucket_count;
+  }
+  return snapshot;
+}
+
+void Histogram::FormatSamples(std::string& out) const {
+  Snapshot snapshot = GetSnapshot();
+  uint64_t cumulative_count = 0;
+  for (size_t i = 0; i <= upper_bounds_.size(); ++i) {
+    cumulative_count += snapshot.bucket_counts[i];
+    out.append(name());
+    out.append("_bucket{le=\"");
+    if (i < upper_bounds_.size()) {
+      AppendUint(out, upper_bounds_[i]);
+    } else {
+      out.append("+Inf");
+    }
+    out.append("\"} ");
+    AppendUint(out, cumulative_count);
+    out.push_back('\n');
+  }
+  out.append(name());
+  out.append("_sum ");
+  AppendUint(out, snapshot.sum);
+  out.push_back('\n');
+  out.append(name());
+  out.append("_count ");
+  AppendUint(out, snapshot.count);
+  out.push_back('\n');
+}
+
+void FormatText(std::string& out) {
+  for (const Metric* metric = Metric::first(); metric;
+       metric = metric->next()) {
+    out.append("# HELP ");
+    out.append(metric->name());
+    out.push_back(' ');
+    AppendHelp(out, metric->help());
+    out.append("\n# TYPE ");
+    out.append(metric->name());
+    switch (metric->type()) {
+      case Metric::Type::kCounter:
+        out.append(" counter\n");
+        break;
+      case Metric::Type::kGauge:
+        out.append(" gauge\n");
+        break;
+      case Metric::Type::kHistogram:
+        out.append(" histogram\n");
+        break;
+    }
+    metric->FormatSamples(out);
+  }
+}
+
+namespace {
+#ifdef XE_PLATFORM_WIN32
+using NativeSocket = SOCKET;
+constexpr NativeSocket kInvalidSocket = INVALID_SOCKET;
+
+int PollSocket(NativeSocket socket, int timeout_ms) {
+  WSAPOLLFD descriptor = {};
+  descriptor.fd = socket;
+  descriptor.events = POLLIN;
+  return WSAPoll(&descriptor, 1, timeout_ms);
+}
+
+void CloseSocket(NativeSocket socket) { closesocket(socket); }
+#else
+using NativeSocket = int;
+constexpr NativeSocket kInvalidSocket = -1;
+
+int PollSocket(NativeSocket socket, int timeout_ms) {
+  pollfd descriptor = {};
+  descriptor.fd = socket;
+  descriptor.events = POLLIN;
+  return poll(&descriptor, 1, timeout_ms);
+}
+
+void CloseSocket(NativeSocket socket) { close(socket); }
+#endif
+}  // namespace
+
+class Exporter::Implementation {
+ public:
+  Implementation(std::filesystem::path path, uint16_t port,
+                 std::chrono::milliseconds interval)
+      : path_(std::move(path)), port_(port), interval_(interval) {}
+  ~Implementation();
+
+  bool Initialize();
+
+ private:
+  // Shutdown is checked between the waits of at most this long.
+  static constexpr std::chrono::milliseconds kShutdownCheckInterval{100};
+  // The requests are small, and tolerating slow clients would block the file
+  // writing.
+  static constexpr int kRequestTimeoutMs = 1000;
+
+  bool Listen();
+  void ThreadMain();
+  void WriteFile();
+  void ServeConnection();
+
+  std::filesystem::path path_;
+  uint16_t port_;
+  std::chrono::milliseconds interval_;
+
+#ifdef XE_PLATFORM_WIN32
+  bool winsock_initialized_ = false;
+#endif
+  NativeSocket listen_socket_ = kInvalidSocket;
+
+  std::atomic<bool> shutdown_{false};
+  std::unique_ptr<threading::Thread> thread_;
+};
+
+Exporter::Implementation::~Implementation() {
+  if (thread_) {
+    shutdown_.store(true, std::memory_order_relaxed);
+    threading::Wait(thread_.get(), false);
+  }
+  if (listen_socket_ != kInvalidSocket) {
+    CloseSocket(listen_socket_);
+  }
+#ifdef XE_PLATFORM_WIN32
+  if (winsock_initialized_) {
+    WSACleanup();
+  }
+#endif
+}
+
+bool Exporter::Implementation::Initialize() {
+  if (port_ && !Listen()) {
+    return false;
+  }
+  threading::Thread::CreationParameters params;
+  thread_ = threading::Thread::Create(params, [this]() { ThreadMain(); });
+  if (!thread_) {
+    XELOGE("Metrics: Failed to create the export thread");
+    return false;
+  }
+  thread_->set_name("Metrics Exporter");
+  return true;
+}
+
+bool Exporter::Implementation::Listen() {
+#ifdef XE_PLATFORM_WIN32
+  WSADATA wsa_data;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa_data)) {
+    XELOGE("Metrics: Failed to initialize Winsock");
+    return false;
+  }
+  winsock_initialized_ = true;
+#endif
+  listen_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_socket_ == kInvalidSocket) {
+    XELOGE("Metrics: Failed to create the listening socket");
+    return false;
+  }
+  // Only local, the metrics are for the agent running on the same machine.
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port_);
+  if (bind(listen_socket_, reinterpret_cast<const sockaddr*>(&address),
+           sizeof(address)) < 0 ||
+      listen(listen_socket_, 4) < 0) {
+    XELOGE("Metrics: Failed to listen on the loopback port {}", port_);
+    return false;
+  }
+  XELOGI("Metrics: Serving on http://127.0.0.1:{}/metrics", port_);
+  return true;
+}
+
+void Exporter::Implementation::ThreadMain() {
+  auto next_write_time = std::chrono::steady_clock::now();
+  while (!shutdown_.load(std::memory_order_relaxed)) {
+    auto now = std::chrono::steady_clock::now();
+    if (!path_.empty() && now >= next_write_time) {
+      WriteFile();
+      next_write_time = now + interval_;
+    }
+    auto wait_duration = kShutdownCheckInterval;
+    if (!path_.empty()) {
+      wait_duration = std::min(
+          wait_duration,
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              next_write_time - std::chrono::steady_clock::now()));
+      wait_duration = std::max(wait_duration, std::chrono::milliseconds(0));
+    }
+    if (listen_socket_ == kInvalidSocket) {
+      threading::Sleep(wait_duration);
+      continue;
+    }
+    if (PollSocket(listen_socket_, int(wait_duration.count())) > 0) {
+      ServeConnection();
+    }
+  }
+  if (!path_.empty()) {
+    // The final values, like the totals of the session.
+    WriteFile();
+  }
+}
+
+void Exporter::Implementation::WriteFile() {
+  std::string text;
+  FormatText(text);
+  std::filesystem::path temporary_path = path_;
+  temporary_path += ".tmp";
+  FILE* file = filesystem::OpenFile(temporary_path, "wb");
+  if (!file) {
+    XELOGE("Metrics: Failed to open {} for writing",
+           xe::path_to_utf8(temporary_path));
+    return;
+  }
+  bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+  written = std::fclose(file) == 0 && written;
+  std::error_code error;
+  if (written) {
+    std::filesystem::rename(temporary_path, path_, error);
+  }
+  if (!written || error) {
+    XELOGE("Metrics: Failed to write {}", xe::path_to_utf8(path_));
+    std::filesystem::remove(temporary_path, error);
+  }
+}
+
+void Exporter::Implementation::ServeConnection() {
+  NativeSocket connection = accept(listen_socket_, nullptr, nullptr);
+  if (connection == kInvalidSocket) {
+    return;
+  }
+  // Only the request line matters, read the headers until the end so the
+  // client doesn't get a reset for the unread data on closing.
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < 16384) {
+    if (PollSocket(connection, kRequestTimeoutMs) <= 0) {
+      CloseSocket(connection);
+      return;
+    }
+    int received = int(recv(connection, buffer, int(sizeof(buffer)), 0));
+    if (received <= 0) {
+      CloseSocket(connection);
+      return;
+    }
+    request.append(buffer, size_t(received));
+  }
+  std::string body;
+  std::string response;
+  if (request.compare(0, 13, "GET /metrics ") == 0 ||
+      request.compare(0, 6, "GET / ") == 0) {
+    FormatText(body);
+    response =
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+  } else {
+    body = "Not found\n";
+    response =
+        "HTTP/1.0 404 Not Found\r\n"
+        "Content-Type: text/plain; charset=utf-8\r\n";
+  }
+  response.append("Content-Length: ");
+  AppendUint(response, body.size());
+  response.append("\r\nConnection: close\r\n\r\n");
+  response.append(body);
+  size_t sent_size = 0;
+  while (sent_size < response.size()) {
+    int sent = int(send(connection, response.data() + sent_size,
+                        int(response.size() - sent_size), 0));
+    if (sent <= 0) {
+      break;
+    }
+    sent_size += size_t(sent);
+  }
+  CloseSocket(connection);
+}
+
+std::unique_ptr<Exporter> Exporter::CreateIfConfigured() {
+  const std::filesystem::path& path = cvars::metrics_export_path;
+  int32_t port = cvars::metrics_export_port;
+  if (path.empty() && !port) {
+    return nullptr;
+  }
+  if (port < 0 || port > UINT16_MAX) {
+    XELOGE("Metrics: Invalid export port {}", port);
+    return nullptr;
+  }
+  auto implementation = std::make_unique<Implementation>(
+      path, uint16_t(port),
+      std::chrono::milliseconds(
+          std::max(cvars::metrics_export_interval_ms, uint32_t(1))));
+  if (!implementation->Initialize()) {
+    return nullptr;
+  }
+  return std::unique_ptr<Exporter>(new Exporter(std::move(implementation)));
+}
+
+Exporter::Exporter(std::unique_ptr<Implementation> implementation)
+    : implementation_(std::move(implementation)) {}
+
+Exporter::~Exporter() = default;
+
+}  // namespace metrics
+}  // namespace xe
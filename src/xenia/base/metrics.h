@@ -0,0 +1,181 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_METRICS_H_
+#define XENIA_BASE_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace xe {
+namespace metrics {
+
+// The metrics published by the subsystems for monitoring the emulator from
+// outside, exported in the Prometheus text format. They're defined at
+// namespace scope, registering themselves on construction, and updating one
+// is a relaxed atomic operation on a cache line mostly used only by the
+// calling thread, so they can be updated on the hot paths.
+
+constexpr size_t kShardCount = 16;
+
+namespace internal {
+// The shard of the sharded metrics updated by the calling thread.
+size_t GetThreadShardIndex();
+}  // namespace internal
+
+class Metric {
+ public:
+  enum class Type {
+    kCounter,
+    kGauge,
+    kHistogram,
+  };
+
+  Metric(const Metric& metric) = delete;
+  Metric& operator=(const Metric& metric) = delete;
+  virtual ~Metric();
+
+  Type type() const { return type_; }
+  // Prometheus naming, like xenia_subsystem_what_unit[_total].
+  const char* name() const { return name_; }
+  const char* help() const { return help_; }
+
+  // Appends the samples, without the HELP and TYPE lines.
+  virtual void FormatSamples(std::string& out) const = 0;
+
+  // The registered metrics in no particular order, not changing after the
+  // static initialization.
+  static const Metric* first();
+  const Metric* next() const { return next_; }
+
+ protected:
+  Metric(Type type, const char* name, const char* help);
+
+ private:
+  Type type_;
+  const char* name_;
+  const char* help_;
+  Metric* next_ = nullptr;
+};
+
+// Monotonically increasing.
+class Counter final : public Metric {
+ public:
+  Counter(const char* name, const char* help)
+      : Metric(Type::kCounter, name, help) {}
+
+  void Add(uint64_t value = 1) {
+    shards_[internal::GetThreadShardIndex()].value.fetch_add(
+        value, std::memory_order_relaxed);
+  }
+  uint64_t value() const;
+
+  void FormatSamples(std::string& out) const override;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+  std::array<Shard, kShardCount> shards_;
+};
+
+// A counter with the total kept elsewhere, read when exporting.
+class CounterFunction final : public Metric {
+ public:
+  CounterFunction(const char* name, const char* help, uint64_t (*function)())
+      : Metric(Type::kCounter, name, help), function_(function) {}
+
+  uint64_t value() const { return function_(); }
+
+  void FormatSamples(std::string& out) const override;
+
+ private:
+  uint64_t (*function_)();
+};
+
+// A current value, not sharded as it's set as a whole.
+class Gauge final : public Metric {
+ public:
+  Gauge(const char* name, const char* help)
+      : Metric(Type::kGauge, name, help) {}
+
+  void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+  void Add(int64_t value) {
+    value_.fetch_add(value, std::memory_order_relaxed);
+  }
+  int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  void FormatSamples(std::string& out) const override;
+
+ private:
+  std::atomic<int64_t> value_{0};
+};
+
+// The distribution of integer observations, in the units in the name, over
+// buckets with the inclusive upper bounds given in ascending order, plus the
+// bucket for the values above all of them.
+class Histogram final : public Metric {
+ public:
+  Histogram(const char* name, const char* help,
+            std::initializer_list<uint64_t> upper_bounds);
+
+  void Observe(uint64_t value);
+
+  struct Snapshot {
+    // Not cumulative, one more than the upper bounds.
+    std::vector<uint64_t> bucket_counts;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+  };
+  Snapshot GetSnapshot() const;
+  const std::vector<uint64_t>& upper_bounds() const { return upper_bounds_; }
+
+  void FormatSamples(std::string& out) const override;
+
+ private:
+  std::vector<uint64_t> upper_bounds_;
+  // For each shard, the bucket counts followed by the sum, padded to whole
+  // cache lines.
+  size_t shard_stride_;
+  std::unique_ptr<std::atomic<uint64_t>[]> shard_values_;
+};
+
+// Appends all the registered metrics in the Prometheus text exposition format.
+void FormatText(std::string& out);
+
+// Writes the metrics to a file, replaced atomically so the collectors reading
+// it, like the textfile collector of the node exporter, never see it partially
+// written, and serves them over HTTP on a loopback port, as configured. The
+// metrics are updated regardless of whether they're exported.
+class Exporter {
+ public:
+  // Returns nullptr if exporting is not configured or it couldn't be started.
+  static std::unique_ptr<Exporter> CreateIfConfigured();
+
+  Exporter(const Exporter& exporter) = delete;
+  Exporter& operator=(const Exporter& exporter) = delete;
+  ~Exporter();
+
+ private:
+  class Implementation;
+  explicit Exporter(std::unique_ptr<Implementation> implementation);
+
+  std::unique_ptr<Implementation> implementation_;
+};
+
+}  // namespace metrics
+}  // namespace xe
+
+#endif  // XENIA_BASE_METRICS_H_
@@ -40,13 +40,35 @@ xe_global_mutex ::~xe_global_mutex() {
 }
 
 void xe_global_mutex::lock() {
+  if (XE_UNLIKELY(lock_profiler::IsEnabled())) {
+    if (TryEnterCriticalSection(global_critical_section(this))) {
+      lock_profiler::OnAcquired(0, false);
+      return;
+    }
+    lock_profiler::OnContended();
+    uint64_t wait_start_ns = lock_profiler::GetTimeNs();
+    EnterCriticalSection(global_critical_section(this));
+    lock_profiler::OnAcquired(lock_profiler::GetTimeNs() - wait_start_ns,
+                              true);
+    return;
+  }
+  if (XE_LIKELY(TryEnterCriticalSection(global_critical_section(this)))) {
+    return;
+  }
+  lock_profiler::OnContended();
   EnterCriticalSection(global_critical_section(this));
 }
 void xe_global_mutex::unlock() {
+  if (XE_UNLIKELY(lock_profiler::IsEnabled())) {
+    lock_profiler::OnReleasing();
+  }
   LeaveCriticalSection(global_critical_section(this));
 }
 bool xe_global_mutex::try_lock() {
   BOOL success = TryEnterCriticalSection(global_critical_section(this));
+  if (success && XE_UNLIKELY(lock_profiler::IsEnabled())) {
+    lock_profiler::OnAcquired(0, false);
+  }
   return success;
 }
 
@@ -64,6 +86,39 @@ void xe_fast_mutex::unlock() { LeaveCriticalSection(fast_crit(this)); }
 bool xe_fast_mutex::try_lock() {
   return TryEnterCriticalSection(fast_crit(this));
 }
+#else
+void xe_global_mutex::lock() {
+  if (XE_UNLIKELY(lock_profiler::IsEnabled())) {
+    if (mutex_.try_lock()) {
+      lock_profiler::OnAcquired(0, false);
+      return;
+    }
+    lock_profiler::OnContended();
+    uint64_t wait_start_ns = lock_profiler::GetTimeNs();
+    mutex_.lock();
+    lock_profiler::OnAcquired(lock_profiler::GetTimeNs() - wait_start_ns,
+                              true);
+    return;
+  }
+  if (XE_LIKELY(mutex_.try_lock())) {
+    return;
+  }
+  lock_profiler::OnContended();
+  mutex_.lock();
+}
+void xe_global_mutex::unlock() {
+  if (XE_UNLIKELY(lock_profiler::IsEnabled())) {
+    lock_profiler::OnReleasing();
+  }
+  mutex_.unlock();
+}
+bool xe_global_mutex::try_lock() {
+  bool success = mutex_.try_lock();
+  if (success && XE_UNLIKELY(lock_profiler::IsEnabled())) {
+    lock_profiler::OnAcquired(0, false);
+  }
+  return success;
+}
 #endif
 // chrispy: moved this out of body of function to eliminate the initialization
 // guards
@@ -12,6 +12,7 @@
 #include <mutex>
 #include "platform.h"
 #include "memory.h"
+#include "xenia/base/lock_profiler.h"
 #define XE_ENABLE_FAST_WIN32_MUTEX 1
 namespace xe {
 
@@ -81,7 +82,17 @@ class xe_unlikely_mutex {
 };
 using xe_mutex = xe_fast_mutex;
 #else
-using global_mutex_type = std::recursive_mutex;
+// Wraps the recursive mutex for profiling.
+class xe_global_mutex {
+ public:
+  void lock();
+  void unlock();
+  bool try_lock();
+
+ private:
+  std::recursive_mutex mutex_;
+};
+using global_mutex_type = xe_global_mutex;
 using xe_mutex = std::mutex;
 using xe_unlikely_mutex = std::mutex;
 #endif
@@ -140,12 +151,14 @@ class global_critical_region {
   // Use this when keeping an instance is not possible. Otherwise, prefer
   // to keep an instance of global_critical_region near the members requiring
   // it to keep things readable.
-  static global_unique_lock_type AcquireDirect() {
+  static global_unique_lock_type AcquireDirect(XE_LOCK_SITE_PARAMETERS) {
+    lock_profiler::SetNextSite(lock_site_file, lock_site_line);
     return global_unique_lock_type(mutex());
   }
 
   // Acquires a lock on the global critical section.
-  static inline global_unique_lock_type Acquire() {
+  static inline global_unique_lock_type Acquire(XE_LOCK_SITE_PARAMETERS) {
+    lock_profiler::SetNextSite(lock_site_file, lock_site_line);
     return global_unique_lock_type(mutex());
   }
 
@@ -156,13 +169,17 @@ class global_critical_region {
   }
 
   // Acquires a deferred lock on the global critical section.
-  static inline global_unique_lock_type AcquireDeferred() {
+  // The site is attributed only if the lock is acquired before another one.
+  static inline global_unique_lock_type AcquireDeferred(
+      XE_LOCK_SITE_PARAMETERS) {
+    lock_profiler::SetNextSite(lock_site_file, lock_site_line);
     return global_unique_lock_type(mutex(), std::defer_lock);
   }
 
   // Tries to acquire a lock on the glboal critical section.
   // Check owns_lock() to see if the lock was successfully acquired.
-  static inline global_unique_lock_type TryAcquire() {
+  static inline global_unique_lock_type TryAcquire(XE_LOCK_SITE_PARAMETERS) {
+    lock_profiler::SetNextSite(lock_site_file, lock_site_line);
     return global_unique_lock_type(mutex(), std::try_to_lock);
   }
 };
@@ -115,6 +115,13 @@ void InitFeatureFlags() {
       }
     }
   }
+  {
+    unsigned int data[4];
+    Xbyak::util::Cpu::getCpuid(1, data);
+    if ((data[2] & (1U << 25)) && (cvars::x64_extension_mask & kX64EmitAES)) {
+      feature_flags_ |= kX64EmitAES;
+    }
+  }
   {
     unsigned int data[4];
     memset(data, 0, sizeof(data));
@@ -127,6 +134,9 @@ void InitFeatureFlags() {
     if ((data[1] & (1 << 9)) && (cvars::x64_extension_mask & kX64FastRepMovs)) {
       feature_flags_ |= kX64FastRepMovs;
     }
+    if ((data[1] & (1U << 29)) && (cvars::x64_extension_mask & kX64EmitSHA)) {
+      feature_flags_ |= kX64EmitSHA;
+    }
   }
   g_feature_flags = feature_flags_;
   g_did_initialize_feature_flags = true;
@@ -46,7 +46,11 @@ enum X64FeatureFlags : uint64_t {
   kX64EmitFMA4 = 1 << 17,  // todo: also use on zen1?
   kX64EmitTBM = 1 << 18,
   kX64EmitMovdir64M = 1 << 19,
-  kX64FastRepMovs = 1 << 20
+  kX64FastRepMovs = 1 << 20,
+  // Not used by the JIT, for the host implementations of the guest
+  // cryptography functions.
+  kX64EmitAES = 1 << 21,
+  kX64EmitSHA = 1 << 22,
 
 };
 
@@ -37,6 +37,8 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/trace_events.h"
 #include "xenia/ui/ui_event.h"
 #include "xenia/ui/virtual_key.h"
 #include "xenia/ui/window.h"
@@ -72,6 +74,8 @@ bool Profiler::is_enabled() { return true; }
 bool Profiler::is_visible() { return is_enabled() && MicroProfileIsDrawing(); }
 
 void Profiler::Initialize() {
+  trace_events::Initialize();
+
   // Custom groups.
   MicroProfileSetEnableAllGroups(false);
   MicroProfileForceEnableGroup("apu", MicroProfileTokenTypeCpu);
@@ -111,6 +115,7 @@ void Profiler::Dump() {
 }
 
 void Profiler::Shutdown() {
+  trace_events::Shutdown();
   SetUserIO(0, nullptr, nullptr, nullptr);
   window_ = nullptr;
   MicroProfileShutdown();
@@ -123,6 +128,9 @@ uint32_t Profiler::GetColor(const char* str) {
 }
 
 void Profiler::ThreadEnter(const char* name) {
+  if (name) {
+    trace_events::SetThreadName(threading::current_thread_system_id(), name);
+  }
   MicroProfileOnThreadCreate(name);
 }
 
@@ -335,11 +343,15 @@ void Profiler::PostInputEvent() {
 
 bool Profiler::is_enabled() { return false; }
 bool Profiler::is_visible() { return false; }
-void Profiler::Initialize() {}
+void Profiler::Initialize() { trace_events::Initialize(); }
 void Profiler::Dump() {}
-void Profiler::Shutdown() {}
+void Profiler::Shutdown() { trace_events::Shutdown(); }
 uint32_t Profiler::GetColor(const char* str) { return 0; }
-void Profiler::ThreadEnter(const char* name) {}
+void Profiler::ThreadEnter(const char* name) {
+  if (name) {
+    trace_events::SetThreadName(threading::current_thread_system_id(), name);
+  }
+}
 void Profiler::ThreadExit() {}
 void Profiler::ToggleDisplay() {}
 void Profiler::TogglePause() {}
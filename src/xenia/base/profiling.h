@@ -16,6 +16,7 @@
 
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
+#include "xenia/base/trace_events.h"
 #include "xenia/ui/ui_drawer.h"
 #include "xenia/ui/virtual_key.h"
 #include "xenia/ui/window_listener.h"
@@ -70,15 +71,17 @@ namespace xe {
 
 // Enters a CPU profiling scope, active for the duration of the containing
 // block. No previous definition required.
-#define SCOPE_profile_cpu_i(group_name, scope_name) \
-  MICROPROFILE_SCOPEI(group_name, scope_name,       \
-                      xe::Profiler::GetColor(scope_name))
+#define SCOPE_profile_cpu_i(group_name, scope_name)        \
+  MICROPROFILE_SCOPEI(group_name, scope_name,              \
+                      xe::Profiler::GetColor(scope_name)); \
+  XE_TRACE_EVENTS_SCOPE(group_name, scope_name)
 
 // Enters a CPU profiling scope by function name, active for the duration of
 // the containing block. No previous definition required.
-#define SCOPE_profile_cpu_f(group_name)         \
-  MICROPROFILE_SCOPEI(group_name, __FUNCTION__, \
-                      xe::Profiler::GetColor(__FUNCTION__))
+#define SCOPE_profile_cpu_f(group_name)                      \
+  MICROPROFILE_SCOPEI(group_name, __FUNCTION__,              \
+                      xe::Profiler::GetColor(__FUNCTION__)); \
+  XE_TRACE_EVENTS_SCOPE(group_name, __FUNCTION__)
 
 // Enters a previously defined GPU profiling scope, active for the duration
 // of the containing block.
@@ -120,12 +123,12 @@ namespace xe {
 #define SCOPE_profile_cpu(name) \
   do {                          \
   } while (false)
-#define SCOPE_profile_cpu_f(name) \
-  do {                            \
-  } while (false)
+// Without microprofile, the CPU scopes are still recorded for the trace event
+// export.
+#define SCOPE_profile_cpu_f(group_name) \
+  XE_TRACE_EVENTS_SCOPE(group_name, __FUNCTION__)
 #define SCOPE_profile_cpu_i(group_name, scope_name) \
-  do {                                              \
-  } while (false)
+  XE_TRACE_EVENTS_SCOPE(group_name, scope_name)
 #define SCOPE_profile_gpu(name) \
   do {                          \
   } while (false)
@@ -0,0 +1,54 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "xenia/base/arena.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("ArenaAllocator vector", "[arena]") {
+  Arena arena(64_KiB);
+  std::vector<uint32_t, ArenaAllocator<uint32_t>> values{
+      ArenaAllocator<uint32_t>(arena)};
+  for (uint32_t i = 0; i < 1024; ++i) {
+    values.push_back(i);
+  }
+  for (uint32_t i = 0; i < 1024; ++i) {
+    REQUIRE(values[i] == i);
+  }
+  REQUIRE(arena.CalculateSize() >= sizeof(uint32_t) * 1024);
+}
+
+TEST_CASE("ArenaAllocator steady state", "[arena]") {
+  Arena arena(64_KiB);
+  size_t warm_chunk_bytes = 0;
+  for (uint32_t frame = 0; frame < 16; ++frame) {
+    {
+      std::vector<uint64_t, ArenaAllocator<uint64_t>> values{
+          ArenaAllocator<uint64_t>(arena)};
+      values.reserve(2048);
+      for (uint64_t i = 0; i < 2048; ++i) {
+        values.push_back(i * frame);
+      }
+      REQUIRE(values.back() == 2047 * uint64_t(frame));
+    }
+    arena.Reset();
+    if (!frame) {
+      warm_chunk_bytes = arena.chunk_bytes_allocated();
+    }
+    // No new chunks once the arena has grown to the frame's needs.
+    REQUIRE(arena.chunk_bytes_allocated() == warm_chunk_bytes);
+  }
+}
+
+}  // namespace xe::base::test
@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/atomic.h"
+#include "xenia/base/byte_order.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("Big-endian atomic max only moves forward", "[atomic]") {
+  SECTION("Earlier values are ignored") {
+    uint64_t value = xe::byte_swap(uint64_t(1000));
+    REQUIRE(atomic_store_max_be(uint64_t(999), &value) == 1000);
+    REQUIRE(xe::byte_swap(value) == 1000);
+    REQUIRE(atomic_store_max_be(uint64_t(1001), &value) == 1001);
+    REQUIRE(xe::byte_swap(value) == 1001);
+  }
+
+  SECTION("Wrapping around") {
+    uint32_t value = xe::byte_swap(uint32_t(0xFFFFFFF0u));
+    REQUIRE(atomic_store_max_be(uint32_t(0x10), &value) == 0x10);
+    REQUIRE(atomic_store_max_be(uint32_t(0xFFFFFFF8u), &value) == 0x10);
+    REQUIRE(xe::byte_swap(value) == 0x10);
+  }
+
+  SECTION("Concurrent writers and readers") {
+    // Writers publish the samples of a shared clock taken at different times,
+    // as a timer and the readers of the bundle do, so the samples arrive out
+    // of order.
+    constexpr uint32_t kThreadCount = 8;
+    constexpr uint32_t kIterations = 100000;
+    std::atomic<uint64_t> clock = {0};
+    uint64_t value = 0;
+    std::atomic<bool> went_backwards = {false};
+    std::vector<std::unique_ptr<std::thread>> threads;
+    for (uint32_t i = 0; i < kThreadCount; ++i) {
+      threads.emplace_back(std::make_unique<std::thread>([&]() {
+        uint64_t last_seen = 0;
+        for (uint32_t n = 0; n < kIterations; ++n) {
+          uint64_t sample = clock.fetch_add(1, std::memory_order_relaxed) + 1;
+          uint64_t seen = atomic_store_max_be(sample, &value);
+          if (seen < sample || seen < last_seen) {
+            went_backwards = true;
+          }
+          last_seen = seen;
+        }
+      }));
+    }
+    for (auto& thread : threads) {
+      thread->join();
+    }
+    REQUIRE(!went_backwards);
+    REQUIRE(xe::byte_swap(value) == uint64_t(kThreadCount) * kIterations);
+  }
+}
+
+}  // namespace xe::base::test
@@ -0,0 +1,614 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/arena.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/crypto.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/literals.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/ring_buffer.h"
+#include "xenia/base/simple_freelist.h"
+#include "xenia/base/split_map.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/type_pool.h"
+#include "xenia/base/xxhash.h"
+
+#if XE_ARCH_AMD64
+#include "xenia/base/platform_amd64.h"
+#endif
+
+#if XE_PLATFORM_LINUX
+#include <sys/resource.h>
+#endif
+
+DEFINE_path(base_bench_output_path, "",
+            "JSON file to write the results to, for comparing runs and "
+            "platforms.",
+            "Other");
+DEFINE_uint32(base_bench_iterations, 100000,
+              "Number of operations in each timed repetition of a benchmark.",
+              "Other");
+DEFINE_uint32(base_bench_repetitions, 5,
+              "Number of timed repetitions of each benchmark, the median and "
+              "the minimum are reported.",
+              "Other");
+DEFINE_uint32(base_bench_timer_ticks, 200,
+              "Number of timer queue callbacks measured for the accuracy.",
+              "Other");
+DEFINE_transient_string(base_bench_name, "",
+                        "Only run the benchmarks with names starting with "
+                        "this.",
+                        "General");
+
+namespace xe {
+namespace base {
+namespace test {
+
+using namespace xe::literals;
+using clock = std::chrono::steady_clock;
+
+struct BenchmarkResult {
+  std::string name;
+  uint64_t operations;
+  double median_ns_per_op;
+  double min_ns_per_op;
+  // Additional measurements, such as timer deviation.
+  std::vector<std::pair<std::string, double>> metrics;
+};
+
+// Written to after every benchmark so the compiler can't remove the work.
+volatile uint64_t benchmark_sink_;
+
+// Runs the body, which performs the given number of operations, a few times,
+// returning the median and the minimum time per operation.
+template <typename Body>
+void MeasureRepetitions(uint64_t operations, Body body,
+                        BenchmarkResult& result) {
+  uint32_t repetitions = std::max(cvars::base_bench_repetitions, uint32_t(1));
+  std::vector<double> ns_per_op;
+  ns_per_op.reserve(repetitions);
+  // Warm up the caches and the lazily allocated storage.
+  body();
+  for (uint32_t i = 0; i < repetitions; ++i) {
+    auto start = clock::now();
+    body();
+    auto end = clock::now();
+    ns_per_op.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count() /
+        double(std::max(operations, uint64_t(1))));
+  }
+  std::sort(ns_per_op.begin(), ns_per_op.end());
+  result.operations = operations;
+  result.median_ns_per_op = ns_per_op[ns_per_op.size() / 2];
+  result.min_ns_per_op = ns_per_op.front();
+}
+
+void BenchmarkRingBuffer(uint64_t iterations, BenchmarkResult& result) {
+  constexpr size_t kCapacity = 64_KiB;
+  auto buffer = std::make_unique<uint8_t[]>(kCapacity);
+  RingBuffer ring_buffer(buffer.get(), kCapacity);
+  MeasureRepetitions(
+      iterations,
+      [&]() {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+          uint32_t value = uint32_t(i);
+          ring_buffer.Write(value);
+          sum += ring_buffer.ReadAndSwap<uint32_t>();
+        }
+        benchmark_sink_ = sum;
+      },
+      result);
+}
+
+void BenchmarkSplitMap(uint64_t iterations, BenchmarkResult& result) {
+  constexpr uint32_t kKeyCount = 4096;
+  split_map<uint32_t, uint32_t> map;
+  map.reserve(kKeyCount);
+  for (uint32_t i = 0; i < kKeyCount; ++i) {
+    map.InsertAt(i * 2, i, i);
+  }
+  MeasureRepetitions(
+      iterations,
+      [&]() {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+          uint32_t key = uint32_t(i * 2654435761u) % (kKeyCount * 2);
+          uint32_t index = map.IndexForKey(key);
+          if (const uint32_t* value = map.ValueAt(index)) {
+            sum += *value;
+          }
+        }
+        benchmark_sink_ = sum;
+      },
+      result);
+}
+
+void BenchmarkSimpleFreelist(uint64_t iterations, BenchmarkResult& result) {
+  struct Entry {
+    uint64_t values[4];
+  };
+  constexpr size_t kEntryCount = 256;
+  std::vector<Entry> entries(kEntryCount);
+  SimpleFreelist<Entry> freelist;
+  for (Entry& entry : entries) {
+    freelist.DeleteEntry(&entry);
+  }
+  std::vector<Entry*> allocated(kEntryCount);
+  MeasureRepetitions(
+      iterations,
+      [&]() {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; i += kEntryCount) {
+          for (size_t j = 0; j < kEntryCount; ++j) {
+            allocated[j] = freelist.NewEntry();
+            sum += uintptr_t(allocated[j]);
+          }
+          for (size_t j = 0; j < kEntryCount; ++j) {
+            freelist.DeleteEntry(allocated[j]);
+          }
+        }
+        benchmark_sink_ = sum;
+      },
+      result);
+}
+
+void BenchmarkTypePool(uint64_t iterations, BenchmarkResult& result) {
+  struct Object {
+    explicit Object(uint32_t value) : value(value) {}
+    uint32_t value;
+  };
+  TypePool<Object, uint32_t> pool;
+  MeasureRepetitions(
+      iterations,
+      [&]() {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+          Object* object = pool.Allocate(uint32_t(i));
+          sum += object->value;
+          pool.Release(object);
+        }
+        benchmark_sink_ = sum;
+      },
+      result);
+}
+
+void BenchmarkArena(uint64_t iterations, BenchmarkResult& result) {
+  Arena arena(64_KiB);
+  MeasureRepetitions(
+      iterations,
+      [&]() {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+          // Resetting like once per translated function or submission.
+          if (!(i & 1023)) {
+            arena.Reset();
+          }
+          sum += uintptr_t(arena.Alloc(48, 8));
+        }
+        benchmark_sink_ = sum;
+      },
+      result);
+}
+
+void BenchmarkByteSwap(uint64_t iterations, BenchmarkResult& result) {
+  MeasureRepetitions(
+      iterations,
+      [&]() {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+          sum += xe::byte_swap(uint32_t(i)) + xe::byte_swap(uint64_t(sum));
+        }
+        benchmark_sink_ = sum;
+      },
+      result);
+}
+
+void BenchmarkCopyAndSwap(uint64_t iterations, BenchmarkResult& result) {
+  // Bytes per operation, like a vertex buffer upload.
+  constexpr size_t kBlockSize = 4096;
+  std::vector<uint32_t> source(kBlockSize / sizeof(uint32_t));
+  std::vector<uint32_t> dest(source.size());
+  for (size_t i = 0; i < source.size(); ++i) {
+    source[i] = uint32_t(i);
+  }
+  uint64_t block_count = std::max(iterations / 256, uint64_t(1));
+  MeasureRepetitions(
+      block_count,
+      [&]() {
+        for (uint64_t i = 0; i < block_count; ++i) {
+          xe::copy_and_swap_32_aligned(dest.data(), source.data(),
+                                       source.size());
+        }
+        benchmark_sink_ = dest[block_count % dest.size()];
+      },
+      result);
+  result.metrics.emplace_back(
+      "gib_per_s", double(kBlockSize) / result.median_ns_per_op *
+                       (1000000000.0 / double(1_GiB)));
+}
+
+void BenchmarkXXHash(uint64_t iterations, BenchmarkResult& result) {
+  constexpr size_t kBlockSize = 4096;
+  std::vector<uint8_t> data(kBlockSize);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = uint8_t(i * 31);
+  }
+  uint64_t block_count = std::max(iterations / 256, uint64_t(1));
+  MeasureRepetitions(
+      block_count,
+      [&]() {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < block_count; ++i) {
+          sum += XXH3_64bits_withSeed(data.data(), data.size(), i);
+        }
+        benchmark_sink_ = sum;
+      },
+      result);
+  result.metrics.emplace_back(
+      "gib_per_s", double(kBlockSize) / result.median_ns_per_op *
+                       (1000000000.0 / double(1_GiB)));
+}
+
+void BenchmarkAesCbcDecrypt(uint64_t iterations, BenchmarkResult& result) {
+  constexpr size_t kBlockSize = 4096;
+  std::vector<uint8_t> data(kBlockSize);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = uint8_t(i * 31);
+  }
+  uint8_t key[16] = {};
+  uint8_t round_keys[crypto::kAes128RoundKeysSize];
+  crypto::Aes128ExpandKey(key, round_keys);
+  uint8_t feed[crypto::kAesBlockSize] = {};
+  uint64_t block_count = std::max(iterations / 256, uint64_t(1));
+  MeasureRepetitions(
+      block_count,
+      [&]() {
+        for (uint64_t i = 0; i < block_count; ++i) {
+          crypto::Aes128DecryptCbc(round_keys, data.data(), data.data(),
+                                   kBlockSize / crypto::kAesBlockSize, feed);
+        }
+        benchmark_sink_ = data[0];
+      },
+      result);
+  result.metrics.emplace_back(
+      "gib_per_s", double(kBlockSize) / result.median_ns_per_op *
+                       (1000000000.0 / double(1_GiB)));
+}
+
+void BenchmarkSha256(uint64_t iterations, BenchmarkResult& result) {
+  constexpr size_t kBlockSize = 4096;
+  std::vector<uint8_t> data(kBlockSize);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = uint8_t(i * 31);
+  }
+  uint32_t state[8] = {};
+  uint64_t block_count = std::max(iterations / 256, uint64_t(1));
+  MeasureRepetitions(
+      block_count,
+      [&]() {
+        for (uint64_t i = 0; i < block_count; ++i) {
+          crypto::Sha256ProcessBlocks(state, data.data(),
+                                      kBlockSize / crypto::kShaBlockSize);
+        }
+        benchmark_sink_ = state[0];
+      },
+      result);
+  result.metrics.emplace_back(
+      "gib_per_s", double(kBlockSize) / result.median_ns_per_op *
+                       (1000000000.0 / double(1_GiB)));
+}
+
+// Context switches of the whole process, where the host reports them.
+bool GetContextSwitchCount(uint64_t& count_out) {
+#if XE_PLATFORM_LINUX
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    return false;
+  }
+  count_out = uint64_t(usage.ru_nvcsw) + uint64_t(usage.ru_nivcsw);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Ping-pong between two threads, each operation is a signal and a wake-up of
+// the other thread, so a round trip is two operations. The idle waiters are
+// threads blocked on other objects for the whole benchmark, which signaling
+// the ping-pong objects must not wake.
+void BenchmarkWaitLatency(
+    uint64_t iterations, BenchmarkResult& result,
+    const std::function<std::unique_ptr<threading::WaitHandle>()>& create,
+    const std::function<void(threading::WaitHandle*)>& signal,
+    uint32_t idle_waiter_count = 0) {
+  std::vector<std::unique_ptr<threading::Event>> idle_waiter_events;
+  std::vector<std::unique_ptr<threading::Thread>> idle_waiters;
+  for (uint32_t i = 0; i < idle_waiter_count; ++i) {
+    threading::Event* event =
+        idle_waiter_events
+            .emplace_back(threading::Event::CreateManualResetEvent(false))
+            .get();
+    threading::Thread::CreationParameters params;
+    idle_waiters.push_back(threading::Thread::Create(
+        params, [event]() { threading::Wait(event, false); }));
+  }
+  uint64_t round_trips = std::max(iterations / 100, uint64_t(1));
+  std::unique_ptr<threading::WaitHandle> ping = create();
+  std::unique_ptr<threading::WaitHandle> pong = create();
+  std::atomic<uint64_t> remaining_round_trips{0};
+  std::unique_ptr<threading::Event> start_event =
+      threading::Event::CreateAutoResetEvent(false);
+  std::atomic<bool> shutdown{false};
+  threading::Thread::CreationParameters params;
+  auto thread = threading::Thread::Create(params, [&]() {
+    while (true) {
+      threading::Wait(start_event.get(), false);
+      if (shutdown.load(std::memory_order_relaxed)) {
+        break;
+      }
+      uint64_t count = remaining_round_trips.load(std::memory_order_relaxed);
+      for (uint64_t i = 0; i < count; ++i) {
+        threading::Wait(ping.get(), false);
+        signal(pong.get());
+      }
+    }
+  });
+  thread->set_name("Benchmark Wait Latency");
+  uint64_t context_switches_start = 0;
+  bool context_switches_measured =
+      GetContextSwitchCount(context_switches_start);
+  MeasureRepetitions(
+      round_trips * 2,
+      [&]() {
+        remaining_round_trips.store(round_trips, std::memory_order_relaxed);
+        start_event->Set();
+        for (uint64_t i = 0; i < round_trips; ++i) {
+          signal(ping.get());
+          threading::Wait(pong.get(), false);
+        }
+      },
+      result);
+  uint64_t context_switches_end = 0;
+  if (context_switches_measured &&
+      GetContextSwitchCount(context_switches_end)) {
+    // Including the warm-up repetition.
+    uint32_t repetitions =
+        std::max(cvars::base_bench_repetitions, uint32_t(1)) + 1;
+    result.metrics.emplace_back(
+        "context_switches_per_op",
+        double(context_switches_end - context_switches_start) /
+            double(round_trips * 2 * repetitions));
+  }
+  shutdown.store(true, std::memory_order_relaxed);
+  start_event->Set();
+  threading::Wait(thread.get(), false);
+  for (size_t i = 0; i < idle_waiters.size(); ++i) {
+    idle_waiter_events[i]->Set();
+    threading::Wait(idle_waiters[i].get(), false);
+  }
+}
+
+void BenchmarkEventLatency(uint64_t iterations, BenchmarkResult& result) {
+  BenchmarkWaitLatency(
+      iterations, result,
+      []() -> std::unique_ptr<threading::WaitHandle> {
+        return threading::Event::CreateAutoResetEvent(false);
+      },
+      [](threading::WaitHandle* handle) {
+        static_cast<threading::Event*>(handle)->Set();
+      });
+}
+
+void BenchmarkEventLatencyIdleWaiters(uint64_t iterations,
+                                      BenchmarkResult& result) {
+  BenchmarkWaitLatency(
+      iterations, result,
+      []() -> std::unique_ptr<threading::WaitHandle> {
+        return threading::Event::CreateAutoResetEvent(false);
+      },
+      [](threading::WaitHandle* handle) {
+        static_cast<threading::Event*>(handle)->Set();
+      },
+      16);
+}
+
+void BenchmarkSemaphoreLatency(uint64_t iterations, BenchmarkResult& result) {
+  BenchmarkWaitLatency(
+      iterations, result,
+      []() -> std::unique_ptr<threading::WaitHandle> {
+        return threading::Semaphore::Create(0, 1);
+      },
+      [](threading::WaitHandle* handle) {
+        static_cast<threading::Semaphore*>(handle)->Release(1, nullptr);
+      });
+}
+
+// Deviation of the timer queue callbacks from the 1 ms period.
+void BenchmarkTimerQueueAccuracy(uint64_t iterations,
+                                 BenchmarkResult& result) {
+  constexpr auto kPeriod = std::chrono::milliseconds(1);
+  uint32_t tick_count = std::max(cvars::base_bench_timer_ticks, uint32_t(2));
+  std::vector<clock::time_point> ticks;
+  ticks.reserve(tick_count);
+  std::unique_ptr<threading::Event> done_event =
+      threading::Event::CreateManualResetEvent(false);
+  {
+    auto timer =
+        threading::HighResolutionTimer::CreateRepeating(kPeriod, [&]() {
+          if (ticks.size() < tick_count) {
+            ticks.push_back(clock::now());
+            if (ticks.size() == tick_count) {
+              done_event->Set();
+            }
+          }
+        });
+    threading::Wait(done_event.get(), false);
+  }
+  double period_ns = std::chrono::duration<double, std::nano>(kPeriod).count();
+  double error_sum_ns = 0.0, error_max_ns = 0.0;
+  std::vector<double> errors_ns;
+  errors_ns.reserve(tick_count - 1);
+  for (uint32_t i = 1; i < tick_count; ++i) {
+    double interval_ns =
+        std::chrono::duration<double, std::nano>(ticks[i] - ticks[i - 1])
+            .count();
+    double error_ns = std::abs(interval_ns - period_ns);
+    errors_ns.push_back(error_ns);
+    error_sum_ns += error_ns;
+    error_max_ns = std::max(error_max_ns, error_ns);
+  }
+  std::sort(errors_ns.begin(), errors_ns.end());
+  double total_ns =
+      std::chrono::duration<double, std::nano>(ticks.back() - ticks.front())
+          .count();
+  result.operations = tick_count - 1;
+  result.median_ns_per_op = total_ns / (tick_count - 1);
+  result.min_ns_per_op = result.median_ns_per_op;
+  result.metrics.emplace_back("mean_error_us",
+                              error_sum_ns / errors_ns.size() / 1000.0);
+  result.metrics.emplace_back("median_error_us",
+                              errors_ns[errors_ns.size() / 2] / 1000.0);
+  result.metrics.emplace_back("max_error_us", error_max_ns / 1000.0);
+}
+
+struct Benchmark {
+  const char* name;
+  void (*function)(uint64_t iterations, BenchmarkResult& result);
+  // Null if the benchmark can run on any host.
+  bool (*is_supported)();
+};
+
+const Benchmark kBenchmarks[] = {
+    {"ring_buffer_write_read", BenchmarkRingBuffer},
+    {"split_map_lookup", BenchmarkSplitMap},
+    {"simple_freelist_new_delete", BenchmarkSimpleFreelist},
+    {"type_pool_allocate_release", BenchmarkTypePool},
+    {"arena_alloc", BenchmarkArena},
+    {"byte_swap", BenchmarkByteSwap},
+    {"copy_and_swap_32_4k", BenchmarkCopyAndSwap},
+    {"xxh3_64_4k", BenchmarkXXHash},
+    {"aes_128_cbc_decrypt_4k", BenchmarkAesCbcDecrypt,
+     crypto::IsAesAccelerated},
+    {"sha256_4k", BenchmarkSha256, crypto::IsShaAccelerated},
+    {"event_wait_signal", BenchmarkEventLatency},
+    {"event_wait_signal_16_idle_waiters", BenchmarkEventLatencyIdleWaiters},
+    {"semaphore_wait_release", BenchmarkSemaphoreLatency},
+    {"timer_queue_1ms", BenchmarkTimerQueueAccuracy},
+};
+
+const char* GetPlatformName() {
+#if XE_PLATFORM_WIN32
+  return "windows";
+#elif XE_PLATFORM_ANDROID
+  return "android";
+#elif XE_PLATFORM_LINUX
+  return "linux";
+#elif XE_PLATFORM_MAC
+  return "mac";
+#else
+  return "unknown";
+#endif
+}
+
+// The names only contain identifier characters, no JSON escaping needed.
+bool WriteResults(const std::filesystem::path& path,
+                  const std::vector<BenchmarkResult>& results) {
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Unable to open {} to write the benchmark results",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  fmt::print(file, "{{\n  \"platform\": \"{}\",\n", GetPlatformName());
+  fmt::print(file, "  \"repetitions\": {},\n  \"benchmarks\": [",
+             cvars::base_bench_repetitions);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchmarkResult& result = results[i];
+    fmt::print(file,
+               "{}\n    {{\"name\": \"{}\", \"operations\": {}, "
+               "\"median_ns_per_op\": {:.3f}, \"min_ns_per_op\": {:.3f}",
+               i ? "," : "", result.name, result.operations,
+               result.median_ns_per_op, result.min_ns_per_op);
+    for (const auto& metric : result.metrics) {
+      fmt::print(file, ", \"{}\": {:.3f}", metric.first, metric.second);
+    }
+    fmt::print(file, "}}");
+  }
+  fmt::print(file, "\n  ]\n}}\n");
+  fclose(file);
+  return true;
+}
+
+bool RunBenchmarks(const std::string_view bench_name) {
+  uint64_t iterations = std::max(cvars::base_bench_iterations, uint32_t(1));
+  XELOGI("Running the base benchmarks on {}, {} iterations, {} repetitions.",
+         GetPlatformName(), iterations, cvars::base_bench_repetitions);
+  std::vector<BenchmarkResult> results;
+  for (const Benchmark& benchmark : kBenchmarks) {
+    if (!bench_name.empty() &&
+        std::string_view(benchmark.name).substr(0, bench_name.size()) !=
+            bench_name) {
+      continue;
+    }
+    if (benchmark.is_supported && !benchmark.is_supported()) {
+      XELOGI("  - {}: not supported on this host", benchmark.name);
+      continue;
+    }
+    BenchmarkResult result;
+    result.name = benchmark.name;
+    benchmark.function(iterations, result);
+    std::string metrics;
+    for (const auto& metric : result.metrics) {
+      metrics += fmt::format(", {} {:.3f}", metric.first, metric.second);
+    }
+    XELOGI("  - {}: {:.2f} ns/op median, {:.2f} ns/op min{}", result.name,
+           result.median_ns_per_op, result.min_ns_per_op, metrics);
+    results.push_back(std::move(result));
+  }
+  if (results.empty()) {
+    XELOGE("No benchmarks matching {}", bench_name);
+    return false;
+  }
+  if (!cvars::base_bench_output_path.empty() &&
+      !WriteResults(cvars::base_bench_output_path, results)) {
+    return false;
+  }
+  return true;
+}
+
+int main(const std::vector<std::string>& args) {
+#if XE_ARCH_AMD64
+  amd64::InitFeatureFlags();
+#endif
+  return RunBenchmarks(cvars::base_bench_name) ? 0 : 1;
+}
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-base-benchmark", xe::base::test::main,
+                      "[benchmark name]", "base_bench_name");
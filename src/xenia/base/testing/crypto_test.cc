@@ -0,0 +1,185 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "xenia/base/crypto.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64
+#include "xenia/base/platform_amd64.h"
+#endif
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+namespace {
+
+void InitFeatureFlags() {
+#if XE_ARCH_AMD64
+  amd64::InitFeatureFlags();
+#endif
+}
+
+// The message padded to a single block as done on finalization.
+void PadShaBlock(const char* message, uint8_t* block) {
+  size_t length = std::strlen(message);
+  std::memset(block, 0, crypto::kShaBlockSize);
+  std::memcpy(block, message, length);
+  block[length] = 0x80;
+  block[crypto::kShaBlockSize - 1] = uint8_t(length * 8);
+}
+
+}  // namespace
+
+TEST_CASE("Sha1ProcessBlocks", "[crypto]") {
+  InitFeatureFlags();
+  if (!crypto::IsShaAccelerated()) {
+    return;
+  }
+  uint8_t block[crypto::kShaBlockSize];
+  PadShaBlock("abc", block);
+  uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                       0xC3D2E1F0};
+  crypto::Sha1ProcessBlocks(state, block, 1);
+  REQUIRE(state[0] == 0xA9993E36);
+  REQUIRE(state[1] == 0x4706816A);
+  REQUIRE(state[2] == 0xBA3E2571);
+  REQUIRE(state[3] == 0x7850C26C);
+  REQUIRE(state[4] == 0x9CD0D89D);
+}
+
+TEST_CASE("Sha256ProcessBlocks", "[crypto]") {
+  InitFeatureFlags();
+  if (!crypto::IsShaAccelerated()) {
+    return;
+  }
+  uint8_t block[crypto::kShaBlockSize];
+  PadShaBlock("abc", block);
+  uint32_t state[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                       0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+  crypto::Sha256ProcessBlocks(state, block, 1);
+  const uint32_t expected[8] = {0xBA7816BF, 0x8F01CFEA, 0x414140DE,
+                                0x5DAE2223, 0xB00361A3, 0x96177A9C,
+                                0xB410FF61, 0xF20015AD};
+  REQUIRE(std::memcmp(state, expected, sizeof(state)) == 0);
+}
+
+TEST_CASE("Aes128ExpandKey", "[crypto]") {
+  InitFeatureFlags();
+  if (!crypto::IsAesAccelerated()) {
+    return;
+  }
+  // FIPS-197 appendix A.1.
+  const uint8_t key[16] = {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                           0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C};
+  const uint8_t last_round_key[16] = {0xD0, 0x14, 0xF9, 0xA8, 0xC9, 0xEE,
+                                      0x25, 0x89, 0xE1, 0x3F, 0x0C, 0xC8,
+                                      0xB6, 0x63, 0x0C, 0xA6};
+  uint8_t round_keys[crypto::kAes128RoundKeysSize];
+  crypto::Aes128ExpandKey(key, round_keys);
+  REQUIRE(std::memcmp(round_keys, key, sizeof(key)) == 0);
+  REQUIRE(std::memcmp(round_keys + crypto::kAes128RoundKeysSize -
+                          crypto::kAesBlockSize,
+                      last_round_key, sizeof(last_round_key)) == 0);
+}
+
+TEST_CASE("Aes128Ecb", "[crypto]") {
+  InitFeatureFlags();
+  if (!crypto::IsAesAccelerated()) {
+    return;
+  }
+  // FIPS-197 appendix C.1.
+  uint8_t key[16];
+  uint8_t plaintext[16];
+  for (uint8_t i = 0; i < 16; ++i) {
+    key[i] = i;
+    plaintext[i] = uint8_t(i * 0x11);
+  }
+  const uint8_t ciphertext[16] = {0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B,
+                                  0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80,
+                                  0x70, 0xB4, 0xC5, 0x5A};
+  uint8_t round_keys[crypto::kAes128RoundKeysSize];
+  crypto::Aes128ExpandKey(key, round_keys);
+  // More than the blocks decrypted at once, for both paths.
+  constexpr size_t kBlockCount = 7;
+  std::vector<uint8_t> data(crypto::kAesBlockSize * kBlockCount);
+  for (size_t i = 0; i < kBlockCount; ++i) {
+    std::memcpy(data.data() + crypto::kAesBlockSize * i, plaintext,
+                sizeof(plaintext));
+  }
+  crypto::Aes128EncryptEcb(round_keys, data.data(), data.data(), kBlockCount);
+  for (size_t i = 0; i < kBlockCount; ++i) {
+    REQUIRE(std::memcmp(data.data() + crypto::kAesBlockSize * i, ciphertext,
+                        sizeof(ciphertext)) == 0);
+  }
+  crypto::Aes128DecryptEcb(round_keys, data.data(), data.data(), kBlockCount);
+  for (size_t i = 0; i < kBlockCount; ++i) {
+    REQUIRE(std::memcmp(data.data() + crypto::kAesBlockSize * i, plaintext,
+                        sizeof(plaintext)) == 0);
+  }
+}
+
+TEST_CASE("Aes128Cbc", "[crypto]") {
+  InitFeatureFlags();
+  if (!crypto::IsAesAccelerated()) {
+    return;
+  }
+  uint8_t key[16];
+  for (uint8_t i = 0; i < 16; ++i) {
+    key[i] = uint8_t(i * 7 + 3);
+  }
+  uint8_t round_keys[crypto::kAes128RoundKeysSize];
+  crypto::Aes128ExpandKey(key, round_keys);
+  constexpr size_t kBlockCount = 11;
+  std::vector<uint8_t> plaintext(crypto::kAesBlockSize * kBlockCount);
+  for (size_t i = 0; i < plaintext.size(); ++i) {
+    plaintext[i] = uint8_t(i * 31);
+  }
+  uint8_t iv[crypto::kAesBlockSize];
+  for (uint8_t i = 0; i < crypto::kAesBlockSize; ++i) {
+    iv[i] = uint8_t(0xF0 - i);
+  }
+
+  // Chaining through ECB encryption of single blocks.
+  std::vector<uint8_t> expected(plaintext.size());
+  uint8_t chain[crypto::kAesBlockSize];
+  std::memcpy(chain, iv, sizeof(iv));
+  for (size_t i = 0; i < kBlockCount; ++i) {
+    for (size_t j = 0; j < crypto::kAesBlockSize; ++j) {
+      chain[j] ^= plaintext[crypto::kAesBlockSize * i + j];
+    }
+    crypto::Aes128EncryptEcb(round_keys, chain, chain, 1);
+    std::memcpy(expected.data() + crypto::kAesBlockSize * i, chain,
+                sizeof(chain));
+  }
+
+  // Encrypting in two calls to check the continuation with the feed.
+  std::vector<uint8_t> data(plaintext);
+  uint8_t feed[crypto::kAesBlockSize];
+  std::memcpy(feed, iv, sizeof(iv));
+  crypto::Aes128EncryptCbc(round_keys, data.data(), data.data(), 5, feed);
+  crypto::Aes128EncryptCbc(
+      round_keys, data.data() + crypto::kAesBlockSize * 5,
+      data.data() + crypto::kAesBlockSize * 5, kBlockCount - 5, feed);
+  REQUIRE(data == expected);
+  REQUIRE(std::memcmp(feed, chain, sizeof(feed)) == 0);
+
+  std::memcpy(feed, iv, sizeof(iv));
+  crypto::Aes128DecryptCbc(round_keys, data.data(), data.data(), 6, feed);
+  crypto::Aes128DecryptCbc(
+      round_keys, data.data() + crypto::kAesBlockSize * 6,
+      data.data() + crypto::kAesBlockSize * 6, kBlockCount - 6, feed);
+  REQUIRE(data == plaintext);
+  REQUIRE(std::memcmp(feed, chain, sizeof(feed)) == 0);
+}
+
+}  // namespace xe::base::test
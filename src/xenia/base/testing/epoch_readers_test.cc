@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/epoch_readers.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+TEST_CASE("Epoch readers never see removed objects as released",
+          "[epoch_readers]") {
+  constexpr uint32_t kAlive = 0xA11FE;
+  constexpr uint32_t kReleased = 0xDEAD;
+  struct Object {
+    std::atomic<uint32_t> state = {kAlive};
+  };
+
+  EpochReaders readers;
+  // Never freed during the test, so using a released object is detected
+  // without undefined behavior.
+  std::vector<std::unique_ptr<Object>> objects;
+  objects.reserve(20001);
+  objects.push_back(std::make_unique<Object>());
+  std::atomic<Object*> slot = {objects.back().get()};
+
+  std::atomic<bool> stop = {false};
+  std::atomic<uint64_t> released_seen = {0};
+  std::vector<std::thread> reader_threads;
+  for (uint32_t i = 0; i < 8; ++i) {
+    reader_threads.emplace_back([&]() {
+      while (!stop.load(std::memory_order_relaxed)) {
+        uint32_t token = readers.BeginRead();
+        Object* object = slot.load(std::memory_order_seq_cst);
+        if (object) {
+          // Giving the writer time to release the object.
+          std::this_thread::yield();
+          if (object->state.load(std::memory_order_seq_cst) != kAlive) {
+            released_seen.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+        readers.EndRead(token);
+      }
+    });
+  }
+
+  // Removing and releasing like the object table.
+  for (uint32_t i = 0; i < 10000; ++i) {
+    Object* removed = slot.exchange(nullptr, std::memory_order_seq_cst);
+    readers.WaitForReaders();
+    removed->state.store(kReleased, std::memory_order_seq_cst);
+    objects.push_back(std::make_unique<Object>());
+    slot.store(objects.back().get(), std::memory_order_seq_cst);
+    if (!(i & 1)) {
+      // Advancing the epoch with nothing removed too, so the parity readers
+      // load may be different from the one when they increment the counter.
+      readers.WaitForReaders();
+    }
+  }
+
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread& thread : reader_threads) {
+    thread.join();
+  }
+  REQUIRE(released_seen.load() == 0);
+}
+
+}  // namespace xe::base::test
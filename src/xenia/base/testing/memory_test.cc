@@ -15,6 +15,8 @@
 #include "xenia/base/clock.h"
 
 #include <array>
+#include <chrono>
+#include <vector>
 
 namespace xe {
 namespace base {
@@ -506,6 +508,157 @@ TEST_CASE("copy_and_swap_16_in_32_unaligned", "[copy_and_swap]") {
   }
 }
 
+TEST_CASE("fill_32", "[bulk_memory]") {
+  // Lengths around the vector widths, at an unaligned offset.
+  for (size_t count = 0; count <= 41; ++count) {
+    std::vector<uint32_t> dest(count + 2, 0x11111111);
+    fill_32(&dest[1], 0x89ABCDEF, count);
+    REQUIRE(dest.front() == 0x11111111);
+    REQUIRE(dest.back() == 0x11111111);
+    for (size_t i = 1; i <= count; ++i) {
+      REQUIRE(dest[i] == 0x89ABCDEF);
+    }
+  }
+}
+
+TEST_CASE("count_leading_equal_32", "[bulk_memory]") {
+  std::vector<uint32_t> src(41, 0x01234567);
+  REQUIRE(count_leading_equal_32(src.data(), 0x01234567, 0) == 0);
+  REQUIRE(count_leading_equal_32(src.data(), 0x01234567, src.size()) ==
+          src.size());
+  REQUIRE(count_leading_equal_32(src.data(), 0x76543210, src.size()) == 0);
+  for (size_t i = 0; i < src.size(); ++i) {
+    src[i] = 0;
+    REQUIRE(count_leading_equal_32(src.data(), 0x01234567, src.size()) == i);
+    src[i] = 0x01234567;
+  }
+}
+
+TEST_CASE("find_32", "[bulk_memory]") {
+  std::vector<uint32_t> src(67);
+  for (size_t i = 0; i < src.size(); ++i) {
+    src[i] = uint32_t(i % 5);
+  }
+  const uint32_t values[] = {3, 4, 0, 1};
+  REQUIRE(find_32(src.data(), src.size(), values, 4) == 3);
+  REQUIRE(find_32(src.data() + 4, src.size() - 4, values, 4) == 4);
+  const uint32_t missing[] = {3, 3};
+  REQUIRE(find_32(src.data(), src.size(), missing, 2) == src.size());
+  // The whole sequence must be within the range.
+  src[src.size() - 1] = 7;
+  const uint32_t last[] = {7, 8};
+  REQUIRE(find_32(src.data(), src.size(), last, 2) == src.size());
+  REQUIRE(find_32(src.data(), src.size(), last, 1) == src.size() - 1);
+  REQUIRE(find_32(src.data(), 0, last, 1) == 0);
+}
+
+TEST_CASE("count_equal_bytes", "[bulk_memory]") {
+  std::vector<uint8_t> src1(77), src2(77);
+  size_t expected = 0;
+  for (size_t i = 0; i < src1.size(); ++i) {
+    src1[i] = uint8_t(i);
+    src2[i] = uint8_t(i % 3 ? i : i + 1);
+    expected += src1[i] == src2[i];
+  }
+  REQUIRE(count_equal_bytes(src1.data(), src2.data(), src1.size()) ==
+          expected);
+  REQUIRE(count_equal_bytes(src1.data(), src1.data(), src1.size()) ==
+          src1.size());
+}
+
+TEST_CASE("find_zero_16", "[bulk_memory]") {
+  std::vector<uint16_t> src(67, 0x4100);
+  // At every offset relative to the alignment of the vector loads.
+  for (size_t offset = 0; offset < 8; ++offset) {
+    for (size_t i = offset; i < src.size(); ++i) {
+      src[i] = 0;
+      REQUIRE(find_zero_16(&src[offset], src.size() - offset) == i - offset);
+      // Not beyond the maximum count.
+      REQUIRE(find_zero_16(&src[offset], (i - offset) / 2) ==
+              (i - offset) / 2);
+      src[i] = 0x4100;
+    }
+  }
+  REQUIRE(find_zero_16(src.data(), src.size()) == src.size());
+}
+
+TEST_CASE("widen_8_to_16_swapped", "[bulk_memory]") {
+  std::vector<uint8_t> src(41);
+  for (size_t i = 0; i < src.size(); ++i) {
+    src[i] = uint8_t(i * 7);
+  }
+  std::vector<uint16_t> dest(src.size() + 1, 0x1111);
+  widen_8_to_16_swapped(dest.data(), src.data(), src.size());
+  for (size_t i = 0; i < src.size(); ++i) {
+    REQUIRE(xe::load_and_swap<uint16_t>(&dest[i]) == src[i]);
+  }
+  REQUIRE(dest.back() == 0x1111);
+}
+
+TEST_CASE("narrow_16_swapped_to_8", "[bulk_memory]") {
+  std::vector<uint16_t> src(41);
+  for (size_t i = 0; i < src.size(); ++i) {
+    xe::store_and_swap<uint16_t>(&src[i],
+                                 uint16_t(i % 3 ? i * 7 : 0x100 + i));
+  }
+  std::vector<uint8_t> dest(src.size() + 1, 0x11);
+  narrow_16_swapped_to_8(dest.data(), src.data(), src.size(), '?');
+  for (size_t i = 0; i < src.size(); ++i) {
+    REQUIRE(dest[i] == (i % 3 ? uint8_t(i * 7) : uint8_t('?')));
+  }
+  REQUIRE(dest.back() == 0x11);
+}
+
+// Throughput of the bulk routines, not run by default.
+TEST_CASE("bulk_memory_throughput", "[.][bulk_memory][benchmark]") {
+  constexpr size_t kCount = 16 * 1024 * 1024;
+  constexpr size_t kIterations = 16;
+  std::vector<uint32_t> src(kCount, 0x01234567), dest(kCount);
+  auto measure = [&](const char* name, auto&& function) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kIterations; ++i) {
+      function();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    WARN(fmt::format("{}: {:.2f} GB/s", name,
+                     double(kCount * sizeof(uint32_t) * kIterations) /
+                         (seconds * 1e9)));
+  };
+  measure("copy_and_swap_16_unaligned", [&]() {
+    copy_and_swap_16_unaligned(dest.data(), src.data(), kCount * 2);
+  });
+  measure("copy_and_swap_32_unaligned", [&]() {
+    copy_and_swap_32_unaligned(dest.data(), src.data(), kCount);
+  });
+  measure("copy_and_swap_64_unaligned", [&]() {
+    copy_and_swap_64_unaligned(dest.data(), src.data(), kCount / 2);
+  });
+  measure("fill_32", [&]() { fill_32(dest.data(), 0x89ABCDEF, kCount); });
+  measure("count_leading_equal_32", [&]() {
+    REQUIRE(count_leading_equal_32(src.data(), 0x01234567, kCount) ==
+            kCount);
+  });
+  const uint32_t values[] = {0x01234567, 0x89ABCDEF};
+  measure("find_32", [&]() {
+    REQUIRE(find_32(src.data(), kCount, values, 2) == kCount);
+  });
+  measure("count_equal_bytes", [&]() {
+    REQUIRE(count_equal_bytes(src.data(), src.data(), kCount * 4) ==
+            kCount * 4);
+  });
+  measure("find_zero_16", [&]() {
+    REQUIRE(find_zero_16(src.data(), kCount * 2) == kCount * 2);
+  });
+  measure("widen_8_to_16_swapped", [&]() {
+    widen_8_to_16_swapped(dest.data(), src.data(), kCount * 2);
+  });
+  measure("narrow_16_swapped_to_8", [&]() {
+    narrow_16_swapped_to_8(dest.data(), src.data(), kCount * 2, '?');
+  });
+}
+
 TEST_CASE("create_and_close_file_mapping", "Virtual Memory Mapping") {
   auto path = fmt::format("xenia_test_{}", Clock::QueryHostTickCount());
   auto memory = xe::memory::CreateFileMappingHandle(
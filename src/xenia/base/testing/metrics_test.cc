@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/metrics.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe::base::test {
+
+namespace {
+metrics::Counter test_counter("xenia_test_counter_total", "Test counter.");
+metrics::Gauge test_gauge("xenia_test_gauge", "Test gauge.");
+metrics::Histogram test_histogram("xenia_test_histogram", "Test\nhistogram.",
+                                  {10, 100});
+}  // namespace
+
+TEST_CASE("Metrics counter sums the shards of all threads", "[metrics]") {
+  uint64_t initial_value = test_counter.value();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < metrics::kShardCount * 2; ++i) {
+    threads.emplace_back([]() {
+      for (uint32_t j = 0; j < 1000; ++j) {
+        test_counter.Add();
+      }
+      test_counter.Add(5);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(test_counter.value() - initial_value ==
+          metrics::kShardCount * 2 * 1005);
+}
+
+TEST_CASE("Metrics histogram buckets", "[metrics]") {
+  metrics::Histogram::Snapshot initial = test_histogram.GetSnapshot();
+  test_histogram.Observe(0);
+  test_histogram.Observe(10);
+  test_histogram.Observe(11);
+  test_histogram.Observe(1000);
+  metrics::Histogram::Snapshot snapshot = test_histogram.GetSnapshot();
+  REQUIRE(snapshot.bucket_counts.size() == 3);
+  REQUIRE(snapshot.bucket_counts[0] - initial.bucket_counts[0] == 2);
+  REQUIRE(snapshot.bucket_counts[1] - initial.bucket_counts[1] == 1);
+  REQUIRE(snapshot.bucket_counts[2] - initial.bucket_counts[2] == 1);
+  REQUIRE(snapshot.count - initial.count == 4);
+  REQUIRE(snapshot.sum - initial.sum == 1021);
+}
+
+TEST_CASE("Metrics text format", "[metrics]") {
+  test_gauge.Set(-3);
+  std::string text;
+  metrics::FormatText(text);
+  REQUIRE(text.find("# HELP xenia_test_gauge Test gauge.\n"
+                    "# TYPE xenia_test_gauge gauge\n"
+                    "xenia_test_gauge -3\n") != std::string::npos);
+  REQUIRE(text.find("# HELP xenia_test_histogram Test\\nhistogram.\n"
+                    "# TYPE xenia_test_histogram histogram\n"
+                    "xenia_test_histogram_bucket{le=\"10\"} ") !=
+          std::string::npos);
+  REQUIRE(text.find("xenia_test_histogram_bucket{le=\"+Inf\"} ") !=
+          std::string::npos);
+  REQUIRE(text.find("# TYPE xenia_test_counter_total counter\n") !=
+          std::string::npos);
+}
+
+}  // namespace xe::base::test
@@ -7,3 +7,22 @@ test_suite("xenia-base-tests", project_root, ".", {
     "xenia-base",
   },
 })
+
+group("tests")
+project("xenia-base-benchmark")
+  uuid("c4f1e93a-7d2b-4a6e-b8f0-5e1d3a9c2b74")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "xenia-base",
+  })
+  files({
+    "base_benchmark_main.cc",
+    "../console_app_main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Windows")
+    debugdir(project_root)
+
+    -- xenia-base needs this
+    links({"xenia-ui"})
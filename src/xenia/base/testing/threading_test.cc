@@ -303,6 +303,24 @@ TEST_CASE("HighResolutionTimer") {
   }
 }
 
+TEST_CASE("HighResolutionTimer statistics", "[timer]") {
+  // Both timers are first due when created, and not again before destroyed.
+  std::atomic<uint32_t> counter(0);
+  auto cb = [&counter] { ++counter; };
+  TimerQueueStatistics statistics_before = GetTimerQueueStatistics();
+  auto pTimer1 = HighResolutionTimer::CreateRepeating(200ms, cb);
+  Sleep(5ms);
+  auto pTimer2 = HighResolutionTimer::CreateRepeating(200ms, cb);
+  Sleep(100ms);
+  pTimer1.reset();
+  pTimer2.reset();
+  TimerQueueStatistics statistics_after = GetTimerQueueStatistics();
+  REQUIRE(counter == 2);
+  REQUIRE(statistics_after.callback_count - statistics_before.callback_count ==
+          2);
+  REQUIRE(statistics_after.wake_up_count > statistics_before.wake_up_count);
+}
+
 TEST_CASE("Wait on Multiple Handles", "[wait]") {
   auto mutant = Mutant::Create(true);
   REQUIRE(mutant);
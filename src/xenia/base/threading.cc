@@ -9,6 +9,8 @@
 
 #include "xenia/base/threading.h"
 
+#include "xenia/base/trace_events.h"
+
 namespace xe {
 namespace threading {
 
@@ -29,5 +31,10 @@ uint32_t current_thread_id() {
 
 void set_current_thread_id(uint32_t id) { current_thread_id_ = id; }
 
+void Thread::set_name(std::string name) {
+  trace_events::SetThreadName(system_id(), name);
+  name_ = std::move(name);
+}
+
 }  // namespace threading
 }  // namespace xe
@@ -90,6 +90,11 @@ class Fence {
 // Returns the total number of logical processors in the host system.
 uint32_t logical_processor_count();
 
+// Returns the affinity mask of the logical processors of the host NUMA node,
+// limited to the first 64 processors (processor group 0 on Windows), or 0 if
+// the node doesn't exist or the topology is unknown.
+uint64_t GetNumaNodeProcessorMask(uint32_t node);
+
 // Enables the current process to set thread affinity.
 // Must be called at startup before attempting to set thread affinity.
 void EnableAffinityConfiguration();
@@ -438,8 +443,8 @@ class Thread : public WaitHandle {
   // Returns the current name of the thread, if previously specified.
   const std::string& name() const { return name_; }
 
-  // Sets the name of the thread, used in debugging and logging.
-  virtual void set_name(std::string name) { name_ = std::move(name); }
+  // Sets the name of the thread, used in debugging, logging and tracing.
+  virtual void set_name(std::string name);
 
   // Returns the current priority value for the thread.
   virtual int32_t priority() = 0;
@@ -14,6 +14,7 @@
 #include "xenia/base/platform.h"
 #include "xenia/base/threading_timer_queue.h"
 
+#include <linux/futex.h>
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
@@ -22,8 +23,12 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
 #include <cstddef>
+#include <cstdio>
 #include <ctime>
 #include <memory>
 
@@ -129,6 +134,38 @@ void install_signal_handler(SignalType type) {
     signal_handler_installed[static_cast<size_t>(type)] = true;
 }
 
+uint64_t GetNumaNodeProcessorMask(uint32_t node) {
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist",
+           node);
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    return 0;
+  }
+  // Comma-separated processors and ranges, like "0-7,16-23".
+  uint64_t mask = 0;
+  unsigned int first, last;
+  int separator;
+  while (fscanf(file, "%u", &first) == 1) {
+    last = first;
+    separator = fgetc(file);
+    if (separator == '-') {
+      if (fscanf(file, "%u", &last) != 1) {
+        break;
+      }
+      separator = fgetc(file);
+    }
+    for (unsigned int i = first; i <= last && i < 64; ++i) {
+      mask |= uint64_t(1) << i;
+    }
+    if (separator != ',') {
+      break;
+    }
+  }
+  fclose(file);
+  return mask;
+}
+
 // TODO(dougvj)
 void EnableAffinityConfiguration() {}
 
@@ -190,95 +227,174 @@ bool SetTlsValue(TlsHandle handle, uintptr_t value) {
                              reinterpret_cast<void*>(value)) == 0;
 }
 
+// A thread blocked waiting for one or more objects. The objects reference the
+// waiters while they're waiting, and wake only them when signaled, rather
+// than all the threads waiting for any object. Each waiter blocks on its own
+// futex word, so waiting for multiple objects doesn't need futex_waitv.
+class PosixWaiter {
+ public:
+  // Must be read with the locks of the objects held, before releasing them to
+  // block, so the wake-ups in between are not missed.
+  uint32_t wake_count() const {
+    return wake_count_.load(std::memory_order_acquire);
+  }
+
+  // With the lock of the object held.
+  void Wake() {
+    wake_count_.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_count_),
+            FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+  }
+
+  // Returns false if the deadline has passed, may also return without having
+  // been woken up.
+  bool Block(uint32_t wake_count,
+             std::chrono::steady_clock::time_point deadline) {
+    timespec timeout_spec;
+    const timespec* timeout = nullptr;
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+      auto remaining = deadline - std::chrono::steady_clock::now();
+      if (remaining <= std::chrono::steady_clock::duration::zero()) {
+        return false;
+      }
+      timeout_spec = DurationToTimeSpec(remaining);
+      timeout = &timeout_spec;
+    }
+    if (syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_count_),
+                FUTEX_WAIT_PRIVATE, wake_count, timeout, nullptr, 0) < 0 &&
+        errno == ETIMEDOUT) {
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  std::atomic<uint32_t> wake_count_{0};
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+                std::atomic<uint32_t>::is_always_lock_free);
+};
+
+thread_local PosixWaiter current_waiter_;
+
 class PosixConditionBase {
  public:
   virtual bool Signal() = 0;
 
   WaitResult Wait(std::chrono::milliseconds timeout) {
-    bool executed;
-    auto predicate = [this] { return this->signaled(); };
-    auto lock = std::unique_lock<std::mutex>(mutex_);
-    if (predicate()) {
-      executed = true;
-    } else {
-      if (timeout == std::chrono::milliseconds::max()) {
-        cond_.wait(lock, predicate);
-        executed = true;  // Did not time out;
-      } else {
-        executed = cond_.wait_for(lock, timeout, predicate);
-      }
-    }
-    if (executed) {
-      post_execution();
-      return WaitResult::kSuccess;
-    } else {
-      return WaitResult::kTimeout;
-    }
+    PosixConditionBase* handle = this;
+    return WaitForConditions(&handle, 1, &handle, 1, true, timeout).first;
   }
 
   static std::pair<WaitResult, size_t> WaitMultiple(
       std::vector<PosixConditionBase*>&& handles, bool wait_all,
       std::chrono::milliseconds timeout) {
     assert_true(handles.size() > 0);
+    // Locked in the order of the addresses, so the threads waiting for the
+    // same objects don't deadlock.
+    std::vector<PosixConditionBase*> lock_order(handles);
+    std::sort(lock_order.begin(), lock_order.end());
+    lock_order.erase(std::unique(lock_order.begin(), lock_order.end()),
+                     lock_order.end());
+    return WaitForConditions(handles.data(), handles.size(), lock_order.data(),
+                             lock_order.size(), wait_all, timeout);
+  }
 
-    // Construct a condition for all or any depending on wait_all
-    std::function<bool()> predicate;
-    {
-      using iter_t = std::vector<PosixConditionBase*>::const_iterator;
-      const auto predicate_inner = [](auto h) { return h->signaled(); };
-      const auto operation =
-          wait_all ? std::all_of<iter_t, decltype(predicate_inner)>
-                   : std::any_of<iter_t, decltype(predicate_inner)>;
-      predicate = [&handles, operation, predicate_inner] {
-        return operation(handles.cbegin(), handles.cend(), predicate_inner);
+  virtual void* native_handle() const { return mutex_.native_handle(); }
+
+ protected:
+  inline virtual bool signaled() const = 0;
+  inline virtual void post_execution() = 0;
+
+  // With the mutex locked, after the object has become signaled.
+  void WakeWaitersLocked() {
+    for (PosixWaiter* waiter : waiters_) {
+      waiter->Wake();
+    }
+  }
+
+  mutable std::mutex mutex_;
+
+ private:
+  static std::pair<WaitResult, size_t> WaitForConditions(
+      PosixConditionBase* const* handles, size_t handle_count,
+      PosixConditionBase* const* lock_order, size_t lock_count, bool wait_all,
+      std::chrono::milliseconds timeout) {
+    auto lock_all = [&]() {
+      for (size_t i = 0; i < lock_count; ++i) {
+        lock_order[i]->mutex_.lock();
+      }
+    };
+    auto unlock_all = [&]() {
+      for (size_t i = lock_count; i-- > 0;) {
+        lock_order[i]->mutex_.unlock();
+      }
+    };
+    auto is_satisfied = [&]() {
+      auto is_signaled = [](const PosixConditionBase* handle) {
+        return handle->signaled();
       };
+      PosixConditionBase* const* handles_end = handles + handle_count;
+      return wait_all ? std::all_of(handles, handles_end, is_signaled)
+                      : std::any_of(handles, handles_end, is_signaled);
+    };
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (timeout != std::chrono::milliseconds::max()) {
+      deadline = std::chrono::steady_clock::now() + timeout;
     }
 
     // TODO(bwrsandman, Triang3l) This is controversial, see issue #1677
-    // This will probably cause a deadlock on the next thread doing any waiting
-    // if the thread is suspended between locking and waiting
-    std::unique_lock<std::mutex> lock(PosixConditionBase::mutex_);
-
-    bool wait_success = true;
-    // If the timeout is infinite, wait without timeout.
-    // The predicate will be checked before beginning the wait
-    if (timeout == std::chrono::milliseconds::max()) {
-      PosixConditionBase::cond_.wait(lock, predicate);
-    } else {
-      // Wait with timeout.
-      wait_success =
-          PosixConditionBase::cond_.wait_for(lock, timeout, predicate);
-    }
-    if (wait_success) {
-      auto first_signaled = std::numeric_limits<size_t>::max();
-      for (auto i = 0u; i < handles.size(); ++i) {
-        if (handles[i]->signaled()) {
-          if (first_signaled > i) {
-            first_signaled = i;
-          }
-          handles[i]->post_execution();
-          if (!wait_all) break;
+    // This will probably cause a deadlock on the next thread waiting for the
+    // same objects if the thread is suspended between locking and waiting.
+    PosixWaiter& waiter = current_waiter_;
+    bool registered = false;
+    bool timed_out = false;
+    lock_all();
+    while (!is_satisfied()) {
+      if (timed_out) {
+        break;
+      }
+      if (!registered) {
+        for (size_t i = 0; i < lock_count; ++i) {
+          lock_order[i]->waiters_.push_back(&waiter);
         }
+        registered = true;
       }
-      assert_true(std::numeric_limits<size_t>::max() != first_signaled);
-      return std::make_pair(WaitResult::kSuccess, first_signaled);
-    } else {
+      uint32_t wake_count = waiter.wake_count();
+      unlock_all();
+      timed_out = !waiter.Block(wake_count, deadline);
+      lock_all();
+    }
+    if (registered) {
+      // Only one reference, the same thread may be waiting in a signal handler
+      // interrupting another wait.
+      for (size_t i = 0; i < lock_count; ++i) {
+        std::vector<PosixWaiter*>& waiters = lock_order[i]->waiters_;
+        waiters.erase(std::find(waiters.begin(), waiters.end(), &waiter));
+      }
+    }
+    if (!is_satisfied()) {
+      unlock_all();
       return std::make_pair<WaitResult, size_t>(WaitResult::kTimeout, 0);
     }
+    auto first_signaled = std::numeric_limits<size_t>::max();
+    for (size_t i = 0; i < handle_count; ++i) {
+      if (handles[i]->signaled()) {
+        if (first_signaled > i) {
+          first_signaled = i;
+        }
+        handles[i]->post_execution();
+        if (!wait_all) break;
+      }
+    }
+    unlock_all();
+    assert_true(std::numeric_limits<size_t>::max() != first_signaled);
+    return std::make_pair(WaitResult::kSuccess, first_signaled);
   }
 
-  virtual void* native_handle() const { return cond_.native_handle(); }
-
- protected:
-  inline virtual bool signaled() const = 0;
-  inline virtual void post_execution() = 0;
-  static std::condition_variable cond_;
-  static std::mutex mutex_;
+  // The threads currently waiting for the object, usually few.
+  std::vector<PosixWaiter*> waiters_;
 };
 
-std::condition_variable PosixConditionBase::cond_;
-std::mutex PosixConditionBase::mutex_;
-
 // There really is no native POSIX handle for a single wait/signal construct
 // pthreads is at a lower level with more handles for such a mechanism.
 // This simple wrapper class functions as our handle and uses conditional
@@ -296,7 +412,7 @@ class PosixCondition<Event> : public PosixConditionBase {
   bool Signal() override {
     auto lock = std::unique_lock<std::mutex>(mutex_);
     signal_ = true;
-    cond_.notify_all();
+    WakeWaitersLocked();
     return true;
   }
 
@@ -325,11 +441,11 @@ class PosixCondition<Semaphore> : public PosixConditionBase {
   bool Signal() override { return Release(1, nullptr); }
 
   bool Release(uint32_t release_count, int* out_previous_count) {
+    auto lock = std::unique_lock<std::mutex>(mutex_);
     if (maximum_count_ - count_ >= release_count) {
-      auto lock = std::unique_lock<std::mutex>(mutex_);
       if (out_previous_count) *out_previous_count = count_;
       count_ += release_count;
-      cond_.notify_all();
+      WakeWaitersLocked();
       return true;
     }
     return false;
@@ -337,10 +453,7 @@ class PosixCondition<Semaphore> : public PosixConditionBase {
 
  private:
   inline bool signaled() const override { return count_ > 0; }
-  inline void post_execution() override {
-    count_--;
-    cond_.notify_all();
-  }
+  inline void post_execution() override { count_--; }
   uint32_t count_;
   const uint32_t maximum_count_;
 };
@@ -358,12 +471,12 @@ class PosixCondition<Mutant> : public PosixConditionBase {
   bool Signal() override { return Release(); }
 
   bool Release() {
+    auto lock = std::unique_lock<std::mutex>(mutex_);
     if (owner_ == std::this_thread::get_id() && count_ > 0) {
-      auto lock = std::unique_lock<std::mutex>(mutex_);
       --count_;
       // Free to be acquired by another thread
       if (count_ == 0) {
-        cond_.notify_all();
+        WakeWaitersLocked();
       }
       return true;
     }
@@ -395,7 +508,7 @@ class PosixCondition<Timer> : public PosixConditionBase {
   bool Signal() override {
     std::lock_guard<std::mutex> lock(mutex_);
     signal_ = true;
-    cond_.notify_all();
+    WakeWaitersLocked();
     return true;
   }
 
@@ -739,7 +852,7 @@ class PosixCondition<Thread> : public PosixConditionBase {
 
       exit_code_ = exit_code;
       signaled_ = true;
-      cond_.notify_all();
+      WakeWaitersLocked();
     }
     if (is_current_thread) {
       pthread_exit(reinterpret_cast<void*>(exit_code));
@@ -1110,10 +1223,10 @@ void* PosixCondition<Thread>::ThreadStartRoutine(void* parameter) {
     thread->handle_.state_ = State::kFinished;
   }
 
-  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_lock<std::mutex> lock(thread->handle_.mutex_);
   thread->handle_.exit_code_ = 0;
   thread->handle_.signaled_ = true;
-  cond_.notify_all();
+  thread->handle_.WakeWaitersLocked();
 
   current_thread_ = nullptr;
   return nullptr;
@@ -49,6 +49,9 @@ class TimerQueue {
         wait_strategy_(),
         claim_strategy_(kWaitCount, wait_strategy_),
         consumed_(wait_strategy_),
+        slack_(clock::duration::zero()),
+        wake_up_count_(0),
+        callback_count_(0),
         shutdown_(false) {
     claim_strategy_.add_claim_barrier(consumed_);
     dispatch_thread_ = std::thread(&TimerQueue::TimerThreadMain, this);
@@ -98,11 +101,14 @@ class TimerQueue {
         }
       }
 
+      wake_up_count_.fetch_add(1, std::memory_order_relaxed);
+
       {
         // Check wait queue, invoke callbacks and reschedule
         std::forward_list<std::shared_ptr<WaitItem>> wait_items;
-        while (!wait_queue_.empty() &&
-               wait_queue_.front()->due_ <= clock::now()) {
+        clock::time_point due_limit =
+            clock::now() + slack_.load(std::memory_order_relaxed);
+        while (!wait_queue_.empty() && wait_queue_.front()->due_ <= due_limit) {
           auto wait_item = std::move(wait_queue_.front());
           wait_queue_.pop_front();
 
@@ -114,6 +120,7 @@ class TimerQueue {
             // Possibility to dispatch to a thread pool here
             assert_not_null(wait_item->callback_);
             wait_item->callback_(wait_item->userdata_);
+            callback_count_.fetch_add(1, std::memory_order_relaxed);
 
             if (wait_item->interval_ != clock::duration::zero() &&
                 wait_item->state_.load(std::memory_order_acquire) !=
@@ -154,6 +161,17 @@ class TimerQueue {
 
   const std::thread& dispatch_thread() const { return dispatch_thread_; }
 
+  void set_slack(clock::duration slack) {
+    slack_.store(slack, std::memory_order_relaxed);
+  }
+
+  TimerQueueStatistics statistics() const {
+    TimerQueueStatistics statistics;
+    statistics.wake_up_count = wake_up_count_.load(std::memory_order_relaxed);
+    statistics.callback_count = callback_count_.load(std::memory_order_relaxed);
+    return statistics;
+  }
+
  private:
   // This ring buffer will be used to introduce timers queued by the public API
   static constexpr size_t kWaitCount = 512;
@@ -166,6 +184,9 @@ class TimerQueue {
   // This is a _sorted_ (ascending due_) list of active timers managed by a
   // dedicated thread
   std::forward_list<std::shared_ptr<WaitItem>> wait_queue_;
+  std::atomic<clock::duration> slack_;
+  std::atomic<uint64_t> wake_up_count_;
+  std::atomic<uint64_t> callback_count_;
   std::atomic_bool shutdown_;
   std::thread dispatch_thread_;
 };
@@ -221,5 +242,13 @@ std::weak_ptr<WaitItem> QueueTimerRecurring(
       std::move(callback), userdata, &timer_queue_, due, interval));
 }
 
+void SetTimerQueueSlack(WaitItem::clock::duration slack) {
+  timer_queue_.set_slack(slack);
+}
+
+TimerQueueStatistics GetTimerQueueStatistics() {
+  return timer_queue_.statistics();
+}
+
 }  // namespace threading
 }  // namespace xe
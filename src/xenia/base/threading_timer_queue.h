@@ -74,6 +74,18 @@ std::weak_ptr<TimerQueueWaitItem> QueueTimerRecurring(
     std::function<void(void*)> callback, void* userdata,
     TimerQueueWaitItem::clock::time_point due,
     TimerQueueWaitItem::clock::duration interval);
+
+// Allows the callbacks due within the slack after the earliest one to be
+// executed early, in the same wake-up of the timer thread, reducing the number
+// of wake-ups with many timers at the cost of precision.
+void SetTimerQueueSlack(TimerQueueWaitItem::clock::duration slack);
+
+struct TimerQueueStatistics {
+  // Times the timer thread has woken up to execute callbacks or add timers.
+  uint64_t wake_up_count;
+  uint64_t callback_count;
+};
+TimerQueueStatistics GetTimerQueueStatistics();
 }  // namespace xe::threading
 
 #endif
@@ -59,6 +59,16 @@ XE_NTDLL_IMPORT(NtQueryEvent, cls_NtQueryEvent, NtQueryEventPointer);
 namespace xe {
 namespace threading {
 
+uint64_t GetNumaNodeProcessorMask(uint32_t node) {
+  GROUP_AFFINITY affinity;
+  if (node > USHRT_MAX ||
+      !GetNumaNodeProcessorMaskEx(USHORT(node), &affinity) ||
+      affinity.Group) {
+    return 0;
+  }
+  return uint64_t(affinity.Mask);
+}
+
 void EnableAffinityConfiguration() {
   // chrispy: i don't think this is necessary,
   // affinity always seems to be the system mask? research more
@@ -0,0 +1,331 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/trace_events.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
+
+DEFINE_path(trace_events_path, "",
+            "File to write the profiling scopes of all threads and the GPU "
+            "timestamps to, as Chrome trace event JSON for Perfetto or "
+            "chrome://tracing. Not recorded if empty.",
+            "General");
+DEFINE_uint32(trace_events_start_frame, 0,
+              "Guest frame to start recording trace_events_path at, 0 to "
+              "record from the startup.",
+              "General");
+DEFINE_uint32(trace_events_frame_count, 10,
+              "Guest frames to record to trace_events_path.", "General");
+
+namespace xe {
+namespace trace_events {
+
+namespace internal {
+std::atomic<bool> is_recording = {false};
+}  // namespace internal
+
+namespace {
+
+// The tracks not belonging to host threads.
+constexpr uint32_t kGpuTrackId = UINT32_MAX;
+constexpr uint32_t kFrameTrackId = UINT32_MAX - 1;
+
+constexpr size_t kChunkEventCount = 4096;
+// Around 128 MB, the events beyond this are dropped.
+constexpr size_t kMaxChunkCount = 1024;
+
+struct Event {
+  const char* category;
+  const char* name;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+};
+
+struct Chunk {
+  Event events[kChunkEventCount];
+  std::atomic<Chunk*> next = {nullptr};
+};
+
+// Written only by one thread, and published to the thread writing the trace
+// with the event count.
+struct EventBuffer {
+  explicit EventBuffer(uint32_t track_id) : track_id(track_id) {}
+  EventBuffer(const EventBuffer& buffer) = delete;
+  EventBuffer& operator=(const EventBuffer& buffer) = delete;
+  ~EventBuffer() {
+    Chunk* chunk = first_chunk.load(std::memory_order_relaxed);
+    while (chunk) {
+      Chunk* next = chunk->next.load(std::memory_order_relaxed);
+      delete chunk;
+      chunk = next;
+    }
+  }
+
+  uint32_t track_id;
+  std::atomic<Chunk*> first_chunk = {nullptr};
+  std::atomic<uint64_t> event_count = {0};
+  // Private to the writing thread.
+  Chunk* write_chunk = nullptr;
+  size_t write_chunk_event_count = kChunkEventCount;
+};
+
+enum class State {
+  kDisabled,
+  kWaiting,
+  kRecording,
+  kWritten,
+};
+
+struct Recorder {
+  std::mutex mutex;
+  State state = State::kDisabled;
+  std::vector<std::unique_ptr<EventBuffer>> thread_buffers;
+  EventBuffer gpu_buffer{kGpuTrackId};
+  std::unordered_map<uint32_t, std::string> thread_names;
+  uint32_t frames_until_start = 0;
+  uint32_t frames_until_stop = 0;
+  uint64_t origin_ns = 0;
+  uint64_t frame_begin_ns = 0;
+  std::vector<std::pair<uint64_t, uint64_t>> frames;
+  std::atomic<size_t> chunks_available = {kMaxChunkCount};
+  std::atomic<uint64_t> dropped_event_count = {0};
+};
+
+Recorder& recorder() {
+  static Recorder recorder;
+  return recorder;
+}
+
+thread_local EventBuffer* thread_buffer = nullptr;
+
+void AppendEvent(EventBuffer& buffer, const Event& event) {
+  if (buffer.write_chunk_event_count >= kChunkEventCount) {
+    Recorder& state = recorder();
+    if (state.chunks_available.fetch_sub(1, std::memory_order_relaxed) == 0) {
+      state.chunks_available.fetch_add(1, std::memory_order_relaxed);
+      state.dropped_event_count.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Chunk* chunk = new Chunk;
+    if (buffer.write_chunk) {
+      buffer.write_chunk->next.store(chunk, std::memory_order_release);
+    } else {
+      buffer.first_chunk.store(chunk, std::memory_order_release);
+    }
+    buffer.write_chunk = chunk;
+    buffer.write_chunk_event_count = 0;
+  }
+  buffer.write_chunk->events[buffer.write_chunk_event_count++] = event;
+  buffer.event_count.fetch_add(1, std::memory_order_release);
+}
+
+// Names may contain the characters that must be escaped in JSON, such as the
+// backslashes in the paths on Windows.
+std::string EscapeJson(std::string_view string) {
+  std::string escaped;
+  escaped.reserve(string.size());
+  for (char c : string) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (uint8_t(c) < 0x20) {
+      escaped.append(fmt::format("\\u{:04x}", uint32_t(uint8_t(c))));
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+// With the mutex locked.
+void PrintEvents(FILE* file, const EventBuffer& buffer, uint64_t origin_ns,
+                 bool& first) {
+  uint64_t event_count = buffer.event_count.load(std::memory_order_acquire);
+  const Chunk* chunk = buffer.first_chunk.load(std::memory_order_acquire);
+  for (uint64_t i = 0; i < event_count; ++i) {
+    if (i && !(i % kChunkEventCount)) {
+      chunk = chunk->next.load(std::memory_order_acquire);
+    }
+    const Event& event = chunk->events[i % kChunkEventCount];
+    // Scopes begun before the recording.
+    if (event.begin_ns < origin_ns) {
+      continue;
+    }
+    fmt::print(file,
+               "{}{{\"ph\":\"X\",\"pid\":1,\"tid\":{},\"cat\":\"{}\","
+               "\"name\":\"{}\",\"ts\":{:.3f},\"dur\":{:.3f}}}",
+               first ? "\n" : ",\n", buffer.track_id,
+               EscapeJson(event.category), EscapeJson(event.name),
+               double(event.begin_ns - origin_ns) / 1000.0,
+               double(event.end_ns - event.begin_ns) / 1000.0);
+    first = false;
+  }
+}
+
+void PrintThreadName(FILE* file, uint32_t track_id, std::string_view name,
+                     bool& first) {
+  fmt::print(file,
+             "{}{{\"ph\":\"M\",\"pid\":1,\"tid\":{},\"name\":\"thread_name\","
+             "\"args\":{{\"name\":\"{}\"}}}}",
+             first ? "\n" : ",\n", track_id, EscapeJson(name));
+  first = false;
+}
+
+// With the mutex locked.
+void WriteTraceLocked(Recorder& state) {
+  state.state = State::kWritten;
+  internal::is_recording.store(false, std::memory_order_relaxed);
+  FILE* file = filesystem::OpenFile(cvars::trace_events_path, "wb");
+  if (!file) {
+    XELOGE("Trace events: Failed to open {} for writing",
+           xe::path_to_utf8(cvars::trace_events_path));
+    return;
+  }
+  fmt::print(file, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  bool first = true;
+  PrintThreadName(file, kFrameTrackId, "Guest frames", first);
+  PrintThreadName(file, kGpuTrackId, "GPU", first);
+  for (const auto& thread_name : state.thread_names) {
+    PrintThreadName(file, thread_name.first, thread_name.second, first);
+  }
+  for (size_t i = 0; i < state.frames.size(); ++i) {
+    const std::pair<uint64_t, uint64_t>& frame = state.frames[i];
+    fmt::print(file,
+               ",\n{{\"ph\":\"X\",\"pid\":1,\"tid\":{},\"cat\":\"frame\","
+               "\"name\":\"Frame {}\",\"ts\":{:.3f},\"dur\":{:.3f}}}",
+               kFrameTrackId, i,
+               double(frame.first - state.origin_ns) / 1000.0,
+               double(frame.second - frame.first) / 1000.0);
+  }
+  for (const std::unique_ptr<EventBuffer>& buffer : state.thread_buffers) {
+    PrintEvents(file, *buffer, state.origin_ns, first);
+  }
+  PrintEvents(file, state.gpu_buffer, state.origin_ns, first);
+  fmt::print(file, "\n]}}\n");
+  fclose(file);
+  uint64_t dropped_event_count =
+      state.dropped_event_count.load(std::memory_order_relaxed);
+  if (dropped_event_count) {
+    XELOGW("Trace events: {} events dropped as the buffers were full",
+           dropped_event_count);
+  }
+  XELOGI("Trace events: Wrote {} frames to {}", state.frames.size(),
+         xe::path_to_utf8(cvars::trace_events_path));
+}
+
+// With the mutex locked.
+void StartRecordingLocked(Recorder& state) {
+  state.state = State::kRecording;
+  state.frames_until_stop = std::max(cvars::trace_events_frame_count, 1u);
+  state.origin_ns = GetTimeNs();
+  state.frame_begin_ns = state.origin_ns;
+  internal::is_recording.store(true, std::memory_order_relaxed);
+  XELOGI("Trace events: Recording {} frames", state.frames_until_stop);
+}
+
+}  // namespace
+
+namespace internal {
+void RecordScope(const char* category, const char* name, uint64_t begin_ns,
+                 uint64_t end_ns) {
+  EventBuffer* buffer = thread_buffer;
+  if (!buffer) {
+    Recorder& state = recorder();
+    auto new_buffer = std::make_unique<EventBuffer>(
+        threading::current_thread_system_id());
+    buffer = new_buffer.get();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.thread_buffers.push_back(std::move(new_buffer));
+    thread_buffer = buffer;
+  }
+  AppendEvent(*buffer, {category, name, begin_ns, end_ns});
+}
+}  // namespace internal
+
+uint64_t GetTimeNs() {
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count());
+}
+
+void Initialize() {
+  if (cvars::trace_events_path.empty()) {
+    return;
+  }
+  Recorder& state = recorder();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.state != State::kDisabled) {
+    return;
+  }
+  state.state = State::kWaiting;
+  state.frames_until_start = cvars::trace_events_start_frame;
+  if (!state.frames_until_start) {
+    StartRecordingLocked(state);
+  }
+}
+
+void Shutdown() {
+  Recorder& state = recorder();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.state == State::kRecording) {
+    WriteTraceLocked(state);
+  }
+}
+
+void OnFrame() {
+  Recorder& state = recorder();
+  // Not locking the mutex every frame when not recording.
+  if (cvars::trace_events_path.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(state.mutex);
+  switch (state.state) {
+    case State::kWaiting:
+      if (!--state.frames_until_start) {
+        StartRecordingLocked(state);
+      }
+      break;
+    case State::kRecording: {
+      uint64_t frame_end_ns = GetTimeNs();
+      state.frames.emplace_back(state.frame_begin_ns, frame_end_ns);
+      state.frame_begin_ns = frame_end_ns;
+      if (!--state.frames_until_stop) {
+        WriteTraceLocked(state);
+      }
+    } break;
+    default:
+      break;
+  }
+}
+
+void SetThreadName(uint32_t thread_system_id, std::string_view name) {
+  Recorder& state = recorder();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.thread_names[thread_system_id] = std::string(name);
+}
+
+void RecordGpuSpan(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+  AppendEvent(recorder().gpu_buffer, {"gpu", name, begin_ns, end_ns});
+}
+
+}  // namespace trace_events
+}  // namespace xe
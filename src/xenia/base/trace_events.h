@@ -0,0 +1,95 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_TRACE_EVENTS_H_
+#define XENIA_BASE_TRACE_EVENTS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#include "xenia/base/platform.h"
+
+namespace xe {
+namespace trace_events {
+
+// Records the profiling scopes of all threads, without the microprofile build
+// option, for a number of guest frames, and writes them as a Chrome trace
+// event JSON file (loadable in Perfetto and chrome://tracing) for analyzing
+// the frame timelines offline. Every thread appends to its own buffer, so
+// recording doesn't synchronize the threads, and when not recording, a scope
+// only checks a flag.
+
+namespace internal {
+extern std::atomic<bool> is_recording;
+void RecordScope(const char* category, const char* name, uint64_t begin_ns,
+                 uint64_t end_ns);
+}  // namespace internal
+
+inline bool IsRecording() {
+  return internal::is_recording.load(std::memory_order_relaxed);
+}
+
+uint64_t GetTimeNs();
+
+// Starts recording if configured to start from the beginning. Called once at
+// startup.
+void Initialize();
+// Writes the recording if it hasn't been finished yet.
+void Shutdown();
+
+// Called at every guest frame swap, starts and stops the recording.
+void OnFrame();
+
+// May be called for any thread, not only the calling one.
+void SetThreadName(uint32_t thread_system_id, std::string_view name);
+
+// A span on the GPU track, for the GPU execution time measured with the
+// timestamp queries, in the host time.
+void RecordGpuSpan(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+// The category and the name must be literals, or stay valid until exit.
+class Scope {
+ public:
+  Scope(const char* category, const char* name) {
+    if (XE_UNLIKELY(IsRecording())) {
+      category_ = category;
+      name_ = name;
+      begin_ns_ = GetTimeNs();
+    }
+  }
+  Scope(const Scope& scope) = delete;
+  Scope& operator=(const Scope& scope) = delete;
+  ~Scope() {
+    // Even if stopped recording during the scope, for the scopes spanning
+    // whole frames.
+    if (XE_UNLIKELY(name_ != nullptr)) {
+      internal::RecordScope(category_, name_, begin_ns_, GetTimeNs());
+    }
+  }
+
+ private:
+  const char* category_ = nullptr;
+  const char* name_ = nullptr;
+  uint64_t begin_ns_ = 0;
+};
+
+}  // namespace trace_events
+}  // namespace xe
+
+#define XE_TRACE_EVENTS_SCOPE_VARIABLE_CONCAT(prefix, line) prefix##line
+#define XE_TRACE_EVENTS_SCOPE_VARIABLE(line) \
+  XE_TRACE_EVENTS_SCOPE_VARIABLE_CONCAT(xe_trace_events_scope_, line)
+
+// Records a scope active for the duration of the containing block.
+#define XE_TRACE_EVENTS_SCOPE(category, name)                       \
+  xe::trace_events::Scope XE_TRACE_EVENTS_SCOPE_VARIABLE(__LINE__)( \
+      category, name)
+
+#endif  // XENIA_BASE_TRACE_EVENTS_H_
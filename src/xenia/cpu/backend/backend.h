@@ -10,7 +10,9 @@
 #ifndef XENIA_CPU_BACKEND_BACKEND_H_
 #define XENIA_CPU_BACKEND_BACKEND_H_
 
+#include <filesystem>
 #include <memory>
+#include <vector>
 
 #include "xenia/cpu/backend/machine_info.h"
 #include "xenia/cpu/thread_debug_info.h"
@@ -22,6 +24,7 @@ class Function;
 class GuestFunction;
 class Module;
 class Processor;
+class ThreadState;
 }  // namespace cpu
 }  // namespace xe
 
@@ -61,6 +64,18 @@ class Backend {
   virtual std::unique_ptr<GuestFunction> CreateGuestFunction(
       Module* module, uint32_t address) = 0;
 
+  // Opens the persistent generated code cache of a module once its image is
+  // final, storing it in the given per-module directory. Returns the guest
+  // addresses of the functions that may be restored via RestoreGuestFunction.
+  virtual std::vector<uint32_t> OpenModuleCodeCache(
+      Module* module, const std::filesystem::path& cache_directory) {
+    return {};
+  }
+  virtual void CloseModuleCodeCache(Module* module) {}
+  // Defines the function using code generated by a previous run, returning
+  // false if it must be translated.
+  virtual bool RestoreGuestFunction(GuestFunction* function) { return false; }
+
   // Calculates the next host instruction based on the current thread state and
   // current PC. This will look for branches and other control flow
   // instructions.
@@ -95,6 +110,12 @@ class Backend {
   virtual bool PopulatePseudoStacktrace(GuestPseudoStackTrace* st) {
     return false;
   }
+  // Same for another thread, which must be suspended or may be caught in the
+  // middle of a call, giving a slightly wrong trace.
+  virtual bool PopulatePseudoStacktrace(ThreadState* thread_state,
+                                        GuestPseudoStackTrace* st) {
+    return false;
+  }
  protected:
   Processor* processor_ = nullptr;
   MachineInfo machine_info_;
@@ -92,15 +92,23 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   }
 
   function->set_debug_info(std::move(debug_info));
+  const void* old_machine_code = function->machine_code();
+  bool replacing_code = old_machine_code != nullptr;
   static_cast<X64Function*>(function)->Setup(
       reinterpret_cast<uint8_t*>(machine_code), code_size);
 
   // Install into indirection table.
   uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
   assert_true((host_address >> 32) == 0);
-  reinterpret_cast<X64CodeCache*>(backend_->code_cache())
-      ->AddIndirection(function->address(),
-                       static_cast<uint32_t>(host_address));
+  auto code_cache = reinterpret_cast<X64CodeCache*>(backend_->code_cache());
+  code_cache->AddIndirection(function->address(),
+                             static_cast<uint32_t>(host_address));
+
+  if (replacing_code) {
+    // Call sites may have cached the old code or call it directly.
+    x64_backend_->FlushIndirectCallCaches();
+    code_cache->RedirectCode(old_machine_code, machine_code);
+  }
 
   return true;
 }
@@ -11,11 +11,13 @@
 
 #include <stddef.h>
 #include <algorithm>
+#include <cstring>
 #include "third_party/capstone/include/capstone/capstone.h"
 #include "third_party/capstone/include/capstone/x86.h"
 
 #include "xenia/base/exception_handler.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/backend/x64/x64_assembler.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
@@ -32,6 +34,25 @@ DEFINE_bool(record_mmio_access_exceptions, true,
             "for them. This info can then be used on a subsequent run to "
             "instruct the recompiler to emit checks",
             "x64");
+DEFINE_bool(retranslate_on_mmio_access, true,
+            "Requests retranslating a function when one of its instructions is "
+            "first caught accessing mmio, so that it stops trapping in the "
+            "same session rather than on the next run. The retranslation is "
+            "done by the background translation threads, or without them on "
+            "the next guest thread to resolve or tier up a function, never in "
+            "the exception handler.",
+            "x64");
+
+DEFINE_bool(reservation_statistics, false,
+            "Counts successful and failed reserved stores (stwcx), logged "
+            "on shutdown.",
+            "x64");
+
+DEFINE_bool(exception_rate_statistics, false,
+            "Logs the host exception handler invocations and the guest traps "
+            "per second, for every second in which there were any, to find "
+            "exception storms slowing down the emulation.",
+            "x64");
 
 DEFINE_int64(max_stackpoints, 65536,
              "Max number of host->guest stack mappings we can record.", "x64");
@@ -41,9 +62,18 @@ DEFINE_bool(enable_host_guest_stack_synchronization, true,
             "and checks for reentry at return sites. Has slight performance "
             "impact, but fixes crashes in games that use setjmp/longjmp.",
             "x64");
+DEFINE_bool(lazy_host_guest_stack_synchronization, false,
+            "With enable_host_guest_stack_synchronization, only records the "
+            "guest stack pointer in each host frame on entry instead of "
+            "maintaining an array of stackpoints at every call and return, "
+            "and finds the frame to resume by walking the host stack when a "
+            "longjmp is detected. Guest stack traces are then only available "
+            "for threads that are in a call to host code.",
+            "x64");
 #if XE_X64_PROFILER_AVAILABLE == 1
 DECLARE_bool(instrument_call_times);
 #endif
+DECLARE_bool(emit_mmio_aware_stores_for_recorded_exception_addresses);
 
 namespace xe {
 namespace cpu {
@@ -63,8 +93,10 @@ class X64HelperEmitter : public X64Emitter {
   ~X64HelperEmitter() override;
   HostToGuestThunk EmitHostToGuestThunk();
   GuestToHostThunk EmitGuestToHostThunk();
+  GuestToHostThunk EmitGuestToHostLeafThunk();
   ResolveFunctionThunk EmitResolveFunctionThunk();
   void* EmitGuestAndHostSynchronizeStackHelper();
+  void* EmitGuestAndHostLazySynchronizeStackHelper();
   // 1 for loading byte, 2 for halfword and 4 for word.
   // these specialized versions save space in the caller
   void* EmitGuestAndHostSynchronizeStackSizeLoadThunk(
@@ -76,6 +108,9 @@ class X64HelperEmitter : public X64Emitter {
  private:
   void* EmitCurrentForOffsets(const _code_offsets& offsets,
                               size_t stack_size = 0);
+  // Replaces the guest address in ecx with the index of its reservation line
+  // version in rcx.
+  void EmitReserveLineIndex();
   // The following four functions provide save/load functionality for registers.
   // They assume at least StackLayout::THUNK_STACK_SIZE bytes have been
   // allocated on the stack.
@@ -95,6 +130,10 @@ X64Backend::X64Backend() : Backend(), code_cache_(nullptr) {
 }
 
 X64Backend::~X64Backend() {
+  exception_report_timer_.reset();
+  DumpIndirectCallCacheStatistics();
+  DumpReservationStatistics();
+
   if (capstone_handle_) {
     cs_close(&capstone_handle_);
   }
@@ -107,10 +146,18 @@ static void ForwardMMIOAccessForRecording(void* context, void* hostaddr) {
   reinterpret_cast<X64Backend*>(context)
       ->RecordMMIOExceptionForGuestInstruction(hostaddr);
 }
+static uint32_t LookupGuestFunctionForMemoryAccess(void* context,
+                                                   void* hostaddr) {
+  GuestFunction* function =
+      reinterpret_cast<X64Backend*>(context)->code_cache()->LookupFunction(
+          reinterpret_cast<uint64_t>(hostaddr));
+  return function ? function->address() : 0;
+}
 #if XE_X64_PROFILER_AVAILABLE == 1
 // todo: better way of passing to atexit. maybe do in destructor instead?
 // nope, destructor is never called
 static GuestProfilerData* backend_profiler_data = nullptr;
+static GuestProfilerData* backend_profiler_mxcsr_switch_data = nullptr;
 
 static uint64_t nanosecond_lifetime_start = 0;
 static void WriteGuestProfilerData() {
@@ -145,9 +192,16 @@ static void WriteGuestProfilerData() {
       double slice = static_cast<double>(sorted_entry.second) /
                      static_cast<double>(totaltime_divisor);
 
+      auto switches =
+          backend_profiler_mxcsr_switch_data->find(sorted_entry.first);
       fprintf(output_file,
-              "%X took %.20f milliseconds, totaltime slice percentage %.20f \n",
-              sorted_entry.first, time_in_milliseconds, slice);
+              "%X took %.20f milliseconds, totaltime slice percentage %.20f, "
+              "%llu mxcsr switches \n",
+              sorted_entry.first, time_in_milliseconds, slice,
+              static_cast<unsigned long long>(
+                  switches != backend_profiler_mxcsr_switch_data->end()
+                      ? switches->second
+                      : 0));
 
       fprintf(idapy_file,
               "print(get_name(0x%X) + ' took %.20f ms, %.20f percent')\n",
@@ -213,11 +267,14 @@ bool X64Backend::Initialize(Processor* processor) {
   X64HelperEmitter thunk_emitter(this, &allocator);
   host_to_guest_thunk_ = thunk_emitter.EmitHostToGuestThunk();
   guest_to_host_thunk_ = thunk_emitter.EmitGuestToHostThunk();
+  guest_to_host_leaf_thunk_ = thunk_emitter.EmitGuestToHostLeafThunk();
   resolve_function_thunk_ = thunk_emitter.EmitResolveFunctionThunk();
 
   if (cvars::enable_host_guest_stack_synchronization) {
     synchronize_guest_and_host_stack_helper_ =
-        thunk_emitter.EmitGuestAndHostSynchronizeStackHelper();
+        cvars::lazy_host_guest_stack_synchronization
+            ? thunk_emitter.EmitGuestAndHostLazySynchronizeStackHelper()
+            : thunk_emitter.EmitGuestAndHostSynchronizeStackHelper();
 
     synchronize_guest_and_host_stack_helper_size8_ =
         thunk_emitter.EmitGuestAndHostSynchronizeStackSizeLoadThunk(
@@ -246,16 +303,46 @@ bool X64Backend::Initialize(Processor* processor) {
   // Allocate emitter constant data.
   emitter_data_ = X64Emitter::PlaceConstData();
 
+  // Everything generated code may reference by a fixed address has been placed
+  // at this point.
+  if (cvars::enable_persistent_code_cache) {
+    code_cache_->InitializePersistentCache(
+        CalculatePersistentCacheIdentityKey(),
+        reinterpret_cast<uint64_t>(&X64Backend::ExceptionCallbackThunk));
+  }
+
   // Setup exception callback
   ExceptionHandler::Install(&ExceptionCallbackThunk, this);
+
+  if (cvars::exception_rate_statistics) {
+    exception_report_timer_ =
+        xe::threading::HighResolutionTimer::CreateRepeating(
+            std::chrono::seconds(1),
+            [this, exceptions_last = ExceptionHandler::invocation_count(),
+             traps_last = guest_trap_count()]() mutable {
+              uint64_t exceptions = ExceptionHandler::invocation_count();
+              uint64_t traps = guest_trap_count();
+              if (exceptions != exceptions_last || traps != traps_last) {
+                XELOGI(
+                    "Host exceptions: {} per second, guest traps: {} per "
+                    "second",
+                    exceptions - exceptions_last, traps - traps_last);
+              }
+              exceptions_last = exceptions;
+              traps_last = traps;
+            });
+  }
   if (cvars::record_mmio_access_exceptions) {
     processor->memory()->SetMMIOExceptionRecordingCallback(
         ForwardMMIOAccessForRecording, (void*)this);
   }
+  processor->memory()->SetGuestFunctionLookupCallback(
+      LookupGuestFunctionForMemoryAccess, this);
 
 #if XE_X64_PROFILER_AVAILABLE == 1
   if (cvars::instrument_call_times) {
     backend_profiler_data = &profiler_data_;
+    backend_profiler_mxcsr_switch_data = &profiler_mxcsr_switch_data_;
     xe::threading::Thread::CreationParameters slimparams;
 
     slimparams.create_suspended = false;
@@ -284,6 +371,122 @@ std::unique_ptr<GuestFunction> X64Backend::CreateGuestFunction(
   return std::make_unique<X64Function>(module, address);
 }
 
+template <typename T>
+static bool AppendConfigVarValue(cvar::IConfigVar* config_var,
+                                 std::string& out) {
+  auto typed_var = dynamic_cast<cvar::ConfigVar<T>*>(config_var);
+  if (!typed_var) {
+    return false;
+  }
+  out += fmt::format("{}={};", typed_var->name(), *typed_var->current_value());
+  return true;
+}
+
+uint64_t X64Backend::CalculatePersistentCacheIdentityKey() const {
+  // Translation options are all in the CPU and x64 categories, hash their
+  // current values regardless of where they've been set.
+  std::string config_values;
+  if (cvar::ConfigVars) {
+    for (const auto& it : *cvar::ConfigVars) {
+      cvar::IConfigVar* config_var = it.second;
+      if (config_var->category() != "CPU" && config_var->category() != "x64") {
+        continue;
+      }
+      AppendConfigVarValue<bool>(config_var, config_values) ||
+          AppendConfigVarValue<int32_t>(config_var, config_values) ||
+          AppendConfigVarValue<uint32_t>(config_var, config_values) ||
+          AppendConfigVarValue<int64_t>(config_var, config_values) ||
+          AppendConfigVarValue<uint64_t>(config_var, config_values) ||
+          AppendConfigVarValue<double>(config_var, config_values) ||
+          AppendConfigVarValue<std::string>(config_var, config_values);
+    }
+  }
+
+  // Addresses that generated code references directly, expected to be the
+  // same on every run with the same executable.
+  struct {
+    uint64_t feature_flags;
+    uint64_t virtual_membase;
+    uint64_t physical_membase;
+    uint64_t emitter_data;
+    uint64_t host_to_guest_thunk;
+    uint64_t guest_to_host_thunk;
+    uint64_t guest_to_host_leaf_thunk;
+    uint64_t resolve_function_thunk;
+    uint64_t synchronize_guest_and_host_stack_helpers[3];
+    uint64_t try_acquire_reservation_helper;
+    uint64_t reserved_store_helpers[2];
+    uint64_t config_values_hash;
+  } identity = {};
+  identity.feature_flags = amd64::GetFeatureFlags();
+  identity.virtual_membase =
+      reinterpret_cast<uint64_t>(processor()->memory()->virtual_membase());
+  identity.physical_membase =
+      reinterpret_cast<uint64_t>(processor()->memory()->physical_membase());
+  identity.emitter_data = emitter_data_;
+  identity.host_to_guest_thunk =
+      reinterpret_cast<uint64_t>(host_to_guest_thunk_);
+  identity.guest_to_host_thunk =
+      reinterpret_cast<uint64_t>(guest_to_host_thunk_);
+  identity.guest_to_host_leaf_thunk =
+      reinterpret_cast<uint64_t>(guest_to_host_leaf_thunk_);
+  identity.resolve_function_thunk =
+      reinterpret_cast<uint64_t>(resolve_function_thunk_);
+  identity.synchronize_guest_and_host_stack_helpers[0] =
+      reinterpret_cast<uint64_t>(synchronize_guest_and_host_stack_helper_size8_);
+  identity.synchronize_guest_and_host_stack_helpers[1] =
+      reinterpret_cast<uint64_t>(
+          synchronize_guest_and_host_stack_helper_size16_);
+  identity.synchronize_guest_and_host_stack_helpers[2] =
+      reinterpret_cast<uint64_t>(
+          synchronize_guest_and_host_stack_helper_size32_);
+  identity.try_acquire_reservation_helper =
+      reinterpret_cast<uint64_t>(try_acquire_reservation_helper_);
+  identity.reserved_store_helpers[0] =
+      reinterpret_cast<uint64_t>(reserved_store_32_helper);
+  identity.reserved_store_helpers[1] =
+      reinterpret_cast<uint64_t>(reserved_store_64_helper);
+  identity.config_values_hash =
+      XXH3_64bits(config_values.data(), config_values.size());
+  return XXH3_64bits(&identity, sizeof(identity));
+}
+
+std::vector<uint32_t> X64Backend::OpenModuleCodeCache(
+    Module* module, const std::filesystem::path& cache_directory) {
+  if (!code_cache_->has_persistent_cache()) {
+    return {};
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(cache_directory, ec);
+  return code_cache_->OpenPersistentModuleCache(
+      module, cache_directory / "x64_code_cache.bin");
+}
+
+void X64Backend::CloseModuleCodeCache(Module* module) {
+  code_cache_->ClosePersistentModuleCache(module);
+}
+
+bool X64Backend::RestoreGuestFunction(GuestFunction* function) {
+  if (!code_cache_->has_persistent_cache()) {
+    return false;
+  }
+  void* machine_code;
+  size_t code_size;
+  if (!code_cache_->RestorePersistentFunction(function, machine_code,
+                                              code_size)) {
+    return false;
+  }
+  static_cast<X64Function*>(function)->Setup(
+      reinterpret_cast<uint8_t*>(machine_code), code_size);
+  // Only fully optimized code is stored.
+  function->set_tier(GuestFunction::Tier::kOptimized);
+  uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
+  assert_true((host_address >> 32) == 0);
+  code_cache_->AddIndirection(function->address(),
+                              static_cast<uint32_t>(host_address));
+  return true;
+}
+
 uint64_t ReadCapstoneReg(HostThreadContext* context, x86_reg reg) {
   switch (reg) {
     case X86_REG_RAX:
@@ -526,8 +729,15 @@ void X64Backend::RecordMMIOExceptionForGuestInstruction(void* host_address) {
         cpu::InfoCacheFlags* icf =
             xex_guest_module->GetInstructionAddressFlags(guestaddr);
 
-        if (icf) {
+        if (icf && !icf->accessed_mmio) {
           icf->accessed_mmio = true;
+          // The new code calls the range handlers directly at the flagged
+          // loads and stores. This only queues it, the translation happens
+          // later outside the exception handler.
+          if (cvars::retranslate_on_mmio_access &&
+              cvars::emit_mmio_aware_stores_for_recorded_exception_addresses) {
+            processor()->RetranslateFunction(fnfor);
+          }
         }
       }
     }
@@ -653,12 +863,101 @@ GuestToHostThunk X64HelperEmitter::EmitGuestToHostThunk() {
   // Save off volatile registers.
   EmitSaveVolatileRegs();
 
+  bool record_host_call = cvars::enable_host_guest_stack_synchronization &&
+                          cvars::lazy_host_guest_stack_synchronization;
+  if (record_host_call) {
+    // The unused rax slot keeps the outer call for returning to it.
+    mov(rax, GetBackendCtxPtr(
+                 offsetof(X64BackendContext, host_call_return_slot)));
+    mov(qword[rsp + offsetof(StackLayout::Thunk, r[0])], rax);
+    lea(rax, ptr[rsp + stack_size]);
+    mov(GetBackendCtxPtr(offsetof(X64BackendContext, host_call_return_slot)),
+        rax);
+  }
+
   mov(rax, rcx);              // function
   mov(rcx, GetContextReg());  // context
   call(rax);
 
   EmitLoadVolatileRegs();
 
+  if (record_host_call) {
+    // rax is the result, and the context is only restored by now on Linux.
+    push(rcx);
+    mov(rcx, qword[rsp + 8 + offsetof(StackLayout::Thunk, r[0])]);
+    mov(GetBackendCtxPtr(offsetof(X64BackendContext, host_call_return_slot)),
+        rcx);
+    pop(rcx);
+  }
+
+  code_offsets.epilog = getSize();
+
+  add(rsp, stack_size);
+  ret();
+
+  code_offsets.tail = getSize();
+
+  assert_zero(code_offsets.prolog);
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.total = getSize();
+  func_info.code_size.prolog = code_offsets.body - code_offsets.prolog;
+  func_info.code_size.body = code_offsets.epilog - code_offsets.body;
+  func_info.code_size.epilog = code_offsets.tail - code_offsets.epilog;
+  func_info.code_size.tail = getSize() - code_offsets.tail;
+  func_info.prolog_stack_alloc_offset =
+      code_offsets.prolog_stack_alloc - code_offsets.prolog;
+  func_info.stack_size = stack_size;
+
+  void* fn = Emplace(func_info);
+  return (GuestToHostThunk)fn;
+}
+
+GuestToHostThunk X64HelperEmitter::EmitGuestToHostLeafThunk() {
+  // rcx = target function
+  // rdx = arg0
+  // r8  = arg1
+  // r9  = arg2
+
+  // Only called by the call_extern sequences of the exports tagged as kLeaf.
+  // The temporaries of the sequence are dead after the call, so only the
+  // volatile registers that the register allocator assigns are preserved, and
+  // as the export doesn't run guest code, the host call doesn't need to be
+  // recorded for walking the guest frames.
+
+  _code_offsets code_offsets = {};
+
+  const size_t stack_size = StackLayout::THUNK_STACK_SIZE;
+
+  code_offsets.prolog = getSize();
+
+  // rsp + 0 = return address
+  sub(rsp, stack_size);
+
+  code_offsets.prolog_stack_alloc = getSize();
+  code_offsets.body = getSize();
+  vzeroupper();
+#if XE_PLATFORM_LINUX
+  mov(qword[rsp + offsetof(StackLayout::Thunk, r[3])], rsi);
+  mov(qword[rsp + offsetof(StackLayout::Thunk, r[4])], rdi);
+#endif
+  mov(qword[rsp + offsetof(StackLayout::Thunk, r[7])], r10);
+  mov(qword[rsp + offsetof(StackLayout::Thunk, r[8])], r11);
+  vmovaps(qword[rsp + offsetof(StackLayout::Thunk, xmm[4])], xmm4);
+  vmovaps(qword[rsp + offsetof(StackLayout::Thunk, xmm[5])], xmm5);
+
+  mov(rax, rcx);              // function
+  mov(rcx, GetContextReg());  // context
+  call(rax);
+
+#if XE_PLATFORM_LINUX
+  mov(rsi, qword[rsp + offsetof(StackLayout::Thunk, r[3])]);
+  mov(rdi, qword[rsp + offsetof(StackLayout::Thunk, r[4])]);
+#endif
+  mov(r10, qword[rsp + offsetof(StackLayout::Thunk, r[7])]);
+  mov(r11, qword[rsp + offsetof(StackLayout::Thunk, r[8])]);
+  vmovaps(xmm4, qword[rsp + offsetof(StackLayout::Thunk, xmm[4])]);
+  vmovaps(xmm5, qword[rsp + offsetof(StackLayout::Thunk, xmm[5])]);
+
   code_offsets.epilog = getSize();
 
   add(rsp, stack_size);
@@ -703,6 +1002,14 @@ ResolveFunctionThunk X64HelperEmitter::EmitResolveFunctionThunk() {
   // Save volatile registers
   EmitSaveVolatileRegs();
 
+  if (cvars::enable_host_guest_stack_synchronization &&
+      cvars::lazy_host_guest_stack_synchronization) {
+    // For ResolveFunction to tell whether this is a longjmp.
+    lea(rax, ptr[rsp + stack_size]);
+    mov(GetBackendCtxPtr(offsetof(X64BackendContext, resolve_return_slot)),
+        rax);
+  }
+
   mov(rcx, rsi);  // context
   mov(rdx, rbx);
   mov(rax, reinterpret_cast<uint64_t>(&ResolveFunction));
@@ -839,6 +1146,42 @@ void* X64HelperEmitter::EmitGuestAndHostSynchronizeStackHelper() {
   return EmitCurrentForOffsets(code_offsets);
 }
 
+// r11 = size of callers stack, r8 = return address w/ adjustment
+// The frame to resume is found by FindReentryHostFrame, rsp still points to the
+// return address of the call or tail call that has reached the return site.
+void* X64HelperEmitter::EmitGuestAndHostLazySynchronizeStackHelper() {
+  _code_offsets code_offsets = {};
+  const size_t stack_size = StackLayout::THUNK_STACK_SIZE;
+
+  code_offsets.prolog = getSize();
+  sub(rsp, stack_size);
+  code_offsets.prolog_stack_alloc = getSize();
+  code_offsets.body = getSize();
+
+  EmitSaveVolatileRegs();
+
+  mov(rcx, GetContextReg());
+  lea(rdx, ptr[rsp + stack_size]);
+  // r8 = continuation
+  mov(r9, r11);
+  mov(rax, reinterpret_cast<uint64_t>(&X64Backend::FindReentryHostFrame));
+  call(rax);
+
+  EmitLoadVolatileRegs();
+
+  code_offsets.epilog = getSize();
+  add(rsp, stack_size);
+  Xbyak::Label not_found;
+  test(rax, rax);
+  jz(not_found);
+  mov(rsp, rax);
+  L(not_found);
+  jmp(r8);
+  code_offsets.tail = getSize();
+
+  return EmitCurrentForOffsets(code_offsets, stack_size);
+}
+
 void* X64HelperEmitter::EmitGuestAndHostSynchronizeStackSizeLoadThunk(
     void* sync_func, unsigned stack_element_size) {
   _code_offsets code_offsets = {};
@@ -865,39 +1208,33 @@ void* X64HelperEmitter::EmitGuestAndHostSynchronizeStackSizeLoadThunk(
   return EmitCurrentForOffsets(code_offsets);
 }
 
+void X64HelperEmitter::EmitReserveLineIndex() {
+  static_assert(RESERVE_NUM_ENTRIES == 65536,
+                "The line index is rotated as a 16-bit register");
+  shr(ecx, RESERVE_LINE_SHIFT);
+  rol(cx, RESERVE_INDEX_ROTATE);
+  // Also avoids the partial register access.
+  movzx(ecx, cx);
+}
+
+// ecx = guest addr, rax is preserved
 void* X64HelperEmitter::EmitTryAcquireReservationHelper() {
   _code_offsets code_offsets = {};
   code_offsets.prolog = getSize();
 
-  Xbyak::Label already_has_a_reservation;
-  Xbyak::Label acquire_new_reservation;
-
-  btr(GetBackendFlagsPtr(), 1);
+  // A new reservation simply replaces the previous one, and a reservation that
+  // is never used doesn't hold anything up for other threads.
   mov(r8, GetBackendCtxPtr(offsetof(X64BackendContext, reserve_helper_)));
-  jc(already_has_a_reservation);
-
-  shr(ecx, RESERVE_BLOCK_SHIFT);
-  xor_(r9d, r9d);
-  mov(edx, ecx);
-  shr(edx, 6);  // divide by 64
-  lea(rdx, ptr[r8 + rdx * 8]);
-  and_(ecx, 64 - 1);
-
-  lock();
-  bts(qword[rdx], rcx);
-  // set flag on local backend context for thread to indicate our previous
-  // attempt to get the reservation succeeded
-  setnc(r9b);  // success = bitmap did not have a set bit at the idx
-  shl(r9b, 1);
+  EmitReserveLineIndex();
+  lea(rdx, ptr[r8 + rcx * 8]);
+  mov(r9, qword[rdx]);
 
   mov(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_offset)),
       rdx);
-  mov(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_bit)), ecx);
-
-  or_(GetBackendCtxPtr(offsetof(X64BackendContext, flags)), r9d);
+  mov(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_version)),
+      r9);
+  bts(GetBackendFlagsPtr(), 1);
   ret();
-  L(already_has_a_reservation);
-  DebugBreak();
 
   code_offsets.prolog_stack_alloc = getSize();
   code_offsets.body = getSize();
@@ -908,73 +1245,69 @@ void* X64HelperEmitter::EmitTryAcquireReservationHelper() {
 // ecx=guest addr
 // r9 = host addr
 // r8 = value
-// if ZF is set and CF is set, we succeeded
+// if ZF is set, we succeeded
 void* X64HelperEmitter::EmitReservedStoreHelper(bool bit64) {
   _code_offsets code_offsets = {};
   code_offsets.prolog = getSize();
-  Xbyak::Label done;
-  Xbyak::Label reservation_isnt_for_our_addr;
-  Xbyak::Label somehow_double_cleared;
-  // carry must be set + zero flag must be set
+  Xbyak::Label no_reservation;
+  Xbyak::Label reservation_lost;
+  Xbyak::Label value_changed;
+  Xbyak::Label failed;
+
+  auto count = [this](size_t offset) {
+    if (!cvars::reservation_statistics) {
+      return;
+    }
+    mov(rcx, GetBackendCtxPtr(offsetof(X64BackendContext, reserve_helper_)));
+    lock();
+    inc(qword[rcx + offset]);
+  };
 
   btr(GetBackendFlagsPtr(), 1);
-
-  jnc(done);
+  jnc(no_reservation);
 
   mov(rax, GetBackendCtxPtr(offsetof(X64BackendContext, reserve_helper_)));
-
-  shr(ecx, RESERVE_BLOCK_SHIFT);
-  mov(edx, ecx);
-  shr(edx, 6);  // divide by 64
-  lea(rdx, ptr[rax + rdx * 8]);
-  // begin acquiring exclusive access to cacheline containing our bit
-  prefetchw(ptr[rdx]);
-
+  EmitReserveLineIndex();
+  lea(rdx, ptr[rax + rcx * 8]);
   cmp(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_offset)),
       rdx);
-  jnz(reservation_isnt_for_our_addr);
+  jnz(no_reservation);
 
+  // Claim the line, failing if another reserving thread has stored to it since
+  // the lwarx.
   mov(rax,
-      GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_value_)));
-
-  // we need modulo bitsize, it turns out bittests' modulus behavior for the
-  // bitoffset only applies for register operands, for memory ones we bug out
-  // todo: actually, the above note may not be true, double check it
-  and_(ecx, 64 - 1);
-  cmp(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_bit)), ecx);
-  jnz(reservation_isnt_for_our_addr);
+      GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_version)));
+  lea(rcx, ptr[rax + 1]);
+  lock();
+  cmpxchg(qword[rdx], rcx);
+  jnz(reservation_lost);
 
   // was our memory modified by kernel code or something?
+  mov(rax,
+      GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_value_)));
   lock();
   if (bit64) {
     cmpxchg(ptr[r9], r8);
-
   } else {
     cmpxchg(ptr[r9], r8d);
   }
-  // the ZF flag is unaffected by BTR! we exploit this for the retval
-
-  // cancel our lock on the 65k block
-  lock();
-  btr(qword[rdx], rcx);
+  jnz(value_changed);
 
-  jnc(somehow_double_cleared);
-
-  L(done);
-  // i don't care that theres a dependency on the prev value of rax atm
-  // sadly theres no CF&ZF condition code
-  setz(al);
-  setc(ah);
-  cmp(ax, 0x0101);
+  count(offsetof(ReserveHelper, stores));
+  xor_(eax, eax);  // ZF = 1
   ret();
 
-  // could be the same label, but otherwise we don't know where we came from
-  // when one gets triggered
-  L(reservation_isnt_for_our_addr);
-  DebugBreak();
-
-  L(somehow_double_cleared);  // somehow, something else cleared our reserve??
-  DebugBreak();
+  L(no_reservation);
+  count(offsetof(ReserveHelper, stores_without_reservation));
+  jmp(failed);
+  L(reservation_lost);
+  count(offsetof(ReserveHelper, reservations_lost));
+  jmp(failed);
+  L(value_changed);
+  count(offsetof(ReserveHelper, values_changed));
+  L(failed);
+  or_(eax, 1);  // ZF = 0
+  ret();
 
   code_offsets.prolog_stack_alloc = getSize();
   code_offsets.body = getSize();
@@ -1092,7 +1425,8 @@ void X64Backend::InitializeBackendContext(void* ctx) {
 
   */
 
-  bctx->stackpoints = cvars::enable_host_guest_stack_synchronization
+  bctx->stackpoints = cvars::enable_host_guest_stack_synchronization &&
+                              !cvars::lazy_host_guest_stack_synchronization
                           ? new X64BackendStackpoint[cvars::max_stackpoints]
                           : nullptr;
   bctx->current_stackpoint_depth = 0;
@@ -1102,6 +1436,8 @@ void X64Backend::InitializeBackendContext(void* ctx) {
   bctx->Ox1000 = 0x1000;
   bctx->guest_tick_count = Clock::GetGuestTickCountPointer();
   bctx->reserve_helper_ = &reserve_helper_;
+  bctx->host_call_return_slot = 0;
+  bctx->resolve_return_slot = 0;
 }
 void X64Backend::DeinitializeBackendContext(void* ctx) {
   X64BackendContext* bctx = BackendContextForGuestContext(ctx);
@@ -1132,19 +1468,54 @@ void X64Backend::SetGuestRoundingMode(void* ctx, unsigned int mode) {
 }
 
 bool X64Backend::PopulatePseudoStacktrace(GuestPseudoStackTrace* st) {
-  if (!cvars::enable_host_guest_stack_synchronization) {
-    return false;
-  }
-
   ThreadState* thrd_state = ThreadState::Get();
   if (!thrd_state) {
     return false;  // we're not a guest!
   }
-  ppc::PPCContext* ctx = thrd_state->context();
+  return PopulatePseudoStacktrace(thrd_state, st);
+}
+
+bool X64Backend::PopulatePseudoStacktrace(ThreadState* thread_state,
+                                          GuestPseudoStackTrace* st) {
+  if (!cvars::enable_host_guest_stack_synchronization) {
+    return false;
+  }
+
+  ppc::PPCContext* ctx = thread_state->context();
 
   X64BackendContext* backend_ctx = BackendContextForGuestContext(ctx);
 
-  uint32_t depth = backend_ctx->current_stackpoint_depth - 1;
+  if (cvars::lazy_host_guest_stack_synchronization) {
+    // The frames below a host call in progress stay put while it runs.
+    uint64_t host_return_slot = *reinterpret_cast<volatile uint64_t*>(
+        &backend_ctx->host_call_return_slot);
+    if (!host_return_slot) {
+      return false;
+    }
+    uint32_t count = 0;
+    bool truncated = false;
+    WalkGuestFrames(host_return_slot, [&](const GuestFrame& frame) {
+      if (count >= MAX_GUEST_PSEUDO_STACKTRACE_ENTRIES) {
+        truncated = true;
+        return false;
+      }
+      st->return_addrs[count++] = frame.guest_return_address;
+      return true;
+    });
+    if (!count) {
+      return false;
+    }
+    st->count = count;
+    st->truncated_flag = truncated ? 1 : 0;
+    return true;
+  }
+
+  // Read once, the thread may be running.
+  uint32_t stackpoint_depth =
+      std::min(*reinterpret_cast<volatile unsigned int*>(
+                   &backend_ctx->current_stackpoint_depth),
+               static_cast<unsigned int>(cvars::max_stackpoints));
+  uint32_t depth = stackpoint_depth - 1;
   if (static_cast<int32_t>(depth) < 1) {
     return false;
   }
@@ -1155,7 +1526,7 @@ bool X64Backend::PopulatePseudoStacktrace(GuestPseudoStackTrace* st) {
   st->truncated_flag = num_entries_to_populate < depth ? 1 : 0;
 
   X64BackendStackpoint* current_stackpoint =
-      &backend_ctx->stackpoints[backend_ctx->current_stackpoint_depth - 1];
+      &backend_ctx->stackpoints[stackpoint_depth - 1];
 
   for (uint32_t stp_index = 0; stp_index < num_entries_to_populate;
        ++stp_index) {
@@ -1165,6 +1536,154 @@ bool X64Backend::PopulatePseudoStacktrace(GuestPseudoStackTrace* st) {
   return true;
 }
 
+template <typename Visitor>
+void X64Backend::WalkGuestFrames(uint64_t host_return_slot, Visitor&& visitor) {
+  uint64_t code_base = code_cache_->execute_base_address();
+  uint64_t code_end = code_base + code_cache_->total_size();
+  // Bounded in case the stack doesn't look like expected.
+  for (uint32_t i = 0; i < uint32_t(cvars::max_stackpoints); ++i) {
+    uint64_t return_address =
+        *reinterpret_cast<const uint64_t*>(host_return_slot);
+    if (return_address < code_base || return_address >= code_end) {
+      break;
+    }
+    // Host code, like the host to guest thunk, has no function.
+    GuestFunction* function = code_cache_->LookupFunction(return_address);
+    if (!function) {
+      break;
+    }
+    GuestFrame frame;
+    frame.host_frame = host_return_slot + 8;
+    frame.host_return_address = return_address;
+    frame.function = function;
+    auto frame_data = reinterpret_cast<const uint8_t*>(frame.host_frame);
+    frame.guest_stack = *reinterpret_cast<const uint32_t*>(
+        frame_data + StackLayout::GUEST_FRAME_GUEST_STACK);
+    frame.guest_return_address = *reinterpret_cast<const uint32_t*>(
+        frame_data + StackLayout::GUEST_RET_ADDR);
+    uint32_t host_stack_size = *reinterpret_cast<const uint32_t*>(
+        frame_data + StackLayout::GUEST_FRAME_HOST_STACK_SIZE);
+    if (host_stack_size < StackLayout::GUEST_STACK_SIZE ||
+        (host_stack_size + 8) % 16 != 0) {
+      break;
+    }
+    if (!visitor(frame)) {
+      break;
+    }
+    host_return_slot = frame.host_frame + host_stack_size;
+  }
+}
+
+uint32_t X64Backend::CountUnwoundGuestFrames(uint64_t host_return_slot,
+                                             uint32_t guest_stack) {
+  uint32_t count = 0;
+  WalkGuestFrames(host_return_slot, [&](const GuestFrame& frame) {
+    if (guest_stack <= frame.guest_stack) {
+      return false;
+    }
+    ++count;
+    return true;
+  });
+  return count;
+}
+
+uint64_t X64Backend::FindReentryHostFrame(void* raw_context,
+                                          uint64_t host_return_slot,
+                                          uint64_t continuation,
+                                          uint64_t host_stack_size) {
+  auto context = reinterpret_cast<ppc::PPCContext*>(raw_context);
+  auto backend = static_cast<X64Backend*>(context->processor->backend());
+  auto function = static_cast<X64Function*>(
+      backend->code_cache()->LookupFunction(continuation));
+  if (!function || !function->machine_code()) {
+    return 0;
+  }
+  // A frame of older code of the function may have a different layout.
+  uint64_t code_begin = reinterpret_cast<uint64_t>(function->machine_code());
+  uint64_t code_size = function->machine_code_length();
+  if (continuation - code_begin >= code_size) {
+    return 0;
+  }
+  // The guest stack pointer restored by the longjmp is below the one at entry
+  // to the function that called setjmp, but not below that of anything it
+  // called.
+  uint32_t guest_stack = uint32_t(context->r[1]);
+  uint64_t host_frame = 0;
+  backend->WalkGuestFrames(host_return_slot, [&](const GuestFrame& frame) {
+    if (frame.function == function &&
+        frame.host_return_address - code_begin < code_size &&
+        frame.guest_stack > guest_stack &&
+        *reinterpret_cast<const uint32_t*>(
+            frame.host_frame + StackLayout::GUEST_FRAME_HOST_STACK_SIZE) ==
+            host_stack_size) {
+      host_frame = frame.host_frame;
+      return false;
+    }
+    return true;
+  });
+  return host_frame;
+}
+
+X64IndirectCallCache* X64Backend::AllocateIndirectCallCache(
+    uint32_t call_site_address) {
+  std::lock_guard<std::mutex> lock(indirect_call_caches_mutex_);
+  X64IndirectCallCache& cache = indirect_call_caches_.emplace_back();
+  std::memset(&cache, 0, sizeof(cache));
+  cache.call_site_address = call_site_address;
+  return &cache;
+}
+
+void X64Backend::FlushIndirectCallCaches() {
+  std::lock_guard<std::mutex> lock(indirect_call_caches_mutex_);
+  for (X64IndirectCallCache& cache : indirect_call_caches_) {
+    // Aligned 64-bit stores are atomic, call sites never see half an entry.
+    for (uint32_t i = 0; i < X64IndirectCallCache::kMaxEntries; ++i) {
+      *reinterpret_cast<volatile uint64_t*>(&cache.entries[i]) = 0;
+    }
+  }
+}
+
+void X64Backend::DumpReservationStatistics() {
+  if (!cvars::reservation_statistics) {
+    return;
+  }
+  const ReserveHelper& helper = reserve_helper_;
+  uint64_t failures = helper.stores_without_reservation +
+                      helper.reservations_lost + helper.values_changed;
+  uint64_t attempts = helper.stores + failures;
+  XELOGI(
+      "Reserved stores: {} attempts, {} succeeded, {} without reservation, {} "
+      "lost to other reservations, {} lost to plain stores ({:.2f}% lost)",
+      attempts, helper.stores, helper.stores_without_reservation,
+      helper.reservations_lost, helper.values_changed,
+      attempts ? 100.0 * double(failures) / double(attempts) : 0.0);
+}
+
+void X64Backend::DumpIndirectCallCacheStatistics() {
+  if (!cvars::indirect_call_inline_cache_statistics) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(indirect_call_caches_mutex_);
+  std::vector<const X64IndirectCallCache*> sorted;
+  uint64_t total_hits = 0, total_misses = 0;
+  for (const X64IndirectCallCache& cache : indirect_call_caches_) {
+    sorted.push_back(&cache);
+    total_hits += cache.hits;
+    total_misses += cache.misses;
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const X64IndirectCallCache* a, const X64IndirectCallCache* b) {
+              return a->misses > b->misses;
+            });
+  XELOGI("Indirect call inline caches: {} sites, {} hits, {} misses",
+         sorted.size(), total_hits, total_misses);
+  for (size_t i = 0; i < std::min(sorted.size(), size_t(32)); ++i) {
+    const X64IndirectCallCache* cache = sorted[i];
+    XELOGI("  {:08X}: {} hits, {} misses", cache->call_site_address,
+           cache->hits, cache->misses);
+  }
+}
+
 #if XE_X64_PROFILER_AVAILABLE == 1
 uint64_t* X64Backend::GetProfilerRecordForFunction(uint32_t guest_address) {
   // who knows, we might want to compile different versions of a function one
@@ -1180,6 +1699,12 @@ uint64_t* X64Backend::GetProfilerRecordForFunction(uint32_t guest_address) {
   }
 }
 
+uint64_t* X64Backend::GetProfilerMxcsrSwitchRecordForFunction(
+    uint32_t guest_address) {
+  // std::map nodes don't move, so the emitted code can keep the address.
+  return &profiler_mxcsr_switch_data_[guest_address];
+}
+
 #endif
 }  // namespace x64
 }  // namespace backend
@@ -10,9 +10,13 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_BACKEND_H_
 #define XENIA_CPU_BACKEND_X64_X64_BACKEND_H_
 
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 
 #include "xenia/base/cvar.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/backend/backend.h"
 
 #if XE_PLATFORM_WIN32 == 1
@@ -26,6 +30,10 @@
 DECLARE_int64(x64_extension_mask);
 DECLARE_int64(max_stackpoints);
 DECLARE_bool(enable_host_guest_stack_synchronization);
+DECLARE_bool(lazy_host_guest_stack_synchronization);
+DECLARE_bool(enable_persistent_code_cache);
+DECLARE_int32(indirect_call_inline_cache_entries);
+DECLARE_bool(indirect_call_inline_cache_statistics);
 namespace xe {
 class Exception;
 }  // namespace xe
@@ -42,15 +50,48 @@ typedef void* (*HostToGuestThunk)(void* target, void* arg0, void* arg1);
 typedef void* (*GuestToHostThunk)(void* target, void* arg0, void* arg1);
 typedef void (*ResolveFunctionThunk)();
 
-#define RESERVE_BLOCK_SHIFT 16
-
-#define RESERVE_NUM_ENTRIES \
-  ((1024ULL * 1024ULL * 1024ULL * 4ULL) >> RESERVE_BLOCK_SHIFT)
+// Reservations are tracked per 128-byte cache line, with the lines hashed into a
+// table of version counters. lwarx records the current version of its line,
+// and stwcx succeeds only if it can advance the version it recorded and the
+// memory still holds the value it loaded. Another reserving thread's store to
+// the line advances the version, while stores from threads that don't reserve
+// are caught by the value compare. Lines aliasing in the table only cause
+// spurious failures, which the guest retries, never incorrect successes.
+// The table index is the line number rotated within its bits, so adjacent
+// guest lines, such as different locks in one structure, get versions in
+// different host cache lines rather than contending for the same one.
+#define RESERVE_LINE_SHIFT 7
+#define RESERVE_NUM_ENTRIES 65536
+#define RESERVE_INDEX_ROTATE 3
 // https://codalogic.com/blog/2022/12/06/Exploring-PowerPCs-read-modify-write-operations
 struct ReserveHelper {
-  uint64_t blocks[RESERVE_NUM_ENTRIES / 64];
+  uint64_t line_versions[RESERVE_NUM_ENTRIES];
+  // Only updated with reservation_statistics.
+  alignas(64) uint64_t stores;
+  // stwcx without a reservation, or for a different line than the lwarx.
+  uint64_t stores_without_reservation;
+  // Another reserving thread stored to the line (or an aliased one) first.
+  uint64_t reservations_lost;
+  // The value was changed by a store that didn't use a reservation.
+  uint64_t values_changed;
+
+  ReserveHelper() { memset(this, 0, sizeof(*this)); }
+};
 
-  ReserveHelper() { memset(blocks, 0, sizeof(blocks)); }
+// Per call site cache of the last targets of an indirect call, so the call can
+// be done directly from the site without the indirection table load.
+struct X64IndirectCallCache {
+  static constexpr uint32_t kMaxEntries = 4;
+  // Guest address in the low 32 bits, host address in the high 32 bits, so an
+  // entry is always updated atomically. 0 for empty entries.
+  uint64_t entries[kMaxEntries];
+  // Entry to replace on the next miss.
+  uint32_t next_entry;
+  // Guest address of the call instruction.
+  uint32_t call_site_address;
+  // Only updated with indirect_call_inline_cache_statistics.
+  uint64_t hits;
+  uint64_t misses;
 };
 
 struct X64BackendStackpoint {
@@ -72,8 +113,9 @@ struct X64BackendContext {
   uint64_t* guest_tick_count;
   // records mapping of host_stack to guest_stack
   X64BackendStackpoint* stackpoints;
+  // Reservation table entry and the version it had at the lwarx.
   uint64_t cached_reserve_offset;
-  uint32_t cached_reserve_bit;
+  uint64_t cached_reserve_version;
   unsigned int current_stackpoint_depth;
   unsigned int mxcsr_fpu;  // currently, the way we implement rounding mode
                            // affects both vmx and the fpu
@@ -83,6 +125,11 @@ struct X64BackendContext {
   unsigned int flags;
   unsigned int Ox1000;  // constant 0x1000 so we can shrink each tail emitted
                         // add of it by... 2 bytes lol
+  // With lazy stack synchronization, the host stack slot holding the return
+  // address into guest code of the innermost guest to host call in progress,
+  // or 0 if there is none, and of the last call to the resolve thunk.
+  uint64_t host_call_return_slot;
+  uint64_t resolve_return_slot;
 };
 constexpr unsigned int DEFAULT_VMX_MXCSR =
     0x8000 |                   // flush to zero
@@ -104,6 +151,11 @@ class X64Backend : public Backend {
   HostToGuestThunk host_to_guest_thunk() const { return host_to_guest_thunk_; }
   // Function that guest code can call to transition into host code.
   GuestToHostThunk guest_to_host_thunk() const { return guest_to_host_thunk_; }
+  // Same as guest_to_host_thunk, but only for the exports tagged as
+  // ExportTag::kLeaf, saving fewer registers.
+  GuestToHostThunk guest_to_host_leaf_thunk() const {
+    return guest_to_host_leaf_thunk_;
+  }
   // Function that thunks to the ResolveFunction in X64Emitter.
   ResolveFunctionThunk resolve_function_thunk() const {
     return resolve_function_thunk_;
@@ -131,6 +183,11 @@ class X64Backend : public Backend {
   std::unique_ptr<GuestFunction> CreateGuestFunction(Module* module,
                                                      uint32_t address) override;
 
+  std::vector<uint32_t> OpenModuleCodeCache(
+      Module* module, const std::filesystem::path& cache_directory) override;
+  void CloseModuleCodeCache(Module* module) override;
+  bool RestoreGuestFunction(GuestFunction* function) override;
+
   uint64_t CalculateNextHostInstruction(ThreadDebugInfo* thread_info,
                                         uint64_t current_pc) override;
 
@@ -146,14 +203,62 @@ class X64Backend : public Backend {
   }
   virtual void SetGuestRoundingMode(void* ctx, unsigned int mode) override;
   virtual bool PopulatePseudoStacktrace(GuestPseudoStackTrace* st) override;
+  virtual bool PopulatePseudoStacktrace(ThreadState* thread_state,
+                                        GuestPseudoStackTrace* st) override;
   void RecordMMIOExceptionForGuestInstruction(void* host_address);
+
+  // Lazy stack synchronization, walking the frames of guest functions on the
+  // host stack starting at the one returned to by the address in
+  // host_return_slot.
+  // Number of innermost frames entered with a lower guest stack pointer than
+  // the current one, which guest code has already unwound.
+  uint32_t CountUnwoundGuestFrames(uint64_t host_return_slot,
+                                   uint32_t guest_stack);
+  // Host stack pointer of the innermost frame of the code containing
+  // continuation that is still live on the guest stack, or 0 if there is none.
+  static uint64_t FindReentryHostFrame(void* raw_context,
+                                       uint64_t host_return_slot,
+                                       uint64_t continuation,
+                                       uint64_t host_stack_size);
+
+  // Returns a zeroed inline cache for an indirect call site, valid for the
+  // lifetime of the backend.
+  X64IndirectCallCache* AllocateIndirectCallCache(uint32_t call_site_address);
+  // Drops all cached targets, must be called when code for a guest function is
+  // replaced so call sites stop using the old code.
+  void FlushIndirectCallCaches();
+  void DumpIndirectCallCacheStatistics();
+  void DumpReservationStatistics();
+  // Returns the number of guest traps hit, including this one.
+  uint64_t RecordGuestTrap() {
+    return guest_trap_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  uint64_t guest_trap_count() const {
+    return guest_trap_count_.load(std::memory_order_relaxed);
+  }
 #if XE_X64_PROFILER_AVAILABLE == 1
   uint64_t* GetProfilerRecordForFunction(uint32_t guest_address);
+  // Number of MXCSR mode switches executed by the function.
+  uint64_t* GetProfilerMxcsrSwitchRecordForFunction(uint32_t guest_address);
 #endif
  private:
   static bool ExceptionCallbackThunk(Exception* ex, void* data);
   bool ExceptionCallback(Exception* ex);
 
+  uint64_t CalculatePersistentCacheIdentityKey() const;
+
+  struct GuestFrame {
+    uint64_t host_frame;
+    uint64_t host_return_address;
+    GuestFunction* function;
+    uint32_t guest_stack;
+    uint32_t guest_return_address;
+  };
+  // Calls visitor with the frames from the innermost outwards until it returns
+  // false or a frame not belonging to guest code is reached.
+  template <typename Visitor>
+  void WalkGuestFrames(uint64_t host_return_slot, Visitor&& visitor);
+
   uintptr_t capstone_handle_ = 0;
 
   std::unique_ptr<X64CodeCache> code_cache_;
@@ -161,6 +266,7 @@ class X64Backend : public Backend {
 
   HostToGuestThunk host_to_guest_thunk_;
   GuestToHostThunk guest_to_host_thunk_;
+  GuestToHostThunk guest_to_host_leaf_thunk_;
   ResolveFunctionThunk resolve_function_thunk_;
   void* synchronize_guest_and_host_stack_helper_ = nullptr;
 
@@ -177,9 +283,16 @@ class X64Backend : public Backend {
  private:
 #if XE_X64_PROFILER_AVAILABLE == 1
   GuestProfilerData profiler_data_;
+  GuestProfilerData profiler_mxcsr_switch_data_;
 #endif
 
+  std::mutex indirect_call_caches_mutex_;
+  std::deque<X64IndirectCallCache> indirect_call_caches_;
+
   alignas(64) ReserveHelper reserve_helper_;
+
+  std::atomic<uint64_t> guest_trap_count_{0};
+  std::unique_ptr<xe::threading::HighResolutionTimer> exception_report_timer_;
 };
 
 }  // namespace x64
@@ -9,9 +9,18 @@
 
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
+#include "xenia/base/platform.h"
+
+#if XE_PLATFORM_LINUX
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #if ENABLE_VTUNE
 #include "third_party/vtune/include/jitprofiling.h"
 #pragma comment(lib, "../third_party/vtune/lib64/jitprofiling.lib")
@@ -20,12 +29,27 @@
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/metrics.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/module.h"
+#include "xenia/memory.h"
+
+DEFINE_bool(perf_map, false,
+            "Write the names of the generated functions to /tmp/perf-<pid>.map "
+            "for Linux perf to symbolize guest code.",
+            "x64");
+DEFINE_path(jitdump_path, "",
+            "Directory to write a jit-<pid>.dump file with the generated code "
+            "to, for Linux perf inject --jit.",
+            "x64");
 
 namespace xe {
 namespace cpu {
@@ -34,9 +58,77 @@ namespace x64 {
 
 using namespace xe::literals;
 
+namespace {
+metrics::Gauge code_cache_used_bytes_metric(
+    "xenia_cpu_code_cache_used_bytes",
+    "Generated code, unwind info and data placed in the code cache.");
+metrics::Gauge code_cache_committed_bytes_metric(
+    "xenia_cpu_code_cache_committed_bytes",
+    "Committed memory of the code cache.");
+metrics::Gauge code_cache_functions_metric(
+    "xenia_cpu_code_cache_functions",
+    "Functions placed in the code cache, including the superseded ones.");
+metrics::Gauge code_cache_superseded_bytes_metric(
+    "xenia_cpu_code_cache_superseded_bytes",
+    "Code of the functions replaced by retranslation, kept in the code cache "
+    "for the callers and the threads still executing it.");
+}  // namespace
+
+#if XE_PLATFORM_LINUX
+namespace {
+// Records of the jitdump format as defined in the Linux perf sources
+// (tools/perf/Documentation/jitdump-specification.txt).
+constexpr uint32_t kJitdumpMagic = 0x4A695444;
+constexpr uint32_t kJitdumpVersion = 1;
+constexpr uint32_t kJitdumpCodeLoad = 0;
+constexpr uint32_t kJitdumpElfMachineX86_64 = 62;
+
+struct JitdumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+static_assert_size(JitdumpHeader, 40);
+
+struct JitdumpCodeLoad {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+};
+static_assert_size(JitdumpCodeLoad, 56);
+
+// perf expects the same clock as its -k mono option.
+uint64_t JitdumpTimestamp() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+}  // namespace
+#endif
+
 X64CodeCache::X64CodeCache() = default;
 
 X64CodeCache::~X64CodeCache() {
+  ShutdownCodeSymbolOutput();
+
+  for (auto& module_cache : persistent_module_caches_) {
+    if (module_cache.second.file) {
+      fclose(module_cache.second.file);
+    }
+  }
+  persistent_module_caches_.clear();
+
   if (indirection_table_base_) {
     xe::memory::DeallocFixed(indirection_table_base_, 0,
                              xe::memory::DeallocationType::kRelease);
@@ -76,7 +168,7 @@ bool X64CodeCache::Initialize() {
   file_name_ = fmt::format("xenia_code_cache_{}", Clock::QueryHostTickCount());
   mapping_ = xe::memory::CreateFileMappingHandle(
       file_name_, kGeneratedCodeSize, xe::memory::PageAccess::kExecuteReadWrite,
-      false);
+      false, Memory::GetHostNumaNode());
   if (mapping_ == xe::memory::kFileMappingHandleInvalid) {
     XELOGE("Unable to create code cache mmap");
     return false;
@@ -123,9 +215,141 @@ bool X64CodeCache::Initialize() {
   // Preallocate the function map to a large, reasonable size.
   generated_code_map_.reserve(kMaximumFunctionCount);
 
+  InitializeCodeSymbolOutput();
+
   return true;
 }
 
+void X64CodeCache::InitializeCodeSymbolOutput() {
+#if XE_PLATFORM_LINUX
+  if (cvars::perf_map) {
+    auto perf_map_path =
+        std::filesystem::path("/tmp") / fmt::format("perf-{}.map", getpid());
+    perf_map_file_ = xe::filesystem::OpenFile(perf_map_path, "w");
+    if (perf_map_file_) {
+      XELOGI("Writing generated code symbols to {}",
+             xe::path_to_utf8(perf_map_path));
+    } else {
+      XELOGE("Failed to open {} for the generated code symbols",
+             xe::path_to_utf8(perf_map_path));
+    }
+  }
+
+  if (!cvars::jitdump_path.empty()) {
+    auto jitdump_file_path =
+        cvars::jitdump_path / fmt::format("jit-{}.dump", getpid());
+    jitdump_file_ = xe::filesystem::OpenFile(jitdump_file_path, "w+b");
+    if (!jitdump_file_) {
+      XELOGE("Failed to open {} for the generated code",
+             xe::path_to_utf8(jitdump_file_path));
+      return;
+    }
+    JitdumpHeader header = {};
+    header.magic = kJitdumpMagic;
+    header.version = kJitdumpVersion;
+    header.total_size = sizeof(header);
+    header.elf_mach = kJitdumpElfMachineX86_64;
+    header.pid = uint32_t(getpid());
+    header.timestamp = JitdumpTimestamp();
+    fwrite(&header, sizeof(header), 1, jitdump_file_);
+    fflush(jitdump_file_);
+    jitdump_marker_size_ = size_t(sysconf(_SC_PAGESIZE));
+    jitdump_marker_ = mmap(nullptr, jitdump_marker_size_,
+                           PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                           fileno(jitdump_file_), 0);
+    if (jitdump_marker_ == MAP_FAILED) {
+      XELOGW("Failed to map {}, perf will not find it",
+             xe::path_to_utf8(jitdump_file_path));
+      jitdump_marker_ = nullptr;
+    }
+    XELOGI("Writing generated code to {}", xe::path_to_utf8(jitdump_file_path));
+  }
+#endif
+}
+
+void X64CodeCache::ShutdownCodeSymbolOutput() {
+  std::lock_guard<std::mutex> lock(code_symbol_mutex_);
+#if XE_PLATFORM_LINUX
+  if (jitdump_marker_) {
+    munmap(jitdump_marker_, jitdump_marker_size_);
+    jitdump_marker_ = nullptr;
+  }
+#endif
+  if (jitdump_file_) {
+    fclose(jitdump_file_);
+    jitdump_file_ = nullptr;
+  }
+  if (perf_map_file_) {
+    fclose(perf_map_file_);
+    perf_map_file_ = nullptr;
+  }
+}
+
+void X64CodeCache::RegisterCodeSymbol(uint32_t guest_address,
+                                      GuestFunction* function_info,
+                                      const void* code_execute_address,
+                                      size_t code_size) {
+#if ENABLE_VTUNE
+  bool vtune_active = iJIT_IsProfilingActive() == iJIT_SAMPLING_ON;
+#else
+  bool vtune_active = false;
+#endif
+  if (!vtune_active && !perf_map_file_ && !jitdump_file_) {
+    return;
+  }
+
+  std::string method_name;
+  if (function_info && function_info->name().size() != 0) {
+    method_name = function_info->name();
+  } else if (guest_address) {
+    method_name = fmt::format("sub_{:08X}", guest_address);
+  } else {
+    method_name = fmt::format("xe_host_code_{:X}",
+                              reinterpret_cast<uintptr_t>(code_execute_address));
+  }
+
+#if ENABLE_VTUNE
+  if (vtune_active) {
+    iJIT_Method_Load_V2 method = {0};
+    method.method_id = iJIT_GetNewMethodID();
+    method.method_load_address = const_cast<void*>(code_execute_address);
+    method.method_size = uint32_t(code_size);
+    method.method_name = const_cast<char*>(method_name.data());
+    method.module_name = function_info
+                             ? (char*)function_info->module()->name().c_str()
+                             : nullptr;
+    iJIT_NotifyEvent(iJVM_EVENT_TYPE_METHOD_LOAD_FINISHED_V2, (void*)&method);
+  }
+#endif
+
+  std::lock_guard<std::mutex> lock(code_symbol_mutex_);
+  if (perf_map_file_) {
+    fmt::print(perf_map_file_, "{:x} {:x} {}\n",
+               reinterpret_cast<uintptr_t>(code_execute_address), code_size,
+               method_name);
+    fflush(perf_map_file_);
+  }
+#if XE_PLATFORM_LINUX
+  if (jitdump_file_) {
+    JitdumpCodeLoad record = {};
+    record.id = kJitdumpCodeLoad;
+    record.total_size =
+        uint32_t(sizeof(record) + method_name.size() + 1 + code_size);
+    record.timestamp = JitdumpTimestamp();
+    record.pid = uint32_t(getpid());
+    record.tid = threading::current_thread_system_id();
+    record.vma = reinterpret_cast<uintptr_t>(code_execute_address);
+    record.code_addr = record.vma;
+    record.code_size = code_size;
+    record.code_index = jitdump_code_index_++;
+    fwrite(&record, sizeof(record), 1, jitdump_file_);
+    fwrite(method_name.c_str(), method_name.size() + 1, 1, jitdump_file_);
+    fwrite(code_execute_address, code_size, 1, jitdump_file_);
+    fflush(jitdump_file_);
+  }
+#endif
+}
+
 void X64CodeCache::set_indirection_default(uint32_t default_value) {
   indirection_default_value_ = default_value;
 }
@@ -141,6 +365,78 @@ void X64CodeCache::AddIndirection(uint32_t guest_address,
   *indirection_slot = host_address;
 }
 
+void X64CodeCache::RedirectCode(const void* old_code_execute_address,
+                                const void* new_code_execute_address) {
+  auto old_execute = reinterpret_cast<const uint8_t*>(old_code_execute_address);
+  auto new_execute = reinterpret_cast<const uint8_t*>(new_code_execute_address);
+  // Replacing the first 8 bytes with one aligned store so threads entering the
+  // code see either the old or the new instruction, never a torn one.
+  if (old_execute < generated_code_execute_base_ ||
+      (reinterpret_cast<uintptr_t>(old_execute) & 7)) {
+    return;
+  }
+  size_t offset = size_t(old_execute - generated_code_execute_base_);
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    if (offset + 8 > generated_code_offset_) {
+      return;
+    }
+    // The map is sorted by the start offset.
+    auto old_entry = std::lower_bound(
+        generated_code_map_.cbegin(), generated_code_map_.cend(),
+        uint64_t(offset) << 32,
+        [](const std::pair<uint64_t, GuestFunction*>& entry, uint64_t key) {
+          return entry.first < key;
+        });
+    if (old_entry != generated_code_map_.cend() &&
+        (old_entry->first >> 32) == offset) {
+      superseded_code_size_ +=
+          size_t(uint32_t(old_entry->first) - uint32_t(offset));
+      code_cache_superseded_bytes_metric.Set(int64_t(superseded_code_size_));
+    }
+  }
+  int64_t displacement = new_execute - (old_execute + 5);
+  if (displacement < INT32_MIN || displacement > INT32_MAX) {
+    return;
+  }
+  auto write_word = reinterpret_cast<volatile uint64_t*>(
+      generated_code_write_base_ + offset);
+  uint8_t bytes[8];
+  uint64_t word = *write_word;
+  std::memcpy(bytes, &word, sizeof(bytes));
+  // jmp rel32, keeping the rest of the old instructions.
+  bytes[0] = 0xE9;
+  int32_t displacement32 = int32_t(displacement);
+  std::memcpy(&bytes[1], &displacement32, sizeof(displacement32));
+  std::memcpy(&word, bytes, sizeof(word));
+  *write_word = word;
+}
+
+void X64CodeCache::CheckCodeCacheCapacity(size_t high_mark) {
+  if (high_mark > kGeneratedCodeSize) {
+    xe::FatalError(fmt::format(
+        "The code cache is full ({} MB of generated code, {} MB of it "
+        "superseded by retranslation). Please report this to the Xenia/Canary "
+        "developers",
+        kGeneratedCodeSize >> 20, superseded_code_size_ >> 20));
+  }
+  // Warning once when a quarter and once when a tenth of the space is left.
+  uint32_t occupancy_level = 0;
+  if (high_mark >= kGeneratedCodeSize / 10 * 9) {
+    occupancy_level = 2;
+  } else if (high_mark >= kGeneratedCodeSize / 4 * 3) {
+    occupancy_level = 1;
+  }
+  if (occupancy_level > code_cache_occupancy_level_) {
+    code_cache_occupancy_level_ = occupancy_level;
+    XELOGW(
+        "Code cache: {} of {} MB used, {} MB of it superseded by "
+        "retranslation",
+        high_mark >> 20, kGeneratedCodeSize >> 20,
+        superseded_code_size_ >> 20);
+  }
+}
+
 void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
                                          uint32_t guest_high) {
   if (!indirection_table_base_) {
@@ -210,6 +506,7 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
         generated_code_write_base_ + generated_code_offset_;
 
     high_mark = generated_code_offset_;
+    CheckCodeCacheCapacity(high_mark);
 
     // Store in map. It is maintained in sorted order of host PC dependent on
     // us also being append-only.
@@ -245,6 +542,10 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
       }
     } while (generated_code_commit_mark_.compare_exchange_weak(
         old_commit_mark, new_commit_mark));
+    code_cache_used_bytes_metric.Set(int64_t(high_mark));
+    code_cache_committed_bytes_metric.Set(
+        int64_t(generated_code_commit_mark_.load(std::memory_order_relaxed)));
+    code_cache_functions_metric.Set(int64_t(generated_code_map_.size()));
 
     // Copy code.
     std::memcpy(code_write_address, machine_code, func_info.code_size.total);
@@ -258,27 +559,6 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
               unwind_reservation);
   }
 
-#if ENABLE_VTUNE
-  if (iJIT_IsProfilingActive() == iJIT_SAMPLING_ON) {
-    std::string method_name;
-    if (function_info && function_info->name().size() != 0) {
-      method_name = function_info->name();
-    } else {
-      method_name = xe::format_string("sub_%.8X", guest_address);
-    }
-
-    iJIT_Method_Load_V2 method = {0};
-    method.method_id = iJIT_GetNewMethodID();
-    method.method_load_address = code_execute_address;
-    method.method_size = uint32_t(code_size);
-    method.method_name = const_cast<char*>(method_name.data());
-    method.module_name = function_info
-                             ? (char*)function_info->module()->name().c_str()
-                             : nullptr;
-    iJIT_NotifyEvent(iJVM_EVENT_TYPE_METHOD_LOAD_FINISHED_V2, (void*)&method);
-  }
-#endif
-
   // Now that everything is ready, fix up the indirection table.
   // Note that we do support code that doesn't have an indirection fixup, so
   // ignore those when we see them.
@@ -303,6 +583,7 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
     generated_code_offset_ += xe::round_up(length, 16);
 
     high_mark = generated_code_offset_;
+    CheckCodeCacheCapacity(high_mark);
   }
 
   // If we are going above the high water mark of committed memory, commit some
@@ -328,6 +609,9 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
     }
   } while (generated_code_commit_mark_.compare_exchange_weak(old_commit_mark,
                                                              new_commit_mark));
+  code_cache_used_bytes_metric.Set(int64_t(high_mark));
+  code_cache_committed_bytes_metric.Set(
+      int64_t(generated_code_commit_mark_.load(std::memory_order_relaxed)));
 
   // Copy code.
   std::memcpy(data_address, data, length);
@@ -362,6 +646,351 @@ GuestFunction* X64CodeCache::LookupFunction(uint64_t host_pc) {
   }
 }
 
+// 'XPCC'.
+static constexpr uint32_t kPersistentCacheMagic = 0x43435058;
+// Increment when the file layout or the emitter relocation rules change.
+static constexpr uint32_t kPersistentCacheVersion = 1;
+
+struct PersistentCacheFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t identity_key;
+  uint64_t image_anchor;
+};
+
+struct PersistentFunctionRecord {
+  uint32_t guest_address;
+  uint32_t guest_end_address;
+  uint64_t guest_code_hash;
+  uint32_t code_size;
+  uint32_t relocation_count;
+  uint32_t source_map_count;
+  uint32_t prolog_size;
+  uint32_t body_size;
+  uint32_t epilog_size;
+  uint32_t tail_size;
+  uint32_t prolog_stack_alloc_offset;
+  uint32_t stack_size;
+  // Hash of everything following the record header.
+  uint32_t payload_hash;
+};
+static_assert(sizeof(PersistentFunctionRecord) % 8 == 0,
+              "Persistent code cache records must keep payload alignment");
+
+static size_t GetPersistentPayloadSize(const PersistentFunctionRecord& record) {
+  return xe::round_up(size_t(record.code_size), size_t(8)) +
+         sizeof(X64CodeRelocation) * record.relocation_count +
+         xe::round_up(sizeof(SourceMapEntry) * record.source_map_count,
+                      size_t(8));
+}
+
+void X64CodeCache::InitializePersistentCache(uint64_t identity_key,
+                                             uint64_t image_anchor) {
+  persistent_cache_identity_key_ = identity_key;
+  persistent_cache_image_anchor_ = image_anchor;
+  persistent_cache_enabled_ = true;
+}
+
+uint64_t X64CodeCache::HashGuestCode(Module* module, uint32_t address,
+                                     uint32_t end_address) {
+  if (end_address < address) {
+    return 0;
+  }
+  return XXH3_64bits(module->memory()->TranslateVirtual(address),
+                     end_address - address + 4);
+}
+
+std::vector<uint32_t> X64CodeCache::OpenPersistentModuleCache(
+    Module* module, const std::filesystem::path& cache_path) {
+  std::vector<uint32_t> addresses;
+  if (!persistent_cache_enabled_) {
+    return addresses;
+  }
+  std::lock_guard<std::mutex> lock(persistent_cache_mutex_);
+  if (persistent_module_caches_.count(module)) {
+    return addresses;
+  }
+
+  FILE* file = xe::filesystem::OpenFile(cache_path, "a+b");
+  if (!file) {
+    XELOGE("Failed to open the persistent code cache file {}",
+           xe::path_to_utf8(cache_path));
+    return addresses;
+  }
+  PersistentModuleCache& module_cache = persistent_module_caches_[module];
+  module_cache.file = file;
+
+  // Read the whole file, validating the header and each record, and discard
+  // everything starting from the first corrupted or incomplete record.
+  xe::filesystem::Seek(file, 0, SEEK_END);
+  int64_t file_size = xe::filesystem::Tell(file);
+  uint64_t valid_size = 0;
+  PersistentCacheFileHeader header;
+  if (file_size >= int64_t(sizeof(header)) &&
+      xe::filesystem::Seek(file, 0, SEEK_SET)) {
+    module_cache.contents.resize(size_t(file_size));
+    module_cache.contents.resize(
+        fread(module_cache.contents.data(), 1, size_t(file_size), file));
+    std::memcpy(&header, module_cache.contents.data(), sizeof(header));
+    if (module_cache.contents.size() >= sizeof(header) &&
+        header.magic == kPersistentCacheMagic &&
+        header.version == kPersistentCacheVersion &&
+        header.identity_key == persistent_cache_identity_key_) {
+      valid_size = sizeof(header);
+    }
+  }
+  if (valid_size && header.image_anchor != persistent_cache_image_anchor_) {
+    // The host executable has been rebased since the records were written.
+    // Rebase the image relocations of all valid records and rewrite the file
+    // so new records are consistent with the anchor in the header.
+    uint64_t image_delta =
+        persistent_cache_image_anchor_ - header.image_anchor;
+    size_t offset = sizeof(header);
+    while (offset + sizeof(PersistentFunctionRecord) <=
+           module_cache.contents.size()) {
+      auto record = reinterpret_cast<PersistentFunctionRecord*>(
+          module_cache.contents.data() + offset);
+      size_t payload_size = GetPersistentPayloadSize(*record);
+      size_t record_end = offset + sizeof(*record) + payload_size;
+      if (record_end > module_cache.contents.size() ||
+          uint32_t(XXH3_64bits(record + 1, payload_size)) !=
+              record->payload_hash) {
+        break;
+      }
+      auto relocations = reinterpret_cast<X64CodeRelocation*>(
+          reinterpret_cast<uint8_t*>(record + 1) +
+          xe::round_up(size_t(record->code_size), size_t(8)));
+      for (uint32_t i = 0; i < record->relocation_count; ++i) {
+        if (relocations[i].type == X64CodeRelocationType::kImageAbsolute64) {
+          relocations[i].target += image_delta;
+        }
+      }
+      record->payload_hash = uint32_t(XXH3_64bits(record + 1, payload_size));
+      offset = record_end;
+    }
+    module_cache.contents.resize(offset);
+    header.image_anchor = persistent_cache_image_anchor_;
+    std::memcpy(module_cache.contents.data(), &header, sizeof(header));
+    if (xe::filesystem::TruncateStdioFile(file, 0)) {
+      fwrite(module_cache.contents.data(), 1, module_cache.contents.size(),
+             file);
+      fflush(file);
+      valid_size = module_cache.contents.size();
+    } else {
+      valid_size = 0;
+    }
+  }
+
+  if (!valid_size) {
+    module_cache.contents.clear();
+    if (!xe::filesystem::TruncateStdioFile(file, 0)) {
+      XELOGE("Failed to reset the persistent code cache file {}",
+             xe::path_to_utf8(cache_path));
+      fclose(file);
+      persistent_module_caches_.erase(module);
+      return addresses;
+    }
+    header.magic = kPersistentCacheMagic;
+    header.version = kPersistentCacheVersion;
+    header.identity_key = persistent_cache_identity_key_;
+    header.image_anchor = persistent_cache_image_anchor_;
+    fwrite(&header, sizeof(header), 1, file);
+    fflush(file);
+    return addresses;
+  }
+
+  size_t offset = sizeof(PersistentCacheFileHeader);
+  while (offset + sizeof(PersistentFunctionRecord) <=
+         module_cache.contents.size()) {
+    auto record = reinterpret_cast<const PersistentFunctionRecord*>(
+        module_cache.contents.data() + offset);
+    size_t payload_size = GetPersistentPayloadSize(*record);
+    size_t record_end = offset + sizeof(*record) + payload_size;
+    if (record_end > module_cache.contents.size() ||
+        uint32_t(XXH3_64bits(record + 1, payload_size)) !=
+            record->payload_hash) {
+      break;
+    }
+    // Later records of the same function supersede the earlier ones.
+    if (module_cache.function_records.emplace(record->guest_address, offset)
+            .second) {
+      addresses.push_back(record->guest_address);
+    } else {
+      module_cache.function_records[record->guest_address] = offset;
+    }
+    offset = record_end;
+  }
+  if (offset != module_cache.contents.size()) {
+    XELOGW(
+        "Persistent code cache file {} is corrupted, truncating it to {} "
+        "bytes",
+        xe::path_to_utf8(cache_path), offset);
+    module_cache.contents.resize(offset);
+    xe::filesystem::TruncateStdioFile(file, offset);
+  }
+  xe::filesystem::Seek(file, 0, SEEK_END);
+  XELOGI("Loaded {} functions from the persistent code cache for {}",
+         module_cache.function_records.size(), module->name());
+  return addresses;
+}
+
+void X64CodeCache::ClosePersistentModuleCache(Module* module) {
+  std::lock_guard<std::mutex> lock(persistent_cache_mutex_);
+  auto it = persistent_module_caches_.find(module);
+  if (it == persistent_module_caches_.end()) {
+    return;
+  }
+  if (it->second.file) {
+    fclose(it->second.file);
+  }
+  persistent_module_caches_.erase(it);
+}
+
+void X64CodeCache::ApplyPersistentRelocations(
+    uint8_t* code_write_address, const uint8_t* code_execute_address,
+    const X64CodeRelocation* relocations, uint32_t relocation_count) const {
+  for (uint32_t i = 0; i < relocation_count; ++i) {
+    const X64CodeRelocation& relocation = relocations[i];
+    uint8_t* field = code_write_address + relocation.offset;
+    switch (relocation.type) {
+      case X64CodeRelocationType::kImageAbsolute64: {
+        uint64_t value = relocation.target;
+        std::memcpy(field, &value, sizeof(value));
+      } break;
+      case X64CodeRelocationType::kCodeCacheRelative32: {
+        int32_t displacement = int32_t(
+            int64_t(relocation.target) -
+            int64_t(uintptr_t(code_execute_address + relocation.offset + 4)));
+        std::memcpy(field, &displacement, sizeof(displacement));
+      } break;
+      default:
+        assert_unhandled_case(relocation.type);
+        break;
+    }
+  }
+}
+
+bool X64CodeCache::RestorePersistentFunction(GuestFunction* function,
+                                             void*& code_execute_address_out,
+                                             size_t& code_size_out) {
+  std::vector<uint8_t> code;
+  std::vector<X64CodeRelocation> relocations;
+  EmitFunctionInfo func_info = {};
+  uint32_t end_address;
+  {
+    std::lock_guard<std::mutex> lock(persistent_cache_mutex_);
+    auto module_it = persistent_module_caches_.find(function->module());
+    if (module_it == persistent_module_caches_.end()) {
+      return false;
+    }
+    PersistentModuleCache& module_cache = module_it->second;
+    auto record_it = module_cache.function_records.find(function->address());
+    if (record_it == module_cache.function_records.end()) {
+      return false;
+    }
+    auto record = reinterpret_cast<const PersistentFunctionRecord*>(
+        module_cache.contents.data() + record_it->second);
+    // Only one restore attempt per run - if it fails, the function will be
+    // translated and stored again.
+    module_cache.function_records.erase(record_it);
+    if (HashGuestCode(function->module(), record->guest_address,
+                      record->guest_end_address) != record->guest_code_hash) {
+      return false;
+    }
+    auto payload = reinterpret_cast<const uint8_t*>(record + 1);
+    code.assign(payload, payload + record->code_size);
+    payload += xe::round_up(size_t(record->code_size), size_t(8));
+    auto record_relocations =
+        reinterpret_cast<const X64CodeRelocation*>(payload);
+    relocations.assign(record_relocations,
+                       record_relocations + record->relocation_count);
+    payload += sizeof(X64CodeRelocation) * record->relocation_count;
+    auto record_source_map = reinterpret_cast<const SourceMapEntry*>(payload);
+    function->source_map().assign(
+        record_source_map, record_source_map + record->source_map_count);
+    end_address = record->guest_end_address;
+    func_info.code_size.prolog = record->prolog_size;
+    func_info.code_size.body = record->body_size;
+    func_info.code_size.epilog = record->epilog_size;
+    func_info.code_size.tail = record->tail_size;
+    func_info.code_size.total = record->code_size;
+    func_info.prolog_stack_alloc_offset = record->prolog_stack_alloc_offset;
+    func_info.stack_size = record->stack_size;
+  }
+
+  function->set_end_address(end_address);
+
+  // Place without touching the indirection table, it must only point to the
+  // code once relocations have been applied.
+  void* code_execute_address;
+  void* code_write_address;
+  PlaceGuestCode(0, code.data(), func_info, function, code_execute_address,
+                 code_write_address);
+  ApplyPersistentRelocations(
+      reinterpret_cast<uint8_t*>(code_write_address),
+      reinterpret_cast<const uint8_t*>(code_execute_address),
+      relocations.data(), uint32_t(relocations.size()));
+  RegisterCodeSymbol(function->address(), function, code_execute_address,
+                     func_info.code_size.total);
+
+  code_execute_address_out = code_execute_address;
+  code_size_out = func_info.code_size.total;
+  return true;
+}
+
+void X64CodeCache::StorePersistentFunction(
+    GuestFunction* function, const void* code_execute_address,
+    const EmitFunctionInfo& func_info,
+    const std::vector<X64CodeRelocation>& relocations,
+    const std::vector<SourceMapEntry>& source_map) {
+  if (!persistent_cache_enabled_ || !function->has_end_address()) {
+    return;
+  }
+
+  PersistentFunctionRecord record;
+  record.guest_address = function->address();
+  record.guest_end_address = function->end_address();
+  record.guest_code_hash = HashGuestCode(
+      function->module(), function->address(), function->end_address());
+  record.code_size = uint32_t(func_info.code_size.total);
+  record.relocation_count = uint32_t(relocations.size());
+  record.source_map_count = uint32_t(source_map.size());
+  record.prolog_size = uint32_t(func_info.code_size.prolog);
+  record.body_size = uint32_t(func_info.code_size.body);
+  record.epilog_size = uint32_t(func_info.code_size.epilog);
+  record.tail_size = uint32_t(func_info.code_size.tail);
+  record.prolog_stack_alloc_offset =
+      uint32_t(func_info.prolog_stack_alloc_offset);
+  record.stack_size = uint32_t(func_info.stack_size);
+
+  // Code is stored as placed, relocated fields are rewritten on restore.
+  std::vector<uint8_t> payload(GetPersistentPayloadSize(record), 0);
+  uint8_t* payload_ptr = payload.data();
+  std::memcpy(payload_ptr, code_execute_address, record.code_size);
+  payload_ptr += xe::round_up(size_t(record.code_size), size_t(8));
+  if (!relocations.empty()) {
+    std::memcpy(payload_ptr, relocations.data(),
+                sizeof(X64CodeRelocation) * relocations.size());
+  }
+  payload_ptr += sizeof(X64CodeRelocation) * relocations.size();
+  if (!source_map.empty()) {
+    std::memcpy(payload_ptr, source_map.data(),
+                sizeof(SourceMapEntry) * source_map.size());
+  }
+  record.payload_hash = uint32_t(XXH3_64bits(payload.data(), payload.size()));
+
+  std::lock_guard<std::mutex> lock(persistent_cache_mutex_);
+  auto module_it = persistent_module_caches_.find(function->module());
+  if (module_it == persistent_module_caches_.end() ||
+      !module_it->second.file) {
+    return;
+  }
+  FILE* file = module_it->second.file;
+  fwrite(&record, sizeof(record), 1, file);
+  fwrite(payload.data(), 1, payload.size(), file);
+  fflush(file);
+}
+
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
@@ -13,8 +13,12 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <filesystem>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -39,6 +43,24 @@ struct EmitFunctionInfo {
   size_t stack_size;
 };
 
+// Host addresses embedded in generated code that must be fixed up when the code
+// is restored from the persistent code cache into another process.
+enum class X64CodeRelocationType : uint32_t {
+  // 64-bit absolute address inside the host executable image, rebased by the
+  // difference between the image bases of the writing and the reading process.
+  kImageAbsolute64,
+  // 32-bit displacement of a call/jmp to a fixed address in the code cache
+  // (thunks and helpers emitted at backend initialization).
+  kCodeCacheRelative32,
+};
+
+struct X64CodeRelocation {
+  X64CodeRelocationType type;
+  // Offset of the relocated field from the start of the function.
+  uint32_t offset;
+  uint64_t target;
+};
+
 class X64CodeCache : public CodeCache {
  public:
   ~X64CodeCache() override;
@@ -60,6 +82,10 @@ class X64CodeCache : public CodeCache {
   bool has_indirection_table() { return indirection_table_base_ != nullptr; }
   void set_indirection_default(uint32_t default_value);
   void AddIndirection(uint32_t guest_address, uint32_t host_address);
+  // Makes the previous code of a retranslated function jump to the new code,
+  // for the direct calls emitted to the previous code.
+  void RedirectCode(const void* old_code_execute_address,
+                    const void* new_code_execute_address);
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high);
 
@@ -73,9 +99,35 @@ class X64CodeCache : public CodeCache {
                       void*& code_execute_address_out,
                       void*& code_write_address_out);
   uint32_t PlaceData(const void* data, size_t length);
+  // Announces code that has been placed and relocated to the external
+  // profilers that were enabled (VTune, the perf map and jitdump on Linux).
+  void RegisterCodeSymbol(uint32_t guest_address, GuestFunction* function_info,
+                          const void* code_execute_address, size_t code_size);
 
   GuestFunction* LookupFunction(uint64_t host_pc) override;
 
+  // Persistent code cache. The identity key must cover everything that affects
+  // code generation or the fixed addresses referenced by generated code, and
+  // image_anchor must be the address of any symbol in the host executable.
+  void InitializePersistentCache(uint64_t identity_key, uint64_t image_anchor);
+  bool has_persistent_cache() const { return persistent_cache_enabled_; }
+  // Opens (creating if needed) the per-module cache file and returns the guest
+  // addresses of functions stored in it.
+  std::vector<uint32_t> OpenPersistentModuleCache(
+      Module* module, const std::filesystem::path& cache_path);
+  void ClosePersistentModuleCache(Module* module);
+  // Places previously persisted machine code of the function, if it's present
+  // and the guest code has not changed. The indirection table is not updated.
+  bool RestorePersistentFunction(GuestFunction* function,
+                                 void*& code_execute_address_out,
+                                 size_t& code_size_out);
+  // Appends the just placed function to the cache file of its module.
+  void StorePersistentFunction(GuestFunction* function,
+                               const void* code_execute_address,
+                               const EmitFunctionInfo& func_info,
+                               const std::vector<X64CodeRelocation>& relocations,
+                               const std::vector<SourceMapEntry>& source_map);
+
  protected:
   // All executable code falls within 0x80000000 to 0x9FFFFFFF, so we can
   // only map enough for lookups within that range.
@@ -142,6 +194,46 @@ class X64CodeCache : public CodeCache {
   // This can be used to bsearch on host PC to find the guest function.
   // The key is [start address | end address].
   std::vector<std::pair<uint64_t, GuestFunction*>> generated_code_map_;
+  // Code of the retranslated functions. It's not reused, as direct calls from
+  // other functions are redirected through it, and threads may still be
+  // executing it or return into it.
+  size_t superseded_code_size_ = 0;
+  // Warnings about the space running out that have been logged.
+  uint32_t code_cache_occupancy_level_ = 0;
+  // With the global critical region held, after reserving up to high_mark.
+  // Aborts if the code cache is exhausted rather than writing past it.
+  void CheckCodeCacheCapacity(size_t high_mark);
+
+  struct PersistentModuleCache {
+    FILE* file = nullptr;
+    // Raw contents of the file as of opening and the offsets of the records of
+    // the functions within it.
+    std::vector<uint8_t> contents;
+    std::unordered_map<uint32_t, size_t> function_records;
+  };
+  static uint64_t HashGuestCode(Module* module, uint32_t address,
+                                uint32_t end_address);
+  void ApplyPersistentRelocations(uint8_t* code_write_address,
+                                  const uint8_t* code_execute_address,
+                                  const X64CodeRelocation* relocations,
+                                  uint32_t relocation_count) const;
+
+  bool persistent_cache_enabled_ = false;
+  uint64_t persistent_cache_identity_key_ = 0;
+  uint64_t persistent_cache_image_anchor_ = 0;
+  std::mutex persistent_cache_mutex_;
+  std::unordered_map<Module*, PersistentModuleCache> persistent_module_caches_;
+
+  // External profiler symbol output.
+  void InitializeCodeSymbolOutput();
+  void ShutdownCodeSymbolOutput();
+  std::mutex code_symbol_mutex_;
+  FILE* perf_map_file_ = nullptr;
+  FILE* jitdump_file_ = nullptr;
+  // perf finds the jitdump file through an executable mapping of it.
+  void* jitdump_marker_ = nullptr;
+  size_t jitdump_marker_size_ = 0;
+  uint64_t jitdump_code_index_ = 0;
 };
 
 }  // namespace x64
@@ -11,6 +11,7 @@
 
 #include <stddef.h>
 
+#include <atomic>
 #include <climits>
 #include <cstring>
 
@@ -30,6 +31,7 @@
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_debug_info.h"
 #include "xenia/cpu/hir/instr.h"
@@ -58,6 +60,37 @@ DEFINE_uint32(align_all_basic_blocks, 0,
               "power of 2, 16 is the recommended value. Results in larger "
               "icache usage, but potentially faster loops",
               "x64");
+DEFINE_bool(profile_guided_block_layout, false,
+            "Moves blocks that are cold according to the execution profile in "
+            "the info cache (gathered with trace_function_coverage), as well "
+            "as blocks that trap, to the end of the function body, so the hot "
+            "path is contiguous.",
+            "x64");
+DEFINE_uint32(align_hot_loop_headers, 16,
+              "With profile_guided_block_layout, aligns the headers of loops "
+              "that are hot according to the execution profile to N bytes. 0 to "
+              "disable.",
+              "x64");
+DEFINE_bool(enable_persistent_code_cache, false,
+            "Stores generated machine code on disk per module and restores it "
+            "on later runs instead of translating the functions again. Guest "
+            "calls always go through the indirection table while enabled.",
+            "x64");
+DEFINE_int32(indirect_call_inline_cache_entries, 2,
+             "Number of recent targets (1, 2 or 4) cached at each indirect "
+             "call site, letting the call skip the indirection table and "
+             "giving each target its own branch. 0 to disable. Not used with "
+             "the persistent code cache.",
+             "x64");
+DEFINE_bool(track_mxcsr_mode_across_blocks, true,
+            "Carries the known MXCSR mode (fpu or vmx) into blocks whose "
+            "predecessors all leave it in the same mode, instead of checking "
+            "it again at the start of every block.",
+            "x64");
+DEFINE_bool(indirect_call_inline_cache_statistics, false,
+            "Counts hits and misses of the indirect call inline caches and "
+            "logs the sites with the most misses on shutdown.",
+            "x64");
 #if XE_X64_PROFILER_AVAILABLE == 1
 DEFINE_bool(instrument_call_times, false,
             "Compute time taken for functions, for profiling guest code",
@@ -119,7 +152,14 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   debug_info_ = debug_info;
   debug_info_flags_ = debug_info_flags;
   trace_data_ = &function->trace_data();
+  tier_up_function_ =
+      function->tier() == GuestFunction::Tier::kBaseline ? function : nullptr;
   source_map_arena_.Reset();
+  code_relocations_.clear();
+  // Trace data is allocated per run and referenced by absolute addresses.
+  code_relocatable_ =
+      !(debug_info_flags & (DebugInfoFlags::kDebugInfoTraceFunctions |
+                            DebugInfoFlags::kDebugInfoTraceFunctionCoverage));
 
   // Fill the generator with code.
   EmitFunctionInfo func_info = {};
@@ -134,6 +174,12 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
 
+  if (code_relocatable_ && code_cache_->has_persistent_cache()) {
+    code_cache_->StorePersistentFunction(function, *out_code_address,
+                                         func_info, code_relocations_,
+                                         *out_source_map);
+  }
+
   return true;
 }
 void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
@@ -160,8 +206,13 @@ void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
   top_ = reinterpret_cast<uint8_t*>(new_write_address);
   ready();
   top_ = old_address;
+  // Only announced now as the relocations are applied by ready().
+  code_cache_->RegisterCodeSymbol(function ? function->address() : 0, function,
+                                  new_execute_address,
+                                  func_info.code_size.total);
   reset();
   tail_code_.clear();
+  pooled_consts_.clear();
   for (auto&& cached_label : label_cache_) {
     delete cached_label;
   }
@@ -228,6 +279,19 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
 
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], rax);  // 0
 
+  if (cvars::enable_host_guest_stack_synchronization &&
+      cvars::lazy_host_guest_stack_synchronization) {
+    // Everything X64Backend::WalkGuestFrames needs, in place of a stackpoint.
+    mov(r8d, dword[GetContextReg() + offsetof(ppc::PPCContext, r[1])]);
+    mov(dword[rsp + StackLayout::GUEST_FRAME_GUEST_STACK], r8d);
+    mov(dword[rsp + StackLayout::GUEST_FRAME_HOST_STACK_SIZE],
+        static_cast<uint32_t>(stack_size));
+  }
+
+  if (tier_up_function_) {
+    EmitTierUpCheck();
+  }
+
 #if XE_X64_PROFILER_AVAILABLE == 1
   if (cvars::instrument_call_times) {
     mov(rdx, 0x7ffe0014);  // load pointer to kusershared systemtime
@@ -271,21 +335,33 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
       qword[GetContextReg() + offsetof(ppc::PPCContext, virtual_membase)]);
   */
   // Body.
-  auto block = builder->first_block();
+  bool reordered = ComputeBlockLayout(builder);
+  const std::vector<hir::Block*>& block_order = block_order_;
+  const std::vector<uint8_t>& block_alignments = block_alignments_;
+  PrepareMxcsrModeTracking();
   synchronize_stack_on_next_instruction_ = false;
-  while (block) {
-    ForgetMxcsrMode();  // at start of block, mxcsr mode is undefined
+  for (size_t block_index = 0; block_index < block_order.size();
+       ++block_index) {
+    hir::Block* block = block_order[block_index];
+    // Undefined unless all the ways into the block agree.
+    mxcsr_mode_ = GetBlockEntryMxcsrMode(block);
+
+    if (cvars::align_all_basic_blocks) {
+      align(cvars::align_all_basic_blocks, true);
+    } else if (block_alignments[block->ordinal]) {
+      align(block_alignments[block->ordinal], true);
+    }
 
     // Mark block labels.
+    if (reordered) {
+      L(GetBlockLayoutLabel(block));
+    }
     auto label = block->label_head;
     while (label) {
       L(std::to_string(label->id));
       label = label->next;
     }
 
-    if (cvars::align_all_basic_blocks) {
-      align(cvars::align_all_basic_blocks, true);
-    }
     // Process instructions.
     const Instr* instr = block->instr_head;
     while (instr) {
@@ -304,10 +380,32 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
         XELOGE("Unable to process HIR opcode {}", GetOpcodeName(instr->opcode));
         break;
       }
+      // The branch sequences merge the MXCSR mode into their targets as they
+      // emit the jumps.
       instr = new_tail;
     }
+    if (block->next && BlockMayFallThrough(block)) {
+      MergeMxcsrModeInto(block->next);
+    }
 
-    block = block->next;
+    // Fall through explicitly if the next block in the original order has
+    // been moved somewhere else. The last block falls through to the epilog.
+    if (reordered && BlockMayFallThrough(block)) {
+      hir::Block* next_emitted = block_index + 1 < block_order.size()
+                                     ? block_order[block_index + 1]
+                                     : nullptr;
+      if (block->next != next_emitted) {
+        if (synchronize_stack_on_next_instruction_) {
+          synchronize_stack_on_next_instruction_ = false;
+          EnsureSynchronizedGuestAndHostStack();
+        }
+        if (block->next) {
+          jmp(GetBlockLayoutLabel(block->next), T_NEAR);
+        } else {
+          jmp(epilog_label, T_NEAR);
+        }
+      }
+    }
   }
 
   // Function epilog.
@@ -331,6 +429,15 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
     }
     tail_item.func(*this, tail_item.label);
   }
+  // Referenced relative to the code, so the function stays relocatable.
+  if (!pooled_consts_.empty()) {
+    align(16);
+    for (const auto& pooled_const : pooled_consts_) {
+      L(*pooled_const.second);
+      dq(pooled_const.first.low);
+      dq(pooled_const.first.high);
+    }
+  }
 
   code_offsets.tail = getSize();
 
@@ -349,10 +456,196 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
 
   return true;
 }
+std::string X64Emitter::GetBlockLayoutLabel(const hir::Block* block) {
+  return fmt::format("__block_layout_{}", block->ordinal);
+}
+
+bool X64Emitter::BlockMayFallThrough(const hir::Block* block) {
+  const Instr* tail = block->instr_tail;
+  if (!tail) {
+    return true;
+  }
+  switch (tail->GetOpcodeNum()) {
+    case hir::OPCODE_BRANCH:
+    case hir::OPCODE_RETURN:
+      return false;
+    default:
+      return true;
+  }
+}
+
+void X64Emitter::PrepareMxcsrModeTracking() {
+  block_mxcsr_states_.resize(block_order_.size());
+  for (size_t i = 0; i < block_order_.size(); ++i) {
+    BlockMxcsrState& state = block_mxcsr_states_[block_order_[i]->ordinal];
+    state.position = uint32_t(i);
+    state.entry_mode = MXCSRMode::Unknown;
+    state.reached = false;
+    state.late_predecessor = false;
+  }
+  if (!cvars::track_mxcsr_mode_across_blocks) {
+    return;
+  }
+  auto mark_edge = [this](const hir::Block* from, const hir::Block* to) {
+    BlockMxcsrState& to_state = block_mxcsr_states_[to->ordinal];
+    if (block_mxcsr_states_[from->ordinal].position >= to_state.position) {
+      to_state.late_predecessor = true;
+    }
+  };
+  for (const hir::Block* block : block_order_) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      switch (instr->GetOpcodeNum()) {
+        case hir::OPCODE_BRANCH:
+          mark_edge(block, instr->src1.label->block);
+          break;
+        case hir::OPCODE_BRANCH_TRUE:
+        case hir::OPCODE_BRANCH_FALSE:
+          mark_edge(block, instr->src2.label->block);
+          break;
+        default:
+          break;
+      }
+    }
+    if (block->next && BlockMayFallThrough(block)) {
+      mark_edge(block, block->next);
+    }
+  }
+}
+
+void X64Emitter::MergeMxcsrModeInto(const hir::Block* block) {
+  BlockMxcsrState& state = block_mxcsr_states_[block->ordinal];
+  if (!state.reached) {
+    state.reached = true;
+    state.entry_mode = mxcsr_mode_;
+  } else if (state.entry_mode != mxcsr_mode_) {
+    state.entry_mode = MXCSRMode::Unknown;
+  }
+}
+
+MXCSRMode X64Emitter::GetBlockEntryMxcsrMode(const hir::Block* block) const {
+  if (!cvars::track_mxcsr_mode_across_blocks) {
+    return MXCSRMode::Unknown;
+  }
+  const BlockMxcsrState& state = block_mxcsr_states_[block->ordinal];
+  // The entry block is also entered from the prolog, in whatever mode the
+  // caller left.
+  if (!state.reached || state.late_predecessor || !state.position) {
+    return MXCSRMode::Unknown;
+  }
+  return state.entry_mode;
+}
+
+bool X64Emitter::ComputeBlockLayout(HIRBuilder* builder) {
+  std::vector<hir::Block*>& block_order = block_order_;
+  std::vector<uint8_t>& block_alignments = block_alignments_;
+  std::vector<hir::Block*>& hot_blocks = hot_blocks_;
+  std::vector<hir::Block*>& cold_blocks = cold_blocks_;
+  block_order.clear();
+  hot_blocks.clear();
+  cold_blocks.clear();
+  for (auto block = builder->first_block(); block; block = block->next) {
+    block_order.push_back(block);
+  }
+  block_alignments.assign(block_order.size(), 0);
+  if (!cvars::profile_guided_block_layout || block_order.size() < 2) {
+    return false;
+  }
+
+  // Without profile data for the function itself, only static hints are used.
+  InfoCacheFlags* entry_flags =
+      guest_module_ ? guest_module_->GetInstructionAddressFlags(
+                          current_guest_function_)
+                    : nullptr;
+  bool profiled = entry_flags && entry_flags->was_executed;
+
+  hot_blocks.reserve(block_order.size());
+  for (hir::Block* block : block_order) {
+    const InfoCacheFlags* block_flags = nullptr;
+    bool traps = false;
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      uint32_t opcode = instr->GetOpcodeNum();
+      if (opcode == hir::OPCODE_SOURCE_OFFSET && !block_flags && profiled) {
+        block_flags = guest_module_->GetInstructionAddressFlags(
+            static_cast<uint32_t>(instr->src1.offset));
+      } else if (opcode == hir::OPCODE_TRAP) {
+        traps = true;
+      } else if (profiled && cvars::align_hot_loop_headers &&
+                 (opcode == hir::OPCODE_BRANCH ||
+                  opcode == hir::OPCODE_BRANCH_TRUE ||
+                  opcode == hir::OPCODE_BRANCH_FALSE)) {
+        // Backward branches mark loop headers, align the hot ones.
+        hir::Label* target = opcode == hir::OPCODE_BRANCH ? instr->src1.label
+                                                          : instr->src2.label;
+        hir::Block* header = target ? target->block : nullptr;
+        if (header && header->ordinal <= block->ordinal &&
+            header->ordinal < block_alignments.size()) {
+          const InfoCacheFlags* header_flags = nullptr;
+          for (auto header_instr = header->instr_head; header_instr;
+               header_instr = header_instr->next) {
+            if (header_instr->GetOpcodeNum() == hir::OPCODE_SOURCE_OFFSET) {
+              header_flags = guest_module_->GetInstructionAddressFlags(
+                  static_cast<uint32_t>(header_instr->src1.offset));
+              break;
+            }
+          }
+          if (header_flags && header_flags->is_hot) {
+            block_alignments[header->ordinal] =
+                uint8_t(std::min(cvars::align_hot_loop_headers, 64u));
+          }
+        }
+      }
+    }
+    // The entry block stays first, the prolog falls through to it.
+    bool cold = block != block_order.front() &&
+                (traps || (block_flags && !block_flags->was_executed));
+    (cold ? cold_blocks : hot_blocks).push_back(block);
+  }
+  if (cold_blocks.empty()) {
+    return false;
+  }
+  // Cold blocks are never aligned, they're not worth the padding.
+  for (hir::Block* block : cold_blocks) {
+    block_alignments[block->ordinal] = 0;
+  }
+  block_order.swap(hot_blocks);
+  block_order.insert(block_order.end(), cold_blocks.cbegin(),
+                     cold_blocks.cend());
+  return true;
+}
+
+void X64Emitter::EmitTierUpCheck() {
+  // The counter lives in the function object.
+  MarkNotRelocatable();
+  GuestFunction* function = tier_up_function_;
+  mov(rdx, reinterpret_cast<uint64_t>(function->tier_up_countdown()));
+  // Not atomic, but an occasional lost decrement doesn't matter, and the
+  // counter going below zero keeps requesting the tier-up until it's handled.
+  sub(dword[rdx], 1);
+  Xbyak::Label& tier_up_resume = NewCachedLabel();
+  Xbyak::Label& tier_up = AddToTail(
+      [function, &tier_up_resume](X64Emitter& e, Xbyak::Label& our_tail_label) {
+        e.L(our_tail_label);
+        e.mov(e.GetNativeParam(0), reinterpret_cast<uint64_t>(function));
+        e.CallNativeSafe(reinterpret_cast<void*>(X64Emitter::HandleTierUp));
+        e.jmp(tier_up_resume, T_NEAR);
+      });
+  jle(tier_up, T_NEAR);
+  L(tier_up_resume);
+}
+
+void X64Emitter::HandleTierUp(ppc::PPCContext* context,
+                              GuestFunction* function) {
+  if (!context->processor->OptimizeFunction(function)) {
+    // Already being handled or can't be done, stop asking.
+    *function->tier_up_countdown() = INT32_MAX;
+  }
+}
+
 // dont use rax, we do this in tail call handling
 void X64Emitter::EmitProfilerEpilogue() {
 #if XE_X64_PROFILER_AVAILABLE == 1
   if (cvars::instrument_call_times) {
+    MarkNotRelocatable();
     uint64_t* profiler_entry =
         backend()->GetProfilerRecordForFunction(current_guest_function_);
 
@@ -375,6 +668,7 @@ void X64Emitter::EmitProfilerEpilogue() {
 void X64Emitter::MarkSourceOffset(const Instr* i) {
   auto entry = source_map_arena_.Alloc<SourceMapEntry>();
   entry->guest_address = static_cast<uint32_t>(i->src1.offset);
+  current_guest_address_ = entry->guest_address;
   entry->hir_offset = uint32_t(i->block->ordinal << 16) | i->ordinal;
   entry->code_offset = static_cast<uint32_t>(getSize());
 
@@ -408,6 +702,8 @@ void X64Emitter::DebugBreak() {
 uint64_t TrapDebugPrint(void* raw_context, uint64_t address) {
   auto thread_state =
       reinterpret_cast<ppc::PPCContext_s*>(raw_context)->thread_state;
+  static_cast<X64Backend*>(thread_state->processor()->backend())
+      ->RecordGuestTrap();
   uint32_t str_ptr = uint32_t(thread_state->context()->r[3]);
   // uint16_t str_len = uint16_t(thread_state->context()->r[4]);
   auto str = thread_state->memory()->TranslateVirtual<const char*>(str_ptr);
@@ -424,14 +720,73 @@ uint64_t TrapDebugPrint(void* raw_context, uint64_t address) {
 uint64_t TrapDebugBreak(void* raw_context, uint64_t address) {
   auto thread_state =
       reinterpret_cast<ppc::PPCContext_s*>(raw_context)->thread_state;
-  XELOGE("tw/td forced trap hit! This should be a crash!");
+  uint64_t count =
+      static_cast<X64Backend*>(thread_state->processor()->backend())
+          ->RecordGuestTrap();
+  // Some titles keep hitting non-fatal traps, only logging on powers of two
+  // hits so the log doesn't become the bottleneck.
+  if (!(count & (count - 1))) {
+    XELOGE("tw/td forced trap hit {} times! This should be a crash!", count);
+  }
+  if (cvars::break_on_debugbreak) {
+    xe::debugging::Break();
+  }
+  return 0;
+}
+
+// Hit counts of the frontend traps, for not logging on every hit of the ones
+// hit very often.
+std::atomic<uint64_t> break_on_instruction_hit_count{0};
+std::atomic<uint64_t> break_on_memory_write_hit_count{0};
+
+uint64_t TrapBreakOnInstruction(void* raw_context, uint64_t guest_address) {
+  uint64_t count =
+      break_on_instruction_hit_count.fetch_add(1, std::memory_order_relaxed) +
+      1;
+  if (!(count & (count - 1))) {
+    XELOGI("Conditional breakpoint at {:08X} hit {} times",
+           uint32_t(guest_address), count);
+  }
+  if (xe::debugging::IsDebuggerAttached()) {
+    xe::debugging::Break();
+  }
+  return 0;
+}
+
+uint64_t TrapBreakOnMemoryWrite(void* raw_context, uint64_t guest_address) {
+  uint64_t count =
+      break_on_memory_write_hit_count.fetch_add(1, std::memory_order_relaxed) +
+      1;
+  if (!(count & (count - 1))) {
+    XELOGI(
+        "Watchpoint at {:08X} (length {}) written by the instruction at "
+        "{:08X}, hit {} times",
+        cvars::break_on_memory_write, cvars::break_on_memory_write_length,
+        uint32_t(guest_address), count);
+  }
+  if (xe::debugging::IsDebuggerAttached()) {
+    xe::debugging::Break();
+  }
+  return 0;
+}
+
+uint64_t TrapUnknown(void* raw_context, uint64_t trap_type) {
+  auto thread_state =
+      reinterpret_cast<ppc::PPCContext_s*>(raw_context)->thread_state;
+  uint64_t count =
+      static_cast<X64Backend*>(thread_state->processor()->backend())
+          ->RecordGuestTrap();
+  if (!(count & (count - 1))) {
+    XELOGW("Unknown trap type {} hit, {} guest traps total", trap_type,
+           count);
+  }
   if (cvars::break_on_debugbreak) {
     xe::debugging::Break();
   }
   return 0;
 }
 
-void X64Emitter::Trap(uint16_t trap_type) {
+void X64Emitter::Trap(uint16_t trap_type, uint32_t guest_address) {
   switch (trap_type) {
     case 20:
     case 26:
@@ -447,9 +802,17 @@ void X64Emitter::Trap(uint16_t trap_type) {
     case 25:
       // ?
       break;
+    case hir::TRAP_BREAK_ON_INSTRUCTION:
+      CallNative(TrapBreakOnInstruction, guest_address);
+      break;
+    case hir::TRAP_BREAK_ON_MEMORY_WRITE:
+      CallNative(TrapBreakOnMemoryWrite, guest_address);
+      break;
     default:
+      // Handled on the host instead of raising a breakpoint exception that
+      // would go through the exception handlers each time it's hit.
       XELOGW("Unknown trap type {}", trap_type);
-      db(0xCC);
+      CallNative(TrapUnknown, trap_type);
       break;
   }
 }
@@ -543,18 +906,25 @@ uint64_t ResolveFunction(void* raw_context, uint64_t target_address) {
                 X64BackendContext* backend_context =
                     backend->BackendContextForGuestContext(guest_context);
 
-                uint32_t current_stackpoint_index =
-                    backend_context->current_stackpoint_depth;
+                uint32_t current_guest_stackpointer =
+                    static_cast<uint32_t>(guest_context->r[1]);
+                uint32_t num_frames_bigger = 0;
 
-                --current_stackpoint_index;
+                if (cvars::lazy_host_guest_stack_synchronization) {
+                  // The same count, from the frames on the host stack.
+                  num_frames_bigger = backend->CountUnwoundGuestFrames(
+                      backend_context->resolve_return_slot,
+                      current_guest_stackpointer);
+                }
+
+                uint32_t current_stackpoint_index =
+                    cvars::lazy_host_guest_stack_synchronization
+                        ? 0xFFFFFFFF
+                        : backend_context->current_stackpoint_depth - 1;
 
                 X64BackendStackpoint* stackpoints =
                     backend_context->stackpoints;
 
-                uint32_t current_guest_stackpointer =
-                    static_cast<uint32_t>(guest_context->r[1]);
-                uint32_t num_frames_bigger = 0;
-
                 /*
                         if the current guest stack pointer is bigger than the
                    recorded pointer for this stack thats fine, plenty of
@@ -680,7 +1050,11 @@ void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   auto fn = static_cast<X64Function*>(function);
   // Resolve address to the function to call and store in rax.
 
-  if (fn->machine_code()) {
+  // Direct calls can't be relocated when restoring from the persistent code
+  // cache since the callee may be placed elsewhere on the next run. Baseline
+  // callees will be replaced, so they're called through the table too.
+  if (fn->machine_code() && !code_cache_->has_persistent_cache() &&
+      fn->tier() != GuestFunction::Tier::kBaseline) {
     if (!(instr->flags & hir::CALL_TAIL)) {
       mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
 
@@ -748,16 +1122,96 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
     if (reg.cvt32() != ebx) {
       mov(ebx, reg.cvt32());
     }
+    uint32_t cache_entries = GetIndirectCallInlineCacheEntries();
+    if (cache_entries) {
+      EmitIndirectCallInlineCache(instr, cache_entries);
+      return;
+    }
     mov(eax, dword[ebx]);
   } else {
     // Old-style resolve.
     // Not too important because indirection table is almost always available.
     mov(edx, reg.cvt32());
-    mov(rax, reinterpret_cast<uint64_t>(ResolveFunction));
+    MovImageAddress(rax, reinterpret_cast<const void*>(ResolveFunction));
     mov(rcx, GetContextReg());
     call(rax);
   }
 
+  EmitIndirectCallToRax(instr);
+}
+
+uint32_t X64Emitter::GetIndirectCallInlineCacheEntries() const {
+  // The cache is heap data, which the persistent code cache can't relocate.
+  if (code_cache_->has_persistent_cache() ||
+      !code_cache_->has_indirection_table()) {
+    return 0;
+  }
+  int32_t entries = cvars::indirect_call_inline_cache_entries;
+  if (entries >= 4) {
+    return 4;
+  }
+  if (entries >= 2) {
+    return 2;
+  }
+  return entries > 0 ? 1 : 0;
+}
+
+void X64Emitter::EmitIndirectCallInlineCache(const hir::Instr* instr,
+                                             uint32_t cache_entries) {
+  // ebx = guest target address.
+  static_assert(X64IndirectCallCache::kMaxEntries == 4,
+                "Entry count clamping depends on the maximum");
+  MarkNotRelocatable();
+  X64IndirectCallCache* cache =
+      backend()->AllocateIndirectCallCache(current_guest_address_);
+  bool statistics = cvars::indirect_call_inline_cache_statistics;
+  bool tail = (instr->flags & hir::CALL_TAIL) != 0;
+  Xbyak::Label done;
+  mov(rdx, reinterpret_cast<uint64_t>(cache));
+
+  // Hits call from their own instruction so each target is predicted
+  // separately.
+  for (uint32_t i = 0; i < cache_entries; ++i) {
+    Xbyak::Label next_entry;
+    mov(rax, qword[rdx + offsetof(X64IndirectCallCache, entries) + i * 8]);
+    cmp(eax, ebx);
+    jne(next_entry, T_NEAR);
+    shr(rax, 32);
+    if (statistics) {
+      inc(qword[rdx + offsetof(X64IndirectCallCache, hits)]);
+    }
+    EmitIndirectCallToRax(instr);
+    if (!tail) {
+      jmp(done, T_NEAR);
+    }
+    L(next_entry);
+  }
+
+  // Miss, take the target from the indirection table and replace the oldest
+  // entry with it. Functions that haven't been translated yet point to the
+  // resolver, which must not be cached.
+  Xbyak::Label miss_call;
+  mov(eax, dword[ebx]);
+  if (statistics) {
+    inc(qword[rdx + offsetof(X64IndirectCallCache, misses)]);
+  }
+  cmp(eax, static_cast<uint32_t>(
+               reinterpret_cast<uintptr_t>(backend()->resolve_function_thunk())));
+  je(miss_call, T_NEAR);
+  mov(ecx, dword[rdx + offsetof(X64IndirectCallCache, next_entry)]);
+  lea(r8d, ptr[rcx + 1]);
+  and_(r8d, cache_entries - 1);
+  mov(dword[rdx + offsetof(X64IndirectCallCache, next_entry)], r8d);
+  mov(r8, rax);
+  shl(r8, 32);
+  or_(r8, rbx);
+  mov(qword[rdx + rcx * 8 + offsetof(X64IndirectCallCache, entries)], r8);
+  L(miss_call);
+  EmitIndirectCallToRax(instr);
+  L(done);
+}
+
+void X64Emitter::EmitIndirectCallToRax(const hir::Instr* instr) {
   // Actually jump/call to rax.
   if (instr->flags & hir::CALL_TAIL) {
     // Since we skip the prolog we need to mark the return here.
@@ -796,14 +1250,18 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     auto builtin_function = static_cast<const BuiltinFunction*>(function);
     if (builtin_function->handler()) {
       undefined = false;
+      // The arguments are heap objects.
+      MarkNotRelocatable();
       // rcx = target function
       // rdx = arg0
       // r8  = arg1
       // r9  = arg2
-      mov(rcx, reinterpret_cast<uint64_t>(builtin_function->handler()));
+      MovImageAddress(
+          rcx, reinterpret_cast<const void*>(builtin_function->handler()));
       mov(rdx, reinterpret_cast<uint64_t>(builtin_function->arg0()));
       mov(r8, reinterpret_cast<uint64_t>(builtin_function->arg1()));
-      call(backend()->guest_to_host_thunk());
+      CallCodeCacheAddress(
+          reinterpret_cast<const void*>(backend()->guest_to_host_thunk()));
       // rax = host return
     }
   } else if (function->behavior() == Function::Behavior::kExtern) {
@@ -814,14 +1272,21 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // rdx = arg0
       // r8  = arg1
       // r9  = arg2
-      mov(rcx, reinterpret_cast<uint64_t>(extern_function->extern_handler()));
+      MovImageAddress(rcx, reinterpret_cast<const void*>(
+                               extern_function->extern_handler()));
       mov(rdx,
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
-      call(backend()->guest_to_host_thunk());
+      const Export* export_data = extern_function->export_data();
+      bool is_leaf =
+          export_data && (export_data->tags & ExportTag::kLeaf) != 0;
+      CallCodeCacheAddress(reinterpret_cast<const void*>(
+          is_leaf ? backend()->guest_to_host_leaf_thunk()
+                  : backend()->guest_to_host_thunk()));
       // rax = host return
     }
   }
   if (undefined) {
+    MarkNotRelocatable();
     CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(function));
   }
 }
@@ -847,11 +1312,32 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // rdx = arg0
   // r8  = arg1
   // r9  = arg2
-  mov(rcx, reinterpret_cast<uint64_t>(fn));
-  call(backend()->guest_to_host_thunk());
+  MovImageAddress(rcx, fn);
+  CallCodeCacheAddress(
+      reinterpret_cast<const void*>(backend()->guest_to_host_thunk()));
   // rax = host return
 }
 
+void X64Emitter::MovImageAddress(const Xbyak::Reg64& dest,
+                                 const void* address) {
+  // Always use the 10-byte mov r64, imm64 form (REX.W B8+r) so the immediate
+  // can be rebased in place regardless of the value.
+  db(0x48 | (dest.getIdx() >= 8 ? 0x01 : 0x00));
+  db(0xB8 | (dest.getIdx() & 7));
+  code_relocations_.push_back({X64CodeRelocationType::kImageAbsolute64,
+                               static_cast<uint32_t>(getSize()),
+                               reinterpret_cast<uint64_t>(address)});
+  dq(reinterpret_cast<uint64_t>(address));
+}
+
+void X64Emitter::CallCodeCacheAddress(const void* target) {
+  call(target);
+  // call rel32 - the displacement is the last 4 bytes of the instruction.
+  code_relocations_.push_back({X64CodeRelocationType::kCodeCacheRelative32,
+                               static_cast<uint32_t>(getSize() - 4),
+                               reinterpret_cast<uint64_t>(target)});
+}
+
 void X64Emitter::SetReturnAddress(uint64_t value) {
   mov(rax, value);
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], rax);
@@ -1240,7 +1726,18 @@ Xbyak::Address X64Emitter::GetXmmConstPtr(XmmConst id) {
   return ptr[reinterpret_cast<void*>(backend_->emitter_data() +
                                      sizeof(vec128_t) * id)];
 }
-// Implies possible StashXmm(0, ...)!
+
+Xbyak::Address X64Emitter::GetPooledConstPtr(const vec128_t& v) {
+  for (const auto& pooled_const : pooled_consts_) {
+    if (pooled_const.first == v) {
+      return ptr[rip + *pooled_const.second];
+    }
+  }
+  Xbyak::Label& label = NewCachedLabel();
+  pooled_consts_.emplace_back(v, &label);
+  return ptr[rip + label];
+}
+
 void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v) {
   // https://www.agner.org/optimize/optimizing_assembly.pdf
   // 13.4 Generating constants
@@ -1275,9 +1772,7 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v) {
           vpbroadcastb(dest, byte[bval]);
           return;
         }
-        // didnt find existing mem with the value
-        mov(byte[rsp + kStashOffset], firstbyte);
-        vpbroadcastb(dest, byte[rsp + kStashOffset]);
+        vmovdqu(dest, GetPooledConstPtr(v));
         return;
       }
 
@@ -1295,9 +1790,7 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v) {
           vpbroadcastw(dest, word[wval]);
           return;
         }
-        // didnt find existing mem with the value
-        mov(word[rsp + kStashOffset], firstword);
-        vpbroadcastw(dest, word[rsp + kStashOffset]);
+        vmovdqu(dest, GetPooledConstPtr(v));
         return;
       }
 
@@ -1315,8 +1808,7 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v) {
           vpbroadcastd(dest, dword[dwval]);
           return;
         }
-        mov(dword[rsp + kStashOffset], firstdword);
-        vpbroadcastd(dest, dword[rsp + kStashOffset]);
+        vmovdqu(dest, GetPooledConstPtr(v));
         return;
       }
 
@@ -1328,8 +1820,7 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v) {
           vpbroadcastq(dest, qword[qwval]);
           return;
         }
-        MovMem64(rsp + kStashOffset, v.low);
-        vpbroadcastq(dest, qword[rsp + kStashOffset]);
+        vmovdqu(dest, GetPooledConstPtr(v));
         return;
       }
     }
@@ -1348,22 +1839,8 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v) {
       movq(dest, dest);
       return;
     }
-    if (v.high == 0) {
-      if ((v.low & 0xFFFFFFFF) == v.low) {
-        mov(dword[rsp + kStashOffset], static_cast<unsigned>(v.low));
-        movd(dest, dword[rsp + kStashOffset]);
-        return;
-      }
-      MovMem64(rsp + kStashOffset, v.low);
-      movq(dest, qword[rsp + kStashOffset]);
-      return;
-    }
 
-    // TODO(benvanik): see what other common values are.
-    // TODO(benvanik): build constant table - 99% are reused.
-    MovMem64(rsp + kStashOffset, v.low);
-    MovMem64(rsp + kStashOffset + 8, v.high);
-    vmovdqa(dest, ptr[rsp + kStashOffset]);
+    vmovdqu(dest, GetPooledConstPtr(v));
   }
 }
 
@@ -1387,10 +1864,8 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, float v) {
         return;
       }
     }
-    // TODO(benvanik): see what other common values are.
-    // TODO(benvanik): build constant table - 99% are reused.
-    mov(eax, x.i);
-    vmovd(dest, eax);
+    vec128_t pooled = vec128i(x.i, 0, 0, 0);
+    vmovss(dest, GetPooledConstPtr(pooled));
   }
 }
 
@@ -1414,10 +1889,8 @@ void X64Emitter::LoadConstantXmm(Xbyak::Xmm dest, double v) {
         return;
       }
     }
-    // TODO(benvanik): see what other common values are.
-    // TODO(benvanik): build constant table - 99% are reused.
-    mov(rax, x.i);
-    vmovq(dest, rax);
+    vec128_t pooled = vec128q(x.i, 0);
+    vmovsd(dest, GetPooledConstPtr(pooled));
   }
 }
 
@@ -1593,6 +2066,7 @@ static void ChangeMxcsrModeDynamicHelper(X64Emitter& e) {
   Xbyak::Label& reload_bailout =
       e.AddToTail([&come_back](X64Emitter& e, Xbyak::Label& thislabel) {
         e.L(thislabel);
+        e.EmitMxcsrSwitchCount();
         if (switching_to_fpu) {
           e.LoadFpuMxcsrDirect();
         } else {
@@ -1644,6 +2118,7 @@ bool X64Emitter::ChangeMxcsrMode(MXCSRMode new_mode, bool already_set) {
   } else {
     mxcsr_mode_ = new_mode;
     if (!already_set) {
+      EmitMxcsrSwitchCount();
       if (new_mode == MXCSRMode::Fpu) {
         LoadFpuMxcsrDirect();
         btr(GetBackendFlagsPtr(), 0);
@@ -1665,6 +2140,20 @@ void X64Emitter::LoadFpuMxcsrDirect() {
 void X64Emitter::LoadVmxMxcsrDirect() {
   vldmxcsr(GetBackendCtxPtr(offsetof(X64BackendContext, mxcsr_vmx)));
 }
+void X64Emitter::EmitMxcsrSwitchCount() {
+#if XE_X64_PROFILER_AVAILABLE == 1
+  if (cvars::instrument_call_times) {
+    MarkNotRelocatable();
+    uint64_t* switch_count =
+        backend()->GetProfilerMxcsrSwitchRecordForFunction(
+            current_guest_function_);
+    push(rax);
+    mov(rax, reinterpret_cast<uintptr_t>(switch_count));
+    inc(qword[rax]);
+    pop(rax);
+  }
+#endif
+}
 Xbyak::Address X64Emitter::GetBackendFlagsPtr() const {
   Xbyak::Address pt = GetBackendCtxPtr(offsetof(X64BackendContext, flags));
   pt.setBit(32);
@@ -1683,7 +2172,8 @@ void X64Emitter::HandleStackpointOverflowError(ppc::PPCContext* context) {
 }
 
 void X64Emitter::PushStackpoint() {
-  if (!cvars::enable_host_guest_stack_synchronization) {
+  if (!cvars::enable_host_guest_stack_synchronization ||
+      cvars::lazy_host_guest_stack_synchronization) {
     return;
   }
   // push the current host and guest stack pointers
@@ -1727,7 +2217,8 @@ void X64Emitter::PushStackpoint() {
   jge(overflowed_stackpoints, T_NEAR);
 }
 void X64Emitter::PopStackpoint() {
-  if (!cvars::enable_host_guest_stack_synchronization) {
+  if (!cvars::enable_host_guest_stack_synchronization ||
+      cvars::lazy_host_guest_stack_synchronization) {
     return;
   }
   // todo: maybe verify that rsp and r1 == the stackpoint?
@@ -1759,15 +2250,18 @@ void X64Emitter::EnsureSynchronizedGuestAndHostStack() {
         uint32_t stack32 = static_cast<uint32_t>(e.stack_size());
         auto backend = e.backend();
         if (stack32 < 256) {
-          e.call(backend->synchronize_guest_and_host_stack_helper_for_size(1));
+          e.CallCodeCacheAddress(
+              backend->synchronize_guest_and_host_stack_helper_for_size(1));
           e.db(stack32);
 
         } else if (stack32 < 65536) {
-          e.call(backend->synchronize_guest_and_host_stack_helper_for_size(2));
+          e.CallCodeCacheAddress(
+              backend->synchronize_guest_and_host_stack_helper_for_size(2));
           e.dw(stack32);
         } else {
           // ought to be impossible, a host stack bigger than 65536??
-          e.call(backend->synchronize_guest_and_host_stack_helper_for_size(4));
+          e.CallCodeCacheAddress(
+              backend->synchronize_guest_and_host_stack_helper_for_size(4));
           e.dd(stack32);
         }
         e.jmp(return_from_sync, T_NEAR);
@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_trace_data.h"
 #include "xenia/cpu/hir/hir_builder.h"
@@ -249,13 +250,18 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::Label& epilog_label() { return *epilog_label_; }
 
   void MarkSourceOffset(const hir::Instr* i);
+  uint32_t current_guest_address() const { return current_guest_address_; }
 
   void DebugBreak();
-  void Trap(uint16_t trap_type = 0);
+  // The guest address is of the instruction the trap is emitted for, reported
+  // for the traps emitted by the frontend.
+  void Trap(uint16_t trap_type = 0, uint32_t guest_address = 0);
   void UnimplementedInstr(const hir::Instr* i);
 
   void Call(const hir::Instr* instr, GuestFunction* function);
   void CallIndirect(const hir::Instr* instr, const Xbyak::Reg64& reg);
+  // 0 if indirect calls don't use inline caches.
+  uint32_t GetIndirectCallInlineCacheEntries() const;
   void CallExtern(const hir::Instr* instr, const Function* function);
   void CallNative(void* fn);
   void CallNative(uint64_t (*fn)(void* raw_context));
@@ -265,6 +271,16 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void CallNativeSafe(void* fn);
   void SetReturnAddress(uint64_t value);
 
+  // Host addresses that may differ between runs must be emitted through these
+  // so the code can be relocated when restored from the persistent code cache.
+  // Loads an address within the host executable image.
+  void MovImageAddress(const Xbyak::Reg64& dest, const void* address);
+  // Calls a thunk or a helper placed in the code cache at initialization.
+  void CallCodeCacheAddress(const void* target);
+  // Excludes the function being emitted from the persistent code cache, for
+  // code referencing heap addresses or other per-run state.
+  void MarkNotRelocatable() { code_relocatable_ = false; }
+
   Xbyak::Reg64 GetNativeParam(uint32_t param);
 
   Xbyak::Reg64 GetContextReg() const;
@@ -279,6 +295,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void MovMem64(const Xbyak::RegExp& addr, uint64_t v);
 
   Xbyak::Address GetXmmConstPtr(XmmConst id);
+  // Interns a constant not in the fixed table in the pool placed after the
+  // tail code of the function, for loading it RIP-relatively.
+  Xbyak::Address GetPooledConstPtr(const vec128_t& v);
   Xbyak::Address GetBackendCtxPtr(int offset_in_x64backendctx) const;
 
   void LoadConstantXmm(Xbyak::Xmm dest, float v);
@@ -321,10 +340,34 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   void LoadFpuMxcsrDirect();  // unsafe, does not change mxcsr_mode_
   void LoadVmxMxcsrDirect();  // unsafe, does not change mxcsr_mode_
+  // Counts an executed MXCSR switch for the function when profiling call
+  // times. Clobbers flags.
+  void EmitMxcsrSwitchCount();
 
   XexModule* GuestModule() { return guest_module_; }
 
   void EmitProfilerEpilogue();
+  void EmitTierUpCheck();
+  void EmitIndirectCallInlineCache(const hir::Instr* instr,
+                                   uint32_t cache_entries);
+  void EmitIndirectCallToRax(const hir::Instr* instr);
+
+  // Fills block_order_ with the order to emit the blocks in and
+  // block_alignments_ with the alignment for each block by ordinal. Returns
+  // true if the order differs from the HIR one, in which case fallthroughs need
+  // to be explicit.
+  bool ComputeBlockLayout(hir::HIRBuilder* builder);
+  static std::string GetBlockLayoutLabel(const hir::Block* block);
+  // Finds the blocks that may be entered with an MXCSR mode that isn't known
+  // yet when they're emitted, because of a jump from a block placed after them.
+  void PrepareMxcsrModeTracking();
+  // Accounts for a jump or fallthrough to the block in the MXCSR mode it will
+  // be entered with. Must be called with the mode at the jump itself, by the
+  // sequences emitting jumps to blocks. Jumps leaving the function don't need
+  // it, and calls forget the mode before emitting anything.
+  void MergeMxcsrModeInto(const hir::Block* block);
+  MXCSRMode GetBlockEntryMxcsrMode(const hir::Block* block) const;
+  static bool BlockMayFallThrough(const hir::Block* block);
 
   void EmitXOP(amdfx::xop_t xoperation) {
     xoperation.ForeachByte([this](uint8_t b) { this->db(b); });
@@ -387,6 +430,7 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void EmitGetCurrentThreadId();
   void EmitTraceUserCallReturn();
   static void HandleStackpointOverflowError(ppc::PPCContext* context);
+  static void HandleTierUp(ppc::PPCContext* context, GuestFunction* function);
  protected:
   Processor* processor_ = nullptr;
   X64Backend* backend_ = nullptr;
@@ -397,6 +441,10 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::util::Cpu cpu_;
   uint64_t feature_flags_ = 0;
   uint32_t current_guest_function_ = 0;
+  // Guest address of the last source offset, for the instruction being emitted.
+  uint32_t current_guest_address_ = 0;
+  // Baseline tier function being emitted, which needs the call counter.
+  GuestFunction* tier_up_function_ = nullptr;
   Xbyak::Label* epilog_label_ = nullptr;
 
   hir::Instr* current_instr_ = nullptr;
@@ -421,6 +469,30 @@ class X64Emitter : public Xbyak::CodeGenerator {
       label_cache_;  // for creating labels that need to be referenced much
                      // later by tail emitters
   MXCSRMode mxcsr_mode_ = MXCSRMode::Unknown;
+
+  bool code_relocatable_ = true;
+  std::vector<X64CodeRelocation> code_relocations_;
+
+  // Constants of the function being emitted, with the labels of their
+  // locations in label_cache_.
+  std::vector<std::pair<vec128_t, Xbyak::Label*>> pooled_consts_;
+
+  // Block layout scratch, kept across functions to avoid reallocating it.
+  std::vector<hir::Block*> block_order_;
+  std::vector<uint8_t> block_alignments_;
+  std::vector<hir::Block*> hot_blocks_;
+  std::vector<hir::Block*> cold_blocks_;
+
+  struct BlockMxcsrState {
+    uint32_t position;
+    // Unknown if the predecessors so far disagree.
+    MXCSRMode entry_mode;
+    bool reached;
+    // Jumped or fallen into from a block emitted after it (or itself).
+    bool late_predecessor;
+  };
+  // By block ordinal.
+  std::vector<BlockMxcsrState> block_mxcsr_states_;
 };
 
 }  // namespace x64
@@ -20,51 +20,97 @@ namespace backend {
 namespace x64 {
 
 volatile int anchor_control = 0;
+// Branches on the flags of the comparison defining the condition if it's the
+// previous instruction. Only for the integer comparisons with a register on
+// the left, as the floating-point ones set the flags differently and the
+// operands are swapped when the left one is a constant.
 template <typename T>
-static void EmitFusedBranch(X64Emitter& e, const T& i) {
-  bool valid = i.instr->prev && i.instr->prev->dest == i.src1.value;
-  auto opcode = valid ? i.instr->prev->opcode->num : -1;
-  if (valid) {
-    std::string name = i.src2.value->GetIdString();
+static void EmitFusedBranch(X64Emitter& e, const T& i,
+                            bool branch_if_false = false) {
+  // Nothing below changes the MXCSR mode, the one the branch is taken in.
+  e.MergeMxcsrModeInto(i.src2.value->block);
+  const Instr* prev = i.instr->prev;
+  bool valid = prev && prev->dest == i.src1.value &&
+               prev->opcode->num >= OPCODE_COMPARE_EQ &&
+               prev->opcode->num <= OPCODE_COMPARE_UGE &&
+               IsScalarIntegralType(prev->src1.value->type) &&
+               !prev->src1.value->IsConstant();
+  std::string name = i.src2.value->GetIdString();
+  if (!valid) {
+    e.test(i.src1, i.src1);
+    if (branch_if_false) {
+      e.jz(std::move(name), e.T_NEAR);
+    } else {
+      e.jnz(std::move(name), e.T_NEAR);
+    }
+    return;
+  }
+  Opcode opcode = prev->opcode->num;
+  if (branch_if_false) {
     switch (opcode) {
       case OPCODE_COMPARE_EQ:
-        e.je(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_NE;
         break;
       case OPCODE_COMPARE_NE:
-        e.jne(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_EQ;
         break;
       case OPCODE_COMPARE_SLT:
-        e.jl(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_SGE;
         break;
       case OPCODE_COMPARE_SLE:
-        e.jle(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_SGT;
         break;
       case OPCODE_COMPARE_SGT:
-        e.jg(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_SLE;
         break;
       case OPCODE_COMPARE_SGE:
-        e.jge(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_SLT;
         break;
       case OPCODE_COMPARE_ULT:
-        e.jb(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_UGE;
         break;
       case OPCODE_COMPARE_ULE:
-        e.jbe(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_UGT;
         break;
       case OPCODE_COMPARE_UGT:
-        e.ja(std::move(name), e.T_NEAR);
-        break;
-      case OPCODE_COMPARE_UGE:
-        e.jae(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_ULE;
         break;
       default:
-        e.test(i.src1, i.src1);
-        e.jnz(std::move(name), e.T_NEAR);
+        opcode = OPCODE_COMPARE_ULT;
         break;
     }
-  } else {
-    e.test(i.src1, i.src1);
-    e.jnz(i.src2.value->GetIdString(), e.T_NEAR);
+  }
+  switch (opcode) {
+    case OPCODE_COMPARE_EQ:
+      e.je(std::move(name), e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_NE:
+      e.jne(std::move(name), e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_SLT:
+      e.jl(std::move(name), e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_SLE:
+      e.jle(std::move(name), e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_SGT:
+      e.jg(std::move(name), e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_SGE:
+      e.jge(std::move(name), e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_ULT:
+      e.jb(std::move(name), e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_ULE:
+      e.jbe(std::move(name), e.T_NEAR);
+      break;
+    case OPCODE_COMPARE_UGT:
+      e.ja(std::move(name), e.T_NEAR);
+      break;
+    default:
+      e.jae(std::move(name), e.T_NEAR);
+      break;
   }
 }
 // ============================================================================
@@ -169,7 +215,7 @@ EMITTER_OPCODE_TABLE(OPCODE_DEBUG_BREAK_TRUE, DEBUG_BREAK_TRUE_I8,
 // ============================================================================
 struct TRAP : Sequence<TRAP, I<OPCODE_TRAP, VoidOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.Trap(i.instr->flags);
+    e.Trap(i.instr->flags, e.current_guest_address());
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_TRAP, TRAP);
@@ -182,10 +228,12 @@ struct TRAP_TRUE_I8
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     Xbyak::Label& after = e.NewCachedLabel();
     unsigned flags = i.instr->flags;
-    Xbyak::Label& dotrap =
-        e.AddToTail([flags, &after](X64Emitter& e, Xbyak::Label& me) {
+    // The tail is emitted after the whole function.
+    uint32_t guest_address = e.current_guest_address();
+    Xbyak::Label& dotrap = e.AddToTail(
+        [flags, guest_address, &after](X64Emitter& e, Xbyak::Label& me) {
           e.L(me);
-          e.Trap(flags);
+          e.Trap(flags, guest_address);
           // does Trap actually return control to the guest?
           e.jmp(after, X64Emitter::T_NEAR);
         });
@@ -348,7 +396,9 @@ struct CALL_INDIRECT_TRUE_I32
     : Sequence<CALL_INDIRECT_TRUE_I32,
                I<OPCODE_CALL_INDIRECT_TRUE, VoidOp, I32Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    if (e.IsFeatureEnabled(kX64FastJrcx)) {
+    // jrcxz can only skip short distances, inline caches are too big for it.
+    if (e.IsFeatureEnabled(kX64FastJrcx) &&
+        !e.GetIndirectCallInlineCacheEntries()) {
       e.mov(e.ecx, i.src1);
       Xbyak::Label skip;
       e.jrcxz(skip);
@@ -367,7 +417,8 @@ struct CALL_INDIRECT_TRUE_I64
     : Sequence<CALL_INDIRECT_TRUE_I64,
                I<OPCODE_CALL_INDIRECT_TRUE, VoidOp, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    if (e.IsFeatureEnabled(kX64FastJrcx)) {
+    if (e.IsFeatureEnabled(kX64FastJrcx) &&
+        !e.GetIndirectCallInlineCacheEntries()) {
       e.mov(e.rcx, i.src1);
       Xbyak::Label skip;
       e.jrcxz(skip);
@@ -490,6 +541,7 @@ EMITTER_OPCODE_TABLE(OPCODE_SET_RETURN_ADDRESS, SET_RETURN_ADDRESS);
 // ============================================================================
 struct BRANCH : Sequence<BRANCH, I<OPCODE_BRANCH, VoidOp, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    e.MergeMxcsrModeInto(i.src1.value->block);
     e.jmp(i.src1.value->GetIdString(), e.T_NEAR);
   }
 };
@@ -534,6 +586,7 @@ struct BRANCH_TRUE_F32
     Xmm input = GetInputRegOrConstant(e, i.src1, e.xmm0);
     e.vmovd(e.eax, input);
     e.test(e.eax, e.eax);
+    e.MergeMxcsrModeInto(i.src2.value->block);
     e.jnz(i.src2.value->GetIdString(), e.T_NEAR);
   }
 };
@@ -543,6 +596,7 @@ struct BRANCH_TRUE_F64
     Xmm input = GetInputRegOrConstant(e, i.src1, e.xmm0);
     e.vmovq(e.rax, input);
     e.test(e.rax, e.rax);
+    e.MergeMxcsrModeInto(i.src2.value->block);
     e.jnz(i.src2.value->GetIdString(), e.T_NEAR);
   }
 };
@@ -556,32 +610,28 @@ EMITTER_OPCODE_TABLE(OPCODE_BRANCH_TRUE, BRANCH_TRUE_I8, BRANCH_TRUE_I16,
 struct BRANCH_FALSE_I8
     : Sequence<BRANCH_FALSE_I8, I<OPCODE_BRANCH_FALSE, VoidOp, I8Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    EmitFusedBranch(e, i, true);
   }
 };
 struct BRANCH_FALSE_I16
     : Sequence<BRANCH_FALSE_I16,
                I<OPCODE_BRANCH_FALSE, VoidOp, I16Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    EmitFusedBranch(e, i, true);
   }
 };
 struct BRANCH_FALSE_I32
     : Sequence<BRANCH_FALSE_I32,
                I<OPCODE_BRANCH_FALSE, VoidOp, I32Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    EmitFusedBranch(e, i, true);
   }
 };
 struct BRANCH_FALSE_I64
     : Sequence<BRANCH_FALSE_I64,
                I<OPCODE_BRANCH_FALSE, VoidOp, I64Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    EmitFusedBranch(e, i, true);
   }
 };
 struct BRANCH_FALSE_F32
@@ -591,6 +641,7 @@ struct BRANCH_FALSE_F32
     Xmm input = GetInputRegOrConstant(e, i.src1, e.xmm0);
     e.vmovd(e.eax, input);
     e.test(e.eax, e.eax);
+    e.MergeMxcsrModeInto(i.src2.value->block);
     e.jz(i.src2.value->GetIdString(), e.T_NEAR);
   }
 };
@@ -601,6 +652,7 @@ struct BRANCH_FALSE_F64
     Xmm input = GetInputRegOrConstant(e, i.src1, e.xmm0);
     e.vmovq(e.rax, input);
     e.test(e.rax, e.rax);
+    e.MergeMxcsrModeInto(i.src2.value->block);
     e.jz(i.src2.value->GetIdString(), e.T_NEAR);
   }
 };
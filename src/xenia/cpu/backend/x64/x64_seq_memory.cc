@@ -30,7 +30,8 @@ DEFINE_bool(enable_rmw_context_merging, false,
             "x64");
 DEFINE_bool(emit_mmio_aware_stores_for_recorded_exception_addresses, true,
             "Uses info gathered via record_mmio_access_exceptions to emit "
-            "special stores that are faster than trapping the exception",
+            "special loads and stores that are faster than trapping the "
+            "exception",
             "CPU");
 
 namespace xe {
@@ -190,6 +191,120 @@ static bool is_definitely_not_eo(const T& v) {
 
   return is_eo_def(v.value);
 }
+
+// Inclusive range of the low 32 bits (the guest address) of a value.
+struct GuestAddressRange {
+  uint32_t low;
+  uint32_t high;
+};
+static constexpr GuestAddressRange kAnyGuestAddress = {0, UINT32_MAX};
+
+// Proves bounds on a guest address from the instructions defining it, so the
+// 0xE0000000+ offset check can be resolved at translation time for addresses
+// like (x & 0x1FFFFFFF) + 0x40 or (x | 0xE0000000). Only looks at operations
+// whose low 32 bits depend only on the low 32 bits of their operands.
+static GuestAddressRange GetGuestAddressRange(const hir::Value* v,
+                                              uint32_t depth = 0) {
+  switch (v->type) {
+    case INT8_TYPE:
+      return {0, UINT8_MAX};
+    case INT16_TYPE:
+      return {0, UINT16_MAX};
+    case INT32_TYPE:
+    case INT64_TYPE:
+      break;
+    default:
+      return kAnyGuestAddress;
+  }
+  if (v->IsConstant()) {
+    uint32_t address = v->type == INT64_TYPE
+                           ? static_cast<uint32_t>(v->constant.u64)
+                           : v->constant.u32;
+    return {address, address};
+  }
+  const hir::Instr* df = v->def;
+  if (!df || depth >= 8) {
+    return kAnyGuestAddress;
+  }
+  switch (df->opcode->num) {
+    case OPCODE_ASSIGN:
+    case OPCODE_TRUNCATE:
+      // Truncation to 8 or 16 bits is handled by the type check above.
+      return GetGuestAddressRange(df->src1.value, depth + 1);
+    case OPCODE_ZERO_EXTEND:
+      switch (df->src1.value->type) {
+        case INT8_TYPE:
+          return {0, UINT8_MAX};
+        case INT16_TYPE:
+          return {0, UINT16_MAX};
+        case INT32_TYPE:
+          return GetGuestAddressRange(df->src1.value, depth + 1);
+        default:
+          return kAnyGuestAddress;
+      }
+    case OPCODE_AND: {
+      GuestAddressRange a = GetGuestAddressRange(df->src1.value, depth + 1);
+      GuestAddressRange b = GetGuestAddressRange(df->src2.value, depth + 1);
+      return {0, std::min(a.high, b.high)};
+    }
+    case OPCODE_OR: {
+      // All bits set in either operand are set in the result.
+      GuestAddressRange a = GetGuestAddressRange(df->src1.value, depth + 1);
+      GuestAddressRange b = GetGuestAddressRange(df->src2.value, depth + 1);
+      return {std::max(a.low, b.low), UINT32_MAX};
+    }
+    case OPCODE_ADD: {
+      GuestAddressRange a = GetGuestAddressRange(df->src1.value, depth + 1);
+      GuestAddressRange b = GetGuestAddressRange(df->src2.value, depth + 1);
+      uint64_t low = uint64_t(a.low) + b.low;
+      uint64_t high = uint64_t(a.high) + b.high;
+      if (high <= UINT32_MAX) {
+        return {uint32_t(low), uint32_t(high)};
+      }
+      // A negative constant offset, as a 32-bit addition it wraps for all
+      // values in the range or for none.
+      if (low >= (UINT64_C(1) << 32)) {
+        return {uint32_t(low), uint32_t(high)};
+      }
+      return kAnyGuestAddress;
+    }
+    default:
+      return kAnyGuestAddress;
+  }
+}
+
+enum class GuestAddressHeap {
+  kUnknown,
+  // Below 0xE0000000, no offset.
+  kBelowE0,
+  // 0xE0000000 and above, the 4 KB offset is always needed.
+  kE0,
+};
+
+template <typename T>
+static GuestAddressHeap ClassifyGuestAddress(const T& guest,
+                                             int32_t offset_const = 0) {
+  if (is_definitely_not_eo(guest)) {
+    return GuestAddressHeap::kBelowE0;
+  }
+  GuestAddressRange range = GetGuestAddressRange(guest.value);
+  if (offset_const) {
+    // Same wrapping rules as an ADD with a constant.
+    uint64_t low = uint64_t(range.low) + uint32_t(offset_const);
+    uint64_t high = uint64_t(range.high) + uint32_t(offset_const);
+    if ((high >> 32) != (low >> 32)) {
+      return GuestAddressHeap::kUnknown;
+    }
+    range = {uint32_t(low), uint32_t(high)};
+  }
+  if (range.high < 0xE0000000) {
+    return GuestAddressHeap::kBelowE0;
+  }
+  if (range.low >= 0xE0000000) {
+    return GuestAddressHeap::kE0;
+  }
+  return GuestAddressHeap::kUnknown;
+}
 // Note: most *should* be aligned, but needs to be checked!
 template <typename T>
 RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
@@ -210,8 +325,14 @@ RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
       return e.GetMembaseReg() + e.rax;
     }
   } else {
-    if (xe::memory::allocation_granularity() > 0x1000 &&
-        !is_definitely_not_eo(guest)) {
+    GuestAddressHeap heap = xe::memory::allocation_granularity() > 0x1000
+                                ? ClassifyGuestAddress(guest)
+                                : GuestAddressHeap::kBelowE0;
+    if (heap == GuestAddressHeap::kE0) {
+      // Known to be in 0xE0000000+, always apply the offset.
+      e.mov(e.eax, guest.reg().cvt32());
+      Do0x1000Add(e, e.eax);
+    } else if (heap == GuestAddressHeap::kUnknown) {
       // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
       // it via memory mapping.
       Xbyak::Label& jmpback = e.NewCachedLabel();
@@ -262,8 +383,15 @@ RegExp ComputeMemoryAddressOffset(X64Emitter& e, const T& guest,
       return e.GetMembaseReg() + e.rax;
     }
   } else {
-    if (xe::memory::allocation_granularity() > 0x1000 &&
-        !is_definitely_not_eo(guest)) {
+    GuestAddressHeap heap = xe::memory::allocation_granularity() > 0x1000
+                                ? ClassifyGuestAddress(guest, offset_const)
+                                : GuestAddressHeap::kBelowE0;
+    if (heap == GuestAddressHeap::kE0) {
+      // Known to be in 0xE0000000+, always apply the offset.
+      e.lea(e.edx, e.ptr[guest.reg().cvt32() + offset_const]);
+      Do0x1000Add(e, e.edx);
+      return e.GetMembaseReg() + e.rdx;
+    } else if (heap == GuestAddressHeap::kUnknown) {
       // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
       // it via memory mapping.
 
@@ -495,7 +623,7 @@ struct RESERVED_LOAD_INT32
     // atomic op in the store
     e.prefetchw(e.ptr[e.rax]);
     e.mov(e.ecx, i.src1.reg().cvt32());
-    e.call(e.backend()->try_acquire_reservation_helper_);
+    e.CallCodeCacheAddress(e.backend()->try_acquire_reservation_helper_);
     e.mov(i.dest, e.dword[e.rax]);
 
     e.mov(
@@ -515,7 +643,7 @@ struct RESERVED_LOAD_INT64
     // atomic op in the store
     e.prefetchw(e.ptr[e.rax]);
 
-    e.call(e.backend()->try_acquire_reservation_helper_);
+    e.CallCodeCacheAddress(e.backend()->try_acquire_reservation_helper_);
     e.mov(i.dest, e.qword[ComputeMemoryAddress(e, i.src1)]);
 
     e.mov(
@@ -540,7 +668,7 @@ struct RESERVED_STORE_INT32
     e.mov(e.ecx, i.src1.reg().cvt32());
     e.lea(e.r9, e.ptr[ComputeMemoryAddress(e, i.src1)]);
     e.mov(e.r8d, i.src2);
-    e.call(e.backend()->reserved_store_32_helper);
+    e.CallCodeCacheAddress(e.backend()->reserved_store_32_helper);
     e.setz(i.dest);
   }
 };
@@ -552,7 +680,7 @@ struct RESERVED_STORE_INT64
     e.mov(e.ecx, i.src1.reg().cvt32());
     e.lea(e.r9, e.ptr[ComputeMemoryAddress(e, i.src1)]);
     e.mov(e.r8, i.src2);
-    e.call(e.backend()->reserved_store_64_helper);
+    e.CallCodeCacheAddress(e.backend()->reserved_store_64_helper);
     e.setz(i.dest);
   }
 };
@@ -567,7 +695,11 @@ struct ATOMIC_COMPARE_EXCHANGE_I32
     : Sequence<ATOMIC_COMPARE_EXCHANGE_I32,
                I<OPCODE_ATOMIC_COMPARE_EXCHANGE, I8Op, I64Op, I32Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.mov(e.eax, i.src2);
+    if (i.src2.is_constant) {
+      e.mov(e.eax, i.src2.constant());
+    } else {
+      e.mov(e.eax, i.src2);
+    }
     if (xe::memory::allocation_granularity() > 0x1000) {
       // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
       // it via memory mapping.
@@ -589,7 +721,12 @@ struct ATOMIC_COMPARE_EXCHANGE_I32
       e.mov(e.ecx, i.src1.reg().cvt32());
     }
     e.lock();
-    e.cmpxchg(e.dword[e.GetMembaseReg() + e.rcx], i.src3);
+    if (i.src3.is_constant) {
+      e.mov(e.edx, i.src3.constant());
+      e.cmpxchg(e.dword[e.GetMembaseReg() + e.rcx], e.edx);
+    } else {
+      e.cmpxchg(e.dword[e.GetMembaseReg() + e.rcx], i.src3);
+    }
     e.sete(i.dest);
   }
 };
@@ -1124,6 +1261,8 @@ struct LOAD_MMIO_I32
     // uint64_t (context, addr)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto read_address = uint32_t(i.src2.value);
+    // The callback context is a heap object.
+    e.MarkNotRelocatable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), read_address);
     e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read));
@@ -1136,7 +1275,27 @@ struct LOAD_MMIO_I32
     }
   }
 };
-EMITTER_OPCODE_TABLE(OPCODE_LOAD_MMIO, LOAD_MMIO_I32);
+struct LOAD_MMIO_I64
+    : Sequence<LOAD_MMIO_I64, I<OPCODE_LOAD_MMIO, I64Op, OffsetOp, OffsetOp>> {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    // Only the inline read ranges provide qword reads.
+    auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
+    auto read_address = uint32_t(i.src2.value);
+    assert_not_null(mmio_range->read64);
+    e.MarkNotRelocatable();
+    e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
+    e.mov(e.GetNativeParam(1).cvt32(), read_address);
+    e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read64));
+    e.bswap(e.rax);
+    e.mov(i.dest, e.rax);
+    if (IsTracingData()) {
+      e.mov(e.GetNativeParam(0), i.dest);
+      e.mov(e.edx, read_address);
+      e.CallNative(reinterpret_cast<void*>(TraceContextLoadI64));
+    }
+  }
+};
+EMITTER_OPCODE_TABLE(OPCODE_LOAD_MMIO, LOAD_MMIO_I32, LOAD_MMIO_I64);
 
 // ============================================================================
 // OPCODE_STORE_MMIO
@@ -1149,6 +1308,8 @@ struct STORE_MMIO_I32
     // void (context, addr, value)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto write_address = uint32_t(i.src2.value);
+    // The callback context is a heap object.
+    e.MarkNotRelocatable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), write_address);
     if (i.src3.is_constant) {
@@ -1170,8 +1331,8 @@ struct STORE_MMIO_I32
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_STORE_MMIO, STORE_MMIO_I32);
-// according to triangle we dont support mmio reads atm so no point in
-// implementing this for them
+// Both the I32 loads and stores that have been caught accessing MMIO call the
+// range handlers directly instead of trapping.
 static bool IsPossibleMMIOInstruction(X64Emitter& e, const hir::Instr* i) {
   if (!cvars::emit_mmio_aware_stores_for_recorded_exception_addresses) {
     return false;
@@ -843,6 +843,60 @@ static XmmConst GetShiftmaskForType(unsigned typ) {
     return XMMXOPDwordShiftMask;
   }
 }
+
+// AVX-512BW provides per-element word shifts (vpsllvw/vpsrlvw/vpsravw) and
+// word to byte narrowing (vpmovwb/vpmovuswb), which replace the scalar loops
+// and native calls used for byte and halfword elements on older hosts.
+static bool IsAVX512BWEnabled(X64Emitter& e) {
+  return e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512BW);
+}
+
+enum class ElementShiftKind { kLeft, kRightLogical, kRightArithmetic };
+
+static void EmitAVX512ElementShiftWords(X64Emitter& e, ElementShiftKind kind,
+                                        const Xbyak::Xmm& dest,
+                                        const Xbyak::Xmm& src1,
+                                        const Xbyak::Xmm& amount) {
+  switch (kind) {
+    case ElementShiftKind::kLeft:
+      e.vpsllvw(dest, src1, amount);
+      break;
+    case ElementShiftKind::kRightLogical:
+      e.vpsrlvw(dest, src1, amount);
+      break;
+    case ElementShiftKind::kRightArithmetic:
+      e.vpsravw(dest, src1, amount);
+      break;
+  }
+}
+
+// src1 may be xmm0 and src2 may be xmm1, the remaining scratch registers are
+// not touched.
+static void EmitAVX512ElementShiftInt8(X64Emitter& e, ElementShiftKind kind,
+                                       const Xbyak::Xmm& dest,
+                                       const Xbyak::Xmm& src1,
+                                       const Xbyak::Xmm& src2) {
+  // Widen the bytes to words so that the word shifts can be used, the counts
+  // only use the low 3 bits.
+  e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMXOPByteShiftMask));
+  if (kind == ElementShiftKind::kRightArithmetic) {
+    e.vpmovsxbw(e.ymm0, src1);
+  } else {
+    e.vpmovzxbw(e.ymm0, src1);
+  }
+  e.vpmovzxbw(e.ymm1, e.xmm1);
+  EmitAVX512ElementShiftWords(e, kind, e.ymm0, e.ymm0, e.ymm1);
+  e.vpmovwb(dest, e.ymm0);
+}
+
+static void EmitAVX512ElementShiftInt16(X64Emitter& e, ElementShiftKind kind,
+                                        const Xbyak::Xmm& dest,
+                                        const Xbyak::Xmm& src1,
+                                        const Xbyak::Xmm& src2) {
+  e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMXOPWordShiftMask));
+  EmitAVX512ElementShiftWords(e, kind, dest, src1, e.xmm1);
+}
+
 struct VECTOR_SHL_V128
     : Sequence<VECTOR_SHL_V128, I<OPCODE_VECTOR_SHL, V128Op, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
@@ -886,6 +940,27 @@ struct VECTOR_SHL_V128
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
     // TODO(benvanik): native version (with shift magic).
 
+    // Checked first, one shift amount for all the elements is cheaper with the
+    // AVX2 constant path below than the variable shifts.
+    bool uniform_constant_shift = false;
+    if (i.src2.is_constant) {
+      const vec128_t& shamt = i.src2.constant();
+      uniform_constant_shift = true;
+      for (unsigned n = 1; n < 16; ++n) {
+        if ((shamt.u8[n] & 7) != (shamt.u8[0] & 7)) {
+          uniform_constant_shift = false;
+          break;
+        }
+      }
+    }
+
+    if (IsAVX512BWEnabled(e) && !uniform_constant_shift) {
+      EmitAVX512ElementShiftInt8(e, ElementShiftKind::kLeft, i.dest,
+                                 GetInputRegOrConstant(e, i.src1, e.xmm0),
+                                 GetInputRegOrConstant(e, i.src2, e.xmm1));
+      return;
+    }
+
     if (e.IsFeatureEnabled(kX64EmitAVX2)) {
       if (!i.src2.is_constant) {
         // get high 8 bytes
@@ -1026,6 +1101,12 @@ struct VECTOR_SHL_V128
       }
     }
 
+    if (IsAVX512BWEnabled(e)) {
+      EmitAVX512ElementShiftInt16(e, ElementShiftKind::kLeft, i.dest, src1,
+                                  GetInputRegOrConstant(e, i.src2, e.xmm1));
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1244,6 +1325,12 @@ struct VECTOR_SHR_V128
         return;
       }
     }
+    if (IsAVX512BWEnabled(e)) {
+      EmitAVX512ElementShiftInt8(e, ElementShiftKind::kRightLogical, i.dest,
+                                 GetInputRegOrConstant(e, i.src1, e.xmm0),
+                                 GetInputRegOrConstant(e, i.src2, e.xmm1));
+      return;
+    }
     unsigned stack_offset_src1 = StackLayout::GUEST_SCRATCH;
     unsigned stack_offset_src2 = StackLayout::GUEST_SCRATCH + 16;
 
@@ -1301,6 +1388,13 @@ struct VECTOR_SHR_V128
       }
     }
 
+    if (IsAVX512BWEnabled(e)) {
+      EmitAVX512ElementShiftInt16(e, ElementShiftKind::kRightLogical, i.dest,
+                                  GetInputRegOrConstant(e, i.src1, e.xmm0),
+                                  GetInputRegOrConstant(e, i.src2, e.xmm1));
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1545,7 +1639,16 @@ struct VECTOR_SHA_V128
         e.vpacksswb(i.dest, e.xmm0, e.xmm1);
         return;
       }
+    }
+
+    if (IsAVX512BWEnabled(e)) {
+      EmitAVX512ElementShiftInt8(e, ElementShiftKind::kRightArithmetic, i.dest,
+                                 GetInputRegOrConstant(e, i.src1, e.xmm0),
+                                 GetInputRegOrConstant(e, i.src2, e.xmm1));
+      return;
+    }
 
+    if (i.src2.is_constant) {
       e.StashConstantXmm(1, i.src2.constant());
       stack_offset_src2 = X64Emitter::kStashOffset + 16;
     } else {
@@ -1600,6 +1703,14 @@ struct VECTOR_SHA_V128
       }
     }
 
+    if (IsAVX512BWEnabled(e)) {
+      EmitAVX512ElementShiftInt16(e, ElementShiftKind::kRightArithmetic,
+                                  i.dest,
+                                  GetInputRegOrConstant(e, i.src1, e.xmm0),
+                                  GetInputRegOrConstant(e, i.src2, e.xmm1));
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1772,6 +1883,21 @@ struct VECTOR_ROTATE_LEFT_V128
       unsigned stack_offset_src2 = StackLayout::GUEST_SCRATCH + 16;
       switch (i.instr->flags) {
         case INT8_TYPE: {
+          if (IsAVX512BWEnabled(e)) {
+            // Duplicate each byte into both halves of a word, shift the words
+            // and take the high halves.
+            Xmm src1 = GetInputRegOrConstant(e, i.src1, e.xmm0);
+            Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
+            e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMXOPByteShiftMask));
+            e.vpmovzxbw(e.ymm0, src1);
+            e.vpmovzxbw(e.ymm1, e.xmm1);
+            e.vpsllw(e.ymm2, e.ymm0, 8);
+            e.vpor(e.ymm0, e.ymm0, e.ymm2);
+            e.vpsllvw(e.ymm0, e.ymm0, e.ymm1);
+            e.vpsrlw(e.ymm0, e.ymm0, 8);
+            e.vpmovwb(i.dest, e.ymm0);
+            break;
+          }
           if (i.src1.is_constant) {
             e.StashConstantXmm(0, i.src1.constant());
             stack_offset_src1 = X64Emitter::kStashOffset;
@@ -1804,6 +1930,20 @@ struct VECTOR_ROTATE_LEFT_V128
 
         } break;
         case INT16_TYPE: {
+          if (IsAVX512BWEnabled(e)) {
+            // Shift the zero extended halfwords as dwords and fold the bits
+            // shifted out of the low half back in.
+            Xmm src1 = GetInputRegOrConstant(e, i.src1, e.xmm0);
+            Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
+            e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMXOPWordShiftMask));
+            e.vpmovzxwd(e.ymm0, src1);
+            e.vpmovzxwd(e.ymm1, e.xmm1);
+            e.vpsllvd(e.ymm0, e.ymm0, e.ymm1);
+            e.vpsrld(e.ymm1, e.ymm0, 16);
+            e.vpor(e.ymm0, e.ymm0, e.ymm1);
+            e.vpmovdw(i.dest, e.ymm0);
+            break;
+          }
           if (i.src1.is_constant) {
             e.StashConstantXmm(0, i.src1.constant());
             stack_offset_src1 = X64Emitter::kStashOffset;
@@ -2134,7 +2274,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovImageAddress(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -2823,7 +2963,20 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
-        if (IsPackOutSaturate(flags)) {
+        if (IsAVX512BWEnabled(e)) {
+          // vpmovuswb/vpmovwb narrow each source to 8 bytes directly.
+          Xmm src1 = GetInputRegOrConstant(e, i.src1, e.xmm2);
+          Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm3);
+          if (IsPackOutSaturate(flags)) {
+            e.vpmovuswb(e.xmm0, src1);
+            e.vpmovuswb(e.xmm1, src2);
+          } else {
+            e.vpmovwb(e.xmm0, src1);
+            e.vpmovwb(e.xmm1, src2);
+          }
+          e.vpunpcklqdq(i.dest, e.xmm0, e.xmm1);
+          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+        } else if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
           if (i.src2.is_constant) {
             e.lea(e.GetNativeParam(1),
@@ -2888,7 +3041,19 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
-        if (IsPackOutSaturate(flags)) {
+        if (IsPackOutSaturate(flags) &&
+            e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+          // unsigned -> unsigned + saturate
+          // vpmovusdw narrows each source to 4 words, then the halfwords are
+          // swapped within each dword like the signed variants below.
+          Xmm src1 = GetInputRegOrConstant(e, i.src1, e.xmm2);
+          Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm3);
+          e.vpmovusdw(e.xmm0, src1);
+          e.vpmovusdw(e.xmm1, src2);
+          e.vpunpcklqdq(i.dest, e.xmm0, e.xmm1);
+          e.vpshuflw(i.dest, i.dest, 0b10110001);
+          e.vpshufhw(i.dest, i.dest, 0b10110001);
+        } else if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
           // Construct a saturation max value
           e.mov(e.eax, 0xFFFFu);
@@ -26,7 +26,6 @@
 
 #include <algorithm>
 #include <cstring>
-#include <unordered_map>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/clock.h"
@@ -72,8 +71,7 @@ using namespace xe::cpu::hir;
 
 using xe::cpu::hir::Instr;
 
-typedef bool (*SequenceSelectFn)(X64Emitter&, const Instr*, InstrKeyValue ikey);
-std::unordered_map<uint32_t, SequenceSelectFn> sequence_table;
+OpcodeSequences sequence_table[hir::__OPCODE_MAX_VALUE];
 
 // ============================================================================
 // OPCODE_COMMENT
@@ -85,6 +83,7 @@ struct COMMENT : Sequence<COMMENT, I<OPCODE_COMMENT, VoidOp, OffsetOp>> {
       // TODO(benvanik): pass through.
       // TODO(benvanik): don't just leak this memory.
       auto str_copy = strdup(str);
+      e.MarkNotRelocatable();
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
     }
@@ -489,13 +488,20 @@ struct LOAD_CLOCK : Sequence<LOAD_CLOCK, I<OPCODE_LOAD_CLOCK, I64Op>> {
             e.GetBackendCtxPtr(offsetof(X64BackendContext, guest_tick_count)));
       e.mov(i.dest, e.qword[e.rcx]);
     } else {
-      // When scaling is disabled and the raw clock source is selected, the code
-      // in the Clock class is actually just forwarding tick counts after one
-      // simple multiply and division. In that case we rather bake the scaling
-      // in here to cut extra function calls with CPU cache misses and stack
-      // frame overhead.
-      if (cvars::clock_no_scaling && cvars::clock_source_raw) {
-        auto ratio = Clock::guest_tick_ratio();
+      // When the raw clock source is selected, the code in the Clock class is
+      // just applying the fixed-point scale to the time stamp counter, so we
+      // rather do it here to cut extra function calls with CPU cache misses
+      // and stack frame overhead. The scale is loaded through the pointer
+      // which the Clock replaces when the guest time scalar changes.
+      if (cvars::clock_source_raw) {
+        // The address of the scale pointer is specific to the process.
+        e.MarkNotRelocatable();
+        using RawGuestTickScale = Clock::RawGuestTickScale;
+        static_assert(sizeof(std::atomic<const RawGuestTickScale*>) ==
+                          sizeof(const RawGuestTickScale*),
+                      "The scale pointer must be loadable as a qword");
+        e.mov(e.rcx, uint64_t(Clock::GetRawGuestTickScalePointer()));
+        e.mov(i.dest, e.qword[e.rcx]);
         // The 360 CPU is an in-order CPU, AMD64 usually isn't. Without
         // mfence/lfence magic the rdtsc instruction can be executed sooner or
         // later in the cache window. Since it's resolution however is much
@@ -506,12 +512,17 @@ struct LOAD_CLOCK : Sequence<LOAD_CLOCK, I<OPCODE_LOAD_CLOCK, I64Op>> {
         // Make it a 64 bit number in rax.
         e.shl(e.rdx, 32);
         e.or_(e.rax, e.rdx);
-        // Apply tick frequency scaling.
-        e.mov(e.rcx, ratio.first);
-        e.mul(e.rcx);
-        // We actually now have a 128 bit number in rdx:rax.
-        e.mov(e.rcx, ratio.second);
-        e.div(e.rcx);
+        // Relative to the base, clamped to 0 (mov doesn't modify the flags).
+        e.sub(e.rax,
+              e.qword[i.dest + offsetof(RawGuestTickScale, host_tick_base)]);
+        e.mov(e.ecx, 0);
+        e.cmovb(e.rax, e.rcx);
+        // Apply the tick frequency scaling, to a 128 bit number in rdx:rax.
+        e.mov(e.ecx, e.dword[i.dest + offsetof(RawGuestTickScale, shift)]);
+        e.mul(e.qword[i.dest + offsetof(RawGuestTickScale, multiplier)]);
+        e.shrd(e.rax, e.rdx, e.cl);
+        e.add(e.rax,
+              e.qword[i.dest + offsetof(RawGuestTickScale, guest_tick_base)]);
         e.mov(i.dest, e.rax);
       } else {
         e.CallNative(LoadClock);
@@ -3192,7 +3203,7 @@ struct SET_ROUNDING_MODE_I32
     } else {
       e.mov(e.ecx, i.src1);
 
-      e.mov(e.rax, uintptr_t(mxcsr_table));
+      e.MovImageAddress(e.rax, mxcsr_table);
       e.mov(e.edx, e.ptr[e.rax + e.rcx * 4]);
       // this was not here
       e.mov(e.GetBackendCtxPtr(offsetof(X64BackendContext, mxcsr_fpu)), e.edx);
@@ -3237,13 +3248,18 @@ bool SelectSequence(X64Emitter* e, const Instr* i, const Instr** new_tail) {
     return true;
   } else {
     const InstrKey key(i);
+    const InstrKeyValue key_value = key;
 
-    auto it = sequence_table.find(key);
-    if (it != sequence_table.end()) {
-      if (it->second(*e, i, InstrKey(i))) {
+    const OpcodeSequences& sequences = sequence_table[key.opcode];
+    for (uint32_t n = 0; n < sequences.count; ++n) {
+      if (sequences.keys[n] != key_value) {
+        continue;
+      }
+      if (sequences.select_fns[n](*e, i, key_value)) {
         *new_tail = i->next;
         return true;
       }
+      break;
     }
     XELOGE("No sequence match for variant {}", GetOpcodeName(i->opcode));
     return false;
@@ -10,10 +10,13 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_SEQUENCES_H_
 #define XENIA_CPU_BACKEND_X64_X64_SEQUENCES_H_
 
+#include <cstdint>
+
+#include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/cpu/hir/instr.h"
+#include "xenia/cpu/hir/opcodes.h"
 
-#include <unordered_map>
 #define assert_impossible_sequence(name)          \
   assert_always("impossible sequence hit" #name); \
   XELOGE("impossible sequence hit: {}", #name)
@@ -26,11 +29,36 @@ namespace x64 {
 class X64Emitter;
 
 typedef bool (*SequenceSelectFn)(X64Emitter&, const hir::Instr*, uint32_t ikey);
-extern std::unordered_map<uint32_t, SequenceSelectFn> sequence_table;
+
+// Sequences are looked up by indexing with the opcode, the low 8 bits of the
+// key, and comparing the whole key with the few type variants registered for
+// it, instead of hashing every instruction key. The table only has constant
+// initialization, so the sequences can be registered from the dynamic
+// initializers of any of the sequence files regardless of their order.
+constexpr uint32_t kMaxSequencesPerOpcode = 16;
+struct OpcodeSequences {
+  uint32_t count;
+  uint32_t keys[kMaxSequencesPerOpcode];
+  SequenceSelectFn select_fns[kMaxSequencesPerOpcode];
+};
+extern OpcodeSequences sequence_table[hir::__OPCODE_MAX_VALUE];
 
 template <typename T>
 bool Register() {
-  sequence_table.insert({T::head_key(), T::Select});
+  constexpr uint32_t key = T::head_key();
+  constexpr uint32_t opcode = key & 0xFF;
+  static_assert(opcode < hir::__OPCODE_MAX_VALUE);
+  OpcodeSequences& sequences = sequence_table[opcode];
+  for (uint32_t i = 0; i < sequences.count; ++i) {
+    if (sequences.keys[i] == key) {
+      // The first registered sequence is used for the key.
+      return true;
+    }
+  }
+  assert_true(sequences.count < kMaxSequencesPerOpcode);
+  sequences.keys[sequences.count] = key;
+  sequences.select_fns[sequences.count] = T::Select;
+  ++sequences.count;
   return true;
 }
 
@@ -106,9 +106,12 @@ class StackLayout {
    *  |                  |
    *  |                  |
    *  +------------------+
-   *  | scratch, 48b     | rsp + 32
+   *  | scratch, 40b     | rsp + 32
    *  |                  |
    *  +------------------+
+   *  | guest r1 at entry| rsp + 72
+   *  | host stack size  | rsp + 76
+   *  +------------------+
    *  | rcx / context    | rsp + 80
    *  +------------------+
    *  | guest ret addr   | rsp + 88
@@ -129,6 +132,10 @@ class StackLayout {
   static const size_t GUEST_PROFILER_START = 80;
   static const size_t GUEST_RET_ADDR = 88;
   static const size_t GUEST_CALL_RET_ADDR = 96;
+  // Only written with lazy_host_guest_stack_synchronization, which rebuilds
+  // the guest stack by walking these frames instead of keeping stackpoints.
+  static const size_t GUEST_FRAME_GUEST_STACK = 72;
+  static const size_t GUEST_FRAME_HOST_STACK_SIZE = 76;
 };
 
 }  // namespace x64
@@ -9,8 +9,11 @@
 
 #include "xenia/cpu/compiler/compiler.h"
 
+#include "xenia/base/clock.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/translation_profiler.h"
 
 namespace xe {
 namespace cpu {
@@ -30,12 +33,19 @@ void Compiler::Reset() {}
 bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
   // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
   //                 stop changing things, etc.
+  TranslationProfiler* profiler =
+      processor_ ? processor_->translation_profiler() : nullptr;
   for (size_t i = 0; i < passes_.size(); ++i) {
     auto& pass = passes_[i];
     scratch_arena_.Reset();
+    uint64_t start_ticks = profiler ? Clock::QueryHostTickCount() : 0;
     if (!pass->Run(builder)) {
       return false;
     }
+    if (profiler) {
+      profiler->RecordPass(pass->name(),
+                           Clock::QueryHostTickCount() - start_ticks);
+    }
   }
 
   return true;
@@ -0,0 +1,108 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/compare_sinking_pass.h"
+
+#include "xenia/base/assert.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+CompareSinkingPass::CompareSinkingPass() : CompilerPass() {}
+
+CompareSinkingPass::~CompareSinkingPass() {}
+
+bool CompareSinkingPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  compares_sunk_ = 0;
+  Block* block = builder->first_block();
+  while (block) {
+    Instr* i = block->instr_head;
+    while (i) {
+      Instr* next = i->next;
+      Opcode opcode = i->opcode->num;
+      if (opcode != OPCODE_BRANCH_TRUE && opcode != OPCODE_BRANCH_FALSE) {
+        i = next;
+        continue;
+      }
+      Value* cond = i->src1.value;
+      Instr* compare = cond->def;
+      // Only the integer comparisons the backend can branch on directly, with
+      // the constant (if any) on the right, as it swaps the operands
+      // otherwise. The operands are values, so the comparison gives the same
+      // result wherever it is in the block.
+      if (!compare || compare->block != block || compare == i->prev ||
+          compare->opcode->num < OPCODE_COMPARE_EQ ||
+          compare->opcode->num > OPCODE_COMPARE_UGE ||
+          !IsScalarIntegralType(compare->src1.value->type) ||
+          compare->src1.value->IsConstant()) {
+        i = next;
+        continue;
+      }
+      if (cond->HasSingleUse()) {
+        compare->MoveBefore(i);
+      } else {
+        Value* clone = CloneCompare(builder, compare);
+        clone->def->MoveBefore(i);
+        i->set_src1(clone);
+      }
+      ++compares_sunk_;
+      i = next;
+    }
+    block = block->next;
+  }
+
+  return true;
+}
+
+Value* CompareSinkingPass::CloneCompare(HIRBuilder* builder, Instr* compare) {
+  Value* value1 = compare->src1.value;
+  Value* value2 = compare->src2.value;
+  switch (compare->opcode->num) {
+    case OPCODE_COMPARE_EQ:
+      return builder->CompareEQ(value1, value2);
+    case OPCODE_COMPARE_NE:
+      return builder->CompareNE(value1, value2);
+    case OPCODE_COMPARE_SLT:
+      return builder->CompareSLT(value1, value2);
+    case OPCODE_COMPARE_SLE:
+      return builder->CompareSLE(value1, value2);
+    case OPCODE_COMPARE_SGT:
+      return builder->CompareSGT(value1, value2);
+    case OPCODE_COMPARE_SGE:
+      return builder->CompareSGE(value1, value2);
+    case OPCODE_COMPARE_ULT:
+      return builder->CompareULT(value1, value2);
+    case OPCODE_COMPARE_ULE:
+      return builder->CompareULE(value1, value2);
+    case OPCODE_COMPARE_UGT:
+      return builder->CompareUGT(value1, value2);
+    default:
+      assert_true(compare->opcode->num == OPCODE_COMPARE_UGE);
+      return builder->CompareUGE(value1, value2);
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
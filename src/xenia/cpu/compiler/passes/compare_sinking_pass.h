@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_COMPARE_SINKING_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_COMPARE_SINKING_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Places the integer comparisons used as the conditions of the branches
+// directly before them, so the backend can branch on the host flags of the
+// comparison instead of testing the stored result. The comparisons written to
+// the condition register (used by the branches after promotion) are usually
+// separated from the branches by other instructions of the guest code.
+// Comparisons only used by the branch are moved, others are duplicated.
+class CompareSinkingPass : public CompilerPass {
+ public:
+  CompareSinkingPass();
+  ~CompareSinkingPass() override;
+
+  const char* name() const override { return "CompareSinkingPass"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+  // Number of comparisons moved or duplicated by the last Run.
+  uint32_t compares_sunk() const { return compares_sunk_; }
+
+ private:
+  hir::Value* CloneCompare(hir::HIRBuilder* builder, hir::Instr* compare);
+
+  uint32_t compares_sunk_ = 0;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_COMPARE_SINKING_PASS_H_
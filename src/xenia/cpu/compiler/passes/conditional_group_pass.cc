@@ -9,10 +9,12 @@
 
 #include "xenia/cpu/compiler/passes/conditional_group_pass.h"
 
+#include "xenia/base/clock.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/cpu/translation_profiler.h"
 
 namespace xe {
 namespace cpu {
@@ -47,6 +49,8 @@ bool ConditionalGroupPass::Initialize(Compiler* compiler) {
 }
 
 bool ConditionalGroupPass::Run(HIRBuilder* builder) {
+  TranslationProfiler* profiler =
+      processor_ ? processor_->translation_profiler() : nullptr;
   bool dirty;
   do {
     dirty = false;
@@ -54,6 +58,7 @@ bool ConditionalGroupPass::Run(HIRBuilder* builder) {
       scratch_arena()->Reset();
       auto& pass = passes_[i];
       auto subpass = dynamic_cast<ConditionalGroupSubpass*>(pass.get());
+      uint64_t start_ticks = profiler ? Clock::QueryHostTickCount() : 0;
       if (!subpass) {
         if (!pass->Run(builder)) {
           return false;
@@ -65,6 +70,10 @@ bool ConditionalGroupPass::Run(HIRBuilder* builder) {
         }
         dirty |= result;
       }
+      if (profiler) {
+        profiler->RecordPass(pass->name(),
+                             Clock::QueryHostTickCount() - start_ticks);
+      }
     }
   } while (dirty);
   return true;
@@ -27,6 +27,8 @@ class ConditionalGroupPass : public CompilerPass {
   ConditionalGroupPass();
   virtual ~ConditionalGroupPass() override;
 
+  const char* name() const override { return "ConditionalGroupPass"; }
+
   bool Initialize(Compiler* compiler) override;
 
   bool Run(hir::HIRBuilder* builder) override;
@@ -263,9 +263,19 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
               address += i->src2.value->constant.i32;
             }
 
+            auto inline_read_range =
+                (v->type == INT32_TYPE || v->type == INT64_TYPE)
+                    ? memory->LookupInlineReadRange(
+                          address, uint32_t(GetTypeSize(v->type)))
+                    : nullptr;
             auto mmio_range =
                 processor_->memory()->LookupVirtualMappedRange(address);
-            if (cvars::inline_mmio_access && mmio_range) {
+            if (inline_read_range) {
+              i->Replace(&OPCODE_LOAD_MMIO_info, 0);
+              i->src1.offset = reinterpret_cast<uint64_t>(inline_read_range);
+              i->src2.offset = address;
+              result = true;
+            } else if (cvars::inline_mmio_access && mmio_range) {
               i->Replace(&OPCODE_LOAD_MMIO_info, 0);
               i->src1.offset = reinterpret_cast<uint64_t>(mmio_range);
               i->src2.offset = address;
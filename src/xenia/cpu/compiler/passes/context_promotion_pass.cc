@@ -17,10 +17,17 @@
 #include "xenia/cpu/processor.h"
 
 DECLARE_bool(debug);
+DECLARE_bool(extended_block_register_allocation);
 
 DEFINE_bool(store_all_context_values, false,
             "Don't strip dead context stores to aid in debugging.", "CPU");
 
+DEFINE_bool(interprocedural_context_promotion, true,
+            "Keep the constant guest register values known before calls to "
+            "translated functions that don't write those registers, and across "
+            "local branches.",
+            "CPU");
+
 DEFINE_bool(full_optimization_even_with_debug, false,
             "For developer use to analyze the quality of the generated code, "
             "not intended for actual debugging of the code",
@@ -72,9 +79,23 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   // instead as it may be faster (at least on the block-level).
 
   // Promote loads to values.
-  // Process each block independently, for now.
+  // Blocks are processed independently unless extended block allocation is
+  // enabled, in which case values flow into successors that are only entered
+  // by falling through (no labels) and the register allocator keeps them live.
+  // Constants don't occupy registers, so they're always kept in the blocks
+  // only entered by falling through.
   auto block = builder->first_block();
   while (block) {
+    bool reset_validity = !cvars::extended_block_register_allocation ||
+                          block->label_head || !block->prev;
+    if (reset_validity) {
+      if (cvars::interprocedural_context_promotion && !block->label_head &&
+          block->prev) {
+        KeepConstants(nullptr);
+      } else {
+        context_validity_.reset();
+      }
+    }
     PromoteBlock(block);
     block = block->next;
   }
@@ -94,16 +115,64 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   return true;
 }
 
+void ContextPromotionPass::KeepConstants(
+    const ContextWriteSummary* callee_writes) {
+  auto& validity = context_validity_;
+  int offset = validity.find_first();
+  while (offset != -1) {
+    if (!context_values_[offset]->IsConstant() ||
+        (callee_writes && callee_writes->MayWrite(size_t(offset)))) {
+      validity.reset(uint32_t(offset));
+    }
+    offset = validity.find_next(offset);
+  }
+}
+
+const ContextWriteSummary* ContextPromotionPass::GetCalleeWrites(
+    const Instr* i, std::shared_ptr<const ContextWriteSummary>& summary_ref) {
+  Function* callee;
+  if (i->opcode == &OPCODE_CALL_info) {
+    callee = i->src1.symbol;
+  } else if (i->opcode == &OPCODE_CALL_TRUE_info) {
+    callee = i->src2.symbol;
+  } else {
+    return nullptr;
+  }
+  if (!callee || !callee->is_guest()) {
+    return nullptr;
+  }
+  auto guest_callee = static_cast<GuestFunction*>(callee);
+  if (guest_callee->extern_handler()) {
+    return nullptr;
+  }
+  summary_ref = guest_callee->context_write_summary();
+  if (!summary_ref) {
+    return nullptr;
+  }
+  guest_callee->mark_context_write_summary_used();
+  return summary_ref.get();
+}
+
 void ContextPromotionPass::PromoteBlock(Block* block) {
   auto& validity = context_validity_;
-  validity.reset();
 
   Instr* i = block->instr_head;
   while (i) {
     auto next = i->next;
     if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
-      // Volatile instruction - requires all context values be flushed.
-      validity.reset();
+      // Volatile instruction - requires all context values be flushed, apart
+      // from the constants not modified by it.
+      std::shared_ptr<const ContextWriteSummary> callee_writes;
+      if (!cvars::interprocedural_context_promotion) {
+        validity.reset();
+      } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &OPCODE_BRANCH_FALSE_info) {
+        KeepConstants(nullptr);
+      } else if (GetCalleeWrites(i, callee_writes)) {
+        KeepConstants(callee_writes.get());
+      } else {
+        validity.reset();
+      }
     } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
       size_t offset = i->src1.offset;
       if (validity.test(static_cast<uint32_t>(offset))) {
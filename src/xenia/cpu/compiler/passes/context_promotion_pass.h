@@ -11,10 +11,12 @@
 #define XENIA_CPU_COMPILER_PASSES_CONTEXT_PROMOTION_PASS_H_
 
 #include <cmath>
+#include <memory>
 #include <vector>
 
 #include "xenia/base/platform.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/function.h"
 
 #if XE_COMPILER_MSVC
 #pragma warning(push)
@@ -36,11 +38,20 @@ class ContextPromotionPass : public CompilerPass {
   ContextPromotionPass();
   virtual ~ContextPromotionPass() override;
 
+  const char* name() const override { return "ContextPromotionPass"; }
+
   bool Initialize(Compiler* compiler) override;
 
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
+  // Invalidates the known context values other than the constants not written
+  // by the callee if it's not null.
+  void KeepConstants(const ContextWriteSummary* callee_writes);
+  // The summary of the guest function called by the instruction if known.
+  const ContextWriteSummary* GetCalleeWrites(
+      const hir::Instr* i,
+      std::shared_ptr<const ContextWriteSummary>& summary_ref);
   void PromoteBlock(hir::Block* block);
   void RemoveDeadStoresBlock(hir::Block* block);
 
@@ -39,7 +39,8 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::OpcodeSignatureType;
 using xe::cpu::hir::Value;
 
-DataFlowAnalysisPass::DataFlowAnalysisPass() : CompilerPass() {}
+DataFlowAnalysisPass::DataFlowAnalysisPass()
+    : CompilerPass(), outgoing_bitvector_(new llvm::BitVector()) {}
 
 DataFlowAnalysisPass::~DataFlowAnalysisPass() {}
 
@@ -75,21 +76,23 @@ void DataFlowAnalysisPass::AnalyzeFlow(HIRBuilder* builder,
   auto value_map = reinterpret_cast<Value**>(
       arena->Alloc(sizeof(Value*) * max_value_estimate, alignof(Value)));
 
-  // Allocate incoming bitvectors for use by blocks. We don't need outgoing
+  // Prepare incoming bitvectors for use by blocks. We don't need outgoing
   // because they are only used during the block iteration.
   // Mapped by block ordinal.
-  // TODO(benvanik): cache this list, grow as needed, etc.
-  auto incoming_bitvectors = (llvm::BitVector**)arena->Alloc(
-      sizeof(llvm::BitVector*) * block_count, alignof(llvm::BitVector));
+  while (incoming_bitvectors_.size() < block_count) {
+    incoming_bitvectors_.emplace_back(new llvm::BitVector());
+  }
   for (auto n = 0u; n < block_count; n++) {
-    incoming_bitvectors[n] = new llvm::BitVector(max_value_estimate);
+    incoming_bitvectors_[n]->reset();
+    incoming_bitvectors_[n]->resize(max_value_estimate);
   }
+  llvm::BitVector& outgoing_values = *outgoing_bitvector_;
 
   // Walk blocks in reverse and calculate incoming/outgoing values.
   auto block = builder->last_block();
   while (block) {
     // Allocate bitsets based on max value number.
-    block->incoming_values = incoming_bitvectors[block->ordinal];
+    block->incoming_values = incoming_bitvectors_[block->ordinal].get();
     auto& incoming_values = *block->incoming_values;
 
     // Walk instructions and gather up incoming values.
@@ -117,7 +120,8 @@ void DataFlowAnalysisPass::AnalyzeFlow(HIRBuilder* builder,
 
     // Add all successor incoming values to our outgoing, as we need to
     // pass them through.
-    llvm::BitVector outgoing_values(max_value_estimate);
+    outgoing_values.reset();
+    outgoing_values.resize(max_value_estimate);
     auto outgoing_edge = block->outgoing_edge_head;
     while (outgoing_edge) {
       if (outgoing_edge->dest->ordinal > block->ordinal) {
@@ -201,11 +205,6 @@ void DataFlowAnalysisPass::AnalyzeFlow(HIRBuilder* builder,
 
     block = block->prev;
   }
-
-  // Cleanup bitvectors.
-  for (auto n = 0u; n < block_count; n++) {
-    delete incoming_bitvectors[n];
-  }
 }
 
 }  // namespace passes
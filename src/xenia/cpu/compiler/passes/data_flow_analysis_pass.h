@@ -10,8 +10,15 @@
 #ifndef XENIA_CPU_COMPILER_PASSES_DATA_FLOW_ANALYSIS_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_DATA_FLOW_ANALYSIS_PASS_H_
 
+#include <memory>
+#include <vector>
+
 #include "xenia/cpu/compiler/compiler_pass.h"
 
+namespace llvm {
+class BitVector;
+}  // namespace llvm
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -22,11 +29,18 @@ class DataFlowAnalysisPass : public CompilerPass {
   DataFlowAnalysisPass();
   ~DataFlowAnalysisPass() override;
 
+  const char* name() const override { return "DataFlowAnalysisPass"; }
+
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
   uint32_t LinearizeBlocks(hir::HIRBuilder* builder);
   void AnalyzeFlow(hir::HIRBuilder* builder, uint32_t block_count);
+
+  // Kept across runs so their storage only grows for the largest function seen
+  // instead of being allocated for every block of every function.
+  std::vector<std::unique_ptr<llvm::BitVector>> incoming_bitvectors_;
+  std::unique_ptr<llvm::BitVector> outgoing_bitvector_;
 };
 
 }  // namespace passes
@@ -0,0 +1,171 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+DECLARE_bool(debug);
+DECLARE_bool(store_all_context_values);
+DECLARE_bool(full_optimization_even_with_debug);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+
+DeadStoreEliminationPass::DeadStoreEliminationPass() : CompilerPass() {}
+
+DeadStoreEliminationPass::~DeadStoreEliminationPass() {}
+
+bool DeadStoreEliminationPass::Initialize(Compiler* compiler) {
+  if (!CompilerPass::Initialize(compiler)) {
+    return false;
+  }
+  context_size_ = uint32_t(sizeof(ppc::PPCContext));
+  live_.resize(context_size_);
+  return true;
+}
+
+bool DeadStoreEliminationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  stores_removed_ = 0;
+  // Same as the block-local removal in ContextPromotionPass, the stored values
+  // can't be recovered for debugging after this.
+  if (!cvars::full_optimization_even_with_debug &&
+      (cvars::debug || cvars::store_all_context_values)) {
+    return true;
+  }
+
+  uint16_t block_count = 0;
+  Block* block = builder->first_block();
+  while (block) {
+    block->ordinal = block_count++;
+    block = block->next;
+  }
+  while (live_in_.size() < block_count) {
+    live_in_.emplace_back(new llvm::BitVector(context_size_));
+  }
+  for (uint16_t i = 0; i < block_count; ++i) {
+    live_in_[i]->reset();
+  }
+
+  // Iterate until the live-in sets stop growing. The blocks are mostly in
+  // forward order, so visiting them backwards converges quickly, with an
+  // additional iteration for each loop nesting level.
+  bool changed;
+  do {
+    changed = false;
+    block = builder->last_block();
+    while (block) {
+      ComputeLiveOut(block, live_);
+      TransferBlock(block, live_, false);
+      llvm::BitVector& block_live_in = *live_in_[block->ordinal];
+      if (block_live_in != live_) {
+        block_live_in = live_;
+        changed = true;
+      }
+      block = block->prev;
+    }
+  } while (changed);
+
+  block = builder->first_block();
+  while (block) {
+    ComputeLiveOut(block, live_);
+    TransferBlock(block, live_, true);
+    block = block->next;
+  }
+
+  return true;
+}
+
+void DeadStoreEliminationPass::ComputeLiveOut(Block* block,
+                                              llvm::BitVector& live) {
+  // Not relying on the CFG edges as they don't include falling through, and
+  // may be outdated after the control flow simplification.
+  live.reset();
+  bool falls_through = true;
+  Instr* i = block->instr_tail;
+  while (i && (i->opcode->flags & OPCODE_FLAG_BRANCH)) {
+    if (i->opcode == &OPCODE_BRANCH_info) {
+      live |= *live_in_[i->src1.label->block->ordinal];
+      falls_through = false;
+    } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+               i->opcode == &OPCODE_BRANCH_FALSE_info) {
+      live |= *live_in_[i->src2.label->block->ordinal];
+    } else {
+      // Calls and returns - the context may be read outside the function.
+      live.set();
+      return;
+    }
+    i = i->prev;
+  }
+  if (falls_through) {
+    if (block->next) {
+      live |= *live_in_[block->next->ordinal];
+    } else {
+      live.set();
+    }
+  }
+}
+
+void DeadStoreEliminationPass::TransferBlock(Block* block,
+                                             llvm::BitVector& live,
+                                             bool remove_dead_stores) {
+  Instr* i = block->instr_tail;
+  while (i) {
+    Instr* prev = i->prev;
+    if (i->opcode == &OPCODE_BRANCH_info ||
+        i->opcode == &OPCODE_BRANCH_TRUE_info ||
+        i->opcode == &OPCODE_BRANCH_FALSE_info) {
+      // Volatile, but only the targets read the context, already accounted
+      // for in the live-out bytes of the block.
+    } else if ((i->opcode->flags & OPCODE_FLAG_VOLATILE) ||
+               i->opcode == &OPCODE_CONTEXT_BARRIER_info) {
+      live.set();
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      uint32_t offset = uint32_t(i->src1.offset);
+      live.set(offset, offset + uint32_t(GetTypeSize(i->dest->type)));
+    } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+      uint32_t offset = uint32_t(i->src1.offset);
+      uint32_t end = offset + uint32_t(GetTypeSize(i->src2.value->type));
+      bool is_live = false;
+      for (uint32_t byte = offset; byte < end; ++byte) {
+        if (live.test(byte)) {
+          is_live = true;
+          break;
+        }
+      }
+      if (is_live || !remove_dead_stores) {
+        live.reset(offset, end);
+      } else {
+        // Overwritten on all paths before being read - the bytes stay dead.
+        i->UnlinkAndNOP();
+        ++stores_removed_;
+      }
+    }
+    i = prev;
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+
+#include <memory>
+#include <vector>
+
+#include "xenia/base/platform.h"
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Removes the context stores overwritten on all paths before the context is
+// read, across blocks, using the liveness of each context byte. The context is
+// considered entirely live at volatile instructions (calls, traps) and when
+// leaving the function.
+class DeadStoreEliminationPass : public CompilerPass {
+ public:
+  DeadStoreEliminationPass();
+  ~DeadStoreEliminationPass() override;
+
+  const char* name() const override { return "DeadStoreEliminationPass"; }
+
+  bool Initialize(Compiler* compiler) override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+  // Number of stores removed by the last Run.
+  uint32_t stores_removed() const { return stores_removed_; }
+
+ private:
+  void ComputeLiveOut(hir::Block* block, llvm::BitVector& live);
+  // Walks the block backwards from the live-out context bytes to the live-in
+  // ones, optionally removing the dead stores on the way.
+  void TransferBlock(hir::Block* block, llvm::BitVector& live,
+                     bool remove_dead_stores);
+
+  uint32_t context_size_ = 0;
+  // Mapped by block ordinal.
+  std::vector<std::unique_ptr<llvm::BitVector>> live_in_;
+  llvm::BitVector live_;
+  uint32_t stores_removed_ = 0;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
@@ -13,6 +13,7 @@
 #include <cstring>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -35,6 +36,12 @@ using xe::cpu::hir::Value;
 
 #define ASSERT_NO_CYCLES 0
 
+DEFINE_bool(extended_block_register_allocation, false,
+            "Keep guest context values in host registers across blocks that "
+            "are only entered by falling through from the previous block, "
+            "instead of reloading them from the context at every block.",
+            "CPU");
+
 RegisterAllocationPass::RegisterAllocationPass(const MachineInfo* machine_info)
     : CompilerPass() {
   // Initialize register sets.
@@ -76,6 +83,10 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
   // optimized with some intra-block analysis (dominators/etc).
   // Really, it'd just be nice to have someone who knew what they
   // were doing lower SSA and do this right.
+  // With extended_block_register_allocation a run of blocks where every block
+  // after the first has no labels (and so can only be entered by falling
+  // through) is treated as a single region: the allocation state carries over
+  // and values defined earlier in the run may be used later in it.
 
   uint16_t block_ordinal = 0;
   uint32_t instr_ordinal = 0;
@@ -84,19 +95,25 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
     // Sequential block ordinals.
     block->ordinal = block_ordinal++;
 
-    // Reset all state.
-    PrepareBlockState();
-
-    // Renumber all instructions in the block. This is required so that
-    // we can sort the usage pointers below.
-    auto instr = block->instr_head;
-    while (instr) {
-      // Sequential global instruction ordinals.
-      instr->ordinal = instr_ordinal++;
-      instr = instr->next;
+    if (!IsExtendedBlockContinuation(block)) {
+      // Reset all state.
+      PrepareBlockState();
+
+      // Renumber all instructions in the region. This is required so that
+      // we can sort the usage pointers below.
+      auto region_block = block;
+      do {
+        auto instr = region_block->instr_head;
+        while (instr) {
+          // Sequential global instruction ordinals.
+          instr->ordinal = instr_ordinal++;
+          instr = instr->next;
+        }
+        region_block = region_block->next;
+      } while (region_block && IsExtendedBlockContinuation(region_block));
     }
 
-    instr = block->instr_head;
+    auto instr = block->instr_head;
     while (instr) {
       const auto info = instr->opcode;
       uint32_t signature = info->signature;
@@ -195,6 +212,12 @@ void RegisterAllocationPass::DumpUsage(const char* name) {
 #endif
 }
 
+bool RegisterAllocationPass::IsExtendedBlockContinuation(
+    const hir::Block* block) {
+  return cvars::extended_block_register_allocation && block->prev &&
+         !block->label_head;
+}
+
 void RegisterAllocationPass::PrepareBlockState() {
   for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
     auto usage_set = usage_sets_.all_sets[i];
@@ -247,8 +270,10 @@ void RegisterAllocationPass::AdvanceUses(Instr* instr) {
         // Remove the iterator.
         auto value = upcoming_use.value;
         upcoming_uses.erase(upcoming_uses.begin() + j);
-        assert_true(next_use->instr->block == instr->block);
-        assert_true(value->def->block == instr->block);
+        assert_true(next_use->instr->block == instr->block ||
+                    cvars::extended_block_register_allocation);
+        assert_true(value->def->block == instr->block ||
+                    cvars::extended_block_register_allocation);
         upcoming_uses.emplace_back(value, next_use);
         // i remains the same.
         continue;
@@ -350,8 +375,10 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   auto furthest_usage =
       std::max_element(usage_set->upcoming_uses.begin(),
                        usage_set->upcoming_uses.end(), &RegisterUsage::Compare);
-  assert_true(furthest_usage->value->def->block == block);
-  assert_true(furthest_usage->use->instr->block == block);
+  assert_true(furthest_usage->value->def->block == block ||
+              cvars::extended_block_register_allocation);
+  assert_true(furthest_usage->use->instr->block == block ||
+              cvars::extended_block_register_allocation);
   auto spill_value = furthest_usage->value;
   Value::Use* prev_use = furthest_usage->use->prev;
   Value::Use* next_use = furthest_usage->use;
@@ -28,6 +28,8 @@ class RegisterAllocationPass : public CompilerPass {
   explicit RegisterAllocationPass(const backend::MachineInfo* machine_info);
   ~RegisterAllocationPass() override;
 
+  const char* name() const override { return "RegisterAllocationPass"; }
+
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
@@ -52,6 +54,7 @@ class RegisterAllocationPass : public CompilerPass {
   };
 
   void DumpUsage(const char* name);
+  static bool IsExtendedBlockContinuation(const hir::Block* block);
   void PrepareBlockState();
   void AdvanceUses(hir::Instr* instr);
   bool IsRegInUse(const hir::RegAssignment& reg);
@@ -22,6 +22,8 @@ class SimplificationPass : public ConditionalGroupSubpass {
   SimplificationPass();
   ~SimplificationPass() override;
 
+  const char* name() const override { return "SimplificationPass"; }
+
   bool Run(hir::HIRBuilder* builder, bool& result) override;
 
  private:
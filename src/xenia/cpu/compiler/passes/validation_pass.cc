@@ -10,11 +10,14 @@
 #include "xenia/cpu/compiler/passes/validation_pass.h"
 
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/processor.h"
 
+DECLARE_bool(extended_block_register_allocation);
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -77,7 +80,10 @@ bool ValidationPass::ValidateInstruction(Block* block, Instr* instr) {
     assert_true(instr->dest->def == instr);
     auto use = instr->dest->use_head;
     while (use) {
-      assert_true(use->instr->block == block);
+      // Values may flow into fallthrough-only successors when extended block
+      // allocation is enabled.
+      assert_true(use->instr->block == block ||
+                  cvars::extended_block_register_allocation);
       use = use->next;
     }
   }
@@ -15,17 +15,6 @@
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/processor.h"
 
-#if XE_COMPILER_MSVC
-#pragma warning(push)
-#pragma warning(disable : 4244)
-#pragma warning(disable : 4267)
-#include <llvm/ADT/BitVector.h>
-#pragma warning(pop)
-#else
-#include <llvm/ADT/BitVector.h>
-#include <cmath>
-#endif  // XE_COMPILER_MSVC
-
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -34,115 +23,120 @@ namespace passes {
 // TODO(benvanik): remove when enums redefined.
 using namespace xe::cpu::hir;
 
+using xe::cpu::hir::Block;
 using xe::cpu::hir::HIRBuilder;
-using xe::cpu::hir::OpcodeInfo;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::TypeName;
 using xe::cpu::hir::Value;
 
 ValueReductionPass::ValueReductionPass() : CompilerPass() {}
 
 ValueReductionPass::~ValueReductionPass() {}
 
-void ValueReductionPass::ComputeLastUse(Value* value) {
-  // TODO(benvanik): compute during construction?
-  // Note that this list isn't sorted (unfortunately), so we have to scan
-  // them all.
-  uint32_t max_ordinal = 0;
-  Value::Use* last_use = nullptr;
-  auto use = value->use_head;
-  while (use) {
-    if (!last_use || use->instr->ordinal >= max_ordinal) {
-      last_use = use;
-      max_ordinal = use->instr->ordinal;
-    }
-    use = use->next;
-  }
-  value->last_use = last_use ? last_use->instr : nullptr;
-}
-
 bool ValueReductionPass::Run(HIRBuilder* builder) {
-  // Walk each block and reuse variable ordinals as much as possible.
-
-  llvm::BitVector ordinals(builder->max_value_ordinal());
-
+  // Performs integer operations only needed in the lower bits in the narrow
+  // type, as the lower bits of the result of these operations only depend on
+  // the lower bits of the operands:
+  //   v1.i64 = zero_extend v0.i32
+  //   v2.i64 = add v1.i64, 0x100000001
+  //   v3.i32 = truncate v2.i64
+  // becomes:
+  //   v1.i64 = zero_extend v0.i32 (may be dead code removed later)
+  //   v2.i64 = add v1.i64, 0x100000001 (may be dead code removed later)
+  //   v3.i32 = add v0.i32, 0x00000001
+  // Only done if all the operands are available in the narrow type without
+  // new instructions, so the instruction count never grows.
+  SCOPE_profile_cpu_f("cpu");
+
+  values_narrowed_ = 0;
   auto block = builder->first_block();
   while (block) {
-    // Reset used ordinals.
-    ordinals.reset();
-
-    // Renumber all instructions to make liveness tracking easier.
-    uint32_t instr_ordinal = 0;
-    auto instr = block->instr_head;
-    while (instr) {
-      instr->ordinal = instr_ordinal++;
-      instr = instr->next;
-    }
-
-    instr = block->instr_head;
-    while (instr) {
-      const OpcodeInfo* info = instr->opcode;
-      auto dest_type = GET_OPCODE_SIG_TYPE_DEST(info->signature);
-      auto src1_type = GET_OPCODE_SIG_TYPE_SRC1(info->signature);
-      auto src2_type = GET_OPCODE_SIG_TYPE_SRC2(info->signature);
-      auto src3_type = GET_OPCODE_SIG_TYPE_SRC3(info->signature);
-      if (src1_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src1.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src1.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
-      }
-      if (src2_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src2.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src2.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
-      }
-      if (src3_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src3.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src3.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
+    auto i = block->instr_head;
+    while (i) {
+      if (i->opcode == &OPCODE_TRUNCATE_info && NarrowTruncate(builder, i)) {
+        ++values_narrowed_;
       }
-      if (dest_type == OPCODE_SIG_TYPE_V) {
-        // Dest values are processed last, as they may be able to reuse a
-        // source value ordinal.
-        auto v = instr->dest;
-        // Find a lower ordinal.
-        for (auto n = 0u; n < ordinals.size(); n++) {
-          if (!ordinals.test(n)) {
-            ordinals.set(n);
-            v->ordinal = n;
-            break;
-          }
-        }
-      }
-
-      instr = instr->next;
+      i = i->next;
     }
-
     block = block->next;
   }
 
   return true;
 }
 
+Value* ValueReductionPass::GetNarrowSource(HIRBuilder* builder, Value* value,
+                                           Block* block, TypeName type) {
+  if (value->IsConstant()) {
+    Value* narrow_value = builder->CloneValue(value);
+    narrow_value->Truncate(type);
+    return narrow_value;
+  }
+  Instr* def = value->def;
+  while (def && def->opcode == &OPCODE_ASSIGN_info) {
+    def = def->src1.value->def;
+  }
+  if (!def || def->block != block) {
+    // Not keeping values alive across blocks.
+    return nullptr;
+  }
+  if (def->opcode != &OPCODE_ZERO_EXTEND_info &&
+      def->opcode != &OPCODE_SIGN_EXTEND_info) {
+    return nullptr;
+  }
+  Value* narrow_value = def->src1.value;
+  if (narrow_value->type != type) {
+    return nullptr;
+  }
+  return narrow_value;
+}
+
+bool ValueReductionPass::NarrowTruncate(HIRBuilder* builder, Instr* i) {
+  TypeName type = i->dest->type;
+  Instr* def = i->src1.value->def;
+  while (def && def->opcode == &OPCODE_ASSIGN_info) {
+    def = def->src1.value->def;
+  }
+  if (!def || !IsScalarIntegralType(def->dest->type) ||
+      (def->flags & ARITHMETIC_SATURATE)) {
+    return false;
+  }
+  bool is_binary;
+  switch (def->opcode->num) {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+      is_binary = true;
+      break;
+    case OPCODE_NOT:
+    case OPCODE_NEG:
+      is_binary = false;
+      break;
+    default:
+      return false;
+  }
+  Value* narrow_src1 =
+      GetNarrowSource(builder, def->src1.value, i->block, type);
+  if (!narrow_src1) {
+    return false;
+  }
+  Value* narrow_src2 = nullptr;
+  if (is_binary) {
+    narrow_src2 = GetNarrowSource(builder, def->src2.value, i->block, type);
+    if (!narrow_src2) {
+      return false;
+    }
+  }
+  i->Replace(def->opcode, def->flags);
+  i->set_src1(narrow_src1);
+  if (narrow_src2) {
+    i->set_src2(narrow_src2);
+  }
+  return true;
+}
+
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
@@ -17,15 +17,26 @@ namespace cpu {
 namespace compiler {
 namespace passes {
 
+// Narrows the integer operations truncated to smaller types.
 class ValueReductionPass : public CompilerPass {
  public:
   ValueReductionPass();
   ~ValueReductionPass() override;
 
+  const char* name() const override { return "ValueReductionPass"; }
+
   bool Run(hir::HIRBuilder* builder) override;
 
+  // Number of truncations replaced with narrow operations by the last Run.
+  uint32_t values_narrowed() const { return values_narrowed_; }
+
  private:
-  void ComputeLastUse(hir::Value* value);
+  // The value in the narrow type without new instructions, or nullptr.
+  hir::Value* GetNarrowSource(hir::HIRBuilder* builder, hir::Value* value,
+                              hir::Block* block, hir::TypeName type);
+  bool NarrowTruncate(hir::HIRBuilder* builder, hir::Instr* i);
+
+  uint32_t values_narrowed_ = 0;
 };
 
 }  // namespace passes
@@ -47,6 +47,14 @@ DEFINE_int32(break_condition_gpr, -1, "GPR compared to", "CPU");
 DEFINE_uint64(break_condition_value, 0, "value compared against", "CPU");
 DEFINE_string(break_condition_op, "eq", "comparison operator", "CPU");
 DEFINE_bool(break_condition_truncate, true, "truncate value to 32-bits", "CPU");
+DEFINE_uint32(break_on_memory_write, 0,
+              "Guest address to report the writes to. Checked inline before "
+              "every store in the translated code, 0 to disable.",
+              "CPU");
+DEFINE_uint32(break_on_memory_write_length, 4,
+              "Length of the range starting at break_on_memory_write to report "
+              "the writes to.",
+              "CPU");
 
 DEFINE_bool(break_on_debugbreak, true, "int3 on JITed __debugbreak requests.",
             "CPU");
@@ -32,6 +32,8 @@ DECLARE_int32(break_condition_gpr);
 DECLARE_uint64(break_condition_value);
 DECLARE_string(break_condition_op);
 DECLARE_bool(break_condition_truncate);
+DECLARE_uint32(break_on_memory_write);
+DECLARE_uint32(break_on_memory_write_length);
 
 DECLARE_bool(break_on_debugbreak);
 
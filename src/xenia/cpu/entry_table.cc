@@ -9,32 +9,77 @@
 
 #include "xenia/cpu/entry_table.h"
 
+#include <chrono>
+#include <utility>
+
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
 
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+EntryTable::Table::Table(uint32_t capacity_log2)
+    : capacity_log2(capacity_log2),
+      mask((uint32_t(1) << capacity_log2) - 1),
+      slots(new std::atomic<Entry*>[size_t(1) << capacity_log2]) {
+  for (uint32_t i = 0; i <= mask; ++i) {
+    slots[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+EntryTable::EntryTable() {
+  deleted_entry_.address = 0;
+  deleted_entry_.end_address = 0;
+  deleted_entry_.status = Entry::STATUS_FAILED;
+  deleted_entry_.function = nullptr;
+  tables_.emplace_back(new Table(kInitialCapacityLog2));
+  table_.store(tables_.back().get(), std::memory_order_release);
+}
 
 EntryTable::~EntryTable() {
-  auto global_lock = global_critical_region_.Acquire();
-  for (auto it : map_.Values()) {
-    Entry* entry = it;
+  std::unique_lock<std::shared_mutex> table_lock(table_mutex_);
+  const Table& table = *table_.load(std::memory_order_relaxed);
+  for (uint32_t i = 0; i <= table.mask; ++i) {
+    Entry* entry = table.slots[i].load(std::memory_order_relaxed);
+    if (entry && entry != &deleted_entry_) {
+      delete entry;
+    }
+  }
+  std::lock_guard<std::mutex> deleted_entries_lock(deleted_entries_mutex_);
+  for (Entry* entry : deleted_entries_) {
     delete entry;
   }
 }
 
-Entry* EntryTable::Get(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  uint32_t idx = map_.IndexForKey(address);
-  if (idx == map_.size() || *map_.KeyAt(idx) != address) {
-    return nullptr;
+Entry* EntryTable::Find(const Table& table, uint32_t address) const {
+  uint32_t i = GetSlotIndex(table, address);
+  while (true) {
+    Entry* entry = table.slots[i].load(std::memory_order_acquire);
+    if (!entry) {
+      return nullptr;
+    }
+    if (entry != &deleted_entry_ && entry->address == address) {
+      return entry;
+    }
+    i = (i + 1) & table.mask;
+  }
+}
+
+void EntryTable::WaitWhileCompiling(Entry* entry) {
+  // If we aren't ready yet spin and wait. Lookups don't hold any lock, so this
+  // doesn't block other threads translating other functions.
+  while (entry->status.load(std::memory_order_acquire) ==
+         Entry::STATUS_COMPILING) {
+    // TODO(benvanik): sleep for less time?
+    xe::threading::Sleep(std::chrono::microseconds(10));
   }
-  Entry* entry = *map_.ValueAt(idx);
+}
+
+Entry* EntryTable::Get(uint32_t address) {
+  Entry* entry = Find(*table_.load(std::memory_order_acquire), address);
   if (entry) {
     // TODO(benvanik): wait if needed?
-    if (entry->status != Entry::STATUS_READY) {
+    if (entry->status.load(std::memory_order_acquire) != Entry::STATUS_READY) {
       entry = nullptr;
     }
   }
@@ -42,68 +87,162 @@ Entry* EntryTable::Get(uint32_t address) {
 }
 
 Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
-
-  auto global_lock = global_critical_region_.Acquire();
-
-  uint32_t idx = map_.IndexForKey(address);
-
-  Entry* entry = idx != map_.size() && *map_.KeyAt(idx) == address
-                     ? *map_.ValueAt(idx)
-                     : nullptr;
-  Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // chrispy: i think this is dead code, if we are compiling we're holding
-      // the global lock, arent we? so we wouldnt be executing here
-      // Still compiling, so spin.
-      do {
-        global_lock.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        global_lock.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
+  Entry* entry = Find(*table_.load(std::memory_order_acquire), address);
+  if (!entry) {
+    auto new_entry = std::make_unique<Entry>();
+    new_entry->address = address;
+    new_entry->end_address = 0;
+    new_entry->status.store(Entry::STATUS_COMPILING, std::memory_order_relaxed);
+    new_entry->function = nullptr;
+    bool created = false;
+    {
+      std::shared_lock<std::shared_mutex> table_lock(table_mutex_);
+      Table& table = *table_.load(std::memory_order_acquire);
+      uint32_t i = GetSlotIndex(table, address);
+      while (true) {
+        Entry* slot_entry = table.slots[i].load(std::memory_order_acquire);
+        if (!slot_entry) {
+          if (table.slots[i].compare_exchange_strong(
+                  slot_entry, new_entry.get(), std::memory_order_acq_rel,
+                  std::memory_order_acquire)) {
+            entry = new_entry.release();
+            created = true;
+            break;
+          }
+          // Another thread has taken the slot, possibly for the same address.
+        }
+        if (slot_entry != &deleted_entry_ && slot_entry->address == address) {
+          entry = slot_entry;
+          break;
+        }
+        i = (i + 1) & table.mask;
+      }
+      if (created) {
+        used_slot_count_.fetch_add(1, std::memory_order_relaxed);
+      }
     }
-    status = entry->status;
-  } else {
-    // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_.InsertAt(address, entry, idx);
-    // map_[address] = entry;
-    status = Entry::STATUS_NEW;
-  }
-  global_lock.unlock();
+    if (created) {
+      GrowIfNeeded();
+      *out_entry = entry;
+      return Entry::STATUS_NEW;
+    }
+  }
+  WaitWhileCompiling(entry);
   *out_entry = entry;
-  return status;
+  return entry->status.load(std::memory_order_acquire);
+}
+
+void EntryTable::GrowIfNeeded() {
+  // Keeping the load factor below 1/2 for short probe sequences. Concurrent
+  // creations may go slightly above that before growing, but never fill the
+  // table.
+  uint32_t capacity_log2 =
+      table_.load(std::memory_order_acquire)->capacity_log2;
+  if (used_slot_count_.load(std::memory_order_relaxed) <
+      (uint32_t(1) << (capacity_log2 - 1))) {
+    return;
+  }
+  std::unique_lock<std::shared_mutex> table_lock(table_mutex_);
+  const Table& old_table = *table_.load(std::memory_order_relaxed);
+  uint32_t used_slot_count = used_slot_count_.load(std::memory_order_relaxed);
+  if (used_slot_count < (uint32_t(1) << (old_table.capacity_log2 - 1))) {
+    // Already grown by another thread.
+    return;
+  }
+  // Not growing if most of the used slots are deleted entries, just dropping
+  // them.
+  uint32_t live_entry_count = 0;
+  for (uint32_t i = 0; i <= old_table.mask; ++i) {
+    Entry* entry = old_table.slots[i].load(std::memory_order_relaxed);
+    if (entry && entry != &deleted_entry_) {
+      ++live_entry_count;
+    }
+  }
+  uint32_t new_capacity_log2 = old_table.capacity_log2;
+  while (live_entry_count >= (uint32_t(1) << (new_capacity_log2 - 2))) {
+    ++new_capacity_log2;
+  }
+  auto new_table = std::make_unique<Table>(new_capacity_log2);
+  for (uint32_t i = 0; i <= old_table.mask; ++i) {
+    Entry* entry = old_table.slots[i].load(std::memory_order_relaxed);
+    if (!entry || entry == &deleted_entry_) {
+      continue;
+    }
+    uint32_t new_i = GetSlotIndex(*new_table, entry->address);
+    while (new_table->slots[new_i].load(std::memory_order_relaxed)) {
+      new_i = (new_i + 1) & new_table->mask;
+    }
+    new_table->slots[new_i].store(entry, std::memory_order_relaxed);
+  }
+  used_slot_count_.store(live_entry_count, std::memory_order_relaxed);
+  table_.store(new_table.get(), std::memory_order_release);
+  tables_.push_back(std::move(new_table));
 }
 
 void EntryTable::Delete(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  // doesnt this leak memory by not deleting the entry?
-  uint32_t idx = map_.IndexForKey(address);
-  if (idx != map_.size() && *map_.KeyAt(idx) == address) {
-    map_.EraseAt(idx);
+  Entry* deleted_entry = nullptr;
+  {
+    std::shared_lock<std::shared_mutex> table_lock(table_mutex_);
+    Table& table = *table_.load(std::memory_order_acquire);
+    uint32_t i = GetSlotIndex(table, address);
+    while (true) {
+      Entry* entry = table.slots[i].load(std::memory_order_acquire);
+      if (!entry) {
+        break;
+      }
+      if (entry != &deleted_entry_ && entry->address == address) {
+        if (table.slots[i].compare_exchange_strong(
+                entry, &deleted_entry_, std::memory_order_acq_rel)) {
+          deleted_entry = entry;
+        }
+        break;
+      }
+      i = (i + 1) & table.mask;
+    }
+  }
+  if (deleted_entry) {
+    // Other threads may still be using the entry.
+    std::lock_guard<std::mutex> deleted_entries_lock(deleted_entries_mutex_);
+    deleted_entries_.push_back(deleted_entry);
   }
 }
 
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
+  const Table& table = *table_.load(std::memory_order_acquire);
   std::vector<Function*> fns;
-  for (auto& it : map_.Values()) {
-    Entry* entry = it;
-    if (address >= entry->address && address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
-        fns.push_back(entry->function);
-      }
+  for (uint32_t i = 0; i <= table.mask; ++i) {
+    Entry* entry = table.slots[i].load(std::memory_order_acquire);
+    if (!entry || entry == &deleted_entry_) {
+      continue;
+    }
+    if (entry->status.load(std::memory_order_acquire) == Entry::STATUS_READY &&
+        address >= entry->address && address <= entry->end_address) {
+      fns.push_back(entry->function);
+    }
+  }
+  return fns;
+}
+
+std::vector<Function*> EntryTable::FindInRange(uint32_t address,
+                                               uint32_t length) {
+  std::vector<Function*> fns;
+  if (!length) {
+    return fns;
+  }
+  const Table& table = *table_.load(std::memory_order_acquire);
+  uint32_t last_address = address + (length - 1);
+  for (uint32_t i = 0; i <= table.mask; ++i) {
+    Entry* entry = table.slots[i].load(std::memory_order_acquire);
+    if (!entry || entry == &deleted_entry_) {
+      continue;
+    }
+    if (entry->status.load(std::memory_order_acquire) == Entry::STATUS_READY &&
+        entry->address <= last_address && entry->end_address >= address) {
+      fns.push_back(entry->function);
     }
   }
   return fns;
 }
+
 }  // namespace cpu
 }  // namespace xe
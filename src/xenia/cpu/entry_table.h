@@ -10,11 +10,13 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
-#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <vector>
 
-#include "xenia/base/mutex.h"
-#include "xenia/base/split_map.h"
 namespace xe {
 namespace cpu {
 
@@ -30,10 +32,16 @@ typedef struct Entry_t {
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
+  // The function and the end address are written before the transition to
+  // STATUS_READY, and may be read after observing it.
+  std::atomic<Status> status;
   Function* function;
 } Entry;
 
+// Open-addressing hash table of the entries. Lookups are lock-free, and
+// creation of new entries only excludes growing the table, not other lookups
+// or creations. Entries are never moved or freed until the table is destroyed,
+// so the pointers stay valid even after Delete.
 class EntryTable {
  public:
   EntryTable();
@@ -44,12 +52,42 @@ class EntryTable {
   void Delete(uint32_t address);
 
   std::vector<Function*> FindWithAddress(uint32_t address);
+  // Ready functions with code overlapping [address, address + length).
+  std::vector<Function*> FindInRange(uint32_t address, uint32_t length);
 
  private:
-  xe::global_critical_region global_critical_region_;
-  // TODO(benvanik): replace with a better data structure.
-  xe::split_map<uint32_t, Entry*> map_;
-  //std::unordered_map<uint32_t, Entry*> map_;
+  static constexpr uint32_t kInitialCapacityLog2 = 14;
+
+  struct Table {
+    explicit Table(uint32_t capacity_log2);
+    uint32_t capacity_log2;
+    uint32_t mask;
+    std::unique_ptr<std::atomic<Entry*>[]> slots;
+  };
+
+  // Fibonacci hashing of the address, which is usually 4-aligned.
+  static uint32_t GetSlotIndex(const Table& table, uint32_t address) {
+    return uint32_t((address >> 2) * UINT32_C(0x9E3779B9)) >>
+           (32 - table.capacity_log2);
+  }
+  Entry* Find(const Table& table, uint32_t address) const;
+  static void WaitWhileCompiling(Entry* entry);
+  void GrowIfNeeded();
+
+  // Placed in the slots of the deleted entries. Lookups must probe past it.
+  Entry deleted_entry_;
+
+  std::atomic<Table*> table_;
+  // Shared for modifying the slots of the current table, exclusive for
+  // replacing it with a larger one.
+  std::shared_mutex table_mutex_;
+  // Including the deleted entries, updated with the table mutex locked.
+  std::atomic<uint32_t> used_slot_count_{0};
+  // The current and the replaced tables, the latter are kept until the
+  // destruction since lock-free lookups may still be reading them.
+  std::vector<std::unique_ptr<Table>> tables_;
+  std::mutex deleted_entries_mutex_;
+  std::vector<Entry*> deleted_entries_;
 };
 
 }  // namespace cpu
@@ -42,7 +42,7 @@ struct ExportTag {
   using type = uint32_t;
 
   // packed like so:
-  // ll...... cccccccc ........ ..bihssi
+  // ll...... cccccccc ........ lvbihssi
 
   static constexpr int CategoryShift = 16;
 
@@ -59,6 +59,10 @@ struct ExportTag {
   // Export blocks the calling thread
   static constexpr type kBlocking = 1u << 5;
   static constexpr type kIsVariable = 1u << 6;
+  // Export returns quickly without blocking and never runs guest code, so it
+  // can be called through a thunk preserving only what the generated code may
+  // keep in the volatile host registers.
+  static constexpr type kLeaf = 1u << 7;
   // Export will be logged on each call.
   static constexpr type kLog = 1u << 30;
   // Export's result will be logged on each call.
@@ -78,7 +82,7 @@ class Export {
   };
   constexpr Export(uint16_t ordinal, Type type, const char* name,
                    ExportTag::type tags = 0)
-      : function_data({nullptr}),
+      : function_data({nullptr, nullptr}),
         name(name ? name : ""),
         tags(tags),
         ordinal(ordinal)
@@ -99,6 +103,10 @@ class Export {
       // Trampoline that is called from the guest-to-host thunk.
       // Expects only PPC context as first arg.
       ExportTrampoline trampoline;
+      // Trampoline only unmarshalling the arguments, without the logging and
+      // the telemetry, which may be selected as the trampoline for the
+      // frequently called exports, or null.
+      ExportTrampoline direct_trampoline;
     } function_data;
   };
   const char* const name;
@@ -9,6 +9,8 @@
 
 #include "xenia/cpu/function.h"
 
+#include <cstddef>
+
 #include "xenia/base/logging.h"
 #include "xenia/cpu/symbol.h"
 #include "xenia/cpu/thread_state.h"
@@ -16,6 +18,64 @@
 namespace xe {
 namespace cpu {
 
+void ContextWriteSummary::AddWrite(size_t offset, size_t length) {
+  size_t end = offset + length;
+  size_t gpr_offset = offsetof(ppc::PPCContext, r);
+  size_t fpr_offset = offsetof(ppc::PPCContext, f);
+  size_t vr_offset = offsetof(ppc::PPCContext, v);
+  if (offset >= gpr_offset && end <= gpr_offset + sizeof(uint64_t) * 32) {
+    for (size_t i = (offset - gpr_offset) / sizeof(uint64_t);
+         i * sizeof(uint64_t) < end - gpr_offset; ++i) {
+      gpr_mask |= uint32_t(1) << i;
+    }
+  } else if (offset >= fpr_offset &&
+             end <= fpr_offset + sizeof(double) * 32) {
+    for (size_t i = (offset - fpr_offset) / sizeof(double);
+         i * sizeof(double) < end - fpr_offset; ++i) {
+      fpr_mask |= uint32_t(1) << i;
+    }
+  } else if (offset >= vr_offset && end <= vr_offset + sizeof(vec128_t) * 128) {
+    for (size_t i = (offset - vr_offset) / sizeof(vec128_t);
+         i * sizeof(vec128_t) < end - vr_offset; ++i) {
+      vr_mask[i >> 6] |= uint64_t(1) << (i & 63);
+    }
+  } else {
+    other_written = true;
+  }
+}
+
+void ContextWriteSummary::Add(const ContextWriteSummary& other) {
+  gpr_mask |= other.gpr_mask;
+  fpr_mask |= other.fpr_mask;
+  vr_mask[0] |= other.vr_mask[0];
+  vr_mask[1] |= other.vr_mask[1];
+  other_written |= other.other_written;
+}
+
+bool ContextWriteSummary::MayWrite(size_t offset) const {
+  size_t gpr_offset = offsetof(ppc::PPCContext, r);
+  size_t fpr_offset = offsetof(ppc::PPCContext, f);
+  size_t vr_offset = offsetof(ppc::PPCContext, v);
+  if (offset >= gpr_offset && offset < gpr_offset + sizeof(uint64_t) * 32) {
+    return (gpr_mask >> ((offset - gpr_offset) / sizeof(uint64_t))) & 1;
+  }
+  if (offset >= fpr_offset && offset < fpr_offset + sizeof(double) * 32) {
+    return (fpr_mask >> ((offset - fpr_offset) / sizeof(double))) & 1;
+  }
+  if (offset >= vr_offset && offset < vr_offset + sizeof(vec128_t) * 128) {
+    size_t i = (offset - vr_offset) / sizeof(vec128_t);
+    return (vr_mask[i >> 6] >> (i & 63)) & 1;
+  }
+  return other_written;
+}
+
+bool ContextWriteSummary::Contains(const ContextWriteSummary& other) const {
+  return !(other.gpr_mask & ~gpr_mask) && !(other.fpr_mask & ~fpr_mask) &&
+         !(other.vr_mask[0] & ~vr_mask[0]) &&
+         !(other.vr_mask[1] & ~vr_mask[1]) &&
+         (other_written || !other.other_written);
+}
+
 Function::Function(Module* module, uint32_t address)
     : Symbol(Symbol::Type::kFunction, module, address) {}
 
@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_FUNCTION_H_
 #define XENIA_CPU_FUNCTION_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -33,6 +34,23 @@ struct SourceMapEntry {
 };
 enum class SaveRestoreType : uint8_t { NONE, GPR, VMX, FPR };
 
+// Parts of the guest context the translated code of a function, including the
+// functions it calls, may write, for keeping the known context values of the
+// callers across calls to it.
+struct ContextWriteSummary {
+  uint32_t gpr_mask = 0;
+  uint32_t fpr_mask = 0;
+  uint64_t vr_mask[2] = {};
+  // Anything outside the register arrays, such as the condition register.
+  bool other_written = false;
+
+  void AddWrite(size_t offset, size_t length);
+  void Add(const ContextWriteSummary& other);
+  // Whether the context value at the offset may be written.
+  bool MayWrite(size_t offset) const;
+  bool Contains(const ContextWriteSummary& other) const;
+};
+
 class Function : public Symbol {
  public:
   enum class Behavior : uint8_t {
@@ -119,6 +137,16 @@ class GuestFunction : public Function {
   typedef void (*ExternHandler)(ppc::PPCContext* ppc_context,
                                 kernel::KernelState* kernel_state);
 
+  // With tiered compilation, functions are first translated with a minimal
+  // pass list and retranslated with all optimizations once they've been
+  // called enough times.
+  enum class Tier : uint8_t {
+    kUntranslated,
+    kBaseline,
+    kOptimizing,
+    kOptimized,
+  };
+
   GuestFunction(Module* module, uint32_t address);
   ~GuestFunction() override;
 
@@ -137,6 +165,45 @@ class GuestFunction : public Function {
   FunctionTraceData& trace_data() { return trace_data_; }
   std::vector<SourceMapEntry>& source_map() { return source_map_; }
 
+  Tier tier() const { return tier_.load(std::memory_order_acquire); }
+  void set_tier(Tier tier) { tier_.store(tier, std::memory_order_release); }
+  // Returns true if the caller should do the retranslation of a baseline
+  // function, false if it's not baseline or another thread is already on it.
+  bool BeginTierUp() {
+    Tier expected = Tier::kBaseline;
+    return tier_.compare_exchange_strong(expected, Tier::kOptimizing,
+                                         std::memory_order_acq_rel);
+  }
+  // Decremented by baseline code on every call, tier-up is requested when it
+  // reaches zero.
+  int32_t* tier_up_countdown() { return &tier_up_countdown_; }
+  // Marks the function as needing another translation because something new
+  // has been learned about its code, like instructions accessing MMIO. Returns
+  // true if the caller should schedule it, false if it's already pending.
+  bool RequestRetranslation() {
+    return !retranslation_requested_.exchange(true, std::memory_order_acq_rel);
+  }
+  void ClearRetranslationRequest() {
+    retranslation_requested_.store(false, std::memory_order_release);
+  }
+
+  // Null if not translated yet, or if the function calls unknown code.
+  std::shared_ptr<const ContextWriteSummary> context_write_summary() const {
+    return std::atomic_load(&context_write_summary_);
+  }
+  void set_context_write_summary(
+      std::shared_ptr<const ContextWriteSummary> summary) {
+    std::atomic_store(&context_write_summary_, std::move(summary));
+  }
+  // Whether the summary has been relied upon when translating the callers, so
+  // they need to be translated again if it grows.
+  bool context_write_summary_used() const {
+    return context_write_summary_used_.load(std::memory_order_acquire);
+  }
+  void mark_context_write_summary_used() {
+    context_write_summary_used_.store(true, std::memory_order_release);
+  }
+
   ExternHandler extern_handler() const { return extern_handler_; }
   Export* export_data() const { return export_data_; }
   void SetupExtern(ExternHandler handler, Export* export_data = nullptr);
@@ -160,6 +227,11 @@ class GuestFunction : public Function {
   std::vector<SourceMapEntry> source_map_;
   ExternHandler extern_handler_ = nullptr;
   Export* export_data_ = nullptr;
+  std::atomic<Tier> tier_ = Tier::kUntranslated;
+  int32_t tier_up_countdown_ = 0;
+  std::atomic<bool> retranslation_requested_ = false;
+  std::shared_ptr<const ContextWriteSummary> context_write_summary_;
+  std::atomic<bool> context_write_summary_used_ = false;
 };
 
 }  // namespace cpu
@@ -47,8 +47,14 @@ namespace hir {
 #define ASSERT_TYPES_EQUAL(value1, value2) \
   assert_true((value1->type) == (value2->type))
 thread_local HIRBuilder* thrd_current_hirfunction = nullptr;
+// Smaller than the main arena chunks as there are three node arenas per
+// builder, still enough for the nodes of large functions.
+constexpr size_t kNodeArenaChunkSize = 1_MiB;
 HIRBuilder::HIRBuilder() {
   arena_ = new Arena();
+  instr_arena_ = new Arena(kNodeArenaChunkSize);
+  value_arena_ = new Arena(kNodeArenaChunkSize);
+  use_arena_ = new Arena(kNodeArenaChunkSize);
   Reset();
 }
 
@@ -63,6 +69,9 @@ void HIRBuilder::RemoveCurrent() {
 
 HIRBuilder::~HIRBuilder() {
   Reset();
+  delete use_arena_;
+  delete value_arena_;
+  delete instr_arena_;
   delete arena_;
   if (thrd_current_hirfunction == this) {
     thrd_current_hirfunction = nullptr;
@@ -78,8 +87,26 @@ void HIRBuilder::Reset() {
   current_block_ = NULL;
 #if SCRIBBLE_ARENA_ON_RESET
   arena_->DebugFill();
+  instr_arena_->DebugFill();
+  value_arena_->DebugFill();
+  use_arena_->DebugFill();
 #endif
   arena_->Reset();
+  instr_arena_->Reset();
+  value_arena_->Reset();
+  use_arena_->Reset();
+}
+
+size_t HIRBuilder::CalculateArenaSize() const {
+  return arena_->CalculateSize() + instr_arena_->CalculateSize() +
+         value_arena_->CalculateSize() + use_arena_->CalculateSize();
+}
+
+size_t HIRBuilder::arena_chunk_bytes_allocated() const {
+  return arena_->chunk_bytes_allocated() +
+         instr_arena_->chunk_bytes_allocated() +
+         value_arena_->chunk_bytes_allocated() +
+         use_arena_->chunk_bytes_allocated();
 }
 
 bool HIRBuilder::Finalize() {
@@ -122,7 +149,7 @@ Instr* HIRBuilder::AllocateInstruction() {
   if (result) {
     return result;
   }
-  return arena()->Alloc<Instr>();
+  return instr_arena_->Alloc<Instr>();
 }
 
 Value* HIRBuilder::AllocateValue() {
@@ -130,14 +157,14 @@ Value* HIRBuilder::AllocateValue() {
   if (result) {
     return result;
   }
-  return arena()->Alloc<Value>();
+  return value_arena_->Alloc<Value>();
 }
 Value::Use* HIRBuilder::AllocateUse() {
   Value::Use* result = free_uses_.NewEntry();
   if (result) {
     return result;
   }
-  return arena()->Alloc<Value::Use>();
+  return use_arena_->Alloc<Value::Use>();
 }
 void HIRBuilder::DeallocateInstruction(Instr* instr) {
   // free_instrs_.DeleteEntry(instr);
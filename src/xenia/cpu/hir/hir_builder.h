@@ -53,6 +53,10 @@ class HIRBuilder {
   void AssertNoCycles();
 
   Arena* arena() const { return arena_; }
+  // Bytes of all the HIR of the function, including the instructions, the
+  // values and the uses kept in their own arenas.
+  size_t CalculateArenaSize() const;
+  size_t arena_chunk_bytes_allocated() const;
 
   uint32_t attributes() const { return attributes_; }
   void set_attributes(uint32_t value) { attributes_ = value; }
@@ -315,6 +319,13 @@ class HIRBuilder {
 
  protected:
   Arena* arena_;
+  // The instructions, the values and the uses are each allocated contiguously
+  // rather than interleaved with each other and the rest of the HIR, so the
+  // passes walking the instruction lists or the use lists touch fewer cache
+  // lines.
+  Arena* instr_arena_;
+  Arena* value_arena_;
+  Arena* use_arena_;
 
   uint32_t attributes_;
 
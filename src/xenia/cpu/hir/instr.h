@@ -10,6 +10,8 @@
 #ifndef XENIA_CPU_HIR_INSTR_H_
 #define XENIA_CPU_HIR_INSTR_H_
 
+#include <cstddef>
+
 #include "xenia/cpu/hir/opcodes.h"
 #include "xenia/cpu/hir/value.h"
 
@@ -36,15 +38,6 @@ enum MovTunnel {
 
 class Instr {
  public:
-  Block* block;
-  Instr* next;
-  Instr* prev;
-
-  const OpcodeInfo* opcode;
-  uint16_t flags;
-  uint16_t backend_flags;  // backends may do whatever they wish with this
-  uint32_t ordinal;
-
   typedef union {
     Function* symbol;
     Label* label;
@@ -52,6 +45,12 @@ class Instr {
     uint64_t offset;
   } Op;
 
+  // The fields read by the passes walking the instruction lists come first,
+  // within 64 bytes, and the ones needed only when modifying the instruction
+  // after them, so walking the contiguously allocated instructions reads less
+  // memory.
+  const OpcodeInfo* opcode;
+  Instr* next;
   Value* dest;
   union {
     struct {
@@ -61,6 +60,12 @@ class Instr {
     };
     Op srcs[3];
   };
+  uint16_t flags;
+  uint16_t backend_flags;  // backends may do whatever they wish with this
+  uint32_t ordinal;
+  Instr* prev;
+
+  Block* block;
   union {
     struct {
       Value::Use* src1_use;
@@ -179,6 +184,9 @@ if both are constant, return nullptr, nullptr
 
   bool AllScalarIntegral();  // dest and all srcs are scalar integral
 };
+static_assert(offsetof(Instr, prev) + sizeof(Instr*) <= 64,
+              "The fields of Instr used for walking the instructions must fit "
+              "in 64 bytes");
 
 }  // namespace hir
 }  // namespace cpu
@@ -46,6 +46,13 @@ enum CacheControlType {
   CACHE_CONTROL_TYPE_DATA_STORE_AND_FLUSH,
 };
 
+// Trap codes of the checks emitted by the frontend rather than by the guest
+// trap instructions, which use the low codes.
+enum TrapCodes : uint16_t {
+  TRAP_BREAK_ON_INSTRUCTION = 0xFF00,
+  TRAP_BREAK_ON_MEMORY_WRITE = 0xFF01,
+};
+
 enum ArithmeticFlags {
   ARITHMETIC_UNSIGNED = (1 << 2),
   ARITHMETIC_SATURATE = (1 << 3),
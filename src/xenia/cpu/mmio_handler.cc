@@ -87,6 +87,7 @@ bool MMIOHandler::RegisterRange(uint32_t virtual_address, uint32_t mask,
       context,
       read_callback,
       write_callback,
+      nullptr,
   });
   return true;
 }
@@ -438,25 +439,14 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
     }
   }
   if (!range) {
-    // Recheck if the pages are still protected (race condition - another thread
-    // clears the watch we just hit).
-    // Do this under the lock so we don't introduce another race condition.
-    auto lock = global_critical_region_.Acquire();
-    memory::PageAccess cur_access;
-    size_t page_length = memory::page_size();
-    memory::QueryProtect(fault_host_address, page_length, cur_access);
-    if (cur_access != memory::PageAccess::kNoAccess &&
-        (!is_write || cur_access != memory::PageAccess::kReadOnly)) {
-      // Another thread has cleared this watch. Abort.
-      XELOGD("Race condition on watch, was already cleared by another thread!");
-      return true;
-    }
     // The address is not found within any range, so either a write watch or an
-    // actual access violation.
+    // actual access violation. The callback locks the global critical region
+    // if needed.
+    auto lock = global_critical_region_.AcquireDeferred();
     if (access_violation_callback_) {
-      return access_violation_callback_(std::move(lock),
-                                        access_violation_callback_context_,
-                                        fault_host_address, is_write);
+      return access_violation_callback_(
+          std::move(lock), access_violation_callback_context_,
+          fault_host_address, is_write, reinterpret_cast<void*>(ex->pc()));
     }
     return false;
   }
@@ -29,6 +29,8 @@ typedef uint32_t (*MMIOReadCallback)(void* ppc_context, void* callback_context,
                                      uint32_t addr);
 typedef void (*MMIOWriteCallback)(void* ppc_context, void* callback_context,
                                   uint32_t addr, uint32_t value);
+typedef uint64_t (*MMIORead64Callback)(void* ppc_context,
+                                       void* callback_context, uint32_t addr);
 typedef void (*MmioAccessRecordCallback)(void* context,
                                          void* host_insn_address);
 struct MMIORange {
@@ -38,6 +40,8 @@ struct MMIORange {
   void* callback_context;
   MMIOReadCallback read;
   MMIOWriteCallback write;
+  // Only for the inline read ranges, for the qword loads.
+  MMIORead64Callback read64;
 };
 
 // NOTE: only one can exist at a time!
@@ -48,12 +52,16 @@ class MMIOHandler {
   typedef uint32_t (*HostToGuestVirtual)(const void* context,
                                          const void* host_address);
   typedef bool (*AccessViolationCallback)(
-      global_unique_lock_type global_lock_locked_once, //not passed by reference with const like the others?
-      void* context, void* host_address, bool is_write);
-
-  // access_violation_callback is called with global_critical_region locked once
-  // on the thread, so if multiple threads trigger an access violation in the
-  // same page, the callback will be called only once.
+      global_unique_lock_type global_lock_deferred, void* context,
+      void* host_address, bool is_write, void* host_insn_address);
+
+  // access_violation_callback is called with a deferred lock of
+  // global_critical_region, not locked yet, so faults that don't need to be
+  // serialized can be handled concurrently. The callback must lock it before
+  // doing anything that may trigger invalidation callbacks, and then recheck
+  // whether the fault has already been handled by another thread, so even if
+  // multiple threads trigger an access violation in the same page, the
+  // callbacks will be called only once.
   static std::unique_ptr<MMIOHandler> Install(
       uint8_t* virtual_membase, uint8_t* physical_membase, uint8_t* membase_end,
       HostToGuestVirtual host_to_guest_virtual,
@@ -79,6 +79,10 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
       } else {
         f.Branch(label, branch_flags);
       }
+    } else if (!cond && f.TryInlineSaveRestoreHelper(nia_value, lk)) {
+      // Save/restore helper emitted in place.
+    } else if (lk && !cond && f.TryInlineCall(nia_value)) {
+      // Small leaf function emitted in place, continue after the bl.
     } else {
       // Call function.
       auto function = f.LookupFunction(nia_value);
@@ -87,7 +91,8 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
           cond = f.IsFalse(cond);
         }
         f.CallTrue(cond, function, call_flags);
-      } else {
+      } else if (!lk || !(f.TryEmitCriticalSectionCall(function, call_flags) ||
+                          f.TryEmitDirectImportCall(function))) {
         f.Call(function, call_flags);
       }
     }
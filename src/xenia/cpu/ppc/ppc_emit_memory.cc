@@ -13,6 +13,7 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
 #include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/ppc/ppc_hir_builder.h"
 
 DEFINE_bool(
@@ -28,6 +29,8 @@ DEFINE_bool(no_reserved_ops, false,
             "load/store impl",
             "CPU");
 
+DECLARE_bool(invalidate_written_code);
+
 namespace xe {
 namespace cpu {
 namespace ppc {
@@ -1181,8 +1184,13 @@ int InstrEmit_dcbz128(PPCHIRBuilder& f, const InstrData& i) {
 }
 
 int InstrEmit_icbi(PPCHIRBuilder& f, const InstrData& i) {
-  // XEINSTRNOTIMPLEMENTED();
-  f.Nop();
+  if (cvars::invalidate_written_code) {
+    // Any written translated code, not only the block, as the guest may
+    // invalidate just the lines it expects to be cached.
+    f.CallExtern(f.builtins()->flush_code_writes);
+  } else {
+    f.Nop();
+  }
   return 0;
 }
 
@@ -14,6 +14,7 @@
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_emit.h"
+#include "xenia/cpu/ppc/ppc_memory_loop.h"
 #include "xenia/cpu/ppc/ppc_opcode_info.h"
 #include "xenia/cpu/ppc/ppc_translator.h"
 #include "xenia/cpu/processor.h"
@@ -91,6 +92,10 @@ void SyscallHandler(PPCContext* ppc_context, void* arg0, void* arg1) {
   }
 }
 
+void FlushCodeWrites(PPCContext* ppc_context, void* arg0, void* arg1) {
+  reinterpret_cast<Processor*>(arg0)->FlushCodeWrites();
+}
+
 bool PPCFrontend::Initialize() {
   void* arg0 = reinterpret_cast<void*>(&xe::global_critical_region::mutex());
   void* arg1 = reinterpret_cast<void*>(&builtins_.global_lock_count);
@@ -102,6 +107,12 @@ bool PPCFrontend::Initialize() {
       processor_->DefineBuiltin("LeaveGlobalLock", LeaveGlobalLock, arg0, arg1);
   builtins_.syscall_handler = processor_->DefineBuiltin(
       "SyscallHandler", SyscallHandler, nullptr, nullptr);
+  builtins_.memory_loop_fast_path =
+      processor_->DefineBuiltin("MemoryLoopFastPath", MemoryLoopFastPath,
+                                reinterpret_cast<void*>(memory()), nullptr);
+  builtins_.flush_code_writes =
+      processor_->DefineBuiltin("FlushCodeWrites", FlushCodeWrites,
+                                reinterpret_cast<void*>(processor_), nullptr);
   return true;
 }
 
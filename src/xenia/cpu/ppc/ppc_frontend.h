@@ -34,6 +34,8 @@ struct PPCBuiltins {
   Function* enter_global_lock;
   Function* leave_global_lock;
   Function* syscall_handler;
+  Function* memory_loop_fast_path;
+  Function* flush_code_writes;
 };
 
 class PPCFrontend {
@@ -10,6 +10,7 @@
 #include "xenia/cpu/ppc/ppc_hir_builder.h"
 
 #include <stddef.h>
+#include <algorithm>
 #include <cstring>
 
 #include "third_party/fmt/include/fmt/format.h"
@@ -21,6 +22,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/base/string.h"
 #include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/hir/label.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
@@ -33,6 +35,37 @@ DEFINE_bool(
     "Break to the host debugger (or crash if no debugger attached) if an "
     "unimplemented PowerPC instruction is encountered.",
     "CPU");
+DEFINE_int32(inline_leaf_function_max_instructions, 0,
+             "Inlines direct calls to leaf functions of up to this many "
+             "instructions (not counting the blr) that don't touch the stack "
+             "pointer or control flow, such as getters and setters. 8 is a "
+             "reasonable value. Breakpoints in inlined functions are not hit "
+             "at the inlined copies. 0 to disable.",
+             "CPU");
+DEFINE_bool(inline_save_restore_helpers, true,
+            "Emits the bodies of the compiler's GPR and FPR save/restore "
+            "helpers (__savegprlr_*, __restgprlr_*, __savefpr_*, "
+            "__restfpr_*) in place of the calls and tail branches to them.",
+            "CPU");
+DEFINE_bool(memory_loop_fast_path, false,
+            "Executes guest loops that only copy or fill memory (like the "
+            "inner loops of memcpy and memset) on the host in one go when "
+            "the ranges are in plain virtual memory. Breakpoints inside such "
+            "loops are only hit when the guest code runs.",
+            "CPU");
+DEFINE_bool(inline_critical_sections, true,
+            "Emits the uncontended paths of RtlEnterCriticalSection, "
+            "RtlTryEnterCriticalSection and RtlLeaveCriticalSection directly "
+            "in the guest code instead of calling the kernel exports.",
+            "CPU");
+DEFINE_bool(direct_import_calls, true,
+            "Calls the host implementations of the imported kernel functions "
+            "directly from the call sites instead of through the import thunks "
+            "of the module. Breakpoints on the import thunks are not hit for "
+            "such calls.",
+            "CPU");
+
+DECLARE_bool(writable_code_segments);
 
 namespace xe {
 namespace cpu {
@@ -78,6 +111,8 @@ void PPCHIRBuilder::Reset() {
   instr_count_ = 0;
   instr_offset_list_ = NULL;
   label_list_ = NULL;
+  memory_loop_branch_address_ = 0;
+  memory_loop_body_label_ = nullptr;
   with_debug_info_ = false;
   HIRBuilder::Reset();
 }
@@ -113,6 +148,8 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   label_list_ = (Label**)arena_->Alloc(list_size, alignof(void*));
   std::memset(instr_offset_list_, 0, list_size);
   std::memset(label_list_, 0, list_size);
+  memory_loop_branch_address_ = 0;
+  memory_loop_body_label_ = nullptr;
 
   // Always mark entry with label.
   label_list_[0] = NewLabel();
@@ -127,6 +164,15 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
     auto opcode = LookupOpcode(code);
     auto& opcode_info = GetOpcodeInfo(opcode);
 
+    // Memory loops need a label at the head so that every branch into the
+    // loop goes through the fast path.
+    MemoryLoop memory_loop;
+    bool is_memory_loop = cvars::memory_loop_fast_path &&
+                          AnalyzeMemoryLoopAt(address, &memory_loop);
+    if (is_memory_loop && !label_list_[offset]) {
+      label_list_[offset] = NewLabel();
+    }
+
     // Mark label, if we were assigned one earlier on in the walk.
     // We may still get a label, but it'll be inserted by LookupLabel
     // as needed.
@@ -157,6 +203,10 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
     // Stash instruction offset. It's either the SOURCE_OFFSET or the COMMENT.
     instr_offset_list_[offset] = first_instr;
 
+    if (is_memory_loop) {
+      EmitMemoryLoopFastPath(memory_loop);
+    }
+
     if (opcode == PPCOpcode::kInvalid) {
       XELOGE("Invalid instruction {:08X} {:08X}", address, code);
       Comment("INVALID!");
@@ -174,6 +224,11 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
 
     MaybeBreakOnInstruction(address);
 
+    if (address == memory_loop_branch_address_) {
+      EmitMemoryLoopBranch();
+      continue;
+    }
+
     InstrData i;
     i.address = address;
     i.code = code;
@@ -220,29 +275,98 @@ void PPCHIRBuilder::MaybeBreakOnInstruction(uint32_t address) {
 
   auto op = cvars::break_condition_op.c_str();
   // TODO(rick): table?
+  // The comparison is done inline, and only the taken trap, on the cold path,
+  // calls the host.
+  Value* cond;
   if (xe_strcasecmp(op, "eq") == 0) {
-    TrapTrue(CompareEQ(left, right));
+    cond = CompareEQ(left, right);
   } else if (xe_strcasecmp(op, "ne") == 0) {
-    TrapTrue(CompareNE(left, right));
+    cond = CompareNE(left, right);
   } else if (xe_strcasecmp(op, "slt") == 0) {
-    TrapTrue(CompareSLT(left, right));
+    cond = CompareSLT(left, right);
   } else if (xe_strcasecmp(op, "sle") == 0) {
-    TrapTrue(CompareSLE(left, right));
+    cond = CompareSLE(left, right);
   } else if (xe_strcasecmp(op, "sgt") == 0) {
-    TrapTrue(CompareSGT(left, right));
+    cond = CompareSGT(left, right);
   } else if (xe_strcasecmp(op, "sge") == 0) {
-    TrapTrue(CompareSGE(left, right));
+    cond = CompareSGE(left, right);
   } else if (xe_strcasecmp(op, "ult") == 0) {
-    TrapTrue(CompareULT(left, right));
+    cond = CompareULT(left, right);
   } else if (xe_strcasecmp(op, "ule") == 0) {
-    TrapTrue(CompareULE(left, right));
+    cond = CompareULE(left, right);
   } else if (xe_strcasecmp(op, "ugt") == 0) {
-    TrapTrue(CompareUGT(left, right));
+    cond = CompareUGT(left, right);
   } else if (xe_strcasecmp(op, "uge") == 0) {
-    TrapTrue(CompareUGE(left, right));
+    cond = CompareUGE(left, right);
   } else {
     assert_always();
+    return;
+  }
+  TrapTrue(cond, TRAP_BREAK_ON_INSTRUCTION);
+}
+
+void PPCHIRBuilder::MaybeBreakOnMemoryWrite(Value* address, uint32_t size) {
+  uint32_t length = cvars::break_on_memory_write_length;
+  if (!cvars::break_on_memory_write || !length || !size) {
+    return;
+  }
+  if (address->type != INT32_TYPE) {
+    address = Truncate(address, INT32_TYPE);
+  }
+  // The store overlaps the range if its first byte is within the range
+  // extended by the size of the store minus 1 before it - a subtraction and a
+  // single unsigned comparison.
+  Value* relative_address = Sub(
+      address, LoadConstantUint32(cvars::break_on_memory_write - (size - 1)));
+  TrapTrue(CompareULT(relative_address, LoadConstantUint32(length + size - 1)),
+           TRAP_BREAK_ON_MEMORY_WRITE);
+}
+
+void PPCHIRBuilder::StoreOffset(Value* address, Value* offset, Value* value,
+                                uint32_t store_flags) {
+  if (cvars::break_on_memory_write) {
+    MaybeBreakOnMemoryWrite(Add(address, offset),
+                            uint32_t(GetTypeSize(value->type)));
+  }
+  HIRBuilder::StoreOffset(address, offset, value, store_flags);
+}
+
+Value* PPCHIRBuilder::StoreWithReserve(Value* address, Value* value,
+                                       TypeName type) {
+  MaybeBreakOnMemoryWrite(address, uint32_t(GetTypeSize(type)));
+  return HIRBuilder::StoreWithReserve(address, value, type);
+}
+
+void PPCHIRBuilder::StoreVectorLeft(Value* address, Value* value) {
+  // Writes from the address to the end of its 16-byte block - checking the
+  // whole block.
+  if (cvars::break_on_memory_write) {
+    MaybeBreakOnMemoryWrite(And(address, LoadConstantUint64(~uint64_t(15))),
+                            16);
+  }
+  HIRBuilder::StoreVectorLeft(address, value);
+}
+
+void PPCHIRBuilder::StoreVectorRight(Value* address, Value* value) {
+  // Writes from the start of the 16-byte block of the address to it - checking
+  // the whole block.
+  if (cvars::break_on_memory_write) {
+    MaybeBreakOnMemoryWrite(And(address, LoadConstantUint64(~uint64_t(15))),
+                            16);
   }
+  HIRBuilder::StoreVectorRight(address, value);
+}
+
+void PPCHIRBuilder::Store(Value* address, Value* value, uint32_t store_flags) {
+  MaybeBreakOnMemoryWrite(address, uint32_t(GetTypeSize(value->type)));
+  HIRBuilder::Store(address, value, store_flags);
+}
+
+void PPCHIRBuilder::Memset(Value* address, Value* value, Value* length) {
+  // Only used with the constant cache line sizes.
+  MaybeBreakOnMemoryWrite(address,
+                          length->IsConstant() ? length->AsUint32() : 128);
+  HIRBuilder::Memset(address, value, length);
 }
 
 void PPCHIRBuilder::AnnotateLabel(uint32_t address, Label* label) {
@@ -256,7 +380,286 @@ void PPCHIRBuilder::AnnotateLabel(uint32_t address, Label* label) {
 }
 
 Function* PPCHIRBuilder::LookupFunction(uint32_t address) {
-  return frontend_->processor()->LookupFunction(address);
+  auto processor = frontend_->processor();
+  Function* function = processor->LookupFunction(address);
+  // Direct callees are likely to be needed soon, get them translated in the
+  // background while the guest is still busy with the caller.
+  if (function && function->is_guest() &&
+      function->status() == Symbol::Status::kDeclared) {
+    processor->QueueFunctionTranslation(address);
+  }
+  return function;
+}
+
+bool PPCHIRBuilder::TryInlineCall(uint32_t address) {
+  int32_t max_instructions = cvars::inline_leaf_function_max_instructions;
+  // The inlined copy would go stale if the code could be modified. Debugging
+  // and tracing expect the callee to be a separate function with its own
+  // source map and counters.
+  if (max_instructions <= 0 || cvars::writable_code_segments ||
+      with_debug_info_) {
+    return false;
+  }
+  max_instructions = std::min(max_instructions, int32_t(kMaxInlinedInstructions));
+  // Special functions (externs, save/restore helpers) are handled elsewhere.
+  auto processor = frontend_->processor();
+  Function* function = processor->LookupFunction(address);
+  if (!function || !function->is_guest() ||
+      function->behavior() != Function::Behavior::kDefault ||
+      static_cast<GuestFunction*>(function)->extern_handler() ||
+      !function->module()->ContainsAddress(address)) {
+    return false;
+  }
+
+  // Only straight-line code ending with a blr. bl has already set LR to the
+  // return address, so reading it in the callee gives the same result, but the
+  // callee must not change it or use any other control flow. Anything touching
+  // r1 is rejected as well, so the guest stack pointer is the same as it would
+  // be around a real call and host/guest stack synchronization is unaffected.
+  uint32_t codes[kMaxInlinedInstructions];
+  int32_t instruction_count = -1;
+  for (int32_t n = 0; n <= max_instructions; ++n) {
+    uint32_t code = xe::load_and_swap<uint32_t>(
+        frontend_->memory()->TranslateVirtual(address + n * 4));
+    if (code == 0x4E800020) {
+      instruction_count = n;
+      break;
+    }
+    if (n == max_instructions) {
+      break;
+    }
+    auto opcode = LookupOpcode(code);
+    if (opcode == PPCOpcode::kInvalid) {
+      return false;
+    }
+    auto& opcode_info = GetOpcodeInfo(opcode);
+    if (!opcode_info.emit || opcode_info.type == PPCOpcodeType::kSync ||
+        opcode_info.group == PPCOpcodeGroup::kB ||
+        opcode_info.group == PPCOpcodeGroup::kC) {
+      return false;
+    }
+    if (((code >> 21) & 0x1F) == 1 || ((code >> 16) & 0x1F) == 1) {
+      return false;
+    }
+    codes[n] = code;
+  }
+  if (instruction_count < 0) {
+    return false;
+  }
+
+  EmitInlinedInstructions(address, codes, uint32_t(instruction_count));
+  return true;
+}
+
+bool PPCHIRBuilder::TryInlineSaveRestoreHelper(uint32_t address, bool lk) {
+  if (!cvars::inline_save_restore_helpers || cvars::writable_code_segments) {
+    return false;
+  }
+  auto processor = frontend_->processor();
+  Function* function = processor->LookupFunction(address);
+  if (!function || !function->is_guest() ||
+      (function->SaverestType() != SaveRestoreType::GPR &&
+       function->SaverestType() != SaveRestoreType::FPR) ||
+      !function->module()->ContainsAddress(address)) {
+    return false;
+  }
+
+  // The helpers are runs of stores or loads relative to r1 or r12 sharing the
+  // same tail, entered in the middle, ending with a blr, with __restgprlr also
+  // reloading LR. They don't modify r1, so emitting them in place is the same
+  // as calling them, other than breakpoints in them not being hit.
+  uint32_t codes[kMaxInlinedHelperInstructions];
+  uint32_t instruction_count = 0;
+  for (;;) {
+    if (instruction_count >= kMaxInlinedHelperInstructions) {
+      return false;
+    }
+    uint32_t code = xe::load_and_swap<uint32_t>(
+        frontend_->memory()->TranslateVirtual(address + instruction_count * 4));
+    if (code == 0x4E800020) {
+      break;
+    }
+    auto opcode = LookupOpcode(code);
+    if (opcode == PPCOpcode::kInvalid) {
+      return false;
+    }
+    auto& opcode_info = GetOpcodeInfo(opcode);
+    if (!opcode_info.emit || (opcode_info.group != PPCOpcodeGroup::kM &&
+                              opcode != PPCOpcode::mtspr)) {
+      return false;
+    }
+    codes[instruction_count++] = code;
+  }
+
+  if (with_debug_info_) {
+    CommentFormat("inlined {}", function->name());
+  }
+  EmitInlinedInstructions(address, codes, instruction_count);
+  if (!lk) {
+    // Reached with a tail branch (normally to __restgprlr), so the blr
+    // returns from the function being translated. bl, on the other hand, has
+    // already set LR to the instruction after it, where translation continues.
+    uint32_t blr_code = 0x4E800020;
+    EmitInlinedInstructions(address + instruction_count * 4, &blr_code, 1);
+  }
+  return true;
+}
+
+void PPCHIRBuilder::EmitInlinedInstructions(uint32_t address,
+                                            const uint32_t* codes,
+                                            uint32_t count) {
+  // No SourceOffset, the code is attributed to the call site, as the source map
+  // and the coverage counters only cover the addresses of the function being
+  // translated.
+  for (uint32_t n = 0; n < count; ++n) {
+    uint32_t instruction_address = address + n * 4;
+    MaybeBreakOnInstruction(instruction_address);
+    InstrData i;
+    i.address = instruction_address;
+    i.code = codes[n];
+    i.opcode = LookupOpcode(codes[n]);
+    i.opcode_info = &GetOpcodeInfo(i.opcode);
+    ++opcode_translation_counts[static_cast<int>(i.opcode)];
+    if (i.opcode_info->emit(*this, i)) {
+      XELOGE("Unimplemented instr {:08X} {:08X} in inlined function",
+             instruction_address, codes[n]);
+      Comment("UNIMPLEMENTED!");
+    }
+  }
+}
+
+bool PPCHIRBuilder::TryEmitCriticalSectionCall(Function* function,
+                                               uint32_t call_flags) {
+  if (!cvars::inline_critical_sections || !function || !function->is_guest()) {
+    return false;
+  }
+  auto guest_function = static_cast<GuestFunction*>(function);
+  const Export* export_data = guest_function->export_data();
+  if (function->behavior() != Function::Behavior::kExtern || !export_data ||
+      !guest_function->extern_handler()) {
+    return false;
+  }
+  enum class Kind { kEnter, kTryEnter, kLeave } kind;
+  if (!std::strcmp(export_data->name, "RtlEnterCriticalSection")) {
+    kind = Kind::kEnter;
+  } else if (!std::strcmp(export_data->name, "RtlTryEnterCriticalSection")) {
+    kind = Kind::kTryEnter;
+  } else if (!std::strcmp(export_data->name, "RtlLeaveCriticalSection")) {
+    kind = Kind::kLeave;
+  } else {
+    return false;
+  }
+
+  if (with_debug_info_) {
+    CommentFormat("inlined {}", export_data->name);
+  }
+  // X_RTL_CRITICAL_SECTION: the lock count is -1 when the section is free and
+  // is only touched atomically by the kernel, so -1 and 0 are the same in both
+  // byte orders. The recursion count and the owning thread are big-endian.
+  // Recursion, contention and waking waiters (including the spinning
+  // requested by the spin count in the header) are left to the export.
+  constexpr uint64_t kLockCountOffset = 0x10;
+  constexpr uint64_t kRecursionCountOffset = 0x14;
+  constexpr uint64_t kOwningThreadOffset = 0x18;
+  // X_KPCR::current_thread, r13 is the PCR.
+  constexpr uint64_t kPcrCurrentThreadOffset = 0x100;
+
+  Label* slow_label = NewLabel();
+  Label* done_label = NewLabel();
+  Value* cs = LoadGPR(3);
+  BranchFalse(cs, slow_label);
+  Value* lock_count_address = Add(cs, LoadConstantUint64(kLockCountOffset));
+  Value* recursion_count_address =
+      Add(cs, LoadConstantUint64(kRecursionCountOffset));
+  Value* owning_thread_address =
+      Add(cs, LoadConstantUint64(kOwningThreadOffset));
+  // Kept in the guest byte order, only copied.
+  Value* current_thread = Load(
+      Add(LoadGPR(13), LoadConstantUint64(kPcrCurrentThreadOffset)),
+      INT32_TYPE);
+  if (kind == Kind::kLeave) {
+    // Only the release of the outermost level.
+    Value* recursion_count =
+        ByteSwap(Load(recursion_count_address, INT32_TYPE));
+    BranchFalse(CompareEQ(recursion_count, LoadConstantInt32(1)), slow_label);
+    Store(recursion_count_address, LoadConstantInt32(0));
+    Store(owning_thread_address, LoadConstantInt32(0));
+    BranchTrue(AtomicCompareExchange(lock_count_address, LoadConstantInt32(0),
+                                     LoadConstantInt32(-1)),
+               done_label);
+    // There are waiters. Nobody else can take the section while the lock count
+    // is not -1, so restore the ownership and let the export wake one of them.
+    Store(owning_thread_address, current_thread);
+    Store(recursion_count_address, ByteSwap(LoadConstantInt32(1)));
+  } else {
+    BranchFalse(AtomicCompareExchange(lock_count_address, LoadConstantInt32(-1),
+                                      LoadConstantInt32(0)),
+                slow_label);
+    Store(owning_thread_address, current_thread);
+    Store(recursion_count_address, ByteSwap(LoadConstantInt32(1)));
+    if (kind == Kind::kTryEnter) {
+      StoreGPR(3, LoadConstantUint64(1));
+    }
+    Branch(done_label);
+  }
+  MarkLabel(slow_label);
+  if (!TryEmitDirectImportCall(function)) {
+    Call(function, call_flags);
+  }
+  MarkLabel(done_label);
+  return true;
+}
+
+bool PPCHIRBuilder::TryEmitDirectImportCall(Function* function) {
+  if (!cvars::direct_import_calls || !function || !function->is_guest() ||
+      function->behavior() != Function::Behavior::kExtern) {
+    return false;
+  }
+  // Imports without an implementation go through the thunk to report the
+  // undefined export.
+  if (!static_cast<GuestFunction*>(function)->extern_handler()) {
+    return false;
+  }
+  // The thunk is `sc 2` followed by `blr` to the return address already stored
+  // in LR by the caller, so this is the same as the call to it.
+  CallExtern(function);
+  return true;
+}
+
+bool PPCHIRBuilder::AnalyzeMemoryLoopAt(uint32_t address,
+                                        MemoryLoop* out_loop) {
+  // The host implementation decodes the loop again when it runs.
+  if (cvars::writable_code_segments ||
+      !AnalyzeMemoryLoop(frontend_->memory(), address,
+                         function_->end_address(), out_loop)) {
+    return false;
+  }
+  // Execution continues after the loop, which must be in this function.
+  return out_loop->branch_address + 4 <= function_->end_address();
+}
+
+void PPCHIRBuilder::EmitMemoryLoopFastPath(const MemoryLoop& loop) {
+  if (with_debug_info_) {
+    CommentFormat("memory loop fast path {:08X}-{:08X}", loop.head_address,
+                  loop.branch_address);
+  }
+  StoreContext(offsetof(PPCContext, scratch),
+               LoadConstantUint64(loop.head_address));
+  CallExtern(builtins()->memory_loop_fast_path);
+  BranchTrue(LoadContext(offsetof(PPCContext, scratch), INT64_TYPE),
+             LookupLabel(loop.branch_address + 4));
+  memory_loop_branch_address_ = loop.branch_address;
+  memory_loop_body_label_ = NewLabel();
+  MarkLabel(memory_loop_body_label_);
+}
+
+void PPCHIRBuilder::EmitMemoryLoopBranch() {
+  // Same as bdnz in InstrEmit_bcx.
+  Value* ctr = Sub(LoadCTR(), LoadConstantUint64(1));
+  StoreCTR(ctr);
+  BranchTrue(Truncate(ctr, INT32_TYPE), memory_loop_body_label_);
+  memory_loop_branch_address_ = 0;
+  memory_loop_body_label_ = nullptr;
 }
 
 Label* PPCHIRBuilder::LookupLabel(uint32_t address) {
@@ -13,6 +13,7 @@
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/ppc/ppc_memory_loop.h"
 
 namespace xe {
 namespace cpu {
@@ -42,6 +43,21 @@ class PPCHIRBuilder : public hir::HIRBuilder {
 
   GuestFunction* function() const { return function_; }
   Function* LookupFunction(uint32_t address);
+  // Emits the body of a small leaf function in place of a direct call to it,
+  // returns false if the function can't be inlined.
+  bool TryInlineCall(uint32_t address);
+  // Emits the body of a GPR or FPR save/restore helper in place of a bl to it
+  // (lk) or a tail branch to it (!lk, including the final blr), returns false
+  // if the address isn't one of the helpers.
+  bool TryInlineSaveRestoreHelper(uint32_t address, bool lk);
+  // Emits the uncontended path of a call to one of the critical section
+  // kernel exports in place, falling back to calling the export, returns false
+  // if the function isn't one of them.
+  bool TryEmitCriticalSectionCall(Function* function, uint32_t call_flags);
+  // Emits a call of the host implementation of an imported kernel function
+  // in place of a bl to its import thunk, returns false if the function isn't
+  // an implemented import.
+  bool TryEmitDirectImportCall(Function* function);
   Label* LookupLabel(uint32_t address);
 
   Value* LoadLR();
@@ -82,9 +98,34 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   Value* LoadReserved();
   //calls original impl in hirbuilder, but also records the is_return_site bit into flags in the guestmodule
   void SetReturnAddress(Value* value);
+  // Call the original implementations in HIRBuilder, but also check the
+  // break_on_memory_write range first.
+  void StoreOffset(Value* address, Value* offset, Value* value,
+                   uint32_t store_flags = 0);
+  Value* StoreWithReserve(Value* address, Value* value, hir::TypeName type);
+  void StoreVectorLeft(Value* address, Value* value);
+  void StoreVectorRight(Value* address, Value* value);
+  void Store(Value* address, Value* value, uint32_t store_flags = 0);
+  void Memset(Value* address, Value* value, Value* length);
  private:
+  static constexpr uint32_t kMaxInlinedInstructions = 32;
+  // The longest helper, __restgprlr_14, is 18 ld, lwz, mtlr before the blr.
+  static constexpr uint32_t kMaxInlinedHelperInstructions = 24;
+
   void MaybeBreakOnInstruction(uint32_t address);
+  // Traps if a store of the given size at the address overlaps the
+  // break_on_memory_write range.
+  void MaybeBreakOnMemoryWrite(Value* address, uint32_t size);
+  void EmitInlinedInstructions(uint32_t address, const uint32_t* codes,
+                               uint32_t count);
   void AnnotateLabel(uint32_t address, Label* label);
+  bool AnalyzeMemoryLoopAt(uint32_t address, MemoryLoop* out_loop);
+  // Emits the call to the host implementation of the loop, skipping it on
+  // success. Must be emitted at the loop head, after its label.
+  void EmitMemoryLoopFastPath(const MemoryLoop& loop);
+  // Emits the closing bdnz of the loop, which branches back past the fast path
+  // so it's not retried on every iteration once it has been declined.
+  void EmitMemoryLoopBranch();
 
   PPCFrontend* frontend_;
 
@@ -98,6 +139,8 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   uint64_t instr_count_;
   Instr** instr_offset_list_;
   Label** label_list_;
+  uint32_t memory_loop_branch_address_;
+  Label* memory_loop_body_label_;
 
   // Reset each instruction.
   struct {
@@ -0,0 +1,453 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/ppc/ppc_memory_loop.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/memory.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/ppc/ppc_instr.h"
+#include "xenia/cpu/ppc/ppc_opcode_info.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace cpu {
+namespace ppc {
+
+namespace {
+
+// Larger ranges are left to the guest code, so a single call can't stall the
+// thread for too long.
+constexpr uint64_t kMaxLength = 64 * 1024 * 1024;
+
+struct MemoryAccess {
+  bool is_store;
+  uint8_t base_reg;
+  // Register stored, or for dcbz the second operand (0 if none).
+  uint8_t value_reg;
+  uint32_t width;
+  int32_t offset;
+  // For copy stores, the load the stored value came from.
+  int32_t load_index;
+};
+
+bool IsBdnzTo(const InstrData& i, uint32_t target) {
+  // Decrement CTR, branch if CTR != 0, ignore the condition.
+  if (i.B.LK || i.B.AA || !(i.B.BO & 0b10000) || (i.B.BO & 0b00110)) {
+    return false;
+  }
+  return uint32_t(i.address + XEEXTS16(i.B.BD << 2)) == target;
+}
+
+// Checks that the accesses cover [offset, offset + stride) exactly once.
+bool CoversStride(const MemoryAccess* accesses, uint32_t count,
+                  uint32_t stride, int32_t* out_offset) {
+  std::pair<int32_t, uint32_t> ranges[MemoryLoop::kMaxInstructions];
+  for (uint32_t n = 0; n < count; ++n) {
+    ranges[n] = {accesses[n].offset, accesses[n].width};
+  }
+  std::sort(ranges, ranges + count);
+  int64_t next = ranges[0].first;
+  for (uint32_t n = 0; n < count; ++n) {
+    if (ranges[n].first != next) {
+      return false;
+    }
+    next += ranges[n].second;
+  }
+  if (next - ranges[0].first != stride) {
+    return false;
+  }
+  *out_offset = ranges[0].first;
+  return true;
+}
+
+// Ranges in anything but the plain virtual heaps are left to the guest code:
+// MMIO is only mapped outside of the heaps, and physical memory pages may be
+// watched by the GPU and other caches which must be notified of writes.
+bool IsPlainMemoryRange(Memory* memory, uint64_t address, uint64_t length) {
+  if (address + length > (UINT64_C(1) << 32)) {
+    return false;
+  }
+  const BaseHeap* heap = memory->LookupHeap(uint32_t(address));
+  if (!heap || heap->heap_type() == HeapType::kGuestPhysical ||
+      heap != memory->LookupHeap(uint32_t(address + length - 1))) {
+    return false;
+  }
+  return true;
+}
+
+uint64_t LoadGuestValue(const uint8_t* host_address, uint32_t width) {
+  switch (width) {
+    case 1:
+      return *host_address;
+    case 2:
+      return xe::load_and_swap<uint16_t>(host_address);
+    case 4:
+      return xe::load_and_swap<uint32_t>(host_address);
+    default:
+      return xe::load_and_swap<uint64_t>(host_address);
+  }
+}
+
+}  // namespace
+
+bool AnalyzeMemoryLoop(Memory* memory, uint32_t head_address,
+                       uint32_t limit_address, MemoryLoop* out_loop) {
+  MemoryLoop& loop = *out_loop;
+  std::memset(&loop, 0, sizeof(loop));
+  loop.head_address = head_address;
+
+  MemoryAccess accesses[MemoryLoop::kMaxInstructions];
+  uint32_t access_count = 0;
+  int32_t last_load[32];
+  std::fill(std::begin(last_load), std::end(last_load), -1);
+  uint32_t loaded_reg_mask = 0;
+  // Registers used to form addresses.
+  uint32_t address_reg_mask = 0;
+  bool closed = false;
+  for (uint32_t n = 0; n < MemoryLoop::kMaxInstructions; ++n) {
+    uint32_t address = head_address + n * 4;
+    if (address > limit_address) {
+      return false;
+    }
+    InstrData i;
+    i.address = address;
+    i.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    i.opcode = LookupOpcode(i.code);
+
+    bool is_store = false;
+    bool is_update = false;
+    uint32_t width = 0;
+    int32_t displacement = 0;
+    switch (i.opcode) {
+      case PPCOpcode::bcx:
+        if (!n || !IsBdnzTo(i, head_address)) {
+          return false;
+        }
+        loop.branch_address = address;
+        closed = true;
+        break;
+      case PPCOpcode::addi:
+        // Only pointer and counter increments, li would be a different value.
+        if (!i.D.RA || i.D.RT != i.D.RA) {
+          return false;
+        }
+        loop.reg_deltas[i.D.RA] += XEEXTS16(i.D.DS);
+        loop.advanced_reg_mask |= 1u << i.D.RA;
+        continue;
+      case PPCOpcode::lbzu:
+        is_update = true;
+        [[fallthrough]];
+      case PPCOpcode::lbz:
+        width = 1;
+        break;
+      case PPCOpcode::lhzu:
+        is_update = true;
+        [[fallthrough]];
+      case PPCOpcode::lhz:
+        width = 2;
+        break;
+      case PPCOpcode::lwzu:
+        is_update = true;
+        [[fallthrough]];
+      case PPCOpcode::lwz:
+        width = 4;
+        break;
+      case PPCOpcode::ldu:
+        is_update = true;
+        [[fallthrough]];
+      case PPCOpcode::ld:
+        width = 8;
+        break;
+      case PPCOpcode::stbu:
+        is_update = true;
+        [[fallthrough]];
+      case PPCOpcode::stb:
+        is_store = true;
+        width = 1;
+        break;
+      case PPCOpcode::sthu:
+        is_update = true;
+        [[fallthrough]];
+      case PPCOpcode::sth:
+        is_store = true;
+        width = 2;
+        break;
+      case PPCOpcode::stwu:
+        is_update = true;
+        [[fallthrough]];
+      case PPCOpcode::stw:
+        is_store = true;
+        width = 4;
+        break;
+      case PPCOpcode::stdu:
+        is_update = true;
+        [[fallthrough]];
+      case PPCOpcode::std:
+        is_store = true;
+        width = 8;
+        break;
+      case PPCOpcode::dcbz:
+        is_store = true;
+        width = 32;
+        break;
+      case PPCOpcode::dcbz128:
+        is_store = true;
+        width = 128;
+        break;
+      default:
+        return false;
+    }
+    if (closed) {
+      break;
+    }
+    if (access_count >= MemoryLoop::kMaxInstructions) {
+      return false;
+    }
+
+    MemoryAccess& access = accesses[access_count];
+    access.is_store = is_store;
+    access.width = width;
+    access.load_index = -1;
+    if (width >= 32) {
+      // dcbz: EA = (RA|0) + RB, one of them is the pointer.
+      uint32_t ra = i.X.RA, rb = i.X.RB;
+      if (ra && (loop.advanced_reg_mask & (1u << ra))) {
+        // r0 as RB is the register, not a zero operand.
+        if (!rb) {
+          return false;
+        }
+        std::swap(ra, rb);
+      }
+      access.base_reg = uint8_t(rb);
+      access.value_reg = uint8_t(ra);
+      access.offset = int32_t(loop.reg_deltas[rb]);
+      if (ra) {
+        address_reg_mask |= 1u << ra;
+      }
+    } else {
+      if (!i.D.RA) {
+        return false;
+      }
+      displacement = (i.opcode == PPCOpcode::ld || i.opcode == PPCOpcode::ldu ||
+                      i.opcode == PPCOpcode::std || i.opcode == PPCOpcode::stdu)
+                         ? int32_t(XEEXTS16(i.DS.DS << 2))
+                         : int32_t(XEEXTS16(i.D.DS));
+      access.base_reg = uint8_t(i.D.RA);
+      access.value_reg = uint8_t(i.D.RT);
+      access.offset = int32_t(loop.reg_deltas[i.D.RA]) + displacement;
+      if (is_update) {
+        if (i.D.RT == i.D.RA) {
+          return false;
+        }
+        loop.reg_deltas[i.D.RA] += displacement;
+        loop.advanced_reg_mask |= 1u << i.D.RA;
+      }
+      if (is_store) {
+        // Copies must store what has been loaded in the same iteration.
+        access.load_index = last_load[i.D.RT];
+      } else {
+        last_load[i.D.RT] = int32_t(access_count);
+        loaded_reg_mask |= 1u << i.D.RT;
+      }
+    }
+    address_reg_mask |= 1u << access.base_reg;
+    ++access_count;
+  }
+  if (!closed || !access_count) {
+    return false;
+  }
+
+  // Values in loaded registers only flow into stores, and pointers and counters
+  // are only changed by constant increments.
+  if (loaded_reg_mask & (loop.advanced_reg_mask | address_reg_mask)) {
+    return false;
+  }
+
+  MemoryAccess loads[MemoryLoop::kMaxInstructions];
+  MemoryAccess stores[MemoryLoop::kMaxInstructions];
+  uint32_t load_count = 0, store_count = 0;
+  for (uint32_t n = 0; n < access_count; ++n) {
+    const MemoryAccess& access = accesses[n];
+    if (access.is_store) {
+      stores[store_count++] = access;
+    } else {
+      loads[load_count++] = access;
+    }
+  }
+  if (!store_count) {
+    return false;
+  }
+
+  loop.dest_reg = stores[0].base_reg;
+  int64_t stride = loop.reg_deltas[loop.dest_reg];
+  if (stride <= 0 || stride > MemoryLoop::kMaxStride) {
+    return false;
+  }
+  loop.stride = uint32_t(stride);
+  for (uint32_t n = 0; n < store_count; ++n) {
+    if (stores[n].base_reg != loop.dest_reg) {
+      return false;
+    }
+  }
+  if (!CoversStride(stores, store_count, loop.stride, &loop.dest_offset)) {
+    return false;
+  }
+
+  if (load_count) {
+    loop.kind = MemoryLoop::Kind::kCopy;
+    loop.source_reg = loads[0].base_reg;
+    if (loop.source_reg == loop.dest_reg ||
+        loop.reg_deltas[loop.source_reg] != stride) {
+      return false;
+    }
+    for (uint32_t n = 0; n < load_count; ++n) {
+      if (loads[n].base_reg != loop.source_reg) {
+        return false;
+      }
+    }
+    if (!CoversStride(loads, load_count, loop.stride, &loop.source_offset)) {
+      return false;
+    }
+    // Every store must write what was read from the same position in the
+    // source range.
+    for (uint32_t n = 0; n < store_count; ++n) {
+      const MemoryAccess& store = stores[n];
+      if (store.width >= 32 || store.load_index < 0) {
+        return false;
+      }
+      const MemoryAccess& load = accesses[store.load_index];
+      if (load.width != store.width ||
+          store.offset - loop.dest_offset != load.offset - loop.source_offset) {
+        return false;
+      }
+    }
+    for (uint32_t reg = 0; reg < 32; ++reg) {
+      if (last_load[reg] >= 0) {
+        const MemoryAccess& load = accesses[last_load[reg]];
+        loop.loads[loop.load_count++] = {uint8_t(reg), uint8_t(load.width),
+                                         load.offset};
+      }
+    }
+  } else {
+    loop.kind = stores[0].width >= 32 ? MemoryLoop::Kind::kZero
+                                      : MemoryLoop::Kind::kFill;
+    loop.operand_reg = stores[0].value_reg;
+    loop.element_width = stores[0].width;
+    for (uint32_t n = 1; n < store_count; ++n) {
+      if (stores[n].width != loop.element_width ||
+          stores[n].value_reg != loop.operand_reg) {
+        return false;
+      }
+    }
+    if (loop.advanced_reg_mask & (1u << loop.operand_reg)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void MemoryLoopFastPath(PPCContext* ppc_context, void* arg0, void* arg1) {
+  auto memory = reinterpret_cast<Memory*>(arg0);
+  uint32_t head_address = uint32_t(ppc_context->scratch);
+  ppc_context->scratch = 0;
+
+  // The code has been checked when translating, but it's cheap enough to decode
+  // again here rather than keeping the results around.
+  MemoryLoop loop;
+  if (!AnalyzeMemoryLoop(memory, head_address,
+                         head_address + MemoryLoop::kMaxInstructions * 4,
+                         &loop)) {
+    return;
+  }
+
+  // bdnz only checks the low 32 bits of CTR.
+  uint32_t count = uint32_t(ppc_context->ctr);
+  uint64_t length = uint64_t(count) * loop.stride;
+  if (!count || length > kMaxLength) {
+    return;
+  }
+  uint64_t dest_address =
+      uint32_t(ppc_context->r[loop.dest_reg] + loop.dest_offset);
+  if (loop.kind == MemoryLoop::Kind::kZero) {
+    if (loop.operand_reg) {
+      dest_address = uint32_t(dest_address + ppc_context->r[loop.operand_reg]);
+    }
+    // dcbz aligns down, which is only contiguous with an aligned start.
+    if (dest_address & (loop.element_width - 1)) {
+      return;
+    }
+  }
+  if (!IsPlainMemoryRange(memory, dest_address, length)) {
+    return;
+  }
+  uint8_t* dest = memory->TranslateVirtual(uint32_t(dest_address));
+
+  switch (loop.kind) {
+    case MemoryLoop::Kind::kCopy: {
+      uint64_t source_address =
+          uint32_t(ppc_context->r[loop.source_reg] + loop.source_offset);
+      if (!IsPlainMemoryRange(memory, source_address, length) ||
+          (source_address < dest_address + length &&
+           dest_address < source_address + length)) {
+        return;
+      }
+      // Big-endian values are copied to big-endian memory, so this is a plain
+      // byte copy.
+      const uint8_t* source =
+          memory->TranslateVirtual(uint32_t(source_address));
+      std::memcpy(dest, source, size_t(length));
+      // Loaded registers keep the values from the last iteration.
+      const uint8_t* last_source = source + (length - loop.stride);
+      for (uint32_t n = 0; n < loop.load_count; ++n) {
+        const MemoryLoop::Load& load = loop.loads[n];
+        ppc_context->r[load.reg] = LoadGuestValue(
+            last_source + (load.offset - loop.source_offset), load.width);
+      }
+    } break;
+    case MemoryLoop::Kind::kFill: {
+      // Store the guest value once big-endian and repeat it, every store has
+      // the same width so the pattern is in phase with the start of the range.
+      uint8_t pattern[8];
+      uint64_t value = ppc_context->r[loop.operand_reg];
+      for (uint32_t n = 0; n < 8; ++n) {
+        uint32_t byte_index = loop.element_width - 1 - (n % loop.element_width);
+        pattern[n] = uint8_t(value >> (byte_index * 8));
+      }
+      if (std::all_of(pattern, pattern + 8,
+                      [&](uint8_t b) { return b == pattern[0]; })) {
+        std::memset(dest, pattern[0], size_t(length));
+      } else {
+        size_t offset = 0;
+        for (; offset + 8 <= length; offset += 8) {
+          std::memcpy(dest + offset, pattern, 8);
+        }
+        std::memcpy(dest + offset, pattern, size_t(length - offset));
+      }
+    } break;
+    case MemoryLoop::Kind::kZero:
+      std::memset(dest, 0, size_t(length));
+      break;
+  }
+
+  for (uint32_t reg = 0; reg < 32; ++reg) {
+    if (loop.advanced_reg_mask & (1u << reg)) {
+      ppc_context->r[reg] += uint64_t(loop.reg_deltas[reg]) * count;
+    }
+  }
+  ppc_context->ctr -= count;
+  ppc_context->scratch = 1;
+}
+
+}  // namespace ppc
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,99 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_PPC_PPC_MEMORY_LOOP_H_
+#define XENIA_CPU_PPC_PPC_MEMORY_LOOP_H_
+
+#include <cstdint>
+
+#include "xenia/cpu/ppc/ppc_context.h"
+
+namespace xe {
+class Memory;
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace ppc {
+
+// A guest loop ending with a bdnz back to its head whose body does nothing but
+// copy or fill a contiguous range of memory and advance the pointers, like the
+// inner loops of the memcpy/memset implementations linked into titles:
+//   loop: ld r9, 0(r4)      loop: stw r0, 0(r3)    loop: dcbz128 0, r3
+//         addi r4, r4, 8          addi r3, r3, 4         addi r3, r3, 128
+//         std r9, 0(r3)           bdnz loop              bdnz loop
+//         addi r3, r3, 8
+//         bdnz loop
+// Unrolled bodies with several accesses per iteration are accepted as long as
+// every iteration covers exactly one stride of memory.
+struct MemoryLoop {
+  static constexpr uint32_t kMaxInstructions = 16;
+  static constexpr uint32_t kMaxStride = 4096;
+
+  enum class Kind {
+    kCopy,
+    kFill,
+    kZero,
+  };
+
+  struct Load {
+    uint8_t reg;
+    uint8_t width;
+    int32_t offset;
+  };
+
+  Kind kind;
+  uint32_t head_address;
+  // Address of the bdnz closing the loop.
+  uint32_t branch_address;
+  // Bytes written (and for copies, read) per iteration.
+  uint32_t stride;
+
+  // Lowest offset from its base register at the start of an iteration at which
+  // memory is written (or read for a copy).
+  uint8_t dest_reg;
+  int32_t dest_offset;
+  uint8_t source_reg;
+  int32_t source_offset;
+  // For kZero, the loop-invariant second dcbz operand added to the base, or
+  // 0 if there's none. For kFill, the register holding the value stored.
+  uint8_t operand_reg;
+  // Size of each store for kFill, cache block size for kZero.
+  uint32_t element_width;
+
+  // Registers changed by a constant every iteration (the base registers and any
+  // other counters) and by how much.
+  uint32_t advanced_reg_mask;
+  int64_t reg_deltas[32];
+
+  // The last load into each register written by loads, which determines its
+  // value after the loop.
+  Load loads[kMaxInstructions];
+  uint32_t load_count;
+};
+
+// Decodes the loop starting at head_address, the closing bdnz must be at or
+// before limit_address. Returns false if the code isn't a recognized memory
+// loop.
+bool AnalyzeMemoryLoop(Memory* memory, uint32_t head_address,
+                       uint32_t limit_address, MemoryLoop* out_loop);
+
+// Builtin executing all remaining iterations of the memory loop at the guest
+// address in scratch on the host, with arg0 being the Memory. Sets scratch to 1
+// if the loop has been completed (registers and CTR are updated as the guest
+// code would have left them), or to 0 if the guest code must run instead - when
+// the count is out of range, the ranges overlap, or either range isn't plain
+// virtual memory (MMIO, or physical memory that may be watched).
+void MemoryLoopFastPath(PPCContext* ppc_context, void* arg0, void* arg1);
+
+}  // namespace ppc
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_PPC_PPC_MEMORY_LOOP_H_
@@ -11,7 +11,9 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/reset_scope.h"
@@ -23,10 +25,34 @@
 #include "xenia/cpu/ppc/ppc_opcode_info.h"
 #include "xenia/cpu/ppc/ppc_scanner.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/cpu/translation_profiler.h"
 #include "xenia/cpu/xex_module.h"
 
+DECLARE_bool(interprocedural_context_promotion);
+
 DEFINE_bool(dump_translated_hir_functions, false, "dumps translated hir",
             "CPU");
+DEFINE_bool(enable_tiered_compilation, false,
+            "Translate functions with only the essential compiler passes at "
+            "first, and retranslate them with all optimizations once they "
+            "have been called tiered_compilation_threshold times. Reduces "
+            "stutter when new code is reached.",
+            "CPU");
+DEFINE_int32(tiered_compilation_threshold, 1000,
+             "Number of calls after which a function translated with the "
+             "baseline passes is retranslated with full optimization.",
+             "CPU");
+DEFINE_bool(log_translation_allocations, false,
+            "Logs how many bytes of HIR were allocated to translate each "
+            "function, and how much of that had to come from new heap "
+            "allocations rather than reused arena memory.",
+            "CPU");
+DEFINE_bool(log_hir_optimization_statistics, false,
+            "Logs the HIR instruction count of each fully optimized function "
+            "before and after compilation, how many context stores and wide "
+            "values were eliminated, and how many comparisons were moved to "
+            "their branches.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -77,15 +103,23 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   }
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
-  // if (validate)
-  // compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  // Context stores dead across blocks, and then narrowing the operations
+  // truncated afterwards, both leaving dead code for the elimination pass.
+  auto dse = std::make_unique<passes::DeadStoreEliminationPass>();
+  dead_store_elimination_pass_ = dse.get();
+  compiler_->AddPass(std::move(dse));
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  auto vrp = std::make_unique<passes::ValueReductionPass>();
+  value_reduction_pass_ = vrp.get();
+  compiler_->AddPass(std::move(vrp));
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-
-  //// Removes all unneeded variables. Try not to add new ones after this.
-  // compiler_->AddPass(new passes::ValueReductionPass());
-  // if (validate) compiler_->AddPass(new passes::ValidationPass());
+  // After the elimination, so only the remaining uses are duplicated for.
+  auto csp = std::make_unique<passes::CompareSinkingPass>();
+  compare_sinking_pass_ = csp.get();
+  compiler_->AddPass(std::move(csp));
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
   // Register allocation for the target backend.
   // Will modify the HIR to add loads/stores.
@@ -97,6 +131,22 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+
+  // Baseline tier: only what's needed for reasonable code. Context promotion
+  // is cheap and removes most of the context traffic, the rest is required.
+  baseline_compiler_.reset(new Compiler(frontend->processor()));
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::ControlFlowAnalysisPass>());
+  baseline_compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>());
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
+      backend->machine_info()));
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
 }
 
 PPCTranslator::~PPCTranslator() = default;
@@ -157,8 +207,10 @@ bool PPCTranslator::Translate(GuestFunction* function,
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
   xe::make_reset_scope(compiler_);
+  xe::make_reset_scope(baseline_compiler_);
   xe::make_reset_scope(assembler_);
   xe::make_reset_scope(&string_buffer_);
+  size_t arena_chunk_bytes = builder_->arena_chunk_bytes_allocated();
 
   // NOTE: we only want to do this when required, as it's expensive to build.
   if (cvars::disassemble_functions) {
@@ -181,10 +233,28 @@ bool PPCTranslator::Translate(GuestFunction* function,
     debug_info.reset(new FunctionDebugInfo());
   }
 
+  // Only the first translation of a function is done at the baseline tier,
+  // any later one is a tier-up. Debug builds of functions are always full.
+  bool baseline = cvars::enable_tiered_compilation && !debug_info_flags &&
+                  function->tier() == GuestFunction::Tier::kUntranslated;
+
+  TranslationProfiler* profiler =
+      frontend_->processor()->translation_profiler();
+  TranslationProfiler::FunctionProfile profile;
+  uint64_t stage_start_ticks = profiler ? Clock::QueryHostTickCount() : 0;
+  auto end_profiled_stage = [&](TranslationProfiler::Stage stage) {
+    if (profiler) {
+      uint64_t ticks = Clock::QueryHostTickCount();
+      profile.stage_ticks[size_t(stage)] += ticks - stage_start_ticks;
+      stage_start_ticks = ticks;
+    }
+  };
+
   // Scan the function to find its extents and gather debug data.
   if (!scanner_->Scan(function, debug_info.get())) {
     return false;
   }
+  end_profiled_stage(TranslationProfiler::Stage::kScan);
 
   // Setup trace data, if needed.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoTraceFunctions) {
@@ -219,9 +289,18 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (debug_info) {
     emit_flags |= PPCHIRBuilder::EMIT_DEBUG_COMMENTS;
   }
+  if (profiler) {
+    stage_start_ticks = Clock::QueryHostTickCount();
+  }
   if (!builder_->Emit(function, emit_flags)) {
     return false;
   }
+  end_profiled_stage(TranslationProfiler::Stage::kHirBuilding);
+  // From the raw HIR, so it doesn't depend on the tier.
+  if (cvars::interprocedural_context_promotion) {
+    function->set_context_write_summary(
+        ComputeContextWriteSummary(builder_.get()));
+  }
 
   // Stash raw HIR.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmRawHir) {
@@ -231,9 +310,32 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
+  Compiler* compiler = baseline ? baseline_compiler_.get() : compiler_.get();
+  size_t emitted_instr_count = 0;
+  if (cvars::log_hir_optimization_statistics || profiler) {
+    emitted_instr_count = CountInstrs(builder_.get());
+  }
+  if (profiler) {
+    stage_start_ticks = Clock::QueryHostTickCount();
+  }
+  if (!compiler->Compile(builder_.get())) {
     return false;
   }
+  end_profiled_stage(TranslationProfiler::Stage::kCompilation);
+  if (profiler) {
+    profile.emitted_instr_count = uint32_t(emitted_instr_count);
+    profile.compiled_instr_count = uint32_t(CountInstrs(builder_.get()));
+    profile.hir_bytes = uint32_t(builder_->CalculateArenaSize());
+  }
+  if (cvars::log_hir_optimization_statistics && !baseline) {
+    XELOGI(
+        "Optimized {:08X}: {} HIR instructions emitted, {} compiled, {} "
+        "context stores and {} wide values eliminated, {} comparisons sunk",
+        function->address(), emitted_instr_count, CountInstrs(builder_.get()),
+        dead_store_elimination_pass_->stores_removed(),
+        value_reduction_pass_->values_narrowed(),
+        compare_sinking_pass_->compares_sunk());
+  }
 
   // Stash optimized HIR.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmHir) {
@@ -244,15 +346,98 @@ bool PPCTranslator::Translate(GuestFunction* function,
 
   DumpHIR(function, builder_.get());
 
-  // Assemble to backend machine code.
+  // Assemble to backend machine code. The backend emits the call counter for
+  // baseline code.
+  GuestFunction::Tier previous_tier = function->tier();
+  if (baseline) {
+    *function->tier_up_countdown() =
+        std::max(int32_t(cvars::tiered_compilation_threshold), int32_t(1));
+    function->set_tier(GuestFunction::Tier::kBaseline);
+  }
+  if (profiler) {
+    stage_start_ticks = Clock::QueryHostTickCount();
+  }
   if (!assembler_->Assemble(function, builder_.get(), debug_info_flags,
                             std::move(debug_info))) {
+    function->set_tier(previous_tier);
     return false;
   }
+  end_profiled_stage(TranslationProfiler::Stage::kEmission);
+  if (profiler) {
+    profile.address = function->address();
+    profile.baseline = baseline;
+    profile.guest_instr_count =
+        (function->end_address() - function->address()) / 4 + 1;
+    profile.machine_code_length = uint32_t(function->machine_code_length());
+    profiler->RecordFunction(profile);
+  }
+  if (!baseline) {
+    function->set_tier(GuestFunction::Tier::kOptimized);
+  }
+
+  if (cvars::log_translation_allocations) {
+    XELOGI("Translated {:08X}: {} bytes of HIR, {} from new arena chunks",
+           function->address(), builder_->CalculateArenaSize(),
+           builder_->arena_chunk_bytes_allocated() - arena_chunk_bytes);
+  }
 
   return true;
 }
 void PPCTranslator::Reset() { builder_->ResetPools(); }
+std::shared_ptr<const ContextWriteSummary>
+PPCTranslator::ComputeContextWriteSummary(hir::HIRBuilder* builder) {
+  auto summary = std::make_shared<ContextWriteSummary>();
+  for (hir::Block* block = builder->first_block(); block;
+       block = block->next) {
+    for (hir::Instr* i = block->instr_head; i; i = i->next) {
+      const hir::OpcodeInfo* opcode = i->opcode;
+      if (opcode == &hir::OPCODE_STORE_CONTEXT_info) {
+        summary->AddWrite(i->src1.offset,
+                          hir::GetTypeSize(i->src2.value->type));
+      } else if (opcode == &hir::OPCODE_CALL_info ||
+                 opcode == &hir::OPCODE_CALL_TRUE_info) {
+        Function* callee = opcode == &hir::OPCODE_CALL_info ? i->src1.symbol
+                                                            : i->src2.symbol;
+        if (!callee || !callee->is_guest()) {
+          return nullptr;
+        }
+        auto guest_callee = static_cast<GuestFunction*>(callee);
+        if (guest_callee->extern_handler()) {
+          return nullptr;
+        }
+        auto callee_summary = guest_callee->context_write_summary();
+        if (!callee_summary) {
+          return nullptr;
+        }
+        guest_callee->mark_context_write_summary_used();
+        summary->Add(*callee_summary);
+      } else if (opcode == &hir::OPCODE_CALL_INDIRECT_info ||
+                 opcode == &hir::OPCODE_CALL_INDIRECT_TRUE_info ||
+                 opcode == &hir::OPCODE_CALL_EXTERN_info ||
+                 opcode == &hir::OPCODE_TRAP_info ||
+                 opcode == &hir::OPCODE_TRAP_TRUE_info ||
+                 opcode == &hir::OPCODE_DEBUG_BREAK_info ||
+                 opcode == &hir::OPCODE_DEBUG_BREAK_TRUE_info) {
+        // Unknown code may be invoked.
+        return nullptr;
+      }
+    }
+  }
+  return summary;
+}
+
+size_t PPCTranslator::CountInstrs(hir::HIRBuilder* builder) {
+  size_t count = 0;
+  for (hir::Block* block = builder->first_block(); block;
+       block = block->next) {
+    for (hir::Instr* i = block->instr_head; i; i = i->next) {
+      if (i->opcode != &hir::OPCODE_COMMENT_info) {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
 void PPCTranslator::DumpSource(GuestFunction* function,
                                StringBuffer* string_buffer) {
   Memory* memory = frontend_->memory();
@@ -17,6 +17,18 @@
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/function.h"
 
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+class CompareSinkingPass;
+class DeadStoreEliminationPass;
+class ValueReductionPass;
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
 namespace xe {
 namespace cpu {
 namespace ppc {
@@ -36,11 +48,21 @@ class PPCTranslator {
 
  private:
   void DumpSource(GuestFunction* function, StringBuffer* string_buffer);
+  // Null if the function calls code with unknown context writes.
+  static std::shared_ptr<const ContextWriteSummary> ComputeContextWriteSummary(
+      hir::HIRBuilder* builder);
+  // Excluding the comments.
+  static size_t CountInstrs(hir::HIRBuilder* builder);
 
   PPCFrontend* frontend_;
   std::unique_ptr<PPCScanner> scanner_;
   std::unique_ptr<PPCHIRBuilder> builder_;
   std::unique_ptr<compiler::Compiler> compiler_;
+  std::unique_ptr<compiler::Compiler> baseline_compiler_;
+  // Owned by compiler_, for the statistics.
+  compiler::passes::DeadStoreEliminationPass* dead_store_elimination_pass_;
+  compiler::passes::ValueReductionPass* value_reduction_pass_;
+  compiler::passes::CompareSinkingPass* compare_sinking_pass_;
   std::unique_ptr<backend::Assembler> assembler_;
 
   StringBuffer string_buffer_;
@@ -0,0 +1,24 @@
+# Benchmark kernels for xenia-cpu-ppc-benchmark. INSTRUCTION_COUNT is the
+# number of guest instructions executed by one call.
+
+test_branches:
+  #_ INSTRUCTION_COUNT 7515
+  li r3, 1000
+  mtctr r3
+  li r4, 0
+  li r5, 0
+branches_loop:
+  andi. r6, r4, 1
+  beq branches_even
+  addi r5, r5, 3
+  b branches_next
+branches_even:
+  addi r5, r5, -1
+branches_next:
+  cmpwi r5, 100
+  blt branches_skip
+  li r5, 0
+branches_skip:
+  addi r4, r4, 1
+  bdnz branches_loop
+  blr
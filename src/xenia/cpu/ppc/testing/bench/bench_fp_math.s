@@ -0,0 +1,20 @@
+# Benchmark kernels for xenia-cpu-ppc-benchmark. INSTRUCTION_COUNT is the
+# number of guest instructions executed by one call.
+
+test_fp_math:
+  #_ REGISTER_IN f1 1.5
+  #_ REGISTER_IN f2 0.75
+  #_ REGISTER_IN f3 2.0
+  #_ INSTRUCTION_COUNT 8003
+  li r3, 1000
+  mtctr r3
+fp_math_loop:
+  fmadd f4, f1, f2, f3
+  fmul f5, f4, f2
+  fdiv f6, f5, f3
+  fsub f7, f6, f2
+  fabs f1, f7
+  frsp f8, f6
+  fsqrt f9, f3
+  bdnz fp_math_loop
+  blr
@@ -0,0 +1,24 @@
+# Benchmark kernels for xenia-cpu-ppc-benchmark. INSTRUCTION_COUNT is the
+# number of guest instructions executed by one call.
+
+test_load_store_byteswap:
+  #_ MEMORY_IN 10001000 00112233 44556677 8899AABB CCDDEEFF
+  #_ INSTRUCTION_COUNT 10007
+  lis r4, 0x1000
+  ori r4, r4, 0x1000
+  li r8, 8
+  li r10, 32
+  li r3, 1000
+  mtctr r3
+load_store_loop:
+  lwbrx r5, 0, r4
+  addi r5, r5, 1
+  stwbrx r5, 0, r4
+  lhbrx r6, 0, r4
+  sthbrx r6, r4, r8
+  lwz r9, 4(r4)
+  stw r9, 12(r4)
+  lvx v1, 0, r4
+  stvx v1, r4, r10
+  bdnz load_store_loop
+  blr
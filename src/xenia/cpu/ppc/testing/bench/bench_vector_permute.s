@@ -0,0 +1,18 @@
+# Benchmark kernels for xenia-cpu-ppc-benchmark. INSTRUCTION_COUNT is the
+# number of guest instructions executed by one call.
+
+test_vector_permute:
+  #_ REGISTER_IN v0 [00010203, 10111213, 04050607, 14151617]
+  #_ REGISTER_IN v1 [00112233, 44556677, 8899AABB, CCDDEEFF]
+  #_ REGISTER_IN v2 [01234567, 89ABCDEF, FEDCBA98, 76543210]
+  #_ INSTRUCTION_COUNT 6003
+  li r3, 1000
+  mtctr r3
+vector_permute_loop:
+  vperm v3, v1, v2, v0
+  vsldoi v4, v3, v1, 4
+  vmrghw v5, v4, v3
+  vspltw v1, v5, 2
+  vxor v2, v2, v3
+  bdnz vector_permute_loop
+  blr
@@ -0,0 +1,309 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/literals.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/ppc/testing/ppc_testing_suite.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/raw_module.h"
+
+#if XE_ARCH_AMD64
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#endif  // XE_ARCH
+
+DEFINE_path(bench_path, "src/xenia/cpu/ppc/testing/bench/",
+            "Directory scanned for benchmark kernels.", "Other");
+DEFINE_path(bench_test_path, "src/xenia/cpu/ppc/testing/",
+            "Directory scanned for instruction tests to also benchmark. Empty "
+            "to only run the benchmark kernels.",
+            "Other");
+DEFINE_path(bench_bin_path, "src/xenia/cpu/ppc/testing/bin/",
+            "Directory with binary outputs of the benchmark and test files.",
+            "Other");
+DEFINE_path(bench_output_path, "",
+            "CSV file to write the results to, for comparing runs.", "Other");
+DEFINE_uint32(bench_iterations, 10000,
+              "Number of times each function is called when timing it.",
+              "Other");
+DEFINE_transient_string(bench_name, "", "Benchmark suite name.", "General");
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+using namespace xe::literals;
+
+struct BenchmarkResult {
+  std::string suite_name;
+  std::string name;
+  double compile_us;
+  double ns_per_call;
+  double ns_per_instruction;
+  uint32_t instruction_count;
+};
+
+class BenchmarkRunner {
+ public:
+  BenchmarkRunner() {
+    memory_.reset(new Memory());
+    memory_->Initialize();
+  }
+
+  ~BenchmarkRunner() {
+    thread_state_.reset();
+    processor_.reset();
+    memory_.reset();
+  }
+
+  bool Setup(TestSuite& suite) {
+    thread_state_.reset();
+    processor_.reset();
+    memory_->Reset();
+
+    std::unique_ptr<xe::cpu::backend::Backend> backend;
+#if XE_ARCH_AMD64
+    if (cvars::cpu == "x64" || cvars::cpu == "any") {
+      backend.reset(new xe::cpu::backend::x64::X64Backend());
+    }
+#endif  // XE_ARCH
+    if (!backend) {
+      XELOGE("No backend available for cpu={}", cvars::cpu);
+      return false;
+    }
+
+    // No debug info so the generated code matches what titles run.
+    processor_.reset(new Processor(memory_.get(), nullptr));
+    processor_->Setup(std::move(backend));
+    processor_->set_debug_info_flags(DebugInfoFlags::kDebugInfoNone);
+
+    auto module = std::make_unique<xe::cpu::RawModule>(processor_.get());
+    if (!module->LoadFile(START_ADDRESS, suite.bin_file_path())) {
+      XELOGE("Unable to load benchmark binary {}",
+             xe::path_to_utf8(suite.bin_file_path()));
+      return false;
+    }
+    processor_->AddModule(std::move(module));
+
+    processor_->backend()->CommitExecutableRange(START_ADDRESS,
+                                                 START_ADDRESS + 1024 * 1024);
+
+    // Same dummy space as the test runner, the load/store kernels use it.
+    processor_->memory()->LookupHeap(0)->AllocFixed(
+        0x10001000, 0xEFFF, 0,
+        kMemoryAllocationReserve | kMemoryAllocationCommit,
+        kMemoryProtectRead | kMemoryProtectWrite);
+
+    uint32_t stack_size = 64 * 1024;
+    uint32_t stack_address = START_ADDRESS - stack_size;
+    uint32_t pcr_address = stack_address - 0x1000;
+    thread_state_.reset(
+        new ThreadState(processor_.get(), 0x100, stack_address, pcr_address));
+    return true;
+  }
+
+  bool Run(TestSuite& suite, TestCase& test_case, BenchmarkResult& result) {
+    using clock = std::chrono::steady_clock;
+
+    PPCContext* ctx = thread_state_->context();
+    ApplyTestInputs(test_case, ctx, memory_.get());
+    ctx->lr = 0xBCBCBCBC;
+
+    // The first resolve translates the function.
+    auto compile_start = clock::now();
+    auto fn = processor_->ResolveFunction(test_case.address);
+    auto compile_end = clock::now();
+    if (!fn) {
+      XELOGE("Entry function not found");
+      return false;
+    }
+
+    // Every call starts from the same state, as the kernels loop on registers
+    // they modify. Restoring it is timed separately and subtracted.
+    std::unique_ptr<uint8_t[]> initial_context(new uint8_t[sizeof(PPCContext)]);
+    std::memcpy(initial_context.get(), ctx, sizeof(PPCContext));
+    uint32_t iterations = std::max(cvars::bench_iterations, uint32_t(1));
+
+    // Warm up caches and any lazily resolved callees.
+    fn->Call(thread_state_.get(), 0xBCBCBCBC);
+
+    auto restore_start = clock::now();
+    for (uint32_t i = 0; i < iterations; ++i) {
+      std::memcpy(ctx, initial_context.get(), sizeof(PPCContext));
+    }
+    auto restore_end = clock::now();
+
+    auto run_start = clock::now();
+    for (uint32_t i = 0; i < iterations; ++i) {
+      std::memcpy(ctx, initial_context.get(), sizeof(PPCContext));
+      fn->Call(thread_state_.get(), 0xBCBCBCBC);
+    }
+    auto run_end = clock::now();
+
+    double restore_ns =
+        std::chrono::duration<double, std::nano>(restore_end - restore_start)
+            .count();
+    double run_ns =
+        std::chrono::duration<double, std::nano>(run_end - run_start).count();
+
+    result.suite_name = suite.name();
+    result.name = test_case.name;
+    result.compile_us =
+        std::chrono::duration<double, std::micro>(compile_end - compile_start)
+            .count();
+    result.ns_per_call = std::max(run_ns - restore_ns, 0.0) / iterations;
+    result.instruction_count = GetInstructionCount(test_case, fn);
+    result.ns_per_instruction =
+        result.ns_per_call / std::max(result.instruction_count, uint32_t(1));
+    return true;
+  }
+
+ private:
+  // Kernels that loop give the dynamic count with #_ INSTRUCTION_COUNT,
+  // straight-line tests execute every instruction of the function once.
+  static uint32_t GetInstructionCount(const TestCase& test_case,
+                                      const Function* fn) {
+    for (auto& it : test_case.annotations) {
+      if (it.first == "INSTRUCTION_COUNT") {
+        return uint32_t(std::strtoul(it.second.c_str(), nullptr, 0));
+      }
+    }
+    if (fn->has_end_address()) {
+      // The end address is that of the final blr.
+      return (fn->end_address() - fn->address()) / 4 + 1;
+    }
+    return 1;
+  }
+
+  std::unique_ptr<Memory> memory_;
+  std::unique_ptr<Processor> processor_;
+  std::unique_ptr<ThreadState> thread_state_;
+};
+
+bool LoadSuites(const std::filesystem::path& path,
+                const std::string_view bench_name,
+                std::vector<TestSuite>& suites) {
+  if (path.empty()) {
+    return true;
+  }
+  std::vector<std::filesystem::path> files;
+  if (!DiscoverTests(path, files)) {
+    return false;
+  }
+  bool load_failed = false;
+  for (auto& file : files) {
+    TestSuite suite(file, cvars::bench_bin_path);
+    if (!bench_name.empty() && suite.name() != bench_name) {
+      continue;
+    }
+    if (!suite.Load()) {
+      XELOGE("BENCHMARK SUITE {} FAILED TO LOAD", xe::path_to_utf8(file));
+      load_failed = true;
+      continue;
+    }
+    suites.push_back(std::move(suite));
+  }
+  return !load_failed;
+}
+
+bool WriteResults(const std::filesystem::path& path,
+                  const std::vector<BenchmarkResult>& results) {
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Unable to open {} to write the benchmark results",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  fmt::print(file,
+             "suite,name,compile_us,ns_per_call,ns_per_instruction,"
+             "instructions\n");
+  for (auto& result : results) {
+    fmt::print(file, "{},{},{:.3f},{:.3f},{:.4f},{}\n", result.suite_name,
+               result.name, result.compile_us, result.ns_per_call,
+               result.ns_per_instruction, result.instruction_count);
+  }
+  fclose(file);
+  return true;
+}
+
+bool RunBenchmarks(const std::string_view bench_name) {
+#if XE_ARCH_AMD64
+  XELOGI("Instruction feature mask {}.", cvars::x64_extension_mask);
+#endif  // XE_ARCH_AMD64
+
+  std::vector<TestSuite> suites;
+  bool load_failed = !LoadSuites(cvars::bench_path, bench_name, suites);
+  load_failed |= !LoadSuites(cvars::bench_test_path, bench_name, suites);
+  if (load_failed) {
+    XELOGE("One or more benchmark suites failed to load.");
+  }
+  if (suites.empty()) {
+    XELOGE("No benchmarks discovered - invalid path?");
+    return false;
+  }
+  XELOGI("{} benchmark suites loaded, {} iterations each.", suites.size(),
+         cvars::bench_iterations);
+  XELOGI("");
+
+  std::vector<BenchmarkResult> results;
+  BenchmarkRunner runner;
+  int failed_count = 0;
+  double total_compile_us = 0.0;
+  for (auto& suite : suites) {
+    XELOGI("{}.s:", suite.name());
+    for (auto& test_case : suite.test_cases()) {
+      BenchmarkResult result;
+      if (!runner.Setup(suite) || !runner.Run(suite, test_case, result)) {
+        XELOGE("  - {}: FAILED", test_case.name);
+        ++failed_count;
+        continue;
+      }
+      XELOGI("  - {}: compile {:.1f} us, {:.1f} ns/call, {:.3f} ns/instr ({})",
+             result.name, result.compile_us, result.ns_per_call,
+             result.ns_per_instruction, result.instruction_count);
+      total_compile_us += result.compile_us;
+      results.push_back(std::move(result));
+    }
+  }
+
+  XELOGI("");
+  XELOGI("Functions: {}", results.size());
+  XELOGI("Failed: {}", failed_count);
+  if (!results.empty()) {
+    XELOGI("Average compile time: {:.1f} us",
+           total_compile_us / results.size());
+  }
+
+  if (!cvars::bench_output_path.empty() &&
+      !WriteResults(cvars::bench_output_path, results)) {
+    return false;
+  }
+  return !failed_count;
+}
+
+int main(const std::vector<std::string>& args) {
+  return RunBenchmarks(cvars::bench_name) ? 0 : 1;
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-cpu-ppc-benchmark", xe::cpu::test::main,
+                      "[benchmark name]", "bench_name");
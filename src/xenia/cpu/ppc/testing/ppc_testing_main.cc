@@ -18,6 +18,7 @@
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/ppc/testing/ppc_testing_suite.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/raw_module.h"
 
@@ -39,147 +40,8 @@ namespace xe {
 namespace cpu {
 namespace test {
 
-using xe::cpu::ppc::PPCContext;
 using namespace xe::literals;
 
-typedef std::vector<std::pair<std::string, std::string>> AnnotationList;
-
-const uint32_t START_ADDRESS = 0x80000000;
-
-struct TestCase {
-  TestCase(uint32_t address, std::string& name)
-      : address(address), name(name) {}
-  uint32_t address;
-  std::string name;
-  AnnotationList annotations;
-};
-
-class TestSuite {
- public:
-  TestSuite(const std::filesystem::path& src_file_path)
-      : src_file_path_(src_file_path) {
-    auto name = src_file_path.filename();
-    name = name.replace_extension();
-
-    name_ = xe::path_to_utf8(name);
-    map_file_path_ = cvars::test_bin_path / name.replace_extension(".map");
-    bin_file_path_ = cvars::test_bin_path / name.replace_extension(".bin");
-  }
-
-  bool Load() {
-    if (!ReadMap()) {
-      XELOGE("Unable to read map for test {}",
-             xe::path_to_utf8(src_file_path_));
-      return false;
-    }
-    if (!ReadAnnotations()) {
-      XELOGE("Unable to read annotations for test {}",
-             xe::path_to_utf8(src_file_path_));
-      return false;
-    }
-    return true;
-  }
-
-  const std::string& name() const { return name_; }
-  const std::filesystem::path& src_file_path() const { return src_file_path_; }
-  const std::filesystem::path& map_file_path() const { return map_file_path_; }
-  const std::filesystem::path& bin_file_path() const { return bin_file_path_; }
-  std::vector<TestCase>& test_cases() { return test_cases_; }
-
- private:
-  std::string name_;
-  std::filesystem::path src_file_path_;
-  std::filesystem::path map_file_path_;
-  std::filesystem::path bin_file_path_;
-  std::vector<TestCase> test_cases_;
-
-  TestCase* FindTestCase(const std::string_view name) {
-    for (auto& test_case : test_cases_) {
-      if (test_case.name == name) {
-        return &test_case;
-      }
-    }
-    return nullptr;
-  }
-
-  bool ReadMap() {
-    FILE* f = filesystem::OpenFile(map_file_path_, "r");
-    if (!f) {
-      return false;
-    }
-    char line_buffer[BUFSIZ];
-    while (fgets(line_buffer, sizeof(line_buffer), f)) {
-      if (!strlen(line_buffer)) {
-        continue;
-      }
-      // 0000000000000000 t test_add1\n
-      char* newline = strrchr(line_buffer, '\n');
-      if (newline) {
-        *newline = 0;
-      }
-      char* t_test_ = strstr(line_buffer, " t test_");
-      if (!t_test_) {
-        continue;
-      }
-      std::string address(line_buffer, t_test_ - line_buffer);
-      std::string name(t_test_ + strlen(" t test_"));
-      test_cases_.emplace_back(START_ADDRESS + std::stoul(address, 0, 16),
-                               name);
-    }
-    fclose(f);
-    return true;
-  }
-
-  bool ReadAnnotations() {
-    TestCase* current_test_case = nullptr;
-    FILE* f = filesystem::OpenFile(src_file_path_, "r");
-    if (!f) {
-      return false;
-    }
-    char line_buffer[BUFSIZ];
-    while (fgets(line_buffer, sizeof(line_buffer), f)) {
-      if (!strlen(line_buffer)) {
-        continue;
-      }
-      // Eat leading whitespace.
-      char* start = line_buffer;
-      while (*start == ' ') {
-        ++start;
-      }
-      if (strncmp(start, "test_", strlen("test_")) == 0) {
-        // Global test label.
-        std::string label(start + strlen("test_"), strchr(start, ':'));
-        current_test_case = FindTestCase(label);
-        if (!current_test_case) {
-          XELOGE("Test case {} not found in corresponding map for {}", label,
-                 xe::path_to_utf8(src_file_path_));
-          return false;
-        }
-      } else if (strlen(start) > 3 && start[0] == '#' && start[1] == '_') {
-        // Annotation.
-        // We don't actually verify anything here.
-        char* next_space = strchr(start + 3, ' ');
-        if (next_space) {
-          // Looks legit.
-          std::string key(start + 3, next_space);
-          std::string value(next_space + 1);
-          while (value.find_last_of(" \t\n") == value.size() - 1) {
-            value.erase(value.end() - 1);
-          }
-          if (!current_test_case) {
-            XELOGE("Annotation outside of test case in {}",
-                   xe::path_to_utf8(src_file_path_));
-            return false;
-          }
-          current_test_case->annotations.emplace_back(key, value);
-        }
-      }
-    }
-    fclose(f);
-    return true;
-  }
-};
-
 class TestRunner {
  public:
   TestRunner() : memory_size_(64_MiB) {
@@ -277,34 +139,7 @@ class TestRunner {
   }
 
   bool SetupTestState(TestCase& test_case) {
-    auto ppc_context = thread_state_->context();
-    for (auto& it : test_case.annotations) {
-      if (it.first == "REGISTER_IN") {
-        size_t space_pos = it.second.find(" ");
-        auto reg_name = it.second.substr(0, space_pos);
-        auto reg_value = it.second.substr(space_pos + 1);
-        ppc_context->SetRegFromString(reg_name.c_str(), reg_value.c_str());
-      } else if (it.first == "MEMORY_IN") {
-        size_t space_pos = it.second.find(" ");
-        auto address_str = it.second.substr(0, space_pos);
-        auto bytes_str = it.second.substr(space_pos + 1);
-        uint32_t address = std::strtoul(address_str.c_str(), nullptr, 16);
-        auto p = memory_->TranslateVirtual(address);
-        const char* c = bytes_str.c_str();
-        while (*c) {
-          while (*c == ' ') ++c;
-          if (!*c) {
-            break;
-          }
-          char ccs[3] = {c[0], c[1], 0};
-          c += 2;
-          uint32_t b = std::strtoul(ccs, nullptr, 16);
-          *p = static_cast<uint8_t>(b);
-          ++p;
-        }
-      }
-    }
-    return true;
+    return ApplyTestInputs(test_case, thread_state_->context(), memory_.get());
   }
 
   bool CheckTestResults(TestCase& test_case) {
@@ -374,17 +209,6 @@ class TestRunner {
   std::unique_ptr<ThreadState> thread_state_;
 };
 
-bool DiscoverTests(const std::filesystem::path& test_path,
-                   std::vector<std::filesystem::path>& test_files) {
-  auto file_infos = xe::filesystem::ListFiles(test_path);
-  for (auto& file_info : file_infos) {
-    if (file_info.name.extension() == ".s") {
-      test_files.push_back(test_path / file_info.name);
-    }
-  }
-  return true;
-}
-
 #if XE_COMPILER_MSVC
 int filter(unsigned int code) {
   if (code == EXCEPTION_ILLEGAL_INSTRUCTION) {
@@ -444,7 +268,7 @@ bool RunTests(const std::string_view test_name) {
   std::vector<TestSuite> test_suites;
   bool load_failed = false;
   for (auto& test_path : test_files) {
-    TestSuite test_suite(test_path);
+    TestSuite test_suite(test_path, cvars::test_bin_path);
     if (!test_name.empty() && test_suite.name() != test_name) {
       continue;
     }
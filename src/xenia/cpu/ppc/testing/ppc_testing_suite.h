@@ -0,0 +1,223 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_PPC_TESTING_PPC_TESTING_SUITE_H_
+#define XENIA_CPU_PPC_TESTING_PPC_TESTING_SUITE_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/memory.h"
+
+// Test suite parsing shared by the codegen test runner and the x64 backend
+// benchmark. A suite is a [name].s source with a [name].map and [name].bin
+// generated by `xenia-build gentests`.
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+using xe::cpu::ppc::PPCContext;
+
+typedef std::vector<std::pair<std::string, std::string>> AnnotationList;
+
+const uint32_t START_ADDRESS = 0x80000000;
+
+struct TestCase {
+  TestCase(uint32_t address, std::string& name)
+      : address(address), name(name) {}
+  uint32_t address;
+  std::string name;
+  AnnotationList annotations;
+};
+
+class TestSuite {
+ public:
+  TestSuite(const std::filesystem::path& src_file_path,
+            const std::filesystem::path& bin_path)
+      : src_file_path_(src_file_path) {
+    auto name = src_file_path.filename();
+    name = name.replace_extension();
+
+    name_ = xe::path_to_utf8(name);
+    map_file_path_ = bin_path / name.replace_extension(".map");
+    bin_file_path_ = bin_path / name.replace_extension(".bin");
+  }
+
+  bool Load() {
+    if (!ReadMap()) {
+      XELOGE("Unable to read map for test {}",
+             xe::path_to_utf8(src_file_path_));
+      return false;
+    }
+    if (!ReadAnnotations()) {
+      XELOGE("Unable to read annotations for test {}",
+             xe::path_to_utf8(src_file_path_));
+      return false;
+    }
+    return true;
+  }
+
+  const std::string& name() const { return name_; }
+  const std::filesystem::path& src_file_path() const { return src_file_path_; }
+  const std::filesystem::path& map_file_path() const { return map_file_path_; }
+  const std::filesystem::path& bin_file_path() const { return bin_file_path_; }
+  std::vector<TestCase>& test_cases() { return test_cases_; }
+
+ private:
+  std::string name_;
+  std::filesystem::path src_file_path_;
+  std::filesystem::path map_file_path_;
+  std::filesystem::path bin_file_path_;
+  std::vector<TestCase> test_cases_;
+
+  TestCase* FindTestCase(const std::string_view name) {
+    for (auto& test_case : test_cases_) {
+      if (test_case.name == name) {
+        return &test_case;
+      }
+    }
+    return nullptr;
+  }
+
+  bool ReadMap() {
+    FILE* f = filesystem::OpenFile(map_file_path_, "r");
+    if (!f) {
+      return false;
+    }
+    char line_buffer[BUFSIZ];
+    while (fgets(line_buffer, sizeof(line_buffer), f)) {
+      if (!strlen(line_buffer)) {
+        continue;
+      }
+      // 0000000000000000 t test_add1\n
+      char* newline = strrchr(line_buffer, '\n');
+      if (newline) {
+        *newline = 0;
+      }
+      char* t_test_ = strstr(line_buffer, " t test_");
+      if (!t_test_) {
+        continue;
+      }
+      std::string address(line_buffer, t_test_ - line_buffer);
+      std::string name(t_test_ + strlen(" t test_"));
+      test_cases_.emplace_back(START_ADDRESS + std::stoul(address, 0, 16),
+                               name);
+    }
+    fclose(f);
+    return true;
+  }
+
+  bool ReadAnnotations() {
+    TestCase* current_test_case = nullptr;
+    FILE* f = filesystem::OpenFile(src_file_path_, "r");
+    if (!f) {
+      return false;
+    }
+    char line_buffer[BUFSIZ];
+    while (fgets(line_buffer, sizeof(line_buffer), f)) {
+      if (!strlen(line_buffer)) {
+        continue;
+      }
+      // Eat leading whitespace.
+      char* start = line_buffer;
+      while (*start == ' ') {
+        ++start;
+      }
+      if (strncmp(start, "test_", strlen("test_")) == 0) {
+        // Global test label.
+        std::string label(start + strlen("test_"), strchr(start, ':'));
+        current_test_case = FindTestCase(label);
+        if (!current_test_case) {
+          XELOGE("Test case {} not found in corresponding map for {}", label,
+                 xe::path_to_utf8(src_file_path_));
+          return false;
+        }
+      } else if (strlen(start) > 3 && start[0] == '#' && start[1] == '_') {
+        // Annotation.
+        // We don't actually verify anything here.
+        char* next_space = strchr(start + 3, ' ');
+        if (next_space) {
+          // Looks legit.
+          std::string key(start + 3, next_space);
+          std::string value(next_space + 1);
+          while (value.find_last_of(" \t\n") == value.size() - 1) {
+            value.erase(value.end() - 1);
+          }
+          if (!current_test_case) {
+            XELOGE("Annotation outside of test case in {}",
+                   xe::path_to_utf8(src_file_path_));
+            return false;
+          }
+          current_test_case->annotations.emplace_back(key, value);
+        }
+      }
+    }
+    fclose(f);
+    return true;
+  }
+};
+
+// Applies the REGISTER_IN and MEMORY_IN annotations of the test case.
+inline bool ApplyTestInputs(const TestCase& test_case, PPCContext* ppc_context,
+                            Memory* memory) {
+  for (auto& it : test_case.annotations) {
+    if (it.first == "REGISTER_IN") {
+      size_t space_pos = it.second.find(" ");
+      auto reg_name = it.second.substr(0, space_pos);
+      auto reg_value = it.second.substr(space_pos + 1);
+      ppc_context->SetRegFromString(reg_name.c_str(), reg_value.c_str());
+    } else if (it.first == "MEMORY_IN") {
+      size_t space_pos = it.second.find(" ");
+      auto address_str = it.second.substr(0, space_pos);
+      auto bytes_str = it.second.substr(space_pos + 1);
+      uint32_t address = std::strtoul(address_str.c_str(), nullptr, 16);
+      auto p = memory->TranslateVirtual(address);
+      const char* c = bytes_str.c_str();
+      while (*c) {
+        while (*c == ' ') ++c;
+        if (!*c) {
+          break;
+        }
+        char ccs[3] = {c[0], c[1], 0};
+        c += 2;
+        uint32_t b = std::strtoul(ccs, nullptr, 16);
+        *p = static_cast<uint8_t>(b);
+        ++p;
+      }
+    }
+  }
+  return true;
+}
+
+inline bool DiscoverTests(const std::filesystem::path& test_path,
+                          std::vector<std::filesystem::path>& test_files) {
+  auto file_infos = xe::filesystem::ListFiles(test_path);
+  for (auto& file_info : file_infos) {
+    if (file_info.name.extension() == ".s") {
+      test_files.push_back(test_path / file_info.name);
+    }
+  }
+  return true;
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_PPC_TESTING_PPC_TESTING_SUITE_H_
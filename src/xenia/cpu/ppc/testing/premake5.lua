@@ -19,6 +19,7 @@ project("xenia-cpu-ppc-tests")
   })
   files({
     "ppc_testing_main.cc",
+    "ppc_testing_suite.h",
     "../../../base/console_app_main_"..platform_suffix..".cc",
   })
   files({
@@ -40,6 +41,40 @@ project("xenia-cpu-ppc-tests")
     -- xenia-base needs this
     links({"xenia-ui"})
 
+project("xenia-cpu-ppc-benchmark")
+  uuid("6bd1a4f2-8c3e-4b57-9e0d-2f71c5a83d46")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "capstone", -- cpu-backend-x64
+    "fmt",
+    "mspack",
+    "imgui",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-base",
+    "xenia-kernel",
+    "xenia-patcher",
+  })
+  files({
+    "ppc_benchmark_main.cc",
+    "../../../base/console_app_main_"..platform_suffix..".cc",
+  })
+  files({
+    "bench/*.s",
+  })
+  filter("files:bench/*.s")
+    flags({"ExcludeFromBuild"})
+  filter("architecture:x86_64")
+    links({
+      "xenia-cpu-backend-x64",
+    })
+  filter("platforms:Windows")
+    debugdir(project_root)
+
+    -- xenia-base needs this
+    links({"xenia-ui"})
+
 if ARCH == "ppc64" or ARCH == "powerpc64" then
 
 project("xenia-cpu-ppc-nativetests")
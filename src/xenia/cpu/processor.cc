@@ -9,16 +9,21 @@
 
 #include "xenia/cpu/processor.h"
 
+#include <atomic>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
+#include "xenia/base/device_profile.h"
 #include "xenia/base/exception_handler.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/metrics.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
@@ -48,6 +53,33 @@ DEFINE_path(trace_function_data_path, "", "File to write trace data to.",
             "CPU");
 DEFINE_bool(break_on_start, false, "Break into the debugger on startup.",
             "CPU");
+DEFINE_int32(background_translation_threads, 0,
+             "Number of host threads translating guest functions that are "
+             "likely to be called (found by code analysis or resolved during "
+             "earlier runs) before the guest demands them. 0 to disable, -1 to "
+             "use one less than the logical processor count.",
+             "CPU");
+DEFINE_path(guest_sampling_profiler_path, "",
+            "Periodically samples the guest call stacks of all guest threads "
+            "and writes them to this file on exit, as collapsed stacks for "
+            "flame graph tools. Needs "
+            "enable_host_guest_stack_synchronization.",
+            "CPU");
+DEFINE_uint32(guest_sampling_profiler_interval, 1,
+              "Milliseconds between guest_sampling_profiler_path samples.",
+              "CPU");
+DEFINE_bool(translation_profiling, false,
+            "Measures the host time spent in each stage and compiler pass of "
+            "the translation of every guest function, and logs the totals and "
+            "the slowest functions to translate on exit.",
+            "CPU");
+DEFINE_bool(invalidate_written_code, true,
+            "Write-protects the host pages of the translated guest code that "
+            "the guest can write to, such as with writable_code_segments, in "
+            "overlays and in generated code, and retranslates the functions in "
+            "the written pages when the guest invalidates the instruction "
+            "cache with icbi.",
+            "CPU");
 
 namespace xe {
 namespace kernel {
@@ -61,6 +93,19 @@ using xe::kernel::XThread;
 
 using namespace xe::literals;
 
+namespace {
+metrics::Counter translated_functions_metric(
+    "xenia_cpu_translated_functions_total",
+    "Guest functions translated to host code.");
+metrics::Counter restored_functions_metric(
+    "xenia_cpu_restored_functions_total",
+    "Guest functions loaded from the persistent code cache.");
+metrics::Histogram translation_time_metric(
+    "xenia_cpu_function_translation_time_microseconds",
+    "Host time of translating a guest function.",
+    {50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000});
+}  // namespace
+
 class BuiltinModule : public Module {
  public:
   explicit BuiltinModule(Processor* processor)
@@ -86,6 +131,12 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver)
     : memory_(memory), export_resolver_(export_resolver) {}
 
 Processor::~Processor() {
+  sampling_profiler_.reset();
+  ShutdownTranslationWorkers();
+  if (cvars::invalidate_written_code && memory_) {
+    memory_->SetCodeWriteCallback(nullptr, nullptr);
+  }
+
   {
     auto global_lock = global_critical_region_.Acquire();
     modules_.clear();
@@ -93,6 +144,8 @@ Processor::~Processor() {
 
   frontend_.reset();
   backend_.reset();
+  // Logs the report.
+  translation_profiler_.reset();
 
   if (functions_trace_file_) {
     functions_trace_file_->Flush();
@@ -154,9 +207,372 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
         ChunkedMappedMemoryWriter::Open(functions_trace_path_, 32_MiB, true);
   }
 
+  if (cvars::translation_profiling) {
+    translation_profiler_ = std::make_unique<TranslationProfiler>();
+  }
+
+  StartTranslationWorkers();
+
+  if (cvars::invalidate_written_code) {
+    memory_->SetCodeWriteCallback(CodeWriteCallbackThunk, this);
+  }
+
+  if (!cvars::guest_sampling_profiler_path.empty()) {
+    sampling_profiler_ = std::make_unique<SamplingProfiler>(this);
+    if (!sampling_profiler_->Start(cvars::guest_sampling_profiler_path,
+                                   cvars::guest_sampling_profiler_interval)) {
+      sampling_profiler_.reset();
+    }
+  }
+
   return true;
 }
 
+void Processor::StartTranslationWorkers() {
+  int32_t worker_count = cvars::background_translation_threads;
+  if (worker_count < 0) {
+    worker_count =
+        std::max(int32_t(threading::logical_processor_count()) - 1, 1);
+    if (device_profile::IsLowMemory()) {
+      // Every translation holds its own HIR and code buffers.
+      worker_count = std::max(worker_count / 2, 1);
+    }
+  }
+  for (int32_t i = 0; i < worker_count; ++i) {
+    threading::Thread::CreationParameters params;
+    params.initial_priority = threading::ThreadPriority::kBelowNormal;
+    auto worker = threading::Thread::Create(
+        params, [this, i, worker_count]() {
+          TranslationWorkerMain(uint32_t(i), uint32_t(worker_count));
+        });
+    if (!worker) {
+      XELOGE("Failed to create background translation thread {}", i);
+      break;
+    }
+    worker->set_name(fmt::format("Translation Worker {}", i));
+    translation_workers_.push_back(std::move(worker));
+  }
+  if (!translation_workers_.empty()) {
+    XELOGI("Translating guest functions in the background on {} threads",
+           translation_workers_.size());
+  }
+}
+
+void Processor::ShutdownTranslationWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(translation_queue_mutex_);
+    translation_workers_shutdown_ = true;
+    translation_queue_.clear();
+    optimization_queue_.clear();
+  }
+  translation_queue_cond_.notify_all();
+  for (auto& worker : translation_workers_) {
+    threading::Wait(worker.get(), false);
+  }
+  translation_workers_.clear();
+}
+
+void Processor::TranslationWorkerMain(uint32_t worker_index,
+                                      uint32_t worker_count) {
+  std::unique_lock<std::mutex> lock(translation_queue_mutex_);
+  while (true) {
+    // Retranslations requested from the exception handler don't notify, so
+    // polling for them too.
+    translation_queue_cond_.wait_for(
+        lock, std::chrono::milliseconds(100), [this]() {
+          return translation_workers_shutdown_ ||
+                 !optimization_queue_.empty() || !translation_queue_.empty() ||
+                 retranslations_pending_.load(std::memory_order_relaxed);
+        });
+    if (translation_workers_shutdown_) {
+      break;
+    }
+    if (retranslations_pending_.load(std::memory_order_acquire)) {
+      lock.unlock();
+      FlushRetranslations();
+      lock.lock();
+      continue;
+    }
+    // Paused while the device is overheating. Sleeping rather than waiting for
+    // the condition variable not to take the notifications from the workers
+    // still allowed to run.
+    if (worker_index >= device_profile::GetAllowedWorkerCount(worker_count)) {
+      lock.unlock();
+      threading::Sleep(std::chrono::milliseconds(100));
+      lock.lock();
+      continue;
+    }
+
+    // Hot functions are already known to matter, do them first.
+    if (!optimization_queue_.empty()) {
+      GuestFunction* function = optimization_queue_.front();
+      optimization_queue_.pop_front();
+      ++translations_in_progress_;
+      lock.unlock();
+      RetranslateOptimized(function);
+      lock.lock();
+      if (!--translations_in_progress_) {
+        translation_idle_cond_.notify_all();
+      }
+      continue;
+    }
+
+    uint32_t address = translation_queue_.front();
+    translation_queue_.pop_front();
+    ++translations_in_progress_;
+    lock.unlock();
+
+    // Something else may have already asked for the function, in which case
+    // it's either ready or being translated by that thread.
+    if (!entry_table_.Get(address)) {
+      ResolveFunction(address, true);
+    }
+
+    lock.lock();
+    if (!--translations_in_progress_) {
+      translation_idle_cond_.notify_all();
+    }
+  }
+}
+
+void Processor::QueueFunctionTranslation(uint32_t address) {
+  if (translation_workers_.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(translation_queue_mutex_);
+    translation_queue_.push_back(address);
+  }
+  translation_queue_cond_.notify_one();
+}
+
+void Processor::QueueFunctionTranslations(
+    const std::vector<uint32_t>& addresses) {
+  if (translation_workers_.empty() || addresses.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(translation_queue_mutex_);
+    translation_queue_.insert(translation_queue_.end(), addresses.cbegin(),
+                              addresses.cend());
+  }
+  translation_queue_cond_.notify_all();
+}
+
+void Processor::TranslateFunctionsAheadOfTime(
+    const std::vector<uint32_t>& addresses) {
+  if (addresses.empty()) {
+    return;
+  }
+  uint64_t start_time = Clock::QueryHostUptimeMillis();
+  std::atomic<size_t> next_index(0);
+  std::atomic<uint32_t> translated_count(0);
+  auto translate = [&]() {
+    size_t index;
+    while ((index = next_index.fetch_add(1, std::memory_order_relaxed)) <
+           addresses.size()) {
+      uint32_t address = addresses[index];
+      // Restored from the persistent code cache or requested concurrently.
+      if (entry_table_.Get(address)) {
+        continue;
+      }
+      if (ResolveFunction(address, true)) {
+        translated_count.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  };
+  // The calling thread translates too.
+  uint32_t thread_count = std::max(threading::logical_processor_count(), 1u);
+  std::vector<std::unique_ptr<threading::Thread>> threads;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    threading::Thread::CreationParameters params;
+    auto thread = threading::Thread::Create(params, translate);
+    if (!thread) {
+      break;
+    }
+    thread->set_name(fmt::format("Ahead-of-Time Translation {}", i));
+    threads.push_back(std::move(thread));
+  }
+  translate();
+  for (auto& thread : threads) {
+    threading::Wait(thread.get(), false);
+  }
+  XELOGI("Translated {} of {} functions ahead of time in {} ms on {} threads",
+         translated_count.load(), addresses.size(),
+         Clock::QueryHostUptimeMillis() - start_time, threads.size() + 1);
+}
+
+bool Processor::OptimizeFunction(GuestFunction* function) {
+  FlushRetranslations();
+  if (!function->BeginTierUp()) {
+    return false;
+  }
+  if (translation_workers_.empty()) {
+    RetranslateOptimized(function);
+    return true;
+  }
+  {
+    std::lock_guard<std::mutex> lock(translation_queue_mutex_);
+    optimization_queue_.push_back(function);
+  }
+  translation_queue_cond_.notify_one();
+  return true;
+}
+
+bool Processor::RetranslateFunction(GuestFunction* function) {
+  if (!function->RequestRetranslation()) {
+    return false;
+  }
+  // Only recorded here, as this may be called from the exception handler,
+  // where translating (or waking the workers) is not safe.
+  std::lock_guard<std::mutex> lock(pending_retranslation_mutex_);
+  pending_retranslations_.push_back(function);
+  retranslations_pending_.store(true, std::memory_order_release);
+  return true;
+}
+
+void Processor::FlushRetranslations() {
+  if (!retranslations_pending_.load(std::memory_order_acquire)) {
+    return;
+  }
+  // Translating may resolve other functions, which flush too, while this
+  // thread may be holding the retranslation lock.
+  static thread_local bool flushing = false;
+  if (flushing) {
+    return;
+  }
+  std::vector<GuestFunction*> functions;
+  {
+    std::lock_guard<std::mutex> lock(pending_retranslation_mutex_);
+    functions.swap(pending_retranslations_);
+    retranslations_pending_.store(false, std::memory_order_relaxed);
+  }
+  if (functions.empty()) {
+    return;
+  }
+  if (!translation_workers_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(translation_queue_mutex_);
+      optimization_queue_.insert(optimization_queue_.end(), functions.cbegin(),
+                                 functions.cend());
+    }
+    translation_queue_cond_.notify_all();
+    return;
+  }
+  flushing = true;
+  for (GuestFunction* function : functions) {
+    RetranslateOptimized(function);
+  }
+  flushing = false;
+}
+
+void Processor::RetranslateOptimized(GuestFunction* function) {
+  std::lock_guard<std::mutex> lock(retranslation_mutex_);
+  // Anything recorded from this point on may be missed by this translation.
+  function->ClearRetranslationRequest();
+  // Before reading the code, so writes during the translation are not missed,
+  // as the code has been unwatched if this is for invalidation.
+  WatchFunctionCode(function);
+  // The new code replaces the old one in the indirection table, threads still
+  // running the previous code finish with it as it's never freed.
+  if (!frontend_->DefineFunction(function, debug_info_flags_)) {
+    XELOGW("Failed to retranslate function {:08X}, keeping previous code",
+           function->address());
+  }
+  // In case the function has grown.
+  WatchFunctionCode(function);
+}
+
+void Processor::WatchFunctionCode(GuestFunction* function) {
+  if (!cvars::invalidate_written_code || !function->end_address()) {
+    return;
+  }
+  memory_->WatchCodeRange(function->address(),
+                          function->end_address() + 4 - function->address());
+}
+
+void Processor::CodeWriteCallbackThunk(void* context, uint32_t address,
+                                       uint32_t length) {
+  auto processor = reinterpret_cast<Processor*>(context);
+  std::lock_guard<std::mutex> lock(processor->code_write_mutex_);
+  processor->pending_code_writes_.emplace_back(address, length);
+  processor->code_writes_pending_.store(true, std::memory_order_release);
+  processor->code_write_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t Processor::FlushCodeWrites() {
+  FlushRetranslations();
+  if (!code_writes_pending_.load(std::memory_order_acquire)) {
+    return 0;
+  }
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  {
+    std::lock_guard<std::mutex> lock(code_write_mutex_);
+    ranges.swap(pending_code_writes_);
+    code_writes_pending_.store(false, std::memory_order_relaxed);
+  }
+  size_t invalidated_count = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> inaccessible_ranges;
+  for (const auto& range : ranges) {
+    // Translating from decommitted memory would crash, keeping the range for
+    // when the memory is reused.
+    BaseHeap* heap = memory_->LookupHeap(range.first);
+    if (!heap || heap->QueryRangeAccess(range.first,
+                                        range.first + range.second - 1) ==
+                     xe::memory::PageAccess::kNoAccess) {
+      inaccessible_ranges.push_back(range);
+      continue;
+    }
+    invalidated_count += InvalidateFunctionsInRange(range.first, range.second);
+  }
+  if (!inaccessible_ranges.empty()) {
+    std::lock_guard<std::mutex> lock(code_write_mutex_);
+    pending_code_writes_.insert(pending_code_writes_.end(),
+                                inaccessible_ranges.cbegin(),
+                                inaccessible_ranges.cend());
+  }
+  if (invalidated_count) {
+    invalidated_function_count_.fetch_add(invalidated_count,
+                                          std::memory_order_relaxed);
+    XELOGD("Retranslated {} functions in {} written code ranges",
+           invalidated_count, ranges.size() - inaccessible_ranges.size());
+  }
+  return invalidated_count;
+}
+
+void Processor::CancelFunctionTranslations(Module* module) {
+  {
+    std::lock_guard<std::mutex> lock(pending_retranslation_mutex_);
+    pending_retranslations_.erase(
+        std::remove_if(pending_retranslations_.begin(),
+                       pending_retranslations_.end(),
+                       [module](GuestFunction* function) {
+                         return !module || function->module() == module;
+                       }),
+        pending_retranslations_.end());
+  }
+  if (translation_workers_.empty()) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(translation_queue_mutex_);
+  optimization_queue_.erase(
+      std::remove_if(optimization_queue_.begin(), optimization_queue_.end(),
+                     [module](GuestFunction* function) {
+                       return !module || function->module() == module;
+                     }),
+      optimization_queue_.end());
+  translation_queue_.erase(
+      std::remove_if(translation_queue_.begin(), translation_queue_.end(),
+                     [module](uint32_t address) {
+                       return !module || module->ContainsAddress(address);
+                     }),
+      translation_queue_.end());
+  // Translation of functions from other modules may be in progress too, but
+  // waiting for everything is simpler and this is rare.
+  translation_idle_cond_.wait(
+      lock, [this]() { return !translations_in_progress_; });
+}
+
 void Processor::PreLaunch() {
   if (cvars::break_on_start) {
     // Start paused.
@@ -176,6 +592,12 @@ bool Processor::AddModule(std::unique_ptr<Module> module) {
 }
 
 void Processor::RemoveModule(const std::string_view name) {
+  // Workers translating code from the module may need the global lock, so wait
+  // for them before taking it.
+  if (Module* module = GetModule(name)) {
+    CancelFunctionTranslations(module);
+  }
+
   auto global_lock = global_critical_region_.Acquire();
 
   auto itr =
@@ -249,7 +671,58 @@ void Processor::RemoveFunctionByAddress(uint32_t address) {
   entry_table_.Delete(address);
 }
 
+size_t Processor::InvalidateFunctionsInRange(uint32_t address,
+                                             uint32_t length) {
+  size_t invalidated_count = 0;
+  bool context_write_summary_grown = false;
+  for (Function* function : entry_table_.FindInRange(address, length)) {
+    if (!function->is_guest()) {
+      continue;
+    }
+    auto guest_function = static_cast<GuestFunction*>(function);
+    if (!guest_function->machine_code()) {
+      continue;
+    }
+    auto old_summary = guest_function->context_write_summary();
+    // Synchronously, so the new code is used as soon as this returns. The
+    // persistent code cache validates the guest code of each function when
+    // restoring it, so the stale record is replaced the next time as well.
+    RetranslateOptimized(guest_function);
+    ++invalidated_count;
+    if (old_summary && guest_function->context_write_summary_used()) {
+      auto new_summary = guest_function->context_write_summary();
+      if (!new_summary || !old_summary->Contains(*new_summary)) {
+        context_write_summary_grown = true;
+      }
+    }
+  }
+  if (context_write_summary_grown) {
+    // The callers may rely on the registers not being written by the patched
+    // code. Which functions are the callers is not tracked, but patching code
+    // already executed is rare.
+    XELOGW(
+        "Patched code writes guest registers its callers may keep, "
+        "retranslating all functions");
+    for (Function* function : entry_table_.FindInRange(0, UINT32_MAX)) {
+      if (!function->is_guest()) {
+        continue;
+      }
+      auto guest_function = static_cast<GuestFunction*>(function);
+      if (guest_function->machine_code()) {
+        RetranslateOptimized(guest_function);
+        ++invalidated_count;
+      }
+    }
+  }
+  return invalidated_count;
+}
+
 Function* Processor::ResolveFunction(uint32_t address) {
+  return ResolveFunction(address, false);
+}
+
+Function* Processor::ResolveFunction(uint32_t address, bool speculative) {
+  FlushRetranslations();
   Entry* entry;
   Entry::Status status = entry_table_.GetOrCreate(address, &entry);
   if (status == Entry::STATUS_NEW) {
@@ -268,9 +741,10 @@ Function* Processor::ResolveFunction(uint32_t address) {
       return nullptr;
     }
     //only add it to the list of resolved functions if resolving succeeded
+    //speculative translations don't mean the guest actually needs it though
     auto module_for = function->module();
 
-    auto xexmod = dynamic_cast<XexModule*>(module_for);
+    auto xexmod = speculative ? nullptr : dynamic_cast<XexModule*>(module_for);
     if (xexmod) {
       auto addr_flags = xexmod->GetInstructionAddressFlags(address);
       if (addr_flags) {
@@ -332,6 +806,21 @@ Function* Processor::LookupFunction(Module* module, uint32_t address) {
   return function;
 }
 
+Processor::TranslationStatistics Processor::GetTranslationStatistics() const {
+  TranslationStatistics statistics;
+  statistics.translated_count =
+      translated_function_count_.load(std::memory_order_relaxed);
+  statistics.restored_count =
+      restored_function_count_.load(std::memory_order_relaxed);
+  statistics.translation_host_ticks =
+      function_translation_host_ticks_.load(std::memory_order_relaxed);
+  statistics.code_write_count =
+      code_write_count_.load(std::memory_order_relaxed);
+  statistics.invalidated_count =
+      invalidated_function_count_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
 bool Processor::DemandFunction(Function* function) {
   // Lock function for generation. If it's already being generated
   // by another thread this will block and return DECLARED.
@@ -340,11 +829,32 @@ bool Processor::DemandFunction(Function* function) {
   if (symbol_status == Symbol::Status::kNew) {
     // Symbol is undefined, so define now.
     assert_true(function->is_guest());
-    if (!frontend_->DefineFunction(static_cast<GuestFunction*>(function),
-                                   debug_info_flags_)) {
-      function->set_status(Symbol::Status::kFailed);
-      return false;
+    auto guest_function = static_cast<GuestFunction*>(function);
+    // Code from the persistent cache carries no debug info, so only use it
+    // when none is requested.
+    bool restored =
+        !debug_info_flags_ && backend_->RestoreGuestFunction(guest_function);
+    if (restored) {
+      restored_function_count_.fetch_add(1, std::memory_order_relaxed);
+      restored_functions_metric.Add();
+    } else {
+      uint64_t translation_start_ticks = Clock::QueryHostTickCount();
+      bool defined =
+          frontend_->DefineFunction(guest_function, debug_info_flags_);
+      uint64_t translation_ticks =
+          Clock::QueryHostTickCount() - translation_start_ticks;
+      function_translation_host_ticks_.fetch_add(translation_ticks,
+                                                 std::memory_order_relaxed);
+      if (!defined) {
+        function->set_status(Symbol::Status::kFailed);
+        return false;
+      }
+      translated_function_count_.fetch_add(1, std::memory_order_relaxed);
+      translated_functions_metric.Add();
+      translation_time_metric.Observe(translation_ticks * 1000000 /
+                                      Clock::QueryHostTickFrequency());
     }
+    WatchFunctionCode(guest_function);
 
     // Before we give the symbol back to the rest, let the debugger know.
     OnFunctionDefined(function);
@@ -575,6 +1085,14 @@ std::vector<ThreadDebugInfo*> Processor::QueryThreadDebugInfos() {
   return result;
 }
 
+void Processor::VisitThreadDebugInfos(
+    const std::function<void(ThreadDebugInfo*)>& visitor) {
+  auto global_lock = global_critical_region_.Acquire();
+  for (auto& it : thread_debug_infos_) {
+    visitor(it.second.get());
+  }
+}
+
 ThreadDebugInfo* Processor::QueryThreadDebugInfo(uint32_t thread_id) {
   auto global_lock = global_critical_region_.Acquire();
   const auto& it = thread_debug_infos_.find(thread_id);
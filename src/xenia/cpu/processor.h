@@ -10,14 +10,20 @@
 #ifndef XENIA_CPU_PROCESSOR_H_
 #define XENIA_CPU_PROCESSOR_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "xenia/base/cvar.h"
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/debug_listener.h"
 #include "xenia/cpu/entry_table.h"
@@ -25,8 +31,10 @@
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/sampling_profiler.h"
 #include "xenia/cpu/thread_debug_info.h"
 #include "xenia/cpu/thread_state.h"
+#include "xenia/cpu/translation_profiler.h"
 #include "xenia/memory.h"
 
 DECLARE_bool(debug);
@@ -68,6 +76,10 @@ class Processor {
 
   Memory* memory() const { return memory_; }
   StackWalker* stack_walker() const { return stack_walker_.get(); }
+  // Null unless translation_profiling is enabled.
+  TranslationProfiler* translation_profiler() const {
+    return translation_profiler_.get();
+  }
   ppc::PPCFrontend* frontend() const { return frontend_.get(); }
   backend::Backend* backend() const { return backend_.get(); }
   ExportResolver* export_resolver() const { return export_resolver_; }
@@ -113,12 +125,62 @@ class Processor {
   Function* QueryFunction(uint32_t address);
   std::vector<Function*> FindFunctionsWithAddress(uint32_t address);
   void RemoveFunctionByAddress(uint32_t address);
+  // Retranslates the already translated functions overlapping the guest code
+  // range after it has been modified, such as by a patch, leaving the rest of
+  // the code intact. Returns the number of functions retranslated.
+  size_t InvalidateFunctionsInRange(uint32_t address, uint32_t length);
+  // With invalidate_written_code, retranslates the functions in the pages of
+  // translated code written since the last call, returning their number.
+  // Called when the guest invalidates the instruction cache, after writing the
+  // code, as the writes are detected before they happen.
+  size_t FlushCodeWrites();
 
   Function* LookupFunction(uint32_t address);
   Module* LookupModule(uint32_t address);
   Function* LookupFunction(Module* module, uint32_t address);
   Function* ResolveFunction(uint32_t address);
 
+  // Schedules a function for translation on the background translation
+  // workers, ahead of the guest demanding it. Guest threads resolving the
+  // function while it's being translated wait for the result. Does nothing if
+  // background translation is disabled.
+  bool has_translation_workers() const { return !translation_workers_.empty(); }
+  void QueueFunctionTranslation(uint32_t address);
+  void QueueFunctionTranslations(const std::vector<uint32_t>& addresses);
+  // Translates all the functions that aren't translated yet on all logical
+  // processors, returning once they're done.
+  void TranslateFunctionsAheadOfTime(const std::vector<uint32_t>& addresses);
+  // Retranslates a hot baseline tier function with all optimizations, in the
+  // background if possible. Returns false if the function doesn't need it or
+  // another thread has already requested it.
+  bool OptimizeFunction(GuestFunction* function);
+  // Requests translating the function again to pick up what has been recorded
+  // about it since. Safe to call from the exception handler, as it only records
+  // the request, which is carried out by the background translation workers or
+  // otherwise on the next thread to resolve or tier up a function or to flush
+  // the code writes. Returns false if a retranslation is already pending.
+  bool RetranslateFunction(GuestFunction* function);
+  // Drops queued translations for functions in the module (or all of them if
+  // null) and waits for the ones in progress to complete. Must be called before
+  // the module code is freed, without holding the global lock as the workers
+  // may need it.
+  void CancelFunctionTranslations(Module* module);
+
+  struct TranslationStatistics {
+    uint64_t translated_count;
+    uint64_t restored_count;
+    // Host ticks spent in the frontend and the backend defining the functions,
+    // not including the persistent code cache restoration.
+    uint64_t translation_host_ticks;
+    // Ranges of watched pages with translated code written to, and functions
+    // retranslated for that, with invalidate_written_code.
+    uint64_t code_write_count;
+    uint64_t invalidated_count;
+  };
+  // Totals since the processor was set up, for the functions defined by any
+  // thread.
+  TranslationStatistics GetTranslationStatistics() const;
+
   bool Execute(ThreadState* thread_state, uint32_t address);
   bool ExecuteRaw(ThreadState* thread_state, uint32_t address);
   uint64_t Execute(ThreadState* thread_state, uint32_t address, uint64_t args[],
@@ -140,6 +202,11 @@ class Processor {
   // Returns the debugger info for the given thread.
   ThreadDebugInfo* QueryThreadDebugInfo(uint32_t thread_id);
 
+  // Calls the visitor for the debugger info of every thread with the global
+  // lock held, so no thread can be created or destroyed meanwhile.
+  void VisitThreadDebugInfos(
+      const std::function<void(ThreadDebugInfo*)>& visitor);
+
   // Adds a breakpoint to the debugger and activates it (if enabled).
   // The given breakpoint will not be owned by the debugger and must remain
   // allocated so long as it is added.
@@ -239,8 +306,19 @@ class Processor {
   uint32_t CalculateNextGuestInstruction(ThreadDebugInfo* thread_info,
                                          uint32_t current_pc);
 
+  Function* ResolveFunction(uint32_t address, bool speculative);
   bool DemandFunction(Function* function);
 
+  void StartTranslationWorkers();
+  void ShutdownTranslationWorkers();
+  void TranslationWorkerMain(uint32_t worker_index, uint32_t worker_count);
+  void RetranslateOptimized(GuestFunction* function);
+  // Queues or carries out the retranslations requested by RetranslateFunction.
+  void FlushRetranslations();
+  void WatchFunctionCode(GuestFunction* function);
+  static void CodeWriteCallbackThunk(void* context, uint32_t address,
+                                     uint32_t length);
+
   Memory* memory_ = nullptr;
   std::unique_ptr<StackWalker> stack_walker_;
 
@@ -249,6 +327,12 @@ class Processor {
 
   // Which debug features are enabled in generated code.
   uint32_t debug_info_flags_ = 0;
+
+  std::atomic<uint64_t> translated_function_count_{0};
+  std::atomic<uint64_t> restored_function_count_{0};
+  std::atomic<uint64_t> function_translation_host_ticks_{0};
+  std::atomic<uint64_t> code_write_count_{0};
+  std::atomic<uint64_t> invalidated_function_count_{0};
   // If specified, the file trace data gets written to when running.
   std::filesystem::path functions_trace_path_;
   std::unique_ptr<ChunkedMappedMemoryWriter> functions_trace_file_;
@@ -271,6 +355,32 @@ class Processor {
   // TODO(benvanik): cleanup/change structures.
   std::vector<Breakpoint*> breakpoints_;
 
+  // Background translation of functions that are likely to be called.
+  std::vector<std::unique_ptr<xe::threading::Thread>> translation_workers_;
+  std::mutex translation_queue_mutex_;
+  std::condition_variable translation_queue_cond_;
+  std::condition_variable translation_idle_cond_;
+  std::deque<uint32_t> translation_queue_;
+  std::deque<GuestFunction*> optimization_queue_;
+  uint32_t translations_in_progress_ = 0;
+  bool translation_workers_shutdown_ = false;
+  // Tier-ups and retranslations for new information may race for a function.
+  std::mutex retranslation_mutex_;
+  // Retranslations requested with RetranslateFunction, waiting for
+  // FlushRetranslations outside the exception handler.
+  std::mutex pending_retranslation_mutex_;
+  std::vector<GuestFunction*> pending_retranslations_;
+  std::atomic<bool> retranslations_pending_{false};
+
+  // Written code ranges waiting for FlushCodeWrites, added by the memory with
+  // the global lock held.
+  std::mutex code_write_mutex_;
+  std::vector<std::pair<uint32_t, uint32_t>> pending_code_writes_;
+  std::atomic<bool> code_writes_pending_{false};
+
+  std::unique_ptr<SamplingProfiler> sampling_profiler_;
+  std::unique_ptr<TranslationProfiler> translation_profiler_;
+
   Irql irql_;
 };
 
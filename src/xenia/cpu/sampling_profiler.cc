@@ -0,0 +1,203 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/sampling_profiler.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/backend/code_cache.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/stack_walker.h"
+#include "xenia/cpu/thread_debug_info.h"
+
+namespace xe {
+namespace cpu {
+
+SamplingProfiler::SamplingProfiler(Processor* processor)
+    : processor_(processor) {}
+
+SamplingProfiler::~SamplingProfiler() { Stop(); }
+
+bool SamplingProfiler::Start(const std::filesystem::path& output_path,
+                             uint32_t interval_ms) {
+  if (thread_) {
+    return false;
+  }
+  output_path_ = output_path;
+  interval_ms_ = std::max(interval_ms, uint32_t(1));
+  stop_event_ = threading::Event::CreateManualResetEvent(false);
+  threading::Thread::CreationParameters params;
+  params.initial_priority = threading::ThreadPriority::kHighest;
+  thread_ = threading::Thread::Create(params, [this]() { ThreadMain(); });
+  if (!thread_) {
+    XELOGE("Failed to create the guest sampling profiler thread");
+    stop_event_.reset();
+    return false;
+  }
+  thread_->set_name("Guest Sampling Profiler");
+  XELOGI("Sampling guest threads every {} ms into {}", interval_ms_,
+         xe::path_to_utf8(output_path_));
+  return true;
+}
+
+void SamplingProfiler::Stop() {
+  if (!thread_) {
+    return;
+  }
+  stop_event_->Set();
+  threading::Wait(thread_.get(), false);
+  thread_.reset();
+  stop_event_.reset();
+  if (WriteCollapsedStacks()) {
+    XELOGI("Wrote {} guest samples ({} distinct stacks) to {}", sample_count_,
+           stack_counts_.size(), xe::path_to_utf8(output_path_));
+  }
+}
+
+void SamplingProfiler::ThreadMain() {
+  std::vector<std::pair<std::string, Sample>> samples;
+  while (threading::Wait(stop_event_.get(), false,
+                         std::chrono::milliseconds(interval_ms_)) ==
+         threading::WaitResult::kTimeout) {
+    // Threads are suspended one at a time, and while one is, only the raw
+    // addresses are copied - nothing is allocated and no symbols or unwind
+    // data are looked up, as the thread may be holding the heap lock or the
+    // debug help library lock. Everything is resolved after resuming it.
+    samples.clear();
+    processor_->VisitThreadDebugInfos([&](ThreadDebugInfo* thread_info) {
+      if (thread_info->state != ThreadDebugInfo::State::kAlive ||
+          thread_info->suspended || !thread_info->thread ||
+          !thread_info->thread->can_debugger_suspend() ||
+          !thread_info->thread->thread_state()) {
+        return;
+      }
+      auto& sample = samples.emplace_back();
+      sample.first = thread_info->thread->thread_name();
+      threading::Thread* thread = thread_info->thread->thread();
+      if (!thread || !thread->Suspend()) {
+        samples.pop_back();
+        return;
+      }
+      sample.second.host_pc = 0;
+      StackWalker* stack_walker = processor_->stack_walker();
+      if (stack_walker) {
+        // No frames to walk, only the context with the PC is read, as walking
+        // needs the function tables.
+        HostThreadContext host_context;
+        host_context.rip = 0;
+        stack_walker->CaptureStackTrace(thread->native_handle(), nullptr, 0, 0,
+                                        nullptr, &host_context);
+        sample.second.host_pc = host_context.rip;
+      }
+      if (!processor_->backend()->PopulatePseudoStacktrace(
+              thread_info->thread->thread_state(), &sample.second.stack)) {
+        sample.second.stack.count = 0;
+      }
+      thread->Resume();
+    });
+    for (const auto& sample : samples) {
+      RecordSample(sample.first, sample.second);
+    }
+  }
+}
+
+void SamplingProfiler::RecordSample(const std::string& thread_name,
+                                    const Sample& sample) {
+  // Outermost frame first, the thread as the root.
+  stack_buffer_ = thread_name.empty() ? "[thread]" : thread_name;
+  for (uint32_t i = sample.stack.count; i-- > 0;) {
+    uint32_t function_address =
+        LookupFunctionAddress(sample.stack.return_addrs[i]);
+    stack_buffer_ += ';';
+    stack_buffer_ += GetFunctionName(function_address);
+  }
+  // The stackpoints only hold return addresses, the innermost function is
+  // only known from the host PC when that is in guest code.
+  GuestFunction* leaf = nullptr;
+  if (sample.host_pc) {
+    backend::CodeCache* code_cache = processor_->backend()->code_cache();
+    if (code_cache) {
+      leaf = code_cache->LookupFunction(sample.host_pc);
+    }
+  }
+  stack_buffer_ += ';';
+  if (leaf) {
+    stack_buffer_ += GetFunctionName(leaf->address());
+  } else {
+    stack_buffer_ += sample.host_pc ? "[host]" : "[unknown]";
+  }
+  ++stack_counts_[stack_buffer_];
+  ++sample_count_;
+}
+
+uint32_t SamplingProfiler::LookupFunctionAddress(uint32_t guest_address) {
+  auto it = function_addresses_.find(guest_address);
+  if (it != function_addresses_.end()) {
+    return it->second;
+  }
+  uint32_t function_address = 0;
+  for (Function* function :
+       processor_->FindFunctionsWithAddress(guest_address)) {
+    if (function->is_guest()) {
+      function_address = function->address();
+      break;
+    }
+  }
+  function_addresses_.emplace(guest_address, function_address);
+  return function_address;
+}
+
+const std::string& SamplingProfiler::GetFunctionName(
+    uint32_t function_address) {
+  auto it = function_names_.find(function_address);
+  if (it != function_names_.end()) {
+    return it->second;
+  }
+  std::string name;
+  if (!function_address) {
+    name = "[unknown]";
+  } else {
+    Function* function = processor_->QueryFunction(function_address);
+    if (function && !function->name().empty()) {
+      name = function->name();
+    } else {
+      name = fmt::format("sub_{:08X}", function_address);
+    }
+    // Separators of the collapsed format.
+    for (char& c : name) {
+      if (c == ';' || c == ' ') {
+        c = '_';
+      }
+    }
+  }
+  return function_names_.emplace(function_address, std::move(name))
+      .first->second;
+}
+
+bool SamplingProfiler::WriteCollapsedStacks() {
+  FILE* file = xe::filesystem::OpenFile(output_path_, "wb");
+  if (!file) {
+    XELOGE("Failed to open {} to write the guest samples",
+           xe::path_to_utf8(output_path_));
+    return false;
+  }
+  for (const auto& it : stack_counts_) {
+    fmt::print(file, "{} {}\n", it.first, it.second);
+  }
+  fclose(file);
+  return true;
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,75 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_SAMPLING_PROFILER_H_
+#define XENIA_CPU_SAMPLING_PROFILER_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "xenia/base/threading.h"
+#include "xenia/cpu/backend/backend.h"
+
+namespace xe {
+namespace cpu {
+
+class Processor;
+struct ThreadDebugInfo;
+
+// Periodically samples where every guest thread is, using the host/guest
+// stackpoints for the callers and the host PC for the innermost function, and
+// aggregates the stacks by guest function. The result is written as collapsed
+// stacks (one "thread;outer;...;inner count" line per distinct stack), the
+// input format of the common flame graph tools.
+class SamplingProfiler {
+ public:
+  explicit SamplingProfiler(Processor* processor);
+  ~SamplingProfiler();
+
+  bool Start(const std::filesystem::path& output_path, uint32_t interval_ms);
+  // Stops sampling and writes what has been gathered.
+  void Stop();
+
+ private:
+  struct Sample {
+    // 0 if it couldn't be captured.
+    uint64_t host_pc;
+    backend::GuestPseudoStackTrace stack;
+  };
+
+  void ThreadMain();
+  void SampleThread(ThreadDebugInfo* thread_info);
+  void RecordSample(const std::string& thread_name, const Sample& sample);
+  // Guest address of the function containing the address, 0 if unknown.
+  uint32_t LookupFunctionAddress(uint32_t guest_address);
+  const std::string& GetFunctionName(uint32_t function_address);
+  bool WriteCollapsedStacks();
+
+  Processor* processor_;
+  std::filesystem::path output_path_;
+  uint32_t interval_ms_ = 1;
+  std::unique_ptr<threading::Event> stop_event_;
+  std::unique_ptr<threading::Thread> thread_;
+
+  // Only accessed by the sampling thread until it's stopped.
+  std::unordered_map<uint32_t, uint32_t> function_addresses_;
+  std::unordered_map<uint32_t, std::string> function_names_;
+  std::map<std::string, uint64_t> stack_counts_;
+  std::string stack_buffer_;
+  uint64_t sample_count_ = 0;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_SAMPLING_PROFILER_H_
@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("BRANCH_FALSE_SUNK_COMPARE", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    Value* less = b.CompareSLT(LoadGPR(b, 4), LoadGPR(b, 5));
+    // Flag-setting arithmetic between the comparison and the branch.
+    StoreGPR(b, 6, b.Add(LoadGPR(b, 4), LoadGPR(b, 5)));
+    StoreGPR(b, 3, b.LoadConstantUint64(1));
+    auto skip = b.NewLabel();
+    b.BranchFalse(less, skip);
+    StoreGPR(b, 3, b.LoadConstantUint64(2));
+    b.MarkLabel(skip);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = uint64_t(-1);
+        ctx->r[5] = 1;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 2);
+        REQUIRE(ctx->r[6] == 0);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 1;
+        ctx->r[5] = uint64_t(-1);
+      },
+      [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 1); });
+}
+
+TEST_CASE("BRANCH_TRUE_DUPLICATED_COMPARE", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    Value* below = b.CompareULT(LoadGPR(b, 4), LoadGPR(b, 5));
+    // Also used by the store, like a condition register field.
+    StoreGPR(b, 7, b.ZeroExtend(below, INT64_TYPE));
+    StoreGPR(b, 6, b.Sub(LoadGPR(b, 4), LoadGPR(b, 5)));
+    StoreGPR(b, 3, b.LoadConstantUint64(1));
+    auto skip = b.NewLabel();
+    b.BranchTrue(below, skip);
+    StoreGPR(b, 3, b.LoadConstantUint64(2));
+    b.MarkLabel(skip);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 1;
+        ctx->r[5] = uint64_t(-1);
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 1);
+        REQUIRE(ctx->r[7] == 1);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = uint64_t(-1);
+        ctx->r[5] = 1;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 2);
+        REQUIRE(ctx->r[7] == 0);
+      });
+}
@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("STORE_CONTEXT_OVERWRITTEN_ACROSS_BLOCKS", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreGPR(b, 3, b.LoadConstantUint64(1));
+    auto overwrite = b.NewLabel();
+    b.Branch(overwrite);
+    b.MarkLabel(overwrite);
+    StoreGPR(b, 3, LoadGPR(b, 4));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 2; },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 2); });
+}
+
+TEST_CASE("STORE_CONTEXT_LIVE_ON_ONE_PATH", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreGPR(b, 3, b.LoadConstantUint64(1));
+    auto skip = b.NewLabel();
+    b.BranchTrue(LoadGPR(b, 5), skip);
+    StoreGPR(b, 3, LoadGPR(b, 4));
+    b.MarkLabel(skip);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 2;
+        ctx->r[5] = 0;
+      },
+      [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 2); });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 2;
+        ctx->r[5] = 1;
+      },
+      [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 1); });
+}
+
+TEST_CASE("TRUNCATE_NARROWED_ADD", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    Value* sum =
+        b.Add(b.ZeroExtend(b.Truncate(LoadGPR(b, 4), INT32_TYPE), INT64_TYPE),
+              b.LoadConstantUint64(0x100000001ull));
+    // The wide sum is also stored, the truncated one is computed separately.
+    StoreGPR(b, 5, sum);
+    StoreGPR(b, 3, b.ZeroExtend(b.Truncate(sum, INT32_TYPE), INT64_TYPE));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 0xFFFFFFFFFFFFFFFFull; },
+           [](PPCContext* ctx) {
+             REQUIRE(ctx->r[3] == 0);
+             REQUIRE(ctx->r[5] == 0x200000000ull);
+           });
+}
@@ -0,0 +1,126 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/translation_profiler.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+
+namespace xe {
+namespace cpu {
+
+namespace {
+
+bool IsFasterToTranslate(const TranslationProfiler::FunctionProfile& a,
+                         const TranslationProfiler::FunctionProfile& b) {
+  return a.total_ticks() > b.total_ticks();
+}
+
+}  // namespace
+
+uint64_t TranslationProfiler::FunctionProfile::total_ticks() const {
+  uint64_t ticks = 0;
+  for (uint64_t stage : stage_ticks) {
+    ticks += stage;
+  }
+  return ticks;
+}
+
+TranslationProfiler::~TranslationProfiler() { LogReport(); }
+
+void TranslationProfiler::RecordPass(const char* name, uint64_t ticks) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PassTotals& totals = passes_[name];
+  ++totals.run_count;
+  totals.ticks += ticks;
+  totals.max_ticks = std::max(totals.max_ticks, ticks);
+}
+
+void TranslationProfiler::RecordFunction(const FunctionProfile& profile) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++function_count_;
+  guest_instr_count_ += profile.guest_instr_count;
+  for (size_t i = 0; i < size_t(Stage::kCount); ++i) {
+    stage_ticks_[i] += profile.stage_ticks[i];
+  }
+  if (slowest_functions_.size() < kSlowestFunctionCount) {
+    slowest_functions_.push_back(profile);
+    std::push_heap(slowest_functions_.begin(), slowest_functions_.end(),
+                   IsFasterToTranslate);
+  } else if (profile.total_ticks() >
+             slowest_functions_.front().total_ticks()) {
+    std::pop_heap(slowest_functions_.begin(), slowest_functions_.end(),
+                  IsFasterToTranslate);
+    slowest_functions_.back() = profile;
+    std::push_heap(slowest_functions_.begin(), slowest_functions_.end(),
+                   IsFasterToTranslate);
+  }
+}
+
+void TranslationProfiler::LogReport() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!function_count_) {
+    return;
+  }
+  double ms_per_tick = 1000.0 / double(Clock::QueryHostTickFrequency());
+  uint64_t total_ticks = 0;
+  for (uint64_t stage : stage_ticks_) {
+    total_ticks += stage;
+  }
+  XELOGI(
+      "Translation profile: {} functions in {:.3f} ms ({:.0f} guest "
+      "instructions per ms), {:.3f} ms scanning, {:.3f} ms building HIR, "
+      "{:.3f} ms in compiler passes, {:.3f} ms emitting host code",
+      function_count_, double(total_ticks) * ms_per_tick,
+      total_ticks ? double(guest_instr_count_) /
+                        (double(total_ticks) * ms_per_tick)
+                  : 0.0,
+      double(stage_ticks_[size_t(Stage::kScan)]) * ms_per_tick,
+      double(stage_ticks_[size_t(Stage::kHirBuilding)]) * ms_per_tick,
+      double(stage_ticks_[size_t(Stage::kCompilation)]) * ms_per_tick,
+      double(stage_ticks_[size_t(Stage::kEmission)]) * ms_per_tick);
+
+  std::vector<std::pair<const char*, PassTotals>> passes(passes_.begin(),
+                                                         passes_.end());
+  std::sort(passes.begin(), passes.end(), [](const auto& a, const auto& b) {
+    return a.second.ticks > b.second.ticks;
+  });
+  for (const auto& pass : passes) {
+    XELOGI("  {}: {} runs, {:.3f} ms, {:.3f} ms at most", pass.first,
+           pass.second.run_count, double(pass.second.ticks) * ms_per_tick,
+           double(pass.second.max_ticks) * ms_per_tick);
+  }
+
+  std::vector<FunctionProfile> functions(slowest_functions_);
+  std::sort_heap(functions.begin(), functions.end(), IsFasterToTranslate);
+  XELOGI("Slowest functions to translate:");
+  for (const FunctionProfile& function : functions) {
+    XELOGI(
+        "  {:08X}{}: {:.3f} ms ({:.3f} scan, {:.3f} HIR, {:.3f} passes, "
+        "{:.3f} emission), {} guest instructions, {} HIR instructions "
+        "emitted, {} compiled ({} bytes of HIR), {} bytes of host code",
+        function.address, function.baseline ? " (baseline)" : "",
+        double(function.total_ticks()) * ms_per_tick,
+        double(function.stage_ticks[size_t(Stage::kScan)]) * ms_per_tick,
+        double(function.stage_ticks[size_t(Stage::kHirBuilding)]) *
+            ms_per_tick,
+        double(function.stage_ticks[size_t(Stage::kCompilation)]) *
+            ms_per_tick,
+        double(function.stage_ticks[size_t(Stage::kEmission)]) * ms_per_tick,
+        function.guest_instr_count, function.emitted_instr_count,
+        function.compiled_instr_count, function.hir_bytes,
+        function.machine_code_length);
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
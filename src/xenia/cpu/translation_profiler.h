@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_TRANSLATION_PROFILER_H_
+#define XENIA_CPU_TRANSLATION_PROFILER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace xe {
+namespace cpu {
+
+// Aggregates the host time spent translating guest functions by translation
+// stage and by compiler pass, and keeps the slowest functions to translate,
+// for finding what causes stutter when new code is reached. The report is
+// logged when the profiler is destroyed.
+class TranslationProfiler {
+ public:
+  enum class Stage : uint32_t {
+    kScan,
+    kHirBuilding,
+    kCompilation,
+    kEmission,
+
+    kCount,
+  };
+
+  struct FunctionProfile {
+    uint32_t address = 0;
+    bool baseline = false;
+    uint64_t stage_ticks[size_t(Stage::kCount)] = {};
+    uint32_t guest_instr_count = 0;
+    uint32_t emitted_instr_count = 0;
+    uint32_t compiled_instr_count = 0;
+    uint32_t machine_code_length = 0;
+    // Memory used by the HIR after the compiler passes.
+    uint32_t hir_bytes = 0;
+
+    uint64_t total_ticks() const;
+  };
+
+  TranslationProfiler() = default;
+  TranslationProfiler(const TranslationProfiler& profiler) = delete;
+  TranslationProfiler& operator=(const TranslationProfiler& profiler) = delete;
+  ~TranslationProfiler();
+
+  // The name must be a string with static storage duration. The passes in a
+  // group are recorded both individually and as a part of the group.
+  void RecordPass(const char* name, uint64_t ticks);
+  void RecordFunction(const FunctionProfile& profile);
+
+  void LogReport() const;
+
+ private:
+  static constexpr size_t kSlowestFunctionCount = 32;
+
+  struct PassTotals {
+    uint64_t run_count = 0;
+    uint64_t ticks = 0;
+    uint64_t max_ticks = 0;
+  };
+
+  mutable std::mutex mutex_;
+  std::unordered_map<const char*, PassTotals> passes_;
+  uint64_t function_count_ = 0;
+  uint64_t guest_instr_count_ = 0;
+  uint64_t stage_ticks_[size_t(Stage::kCount)] = {};
+  // Min-heap by the total ticks.
+  std::vector<FunctionProfile> slowest_functions_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_TRANSLATION_PROFILER_H_
@@ -10,14 +10,23 @@
 #include "xenia/cpu/xex_module.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <thread>
 
 #include "third_party/fmt/include/fmt/format.h"
 
 #include "xenia/base/byte_order.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
@@ -48,6 +57,60 @@ DEFINE_bool(
     "finding/stress testing with the JIT",
     "CPU");
 
+DEFINE_bool(translate_all_functions_on_load, false,
+            "Translates every function found in the code of a module (from "
+            ".pdata, call targets, function prologs and the functions called "
+            "during earlier runs) on all logical processors while loading it, "
+            "so no translation happens while the title runs. Combine with "
+            "enable_persistent_code_cache to only pay for it once.",
+            "CPU");
+
+DEFINE_uint64(hot_instruction_execution_count, 10000,
+              "Instructions executed at least this many times while profiling "
+              "with trace_function_coverage are recorded as hot in the info "
+              "cache.",
+              "CPU");
+
+DEFINE_int32(xex_load_threads, 0,
+             "Number of threads decrypting and verifying XEX images while "
+             "loading them, 0 to use all logical processors.",
+             "CPU");
+
+DEFINE_bool(cache_xex_images, false,
+            "Stores the decrypted and decompressed basefile of loaded XEX "
+            "files in the cache directory and loads it from there on later "
+            "launches, skipping decryption and decompression. Base images "
+            "with title updates applied are cached too. The file is "
+            "mapped read-only, so multiple instances running the same title "
+            "share its pages in the OS file cache.",
+            "CPU");
+
+// Runs fn(begin, end) over [0, count), split across up to xex_load_threads
+// threads (including the calling one) so that each gets at least min_chunk.
+static void ParallelForRanges(size_t count, size_t min_chunk,
+                              const std::function<void(size_t, size_t)>& fn) {
+  size_t thread_count = cvars::xex_load_threads > 0
+                            ? size_t(cvars::xex_load_threads)
+                            : size_t(xe::threading::logical_processor_count());
+  thread_count =
+      std::min(thread_count, std::max(count / std::max(min_chunk, size_t(1)),
+                                      size_t(1)));
+  if (thread_count <= 1) {
+    fn(0, count);
+    return;
+  }
+  size_t chunk = (count + thread_count - 1) / thread_count;
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count - 1);
+  for (size_t begin = chunk; begin < count; begin += chunk) {
+    threads.emplace_back(fn, begin, std::min(begin + chunk, count));
+  }
+  fn(0, std::min(chunk, count));
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
 static const uint8_t xe_xex2_retail_key[16] = {
     0x20, 0xB1, 0x85, 0xA5, 0x9D, 0x28, 0xFD, 0xC3,
     0x40, 0x58, 0x3F, 0xBB, 0x08, 0x96, 0xBF, 0x91};
@@ -55,14 +118,11 @@ static const uint8_t xe_xex2_devkit_key[16] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
-void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
-                        const size_t input_size, uint8_t* output_buffer,
-                        const size_t output_size) {
-  uint32_t rk[4 * (MAXNR + 1)];
-  uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
-  const uint8_t* ct = input_buffer;
-  uint8_t* pt = output_buffer;
+static void aes_decrypt_cbc(const uint32_t* rk, int32_t Nr,
+                            const uint8_t* initial_ivec, const uint8_t* ct,
+                            size_t input_size, uint8_t* pt) {
+  uint8_t ivec[16];
+  std::memcpy(ivec, initial_ivec, 16);
   for (size_t n = 0; n < input_size; n += 16, ct += 16, pt += 16) {
     // Decrypt 16 uint8_ts from input -> output.
     rijndaelDecrypt(rk, Nr, ct, pt);
@@ -75,6 +135,34 @@ void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
   }
 }
 
+void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
+                        const size_t input_size, uint8_t* output_buffer,
+                        const size_t output_size) {
+  // 256 KiB per thread at least.
+  constexpr size_t kParallelMinBlocks = 16384;
+  static const uint8_t zero_ivec[16] = {0};
+  uint32_t rk[4 * (MAXNR + 1)];
+  int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
+  if (input_buffer == output_buffer) {
+    aes_decrypt_cbc(rk, Nr, zero_ivec, input_buffer, input_size,
+                    output_buffer);
+    return;
+  }
+  // Decrypting a CBC block only needs the previous ciphertext block, so with
+  // separate buffers any range can be decrypted independently.
+  size_t block_count = (input_size + 15) / 16;
+  ParallelForRanges(block_count, kParallelMinBlocks,
+                    [&](size_t begin, size_t end) {
+                      size_t offset = begin * 16;
+                      aes_decrypt_cbc(
+                          rk, Nr,
+                          offset ? input_buffer + offset - 16 : zero_ivec,
+                          input_buffer + offset,
+                          std::min(end * 16, input_size) - offset,
+                          output_buffer + offset);
+                    });
+}
+
 namespace xe {
 namespace cpu {
 
@@ -222,6 +310,21 @@ int XexModule::ApplyPatch(XexModule* module) {
     return 1;
   }
 
+  // Applying large title updates takes seconds, the result is cached for the
+  // next launches.
+  std::filesystem::path image_cache_path;
+  uint64_t patch_hash = 0;
+  if (module->xex_hash_) {
+    patch_hash = XXH3_64bits_withSeed(
+        xexp_data_mem_.data(), xexp_data_mem_.size(),
+        XXH3_64bits(xex_header_mem_.data(), xex_header_mem_.size()));
+    image_cache_path =
+        GetPatchedImageCachePath(module->xex_hash_, patch_hash);
+    if (LoadCachedPatchedImage(module, image_cache_path, patch_hash)) {
+      return 0;
+    }
+  }
+
   // Grab the delta descriptor and get to work.
   xex2_opt_delta_patch_descriptor* patch_header = nullptr;
   GetOptHeader(XEX_HEADER_DELTA_PATCH_DESCRIPTOR,
@@ -475,6 +578,9 @@ int XexModule::ApplyPatch(XexModule* module) {
         "version: {}.{}.{}.{}",
         source_ver.major, source_ver.minor, source_ver.build, source_ver.qfe,
         target_ver.major, target_ver.minor, target_ver.build, target_ver.qfe);
+    if (!image_cache_path.empty()) {
+      StoreCachedPatchedImage(module, image_cache_path, patch_hash);
+    }
   } else {
     XELOGE("XEX patch application failed, error code {}", result_code);
   }
@@ -556,6 +662,7 @@ int XexModule::ReadImageUncompressed(const void* xex_addr, size_t xex_length) {
            uncompressed_size);
     return 2;
   }
+  image_allocation_size_ = uncompressed_size;
   uint8_t* buffer = memory()->TranslateVirtual(base_address_);
   std::memset(buffer, 0, uncompressed_size);
 
@@ -624,49 +731,61 @@ int XexModule::ReadImageBasicCompressed(const void* xex_addr,
     return 1;
   }
 
+  image_allocation_size_ = total_size;
+
   uint8_t* buffer = memory()->TranslateVirtual(base_address_);
   std::memset(buffer, 0, total_size);  // Quickly zero the contents.
-  uint8_t* d = buffer;
 
-  uint32_t rk[4 * (MAXNR + 1)];
-  uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, session_key_, 128);
+  const auto encryption_type = opt_file_format_info()->encryption_type;
+  if (encryption_type != XEX_ENCRYPTION_NONE &&
+      encryption_type != XEX_ENCRYPTION_NORMAL) {
+    assert_always();
+    return 1;
+  }
 
-  for (size_t n = 0; n < block_count; n++) {
+  // Locate every block first so they can be copied or decrypted in parallel.
+  struct BlockRange {
+    size_t source_offset;
+    size_t dest_offset;
+    uint32_t data_size;
+  };
+  std::vector<BlockRange> block_ranges(block_count);
+  size_t source_offset = 0;
+  size_t dest_offset = 0;
+  for (uint32_t n = 0; n < block_count; n++) {
     const uint32_t data_size = comp_info.blocks[n].data_size;
     const uint32_t zero_size = comp_info.blocks[n].zero_size;
-
-    switch (opt_file_format_info()->encryption_type) {
-      case XEX_ENCRYPTION_NONE:
-        if (data_size > uncompressed_size - (d - buffer)) {
-          // Overflow.
-          return 1;
-        }
-        memcpy(d, p, data_size);
-        break;
-      case XEX_ENCRYPTION_NORMAL: {
-        const uint8_t* ct = p;
-        uint8_t* pt = d;
-        for (size_t m = 0; m < data_size; m += 16, ct += 16, pt += 16) {
-          // Decrypt 16 uint8_ts from input -> output.
-          rijndaelDecrypt(rk, Nr, ct, pt);
-          for (size_t i = 0; i < 16; i++) {
-            // XOR with previous.
-            pt[i] ^= ivec[i];
-            // Set previous.
-            ivec[i] = ct[i];
-          }
-        }
-      } break;
-      default:
-        assert_always();
-        return 1;
+    if (encryption_type == XEX_ENCRYPTION_NONE &&
+        data_size > uncompressed_size - dest_offset) {
+      // Overflow.
+      return 1;
     }
-
-    p += data_size;
-    d += data_size + zero_size;
+    block_ranges[n] = {source_offset, dest_offset, data_size};
+    source_offset += data_size;
+    dest_offset += data_size + zero_size;
   }
 
+  uint32_t rk[4 * (MAXNR + 1)];
+  static const uint8_t zero_ivec[16] = {0};
+  int32_t Nr = rijndaelKeySetupDec(rk, session_key_, 128);
+
+  // The data of all blocks forms one CBC chain, each continuing from the
+  // ciphertext right before it.
+  ParallelForRanges(block_count, 16, [&](size_t begin, size_t end) {
+    for (size_t n = begin; n < end; n++) {
+      const BlockRange& range = block_ranges[n];
+      const uint8_t* block_source = p + range.source_offset;
+      uint8_t* block_dest = buffer + range.dest_offset;
+      if (encryption_type == XEX_ENCRYPTION_NONE) {
+        memcpy(block_dest, block_source, range.data_size);
+      } else {
+        aes_decrypt_cbc(
+            rk, Nr, range.source_offset ? block_source - 16 : zero_ivec,
+            block_source, range.data_size, block_dest);
+      }
+    }
+  });
+
   return 0;
 }
 
@@ -687,7 +806,6 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   uint8_t* compress_buffer = NULL;
   const uint8_t* p = NULL;
   uint8_t* d = NULL;
-  sha1::SHA1 s;
 
   // Decrypt (if needed).
   bool free_input = false;
@@ -722,38 +840,62 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   // De-block.
   int result_code = 0;
 
-  uint8_t block_calced_digest[0x14];
+  // The info (size and hash) of each block is at the start of the previous
+  // one, walk the chain first and verify the hashes in parallel.
+  std::vector<std::pair<const uint8_t*, const xex2_compressed_block_info*>>
+      blocks;
+  const uint8_t* input_end = input_buffer + input_size;
   while (cur_block->block_size) {
-    const uint8_t* pnext = p + cur_block->block_size;
+    if (cur_block->block_size < sizeof(xex2_compressed_block_info) ||
+        cur_block->block_size > size_t(input_end - p)) {
+      // Garbage, most likely from the wrong decryption key.
+      result_code = 2;
+      break;
+    }
+    blocks.emplace_back(p, cur_block);
     const auto* next_block = (const xex2_compressed_block_info*)p;
+    p += cur_block->block_size;
+    cur_block = next_block;
+  }
 
-    // Compare block hash, if no match we probably used wrong decrypt key
-    s.reset();
-    s.processBytes(p, cur_block->block_size);
-    s.finalize(block_calced_digest);
-    if (memcmp(block_calced_digest, cur_block->block_hash, 0x14) != 0) {
+  if (!result_code) {
+    std::atomic<bool> hash_mismatch(false);
+    ParallelForRanges(blocks.size(), 4, [&](size_t begin, size_t end) {
+      sha1::SHA1 s;
+      uint8_t block_calced_digest[0x14];
+      for (size_t n = begin; n < end && !hash_mismatch; n++) {
+        // Compare block hash, if no match we probably used wrong decrypt key
+        s.reset();
+        s.processBytes(blocks[n].first, blocks[n].second->block_size);
+        s.finalize(block_calced_digest);
+        if (memcmp(block_calced_digest, blocks[n].second->block_hash, 0x14) !=
+            0) {
+          hash_mismatch = true;
+        }
+      }
+    });
+    if (hash_mismatch) {
       result_code = 2;
-      break;
     }
+  }
 
-    // skip block info
-    p += 4;
-    p += 20;
+  if (!result_code) {
+    for (const auto& block : blocks) {
+      // skip block info
+      p = block.first + 4 + 20;
+
+      while (true) {
+        const size_t chunk_size = (p[0] << 8) | p[1];
+        p += 2;
+        if (!chunk_size) {
+          break;
+        }
 
-    while (true) {
-      const size_t chunk_size = (p[0] << 8) | p[1];
-      p += 2;
-      if (!chunk_size) {
-        break;
+        memcpy(d, p, chunk_size);
+        p += chunk_size;
+        d += chunk_size;
       }
-
-      memcpy(d, p, chunk_size);
-      p += chunk_size;
-      d += chunk_size;
     }
-
-    p = pnext;
-    cur_block = next_block;
   }
 
   if (!result_code) {
@@ -769,6 +911,7 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
                 xe::kMemoryProtectRead | xe::kMemoryProtectWrite);
 
     if (alloc_result) {
+      image_allocation_size_ = uncompressed_size;
       uint8_t* buffer = memory()->TranslateVirtual(base_address_);
       std::memset(buffer, 0, uncompressed_size);
 
@@ -949,6 +1092,18 @@ bool XexModule::Load(const std::string_view name, const std::string_view path,
   name_ = name;
   path_ = path;
 
+  std::filesystem::path image_cache_path;
+  uint64_t xex_hash = 0;
+  if (cvars::cache_xex_images && !is_patch() && opt_file_format_info() &&
+      kernel_state_ && !kernel_state_->emulator()->cache_root().empty()) {
+    xex_hash = XXH3_64bits(xex_addr, xex_length);
+    xex_hash_ = xex_hash;
+    image_cache_path = GetImageCachePath(xex_hash);
+    if (LoadCachedImage(image_cache_path, xex_hash)) {
+      return true;
+    }
+  }
+
   // Load in the XEX basefile
   // We'll try using both XEX2 keys to see if any give a valid PE
   int result_code = ReadImage(xex_addr, xex_length, false);
@@ -964,11 +1119,240 @@ bool XexModule::Load(const std::string_view name, const std::string_view path,
     }
   }
 
+  if (!image_cache_path.empty()) {
+    StoreCachedImage(image_cache_path, xex_hash);
+  }
+
   // Note: caller will have to call LoadContinue once it's determined whether a
   // patch file exists or not!
   return true;
 }
 
+namespace {
+struct XexImageCacheHeader {
+  static constexpr uint32_t kMagic = 0x474D4958;  // 'XIMG'
+  static constexpr uint32_t kVersion = 1;
+  uint32_t magic;
+  uint32_t version;
+  uint64_t xex_hash;
+  uint32_t base_address;
+  uint32_t image_size;
+  uint32_t is_dev_kit;
+  uint32_t reserved;
+};
+static_assert_size(XexImageCacheHeader, 32);
+
+struct XexPatchedImageCacheHeader {
+  static constexpr uint32_t kMagic = 0x54415058;  // 'XPAT'
+  static constexpr uint32_t kVersion = 1;
+  uint32_t magic;
+  uint32_t version;
+  uint64_t base_xex_hash;
+  uint64_t patch_hash;
+  uint32_t base_address;
+  // The patched XEX header follows this header, and then the image.
+  uint32_t xex_header_size;
+  uint32_t image_size;
+  uint32_t reserved;
+};
+static_assert_size(XexPatchedImageCacheHeader, 40);
+
+// Writes the parts of a cache file to a temporary file first so an
+// interrupted write is never loaded, with a unique name as other instances may
+// be storing the same file.
+bool WriteXexCacheFile(
+    const std::filesystem::path& path,
+    std::initializer_list<std::pair<const void*, size_t>> parts) {
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+  std::filesystem::path temp_path = path;
+  temp_path += fmt::format(
+      ".{:016X}.tmp",
+      uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()) ^
+          (uint64_t(threading::current_thread_system_id()) << 32));
+  FILE* file = xe::filesystem::OpenFile(temp_path, "wb");
+  if (!file) {
+    XELOGW("Failed to create the XEX cache file {}",
+           xe::path_to_utf8(temp_path));
+    return false;
+  }
+  bool write_result = true;
+  for (const std::pair<const void*, size_t>& part : parts) {
+    if (fwrite(part.first, part.second, 1, file) != 1) {
+      write_result = false;
+      break;
+    }
+  }
+  fclose(file);
+  if (write_result) {
+    std::filesystem::rename(temp_path, path, error);
+    // Replacing may fail while another instance has the file mapped, but then
+    // it has already been stored.
+    write_result = !error || std::filesystem::exists(path);
+  }
+  if (!write_result) {
+    XELOGW("Failed to write the XEX cache file {}", xe::path_to_utf8(path));
+  }
+  std::filesystem::remove(temp_path, error);
+  return write_result;
+}
+}  // namespace
+
+std::filesystem::path XexModule::GetImageCachePath(uint64_t xex_hash) const {
+  return kernel_state_->emulator()->cache_root() / "xex_images" /
+         fmt::format("{:016X}.bin", xex_hash);
+}
+
+bool XexModule::LoadCachedImage(const std::filesystem::path& path,
+                                uint64_t xex_hash) {
+  if (!std::filesystem::exists(path)) {
+    return false;
+  }
+  // Mapped rather than read into a private buffer, so with many instances of
+  // the same title, the file is read from the storage once and only copied
+  // into the guest memory of each.
+  auto mapping = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < sizeof(XexImageCacheHeader)) {
+    return false;
+  }
+  XexImageCacheHeader header;
+  std::memcpy(&header, mapping->data(), sizeof(header));
+  if (header.magic != XexImageCacheHeader::kMagic ||
+      header.version != XexImageCacheHeader::kVersion ||
+      header.xex_hash != xex_hash || header.base_address != base_address_ ||
+      !header.image_size ||
+      mapping->size() - sizeof(header) < header.image_size) {
+    return false;
+  }
+
+  auto heap = memory()->LookupHeap(base_address_);
+  heap->Reset();
+  if (!heap->AllocFixed(
+          base_address_, header.image_size, 4096,
+          xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
+          xe::kMemoryProtectRead | xe::kMemoryProtectWrite)) {
+    return false;
+  }
+  std::memcpy(memory()->TranslateVirtual(base_address_),
+              mapping->data() + sizeof(header), header.image_size);
+  mapping.reset();
+  if (!is_valid_executable()) {
+    XELOGW("Discarding the invalid cached XEX image {}",
+           xe::path_to_utf8(path));
+    heap->Reset();
+    return false;
+  }
+
+  // Patches are decrypted with the session key.
+  is_dev_kit_ = header.is_dev_kit != 0;
+  aes_decrypt_buffer(
+      is_dev_kit_ ? xe_xex2_devkit_key : xe_xex2_retail_key,
+      reinterpret_cast<const uint8_t*>(xex_security_info()->aes_key), 16,
+      session_key_, 16);
+  image_allocation_size_ = header.image_size;
+  XELOGI("Loaded the XEX image from {}", xe::path_to_utf8(path));
+  return true;
+}
+
+void XexModule::StoreCachedImage(const std::filesystem::path& path,
+                                 uint64_t xex_hash) {
+  if (!image_allocation_size_) {
+    return;
+  }
+  XexImageCacheHeader header = {};
+  header.magic = XexImageCacheHeader::kMagic;
+  header.version = XexImageCacheHeader::kVersion;
+  header.xex_hash = xex_hash;
+  header.base_address = base_address_;
+  header.image_size = image_allocation_size_;
+  header.is_dev_kit = is_dev_kit_ ? 1 : 0;
+  WriteXexCacheFile(path,
+                    {{&header, sizeof(header)},
+                     {memory()->TranslateVirtual(base_address_),
+                      image_allocation_size_}});
+}
+
+std::filesystem::path XexModule::GetPatchedImageCachePath(
+    uint64_t base_xex_hash, uint64_t patch_hash) const {
+  return kernel_state_->emulator()->cache_root() / "xex_images" /
+         fmt::format("{:016X}_{:016X}.bin", base_xex_hash, patch_hash);
+}
+
+bool XexModule::LoadCachedPatchedImage(XexModule* module,
+                                       const std::filesystem::path& path,
+                                       uint64_t patch_hash) {
+  if (!std::filesystem::exists(path)) {
+    return false;
+  }
+  auto mapping = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < sizeof(XexPatchedImageCacheHeader)) {
+    return false;
+  }
+  XexPatchedImageCacheHeader header;
+  std::memcpy(&header, mapping->data(), sizeof(header));
+  if (header.magic != XexPatchedImageCacheHeader::kMagic ||
+      header.version != XexPatchedImageCacheHeader::kVersion ||
+      header.base_xex_hash != module->xex_hash_ ||
+      header.patch_hash != patch_hash ||
+      header.base_address != module->base_address_ ||
+      header.xex_header_size < sizeof(xex2_header) || !header.image_size ||
+      mapping->size() - sizeof(header) <
+          uint64_t(header.xex_header_size) + header.image_size) {
+    return false;
+  }
+  const uint8_t* cached_xex_header = mapping->data() + sizeof(header);
+  const uint8_t* cached_image = cached_xex_header + header.xex_header_size;
+
+  // Resize the image allocation like when applying the patch.
+  uint32_t original_image_size = module->image_size();
+  if (header.image_size > original_image_size) {
+    uint32_t size_delta = header.image_size - original_image_size;
+    uint32_t addr_new_mem = module->base_address_ + original_image_size;
+    if (!memory()->LookupHeap(addr_new_mem)->AllocFixed(
+            addr_new_mem, size_delta, 4096,
+            xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
+            xe::kMemoryProtectRead | xe::kMemoryProtectWrite)) {
+      return false;
+    }
+  } else if (header.image_size < original_image_size) {
+    uint32_t addr_free_mem = module->base_address_ + header.image_size;
+    memory()
+        ->LookupHeap(addr_free_mem)
+        ->Decommit(addr_free_mem, original_image_size - header.image_size);
+  }
+
+  module->xex_header_mem_.assign(cached_xex_header,
+                                 cached_xex_header + header.xex_header_size);
+  module->ReadSecurityInfo();
+  aes_decrypt_buffer(
+      module->is_dev_kit_ ? xe_xex2_devkit_key : xe_xex2_retail_key,
+      reinterpret_cast<const uint8_t*>(module->xex_security_info()->aes_key),
+      16, module->session_key_, 16);
+  std::memcpy(memory()->TranslateVirtual(module->base_address_), cached_image,
+              header.image_size);
+  XELOGI("Loaded the XEX image with the patch applied from {}",
+         xe::path_to_utf8(path));
+  return true;
+}
+
+void XexModule::StoreCachedPatchedImage(XexModule* module,
+                                        const std::filesystem::path& path,
+                                        uint64_t patch_hash) {
+  XexPatchedImageCacheHeader header = {};
+  header.magic = XexPatchedImageCacheHeader::kMagic;
+  header.version = XexPatchedImageCacheHeader::kVersion;
+  header.base_xex_hash = module->xex_hash_;
+  header.patch_hash = patch_hash;
+  header.base_address = module->base_address_;
+  header.xex_header_size = uint32_t(module->xex_header_mem_.size());
+  header.image_size = module->image_size();
+  WriteXexCacheFile(
+      path, {{&header, sizeof(header)},
+             {module->xex_header_mem_.data(), header.xex_header_size},
+             {memory()->TranslateVirtual(module->base_address_),
+              header.image_size}});
+}
+
 bool XexModule::LoadContinue() {
   // Second part of image load
   // Split from Load() so that we can patch the XEX before loading this data
@@ -1125,7 +1509,14 @@ void XexModule::Precompile() {
   }
 
   info_cache_.Init(this);
-  PrecompileDiscoveredFunctions();
+  RestorePersistentFunctions();
+  if (cvars::translate_all_functions_on_load) {
+    processor_->TranslateFunctionsAheadOfTime(CollectLikelyFunctions());
+  } else if (processor_->has_translation_workers()) {
+    QueueBackgroundTranslation();
+  } else {
+    PrecompileDiscoveredFunctions();
+  }
 }
 bool XexModule::Unload() {
   if (!loaded_) {
@@ -1133,6 +1524,9 @@ bool XexModule::Unload() {
   }
   loaded_ = false;
 
+  RecordExecutionProfile();
+  processor_->backend()->CloseModuleCodeCache(this);
+
   // If this isn't a patch, just deallocate the memory occupied by the exe
   if (!is_patch()) {
     assert_not_zero(base_address_);
@@ -1338,12 +1732,7 @@ void XexInfoCache::Init(XexModule* xexmod) {
     return;
   }
 
-  auto emu = xexmod->kernel_state_->emulator();
-  std::filesystem::path infocache_path = emu->cache_root();
-
-  infocache_path.append(L"modules");
-
-  infocache_path.append(xexmod->image_sha_str_);
+  std::filesystem::path infocache_path = xexmod->GetModuleCacheDirectory();
 
   std::filesystem::create_directories(infocache_path);
   infocache_path.append("executable_addr_flags.bin");
@@ -1383,6 +1772,66 @@ void XexInfoCache::Init(XexModule* xexmod) {
     }
   }
 }
+std::filesystem::path XexModule::GetModuleCacheDirectory() const {
+  std::filesystem::path cache_directory =
+      kernel_state_->emulator()->cache_root();
+  cache_directory.append(L"modules");
+  cache_directory.append(image_sha_str_);
+  return cache_directory;
+}
+
+void XexModule::RestorePersistentFunctions() {
+  // Place everything up front so the indirection table already points to the
+  // code and guest calls don't go through the resolver at all.
+  auto addresses = processor_->backend()->OpenModuleCodeCache(
+      this, GetModuleCacheDirectory());
+  for (uint32_t address : addresses) {
+    if (address < low_address_ || address >= high_address_) {
+      continue;
+    }
+    processor_->ResolveFunction(address);
+  }
+}
+
+void XexModule::RecordExecutionProfile() {
+  // Instruction counts only exist for functions translated with coverage
+  // tracing. Merge them into the info cache so later runs without tracing can
+  // lay out code based on them.
+  if (!info_cache_.LookupFlags(0)) {
+    return;
+  }
+  uint64_t hot_count = cvars::hot_instruction_execution_count;
+  ForEachFunction([this, hot_count](Function* function) {
+    if (!function->is_guest()) {
+      return;
+    }
+    auto& trace_data = static_cast<GuestFunction*>(function)->trace_data();
+    if (!trace_data.is_valid() ||
+        trace_data.header()->data_size <
+            FunctionTraceData::SizeOfHeader() +
+                FunctionTraceData::SizeOfInstructionCounts(
+                    trace_data.start_address(), trace_data.end_address())) {
+      return;
+    }
+    auto counts =
+        reinterpret_cast<const uint64_t*>(trace_data.instruction_execute_counts());
+    for (uint32_t i = 0; i < trace_data.instruction_count(); ++i) {
+      if (!counts[i]) {
+        continue;
+      }
+      InfoCacheFlags* flags =
+          GetInstructionAddressFlags(trace_data.start_address() + i * 4);
+      if (!flags) {
+        continue;
+      }
+      flags->was_executed = 1;
+      if (counts[i] >= hot_count) {
+        flags->is_hot = 1;
+      }
+    }
+  });
+}
+
 InfoCacheFlags* XexModule::GetInstructionAddressFlags(uint32_t guest_addr) {
   if (guest_addr < low_address_ || guest_addr > high_address_) {
     return nullptr;
@@ -1409,6 +1858,33 @@ void XexModule::PrecompileDiscoveredFunctions() {
     }
   }
 }
+std::vector<uint32_t> XexModule::CollectLikelyFunctions() {
+  std::vector<uint32_t> addresses;
+  // Functions resolved during earlier runs go first as they're known to be
+  // needed, then everything the code scan finds.
+  auto flags = info_cache_.LookupFlags(0);
+  if (flags) {
+    uint32_t end = (high_address_ - low_address_) / 4;
+    for (uint32_t i = 0; i < end; i++) {
+      if (flags[i].was_resolved) {
+        addresses.push_back(low_address_ + (i * 4));
+      }
+    }
+  }
+  for (uint32_t address : PreanalyzeCode()) {
+    if (address >= low_address_ && address < high_address_) {
+      addresses.push_back(address);
+    }
+  }
+  return addresses;
+}
+
+void XexModule::QueueBackgroundTranslation() {
+  std::vector<uint32_t> addresses = CollectLikelyFunctions();
+  XELOGI("Queued {} functions of {} for background translation",
+         addresses.size(), name());
+  processor_->QueueFunctionTranslations(addresses);
+}
 void XexModule::PrecompileKnownFunctions() {
   if (!cvars::enable_early_precompilation) {
     return;
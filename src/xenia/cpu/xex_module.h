@@ -37,7 +37,11 @@ struct InfoCacheFlags {
   uint32_t is_syscall_func : 1;
   uint32_t is_return_site : 1;  // address can be reached from another function
                                 // by returning
-  uint32_t reserved : 28;
+  // Execution profile gathered with trace_function_coverage, used for the
+  // block layout.
+  uint32_t was_executed : 1;
+  uint32_t is_hot : 1;
+  uint32_t reserved : 26;
 };
 static_assert(sizeof(InfoCacheFlags) == 4,
               "InfoCacheFlags size should be equal to sizeof ppc instruction.");
@@ -240,6 +244,13 @@ class XexModule : public xe::cpu::Module {
  private:
   void PrecompileKnownFunctions();
   void PrecompileDiscoveredFunctions();
+  // Functions resolved during earlier runs first, then everything the code
+  // scan finds.
+  std::vector<uint32_t> CollectLikelyFunctions();
+  void QueueBackgroundTranslation();
+  void RestorePersistentFunctions();
+  void RecordExecutionProfile();
+  std::filesystem::path GetModuleCacheDirectory() const;
   std::vector<uint32_t> PreanalyzeCode();
   friend struct XexInfoCache;
   void ReadSecurityInfo();
@@ -248,6 +259,20 @@ class XexModule : public xe::cpu::Module {
   int ReadImageUncompressed(const void* xex_addr, size_t xex_length);
   int ReadImageBasicCompressed(const void* xex_addr, size_t xex_length);
   int ReadImageCompressed(const void* xex_addr, size_t xex_length);
+  // Cache of the basefile as loaded into memory, keyed by the hash of the XEX.
+  std::filesystem::path GetImageCachePath(uint64_t xex_hash) const;
+  bool LoadCachedImage(const std::filesystem::path& path, uint64_t xex_hash);
+  void StoreCachedImage(const std::filesystem::path& path, uint64_t xex_hash);
+  // Cache of the base image with the title update applied, called for the
+  // patch, keyed by the hashes of the base XEX and of the patch.
+  std::filesystem::path GetPatchedImageCachePath(uint64_t base_xex_hash,
+                                                 uint64_t patch_hash) const;
+  bool LoadCachedPatchedImage(XexModule* module,
+                              const std::filesystem::path& path,
+                              uint64_t patch_hash);
+  void StoreCachedPatchedImage(XexModule* module,
+                               const std::filesystem::path& path,
+                               uint64_t patch_hash);
 
   int ReadPEHeaders();
 
@@ -271,6 +296,10 @@ class XexModule : public xe::cpu::Module {
 
   uint8_t session_key_[0x10];
   bool is_dev_kit_ = false;
+  // Size of the basefile allocation at base_address_.
+  uint32_t image_allocation_size_ = 0;
+  // Hash of the XEX file if the images are cached, 0 otherwise.
+  uint64_t xex_hash_ = 0;
 
   bool loaded_ = false;         // Loaded into memory?
   bool finished_load_ = false;  // PE/imports/symbols/etc all loaded?
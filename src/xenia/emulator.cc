@@ -11,6 +11,8 @@
 
 #include <algorithm>
 #include <cinttypes>
+#include <functional>
+#include <mutex>
 
 #include "config.h"
 #include "third_party/fmt/include/fmt/format.h"
@@ -22,11 +24,13 @@
 #include "xenia/base/debugging.h"
 #include "xenia/base/exception_handler.h"
 #include "xenia/base/literals.h"
+#include "xenia/base/lock_profiler.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
 #include "xenia/base/system.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/backend/code_cache.h"
 #include "xenia/cpu/backend/null_backend.h"
 #include "xenia/cpu/cpu_flags.h"
@@ -47,6 +51,7 @@
 #include "xenia/ui/imgui_drawer.h"
 #include "xenia/ui/window.h"
 #include "xenia/ui/windowed_app_context.h"
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
 #include "xenia/vfs/devices/disc_image_device.h"
 #include "xenia/vfs/devices/host_path_device.h"
 #include "xenia/vfs/devices/null_device.h"
@@ -72,6 +77,16 @@ DEFINE_bool(allow_game_relative_writes, false,
             "relative to game://. Used for "
             "generating test data to compare with original hardware. ",
             "General");
+DEFINE_bool(save_state_incremental, false,
+            "Store only the memory modified since the last full save or "
+            "restore in save states written to other files, referencing the "
+            "rest in the file of that save, which must be kept for restoring "
+            "them.",
+            "General");
+DEFINE_bool(parallel_startup, true,
+            "Initialize the subsystems not depending on each other, such as "
+            "the host graphics device and the CPU, concurrently on startup.",
+            "General");
 
 namespace xe {
 using namespace xe::literals;
@@ -111,6 +126,8 @@ Emulator::Emulator(const std::filesystem::path& command_line,
       paused_(false),
       restoring_(false),
       restore_fence_() {
+  lock_profiler::Initialize();
+
   // show the quickstart guide the first time they ever open the emulator
   uint64_t persistent_flags = GetPersistentEmulatorFlags();
   if (!(persistent_flags & EmulatorFlagQuickstartShown)) {
@@ -143,8 +160,99 @@ Emulator::~Emulator() {
   export_resolver_.reset();
 
   ExceptionHandler::Uninstall(Emulator::ExceptionCallbackThunk, this);
+
+  lock_profiler::LogReport();
+
+  metrics_exporter_.reset();
 }
 
+namespace {
+
+// Durations of the startup steps, possibly running on different threads,
+// logged together once the startup is complete.
+class StartupTimeline {
+ public:
+  StartupTimeline() : origin_ticks_(Clock::QueryHostTickCount()) {}
+
+  uint64_t Begin() const { return Clock::QueryHostTickCount(); }
+  void End(const char* name, uint64_t begin_ticks) {
+    uint64_t end_ticks = Clock::QueryHostTickCount();
+    std::lock_guard<std::mutex> lock(mutex_);
+    steps_.push_back({name, begin_ticks, end_ticks});
+  }
+
+  void Log() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::sort(steps_.begin(), steps_.end(),
+              [](const Step& a, const Step& b) {
+                return a.begin_ticks < b.begin_ticks;
+              });
+    double ms_per_tick = 1000.0 / double(Clock::QueryHostTickFrequency());
+    XELOGI("Emulator startup took {:.1f} ms:",
+           double(Clock::QueryHostTickCount() - origin_ticks_) * ms_per_tick);
+    for (const Step& step : steps_) {
+      XELOGI("  {}: {:.1f} ms to {:.1f} ms ({:.1f} ms)", step.name,
+             double(step.begin_ticks - origin_ticks_) * ms_per_tick,
+             double(step.end_ticks - origin_ticks_) * ms_per_tick,
+             double(step.end_ticks - step.begin_ticks) * ms_per_tick);
+    }
+  }
+
+ private:
+  struct Step {
+    const char* name;
+    uint64_t begin_ticks;
+    uint64_t end_ticks;
+  };
+
+  uint64_t origin_ticks_;
+  std::mutex mutex_;
+  std::vector<Step> steps_;
+};
+
+// Runs a startup step on a separate thread if parallel_startup is enabled, or
+// immediately otherwise.
+class StartupTask {
+ public:
+  StartupTask(StartupTimeline& timeline, const char* name,
+              std::function<void()> function)
+      : timeline_(timeline), name_(name), function_(std::move(function)) {
+    if (cvars::parallel_startup) {
+      threading::Thread::CreationParameters params;
+      thread_ = threading::Thread::Create(params, [this]() { Run(); });
+      if (thread_) {
+        thread_->set_name(std::string("Startup: ") + name_);
+        return;
+      }
+    }
+    Run();
+  }
+  StartupTask(const StartupTask& task) = delete;
+  StartupTask& operator=(const StartupTask& task) = delete;
+  ~StartupTask() { Join(); }
+
+  void Join() {
+    if (thread_) {
+      threading::Wait(thread_.get(), false);
+      thread_.reset();
+    }
+  }
+
+ private:
+  void Run() {
+    uint64_t begin_ticks = timeline_.Begin();
+    function_();
+    timeline_.End(name_, begin_ticks);
+  }
+
+  StartupTimeline& timeline_;
+  const char* name_;
+  std::function<void()> function_;
+  std::unique_ptr<threading::Thread> thread_;
+};
+
+}  // namespace
+
 X_STATUS Emulator::Setup(
     ui::Window* display_window, ui::ImGuiDrawer* imgui_drawer,
     bool require_cpu_backend,
@@ -159,6 +267,9 @@ X_STATUS Emulator::Setup(
   display_window_ = display_window;
   imgui_drawer_ = imgui_drawer;
 
+  StartupTimeline timeline;
+  uint64_t step_begin_ticks;
+
   // Initialize clock.
   // 360 uses a 50MHz clock.
   Clock::set_guest_tick_frequency(50000000);
@@ -171,11 +282,32 @@ X_STATUS Emulator::Setup(
   // logical processors.
   xe::threading::EnableAffinityConfiguration();
 
-  // Create memory system first, as it is required for other systems.
+  metrics_exporter_ = metrics::Exporter::CreateIfConfigured();
+
+  // Create memory system first, as it is required for other systems. Also
+  // before the startup threads may take the fixed address ranges it reserves.
+  step_begin_ticks = timeline.Begin();
   memory_ = std::make_unique<Memory>();
   if (!memory_->Initialize()) {
     return false;
   }
+  timeline.End("Memory", step_begin_ticks);
+
+  // The game patches and the host graphics device, which may take a while to
+  // create, don't depend on the other subsystems, so they're loaded while
+  // those are being initialized.
+  StartupTask patcher_task(timeline, "Patches", [this]() {
+    patcher_ = std::make_unique<xe::patcher::Patcher>(storage_root_);
+  });
+  step_begin_ticks = timeline.Begin();
+  graphics_system_ = graphics_system_factory();
+  if (!graphics_system_) {
+    return X_STATUS_NOT_IMPLEMENTED;
+  }
+  timeline.End("Graphics system creation", step_begin_ticks);
+  StartupTask graphics_provider_task(timeline, "Graphics device", [this]() {
+    graphics_system_->CreateProvider(display_window_ != nullptr);
+  });
 
   // Shared export resolver used to attach and query for HLE exports.
   export_resolver_ = std::make_unique<xe::cpu::ExportResolver>();
@@ -198,27 +330,26 @@ X_STATUS Emulator::Setup(
   }
 
   // Initialize the CPU.
+  step_begin_ticks = timeline.Begin();
   processor_ = std::make_unique<xe::cpu::Processor>(memory_.get(),
                                                     export_resolver_.get());
   if (!processor_->Setup(std::move(backend))) {
     return X_STATUS_UNSUCCESSFUL;
   }
+  timeline.End("Processor", step_begin_ticks);
 
   // Initialize the APU.
   if (audio_system_factory) {
+    step_begin_ticks = timeline.Begin();
     audio_system_ = audio_system_factory(processor_.get());
     if (!audio_system_) {
       return X_STATUS_NOT_IMPLEMENTED;
     }
-  }
-
-  // Initialize the GPU.
-  graphics_system_ = graphics_system_factory();
-  if (!graphics_system_) {
-    return X_STATUS_NOT_IMPLEMENTED;
+    timeline.End("Audio system creation", step_begin_ticks);
   }
 
   // Initialize the HID.
+  step_begin_ticks = timeline.Begin();
   input_system_ = std::make_unique<xe::hid::InputSystem>(display_window_);
   if (!input_system_) {
     return X_STATUS_NOT_IMPLEMENTED;
@@ -237,16 +368,19 @@ X_STATUS Emulator::Setup(
   if (result) {
     return result;
   }
+  timeline.End("Input system", step_begin_ticks);
 
   // Bring up the virtual filesystem used by the kernel.
   file_system_ = std::make_unique<xe::vfs::VirtualFileSystem>();
 
-  patcher_ = std::make_unique<xe::patcher::Patcher>(storage_root_);
-
   // Shared kernel state.
+  step_begin_ticks = timeline.Begin();
   kernel_state_ = std::make_unique<xe::kernel::KernelState>(this);
+  timeline.End("Kernel state", step_begin_ticks);
 
   // Setup the core components.
+  graphics_provider_task.Join();
+  step_begin_ticks = timeline.Begin();
   result = graphics_system_->Setup(
       processor_.get(), kernel_state_.get(),
       display_window_ ? &display_window_->app_context() : nullptr,
@@ -254,14 +388,18 @@ X_STATUS Emulator::Setup(
   if (result) {
     return result;
   }
+  timeline.End("Graphics system", step_begin_ticks);
 
   if (audio_system_) {
+    step_begin_ticks = timeline.Begin();
     result = audio_system_->Setup(kernel_state_.get());
     if (result) {
       return result;
     }
+    timeline.End("Audio system", step_begin_ticks);
   }
 
+  step_begin_ticks = timeline.Begin();
 #define LOAD_KERNEL_MODULE(t) \
   static_cast<void>(kernel_state_->LoadKernelModule<kernel::t>())
   // HLE kernel modules.
@@ -269,10 +407,14 @@ X_STATUS Emulator::Setup(
   LOAD_KERNEL_MODULE(xam::XamModule);
   LOAD_KERNEL_MODULE(xbdm::XbdmModule);
 #undef LOAD_KERNEL_MODULE
+  timeline.End("Kernel modules", step_begin_ticks);
 
   // Initialize emulator fallback exception handling last.
   ExceptionHandler::Install(Emulator::ExceptionCallbackThunk, this);
 
+  patcher_task.Join();
+  timeline.Log();
+
   return result;
 }
 
@@ -281,6 +423,7 @@ X_STATUS Emulator::TerminateTitle() {
     return X_STATUS_UNSUCCESSFUL;
   }
 
+  file_system_->access_prefetcher().End();
   kernel_state_->TerminateTitle();
   title_id_ = std::nullopt;
   title_name_ = "";
@@ -317,6 +460,8 @@ const std::unique_ptr<vfs::Device> Emulator::CreateVfsDeviceBasedOnPath(
         "https://www.google.com/search?q=how+to+extract+{}+file", extension));
 
     xe::FatalError("Terminating due to user's lack of basic computer skills.");
+  } else if (extension == ".xcz") {
+    return std::make_unique<vfs::CompressedDiscImageDevice>(mount_path, path);
   }
   return std::make_unique<vfs::DiscImageDevice>(mount_path, path);
 }
@@ -595,7 +740,7 @@ bool Emulator::SaveToFile(const std::filesystem::path& path) {
   graphics_system_->Save(&stream);
   audio_system_->Save(&stream);
   kernel_state_->Save(&stream);
-  memory_->Save(&stream);
+  memory_->Save(&stream, path, cvars::save_state_incremental);
   map->Close(stream.offset());
 
   Resume();
@@ -651,7 +796,7 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
     XELOGE("Could not restore kernel state!");
     return false;
   }
-  if (!memory_->Restore(&stream)) {
+  if (!memory_->Restore(&stream, path)) {
     XELOGE("Could not restore memory!");
     return false;
   }
@@ -905,8 +1050,10 @@ static std::string format_version(xex2_version version) {
 X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
                                   const std::string_view module_path) {
   // Making changes to the UI (setting the icon) and executing game config
-  // load callbacks which expect to be called from the UI thread.
-  assert_true(display_window_->app_context().IsInUIThread());
+  // load callbacks which expect to be called from the UI thread. No UI thread
+  // when running headless.
+  assert_true(!display_window_ ||
+              display_window_->app_context().IsInUIThread());
 
   // Setup NullDevices for raw HDD partition accesses
   // Cache/STFC code baked into games tries reading/writing to these
@@ -931,7 +1078,9 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
   title_id_ = std::nullopt;
   title_name_ = "";
   title_version_ = "";
-  display_window_->SetIcon(nullptr, 0);
+  if (display_window_) {
+    display_window_->SetIcon(nullptr, 0);
+  }
 
   // Allow xam to request module loads.
   auto xam = kernel_state()->GetKernelModule<kernel::xam::XamModule>("xam.xex");
@@ -1002,7 +1151,7 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
 
       // Show achievments data
       XELOGI("-------------------- ACHIEVEMENTS --------------------");
-      const std::vector<kernel::util::XdbfAchievementTableEntry>
+      const std::vector<kernel::util::XdbfAchievementTableEntry>&
           achievement_list = db.GetAchievements();
       for (const kernel::util::XdbfAchievementTableEntry& entry :
            achievement_list) {
@@ -1015,7 +1164,7 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
       XELOGI("----------------- END OF ACHIEVEMENTS ----------------");
 
       auto icon_block = db.icon();
-      if (icon_block) {
+      if (icon_block && display_window_) {
         display_window_->SetIcon(icon_block.buffer, icon_block.size);
       }
     }
@@ -1030,6 +1179,14 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
                                             true);
   on_shader_storage_initialization(false);
 
+  vfs::Entry* game_entry = file_system_->ResolvePath("game:");
+  if (game_entry) {
+    file_system_->access_prefetcher().Begin(
+        game_entry->device(),
+        cache_root_ / "io_traces" /
+            fmt::format("{:08X}.txt", title_id_.value()));
+  }
+
   auto main_thread = kernel_state_->LaunchModule(module);
   if (!main_thread) {
     return X_STATUS_UNSUCCESSFUL;
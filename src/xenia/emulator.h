@@ -19,6 +19,7 @@
 
 #include "xenia/base/delegate.h"
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/metrics.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/memory.h"
 #include "xenia/patcher/patcher.h"
@@ -267,6 +268,9 @@ class Emulator {
 
   std::unique_ptr<kernel::KernelState> kernel_state_;
 
+  // Destroyed last, writing the final values of the metrics.
+  std::unique_ptr<metrics::Exporter> metrics_exporter_;
+
   // Accessible only from the thread that invokes those callbacks (the UI thread
   // if the UI is available).
   std::vector<GameConfigLoadCallback*> game_config_load_callbacks_;
@@ -9,13 +9,18 @@
 
 #include "xenia/gpu/command_processor.h"
 
+#include <algorithm>
 #include <cinttypes>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/metrics.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/utf8.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/graphics_system.h"
 #include "xenia/gpu/packet_disassembler.h"
@@ -45,11 +50,68 @@ DEFINE_bool(
     "of the guest thread that wrote the new read position.",
     "GPU");
 
+DEFINE_path(
+    shader_storage_import_path, "",
+    "Directory with shareable shader storage files (the contents of "
+    "cache/shaders/shareable from another machine, such as guest shaders and "
+    "pipeline descriptions of the host GPU APIs) to copy to the local shader "
+    "storage for the titles that don't have their files in it yet, so the "
+    "shaders and pipelines are precompiled on the first launch.",
+    "GPU");
+
+DEFINE_uint32(
+    gpu_worker_spin_microseconds, 100,
+    "Time for the GPU command processor to spin waiting for new guest "
+    "commands before going to sleep until the guest writes the ring buffer "
+    "write pointer. Higher values reduce the latency of resuming the command "
+    "processing, lower values reduce the CPU usage of the GPU thread. 0 to "
+    "always sleep.",
+    "GPU");
+
 namespace xe {
 namespace gpu {
 
 using namespace xe::gpu::xenos;
 
+namespace {
+metrics::Counter frames_metric("xenia_gpu_frames_total",
+                               "Guest frames completed by the GPU emulation.");
+metrics::Counter pipelines_created_metric(
+    "xenia_gpu_pipelines_created_total", "Host pipelines created.");
+metrics::Counter texture_load_bytes_metric(
+    "xenia_gpu_texture_load_bytes_total",
+    "Guest texture data loaded into the host textures.");
+metrics::Gauge pipelines_pending_metric(
+    "xenia_gpu_pipelines_pending",
+    "Host pipelines waiting to be created at the end of the latest frame.");
+metrics::Histogram shared_memory_invalidations_metric(
+    "xenia_gpu_frame_shared_memory_invalidations",
+    "Shared memory ranges invalidated by CPU writes during a frame.",
+    {0, 1, 4, 16, 64, 256, 1024});
+metrics::Counter culled_draws_metric(
+    "xenia_gpu_draws_culled_total",
+    "Guest draws dropped on the CPU as they couldn't produce any pixels.");
+metrics::Counter worker_spin_wakeups_metric(
+    "xenia_gpu_command_processor_spin_wakeups_total",
+    "New guest commands noticed by the command processor while spinning.");
+metrics::Counter worker_sleep_wakeups_metric(
+    "xenia_gpu_command_processor_sleep_wakeups_total",
+    "Wakeups of the command processor sleeping until new guest commands.");
+metrics::Histogram worker_wakeup_latency_metric(
+    "xenia_gpu_command_processor_wakeup_latency_microseconds",
+    "Time from the guest writing the ring buffer write pointer to the command "
+    "processor starting executing the new commands after waiting for them.",
+    {5, 10, 25, 50, 100, 250, 500, 1000, 2000});
+metrics::Counter submission_fence_wait_metric(
+    "xenia_gpu_submission_fence_wait_microseconds_total",
+    "Time the command processor spent blocked waiting for the host GPU to "
+    "complete submissions.");
+metrics::Histogram submission_fence_waits_metric(
+    "xenia_gpu_submission_fence_wait_microseconds",
+    "Durations of the blocking waits for the host GPU submission fences.",
+    {10, 100, 500, 1000, 2000, 4000, 8000, 16000, 33000});
+}  // namespace
+
 CommandProcessor::CommandProcessor(GraphicsSystem* graphics_system,
                                    kernel::KernelState* kernel_state)
     : reader_(nullptr, 0),
@@ -86,6 +148,10 @@ bool CommandProcessor::Initialize() {
     }
   }
 
+  if (cvars::gpu_indirect_buffer_cache) {
+    indirect_buffer_cache_ = std::make_unique<IndirectBufferCache>(*memory_);
+  }
+
   worker_running_ = true;
   worker_thread_ = kernel::object_ref<kernel::XHostThread>(
       new kernel::XHostThread(kernel_state_, 128 * 1024, 0, [this]() {
@@ -105,10 +171,57 @@ void CommandProcessor::Shutdown() {
   write_ptr_index_event_->Set();
   worker_thread_->Wait(0, 0, 0, nullptr);
   worker_thread_.reset();
+
+  indirect_buffer_cache_.reset();
 }
 
 void CommandProcessor::InitializeShaderStorage(
     const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  shader_storage_cache_root_ = cache_root;
+  shader_storage_title_id_ = title_id;
+  ImportShaderStorage(cache_root, title_id);
+}
+
+void CommandProcessor::ImportShaderStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id) {
+  const std::filesystem::path& import_root = cvars::shader_storage_import_path;
+  std::error_code error_code;
+  if (import_root.empty() ||
+      !std::filesystem::is_directory(import_root, error_code)) {
+    return;
+  }
+  auto shareable_root = cache_root / "shaders" / "shareable";
+  std::filesystem::create_directories(shareable_root, error_code);
+  // All the storage files of the title are prefixed with its ID - the guest
+  // shaders and the pipelines for every host GPU API and configuration, each
+  // loaded by the backend it's for.
+  std::string title_prefix = fmt::format("{:08X}.", title_id);
+  size_t files_imported = 0;
+  for (const std::filesystem::directory_entry& entry :
+       std::filesystem::directory_iterator(import_root, error_code)) {
+    if (!entry.is_regular_file(error_code)) {
+      continue;
+    }
+    std::string file_name = xe::path_to_utf8(entry.path().filename());
+    if (!utf8::starts_with(file_name, title_prefix)) {
+      continue;
+    }
+    // Not replacing what has been gathered locally already.
+    auto local_path = shareable_root / entry.path().filename();
+    if (std::filesystem::exists(local_path, error_code)) {
+      continue;
+    }
+    if (!std::filesystem::copy_file(entry.path(), local_path, error_code)) {
+      XELOGW("Failed to import the shader storage file {}: {}",
+             xe::path_to_utf8(entry.path()), error_code.message());
+      continue;
+    }
+    ++files_imported;
+  }
+  if (files_imported) {
+    XELOGI("Imported {} shader storage files for title {:08X} from {}",
+           files_imported, title_id, xe::path_to_utf8(import_root));
+  }
 }
 
 void CommandProcessor::RequestFrameTrace(
@@ -197,7 +310,77 @@ void CommandProcessor::CallInThread(std::function<void()> fn) {
   }
 }
 
-void CommandProcessor::ClearCaches() {}
+void CommandProcessor::ClearCaches() {
+  if (indirect_buffer_cache_) {
+    indirect_buffer_cache_->Clear();
+  }
+}
+
+void CommandProcessor::BeginBenchmarkStatistics() {
+  benchmark_statistics_ = BenchmarkStatistics();
+  benchmark_statistics_enabled_ = true;
+}
+
+CommandProcessor::BenchmarkStatistics
+CommandProcessor::EndBenchmarkStatistics() {
+  benchmark_statistics_enabled_ = false;
+  return benchmark_statistics_;
+}
+
+CommandProcessor::LiveStatistics CommandProcessor::GetLiveStatistics() const {
+  LiveStatistics statistics;
+  statistics.pipeline_created_count =
+      live_pipeline_created_count_.load(std::memory_order_relaxed);
+  statistics.texture_load_bytes =
+      live_texture_load_bytes_.load(std::memory_order_relaxed);
+  statistics.pipeline_pending_count =
+      live_pipeline_pending_count_.load(std::memory_order_relaxed);
+  statistics.shared_memory_invalidation_count =
+      live_shared_memory_invalidation_count_.load(std::memory_order_relaxed);
+  statistics.culled_draw_count =
+      live_culled_draw_count_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+uint32_t CommandProcessor::GetFramesInFlight(uint32_t max_frames_in_flight) {
+  return std::clamp(cvars::gpu_frames_in_flight, uint32_t(1),
+                    max_frames_in_flight);
+}
+
+void CommandProcessor::RecordSubmissionFenceWait(uint64_t host_ticks) {
+  uint64_t microseconds =
+      host_ticks * 1000000 / std::max(Clock::QueryHostTickFrequency(),
+                                       uint64_t(1));
+  submission_fence_wait_metric.Add(microseconds);
+  submission_fence_waits_metric.Observe(microseconds);
+}
+
+void CommandProcessor::PublishLiveStatistics(
+    const LiveStatistics& statistics) {
+  // The totals only grow for the lifetime of the command processor.
+  frames_metric.Add();
+  pipelines_created_metric.Add(
+      statistics.pipeline_created_count -
+      live_pipeline_created_count_.load(std::memory_order_relaxed));
+  texture_load_bytes_metric.Add(
+      statistics.texture_load_bytes -
+      live_texture_load_bytes_.load(std::memory_order_relaxed));
+  pipelines_pending_metric.Set(statistics.pipeline_pending_count);
+  shared_memory_invalidations_metric.Observe(
+      statistics.shared_memory_invalidation_count);
+  culled_draws_metric.Add(statistics.culled_draw_count);
+  live_pipeline_created_count_.store(statistics.pipeline_created_count,
+                                     std::memory_order_relaxed);
+  live_texture_load_bytes_.store(statistics.texture_load_bytes,
+                                 std::memory_order_relaxed);
+  live_pipeline_pending_count_.store(statistics.pipeline_pending_count,
+                                     std::memory_order_relaxed);
+  live_shared_memory_invalidation_count_.store(
+      statistics.shared_memory_invalidation_count, std::memory_order_relaxed);
+  live_culled_draw_count_.store(statistics.culled_draw_count,
+                                std::memory_order_relaxed);
+  frame_culled_draw_count_ = 0;
+}
 
 void CommandProcessor::SetDesiredSwapPostEffect(
     SwapPostEffect swap_post_effect) {
@@ -223,24 +406,61 @@ void CommandProcessor::WorkerThreadMain() {
       fn();
     }
 
+    if (context_restart_pending_) {
+      // All the guest data is reloaded from the memory after recreating the
+      // context, the EDRAM contents are lost.
+      context_restart_pending_ = false;
+      ShutdownContext();
+      if (!SetupContext()) {
+        xe::FatalError("Unable to recreate command processor internal state");
+        return;
+      }
+      if (!shader_storage_cache_root_.empty()) {
+        InitializeShaderStorage(shader_storage_cache_root_,
+                                shader_storage_title_id_, true);
+      }
+    }
+
     uint32_t write_ptr_index = write_ptr_index_.load();
     if (write_ptr_index == 0xBAADF00D || read_ptr_index_ == write_ptr_index) {
       SCOPE_profile_cpu_i("gpu", "xe::gpu::CommandProcessor::Stall");
       // We've run out of commands to execute.
-      // We spin here waiting for new ones, as the overhead of waiting on our
-      // event is too high.
+      // Spinning for a short time first, as the guest often submits the next
+      // commands soon, and waking up from an event is much slower, then
+      // sleeping until the guest writes the write pointer. The event is only
+      // signaled by the guest if the worker may be sleeping, so spinning
+      // doesn't cost the guest anything.
       PrepareForWait();
-      uint32_t loop_count = 0;
+      uint64_t spin_end_tick =
+          Clock::QueryHostTickCount() +
+          Clock::QueryHostTickFrequency() *
+              cvars::gpu_worker_spin_microseconds / 1000000;
+      bool slept = false;
       do {
-        // If we spin around too much, revert to a "low-power" state.
-        if (loop_count > 500) {
-          const int wait_time_ms = 2;
-          xe::threading::Wait(write_ptr_index_event_.get(), true,
-                              std::chrono::milliseconds(wait_time_ms));
+        if (Clock::QueryHostTickCount() < spin_end_tick) {
+          for (uint32_t i = 0; i < 32; ++i) {
+#if XE_ARCH_AMD64 == 1
+            _mm_pause();
+#else
+            xe::threading::MaybeYield();
+#endif
+          }
         } else {
-          xe::threading::MaybeYield();
+          // Sequentially consistent with storing the write pointer and loading
+          // the sleeping flag in UpdateWritePointer, so either the guest sees
+          // the flag, or the worker sees the new write pointer.
+          worker_sleeping_.store(true);
+          write_ptr_index = write_ptr_index_.load();
+          if (worker_running_ && pending_fns_.empty() &&
+              (write_ptr_index == 0xBAADF00D ||
+               read_ptr_index_ == write_ptr_index)) {
+            // With a timeout for checking the functions called in the thread.
+            xe::threading::Wait(write_ptr_index_event_.get(), true,
+                                std::chrono::milliseconds(2));
+            slept = true;
+          }
+          worker_sleeping_.store(false);
         }
-        loop_count++;
         write_ptr_index = write_ptr_index_.load();
       } while (worker_running_ && pending_fns_.empty() &&
                (write_ptr_index == 0xBAADF00D ||
@@ -249,6 +469,15 @@ void CommandProcessor::WorkerThreadMain() {
       if (!worker_running_ || !pending_fns_.empty()) {
         continue;
       }
+      (slept ? worker_sleep_wakeups_metric : worker_spin_wakeups_metric).Add();
+      uint64_t write_ptr_update_tick =
+          write_ptr_update_host_tick_.load(std::memory_order_relaxed);
+      uint64_t wakeup_tick = Clock::QueryHostTickCount();
+      if (wakeup_tick > write_ptr_update_tick) {
+        worker_wakeup_latency_metric.Observe(
+            (wakeup_tick - write_ptr_update_tick) * 1000000 /
+            Clock::QueryHostTickFrequency());
+      }
     }
     assert_true(read_ptr_index_ != write_ptr_index);
 
@@ -371,8 +600,14 @@ void CommandProcessor::UpdateWritePointer(uint32_t value) {
   XE_UNLIKELY_IF (cvars::log_ringbuffer_kickoff_initiator_bts) {
     LogKickoffInitator(value);
   }
+  write_ptr_update_host_tick_.store(Clock::QueryHostTickCount(),
+                                    std::memory_order_relaxed);
   write_ptr_index_ = value;
-  write_ptr_index_event_->SetBoostPriority();
+  // Waking up the worker only if it may be sleeping, not if it's busy or
+  // spinning, as signaling the event is a system call.
+  if (worker_sleeping_.load()) {
+    write_ptr_index_event_->SetBoostPriority();
+  }
 }
 
 void CommandProcessor::LogRegisterSet(uint32_t register_index, uint32_t value) {
@@ -733,6 +968,19 @@ void CommandProcessor::InitializeTrace() {
   trace_writer_.WriteGammaRamp(gamma_ramp_256_entry_table(),
                                gamma_ramp_pwl_rgb(), gamma_ramp_rw_component_);
 }
+
+size_t CommandProcessor::ResetSubmissionScratchArena() {
+  submission_scratch_arena_.Reset();
+  size_t chunk_bytes = submission_scratch_arena_.chunk_bytes_allocated();
+  size_t new_chunk_bytes = chunk_bytes - submission_scratch_chunk_bytes_;
+  submission_scratch_chunk_bytes_ = chunk_bytes;
+  if (new_chunk_bytes) {
+    XELOGGPU("Submission scratch arena grew by {} bytes to {} bytes",
+             new_chunk_bytes, chunk_bytes);
+  }
+  return new_chunk_bytes;
+}
+
 #define COMMAND_PROCESSOR CommandProcessor
 #include "pm4_command_processor_implement.h"
 }  // namespace gpu
@@ -19,7 +19,10 @@
 #include <string>
 #include <vector>
 
+#include "xenia/base/arena.h"
 #include "xenia/base/ring_buffer.h"
+#include "xenia/gpu/draw_resolution_scale_controller.h"
+#include "xenia/gpu/indirect_buffer_cache.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/trace_writer.h"
 #include "xenia/gpu/xenos.h"
@@ -92,6 +95,58 @@ class CommandProcessor {
 
   virtual void ClearCaches();
 
+  // Work done by the command processor between BeginBenchmarkStatistics and
+  // EndBenchmarkStatistics, for benchmarking trace playback.
+  struct BenchmarkStatistics {
+    uint32_t submission_count = 0;
+    // Submissions the GPU execution time could be measured for, and the sum of
+    // their GPU execution times, if the implementation supports measuring it.
+    uint32_t gpu_timed_submission_count = 0;
+    uint64_t gpu_time_ns = 0;
+    uint32_t pipeline_lookup_count = 0;
+    uint32_t pipeline_miss_count = 0;
+    uint32_t texture_lookup_count = 0;
+    uint32_t texture_miss_count = 0;
+    // Guest bytes of the texture data loaded from the memory or the disk cache.
+    uint64_t texture_load_bytes = 0;
+    // Host render passes begun, for the implementations using them, and the
+    // commands submitting the batched resource barriers, for finding what
+    // splits the work into more render passes than needed.
+    uint32_t render_pass_count = 0;
+    uint32_t barrier_batch_count = 0;
+    // Guest memory bytes marked as written by shader memory exports, for the
+    // implementations supporting them.
+    uint64_t memexport_bytes = 0;
+  };
+  // Both must be called on the command processor thread. Ending submits all
+  // the pending work and awaits its completion so its GPU time is included.
+  virtual void BeginBenchmarkStatistics();
+  virtual BenchmarkStatistics EndBenchmarkStatistics();
+
+  // Published by the implementations at the end of every guest frame, so they
+  // can be read from any thread, such as for the performance overlay, without
+  // synchronizing with the command processor.
+  struct LiveStatistics {
+    // Totals since the command processor was set up.
+    uint64_t pipeline_created_count = 0;
+    uint64_t texture_load_bytes = 0;
+    // At the end of the latest frame.
+    uint32_t pipeline_pending_count = 0;
+    // Shared memory invalidations by CPU writes during the latest frame.
+    uint32_t shared_memory_invalidation_count = 0;
+    // Draws dropped on the CPU during the latest frame as they couldn't
+    // produce any pixels.
+    uint32_t culled_draw_count = 0;
+  };
+  LiveStatistics GetLiveStatistics() const;
+
+  // Invoked on the command processor thread after every guest frame swap, for
+  // the tools measuring the frames. Must be set on the command processor
+  // thread, such as via CallInThread.
+  void set_swap_callback(std::function<void()> swap_callback) {
+    swap_callback_ = std::move(swap_callback);
+  }
+
   // "Desired" is for the external thread managing the post-processing effect.
   SwapPostEffect GetDesiredSwapPostEffect() const {
     return swap_post_effect_desired_;
@@ -152,6 +207,11 @@ class CommandProcessor {
   };
 
   void WorkerThreadMain();
+  // Copies the shareable shader storage files of the title from
+  // shader_storage_import_path that don't exist locally yet, before the backend
+  // loads the storage.
+  static void ImportShaderStorage(const std::filesystem::path& cache_root,
+                                  uint32_t title_id);
   virtual bool SetupContext() = 0;
   virtual void ShutdownContext() = 0;
   // rarely needed, most register writes have no special logic here
@@ -238,6 +298,14 @@ class CommandProcessor {
   }
   virtual bool IssueCopy() { return false; }
 
+  // Guest occlusion queries (EVENT_WRITE_ZPD). EndOcclusionQuery returns the
+  // sample count to report to the guest.
+  virtual void BeginOcclusionQuery() {}
+  virtual uint32_t EndOcclusionQuery(uint32_t sample_counts_address,
+                                     uint32_t fallback_sample_count) {
+    return fallback_sample_count;
+  }
+
   // "Actual" is for the command processor thread, to be read by the
   // implementations.
   SwapPostEffect GetActualSwapPostEffect() const {
@@ -246,12 +314,28 @@ class CommandProcessor {
 
   virtual void InitializeTrace();
 
+  // Scratch containers for the current submission, which must be destroyed
+  // before it ends, to avoid heap allocations in the per-draw paths.
+  template <typename T>
+  using SubmissionScratchVector = std::vector<T, ArenaAllocator<T>>;
+  template <typename T>
+  SubmissionScratchVector<T> MakeSubmissionScratchVector() {
+    return SubmissionScratchVector<T>(
+        ArenaAllocator<T>(submission_scratch_arena_));
+  }
+  // To be called by the implementations when the submission has ended.
+  // Returns the bytes of new arena chunks allocated from the heap during the
+  // submission, which should be zero once warmed up.
+  size_t ResetSubmissionScratchArena();
+
   Memory* memory_ = nullptr;
   kernel::KernelState* kernel_state_ = nullptr;
   GraphicsSystem* graphics_system_ = nullptr;
   RegisterFile* XE_RESTRICT register_file_ = nullptr;
 
   TraceWriter trace_writer_;
+  // Null if disabled.
+  std::unique_ptr<IndirectBufferCache> indirect_buffer_cache_;
   enum class TraceState {
     kDisabled,
     kStreaming,
@@ -271,6 +355,26 @@ class CommandProcessor {
 
   uint32_t counter_ = 0;
 
+  // Incremented by the implementations for the draws they drop without doing
+  // anything for them, and reset when the statistics are published.
+  uint32_t frame_culled_draw_count_ = 0;
+
+  // To be called on the command processor thread at the end of a frame.
+  void PublishLiveStatistics(const LiveStatistics& statistics);
+
+  // The number of guest frames the implementation may have submitted but not
+  // completed on the host GPU when opening a new one, from the configuration,
+  // clamped to the size of the per-frame resource rings of the implementation.
+  static uint32_t GetFramesInFlight(uint32_t max_frames_in_flight);
+  // To be called by the implementations for the time spent blocked on the host
+  // GPU submission fences, in the host ticks.
+  static void RecordSubmissionFenceWait(uint64_t host_ticks);
+  std::atomic<uint64_t> live_pipeline_created_count_ = {0};
+  std::atomic<uint64_t> live_texture_load_bytes_ = {0};
+  std::atomic<uint32_t> live_pipeline_pending_count_ = {0};
+  std::atomic<uint32_t> live_shared_memory_invalidation_count_ = {0};
+  std::atomic<uint32_t> live_culled_draw_count_ = {0};
+
   uint32_t primary_buffer_ptr_ = 0;
   uint32_t primary_buffer_size_ = 0;
 
@@ -280,6 +384,11 @@ class CommandProcessor {
 
   std::unique_ptr<xe::threading::Event> write_ptr_index_event_;
   std::atomic<uint32_t> write_ptr_index_;
+  // Whether the worker may be waiting on write_ptr_index_event_ rather than
+  // spinning or executing.
+  std::atomic<bool> worker_sleeping_ = {false};
+  // For measuring the latency of resuming the command processing.
+  std::atomic<uint64_t> write_ptr_update_host_tick_ = {0};
 
   uint64_t bin_select_ = 0xFFFFFFFFull;
   uint64_t bin_mask_ = 0xFFFFFFFFull;
@@ -289,12 +398,30 @@ class CommandProcessor {
 
   bool paused_ = false;
 
+  // Whether the submissions need to be counted and timed for benchmarking,
+  // between BeginBenchmarkStatistics and EndBenchmarkStatistics.
+  bool benchmark_statistics_enabled_ = false;
+  BenchmarkStatistics benchmark_statistics_;
+
+  std::function<void()> swap_callback_;
+
   // By default (such as for tools), post-processing is disabled.
   // "Desired" is for the external thread managing the post-processing effect.
   SwapPostEffect swap_post_effect_desired_ = SwapPostEffect::kNone;
   SwapPostEffect swap_post_effect_actual_ = SwapPostEffect::kNone;
 
+  DrawResolutionScaleController draw_resolution_scale_controller_;
+  // Set when the draw resolution scale has been changed, to recreate the
+  // context between primary buffers.
+  bool context_restart_pending_ = false;
+  // For reinitializing the shader storage after recreating the context.
+  std::filesystem::path shader_storage_cache_root_;
+  uint32_t shader_storage_title_id_ = 0;
+
  private:
+  Arena submission_scratch_arena_{256_KiB};
+  size_t submission_scratch_chunk_bytes_ = 0;
+
   reg::DC_LUT_30_COLOR gamma_ramp_256_entry_table_[256] = {};
   reg::DC_LUT_PWL_DATA gamma_ramp_pwl_rgb_[128][3] = {};
   uint32_t gamma_ramp_rw_component_ = 0;
@@ -14,6 +14,7 @@
 #include <utility>
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
@@ -45,6 +46,15 @@ DEFINE_bool(d3d12_readback_resolve, false,
             "causes mid-frame synchronization, so it has a huge performance "
             "impact.",
             "D3D12");
+DEFINE_bool(d3d12_readback_async, false,
+            "With d3d12_readback_memexport or d3d12_readback_resolve, instead "
+            "of waiting for the GPU immediately, write the data to guest "
+            "memory when the GPU has finished the submission that produced it "
+            "(skipping the pages modified by the CPU since). Avoids the "
+            "mid-frame synchronization, but the data reaches the CPU later, so "
+            "this only works in games not reading it right after the draw or "
+            "the resolve.",
+            "D3D12");
 DEFINE_bool(d3d12_submit_on_primary_buffer_end, true,
             "Submit the command list when a PM4 primary buffer ends if it's "
             "possible to submit immediately to try to reduce frame latency.",
@@ -53,6 +63,17 @@ DEFINE_bool(d3d12_clear_memory_page_state, false,
             "Refresh state of memory pages to enable gpu written data. (Use "
             "for 'Team Ninja' Games to fix missing character models)",
             "D3D12");
+DEFINE_bool(d3d12_async_swap_post_processing, false,
+            "Apply the gamma ramp and FXAA to the guest output on an "
+            "asynchronous compute queue, overlapping with the rendering of "
+            "the next frame on the direct queue instead of delaying it.",
+            "D3D12");
+DEFINE_uint32(
+    d3d12_parallel_command_lists, 0,
+    "Maximum number of command lists the commands of a submission are "
+    "recorded to in parallel on multiple threads, split at render target "
+    "changes. 0 or 1 to record everything on the command processor thread.",
+    "D3D12");
 
 namespace xe {
 namespace gpu {
@@ -84,7 +105,8 @@ namespace shaders {
 D3D12CommandProcessor::D3D12CommandProcessor(
     D3D12GraphicsSystem* graphics_system, kernel::KernelState* kernel_state)
     : CommandProcessor(graphics_system, kernel_state),
-      deferred_command_list_(*this) {}
+      deferred_command_list_(*this),
+      async_compute_deferred_command_list_(*this) {}
 D3D12CommandProcessor::~D3D12CommandProcessor() = default;
 
 void D3D12CommandProcessor::ClearCaches() {
@@ -92,10 +114,186 @@ void D3D12CommandProcessor::ClearCaches() {
   cache_clear_requested_ = true;
 }
 
+void D3D12CommandProcessor::BeginBenchmarkStatistics() {
+  // Don't include the work done before.
+  AwaitAllQueueOperationsCompletion();
+  CommandProcessor::BeginBenchmarkStatistics();
+  pipeline_cache_->ResetPipelineLookupCounts();
+  texture_cache_->ResetTextureLookupCounts();
+  InitializeTimestampQueries();
+}
+
+CommandProcessor::BenchmarkStatistics
+D3D12CommandProcessor::EndBenchmarkStatistics() {
+  // Read back the timestamps of all the submissions.
+  AwaitAllQueueOperationsCompletion();
+  benchmark_statistics_.pipeline_lookup_count =
+      pipeline_cache_->pipeline_lookup_count();
+  benchmark_statistics_.pipeline_miss_count =
+      pipeline_cache_->pipeline_miss_count();
+  benchmark_statistics_.texture_lookup_count =
+      texture_cache_->texture_lookup_count();
+  benchmark_statistics_.texture_miss_count =
+      texture_cache_->texture_miss_count();
+  benchmark_statistics_.texture_load_bytes =
+      texture_cache_->texture_load_byte_count();
+  return CommandProcessor::EndBenchmarkStatistics();
+}
+
+GpuPass D3D12CommandProcessor::SwitchGpuPass(GpuPass pass) {
+  if (pass != GpuPass::kDraws) {
+    // Not guest draws, such as EDRAM transfers, must not be counted.
+    EndOcclusionHostQuery();
+  }
+  GpuPass previous_pass;
+  uint32_t query = gpu_pass_timestamps_.SwitchPass(pass, previous_pass);
+  if (query != UINT32_MAX) {
+    deferred_command_list_.D3DEndQuery(timestamp_query_heap_,
+                                       D3D12_QUERY_TYPE_TIMESTAMP, query);
+  }
+  return previous_pass;
+}
+
+bool D3D12CommandProcessor::InitializeTimestampQueries() {
+  if (timestamp_query_heap_) {
+    return true;
+  }
+  const ui::d3d12::D3D12Provider& provider = GetD3D12Provider();
+  ID3D12Device* device = provider.GetDevice();
+  UINT64 timestamp_frequency;
+  if (FAILED(provider.GetDirectQueue()->GetTimestampFrequency(
+          &timestamp_frequency)) ||
+      !timestamp_frequency) {
+    XELOGW("Failed to get the GPU timestamp frequency, not measuring the GPU "
+           "time");
+    return false;
+  }
+  D3D12_QUERY_HEAP_DESC query_heap_desc;
+  query_heap_desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+  query_heap_desc.Count = GpuPassTimestamps::kTimestampCount;
+  query_heap_desc.NodeMask = 0;
+  if (FAILED(device->CreateQueryHeap(&query_heap_desc,
+                                     IID_PPV_ARGS(&timestamp_query_heap_)))) {
+    XELOGW("Failed to create the timestamp query heap, not measuring the GPU "
+           "time");
+    return false;
+  }
+  D3D12_RESOURCE_DESC buffer_desc;
+  ui::d3d12::util::FillBufferResourceDesc(
+      buffer_desc, sizeof(uint64_t) * GpuPassTimestamps::kTimestampCount,
+      D3D12_RESOURCE_FLAG_NONE);
+  if (FAILED(device->CreateCommittedResource(
+          &ui::d3d12::util::kHeapPropertiesReadback,
+          provider.GetHeapFlagCreateNotZeroed(), &buffer_desc,
+          D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+          IID_PPV_ARGS(&timestamp_readback_buffer_)))) {
+    XELOGW("Failed to create the timestamp readback buffer, not measuring the "
+           "GPU time");
+    ui::d3d12::util::ReleaseAndNull(timestamp_query_heap_);
+    return false;
+  }
+  void* timestamp_readback_mapping;
+  if (FAILED(timestamp_readback_buffer_->Map(0, nullptr,
+                                             &timestamp_readback_mapping))) {
+    XELOGW("Failed to map the timestamp readback buffer, not measuring the "
+           "GPU time");
+    ui::d3d12::util::ReleaseAndNull(timestamp_readback_buffer_);
+    ui::d3d12::util::ReleaseAndNull(timestamp_query_heap_);
+    return false;
+  }
+  timestamp_readback_mapping_ =
+      static_cast<const uint64_t*>(timestamp_readback_mapping);
+  timestamp_frequency_ = timestamp_frequency;
+  return true;
+}
+
+bool D3D12CommandProcessor::InitializeOcclusionQueries() {
+  if (occlusion_query_heap_) {
+    return true;
+  }
+  const ui::d3d12::D3D12Provider& provider = GetD3D12Provider();
+  ID3D12Device* device = provider.GetDevice();
+  D3D12_QUERY_HEAP_DESC query_heap_desc;
+  query_heap_desc.Type = D3D12_QUERY_HEAP_TYPE_OCCLUSION;
+  query_heap_desc.Count = OcclusionQueryTracker::kHostQueryCount;
+  query_heap_desc.NodeMask = 0;
+  if (FAILED(device->CreateQueryHeap(&query_heap_desc,
+                                     IID_PPV_ARGS(&occlusion_query_heap_)))) {
+    XELOGW("Failed to create the occlusion query heap, not using host "
+           "occlusion queries");
+    return false;
+  }
+  D3D12_RESOURCE_DESC buffer_desc;
+  ui::d3d12::util::FillBufferResourceDesc(
+      buffer_desc, sizeof(uint64_t) * OcclusionQueryTracker::kHostQueryCount,
+      D3D12_RESOURCE_FLAG_NONE);
+  if (FAILED(device->CreateCommittedResource(
+          &ui::d3d12::util::kHeapPropertiesReadback,
+          provider.GetHeapFlagCreateNotZeroed(), &buffer_desc,
+          D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+          IID_PPV_ARGS(&occlusion_query_readback_buffer_)))) {
+    XELOGW("Failed to create the occlusion query readback buffer, not using "
+           "host occlusion queries");
+    ui::d3d12::util::ReleaseAndNull(occlusion_query_heap_);
+    return false;
+  }
+  void* occlusion_query_readback_mapping;
+  if (FAILED(occlusion_query_readback_buffer_->Map(
+          0, nullptr, &occlusion_query_readback_mapping))) {
+    XELOGW("Failed to map the occlusion query readback buffer, not using host "
+           "occlusion queries");
+    ui::d3d12::util::ReleaseAndNull(occlusion_query_readback_buffer_);
+    ui::d3d12::util::ReleaseAndNull(occlusion_query_heap_);
+    return false;
+  }
+  occlusion_query_readback_mapping_ =
+      static_cast<const uint64_t*>(occlusion_query_readback_mapping);
+  return true;
+}
+
+void D3D12CommandProcessor::BeginOcclusionHostQuery() {
+  if (!occlusion_query_heap_ ||
+      occlusion_query_tracker_.is_host_query_active()) {
+    return;
+  }
+  uint32_t query = occlusion_query_tracker_.BeginHostQuery(submission_current_);
+  if (query != UINT32_MAX) {
+    deferred_command_list_.D3DBeginQuery(occlusion_query_heap_,
+                                         D3D12_QUERY_TYPE_OCCLUSION, query);
+  }
+}
+
+void D3D12CommandProcessor::EndOcclusionHostQuery() {
+  uint32_t query = occlusion_query_tracker_.EndHostQuery();
+  if (query != UINT32_MAX) {
+    deferred_command_list_.D3DEndQuery(occlusion_query_heap_,
+                                       D3D12_QUERY_TYPE_OCCLUSION, query);
+  }
+}
+
+void D3D12CommandProcessor::BeginOcclusionQuery() {
+  if (!occlusion_query_heap_) {
+    return;
+  }
+  EndOcclusionHostQuery();
+  occlusion_query_tracker_.BeginGuestQuery();
+}
+
+uint32_t D3D12CommandProcessor::EndOcclusionQuery(
+    uint32_t sample_counts_address, uint32_t fallback_sample_count) {
+  if (!occlusion_query_heap_) {
+    return fallback_sample_count;
+  }
+  EndOcclusionHostQuery();
+  return occlusion_query_tracker_.EndGuestQuery(sample_counts_address,
+                                                fallback_sample_count);
+}
+
 void D3D12CommandProcessor::InitializeShaderStorage(
     const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
   CommandProcessor::InitializeShaderStorage(cache_root, title_id, blocking);
   pipeline_cache_->InitializeShaderStorage(cache_root, title_id, blocking);
+  texture_cache_->InitializeDiskCache(cache_root, title_id);
 }
 
 void D3D12CommandProcessor::RequestFrameTrace(
@@ -162,6 +360,9 @@ void D3D12CommandProcessor::SubmitBarriers() {
   if (barrier_count != 0) {
     deferred_command_list_.D3DResourceBarrier(barrier_count, barriers_.data());
     barriers_.clear();
+    if (benchmark_statistics_enabled_) {
+      ++benchmark_statistics_.barrier_batch_count;
+    }
   }
 }
 
@@ -880,6 +1081,42 @@ bool D3D12CommandProcessor::SetupContext() {
   // Optional - added in Creators Update (SDK 10.0.15063.0).
   command_list_->QueryInterface(IID_PPV_ARGS(&command_list_1_));
 
+  if (cvars::d3d12_async_swap_post_processing) {
+    D3D12_COMMAND_QUEUE_DESC async_compute_queue_desc;
+    async_compute_queue_desc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+    async_compute_queue_desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+    async_compute_queue_desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    async_compute_queue_desc.NodeMask = 0;
+    if (FAILED(device->CreateCommandQueue(
+            &async_compute_queue_desc, IID_PPV_ARGS(&async_compute_queue_))) ||
+        FAILED(device->CreateFence(
+            0, D3D12_FENCE_FLAG_NONE,
+            IID_PPV_ARGS(&async_compute_wait_fence_)))) {
+      XELOGW(
+          "Failed to create the asynchronous compute queue, post-processing "
+          "the guest output on the direct queue");
+      ui::d3d12::util::ReleaseAndNull(async_compute_wait_fence_);
+      ui::d3d12::util::ReleaseAndNull(async_compute_queue_);
+    }
+  }
+
+  // The command processor thread records the first segment itself.
+  command_list_segment_next_ = 0;
+  command_list_segment_end_ = 0;
+  command_list_segments_remaining_ = 0;
+  command_list_threads_shutdown_ = false;
+  uint32_t command_list_count =
+      std::min(std::min(cvars::d3d12_parallel_command_lists,
+                        kMaxParallelCommandLists),
+               std::max(xe::threading::logical_processor_count(), uint32_t(1)));
+  for (uint32_t i = 1; i < command_list_count; ++i) {
+    std::unique_ptr<xe::threading::Thread> command_list_thread =
+        xe::threading::Thread::Create({}, [this]() { CommandListThread(); });
+    assert_not_null(command_list_thread);
+    command_list_thread->set_name("D3D12 Command Lists");
+    command_list_threads_.push_back(std::move(command_list_thread));
+  }
+
   bindless_resources_used_ =
       cvars::d3d12_bindless &&
       provider.GetResourceBindingTier() >= D3D12_RESOURCE_BINDING_TIER_2;
@@ -895,6 +1132,8 @@ bool D3D12CommandProcessor::SetupContext() {
           draw_resolution_scale_x, draw_resolution_scale_y, provider)) {
     draw_resolution_scale_not_clamped = false;
   }
+  draw_resolution_scale_controller_.Apply(draw_resolution_scale_x,
+                                          draw_resolution_scale_y);
   if (!draw_resolution_scale_not_clamped) {
     XELOGW(
         "The requested draw resolution scale is not supported by the device or "
@@ -1634,6 +1873,18 @@ bool D3D12CommandProcessor::SetupContext() {
   pix_capture_requested_.store(false, std::memory_order_relaxed);
   pix_capturing_ = false;
 
+  // With the pixel shader interlock, the depth test is done in the shader, so
+  // host queries count the samples before it.
+  if (OcclusionQueryTracker::IsHostQueryingRequested()) {
+    if (render_target_cache_->GetPath() ==
+        RenderTargetCache::Path::kPixelShaderInterlock) {
+      XELOGW("Host occlusion queries are not supported with rasterizer-ordered "
+             "views, reporting the fake sample count");
+    } else {
+      InitializeOcclusionQueries();
+    }
+  }
+
   // Just not to expose uninitialized memory.
   std::memset(&system_constants_, 0, sizeof(system_constants_));
 
@@ -1643,9 +1894,31 @@ bool D3D12CommandProcessor::SetupContext() {
 void D3D12CommandProcessor::ShutdownContext() {
   AwaitAllQueueOperationsCompletion();
 
+  gpu_pass_timestamps_.Shutdown();
+  timestamp_readback_mapping_ = nullptr;
+  ui::d3d12::util::ReleaseAndNull(timestamp_readback_buffer_);
+  ui::d3d12::util::ReleaseAndNull(timestamp_query_heap_);
+  timestamp_query_begin_ = UINT32_MAX;
+
+  occlusion_query_tracker_.Reset();
+  occlusion_query_readback_mapping_ = nullptr;
+  ui::d3d12::util::ReleaseAndNull(occlusion_query_readback_buffer_);
+  ui::d3d12::util::ReleaseAndNull(occlusion_query_heap_);
+
   ui::d3d12::util::ReleaseAndNull(readback_buffer_);
   readback_buffer_size_ = 0;
 
+  for (PendingReadback& pending_readback : pending_readbacks_) {
+    pending_readback.buffer->Release();
+  }
+  pending_readbacks_.clear();
+  for (const std::pair<uint32_t, ID3D12Resource*>& readback_buffer :
+       async_readback_buffers_free_) {
+    readback_buffer.second->Release();
+  }
+  async_readback_buffers_free_.clear();
+  async_readback_ranges_free_.clear();
+
   ui::d3d12::util::ReleaseAndNull(scratch_buffer_);
   scratch_buffer_size_ = 0;
 
@@ -1712,6 +1985,37 @@ void D3D12CommandProcessor::ShutdownContext() {
 
   shared_memory_.reset();
 
+  if (!command_list_threads_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(command_list_thread_mutex_);
+      command_list_threads_shutdown_ = true;
+    }
+    command_list_thread_cond_.notify_all();
+    for (size_t i = 0; i < command_list_threads_.size(); ++i) {
+      xe::threading::Wait(command_list_threads_[i].get(), false);
+    }
+    command_list_threads_.clear();
+  }
+  command_list_segments_.clear();
+  for (ID3D12GraphicsCommandList1* parallel_command_list_1 :
+       parallel_command_lists_1_) {
+    if (parallel_command_list_1) {
+      parallel_command_list_1->Release();
+    }
+  }
+  parallel_command_lists_1_.clear();
+  for (ID3D12GraphicsCommandList* parallel_command_list :
+       parallel_command_lists_) {
+    parallel_command_list->Release();
+  }
+  parallel_command_lists_.clear();
+
+  async_compute_deferred_command_list_.Reset();
+  async_compute_submission_last_ = 0;
+  ui::d3d12::util::ReleaseAndNull(async_compute_command_list_);
+  ui::d3d12::util::ReleaseAndNull(async_compute_wait_fence_);
+  ui::d3d12::util::ReleaseAndNull(async_compute_queue_);
+
   deferred_command_list_.Reset();
   ui::d3d12::util::ReleaseAndNull(command_list_1_);
   ui::d3d12::util::ReleaseAndNull(command_list_);
@@ -1721,6 +2025,7 @@ void D3D12CommandProcessor::ShutdownContext() {
   frame_current_ = 1;
   frame_completed_ = 0;
   std::memset(closed_frame_submissions_, 0, sizeof(closed_frame_submissions_));
+  frames_in_flight_ = GetFramesInFlight(kQueueFrames);
 
   // First release the fences since they may reference fence_completion_event_.
 
@@ -1774,13 +2079,17 @@ void D3D12CommandProcessor::WriteRegisterForceinline(uint32_t index,
   __m128i is_above_lower = _mm_cmpgt_epi16(to_rangecheck, lower_bounds);
   __m128i is_below_upper = _mm_cmplt_epi16(to_rangecheck, upper_bounds);
   __m128i is_within_range = _mm_and_si128(is_above_lower, is_below_upper);
+  // Rewriting a constant with the value it already has, as titles often do
+  // when setting a whole constant block for every draw, doesn't require the
+  // constant buffer to be uploaded again.
+  bool value_changed = register_file_->values[index].u32 != value;
   register_file_->values[index].u32 = value;
 
   uint32_t movmask = static_cast<uint32_t>(_mm_movemask_epi8(is_within_range));
 
   if (movmask) {
     if (movmask & (1 << 3)) {
-      if (frame_open_) {
+      if (frame_open_ && value_changed) {
         uint32_t float_constant_index =
             (index - XE_GPU_REG_SHADER_CONSTANT_000_X) >> 2;
         uint64_t float_constant_mask = 1ULL << float_constant_index;
@@ -1801,12 +2110,18 @@ void D3D12CommandProcessor::WriteRegisterForceinline(uint32_t index,
         }
       }
     } else if (movmask & (1 << 5)) {
-      cbuffer_binding_bool_loop_.up_to_date = false;
+      if (value_changed) {
+        cbuffer_binding_bool_loop_.up_to_date = false;
+      }
     } else if (movmask & (1 << 1)) {
-      cbuffer_binding_fetch_.up_to_date = false;
+      // Rebinding the same resources also doesn't require the texture
+      // bindings to be updated.
+      if (value_changed) {
+        cbuffer_binding_fetch_.up_to_date = false;
 
-      texture_cache_->TextureFetchConstantWritten(
-          (index - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6);
+        texture_cache_->TextureFetchConstantWritten(
+            (index - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6);
+      }
     } else {
       HandleSpecialRegisterWrite(index, value);
     }
@@ -1979,34 +2294,50 @@ void D3D12CommandProcessor::WriteShaderConstantsFromMem(
     bool cbuffer_pixel_uptodate = cbuffer_binding_float_pixel_.up_to_date;
     bool cbuffer_vertex_uptodate = cbuffer_binding_float_vertex_.up_to_date;
     if (cbuffer_pixel_uptodate || cbuffer_vertex_uptodate) {
-      // super naive, could just do some bit magic and interval checking,
-      // but we just need this hoisted out of the copy so we do a bulk copy
-      // because its the actual load/swap/store we're getting murdered by
-      // this precheck followed by copy_and_swap_32_unaligned reduced the cpu
-      // usage from packettype0/writeregistersfrommem from 10-11% of cpu time
-      // spent on xenia to like 1%
-      // chrispy: todo, this can be reduced even further, should be split into
-      // two loops and should skip whole words, this could net us even bigger
-      // gains
+      // Hoisted out of the copy so the copy itself can be done in bulk - the
+      // load/swap/store of individual registers was responsible for most of
+      // the time spent in packet type 0 / WriteRegistersFromMem.
+      // A buffer is only invalidated if a vector used by the current shader
+      // has actually changed, as titles often rewrite whole constant blocks
+      // for every draw while only modifying a few vectors in them.
+      uint32_t end_index = start_index + num_registers;
+      auto vector_changed = [&](uint32_t vector_index) {
+        uint32_t vector_start =
+            XE_GPU_REG_SHADER_CONSTANT_000_X + (vector_index << 2);
+        uint32_t register_index = std::max(vector_start, start_index);
+        uint32_t register_end = std::min(vector_start + 4, end_index);
+        for (; register_index < register_end; ++register_index) {
+          if (xe::load_and_swap<uint32_t>(base +
+                                          (register_index - start_index)) !=
+              register_file_->values[register_index].u32) {
+            return true;
+          }
+        }
+        return false;
+      };
       uint32_t map_index = (start_index - XE_GPU_REG_SHADER_CONSTANT_000_X) / 4;
+      // Including the last vector if it's written partially.
       uint32_t end_map_index =
-          (start_index + num_registers - XE_GPU_REG_SHADER_CONSTANT_000_X) / 4;
+          (end_index - XE_GPU_REG_SHADER_CONSTANT_000_X + 3) / 4;
 
       if (map_index < 256 && cbuffer_vertex_uptodate) {
-        for (; map_index < end_map_index; ++map_index) {
-          if (current_float_constant_map_vertex_[map_index >> 6] &
-              (1ull << map_index)) {
+        uint32_t vertex_end_map_index = std::min(end_map_index, UINT32_C(256));
+        for (; map_index < vertex_end_map_index; ++map_index) {
+          if ((current_float_constant_map_vertex_[map_index >> 6] &
+               (1ull << (map_index & 63))) &&
+              vector_changed(map_index)) {
             cbuffer_vertex_uptodate = false;
             break;
           }
         }
       }
       if (end_map_index > 256 && cbuffer_pixel_uptodate) {
-        for (; map_index < end_map_index; ++map_index) {
-          uint32_t float_constant_index = map_index;
-          float_constant_index -= 256;
-          if (current_float_constant_map_pixel_[float_constant_index >> 6] &
-              (1ull << float_constant_index)) {
+        for (map_index = std::max(map_index, UINT32_C(256));
+             map_index < end_map_index; ++map_index) {
+          uint32_t float_constant_index = map_index - 256;
+          if ((current_float_constant_map_pixel_[float_constant_index >> 6] &
+               (1ull << (float_constant_index & 63))) &&
+              vector_changed(map_index)) {
             cbuffer_pixel_uptodate = false;
             break;
           }
@@ -2025,7 +2356,15 @@ XE_FORCEINLINE
 void D3D12CommandProcessor::WriteBoolLoopFromMem(uint32_t start_index,
                                                  uint32_t* base,
                                                  uint32_t num_registers) {
-  cbuffer_binding_bool_loop_.up_to_date = false;
+  if (cbuffer_binding_bool_loop_.up_to_date) {
+    for (uint32_t i = 0; i < num_registers; ++i) {
+      if (xe::load_and_swap<uint32_t>(base + i) !=
+          register_file_->values[start_index + i].u32) {
+        cbuffer_binding_bool_loop_.up_to_date = false;
+        break;
+      }
+    }
+  }
   copy_and_swap_32_unaligned(&register_file_->values[start_index], base,
                              num_registers);
 }
@@ -2033,15 +2372,23 @@ XE_FORCEINLINE
 void D3D12CommandProcessor::WriteFetchFromMem(uint32_t start_index,
                                               uint32_t* base,
                                               uint32_t num_registers) {
-  cbuffer_binding_fetch_.up_to_date = false;
-
-  uint32_t first_fetch =
-      ((start_index - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6);
-  uint32_t last_fetch =  // i think last_fetch should be inclusive if its modulo
-                         // is nz...
-      (((start_index + num_registers) - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) /
-       6);
-  texture_cache_->TextureFetchConstantsWritten(first_fetch, last_fetch);
+  // Only notifying about the fetch constants that actually change, as titles
+  // often rebind the same resources for every draw.
+  uint32_t first_changed_fetch = UINT32_MAX, last_changed_fetch = 0;
+  for (uint32_t i = 0; i < num_registers; ++i) {
+    if (xe::load_and_swap<uint32_t>(base + i) !=
+        register_file_->values[start_index + i].u32) {
+      uint32_t fetch_index =
+          (start_index + i - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6;
+      first_changed_fetch = std::min(first_changed_fetch, fetch_index);
+      last_changed_fetch = fetch_index;
+    }
+  }
+  if (first_changed_fetch != UINT32_MAX) {
+    cbuffer_binding_fetch_.up_to_date = false;
+    texture_cache_->TextureFetchConstantsWritten(first_changed_fetch,
+                                                 last_changed_fetch);
+  }
 
   copy_and_swap_32_unaligned(&register_file_->values[start_index], base,
                              num_registers);
@@ -2200,6 +2547,8 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
     return;
   }
 
+  EndOcclusionHostQuery();
+
   // Obtain the actual front buffer size to pass to RefreshGuestOutput,
   // resolution-scaled if it's a resolve destination, or not otherwise.
   D3D12_SHADER_RESOURCE_VIEW_DESC swap_texture_srv_desc;
@@ -2281,6 +2630,32 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
 
         context.SetIs8bpc(!use_pwl_gamma_ramp && !use_fxaa);
 
+        auto& d3d12_context = static_cast<
+            ui::d3d12::D3D12Presenter::D3D12GuestOutputRefreshContext&>(
+            context);
+        ID3D12Resource* guest_output_resource =
+            d3d12_context.resource_uav_capable();
+        // kGuestOutputInternalState is not a valid state on the compute queue,
+        // in this case the guest output is left in the UAV state for the
+        // presenter to transition it after awaiting.
+        D3D12_RESOURCE_STATES guest_output_state =
+            async_compute_queue_
+                ? D3D12_RESOURCE_STATE_UNORDERED_ACCESS
+                : ui::d3d12::D3D12Presenter::kGuestOutputInternalState;
+        PushTransitionBarrier(guest_output_resource,
+                              d3d12_context.resource_state(),
+                              guest_output_state);
+        // The rest is done on the asynchronous compute queue if available,
+        // overlapping with the next frame. If failed before the end, the
+        // commands are executed on the direct queue, but the submission fence
+        // is still signaled after them.
+        size_t async_compute_begin = SIZE_MAX;
+        if (async_compute_queue_) {
+          async_compute_begin = BeginAsyncComputeCommands();
+          d3d12_context.SetAsyncCompletion(submission_fence_,
+                                           submission_current_);
+        }
+
         // Upload the new gamma ramp, using the upload buffer for the current
         // frame (will close the frame after this anyway, so can't write
         // multiple times per frame).
@@ -2354,12 +2729,6 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
                             apply_gamma_descriptor_gamma_ramp.first);
         }
 
-        ID3D12Resource* guest_output_resource =
-            static_cast<
-                ui::d3d12::D3D12Presenter::D3D12GuestOutputRefreshContext&>(
-                context)
-                .resource_uav_capable();
-
         if (use_fxaa) {
           fxaa_source_texture_submission_ = submission_current_;
         }
@@ -2368,10 +2737,7 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
             use_fxaa ? fxaa_source_texture_.Get() : guest_output_resource;
         D3D12_RESOURCE_STATES apply_gamma_dest_initial_state =
             use_fxaa ? D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE
-                     : ui::d3d12::D3D12Presenter::kGuestOutputInternalState;
-        static_cast<ui::d3d12::D3D12Presenter::D3D12GuestOutputRefreshContext&>(
-            context)
-            .resource_uav_capable();
+                     : guest_output_state;
         PushTransitionBarrier(apply_gamma_dest, apply_gamma_dest_initial_state,
                               D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         // From now on, even in case of failure, apply_gamma_dest must be
@@ -2442,19 +2808,17 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
             PushTransitionBarrier(apply_gamma_dest,
                                   D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
                                   D3D12_RESOURCE_STATE_COPY_SOURCE);
-            PushTransitionBarrier(
-                guest_output_resource,
-                ui::d3d12::D3D12Presenter::kGuestOutputInternalState,
-                D3D12_RESOURCE_STATE_COPY_DEST);
+            PushTransitionBarrier(guest_output_resource, guest_output_state,
+                                  D3D12_RESOURCE_STATE_COPY_DEST);
             SubmitBarriers();
             deferred_command_list_.D3DCopyResource(guest_output_resource,
                                                    apply_gamma_dest);
             PushTransitionBarrier(apply_gamma_dest,
                                   D3D12_RESOURCE_STATE_COPY_SOURCE,
                                   apply_gamma_dest_initial_state);
-            PushTransitionBarrier(
-                guest_output_resource, D3D12_RESOURCE_STATE_COPY_DEST,
-                ui::d3d12::D3D12Presenter::kGuestOutputInternalState);
+            PushTransitionBarrier(guest_output_resource,
+                                  D3D12_RESOURCE_STATE_COPY_DEST,
+                                  guest_output_state);
             return false;
           } else {
             assert_true(apply_gamma_dest_initial_state ==
@@ -2462,12 +2826,10 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
             PushTransitionBarrier(apply_gamma_dest,
                                   D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
                                   apply_gamma_dest_initial_state);
-            PushTransitionBarrier(
-                guest_output_resource,
-                ui::d3d12::D3D12Presenter::kGuestOutputInternalState,
-                D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            PushTransitionBarrier(guest_output_resource, guest_output_state,
+                                  D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
             // From now on, even in case of failure, guest_output_resource must
-            // be transitioned back to kGuestOutputInternalState!
+            // be transitioned back to guest_output_state!
             deferred_command_list_.D3DSetComputeRootSignature(
                 fxaa_root_signature_.Get());
             FxaaConstants fxaa_constants;
@@ -2509,13 +2871,12 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
                                     : fxaa_pipeline_.Get());
             SubmitBarriers();
             deferred_command_list_.D3DDispatch(group_count_x, group_count_y, 1);
-            PushTransitionBarrier(
-                guest_output_resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-                ui::d3d12::D3D12Presenter::kGuestOutputInternalState);
+            PushTransitionBarrier(guest_output_resource,
+                                  D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                                  guest_output_state);
           }
         } else {
-          assert_true(apply_gamma_dest_initial_state ==
-                      ui::d3d12::D3D12Presenter::kGuestOutputInternalState);
+          assert_true(apply_gamma_dest_initial_state == guest_output_state);
           PushTransitionBarrier(apply_gamma_dest,
                                 D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
                                 apply_gamma_dest_initial_state);
@@ -2524,7 +2885,11 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
         // Need to submit all the commands before giving the image back to the
         // presenter so it can submit its own commands for displaying it to the
         // queue.
-        SubmitBarriers();
+        if (async_compute_begin != SIZE_MAX) {
+          EndAsyncComputeCommands(async_compute_begin);
+        } else {
+          SubmitBarriers();
+        }
         EndSubmission(true);
         return true;
       });
@@ -2604,9 +2969,17 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     // cache.
     if (!memexport_used_vertex) {
       // This draw has no effect.
+      ++frame_culled_draw_count_;
       return true;
     }
   }
+  // Drop the draws that can't cover any pixels before doing anything for them.
+  if (cvars::cull_scissored_out_draws && is_rasterization_done &&
+      !memexport_used_vertex &&
+      render_target_cache_->IsDrawScissoredOut(*vertex_shader)) {
+    ++frame_culled_draw_count_;
+    return true;
+  }
 
   const bool memexport_used_pixel =
       pixel_shader && pixel_shader->is_valid_memexport_used();
@@ -2623,6 +2996,7 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
   }
   if (!primitive_processing_result.host_draw_vertex_count) {
     // Nothing to draw.
+    ++frame_culled_draw_count_;
     return true;
   }
 
@@ -2919,6 +3293,7 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
       shared_memory_->UseForWriting();
     }
     SubmitBarriers();
+    BeginOcclusionHostQuery();
     deferred_command_list_.D3DDrawInstanced(
         primitive_processing_result.host_draw_vertex_count, 1, 0, 0);
   } else {
@@ -2973,6 +3348,7 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
       shared_memory_->UseForReading();
     }
     SubmitBarriers();
+    BeginOcclusionHostQuery();
     deferred_command_list_.D3DDrawIndexedInstanced(
         primitive_processing_result.host_draw_vertex_count, 1, 0, 0, 0);
     if (scratch_index_buffer != nullptr) {
@@ -3020,15 +3396,17 @@ bool D3D12CommandProcessor::GatherMemexportRangesAndMakeResident(
   auto vertex_shader = static_cast<D3D12Shader*>(active_vertex_shader());
   auto pixel_shader = static_cast<D3D12Shader*>(active_pixel_shader());
   const xe::gpu::RegisterFile& regs = *register_file_;
-  const bool memexport_used_vertex = vertex_shader->is_valid_memexport_used();
-  const bool memexport_used_pixel =
-      pixel_shader && pixel_shader->is_valid_memexport_used();
   retflag = true;
-  if (memexport_used_vertex) {
-    for (uint32_t constant_index :
-         vertex_shader->memexport_stream_constants()) {
+  for (uint32_t i = 0; i < 2; ++i) {
+    const D3D12Shader* shader = i ? pixel_shader : vertex_shader;
+    if (!shader || !shader->is_valid_memexport_used()) {
+      continue;
+    }
+    uint32_t constant_register_base = i ? XE_GPU_REG_SHADER_CONSTANT_256_X
+                                         : XE_GPU_REG_SHADER_CONSTANT_000_X;
+    for (uint32_t constant_index : shader->memexport_stream_constants()) {
       const auto& memexport_stream = regs.Get<xenos::xe_gpu_memexport_stream_t>(
-          XE_GPU_REG_SHADER_CONSTANT_000_X + constant_index * 4);
+          constant_register_base + constant_index * 4);
       if (memexport_stream.index_count == 0) {
         continue;
       }
@@ -3040,66 +3418,39 @@ bool D3D12CommandProcessor::GatherMemexportRangesAndMakeResident(
                    xenos::TextureFormat(uint32_t(memexport_stream.format))));
         return false;
       }
-      uint32_t memexport_size_dwords =
+      MemExportRange& memexport_range =
+          memexport_ranges_[memexport_range_count_++];
+      memexport_range.base_address_dwords = memexport_stream.base_address;
+      memexport_range.size_dwords =
           memexport_stream.index_count * memexport_format_size;
-      // Try to reduce the number of shared memory operations when writing
-      // different elements into the same buffer through different exports
-      // (happens in 4D5307E6).
-      bool memexport_range_reused = false;
-      for (uint32_t i = 0; i < memexport_range_count_; ++i) {
-        MemExportRange& memexport_range = memexport_ranges_[i];
-        if (memexport_range.base_address_dwords ==
-            memexport_stream.base_address) {
-          memexport_range.size_dwords =
-              std::max(memexport_range.size_dwords, memexport_size_dwords);
-          memexport_range_reused = true;
-          break;
-        }
-      }
-      // Add a new range if haven't expanded an existing one.
-      if (!memexport_range_reused) {
-        MemExportRange& memexport_range =
-            memexport_ranges_[memexport_range_count_++];
-        memexport_range.base_address_dwords = memexport_stream.base_address;
-        memexport_range.size_dwords = memexport_size_dwords;
-      }
     }
   }
-  if (memexport_used_pixel) {
-    for (uint32_t constant_index : pixel_shader->memexport_stream_constants()) {
-      const auto& memexport_stream = regs.Get<xenos::xe_gpu_memexport_stream_t>(
-          XE_GPU_REG_SHADER_CONSTANT_256_X + constant_index * 4);
-      if (memexport_stream.index_count == 0) {
-        continue;
-      }
-      uint32_t memexport_format_size =
-          GetSupportedMemExportFormatSize(memexport_stream.format);
-      if (memexport_format_size == 0) {
-        XELOGE("Unsupported memexport format {}",
-               FormatInfo::GetName(
-                   xenos::TextureFormat(uint32_t(memexport_stream.format))));
-        return false;
-      }
-      uint32_t memexport_size_dwords =
-          memexport_stream.index_count * memexport_format_size;
-      bool memexport_range_reused = false;
-      for (uint32_t i = 0; i < memexport_range_count_; ++i) {
-        MemExportRange& memexport_range = memexport_ranges_[i];
-        if (memexport_range.base_address_dwords ==
-            memexport_stream.base_address) {
-          memexport_range.size_dwords =
-              std::max(memexport_range.size_dwords, memexport_size_dwords);
-          memexport_range_reused = true;
-          break;
-        }
-      }
-      if (!memexport_range_reused) {
-        MemExportRange& memexport_range =
-            memexport_ranges_[memexport_range_count_++];
-        memexport_range.base_address_dwords = memexport_stream.base_address;
-        memexport_range.size_dwords = memexport_size_dwords;
+  // Coalesce the overlapping and the adjacent ranges, to reduce the number of
+  // shared memory operations when writing different elements into the same
+  // buffer through different exports (happens in 4D5307E6), while still only
+  // invalidating and reading back the memory actually exported to.
+  if (memexport_range_count_ > 1) {
+    std::sort(memexport_ranges_, memexport_ranges_ + memexport_range_count_,
+              [](const MemExportRange& a, const MemExportRange& b) {
+                return a.base_address_dwords < b.base_address_dwords;
+              });
+    uint32_t coalesced_range_count = 1;
+    for (uint32_t i = 1; i < memexport_range_count_; ++i) {
+      const MemExportRange& memexport_range = memexport_ranges_[i];
+      MemExportRange& last_range = memexport_ranges_[coalesced_range_count - 1];
+      uint64_t last_range_end = uint64_t(last_range.base_address_dwords) +
+                                last_range.size_dwords;
+      if (memexport_range.base_address_dwords <= last_range_end) {
+        last_range.size_dwords = uint32_t(
+            std::max(last_range_end,
+                     uint64_t(memexport_range.base_address_dwords) +
+                         memexport_range.size_dwords) -
+            last_range.base_address_dwords);
+      } else {
+        memexport_ranges_[coalesced_range_count++] = memexport_range;
       }
     }
+    memexport_range_count_ = coalesced_range_count;
   }
   for (uint32_t i = 0; i < memexport_range_count_; ++i) {
     const MemExportRange& memexport_range = memexport_ranges_[i];
@@ -3129,8 +3480,22 @@ void D3D12CommandProcessor::HandleMemexportDrawOrdering_AndReadback() {
     const MemExportRange& memexport_range = memexport_ranges_[i];
     shared_memory_->RangeWrittenByGpu(memexport_range.base_address_dwords << 2,
                                       memexport_range.size_dwords << 2, false);
+    if (benchmark_statistics_enabled_) {
+      benchmark_statistics_.memexport_bytes +=
+          uint64_t(memexport_range.size_dwords) << 2;
+    }
   }
-  if (cvars::d3d12_readback_memexport) {
+  if (cvars::d3d12_readback_memexport && cvars::d3d12_readback_async) {
+    SubmissionScratchVector<std::pair<uint32_t, uint32_t>> readback_ranges =
+        MakeSubmissionScratchVector<std::pair<uint32_t, uint32_t>>();
+    readback_ranges.reserve(memexport_range_count_);
+    for (uint32_t i = 0; i < memexport_range_count_; ++i) {
+      const MemExportRange& memexport_range = memexport_ranges_[i];
+      readback_ranges.emplace_back(memexport_range.base_address_dwords << 2,
+                                   memexport_range.size_dwords << 2);
+    }
+    ReadbackSharedMemoryAsync(readback_ranges.data(), readback_ranges.size());
+  } else if (cvars::d3d12_readback_memexport) {
     // Read the exported data on the CPU.
     uint32_t memexport_total_size = 0;
     for (uint32_t i = 0; i < memexport_range_count_; ++i) {
@@ -3221,7 +3586,12 @@ bool D3D12CommandProcessor::IssueCopy_ReadbackResolvePath() {
   uint32_t written_address, written_length;
   if (render_target_cache_->Resolve(*memory_, *shared_memory_, *texture_cache_,
                                     written_address, written_length)) {
-    if (!texture_cache_->IsDrawResolutionScaled() && written_length) {
+    if (!texture_cache_->IsDrawResolutionScaled() && written_length &&
+        cvars::d3d12_readback_async) {
+      std::pair<uint32_t, uint32_t> readback_range(written_address,
+                                                   written_length);
+      ReadbackSharedMemoryAsync(&readback_range, 1);
+    } else if (!texture_cache_->IsDrawResolutionScaled() && written_length) {
       // Read the resolved data on the CPU.
       ID3D12Resource* readback_buffer = RequestReadbackBuffer(written_length);
       if (readback_buffer != nullptr) {
@@ -3286,10 +3656,12 @@ void D3D12CommandProcessor::CheckSubmissionFence(uint64_t await_submission) {
   uint64_t submission_completed_before = submission_completed_;
   submission_completed_ = submission_fence_->GetCompletedValue();
   if (submission_completed_ < await_submission) {
+    uint64_t wait_start_tick = Clock::QueryHostTickCount();
     if (SUCCEEDED(submission_fence_->SetEventOnCompletion(await_submission,
                                                           nullptr))) {
       submission_completed_ = submission_fence_->GetCompletedValue();
     }
+    RecordSubmissionFenceWait(Clock::QueryHostTickCount() - wait_start_tick);
   }
   if (submission_completed_ < await_submission) {
     XELOGE("Failed to await a submission completion Direct3D 12 fence");
@@ -3347,6 +3719,54 @@ void D3D12CommandProcessor::CheckSubmissionFence(uint64_t await_submission) {
   primitive_processor_->CompletedSubmissionUpdated();
 
   texture_cache_->CompletedSubmissionUpdated(submission_completed_);
+
+  CompletePendingReadbacks();
+
+  // Report the results of the guest occlusion queries whose host queries have
+  // been completed.
+  if (occlusion_query_readback_mapping_) {
+    uint32_t draw_resolution_scale = texture_cache_->draw_resolution_scale_x() *
+                                     texture_cache_->draw_resolution_scale_y();
+    uint32_t host_query_first, host_query_count;
+    while (occlusion_query_tracker_.GetCompletedGuestQuery(
+        submission_completed_, host_query_first, host_query_count)) {
+      uint64_t sample_count = 0;
+      for (uint32_t i = 0; i < host_query_count; ++i) {
+        sample_count += occlusion_query_readback_mapping_
+            [(host_query_first + i) % OcclusionQueryTracker::kHostQueryCount];
+      }
+      occlusion_query_tracker_.CompleteGuestQuery(
+          sample_count / draw_resolution_scale, *memory_);
+    }
+  }
+
+  // Gather the GPU time of the submissions whose timestamp slots haven't been
+  // reused by later submissions yet.
+  if (timestamp_readback_mapping_) {
+    uint64_t timestamp_submission_first = submission_completed_before + 1;
+    if (submission_completed_ >= GpuPassTimestamps::kSlotCount) {
+      timestamp_submission_first =
+          std::max(timestamp_submission_first,
+                   submission_completed_ - GpuPassTimestamps::kSlotCount + 1);
+    }
+    double nanoseconds_per_tick = 1000000000.0 / double(timestamp_frequency_);
+    for (uint64_t i = timestamp_submission_first; i <= submission_completed_;
+         ++i) {
+      uint32_t timestamp_query_first, timestamp_query_count;
+      if (!gpu_pass_timestamps_.GetSubmissionQueries(
+              i, timestamp_query_first, timestamp_query_count)) {
+        continue;
+      }
+      uint64_t gpu_time_ns = gpu_pass_timestamps_.SubmissionCompleted(
+          i, timestamp_readback_mapping_ + timestamp_query_first, UINT64_MAX,
+          nanoseconds_per_tick);
+      draw_resolution_scale_controller_.AddSubmissionGpuTime(gpu_time_ns);
+      if (benchmark_statistics_enabled_) {
+        ++benchmark_statistics_.gpu_timed_submission_count;
+        benchmark_statistics_.gpu_time_ns += gpu_time_ns;
+      }
+    }
+  }
 }
 
 bool D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
@@ -3377,18 +3797,21 @@ bool D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
   // resources early) and specifically for frames (not to queue too many), and
   // await the availability of the current frame.
   CheckSubmissionFence(
-      is_opening_frame
-          ? closed_frame_submissions_[frame_current_ % kQueueFrames]
+      is_opening_frame && frame_current_ > frames_in_flight_
+          ? closed_frame_submissions_[(frame_current_ - frames_in_flight_) %
+                                      kQueueFrames]
           : 0);
   // TODO(Triang3l): If failed to await (completed submission < awaited frame
   // submission), do something like dropping the draw command that wanted to
   // open the frame.
   if (is_opening_frame) {
     // Update the completed frame index, also obtaining the actual completed
-    // frame number (since the CPU may be actually less than 3 frames behind)
-    // before reclaiming resources tracked with the frame number.
+    // frame number (since the CPU may be actually less than frames_in_flight_
+    // frames behind) before reclaiming resources tracked with the frame
+    // number.
     frame_completed_ =
-        std::max(frame_current_, uint64_t(kQueueFrames)) - kQueueFrames;
+        std::max(frame_current_, uint64_t(frames_in_flight_)) -
+        frames_in_flight_;
     for (uint64_t frame = frame_completed_ + 1; frame < frame_current_;
          ++frame) {
       if (closed_frame_submissions_[frame % kQueueFrames] >
@@ -3430,6 +3853,14 @@ bool D3D12CommandProcessor::BeginSubmission(bool is_guest_command) {
     primitive_processor_->BeginSubmission();
 
     texture_cache_->BeginSubmission(submission_current_);
+
+    bool time_passes = GpuPassTimestamps::IsPassTimingRequested();
+    if ((benchmark_statistics_enabled_ || time_passes ||
+         draw_resolution_scale_controller_.is_enabled()) &&
+        InitializeTimestampQueries()) {
+      gpu_pass_timestamps_.BeginSubmission(submission_current_, frame_current_,
+                                           time_passes);
+    }
   }
 
   if (is_opening_frame) {
@@ -3513,6 +3944,20 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
     texture_cache_->EndFrame();
 
     primitive_processor_->EndFrame();
+
+    shared_memory_->EndFrame();
+
+    LiveStatistics live_statistics;
+    live_statistics.pipeline_created_count =
+        pipeline_cache_->created_pipeline_count();
+    live_statistics.texture_load_bytes =
+        texture_cache_->total_texture_load_byte_count();
+    live_statistics.pipeline_pending_count =
+        pipeline_cache_->GetPendingPipelineCount();
+    live_statistics.shared_memory_invalidation_count =
+        shared_memory_->last_frame_cpu_invalidation_count();
+    live_statistics.culled_draw_count = frame_culled_draw_count_;
+    PublishLiveStatistics(live_statistics);
   }
 
   if (submission_open_) {
@@ -3520,25 +3965,48 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
 
     pipeline_cache_->EndSubmission();
 
+    shared_memory_->EndSubmission();
+
     // Submit barriers now because resources with the queued barriers may be
     // destroyed between frames.
     SubmitBarriers();
 
+    // Host queries can't span command lists, resolve the ones of this
+    // submission, possibly in two parts if wrapping around the ring.
+    EndOcclusionHostQuery();
+    uint32_t occlusion_query_first;
+    uint32_t occlusion_query_count =
+        occlusion_query_tracker_.TakeSubmissionHostQueries(
+            occlusion_query_first);
+    while (occlusion_query_count) {
+      uint32_t occlusion_query_resolve_count =
+          std::min(occlusion_query_count,
+                   OcclusionQueryTracker::kHostQueryCount -
+                       occlusion_query_first);
+      deferred_command_list_.D3DResolveQueryData(
+          occlusion_query_heap_, D3D12_QUERY_TYPE_OCCLUSION,
+          occlusion_query_first, occlusion_query_resolve_count,
+          occlusion_query_readback_buffer_,
+          sizeof(uint64_t) * occlusion_query_first);
+      occlusion_query_first = 0;
+      occlusion_query_count -= occlusion_query_resolve_count;
+    }
+
     ID3D12CommandQueue* direct_queue = provider.GetDirectQueue();
 
     // Submit the deferred command list.
-    // Only one deferred command list must be executed in the same
-    // ExecuteCommandLists - the boundaries of ExecuteCommandLists are a full
-    // UAV and aliasing barrier, and subsystems of the emulator assume it
-    // happens between Xenia submissions.
-    ID3D12CommandAllocator* command_allocator =
-        command_allocator_writable_first_->command_allocator;
-    command_allocator->Reset();
-    command_list_->Reset(command_allocator, nullptr);
-    deferred_command_list_.Execute(command_list_, command_list_1_);
-    command_list_->Close();
-    ID3D12CommandList* execute_command_lists[] = {command_list_};
-    direct_queue->ExecuteCommandLists(1, execute_command_lists);
+    if (benchmark_statistics_enabled_) {
+      ++benchmark_statistics_.submission_count;
+    }
+    timestamp_query_end_ = gpu_pass_timestamps_.EndSubmission(
+        timestamp_query_begin_, timestamp_query_count_);
+    if (timestamp_query_end_ == UINT32_MAX) {
+      timestamp_query_begin_ = UINT32_MAX;
+    }
+    ExecuteDeferredCommandList(direct_queue);
+    timestamp_query_begin_ = UINT32_MAX;
+    bool async_compute_executed =
+        ExecuteAsyncComputeCommandList(direct_queue);
     command_allocator_writable_first_->last_usage_submission =
         submission_current_;
     if (command_allocator_submitted_last_) {
@@ -3554,9 +4022,22 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
       command_allocator_writable_last_ = nullptr;
     }
 
-    direct_queue->Signal(submission_fence_, submission_current_++);
+    if (async_compute_executed) {
+      async_compute_queue_->Signal(submission_fence_, submission_current_);
+      async_compute_submission_last_ = submission_current_;
+    } else {
+      // Keep the fence values signaled in order if the previous submission was
+      // completed on the asynchronous compute queue.
+      if (async_compute_submission_last_ &&
+          async_compute_submission_last_ + 1 == submission_current_) {
+        direct_queue->Wait(submission_fence_, async_compute_submission_last_);
+      }
+      direct_queue->Signal(submission_fence_, submission_current_);
+    }
+    ++submission_current_;
 
     submission_open_ = false;
+    ResetSubmissionScratchArena();
 
     // Queue operations done directly (like UpdateTileMappings) will be awaited
     // alongside the last submission if needed.
@@ -3626,6 +4107,14 @@ void D3D12CommandProcessor::ClearCommandAllocatorCache() {
   while (command_allocator_submitted_first_) {
     auto next = command_allocator_submitted_first_->next;
     command_allocator_submitted_first_->command_allocator->Release();
+    for (ID3D12CommandAllocator* parallel_command_allocator :
+         command_allocator_submitted_first_->parallel_command_allocators) {
+      parallel_command_allocator->Release();
+    }
+    if (command_allocator_submitted_first_->async_compute_command_allocator) {
+      command_allocator_submitted_first_->async_compute_command_allocator
+          ->Release();
+    }
     delete command_allocator_submitted_first_;
     command_allocator_submitted_first_ = next;
   }
@@ -3633,12 +4122,296 @@ void D3D12CommandProcessor::ClearCommandAllocatorCache() {
   while (command_allocator_writable_first_) {
     auto next = command_allocator_writable_first_->next;
     command_allocator_writable_first_->command_allocator->Release();
+    for (ID3D12CommandAllocator* parallel_command_allocator :
+         command_allocator_writable_first_->parallel_command_allocators) {
+      parallel_command_allocator->Release();
+    }
+    if (command_allocator_writable_first_->async_compute_command_allocator) {
+      command_allocator_writable_first_->async_compute_command_allocator
+          ->Release();
+    }
     delete command_allocator_writable_first_;
     command_allocator_writable_first_ = next;
   }
   command_allocator_writable_last_ = nullptr;
 }
 
+void D3D12CommandProcessor::ExecuteDeferredCommandList(
+    ID3D12CommandQueue* direct_queue) {
+  // Only one deferred command list must be executed in the same
+  // ExecuteCommandLists - the boundaries of ExecuteCommandLists are a full UAV
+  // and aliasing barrier, and subsystems of the emulator assume it happens
+  // between Xenia submissions. If it's split into multiple command lists, all
+  // of them are executed in order in one ExecuteCommandLists.
+  CommandAllocator& command_allocator = *command_allocator_writable_first_;
+  command_allocator.command_allocator->Reset();
+  command_list_->Reset(command_allocator.command_allocator, nullptr);
+  WriteSubmissionTimestamp(command_list_, false);
+
+  if (command_list_threads_.empty()) {
+    deferred_command_list_.Execute(command_list_, command_list_1_);
+    WriteSubmissionTimestamp(command_list_, true);
+    command_list_->Close();
+    ID3D12CommandList* execute_command_lists[] = {command_list_};
+    direct_queue->ExecuteCommandLists(1, execute_command_lists);
+    return;
+  }
+
+  // Splitting small submissions is not worth the overhead of the additional
+  // command lists and the state setup in each of them.
+  static constexpr uint32_t kMinParallelCommandListDraws = 512;
+  deferred_command_list_.Split(uint32_t(command_list_threads_.size() + 1),
+                               kMinParallelCommandListDraws,
+                               command_list_segments_);
+  // Prepare the allocators and the command lists for the segments recorded on
+  // other threads, merging the segments into the last one that could be
+  // prepared in case of a failure.
+  ID3D12Device* device = GetD3D12Provider().GetDevice();
+  size_t segment_count = command_list_segments_.size();
+  for (size_t i = 1; i < segment_count; ++i) {
+    size_t parallel_index = i - 1;
+    if (command_allocator.parallel_command_allocators.size() <=
+        parallel_index) {
+      ID3D12CommandAllocator* parallel_command_allocator;
+      if (FAILED(device->CreateCommandAllocator(
+              D3D12_COMMAND_LIST_TYPE_DIRECT,
+              IID_PPV_ARGS(&parallel_command_allocator)))) {
+        XELOGE("Failed to create a command allocator for parallel recording");
+        segment_count = i;
+        break;
+      }
+      command_allocator.parallel_command_allocators.push_back(
+          parallel_command_allocator);
+    }
+    ID3D12CommandAllocator* parallel_command_allocator =
+        command_allocator.parallel_command_allocators[parallel_index];
+    parallel_command_allocator->Reset();
+    if (parallel_command_lists_.size() <= parallel_index) {
+      // Created in the open state.
+      ID3D12GraphicsCommandList* parallel_command_list;
+      if (FAILED(device->CreateCommandList(
+              0, D3D12_COMMAND_LIST_TYPE_DIRECT, parallel_command_allocator,
+              nullptr, IID_PPV_ARGS(&parallel_command_list)))) {
+        XELOGE("Failed to create a graphics command list for parallel "
+               "recording");
+        segment_count = i;
+        break;
+      }
+      parallel_command_lists_.push_back(parallel_command_list);
+      ID3D12GraphicsCommandList1* parallel_command_list_1 = nullptr;
+      parallel_command_list->QueryInterface(
+          IID_PPV_ARGS(&parallel_command_list_1));
+      parallel_command_lists_1_.push_back(parallel_command_list_1);
+    } else {
+      parallel_command_lists_[parallel_index]->Reset(
+          parallel_command_allocator, nullptr);
+    }
+  }
+  if (segment_count < command_list_segments_.size()) {
+    command_list_segments_[segment_count - 1].end =
+        command_list_segments_.back().end;
+    command_list_segments_.resize(segment_count);
+  }
+
+  if (segment_count > 1) {
+    {
+      std::lock_guard<std::mutex> lock(command_list_thread_mutex_);
+      command_list_segment_next_ = 1;
+      command_list_segment_end_ = segment_count;
+      command_list_segments_remaining_ = segment_count - 1;
+    }
+    command_list_thread_cond_.notify_all();
+  }
+  deferred_command_list_.ExecuteSegment(command_list_, command_list_1_,
+                                        command_list_segments_[0]);
+  if (segment_count <= 1) {
+    WriteSubmissionTimestamp(command_list_, true);
+  }
+  command_list_->Close();
+  if (segment_count <= 1) {
+    ID3D12CommandList* execute_command_lists[] = {command_list_};
+    direct_queue->ExecuteCommandLists(1, execute_command_lists);
+    return;
+  }
+  // Help the threads with the segments not taken yet.
+  RecordQueuedCommandListSegments();
+  {
+    std::unique_lock<std::mutex> lock(command_list_thread_mutex_);
+    while (command_list_segments_remaining_) {
+      command_list_done_cond_.wait(lock);
+    }
+  }
+  ID3D12CommandList* execute_command_lists[kMaxParallelCommandLists];
+  execute_command_lists[0] = command_list_;
+  for (size_t i = 1; i < segment_count; ++i) {
+    execute_command_lists[i] = parallel_command_lists_[i - 1];
+  }
+  direct_queue->ExecuteCommandLists(UINT(segment_count), execute_command_lists);
+}
+
+bool D3D12CommandProcessor::ExecuteAsyncComputeCommandList(
+    ID3D12CommandQueue* direct_queue) {
+  if (!async_compute_deferred_command_list_.GetStreamPosition()) {
+    return false;
+  }
+  CommandAllocator& command_allocator = *command_allocator_writable_first_;
+  bool async = false;
+  if (async_compute_queue_) {
+    ID3D12Device* device = GetD3D12Provider().GetDevice();
+    ID3D12CommandAllocator*& async_compute_command_allocator =
+        command_allocator.async_compute_command_allocator;
+    if (!async_compute_command_allocator &&
+        FAILED(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_COMPUTE,
+            IID_PPV_ARGS(&async_compute_command_allocator)))) {
+      XELOGE("Failed to create an asynchronous compute command allocator");
+      async_compute_command_allocator = nullptr;
+    }
+    if (async_compute_command_allocator) {
+      async_compute_command_allocator->Reset();
+      if (async_compute_command_list_) {
+        async_compute_command_list_->Reset(async_compute_command_allocator,
+                                           nullptr);
+        async = true;
+      } else if (SUCCEEDED(device->CreateCommandList(
+                     0, D3D12_COMMAND_LIST_TYPE_COMPUTE,
+                     async_compute_command_allocator, nullptr,
+                     IID_PPV_ARGS(&async_compute_command_list_)))) {
+        // Created in the open state.
+        async = true;
+      } else {
+        XELOGE("Failed to create the asynchronous compute command list");
+        async_compute_command_list_ = nullptr;
+      }
+    }
+  }
+  // If failed, execute the commands on the direct queue, the command list may
+  // be reused right after being submitted.
+  ID3D12GraphicsCommandList* command_list;
+  if (async) {
+    command_list = async_compute_command_list_;
+  } else {
+    command_list = command_list_;
+    command_list->Reset(command_allocator.command_allocator, nullptr);
+  }
+  async_compute_deferred_command_list_.Execute(command_list, nullptr);
+  async_compute_deferred_command_list_.Reset();
+  command_list->Close();
+  ID3D12CommandList* execute_command_lists[] = {command_list};
+  if (!async) {
+    direct_queue->ExecuteCommandLists(1, execute_command_lists);
+    return false;
+  }
+  direct_queue->Signal(async_compute_wait_fence_, submission_current_);
+  async_compute_queue_->Wait(async_compute_wait_fence_, submission_current_);
+  async_compute_queue_->ExecuteCommandLists(1, execute_command_lists);
+  return true;
+}
+
+size_t D3D12CommandProcessor::BeginAsyncComputeCommands() {
+  assert_not_null(async_compute_queue_);
+  SubmitBarriers();
+  size_t begin = deferred_command_list_.GetStreamPosition();
+  // The compute command list is executed with no state set.
+  InvalidateCommandListBindings();
+  return begin;
+}
+
+void D3D12CommandProcessor::EndAsyncComputeCommands(size_t begin) {
+  SubmitBarriers();
+  deferred_command_list_.MoveCommands(begin,
+                                      async_compute_deferred_command_list_);
+  // The remaining commands of the direct command list may have different
+  // bindings than the ones set on the compute command list.
+  InvalidateCommandListBindings();
+}
+
+void D3D12CommandProcessor::InvalidateCommandListBindings() {
+  current_guest_pipeline_ = nullptr;
+  current_external_pipeline_ = nullptr;
+  current_graphics_root_signature_ = nullptr;
+  current_graphics_root_up_to_date_ = 0;
+  if (bindless_resources_used_) {
+    deferred_command_list_.SetDescriptorHeaps(view_bindless_heap_,
+                                              sampler_bindless_heap_current_);
+  } else if (view_bindful_heap_current_ || sampler_bindful_heap_current_) {
+    deferred_command_list_.SetDescriptorHeaps(view_bindful_heap_current_,
+                                              sampler_bindful_heap_current_);
+  }
+}
+
+void D3D12CommandProcessor::WriteSubmissionTimestamp(
+    ID3D12GraphicsCommandList* command_list, bool end) {
+  if (timestamp_query_begin_ == UINT32_MAX) {
+    return;
+  }
+  if (!end) {
+    command_list->EndQuery(timestamp_query_heap_, D3D12_QUERY_TYPE_TIMESTAMP,
+                           timestamp_query_begin_);
+    return;
+  }
+  command_list->EndQuery(timestamp_query_heap_, D3D12_QUERY_TYPE_TIMESTAMP,
+                         timestamp_query_end_);
+  command_list->ResolveQueryData(
+      timestamp_query_heap_, D3D12_QUERY_TYPE_TIMESTAMP, timestamp_query_begin_,
+      timestamp_query_count_, timestamp_readback_buffer_,
+      sizeof(uint64_t) * timestamp_query_begin_);
+}
+
+void D3D12CommandProcessor::CommandListThread() {
+  while (true) {
+    size_t segment_index;
+    {
+      std::unique_lock<std::mutex> lock(command_list_thread_mutex_);
+      while (!command_list_threads_shutdown_ &&
+             command_list_segment_next_ >= command_list_segment_end_) {
+        command_list_thread_cond_.wait(lock);
+      }
+      if (command_list_threads_shutdown_) {
+        return;
+      }
+      segment_index = command_list_segment_next_++;
+    }
+    RecordCommandListSegment(segment_index);
+  }
+}
+
+void D3D12CommandProcessor::RecordCommandListSegment(size_t segment_index) {
+  assert_not_zero(segment_index);
+  size_t parallel_index = segment_index - 1;
+  ID3D12GraphicsCommandList* parallel_command_list =
+      parallel_command_lists_[parallel_index];
+  deferred_command_list_.ExecuteSegment(
+      parallel_command_list, parallel_command_lists_1_[parallel_index],
+      command_list_segments_[segment_index]);
+  if (segment_index + 1 >= command_list_segments_.size()) {
+    WriteSubmissionTimestamp(parallel_command_list, true);
+  }
+  parallel_command_list->Close();
+  bool all_segments_recorded;
+  {
+    std::lock_guard<std::mutex> lock(command_list_thread_mutex_);
+    all_segments_recorded = !--command_list_segments_remaining_;
+  }
+  if (all_segments_recorded) {
+    command_list_done_cond_.notify_all();
+  }
+}
+
+void D3D12CommandProcessor::RecordQueuedCommandListSegments() {
+  while (true) {
+    size_t segment_index;
+    {
+      std::lock_guard<std::mutex> lock(command_list_thread_mutex_);
+      if (command_list_segment_next_ >= command_list_segment_end_) {
+        return;
+      }
+      segment_index = command_list_segment_next_++;
+    }
+    RecordCommandListSegment(segment_index);
+  }
+}
+
 void D3D12CommandProcessor::UpdateFixedFunctionState(
     const draw_util::ViewportInfo& viewport_info,
     const draw_util::Scissor& scissor, bool primitive_polygonal,
@@ -5271,6 +6044,116 @@ ID3D12Resource* D3D12CommandProcessor::RequestReadbackBuffer(uint32_t size) {
   return readback_buffer_;
 }
 
+void D3D12CommandProcessor::ReadbackSharedMemoryAsync(
+    const std::pair<uint32_t, uint32_t>* ranges, size_t range_count) {
+  uint32_t total_size = 0;
+  for (size_t i = 0; i < range_count; ++i) {
+    total_size += ranges[i].second;
+  }
+  if (!total_size) {
+    return;
+  }
+  PendingReadback pending_readback;
+  pending_readback.buffer_size =
+      xe::align(total_size, kAsyncReadbackBufferSizeIncrement);
+  // Take the smallest free buffer that's large enough.
+  size_t free_buffer_index = SIZE_MAX;
+  for (size_t i = 0; i < async_readback_buffers_free_.size(); ++i) {
+    uint32_t free_buffer_size = async_readback_buffers_free_[i].first;
+    if (free_buffer_size >= pending_readback.buffer_size &&
+        (free_buffer_index == SIZE_MAX ||
+         free_buffer_size <
+             async_readback_buffers_free_[free_buffer_index].first)) {
+      free_buffer_index = i;
+    }
+  }
+  if (free_buffer_index != SIZE_MAX) {
+    pending_readback.buffer_size =
+        async_readback_buffers_free_[free_buffer_index].first;
+    pending_readback.buffer =
+        async_readback_buffers_free_[free_buffer_index].second;
+    async_readback_buffers_free_[free_buffer_index] =
+        async_readback_buffers_free_.back();
+    async_readback_buffers_free_.pop_back();
+  } else {
+    const ui::d3d12::D3D12Provider& provider = GetD3D12Provider();
+    D3D12_RESOURCE_DESC buffer_desc;
+    ui::d3d12::util::FillBufferResourceDesc(
+        buffer_desc, pending_readback.buffer_size, D3D12_RESOURCE_FLAG_NONE);
+    if (FAILED(provider.GetDevice()->CreateCommittedResource(
+            &ui::d3d12::util::kHeapPropertiesReadback,
+            provider.GetHeapFlagCreateNotZeroed(), &buffer_desc,
+            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+            IID_PPV_ARGS(&pending_readback.buffer)))) {
+      XELOGE("Failed to create a {} MB asynchronous readback buffer",
+             pending_readback.buffer_size >> 20);
+      return;
+    }
+  }
+  shared_memory_->UseAsCopySource();
+  SubmitBarriers();
+  ID3D12Resource* shared_memory_buffer = shared_memory_->GetBuffer();
+  uint32_t readback_buffer_offset = 0;
+  for (size_t i = 0; i < range_count; ++i) {
+    const std::pair<uint32_t, uint32_t>& range = ranges[i];
+    deferred_command_list_.D3DCopyBufferRegion(
+        pending_readback.buffer, readback_buffer_offset, shared_memory_buffer,
+        range.first, range.second);
+    readback_buffer_offset += range.second;
+  }
+  pending_readback.submission = submission_current_;
+  // Reusing the range lists of the completed readbacks.
+  if (!async_readback_ranges_free_.empty()) {
+    pending_readback.ranges = std::move(async_readback_ranges_free_.back());
+    async_readback_ranges_free_.pop_back();
+  }
+  pending_readback.ranges.assign(ranges, ranges + range_count);
+  pending_readbacks_.push_back(std::move(pending_readback));
+}
+
+void D3D12CommandProcessor::CompletePendingReadbacks() {
+  while (!pending_readbacks_.empty()) {
+    PendingReadback& pending_readback = pending_readbacks_.front();
+    if (pending_readback.submission > submission_completed_) {
+      break;
+    }
+    D3D12_RANGE readback_range;
+    readback_range.Begin = 0;
+    readback_range.End = 0;
+    for (const std::pair<uint32_t, uint32_t>& range :
+         pending_readback.ranges) {
+      readback_range.End += range.second;
+    }
+    void* readback_mapping;
+    if (SUCCEEDED(pending_readback.buffer->Map(0, &readback_range,
+                                               &readback_mapping))) {
+      const uint8_t* readback_bytes =
+          reinterpret_cast<const uint8_t*>(readback_mapping);
+      for (const std::pair<uint32_t, uint32_t>& range :
+           pending_readback.ranges) {
+        // If the CPU has written to a page since, the GPU data there is stale
+        // - and it's already invalidated in shared memory, so the CPU data is
+        // what the GPU sees too.
+        shared_memory_->GetRangesWrittenByGpu(
+            range.first, range.second, async_readback_gpu_written_ranges_);
+        for (const std::pair<uint32_t, uint32_t>& written_range :
+             async_readback_gpu_written_ranges_) {
+          std::memcpy(memory_->TranslatePhysical(written_range.first),
+                      readback_bytes + (written_range.first - range.first),
+                      written_range.second);
+        }
+        readback_bytes += range.second;
+      }
+      D3D12_RANGE readback_write_range = {};
+      pending_readback.buffer->Unmap(0, &readback_write_range);
+    }
+    async_readback_buffers_free_.emplace_back(pending_readback.buffer_size,
+                                              pending_readback.buffer);
+    async_readback_ranges_free_.push_back(std::move(pending_readback.ranges));
+    pending_readbacks_.pop_front();
+  }
+}
+
 void D3D12CommandProcessor::WriteGammaRampSRV(
     bool is_pwl, D3D12_CPU_DESCRIPTOR_HANDLE handle) const {
   ID3D12Device* device = GetD3D12Provider().GetDevice();
@@ -12,14 +12,18 @@
 
 #include <algorithm>
 #include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/d3d12/d3d12_graphics_system.h"
 #include "xenia/gpu/d3d12/d3d12_primitive_processor.h"
@@ -31,6 +35,8 @@
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/dxbc_shader.h"
 #include "xenia/gpu/dxbc_shader_translator.h"
+#include "xenia/gpu/gpu_pass_timestamps.h"
+#include "xenia/gpu/occlusion_query_tracker.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/kernel/kernel_state.h"
@@ -67,6 +73,9 @@ class D3D12CommandProcessor final : public CommandProcessor {
 
   void ClearCaches() override;
 
+  void BeginBenchmarkStatistics() override;
+  BenchmarkStatistics EndBenchmarkStatistics() override;
+
   void InitializeShaderStorage(const std::filesystem::path& cache_root,
                                uint32_t title_id, bool blocking) override;
 
@@ -111,6 +120,10 @@ class D3D12CommandProcessor final : public CommandProcessor {
   void PushUAVBarrier(ID3D12Resource* resource);
   void SubmitBarriers();
 
+  // Changes the category the GPU time of the following commands is attributed
+  // to if timing the passes, returning the previous one. Use GpuPassScope.
+  GpuPass SwitchGpuPass(GpuPass pass);
+
   // Finds or creates root signature for a pipeline.
   ID3D12RootSignature* GetRootSignature(const DxbcShader* vertex_shader,
                                         const DxbcShader* pixel_shader,
@@ -335,9 +348,14 @@ class D3D12CommandProcessor final : public CommandProcessor {
   bool IssueCopy() override;
   XE_NOINLINE
   bool IssueCopy_ReadbackResolvePath();
+  void BeginOcclusionQuery() override;
+  uint32_t EndOcclusionQuery(uint32_t sample_counts_address,
+                             uint32_t fallback_sample_count) override;
   void InitializeTrace() override;
 
  private:
+  // The size of the per-frame resource rings, the maximum number of frames in
+  // flight.
   static constexpr uint32_t kQueueFrames = 3;
 
   enum RootParameter : UINT {
@@ -452,6 +470,46 @@ class D3D12CommandProcessor final : public CommandProcessor {
   // Need to await submission completion before calling.
   void ClearCommandAllocatorCache();
 
+  // Replays and submits the deferred command list using the first writable
+  // command allocator, on multiple command lists recorded in parallel if it's
+  // large enough.
+  void ExecuteDeferredCommandList(ID3D12CommandQueue* direct_queue);
+  // Submits the commands moved to async_compute_deferred_command_list_, if
+  // any, to the asynchronous compute queue after the direct queue part of the
+  // submission using the first writable command allocator. Returns whether
+  // they have been submitted to the asynchronous compute queue rather than to
+  // the direct queue as a fallback.
+  bool ExecuteAsyncComputeCommandList(ID3D12CommandQueue* direct_queue);
+  // The commands recorded between these (only using the states valid on
+  // compute queues, and not depending on the state set before) are executed on
+  // the asynchronous compute queue in the end of the submission.
+  size_t BeginAsyncComputeCommands();
+  void EndAsyncComputeCommands(size_t begin);
+  // Drops the cached pipeline and root signature bindings and sets the current
+  // descriptor heaps again on the command list.
+  void InvalidateCommandListBindings();
+  void CommandListThread();
+  void RecordCommandListSegment(size_t segment_index);
+  // Creates the timestamp query heap and the readback buffer if needed,
+  // returning whether they are available.
+  bool InitializeTimestampQueries();
+  // Writes the timestamp of the beginning or the end of the commands of the
+  // submission, and resolves its queries at the end, if it's being timed.
+  void WriteSubmissionTimestamp(ID3D12GraphicsCommandList* command_list,
+                                bool end);
+  // Records the remaining queued segments on the calling thread.
+  void RecordQueuedCommandListSegments();
+
+  // Creates the occlusion query heap and the readback buffer, returning whether
+  // they are available.
+  bool InitializeOcclusionQueries();
+  // Begins a host occlusion query before a guest draw if a guest occlusion
+  // query is active and the host query hasn't been begun yet.
+  void BeginOcclusionHostQuery();
+  // Ends the host occlusion query, if active, before commands that must not be
+  // counted in the guest occlusion query.
+  void EndOcclusionHostQuery();
+
   // Request descriptors and automatically rebind the descriptor heap on the
   // draw command list. Refer to D3D12DescriptorHeapPool::Request for partial /
   // full update explanation. Doesn't work when bindless descriptors are used.
@@ -513,6 +571,16 @@ class D3D12CommandProcessor final : public CommandProcessor {
   // Returns a buffer for reading GPU data back to the CPU. Assuming
   // synchronizing immediately after use. Always in COPY_DEST state.
   ID3D12Resource* RequestReadbackBuffer(uint32_t size);
+  // Copies the <physical address, length> ranges of shared memory to a
+  // readback buffer in the current submission without awaiting it - the data
+  // is written to guest memory by CompletePendingReadbacks when the submission
+  // is completed.
+  void ReadbackSharedMemoryAsync(const std::pair<uint32_t, uint32_t>* ranges,
+                                 size_t range_count);
+  // Writes the data of the readbacks from completed submissions to guest
+  // memory, in the pages not modified by the CPU since they were resolved or
+  // memexported to, and recycles their buffers.
+  void CompletePendingReadbacks();
 
   void WriteGammaRampSRV(bool is_pwl, D3D12_CPU_DESCRIPTOR_HANDLE handle) const;
 
@@ -543,11 +611,18 @@ class D3D12CommandProcessor final : public CommandProcessor {
   uint64_t frame_completed_ = 0;
   // Submission indices of frames that have already been submitted.
   uint64_t closed_frame_submissions_[kQueueFrames] = {};
+  // Guest frames that may be not completed on the GPU when opening a new one,
+  // up to kQueueFrames.
+  uint32_t frames_in_flight_ = kQueueFrames;
 
   struct CommandAllocator {
     ID3D12CommandAllocator* command_allocator;
     uint64_t last_usage_submission;
     CommandAllocator* next;
+    // For the command lists recorded on other threads, created on demand.
+    std::vector<ID3D12CommandAllocator*> parallel_command_allocators;
+    // For the asynchronous compute command list, created on demand.
+    ID3D12CommandAllocator* async_compute_command_allocator = nullptr;
   };
   CommandAllocator* command_allocator_writable_first_ = nullptr;
   CommandAllocator* command_allocator_writable_last_ = nullptr;
@@ -557,6 +632,62 @@ class D3D12CommandProcessor final : public CommandProcessor {
   ID3D12GraphicsCommandList1* command_list_1_ = nullptr;
   DeferredCommandList deferred_command_list_;
 
+  // For overlapping the swap post-processing with the next frame
+  // (--d3d12_async_swap_post_processing), null if not used. The submission
+  // fence value of a submission with asynchronous compute work is signaled on
+  // the compute queue, and if the next submission doesn't have any, it's
+  // signaled on the direct queue after awaiting the previous value to keep
+  // them in order.
+  ID3D12CommandQueue* async_compute_queue_ = nullptr;
+  // Signaled on the direct queue with the index of the submission before
+  // starting its asynchronous compute work.
+  ID3D12Fence* async_compute_wait_fence_ = nullptr;
+  ID3D12GraphicsCommandList* async_compute_command_list_ = nullptr;
+  DeferredCommandList async_compute_deferred_command_list_;
+  // The latest submission whose fence value was signaled on the asynchronous
+  // compute queue.
+  uint64_t async_compute_submission_last_ = 0;
+
+  static constexpr uint32_t kMaxParallelCommandLists = 16;
+  // Additional command lists for recording the parts of the deferred command
+  // list after the first one on other threads, created on demand.
+  std::vector<ID3D12GraphicsCommandList*> parallel_command_lists_;
+  std::vector<ID3D12GraphicsCommandList1*> parallel_command_lists_1_;
+  std::vector<DeferredCommandList::Segment> command_list_segments_;
+  std::vector<std::unique_ptr<xe::threading::Thread>> command_list_threads_;
+  std::mutex command_list_thread_mutex_;
+  // Notified when segments are queued or the threads need to exit.
+  std::condition_variable command_list_thread_cond_;
+  // Notified when all the queued segments have been recorded.
+  std::condition_variable command_list_done_cond_;
+  // Protected by command_list_thread_mutex_.
+  size_t command_list_segment_next_ = 0;
+  size_t command_list_segment_end_ = 0;
+  size_t command_list_segments_remaining_ = 0;
+  bool command_list_threads_shutdown_ = false;
+
+  // Timestamps for measuring the GPU time of the submissions for benchmarking
+  // and of the passes in them, created on demand.
+  GpuPassTimestamps gpu_pass_timestamps_;
+  ID3D12QueryHeap* timestamp_query_heap_ = nullptr;
+  ID3D12Resource* timestamp_readback_buffer_ = nullptr;
+  // Persistently mapped.
+  const uint64_t* timestamp_readback_mapping_ = nullptr;
+  uint64_t timestamp_frequency_ = 0;
+  // Queries of the submission being executed, timestamp_query_begin_ is
+  // UINT32_MAX if it's not timed.
+  uint32_t timestamp_query_begin_ = UINT32_MAX;
+  uint32_t timestamp_query_end_ = UINT32_MAX;
+  uint32_t timestamp_query_count_ = 0;
+
+  // Host occlusion queries for the guest ones, the heap is null if they're not
+  // used.
+  OcclusionQueryTracker occlusion_query_tracker_;
+  ID3D12QueryHeap* occlusion_query_heap_ = nullptr;
+  ID3D12Resource* occlusion_query_readback_buffer_ = nullptr;
+  // Persistently mapped.
+  const uint64_t* occlusion_query_readback_mapping_ = nullptr;
+
   // Should bindless textures and samplers be used - many times faster
   // UpdateBindings than bindful (that becomes a significant bottleneck with
   // bindful - mainly because of CopyDescriptorsSimple, which takes the majority
@@ -714,6 +845,25 @@ class D3D12CommandProcessor final : public CommandProcessor {
   ID3D12Resource* readback_buffer_ = nullptr;
   uint32_t readback_buffer_size_ = 0;
 
+  // Readbacks with d3d12_readback_async.
+  struct PendingReadback {
+    uint64_t submission;
+    ID3D12Resource* buffer;
+    uint32_t buffer_size;
+    // <Physical address, length>, tightly packed in the buffer in this order.
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  };
+  static constexpr uint32_t kAsyncReadbackBufferSizeIncrement = 1024 * 1024;
+  // Sorted by the submission number.
+  std::deque<PendingReadback> pending_readbacks_;
+  // <Size, buffer> of completed readbacks, in COPY_DEST state.
+  std::vector<std::pair<uint32_t, ID3D12Resource*>>
+      async_readback_buffers_free_;
+  // Range lists of completed readbacks, for reuse.
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>>
+      async_readback_ranges_free_;
+  std::vector<std::pair<uint32_t, uint32_t>> async_readback_gpu_written_ranges_;
+
   // The current fixed-function drawing state.
   D3D12_VIEWPORT ff_viewport_;
   D3D12_RECT ff_scissor_;
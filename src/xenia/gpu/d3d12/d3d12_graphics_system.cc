@@ -39,11 +39,18 @@ std::string D3D12GraphicsSystem::name() const {
   return "Direct3D 12";
 }
 
+void D3D12GraphicsSystem::CreateProvider(
+    [[maybe_unused]] bool is_surface_required) {
+  provider_ = xe::ui::d3d12::D3D12Provider::Create();
+}
+
 X_STATUS D3D12GraphicsSystem::Setup(cpu::Processor* processor,
                                     kernel::KernelState* kernel_state,
                                     ui::WindowedAppContext* app_context,
                                     bool is_surface_required) {
-  provider_ = xe::ui::d3d12::D3D12Provider::Create();
+  if (!provider_) {
+    CreateProvider(is_surface_required);
+  }
   return GraphicsSystem::Setup(processor, kernel_state, app_context,
                                is_surface_required);
 }
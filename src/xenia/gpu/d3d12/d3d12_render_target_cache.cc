@@ -30,6 +30,7 @@
 #include "xenia/gpu/d3d12/d3d12_texture_cache.h"
 #include "xenia/gpu/d3d12/deferred_command_list.h"
 #include "xenia/gpu/draw_util.h"
+#include "xenia/gpu/gpu_pass_timestamps.h"
 #include "xenia/gpu/dxbc.h"
 #include "xenia/gpu/dxbc_shader_translator.h"
 #include "xenia/gpu/gpu_flags.h"
@@ -461,6 +462,14 @@ bool D3D12RenderTargetCache::Initialize() {
     depth_float24_round_ = cvars::depth_float24_round;
     depth_float24_convert_in_pixel_shader_ =
         cvars::depth_float24_convert_in_pixel_shader;
+    if (depth_float24_convert_in_pixel_shader_ && depth_float24_round_) {
+      // Truncation is done with SV_DepthLessEqual, but the rounded depth may
+      // be bigger than the interpolated one, so SV_Depth is needed.
+      XELOGW(
+          "D3D12: Rounding the float24 depth in pixel shaders - early depth "
+          "rejection of pixels is not possible in draws with float24 depth "
+          "buffers");
+    }
 
     // Check if 2x MSAA is supported or needs to be emulated with 4x MSAA
     // instead.
@@ -1353,6 +1362,11 @@ bool D3D12RenderTargetCache::Resolve(const Memory& memory,
   // Copying.
   bool copied = false;
   if (resolve_info.copy_dest_extent_length) {
+    // Dumping the render targets is timed as a part of the copy.
+    GpuPassScope<D3D12CommandProcessor> copy_gpu_pass_scope(
+        command_processor_, resolve_info.IsCopyBitwise()
+                                ? GpuPass::kResolveCopiesBitwise
+                                : GpuPass::kResolveCopiesConverting);
     if (GetPath() == Path::kHostRenderTargets) {
       // Dump the current contents of the render targets owning the affected
       // range to edram_buffer_.
@@ -1501,6 +1515,8 @@ bool D3D12RenderTargetCache::Resolve(const Memory& memory,
   bool clear_depth = resolve_info.IsClearingDepth();
   bool clear_color = resolve_info.IsClearingColor();
   if (clear_depth || clear_color) {
+    GpuPassScope<D3D12CommandProcessor> clear_gpu_pass_scope(
+        command_processor_, GpuPass::kResolveClears);
     switch (GetPath()) {
       case Path::kHostRenderTargets: {
         Transfer::Rectangle clear_rectangle;
@@ -4462,6 +4478,18 @@ void D3D12RenderTargetCache::PerformTransfersAndResolveClears(
   DeferredCommandList& command_list =
       command_processor_.GetDeferredCommandList();
 
+  // Called for every draw, only switching the pass if there's anything to
+  // transfer.
+  bool transfers_needed = false;
+  for (uint32_t i = 0; i < render_target_count; ++i) {
+    if (render_targets[i] && !render_target_transfers[i].empty()) {
+      transfers_needed = true;
+      break;
+    }
+  }
+  GpuPassScope<D3D12CommandProcessor> gpu_pass_scope(
+      command_processor_, GpuPass::kEdramTransfers, transfers_needed);
+
   bool resolve_clear_needed =
       render_target_resolve_clear_values && resolve_clear_rectangle;
   D3D12_RECT clear_rect;
@@ -4509,6 +4537,7 @@ void D3D12RenderTargetCache::PerformTransfersAndResolveClears(
                 host_depth_store_descriptors)) {
           continue;
         }
+        command_processor_.SwitchGpuPass(GpuPass::kHostDepthStores);
         command_list.D3DSetComputeRootSignature(
             host_depth_store_root_signature_);
         // Destination (EDRAM uint4 buffer).
@@ -4590,6 +4619,9 @@ void D3D12RenderTargetCache::PerformTransfersAndResolveClears(
     }
     break;
   }
+  if (host_depth_store_set_up) {
+    command_processor_.SwitchGpuPass(GpuPass::kEdramTransfers);
+  }
 
   // Try to insert as many barriers as possible in one place, hoping that in the
   // best case (no cross-copying between current render targets), barriers will
@@ -171,9 +171,16 @@ void D3D12SharedMemory::Shutdown(bool from_destructor) {
   ui::d3d12::util::ReleaseAndNull(buffer_);
 
   for (ID3D12Heap* heap : buffer_tiled_heaps_) {
-    heap->Release();
+    if (heap) {
+      heap->Release();
+    }
   }
   buffer_tiled_heaps_.clear();
+  for (const std::pair<uint64_t, ID3D12Heap*>& released_heap :
+       buffer_tiled_heaps_released_) {
+    released_heap.second->Release();
+  }
+  buffer_tiled_heaps_released_.clear();
 
   // If calling from the destructor, the SharedMemory destructor will call
   // ShutdownCommon.
@@ -189,7 +196,13 @@ void D3D12SharedMemory::ClearCache() {
 }
 
 void D3D12SharedMemory::CompletedSubmissionUpdated() {
-  upload_buffer_pool_->Reclaim(command_processor_.GetCompletedSubmission());
+  uint64_t completed_submission = command_processor_.GetCompletedSubmission();
+  upload_buffer_pool_->Reclaim(completed_submission);
+  while (!buffer_tiled_heaps_released_.empty() &&
+         buffer_tiled_heaps_released_.front().first <= completed_submission) {
+    buffer_tiled_heaps_released_.front().second->Release();
+    buffer_tiled_heaps_released_.pop_front();
+  }
 }
 
 void D3D12SharedMemory::BeginSubmission() {
@@ -197,8 +210,14 @@ void D3D12SharedMemory::BeginSubmission() {
   buffer_uav_writes_commit_needed_ = false;
 }
 
+void D3D12SharedMemory::EndSubmission() { FlushUploadCopy(); }
+
 void D3D12SharedMemory::CommitUAVWritesAndTransitionBuffer(
     D3D12_RESOURCE_STATES new_state) {
+  if (buffer_state_ == D3D12_RESOURCE_STATE_COPY_DEST &&
+      new_state != D3D12_RESOURCE_STATE_COPY_DEST) {
+    FlushUploadCopy();
+  }
   if (buffer_state_ == new_state) {
     if (new_state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS &&
         buffer_uav_writes_commit_needed_) {
@@ -364,44 +383,101 @@ bool D3D12SharedMemory::AllocateSparseHostGpuMemoryRange(
     return true;
   }
 
-  uint32_t offset_bytes = offset_allocations
-                          << host_gpu_memory_sparse_granularity_log2();
-  uint32_t length_bytes = length_allocations
-                          << host_gpu_memory_sparse_granularity_log2();
+  uint32_t allocation_size_bytes = uint32_t(1)
+                                   << host_gpu_memory_sparse_granularity_log2();
+  if (buffer_tiled_heaps_.empty()) {
+    buffer_tiled_heaps_.resize(kBufferSize / allocation_size_bytes);
+  }
 
   const ui::d3d12::D3D12Provider& provider =
       command_processor_.GetD3D12Provider();
   ID3D12Device* device = provider.GetDevice();
   ID3D12CommandQueue* direct_queue = provider.GetDirectQueue();
 
+  // A separate heap for every allocation so they can be freed individually.
   D3D12_HEAP_DESC heap_desc = {};
-  heap_desc.SizeInBytes = length_bytes;
+  heap_desc.SizeInBytes = allocation_size_bytes;
   heap_desc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
   heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS |
                     provider.GetHeapFlagCreateNotZeroed();
-  ID3D12Heap* heap;
-  if (FAILED(device->CreateHeap(&heap_desc, IID_PPV_ARGS(&heap)))) {
-    XELOGE("Shared memory: Failed to create a tile heap");
-    return false;
+  D3D12_TILED_RESOURCE_COORDINATE region_start_coordinates;
+  region_start_coordinates.Y = 0;
+  region_start_coordinates.Z = 0;
+  region_start_coordinates.Subresource = 0;
+  D3D12_TILE_REGION_SIZE region_size;
+  region_size.NumTiles =
+      allocation_size_bytes / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+  region_size.UseBox = FALSE;
+  D3D12_TILE_RANGE_FLAGS range_flags = D3D12_TILE_RANGE_FLAG_NONE;
+  UINT heap_range_start_offset = 0;
+  bool queue_operations_done = false;
+  bool successful = true;
+  for (uint32_t i = offset_allocations;
+       i < offset_allocations + length_allocations; ++i) {
+    if (buffer_tiled_heaps_[i]) {
+      // Allocated before a failure in an earlier call.
+      continue;
+    }
+    ID3D12Heap* heap;
+    if (FAILED(device->CreateHeap(&heap_desc, IID_PPV_ARGS(&heap)))) {
+      XELOGE("Shared memory: Failed to create a tile heap");
+      successful = false;
+      break;
+    }
+    buffer_tiled_heaps_[i] = heap;
+    region_start_coordinates.X =
+        i * (allocation_size_bytes / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
+    direct_queue->UpdateTileMappings(
+        buffer_, 1, &region_start_coordinates, &region_size, heap, 1,
+        &range_flags, &heap_range_start_offset, &region_size.NumTiles,
+        D3D12_TILE_MAPPING_FLAG_NONE);
+    queue_operations_done = true;
+  }
+  if (queue_operations_done) {
+    command_processor_.NotifyQueueOperationsDoneDirectly();
   }
-  buffer_tiled_heaps_.push_back(heap);
+  return successful;
+}
 
+bool D3D12SharedMemory::FreeSparseHostGpuMemoryRange(
+    uint32_t offset_allocations, uint32_t length_allocations) {
+  uint32_t allocation_size_bytes = uint32_t(1)
+                                   << host_gpu_memory_sparse_granularity_log2();
+  ID3D12CommandQueue* direct_queue =
+      command_processor_.GetD3D12Provider().GetDirectQueue();
   D3D12_TILED_RESOURCE_COORDINATE region_start_coordinates;
-  region_start_coordinates.X =
-      offset_bytes / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
   region_start_coordinates.Y = 0;
   region_start_coordinates.Z = 0;
   region_start_coordinates.Subresource = 0;
   D3D12_TILE_REGION_SIZE region_size;
-  region_size.NumTiles = length_bytes / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+  region_size.NumTiles =
+      allocation_size_bytes / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
   region_size.UseBox = FALSE;
-  D3D12_TILE_RANGE_FLAGS range_flags = D3D12_TILE_RANGE_FLAG_NONE;
+  D3D12_TILE_RANGE_FLAGS range_flags = D3D12_TILE_RANGE_FLAG_NULL;
   UINT heap_range_start_offset = 0;
-  direct_queue->UpdateTileMappings(
-      buffer_, 1, &region_start_coordinates, &region_size, heap, 1,
-      &range_flags, &heap_range_start_offset, &region_size.NumTiles,
-      D3D12_TILE_MAPPING_FLAG_NONE);
-  command_processor_.NotifyQueueOperationsDoneDirectly();
+  bool queue_operations_done = false;
+  for (uint32_t i = offset_allocations;
+       i < offset_allocations + length_allocations; ++i) {
+    ID3D12Heap* heap = buffer_tiled_heaps_[i];
+    if (!heap) {
+      continue;
+    }
+    region_start_coordinates.X =
+        i * (allocation_size_bytes / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
+    direct_queue->UpdateTileMappings(
+        buffer_, 1, &region_start_coordinates, &region_size, nullptr, 1,
+        &range_flags, &heap_range_start_offset, &region_size.NumTiles,
+        D3D12_TILE_MAPPING_FLAG_NONE);
+    queue_operations_done = true;
+    // The unmapping is done on the queue before the current submission, and
+    // the heap may still be accessed by the submissions before it.
+    buffer_tiled_heaps_released_.emplace_back(
+        command_processor_.GetCurrentSubmission(), heap);
+    buffer_tiled_heaps_[i] = nullptr;
+  }
+  if (queue_operations_done) {
+    command_processor_.NotifyQueueOperationsDoneDirectly();
+  }
   return true;
 }
 
@@ -413,7 +489,6 @@ bool D3D12SharedMemory::UploadRanges(
   }
   CommitUAVWritesAndTransitionBuffer(D3D12_RESOURCE_STATE_COPY_DEST);
   command_processor_.SubmitBarriers();
-  auto& command_list = command_processor_.GetDeferredCommandList();
   for (uint32_t i = 0; i < num_upload_page_ranges; ++i) {
     auto& upload_range = upload_page_ranges[i];
     uint32_t upload_range_start = upload_range.first;
@@ -463,9 +538,9 @@ bool D3D12SharedMemory::UploadRanges(
             memory().TranslatePhysical(upload_range_start << page_size_log2()),
             upload_buffer_size);
       }
-      command_list.D3DCopyBufferRegion(
-          buffer_, upload_range_start << page_size_log2(), upload_buffer,
-          UINT64(upload_buffer_offset), UINT64(upload_buffer_size));
+      QueueUploadCopy(upload_buffer, UINT64(upload_buffer_offset),
+                      UINT64(upload_range_start) << page_size_log2(),
+                      UINT64(upload_buffer_size));
       uint32_t upload_buffer_pages =
           uint32_t(upload_buffer_size >> page_size_log2());
       upload_range_start += upload_buffer_pages;
@@ -475,6 +550,34 @@ bool D3D12SharedMemory::UploadRanges(
   return true;
 }
 
+void D3D12SharedMemory::QueueUploadCopy(ID3D12Resource* source,
+                                        UINT64 source_offset,
+                                        UINT64 dest_offset, UINT64 size) {
+  if (upload_copy_pending_source_ == source &&
+      upload_copy_pending_source_offset_ + upload_copy_pending_size_ ==
+          source_offset &&
+      upload_copy_pending_dest_offset_ + upload_copy_pending_size_ ==
+          dest_offset) {
+    upload_copy_pending_size_ += size;
+    return;
+  }
+  FlushUploadCopy();
+  upload_copy_pending_source_ = source;
+  upload_copy_pending_source_offset_ = source_offset;
+  upload_copy_pending_dest_offset_ = dest_offset;
+  upload_copy_pending_size_ = size;
+}
+
+void D3D12SharedMemory::FlushUploadCopy() {
+  if (!upload_copy_pending_source_) {
+    return;
+  }
+  command_processor_.GetDeferredCommandList().D3DCopyBufferRegion(
+      buffer_, upload_copy_pending_dest_offset_, upload_copy_pending_source_,
+      upload_copy_pending_source_offset_, upload_copy_pending_size_);
+  upload_copy_pending_source_ = nullptr;
+}
+
 }  // namespace d3d12
 }  // namespace gpu
 }  // namespace xe
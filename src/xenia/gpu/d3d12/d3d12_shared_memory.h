@@ -11,6 +11,7 @@
 #define XENIA_GPU_D3D12_D3D12_SHARED_MEMORY_H_
 
 #include <algorithm>
+#include <deque>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -44,6 +45,7 @@ class D3D12SharedMemory : public SharedMemory {
 
   void CompletedSubmissionUpdated();
   void BeginSubmission();
+  void EndSubmission();
 
   // RequestRange may transition the buffer to copy destination - call it before
   // UseForReading or UseForWriting.
@@ -90,6 +92,8 @@ class D3D12SharedMemory : public SharedMemory {
  protected:
   bool AllocateSparseHostGpuMemoryRange(uint32_t offset_allocations,
                                         uint32_t length_allocations) override;
+  bool FreeSparseHostGpuMemoryRange(uint32_t offset_allocations,
+                                    uint32_t length_allocations) override;
 
   bool UploadRanges(const std::pair<uint32_t, uint32_t>* upload_page_ranges,
                     uint32_t num_ranges) override;
@@ -101,11 +105,26 @@ class D3D12SharedMemory : public SharedMemory {
   // The 512 MB tiled buffer.
   ID3D12Resource* buffer_ = nullptr;
   D3D12_GPU_VIRTUAL_ADDRESS buffer_gpu_address_ = 0;
+  // One per sparse allocation, nullptr if not allocated.
   std::vector<ID3D12Heap*> buffer_tiled_heaps_;
+  // <Submission where unmapped, heap>, sorted by the submission number.
+  std::deque<std::pair<uint64_t, ID3D12Heap*>> buffer_tiled_heaps_released_;
   D3D12_RESOURCE_STATES buffer_state_ = D3D12_RESOURCE_STATE_COPY_DEST;
   bool buffer_uav_writes_commit_needed_ = false;
   void CommitUAVWritesAndTransitionBuffer(D3D12_RESOURCE_STATES new_state);
 
+  // Uploads contiguous both in the upload buffer and in the shared memory
+  // buffer (such as from consecutive RequestRange calls for adjacent data) are
+  // merged into one copy command, recorded when the buffer leaves the copy
+  // destination state or when the submission ends.
+  void QueueUploadCopy(ID3D12Resource* source, UINT64 source_offset,
+                       UINT64 dest_offset, UINT64 size);
+  void FlushUploadCopy();
+  ID3D12Resource* upload_copy_pending_source_ = nullptr;
+  UINT64 upload_copy_pending_source_offset_;
+  UINT64 upload_copy_pending_dest_offset_;
+  UINT64 upload_copy_pending_size_;
+
   // Non-shader-visible buffer descriptor heap for faster binding (via copying
   // rather than creation).
   enum class BufferDescriptorIndex : uint32_t {
@@ -22,6 +22,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/gpu/d3d12/d3d12_command_processor.h"
 #include "xenia/gpu/d3d12/d3d12_shared_memory.h"
+#include "xenia/gpu/gpu_pass_timestamps.h"
 #include "xenia/gpu/texture_info.h"
 #include "xenia/gpu/texture_util.h"
 #include "xenia/gpu/xenos.h"
@@ -1301,6 +1302,23 @@ uint32_t D3D12TextureCache::GetMaxHostTextureDepthOrArraySize(
   }
 }
 
+bool D3D12TextureCache::GetHostMemoryBudget(uint64_t& budget_out,
+                                            uint64_t& usage_out) const {
+  IDXGIAdapter3* dxgi_adapter3 =
+      command_processor_.GetD3D12Provider().GetDXGIAdapter3();
+  if (!dxgi_adapter3) {
+    return false;
+  }
+  DXGI_QUERY_VIDEO_MEMORY_INFO video_memory_info;
+  if (FAILED(dxgi_adapter3->QueryVideoMemoryInfo(
+          0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &video_memory_info))) {
+    return false;
+  }
+  budget_out = video_memory_info.Budget;
+  usage_out = video_memory_info.CurrentUsage;
+  return budget_out != 0;
+}
+
 std::unique_ptr<TextureCache::Texture> D3D12TextureCache::CreateTexture(
     TextureKey key) {
   D3D12_RESOURCE_DESC desc;
@@ -1347,12 +1365,16 @@ std::unique_ptr<TextureCache::Texture> D3D12TextureCache::CreateTexture(
       new D3D12Texture(*this, key, resource.Get(), resource_state));
 }
 
-bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
-                                                              bool load_base,
-                                                              bool load_mips) {
+bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(
+    Texture& texture, bool load_base, bool load_mips,
+    uint64_t disk_cache_hash) {
+  // GetDiskCacheHostFormat is not implemented, so disk_cache_hash is always 0.
   D3D12Texture& d3d12_texture = static_cast<D3D12Texture&>(texture);
   TextureKey texture_key = d3d12_texture.key();
 
+  GpuPassScope<D3D12CommandProcessor> gpu_pass_scope(command_processor_,
+                                                     GpuPass::kTextureLoads);
+
   DeferredCommandList& command_list =
       command_processor_.GetDeferredCommandList();
   ID3D12Device* device = command_processor_.GetD3D12Provider().GetDevice();
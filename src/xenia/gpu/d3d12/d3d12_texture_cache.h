@@ -536,11 +536,15 @@ class D3D12TextureCache final : public TextureCache {
   uint32_t GetMaxHostTextureDepthOrArraySize(
       xenos::DataDimension dimension) const override;
 
+  bool GetHostMemoryBudget(uint64_t& budget_out,
+                           uint64_t& usage_out) const override;
+
   std::unique_ptr<Texture> CreateTexture(TextureKey key) override;
 
   // This binds pipelines, allocates descriptors, and copies!
-  bool LoadTextureDataFromResidentMemoryImpl(Texture& texture, bool load_base,
-                                             bool load_mips) override;
+  bool LoadTextureDataFromResidentMemoryImpl(
+      Texture& texture, bool load_base, bool load_mips,
+      uint64_t disk_cache_hash) override;
 
   void UpdateTextureBindingsImpl(uint32_t fetch_constant_mask) override;
 
@@ -9,6 +9,8 @@
 
 #include "xenia/gpu/d3d12/deferred_command_list.h"
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -28,239 +30,530 @@ void DeferredCommandList::Reset() { command_stream_.clear(); }
 
 void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
                                   ID3D12GraphicsCommandList1* command_list_1) {
+  Segment whole_stream;
+  whole_stream.begin = 0;
+  whole_stream.end = command_stream_.size() / sizeof(uintmax_t);
+  ExecuteSegment(command_list, command_list_1, whole_stream);
+}
+
+void DeferredCommandList::MoveCommands(size_t begin,
+                                       DeferredCommandList& target) {
+  size_t begin_bytes = begin * sizeof(uintmax_t);
+  size_t end_bytes = command_stream_.size();
+  assert_true(begin_bytes <= end_bytes);
+  size_t move_size_bytes = end_bytes - begin_bytes;
+  size_t target_offset_bytes = target.command_stream_.size();
+  target.command_stream_.resize(target_offset_bytes + move_size_bytes);
+  std::memcpy(target.command_stream_.data() + target_offset_bytes,
+              command_stream_.data() + begin_bytes, move_size_bytes);
+  command_stream_.resize(begin_bytes);
+}
+
+void DeferredCommandList::Split(uint32_t max_segment_count,
+                                uint32_t min_segment_draw_count,
+                                std::vector<Segment>& segments_out) const {
+  const uintmax_t* stream_start =
+      reinterpret_cast<const uintmax_t*>(command_stream_.data());
+  size_t stream_size = command_stream_.size() / sizeof(uintmax_t);
+  segments_out.clear();
+  Segment& first_segment = segments_out.emplace_back();
+  first_segment.begin = 0;
+  first_segment.end = stream_size;
+  if (max_segment_count <= 1) {
+    return;
+  }
+
+  uint32_t draw_count = 0;
+  for (size_t offset = 0; offset < stream_size;) {
+    const CommandHeader& header =
+        *reinterpret_cast<const CommandHeader*>(stream_start + offset);
+    if (header.command == Command::kD3DDrawIndexedInstanced ||
+        header.command == Command::kD3DDrawInstanced) {
+      ++draw_count;
+    }
+    offset += kCommandHeaderSizeElements + header.arguments_size_elements;
+  }
+  uint32_t segment_draw_count_target =
+      std::max(draw_count / max_segment_count,
+               std::max(min_segment_draw_count, uint32_t(1)));
+  if (draw_count < segment_draw_count_target * 2) {
+    return;
+  }
+
+  // Offsets of the latest commands setting each part of the state.
+  static constexpr size_t kNoCommand = SIZE_MAX;
+  enum StateCommand {
+    kStateCommandDescriptorHeaps,
+    kStateCommandPipelineState,
+    kStateCommandPrimitiveTopology,
+    kStateCommandIndexBuffer,
+    kStateCommandVertexBuffers,
+    kStateCommandBlendFactor,
+    kStateCommandRenderTargets,
+    kStateCommandStencilRef,
+    kStateCommandScissorRect,
+    kStateCommandViewport,
+    kStateCommandSamplePositions,
+
+    kStateCommandCount,
+  };
+  size_t state_commands[kStateCommandCount];
+  std::fill(state_commands, state_commands + kStateCommandCount, kNoCommand);
+  // Root parameters are reset by root signature changes, so only the commands
+  // after the latest root signature command are needed.
+  static constexpr uint32_t kMaxRootParameters = 64;
+  struct RootBindings {
+    size_t root_signature = kNoCommand;
+    // Descriptor tables and root descriptors.
+    size_t parameters[kMaxRootParameters];
+    // Constants may be set partially, so all the commands since the last one
+    // that has overwritten all the constants set previously are kept.
+    std::vector<size_t> constants[kMaxRootParameters];
+    uint32_t constants_set[kMaxRootParameters];
+
+    void Reset(size_t root_signature_command) {
+      root_signature = root_signature_command;
+      std::fill(parameters, parameters + kMaxRootParameters, kNoCommand);
+      for (uint32_t i = 0; i < kMaxRootParameters; ++i) {
+        constants[i].clear();
+      }
+      std::fill(constants_set, constants_set + kMaxRootParameters, 0);
+    }
+    void SetParameter(UINT root_parameter_index, size_t command) {
+      if (root_parameter_index < kMaxRootParameters) {
+        parameters[root_parameter_index] = command;
+      }
+    }
+    void SetConstants(const SetRoot32BitConstantsHeader& args,
+                      size_t command) {
+      if (args.root_parameter_index >= kMaxRootParameters) {
+        return;
+      }
+      std::vector<size_t>& parameter_constants =
+          constants[args.root_parameter_index];
+      uint32_t& parameter_constants_set =
+          constants_set[args.root_parameter_index];
+      if (!args.dest_offset_in_32bit_values &&
+          args.num_32bit_values_to_set >= parameter_constants_set) {
+        parameter_constants.clear();
+        parameter_constants_set = args.num_32bit_values_to_set;
+      } else {
+        parameter_constants_set = std::max(
+            parameter_constants_set,
+            uint32_t(args.dest_offset_in_32bit_values +
+                     args.num_32bit_values_to_set));
+      }
+      parameter_constants.push_back(command);
+    }
+    void Gather(std::vector<size_t>& commands_out) const {
+      if (root_signature == kNoCommand) {
+        return;
+      }
+      commands_out.push_back(root_signature);
+      for (uint32_t i = 0; i < kMaxRootParameters; ++i) {
+        if (parameters[i] != kNoCommand) {
+          commands_out.push_back(parameters[i]);
+        }
+        commands_out.insert(commands_out.end(), constants[i].cbegin(),
+                            constants[i].cend());
+      }
+    }
+  };
+  RootBindings graphics_root_bindings, compute_root_bindings;
+  graphics_root_bindings.Reset(kNoCommand);
+  compute_root_bindings.Reset(kNoCommand);
+
+  uint32_t segment_draw_count = 0;
+  // Queries must begin and end in the same command list.
+  bool occlusion_query_active = false;
+  for (size_t offset = 0; offset < stream_size;) {
+    const CommandHeader& header =
+        *reinterpret_cast<const CommandHeader*>(stream_start + offset);
+    const uintmax_t* stream =
+        stream_start + offset + kCommandHeaderSizeElements;
+    switch (header.command) {
+      case Command::kD3DDrawIndexedInstanced:
+      case Command::kD3DDrawInstanced:
+        ++segment_draw_count;
+        break;
+      case Command::kD3DBeginQuery:
+      case Command::kD3DEndQuery:
+        if (reinterpret_cast<const D3DQueryArguments*>(stream)->type ==
+            D3D12_QUERY_TYPE_OCCLUSION) {
+          occlusion_query_active = header.command == Command::kD3DBeginQuery;
+        }
+        break;
+      case Command::kD3DIASetIndexBuffer:
+        state_commands[kStateCommandIndexBuffer] = offset;
+        break;
+      case Command::kD3DIASetPrimitiveTopology:
+        state_commands[kStateCommandPrimitiveTopology] = offset;
+        break;
+      case Command::kD3DIASetVertexBuffers:
+        // Only one vertex buffer slot is used.
+        state_commands[kStateCommandVertexBuffers] = offset;
+        break;
+      case Command::kD3DOMSetBlendFactor:
+        state_commands[kStateCommandBlendFactor] = offset;
+        break;
+      case Command::kD3DOMSetRenderTargets:
+        if (segment_draw_count >= segment_draw_count_target &&
+            segments_out.size() < max_segment_count &&
+            !occlusion_query_active) {
+          segments_out.back().end = offset;
+          Segment& segment = segments_out.emplace_back();
+          segment.begin = offset;
+          segment.end = stream_size;
+          for (uint32_t i = 0; i < kStateCommandCount; ++i) {
+            if (state_commands[i] != kNoCommand) {
+              segment.state_commands.push_back(state_commands[i]);
+            }
+          }
+          graphics_root_bindings.Gather(segment.state_commands);
+          compute_root_bindings.Gather(segment.state_commands);
+          // Descriptor heaps must be set before the descriptor tables, and
+          // the latest pipeline state must take effect.
+          std::sort(segment.state_commands.begin(),
+                    segment.state_commands.end());
+          segment_draw_count = 0;
+        }
+        state_commands[kStateCommandRenderTargets] = offset;
+        break;
+      case Command::kD3DOMSetStencilRef:
+        state_commands[kStateCommandStencilRef] = offset;
+        break;
+      case Command::kRSSetScissorRect:
+        state_commands[kStateCommandScissorRect] = offset;
+        break;
+      case Command::kRSSetViewport:
+        state_commands[kStateCommandViewport] = offset;
+        break;
+      case Command::kD3DSetComputeRoot32BitConstants:
+        compute_root_bindings.SetConstants(
+            *reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream),
+            offset);
+        break;
+      case Command::kD3DSetGraphicsRoot32BitConstants:
+        graphics_root_bindings.SetConstants(
+            *reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream),
+            offset);
+        break;
+      case Command::kD3DSetComputeRootConstantBufferView:
+        compute_root_bindings.SetParameter(
+            reinterpret_cast<const SetRootConstantBufferViewArguments*>(stream)
+                ->root_parameter_index,
+            offset);
+        break;
+      case Command::kD3DSetGraphicsRootConstantBufferView:
+        graphics_root_bindings.SetParameter(
+            reinterpret_cast<const SetRootConstantBufferViewArguments*>(stream)
+                ->root_parameter_index,
+            offset);
+        break;
+      case Command::kD3DSetComputeRootDescriptorTable:
+        compute_root_bindings.SetParameter(
+            reinterpret_cast<const SetRootDescriptorTableArguments*>(stream)
+                ->root_parameter_index,
+            offset);
+        break;
+      case Command::kD3DSetGraphicsRootDescriptorTable:
+        graphics_root_bindings.SetParameter(
+            reinterpret_cast<const SetRootDescriptorTableArguments*>(stream)
+                ->root_parameter_index,
+            offset);
+        break;
+      case Command::kD3DSetComputeRootSignature:
+        compute_root_bindings.Reset(offset);
+        break;
+      case Command::kD3DSetGraphicsRootSignature:
+        graphics_root_bindings.Reset(offset);
+        break;
+      case Command::kSetDescriptorHeaps:
+        state_commands[kStateCommandDescriptorHeaps] = offset;
+        break;
+      case Command::kD3DSetPipelineState:
+      case Command::kSetPipelineStateHandle:
+        state_commands[kStateCommandPipelineState] = offset;
+        break;
+      case Command::kD3DSetSamplePositions:
+        state_commands[kStateCommandSamplePositions] = offset;
+        break;
+      default:
+        break;
+    }
+    offset += kCommandHeaderSizeElements + header.arguments_size_elements;
+  }
+}
+
+void DeferredCommandList::ExecuteSegment(
+    ID3D12GraphicsCommandList* command_list,
+    ID3D12GraphicsCommandList1* command_list_1, const Segment& segment) const {
 #if XE_UI_D3D12_FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
 #endif  // XE_UI_D3D12_FINE_GRAINED_DRAW_SCOPES
-  const uintmax_t* stream = (const uintmax_t*)command_stream_.data();
-  size_t stream_remaining = command_stream_.size() / sizeof(uintmax_t);
+  const uintmax_t* stream_start =
+      reinterpret_cast<const uintmax_t*>(command_stream_.data());
   ID3D12PipelineState* current_pipeline_state = nullptr;
+  // Bring a new command list to the state at the beginning of the segment.
+  for (size_t state_command_offset : segment.state_commands) {
+    const uintmax_t* stream = stream_start + state_command_offset;
+    ExecuteCommand(command_list, command_list_1,
+                   *reinterpret_cast<const CommandHeader*>(stream),
+                   stream + kCommandHeaderSizeElements, current_pipeline_state);
+  }
+  const uintmax_t* stream = stream_start + segment.begin;
+  size_t stream_remaining = segment.end - segment.begin;
   while (stream_remaining != 0) {
     const CommandHeader& header =
         *reinterpret_cast<const CommandHeader*>(stream);
     stream += kCommandHeaderSizeElements;
     stream_remaining -= kCommandHeaderSizeElements;
-    switch (header.command) {
-      case Command::kD3DClearDepthStencilView: {
-        auto& args =
-            *reinterpret_cast<const ClearDepthStencilViewHeader*>(stream);
-        command_list->ClearDepthStencilView(
-            args.depth_stencil_view, args.clear_flags, args.depth, args.stencil,
-            args.num_rects,
-            args.num_rects ? reinterpret_cast<const D3D12_RECT*>(&args + 1)
-                           : nullptr);
-      } break;
-      case Command::kD3DClearRenderTargetView: {
-        auto& args =
-            *reinterpret_cast<const ClearRenderTargetViewHeader*>(stream);
-        command_list->ClearRenderTargetView(
-            args.render_target_view, args.color_rgba, args.num_rects,
-            args.num_rects ? reinterpret_cast<const D3D12_RECT*>(&args + 1)
-                           : nullptr);
-      } break;
-      case Command::kD3DClearUnorderedAccessViewUint: {
-        auto& args =
-            *reinterpret_cast<const ClearUnorderedAccessViewHeader*>(stream);
-        command_list->ClearUnorderedAccessViewUint(
-            args.view_gpu_handle_in_current_heap, args.view_cpu_handle,
-            args.resource, args.values_uint, args.num_rects,
-            args.num_rects ? reinterpret_cast<const D3D12_RECT*>(&args + 1)
-                           : nullptr);
-      } break;
-      case Command::kD3DCopyBufferRegion: {
-        auto& args =
-            *reinterpret_cast<const D3DCopyBufferRegionArguments*>(stream);
-        command_list->CopyBufferRegion(args.dst_buffer, args.dst_offset,
-                                       args.src_buffer, args.src_offset,
-                                       args.num_bytes);
-      } break;
-      case Command::kD3DCopyResource: {
-        auto& args = *reinterpret_cast<const D3DCopyResourceArguments*>(stream);
-        command_list->CopyResource(args.dst_resource, args.src_resource);
-      } break;
-      case Command::kCopyTexture: {
-        auto& args = *reinterpret_cast<const CopyTextureArguments*>(stream);
-        command_list->CopyTextureRegion(&args.dst, 0, 0, 0, &args.src, nullptr);
-      } break;
-      case Command::kD3DCopyTextureRegion: {
-        auto& args =
-            *reinterpret_cast<const D3DCopyTextureRegionArguments*>(stream);
-        command_list->CopyTextureRegion(
-            &args.dst, args.dst_x, args.dst_y, args.dst_z, &args.src,
-            args.has_src_box ? &args.src_box : nullptr);
-      } break;
-      case Command::kD3DDispatch: {
-        if (current_pipeline_state != nullptr) {
-          auto& args = *reinterpret_cast<const D3DDispatchArguments*>(stream);
-          command_list->Dispatch(args.thread_group_count_x,
-                                 args.thread_group_count_y,
-                                 args.thread_group_count_z);
-        }
-      } break;
-      case Command::kD3DDrawIndexedInstanced: {
-        if (current_pipeline_state != nullptr) {
-          auto& args =
-              *reinterpret_cast<const D3DDrawIndexedInstancedArguments*>(
-                  stream);
-          command_list->DrawIndexedInstanced(
-              args.index_count_per_instance, args.instance_count,
-              args.start_index_location, args.base_vertex_location,
-              args.start_instance_location);
-        }
-      } break;
-      case Command::kD3DDrawInstanced: {
-        if (current_pipeline_state != nullptr) {
-          auto& args =
-              *reinterpret_cast<const D3DDrawInstancedArguments*>(stream);
-          command_list->DrawInstanced(
-              args.vertex_count_per_instance, args.instance_count,
-              args.start_vertex_location, args.start_instance_location);
-        }
-      } break;
-      case Command::kD3DIASetIndexBuffer: {
-        auto view = reinterpret_cast<const D3D12_INDEX_BUFFER_VIEW*>(stream);
-        command_list->IASetIndexBuffer(
-            view->Format != DXGI_FORMAT_UNKNOWN ? view : nullptr);
-      } break;
-      case Command::kD3DIASetPrimitiveTopology: {
-        command_list->IASetPrimitiveTopology(
-            *reinterpret_cast<const D3D12_PRIMITIVE_TOPOLOGY*>(stream));
-      } break;
-      case Command::kD3DIASetVertexBuffers: {
-        static_assert(alignof(D3D12_VERTEX_BUFFER_VIEW) <= alignof(uintmax_t));
-        auto& args =
-            *reinterpret_cast<const D3DIASetVertexBuffersHeader*>(stream);
-        command_list->IASetVertexBuffers(
-            args.start_slot, args.num_views,
-            reinterpret_cast<const D3D12_VERTEX_BUFFER_VIEW*>(
-                reinterpret_cast<const uint8_t*>(stream) +
-                xe::align(sizeof(D3DIASetVertexBuffersHeader),
-                          alignof(D3D12_VERTEX_BUFFER_VIEW))));
-      } break;
-      case Command::kD3DOMSetBlendFactor: {
-        command_list->OMSetBlendFactor(reinterpret_cast<const FLOAT*>(stream));
-      } break;
-      case Command::kD3DOMSetRenderTargets: {
-        auto& args =
-            *reinterpret_cast<const D3DOMSetRenderTargetsArguments*>(stream);
-        command_list->OMSetRenderTargets(
-            args.num_render_target_descriptors, args.render_target_descriptors,
-            args.rts_single_handle_to_descriptor_range ? TRUE : FALSE,
-            args.depth_stencil ? &args.depth_stencil_descriptor : nullptr);
-      } break;
-      case Command::kD3DOMSetStencilRef: {
-        command_list->OMSetStencilRef(*reinterpret_cast<const UINT*>(stream));
-      } break;
-      case Command::kD3DResourceBarrier: {
-        static_assert(alignof(D3D12_RESOURCE_BARRIER) <= alignof(uintmax_t));
-        command_list->ResourceBarrier(
-            *reinterpret_cast<const UINT*>(stream),
-            reinterpret_cast<const D3D12_RESOURCE_BARRIER*>(
-                reinterpret_cast<const uint8_t*>(stream) +
-                xe::align(sizeof(UINT), alignof(D3D12_RESOURCE_BARRIER))));
-      } break;
-      case Command::kRSSetScissorRect: {
-        command_list->RSSetScissorRects(
-            1, reinterpret_cast<const D3D12_RECT*>(stream));
-      } break;
-      case Command::kRSSetViewport: {
-        command_list->RSSetViewports(
-            1, reinterpret_cast<const D3D12_VIEWPORT*>(stream));
-      } break;
-      case Command::kD3DSetComputeRoot32BitConstants: {
-        auto args =
-            reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream);
-        command_list->SetComputeRoot32BitConstants(
-            args->root_parameter_index, args->num_32bit_values_to_set, args + 1,
-            args->dest_offset_in_32bit_values);
-      } break;
-      case Command::kD3DSetGraphicsRoot32BitConstants: {
-        auto args =
-            reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream);
-        command_list->SetGraphicsRoot32BitConstants(
-            args->root_parameter_index, args->num_32bit_values_to_set, args + 1,
-            args->dest_offset_in_32bit_values);
-      } break;
-      case Command::kD3DSetComputeRootConstantBufferView: {
-        auto& args =
-            *reinterpret_cast<const SetRootConstantBufferViewArguments*>(
-                stream);
-        command_list->SetComputeRootConstantBufferView(
-            args.root_parameter_index, args.buffer_location);
-      } break;
-      case Command::kD3DSetGraphicsRootConstantBufferView: {
+    ExecuteCommand(command_list, command_list_1, header, stream,
+                   current_pipeline_state);
+    stream += header.arguments_size_elements;
+    stream_remaining -= header.arguments_size_elements;
+  }
+}
+
+void DeferredCommandList::ExecuteCommand(
+    ID3D12GraphicsCommandList* command_list,
+    ID3D12GraphicsCommandList1* command_list_1, const CommandHeader& header,
+    const uintmax_t* stream,
+    ID3D12PipelineState*& current_pipeline_state) const {
+  switch (header.command) {
+    case Command::kD3DBeginQuery: {
+      auto& args = *reinterpret_cast<const D3DQueryArguments*>(stream);
+      command_list->BeginQuery(args.query_heap, args.type, args.index);
+    } break;
+    case Command::kD3DClearDepthStencilView: {
+      auto& args =
+          *reinterpret_cast<const ClearDepthStencilViewHeader*>(stream);
+      command_list->ClearDepthStencilView(
+          args.depth_stencil_view, args.clear_flags, args.depth, args.stencil,
+          args.num_rects,
+          args.num_rects ? reinterpret_cast<const D3D12_RECT*>(&args + 1)
+                         : nullptr);
+    } break;
+    case Command::kD3DClearRenderTargetView: {
+      auto& args =
+          *reinterpret_cast<const ClearRenderTargetViewHeader*>(stream);
+      command_list->ClearRenderTargetView(
+          args.render_target_view, args.color_rgba, args.num_rects,
+          args.num_rects ? reinterpret_cast<const D3D12_RECT*>(&args + 1)
+                         : nullptr);
+    } break;
+    case Command::kD3DClearUnorderedAccessViewUint: {
+      auto& args =
+          *reinterpret_cast<const ClearUnorderedAccessViewHeader*>(stream);
+      command_list->ClearUnorderedAccessViewUint(
+          args.view_gpu_handle_in_current_heap, args.view_cpu_handle,
+          args.resource, args.values_uint, args.num_rects,
+          args.num_rects ? reinterpret_cast<const D3D12_RECT*>(&args + 1)
+                         : nullptr);
+    } break;
+    case Command::kD3DCopyBufferRegion: {
+      auto& args =
+          *reinterpret_cast<const D3DCopyBufferRegionArguments*>(stream);
+      command_list->CopyBufferRegion(args.dst_buffer, args.dst_offset,
+                                     args.src_buffer, args.src_offset,
+                                     args.num_bytes);
+    } break;
+    case Command::kD3DCopyResource: {
+      auto& args = *reinterpret_cast<const D3DCopyResourceArguments*>(stream);
+      command_list->CopyResource(args.dst_resource, args.src_resource);
+    } break;
+    case Command::kCopyTexture: {
+      auto& args = *reinterpret_cast<const CopyTextureArguments*>(stream);
+      command_list->CopyTextureRegion(&args.dst, 0, 0, 0, &args.src, nullptr);
+    } break;
+    case Command::kD3DCopyTextureRegion: {
+      auto& args =
+          *reinterpret_cast<const D3DCopyTextureRegionArguments*>(stream);
+      command_list->CopyTextureRegion(
+          &args.dst, args.dst_x, args.dst_y, args.dst_z, &args.src,
+          args.has_src_box ? &args.src_box : nullptr);
+    } break;
+    case Command::kD3DDispatch: {
+      if (current_pipeline_state != nullptr) {
+        auto& args = *reinterpret_cast<const D3DDispatchArguments*>(stream);
+        command_list->Dispatch(args.thread_group_count_x,
+                               args.thread_group_count_y,
+                               args.thread_group_count_z);
+      }
+    } break;
+    case Command::kD3DDrawIndexedInstanced: {
+      if (current_pipeline_state != nullptr) {
         auto& args =
-            *reinterpret_cast<const SetRootConstantBufferViewArguments*>(
+            *reinterpret_cast<const D3DDrawIndexedInstancedArguments*>(
                 stream);
-        command_list->SetGraphicsRootConstantBufferView(
-            args.root_parameter_index, args.buffer_location);
-      } break;
-      case Command::kD3DSetComputeRootDescriptorTable: {
-        auto& args =
-            *reinterpret_cast<const SetRootDescriptorTableArguments*>(stream);
-        command_list->SetComputeRootDescriptorTable(args.root_parameter_index,
-                                                    args.base_descriptor);
-      } break;
-      case Command::kD3DSetGraphicsRootDescriptorTable: {
+        command_list->DrawIndexedInstanced(
+            args.index_count_per_instance, args.instance_count,
+            args.start_index_location, args.base_vertex_location,
+            args.start_instance_location);
+      }
+    } break;
+    case Command::kD3DDrawInstanced: {
+      if (current_pipeline_state != nullptr) {
         auto& args =
-            *reinterpret_cast<const SetRootDescriptorTableArguments*>(stream);
-        command_list->SetGraphicsRootDescriptorTable(args.root_parameter_index,
-                                                     args.base_descriptor);
-      } break;
-      case Command::kD3DSetComputeRootSignature: {
-        command_list->SetComputeRootSignature(
-            *reinterpret_cast<ID3D12RootSignature* const*>(stream));
-      } break;
-      case Command::kD3DSetGraphicsRootSignature: {
-        command_list->SetGraphicsRootSignature(
-            *reinterpret_cast<ID3D12RootSignature* const*>(stream));
-      } break;
-      case Command::kSetDescriptorHeaps: {
+            *reinterpret_cast<const D3DDrawInstancedArguments*>(stream);
+        command_list->DrawInstanced(
+            args.vertex_count_per_instance, args.instance_count,
+            args.start_vertex_location, args.start_instance_location);
+      }
+    } break;
+    case Command::kD3DEndQuery: {
+      auto& args = *reinterpret_cast<const D3DQueryArguments*>(stream);
+      command_list->EndQuery(args.query_heap, args.type, args.index);
+    } break;
+    case Command::kD3DIASetIndexBuffer: {
+      auto view = reinterpret_cast<const D3D12_INDEX_BUFFER_VIEW*>(stream);
+      command_list->IASetIndexBuffer(
+          view->Format != DXGI_FORMAT_UNKNOWN ? view : nullptr);
+    } break;
+    case Command::kD3DIASetPrimitiveTopology: {
+      command_list->IASetPrimitiveTopology(
+          *reinterpret_cast<const D3D12_PRIMITIVE_TOPOLOGY*>(stream));
+    } break;
+    case Command::kD3DIASetVertexBuffers: {
+      static_assert(alignof(D3D12_VERTEX_BUFFER_VIEW) <= alignof(uintmax_t));
+      auto& args =
+          *reinterpret_cast<const D3DIASetVertexBuffersHeader*>(stream);
+      command_list->IASetVertexBuffers(
+          args.start_slot, args.num_views,
+          reinterpret_cast<const D3D12_VERTEX_BUFFER_VIEW*>(
+              reinterpret_cast<const uint8_t*>(stream) +
+              xe::align(sizeof(D3DIASetVertexBuffersHeader),
+                        alignof(D3D12_VERTEX_BUFFER_VIEW))));
+    } break;
+    case Command::kD3DOMSetBlendFactor: {
+      command_list->OMSetBlendFactor(reinterpret_cast<const FLOAT*>(stream));
+    } break;
+    case Command::kD3DOMSetRenderTargets: {
+      auto& args =
+          *reinterpret_cast<const D3DOMSetRenderTargetsArguments*>(stream);
+      command_list->OMSetRenderTargets(
+          args.num_render_target_descriptors, args.render_target_descriptors,
+          args.rts_single_handle_to_descriptor_range ? TRUE : FALSE,
+          args.depth_stencil ? &args.depth_stencil_descriptor : nullptr);
+    } break;
+    case Command::kD3DOMSetStencilRef: {
+      command_list->OMSetStencilRef(*reinterpret_cast<const UINT*>(stream));
+    } break;
+    case Command::kD3DResolveQueryData: {
+      auto& args =
+          *reinterpret_cast<const D3DResolveQueryDataArguments*>(stream);
+      command_list->ResolveQueryData(
+          args.query_heap, args.type, args.start_index, args.num_queries,
+          args.destination_buffer, args.aligned_destination_buffer_offset);
+    } break;
+    case Command::kD3DResourceBarrier: {
+      static_assert(alignof(D3D12_RESOURCE_BARRIER) <= alignof(uintmax_t));
+      command_list->ResourceBarrier(
+          *reinterpret_cast<const UINT*>(stream),
+          reinterpret_cast<const D3D12_RESOURCE_BARRIER*>(
+              reinterpret_cast<const uint8_t*>(stream) +
+              xe::align(sizeof(UINT), alignof(D3D12_RESOURCE_BARRIER))));
+    } break;
+    case Command::kRSSetScissorRect: {
+      command_list->RSSetScissorRects(
+          1, reinterpret_cast<const D3D12_RECT*>(stream));
+    } break;
+    case Command::kRSSetViewport: {
+      command_list->RSSetViewports(
+          1, reinterpret_cast<const D3D12_VIEWPORT*>(stream));
+    } break;
+    case Command::kD3DSetComputeRoot32BitConstants: {
+      auto args =
+          reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream);
+      command_list->SetComputeRoot32BitConstants(
+          args->root_parameter_index, args->num_32bit_values_to_set, args + 1,
+          args->dest_offset_in_32bit_values);
+    } break;
+    case Command::kD3DSetGraphicsRoot32BitConstants: {
+      auto args =
+          reinterpret_cast<const SetRoot32BitConstantsHeader*>(stream);
+      command_list->SetGraphicsRoot32BitConstants(
+          args->root_parameter_index, args->num_32bit_values_to_set, args + 1,
+          args->dest_offset_in_32bit_values);
+    } break;
+    case Command::kD3DSetComputeRootConstantBufferView: {
+      auto& args =
+          *reinterpret_cast<const SetRootConstantBufferViewArguments*>(
+              stream);
+      command_list->SetComputeRootConstantBufferView(
+          args.root_parameter_index, args.buffer_location);
+    } break;
+    case Command::kD3DSetGraphicsRootConstantBufferView: {
+      auto& args =
+          *reinterpret_cast<const SetRootConstantBufferViewArguments*>(
+              stream);
+      command_list->SetGraphicsRootConstantBufferView(
+          args.root_parameter_index, args.buffer_location);
+    } break;
+    case Command::kD3DSetComputeRootDescriptorTable: {
+      auto& args =
+          *reinterpret_cast<const SetRootDescriptorTableArguments*>(stream);
+      command_list->SetComputeRootDescriptorTable(args.root_parameter_index,
+                                                  args.base_descriptor);
+    } break;
+    case Command::kD3DSetGraphicsRootDescriptorTable: {
+      auto& args =
+          *reinterpret_cast<const SetRootDescriptorTableArguments*>(stream);
+      command_list->SetGraphicsRootDescriptorTable(args.root_parameter_index,
+                                                   args.base_descriptor);
+    } break;
+    case Command::kD3DSetComputeRootSignature: {
+      command_list->SetComputeRootSignature(
+          *reinterpret_cast<ID3D12RootSignature* const*>(stream));
+    } break;
+    case Command::kD3DSetGraphicsRootSignature: {
+      command_list->SetGraphicsRootSignature(
+          *reinterpret_cast<ID3D12RootSignature* const*>(stream));
+    } break;
+    case Command::kSetDescriptorHeaps: {
+      auto& args =
+          *reinterpret_cast<const SetDescriptorHeapsArguments*>(stream);
+      UINT num_descriptor_heaps = 0;
+      ID3D12DescriptorHeap* descriptor_heaps[2];
+      if (args.cbv_srv_uav_descriptor_heap != nullptr) {
+        descriptor_heaps[num_descriptor_heaps++] =
+            args.cbv_srv_uav_descriptor_heap;
+      }
+      if (args.sampler_descriptor_heap != nullptr) {
+        descriptor_heaps[num_descriptor_heaps++] =
+            args.sampler_descriptor_heap;
+      }
+      command_list->SetDescriptorHeaps(num_descriptor_heaps,
+                                       descriptor_heaps);
+    } break;
+    case Command::kD3DSetPipelineState: {
+      current_pipeline_state =
+          *reinterpret_cast<ID3D12PipelineState* const*>(stream);
+      if (current_pipeline_state) {
+        command_list->SetPipelineState(current_pipeline_state);
+      }
+    } break;
+    case Command::kSetPipelineStateHandle: {
+      current_pipeline_state = command_processor_.GetD3D12PipelineByHandle(
+          *reinterpret_cast<void* const*>(stream));
+      if (current_pipeline_state) {
+        command_list->SetPipelineState(current_pipeline_state);
+      }
+    } break;
+    case Command::kD3DSetSamplePositions: {
+      if (command_list_1 != nullptr) {
         auto& args =
-            *reinterpret_cast<const SetDescriptorHeapsArguments*>(stream);
-        UINT num_descriptor_heaps = 0;
-        ID3D12DescriptorHeap* descriptor_heaps[2];
-        if (args.cbv_srv_uav_descriptor_heap != nullptr) {
-          descriptor_heaps[num_descriptor_heaps++] =
-              args.cbv_srv_uav_descriptor_heap;
-        }
-        if (args.sampler_descriptor_heap != nullptr) {
-          descriptor_heaps[num_descriptor_heaps++] =
-              args.sampler_descriptor_heap;
-        }
-        command_list->SetDescriptorHeaps(num_descriptor_heaps,
-                                         descriptor_heaps);
-      } break;
-      case Command::kD3DSetPipelineState: {
-        current_pipeline_state =
-            *reinterpret_cast<ID3D12PipelineState* const*>(stream);
-        if (current_pipeline_state) {
-          command_list->SetPipelineState(current_pipeline_state);
-        }
-      } break;
-      case Command::kSetPipelineStateHandle: {
-        current_pipeline_state = command_processor_.GetD3D12PipelineByHandle(
-            *reinterpret_cast<void* const*>(stream));
-        if (current_pipeline_state) {
-          command_list->SetPipelineState(current_pipeline_state);
-        }
-      } break;
-      case Command::kD3DSetSamplePositions: {
-        if (command_list_1 != nullptr) {
-          auto& args =
-              *reinterpret_cast<const D3DSetSamplePositionsArguments*>(stream);
-          command_list_1->SetSamplePositions(
-              args.num_samples_per_pixel, args.num_pixels,
-              (args.num_samples_per_pixel && args.num_pixels)
-                  ? const_cast<D3D12_SAMPLE_POSITION*>(args.sample_positions)
-                  : nullptr);
-        }
-      } break;
-      default:
-        assert_unhandled_case(header.command);
-        break;
-    }
-    stream += header.arguments_size_elements;
-    stream_remaining -= header.arguments_size_elements;
+            *reinterpret_cast<const D3DSetSamplePositionsArguments*>(stream);
+        command_list_1->SetSamplePositions(
+            args.num_samples_per_pixel, args.num_pixels,
+            (args.num_samples_per_pixel && args.num_pixels)
+                ? const_cast<D3D12_SAMPLE_POSITION*>(args.sample_positions)
+                : nullptr);
+      }
+    } break;
+    default:
+      assert_unhandled_case(header.command);
+      break;
   }
 }
 
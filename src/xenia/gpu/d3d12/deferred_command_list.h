@@ -37,9 +37,43 @@ class DeferredCommandList {
   DeferredCommandList(const D3D12CommandProcessor& command_processor,
                       size_t initial_size_bytes = MAX_SIZEOF_COMMANDLIST);
 
+  // A range of the command stream that can be executed on its own command
+  // list, with the commands required to set up the bindings, the pipeline and
+  // the render targets in effect at its beginning.
+  struct Segment {
+    // In uintmax_t elements.
+    size_t begin;
+    size_t end;
+    // Offsets of the state commands preceding the segment to replay on the
+    // command list first, in stream order.
+    std::vector<size_t> state_commands;
+  };
+
   void Reset();
   void Execute(ID3D12GraphicsCommandList* command_list,
                ID3D12GraphicsCommandList1* command_list_1);
+  // Splits the stream at render target changes into at most max_segment_count
+  // segments containing roughly the same number of draws, but no fewer than
+  // min_segment_draw_count. Returns one segment covering the whole stream if
+  // it's not worth splitting. The segments must be submitted in order in the
+  // same ExecuteCommandLists call, as barriers are only placed in the stream
+  // itself.
+  void Split(uint32_t max_segment_count, uint32_t min_segment_draw_count,
+             std::vector<Segment>& segments_out) const;
+  // May be called from multiple threads for different segments.
+  void ExecuteSegment(ID3D12GraphicsCommandList* command_list,
+                      ID3D12GraphicsCommandList1* command_list_1,
+                      const Segment& segment) const;
+
+  // In uintmax_t elements, for marking the beginning of the commands to move
+  // with MoveCommands.
+  size_t GetStreamPosition() const {
+    return command_stream_.size() / sizeof(uintmax_t);
+  }
+  // Moves the commands recorded since the stream position to the end of
+  // another list, for executing them on a different queue. The moved commands
+  // must not depend on the state set by the commands preceding them.
+  void MoveCommands(size_t begin, DeferredCommandList& target);
 
   D3D12_RECT* ClearDepthStencilViewAllocatedRects(
       D3D12_CPU_DESCRIPTOR_HANDLE depth_stencil_view,
@@ -56,6 +90,15 @@ class DeferredCommandList {
     return num_rects ? reinterpret_cast<D3D12_RECT*>(args + 1) : nullptr;
   }
 
+  void D3DBeginQuery(ID3D12QueryHeap* query_heap, D3D12_QUERY_TYPE type,
+                     UINT index) {
+    auto& args = *reinterpret_cast<D3DQueryArguments*>(
+        WriteCommand(Command::kD3DBeginQuery, sizeof(D3DQueryArguments)));
+    args.query_heap = query_heap;
+    args.type = type;
+    args.index = index;
+  }
+
   void D3DClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depth_stencil_view,
                                 D3D12_CLEAR_FLAGS clear_flags, FLOAT depth,
                                 UINT8 stencil, UINT num_rects,
@@ -183,6 +226,15 @@ class DeferredCommandList {
     args.start_instance_location = start_instance_location;
   }
 
+  void D3DEndQuery(ID3D12QueryHeap* query_heap, D3D12_QUERY_TYPE type,
+                   UINT index) {
+    auto& args = *reinterpret_cast<D3DQueryArguments*>(
+        WriteCommand(Command::kD3DEndQuery, sizeof(D3DQueryArguments)));
+    args.query_heap = query_heap;
+    args.type = type;
+    args.index = index;
+  }
+
   void D3DIASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) {
     auto& args = *reinterpret_cast<D3D12_INDEX_BUFFER_VIEW*>(WriteCommand(
         Command::kD3DIASetIndexBuffer, sizeof(D3D12_INDEX_BUFFER_VIEW)));
@@ -262,6 +314,21 @@ class DeferredCommandList {
     arg = stencil_ref;
   }
 
+  void D3DResolveQueryData(ID3D12QueryHeap* query_heap, D3D12_QUERY_TYPE type,
+                           UINT start_index, UINT num_queries,
+                           ID3D12Resource* destination_buffer,
+                           UINT64 aligned_destination_buffer_offset) {
+    auto& args = *reinterpret_cast<D3DResolveQueryDataArguments*>(
+        WriteCommand(Command::kD3DResolveQueryData,
+                     sizeof(D3DResolveQueryDataArguments)));
+    args.query_heap = query_heap;
+    args.type = type;
+    args.start_index = start_index;
+    args.num_queries = num_queries;
+    args.destination_buffer = destination_buffer;
+    args.aligned_destination_buffer_offset = aligned_destination_buffer_offset;
+  }
+
   void D3DResourceBarrier(UINT num_barriers,
                           const D3D12_RESOURCE_BARRIER* barriers) {
     if (num_barriers == 0) {
@@ -406,6 +473,7 @@ class DeferredCommandList {
 
  private:
   enum class Command {
+    kD3DBeginQuery,
     kD3DClearDepthStencilView,
     kD3DClearRenderTargetView,
     kD3DClearUnorderedAccessViewUint,
@@ -416,12 +484,14 @@ class DeferredCommandList {
     kD3DDispatch,
     kD3DDrawIndexedInstanced,
     kD3DDrawInstanced,
+    kD3DEndQuery,
     kD3DIASetIndexBuffer,
     kD3DIASetPrimitiveTopology,
     kD3DIASetVertexBuffers,
     kD3DOMSetBlendFactor,
     kD3DOMSetRenderTargets,
     kD3DOMSetStencilRef,
+    kD3DResolveQueryData,
     kD3DResourceBarrier,
     kRSSetScissorRect,
     kRSSetViewport,
@@ -446,6 +516,11 @@ class DeferredCommandList {
   static constexpr size_t kCommandHeaderSizeElements =
       (sizeof(CommandHeader) + sizeof(uintmax_t) - 1) / sizeof(uintmax_t);
 
+  void ExecuteCommand(ID3D12GraphicsCommandList* command_list,
+                      ID3D12GraphicsCommandList1* command_list_1,
+                      const CommandHeader& header, const uintmax_t* stream,
+                      ID3D12PipelineState*& current_pipeline_state) const;
+
   struct ClearDepthStencilViewHeader {
     D3D12_CPU_DESCRIPTOR_HANDLE depth_stencil_view;
     D3D12_CLEAR_FLAGS clear_flags;
@@ -520,6 +595,12 @@ class DeferredCommandList {
     UINT start_instance_location;
   };
 
+  struct D3DQueryArguments {
+    ID3D12QueryHeap* query_heap;
+    D3D12_QUERY_TYPE type;
+    UINT index;
+  };
+
   struct D3DIASetVertexBuffersHeader {
     UINT start_slot;
     UINT num_views;
@@ -534,6 +615,15 @@ class DeferredCommandList {
     D3D12_CPU_DESCRIPTOR_HANDLE depth_stencil_descriptor;
   };
 
+  struct D3DResolveQueryDataArguments {
+    ID3D12QueryHeap* query_heap;
+    D3D12_QUERY_TYPE type;
+    UINT start_index;
+    UINT num_queries;
+    ID3D12Resource* destination_buffer;
+    UINT64 aligned_destination_buffer_offset;
+  };
+
   struct SetRoot32BitConstantsHeader {
     UINT root_parameter_index;
     UINT num_32bit_values_to_set;
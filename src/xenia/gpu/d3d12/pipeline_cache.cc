@@ -17,6 +17,7 @@
 #include <deque>
 #include <mutex>
 #include <set>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -28,6 +29,7 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/string.h"
@@ -61,6 +63,14 @@ DEFINE_int32(
 DEFINE_bool(d3d12_tessellation_wireframe, false,
             "Display tessellated surfaces as wireframe for debugging.",
             "D3D12");
+DEFINE_bool(
+    d3d12_tessellation_pipeline_variants, true,
+    "When loading the pipeline storage, also create the pipelines for the "
+    "other tessellation modes supported by the primitive type for the stored "
+    "tessellated pipelines, to avoid stuttering when a game switches the "
+    "tessellation mode of a surface. The shader translations are shared "
+    "between the modes, so only the pipelines are created additionally.",
+    "D3D12");
 
 namespace xe {
 namespace gpu {
@@ -175,6 +185,26 @@ bool PipelineCache::Initialize() {
       creation_threads_.push_back(std::move(creation_thread));
     }
   }
+
+  if (cvars::parallel_shader_translation &&
+      !cvars::d3d12_dxbc_disasm_dxilconv && logical_processor_count > 1) {
+    translation_thread_translator_ = std::make_unique<DxbcShaderTranslator>(
+        provider.GetAdapterVendorID(), bindless_resources_used_,
+        render_target_cache_.GetPath() ==
+            RenderTargetCache::Path::kPixelShaderInterlock,
+        render_target_cache_.gamma_render_target_as_srgb(),
+        render_target_cache_.msaa_2x_supported(),
+        render_target_cache_.draw_resolution_scale_x(),
+        render_target_cache_.draw_resolution_scale_y(),
+        provider.GetGraphicsAnalysis() != nullptr);
+    translation_request_ = nullptr;
+    translation_request_completed_ = false;
+    translation_thread_shutdown_ = false;
+    translation_thread_ =
+        xe::threading::Thread::Create({}, [this]() { TranslationThread(); });
+    assert_not_null(translation_thread_);
+    translation_thread_->set_name("D3D12 Shader Translation");
+  }
   return true;
 }
 
@@ -193,6 +223,16 @@ void PipelineCache::Shutdown() {
     creation_threads_.clear();
   }
   creation_completion_event_.reset();
+  if (translation_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(translation_request_lock_);
+      translation_thread_shutdown_ = true;
+    }
+    translation_request_cond_.notify_all();
+    xe::threading::Wait(translation_thread_.get(), false);
+    translation_thread_.reset();
+  }
+  translation_thread_translator_.reset();
 
   // Shut down the persistent shader / pipeline storage.
   ShutdownShaderStorage();
@@ -268,6 +308,10 @@ void PipelineCache::InitializeShaderStorage(
         xe::path_to_utf8(pipeline_storage_file_path));
     return;
   }
+  // Unbuffered so every description is appended with a single write, not
+  // interleaved with the appends by other emulator instances using the same
+  // storage.
+  setvbuf(pipeline_storage_file_, nullptr, _IONBF, 0);
   pipeline_storage_file_flush_needed_ = false;
   // 'XEPS'.
   const uint32_t pipeline_storage_magic = 0x53504558;
@@ -333,6 +377,33 @@ void PipelineCache::InitializeShaderStorage(
                   .pixel_shader_modification);
         }
       }
+      // Remove the duplicate descriptions, such as ones appended by multiple
+      // emulator instances, rewriting them after the header (the file is
+      // opened for appending) - if interrupted, the file still contains only
+      // valid descriptions, though possibly not all of them.
+      std::unordered_set<uint64_t> pipeline_stored_hashes;
+      size_t pipeline_stored_unique_count = 0;
+      for (const PipelineStoredDescription& pipeline_stored_description :
+           pipeline_stored_descriptions) {
+        if (pipeline_stored_hashes
+                .insert(pipeline_stored_description.description_hash)
+                .second) {
+          pipeline_stored_descriptions[pipeline_stored_unique_count++] =
+              pipeline_stored_description;
+        }
+      }
+      if (pipeline_stored_unique_count < pipeline_stored_descriptions.size()) {
+        XELOGGPU("Removing {} duplicate pipeline descriptions from the storage",
+                 pipeline_stored_descriptions.size() -
+                     pipeline_stored_unique_count);
+        pipeline_stored_descriptions.resize(pipeline_stored_unique_count);
+        xe::filesystem::TruncateStdioFile(
+            pipeline_storage_file_,
+            uint64_t(sizeof(pipeline_storage_file_header)));
+        fwrite(pipeline_stored_descriptions.data(),
+               sizeof(PipelineStoredDescription),
+               pipeline_stored_descriptions.size(), pipeline_storage_file_);
+      }
     }
   }
 
@@ -347,16 +418,41 @@ void PipelineCache::InitializeShaderStorage(
       xe::Clock::QueryHostTickCount();
   auto shader_storage_file_path =
       shader_storage_shareable_root / fmt::format("{:08X}.xsh", title_id);
-  shader_storage_file_ =
-      xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
-  if (!shader_storage_file_) {
-    XELOGE(
-        "Failed to open the guest shader storage file for writing, persistent "
-        "shader storage will be disabled: {}",
-        xe::path_to_utf8(shader_storage_file_path));
-    fclose(pipeline_storage_file_);
-    pipeline_storage_file_ = nullptr;
-    return;
+  // Read the existing shaders through a mapping of the whole file rather than
+  // with a read call for every part of every shader. Done before opening the
+  // file for appending, so the file can be replaced by a compacted one.
+  std::unique_ptr<MappedMemory> shader_storage_mapping;
+  std::vector<uint8_t> shader_storage_read_buffer;
+  const uint8_t* shader_storage_data = nullptr;
+  size_t shader_storage_size = 0;
+  if (std::filesystem::exists(shader_storage_file_path)) {
+    shader_storage_mapping = MappedMemory::Open(shader_storage_file_path,
+                                                MappedMemory::Mode::kRead);
+    if (shader_storage_mapping) {
+      shader_storage_data = shader_storage_mapping->data();
+      shader_storage_size = shader_storage_mapping->size();
+    } else {
+      // Can't be mapped if empty, or on Windows, if another emulator instance
+      // has it open for writing.
+      FILE* shader_storage_read_file =
+          xe::filesystem::OpenFile(shader_storage_file_path, "rb");
+      if (shader_storage_read_file) {
+        xe::filesystem::Seek(shader_storage_read_file, 0, SEEK_END);
+        int64_t shader_storage_told_end =
+            xe::filesystem::Tell(shader_storage_read_file);
+        if (shader_storage_told_end > 0 &&
+            xe::filesystem::Seek(shader_storage_read_file, 0, SEEK_SET)) {
+          shader_storage_read_buffer.resize(size_t(shader_storage_told_end));
+          shader_storage_read_buffer.resize(
+              fread(shader_storage_read_buffer.data(), 1,
+                    shader_storage_read_buffer.size(),
+                    shader_storage_read_file));
+        }
+        fclose(shader_storage_read_file);
+      }
+      shader_storage_data = shader_storage_read_buffer.data();
+      shader_storage_size = shader_storage_read_buffer.size();
+    }
   }
   ++shader_storage_index_;
   shader_storage_file_flush_needed_ = false;
@@ -366,18 +462,29 @@ void PipelineCache::InitializeShaderStorage(
   } shader_storage_file_header;
   // 'XESH'.
   const uint32_t shader_storage_magic = 0x48534558;
-  if (fread(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
-            shader_storage_file_) &&
-      shader_storage_file_header.magic == shader_storage_magic &&
-      xe::byte_swap(shader_storage_file_header.version_swapped) ==
-          ShaderStoredHeader::kVersion) {
-    uint64_t shader_storage_valid_bytes = sizeof(shader_storage_file_header);
+  bool shader_storage_header_valid = false;
+  uint64_t shader_storage_valid_bytes = 0;
+  // Offsets and sizes of the shaders not stored in the file multiple times, for
+  // compacting it.
+  std::vector<std::pair<size_t, size_t>> shader_storage_unique_ranges;
+  uint64_t shader_storage_duplicate_bytes = 0;
+  if (shader_storage_size >= sizeof(shader_storage_file_header)) {
+    std::memcpy(&shader_storage_file_header, shader_storage_data,
+                sizeof(shader_storage_file_header));
+    shader_storage_header_valid =
+        shader_storage_file_header.magic == shader_storage_magic &&
+        xe::byte_swap(shader_storage_file_header.version_swapped) ==
+            ShaderStoredHeader::kVersion;
+  }
+  if (shader_storage_header_valid) {
+    shader_storage_valid_bytes = sizeof(shader_storage_file_header);
     // Load and translate shaders written by previous Xenia executions until the
     // end of the file or until a corrupted one is detected.
     ShaderStoredHeader shader_header;
     std::vector<uint32_t> ucode_dwords;
     ucode_dwords.reserve(0xFFFF);
     size_t shaders_translated = 0;
+    size_t shaders_analysis_loaded = 0;
 
     // Threads overlapping file reading.
     std::mutex shaders_translation_thread_mutex;
@@ -472,33 +579,52 @@ void PipelineCache::InitializeShaderStorage(
         shader_translation_threads;
 
     while (true) {
-      if (!fread(&shader_header, sizeof(shader_header), 1,
-                 shader_storage_file_)) {
+      size_t shader_offset = size_t(shader_storage_valid_bytes);
+      if (shader_storage_size - shader_offset < sizeof(shader_header)) {
         break;
       }
+      std::memcpy(&shader_header, shader_storage_data + shader_offset,
+                  sizeof(shader_header));
       size_t ucode_byte_count =
           shader_header.ucode_dword_count * sizeof(uint32_t);
-      ucode_dwords.resize(shader_header.ucode_dword_count);
-      if (shader_header.ucode_dword_count &&
-          !fread(ucode_dwords.data(), ucode_byte_count, 1,
-                 shader_storage_file_)) {
+      size_t shader_size = sizeof(shader_header) + ucode_byte_count +
+                           shader_header.ucode_analysis_size;
+      if (shader_storage_size - shader_offset < shader_size) {
         break;
       }
+      // Copied as the mapping is not aligned to dwords after the analysis
+      // data.
+      ucode_dwords.resize(shader_header.ucode_dword_count);
+      std::memcpy(ucode_dwords.data(),
+                  shader_storage_data + shader_offset + sizeof(shader_header),
+                  ucode_byte_count);
       uint64_t ucode_data_hash =
           XXH3_64bits(ucode_dwords.data(), ucode_byte_count);
       if (shader_header.ucode_data_hash != ucode_data_hash) {
         // Validation failed.
         break;
       }
-      shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count;
+      const uint8_t* ucode_analysis = shader_storage_data + shader_offset +
+                                      sizeof(shader_header) + ucode_byte_count;
+      shader_storage_valid_bytes += shader_size;
       D3D12Shader* shader =
           LoadShader(shader_header.type, ucode_dwords.data(),
                      shader_header.ucode_dword_count, ucode_data_hash);
       if (shader->ucode_storage_index() == shader_storage_index_) {
-        // Appeared twice in this file for some reason - skip, otherwise race
-        // condition will be caused by translating twice in parallel.
+        // Appeared twice in this file, such as if appended by multiple emulator
+        // instances - skip, otherwise race condition will be caused by
+        // translating twice in parallel, and drop when compacting.
+        shader_storage_duplicate_bytes += shader_size;
         continue;
       }
+      shader_storage_unique_ranges.emplace_back(shader_offset, shader_size);
+      // Skip the analysis on the translation threads if it has been stored by
+      // a compatible build, otherwise it will be done there as usual.
+      if (!shader->is_ucode_analyzed() && shader_header.ucode_analysis_size &&
+          shader->DeserializeUcodeAnalysis(ucode_analysis,
+                                           shader_header.ucode_analysis_size)) {
+        ++shaders_analysis_loaded;
+      }
       // Loaded from the current storage - don't write again.
       shader->set_ucode_storage_index(shader_storage_index_);
       // Create new threads if the currently existing threads can't keep up
@@ -549,11 +675,82 @@ void PipelineCache::InitializeShaderStorage(
         }
       }
     }
-    XELOGGPU("Translated {} shaders from the storage in {} milliseconds",
-             shaders_translated,
-             (xe::Clock::QueryHostTickCount() -
-              shader_storage_initialization_start) *
-                 1000 / xe::Clock::QueryHostTickFrequency());
+    XELOGGPU(
+        "Translated {} shaders ({} with the stored ucode analysis) from the "
+        "storage in {} milliseconds",
+        shaders_translated, shaders_analysis_loaded,
+        (xe::Clock::QueryHostTickCount() -
+         shader_storage_initialization_start) *
+            1000 / xe::Clock::QueryHostTickFrequency());
+  }
+
+  // Compact the file if it contains duplicate shaders, writing a new file and
+  // replacing the old one with it, so if interrupted, or if the file can't be
+  // replaced because another emulator instance is using it, the old one is
+  // kept.
+  if (shader_storage_duplicate_bytes) {
+    auto shader_storage_compacted_file_path = shader_storage_file_path;
+    shader_storage_compacted_file_path += ".tmp";
+    FILE* shader_storage_compacted_file =
+        xe::filesystem::OpenFile(shader_storage_compacted_file_path, "wb");
+    if (shader_storage_compacted_file) {
+      bool shader_storage_compacted_written =
+          fwrite(&shader_storage_file_header,
+                 sizeof(shader_storage_file_header), 1,
+                 shader_storage_compacted_file) != 0;
+      uint64_t shader_storage_compacted_bytes =
+          sizeof(shader_storage_file_header);
+      for (const std::pair<size_t, size_t>& shader_range :
+           shader_storage_unique_ranges) {
+        if (!shader_storage_compacted_written) {
+          break;
+        }
+        shader_storage_compacted_written =
+            fwrite(shader_storage_data + shader_range.first,
+                   shader_range.second, 1, shader_storage_compacted_file) != 0;
+        shader_storage_compacted_bytes += shader_range.second;
+      }
+      fclose(shader_storage_compacted_file);
+      // Must be unmapped to be replaced on Windows.
+      shader_storage_mapping.reset();
+      std::error_code error_code;
+      if (shader_storage_compacted_written) {
+        std::filesystem::rename(shader_storage_compacted_file_path,
+                                shader_storage_file_path, error_code);
+      }
+      if (shader_storage_compacted_written && !error_code) {
+        XELOGGPU(
+            "Compacted the shader storage, removing {} bytes of duplicate "
+            "shaders",
+            shader_storage_duplicate_bytes);
+        shader_storage_valid_bytes = shader_storage_compacted_bytes;
+      } else {
+        XELOGW("Failed to compact the shader storage file {}",
+               xe::path_to_utf8(shader_storage_file_path));
+        std::filesystem::remove(shader_storage_compacted_file_path,
+                                error_code);
+      }
+    }
+  }
+  shader_storage_mapping.reset();
+  shader_storage_read_buffer = std::vector<uint8_t>();
+
+  shader_storage_file_ =
+      xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
+  if (!shader_storage_file_) {
+    XELOGE(
+        "Failed to open the guest shader storage file for writing, persistent "
+        "shader storage will be disabled: {}",
+        xe::path_to_utf8(shader_storage_file_path));
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    return;
+  }
+  // Unbuffered so every shader is appended with a single write, not
+  // interleaved with the appends by other emulator instances using the same
+  // storage.
+  setvbuf(shader_storage_file_, nullptr, _IONBF, 0);
+  if (shader_storage_header_valid) {
     xe::filesystem::TruncateStdioFile(shader_storage_file_,
                                       shader_storage_valid_bytes);
   } else {
@@ -587,9 +784,56 @@ void PipelineCache::InitializeShaderStorage(
       creation_threads_.push_back(std::move(creation_thread));
     }
 
+    // The translated domain shaders don't depend on the tessellation mode, only
+    // the hull shader and, for adaptive tessellation, the vertex shader do.
+    std::vector<PipelineStoredDescription> tessellation_variant_descriptions;
+    if (cvars::d3d12_tessellation_pipeline_variants) {
+      for (const PipelineStoredDescription& pipeline_stored_description :
+           pipeline_stored_descriptions) {
+        const PipelineDescription& pipeline_description =
+            pipeline_stored_description.description;
+        Shader::HostVertexShaderType host_vertex_shader_type =
+            DxbcShaderTranslator::Modification(
+                pipeline_description.vertex_shader_modification)
+                .vertex.host_vertex_shader_type;
+        if (!Shader::IsHostVertexShaderTypeDomain(host_vertex_shader_type)) {
+          continue;
+        }
+        // Adaptive tessellation takes the factors from the index buffer, so
+        // it's only available for patch primitive types.
+        uint32_t tessellation_mode_count =
+            (host_vertex_shader_type ==
+                 Shader::HostVertexShaderType::kTriangleDomainPatchIndexed ||
+             host_vertex_shader_type ==
+                 Shader::HostVertexShaderType::kQuadDomainPatchIndexed)
+                ? uint32_t(xenos::TessellationMode::kAdaptive) + 1
+                : uint32_t(xenos::TessellationMode::kContinuous) + 1;
+        for (uint32_t i = 0; i < tessellation_mode_count; ++i) {
+          if (i == pipeline_description
+                       .primitive_topology_type_or_tessellation_mode) {
+            continue;
+          }
+          PipelineStoredDescription& variant_description =
+              tessellation_variant_descriptions.emplace_back(
+                  pipeline_stored_description);
+          variant_description.description
+              .primitive_topology_type_or_tessellation_mode = i;
+          variant_description.description_hash =
+              XXH3_64bits(&variant_description.description,
+                          sizeof(variant_description.description));
+        }
+      }
+    }
+
     size_t pipelines_created = 0;
-    for (const PipelineStoredDescription& pipeline_stored_description :
-         pipeline_stored_descriptions) {
+    size_t stored_pipeline_count = pipeline_stored_descriptions.size();
+    for (size_t i = 0;
+         i < stored_pipeline_count + tessellation_variant_descriptions.size();
+         ++i) {
+      const PipelineStoredDescription& pipeline_stored_description =
+          i < stored_pipeline_count
+              ? pipeline_stored_descriptions[i]
+              : tessellation_variant_descriptions[i - stored_pipeline_count];
       const PipelineDescription& pipeline_description =
           pipeline_stored_description.description;
       // TODO(Triang3l): On Vulkan, skip pipelines requiring unsupported device
@@ -838,6 +1082,14 @@ bool PipelineCache::IsCreatingPipelines() {
   return !creation_queue_.empty() || creation_threads_busy_ != 0;
 }
 
+uint32_t PipelineCache::GetPendingPipelineCount() {
+  if (creation_threads_.empty()) {
+    return 0;
+  }
+  std::lock_guard<xe_mutex> lock(creation_request_lock_);
+  return uint32_t(creation_queue_.size() + creation_threads_busy_);
+}
+
 D3D12Shader* PipelineCache::LoadShader(xenos::ShaderType shader_type,
                                        const uint32_t* host_address,
                                        uint32_t dword_count) {
@@ -981,12 +1233,39 @@ bool PipelineCache::ConfigurePipeline(
               register_file_.Get<reg::SQ_PROGRAM_CNTL>().vs_export_mode !=
                   xenos::VertexShaderExportMode::kPosition2VectorsEdgeKill);
   assert_false(register_file_.Get<reg::SQ_PROGRAM_CNTL>().gen_index_vtx);
-  if (!vertex_shader->is_translated()) {
+  bool vertex_shader_translation_needed = !vertex_shader->is_translated();
+  bool pixel_shader_translation_needed =
+      pixel_shader != nullptr && !pixel_shader->is_translated();
+  bool pixel_shader_translating_on_thread = false;
+  if (vertex_shader_translation_needed && pixel_shader_translation_needed &&
+      translation_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(translation_request_lock_);
+      translation_request_ = pixel_shader;
+      translation_request_completed_ = false;
+    }
+    translation_request_cond_.notify_all();
+    pixel_shader_translating_on_thread = true;
+  }
+  bool vertex_shader_translated = true;
+  if (vertex_shader_translation_needed) {
     if (!vertex_shader->shader().is_ucode_analyzed()) {
       vertex_shader->shader().AnalyzeUcode(ucode_disasm_buffer_);
     }
-    if (!TranslateAnalyzedShader(*shader_translator_, *vertex_shader,
-                                 dxbc_converter_, dxc_utils_, dxc_compiler_)) {
+    vertex_shader_translated =
+        TranslateAnalyzedShader(*shader_translator_, *vertex_shader,
+                                dxbc_converter_, dxc_utils_, dxc_compiler_);
+  }
+  bool pixel_shader_translated = true;
+  if (pixel_shader_translating_on_thread) {
+    std::unique_lock<std::mutex> lock(translation_request_lock_);
+    while (!translation_request_completed_) {
+      translation_request_cond_.wait(lock);
+    }
+    pixel_shader_translated = translation_request_result_;
+  }
+  if (vertex_shader_translation_needed) {
+    if (!vertex_shader_translated) {
       XELOGE("Failed to translate the vertex shader!");
       return false;
     }
@@ -1007,13 +1286,16 @@ bool PipelineCache::ConfigurePipeline(
     return false;
   }
   if (pixel_shader != nullptr) {
-    if (!pixel_shader->is_translated()) {
-      if (!pixel_shader->shader().is_ucode_analyzed()) {
-        pixel_shader->shader().AnalyzeUcode(ucode_disasm_buffer_);
+    if (pixel_shader_translation_needed) {
+      if (!pixel_shader_translating_on_thread) {
+        if (!pixel_shader->shader().is_ucode_analyzed()) {
+          pixel_shader->shader().AnalyzeUcode(ucode_disasm_buffer_);
+        }
+        pixel_shader_translated =
+            TranslateAnalyzedShader(*shader_translator_, *pixel_shader,
+                                    dxbc_converter_, dxc_utils_, dxc_compiler_);
       }
-      if (!TranslateAnalyzedShader(*shader_translator_, *pixel_shader,
-                                   dxbc_converter_, dxc_utils_,
-                                   dxc_compiler_)) {
+      if (!pixel_shader_translated) {
         XELOGE("Failed to translate the pixel shader!");
         return false;
       }
@@ -1046,6 +1328,7 @@ bool PipelineCache::ConfigurePipeline(
   }
   PipelineDescription& description = runtime_description.description;
 
+  ++pipeline_lookup_count_;
   if (current_pipeline_ != nullptr &&
       current_pipeline_->description.description == description) {
     *pipeline_handle_out = current_pipeline_;
@@ -1066,6 +1349,7 @@ bool PipelineCache::ConfigurePipeline(
     }
   }
 
+  ++pipeline_miss_count_;
   Pipeline* new_pipeline = new Pipeline;
   new_pipeline->state = nullptr;
   std::memcpy(&new_pipeline->description, &runtime_description,
@@ -1105,6 +1389,35 @@ bool PipelineCache::ConfigurePipeline(
   return true;
 }
 
+void PipelineCache::TranslationThread() {
+  while (true) {
+    D3D12Shader::D3D12Translation* translation;
+    {
+      std::unique_lock<std::mutex> lock(translation_request_lock_);
+      while (!translation_request_ && !translation_thread_shutdown_) {
+        translation_request_cond_.wait(lock);
+      }
+      if (!translation_request_) {
+        return;
+      }
+      translation = translation_request_;
+    }
+    if (!translation->shader().is_ucode_analyzed()) {
+      translation->shader().AnalyzeUcode(
+          translation_thread_ucode_disasm_buffer_);
+    }
+    bool translated =
+        TranslateAnalyzedShader(*translation_thread_translator_, *translation);
+    {
+      std::lock_guard<std::mutex> lock(translation_request_lock_);
+      translation_request_ = nullptr;
+      translation_request_result_ = translated;
+      translation_request_completed_ = true;
+    }
+    translation_request_cond_.notify_all();
+  }
+}
+
 bool PipelineCache::TranslateAnalyzedShader(
     DxbcShaderTranslator& translator,
     D3D12Shader::D3D12Translation& translation, IDxbcConverter* dxbc_converter,
@@ -3225,6 +3538,7 @@ ID3D12PipelineState* PipelineCache::CreateD3D12Pipeline(
         runtime_description.vertex_shader->shader().ucode_data_hash());
   }
   state->SetName(name.c_str());
+  created_pipeline_count_.fetch_add(1, std::memory_order_relaxed);
   return state;
 }
 
@@ -3235,6 +3549,8 @@ void PipelineCache::StorageWriteThread() {
 
   std::vector<uint32_t> ucode_guest_endian;
   ucode_guest_endian.reserve(0xFFFF);
+  std::vector<uint8_t> ucode_analysis;
+  std::vector<uint8_t> shader_record;
 
   bool flush_shaders = false;
   bool flush_pipelines = false;
@@ -3286,18 +3602,33 @@ void PipelineCache::StorageWriteThread() {
       shader_header.ucode_data_hash = shader->ucode_data_hash();
       shader_header.ucode_dword_count = shader->ucode_dword_count();
       shader_header.type = shader->type();
+      // Shaders are queued for writing after being analyzed, and the analysis
+      // results aren't modified afterwards.
+      ucode_analysis.clear();
+      if (shader->is_ucode_analyzed()) {
+        shader->SerializeUcodeAnalysis(ucode_analysis);
+      }
+      shader_header.ucode_analysis_size = uint32_t(ucode_analysis.size());
+      // Written with a single call so the shaders appended by multiple
+      // emulator instances are not interleaved.
+      size_t ucode_byte_count =
+          shader_header.ucode_dword_count * sizeof(uint32_t);
+      shader_record.resize(sizeof(shader_header) + ucode_byte_count +
+                           shader_header.ucode_analysis_size);
+      std::memcpy(shader_record.data(), &shader_header, sizeof(shader_header));
+      // Need to swap because the hash is calculated for the shader with guest
+      // endianness.
+      ucode_guest_endian.resize(shader_header.ucode_dword_count);
+      xe::copy_and_swap(ucode_guest_endian.data(), shader->ucode_dwords(),
+                        shader_header.ucode_dword_count);
+      std::memcpy(shader_record.data() + sizeof(shader_header),
+                  ucode_guest_endian.data(), ucode_byte_count);
+      std::memcpy(
+          shader_record.data() + sizeof(shader_header) + ucode_byte_count,
+          ucode_analysis.data(), shader_header.ucode_analysis_size);
       assert_not_null(shader_storage_file_);
-      fwrite(&shader_header, sizeof(shader_header), 1, shader_storage_file_);
-      if (shader_header.ucode_dword_count) {
-        ucode_guest_endian.resize(shader_header.ucode_dword_count);
-        // Need to swap because the hash is calculated for the shader with guest
-        // endianness.
-        xe::copy_and_swap(ucode_guest_endian.data(), shader->ucode_dwords(),
-                          shader_header.ucode_dword_count);
-        fwrite(ucode_guest_endian.data(),
-               shader_header.ucode_dword_count * sizeof(uint32_t), 1,
-               shader_storage_file_);
-      }
+      fwrite(shader_record.data(), shader_record.size(), 1,
+             shader_storage_file_);
     }
 
     if (write_pipeline) {
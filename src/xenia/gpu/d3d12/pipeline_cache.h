@@ -10,6 +10,7 @@
 #ifndef XENIA_GPU_D3D12_PIPELINE_CACHE_H_
 #define XENIA_GPU_D3D12_PIPELINE_CACHE_H_
 
+#include <atomic>
 #include <condition_variable>
 #include <cstdio>
 #include <deque>
@@ -66,6 +67,12 @@ class PipelineCache {
 
   void EndSubmission();
   bool IsCreatingPipelines();
+  // Pipelines queued or being created by the creation threads.
+  uint32_t GetPendingPipelineCount();
+  // Pipelines created since the cache was set up, by any thread.
+  uint64_t created_pipeline_count() const {
+    return created_pipeline_count_.load(std::memory_order_relaxed);
+  }
 
   D3D12Shader* LoadShader(xenos::ShaderType shader_type,
                           const uint32_t* host_address, uint32_t dword_count);
@@ -104,6 +111,15 @@ class PipelineCache {
     return reinterpret_cast<const Pipeline*>(handle)->state;
   }
 
+  // Pipeline lookups, and those that needed a new pipeline to be created, since
+  // the last reset, for benchmarking.
+  uint32_t pipeline_lookup_count() const { return pipeline_lookup_count_; }
+  uint32_t pipeline_miss_count() const { return pipeline_miss_count_; }
+  void ResetPipelineLookupCounts() {
+    pipeline_lookup_count_ = 0;
+    pipeline_miss_count_ = 0;
+  }
+
  private:
   XEPACKEDSTRUCT(ShaderStoredHeader, {
     uint64_t ucode_data_hash;
@@ -111,7 +127,11 @@ class PipelineCache {
     uint32_t ucode_dword_count : 31;
     xenos::ShaderType type : 1;
 
-    static constexpr uint32_t kVersion = 0x20201219;
+    // Size of the Shader::SerializeUcodeAnalysis data following the ucode, or
+    // 0 if not stored.
+    uint32_t ucode_analysis_size;
+
+    static constexpr uint32_t kVersion = 0x20241016;
   });
 
   // Update PipelineDescription::kVersion if any of the Pipeline* enums are
@@ -322,6 +342,22 @@ class PipelineCache {
   IDxcUtils* dxc_utils_ = nullptr;
   IDxcCompiler* dxc_compiler_ = nullptr;
 
+  // Thread translating the pixel shader in parallel with the vertex shader
+  // translated on the command processor thread if both are new, with its own
+  // translator and disassembly buffer. Not used if DXIL disassembly is enabled.
+  void TranslationThread();
+  std::unique_ptr<xe::threading::Thread> translation_thread_;
+  StringBuffer translation_thread_ucode_disasm_buffer_;
+  std::unique_ptr<DxbcShaderTranslator> translation_thread_translator_;
+  std::mutex translation_request_lock_;
+  std::condition_variable translation_request_cond_;
+  // Protected with translation_request_lock_, notify_all
+  // translation_request_cond_ when changed.
+  D3D12Shader::D3D12Translation* translation_request_ = nullptr;
+  bool translation_request_completed_ = false;
+  bool translation_request_result_ = false;
+  bool translation_thread_shutdown_ = false;
+
   // Ucode hash -> shader.
   std::unordered_map<uint64_t, D3D12Shader*, xe::hash::IdentityHasher<uint64_t>>
       shaders_;
@@ -372,6 +408,10 @@ class PipelineCache {
   // changed.
   Pipeline* current_pipeline_ = nullptr;
 
+  uint32_t pipeline_lookup_count_ = 0;
+  uint32_t pipeline_miss_count_ = 0;
+  std::atomic<uint64_t> created_pipeline_count_ = {0};
+
   // Currently open shader storage path.
   std::filesystem::path shader_storage_cache_root_;
   uint32_t shader_storage_title_id_ = 0;
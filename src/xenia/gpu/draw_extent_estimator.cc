@@ -16,6 +16,7 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/ucode.h"
 #include "xenia/gpu/xenos.h"
@@ -164,12 +165,11 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
         float(regs.Get<reg::PA_SU_POINT_SIZE>().height) * (1.0f / 16.0f);
   }
 
-  float max_y = -FLT_MAX;
-
-  shader_interpreter_.SetShader(vertex_shader);
-
-  PositionYExportSink position_y_export_sink;
-  shader_interpreter_.SetExportSink(&position_y_export_sink);
+  // Gather the vertices to process.
+  unique_vertex_indices_.clear();
+  if (vertex_index_bitmap_.empty()) {
+    vertex_index_bitmap_.resize(size_t(1) << (24 - 6));
+  }
   for (uint32_t i = 0; i < vgt_draw_initiator.num_indices; ++i) {
     uint32_t vertex_index;
     if (vgt_draw_initiator.source_select == xenos::SourceSelect::kDMA) {
@@ -195,7 +195,75 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
     vertex_index =
         std::min(max_index,
                  std::max(min_index, (vertex_index + index_offset) & 0xFFFFFF));
+    uint64_t& vertex_index_bitmap_entry =
+        vertex_index_bitmap_[vertex_index >> 6];
+    uint64_t vertex_index_bit = UINT64_C(1) << (vertex_index & 63);
+    if (vertex_index_bitmap_entry & vertex_index_bit) {
+      continue;
+    }
+    vertex_index_bitmap_entry |= vertex_index_bit;
+    unique_vertex_indices_.push_back(vertex_index);
+  }
+  for (uint32_t vertex_index : unique_vertex_indices_) {
+    vertex_index_bitmap_[vertex_index >> 6] = 0;
+  }
 
+  uint64_t cache_key;
+  bool use_cache = GetVertexMaxYCacheKey(
+      vertex_shader, vgt_draw_initiator.prim_type, pa_cl_vte_cntl.vtx_xy_fmt,
+      viewport_y_scale, viewport_y_offset, point_vertex_min_diameter_float,
+      point_vertex_max_diameter_float, point_constant_radius_y, cache_key);
+  auto cache_it = use_cache ? vertex_max_y_cache_.find(cache_key)
+                            : vertex_max_y_cache_.end();
+  float max_y;
+  if (cache_it != vertex_max_y_cache_.end()) {
+    max_y = cache_it->second;
+  } else {
+    max_y = ExecuteVertexMaxY(
+        vertex_shader, vgt_draw_initiator.prim_type, pa_cl_vte_cntl.vtx_xy_fmt,
+        viewport_y_scale, viewport_y_offset, point_vertex_min_diameter_float,
+        point_vertex_max_diameter_float, point_constant_radius_y);
+    if (use_cache) {
+      if (vertex_max_y_cache_.size() >= kVertexMaxYCacheMaxEntries) {
+        vertex_max_y_cache_.clear();
+      }
+      vertex_max_y_cache_.emplace(cache_key, max_y);
+    }
+  }
+
+  int32_t max_y_24p8 = ui::FloatToD3D11Fixed16p8(max_y);
+  // 16p8 range is -32768 to 32767+255/256, but it's stored as uint32_t here,
+  // as 24p8, so overflowing up to -8388608 to 8388608+255/256 is safe. The
+  // range of the window offset plus the half-pixel offset is -16384 to 16384.5,
+  // so it's safe to add both - adding it will neither move the 16p8 clamping
+  // bounds -32768 and 32767+255/256 into the 0...8192 screen space range, nor
+  // cause 24p8 overflow.
+  if (!regs.Get<reg::PA_SU_VTX_CNTL>().pix_center) {
+    max_y_24p8 += 128;
+  }
+  if (pa_su_sc_mode_cntl.vtx_window_offset_enable) {
+    max_y_24p8 += regs.Get<reg::PA_SC_WINDOW_OFFSET>().window_y_offset * 256;
+  }
+  // Top-left rule - .5 exclusive without MSAA, 1. exclusive with MSAA.
+  auto rb_surface_info = regs.Get<reg::RB_SURFACE_INFO>();
+  return (uint32_t(std::max(int32_t(0), max_y_24p8)) +
+          ((rb_surface_info.msaa_samples == xenos::MsaaSamples::k1X) ? 127
+                                                                     : 255)) >>
+         8;
+}
+
+float DrawExtentEstimator::ExecuteVertexMaxY(
+    const Shader& vertex_shader, xenos::PrimitiveType primitive_type,
+    bool vtx_xy_fmt, float viewport_y_scale, float viewport_y_offset,
+    int32_t point_vertex_min_diameter_float,
+    int32_t point_vertex_max_diameter_float, float point_constant_radius_y) {
+  float max_y = -FLT_MAX;
+
+  shader_interpreter_.SetShader(vertex_shader);
+
+  PositionYExportSink position_y_export_sink;
+  shader_interpreter_.SetExportSink(&position_y_export_sink);
+  for (uint32_t vertex_index : unique_vertex_indices_) {
     position_y_export_sink.Reset();
 
     shader_interpreter_.temp_registers()[0] = float(vertex_index);
@@ -209,7 +277,7 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
       continue;
     }
     float vertex_y = position_y_export_sink.position_y().value();
-    if (!pa_cl_vte_cntl.vtx_xy_fmt) {
+    if (!vtx_xy_fmt) {
       if (!position_y_export_sink.position_w().has_value()) {
         continue;
       }
@@ -218,7 +286,7 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
 
     vertex_y = vertex_y * viewport_y_scale + viewport_y_offset;
 
-    if (vgt_draw_initiator.prim_type == xenos::PrimitiveType::kPointList) {
+    if (primitive_type == xenos::PrimitiveType::kPointList) {
       float point_radius_y;
       if (position_y_export_sink.point_size().has_value()) {
         // Vertex-specified diameter. Clamped effectively as a signed integer in
@@ -243,25 +311,68 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
   }
   shader_interpreter_.SetExportSink(nullptr);
 
-  int32_t max_y_24p8 = ui::FloatToD3D11Fixed16p8(max_y);
-  // 16p8 range is -32768 to 32767+255/256, but it's stored as uint32_t here,
-  // as 24p8, so overflowing up to -8388608 to 8388608+255/256 is safe. The
-  // range of the window offset plus the half-pixel offset is -16384 to 16384.5,
-  // so it's safe to add both - adding it will neither move the 16p8 clamping
-  // bounds -32768 and 32767+255/256 into the 0...8192 screen space range, nor
-  // cause 24p8 overflow.
-  if (!regs.Get<reg::PA_SU_VTX_CNTL>().pix_center) {
-    max_y_24p8 += 128;
+  return max_y;
+}
+
+bool DrawExtentEstimator::GetVertexMaxYCacheKey(
+    const Shader& vertex_shader, xenos::PrimitiveType primitive_type,
+    bool vtx_xy_fmt, float viewport_y_scale, float viewport_y_offset,
+    int32_t point_vertex_min_diameter_float,
+    int32_t point_vertex_max_diameter_float, float point_constant_radius_y,
+    uint64_t& key_out) const {
+  // The memory reads done by the shader must be recorded in traces.
+  if (trace_writer_ && trace_writer_->is_open()) {
+    return false;
   }
-  if (pa_su_sc_mode_cntl.vtx_window_offset_enable) {
-    max_y_24p8 += regs.Get<reg::PA_SC_WINDOW_OFFSET>().window_y_offset * 256;
+
+  const RegisterFile& regs = register_file_;
+
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+  auto hash_value = [&hash_state](const auto& value) {
+    XXH3_64bits_update(&hash_state, &value, sizeof(value));
+  };
+  hash_value(vertex_shader.ucode_data_hash());
+  hash_value(primitive_type);
+  hash_value(vtx_xy_fmt);
+  hash_value(viewport_y_scale);
+  hash_value(viewport_y_offset);
+  if (primitive_type == xenos::PrimitiveType::kPointList) {
+    hash_value(point_vertex_min_diameter_float);
+    hash_value(point_vertex_max_diameter_float);
+    hash_value(point_constant_radius_y);
   }
-  // Top-left rule - .5 exclusive without MSAA, 1. exclusive with MSAA.
-  auto rb_surface_info = regs.Get<reg::RB_SURFACE_INFO>();
-  return (uint32_t(std::max(int32_t(0), max_y_24p8)) +
-          ((rb_surface_info.msaa_samples == xenos::MsaaSamples::k1X) ? 127
-                                                                     : 255)) >>
-         8;
+  XXH3_64bits_update(&hash_state, unique_vertex_indices_.data(),
+                     sizeof(uint32_t) * unique_vertex_indices_.size());
+  // All the vertex shader float constants, the bool constants and the loop
+  // constants, as they may be accessed with relative addressing.
+  XXH3_64bits_update(&hash_state,
+                     &regs[XE_GPU_REG_SHADER_CONSTANT_000_X].u32,
+                     sizeof(uint32_t) * 4 * 256);
+  XXH3_64bits_update(&hash_state,
+                     &regs[XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031].u32,
+                     sizeof(uint32_t) * (8 + 32));
+  // The interpreter only reads the vertex data within the buffer ranges
+  // specified in the fetch constants.
+  uint32_t vertex_data_size = 0;
+  const uint32_t* memory_dwords =
+      reinterpret_cast<const uint32_t*>(memory_.physical_membase());
+  for (const Shader::VertexBinding& vertex_binding :
+       vertex_shader.vertex_bindings()) {
+    auto vertex_fetch = regs.Get<xenos::xe_gpu_vertex_fetch_t>(
+        XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 +
+        vertex_binding.fetch_constant * 2);
+    hash_value(vertex_fetch.dword_0);
+    hash_value(vertex_fetch.dword_1);
+    vertex_data_size += sizeof(uint32_t) * vertex_fetch.size;
+    if (vertex_data_size > kVertexMaxYCacheMaxVertexDataSize) {
+      return false;
+    }
+    XXH3_64bits_update(&hash_state, memory_dwords + vertex_fetch.address,
+                       sizeof(uint32_t) * vertex_fetch.size);
+  }
+  key_out = XXH3_64bits_digest(&hash_state);
+  return true;
 }
 
 uint32_t DrawExtentEstimator::EstimateMaxY(bool try_to_estimate_vertex_max_y,
@@ -12,7 +12,10 @@
 
 #include <cstdint>
 #include <optional>
+#include <unordered_map>
+#include <vector>
 
+#include "xenia/base/hash.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/shader.h"
 #include "xenia/gpu/shader_interpreter.h"
@@ -63,11 +66,50 @@ class DrawExtentEstimator {
     std::optional<uint32_t> vertex_kill_;
   };
 
+  // Vertex data larger than this is not hashed for the vertex maximum Y cache,
+  // as hashing it would take a considerable portion of the time of executing
+  // the shader for the vertices.
+  static constexpr uint32_t kVertexMaxYCacheMaxVertexDataSize = UINT32_C(1)
+                                                                << 22;
+  static constexpr size_t kVertexMaxYCacheMaxEntries = 4096;
+
+  // Executes the shader for unique_vertex_indices_.
+  float ExecuteVertexMaxY(const Shader& vertex_shader,
+                          xenos::PrimitiveType primitive_type, bool vtx_xy_fmt,
+                          float viewport_y_scale, float viewport_y_offset,
+                          int32_t point_vertex_min_diameter_float,
+                          int32_t point_vertex_max_diameter_float,
+                          float point_constant_radius_y);
+  // Returns false if the result shouldn't be cached.
+  bool GetVertexMaxYCacheKey(const Shader& vertex_shader,
+                             xenos::PrimitiveType primitive_type,
+                             bool vtx_xy_fmt, float viewport_y_scale,
+                             float viewport_y_offset,
+                             int32_t point_vertex_min_diameter_float,
+                             int32_t point_vertex_max_diameter_float,
+                             float point_constant_radius_y,
+                             uint64_t& key_out) const;
+
   const RegisterFile& register_file_;
   const Memory& memory_;
   TraceWriter* trace_writer_;
 
   ShaderInterpreter shader_interpreter_;
+
+  // Vertices referenced by the current draw, each only once, as with indexed
+  // draws, the same vertex is usually used by multiple primitives, and the
+  // vertex shader result only depends on the index.
+  std::vector<uint32_t> unique_vertex_indices_;
+  // Bits for all 24-bit vertex indices, only set while gathering the unique
+  // vertices, allocated on the first use.
+  std::vector<uint64_t> vertex_index_bitmap_;
+
+  // Maximum post-transform vertex Y coordinates of previous draws, keyed by
+  // the hash of the shader and all the data involved in calculating the
+  // maximum, as the same draws (clears, full-screen passes) are usually
+  // repeated every frame with the same constants and vertices.
+  std::unordered_map<uint64_t, float, xe::hash::IdentityHasher<uint64_t>>
+      vertex_max_y_cache_;
 };
 
 }  // namespace gpu
@@ -0,0 +1,120 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/draw_resolution_scale_controller.h"
+
+#include <algorithm>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/device_profile.h"
+#include "xenia/base/logging.h"
+
+DEFINE_bool(draw_resolution_scale_dynamic, false,
+            "Lower the draw resolution scale at runtime, down to 1x, if the "
+            "GPU time of the frames exceeds draw_resolution_scale_dynamic_"
+            "target_ms, and raise it back up to draw_resolution_scale_x/y "
+            "when it's expected to fit. Changing the scale recreates the GPU "
+            "emulation resources, causing a short hitch.",
+            "GPU");
+DEFINE_double(draw_resolution_scale_dynamic_target_ms, 16.0,
+              "With draw_resolution_scale_dynamic, the GPU time of a frame to "
+              "stay below.",
+              "GPU");
+
+DECLARE_bool(thermal_throttling);
+
+namespace xe {
+namespace gpu {
+
+namespace {
+// The scale is decided from the average GPU time of this many frames.
+constexpr uint32_t kMeasurementFrameCount = 60;
+// Frames to ignore after a change, rendered or still being completed with the
+// previous scale, or reloading the data.
+constexpr uint32_t kSettleFrameCount = 120;
+// Raise the scale only if the predicted frame time is below this fraction of
+// the target, to avoid oscillating between two scales.
+constexpr double kRaiseHeadroom = 0.8;
+}  // namespace
+
+bool DrawResolutionScaleController::IsDynamicScaleRequested() {
+  return cvars::draw_resolution_scale_dynamic;
+}
+
+void DrawResolutionScaleController::Apply(uint32_t& scale_x,
+                                          uint32_t& scale_y) {
+  if (!is_enabled()) {
+    return;
+  }
+  if (!max_scale_) {
+    max_scale_ = std::max(scale_x, scale_y);
+    scale_ = max_scale_;
+    frames_until_measurement_ = kSettleFrameCount;
+  }
+  scale_x = std::min(scale_x, scale_);
+  scale_y = std::min(scale_y, scale_);
+}
+
+bool DrawResolutionScaleController::EndFrame() {
+  if (!is_enabled() || max_scale_ <= 1) {
+    return false;
+  }
+  if (frames_until_measurement_) {
+    --frames_until_measurement_;
+    gpu_time_ns_ = 0;
+    frame_count_ = 0;
+    return false;
+  }
+  if (++frame_count_ < kMeasurementFrameCount) {
+    return false;
+  }
+  double frame_time_ms = double(gpu_time_ns_) / double(frame_count_) * 1.0e-6;
+  gpu_time_ns_ = 0;
+  frame_count_ = 0;
+  if (!frame_time_ms) {
+    // No timestamps - the GPU time is not measurable.
+    return false;
+  }
+  double target_ms = cvars::draw_resolution_scale_dynamic_target_ms;
+  // Reducing the GPU work before the OS throttles the device, and not raising
+  // the scale until it has cooled down.
+  device_profile::ThermalStatus thermal_status =
+      cvars::thermal_throttling ? device_profile::GetThermalStatus()
+                                : device_profile::ThermalStatus::kNone;
+  uint32_t new_scale = scale_;
+  if (frame_time_ms > target_ms ||
+      thermal_status >= device_profile::ThermalStatus::kSevere) {
+    if (scale_ > 1) {
+      new_scale = scale_ - 1;
+    }
+  } else if (scale_ < max_scale_ &&
+             thermal_status < device_profile::ThermalStatus::kModerate) {
+    // Pessimistically assuming that all the GPU time is proportional to the
+    // pixel count.
+    double scale_next_ratio = double(scale_ + 1) / double(scale_);
+    if (frame_time_ms * scale_next_ratio * scale_next_ratio <
+        target_ms * kRaiseHeadroom) {
+      new_scale = scale_ + 1;
+    }
+  }
+  if (new_scale == scale_) {
+    return false;
+  }
+  XELOGI(
+      "Changing the draw resolution scale from {}x to {}x, the average GPU "
+      "frame time is {:.2f} ms with the target of {:.2f} ms, the host thermal "
+      "status is {}",
+      scale_, new_scale, frame_time_ms, target_ms, uint32_t(thermal_status));
+  scale_ = new_scale;
+  frames_until_measurement_ = kSettleFrameCount;
+  return true;
+}
+
+}  // namespace gpu
+}  // namespace xe
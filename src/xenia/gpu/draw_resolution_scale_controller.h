@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_DRAW_RESOLUTION_SCALE_CONTROLLER_H_
+#define XENIA_GPU_DRAW_RESOLUTION_SCALE_CONTROLLER_H_
+
+#include <cstdint>
+
+namespace xe {
+namespace gpu {
+
+// Chooses the draw resolution scale at runtime
+// (--draw_resolution_scale_dynamic) from the GPU time of the frames measured
+// with timestamp queries, stepping it by 1 along both axes between 1 and the
+// configured scale, so heavy scenes keep the target frame time while light
+// scenes are rendered at the full scale.
+//
+// The scale is baked into the texture cache, the render target cache, the
+// shared memory and the translated shaders, so the command processor applies a
+// new scale by recreating its context between command buffers, with all the
+// render target and texture data reloaded from the guest memory. To make that
+// rare, the decision is made from the average of many frames, and the frames
+// right after a change are not considered.
+class DrawResolutionScaleController {
+ public:
+  static bool IsDynamicScaleRequested();
+
+  bool is_enabled() const { return IsDynamicScaleRequested(); }
+
+  // Limits the scale obtained from the configuration (and clamped to the
+  // supported range) to the current dynamic scale.
+  void Apply(uint32_t& scale_x, uint32_t& scale_y);
+
+  // Accumulates the GPU time of a completed submission.
+  void AddSubmissionGpuTime(uint64_t gpu_time_ns) {
+    gpu_time_ns_ += gpu_time_ns;
+  }
+  // Call at the end of each guest frame, returns true if the scale should be
+  // changed and the context should be recreated.
+  bool EndFrame();
+
+ private:
+  // 0 if not initialized from the configuration yet.
+  uint32_t max_scale_ = 0;
+  uint32_t scale_ = 0;
+  uint64_t gpu_time_ns_ = 0;
+  uint32_t frame_count_ = 0;
+  uint32_t frames_until_measurement_ = 0;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_DRAW_RESOLUTION_SCALE_CONTROLLER_H_
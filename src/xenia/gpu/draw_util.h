@@ -680,6 +680,20 @@ struct ResolveInfo {
     pitch_out = edram_info.pitch_tiles;
   }
 
+  // Whether the copy is done without any conversion of the EDRAM data other
+  // than tiling - depth, or a single sample of a color format bitwise
+  // equivalent to the destination format without exponent bias - using the
+  // kFast* shaders.
+  bool IsCopyBitwise() const {
+    return IsCopyingDepth() ||
+           (!copy_dest_info.copy_dest_exp_bias &&
+            xenos::IsSingleCopySampleSelected(
+                copy_dest_coordinate_info.copy_sample_select) &&
+            xenos::IsColorResolveFormatBitwiseEquivalent(
+                xenos::ColorRenderTargetFormat(color_edram_info.format),
+                xenos::ColorFormat(copy_dest_info.copy_dest_format)));
+  }
+
   ResolveCopyShaderIndex GetCopyShader(
       uint32_t draw_resolution_scale_x, uint32_t draw_resolution_scale_y,
       ResolveCopyShaderConstants& constants_out, uint32_t& group_count_x_out,
@@ -932,8 +932,9 @@ void DxbcShaderTranslator::StartTranslation() {
     StartPixelShader();
   }
 
-  // If not translating anything, don't start the main loop.
-  if (is_depth_only_pixel_shader_) {
+  // If not translating anything, don't start the main loop. Structured control
+  // flow doesn't need it either.
+  if (is_depth_only_pixel_shader_ || is_control_flow_structured()) {
     return;
   }
 
@@ -1072,16 +1073,18 @@ void DxbcShaderTranslator::CompleteShaderCode() {
     // Close the last exec, there's nothing to merge it with anymore, and we're
     // closing upper-level flow control blocks.
     CloseExecConditionals();
-    // Close the last label and the switch.
-    if (UseSwitchForControlFlow()) {
+    if (!is_control_flow_structured()) {
+      // Close the last label and the switch.
+      if (UseSwitchForControlFlow()) {
+        a_.OpBreak();
+        a_.OpEndSwitch();
+      } else {
+        a_.OpEndIf();
+      }
+      // End the main loop.
       a_.OpBreak();
-      a_.OpEndSwitch();
-    } else {
-      a_.OpEndIf();
+      a_.OpEndLoop();
     }
-    // End the main loop.
-    a_.OpBreak();
-    a_.OpEndLoop();
 
     // Release the following system temporary values so epilogue can reuse them:
     // - system_temp_result_.
@@ -1640,6 +1643,19 @@ void DxbcShaderTranslator::StoreResult(const InstructionResult& result,
   }
 }
 
+void DxbcShaderTranslator::TestBoolConstant(uint32_t temp,
+                                            uint32_t bool_constant_index) {
+  if (cbuffer_index_bool_loop_constants_ == kBindingIndexUnallocated) {
+    cbuffer_index_bool_loop_constants_ = cbuffer_count_++;
+  }
+  a_.OpAnd(dxbc::Dest::R(temp, 0b0001),
+           dxbc::Src::CB(cbuffer_index_bool_loop_constants_,
+                         uint32_t(CbufferRegister::kBoolLoopConstants),
+                         bool_constant_index >> 7)
+               .Select((bool_constant_index >> 5) & 3),
+           dxbc::Src::LU(uint32_t(1) << (bool_constant_index & 31)));
+}
+
 void DxbcShaderTranslator::UpdateExecConditionalsAndEmitDisassembly(
     ParsedExecInstruction::Type type, uint32_t bool_constant_index,
     bool condition) {
@@ -1682,16 +1698,7 @@ void DxbcShaderTranslator::UpdateExecConditionalsAndEmitDisassembly(
 
   if (type == ParsedExecInstruction::Type::kConditional) {
     uint32_t bool_constant_test_temp = PushSystemTemp();
-    // Check the bool constant value.
-    if (cbuffer_index_bool_loop_constants_ == kBindingIndexUnallocated) {
-      cbuffer_index_bool_loop_constants_ = cbuffer_count_++;
-    }
-    a_.OpAnd(dxbc::Dest::R(bool_constant_test_temp, 0b0001),
-             dxbc::Src::CB(cbuffer_index_bool_loop_constants_,
-                           uint32_t(CbufferRegister::kBoolLoopConstants),
-                           bool_constant_index >> 7)
-                 .Select((bool_constant_index >> 5) & 3),
-             dxbc::Src::LU(uint32_t(1) << (bool_constant_index & 31)));
+    TestBoolConstant(bool_constant_test_temp, bool_constant_index);
     // Open the new `if`.
     a_.OpIf(condition, dxbc::Src::R(bool_constant_test_temp, dxbc::Src::kXXXX));
     // Release bool_constant_test_temp.
@@ -1809,7 +1816,8 @@ void DxbcShaderTranslator::ProcessExecInstructionBegin(
 
 void DxbcShaderTranslator::ProcessExecInstructionEnd(
     const ParsedExecInstruction& instr) {
-  if (instr.is_end) {
+  // With structured control flow, nothing is executed after the ending exec.
+  if (instr.is_end && !is_control_flow_structured()) {
     // Break out of the main loop.
     CloseInstructionPredication();
     if (UseSwitchForControlFlow()) {
@@ -1989,6 +1997,38 @@ void DxbcShaderTranslator::ProcessJumpInstruction(
   JumpToLabel(instr.target_address);
 }
 
+void DxbcShaderTranslator::ProcessSkippableRegionBegin(
+    const ParsedJumpInstruction& instr) {
+  // The region `if` stays open until the jump target, so it can't be merged
+  // with the conditionals of the execs.
+  CloseExecConditionals();
+
+  if (emit_source_map_) {
+    instruction_disassembly_buffer_.Reset();
+    instr.Disassemble(&instruction_disassembly_buffer_);
+    EmitInstructionDisassembly();
+  }
+
+  // Execute the region if the jump is not taken.
+  if (instr.type == ParsedJumpInstruction::Type::kConditional) {
+    uint32_t bool_constant_test_temp = PushSystemTemp();
+    TestBoolConstant(bool_constant_test_temp, instr.bool_constant_index);
+    a_.OpIf(!instr.condition,
+            dxbc::Src::R(bool_constant_test_temp, dxbc::Src::kXXXX));
+    // Release bool_constant_test_temp.
+    PopSystemTemp();
+  } else {
+    assert_true(instr.type == ParsedJumpInstruction::Type::kPredicated);
+    a_.OpIf(!instr.condition,
+            dxbc::Src::R(system_temp_ps_pc_p0_a0_, dxbc::Src::kZZZZ));
+  }
+}
+
+void DxbcShaderTranslator::ProcessSkippableRegionEnd() {
+  CloseExecConditionals();
+  a_.OpEndIf();
+}
+
 void DxbcShaderTranslator::ProcessAllocInstruction(
     const ParsedAllocInstruction& instr) {
   if (emit_source_map_) {
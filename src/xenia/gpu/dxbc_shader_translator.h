@@ -576,6 +576,8 @@ class DxbcShaderTranslator : public ShaderTranslator {
 
   uint32_t GetModificationRegisterCount() const override;
 
+  bool SupportsStructuredControlFlow() const override { return true; }
+
   void StartTranslation() override;
   std::vector<uint8_t> CompleteTranslation() override;
   void PostTranslation() override;
@@ -589,6 +591,9 @@ class DxbcShaderTranslator : public ShaderTranslator {
   void ProcessLoopEndInstruction(
       const ParsedLoopEndInstruction& instr) override;
   void ProcessJumpInstruction(const ParsedJumpInstruction& instr) override;
+  void ProcessSkippableRegionBegin(
+      const ParsedJumpInstruction& instr) override;
+  void ProcessSkippableRegionEnd() override;
   void ProcessAllocInstruction(const ParsedAllocInstruction& instr) override;
 
   void ProcessVertexFetchInstruction(
@@ -858,6 +863,9 @@ class DxbcShaderTranslator : public ShaderTranslator {
   // texture fetch instruction implementation):
   // https://docs.microsoft.com/en-us/windows/desktop/direct3dhlsl/dx9-graphics-reference-asm-ps-registers-output-color
 
+  // Writes whether the bool constant is true to the X of the temporary
+  // register.
+  void TestBoolConstant(uint32_t temp, uint32_t bool_constant_index);
   // Updates the current flow control condition (to be called in the beginning
   // of exec and in jumps), closing the previous conditionals if needed.
   // However, if the condition is not different, the instruction-level predicate
@@ -21,7 +21,14 @@ DEFINE_path(
 DEFINE_bool(vsync, true, "Enable VSYNC.", "GPU");
 
 DEFINE_uint64(vsync_interval, 16,
-              "VSYNC interval. Value is frametime in milliseconds.", "GPU");
+              "VSYNC interval. Value is frametime in milliseconds. Only used "
+              "if vsync_refresh_rate is 0.",
+              "GPU");
+
+DEFINE_double(vsync_refresh_rate, 59.94,
+              "Frequency of the guest vertical blank interrupts in Hz, 59.94 "
+              "for NTSC and 50 for PAL display modes. 0 to use vsync_interval.",
+              "GPU");
 
 DEFINE_bool(
     gpu_allow_invalid_fetch_constants, false,
@@ -45,6 +52,42 @@ DEFINE_bool(
     "when MSAA is used with fullscreen passes.",
     "GPU");
 
+DEFINE_bool(
+    parallel_shader_translation, true,
+    "When both the vertex shader and the pixel shader of a draw are new, "
+    "translate the pixel shader on a separate thread while the vertex shader "
+    "is being translated, approximately halving the stutter on the GPU thread.",
+    "GPU");
+
+DEFINE_bool(
+    structured_shader_control_flow, true,
+    "Translate shaders without loops, calls and backward jumps to structured "
+    "host code with the conditional jumps converted to `if` statements, rather "
+    "than to a loop with a program counter, which the host shader compilers "
+    "optimize and compile faster.",
+    "GPU");
+
+DEFINE_bool(
+    cull_scissored_out_draws, true,
+    "Drop draws on the CPU, before binding anything or updating the render "
+    "targets for them, if they can't cover any pixels because the scissor "
+    "rectangle is empty or is below the bottom of the viewport.",
+    "GPU");
+
+DEFINE_uint32(
+    gpu_frames_in_flight, 3,
+    "Maximum number of guest frames the command processor may submit ahead of "
+    "the host GPU completing them, from 1 to 3. 1 minimizes the input latency, "
+    "3 maximizes the throughput by hiding the host GPU and driver stalls.",
+    "GPU");
+
+DEFINE_bool(
+    gpu_indirect_buffer_cache, true,
+    "Decode the indirect buffers executed repeatedly by the guest once, and "
+    "write the registers set by them in bulk on the next executions, with the "
+    "guest memory of the buffers write-watched to detect changes.",
+    "GPU");
+
 DEFINE_int32(query_occlusion_fake_sample_count, 1000,
              "If set to -1 no sample counts are written, games may hang. Else, "
              "the sample count of every tile will be incremented on every "
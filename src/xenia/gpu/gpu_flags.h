@@ -20,6 +20,8 @@ DECLARE_bool(vsync);
 
 DECLARE_uint64(vsync_interval);
 
+DECLARE_double(vsync_refresh_rate);
+
 DECLARE_bool(gpu_allow_invalid_fetch_constants);
 
 DECLARE_bool(half_pixel_offset);
@@ -28,4 +30,14 @@ DECLARE_int32(query_occlusion_fake_sample_count);
 
 DECLARE_bool(disassemble_pm4);
 
+DECLARE_bool(parallel_shader_translation);
+
+DECLARE_bool(structured_shader_control_flow);
+
+DECLARE_bool(cull_scissored_out_draws);
+
+DECLARE_uint32(gpu_frames_in_flight);
+
+DECLARE_bool(gpu_indirect_buffer_cache);
+
 #endif  // XENIA_GPU_GPU_FLAGS_H_
@@ -0,0 +1,265 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/gpu_pass_timestamps.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+#include "xenia/base/trace_events.h"
+
+DEFINE_bool(gpu_pass_timing, false,
+            "Measure the GPU time of EDRAM transfers, resolves (bitwise "
+            "copies, converting copies and clears separately), texture loads, "
+            "host depth stores and draws with timestamp queries, and show the "
+            "time of each per frame in the profiler counters.",
+            "GPU");
+DEFINE_path(gpu_pass_timing_csv, "",
+            "With gpu_pass_timing, path to a CSV file to write the GPU time "
+            "of the passes of every frame to.",
+            "GPU");
+
+namespace xe {
+namespace gpu {
+
+const char* GetGpuPassName(GpuPass pass) {
+  switch (pass) {
+    case GpuPass::kDraws:
+      return "draws";
+    case GpuPass::kEdramTransfers:
+      return "edram_transfers";
+    case GpuPass::kResolveCopiesBitwise:
+      return "resolve_copies_bitwise";
+    case GpuPass::kResolveCopiesConverting:
+      return "resolve_copies_converting";
+    case GpuPass::kResolveClears:
+      return "resolve_clears";
+    case GpuPass::kTextureLoads:
+      return "texture_loads";
+    case GpuPass::kHostDepthStores:
+      return "host_depth_stores";
+    default:
+      assert_unhandled_case(pass);
+      return "unknown";
+  }
+}
+
+bool GpuPassTimestamps::IsPassTimingRequested() {
+  return cvars::gpu_pass_timing || trace_events::IsRecording();
+}
+
+void GpuPassTimestamps::Shutdown() {
+  ReportFrame();
+  if (csv_file_) {
+    fclose(csv_file_);
+    csv_file_ = nullptr;
+  }
+  csv_file_open_attempted_ = false;
+  slots_.reset();
+  slot_current_ = UINT32_MAX;
+  pass_current_ = GpuPass::kDraws;
+}
+
+uint32_t GpuPassTimestamps::BeginSubmission(uint64_t submission,
+                                            uint64_t frame, bool time_passes) {
+  if (!slots_) {
+    slots_ = std::make_unique<Slot[]>(kSlotCount);
+  }
+  slot_current_ = uint32_t(submission % kSlotCount);
+  Slot& slot = slots_[slot_current_];
+  slot.submission = submission;
+  slot.frame = frame;
+  slot.timestamp_count = 1;
+  slot.passes_timed = time_passes;
+  slot.passes[0] = pass_current_;
+  return slot_current_ * kTimestampsPerSlot;
+}
+
+uint32_t GpuPassTimestamps::SwitchPass(GpuPass pass,
+                                       GpuPass& previous_pass_out) {
+  previous_pass_out = pass_current_;
+  if (pass == pass_current_) {
+    return UINT32_MAX;
+  }
+  pass_current_ = pass;
+  if (slot_current_ == UINT32_MAX) {
+    return UINT32_MAX;
+  }
+  Slot& slot = slots_[slot_current_];
+  // Keep the last query for the end of the submission. If there are too many
+  // switches, the time is attributed to the last pass a timestamp was written
+  // for.
+  if (!slot.passes_timed || slot.timestamp_count + 1 >= kTimestampsPerSlot) {
+    return UINT32_MAX;
+  }
+  uint32_t timestamp_index = slot.timestamp_count++;
+  slot.passes[timestamp_index] = pass;
+  return slot_current_ * kTimestampsPerSlot + timestamp_index;
+}
+
+uint32_t GpuPassTimestamps::EndSubmission(uint32_t& first_query_out,
+                                          uint32_t& query_count_out) {
+  if (slot_current_ == UINT32_MAX) {
+    first_query_out = 0;
+    query_count_out = 0;
+    return UINT32_MAX;
+  }
+  Slot& slot = slots_[slot_current_];
+  uint32_t timestamp_index = slot.timestamp_count++;
+  slot.end_host_time_ns = trace_events::GetTimeNs();
+  first_query_out = slot_current_ * kTimestampsPerSlot;
+  query_count_out = slot.timestamp_count;
+  slot_current_ = UINT32_MAX;
+  return first_query_out + timestamp_index;
+}
+
+bool GpuPassTimestamps::GetSubmissionQueries(uint64_t submission,
+                                             uint32_t& first_query_out,
+                                             uint32_t& query_count_out) const {
+  if (!slots_) {
+    return false;
+  }
+  uint32_t slot_index = uint32_t(submission % kSlotCount);
+  const Slot& slot = slots_[slot_index];
+  if (slot.submission != submission || slot.timestamp_count < 2) {
+    return false;
+  }
+  first_query_out = slot_index * kTimestampsPerSlot;
+  query_count_out = slot.timestamp_count;
+  return true;
+}
+
+uint64_t GpuPassTimestamps::SubmissionCompleted(uint64_t submission,
+                                                const uint64_t* timestamps,
+                                                uint64_t timestamp_mask,
+                                                double nanoseconds_per_tick) {
+  Slot& slot = slots_[submission % kSlotCount];
+  assert_true(slot.submission == submission);
+  slot.submission = 0;
+  uint32_t timestamp_count = slot.timestamp_count;
+  if (slot.passes_timed) {
+    if (report_frame_valid_ && report_frame_ != slot.frame) {
+      ReportFrame();
+    }
+    if (!report_frame_valid_) {
+      report_frame_ = slot.frame;
+      report_frame_valid_ = true;
+      std::memset(report_frame_pass_ns_, 0, sizeof(report_frame_pass_ns_));
+    }
+    for (uint32_t i = 0; i + 1 < timestamp_count; ++i) {
+      uint64_t pass_ticks =
+          GetTimestampDelta(timestamps[i], timestamps[i + 1], timestamp_mask);
+      if (pass_ticks != UINT64_MAX) {
+        report_frame_pass_ns_[size_t(slot.passes[i])] +=
+            uint64_t(double(pass_ticks) * nanoseconds_per_tick);
+      }
+    }
+  }
+  uint64_t submission_ticks = GetTimestampDelta(
+      timestamps[0], timestamps[timestamp_count - 1], timestamp_mask);
+  if (submission_ticks == UINT64_MAX) {
+    return 0;
+  }
+  if (trace_events::IsRecording()) {
+    RecordTraceSpans(slot, timestamps, timestamp_mask, nanoseconds_per_tick);
+  }
+  return uint64_t(double(submission_ticks) * nanoseconds_per_tick);
+}
+
+void GpuPassTimestamps::RecordTraceSpans(const Slot& slot,
+                                         const uint64_t* timestamps,
+                                         uint64_t timestamp_mask,
+                                         double nanoseconds_per_tick) {
+  uint64_t begin_ns = std::max(slot.end_host_time_ns, trace_gpu_end_ns_);
+  auto timestamp_to_ns = [&](uint64_t timestamp) {
+    return begin_ns +
+           uint64_t(double((timestamp - timestamps[0]) & timestamp_mask) *
+                    nanoseconds_per_tick);
+  };
+  uint64_t end_ns = timestamp_to_ns(timestamps[slot.timestamp_count - 1]);
+  trace_events::RecordGpuSpan("Submission", begin_ns, end_ns);
+  if (slot.passes_timed) {
+    // Nested in the submission span.
+    for (uint32_t i = 0; i + 1 < slot.timestamp_count; ++i) {
+      uint64_t pass_ticks =
+          GetTimestampDelta(timestamps[i], timestamps[i + 1], timestamp_mask);
+      if (pass_ticks && pass_ticks != UINT64_MAX &&
+          GetTimestampDelta(timestamps[0], timestamps[i], timestamp_mask) !=
+              UINT64_MAX) {
+        trace_events::RecordGpuSpan(GetGpuPassName(slot.passes[i]),
+                                    timestamp_to_ns(timestamps[i]),
+                                    timestamp_to_ns(timestamps[i + 1]));
+      }
+    }
+  }
+  trace_gpu_end_ns_ = end_ns;
+}
+
+void GpuPassTimestamps::ReportFrame() {
+  if (!report_frame_valid_) {
+    return;
+  }
+  report_frame_valid_ = false;
+
+  // The counter names must be literals.
+  COUNT_profile_set(
+      "gpu/passes/draws_us",
+      report_frame_pass_ns_[size_t(GpuPass::kDraws)] / 1000);
+  COUNT_profile_set(
+      "gpu/passes/edram_transfers_us",
+      report_frame_pass_ns_[size_t(GpuPass::kEdramTransfers)] / 1000);
+  COUNT_profile_set(
+      "gpu/passes/resolve_copies_bitwise_us",
+      report_frame_pass_ns_[size_t(GpuPass::kResolveCopiesBitwise)] / 1000);
+  COUNT_profile_set(
+      "gpu/passes/resolve_copies_converting_us",
+      report_frame_pass_ns_[size_t(GpuPass::kResolveCopiesConverting)] / 1000);
+  COUNT_profile_set(
+      "gpu/passes/resolve_clears_us",
+      report_frame_pass_ns_[size_t(GpuPass::kResolveClears)] / 1000);
+  COUNT_profile_set(
+      "gpu/passes/texture_loads_us",
+      report_frame_pass_ns_[size_t(GpuPass::kTextureLoads)] / 1000);
+  COUNT_profile_set(
+      "gpu/passes/host_depth_stores_us",
+      report_frame_pass_ns_[size_t(GpuPass::kHostDepthStores)] / 1000);
+
+  if (!csv_file_ && !csv_file_open_attempted_ &&
+      !cvars::gpu_pass_timing_csv.empty()) {
+    csv_file_open_attempted_ = true;
+    csv_file_ = xe::filesystem::OpenFile(cvars::gpu_pass_timing_csv, "wb");
+    if (!csv_file_) {
+      XELOGE("Failed to open {} for writing the GPU pass times",
+             xe::path_to_utf8(cvars::gpu_pass_timing_csv));
+      return;
+    }
+    fmt::print(csv_file_, "frame");
+    for (size_t i = 0; i < size_t(GpuPass::kCount); ++i) {
+      fmt::print(csv_file_, ",{}_us", GetGpuPassName(GpuPass(i)));
+    }
+    fmt::print(csv_file_, "\n");
+  }
+  if (csv_file_) {
+    fmt::print(csv_file_, "{}", report_frame_);
+    for (size_t i = 0; i < size_t(GpuPass::kCount); ++i) {
+      fmt::print(csv_file_, ",{:.3f}",
+                 double(report_frame_pass_ns_[i]) / 1000.0);
+    }
+    fmt::print(csv_file_, "\n");
+  }
+}
+
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,161 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_GPU_PASS_TIMESTAMPS_H_
+#define XENIA_GPU_GPU_PASS_TIMESTAMPS_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+namespace xe {
+namespace gpu {
+
+// Categories of the GPU work the execution time is measured for.
+enum class GpuPass : uint8_t {
+  // Guest draws, and everything not in the other categories.
+  kDraws,
+  kEdramTransfers,
+  // Resolves, by the kind of the work, for finding which of them serialize
+  // the GPU work the most.
+  kResolveCopiesBitwise,
+  kResolveCopiesConverting,
+  kResolveClears,
+  kTextureLoads,
+  kHostDepthStores,
+
+  kCount,
+};
+
+const char* GetGpuPassName(GpuPass pass);
+
+// Backend-independent bookkeeping for measuring the GPU time of submissions
+// and of the passes in them with timestamp queries. A timestamp is written at
+// the beginning and the end of each timed submission, and, if pass timing is
+// enabled, whenever the pass changes, with the time between two timestamps
+// attributed to the pass active after the first of them. Submissions use the
+// slot of kTimestampsPerSlot queries at their index modulo kSlotCount, so the
+// results must be read before kSlotCount more submissions are made, and the
+// index of the submission the slot was last used by is stored to ignore the
+// slots overwritten by later submissions. The total time of the passes of each
+// frame is reported in the profiler counters and optionally to a CSV file.
+class GpuPassTimestamps {
+ public:
+  static constexpr uint32_t kSlotCount = 64;
+  static constexpr uint32_t kTimestampsPerSlot = 512;
+  static constexpr uint32_t kTimestampCount = kSlotCount * kTimestampsPerSlot;
+
+  GpuPassTimestamps() = default;
+  GpuPassTimestamps(const GpuPassTimestamps& timestamps) = delete;
+  GpuPassTimestamps& operator=(const GpuPassTimestamps& timestamps) = delete;
+  ~GpuPassTimestamps() { Shutdown(); }
+
+  // Whether timestamps should be written between passes (--gpu_pass_timing,
+  // or while recording the trace events, which also get the GPU spans).
+  static bool IsPassTimingRequested();
+
+  // Reports the last frame and drops all the pending timestamps.
+  void Shutdown();
+
+  // Returns the index of the timestamp query to write at the beginning of the
+  // submission.
+  uint32_t BeginSubmission(uint64_t submission, uint64_t frame,
+                           bool time_passes);
+  // Returns whether a submission is currently being timed.
+  bool is_submission_timed() const { return slot_current_ != UINT32_MAX; }
+  // Returns the index of the timestamp query to write before the commands of
+  // the new pass, or UINT32_MAX if a timestamp is not needed.
+  uint32_t SwitchPass(GpuPass pass, GpuPass& previous_pass_out);
+  // Returns the index of the timestamp query to write at the end of the
+  // submission, and the range of the queries of the submission to resolve, or
+  // UINT32_MAX if the submission is not timed.
+  uint32_t EndSubmission(uint32_t& first_query_out, uint32_t& query_count_out);
+
+  // Returns whether the timestamps of the completed submission are still
+  // available, and which queries contain them.
+  bool GetSubmissionQueries(uint64_t submission, uint32_t& first_query_out,
+                            uint32_t& query_count_out) const;
+  // Takes the timestamps of the completed submission (submissions must be
+  // completed in order), returning its total GPU time in nanoseconds. Only the
+  // bits in timestamp_mask are valid in the timestamps, and the counter may
+  // wrap around within a submission.
+  uint64_t SubmissionCompleted(uint64_t submission, const uint64_t* timestamps,
+                               uint64_t timestamp_mask,
+                               double nanoseconds_per_tick);
+
+ private:
+  struct Slot {
+    uint64_t submission = 0;
+    uint64_t frame = 0;
+    uint32_t timestamp_count = 0;
+    bool passes_timed = false;
+    // The host time of ending the submission, for placing the GPU spans on
+    // the trace timeline.
+    uint64_t end_host_time_ns = 0;
+    // The pass active after each timestamp.
+    GpuPass passes[kTimestampsPerSlot];
+  };
+
+  // Returns the number of ticks from the earlier to the later timestamp, or
+  // UINT64_MAX if the later timestamp is before the earlier one.
+  static uint64_t GetTimestampDelta(uint64_t timestamp_earlier,
+                                    uint64_t timestamp_later,
+                                    uint64_t timestamp_mask) {
+    uint64_t delta = (timestamp_later - timestamp_earlier) & timestamp_mask;
+    return delta <= (timestamp_mask >> 1) ? delta : UINT64_MAX;
+  }
+
+  void ReportFrame();
+  void RecordTraceSpans(const Slot& slot, const uint64_t* timestamps,
+                        uint64_t timestamp_mask, double nanoseconds_per_tick);
+
+  std::unique_ptr<Slot[]> slots_;
+  // UINT32_MAX if the submission being recorded is not timed.
+  uint32_t slot_current_ = UINT32_MAX;
+  GpuPass pass_current_ = GpuPass::kDraws;
+
+  // The GPU clock isn't calibrated against the host one, so the GPU spans of
+  // a submission start when it was submitted, or after the previous ones.
+  uint64_t trace_gpu_end_ns_ = 0;
+
+  // The frame the completed submissions are being accumulated for.
+  uint64_t report_frame_ = 0;
+  bool report_frame_valid_ = false;
+  uint64_t report_frame_pass_ns_[size_t(GpuPass::kCount)] = {};
+  FILE* csv_file_ = nullptr;
+  bool csv_file_open_attempted_ = false;
+};
+
+// Sets the pass for the lifetime of the scope if the condition is true.
+template <typename T>
+class GpuPassScope {
+ public:
+  GpuPassScope(T& command_processor, GpuPass pass, bool condition = true)
+      : command_processor_(condition ? &command_processor : nullptr) {
+    if (command_processor_) {
+      previous_pass_ = command_processor_->SwitchGpuPass(pass);
+    }
+  }
+  GpuPassScope(const GpuPassScope& scope) = delete;
+  GpuPassScope& operator=(const GpuPassScope& scope) = delete;
+  ~GpuPassScope() {
+    if (command_processor_) {
+      command_processor_->SwitchGpuPass(previous_pass_);
+    }
+  }
+
+ private:
+  T* command_processor_;
+  GpuPass previous_pass_ = GpuPass::kDraws;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_GPU_PASS_TIMESTAMPS_H_
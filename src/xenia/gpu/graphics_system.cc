@@ -11,6 +11,7 @@
 
 #include "xenia/gpu/graphics_system.h"
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -21,6 +22,7 @@
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/metrics.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
 #include "xenia/gpu/command_processor.h"
@@ -34,10 +36,24 @@ DEFINE_bool(
     "Store shaders persistently and load them when loading games to avoid "
     "runtime spikes and freezes when playing the game not for the first time.",
     "GPU");
+DEFINE_bool(
+    keep_shader_storage_on_relaunch, true,
+    "When the title that was running last is launched again, such as when "
+    "returning from the dashboard or restarting, keep using its shaders and "
+    "pipelines already in memory instead of loading the shader storage again.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
 
+namespace {
+metrics::Histogram vblank_jitter_metric(
+    "xenia_gpu_vblank_jitter_microseconds",
+    "Lateness of the guest vertical blank interrupts relative to their "
+    "deadlines.",
+    {50, 100, 250, 500, 1000, 2000, 4000, 8000});
+}  // namespace
+
 // Nvidia Optimus/AMD PowerXpress support.
 // These exports force the process to trigger the discrete GPU in multi-GPU
 // systems.
@@ -104,19 +120,7 @@ X_STATUS GraphicsSystem::Setup(cpu::Processor* processor,
   vsync_worker_running_ = true;
   vsync_worker_thread_ = kernel::object_ref<kernel::XHostThread>(
       new kernel::XHostThread(kernel_state_, 128 * 1024, 0, [this]() {
-        uint64_t vsync_duration =
-            cvars::vsync ? std::max<uint64_t>(5, cvars::vsync_interval) : 1;
-        uint64_t last_frame_time = Clock::QueryGuestTickCount();
-        while (vsync_worker_running_) {
-          uint64_t current_time = Clock::QueryGuestTickCount();
-          uint64_t elapsed = (current_time - last_frame_time) /
-                             (Clock::guest_tick_frequency() / 1000);
-          if (elapsed >= vsync_duration) {
-            MarkVblank();
-            last_frame_time = current_time;
-          }
-          xe::threading::Sleep(std::chrono::milliseconds(1));
-        }
+        VsyncWorkerThreadMain();
         return 0;
       }));
   // As we run vblank interrupts the debugger must be able to suspend us.
@@ -136,6 +140,7 @@ void GraphicsSystem::Shutdown() {
     EndTracing();
     command_processor_->Shutdown();
     command_processor_.reset();
+    shader_storage_initialized_ = false;
   }
 
   if (vsync_worker_thread_) {
@@ -267,6 +272,63 @@ void GraphicsSystem::DispatchInterruptCallback(uint32_t source, uint32_t cpu) {
                                args, xe::countof(args));
 }
 
+void GraphicsSystem::VsyncWorkerThreadMain() {
+  double period_seconds;
+  if (!cvars::vsync) {
+    period_seconds = 0.001;
+  } else if (cvars::vsync_refresh_rate > 0.0) {
+    period_seconds = 1.0 / std::max(cvars::vsync_refresh_rate, 1.0);
+  } else {
+    period_seconds =
+        double(std::max<uint64_t>(5, cvars::vsync_interval)) / 1000.0;
+  }
+  // The vblanks are in the guest time.
+  period_seconds /= std::max(Clock::guest_time_scalar(), 0.001);
+  auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(period_seconds));
+
+  // Waiting on a timer until absolute deadlines, computed from the number of
+  // the vblank since the origin rather than the time of the previous one so
+  // the lateness of the wakeups doesn't accumulate.
+  std::unique_ptr<threading::Timer> timer =
+      threading::Timer::CreateSynchronizationTimer();
+  auto origin = std::chrono::steady_clock::now();
+  uint64_t vblank_index = 1;
+  while (vsync_worker_running_) {
+    auto deadline =
+        origin +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(period_seconds *
+                                          double(vblank_index)));
+    auto now = std::chrono::steady_clock::now();
+    if (now < deadline) {
+      auto remaining = deadline - now;
+      if (timer &&
+          timer->SetOnceAfter(
+              std::chrono::duration_cast<xe::chrono::hundrednanoseconds>(
+                  remaining))) {
+        threading::Wait(timer.get(), false);
+      } else {
+        threading::Sleep(
+            std::chrono::duration_cast<std::chrono::microseconds>(remaining));
+      }
+      // Woken up early if the timer is coarser - wait for the rest.
+      continue;
+    }
+    vblank_jitter_metric.Observe(uint64_t(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - deadline)
+            .count()));
+    MarkVblank();
+    ++vblank_index;
+    // Skipping the vblanks missed while suspended (such as in the debugger)
+    // instead of delivering them in a burst.
+    if (now - deadline >= period) {
+      origin = now;
+      vblank_index = 1;
+    }
+  }
+}
+
 void GraphicsSystem::MarkVblank() {
   SCOPE_profile_cpu_f("gpu");
 
@@ -289,6 +351,18 @@ void GraphicsSystem::InitializeShaderStorage(
   if (!cvars::store_shaders) {
     return;
   }
+  // The storage stays open and the translated shaders and the pipelines stay
+  // in the caches when the title is terminated, and the context restarts load
+  // the storage on their own.
+  if (cvars::keep_shader_storage_on_relaunch &&
+      shader_storage_initialized_ && shader_storage_title_id_ == title_id &&
+      shader_storage_cache_root_ == cache_root) {
+    XELOGI("Keeping the loaded shader storage of title {:08X}", title_id);
+    return;
+  }
+  shader_storage_initialized_ = true;
+  shader_storage_cache_root_ = cache_root;
+  shader_storage_title_id_ = title_id;
   if (blocking) {
     if (command_processor_->is_paused()) {
       // Safe to run on any thread while the command processor is paused, no
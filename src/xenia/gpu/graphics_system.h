@@ -12,6 +12,7 @@
 
 #include <atomic>
 #include <cstdint>
+#include <filesystem>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -48,6 +49,11 @@ class GraphicsSystem {
   ui::GraphicsProvider* provider() const { return provider_.get(); }
   ui::Presenter* presenter() const { return presenter_.get(); }
 
+  // Creates the host graphics provider, which doesn't depend on the other
+  // subsystems, so this may be called on another thread before Setup to
+  // overlap the device creation with their initialization. Called by Setup if
+  // the provider hasn't been created yet.
+  virtual void CreateProvider(bool is_surface_required) {}
   virtual X_STATUS Setup(cpu::Processor* processor,
                          kernel::KernelState* kernel_state,
                          ui::WindowedAppContext* app_context,
@@ -72,6 +78,8 @@ class GraphicsSystem {
 
   virtual void ClearCaches();
 
+  // Does nothing if the storage of the same title is already initialized,
+  // unless keep_shader_storage_on_relaunch is disabled.
   void InitializeShaderStorage(const std::filesystem::path& cache_root,
                                uint32_t title_id, bool blocking);
 
@@ -98,6 +106,8 @@ class GraphicsSystem {
   uint32_t ReadRegister(uint32_t addr);
   void WriteRegister(uint32_t addr, uint32_t value);
 
+  // Delivers the vblank interrupts at the configured refresh rate.
+  void VsyncWorkerThreadMain();
   void MarkVblank();
 
   Memory* memory_ = nullptr;
@@ -120,6 +130,11 @@ class GraphicsSystem {
  private:
   std::unique_ptr<ui::Presenter> presenter_;
 
+  // The last shader storage requested by InitializeShaderStorage.
+  bool shader_storage_initialized_ = false;
+  std::filesystem::path shader_storage_cache_root_;
+  uint32_t shader_storage_title_id_ = 0;
+
   std::atomic_flag host_gpu_loss_reported_;
 };
 
@@ -0,0 +1,299 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/indirect_buffer_cache.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/metrics.h"
+#include "xenia/base/xxhash.h"
+
+namespace xe {
+namespace gpu {
+
+namespace {
+metrics::Counter indirect_buffer_cache_hits_metric(
+    "xenia_gpu_indirect_buffer_cache_hits_total",
+    "Indirect buffers executed from their pre-decoded contents.");
+metrics::Counter indirect_buffer_cache_decodes_metric(
+    "xenia_gpu_indirect_buffer_cache_decodes_total",
+    "Indirect buffers decoded for executing them from the cache.");
+metrics::Counter indirect_buffer_cache_revalidations_metric(
+    "xenia_gpu_indirect_buffer_cache_revalidations_total",
+    "Cached indirect buffers found unchanged by the hash after being written.");
+}  // namespace
+
+IndirectBufferCache::IndirectBufferCache(Memory& memory) : memory_(memory) {
+  page_size_log2_ = xe::log2_ceil(uint32_t(xe::memory::page_size()));
+  uint32_t page_count = kPhysicalMemorySize >> page_size_log2_;
+  page_invalidation_epochs_.resize(page_count);
+  watched_pages_.resize((page_count + 63) / 64);
+  memory_invalidation_callback_handle_ =
+      memory_.RegisterPhysicalMemoryInvalidationCallback(
+          MemoryInvalidationCallbackThunk, this);
+}
+
+IndirectBufferCache::~IndirectBufferCache() {
+  if (memory_invalidation_callback_handle_) {
+    memory_.UnregisterPhysicalMemoryInvalidationCallback(
+        memory_invalidation_callback_handle_);
+  }
+}
+
+std::shared_ptr<IndirectBufferCache::Entry>
+IndirectBufferCache::GetDecodedBuffer(uint32_t physical_address,
+                                      uint32_t dword_count) {
+  if (!dword_count || physical_address >= kPhysicalMemorySize ||
+      (kPhysicalMemorySize - physical_address) / sizeof(uint32_t) <
+          dword_count) {
+    return nullptr;
+  }
+
+  // Without the notifications on every write, the written pages must be
+  // checked explicitly.
+  memory_.CollectPhysicalMemoryWrites();
+
+  uint64_t key = (uint64_t(physical_address) << 32) | dword_count;
+  auto global_lock = global_critical_region_.Acquire();
+
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    // Only caching the buffers executed repeatedly.
+    if (entries_.size() < kMaxEntries) {
+      entries_.emplace(key, nullptr);
+    }
+    return nullptr;
+  }
+  std::shared_ptr<Entry>& entry = it->second;
+  if (entry) {
+    if (entry->change_count > kMaxChangeCount) {
+      return nullptr;
+    }
+    if (IsWatched(*entry, physical_address, dword_count)) {
+      if (!entry->has_register_writes) {
+        return nullptr;
+      }
+      indirect_buffer_cache_hits_metric.Add();
+      return entry;
+    }
+  }
+
+  // Watching before reading the contents so any changes made after reading
+  // are detected. With the global critical region locked, the pages can't be
+  // written until the contents are read.
+  Watch(physical_address, dword_count);
+  const uint32_t* words =
+      memory_.TranslatePhysical<const uint32_t*>(physical_address);
+  uint64_t hash = XXH3_64bits(words, sizeof(uint32_t) * dword_count);
+  if (entry) {
+    if (entry->hash == hash) {
+      entry->watch_epoch = invalidation_epoch_;
+      indirect_buffer_cache_revalidations_metric.Add();
+      if (!entry->has_register_writes) {
+        return nullptr;
+      }
+      indirect_buffer_cache_hits_metric.Add();
+      return entry;
+    }
+    if (entry->change_count >= kMaxChangeCount) {
+      // Dynamic - keeping the entry so the buffer is not watched again.
+      auto dynamic_entry = std::make_shared<Entry>();
+      dynamic_entry->change_count = entry->change_count + 1;
+      entry = std::move(dynamic_entry);
+      return nullptr;
+    }
+  }
+
+  // Not modifying the existing entry as it may be being executed.
+  auto new_entry = std::make_shared<Entry>();
+  Decode(words, dword_count, *new_entry);
+  new_entry->hash = hash;
+  new_entry->watch_epoch = invalidation_epoch_;
+  if (entry) {
+    new_entry->change_count = entry->change_count + 1;
+  }
+  entry = new_entry;
+  indirect_buffer_cache_decodes_metric.Add();
+  if (!new_entry->has_register_writes) {
+    return nullptr;
+  }
+  return new_entry;
+}
+
+void IndirectBufferCache::Clear() {
+  auto global_lock = global_critical_region_.Acquire();
+  entries_.clear();
+}
+
+void IndirectBufferCache::Decode(const uint32_t* words, uint32_t dword_count,
+                                 Entry& entry) {
+  // The start of the packets to execute normally not added to the segments
+  // yet.
+  uint32_t packets_start = UINT32_MAX;
+  auto flush_packets = [&](uint32_t packets_end) {
+    if (packets_start != UINT32_MAX) {
+      entry.segments.push_back({0, packets_start, packets_end - packets_start});
+      packets_start = UINT32_MAX;
+    }
+  };
+  auto add_registers = [&](uint32_t first, const uint32_t* values,
+                           uint32_t count, uint32_t position) {
+    flush_packets(position);
+    if (entry.segments.empty() || !entry.segments.back().register_count ||
+        entry.segments.back().first + entry.segments.back().register_count !=
+            first) {
+      entry.segments.push_back(
+          {0, first, uint32_t(entry.register_values.size())});
+    }
+    entry.segments.back().register_count += count;
+    entry.register_values.insert(entry.register_values.end(), values,
+                                 values + count);
+    entry.has_register_writes = true;
+  };
+
+  uint32_t position = 0;
+  while (position < dword_count) {
+    uint32_t packet = xe::load_and_swap<uint32_t>(words + position);
+    uint32_t packet_type = packet >> 30;
+    // Skipped like invalid packets by the command processor.
+    if (!packet || packet == 0x0BADF00D) {
+      flush_packets(position);
+      ++position;
+      continue;
+    }
+    uint32_t packet_dword_count;
+    switch (packet_type) {
+      case 0:
+      case 3:
+        packet_dword_count = 2 + ((packet >> 16) & 0x3FFF);
+        break;
+      case 1:
+        packet_dword_count = 3;
+        break;
+      default:
+        packet_dword_count = 1;
+        break;
+    }
+    if (packet_dword_count > dword_count - position) {
+      // Truncated, let the command processor handle the overflow.
+      if (packets_start == UINT32_MAX) {
+        packets_start = position;
+      }
+      position = dword_count;
+      break;
+    }
+    if (packet_type == 0 && !(packet & (UINT32_C(1) << 15))) {
+      add_registers(packet & 0x7FFF, words + position + 1,
+                    packet_dword_count - 1, position);
+    } else if (packet_type == 1) {
+      add_registers(packet & 0x7FF, words + position + 1, 1, position);
+      add_registers((packet >> 11) & 0x7FF, words + position + 2, 1,
+                    position);
+    } else if (packet_type == 2) {
+      // No-op.
+      flush_packets(position);
+    } else if (packets_start == UINT32_MAX) {
+      packets_start = position;
+    }
+    position += packet_dword_count;
+  }
+  flush_packets(position);
+}
+
+bool IndirectBufferCache::IsWatched(const Entry& entry,
+                                    uint32_t physical_address,
+                                    uint32_t dword_count) const {
+  uint32_t page_first = physical_address >> page_size_log2_;
+  uint32_t page_last =
+      (physical_address + sizeof(uint32_t) * dword_count - 1) >>
+      page_size_log2_;
+  for (uint32_t i = page_first; i <= page_last; ++i) {
+    if (page_invalidation_epochs_[i] > entry.watch_epoch) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void IndirectBufferCache::Watch(uint32_t physical_address,
+                                uint32_t dword_count) {
+  uint32_t length = sizeof(uint32_t) * dword_count;
+  uint32_t page_first = physical_address >> page_size_log2_;
+  uint32_t page_last = (physical_address + length - 1) >> page_size_log2_;
+  for (uint32_t i = page_first; i <= page_last; ++i) {
+    watched_pages_[i >> 6] |= uint64_t(1) << (i & 63);
+  }
+  memory_.EnablePhysicalMemoryAccessCallbacks(physical_address, length, true,
+                                              false);
+}
+
+std::pair<uint32_t, uint32_t>
+IndirectBufferCache::MemoryInvalidationCallbackThunk(
+    void* context_ptr, uint32_t physical_address_start, uint32_t length,
+    bool exact_range) {
+  return reinterpret_cast<IndirectBufferCache*>(context_ptr)
+      ->MemoryInvalidationCallback(physical_address_start, length,
+                                   exact_range);
+}
+
+std::pair<uint32_t, uint32_t> IndirectBufferCache::MemoryInvalidationCallback(
+    uint32_t physical_address_start, uint32_t length, bool exact_range) {
+  if (length == 0 || physical_address_start >= kPhysicalMemorySize) {
+    return std::make_pair(uint32_t(0), UINT32_MAX);
+  }
+  length = std::min(length, kPhysicalMemorySize - physical_address_start);
+  uint32_t page_first = physical_address_start >> page_size_log2_;
+  uint32_t page_last =
+      (physical_address_start + (length - 1)) >> page_size_log2_;
+  uint32_t block_first = page_first >> 6;
+  uint32_t block_last = page_last >> 6;
+
+  auto global_lock = global_critical_region_.Acquire();
+
+  uint64_t epoch = ++invalidation_epoch_;
+  for (uint32_t i = page_first; i <= page_last; ++i) {
+    page_invalidation_epochs_[i] = epoch;
+  }
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t unwatched_bits = UINT64_MAX;
+    if (i == block_first) {
+      unwatched_bits &= ~((uint64_t(1) << (page_first & 63)) - 1);
+    }
+    if (i == block_last && (page_last & 63) != 63) {
+      unwatched_bits &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+    }
+    watched_pages_[i] &= ~unwatched_bits;
+  }
+
+  if (!exact_range) {
+    // Let the memory unwatch the pages around the written ones up to the
+    // nearest pages still watched for the cached buffers within the blocks.
+    if (page_first & 63) {
+      uint64_t watched_before = watched_pages_[block_first] &
+                                ((uint64_t(1) << (page_first & 63)) - 1);
+      page_first =
+          (page_first & ~uint32_t(63)) + (64 - xe::lzcnt(watched_before));
+    }
+    if ((page_last & 63) != 63) {
+      uint64_t watched_after = watched_pages_[block_last] &
+                               ~((uint64_t(1) << ((page_last & 63) + 1)) - 1);
+      page_last = (page_last & ~uint32_t(63)) +
+                  (std::max(xe::tzcnt(watched_after), uint8_t(1)) - 1);
+    }
+  }
+
+  return std::make_pair(page_first << page_size_log2_,
+                        (page_last - page_first + 1) << page_size_log2_);
+}
+
+}  // namespace gpu
+}  // namespace xe
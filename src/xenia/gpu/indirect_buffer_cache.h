@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_INDIRECT_BUFFER_CACHE_H_
+#define XENIA_GPU_INDIRECT_BUFFER_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace gpu {
+
+// Pre-decoded contents of the indirect buffers executed repeatedly, such as the
+// static command lists built by titles once at load time. The runs of register
+// writes done by the type 0 and type 1 packets are extracted so the command
+// processor can write them in bulk without parsing the packets again, while
+// the other packets are executed from the guest memory as usual.
+//
+// A buffer is decoded the second time it's executed, and its pages are then
+// write-watched. When they're written, the contents are hashed on the next
+// execution, and if they're unchanged, as titles often rewrite the same
+// commands, the decoded contents are reused. Buffers that keep changing are
+// not cached anymore so writing them doesn't cause access violations.
+class IndirectBufferCache {
+ public:
+  struct Segment {
+    // Number of registers to write, or 0 for the packets to execute normally.
+    uint32_t register_count;
+    // The first register to write, or the offset of the packets in the buffer
+    // in dwords.
+    uint32_t first;
+    // The offset of the big-endian register values in register_values, or the
+    // length of the packets in dwords.
+    uint32_t data;
+  };
+
+  struct Entry {
+    std::vector<Segment> segments;
+    std::vector<uint32_t> register_values;
+    uint64_t hash = 0;
+    // Value of invalidation_epoch_ when the pages of the buffer were watched.
+    uint64_t watch_epoch = 0;
+    // Number of times the contents were found changed.
+    uint32_t change_count = 0;
+    // Whether replaying the segments is beneficial.
+    bool has_register_writes = false;
+  };
+
+  explicit IndirectBufferCache(Memory& memory);
+  IndirectBufferCache(const IndirectBufferCache& cache) = delete;
+  IndirectBufferCache& operator=(const IndirectBufferCache& cache) = delete;
+  ~IndirectBufferCache();
+
+  // Returns the decoded contents of the buffer, or nullptr if it should be
+  // executed from the guest memory. Shared as executing the buffer may clear
+  // the cache.
+  std::shared_ptr<Entry> GetDecodedBuffer(uint32_t physical_address,
+                                          uint32_t dword_count);
+
+  void Clear();
+
+ private:
+  static constexpr uint32_t kPhysicalMemorySize = UINT32_C(0x20000000);
+  static constexpr size_t kMaxEntries = 8192;
+  // Contents changes after which the buffer is considered dynamic.
+  static constexpr uint32_t kMaxChangeCount = 2;
+
+  static void Decode(const uint32_t* words, uint32_t dword_count,
+                     Entry& entry);
+  // With the global critical region locked.
+  bool IsWatched(const Entry& entry, uint32_t physical_address,
+                 uint32_t dword_count) const;
+  void Watch(uint32_t physical_address, uint32_t dword_count);
+
+  static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
+      void* context_ptr, uint32_t physical_address_start, uint32_t length,
+      bool exact_range);
+  std::pair<uint32_t, uint32_t> MemoryInvalidationCallback(
+      uint32_t physical_address_start, uint32_t length, bool exact_range);
+
+  Memory& memory_;
+  uint32_t page_size_log2_;
+  void* memory_invalidation_callback_handle_ = nullptr;
+
+  static constexpr xe::global_critical_region global_critical_region_{};
+  // Things below are protected by global_critical_region.
+  // Keyed by the physical address in the upper 32 bits and the dword count in
+  // the lower. Null for the buffers executed only once so far.
+  std::unordered_map<uint64_t, std::shared_ptr<Entry>> entries_;
+  uint64_t invalidation_epoch_ = 0;
+  // The last invalidation_epoch_ when each page was written to.
+  std::vector<uint64_t> page_invalidation_epochs_;
+  // Pages where the cached buffers are watched, to let the memory unwatch
+  // more pages around the written ones.
+  std::vector<uint64_t> watched_pages_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_INDIRECT_BUFFER_CACHE_H_
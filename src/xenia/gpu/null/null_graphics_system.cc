@@ -21,13 +21,19 @@ NullGraphicsSystem::NullGraphicsSystem() {}
 
 NullGraphicsSystem::~NullGraphicsSystem() {}
 
+void NullGraphicsSystem::CreateProvider(bool is_surface_required) {
+  provider_ = xe::ui::vulkan::VulkanProvider::Create(is_surface_required);
+}
+
 X_STATUS NullGraphicsSystem::Setup(cpu::Processor* processor,
                                    kernel::KernelState* kernel_state,
                                    ui::WindowedAppContext* app_context,
                                    bool is_surface_required) {
   // This is a null graphics system, but we still setup vulkan because UI needs
   // it through us :|
-  provider_ = xe::ui::vulkan::VulkanProvider::Create(is_surface_required);
+  if (!provider_) {
+    CreateProvider(is_surface_required);
+  }
   return GraphicsSystem::Setup(processor, kernel_state, app_context,
                                is_surface_required);
 }
@@ -28,6 +28,7 @@ class NullGraphicsSystem : public GraphicsSystem {
 
   std::string name() const override { return "null"; }
 
+  void CreateProvider(bool is_surface_required) override;
   X_STATUS Setup(cpu::Processor* processor, kernel::KernelState* kernel_state,
                  ui::WindowedAppContext* app_context,
                  bool is_surface_required) override;
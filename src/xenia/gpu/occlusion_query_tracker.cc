@@ -0,0 +1,173 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/occlusion_query_tracker.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/gpu/xenos.h"
+
+DEFINE_bool(query_occlusion_host, false,
+            "Emulate occlusion queries with host occlusion queries instead of "
+            "reporting query_occlusion_fake_sample_count. The results are "
+            "obtained asynchronously, so the result of the previous query at "
+            "the same address, usually of the previous frame, is reported, "
+            "and query_occlusion_fake_sample_count is reported only for the "
+            "first one. Not supported with the pixel shader interlock render "
+            "target paths.",
+            "GPU");
+
+namespace xe {
+namespace gpu {
+
+bool OcclusionQueryTracker::IsHostQueryingRequested() {
+  return cvars::query_occlusion_host;
+}
+
+void OcclusionQueryTracker::Reset() {
+  guest_queries_.clear();
+  guest_query_active_ = false;
+  guest_query_host_queries_exhausted_ = false;
+  host_query_next_ = 0;
+  host_queries_in_flight_ = 0;
+  host_query_active_ = false;
+  submission_host_query_first_ = 0;
+  submission_host_query_count_ = 0;
+  last_known_sample_counts_.clear();
+}
+
+void OcclusionQueryTracker::BeginGuestQuery() {
+  assert_false(host_query_active_);
+  if (guest_query_active_) {
+    // Never ended - drop the result.
+    GuestQuery& replaced_query = guest_queries_.back();
+    replaced_query.sample_counts_address = 0;
+    replaced_query.ended = true;
+  }
+  GuestQuery& guest_query = guest_queries_.emplace_back();
+  guest_query.sample_counts_address = 0;
+  guest_query.sample_count_written = 0;
+  guest_query.host_query_first = host_query_next_;
+  guest_query.host_query_count = 0;
+  guest_query.host_query_last_submission = 0;
+  guest_query.ended = false;
+  guest_query_active_ = true;
+  guest_query_host_queries_exhausted_ = false;
+}
+
+uint32_t OcclusionQueryTracker::EndGuestQuery(uint32_t sample_counts_address,
+                                              uint32_t fallback_sample_count) {
+  assert_false(host_query_active_);
+  uint32_t sample_count = fallback_sample_count;
+  auto last_known_it = last_known_sample_counts_.find(sample_counts_address);
+  if (last_known_it != last_known_sample_counts_.end()) {
+    sample_count = last_known_it->second;
+  }
+  if (!guest_query_active_) {
+    return sample_count;
+  }
+  GuestQuery& guest_query = guest_queries_.back();
+  if (!guest_query_host_queries_exhausted_) {
+    guest_query.sample_counts_address = sample_counts_address;
+    if (!guest_query.host_query_count) {
+      // Nothing drawn - the result is known already.
+      sample_count = 0;
+    }
+  }
+  guest_query.sample_count_written = sample_count;
+  guest_query.ended = true;
+  guest_query_active_ = false;
+  return sample_count;
+}
+
+uint32_t OcclusionQueryTracker::BeginHostQuery(uint64_t submission) {
+  assert_false(host_query_active_);
+  if (!guest_query_active_ || guest_query_host_queries_exhausted_) {
+    return UINT32_MAX;
+  }
+  if (host_queries_in_flight_ >= kHostQueryCount) {
+    guest_query_host_queries_exhausted_ = true;
+    return UINT32_MAX;
+  }
+  uint32_t host_query = host_query_next_;
+  host_query_next_ = (host_query_next_ + 1) % kHostQueryCount;
+  ++host_queries_in_flight_;
+  GuestQuery& guest_query = guest_queries_.back();
+  ++guest_query.host_query_count;
+  guest_query.host_query_last_submission = submission;
+  if (!submission_host_query_count_) {
+    submission_host_query_first_ = host_query;
+  }
+  ++submission_host_query_count_;
+  host_query_active_ = true;
+  return host_query;
+}
+
+uint32_t OcclusionQueryTracker::EndHostQuery() {
+  if (!host_query_active_) {
+    return UINT32_MAX;
+  }
+  host_query_active_ = false;
+  return (host_query_next_ + kHostQueryCount - 1) % kHostQueryCount;
+}
+
+uint32_t OcclusionQueryTracker::TakeSubmissionHostQueries(uint32_t& first_out) {
+  assert_false(host_query_active_);
+  first_out = submission_host_query_first_;
+  uint32_t count = submission_host_query_count_;
+  submission_host_query_count_ = 0;
+  return count;
+}
+
+bool OcclusionQueryTracker::GetCompletedGuestQuery(
+    uint64_t submission_completed, uint32_t& host_query_first_out,
+    uint32_t& host_query_count_out) const {
+  if (guest_queries_.empty()) {
+    return false;
+  }
+  const GuestQuery& guest_query = guest_queries_.front();
+  if (!guest_query.ended ||
+      guest_query.host_query_last_submission > submission_completed) {
+    return false;
+  }
+  host_query_first_out = guest_query.host_query_first;
+  host_query_count_out = guest_query.host_query_count;
+  return true;
+}
+
+void OcclusionQueryTracker::CompleteGuestQuery(uint64_t sample_count,
+                                               const Memory& memory) {
+  assert_false(guest_queries_.empty());
+  const GuestQuery& guest_query = guest_queries_.front();
+  assert_true(host_queries_in_flight_ >= guest_query.host_query_count);
+  host_queries_in_flight_ -= guest_query.host_query_count;
+  if (sample_count != UINT64_MAX && guest_query.sample_counts_address) {
+    uint32_t sample_count_32 =
+        uint32_t(std::min(sample_count, uint64_t(UINT32_MAX)));
+    last_known_sample_counts_[guest_query.sample_counts_address] =
+        sample_count_32;
+    // Update the result if the guest hasn't reset the memory for another query
+    // yet.
+    auto& sample_counts =
+        *memory.TranslatePhysical<xenos::xe_gpu_depth_sample_counts*>(
+            guest_query.sample_counts_address);
+    if (sample_counts.ZPass_A == guest_query.sample_count_written &&
+        sample_counts.Total_A == guest_query.sample_count_written &&
+        !sample_counts.ZPass_B && !sample_counts.Total_B) {
+      sample_counts.ZPass_A = sample_count_32;
+      sample_counts.Total_A = sample_count_32;
+    }
+  }
+  guest_queries_.pop_front();
+}
+
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,115 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_OCCLUSION_QUERY_TRACKER_H_
+#define XENIA_GPU_OCCLUSION_QUERY_TRACKER_H_
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+
+#include "xenia/base/hash.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace gpu {
+
+// Backend-independent bookkeeping for emulating guest occlusion queries
+// (EVENT_WRITE_ZPD) with host occlusion queries without stalling.
+//
+// A guest query is covered by a series of host queries, each spanning a run of
+// guest draws - the backend ends the host query before any other work (such as
+// render target ownership transfers, which would also pass the depth test, or
+// submission and render pass boundaries that host queries can't span) and
+// begins a new one before the next guest draw. The host queries are allocated
+// from a ring, so the host queries of one guest query are consecutive in it
+// modulo kHostQueryCount, and the guest queries are completed in order.
+//
+// When the guest ends a query, the result can't be known yet, so the last
+// result known for the same guest address (likely the same query object issued
+// in the previous frame) is returned immediately, or the fallback if there's
+// none. When the host results arrive, they become the last known result, and,
+// if the guest hasn't reused the memory yet, are also written to it.
+class OcclusionQueryTracker {
+ public:
+  static constexpr uint32_t kHostQueryCount = 8192;
+
+  // Whether host queries should be used (--query_occlusion_host).
+  static bool IsHostQueryingRequested();
+
+  OcclusionQueryTracker() = default;
+  OcclusionQueryTracker(const OcclusionQueryTracker& tracker) = delete;
+  OcclusionQueryTracker& operator=(const OcclusionQueryTracker& tracker) =
+      delete;
+
+  // Drops all the queries in flight and the known results.
+  void Reset();
+
+  // The host query, if active, must be ended before calling these. A guest
+  // query begun while another one is active replaces it.
+  void BeginGuestQuery();
+  // Returns the sample count to write to the guest memory now.
+  uint32_t EndGuestQuery(uint32_t sample_counts_address,
+                         uint32_t fallback_sample_count);
+  bool is_guest_query_active() const { return guest_query_active_; }
+
+  // Returns the index of the host query to begin, or UINT32_MAX if no host
+  // query is needed or all of them are in flight (in this case, the result of
+  // the guest query will be unknown).
+  uint32_t BeginHostQuery(uint64_t submission);
+  // Returns the index of the host query to end, or UINT32_MAX if none is
+  // active.
+  uint32_t EndHostQuery();
+  bool is_host_query_active() const { return host_query_active_; }
+
+  // Returns the range (possibly wrapping around the ring) of the host queries
+  // begun since the last call, to reset or to resolve for the submission being
+  // ended, or 0 as the count if there are none. The host query must be ended.
+  uint32_t TakeSubmissionHostQueries(uint32_t& first_out);
+
+  // Returns the range (possibly wrapping around the ring, and possibly empty)
+  // of the host queries to sum the results of for the oldest guest query if
+  // all its host queries have been completed.
+  bool GetCompletedGuestQuery(uint64_t submission_completed,
+                              uint32_t& host_query_first_out,
+                              uint32_t& host_query_count_out) const;
+  // Takes the total result of the oldest guest query returned by
+  // GetCompletedGuestQuery, in guest samples, or UINT64_MAX if the results
+  // couldn't be obtained.
+  void CompleteGuestQuery(uint64_t sample_count, const Memory& memory);
+
+ private:
+  struct GuestQuery {
+    // 0 if the result should be dropped.
+    uint32_t sample_counts_address;
+    uint32_t sample_count_written;
+    uint32_t host_query_first;
+    uint32_t host_query_count;
+    uint64_t host_query_last_submission;
+    bool ended;
+  };
+
+  std::deque<GuestQuery> guest_queries_;
+  bool guest_query_active_ = false;
+  bool guest_query_host_queries_exhausted_ = false;
+
+  uint32_t host_query_next_ = 0;
+  uint32_t host_queries_in_flight_ = 0;
+  bool host_query_active_ = false;
+  uint32_t submission_host_query_first_ = 0;
+  uint32_t submission_host_query_count_ = 0;
+
+  std::unordered_map<uint32_t, uint32_t, xe::hash::IdentityHasher<uint32_t>>
+      last_known_sample_counts_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_OCCLUSION_QUERY_TRACKER_H_
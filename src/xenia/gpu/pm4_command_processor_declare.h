@@ -5,6 +5,9 @@
 #else
 #define PM4_OVERRIDE
 #endif
+// Cache lines at the beginning of the next indirect buffer to prefetch while
+// the current one is executed.
+static constexpr uint32_t kIndirectBufferPrefetchLines = 16;
 void ExecuteIndirectBuffer(uint32_t ptr,
                            uint32_t count) XE_RESTRICT;
 virtual uint32_t ExecutePrimaryBuffer(uint32_t start_index, uint32_t end_index)
@@ -13,6 +13,43 @@ void COMMAND_PROCESSOR::ExecuteIndirectBuffer(uint32_t ptr,
   if (count != 0) {
     RingBuffer old_reader = reader_;
 
+    // The packets must be seen individually for tracing and disassembly.
+    bool use_indirect_buffer_cache =
+        indirect_buffer_cache_ && !trace_writer_.is_open();
+#if XE_ENABLE_PM4_DISASM == 1
+    use_indirect_buffer_cache &= !cvars::disassemble_pm4;
+#endif
+    std::shared_ptr<IndirectBufferCache::Entry> decoded_buffer;
+    if (use_indirect_buffer_cache) {
+      decoded_buffer = indirect_buffer_cache_->GetDecodedBuffer(ptr, count);
+    }
+    if (decoded_buffer) {
+      uint32_t* register_values = decoded_buffer->register_values.data();
+      for (const IndirectBufferCache::Segment& segment :
+           decoded_buffer->segments) {
+        if (segment.register_count) {
+          COMMAND_PROCESSOR::WriteRegistersFromMem(
+              segment.first, register_values + segment.data,
+              segment.register_count);
+          continue;
+        }
+        new (&reader_) RingBuffer(
+            memory_->TranslatePhysical(ptr +
+                                       segment.first * sizeof(uint32_t)),
+            segment.data * sizeof(uint32_t));
+        reader_.set_write_offset(segment.data * sizeof(uint32_t));
+        do {
+          if (!COMMAND_PROCESSOR::ExecutePacket()) {
+            XELOGE("**** INDIRECT RINGBUFFER: Failed to execute packet.");
+            assert_always();
+          }
+        } while (reader_.read_count());
+      }
+      trace_writer_.WriteIndirectBufferEnd();
+      reader_ = old_reader;
+      return;
+    }
+
     // Execute commands!
     new (&reader_)
         RingBuffer(memory_->TranslatePhysical(ptr), count * sizeof(uint32_t));
@@ -662,8 +699,15 @@ bool COMMAND_PROCESSOR::ExecutePacketType3_XE_SWAP(uint32_t packet,
 
   COMMAND_PROCESSOR::IssueSwap(frontbuffer_ptr, frontbuffer_width,
                                frontbuffer_height);
+  if (draw_resolution_scale_controller_.EndFrame()) {
+    context_restart_pending_ = true;
+  }
 
   ++counter_;
+  trace_events::OnFrame();
+  if (swap_callback_) {
+    swap_callback_();
+  }
   return true;
 }
 
@@ -674,6 +718,36 @@ bool COMMAND_PROCESSOR::ExecutePacketType3_INDIRECT_BUFFER(
   uint32_t list_length = reader_.ReadAndSwap<uint32_t>();
   assert_zero(list_length & ~0xFFFFF);
   list_length &= 0xFFFFF;
+  // Primary buffers usually consist of consecutive indirect buffer packets -
+  // start loading the beginning of the next indirect buffer, if there is one,
+  // while this one is being executed, as the hardware prefetcher can't predict
+  // the jump to a different location in the guest memory.
+  if (reader_.read_count() >= sizeof(uint32_t) * 3 &&
+      reader_.read_offset() + sizeof(uint32_t) * 3 <= reader_.capacity()) {
+    const uint8_t* next_packet_ptr = reader_.buffer() + reader_.read_offset();
+    uint32_t next_packet = xe::load_and_swap<uint32_t>(next_packet_ptr);
+    uint32_t next_opcode = (next_packet >> 8) & 0x7F;
+    if ((next_packet >> 30) == 3 && ((next_packet >> 16) & 0x3FFF) == 1 &&
+        (next_opcode == PM4_INDIRECT_BUFFER ||
+         next_opcode == PM4_INDIRECT_BUFFER_PFD)) {
+      uint32_t next_list_ptr = GpuToCpu(CpuToGpu(xe::load_and_swap<uint32_t>(
+          next_packet_ptr + sizeof(uint32_t))));
+      uint32_t next_list_length =
+          xe::load_and_swap<uint32_t>(next_packet_ptr + sizeof(uint32_t) * 2) &
+          0xFFFFF;
+      const uint8_t* next_list =
+          memory_->TranslatePhysical<const uint8_t*>(next_list_ptr);
+      uint32_t next_list_prefetch_lines =
+          std::min(xe::align(uint32_t(sizeof(uint32_t) * next_list_length),
+                             uint32_t(XE_HOST_CACHE_LINE_SIZE)) /
+                       uint32_t(XE_HOST_CACHE_LINE_SIZE),
+                   kIndirectBufferPrefetchLines);
+      for (uint32_t i = 0; i < next_list_prefetch_lines; ++i) {
+        swcache::Prefetch<swcache::PrefetchTag::Level2>(
+            next_list + XE_HOST_CACHE_LINE_SIZE * i);
+      }
+    }
+  }
   COMMAND_PROCESSOR::ExecuteIndirectBuffer(GpuToCpu(list_ptr), list_length);
   return true;
 }
@@ -972,12 +1046,15 @@ bool COMMAND_PROCESSOR::ExecutePacketType3_EVENT_WRITE_ZPD(
 
   // Occlusion queries:
   // This command is send on query begin and end.
-  // As a workaround report some fixed amount of passed samples.
+  // Unless the backend measures the sample counts with host queries, report
+  // some fixed amount of passed samples as a workaround.
   auto fake_sample_count = cvars::query_occlusion_fake_sample_count;
   if (fake_sample_count >= 0) {
+    uint32_t sample_counts_address =
+        register_file_->values[XE_GPU_REG_RB_SAMPLE_COUNT_ADDR].u32;
     auto* pSampleCounts =
         memory_->TranslatePhysical<xe_gpu_depth_sample_counts*>(
-            register_file_->values[XE_GPU_REG_RB_SAMPLE_COUNT_ADDR].u32);
+            sample_counts_address);
     // 0xFFFFFEED is written to this two locations by D3D only on D3DISSUE_END
     // and used to detect a finished query.
     bool is_end_via_z_pass = pSampleCounts->ZPass_A == kQueryFinished &&
@@ -987,8 +1064,12 @@ bool COMMAND_PROCESSOR::ExecutePacketType3_EVENT_WRITE_ZPD(
                              pSampleCounts->ZFail_B == kQueryFinished;
     std::memset(pSampleCounts, 0, sizeof(xe_gpu_depth_sample_counts));
     if (is_end_via_z_pass || is_end_via_z_fail) {
-      pSampleCounts->ZPass_A = fake_sample_count;
-      pSampleCounts->Total_A = fake_sample_count;
+      uint32_t sample_count =
+          EndOcclusionQuery(sample_counts_address, uint32_t(fake_sample_count));
+      pSampleCounts->ZPass_A = sample_count;
+      pSampleCounts->Total_A = sample_count;
+    } else {
+      BeginOcclusionQuery();
     }
   }
 
@@ -1090,6 +1171,9 @@ bool COMMAND_PROCESSOR::ExecutePacketType3Draw(
       // shader has memexport.
       // TODO(Triang3l || JoelLinn): Handle this properly in the render
       // backends.
+      // Invalidate what the CPU has written since the last draw if not
+      // notified on every write.
+      memory_->CollectPhysicalMemoryWrites();
       draw_succeeded = COMMAND_PROCESSOR::IssueDraw(
           vgt_draw_initiator.prim_type, vgt_draw_initiator.num_indices,
           is_indexed ? &index_buffer_info : nullptr,
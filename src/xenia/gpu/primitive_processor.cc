@@ -1008,6 +1008,22 @@ bool PrimitiveProcessor::IsResetUsed(const uint16_t* source, uint32_t count,
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
+#if XE_ARCH_AMD64
+    if (IsAvx2Available()) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+      while (count >= 2 * kSimdVectorU16Elements) {
+        count -= 2 * kSimdVectorU16Elements;
+        __m256i source_avx2 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        source += 2 * kSimdVectorU16Elements;
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(
+                source_avx2, reset_index_guest_endian_avx2))) {
+          return true;
+        }
+      }
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU16Elements) {
       count -= kSimdVectorU16Elements;
       SimdVectorU16 source_simd = LoadAlignedVectorU16(source);
@@ -1070,6 +1086,30 @@ void PrimitiveProcessor::Get16BitResetIndexUsage(
     SimdVectorU16 ffff_simd = ReplicateU16(UINT16_MAX);
     SimdVectorU16 is_reset_simd = ReplicateU16(0);
     SimdVectorU16 is_ffff_simd = ReplicateU16(0);
+#if XE_ARCH_AMD64
+    if (IsAvx2Available() && count >= 2 * kSimdVectorU16Elements) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+      __m256i ffff_avx2 = _mm256_broadcastsi128_si256(ffff_simd);
+      __m256i is_reset_avx2 = _mm256_setzero_si256();
+      __m256i is_ffff_avx2 = _mm256_setzero_si256();
+      while (count >= 2 * kSimdVectorU16Elements) {
+        count -= 2 * kSimdVectorU16Elements;
+        __m256i source_avx2 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        source += 2 * kSimdVectorU16Elements;
+        is_reset_avx2 = _mm256_or_si256(
+            is_reset_avx2,
+            _mm256_cmpeq_epi16(source_avx2, reset_index_guest_endian_avx2));
+        is_ffff_avx2 = _mm256_or_si256(
+            is_ffff_avx2, _mm256_cmpeq_epi16(source_avx2, ffff_avx2));
+      }
+      is_reset_simd = _mm_or_si128(_mm256_castsi256_si128(is_reset_avx2),
+                                   _mm256_extracti128_si256(is_reset_avx2, 1));
+      is_ffff_simd = _mm_or_si128(_mm256_castsi256_si128(is_ffff_avx2),
+                                  _mm256_extracti128_si256(is_ffff_avx2, 1));
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU16Elements) {
       count -= kSimdVectorU16Elements;
       SimdVectorU16 source_simd = LoadAlignedVectorU16(source);
@@ -1139,6 +1179,25 @@ bool PrimitiveProcessor::IsResetUsed(const uint32_t* source, uint32_t count,
   if (count >= kSimdVectorU32Elements) {
     SimdVectorU32 reset_index_guest_endian_simd =
         ReplicateU32(reset_index_guest_endian);
+#if XE_ARCH_AMD64
+    if (IsAvx2Available()) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_set1_epi32(int32_t(reset_index_guest_endian));
+      __m256i low_bits_mask_guest_endian_avx2 =
+          _mm256_set1_epi32(int32_t(low_bits_mask_guest_endian));
+      while (count >= 2 * kSimdVectorU32Elements) {
+        count -= 2 * kSimdVectorU32Elements;
+        __m256i source_avx2 = _mm256_and_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)),
+            low_bits_mask_guest_endian_avx2);
+        source += 2 * kSimdVectorU32Elements;
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(
+                source_avx2, reset_index_guest_endian_avx2))) {
+          return true;
+        }
+      }
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU32Elements) {
       count -= kSimdVectorU32Elements;
       SimdVectorU32 source_simd = LoadAlignedVectorU32(source);
@@ -1186,6 +1245,24 @@ void PrimitiveProcessor::ReplaceResetIndex16To16(
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
+#if XE_ARCH_AMD64
+    if (IsAvx2Available()) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+      while (count >= 2 * kSimdVectorU16Elements) {
+        count -= 2 * kSimdVectorU16Elements;
+        __m256i source_avx2 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        source += 2 * kSimdVectorU16Elements;
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(dest),
+            _mm256_or_si256(source_avx2,
+                            _mm256_cmpeq_epi16(source_avx2,
+                                               reset_index_guest_endian_avx2)));
+        dest += 2 * kSimdVectorU16Elements;
+      }
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU16Elements) {
       count -= kSimdVectorU16Elements;
       // Comparison produces 0 or 0xFFFF on AVX and Neon - we need 0xFFFF as the
@@ -1311,9 +1388,8 @@ PrimitiveProcessor::ReplaceResetIndex32To24<xenos::Endian::k16in32>(
 XE_GPU_PRIMITIVE_PROCESSOR_INSTANTIATE_CONVERSION(TriangleFanToList)
 XE_GPU_PRIMITIVE_PROCESSOR_INSTANTIATE_CONVERSION_NO_PASSTHROUGH(
     LineLoopToStrip)
-// TODO(Triang3l): SIMD quad conversion maybe - 2 vectors to 3 vectors (though
-// multiple quads are rarely drawn anyway).
-XE_GPU_PRIMITIVE_PROCESSOR_INSTANTIATE_CONVERSION(QuadListToTriangleList)
+XE_GPU_PRIMITIVE_PROCESSOR_INSTANTIATE_CONVERSION_NO_PASSTHROUGH(
+    QuadListToTriangleList)
 #undef XE_GPU_PRIMITIVE_PROCESSOR_INSTANTIATE_CONVERSION_NO_PASSTHROUGH
 #undef XE_GPU_PRIMITIVE_PROCESSOR_INSTANTIATE_CONVERSION
 
@@ -1338,6 +1414,92 @@ void PrimitiveProcessor::LineLoopToStrip(
   dest[source_index_count] = source[0];
 }
 
+// Every vector of quads is shuffled into 1.5 vectors of triangles, the full
+// vector from the first part of the quads, and the half vector from the rest.
+// Byte shuffle indices, 0xFF (zero on both AMD64 and ARM64) for the unused
+// bytes of the half vector.
+#if XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE
+alignas(16) static const uint8_t kQuadListToTriangleList16Shuffles[2][16] = {
+    // (q0v0, q0v1, q0v2), (q0v0, q0v2, q0v3), (q1v0, q1v1,
+    {0, 1, 2, 3, 4, 5, 0, 1, 4, 5, 6, 7, 8, 9, 10, 11},
+    // q1v2), (q1v0, q1v2, q1v3).
+    {12, 13, 8, 9, 12, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+     0xFF},
+};
+alignas(16) static const uint8_t kQuadListToTriangleList32Shuffles[2][16] = {
+    // (v0, v1, v2), (v0,
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3},
+    // v2, v3).
+    {8, 9, 10, 11, 12, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+     0xFF},
+};
+
+template <typename Index>
+static void QuadListVectorsToTriangleList(
+    Index*& dest, const Index*& source, uint32_t& quad_count,
+    const uint8_t (&shuffles)[2][16]) {
+  constexpr uint32_t kVectorQuadCount =
+      XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE / (sizeof(Index) * 4);
+  if (quad_count < kVectorQuadCount) {
+    return;
+  }
+#if XE_ARCH_AMD64
+  __m128i shuffle_0 =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(shuffles[0]));
+  __m128i shuffle_1 =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(shuffles[1]));
+#elif XE_ARCH_ARM64
+  uint8x16_t shuffle_0 = vld1q_u8(shuffles[0]);
+  uint8x16_t shuffle_1 = vld1q_u8(shuffles[1]);
+#else
+#error SIMD QuadListToTriangleList not implemented.
+#endif  // XE_ARCH
+  while (quad_count >= kVectorQuadCount) {
+    quad_count -= kVectorQuadCount;
+#if XE_ARCH_AMD64
+    __m128i quads = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest),
+                     _mm_shuffle_epi8(quads, shuffle_0));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(
+                         reinterpret_cast<uint8_t*>(dest) +
+                         XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE),
+                     _mm_shuffle_epi8(quads, shuffle_1));
+#elif XE_ARCH_ARM64
+    uint8x16_t quads = vld1q_u8(reinterpret_cast<const uint8_t*>(source));
+    vst1q_u8(reinterpret_cast<uint8_t*>(dest), vqtbl1q_u8(quads, shuffle_0));
+    vst1_u8(reinterpret_cast<uint8_t*>(dest) +
+                XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE,
+            vget_low_u8(vqtbl1q_u8(quads, shuffle_1)));
+#endif  // XE_ARCH
+    source += kVectorQuadCount * 4;
+    dest += kVectorQuadCount * 6;
+  }
+}
+#endif  // XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE
+
+void PrimitiveProcessor::QuadListToTriangleList(
+    uint16_t* dest, const uint16_t* source, uint32_t source_index_count,
+    const PassthroughIndexTransform& index_transform) {
+  uint32_t quad_count = source_index_count / 4;
+#if XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE
+  QuadListVectorsToTriangleList(dest, source, quad_count,
+                                kQuadListToTriangleList16Shuffles);
+#endif  // XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE
+  QuadListToTriangleList<uint16_t, PassthroughIndexTransform>(
+      dest, source, quad_count * 4, index_transform);
+}
+void PrimitiveProcessor::QuadListToTriangleList(
+    uint32_t* dest, const uint32_t* source, uint32_t source_index_count,
+    const PassthroughIndexTransform& index_transform) {
+  uint32_t quad_count = source_index_count / 4;
+#if XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE
+  QuadListVectorsToTriangleList(dest, source, quad_count,
+                                kQuadListToTriangleList32Shuffles);
+#endif  // XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE
+  QuadListToTriangleList<uint32_t, PassthroughIndexTransform>(
+      dest, source, quad_count * 4, index_transform);
+}
+
 uint32_t PrimitiveProcessor::GetMultiPrimitiveHostIndexCountAndRanges(
     std::function<uint32_t(uint32_t)> single_primitive_guest_to_host_count,
     const uint16_t* source, uint32_t source_index_count,
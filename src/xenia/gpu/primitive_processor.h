@@ -36,7 +36,9 @@
 #if XE_ARCH_AMD64
 // 128-bit SSSE3-level (SSE2+ for integer comparison, SSSE3 for pshufb) or AVX
 // (256-bit AVX only got integer operations such as comparison in AVX2, which is
-// above the minimum requirements of Xenia).
+// above the minimum requirements of Xenia, so it's used only if detected at
+// runtime, for the bulk of the data after the 128-bit alignment prologue).
+#include <immintrin.h>
 #include <tmmintrin.h>
 #define XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE 16
 #elif XE_ARCH_ARM64
@@ -340,6 +342,9 @@ class PrimitiveProcessor {
   static void StoreUnalignedVectorU32(uint32_t* dest, SimdVectorU32 source) {
     _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), source);
   }
+  static bool IsAvx2Available() {
+    return (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) != 0;
+  }
 #elif XE_ARCH_ARM64
   // NEON.
   using SimdVectorU16 = uint16x8_t;
@@ -447,6 +452,33 @@ class PrimitiveProcessor {
             int32_t(xenos::GpuSwapInline(uint32_t(0x07060504), HostSwap)),
             int32_t(xenos::GpuSwapInline(uint32_t(0x03020100), HostSwap)));
       }
+      if (IsAvx2Available()) {
+        __m256i reset_index_guest_endian_avx2 =
+            _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+        __m256i low_bits_mask_guest_endian_avx2 =
+            _mm256_broadcastsi128_si256(low_bits_mask_guest_endian_simd);
+        __m256i host_swap_shuffle_avx2;
+        if constexpr (HostSwap != xenos::Endian::kNone) {
+          host_swap_shuffle_avx2 =
+              _mm256_broadcastsi128_si256(host_swap_shuffle);
+        }
+        while (count >= 2 * kSimdVectorU32Elements) {
+          count -= 2 * kSimdVectorU32Elements;
+          __m256i source_avx2 = _mm256_and_si256(
+              _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)),
+              low_bits_mask_guest_endian_avx2);
+          source += 2 * kSimdVectorU32Elements;
+          __m256i result_avx2 = _mm256_or_si256(
+              source_avx2,
+              _mm256_cmpeq_epi32(source_avx2, reset_index_guest_endian_avx2));
+          if constexpr (HostSwap != xenos::Endian::kNone) {
+            result_avx2 =
+                _mm256_shuffle_epi8(result_avx2, host_swap_shuffle_avx2);
+          }
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), result_avx2);
+          dest += 2 * kSimdVectorU32Elements;
+        }
+      }
 #endif  // XE_ARCH_AMD64
       while (count >= kSimdVectorU32Elements) {
         count -= kSimdVectorU32Elements;
@@ -622,6 +654,13 @@ class PrimitiveProcessor {
       *(dest++) = index_transform(*(source++));
     }
   }
+  // Shuffling whole vectors of quads without index transformation.
+  static void QuadListToTriangleList(
+      uint16_t* dest, const uint16_t* source, uint32_t source_index_count,
+      const PassthroughIndexTransform& index_transform);
+  static void QuadListToTriangleList(
+      uint32_t* dest, const uint32_t* source, uint32_t source_index_count,
+      const PassthroughIndexTransform& index_transform);
 
   // Pre-gathering the ranges allows for usage of the same functions for
   // conversion with and without reset. In addition, this increases safety in
@@ -21,6 +21,7 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/profiling.h"
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/registers.h"
@@ -569,7 +570,32 @@ void RenderTargetCache::ClearCache() {
   }
 }
 
-void RenderTargetCache::BeginFrame() { ResetAccumulatedRenderTargets(); }
+void RenderTargetCache::BeginFrame() {
+  ResetAccumulatedRenderTargets();
+
+  COUNT_profile_set("gpu/render_target_cache/transfers_per_frame",
+                    transfers_frame_);
+  COUNT_profile_set("gpu/render_target_cache/transfer_tiles_per_frame",
+                    transfer_tiles_frame_);
+  COUNT_profile_set(
+      "gpu/render_target_cache/transfer_round_trip_skipped_tiles_per_frame",
+      transfer_round_trip_skipped_tiles_frame_);
+  transfers_frame_ = 0;
+  transfer_tiles_frame_ = 0;
+  transfer_round_trip_skipped_tiles_frame_ = 0;
+}
+
+bool RenderTargetCache::IsDrawScissoredOut(const Shader& vertex_shader) {
+  draw_util::Scissor scissor;
+  draw_util::GetScissor(register_file(), scissor);
+  if (!scissor.extent[0] || !scissor.extent[1]) {
+    return true;
+  }
+  // Only the viewport, not executing the vertex shader on the CPU, which
+  // would be too expensive for every draw.
+  return draw_extent_estimator_.EstimateMaxY(false, vertex_shader) <=
+         scissor.offset[1];
+}
 
 bool RenderTargetCache::Update(bool is_rasterization_done,
                                reg::RB_DEPTHCONTROL normalized_depth_control,
@@ -885,10 +911,16 @@ bool RenderTargetCache::Update(bool is_rasterization_done,
   for (uint32_t i = 0; i < edram_bases_sorted_count; ++i) {
     const std::pair<uint32_t, uint32_t>& rt_base_index = edram_bases_sorted[i];
     uint32_t rt_bit_index = rt_base_index.second;
+    // Color render targets are bound only if written to. With pixel shader
+    // interlock, the ownership is used for barriers, always assume writing.
+    bool rt_written = interlock_barrier_only || rt_bit_index != 0 ||
+                      normalized_depth_control.z_write_enable ||
+                      normalized_depth_control.stencil_enable;
     ChangeOwnership(rt_keys[rt_bit_index], 0, rt_lengths_tiles[i],
                     interlock_barrier_only
                         ? nullptr
-                        : &last_update_transfers_[rt_bit_index]);
+                        : &last_update_transfers_[rt_bit_index],
+                    nullptr, rt_written);
   }
 
   if (interlock_barrier_only) {
@@ -1539,7 +1571,7 @@ bool RenderTargetCache::WouldOwnershipChangeRequireTransfers(
 void RenderTargetCache::ChangeOwnership(
     RenderTargetKey dest, uint32_t start_tiles_base_relative,
     uint32_t length_tiles, std::vector<Transfer>* transfers_append_out,
-    const Transfer::Rectangle* resolve_clear_cutout) {
+    const Transfer::Rectangle* resolve_clear_cutout, bool dest_written) {
   // xenos::kEdramTileCount with length 0 is fine if both the start and the end
   // are clamped to xenos::kEdramTileCount.
   assert_true(start_tiles_base_relative <=
@@ -1578,9 +1610,11 @@ void RenderTargetCache::ChangeOwnership(
         // Outside the touched extent already.
         break;
       }
-      if (it->second.IsOwnedBy(dest, host_depth_encoding_different)) {
+      if (it->second.IsOwnedBy(dest, host_depth_encoding_different) &&
+          (!dest_written || it->second.unmodified_source.IsEmpty())) {
         // Already owned by the needed render target - no need to transfer
-        // anything.
+        // anything. If going to write, still need to drop the unmodified
+        // source via the common path.
         ++it;
         continue;
       }
@@ -1591,14 +1625,21 @@ void RenderTargetCache::ChangeOwnership(
         ownership_ranges_.emplace(extent_end, it->second);
         it->second.end_tiles = extent_end;
       }
-      if (transfers_append_out) {
-        RenderTargetKey transfer_source = it->second.render_target;
+      RenderTargetKey previous_owner = it->second.render_target;
+      if (transfers_append_out && !previous_owner.IsEmpty() &&
+          previous_owner != dest && it->second.unmodified_source == dest) {
+        // The destination still has the same data as the current owner.
+        transfer_round_trip_skipped_tiles_frame_ +=
+            std::min(it->second.end_tiles, extent_end) - it->first;
+      } else if (transfers_append_out) {
+        RenderTargetKey transfer_source = previous_owner;
         // Only perform the copying when actually changing the latest owner, not
         // just the latest host depth owner - the transfer source is expected to
         // be different than the destination.
         if (!transfer_source.IsEmpty() && transfer_source != dest) {
           uint32_t transfer_end_tiles =
               std::min(it->second.end_tiles, extent_end);
+          transfer_tiles_frame_ += transfer_end_tiles - it->first;
           if (!resolve_clear_cutout ||
               Transfer::GetRangeRectangles(it->first, transfer_end_tiles,
                                            dest.base_tiles, dest_pitch_tiles,
@@ -1624,6 +1665,7 @@ void RenderTargetCache::ChangeOwnership(
               // but host depth is different.
               transfers_append_out->back().end_tiles = transfer_end_tiles;
             } else {
+              ++transfers_frame_;
               auto transfer_source_rt_it =
                   render_targets_.find(transfer_source);
               if (transfer_source_rt_it != render_targets_.end()) {
@@ -1651,6 +1693,9 @@ void RenderTargetCache::ChangeOwnership(
       }
       // Claim the current range.
       it->second.render_target = dest;
+      it->second.unmodified_source =
+          (!dest_written && previous_owner != dest) ? previous_owner
+                                                    : RenderTargetKey();
       if (host_depth_encoding_different) {
         it->second.GetHostDepthRenderTarget(dest.GetDepthFormat()) = dest;
       }
@@ -216,6 +216,12 @@ class RenderTargetCache {
                       uint32_t normalized_color_mask,
                       const Shader& vertex_shader);
 
+  // Whether the current draw can't cover any pixels because the scissor
+  // rectangle is empty or is entirely below the viewport, checked without
+  // processing the vertices. Such a draw can be dropped without calling Update
+  // if it has no side effects other than rasterization.
+  bool IsDrawScissoredOut(const Shader& vertex_shader);
+
   // Returns bits where 0 is whether a depth render target is currently bound on
   // the host and 1... are whether the same applies to color render targets, and
   // formats (resource formats, but if needed, with gamma taken into account) of
@@ -651,6 +657,12 @@ class RenderTargetCache {
     // empty too.
     RenderTargetKey host_depth_render_target_unorm24;
     RenderTargetKey host_depth_render_target_float24;
+    // Previous owner of the range if its data was transferred to the current
+    // owner, and the current owner hasn't been written to in this range since
+    // then, so the data in both is the same, and transferring it back to the
+    // previous owner can be skipped. Neither can be modified without changing
+    // the ownership (or writing to the current owner, which resets this).
+    RenderTargetKey unmodified_source;
     OwnershipRange(uint32_t end_tiles, RenderTargetKey render_target,
                    RenderTargetKey host_depth_render_target_unorm24,
                    RenderTargetKey host_depth_render_target_float24)
@@ -694,7 +706,8 @@ class RenderTargetCache {
              host_depth_render_target_unorm24 ==
                  other_range.host_depth_render_target_unorm24 &&
              host_depth_render_target_float24 ==
-                 other_range.host_depth_render_target_float24;
+                 other_range.host_depth_render_target_float24 &&
+             unmodified_source == other_range.unmodified_source;
     }
   };
 
@@ -720,11 +733,20 @@ class RenderTargetCache {
                                             uint32_t start_tiles_base_relative,
                                             uint32_t length_tiles) const;
   // Updates ownership_ranges_, adds the transfers needed for the ownership
-  // change to transfers_append_out if it's not null.
+  // change to transfers_append_out if it's not null. dest_written must be true
+  // if the range may be modified in the destination after the ownership change
+  // (false only if it's just going to be read, such as when depth / stencil
+  // testing without writing).
   void ChangeOwnership(
       RenderTargetKey dest, uint32_t start_tiles_base_relative,
       uint32_t length_tiles, std::vector<Transfer>* transfers_append_out,
-      const Transfer::Rectangle* resolve_clear_cutout = nullptr);
+      const Transfer::Rectangle* resolve_clear_cutout = nullptr,
+      bool dest_written = true);
+
+  // Ownership transfer statistics for the current frame, in tiles.
+  uint32_t transfers_frame_ = 0;
+  uint32_t transfer_tiles_frame_ = 0;
+  uint32_t transfer_round_trip_skipped_tiles_frame_ = 0;
 
   // If failed to create, may contain nullptr to prevent attempting to create a
   // render target twice.
@@ -857,6 +857,18 @@ class Shader {
   // ucode_disasm_buffer is temporary storage for disassembly (provided
   // externally so it won't need to be reallocated for every shader).
   void AnalyzeUcode(StringBuffer& ucode_disasm_buffer);
+  // Appends the results of AnalyzeUcode to the data, for persistent storage
+  // along with the ucode, so the analysis doesn't need to be done again for the
+  // shader loaded from the storage. The data is in the host byte order and
+  // layout, and isn't portable between builds with a different layout of the
+  // structures (which is checked when deserializing).
+  void SerializeUcodeAnalysis(std::vector<uint8_t>& data_out) const;
+  // Sets the results of the ucode analysis from the data written by
+  // SerializeUcodeAnalysis instead of doing AnalyzeUcode, returning false, and
+  // leaving the shader not analyzed, if the data is incompatible or corrupted.
+  // The opcode names in the instructions of the bindings are not restored -
+  // they're only used for disassembly during the analysis.
+  bool DeserializeUcodeAnalysis(const void* data, size_t data_size);
 
   // The following parameters, until the translation, are valid if ucode
   // information has been gathered.
@@ -7,10 +7,16 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <cstring>
+#include <filesystem>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -18,10 +24,14 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/console_app_main.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
 #include "xenia/base/string_buffer.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/dxbc_shader_translator.h"
 #include "xenia/gpu/shader_translator.h"
 #include "xenia/gpu/spirv_shader_translator.h"
@@ -33,7 +43,11 @@
 #include "xenia/ui/d3d12/d3d12_api.h"
 #endif  // XE_PLATFORM_WIN32
 
-DEFINE_path(shader_input, "", "Input shader binary file path.", "GPU");
+DEFINE_path(shader_input, "",
+            "Input shader binary file path, or, for translating shaders in "
+            "batch, a guest shader storage (.xsh) file or a directory of "
+            "shader binaries (.vs and .ps).",
+            "GPU");
 DEFINE_string(shader_input_type, "",
               "'vs', 'ps', or unspecified to infer from the given filename.",
               "GPU");
@@ -42,7 +56,20 @@ DEFINE_bool(
     "Whether the input shader binary is little-endian (from an Arm device with "
     "the Qualcomm Adreno 200, for instance).",
     "GPU");
-DEFINE_path(shader_output, "", "Output shader file path.", "GPU");
+DEFINE_path(shader_output, "",
+            "Output shader file path, or the directory to write the shaders "
+            "translated in batch to.",
+            "GPU");
+DEFINE_path(shader_output_storage, "",
+            "For translating shaders in batch, guest shader storage (.xsh) "
+            "file to write the deduplicated input shaders to along with their "
+            "ucode analysis, to be placed in the shader storage directory so "
+            "the analysis is skipped when the emulator loads the shaders.",
+            "GPU");
+DEFINE_uint32(shader_batch_threads, 0,
+              "Number of threads to translate shaders in batch on, or 0 to use "
+              "all logical processors.",
+              "GPU");
 DEFINE_string(shader_output_type, "ucode",
               "Translator to use: [ucode, spirv, spirvtext, dxbc, dxbctext].",
               "GPU");
@@ -50,7 +77,8 @@ DEFINE_string(
     vertex_shader_output_type, "",
     "Type of the host interface to produce the vertex or domain shader for: "
     "[vertex or unspecified, linedomaincp, linedomainpatch, triangledomaincp, "
-    "triangledomainpatch, quaddomaincp, quaddomainpatch].",
+    "triangledomainpatch, quaddomaincp, quaddomainpatch, or all (for "
+    "translating shaders in batch)].",
     "GPU");
 DEFINE_bool(shader_output_bindless_resources, false,
             "Output host shader with bindless resources used.", "GPU");
@@ -63,7 +91,356 @@ DEFINE_bool(
 namespace xe {
 namespace gpu {
 
+static std::unique_ptr<ShaderTranslator> CreateShaderTranslator(
+    const SpirvShaderTranslator::Features& spirv_features) {
+  if (cvars::shader_output_type == "spirv" ||
+      cvars::shader_output_type == "spirvtext") {
+    return std::make_unique<SpirvShaderTranslator>(
+        spirv_features, true, true,
+        cvars::shader_output_pixel_shader_interlock,
+        cvars::shader_output_bindless_resources);
+  }
+  if (cvars::shader_output_type == "dxbc" ||
+      cvars::shader_output_type == "dxbctext") {
+    return std::make_unique<DxbcShaderTranslator>(
+        ui::GraphicsProvider::GpuVendorID(0),
+        cvars::shader_output_bindless_resources,
+        cvars::shader_output_pixel_shader_interlock);
+  }
+  return nullptr;
+}
+
+static std::vector<Shader::HostVertexShaderType> GetHostVertexShaderTypes() {
+  const std::string& type = cvars::vertex_shader_output_type;
+  if (type == "linedomaincp") {
+    return {Shader::HostVertexShaderType::kLineDomainCPIndexed};
+  }
+  if (type == "linedomainpatch") {
+    return {Shader::HostVertexShaderType::kLineDomainPatchIndexed};
+  }
+  if (type == "triangledomaincp") {
+    return {Shader::HostVertexShaderType::kTriangleDomainCPIndexed};
+  }
+  if (type == "triangledomainpatch") {
+    return {Shader::HostVertexShaderType::kTriangleDomainPatchIndexed};
+  }
+  if (type == "quaddomaincp") {
+    return {Shader::HostVertexShaderType::kQuadDomainCPIndexed};
+  }
+  if (type == "quaddomainpatch") {
+    return {Shader::HostVertexShaderType::kQuadDomainPatchIndexed};
+  }
+  if (type == "all") {
+    std::vector<Shader::HostVertexShaderType> types;
+    types.push_back(Shader::HostVertexShaderType::kVertex);
+    for (uint32_t i = uint32_t(Shader::HostVertexShaderType::kDomainStart);
+         i < uint32_t(Shader::HostVertexShaderType::kDomainEnd); ++i) {
+      types.push_back(Shader::HostVertexShaderType(i));
+    }
+    return types;
+  }
+  return {Shader::HostVertexShaderType::kVertex};
+}
+
+// Same layout as the records in the guest shader storage files of the pipeline
+// caches - keep in sync with PipelineCache::ShaderStoredHeader.
+XEPACKEDSTRUCT(BatchShaderStoredHeader, {
+  uint64_t ucode_data_hash;
+
+  uint32_t ucode_dword_count : 31;
+  xenos::ShaderType type : 1;
+
+  uint32_t ucode_analysis_size;
+
+  static constexpr uint32_t kVersion = 0x20241016;
+});
+// 'XESH'.
+constexpr uint32_t kBatchShaderStorageMagic = 0x48534558;
+
+struct BatchShader {
+  xenos::ShaderType type;
+  uint64_t ucode_data_hash;
+  // Guest (big-endian) ucode, as hashed.
+  std::vector<uint32_t> ucode_guest_endian;
+  // The ucode analysis from the input storage, if present.
+  std::vector<uint8_t> ucode_analysis;
+};
+
+static bool LoadBatchShaderStorage(const std::filesystem::path& path,
+                                   std::vector<BatchShader>& shaders) {
+  FILE* file = filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("Unable to open shader storage file: {}", xe::path_to_utf8(path));
+    return false;
+  }
+  struct {
+    uint32_t magic;
+    uint32_t version_swapped;
+  } file_header;
+  if (!fread(&file_header, sizeof(file_header), 1, file) ||
+      file_header.magic != kBatchShaderStorageMagic ||
+      xe::byte_swap(file_header.version_swapped) !=
+          BatchShaderStoredHeader::kVersion) {
+    XELOGE("Shader storage file {} is not compatible with this version",
+           xe::path_to_utf8(path));
+    fclose(file);
+    return false;
+  }
+  BatchShaderStoredHeader shader_header;
+  while (fread(&shader_header, sizeof(shader_header), 1, file)) {
+    BatchShader shader;
+    shader.type = shader_header.type;
+    shader.ucode_data_hash = shader_header.ucode_data_hash;
+    shader.ucode_guest_endian.resize(shader_header.ucode_dword_count);
+    if (shader_header.ucode_dword_count &&
+        !fread(shader.ucode_guest_endian.data(),
+               sizeof(uint32_t) * shader_header.ucode_dword_count, 1, file)) {
+      break;
+    }
+    if (XXH3_64bits(shader.ucode_guest_endian.data(),
+                    sizeof(uint32_t) * shader.ucode_guest_endian.size()) !=
+        shader.ucode_data_hash) {
+      // Stop at the first corrupted shader, like the pipeline caches.
+      break;
+    }
+    shader.ucode_analysis.resize(shader_header.ucode_analysis_size);
+    if (shader_header.ucode_analysis_size &&
+        !fread(shader.ucode_analysis.data(), shader_header.ucode_analysis_size,
+               1, file)) {
+      break;
+    }
+    shaders.push_back(std::move(shader));
+  }
+  fclose(file);
+  return true;
+}
+
+static bool LoadBatchShaderDirectory(const std::filesystem::path& path,
+                                     std::vector<BatchShader>& shaders) {
+  for (const filesystem::FileInfo& file_info : filesystem::ListFiles(path)) {
+    if (file_info.type != filesystem::FileInfo::Type::kFile) {
+      continue;
+    }
+    BatchShader shader;
+    auto extension = file_info.name.extension();
+    if (extension == ".vs") {
+      shader.type = xenos::ShaderType::kVertex;
+    } else if (extension == ".ps") {
+      shader.type = xenos::ShaderType::kPixel;
+    } else {
+      continue;
+    }
+    FILE* file = filesystem::OpenFile(file_info.path, "rb");
+    if (!file) {
+      XELOGW("Unable to open input file: {}",
+             xe::path_to_utf8(file_info.path));
+      continue;
+    }
+    shader.ucode_guest_endian.resize(file_info.total_size / sizeof(uint32_t));
+    shader.ucode_guest_endian.resize(fread(shader.ucode_guest_endian.data(),
+                                           sizeof(uint32_t),
+                                           shader.ucode_guest_endian.size(),
+                                           file));
+    fclose(file);
+    if (cvars::shader_input_little_endian) {
+      xe::copy_and_swap(shader.ucode_guest_endian.data(),
+                        shader.ucode_guest_endian.data(),
+                        shader.ucode_guest_endian.size());
+    }
+    shader.ucode_data_hash =
+        XXH3_64bits(shader.ucode_guest_endian.data(),
+                    sizeof(uint32_t) * shader.ucode_guest_endian.size());
+    shaders.push_back(std::move(shader));
+  }
+  return true;
+}
+
+// Translates all the shaders from a shader storage file or a directory on all
+// logical processors, so the translation of the shaders of the titles can be
+// done ahead of time, and writes the translated shaders to a directory, and,
+// optionally, the deduplicated shaders with their ucode analysis to a shader
+// storage file that the emulator can load without analyzing the ucode.
+static int shader_compiler_batch_main() {
+  if (cvars::shader_output_type == "spirvtext" ||
+      cvars::shader_output_type == "dxbctext") {
+    XELOGE(
+        "Disassembly output types are not supported for translating shaders "
+        "in batch.");
+    return 1;
+  }
+
+  std::vector<BatchShader> shaders;
+  if (std::filesystem::is_directory(cvars::shader_input)) {
+    if (!LoadBatchShaderDirectory(cvars::shader_input, shaders)) {
+      return 1;
+    }
+  } else if (!LoadBatchShaderStorage(cvars::shader_input, shaders)) {
+    return 1;
+  }
+  // Shader storage files may contain duplicates.
+  {
+    std::unordered_set<uint64_t> shader_hashes;
+    size_t unique_shader_count = 0;
+    for (BatchShader& shader : shaders) {
+      if (shader_hashes.insert(shader.ucode_data_hash).second) {
+        shaders[unique_shader_count++] = std::move(shader);
+      }
+    }
+    shaders.resize(unique_shader_count);
+  }
+  XELOGI("Loaded {} shaders from {}", shaders.size(),
+         xe::path_to_utf8(cvars::shader_input));
+
+  const char* output_extension = nullptr;
+  if (cvars::shader_output_type == "spirv") {
+    output_extension = "spv";
+  } else if (cvars::shader_output_type == "dxbc") {
+    output_extension = "dxbc";
+  }
+  if (output_extension && !cvars::shader_output.empty()) {
+    std::error_code error_code;
+    std::filesystem::create_directories(cvars::shader_output, error_code);
+  }
+
+  std::vector<Shader::HostVertexShaderType> host_vertex_shader_types =
+      GetHostVertexShaderTypes();
+  // Written by the threads at the index of each shader.
+  std::vector<std::vector<uint8_t>> ucode_analyses(shaders.size());
+  std::atomic<size_t> next_shader_index = {0};
+  std::atomic<size_t> translation_count = {0};
+  std::atomic<size_t> failed_translation_count = {0};
+  auto translation_thread_function = [&]() {
+    SpirvShaderTranslator::Features spirv_features(true);
+    std::unique_ptr<ShaderTranslator> translator =
+        CreateShaderTranslator(spirv_features);
+    StringBuffer ucode_disasm_buffer;
+    while (true) {
+      size_t shader_index =
+          next_shader_index.fetch_add(1, std::memory_order_relaxed);
+      if (shader_index >= shaders.size()) {
+        break;
+      }
+      const BatchShader& batch_shader = shaders[shader_index];
+      Shader shader(batch_shader.type, batch_shader.ucode_data_hash,
+                    batch_shader.ucode_guest_endian.data(),
+                    batch_shader.ucode_guest_endian.size());
+      if (batch_shader.ucode_analysis.empty() ||
+          !shader.DeserializeUcodeAnalysis(
+              batch_shader.ucode_analysis.data(),
+              batch_shader.ucode_analysis.size())) {
+        shader.AnalyzeUcode(ucode_disasm_buffer);
+      }
+      shader.SerializeUcodeAnalysis(ucode_analyses[shader_index]);
+      if (!translator) {
+        continue;
+      }
+      std::vector<uint64_t> modifications;
+      if (batch_shader.type == xenos::ShaderType::kVertex) {
+        for (Shader::HostVertexShaderType host_vertex_shader_type :
+             host_vertex_shader_types) {
+          modifications.push_back(
+              translator->GetDefaultVertexShaderModification(
+                  xenos::kMaxShaderTempRegisters, host_vertex_shader_type));
+        }
+      } else {
+        modifications.push_back(translator->GetDefaultPixelShaderModification(
+            xenos::kMaxShaderTempRegisters));
+      }
+      for (uint64_t modification : modifications) {
+        Shader::Translation* translation =
+            shader.GetOrCreateTranslation(modification);
+        if (!translator->TranslateAnalyzedShader(*translation) ||
+            !translation->is_valid()) {
+          XELOGW("Failed to translate shader {:016X} with modification {:016X}",
+                 batch_shader.ucode_data_hash, modification);
+          failed_translation_count.fetch_add(1, std::memory_order_relaxed);
+          continue;
+        }
+        translation_count.fetch_add(1, std::memory_order_relaxed);
+        if (cvars::shader_output.empty()) {
+          continue;
+        }
+        auto output_path =
+            cvars::shader_output /
+            fmt::format("shader_{:016X}.{:016X}.{}.{}",
+                        batch_shader.ucode_data_hash, modification,
+                        batch_shader.type == xenos::ShaderType::kVertex ? "vs"
+                                                                        : "ps",
+                        output_extension);
+        FILE* output_file = filesystem::OpenFile(output_path, "wb");
+        if (!output_file) {
+          XELOGE("Unable to open output file: {}",
+                 xe::path_to_utf8(output_path));
+          continue;
+        }
+        fwrite(translation->translated_binary().data(), 1,
+               translation->translated_binary().size(), output_file);
+        fclose(output_file);
+      }
+    }
+  };
+  size_t thread_count = cvars::shader_batch_threads
+                            ? size_t(cvars::shader_batch_threads)
+                            : size_t(xe::threading::logical_processor_count());
+  thread_count = std::max(std::min(thread_count, shaders.size()), size_t(1));
+  std::vector<std::thread> translation_threads;
+  translation_threads.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    translation_threads.emplace_back(translation_thread_function);
+  }
+  for (std::thread& translation_thread : translation_threads) {
+    translation_thread.join();
+  }
+  XELOGI("Translated {} shader modifications on {} threads, {} failed",
+         translation_count.load(std::memory_order_relaxed), thread_count,
+         failed_translation_count.load(std::memory_order_relaxed));
+
+  if (!cvars::shader_output_storage.empty()) {
+    FILE* storage_file =
+        filesystem::OpenFile(cvars::shader_output_storage, "wb");
+    if (!storage_file) {
+      XELOGE("Unable to open output shader storage file: {}",
+             xe::path_to_utf8(cvars::shader_output_storage));
+      return 1;
+    }
+    struct {
+      uint32_t magic;
+      uint32_t version_swapped;
+    } file_header;
+    file_header.magic = kBatchShaderStorageMagic;
+    file_header.version_swapped =
+        xe::byte_swap(BatchShaderStoredHeader::kVersion);
+    fwrite(&file_header, sizeof(file_header), 1, storage_file);
+    BatchShaderStoredHeader shader_header;
+    // Don't leak anything in unused bits.
+    std::memset(&shader_header, 0, sizeof(shader_header));
+    for (size_t i = 0; i < shaders.size(); ++i) {
+      const BatchShader& shader = shaders[i];
+      shader_header.ucode_data_hash = shader.ucode_data_hash;
+      shader_header.ucode_dword_count =
+          uint32_t(shader.ucode_guest_endian.size());
+      shader_header.type = shader.type;
+      shader_header.ucode_analysis_size = uint32_t(ucode_analyses[i].size());
+      fwrite(&shader_header, sizeof(shader_header), 1, storage_file);
+      fwrite(shader.ucode_guest_endian.data(), sizeof(uint32_t),
+             shader.ucode_guest_endian.size(), storage_file);
+      fwrite(ucode_analyses[i].data(), 1, ucode_analyses[i].size(),
+             storage_file);
+    }
+    fclose(storage_file);
+    XELOGI("Wrote {} shaders with the ucode analysis to {}", shaders.size(),
+           xe::path_to_utf8(cvars::shader_output_storage));
+  }
+
+  return 0;
+}
+
 int shader_compiler_main(const std::vector<std::string>& args) {
+  if (std::filesystem::is_directory(cvars::shader_input) ||
+      cvars::shader_input.extension() == ".xsh") {
+    return shader_compiler_batch_main();
+  }
+
   xenos::ShaderType shader_type;
   if (!cvars::shader_input_type.empty()) {
     if (cvars::shader_input_type == "vs") {
@@ -122,20 +499,10 @@ int shader_compiler_main(const std::vector<std::string>& args) {
   StringBuffer ucode_disasm_buffer;
   shader->AnalyzeUcode(ucode_disasm_buffer);
 
-  std::unique_ptr<ShaderTranslator> translator;
   SpirvShaderTranslator::Features spirv_features(true);
-  if (cvars::shader_output_type == "spirv" ||
-      cvars::shader_output_type == "spirvtext") {
-    translator = std::make_unique<SpirvShaderTranslator>(
-        spirv_features, true, true,
-        cvars::shader_output_pixel_shader_interlock);
-  } else if (cvars::shader_output_type == "dxbc" ||
-             cvars::shader_output_type == "dxbctext") {
-    translator = std::make_unique<DxbcShaderTranslator>(
-        ui::GraphicsProvider::GpuVendorID(0),
-        cvars::shader_output_bindless_resources,
-        cvars::shader_output_pixel_shader_interlock);
-  } else {
+  std::unique_ptr<ShaderTranslator> translator =
+      CreateShaderTranslator(spirv_features);
+  if (!translator) {
     // Just output microcode disassembly generated during microcode information
     // gathering.
     if (!cvars::shader_output.empty()) {
@@ -150,25 +517,7 @@ int shader_compiler_main(const std::vector<std::string>& args) {
   Shader::HostVertexShaderType host_vertex_shader_type =
       Shader::HostVertexShaderType::kVertex;
   if (shader_type == xenos::ShaderType::kVertex) {
-    if (cvars::vertex_shader_output_type == "linedomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kLineDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "linedomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kLineDomainPatchIndexed;
-    } else if (cvars::vertex_shader_output_type == "triangledomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kTriangleDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "triangledomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kTriangleDomainPatchIndexed;
-    } else if (cvars::vertex_shader_output_type == "quaddomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kQuadDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "quaddomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kQuadDomainPatchIndexed;
-    }
+    host_vertex_shader_type = GetHostVertexShaderTypes().front();
   }
   uint64_t modification;
   switch (shader_type) {
@@ -265,5 +614,5 @@ int shader_compiler_main(const std::vector<std::string>& args) {
 }  // namespace xe
 
 XE_DEFINE_CONSOLE_APP("xenia-gpu-shader-compiler",
-                      xe::gpu::shader_compiler_main, "shader.bin",
+                      xe::gpu::shader_compiler_main, "shader.bin|storage.xsh",
                       "shader_input");
@@ -980,7 +980,7 @@ void ShaderInterpreter::ExecuteVertexFetchInstruction(
   xenos::xe_gpu_vertex_fetch_t fetch_constant =
       *reinterpret_cast<const xenos::xe_gpu_vertex_fetch_t*>(
           &register_file_[XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 +
-                          state_.vfetch_full_last.fetch_constant_index()]);
+                          state_.vfetch_full_last.fetch_constant_index() * 2]);
 
   if (!instr.is_mini_fetch()) {
     // Get the part of the address that depends on vfetch_full data.
@@ -9,7 +9,11 @@
 
 #include "xenia/gpu/shader_translator.h"
 
+#include <algorithm>
 #include <cstdarg>
+#include <cstring>
+#include <type_traits>
+#include <utility>
 
 #include "xenia/base/logging.h"
 #include "xenia/gpu/gpu_flags.h"
@@ -227,6 +231,217 @@ void Shader::AnalyzeUcode(StringBuffer& ucode_disasm_buffer) {
   }
 }
 
+namespace {
+// Change when Shader::AnalyzeUcode starts gathering different information.
+constexpr uint32_t kUcodeAnalysisVersion = 1;
+// Unusable in builds with a different layout of the copied structures.
+struct UcodeAnalysisHeader {
+  uint32_t version;
+  uint32_t constant_register_map_size;
+  uint32_t vertex_fetch_instruction_size;
+  uint32_t texture_fetch_instruction_size;
+};
+const UcodeAnalysisHeader kUcodeAnalysisHeader = {
+    kUcodeAnalysisVersion,
+    uint32_t(sizeof(Shader::ConstantRegisterMap)),
+    uint32_t(sizeof(ParsedVertexFetchInstruction)),
+    uint32_t(sizeof(ParsedTextureFetchInstruction)),
+};
+static_assert(std::is_trivially_copyable_v<Shader::ConstantRegisterMap> &&
+                  std::is_trivially_copyable_v<ParsedVertexFetchInstruction> &&
+                  std::is_trivially_copyable_v<ParsedTextureFetchInstruction>,
+              "Ucode analysis structures must be copyable as bytes");
+
+class UcodeAnalysisReader {
+ public:
+  UcodeAnalysisReader(const void* data, size_t size)
+      : data_(reinterpret_cast<const uint8_t*>(data)), remaining_(size) {}
+  bool Read(void* value, size_t size) {
+    if (size > remaining_) {
+      return false;
+    }
+    std::memcpy(value, data_, size);
+    data_ += size;
+    remaining_ -= size;
+    return true;
+  }
+  template <typename T>
+  bool Read(T& value) {
+    return Read(&value, sizeof(value));
+  }
+  size_t remaining() const { return remaining_; }
+
+ private:
+  const uint8_t* data_;
+  size_t remaining_;
+};
+
+template <typename T>
+void WriteUcodeAnalysis(std::vector<uint8_t>& data_out, const T& value) {
+  auto value_bytes = reinterpret_cast<const uint8_t*>(&value);
+  data_out.insert(data_out.end(), value_bytes, value_bytes + sizeof(value));
+}
+}  // namespace
+
+void Shader::SerializeUcodeAnalysis(std::vector<uint8_t>& data_out) const {
+  assert_true(is_ucode_analyzed());
+  WriteUcodeAnalysis(data_out, kUcodeAnalysisHeader);
+  WriteUcodeAnalysis(data_out, cf_pair_index_bound_);
+  WriteUcodeAnalysis(data_out, register_static_address_bound_);
+  WriteUcodeAnalysis(data_out, writes_interpolators_);
+  WriteUcodeAnalysis(data_out, writes_point_size_edge_flag_kill_vertex_);
+  WriteUcodeAnalysis(data_out, writes_color_targets_);
+  uint32_t flags = uint32_t(uses_register_dynamic_addressing_) |
+                   (uint32_t(kills_pixels_) << 1) |
+                   (uint32_t(uses_texture_fetch_instruction_results_) << 2) |
+                   (uint32_t(writes_depth_) << 3);
+  WriteUcodeAnalysis(data_out, flags);
+  WriteUcodeAnalysis(data_out, constant_register_map_);
+  WriteUcodeAnalysis(data_out, memexport_eM_written_);
+  WriteUcodeAnalysis(data_out, uint32_t(memexport_stream_constants_.size()));
+  for (uint32_t stream_constant : memexport_stream_constants_) {
+    WriteUcodeAnalysis(data_out, stream_constant);
+  }
+  WriteUcodeAnalysis(data_out, uint32_t(label_addresses_.size()));
+  for (uint32_t label_address : label_addresses_) {
+    WriteUcodeAnalysis(data_out, label_address);
+  }
+  WriteUcodeAnalysis(data_out, uint32_t(vertex_bindings_.size()));
+  for (const VertexBinding& vertex_binding : vertex_bindings_) {
+    WriteUcodeAnalysis(data_out, int32_t(vertex_binding.binding_index));
+    WriteUcodeAnalysis(data_out, vertex_binding.fetch_constant);
+    WriteUcodeAnalysis(data_out, vertex_binding.stride_words);
+    WriteUcodeAnalysis(data_out, uint32_t(vertex_binding.attributes.size()));
+    for (const VertexBinding::Attribute& attribute :
+         vertex_binding.attributes) {
+      WriteUcodeAnalysis(data_out, attribute.fetch_instr);
+    }
+  }
+  WriteUcodeAnalysis(data_out, uint32_t(texture_bindings_.size()));
+  for (const TextureBinding& texture_binding : texture_bindings_) {
+    WriteUcodeAnalysis(data_out, uint32_t(texture_binding.binding_index));
+    WriteUcodeAnalysis(data_out, texture_binding.fetch_constant);
+    WriteUcodeAnalysis(data_out, texture_binding.fetch_instr);
+  }
+  WriteUcodeAnalysis(data_out, uint32_t(ucode_disassembly_.size()));
+  data_out.insert(data_out.end(), ucode_disassembly_.cbegin(),
+                  ucode_disassembly_.cend());
+}
+
+bool Shader::DeserializeUcodeAnalysis(const void* data, size_t data_size) {
+  if (is_ucode_analyzed_) {
+    return true;
+  }
+  UcodeAnalysisReader reader(data, data_size);
+  UcodeAnalysisHeader header;
+  if (!reader.Read(header) ||
+      std::memcmp(&header, &kUcodeAnalysisHeader, sizeof(header))) {
+    return false;
+  }
+  // Reading into local copies not to leave the shader partially initialized.
+  uint32_t cf_pair_index_bound, register_static_address_bound;
+  uint32_t writes_interpolators, writes_point_size_edge_flag_kill_vertex;
+  uint32_t writes_color_targets, flags;
+  ConstantRegisterMap constant_register_map;
+  uint8_t memexport_eM_written[kMaxMemExports];
+  if (!reader.Read(cf_pair_index_bound) ||
+      !reader.Read(register_static_address_bound) ||
+      !reader.Read(writes_interpolators) ||
+      !reader.Read(writes_point_size_edge_flag_kill_vertex) ||
+      !reader.Read(writes_color_targets) || !reader.Read(flags) ||
+      !reader.Read(constant_register_map) ||
+      !reader.Read(memexport_eM_written)) {
+    return false;
+  }
+  uint32_t count;
+  std::set<uint32_t> memexport_stream_constants;
+  if (!reader.Read(count) || count > reader.remaining() / sizeof(uint32_t)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t stream_constant;
+    reader.Read(stream_constant);
+    memexport_stream_constants.insert(stream_constant);
+  }
+  std::set<uint32_t> label_addresses;
+  if (!reader.Read(count) || count > reader.remaining() / sizeof(uint32_t)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t label_address;
+    reader.Read(label_address);
+    label_addresses.insert(label_address);
+  }
+  std::vector<VertexBinding> vertex_bindings;
+  if (!reader.Read(count) || count > reader.remaining()) {
+    return false;
+  }
+  vertex_bindings.resize(count);
+  for (VertexBinding& vertex_binding : vertex_bindings) {
+    int32_t binding_index;
+    uint32_t attribute_count;
+    if (!reader.Read(binding_index) ||
+        !reader.Read(vertex_binding.fetch_constant) ||
+        !reader.Read(vertex_binding.stride_words) ||
+        !reader.Read(attribute_count) ||
+        attribute_count > reader.remaining() /
+                              sizeof(ParsedVertexFetchInstruction)) {
+      return false;
+    }
+    vertex_binding.binding_index = binding_index;
+    vertex_binding.attributes.resize(attribute_count);
+    for (VertexBinding::Attribute& attribute : vertex_binding.attributes) {
+      reader.Read(attribute.fetch_instr);
+      attribute.fetch_instr.opcode_name = nullptr;
+    }
+  }
+  std::vector<TextureBinding> texture_bindings;
+  if (!reader.Read(count) || count > reader.remaining()) {
+    return false;
+  }
+  texture_bindings.resize(count);
+  for (TextureBinding& texture_binding : texture_bindings) {
+    uint32_t binding_index;
+    if (!reader.Read(binding_index) ||
+        !reader.Read(texture_binding.fetch_constant) ||
+        !reader.Read(texture_binding.fetch_instr)) {
+      return false;
+    }
+    texture_binding.binding_index = binding_index;
+    texture_binding.fetch_instr.opcode_name = nullptr;
+  }
+  if (!reader.Read(count) || count != reader.remaining()) {
+    return false;
+  }
+  ucode_disassembly_.resize(count);
+  reader.Read(ucode_disassembly_.data(), count);
+
+  cf_pair_index_bound_ = cf_pair_index_bound;
+  register_static_address_bound_ = register_static_address_bound;
+  writes_interpolators_ = writes_interpolators;
+  writes_point_size_edge_flag_kill_vertex_ =
+      writes_point_size_edge_flag_kill_vertex;
+  writes_color_targets_ = writes_color_targets;
+  uses_register_dynamic_addressing_ = (flags & (uint32_t(1) << 0)) != 0;
+  kills_pixels_ = (flags & (uint32_t(1) << 1)) != 0;
+  uses_texture_fetch_instruction_results_ = (flags & (uint32_t(1) << 2)) != 0;
+  writes_depth_ = (flags & (uint32_t(1) << 3)) != 0;
+  constant_register_map_ = constant_register_map;
+  std::memcpy(memexport_eM_written_, memexport_eM_written,
+              sizeof(memexport_eM_written_));
+  memexport_stream_constants_ = std::move(memexport_stream_constants);
+  label_addresses_ = std::move(label_addresses);
+  vertex_bindings_ = std::move(vertex_bindings);
+  texture_bindings_ = std::move(texture_bindings);
+
+  is_ucode_analyzed_ = true;
+
+  if (!cvars::dump_shaders.empty() && !ucode_data().empty()) {
+    DumpUcode(cvars::dump_shaders);
+  }
+  return true;
+}
+
 uint32_t Shader::GetInterpolatorInputMask(reg::SQ_PROGRAM_CNTL sq_program_cntl,
                                           reg::SQ_CONTEXT_MISC sq_context_misc,
                                           uint32_t& param_gen_pos_out) const {
@@ -527,6 +742,8 @@ ShaderTranslator::~ShaderTranslator() = default;
 
 void ShaderTranslator::Reset() {
   errors_.clear();
+  control_flow_structured_ = false;
+  skippable_region_ends_.clear();
   std::memset(&previous_vfetch_full_, 0, sizeof(previous_vfetch_full_));
 }
 
@@ -550,11 +767,8 @@ bool ShaderTranslator::TranslateAnalyzedShader(
     register_count_ = std::max(register_count_, GetModificationRegisterCount());
   }
 
-  StartTranslation();
-
   const uint32_t* ucode_dwords = shader.ucode_data().data();
 
-  // TODO(Triang3l): Remove when the old SPIR-V shader translator is deleted.
   uint32_t cf_pair_index_bound = shader.cf_pair_index_bound();
   std::vector<ControlFlowInstruction> cf_instructions;
   for (uint32_t i = 0; i < cf_pair_index_bound; ++i) {
@@ -563,6 +777,13 @@ bool ShaderTranslator::TranslateAnalyzedShader(
     cf_instructions.push_back(cf_ab[0]);
     cf_instructions.push_back(cf_ab[1]);
   }
+  control_flow_structured_ = cvars::structured_shader_control_flow &&
+                             SupportsStructuredControlFlow() &&
+                             AnalyzeStructuredControlFlow(cf_instructions);
+
+  StartTranslation();
+
+  // TODO(Triang3l): Remove when the old SPIR-V shader translator is deleted.
   PreProcessControlFlowInstructions(cf_instructions);
 
   // Translate all instructions.
@@ -573,7 +794,13 @@ bool ShaderTranslator::TranslateAnalyzedShader(
     for (uint32_t j = 0; j < 2; ++j) {
       uint32_t cf_index = i * 2 + j;
       cf_index_ = cf_index;
-      if (label_addresses.find(cf_index) != label_addresses.end()) {
+      if (control_flow_structured_) {
+        while (!skippable_region_ends_.empty() &&
+               skippable_region_ends_.back() == cf_index) {
+          skippable_region_ends_.pop_back();
+          ProcessSkippableRegionEnd();
+        }
+      } else if (label_addresses.find(cf_index) != label_addresses.end()) {
         ProcessLabel(cf_index);
       }
       ProcessControlFlowInstructionBegin(cf_index);
@@ -581,6 +808,11 @@ bool ShaderTranslator::TranslateAnalyzedShader(
       ProcessControlFlowInstructionEnd(cf_index);
     }
   }
+  // Close the regions skipped by the jumps to the end of the shader or beyond.
+  while (!skippable_region_ends_.empty()) {
+    skippable_region_ends_.pop_back();
+    ProcessSkippableRegionEnd();
+  }
 
   translation.errors_ = std::move(errors_);
   translation.translated_binary_ = CompleteTranslation();
@@ -611,6 +843,65 @@ void ShaderTranslator::EmitTranslationError(const char* message,
   XELOGE("Shader translation {}error: {}", is_fatal ? "fatal " : "", message);
 }
 
+bool ShaderTranslator::AnalyzeStructuredControlFlow(
+    const std::vector<ControlFlowInstruction>& cf_instructions) const {
+  // Recovering only the simplest, but the most common, structure - execs
+  // possibly skipped by conditional forward jumps with the regions between the
+  // jumps and their targets properly nested, like from `if` statements in the
+  // HLSL source. Loops and calls need the program counter to go back.
+  uint32_t cf_count = uint32_t(cf_instructions.size());
+  // The end addresses of the regions open at the current instruction, from the
+  // outermost to the innermost.
+  std::vector<uint32_t> region_ends;
+  bool shader_ended = false;
+  for (uint32_t i = 0; i < cf_count; ++i) {
+    while (!region_ends.empty() && region_ends.back() == i) {
+      region_ends.pop_back();
+    }
+    const ControlFlowInstruction& cf = cf_instructions[i];
+    switch (cf.opcode()) {
+      case ControlFlowOpcode::kNop:
+      case ControlFlowOpcode::kAlloc:
+      case ControlFlowOpcode::kMarkVsFetchDone:
+        break;
+      case ControlFlowOpcode::kExec:
+      case ControlFlowOpcode::kExecEnd:
+      case ControlFlowOpcode::kCondExec:
+      case ControlFlowOpcode::kCondExecEnd:
+      case ControlFlowOpcode::kCondExecPred:
+      case ControlFlowOpcode::kCondExecPredEnd:
+      case ControlFlowOpcode::kCondExecPredClean:
+      case ControlFlowOpcode::kCondExecPredCleanEnd:
+        // Ending the shader in the middle requires breaking out of a loop.
+        if (shader_ended) {
+          return false;
+        }
+        shader_ended = DoesControlFlowOpcodeEndShader(cf.opcode());
+        break;
+      case ControlFlowOpcode::kCondJmp: {
+        if (shader_ended) {
+          return false;
+        }
+        ParsedJumpInstruction instr;
+        ParseControlFlowCondJmp(cf.cond_jmp, i, instr);
+        if (instr.type == ParsedJumpInstruction::Type::kUnconditional ||
+            instr.target_address <= i) {
+          return false;
+        }
+        uint32_t region_end = std::min(instr.target_address, cf_count);
+        if (!region_ends.empty() && region_end > region_ends.back()) {
+          // Overlaps the end of an enclosing region.
+          return false;
+        }
+        region_ends.push_back(region_end);
+      } break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
 void ShaderTranslator::TranslateControlFlowInstruction(
     const ControlFlowInstruction& cf) {
   switch (cf.opcode()) {
@@ -660,7 +951,13 @@ void ShaderTranslator::TranslateControlFlowInstruction(
     case ControlFlowOpcode::kCondJmp: {
       ParsedJumpInstruction instr;
       ParseControlFlowCondJmp(cf.cond_jmp, cf_index_, instr);
-      ProcessJumpInstruction(instr);
+      if (control_flow_structured_) {
+        skippable_region_ends_.push_back(std::min(
+            instr.target_address, current_shader().cf_pair_index_bound() * 2));
+        ProcessSkippableRegionBegin(instr);
+      } else {
+        ProcessJumpInstruction(instr);
+      }
     } break;
     case ControlFlowOpcode::kAlloc: {
       ParsedAllocInstruction instr;
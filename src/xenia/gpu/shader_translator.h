@@ -11,6 +11,8 @@
 #define XENIA_GPU_SHADER_TRANSLATOR_H_
 
 #include <memory>
+#include <vector>
+
 #include "xenia/gpu/shader.h"
 
 namespace xe {
@@ -62,6 +64,19 @@ class ShaderTranslator {
   // Temporary register count, accessible via static and dynamic addressing.
   uint32_t register_count() const { return register_count_; }
 
+  // Whether the implementation can translate structured control flow, with
+  // forward jumps handled by ProcessSkippableRegionBegin and
+  // ProcessSkippableRegionEnd rather than by ProcessLabel and
+  // ProcessJumpInstruction.
+  virtual bool SupportsStructuredControlFlow() const { return false; }
+  // True if the control flow of the current shader has been recovered as
+  // nested regions skipped by forward jumps, so it can be translated without a
+  // loop containing a program counter dispatch. In this case, there are no
+  // loops, calls or backward jumps, ProcessLabel is not called, and nothing is
+  // executed after the ending exec, so it doesn't need to break out of
+  // anything. Known before StartTranslation.
+  bool is_control_flow_structured() const { return control_flow_structured_; }
+
   // Emits a translation error that will be passed back in the result.
   virtual void EmitTranslationError(const char* message, bool is_fatal = true);
 
@@ -118,6 +133,14 @@ class ShaderTranslator {
   virtual void ProcessReturnInstruction(const ParsedReturnInstruction& instr) {}
   // Handles translation for jump instructions.
   virtual void ProcessJumpInstruction(const ParsedJumpInstruction& instr) {}
+  // With structured control flow, handles a conditional forward jump, opening
+  // the region up to its target executed only if the jump is not taken.
+  virtual void ProcessSkippableRegionBegin(const ParsedJumpInstruction& instr) {
+  }
+  // With structured control flow, closes the innermost skippable region, at
+  // its target or at the end of the shader. Multiple regions may end at the
+  // same address.
+  virtual void ProcessSkippableRegionEnd() {}
   // Handles translation for alloc instructions.
   virtual void ProcessAllocInstruction(const ParsedAllocInstruction& instr) {}
 
@@ -131,6 +154,10 @@ class ShaderTranslator {
   virtual void ProcessAluInstruction(const ParsedAluInstruction& instr) {}
 
  private:
+  // Checks if the control flow can be translated as nested regions skipped by
+  // conditional forward jumps, rather than as a state machine.
+  bool AnalyzeStructuredControlFlow(
+      const std::vector<ucode::ControlFlowInstruction>& cf_instructions) const;
   void TranslateControlFlowInstruction(const ucode::ControlFlowInstruction& cf);
   void TranslateExecInstructions(const ParsedExecInstruction& instr);
 
@@ -146,6 +173,11 @@ class ShaderTranslator {
   // Current control flow dword index.
   uint32_t cf_index_ = 0;
 
+  bool control_flow_structured_ = false;
+  // With structured control flow, the end addresses of the currently open
+  // skippable regions, from the outermost to the innermost.
+  std::vector<uint32_t> skippable_region_ends_;
+
   // Kept for supporting vfetch_mini.
   ucode::VertexFetchInstruction previous_vfetch_full_;
 };
@@ -10,12 +10,42 @@
 #include "xenia/gpu/shared_memory.h"
 
 #include <algorithm>
+#include <cstring>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/bit_range.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/profiling.h"
 
+DEFINE_uint32(
+    gpu_shared_memory_sparse_free_frames, 0,
+    "Number of frames after which an allocation of the host GPU memory for "
+    "the guest physical memory (with d3d12_tiled_shared_memory or "
+    "vulkan_sparse_shared_memory) not used by the GPU and not containing data "
+    "written by the GPU is freed, reducing the video memory usage. If the "
+    "guest uses the memory again, it has to be allocated and mapped again, "
+    "and its data uploaded again, which may cause stuttering, so this is "
+    "mainly useful on GPUs with little video memory. 0 to keep all "
+    "allocations until the cache is cleared.",
+    "GPU");
+DEFINE_uint32(
+    gpu_shared_memory_sparse_prefetch_allocations, 4,
+    "Number of allocations of the host GPU memory for the guest physical "
+    "memory (with d3d12_tiled_shared_memory or vulkan_sparse_shared_memory) "
+    "to make ahead when the GPU starts using the memory right after the last "
+    "allocated range, as guest data is usually laid out sequentially, so it's "
+    "committed in fewer, larger batches.",
+    "GPU");
+DEFINE_bool(
+    gpu_shared_memory_unwatch_hot_pages, false,
+    "Stop write-protecting guest memory pages used by the GPU that the CPU "
+    "writes to every frame (such as dynamic vertex buffers), and instead "
+    "reload them from guest memory once per frame. Avoids the cost of the "
+    "access violations, but CPU writes to such pages between draws within a "
+    "frame may not be seen by the GPU until the next frame.",
+    "GPU");
+
 namespace xe {
 namespace gpu {
 
@@ -48,6 +78,11 @@ void SharedMemory::InitializeCommon() {
          8 * num_system_page_flags_entries);
   memset(system_page_flags_valid_and_gpu_written_, 0,
          8 * num_system_page_flags_entries);
+  system_page_flags_cpu_invalidated_frame_.resize(num_system_page_flags_);
+  hot_page_frame_counters_.resize(kBufferSize >> page_size_log2_);
+  hot_page_counted_.resize(num_system_page_flags_);
+  hot_page_unwatched_.resize(num_system_page_flags_);
+
   memory_invalidation_callback_handle_ =
       memory_.RegisterPhysicalMemoryInvalidationCallback(
           MemoryInvalidationCallbackThunk, this);
@@ -60,6 +95,8 @@ void SharedMemory::InitializeSparseHostGpuMemory(uint32_t granularity_log2) {
   host_gpu_memory_sparse_allocated_.resize(
       size_t(1) << (std::max(kBufferSizeLog2 - granularity_log2, uint32_t(6)) -
                     6));
+  host_gpu_memory_sparse_last_usage_frame_.resize(
+      size_t(1) << (kBufferSizeLog2 - granularity_log2));
 }
 
 void SharedMemory::ShutdownCommon() {
@@ -99,6 +136,9 @@ void SharedMemory::ShutdownCommon() {
   }
   host_gpu_memory_sparse_allocated_.clear();
   host_gpu_memory_sparse_allocated_.shrink_to_fit();
+  host_gpu_memory_sparse_last_usage_frame_.clear();
+  host_gpu_memory_sparse_last_usage_frame_.shrink_to_fit();
+  host_gpu_memory_sparse_sequential_end_ = UINT32_MAX;
   host_gpu_memory_sparse_granularity_log2_ = UINT32_MAX;
   memory::DeallocFixed(system_page_flags_valid_, 0,
                        memory::DeallocationType::kRelease);
@@ -106,6 +146,15 @@ void SharedMemory::ShutdownCommon() {
   system_page_flags_valid_and_gpu_resolved_ = nullptr;
   system_page_flags_valid_and_gpu_written_ = nullptr;
   num_system_page_flags_ = 0;
+  system_page_flags_cpu_invalidated_frame_.clear();
+  system_page_flags_cpu_invalidated_frame_.shrink_to_fit();
+  cpu_invalidations_frame_ = 0;
+  hot_page_frame_counters_.clear();
+  hot_page_frame_counters_.shrink_to_fit();
+  hot_page_counted_.clear();
+  hot_page_counted_.shrink_to_fit();
+  hot_page_unwatched_.clear();
+  hot_page_unwatched_.shrink_to_fit();
 }
 
 void SharedMemory::ClearCache() {
@@ -301,6 +350,65 @@ void SharedMemory::RangeWrittenByGpu(uint32_t start, uint32_t length,
   MakeRangeValid(start, length, true, is_resolve);
 }
 
+bool SharedMemory::IsRangeWrittenByGpu(uint32_t start, uint32_t length) {
+  if (length == 0 || start >= kBufferSize) {
+    return false;
+  }
+  length = std::min(length, kBufferSize - start);
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = (start + length - 1) >> page_size_log2_;
+  uint32_t block_first = page_first >> 6;
+  uint32_t block_last = page_last >> 6;
+  auto global_lock = global_critical_region_.Acquire();
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t block_bits = UINT64_MAX;
+    if (i == block_first) {
+      block_bits &= ~((uint64_t(1) << (page_first & 63)) - 1);
+    }
+    if (i == block_last && (page_last & 63) != 63) {
+      block_bits &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+    }
+    if (system_page_flags_valid_and_gpu_written_[i] & block_bits) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SharedMemory::GetRangesWrittenByGpu(
+    uint32_t start, uint32_t length,
+    std::vector<std::pair<uint32_t, uint32_t>>& ranges_out) {
+  ranges_out.clear();
+  if (length == 0 || start >= kBufferSize) {
+    return;
+  }
+  length = std::min(length, kBufferSize - start);
+  uint32_t end = start + length;
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = (end - 1) >> page_size_log2_;
+  auto add_run = [&](uint32_t run_page_first, uint32_t run_page_end) {
+    uint32_t run_start = std::max(run_page_first << page_size_log2_, start);
+    uint32_t run_end = std::min(run_page_end << page_size_log2_, end);
+    ranges_out.emplace_back(run_start, run_end - run_start);
+  };
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t run_page_first = UINT32_MAX;
+  for (uint32_t i = page_first; i <= page_last; ++i) {
+    if (system_page_flags_valid_and_gpu_written_[i >> 6] &
+        (uint64_t(1) << (i & 63))) {
+      if (run_page_first == UINT32_MAX) {
+        run_page_first = i;
+      }
+    } else if (run_page_first != UINT32_MAX) {
+      add_run(run_page_first, i);
+      run_page_first = UINT32_MAX;
+    }
+  }
+  if (run_page_first != UINT32_MAX) {
+    add_run(run_page_first, page_last + 1);
+  }
+}
+
 bool SharedMemory::AllocateSparseHostGpuMemoryRange(
     uint32_t offset_allocations, uint32_t length_allocations) {
   assert_always(
@@ -338,6 +446,8 @@ void SharedMemory::MakeRangeValid(uint32_t start, uint32_t length,
       system_page_flags_valid_[i] |= valid_bits;
       if (written_by_gpu) {
         system_page_flags_valid_and_gpu_written_[i] |= valid_bits;
+        // GPU-written data can't be reloaded from the guest memory.
+        hot_page_unwatched_[i] &= ~valid_bits;
       } else {
         system_page_flags_valid_and_gpu_written_[i] &= ~valid_bits;
       }
@@ -350,10 +460,44 @@ void SharedMemory::MakeRangeValid(uint32_t start, uint32_t length,
   }
 
   if (memory_invalidation_callback_handle_) {
-    memory().EnablePhysicalMemoryAccessCallbacks(
-        valid_page_first << page_size_log2_,
-        (valid_page_last - valid_page_first + 1) << page_size_log2_, true,
-        false);
+    // Protect the runs of pages that are not hot.
+    uint32_t protect_page_first = UINT32_MAX;
+    for (uint32_t i = valid_block_first; i <= valid_block_last; ++i) {
+      uint64_t unwatched = hot_page_unwatched_[i];
+      if (i == valid_block_first) {
+        unwatched |= (uint64_t(1) << (valid_page_first & 63)) - 1;
+      }
+      if (i == valid_block_last && (valid_page_last & 63) != 63) {
+        unwatched |= ~((uint64_t(1) << ((valid_page_last & 63) + 1)) - 1);
+      }
+      uint32_t block_page = 0;
+      while (block_page < 64) {
+        uint64_t run_bits =
+            protect_page_first == UINT32_MAX ? ~unwatched : unwatched;
+        run_bits &= ~((uint64_t(1) << block_page) - 1);
+        uint32_t run_block_page;
+        if (!xe::bit_scan_forward(run_bits, &run_block_page)) {
+          break;
+        }
+        if (protect_page_first == UINT32_MAX) {
+          protect_page_first = (i << 6) + run_block_page;
+        } else {
+          uint32_t protect_page_end = (i << 6) + run_block_page;
+          memory().EnablePhysicalMemoryAccessCallbacks(
+              protect_page_first << page_size_log2_,
+              (protect_page_end - protect_page_first) << page_size_log2_,
+              true, false);
+          protect_page_first = UINT32_MAX;
+        }
+        block_page = run_block_page + 1;
+      }
+    }
+    if (protect_page_first != UINT32_MAX) {
+      memory().EnablePhysicalMemoryAccessCallbacks(
+          protect_page_first << page_size_log2_,
+          (valid_page_last + 1 - protect_page_first) << page_size_log2_, true,
+          false);
+    }
   }
 }
 
@@ -431,9 +575,181 @@ bool SharedMemory::RequestRange(uint32_t start, uint32_t length,
     return true;
   }
 
+  upload_frame_ranges_ += current_upload_range;
+  for (unsigned int i = 0; i < current_upload_range; ++i) {
+    upload_frame_bytes_ += uint64_t(uploads[i].second) << page_size_log2_;
+  }
+
   return UploadRanges(uploads, current_upload_range);
 }
 
+void SharedMemory::EndFrame() {
+  COUNT_profile_set("gpu/shared_memory/upload_kb_per_frame",
+                    (upload_frame_bytes_ + 1023) >> 10);
+  COUNT_profile_set("gpu/shared_memory/upload_ranges_per_frame",
+                    upload_frame_ranges_);
+  upload_frame_bytes_ = 0;
+  upload_frame_ranges_ = 0;
+  UpdateHotPages();
+  ++frame_current_;
+  FreeUnusedSparseHostGpuMemory();
+}
+
+void SharedMemory::UpdateHotPages() {
+  auto global_lock = global_critical_region_.Acquire();
+
+  COUNT_profile_set("gpu/shared_memory/cpu_invalidations_per_frame",
+                    cpu_invalidations_frame_);
+  cpu_invalidations_last_frame_ = cpu_invalidations_frame_;
+  cpu_invalidations_frame_ = 0;
+
+  if (!cvars::gpu_shared_memory_unwatch_hot_pages) {
+    bool any_hot_pages = false;
+    for (uint32_t i = 0; i < num_system_page_flags_; ++i) {
+      system_page_flags_cpu_invalidated_frame_[i] = 0;
+      any_hot_pages |= hot_page_counted_[i] != 0;
+    }
+    if (any_hot_pages) {
+      // Disabled while running - let MakeRangeValid protect the pages again.
+      std::memset(hot_page_counted_.data(), 0,
+                  sizeof(uint64_t) * hot_page_counted_.size());
+      std::memset(hot_page_unwatched_.data(), 0,
+                  sizeof(uint64_t) * hot_page_unwatched_.size());
+      std::memset(hot_page_frame_counters_.data(), 0,
+                  hot_page_frame_counters_.size());
+      COUNT_profile_set("gpu/shared_memory/unwatched_pages", 0);
+    }
+    return;
+  }
+
+  uint32_t unwatched_page_count = 0;
+  uint32_t fire_watches_page_first = UINT32_MAX;
+  for (uint32_t i = 0; i < num_system_page_flags_; ++i) {
+    uint64_t invalidated = system_page_flags_cpu_invalidated_frame_[i];
+    system_page_flags_cpu_invalidated_frame_[i] = 0;
+    uint64_t unwatched = hot_page_unwatched_[i];
+    uint64_t counted = hot_page_counted_[i];
+    uint64_t update_pages = invalidated | counted | unwatched;
+    uint32_t block_page;
+    while (xe::bit_scan_forward(update_pages, &block_page)) {
+      update_pages &= ~(uint64_t(1) << block_page);
+      uint64_t page_bit = uint64_t(1) << block_page;
+      uint8_t& counter = hot_page_frame_counters_[(i << 6) + block_page];
+      if (unwatched & page_bit) {
+        if (++counter >= kHotPageUnwatchedFrames) {
+          // Check again whether the page is still written every frame.
+          counter = 0;
+          counted &= ~page_bit;
+          unwatched &= ~page_bit;
+        }
+      } else if (invalidated & page_bit) {
+        counted |= page_bit;
+        if (++counter >= kHotPageFrames) {
+          counter = 0;
+          unwatched |= page_bit;
+        }
+      } else {
+        counter = 0;
+        counted &= ~page_bit;
+      }
+    }
+    // Reload all the pages unwatched in this frame, including those that will
+    // be protected again, from the guest memory in the next frame.
+    uint64_t invalidate_pages =
+        (hot_page_unwatched_[i] | unwatched) &
+        ~system_page_flags_valid_and_gpu_written_[i];
+    hot_page_unwatched_[i] = unwatched;
+    hot_page_counted_[i] = counted | unwatched;
+    unwatched_page_count += xe::bit_count(unwatched);
+    system_page_flags_valid_[i] &= ~invalidate_pages;
+    system_page_flags_valid_and_gpu_resolved_[i] &= ~invalidate_pages;
+    // Fire the watches for the runs of the invalidated pages.
+    uint32_t fire_watches_block_page = 0;
+    while (fire_watches_block_page < 64) {
+      uint64_t run_bits = fire_watches_page_first == UINT32_MAX
+                              ? invalidate_pages
+                              : ~invalidate_pages;
+      run_bits &= ~((uint64_t(1) << fire_watches_block_page) - 1);
+      uint32_t run_block_page;
+      if (!xe::bit_scan_forward(run_bits, &run_block_page)) {
+        break;
+      }
+      if (fire_watches_page_first == UINT32_MAX) {
+        fire_watches_page_first = (i << 6) + run_block_page;
+      } else {
+        FireWatches(fire_watches_page_first, (i << 6) + run_block_page - 1,
+                    false);
+        fire_watches_page_first = UINT32_MAX;
+      }
+      fire_watches_block_page = run_block_page + 1;
+    }
+  }
+  if (fire_watches_page_first != UINT32_MAX) {
+    FireWatches(fire_watches_page_first, (num_system_page_flags_ << 6) - 1,
+                false);
+  }
+  COUNT_profile_set("gpu/shared_memory/unwatched_pages", unwatched_page_count);
+}
+
+void SharedMemory::FreeUnusedSparseHostGpuMemory() {
+  if (host_gpu_memory_sparse_granularity_log2_ == UINT32_MAX ||
+      !cvars::gpu_shared_memory_sparse_free_frames ||
+      frame_current_ <= cvars::gpu_shared_memory_sparse_free_frames) {
+    return;
+  }
+  // Whole page flag blocks are checked for GPU-written data.
+  if (host_gpu_memory_sparse_granularity_log2_ < page_size_log2_ + 6) {
+    return;
+  }
+  uint32_t allocation_blocks_log2 =
+      host_gpu_memory_sparse_granularity_log2_ - page_size_log2_ - 6;
+  uint64_t last_usage_frame_max =
+      frame_current_ - cvars::gpu_shared_memory_sparse_free_frames;
+  uint32_t allocation_count =
+      uint32_t(host_gpu_memory_sparse_last_usage_frame_.size());
+  for (uint32_t i = 0; i < allocation_count; ++i) {
+    if (host_gpu_memory_sparse_last_usage_frame_[i] > last_usage_frame_max ||
+        !(host_gpu_memory_sparse_allocated_[i >> 6] &
+          (uint64_t(1) << (i & 63)))) {
+      continue;
+    }
+    uint32_t block_first = i << allocation_blocks_log2;
+    uint32_t block_end = (i + 1) << allocation_blocks_log2;
+    // Only the GPU emulation thread marks data as GPU-written, so this can't
+    // change until the allocation is freed.
+    bool gpu_written = false;
+    {
+      auto global_lock = global_critical_region_.Acquire();
+      for (uint32_t j = block_first; j < block_end; ++j) {
+        if (system_page_flags_valid_and_gpu_written_[j]) {
+          gpu_written = true;
+          break;
+        }
+      }
+    }
+    if (gpu_written || !FreeSparseHostGpuMemoryRange(i, 1)) {
+      continue;
+    }
+    {
+      // The data needs to be uploaded again to the new allocation.
+      auto global_lock = global_critical_region_.Acquire();
+      for (uint32_t j = block_first; j < block_end; ++j) {
+        system_page_flags_valid_[j] = 0;
+        system_page_flags_valid_and_gpu_resolved_[j] = 0;
+      }
+    }
+    host_gpu_memory_sparse_allocated_[i >> 6] &= ~(uint64_t(1) << (i & 63));
+    --host_gpu_memory_sparse_allocations_;
+    COUNT_profile_set("gpu/shared_memory/host_gpu_memory_sparse_allocations",
+                      host_gpu_memory_sparse_allocations_);
+    host_gpu_memory_sparse_used_bytes_ -=
+        uint32_t(1) << host_gpu_memory_sparse_granularity_log2_;
+    COUNT_profile_set(
+        "gpu/shared_memory/host_gpu_memory_sparse_used_mb",
+        (host_gpu_memory_sparse_used_bytes_ + ((1 << 20) - 1)) >> 20);
+  }
+}
+
 template <typename T>
 XE_FORCEINLINE XE_NOALIAS static T mod_shift_left(T value, uint32_t by) {
 #if XE_ARCH_AMD64 == 1
@@ -560,6 +876,20 @@ std::pair<uint32_t, uint32_t> SharedMemory::MemoryInvalidationCallback(
 
   auto global_lock = global_critical_region_.Acquire();
 
+  // For detecting pages written every frame - only the pages actually written
+  // and previously valid.
+  ++cpu_invalidations_frame_;
+  for (uint32_t i = block_first; i <= block_last; ++i) {
+    uint64_t written_bits = system_page_flags_valid_[i];
+    if (i == block_first) {
+      written_bits &= ~((uint64_t(1) << (page_first & 63)) - 1);
+    }
+    if (i == block_last && (page_last & 63) != 63) {
+      written_bits &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+    }
+    system_page_flags_cpu_invalidated_frame_[i] |= written_bits;
+  }
+
   if (!exact_range) {
     // Check if a somewhat wider range (up to 256 KB with 4 KB pages) can be
     // invalidated - if no GPU-written data nearby that was not intended to be
@@ -715,6 +1045,20 @@ bool SharedMemory::EnsureHostGpuMemoryAllocated(uint32_t start,
                                   host_gpu_memory_sparse_granularity_log2_;
       uint32_t allocation_last = page_last << page_size_log2_ >>
                                  host_gpu_memory_sparse_granularity_log2_;
+      for (uint32_t i = allocation_first; i <= allocation_last; ++i) {
+        host_gpu_memory_sparse_last_usage_frame_[i] = frame_current_;
+      }
+      // Continuing past the end of the range allocated last time - likely to
+      // go further.
+      uint32_t allocation_requested_last = allocation_last;
+      if (allocation_first <= host_gpu_memory_sparse_sequential_end_ &&
+          allocation_last >= host_gpu_memory_sparse_sequential_end_) {
+        uint32_t allocation_max =
+            uint32_t(host_gpu_memory_sparse_last_usage_frame_.size()) - 1;
+        allocation_last += std::min(
+            cvars::gpu_shared_memory_sparse_prefetch_allocations,
+            allocation_max - allocation_last);
+      }
       while (true) {
         std::pair<size_t, size_t> allocation_range =
             xe::bit_range::NextUnsetRange(
@@ -726,12 +1070,23 @@ bool SharedMemory::EnsureHostGpuMemoryAllocated(uint32_t start,
         if (!AllocateSparseHostGpuMemoryRange(
                 uint32_t(allocation_range.first),
                 uint32_t(allocation_range.second))) {
+          // Not failing if only the prediction couldn't be allocated.
+          if (allocation_range.first > allocation_requested_last) {
+            break;
+          }
           return false;
         }
         xe::bit_range::SetRange(host_gpu_memory_sparse_allocated_.data(),
                                 allocation_range.first,
                                 allocation_range.second);
-        ++host_gpu_memory_sparse_allocations_;
+        for (size_t i = 0; i < allocation_range.second; ++i) {
+          host_gpu_memory_sparse_last_usage_frame_[allocation_range.first + i] =
+              frame_current_;
+        }
+        host_gpu_memory_sparse_sequential_end_ =
+            uint32_t(allocation_range.first + allocation_range.second);
+        host_gpu_memory_sparse_allocations_ +=
+            uint32_t(allocation_range.second);
         COUNT_profile_set(
             "gpu/shared_memory/host_gpu_memory_sparse_allocations",
             host_gpu_memory_sparse_allocations_);
@@ -74,6 +74,17 @@ class SharedMemory {
   bool RequestRange(uint32_t start, uint32_t length,
                     bool* any_data_resolved_out = nullptr);
 
+  // Call at the end of every frame, to publish the upload and invalidation
+  // statistics, to invalidate the pages written by the CPU too often to be
+  // protected, and to free the sparse host GPU memory allocations not
+  // requested for a long time.
+  void EndFrame();
+  // Invalidation callbacks from CPU writes to the GPU data during the frame
+  // that has ended most recently.
+  uint32_t last_frame_cpu_invalidation_count() const {
+    return cpu_invalidations_last_frame_;
+  }
+
   void TryFindUploadRange(const uint32_t& block_first,
                           const uint32_t& block_last,
                           const uint32_t& page_first, const uint32_t& page_last,
@@ -102,6 +113,19 @@ class SharedMemory {
   // regions in those pages.
   void RangeWrittenByGpu(uint32_t start, uint32_t length, bool is_resolve);
 
+  // Whether any page in the range contains data written by the GPU (by resolves
+  // or memexport), so the guest memory doesn't represent what the GPU sees.
+  bool IsRangeWrittenByGpu(uint32_t start, uint32_t length);
+  // Collects the parts of the range in pages still containing GPU-written data
+  // (not modified by the CPU since) as <start, length> pairs.
+  void GetRangesWrittenByGpu(
+      uint32_t start, uint32_t length,
+      std::vector<std::pair<uint32_t, uint32_t>>& ranges_out);
+  // Guest memory backing the physical address, not the host GPU copy.
+  const uint8_t* TranslatePhysical(uint32_t address) const {
+    return memory_.TranslatePhysical(address);
+  }
+
  protected:
   SharedMemory(Memory& memory);
   // Call in implementation-specific initialization.
@@ -132,6 +156,15 @@ class SharedMemory {
   // access in the texture cache.
   virtual bool AllocateSparseHostGpuMemoryRange(uint32_t offset_allocations,
                                                 uint32_t length_allocations);
+  // Releases allocations made with AllocateSparseHostGpuMemoryRange, with all
+  // pages in them not containing GPU-written data, and not used by the GPU in
+  // the current submission. The memory must be kept alive until the GPU is done
+  // with the earlier submissions. Returns false if not supported, in this case
+  // the allocations are kept.
+  virtual bool FreeSparseHostGpuMemoryRange(uint32_t offset_allocations,
+                                            uint32_t length_allocations) {
+    return false;
+  }
 
   // Mark the memory range as updated and protect it.
   void MakeRangeValid(uint32_t start, uint32_t length, bool written_by_gpu,
@@ -178,6 +211,33 @@ class SharedMemory {
   std::vector<uint64_t> host_gpu_memory_sparse_allocated_;
   uint32_t host_gpu_memory_sparse_allocations_ = 0;
   uint32_t host_gpu_memory_sparse_used_bytes_ = 0;
+  // Number of the frame when each sparse allocation was last requested.
+  std::vector<uint64_t> host_gpu_memory_sparse_last_usage_frame_;
+  // The allocation after the last range allocated, for predicting sequential
+  // usage.
+  uint32_t host_gpu_memory_sparse_sequential_end_ = UINT32_MAX;
+  void FreeUnusedSparseHostGpuMemory();
+
+  uint64_t frame_current_ = 0;
+  // Statistics for the current frame.
+  uint64_t upload_frame_bytes_ = 0;
+  uint32_t upload_frame_ranges_ = 0;
+
+  // With gpu_shared_memory_unwatch_hot_pages, pages invalidated by CPU writes
+  // in kHotPageFrames consecutive frames stop being protected, and instead are
+  // invalidated at the end of every frame, for kHotPageUnwatchedFrames frames
+  // before checking again whether they're still written that often. Pages
+  // written by the GPU are always protected, as their data can't be reuploaded.
+  static constexpr uint8_t kHotPageFrames = 8;
+  static constexpr uint8_t kHotPageUnwatchedFrames = 240;
+  // For pages not hot, the number of consecutive frames they have been
+  // invalidated in, for hot pages, the number of frames since they became hot.
+  std::vector<uint8_t> hot_page_frame_counters_;
+  // Pages with a non-zero hot_page_frame_counters_ entry.
+  std::vector<uint64_t> hot_page_counted_;
+  // Pages not protected, accessed only by the GPU emulation thread.
+  std::vector<uint64_t> hot_page_unwatched_;
+  void UpdateHotPages();
 
   void* memory_invalidation_callback_handle_ = nullptr;
   void* memory_data_provider_handle_ = nullptr;
@@ -218,6 +278,11 @@ class SharedMemory {
            *system_page_flags_valid_and_gpu_written_ = nullptr,
            *system_page_flags_valid_and_gpu_resolved_ = nullptr;
   unsigned num_system_page_flags_ = 0;
+  // Pages invalidated by the CPU during the current frame, and the number of
+  // invalidation callbacks.
+  std::vector<uint64_t> system_page_flags_cpu_invalidated_frame_;
+  uint32_t cpu_invalidations_frame_ = 0;
+  uint32_t cpu_invalidations_last_frame_ = 0;
   static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
       void* context_ptr, uint32_t physical_address_start, uint32_t length,
       bool exact_range);
@@ -41,6 +41,8 @@ class SpirvShader : public Shader {
     // Stacked and 3D are separate TextureBindings.
     xenos::FetchOpDimension dimension : 2;
     uint32_t is_signed : 1;
+    // 0 if bindless resources are not used.
+    uint32_t bindless_descriptor_index : 10;
   };
   // Safe to hash and compare with memcmp for layout hashing.
   const std::vector<TextureBinding>& GetTextureBindingsAfterTranslation()
@@ -57,6 +59,8 @@ class SpirvShader : public Shader {
     xenos::TextureFilter min_filter : 2;
     xenos::TextureFilter mip_filter : 2;
     xenos::AnisoFilter aniso_filter : 3;
+    // 0 if bindless resources are not used.
+    uint32_t bindless_descriptor_index : 10;
   };
   const std::vector<SamplerBinding>& GetSamplerBindingsAfterTranslation()
       const {
@@ -138,6 +138,8 @@ void SpirvShaderTranslator::Reset() {
 
   sampler_bindings_.clear();
   texture_bindings_.clear();
+  bindless_resource_arrays_.fill(spv::NoResult);
+  uniform_bindless_descriptor_indices_ = spv::NoResult;
 
   main_interface_.clear();
   var_main_registers_ = spv::NoResult;
@@ -148,6 +150,8 @@ void SpirvShaderTranslator::Reset() {
   main_switch_op_.reset();
   main_switch_next_pc_phi_operands_.clear();
 
+  skippable_region_merges_.clear();
+
   cf_exec_conditional_merge_ = nullptr;
   cf_instruction_predicate_merge_ = nullptr;
 }
@@ -278,6 +282,7 @@ void SpirvShaderTranslator::StartTranslation() {
        type_uint_},
       {"edram_depth_base_dwords_scaled",
        offsetof(SystemConstants, edram_depth_base_dwords_scaled), type_uint_},
+      {"alpha_to_mask", offsetof(SystemConstants, alpha_to_mask), type_uint_},
       {"color_exp_bias", offsetof(SystemConstants, color_exp_bias),
        type_float4_},
       {"edram_poly_offset_front_scale",
@@ -542,7 +547,8 @@ void SpirvShaderTranslator::StartTranslation() {
     StartFragmentShaderInMain();
   }
 
-  if (is_depth_only_fragment_shader_) {
+  // Structured control flow doesn't need the main loop.
+  if (is_depth_only_fragment_shader_ || is_control_flow_structured()) {
     return;
   }
 
@@ -613,7 +619,11 @@ void SpirvShaderTranslator::StartTranslation() {
 }
 
 std::vector<uint8_t> SpirvShaderTranslator::CompleteTranslation() {
-  if (!is_depth_only_fragment_shader_) {
+  if (is_control_flow_structured() && !is_depth_only_fragment_shader_) {
+    // Fall through to the epilogue after the last exec.
+    CloseExecConditionals();
+    EnsureBuildPointAvailable();
+  } else if (!is_depth_only_fragment_shader_) {
     // Close flow control within the last switch case.
     CloseExecConditionals();
     bool has_main_switch = !current_shader().label_addresses().empty();
@@ -730,7 +740,7 @@ std::vector<uint8_t> SpirvShaderTranslator::CompleteTranslation() {
     entry_point->addIdOperand(interface_id);
   }
 
-  if (!is_depth_only_fragment_shader_) {
+  if (!is_depth_only_fragment_shader_ && !bindless_resources_used_) {
     // Specify the binding indices for samplers when the number of textures is
     // known, as samplers are located after images in the texture descriptor
     // set.
@@ -773,6 +783,8 @@ void SpirvShaderTranslator::PostTranslation() {
       shader_binding.fetch_constant = translator_binding.fetch_constant;
       shader_binding.dimension = translator_binding.dimension;
       shader_binding.is_signed = translator_binding.is_signed;
+      shader_binding.bindless_descriptor_index =
+          translator_binding.bindless_descriptor_index;
       spirv_shader->used_texture_mask_ |= UINT32_C(1)
                                           << translator_binding.fetch_constant;
     }
@@ -786,6 +798,8 @@ void SpirvShaderTranslator::PostTranslation() {
       shader_binding.min_filter = translator_binding.min_filter;
       shader_binding.mip_filter = translator_binding.mip_filter;
       shader_binding.aniso_filter = translator_binding.aniso_filter;
+      shader_binding.bindless_descriptor_index =
+          translator_binding.bindless_descriptor_index;
     }
   }
 }
@@ -825,7 +839,8 @@ void SpirvShaderTranslator::ProcessExecInstructionBegin(
 
 void SpirvShaderTranslator::ProcessExecInstructionEnd(
     const ParsedExecInstruction& instr) {
-  if (instr.is_end) {
+  // With structured control flow, nothing is executed after the ending exec.
+  if (instr.is_end && !is_control_flow_structured()) {
     // Break out of the main switch (if exists) and the main loop.
     CloseInstructionPredication();
     if (!builder_->getBuildPoint()->isTerminated()) {
@@ -1095,6 +1110,46 @@ void SpirvShaderTranslator::ProcessJumpInstruction(
   builder_->createBranch(main_loop_continue_);
 }
 
+void SpirvShaderTranslator::ProcessSkippableRegionBegin(
+    const ParsedJumpInstruction& instr) {
+  // The region conditional stays open until the jump target, so it can't be
+  // merged with the conditionals of the execs.
+  CloseExecConditionals();
+
+  EnsureBuildPointAvailable();
+  spv::Id condition_id;
+  if (instr.type == ParsedJumpInstruction::Type::kConditional) {
+    condition_id = LoadBoolConstant(instr.bool_constant_index);
+  } else {
+    assert_true(instr.type == ParsedJumpInstruction::Type::kPredicated);
+    condition_id = builder_->createLoad(var_main_predicate_, spv::NoPrecision);
+  }
+  spv::Block* region_merge = new spv::Block(
+      builder_->getUniqueId(), builder_->getBuildPoint()->getParent());
+  builder_->createSelectionMerge(region_merge,
+                                 spv::SelectionControlDontFlattenMask);
+  // Execute the region if the jump is not taken.
+  spv::Block& region_block = builder_->makeNewBlock();
+  builder_->createConditionalBranch(
+      condition_id, instr.condition ? region_merge : &region_block,
+      instr.condition ? &region_block : region_merge);
+  builder_->setBuildPoint(&region_block);
+  skippable_region_merges_.push_back(region_merge);
+}
+
+void SpirvShaderTranslator::ProcessSkippableRegionEnd() {
+  CloseExecConditionals();
+  assert_false(skippable_region_merges_.empty());
+  spv::Block* region_merge = skippable_region_merges_.back();
+  skippable_region_merges_.pop_back();
+  spv::Block& inner_block = *builder_->getBuildPoint();
+  if (!inner_block.isTerminated()) {
+    builder_->createBranch(region_merge);
+  }
+  inner_block.getParent().addBlock(region_merge);
+  builder_->setBuildPoint(region_merge);
+}
+
 spv::Id SpirvShaderTranslator::SpirvSmearScalarResultOrConstant(
     spv::Id scalar, spv::Id vector_type) {
   bool is_constant = builder_->isConstant(scalar);
@@ -2185,27 +2240,7 @@ void SpirvShaderTranslator::UpdateExecConditionals(
   EnsureBuildPointAvailable();
   spv::Id condition_id;
   if (type == ParsedExecInstruction::Type::kConditional) {
-    id_vector_temp_.clear();
-    // Bool constants (member 0).
-    id_vector_temp_.push_back(const_int_0_);
-    // 128-bit vector.
-    id_vector_temp_.push_back(
-        builder_->makeIntConstant(int(bool_constant_index >> 7)));
-    // 32-bit scalar of a 128-bit vector.
-    id_vector_temp_.push_back(
-        builder_->makeIntConstant(int((bool_constant_index >> 5) & 3)));
-    spv::Id bool_constant_scalar =
-        builder_->createLoad(builder_->createAccessChain(
-                                 spv::StorageClassUniform,
-                                 uniform_bool_loop_constants_, id_vector_temp_),
-                             spv::NoPrecision);
-    condition_id = builder_->createBinOp(
-        spv::OpINotEqual, type_bool_,
-        builder_->createBinOp(
-            spv::OpBitwiseAnd, type_uint_, bool_constant_scalar,
-            builder_->makeUintConstant(uint32_t(1)
-                                       << (bool_constant_index & 31))),
-        const_uint_0_);
+    condition_id = LoadBoolConstant(bool_constant_index);
     cf_exec_bool_constant_or_predicate_ = bool_constant_index;
   } else if (type == ParsedExecInstruction::Type::kPredicated) {
     condition_id = builder_->createLoad(var_main_predicate_, spv::NoPrecision);
@@ -2226,6 +2261,29 @@ void SpirvShaderTranslator::UpdateExecConditionals(
   builder_->setBuildPoint(&inner_block);
 }
 
+spv::Id SpirvShaderTranslator::LoadBoolConstant(uint32_t bool_constant_index) {
+  id_vector_temp_.clear();
+  // Bool constants (member 0).
+  id_vector_temp_.push_back(const_int_0_);
+  // 128-bit vector.
+  id_vector_temp_.push_back(
+      builder_->makeIntConstant(int(bool_constant_index >> 7)));
+  // 32-bit scalar of a 128-bit vector.
+  id_vector_temp_.push_back(
+      builder_->makeIntConstant(int((bool_constant_index >> 5) & 3)));
+  spv::Id bool_constant_scalar =
+      builder_->createLoad(builder_->createAccessChain(
+                               spv::StorageClassUniform,
+                               uniform_bool_loop_constants_, id_vector_temp_),
+                           spv::NoPrecision);
+  return builder_->createBinOp(
+      spv::OpINotEqual, type_bool_,
+      builder_->createBinOp(spv::OpBitwiseAnd, type_uint_, bool_constant_scalar,
+                            builder_->makeUintConstant(
+                                uint32_t(1) << (bool_constant_index & 31))),
+      const_uint_0_);
+}
+
 void SpirvShaderTranslator::UpdateInstructionPredication(bool predicated,
                                                          bool condition) {
   if (!predicated) {
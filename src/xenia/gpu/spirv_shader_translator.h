@@ -205,7 +205,10 @@ class SpirvShaderTranslator : public ShaderTranslator {
     float alpha_test_reference;
     uint32_t edram_32bpp_tile_pitch_dwords_scaled;
     uint32_t edram_depth_base_dwords_scaled;
-    float padding_edram_depth_base_dwords_scaled;
+    // With fragment shader interlock, if alpha to coverage is enabled, bits
+    // 0:7 are the dithering threshold offsets of RB_COLORCONTROL, and bit 8 is
+    // set. 0 if alpha to coverage is disabled.
+    uint32_t alpha_to_mask;
 
     float color_exp_bias[4];
 
@@ -306,6 +309,16 @@ class SpirvShaderTranslator : public ShaderTranslator {
     kDescriptorSetTexturesPixel,
 
     kDescriptorSetCount,
+
+    // With bindless resources, the texture descriptor sets are replaced with
+    // a fixed layout:
+    // Never changed - images and samplers for all shader stages, indexed with
+    // the values from kDescriptorSetBindlessDescriptorIndices.
+    kDescriptorSetBindlessResources = kDescriptorSetTexturesVertex,
+    // Changed when the textures or the samplers used by the shaders are
+    // changed - uniform buffers with the indices of the descriptors in
+    // kDescriptorSetBindlessResources used by the shaders.
+    kDescriptorSetBindlessDescriptorIndices = kDescriptorSetTexturesPixel,
   };
   static_assert(
       kDescriptorSetCount <= 4,
@@ -315,6 +328,38 @@ class SpirvShaderTranslator : public ShaderTranslator {
       "PowerVR, Qualcomm Adreno 6xx and older, as well as on old PC Nvidia "
       "drivers");
 
+  enum BindlessResourceBinding : uint32_t {
+    kBindlessResourceBindingTextures2DArray,
+    kBindlessResourceBindingTextures3D,
+    kBindlessResourceBindingTexturesCube,
+    kBindlessResourceBindingSamplers,
+
+    kBindlessResourceBindingCount,
+  };
+  // Sizes of the arrays in kDescriptorSetBindlessResources. The total is within
+  // the minimum update-after-bind limits of 500000 for devices supporting the
+  // descriptorIndexing feature, and the sampler count is within the minimum
+  // maxSamplerAllocationCount of 4000.
+  static constexpr uint32_t kBindlessResourceBindingDescriptorCounts
+      [kBindlessResourceBindingCount] = {
+          131072,
+          16384,
+          16384,
+          4000,
+  };
+
+  enum BindlessDescriptorIndicesBinding : uint32_t {
+    kBindlessDescriptorIndicesBindingVertex,
+    kBindlessDescriptorIndicesBindingPixel,
+
+    kBindlessDescriptorIndicesBindingCount,
+  };
+  // Maximum number of textures and samplers in a single shader with bindless
+  // resources, to declare the descriptor index uniform buffer (uint4 array in
+  // std140) with a fixed size - only the part for the bindings actually used is
+  // bound.
+  static constexpr uint32_t kMaxBindlessDescriptorIndices = 1024;
+
   // "Xenia Emulator Microcode Translator".
   // https://github.com/KhronosGroup/SPIRV-Headers/blob/c43a43c7cc3af55910b9bec2a71e3e8a622443cf/include/spirv/spir-v.xml#L79
   static constexpr uint32_t kSpirvMagicToolId = 26;
@@ -337,11 +382,13 @@ class SpirvShaderTranslator : public ShaderTranslator {
   SpirvShaderTranslator(const Features& features,
                         bool native_2x_msaa_with_attachments,
                         bool native_2x_msaa_no_attachments,
-                        bool edram_fragment_shader_interlock)
+                        bool edram_fragment_shader_interlock,
+                        bool bindless_resources_used)
       : features_(features),
         native_2x_msaa_with_attachments_(native_2x_msaa_with_attachments),
         native_2x_msaa_no_attachments_(native_2x_msaa_no_attachments),
-        edram_fragment_shader_interlock_(edram_fragment_shader_interlock) {}
+        edram_fragment_shader_interlock_(edram_fragment_shader_interlock),
+        bindless_resources_used_(bindless_resources_used) {}
 
   uint64_t GetDefaultVertexShaderModification(
       uint32_t dynamic_addressable_register_count,
@@ -407,6 +454,8 @@ class SpirvShaderTranslator : public ShaderTranslator {
 
   uint32_t GetModificationRegisterCount() const override;
 
+  bool SupportsStructuredControlFlow() const override { return true; }
+
   void StartTranslation() override;
 
   std::vector<uint8_t> CompleteTranslation() override;
@@ -422,6 +471,9 @@ class SpirvShaderTranslator : public ShaderTranslator {
   void ProcessLoopEndInstruction(
       const ParsedLoopEndInstruction& instr) override;
   void ProcessJumpInstruction(const ParsedJumpInstruction& instr) override;
+  void ProcessSkippableRegionBegin(
+      const ParsedJumpInstruction& instr) override;
+  void ProcessSkippableRegionEnd() override;
 
   void ProcessVertexFetchInstruction(
       const ParsedVertexFetchInstruction& instr) override;
@@ -436,6 +488,10 @@ class SpirvShaderTranslator : public ShaderTranslator {
     xenos::FetchOpDimension dimension;
     bool is_signed;
 
+    // Index in the descriptor index buffer with bindless resources, assigned
+    // along with those of the samplers in the order of addition.
+    uint32_t bindless_descriptor_index;
+    // spv::NoResult with bindless resources.
     spv::Id variable;
   };
 
@@ -446,6 +502,7 @@ class SpirvShaderTranslator : public ShaderTranslator {
     xenos::TextureFilter mip_filter;
     xenos::AnisoFilter aniso_filter;
 
+    uint32_t bindless_descriptor_index;
     spv::Id variable;
   };
 
@@ -505,6 +562,8 @@ class SpirvShaderTranslator : public ShaderTranslator {
   // needed (for example, in jumps).
   void UpdateExecConditionals(ParsedExecInstruction::Type type,
                               uint32_t bool_constant_index, bool condition);
+  // Returns whether the bool constant is true, as a bool.
+  spv::Id LoadBoolConstant(uint32_t bool_constant_index);
   // Opens or reopens the predicate check conditional for the instruction.
   // Should be called before processing a non-control-flow instruction.
   void UpdateInstructionPredication(bool predicated, bool condition);
@@ -594,6 +653,17 @@ class SpirvShaderTranslator : public ShaderTranslator {
                                  xenos::TextureFilter min_filter,
                                  xenos::TextureFilter mip_filter,
                                  xenos::AnisoFilter aniso_filter);
+  uint32_t GetBindlessDescriptorIndexCount() const {
+    return uint32_t(texture_bindings_.size() + sampler_bindings_.size());
+  }
+  // Loads the index of the bindless descriptor for a texture or a sampler
+  // binding from the descriptor index uniform buffer.
+  spv::Id LoadBindlessDescriptorIndex(uint32_t bindless_descriptor_index);
+  spv::Id GetBindlessResourceArray(BindlessResourceBinding binding);
+  // Load the image or the sampler from the variable of the binding, or, with
+  // bindless resources, from the global descriptor array.
+  spv::Id LoadTextureBinding(size_t texture_binding_index);
+  spv::Id LoadSamplerBinding(size_t sampler_binding_index);
   // `texture_parameters` need to be set up except for `sampler`, which will be
   // set internally, optionally doing linear interpolation between the an
   // existing value and the new one (the result location may be the same as for
@@ -623,6 +693,10 @@ class SpirvShaderTranslator : public ShaderTranslator {
            !current_shader().is_valid_memexport_used();
   }
   void FSI_LoadSampleMask(spv::Id msaa_samples);
+  // Returns the sample mask with the samples not covered by alpha to coverage
+  // (if enabled) dropped, including their deferred depth / stencil writes. The
+  // MSAA sample count is loaded if NoResult.
+  spv::Id FSI_AlphaToMask(spv::Id sample_mask, spv::Id msaa_samples);
   void FSI_LoadEdramOffsets(spv::Id msaa_samples);
   // The address must be a signed int. Whether the render target is 64bpp, if
   // present at all, must be a bool (if it's NoResult, 32bpp will be assumed).
@@ -675,6 +749,7 @@ class SpirvShaderTranslator : public ShaderTranslator {
   // flow of the main function, and that there are no returns before either
   // (there's a single return from the shader).
   bool edram_fragment_shader_interlock_;
+  bool bindless_resources_used_;
 
   // Is currently writing the empty depth-only pixel shader, such as for depth
   // and stencil testing with fragment shader interlock.
@@ -773,6 +848,7 @@ class SpirvShaderTranslator : public ShaderTranslator {
     kSystemConstantAlphaTestReference,
     kSystemConstantEdram32bppTilePitchDwordsScaled,
     kSystemConstantEdramDepthBaseDwordsScaled,
+    kSystemConstantAlphaToMask,
     kSystemConstantColorExpBias,
     kSystemConstantEdramPolyOffsetFrontScale,
     kSystemConstantEdramPolyOffsetBackScale,
@@ -803,6 +879,9 @@ class SpirvShaderTranslator : public ShaderTranslator {
   // are, for regular fetches, two bindings (unsigned and signed).
   std::vector<TextureBinding> texture_bindings_;
   std::vector<SamplerBinding> sampler_bindings_;
+  // Bindless resources, created when first needed.
+  std::array<spv::Id, kBindlessResourceBindingCount> bindless_resource_arrays_;
+  spv::Id uniform_bindless_descriptor_indices_;
 
   // VS as VS only - int.
   spv::Id input_vertex_index_;
@@ -913,6 +992,11 @@ class SpirvShaderTranslator : public ShaderTranslator {
   spv::Block* main_switch_merge_;
   std::vector<spv::Id> main_switch_next_pc_phi_operands_;
 
+  // With structured control flow, the blocks after the currently open
+  // skippable regions (not added to the function yet), from the outermost to
+  // the innermost.
+  std::vector<spv::Block*> skippable_region_merges_;
+
   // If the exec bool constant / predicate conditional is open, block after it
   // (not added to the function yet).
   spv::Block* cf_exec_conditional_merge_;
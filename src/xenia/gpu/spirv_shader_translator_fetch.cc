@@ -713,27 +713,16 @@ void SpirvShaderTranslator::ProcessTextureFetchInstruction(
                     const_float_vectors_0_[used_result_component_count - 1]);
         return;
       }
-      sampler = builder_->createLoad(sampler_bindings_[sampler_index].variable,
-                                     spv::NoPrecision);
-      const TextureBinding& image_2d_array_or_cube_unsigned_binding =
-          texture_bindings_[image_2d_array_or_cube_unsigned_index];
-      image_2d_array_or_cube_unsigned = builder_->createLoad(
-          image_2d_array_or_cube_unsigned_binding.variable, spv::NoPrecision);
-      const TextureBinding& image_2d_array_or_cube_signed_binding =
-          texture_bindings_[image_2d_array_or_cube_signed_index];
-      image_2d_array_or_cube_signed = builder_->createLoad(
-          image_2d_array_or_cube_signed_binding.variable, spv::NoPrecision);
+      sampler = LoadSamplerBinding(sampler_index);
+      image_2d_array_or_cube_unsigned =
+          LoadTextureBinding(image_2d_array_or_cube_unsigned_index);
+      image_2d_array_or_cube_signed =
+          LoadTextureBinding(image_2d_array_or_cube_signed_index);
       if (image_3d_unsigned_index != SIZE_MAX) {
-        const TextureBinding& image_3d_unsigned_binding =
-            texture_bindings_[image_3d_unsigned_index];
-        image_3d_unsigned = builder_->createLoad(
-            image_3d_unsigned_binding.variable, spv::NoPrecision);
+        image_3d_unsigned = LoadTextureBinding(image_3d_unsigned_index);
       }
       if (image_3d_signed_index != SIZE_MAX) {
-        const TextureBinding& image_3d_signed_binding =
-            texture_bindings_[image_3d_signed_index];
-        image_3d_signed = builder_->createLoad(image_3d_signed_binding.variable,
-                                               spv::NoPrecision);
+        image_3d_signed = LoadTextureBinding(image_3d_signed_index);
       }
     }
 
@@ -2338,6 +2327,20 @@ size_t SpirvShaderTranslator::FindOrAddTextureBinding(
       return i;
     }
   }
+  if (bindless_resources_used_) {
+    if (GetBindlessDescriptorIndexCount() >= kMaxBindlessDescriptorIndices) {
+      return SIZE_MAX;
+    }
+    size_t new_texture_binding_index = texture_bindings_.size();
+    TextureBinding& new_texture_binding = texture_bindings_.emplace_back();
+    new_texture_binding.fetch_constant = fetch_constant;
+    new_texture_binding.dimension = dimension;
+    new_texture_binding.is_signed = is_signed;
+    new_texture_binding.bindless_descriptor_index =
+        GetBindlessDescriptorIndexCount() - 1;
+    new_texture_binding.variable = spv::NoResult;
+    return new_texture_binding_index;
+  }
   // TODO(Triang3l): Limit the total count to that actually supported by the
   // implementation.
   size_t new_texture_binding_index = texture_bindings_.size();
@@ -2345,6 +2348,7 @@ size_t SpirvShaderTranslator::FindOrAddTextureBinding(
   new_texture_binding.fetch_constant = fetch_constant;
   new_texture_binding.dimension = dimension;
   new_texture_binding.is_signed = is_signed;
+  new_texture_binding.bindless_descriptor_index = 0;
   spv::Dim type_dimension;
   bool is_array;
   const char* dimension_name;
@@ -2401,6 +2405,10 @@ size_t SpirvShaderTranslator::FindOrAddSamplerBinding(
       return i;
     }
   }
+  if (bindless_resources_used_ &&
+      GetBindlessDescriptorIndexCount() >= kMaxBindlessDescriptorIndices) {
+    return SIZE_MAX;
+  }
   // TODO(Triang3l): Limit the total count to that actually supported by the
   // implementation.
   size_t new_sampler_binding_index = sampler_bindings_.size();
@@ -2410,6 +2418,13 @@ size_t SpirvShaderTranslator::FindOrAddSamplerBinding(
   new_sampler_binding.min_filter = min_filter;
   new_sampler_binding.mip_filter = mip_filter;
   new_sampler_binding.aniso_filter = aniso_filter;
+  if (bindless_resources_used_) {
+    new_sampler_binding.bindless_descriptor_index =
+        GetBindlessDescriptorIndexCount() - 1;
+    new_sampler_binding.variable = spv::NoResult;
+    return new_sampler_binding_index;
+  }
+  new_sampler_binding.bindless_descriptor_index = 0;
   std::ostringstream name;
   static const char kFilterSuffixes[] = {'p', 'l', 'b', 'f'};
   name << "xe_sampler" << fetch_constant << '_'
@@ -2438,6 +2453,155 @@ size_t SpirvShaderTranslator::FindOrAddSamplerBinding(
   return new_sampler_binding_index;
 }
 
+spv::Id SpirvShaderTranslator::LoadBindlessDescriptorIndex(
+    uint32_t bindless_descriptor_index) {
+  assert_true(bindless_resources_used_);
+  if (uniform_bindless_descriptor_indices_ == spv::NoResult) {
+    // Packed in std140 as 4-component vectors.
+    id_vector_temp_.clear();
+    id_vector_temp_.push_back(builder_->makeArrayType(
+        type_uint4_,
+        builder_->makeUintConstant(kMaxBindlessDescriptorIndices / 4),
+        sizeof(uint32_t) * 4));
+    builder_->addDecoration(id_vector_temp_.back(), spv::DecorationArrayStride,
+                            sizeof(uint32_t) * 4);
+    spv::Id type_descriptor_indices =
+        builder_->makeStructType(id_vector_temp_, "XeDescriptorIndices");
+    builder_->addMemberName(type_descriptor_indices, 0, "descriptor_indices");
+    builder_->addMemberDecoration(type_descriptor_indices, 0,
+                                  spv::DecorationOffset, 0);
+    builder_->addDecoration(type_descriptor_indices, spv::DecorationBlock);
+    uniform_bindless_descriptor_indices_ = builder_->createVariable(
+        spv::NoPrecision, spv::StorageClassUniform, type_descriptor_indices,
+        "xe_uniform_descriptor_indices");
+    builder_->addDecoration(uniform_bindless_descriptor_indices_,
+                            spv::DecorationDescriptorSet,
+                            int(kDescriptorSetBindlessDescriptorIndices));
+    builder_->addDecoration(uniform_bindless_descriptor_indices_,
+                            spv::DecorationBinding,
+                            int(is_vertex_shader()
+                                    ? kBindlessDescriptorIndicesBindingVertex
+                                    : kBindlessDescriptorIndicesBindingPixel));
+    if (features_.spirv_version >= spv::Spv_1_4) {
+      main_interface_.push_back(uniform_bindless_descriptor_indices_);
+    }
+  }
+  id_vector_temp_.clear();
+  // The only uniform buffer struct member.
+  id_vector_temp_.push_back(const_int_0_);
+  id_vector_temp_.push_back(
+      builder_->makeIntConstant(int(bindless_descriptor_index >> 2)));
+  id_vector_temp_.push_back(
+      builder_->makeIntConstant(int(bindless_descriptor_index & 3)));
+  return builder_->createLoad(
+      builder_->createAccessChain(spv::StorageClassUniform,
+                                  uniform_bindless_descriptor_indices_,
+                                  id_vector_temp_),
+      spv::NoPrecision);
+}
+
+spv::Id SpirvShaderTranslator::GetBindlessResourceArray(
+    BindlessResourceBinding binding) {
+  assert_true(bindless_resources_used_);
+  spv::Id& resource_array = bindless_resource_arrays_[binding];
+  if (resource_array != spv::NoResult) {
+    return resource_array;
+  }
+  spv::Id type_resource;
+  const char* name;
+  switch (binding) {
+    case kBindlessResourceBindingTextures3D:
+      type_resource =
+          builder_->makeImageType(type_float_, spv::Dim3D, false, false, false,
+                                  1, spv::ImageFormatUnknown);
+      name = "xe_textures_3d";
+      break;
+    case kBindlessResourceBindingTexturesCube:
+      type_resource =
+          builder_->makeImageType(type_float_, spv::DimCube, false, false,
+                                  false, 1, spv::ImageFormatUnknown);
+      name = "xe_textures_cube";
+      break;
+    case kBindlessResourceBindingSamplers:
+      type_resource = builder_->makeSamplerType();
+      name = "xe_samplers";
+      break;
+    default:
+      type_resource =
+          builder_->makeImageType(type_float_, spv::Dim2D, false, true, false,
+                                  1, spv::ImageFormatUnknown);
+      name = "xe_textures_2d";
+      break;
+  }
+  // Indexed with a dynamically uniform value from a uniform buffer.
+  builder_->addCapability(spv::CapabilitySampledImageArrayDynamicIndexing);
+  resource_array = builder_->createVariable(
+      spv::NoPrecision, spv::StorageClassUniformConstant,
+      builder_->makeArrayType(
+          type_resource,
+          builder_->makeUintConstant(
+              kBindlessResourceBindingDescriptorCounts[binding]),
+          0),
+      name);
+  builder_->addDecoration(resource_array, spv::DecorationDescriptorSet,
+                          int(kDescriptorSetBindlessResources));
+  builder_->addDecoration(resource_array, spv::DecorationBinding,
+                          int(binding));
+  if (features_.spirv_version >= spv::Spv_1_4) {
+    main_interface_.push_back(resource_array);
+  }
+  return resource_array;
+}
+
+spv::Id SpirvShaderTranslator::LoadTextureBinding(
+    size_t texture_binding_index) {
+  const TextureBinding& texture_binding =
+      texture_bindings_[texture_binding_index];
+  if (!bindless_resources_used_) {
+    return builder_->createLoad(texture_binding.variable, spv::NoPrecision);
+  }
+  BindlessResourceBinding resource_binding;
+  switch (texture_binding.dimension) {
+    case xenos::FetchOpDimension::k3DOrStacked:
+      resource_binding = kBindlessResourceBindingTextures3D;
+      break;
+    case xenos::FetchOpDimension::kCube:
+      resource_binding = kBindlessResourceBindingTexturesCube;
+      break;
+    default:
+      resource_binding = kBindlessResourceBindingTextures2DArray;
+      break;
+  }
+  spv::Id resource_array = GetBindlessResourceArray(resource_binding);
+  spv::Id descriptor_index =
+      LoadBindlessDescriptorIndex(texture_binding.bindless_descriptor_index);
+  id_vector_temp_.clear();
+  id_vector_temp_.push_back(descriptor_index);
+  return builder_->createLoad(
+      builder_->createAccessChain(spv::StorageClassUniformConstant,
+                                  resource_array, id_vector_temp_),
+      spv::NoPrecision);
+}
+
+spv::Id SpirvShaderTranslator::LoadSamplerBinding(
+    size_t sampler_binding_index) {
+  const SamplerBinding& sampler_binding =
+      sampler_bindings_[sampler_binding_index];
+  if (!bindless_resources_used_) {
+    return builder_->createLoad(sampler_binding.variable, spv::NoPrecision);
+  }
+  spv::Id resource_array =
+      GetBindlessResourceArray(kBindlessResourceBindingSamplers);
+  spv::Id descriptor_index =
+      LoadBindlessDescriptorIndex(sampler_binding.bindless_descriptor_index);
+  id_vector_temp_.clear();
+  id_vector_temp_.push_back(descriptor_index);
+  return builder_->createLoad(
+      builder_->createAccessChain(spv::StorageClassUniformConstant,
+                                  resource_array, id_vector_temp_),
+      spv::NoPrecision);
+}
+
 void SpirvShaderTranslator::SampleTexture(
     spv::Builder::TextureParameters& texture_parameters,
     spv::ImageOperandsMask image_operands_mask, spv::Id image_unsigned,
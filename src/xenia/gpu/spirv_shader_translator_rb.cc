@@ -536,8 +536,11 @@ void SpirvShaderTranslator::CompleteFragmentShaderInMain() {
     spv::Id alpha_test_function_is_non_always = builder_->createBinOp(
         spv::OpINotEqual, type_bool_, alpha_test_function,
         builder_->makeUintConstant(uint32_t(xenos::CompareFunction::kAlways)));
+    spv::Block& block_alpha_test_head = *builder_->getBuildPoint();
     spv::Block& block_alpha_test = builder_->makeNewBlock();
     spv::Block& block_alpha_test_merge = builder_->makeNewBlock();
+    spv::Id fsi_sample_mask_after_alpha_test = spv::NoResult;
+    spv::Block* block_alpha_test_end = nullptr;
     builder_->createSelectionMerge(&block_alpha_test_merge,
                                    spv::SelectionControlDontFlattenMask);
     builder_->createConditionalBranch(alpha_test_function_is_non_always,
@@ -623,9 +626,11 @@ void SpirvShaderTranslator::CompleteFragmentShaderInMain() {
       if (edram_fragment_shader_interlock_ &&
           !features_.demote_to_helper_invocation) {
         fsi_pixel_potentially_killed = true;
-        fsi_sample_mask_in_rt_0_alpha_tests = builder_->createTriOp(
+        fsi_sample_mask_after_alpha_test = builder_->createTriOp(
             spv::OpSelect, type_uint_, alpha_test_result,
             fsi_sample_mask_in_rt_0_alpha_tests, const_uint_0_);
+        block_alpha_test_end = builder_->getBuildPoint();
+        builder_->createBranch(&block_alpha_test_merge);
       } else {
         // Creating a merge block even though it will contain just one OpBranch
         // since SPIR-V requires structured control flow in shaders.
@@ -657,8 +662,22 @@ void SpirvShaderTranslator::CompleteFragmentShaderInMain() {
       }
     }
     builder_->setBuildPoint(&block_alpha_test_merge);
+    if (fsi_sample_mask_after_alpha_test != spv::NoResult) {
+      id_vector_temp_.clear();
+      id_vector_temp_.push_back(fsi_sample_mask_after_alpha_test);
+      id_vector_temp_.push_back(block_alpha_test_end->getId());
+      id_vector_temp_.push_back(fsi_sample_mask_in_rt_0_alpha_tests);
+      id_vector_temp_.push_back(block_alpha_test_head.getId());
+      fsi_sample_mask_in_rt_0_alpha_tests =
+          builder_->createOp(spv::OpPhi, type_uint_, id_vector_temp_);
+    }
 
-    // TODO(Triang3l): Alpha to coverage.
+    // TODO(Triang3l): Alpha to coverage with host render targets.
+    if (edram_fragment_shader_interlock_) {
+      fsi_pixel_potentially_killed = true;
+      fsi_sample_mask_in_rt_0_alpha_tests = FSI_AlphaToMask(
+          fsi_sample_mask_in_rt_0_alpha_tests, msaa_samples);
+    }
 
     if (edram_fragment_shader_interlock_) {
       // Close the render target 0 written check.
@@ -666,19 +685,17 @@ void SpirvShaderTranslator::CompleteFragmentShaderInMain() {
       spv::Block& block_fsi_rt_0_alpha_tests_rt_written_end =
           *builder_->getBuildPoint();
       builder_->setBuildPoint(block_fsi_rt_0_alpha_tests_rt_written_merge);
-      if (!features_.demote_to_helper_invocation) {
-        // The tests might have modified the sample mask via
-        // fsi_sample_mask_in_rt_0_alpha_tests.
-        id_vector_temp_.clear();
-        id_vector_temp_.push_back(fsi_sample_mask_in_rt_0_alpha_tests);
-        id_vector_temp_.push_back(
-            block_fsi_rt_0_alpha_tests_rt_written_end.getId());
-        id_vector_temp_.push_back(main_fsi_sample_mask_);
-        id_vector_temp_.push_back(
-            block_fsi_rt_0_alpha_tests_rt_written_head->getId());
-        main_fsi_sample_mask_ =
-            builder_->createOp(spv::OpPhi, type_uint_, id_vector_temp_);
-      }
+      // The tests might have modified the sample mask via
+      // fsi_sample_mask_in_rt_0_alpha_tests.
+      id_vector_temp_.clear();
+      id_vector_temp_.push_back(fsi_sample_mask_in_rt_0_alpha_tests);
+      id_vector_temp_.push_back(
+          block_fsi_rt_0_alpha_tests_rt_written_end.getId());
+      id_vector_temp_.push_back(main_fsi_sample_mask_);
+      id_vector_temp_.push_back(
+          block_fsi_rt_0_alpha_tests_rt_written_head->getId());
+      main_fsi_sample_mask_ =
+          builder_->createOp(spv::OpPhi, type_uint_, id_vector_temp_);
     }
   }
 
@@ -1568,6 +1585,137 @@ void SpirvShaderTranslator::FSI_LoadSampleMask(spv::Id msaa_samples) {
       builder_->createOp(spv::OpPhi, type_uint_, id_vector_temp_);
 }
 
+spv::Id SpirvShaderTranslator::FSI_AlphaToMask(spv::Id sample_mask,
+                                               spv::Id msaa_samples) {
+  id_vector_temp_.clear();
+  id_vector_temp_.push_back(
+      builder_->makeIntConstant(kSystemConstantAlphaToMask));
+  spv::Id alpha_to_mask = builder_->createLoad(
+      builder_->createAccessChain(spv::StorageClassUniform,
+                                  uniform_system_constants_, id_vector_temp_),
+      spv::NoPrecision);
+  // Not storing the sample count for reuse, as this is in a conditional block.
+  if (msaa_samples == spv::NoResult) {
+    msaa_samples = LoadMsaaSamplesFromFlags();
+  }
+
+  spv::Block& block_alpha_to_mask_head = *builder_->getBuildPoint();
+  spv::Block& block_alpha_to_mask = builder_->makeNewBlock();
+  spv::Block& block_alpha_to_mask_merge = builder_->makeNewBlock();
+  builder_->createSelectionMerge(&block_alpha_to_mask_merge,
+                                 spv::SelectionControlDontFlattenMask);
+  builder_->createConditionalBranch(
+      builder_->createBinOp(spv::OpINotEqual, type_bool_, alpha_to_mask,
+                            const_uint_0_),
+      &block_alpha_to_mask, &block_alpha_to_mask_merge);
+  builder_->setBuildPoint(&block_alpha_to_mask);
+
+  spv::Id const_uint_1 = builder_->makeUintConstant(1);
+
+  // Get the dithering threshold offset index for the pixel, Y - low bit of
+  // offset index, X - high bit, and extract the offset. With resolution
+  // scaling, still using host pixels, to preserve the idea of dithering.
+  assert_true(input_fragment_coordinates_ != spv::NoResult);
+  spv::Id pixel_coordinates[2];
+  for (uint32_t i = 0; i < 2; ++i) {
+    id_vector_temp_.clear();
+    id_vector_temp_.push_back(builder_->makeIntConstant(int32_t(i)));
+    pixel_coordinates[i] = builder_->createUnaryOp(
+        spv::OpConvertFToU, type_uint_,
+        builder_->createLoad(
+            builder_->createAccessChain(spv::StorageClassInput,
+                                        input_fragment_coordinates_,
+                                        id_vector_temp_),
+            spv::NoPrecision));
+  }
+  spv::Id offset_shift = builder_->createBinOp(
+      spv::OpBitwiseOr, type_uint_,
+      builder_->createBinOp(
+          spv::OpShiftLeftLogical, type_uint_,
+          builder_->createBinOp(spv::OpBitwiseAnd, type_uint_,
+                                pixel_coordinates[0], const_uint_1),
+          builder_->makeUintConstant(2)),
+      builder_->createBinOp(
+          spv::OpShiftLeftLogical, type_uint_,
+          builder_->createBinOp(spv::OpBitwiseAnd, type_uint_,
+                                pixel_coordinates[1], const_uint_1),
+          const_uint_1));
+  spv::Id threshold_offset = builder_->createUnaryOp(
+      spv::OpConvertUToF, type_float_,
+      builder_->createTriOp(spv::OpBitFieldUExtract, type_uint_,
+                            alpha_to_mask, offset_shift,
+                            builder_->makeUintConstant(2)));
+
+  // Using the guest sample indices, with the thresholds of Direct3D 9 on the
+  // Xbox 360:
+  // - 4x: 0.75, 0.25, 0.5, 1.0 minus offset / 16.
+  // - 2x: 0.5, 1.0 minus offset / 8.
+  // - 1x: 1.0 minus offset / 4.
+  // Samples not covered with the current sample count are not in the mask
+  // anyway.
+  spv::Id is_msaa_4x = builder_->createBinOp(
+      spv::OpIEqual, type_bool_, msaa_samples,
+      builder_->makeUintConstant(uint32_t(xenos::MsaaSamples::k4X)));
+  spv::Id is_msaa_2x = builder_->createBinOp(
+      spv::OpIEqual, type_bool_, msaa_samples,
+      builder_->makeUintConstant(uint32_t(xenos::MsaaSamples::k2X)));
+  spv::Id const_float_0_5 = builder_->makeFloatConstant(0.5f);
+  spv::Id const_float_1 = builder_->makeFloatConstant(1.0f);
+  threshold_offset = builder_->createBinOp(
+      spv::OpFMul, type_float_, threshold_offset,
+      builder_->createTriOp(
+          spv::OpSelect, type_float_, is_msaa_4x,
+          builder_->makeFloatConstant(1.0f / 16.0f),
+          builder_->createTriOp(spv::OpSelect, type_float_, is_msaa_2x,
+                                builder_->makeFloatConstant(1.0f / 8.0f),
+                                builder_->makeFloatConstant(1.0f / 4.0f))));
+  spv::Id threshold_bases[4] = {
+      builder_->createTriOp(
+          spv::OpSelect, type_float_, is_msaa_4x,
+          builder_->makeFloatConstant(0.75f),
+          builder_->createTriOp(spv::OpSelect, type_float_, is_msaa_2x,
+                                const_float_0_5, const_float_1)),
+      builder_->createTriOp(spv::OpSelect, type_float_, is_msaa_4x,
+                            builder_->makeFloatConstant(0.25f), const_float_1),
+      const_float_0_5,
+      const_float_1,
+  };
+
+  id_vector_temp_.clear();
+  id_vector_temp_.push_back(builder_->makeIntConstant(3));
+  spv::Id alpha = builder_->createLoad(
+      builder_->createAccessChain(spv::StorageClassFunction,
+                                  output_or_var_fragment_data_[0],
+                                  id_vector_temp_),
+      spv::NoPrecision);
+  spv::Id const_uint_max = builder_->makeUintConstant(UINT32_MAX);
+  spv::Id sample_mask_alpha_to_mask = sample_mask;
+  for (uint32_t i = 0; i < 4; ++i) {
+    // Not covered if alpha is NaN.
+    spv::Id sample_covered = builder_->createBinOp(
+        spv::OpFOrdGreaterThanEqual, type_bool_, alpha,
+        builder_->createBinOp(spv::OpFSub, type_float_, threshold_bases[i],
+                              threshold_offset));
+    // Drop the late depth / stencil write along with the coverage, as the
+    // sample must not be written at all if discarded by alpha to coverage.
+    sample_mask_alpha_to_mask = builder_->createBinOp(
+        spv::OpBitwiseAnd, type_uint_, sample_mask_alpha_to_mask,
+        builder_->createTriOp(
+            spv::OpSelect, type_uint_, sample_covered, const_uint_max,
+            builder_->makeUintConstant(~(UINT32_C(0b00010001) << i))));
+  }
+  spv::Block& block_alpha_to_mask_end = *builder_->getBuildPoint();
+  builder_->createBranch(&block_alpha_to_mask_merge);
+
+  builder_->setBuildPoint(&block_alpha_to_mask_merge);
+  id_vector_temp_.clear();
+  id_vector_temp_.push_back(sample_mask_alpha_to_mask);
+  id_vector_temp_.push_back(block_alpha_to_mask_end.getId());
+  id_vector_temp_.push_back(sample_mask);
+  id_vector_temp_.push_back(block_alpha_to_mask_head.getId());
+  return builder_->createOp(spv::OpPhi, type_uint_, id_vector_temp_);
+}
+
 void SpirvShaderTranslator::FSI_LoadEdramOffsets(spv::Id msaa_samples) {
   // Convert the floating-point pixel coordinates to integer sample 0
   // coordinates.
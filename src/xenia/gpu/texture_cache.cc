@@ -9,10 +9,15 @@
 
 #include "xenia/gpu/texture_cache.h"
 
+#include <algorithm>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/device_profile.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/gpu_flags.h"
 
 DEFINE_int32(
@@ -49,6 +54,18 @@ DEFINE_uint32(
     "Maximum host texture memory usage (in megabytes) above which textures "
     "will be destroyed as soon as possible.",
     "GPU");
+DEFINE_uint32(
+    texture_cache_memory_budget_percent, 90,
+    "Percentage of the device memory budget provided by the OS and the driver "
+    "(via VK_EXT_memory_budget on Vulkan or QueryVideoMemoryInfo on Direct3D "
+    "12) that the textures may use together with all the other device memory "
+    "of the process. Above it, textures not used by the GPU anymore will be "
+    "destroyed regardless of their lifetime, to avoid paging and device loss "
+    "with high resolution scales on GPUs with little memory, but never below "
+    "texture_cache_memory_limit_soft, so memory used by other resources "
+    "doesn't cause all textures to be reloaded constantly. 0 to use only the "
+    "fixed texture memory limits.",
+    "GPU");
 DEFINE_uint32(
     texture_cache_memory_limit_render_to_texture, 24,
     "Part of the host texture memory budget (in megabytes) that will be scaled "
@@ -59,6 +76,22 @@ DEFINE_uint32(
     "textures - so with 2x2 resolution scaling, the soft limit will be 360 + "
     "96 MB, and with 3x3, it will be 360 + 216 MB.",
     "GPU");
+DEFINE_uint32(
+    texture_load_submission_budget_kb, 0,
+    "Maximum amount of guest texture data (in kilobytes) to load in a single "
+    "GPU submission before spreading the reloading of textures over the next "
+    "submissions, to reduce stuttering when many textures are streamed in at "
+    "once. Textures that are postponed keep their previous contents until "
+    "reloaded, while newly created textures and render-to-texture results are "
+    "always loaded immediately. 0 to load everything immediately.",
+    "GPU");
+DEFINE_bool(
+    texture_disk_cache, false,
+    "Store textures converted to the host format in the cache directory, "
+    "keyed by the hash of the guest data, and load them from there in later "
+    "sessions instead of converting them again on the GPU. Increases disk "
+    "usage.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
@@ -180,8 +213,13 @@ bool TextureCache::GetConfigDrawResolutionScale(uint32_t& x_out,
   uint32_t config_y =
       uint32_t(std::max(INT32_C(1), cvars::draw_resolution_scale_y));
 
-  uint32_t clamped_x = std::min(kMaxDrawResolutionScaleAlongAxis, config_x);
-  uint32_t clamped_y = std::min(kMaxDrawResolutionScaleAlongAxis, config_y);
+  uint32_t max_scale = kMaxDrawResolutionScaleAlongAxis;
+  if (xe::device_profile::IsLowMemory()) {
+    // The render target and texture memory grows with the square of the scale.
+    max_scale = std::min(max_scale, uint32_t(2));
+  }
+  uint32_t clamped_x = std::min(max_scale, config_x);
+  uint32_t clamped_y = std::min(max_scale, config_y);
   x_out = clamped_x;
   y_out = clamped_y;
   return clamped_x == config_x && clamped_y == config_y;
@@ -189,6 +227,24 @@ bool TextureCache::GetConfigDrawResolutionScale(uint32_t& x_out,
 
 void TextureCache::ClearCache() { DestroyAllTextures(); }
 
+void TextureCache::InitializeDiskCache(const std::filesystem::path& cache_root,
+                                       uint32_t title_id) {
+  ShutdownDiskCache();
+  if (!cvars::texture_disk_cache || cache_root.empty()) {
+    return;
+  }
+  disk_cache_ = std::make_unique<TextureDiskCache>();
+  if (!disk_cache_->Initialize(cache_root / "textures" /
+                               fmt::format("{:08X}", title_id))) {
+    disk_cache_.reset();
+  }
+}
+
+void TextureCache::ShutdownDiskCache() {
+  // Writes all the pending entries.
+  disk_cache_.reset();
+}
+
 void TextureCache::CompletedSubmissionUpdated(
     uint64_t completed_submission_index) {
   // If memory usage is too high, destroy unused textures.
@@ -203,24 +259,78 @@ void TextureCache::CompletedSubmissionUpdated(
       cvars::texture_cache_memory_limit_soft + limit_scaled_resolve_add_mb;
   uint32_t limit_hard_mb =
       cvars::texture_cache_memory_limit_hard + limit_scaled_resolve_add_mb;
+  if (xe::device_profile::IsLowMemory()) {
+    limit_soft_mb /= 2;
+    limit_hard_mb /= 2;
+  }
   uint32_t limit_soft_lifetime =
       cvars::texture_cache_memory_limit_soft_lifetime * 1000;
+  // The textures are given what's left of the budget after the rest of the
+  // memory used by the process, but at least the soft limit, as they're the
+  // only thing destroyed here, and evicting everything because of other
+  // resources would only cause constant reloading. Compared to the textures'
+  // own usage, so the ones destroyed during this update are subtracted from
+  // the excess.
+  uint64_t budget_excess = 0;
+  uint64_t host_memory_budget, host_memory_usage;
+  if (cvars::texture_cache_memory_budget_percent &&
+      GetHostMemoryBudget(host_memory_budget, host_memory_usage)) {
+    uint64_t host_memory_budget_limit =
+        host_memory_budget *
+        std::min(cvars::texture_cache_memory_budget_percent, uint32_t(100)) /
+        100;
+    uint64_t other_host_memory_usage =
+        host_memory_usage -
+        std::min(host_memory_usage, textures_total_host_memory_usage_);
+    uint64_t texture_budget_limit = std::max(
+        host_memory_budget_limit -
+            std::min(host_memory_budget_limit, other_host_memory_usage),
+        uint64_t(limit_soft_mb) << 20);
+    if (textures_total_host_memory_usage_ > texture_budget_limit) {
+      budget_excess = textures_total_host_memory_usage_ - texture_budget_limit;
+    }
+    bool host_memory_budget_exceeded = budget_excess != 0;
+    if (host_memory_budget_exceeded_ != host_memory_budget_exceeded) {
+      host_memory_budget_exceeded_ = host_memory_budget_exceeded;
+      if (host_memory_budget_exceeded) {
+        XELOGW(
+            "Texture cache: Device memory usage {} MB exceeds {}% of the {} MB "
+            "budget, destroying unused textures",
+            host_memory_usage >> 20, cvars::texture_cache_memory_budget_percent,
+            host_memory_budget >> 20);
+      } else {
+        XELOGGPU("Texture cache: Device memory usage is within the budget");
+      }
+    }
+  }
   bool destroyed_any = false;
   while (texture_used_first_ != nullptr) {
     uint64_t total_host_memory_usage_mb =
         (textures_total_host_memory_usage_ + ((UINT32_C(1) << 20) - 1)) >> 20;
     bool limit_hard_exceeded = total_host_memory_usage_mb > limit_hard_mb;
-    if (total_host_memory_usage_mb <= limit_soft_mb && !limit_hard_exceeded) {
+    bool budget_exceeded = budget_excess != 0;
+    if (total_host_memory_usage_mb <= limit_soft_mb && !limit_hard_exceeded &&
+        !budget_exceeded) {
       break;
     }
     Texture* texture = texture_used_first_;
     if (texture->last_usage_submission_index() > completed_submission_index) {
       break;
     }
-    if (!limit_hard_exceeded &&
+    if (!limit_hard_exceeded && !budget_exceeded &&
         (texture->last_usage_time() + limit_soft_lifetime) > current_time) {
       break;
     }
+    uint64_t texture_host_memory_usage = texture->GetHostMemoryUsage();
+    if (limit_hard_exceeded) {
+      ++textures_evicted_hard_;
+    } else if (budget_exceeded) {
+      ++textures_evicted_budget_;
+    } else {
+      ++textures_evicted_soft_;
+    }
+    textures_evicted_bytes_ += texture_host_memory_usage;
+    budget_excess -= std::min(budget_excess, texture_host_memory_usage);
     if (!destroyed_any) {
       destroyed_any = true;
       // The texture being destroyed might have been bound in the previous
@@ -231,16 +341,17 @@ void TextureCache::CompletedSubmissionUpdated(
       ResetTextureBindings();
     }
     // Remove the texture from the map and destroy it via its unique_ptr.
-    auto found_texture_it = textures_.find(texture->key());
-    assert_true(found_texture_it != textures_.end());
-    if (found_texture_it != textures_.end()) {
-      assert_true(found_texture_it->second.get() == texture);
-      textures_.erase(found_texture_it);
-      // `texture` is invalid now.
-    }
+    textures_.Erase(texture);
+    // `texture` is invalid now.
   }
   if (destroyed_any) {
     COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
+    COUNT_profile_set("gpu/texture_cache/evicted_soft", textures_evicted_soft_);
+    COUNT_profile_set("gpu/texture_cache/evicted_hard", textures_evicted_hard_);
+    COUNT_profile_set("gpu/texture_cache/evicted_budget",
+                      textures_evicted_budget_);
+    COUNT_profile_set("gpu/texture_cache/evicted_mb",
+                      textures_evicted_bytes_ >> 20);
   }
 }
 
@@ -248,6 +359,12 @@ void TextureCache::BeginSubmission(uint64_t new_submission_index) {
   assert_true(new_submission_index > current_submission_index_);
   current_submission_index_ = new_submission_index;
   current_submission_time_ = xe::Clock::QueryHostUptimeMillis();
+  submission_texture_load_bytes_ = 0;
+  if (texture_loads_deferred_) {
+    // Retry the postponed loads when the textures are used next time.
+    texture_loads_deferred_ = false;
+    ResetTextureBindings();
+  }
 }
 
 void TextureCache::BeginFrame() {
@@ -573,9 +690,99 @@ void TextureCache::WatchCallback(const global_unique_lock_type& global_lock,
       true, std::memory_order_release);
 }
 
+TextureCache::Texture* TextureCache::TextureMap::Find(const TextureKey& key,
+                                                      uint64_t key_hash) const {
+  if (slots_.empty()) {
+    return nullptr;
+  }
+  size_t slot_mask = slots_.size() - 1;
+  for (size_t i = size_t(key_hash) & slot_mask;; i = (i + 1) & slot_mask) {
+    const Slot& slot = slots_[i];
+    if (!slot.texture) {
+      return nullptr;
+    }
+    if (slot.key_hash == key_hash && slot.texture->key() == key) {
+      return slot.texture.get();
+    }
+  }
+}
+
+TextureCache::Texture* TextureCache::TextureMap::Insert(
+    std::unique_ptr<Texture> texture, uint64_t key_hash) {
+  if ((size_ + 1) * 4 > slots_.size() * 3) {
+    Grow();
+  }
+  size_t slot_mask = slots_.size() - 1;
+  size_t i = size_t(key_hash) & slot_mask;
+  while (slots_[i].texture) {
+    i = (i + 1) & slot_mask;
+  }
+  Slot& slot = slots_[i];
+  slot.key_hash = key_hash;
+  slot.texture = std::move(texture);
+  ++size_;
+  return slot.texture.get();
+}
+
+void TextureCache::TextureMap::Erase(const Texture* texture) {
+  if (slots_.empty()) {
+    assert_always();
+    return;
+  }
+  size_t slot_mask = slots_.size() - 1;
+  size_t i = size_t(TextureKey::Hasher()(texture->key())) & slot_mask;
+  while (slots_[i].texture.get() != texture) {
+    if (!slots_[i].texture) {
+      assert_always();
+      return;
+    }
+    i = (i + 1) & slot_mask;
+  }
+  slots_[i].texture.reset();
+  --size_;
+  // Shift the following slots of the probe sequence back into the hole so the
+  // lookups don't need tombstones.
+  size_t hole = i;
+  for (size_t j = (i + 1) & slot_mask; slots_[j].texture;
+       j = (j + 1) & slot_mask) {
+    size_t home = size_t(slots_[j].key_hash) & slot_mask;
+    // Whether the home of the entry is cyclically outside (hole, j].
+    if (((j - home) & slot_mask) >= ((j - hole) & slot_mask)) {
+      slots_[hole] = std::move(slots_[j]);
+      hole = j;
+    }
+  }
+}
+
+void TextureCache::TextureMap::Clear() {
+  // Destroying the textures while the slots are still valid.
+  for (Slot& slot : slots_) {
+    slot.texture.reset();
+  }
+  slots_.clear();
+  size_ = 0;
+}
+
+void TextureCache::TextureMap::Grow() {
+  std::vector<Slot> old_slots = std::move(slots_);
+  slots_.clear();
+  slots_.resize(old_slots.empty() ? kInitialSlotCount : old_slots.size() * 2);
+  size_t slot_mask = slots_.size() - 1;
+  for (Slot& old_slot : old_slots) {
+    if (!old_slot.texture) {
+      continue;
+    }
+    size_t i = size_t(old_slot.key_hash) & slot_mask;
+    while (slots_[i].texture) {
+      i = (i + 1) & slot_mask;
+    }
+    slots_[i] = std::move(old_slot);
+  }
+}
+
 void TextureCache::DestroyAllTextures(bool from_destructor) {
   ResetTextureBindings(from_destructor);
-  textures_.clear();
+  textures_.Clear();
   COUNT_profile_set("gpu/texture_cache/textures", 0);
 }
 
@@ -619,10 +826,13 @@ TextureCache::Texture* TextureCache::FindOrCreateTexture(TextureKey key) {
   // Try to find an existing texture.
   // TODO(Triang3l): Reuse a texture with mip_page unchanged, but base_page
   // previously 0, now not 0, to save memory - common case in streaming.
-  auto found_texture_it = textures_.find(key);
-  if (found_texture_it != textures_.end()) {
-    return found_texture_it->second.get();
+  ++texture_lookup_count_;
+  uint64_t key_hash = TextureKey::Hasher()(key);
+  Texture* found_texture = textures_.Find(key, key_hash);
+  if (found_texture) {
+    return found_texture;
   }
+  ++texture_miss_count_;
 
   // Create the texture and add it to the map.
   Texture* texture;
@@ -633,8 +843,7 @@ TextureCache::Texture* TextureCache::FindOrCreateTexture(TextureKey key) {
       return nullptr;
     }
     assert_true(new_texture->key() == key);
-    texture =
-        textures_.emplace(key, std::move(new_texture)).first->second.get();
+    texture = textures_.Insert(std::move(new_texture), key_hash);
   }
   COUNT_profile_set("gpu/texture_cache/textures", textures_.size());
   texture->LogAction("Created");
@@ -646,7 +855,7 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
     if (!n_textures) {
       return;
     } else {
-      LoadTextureData(*textures[0]);
+      LoadTextureData(*textures[0], true);
       return;
     }
   }
@@ -685,6 +894,11 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
     textures[i] = nullptr;
     Texture& texture = *p_texture;
 
+    if (DeferTextureLoad(texture, (index_base_outdated & (1ULL << i)) != 0,
+                         (index_mips_outdated & (1ULL << i)) != 0)) {
+      continue;
+    }
+
     TextureKey texture_key = texture.key();
     // Implementation may load multiple blocks at once via accesses of up to 128
     // bits (R32G32B32A32_UINT), so aligning the size to this value to make sure
@@ -734,9 +948,9 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
     }
 
     // Actually load the texture data.
-    if (!LoadTextureDataFromResidentMemoryImpl(
-            texture, (index_base_outdated & (1ULL << i)) != 0,
-            (index_mips_outdated & (1ULL << i)) != 0)) {
+    if (!LoadTextureDataFromMemory(texture,
+                                   (index_base_outdated & (1ULL << i)) != 0,
+                                   (index_mips_outdated & (1ULL << i)) != 0)) {
       continue;
     }
 
@@ -747,6 +961,7 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
       texture.SetBaseResolved(base_resolved);
       texture.SetMipsResolved(mips_resolved);
     }
+    texture.SetDataLoaded();
     // reque for makeuptodatandwatch
     textures[i] = &texture;
   }
@@ -768,7 +983,7 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
     }
   }
 }
-bool TextureCache::LoadTextureData(Texture& texture) {
+bool TextureCache::LoadTextureData(Texture& texture, bool allow_deferral) {
   // Check what needs to be uploaded.
   bool base_outdated, mips_outdated;
   {
@@ -779,6 +994,10 @@ bool TextureCache::LoadTextureData(Texture& texture) {
   if (!base_outdated && !mips_outdated) {
     return true;
   }
+  if (allow_deferral &&
+      DeferTextureLoad(texture, base_outdated, mips_outdated)) {
+    return true;
+  }
 
   TextureKey texture_key = texture.key();
 
@@ -830,8 +1049,7 @@ bool TextureCache::LoadTextureData(Texture& texture) {
   }
 
   // Actually load the texture data.
-  if (!LoadTextureDataFromResidentMemoryImpl(texture, base_outdated,
-                                             mips_outdated)) {
+  if (!LoadTextureDataFromMemory(texture, base_outdated, mips_outdated)) {
     return false;
   }
 
@@ -842,6 +1060,7 @@ bool TextureCache::LoadTextureData(Texture& texture) {
     texture.SetBaseResolved(base_resolved);
     texture.SetMipsResolved(mips_resolved);
   }
+  texture.SetDataLoaded();
 
   // Mark the ranges as uploaded and watch them. This is needed for scaled
   // resolves as well to detect when the CPU wants to reuse the memory for a
@@ -854,6 +1073,101 @@ bool TextureCache::LoadTextureData(Texture& texture) {
   return true;
 }
 
+bool TextureCache::DeferTextureLoad(const Texture& texture, bool load_base,
+                                    bool load_mips) {
+  if (!cvars::texture_load_submission_budget_kb) {
+    return false;
+  }
+  uint64_t load_bytes = 0;
+  if (load_base) {
+    load_bytes += texture.GetGuestBaseSize();
+  }
+  if (load_mips) {
+    load_bytes += texture.GetGuestMipsSize();
+  }
+  // Always allow at least one load in a submission so big textures still make
+  // progress.
+  if (texture.IsDataLoaded() && !texture.key().scaled_resolve &&
+      !texture.IsResolved() && submission_texture_load_bytes_ &&
+      submission_texture_load_bytes_ + load_bytes >
+          uint64_t(cvars::texture_load_submission_budget_kb) << 10) {
+    texture_loads_deferred_ = true;
+    texture.LogAction("Postponed loading");
+    return true;
+  }
+  submission_texture_load_bytes_ += load_bytes;
+  return false;
+}
+
+bool TextureCache::LoadTextureDataFromMemory(Texture& texture, bool load_base,
+                                             bool load_mips) {
+  uint64_t load_byte_count = 0;
+  if (load_base) {
+    load_byte_count += texture.GetGuestBaseSize();
+  }
+  if (load_mips) {
+    load_byte_count += texture.GetGuestMipsSize();
+  }
+  texture_load_byte_count_ += load_byte_count;
+  total_texture_load_byte_count_ += load_byte_count;
+  uint64_t disk_cache_hash = 0;
+  TextureKey texture_key = texture.key();
+  if (disk_cache_ && !texture_key.scaled_resolve) {
+    uint64_t host_format = GetDiskCacheHostFormat(texture_key);
+    // Only the data from the CPU can be hashed, the guest memory doesn't
+    // contain what has been written by the GPU.
+    if (host_format &&
+        !(load_base && shared_memory().IsRangeWrittenByGpu(
+                           texture_key.base_page << 12,
+                           texture.GetGuestBaseSize())) &&
+        !(load_mips && shared_memory().IsRangeWrittenByGpu(
+                           texture_key.mip_page << 12,
+                           texture.GetGuestMipsSize()))) {
+      disk_cache_hash =
+          GetDiskCacheHash(texture, load_base, load_mips, host_format);
+      if (disk_cache_->Load(disk_cache_hash, disk_cache_load_buffer_)) {
+        if (LoadTextureDataFromHostDataImpl(
+                texture, load_base, load_mips, disk_cache_load_buffer_.data(),
+                disk_cache_load_buffer_.size())) {
+          texture.LogAction("Loaded from the disk cache");
+          return true;
+        }
+        // Not storing the entry again.
+        disk_cache_hash = 0;
+      }
+    }
+  }
+  return LoadTextureDataFromResidentMemoryImpl(texture, load_base, load_mips,
+                                               disk_cache_hash);
+}
+
+uint64_t TextureCache::GetDiskCacheHash(const Texture& texture, bool load_base,
+                                        bool load_mips,
+                                        uint64_t host_format) const {
+  TextureKey texture_key = texture.key();
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+  XXH3_64bits_update(&hash_state, &texture_key, sizeof(texture_key));
+  XXH3_64bits_update(&hash_state, &host_format, sizeof(host_format));
+  uint32_t parts = uint32_t(load_base) | (uint32_t(load_mips) << 1);
+  XXH3_64bits_update(&hash_state, &parts, sizeof(parts));
+  if (load_base) {
+    XXH3_64bits_update(
+        &hash_state,
+        shared_memory().TranslatePhysical(texture_key.base_page << 12),
+        texture.GetGuestBaseSize());
+  }
+  if (load_mips) {
+    XXH3_64bits_update(
+        &hash_state,
+        shared_memory().TranslatePhysical(texture_key.mip_page << 12),
+        texture.GetGuestMipsSize());
+  }
+  uint64_t hash = XXH3_64bits_digest(&hash_state);
+  // 0 is reserved for no hash.
+  return hash ? hash : 1;
+}
+
 void TextureCache::BindingInfoFromFetchConstant(
     const xenos::xe_gpu_texture_fetch_t& fetch, TextureKey& key_out,
     uint8_t* swizzled_signs_out) {
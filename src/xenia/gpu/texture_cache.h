@@ -14,8 +14,9 @@
 #include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/hash.h"
@@ -23,6 +24,7 @@
 #include "xenia/base/mutex.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/shared_memory.h"
+#include "xenia/gpu/texture_disk_cache.h"
 #include "xenia/gpu/texture_util.h"
 #include "xenia/gpu/xenos.h"
 
@@ -85,10 +87,33 @@ class TextureCache {
 
   virtual void ClearCache();
 
+  // Opens the persistent cache of converted host texture data for the title if
+  // enabled and supported by the implementation.
+  void InitializeDiskCache(const std::filesystem::path& cache_root,
+                           uint32_t title_id);
+  void ShutdownDiskCache();
+
   virtual void CompletedSubmissionUpdated(uint64_t completed_submission_index);
   virtual void BeginSubmission(uint64_t new_submission_index);
   virtual void BeginFrame();
 
+  // Texture lookups by key, and those that needed a new texture to be created,
+  // and the guest bytes of the texture data loads, since the last reset, for
+  // benchmarking.
+  uint32_t texture_lookup_count() const { return texture_lookup_count_; }
+  uint32_t texture_miss_count() const { return texture_miss_count_; }
+  uint64_t texture_load_byte_count() const { return texture_load_byte_count_; }
+  void ResetTextureLookupCounts() {
+    texture_lookup_count_ = 0;
+    texture_miss_count_ = 0;
+    texture_load_byte_count_ = 0;
+  }
+  // Guest bytes of the texture data loads since the cache was created, not
+  // reset for benchmarking.
+  uint64_t total_texture_load_byte_count() const {
+    return total_texture_load_byte_count_;
+  }
+
   void MarkRangeAsResolved(uint32_t start_unscaled, uint32_t length_unscaled);
   // Ensures the memory backing the range in the scaled resolve address space is
   // allocated and returns whether it is.
@@ -256,6 +281,11 @@ class TextureCache {
     }
     bool IsResolved() const { return base_resolved_ || mips_resolved_; }
 
+    // Whether the host texture has been loaded at least once, so it contains
+    // some meaningful data even if outdated.
+    bool IsDataLoaded() const { return data_loaded_; }
+    void SetDataLoaded() { data_loaded_ = true; }
+
     bool base_outdated(const global_unique_lock_type& global_lock) const {
       return base_outdated_;
     }
@@ -304,6 +334,8 @@ class TextureCache {
     bool base_resolved_;
     bool mips_resolved_;
 
+    bool data_loaded_ = false;
+
     // These are to be accessed within the global critical region to synchronize
     // with shared memory.
     // Whether the recent base level data needs reloading from the memory.
@@ -552,6 +584,14 @@ class TextureCache {
   virtual uint32_t GetMaxHostTextureDepthOrArraySize(
       xenos::DataDimension dimension) const = 0;
 
+  // Returns the device-local memory budget given to the process by the OS and
+  // the driver and the current usage by the whole process, in bytes, or false
+  // if the host doesn't report them.
+  virtual bool GetHostMemoryBudget(uint64_t& budget_out,
+                                   uint64_t& usage_out) const {
+    return false;
+  }
+
   // The texture must be created exactly with this key (if the implementation
   // supports the texture with this key, otherwise, or in case of a runtime
   // failure, it should return nullptr), modifying it is not allowed.
@@ -567,15 +607,55 @@ class TextureCache {
     assert_true(load_shader_index < kLoadShaderCount);
     return load_shader_info_[load_shader_index];
   }
-  bool LoadTextureData(Texture& texture);
+  // If allow_deferral is true, reloading may be postponed to a later
+  // submission if the per-submission load budget has been exhausted (returning
+  // true in this case, with the texture staying outdated).
+  bool LoadTextureData(Texture& texture, bool allow_deferral = false);
   void LoadTexturesData(Texture** textures, uint32_t n_textures);
+  // Checks whether loading of the outdated parts of the texture should be
+  // postponed to a later submission to stay within
+  // texture_load_submission_budget_kb, and if not, adds the size to the amount
+  // loaded in the current submission. Only textures that already contain data
+  // can be postponed, with their previous contents used meanwhile - new
+  // textures and render-to-texture results are always loaded.
+  bool DeferTextureLoad(const Texture& texture, bool load_base,
+                        bool load_mips);
+  // Loads the texture data from the disk cache if possible, or from the
+  // resident memory otherwise, with the memory already requested.
+  bool LoadTextureDataFromMemory(Texture& texture, bool load_base,
+                                 bool load_mips);
+  // Hash of the guest data of the texture and the host representation for the
+  // disk cache.
+  uint64_t GetDiskCacheHash(const Texture& texture, bool load_base,
+                            bool load_mips, uint64_t host_format) const;
   // Writes the texture data (for base, mips or both - but not neither) from the
   // shared memory or the scaled resolve memory. The shared memory management is
   // done outside this function, the implementation just needs to load the data
-  // into the texture object.
-  virtual bool LoadTextureDataFromResidentMemoryImpl(Texture& texture,
-                                                     bool load_base,
-                                                     bool load_mips) = 0;
+  // into the texture object. If disk_cache_hash is not 0, the implementation
+  // should pass the converted data to StoreTextureHostDataInDiskCache with it
+  // when it's available.
+  virtual bool LoadTextureDataFromResidentMemoryImpl(
+      Texture& texture, bool load_base, bool load_mips,
+      uint64_t disk_cache_hash) = 0;
+
+  // Non-zero identifier of the host representation (the host format and the
+  // layout of the data) of the texture for keying the disk cache, or 0 if the
+  // implementation doesn't support loading the texture via the disk cache.
+  virtual uint64_t GetDiskCacheHostFormat(TextureKey key) const { return 0; }
+  // Writes the texture data (base, mips or both) from the host data previously
+  // stored by the implementation in the disk cache.
+  virtual bool LoadTextureDataFromHostDataImpl(Texture& texture,
+                                               bool load_base, bool load_mips,
+                                               const uint8_t* host_data,
+                                               size_t host_data_size) {
+    return false;
+  }
+  void StoreTextureHostDataInDiskCache(uint64_t disk_cache_hash,
+                                       std::vector<uint8_t>&& host_data) {
+    if (disk_cache_) {
+      disk_cache_->Store(disk_cache_hash, std::move(host_data));
+    }
+  }
 
   // Converts a texture fetch constant to a texture key, normalizing and
   // validating the values, or creating an invalid key, and also gets the
@@ -642,14 +722,59 @@ class TextureCache {
   uint64_t current_submission_index_ = 0;
   uint64_t current_submission_time_ = 0;
 
-  std::unordered_map<TextureKey, std::unique_ptr<Texture>, TextureKey::Hasher>
-      textures_;
+  // Guest bytes of texture data loaded in the current submission, for the
+  // texture_load_submission_budget_kb limit.
+  uint64_t submission_texture_load_bytes_ = 0;
+  // Whether any texture loads have been postponed in the current submission,
+  // so the bindings need to be checked again in the next one.
+  bool texture_loads_deferred_ = false;
+
+  std::unique_ptr<TextureDiskCache> disk_cache_;
+  // Reusable buffer for the data loaded from the disk cache.
+  std::vector<uint8_t> disk_cache_load_buffer_;
+
+  // Open addressing table owning the textures, with linear probing. The
+  // hashes of the keys are stored in the slots so probing doesn't need to
+  // access the textures until a hash matches.
+  class TextureMap {
+   public:
+    Texture* Find(const TextureKey& key, uint64_t key_hash) const;
+    Texture* Insert(std::unique_ptr<Texture> texture, uint64_t key_hash);
+    void Erase(const Texture* texture);
+    void Clear();
+    size_t size() const { return size_; }
+
+   private:
+    struct Slot {
+      uint64_t key_hash;
+      std::unique_ptr<Texture> texture;
+    };
+    static constexpr size_t kInitialSlotCount = 256;
+    void Grow();
+    // A power of two number of slots, never more than 3/4 occupied.
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+  };
+  TextureMap textures_;
+  uint32_t texture_lookup_count_ = 0;
+  uint32_t texture_miss_count_ = 0;
+  uint64_t texture_load_byte_count_ = 0;
+  uint64_t total_texture_load_byte_count_ = 0;
 
   uint64_t textures_total_host_memory_usage_ = 0;
 
   Texture* texture_used_first_ = nullptr;
   Texture* texture_used_last_ = nullptr;
 
+  // Eviction statistics, by the reason of the destruction.
+  uint64_t textures_evicted_soft_ = 0;
+  uint64_t textures_evicted_hard_ = 0;
+  uint64_t textures_evicted_budget_ = 0;
+  uint64_t textures_evicted_bytes_ = 0;
+  // Whether the host memory budget was exceeded during the last check, for
+  // logging only when the state changes.
+  bool host_memory_budget_exceeded_ = false;
+
   // Whether a texture has become outdated (a memory watch has been triggered),
   // so need to recheck if textures aren't outdated, disregarding whether fetch
   // constants have been changed.
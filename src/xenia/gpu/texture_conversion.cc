@@ -126,6 +126,13 @@ void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
   auto log2_bpp = (input_bytes_per_block / 4) +
                   ((input_bytes_per_block / 2) >> (input_bytes_per_block / 4));
 
+  // Within each 16 bytes of a row of a tile, the blocks are stored linearly, so
+  // if the block size is not changed by the conversion, they can be copied or
+  // converted in runs rather than one by one.
+  uint32_t run_blocks = input_bytes_per_block == output_bytes_per_block
+                            ? std::max(uint32_t(16) >> log2_bpp, uint32_t(1))
+                            : uint32_t(1);
+
   // Offset to the current row, in bytes.
   uint32_t output_row_offset = 0;
   for (uint32_t y = 0; y < untile_info->height; y++) {
@@ -135,18 +142,27 @@ void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
     // Go block-by-block on this row.
     uint32_t output_offset = output_row_offset;
 
-    for (uint32_t x = 0; x < untile_info->width; x++) {
-      auto input_offset = TiledOffset2DColumn(untile_info->offset_x + x,
-                                              untile_info->offset_y + y,
-                                              log2_bpp, input_row_offset);
+    for (uint32_t x = 0; x < untile_info->width;) {
+      uint32_t input_x = untile_info->offset_x + x;
+      auto input_offset = TiledOffset2DColumn(
+          input_x, untile_info->offset_y + y, log2_bpp, input_row_offset);
       input_offset >>= log2_bpp;
 
-      untile_info->copy_callback(
-          &output_buffer[output_offset],
-          &input_buffer[input_offset * input_bytes_per_block],
-          output_bytes_per_block);
-
-      output_offset += output_bytes_per_block;
+      uint32_t blocks = std::min(run_blocks - (input_x & (run_blocks - 1)),
+                                 untile_info->width - x);
+      size_t run_length = size_t(output_bytes_per_block) * blocks;
+      if (untile_info->copy_callback) {
+        untile_info->copy_callback(
+            &output_buffer[output_offset],
+            &input_buffer[input_offset * input_bytes_per_block], run_length);
+      } else {
+        std::memcpy(&output_buffer[output_offset],
+                    &input_buffer[input_offset * input_bytes_per_block],
+                    run_length);
+      }
+
+      x += blocks;
+      output_offset += uint32_t(run_length);
     }
 
     output_row_offset += output_pitch;
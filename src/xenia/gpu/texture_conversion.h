@@ -32,6 +32,8 @@ void ConvertTexelCTX1ToR8G8(xenos::Endian endian, void* output,
 void ConvertTexelDXT3AToDXT3(xenos::Endian endian, void* output,
                              const void* input, size_t length);
 
+// Invoked with the output length of multiple consecutive blocks at once if the
+// input and the output block sizes are the same.
 typedef std::function<void(void*, const void*, size_t)> UntileCopyBlockCallback;
 
 typedef struct UntileInfo {
@@ -43,9 +45,13 @@ typedef struct UntileInfo {
   uint32_t output_pitch;
   const FormatInfo* input_format_info;
   const FormatInfo* output_format_info;
+  // If empty, the blocks are copied as is, without conversion.
   UntileCopyBlockCallback copy_callback;
 } UntileInfo;
 
+// Only writes the rows from offset_y to offset_y + height of the input to the
+// output buffer, so a large texture can be untiled on multiple threads in row
+// ranges, with the output buffer pointer advanced accordingly for each.
 void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
             const UntileInfo* untile_info);
 
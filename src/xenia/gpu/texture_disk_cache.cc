@@ -0,0 +1,214 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/texture_disk_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+
+namespace xe {
+namespace gpu {
+
+bool TextureDiskCache::Initialize(const std::filesystem::path& directory) {
+  Shutdown();
+
+  std::error_code ec;
+  if (!std::filesystem::exists(directory) &&
+      !std::filesystem::create_directories(directory, ec)) {
+    XELOGE("Failed to create the texture disk cache directory {}",
+           xe::path_to_utf8(directory));
+    return false;
+  }
+  directory_ = directory;
+
+  {
+    std::lock_guard<std::mutex> entries_lock(entries_mutex_);
+    entries_.clear();
+    for (const xe::filesystem::FileInfo& file_info :
+         xe::filesystem::ListFiles(directory_)) {
+      if (file_info.type != xe::filesystem::FileInfo::Type::kFile ||
+          file_info.name.extension() != ".xtd") {
+        continue;
+      }
+      std::string stem = xe::path_to_utf8(file_info.name.stem());
+      if (stem.size() != 16) {
+        continue;
+      }
+      char* stem_end;
+      uint64_t hash = std::strtoull(stem.c_str(), &stem_end, 16);
+      if (stem_end == stem.c_str() + stem.size()) {
+        entries_.insert(hash);
+      }
+    }
+    XELOGI("Texture disk cache: {} entries in {}", entries_.size(),
+           xe::path_to_utf8(directory_));
+  }
+
+  write_thread_shutdown_ = false;
+  write_thread_ =
+      xe::threading::Thread::Create({}, [this]() { WriteThread(); });
+  assert_not_null(write_thread_);
+  write_thread_->set_name("Texture Disk Cache Writer");
+  return true;
+}
+
+void TextureDiskCache::Shutdown() {
+  if (write_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(write_request_lock_);
+      write_thread_shutdown_ = true;
+    }
+    write_request_cond_.notify_all();
+    xe::threading::Wait(write_thread_.get(), false);
+    write_thread_.reset();
+  }
+  write_queue_.clear();
+  {
+    std::lock_guard<std::mutex> entries_lock(entries_mutex_);
+    entries_.clear();
+  }
+  directory_.clear();
+}
+
+bool TextureDiskCache::Load(uint64_t hash,
+                            std::vector<uint8_t>& host_data_out) {
+  {
+    std::lock_guard<std::mutex> entries_lock(entries_mutex_);
+    if (entries_.find(hash) == entries_.end()) {
+      return false;
+    }
+  }
+  {
+    // May still be in the write queue.
+    std::lock_guard<std::mutex> lock(write_request_lock_);
+    for (const auto& queued_entry : write_queue_) {
+      if (queued_entry.first == hash) {
+        host_data_out = queued_entry.second;
+        return true;
+      }
+    }
+  }
+  FILE* file = xe::filesystem::OpenFile(GetEntryPath(hash), "rb");
+  if (!file) {
+    return false;
+  }
+  EntryHeader header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               header.magic == EntryHeader::kMagic &&
+               header.version == EntryHeader::kVersion &&
+               header.hash == hash && header.data_size &&
+               header.data_size <= kMaxHostDataSize;
+  if (valid) {
+    host_data_out.resize(size_t(header.data_size));
+    valid = fread(host_data_out.data(), host_data_out.size(), 1, file) == 1 &&
+            XXH3_64bits(host_data_out.data(), host_data_out.size()) ==
+                header.data_hash;
+  }
+  fclose(file);
+  if (!valid) {
+    // Don't try to load a corrupted or outdated entry again, it will be
+    // overwritten when stored.
+    XELOGW("Texture disk cache: Entry {:016X} is invalid", hash);
+    std::lock_guard<std::mutex> entries_lock(entries_mutex_);
+    entries_.erase(hash);
+  }
+  return valid;
+}
+
+void TextureDiskCache::Store(uint64_t hash, std::vector<uint8_t>&& host_data) {
+  if (!write_thread_ || host_data.empty() ||
+      host_data.size() > kMaxHostDataSize) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> entries_lock(entries_mutex_);
+    if (!entries_.insert(hash).second) {
+      return;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(write_request_lock_);
+    write_queue_.emplace_back(hash, std::move(host_data));
+  }
+  write_request_cond_.notify_one();
+}
+
+std::filesystem::path TextureDiskCache::GetEntryPath(uint64_t hash) const {
+  return directory_ / fmt::format("{:016X}.xtd", hash);
+}
+
+void TextureDiskCache::WriteThread() {
+  while (true) {
+    const std::pair<uint64_t, std::vector<uint8_t>>* entry_ptr;
+    {
+      std::unique_lock<std::mutex> lock(write_request_lock_);
+      while (write_queue_.empty() && !write_thread_shutdown_) {
+        write_request_cond_.wait(lock);
+      }
+      if (write_queue_.empty()) {
+        // Shutting down with everything written.
+        return;
+      }
+      // Keeping the entry in the queue while writing so Load can still find
+      // it - only this thread removes entries, and push_back doesn't
+      // invalidate references to the existing elements of a deque.
+      entry_ptr = &write_queue_.front();
+    }
+    const std::pair<uint64_t, std::vector<uint8_t>>& entry = *entry_ptr;
+
+    EntryHeader header;
+    header.magic = EntryHeader::kMagic;
+    header.version = EntryHeader::kVersion;
+    header.hash = entry.first;
+    header.data_size = entry.second.size();
+    header.data_hash = XXH3_64bits(entry.second.data(), entry.second.size());
+    // Write to a temporary file first so a partially written entry is never
+    // loaded.
+    std::filesystem::path entry_path = GetEntryPath(entry.first);
+    std::filesystem::path temp_path = entry_path;
+    temp_path += ".tmp";
+    bool written = false;
+    FILE* file = xe::filesystem::OpenFile(temp_path, "wb");
+    if (file) {
+      written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                fwrite(entry.second.data(), entry.second.size(), 1, file) == 1;
+      written &= fclose(file) == 0;
+      if (written) {
+        std::error_code ec;
+        std::filesystem::rename(temp_path, entry_path, ec);
+        written = !ec;
+      }
+      if (!written) {
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+      }
+    }
+    if (!written) {
+      XELOGW("Texture disk cache: Failed to write entry {:016X}", entry.first);
+      std::lock_guard<std::mutex> entries_lock(entries_mutex_);
+      entries_.erase(entry.first);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(write_request_lock_);
+      write_queue_.pop_front();
+    }
+  }
+}
+
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,91 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_TEXTURE_DISK_CACHE_H_
+#define XENIA_GPU_TEXTURE_DISK_CACHE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/hash.h"
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace gpu {
+
+// Persistent storage of texture data already converted to the host format by
+// the backend, keyed by a hash of the guest data, the texture key and the host
+// format, so loading the same texture in a later session costs only I/O
+// instead of running the load shaders. Every entry is a separate file named by
+// the hash, so entries can also be produced by external tools (such as for
+// re-encoding into other formats, or for replacing textures) as long as they
+// use the backend's layout of the host data.
+class TextureDiskCache {
+ public:
+  // Entries with larger data are not stored.
+  static constexpr size_t kMaxHostDataSize = size_t(16) << 20;
+
+  TextureDiskCache() = default;
+  TextureDiskCache(const TextureDiskCache& cache) = delete;
+  TextureDiskCache& operator=(const TextureDiskCache& cache) = delete;
+  ~TextureDiskCache() { Shutdown(); }
+
+  bool Initialize(const std::filesystem::path& directory);
+  void Shutdown();
+
+  // Returns false if there's no valid entry for the hash.
+  bool Load(uint64_t hash, std::vector<uint8_t>& host_data_out);
+  // Writes the entry asynchronously.
+  void Store(uint64_t hash, std::vector<uint8_t>&& host_data);
+
+ private:
+  struct EntryHeader {
+    // 'XETD'.
+    static constexpr uint32_t kMagic = 0x44544558;
+    static constexpr uint32_t kVersion = 0x20241020;
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint64_t data_size;
+    uint64_t data_hash;
+  };
+
+  std::filesystem::path GetEntryPath(uint64_t hash) const;
+
+  void WriteThread();
+
+  std::filesystem::path directory_;
+
+  std::mutex entries_mutex_;
+  // Hashes of the entries existing or queued for writing, to avoid touching the
+  // file system for lookups of textures not in the cache and to avoid writing
+  // the same entry multiple times.
+  std::unordered_set<uint64_t, xe::hash::IdentityHasher<uint64_t>> entries_;
+
+  std::unique_ptr<xe::threading::Thread> write_thread_;
+  std::mutex write_request_lock_;
+  std::condition_variable write_request_cond_;
+  // Protected with write_request_lock_, notify_one write_request_cond_ when
+  // changed.
+  std::deque<std::pair<uint64_t, std::vector<uint8_t>>> write_queue_;
+  bool write_thread_shutdown_ = false;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_TEXTURE_DISK_CACHE_H_
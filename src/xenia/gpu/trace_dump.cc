@@ -9,6 +9,13 @@
 
 #include "xenia/gpu/trace_dump.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "third_party/stb/stb_image_write.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
@@ -30,6 +37,21 @@
 
 DEFINE_path(target_trace_file, "", "Specifies the trace file to load.", "GPU");
 DEFINE_path(trace_dump_path, "", "Output path for dumped files.", "GPU");
+DEFINE_uint32(trace_benchmark_iterations, 0,
+              "Instead of dumping the image, replay every frame of the trace "
+              "this many times after a warm-up pass and write the CPU and GPU "
+              "time and the cache hit rates of each frame to a .json file at "
+              "the output path. 0 to dump the image.",
+              "GPU");
+DEFINE_path(trace_benchmark_baseline, "",
+            "A .json file written by an earlier trace_benchmark_iterations run "
+            "of the same trace to compare the results with.",
+            "GPU");
+DEFINE_double(trace_benchmark_max_regression, 0.0,
+              "Percentage by which the total CPU or GPU time may exceed the "
+              "one in trace_benchmark_baseline before the benchmark is "
+              "considered failed. 0 to only report the difference.",
+              "GPU");
 
 namespace xe {
 namespace gpu {
@@ -89,6 +111,9 @@ int TraceDump::Main(const std::vector<std::string>& args) {
   // Ensure output path exists.
   xe::filesystem::CreateParentFolder(base_output_path_);
 
+  if (cvars::trace_benchmark_iterations) {
+    return RunBenchmark();
+  }
   return Run();
 }
 
@@ -151,5 +176,224 @@ int TraceDump::Run() {
   return result;
 }
 
+namespace {
+
+struct FrameBenchmark {
+  uint64_t cpu_time_ns_total = 0;
+  uint64_t cpu_time_ns_min = UINT64_MAX;
+  uint64_t gpu_time_ns_total = 0;
+  uint64_t gpu_time_ns_min = UINT64_MAX;
+  // False if the GPU time of any of the submissions couldn't be measured.
+  bool gpu_timed = true;
+  // Of the last iteration - with warm caches, the same for every iteration.
+  CommandProcessor::BenchmarkStatistics statistics;
+};
+
+double GetHitRate(uint32_t lookup_count, uint32_t miss_count) {
+  return lookup_count ? double(lookup_count - miss_count) / double(lookup_count)
+                      : 1.0;
+}
+
+// Only for reading the files written by RunBenchmark, with one object per line.
+bool FindJsonNumber(const char* line, const char* key, double& value_out) {
+  std::string pattern = fmt::format("\"{}\":", key);
+  const char* found = std::strstr(line, pattern.c_str());
+  if (!found) {
+    return false;
+  }
+  const char* value_start = found + pattern.size();
+  char* value_end;
+  value_out = std::strtod(value_start, &value_end);
+  return value_end != value_start;
+}
+
+void CompareBenchmarkTime(const char* name, double time_ms,
+                          double baseline_time_ms,
+                          double& regression_percent_out) {
+  regression_percent_out = 0.0;
+  if (time_ms < 0.0 || baseline_time_ms <= 0.0) {
+    return;
+  }
+  regression_percent_out = (time_ms / baseline_time_ms - 1.0) * 100.0;
+  XELOGI("  {}: {:.3f} ms, baseline {:.3f} ms ({:+.2f}%)", name, time_ms,
+         baseline_time_ms, regression_percent_out);
+}
+
+}  // namespace
+
+int TraceDump::RunBenchmark() {
+  int frame_count = player_->frame_count();
+  if (!frame_count) {
+    XELOGE("The trace has no frames to benchmark");
+    return 1;
+  }
+  uint32_t iterations = cvars::trace_benchmark_iterations;
+  XELOGI("Benchmarking {} frames, {} iterations", frame_count, iterations);
+
+  // The first pass only warms up the caches - translates the shaders, creates
+  // the pipelines and loads the textures.
+  std::vector<FrameBenchmark> frames(frame_count);
+  for (uint32_t i = 0; i <= iterations; ++i) {
+    for (int j = 0; j < frame_count; ++j) {
+      uint64_t cpu_time_ns;
+      CommandProcessor::BenchmarkStatistics statistics;
+      player_->BenchmarkFrame(j, cpu_time_ns, statistics);
+      if (!i) {
+        continue;
+      }
+      FrameBenchmark& frame = frames[j];
+      frame.cpu_time_ns_total += cpu_time_ns;
+      frame.cpu_time_ns_min = std::min(frame.cpu_time_ns_min, cpu_time_ns);
+      if (statistics.gpu_timed_submission_count < statistics.submission_count) {
+        frame.gpu_timed = false;
+      }
+      frame.gpu_time_ns_total += statistics.gpu_time_ns;
+      frame.gpu_time_ns_min =
+          std::min(frame.gpu_time_ns_min, statistics.gpu_time_ns);
+      frame.statistics = statistics;
+    }
+  }
+
+  // Negative GPU time if not measured.
+  auto ns_to_ms = [](uint64_t ns) { return double(ns) / 1000000.0; };
+  bool gpu_timed = true;
+  double total_cpu_ms_avg = 0.0, total_cpu_ms_min = 0.0;
+  double total_gpu_ms_avg = 0.0, total_gpu_ms_min = 0.0;
+  std::string frames_json;
+  for (int i = 0; i < frame_count; ++i) {
+    const FrameBenchmark& frame = frames[i];
+    double cpu_ms_avg = ns_to_ms(frame.cpu_time_ns_total) / iterations;
+    double cpu_ms_min = ns_to_ms(frame.cpu_time_ns_min);
+    double gpu_ms_avg = -1.0, gpu_ms_min = -1.0;
+    if (frame.gpu_timed) {
+      gpu_ms_avg = ns_to_ms(frame.gpu_time_ns_total) / iterations;
+      gpu_ms_min = ns_to_ms(frame.gpu_time_ns_min);
+      total_gpu_ms_avg += gpu_ms_avg;
+      total_gpu_ms_min += gpu_ms_min;
+    } else {
+      gpu_timed = false;
+    }
+    total_cpu_ms_avg += cpu_ms_avg;
+    total_cpu_ms_min += cpu_ms_min;
+    const CommandProcessor::BenchmarkStatistics& statistics = frame.statistics;
+    double pipeline_hit_rate = GetHitRate(statistics.pipeline_lookup_count,
+                                          statistics.pipeline_miss_count);
+    double texture_hit_rate = GetHitRate(statistics.texture_lookup_count,
+                                         statistics.texture_miss_count);
+    XELOGI(
+        "Frame {}: CPU {:.3f} ms (min {:.3f}), GPU {:.3f} ms (min {:.3f}), {} "
+        "submissions, pipeline hit rate {:.2f}% of {}, texture hit rate "
+        "{:.2f}% of {}, {} render passes, {} barrier batches",
+        i, cpu_ms_avg, cpu_ms_min, gpu_ms_avg, gpu_ms_min,
+        statistics.submission_count, pipeline_hit_rate * 100.0,
+        statistics.pipeline_lookup_count, texture_hit_rate * 100.0,
+        statistics.texture_lookup_count, statistics.render_pass_count,
+        statistics.barrier_batch_count);
+    frames_json += fmt::format(
+        "    {{\"frame\": {}, \"cpu_ms_avg\": {:.6f}, \"cpu_ms_min\": {:.6f}, "
+        "\"gpu_ms_avg\": {:.6f}, \"gpu_ms_min\": {:.6f}, \"submissions\": {}, "
+        "\"pipeline_lookups\": {}, \"pipeline_hit_rate\": {:.6f}, "
+        "\"texture_lookups\": {}, \"texture_hit_rate\": {:.6f}, "
+        "\"render_passes\": {}, \"barrier_batches\": {}, "
+        "\"memexport_bytes\": {}}}{}\n",
+        i, cpu_ms_avg, cpu_ms_min, gpu_ms_avg, gpu_ms_min,
+        statistics.submission_count, statistics.pipeline_lookup_count,
+        pipeline_hit_rate, statistics.texture_lookup_count, texture_hit_rate,
+        statistics.render_pass_count, statistics.barrier_batch_count,
+        statistics.memexport_bytes, i + 1 < frame_count ? "," : "");
+  }
+  if (!gpu_timed) {
+    total_gpu_ms_avg = -1.0;
+    total_gpu_ms_min = -1.0;
+  }
+  XELOGI("Total: CPU {:.3f} ms (min {:.3f}), GPU {:.3f} ms (min {:.3f})",
+         total_cpu_ms_avg, total_cpu_ms_min, total_gpu_ms_avg,
+         total_gpu_ms_min);
+
+  int result = 0;
+  auto json_path = base_output_path_;
+  json_path.replace_extension(".benchmark.json");
+  FILE* json_file = filesystem::OpenFile(json_path, "wb");
+  if (json_file) {
+    fmt::print(json_file,
+               "{{\n  \"trace\": \"{}\",\n  \"iterations\": {},\n"
+               "  \"frames\": [\n{}  ],\n",
+               path_to_utf8(trace_file_path_.filename()), iterations,
+               frames_json);
+    fmt::print(json_file,
+               "  \"total\": {{\"cpu_ms_avg\": {:.6f}, \"cpu_ms_min\": {:.6f}, "
+               "\"gpu_ms_avg\": {:.6f}, \"gpu_ms_min\": {:.6f}}}\n}}\n",
+               total_cpu_ms_avg, total_cpu_ms_min, total_gpu_ms_avg,
+               total_gpu_ms_min);
+    fclose(json_file);
+  } else {
+    XELOGE("Failed to write the benchmark results to {}",
+           path_to_utf8(json_path));
+    result = 1;
+  }
+
+  // The minimum times are compared as they're the least affected by the noise
+  // from the rest of the system.
+  FILE* baseline_file = nullptr;
+  if (!cvars::trace_benchmark_baseline.empty()) {
+    baseline_file = filesystem::OpenFile(cvars::trace_benchmark_baseline, "rb");
+    if (!baseline_file) {
+      XELOGE("Failed to open the benchmark baseline {}",
+             path_to_utf8(cvars::trace_benchmark_baseline));
+      result = 1;
+    }
+  }
+  if (baseline_file) {
+    XELOGI("Comparison with {}:",
+           path_to_utf8(cvars::trace_benchmark_baseline));
+    double regression_percent;
+    double max_regression_percent = 0.0;
+    char line[1024];
+    while (std::fgets(line, sizeof(line), baseline_file)) {
+      double baseline_cpu_ms, baseline_gpu_ms;
+      if (!FindJsonNumber(line, "cpu_ms_min", baseline_cpu_ms) ||
+          !FindJsonNumber(line, "gpu_ms_min", baseline_gpu_ms)) {
+        continue;
+      }
+      double frame_index;
+      if (FindJsonNumber(line, "frame", frame_index)) {
+        int frame = int(frame_index);
+        if (frame < 0 || frame >= frame_count) {
+          continue;
+        }
+        XELOGI(" Frame {}:", frame);
+        CompareBenchmarkTime("CPU", ns_to_ms(frames[frame].cpu_time_ns_min),
+                             baseline_cpu_ms, regression_percent);
+        CompareBenchmarkTime("GPU",
+                             frames[frame].gpu_timed
+                                 ? ns_to_ms(frames[frame].gpu_time_ns_min)
+                                 : -1.0,
+                             baseline_gpu_ms, regression_percent);
+      } else if (std::strstr(line, "\"total\":")) {
+        XELOGI(" Total:");
+        CompareBenchmarkTime("CPU", total_cpu_ms_min, baseline_cpu_ms,
+                             regression_percent);
+        max_regression_percent =
+            std::max(max_regression_percent, regression_percent);
+        CompareBenchmarkTime("GPU", total_gpu_ms_min, baseline_gpu_ms,
+                             regression_percent);
+        max_regression_percent =
+            std::max(max_regression_percent, regression_percent);
+      }
+    }
+    fclose(baseline_file);
+    if (cvars::trace_benchmark_max_regression > 0.0 &&
+        max_regression_percent > cvars::trace_benchmark_max_regression) {
+      XELOGE("The total time is {:.2f}% higher than in the baseline",
+             max_regression_percent);
+      result = 2;
+    }
+  }
+
+  player_.reset();
+  emulator_.reset();
+  return result;
+}
+
 }  //  namespace gpu
 }  //  namespace xe
@@ -47,6 +47,9 @@ class TraceDump {
   bool Setup();
   bool Load(const std::filesystem::path& trace_file_path);
   int Run();
+  // Replays the trace multiple times with warm caches and reports the
+  // performance of every frame instead of dumping the image.
+  int RunBenchmark();
 
   std::filesystem::path trace_file_path_;
   std::filesystem::path base_output_path_;
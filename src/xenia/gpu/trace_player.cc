@@ -9,6 +9,7 @@
 
 #include "xenia/gpu/trace_player.h"
 
+#include <chrono>
 #include <memory>
 
 #include "xenia/gpu/command_processor.h"
@@ -85,16 +86,44 @@ void TracePlayer::WaitOnPlayback() {
   xe::threading::Wait(playback_event_.get(), true);
 }
 
+void TracePlayer::BenchmarkFrame(
+    int frame_index, uint64_t& cpu_time_ns_out,
+    CommandProcessor::BenchmarkStatistics& statistics_out) {
+  current_frame_index_ = frame_index;
+  const Frame* frame = current_frame();
+  current_command_index_ = int(frame->commands.size()) - 1;
+  assert_true(frame->start_ptr <= frame->end_ptr);
+  CommandProcessor* command_processor = graphics_system_->command_processor();
+  playing_trace_ = true;
+  command_processor->CallInThread([=, &cpu_time_ns_out, &statistics_out]() {
+    command_processor->BeginBenchmarkStatistics();
+    auto playback_start = std::chrono::steady_clock::now();
+    PlayTraceOnThread(frame->start_ptr, frame->end_ptr - frame->start_ptr,
+                      TracePlaybackMode::kUntilEnd, false);
+    auto playback_end = std::chrono::steady_clock::now();
+    cpu_time_ns_out =
+        uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     playback_end - playback_start)
+                     .count());
+    statistics_out = command_processor->EndBenchmarkStatistics();
+    playback_event_->Set();
+  });
+  WaitOnPlayback();
+}
+
 void TracePlayer::PlayTrace(const uint8_t* trace_data, size_t trace_size,
                             TracePlaybackMode playback_mode,
                             bool clear_caches) {
   playing_trace_ = true;
   graphics_system_->command_processor()->CallInThread([=]() {
-    PlayTraceOnThread(trace_data, trace_size, playback_mode, clear_caches);
+    if (PlayTraceOnThread(trace_data, trace_size, playback_mode,
+                          clear_caches)) {
+      playback_event_->Set();
+    }
   });
 }
 
-void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
+bool TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
                                     size_t trace_size,
                                     TracePlaybackMode playback_mode,
                                     bool clear_caches) {
@@ -164,7 +193,7 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
         }
         if (pending_break) {
           playing_trace_ = false;
-          return;
+          return false;
         }
         break;
       }
@@ -239,12 +268,17 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
             cmd->rw_component);
         break;
       }
+      case TraceCommandType::kMemoryPage: {
+        // Only referenced by memory reads, already gathered by ParseTrace.
+        auto cmd = reinterpret_cast<const MemoryPageCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd) + cmd->encoded_length;
+        break;
+      }
     }
   }
 
   playing_trace_ = false;
-
-  playback_event_->Set();
+  return true;
 }
 
 }  // namespace gpu
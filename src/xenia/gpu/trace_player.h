@@ -11,9 +11,11 @@
 #define XENIA_GPU_TRACE_PLAYER_H_
 
 #include <atomic>
+#include <cstdint>
 #include <string>
 
 #include "xenia/base/threading.h"
+#include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/trace_protocol.h"
 #include "xenia/gpu/trace_reader.h"
 
@@ -46,10 +48,17 @@ class TracePlayer : public TraceReader {
 
   void WaitOnPlayback();
 
+  // Plays the whole frame without clearing the caches and awaits its
+  // completion on the GPU, returning the time the command processor thread
+  // spent on playing it and the statistics of the command processor.
+  void BenchmarkFrame(int frame_index, uint64_t& cpu_time_ns_out,
+                      CommandProcessor::BenchmarkStatistics& statistics_out);
+
  private:
   void PlayTrace(const uint8_t* trace_data, size_t trace_size,
                  TracePlaybackMode playback_mode, bool clear_caches);
-  void PlayTraceOnThread(const uint8_t* trace_data, size_t trace_size,
+  // Returns false if stopped on a swap before reaching the end.
+  bool PlayTraceOnThread(const uint8_t* trace_data, size_t trace_size,
                          TracePlaybackMode playback_mode, bool clear_caches);
 
   GraphicsSystem* graphics_system_;
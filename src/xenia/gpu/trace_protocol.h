@@ -23,7 +23,7 @@ static const char kTraceExtension[] = "xtr";
 // Other changes besides the file format may require bumps, such as
 // anything that changes what is recorded into the files (new GPU
 // command processor commands, etc).
-constexpr uint32_t kTraceFormatVersion = 1;
+constexpr uint32_t kTraceFormatVersion = 2;
 
 // Trace file header identifying information about the trace.
 // This must be positioned at the start of the file and must only occur once.
@@ -55,6 +55,7 @@ enum class TraceCommandType : uint32_t {
   kEvent,
   kRegisters,
   kGammaRamp,
+  kMemoryPage,
 };
 
 struct PrimaryBufferStartCommand {
@@ -95,8 +96,16 @@ enum class MemoryEncodingFormat {
   kNone,
   // Data is compressed with third_party/snappy.
   kSnappy,
+  // Data is a list of uint32_t indices of MemoryPageCommands written earlier in
+  // the trace, each providing kTraceMemoryPageSize bytes of the range (or less
+  // for the last page). Only used for memory reads and writes and EDRAM
+  // snapshots.
+  kPageReferences,
 };
 
+// Memory reads and writes are split into pages of this size for deduplication.
+constexpr uint32_t kTraceMemoryPageSize = 4096;
+
 // Represents the GPU reading or writing data from or to memory.
 // Used for both TraceCommandType::kMemoryRead and kMemoryWrite.
 struct MemoryCommand {
@@ -113,10 +122,27 @@ struct MemoryCommand {
   uint32_t decoded_length;
 };
 
+// Contents of a memory page referenced by index (in the order of appearance of
+// MemoryPageCommands in the trace) from memory reads and writes with
+// MemoryEncodingFormat::kPageReferences. Pages with the same contents are
+// written only once per trace. Doesn't modify memory by itself.
+struct MemoryPageCommand {
+  TraceCommandType type;
+
+  // Encoding format of the data in the trace file (kNone or kSnappy).
+  MemoryEncodingFormat encoding_format;
+  // Number of bytes the data occupies in the trace file in its encoded form.
+  uint32_t encoded_length;
+  // Number of bytes the data occupies in memory after decoding, up to
+  // kTraceMemoryPageSize.
+  uint32_t decoded_length;
+};
+
 // Represents a full 10 MB snapshot of EDRAM contents, for trace initialization
 // (since replaying the trace will reconstruct its state at any point later) as
 // a sequence of tiles with row-major samples (2x multisampling as 1x2 samples,
-// 4x as 2x2 samples).
+// 4x as 2x2 samples). Split into memory pages (kPageReferences) when compressed
+// since the contents are mostly repetitive.
 struct EdramSnapshotCommand {
   TraceCommandType type;
   // Encoding format of the data in the trace file.
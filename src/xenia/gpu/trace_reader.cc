@@ -71,6 +71,8 @@ void TraceReader::Close() {
   mmap_.reset();
   trace_data_ = nullptr;
   trace_size_ = 0;
+  frames_.clear();
+  memory_pages_.clear();
 }
 
 void TraceReader::ParseTrace() {
@@ -225,6 +227,12 @@ void TraceReader::ParseTrace() {
         trace_ptr += sizeof(*cmd) + cmd->encoded_length;
         break;
       }
+      case TraceCommandType::kMemoryPage: {
+        auto cmd = reinterpret_cast<const MemoryPageCommand*>(trace_ptr);
+        memory_pages_.push_back(cmd);
+        trace_ptr += sizeof(*cmd) + cmd->encoded_length;
+        break;
+      }
       default:
         // Broken trace file?
         assert_unhandled_case(type);
@@ -248,6 +256,31 @@ bool TraceReader::DecompressMemory(MemoryEncodingFormat encoding_format,
     case MemoryEncodingFormat::kSnappy:
       return snappy::RawUncompress(reinterpret_cast<const char*>(src), src_size,
                                    reinterpret_cast<char*>(dest));
+    case MemoryEncodingFormat::kPageReferences: {
+      auto page_indices = reinterpret_cast<const uint32_t*>(src);
+      size_t page_count = src_size / sizeof(uint32_t);
+      auto dest_bytes = reinterpret_cast<uint8_t*>(dest);
+      size_t dest_offset = 0;
+      for (size_t i = 0; i < page_count; ++i) {
+        uint32_t page_index = page_indices[i];
+        if (page_index >= memory_pages_.size()) {
+          XELOGE("Trace memory page {} referenced, but only {} are known",
+                 page_index, memory_pages_.size());
+          return false;
+        }
+        const MemoryPageCommand* page = memory_pages_[page_index];
+        if (page->decoded_length > dest_size - dest_offset ||
+            page->encoding_format == MemoryEncodingFormat::kPageReferences ||
+            !DecompressMemory(page->encoding_format, page + 1,
+                              page->encoded_length, dest_bytes + dest_offset,
+                              page->decoded_length)) {
+          return false;
+        }
+        dest_offset += page->decoded_length;
+      }
+      assert_true(dest_offset == dest_size);
+      return true;
+    }
     default:
       assert_unhandled_case(encoding_format);
       return false;
@@ -112,6 +112,8 @@ class TraceReader {
   const uint8_t* trace_data_ = nullptr;
   size_t trace_size_ = 0;
   std::vector<Frame> frames_;
+  // MemoryPageCommands in the trace, indexed by kPageReferences memory data.
+  std::vector<const MemoryPageCommand*> memory_pages_;
 };
 
 }  // namespace gpu
@@ -423,6 +423,11 @@ void TraceViewer::DrawPacketDisassemblerUI() {
         // ImGui::BulletText("GammaRamp");
         break;
       }
+      case TraceCommandType::kMemoryPage: {
+        auto cmd = reinterpret_cast<const MemoryPageCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd) + cmd->encoded_length;
+        break;
+      }
     }
   }
   ImGui::EndChild();
@@ -9,27 +9,36 @@
 
 #include "xenia/gpu/trace_writer.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstring>
 #include <memory>
 
-#include "third_party/snappy/snappy-sinksource.h"
 #include "third_party/snappy/snappy.h"
 
 #include "build/version.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/xenos.h"
 
+DEFINE_uint32(trace_gpu_queue_size_mb, 256,
+              "Maximum size in megabytes of GPU trace data gathered, but not "
+              "compressed and written to the file yet, after which the GPU "
+              "waits for the trace writer thread to catch up.",
+              "GPU");
+
 namespace xe {
 namespace gpu {
 #if XE_ENABLE_TRACE_WRITER_INSTRUMENTATION == 1
 TraceWriter::TraceWriter(uint8_t* membase)
     : membase_(membase), file_(nullptr) {}
 
-TraceWriter::~TraceWriter() = default;
+TraceWriter::~TraceWriter() { Close(); }
 
 bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   Close();
@@ -54,18 +63,44 @@ bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   fwrite(&header, sizeof(header), 1, file_);
 
   cached_memory_reads_.clear();
+  memory_pages_.clear();
+  memory_page_data_.clear();
+  memory_page_count_ = 0;
+
+  write_thread_shutdown_ = false;
+  write_thread_ =
+      xe::threading::Thread::Create({}, [this]() { WriteThread(); });
+  assert_not_null(write_thread_);
+  write_thread_->set_name("GPU Trace Writer");
   return true;
 }
 
 void TraceWriter::Flush() {
   if (file_) {
-    fflush(file_);
+    // The writer thread flushes the file once it has written everything.
+    SubmitRaw();
   }
 }
 
 void TraceWriter::Close() {
   if (file_) {
+    SubmitRaw();
+    if (write_thread_) {
+      {
+        std::lock_guard<std::mutex> lock(write_request_lock_);
+        write_thread_shutdown_ = true;
+      }
+      write_request_cond_.notify_all();
+      xe::threading::Wait(write_thread_.get(), false);
+      write_thread_.reset();
+    }
+    assert_true(write_queue_.empty());
+
     cached_memory_reads_.clear();
+    memory_pages_.clear();
+    memory_page_data_.clear();
+    memory_page_data_.shrink_to_fit();
+    memory_page_count_ = 0;
 
     fflush(file_);
     fclose(file_);
@@ -73,6 +108,118 @@ void TraceWriter::Close() {
   }
 }
 
+void TraceWriter::WriteRaw(const void* data, size_t length) {
+  // Batching small commands to avoid locking for every one.
+  constexpr size_t kRawDataSubmitSize = 64 * 1024;
+  raw_data_.insert(raw_data_.end(), reinterpret_cast<const uint8_t*>(data),
+                   reinterpret_cast<const uint8_t*>(data) + length);
+  if (raw_data_.size() >= kRawDataSubmitSize) {
+    SubmitRaw();
+  }
+}
+
+template <typename T>
+void TraceWriter::WriteCompressedCommand(T& cmd, const void* payload,
+                                         size_t payload_length,
+                                         const void* payload_2,
+                                         size_t payload_2_length) {
+  cmd.encoding_format = MemoryEncodingFormat::kNone;
+  cmd.encoded_length = uint32_t(payload_length + payload_2_length);
+  // Keeping the order of the commands.
+  SubmitRaw();
+  WriteRequest request;
+  request.data.resize(sizeof(cmd) + payload_length + payload_2_length);
+  std::memcpy(request.data.data(), &cmd, sizeof(cmd));
+  std::memcpy(request.data.data() + sizeof(cmd), payload, payload_length);
+  if (payload_2_length) {
+    std::memcpy(request.data.data() + sizeof(cmd) + payload_length, payload_2,
+                payload_2_length);
+  }
+  if (compress_output_) {
+    request.compressed_header_size = sizeof(cmd);
+    request.encoding_format_offset = offsetof(T, encoding_format);
+    request.encoded_length_offset = offsetof(T, encoded_length);
+  }
+  SubmitRequest(std::move(request));
+}
+
+void TraceWriter::SubmitRaw() {
+  if (raw_data_.empty()) {
+    return;
+  }
+  size_t raw_data_capacity = raw_data_.capacity();
+  WriteRequest request;
+  request.data.swap(raw_data_);
+  raw_data_.reserve(raw_data_capacity);
+  SubmitRequest(std::move(request));
+}
+
+void TraceWriter::SubmitRequest(WriteRequest&& request) {
+  size_t max_queue_size = size_t(cvars::trace_gpu_queue_size_mb) << 20;
+  size_t request_size = request.data.size();
+  {
+    std::unique_lock<std::mutex> lock(write_request_lock_);
+    // Something must be in the queue for the writer thread to make progress.
+    while (write_queue_size_ &&
+           write_queue_size_ + request_size > max_queue_size) {
+      write_done_cond_.wait(lock);
+    }
+    write_queue_.push_back(std::move(request));
+    write_queue_size_ += request_size;
+  }
+  write_request_cond_.notify_one();
+}
+
+void TraceWriter::WriteThread() {
+  std::string compressed;
+  while (true) {
+    WriteRequest* request_ptr;
+    {
+      std::unique_lock<std::mutex> lock(write_request_lock_);
+      while (write_queue_.empty() && !write_thread_shutdown_) {
+        write_request_cond_.wait(lock);
+      }
+      if (write_queue_.empty()) {
+        // Shutting down with everything written.
+        return;
+      }
+      // Only this thread removes requests, and push_back doesn't invalidate
+      // references to the existing elements of a deque.
+      request_ptr = &write_queue_.front();
+    }
+    WriteRequest& request = *request_ptr;
+
+    if (request.compressed_header_size) {
+      size_t header_size = request.compressed_header_size;
+      snappy::Compress(
+          reinterpret_cast<const char*>(request.data.data() + header_size),
+          request.data.size() - header_size, &compressed);
+      MemoryEncodingFormat encoding_format = MemoryEncodingFormat::kSnappy;
+      uint32_t encoded_length = uint32_t(compressed.size());
+      std::memcpy(request.data.data() + request.encoding_format_offset,
+                  &encoding_format, sizeof(encoding_format));
+      std::memcpy(request.data.data() + request.encoded_length_offset,
+                  &encoded_length, sizeof(encoded_length));
+      fwrite(request.data.data(), 1, header_size, file_);
+      fwrite(compressed.data(), 1, compressed.size(), file_);
+    } else {
+      fwrite(request.data.data(), 1, request.data.size(), file_);
+    }
+
+    bool queue_empty;
+    {
+      std::lock_guard<std::mutex> lock(write_request_lock_);
+      write_queue_size_ -= request.data.size();
+      write_queue_.pop_front();
+      queue_empty = write_queue_.empty();
+    }
+    write_done_cond_.notify_all();
+    if (queue_empty) {
+      fflush(file_);
+    }
+  }
+}
+
 void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
   if (!file_) {
     return;
@@ -82,7 +229,7 @@ void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  WriteRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePrimaryBufferEnd() {
@@ -92,7 +239,7 @@ void TraceWriter::WritePrimaryBufferEnd() {
   PrimaryBufferEndCommand cmd = {
       TraceCommandType::kPrimaryBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  WriteRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
@@ -104,7 +251,7 @@ void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  WriteRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferEnd() {
@@ -114,7 +261,7 @@ void TraceWriter::WriteIndirectBufferEnd() {
   IndirectBufferEndCommand cmd = {
       TraceCommandType::kIndirectBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  WriteRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
@@ -126,8 +273,8 @@ void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       count,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
-  fwrite(membase_ + base_ptr, 4, count, file_);
+  WriteRaw(&cmd, sizeof(cmd));
+  WriteRaw(membase_ + base_ptr, sizeof(uint32_t) * count);
 }
 
 void TraceWriter::WritePacketEnd() {
@@ -137,7 +284,7 @@ void TraceWriter::WritePacketEnd() {
   PacketEndCommand cmd = {
       TraceCommandType::kPacketEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  WriteRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteMemoryRead(uint32_t base_ptr, size_t length,
@@ -182,86 +329,95 @@ void TraceWriter::WriteMemoryWrite(uint32_t base_ptr, size_t length,
                      host_ptr);
 }
 
-class SnappySink : public snappy::Sink {
- public:
-  SnappySink(FILE* file) : file_(file) {}
-
-  void Append(const char* bytes, size_t n) override {
-    fwrite(bytes, 1, n, file_);
-  }
-
- private:
-  FILE* file_ = nullptr;
-};
-
 void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
                                      size_t length, const void* host_ptr) {
   MemoryCommand cmd = {};
   cmd.type = type;
   cmd.base_ptr = base_ptr;
-  cmd.encoding_format = MemoryEncodingFormat::kNone;
-  cmd.encoded_length = cmd.decoded_length = static_cast<uint32_t>(length);
+  cmd.decoded_length = static_cast<uint32_t>(length);
 
   if (!host_ptr) {
     host_ptr = membase_ + cmd.base_ptr;
   }
 
-  bool compress = compress_output_ && length > compression_threshold_;
-  if (compress) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(host_ptr), cmd.decoded_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
+  if (!compress_output_ || length <= compression_threshold_) {
+    // Small - write the data directly.
     cmd.encoding_format = MemoryEncodingFormat::kNone;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(host_ptr, 1, cmd.decoded_length, file_);
+    cmd.encoded_length = cmd.decoded_length;
+    WriteRaw(&cmd, sizeof(cmd));
+    WriteRaw(host_ptr, cmd.decoded_length);
+    return;
   }
+
+  // Only copying the pages not in the trace yet, the rest are referenced. All
+  // pages must be queued before the command since they may flush the raw
+  // data.
+  memory_page_indices_.clear();
+  auto host_bytes = reinterpret_cast<const uint8_t*>(host_ptr);
+  for (uint32_t page_offset = 0; page_offset < cmd.decoded_length;
+       page_offset += kTraceMemoryPageSize) {
+    memory_page_indices_.push_back(GetOrWriteMemoryPage(
+        host_bytes + page_offset,
+        std::min(kTraceMemoryPageSize, cmd.decoded_length - page_offset)));
+  }
+  cmd.encoding_format = MemoryEncodingFormat::kPageReferences;
+  cmd.encoded_length =
+      uint32_t(sizeof(uint32_t) * memory_page_indices_.size());
+  WriteRaw(&cmd, sizeof(cmd));
+  WriteRaw(memory_page_indices_.data(), cmd.encoded_length);
+}
+
+uint32_t TraceWriter::GetOrWriteMemoryPage(const uint8_t* data,
+                                           uint32_t length) {
+  uint64_t hash = XXH3_64bits(data, length);
+  auto range = memory_pages_.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    const MemoryPage& page = it->second;
+    if (page.length == length &&
+        !std::memcmp(memory_page_data_.data() + page.data_offset, data,
+                     length)) {
+      return page.index;
+    }
+  }
+  MemoryPageCommand cmd = {};
+  cmd.type = TraceCommandType::kMemoryPage;
+  cmd.decoded_length = length;
+  WriteCompressedCommand(cmd, data, length);
+  MemoryPage page;
+  page.index = memory_page_count_++;
+  page.length = length;
+  page.data_offset = memory_page_data_.size();
+  memory_page_data_.insert(memory_page_data_.end(), data, data + length);
+  memory_pages_.emplace(hash, page);
+  return page.index;
 }
 
 void TraceWriter::WriteEdramSnapshot(const void* snapshot) {
+  if (!file_) {
+    return;
+  }
   EdramSnapshotCommand cmd = {};
   cmd.type = TraceCommandType::kEdramSnapshot;
-
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(snapshot), xenos::kEdramSizeBytes);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = xenos::kEdramSizeBytes;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(snapshot, 1, xenos::kEdramSizeBytes, file_);
+  if (!compress_output_) {
+    WriteCompressedCommand(cmd, snapshot, xenos::kEdramSizeBytes);
+    return;
   }
+  // Large parts of the EDRAM are usually cleared to the same values, or not
+  // used at all, so splitting it into pages like memory reads and writes, with
+  // the identical ones written and compressed only once.
+  memory_page_indices_.clear();
+  auto snapshot_bytes = reinterpret_cast<const uint8_t*>(snapshot);
+  for (uint32_t page_offset = 0; page_offset < xenos::kEdramSizeBytes;
+       page_offset += kTraceMemoryPageSize) {
+    memory_page_indices_.push_back(GetOrWriteMemoryPage(
+        snapshot_bytes + page_offset,
+        std::min(kTraceMemoryPageSize, xenos::kEdramSizeBytes - page_offset)));
+  }
+  cmd.encoding_format = MemoryEncodingFormat::kPageReferences;
+  cmd.encoded_length =
+      uint32_t(sizeof(uint32_t) * memory_page_indices_.size());
+  WriteRaw(&cmd, sizeof(cmd));
+  WriteRaw(memory_page_indices_.data(), cmd.encoded_length);
 }
 
 void TraceWriter::WriteEvent(EventCommand::Type event_type) {
@@ -272,95 +428,39 @@ void TraceWriter::WriteEvent(EventCommand::Type event_type) {
       TraceCommandType::kEvent,
       event_type,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  WriteRaw(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteRegisters(uint32_t first_register,
                                  const uint32_t* register_values,
                                  uint32_t register_count,
                                  bool execute_callbacks_on_play) {
+  if (!file_) {
+    return;
+  }
   RegistersCommand cmd = {};
   cmd.type = TraceCommandType::kRegisters;
   cmd.first_register = first_register;
   cmd.register_count = register_count;
   cmd.execute_callbacks = execute_callbacks_on_play;
-
-  uint32_t uncompressed_length = uint32_t(sizeof(uint32_t) * register_count);
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(register_values), uncompressed_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write the values directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = uncompressed_length;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(register_values, 1, uncompressed_length, file_);
-  }
+  WriteCompressedCommand(cmd, register_values,
+                         sizeof(uint32_t) * register_count);
 }
 
 void TraceWriter::WriteGammaRamp(
     const reg::DC_LUT_30_COLOR* gamma_ramp_256_entry_table,
     const reg::DC_LUT_PWL_DATA* gamma_ramp_pwl_rgb,
     uint32_t gamma_ramp_rw_component) {
+  if (!file_) {
+    return;
+  }
   GammaRampCommand cmd = {};
   cmd.type = TraceCommandType::kGammaRamp;
   cmd.rw_component = uint8_t(gamma_ramp_rw_component);
-
-  constexpr uint32_t k256EntryTableUncompressedLength =
-      sizeof(reg::DC_LUT_30_COLOR) * 256;
-  constexpr uint32_t kPWLUncompressedLength =
-      sizeof(reg::DC_LUT_PWL_DATA) * 3 * 128;
-  constexpr uint32_t kUncompressedLength =
-      k256EntryTableUncompressedLength + kPWLUncompressedLength;
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    {
-      std::unique_ptr<char[]> gamma_ramps(new char[kUncompressedLength]);
-      std::memcpy(gamma_ramps.get(), gamma_ramp_256_entry_table,
-                  k256EntryTableUncompressedLength);
-      std::memcpy(gamma_ramps.get() + k256EntryTableUncompressedLength,
-                  gamma_ramp_pwl_rgb, kPWLUncompressedLength);
-      snappy::ByteArraySource snappy_source(gamma_ramps.get(),
-                                            kUncompressedLength);
-      SnappySink snappy_sink(file_);
-      cmd.encoded_length =
-          static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-    }
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write the values directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = kUncompressedLength;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(gamma_ramp_256_entry_table, 1, k256EntryTableUncompressedLength,
-           file_);
-    fwrite(gamma_ramp_pwl_rgb, 1, kPWLUncompressedLength, file_);
-  }
+  WriteCompressedCommand(cmd, gamma_ramp_256_entry_table,
+                         sizeof(reg::DC_LUT_30_COLOR) * 256,
+                         gamma_ramp_pwl_rgb,
+                         sizeof(reg::DC_LUT_PWL_DATA) * 3 * 128);
 }
 #endif
 }  //  namespace gpu
@@ -10,9 +10,20 @@
 #ifndef XENIA_GPU_TRACE_WRITER_H_
 #define XENIA_GPU_TRACE_WRITER_H_
 
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/hash.h"
+#include "xenia/base/threading.h"
 
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/trace_protocol.h"
@@ -30,6 +41,11 @@
 namespace xe {
 namespace gpu {
 
+// Commands are gathered on the calling thread, while compression and file
+// writing are done on a separate thread, with the calling thread waiting only
+// if the queue of data not written yet becomes too big. Memory reads and writes
+// and EDRAM snapshots are split into pages, and pages with contents already
+// written to the trace are only referenced, not copied again.
 class TraceWriter {
  public:
 #if XE_ENABLE_TRACE_WRITER_INSTRUMENTATION == 1
@@ -63,8 +79,43 @@ class TraceWriter {
                       uint32_t gamma_ramp_rw_component);
 
  private:
+  struct WriteRequest {
+    // Command header followed by the payload.
+    std::vector<uint8_t> data;
+    // If not 0, the payload after the header of this size needs to be
+    // compressed, with the encoding format and the encoded length in the
+    // header replaced.
+    size_t compressed_header_size = 0;
+    size_t encoding_format_offset = 0;
+    size_t encoded_length_offset = 0;
+  };
+
+  struct MemoryPage {
+    uint32_t index;
+    uint32_t length;
+    // In memory_page_data_.
+    size_t data_offset;
+  };
+
+  // Appends to the uncompressed data gathered for the next request.
+  void WriteRaw(const void* data, size_t length);
+  // Queues the command with the payload to be compressed on the writer thread
+  // if compress_output_ is enabled.
+  template <typename T>
+  void WriteCompressedCommand(T& cmd, const void* payload,
+                              size_t payload_length,
+                              const void* payload_2 = nullptr,
+                              size_t payload_2_length = 0);
   void WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
                           size_t length, const void* host_ptr = nullptr);
+  // Returns the index of the MemoryPageCommand with the contents, queueing it
+  // if there's no such page in the trace yet.
+  uint32_t GetOrWriteMemoryPage(const uint8_t* data, uint32_t length);
+
+  // Queues the raw data gathered so far.
+  void SubmitRaw();
+  void SubmitRequest(WriteRequest&& request);
+  void WriteThread();
 
   std::set<uint64_t> cached_memory_reads_;
   uint8_t* membase_;
@@ -73,6 +124,28 @@ class TraceWriter {
   bool compress_output_ = true;
   size_t compression_threshold_ = 1024;  // Min. number of bytes to compress.
 
+  // Accessed only by the thread writing commands.
+  std::vector<uint8_t> raw_data_;
+  // Pages with colliding hashes are all kept, with their contents compared.
+  std::unordered_multimap<uint64_t, MemoryPage,
+                          xe::hash::IdentityHasher<uint64_t>>
+      memory_pages_;
+  // Contents of all the pages written so far.
+  std::vector<uint8_t> memory_page_data_;
+  uint32_t memory_page_count_ = 0;
+  std::vector<uint32_t> memory_page_indices_;
+
+  std::unique_ptr<xe::threading::Thread> write_thread_;
+  std::mutex write_request_lock_;
+  // Notified when a request is queued or on shutdown.
+  std::condition_variable write_request_cond_;
+  // Notified when a request has been written.
+  std::condition_variable write_done_cond_;
+  // Protected with write_request_lock_.
+  std::deque<WriteRequest> write_queue_;
+  size_t write_queue_size_ = 0;
+  bool write_thread_shutdown_ = false;
+
 #else
   // this could be annoying to maintain if new methods are added or the
   // signatures change
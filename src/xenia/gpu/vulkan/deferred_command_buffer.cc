@@ -39,6 +39,9 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
       command_processor_.GetVulkanProvider().dfn();
   const uintmax_t* stream = command_stream_.data();
   size_t stream_remaining = command_stream_.size();
+  // Whether the last bound graphics pipeline has failed to be created, so
+  // draws must be skipped.
+  bool graphics_pipeline_missing = false;
   while (stream_remaining) {
     const CommandHeader& header =
         *reinterpret_cast<const CommandHeader*>(stream);
@@ -46,6 +49,24 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
     stream_remaining -= kCommandHeaderSizeElements;
 
     switch (header.command) {
+      case Command::kBindGraphicsPipelineHandle: {
+        auto& args =
+            *reinterpret_cast<const ArgsBindGraphicsPipelineHandle*>(stream);
+        VkPipeline pipeline =
+            command_processor_.GetVulkanPipelineByHandle(args.pipeline_handle);
+        graphics_pipeline_missing = pipeline == VK_NULL_HANDLE;
+        if (!graphics_pipeline_missing) {
+          dfn.vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                pipeline);
+        }
+      } break;
+
+      case Command::kVkBeginQuery: {
+        auto& args = *reinterpret_cast<const ArgsVkBeginQuery*>(stream);
+        dfn.vkCmdBeginQuery(command_buffer, args.query_pool, args.query,
+                            args.flags);
+      } break;
+
       case Command::kVkBeginRenderPass: {
         auto& args = *reinterpret_cast<const ArgsVkBeginRenderPass*>(stream);
         size_t offset_bytes = sizeof(ArgsVkBeginRenderPass);
@@ -101,6 +122,9 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
         auto& args = *reinterpret_cast<const ArgsVkBindPipeline*>(stream);
         dfn.vkCmdBindPipeline(command_buffer, args.pipeline_bind_point,
                               args.pipeline);
+        if (args.pipeline_bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS) {
+          graphics_pipeline_missing = false;
+        }
       } break;
 
       case Command::kVkBindVertexBuffers: {
@@ -172,18 +196,29 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
       } break;
 
       case Command::kVkDraw: {
+        if (graphics_pipeline_missing) {
+          break;
+        }
         auto& args = *reinterpret_cast<const ArgsVkDraw*>(stream);
         dfn.vkCmdDraw(command_buffer, args.vertex_count, args.instance_count,
                       args.first_vertex, args.first_instance);
       } break;
 
       case Command::kVkDrawIndexed: {
+        if (graphics_pipeline_missing) {
+          break;
+        }
         auto& args = *reinterpret_cast<const ArgsVkDrawIndexed*>(stream);
         dfn.vkCmdDrawIndexed(command_buffer, args.index_count,
                              args.instance_count, args.first_index,
                              args.vertex_offset, args.first_instance);
       } break;
 
+      case Command::kVkEndQuery: {
+        auto& args = *reinterpret_cast<const ArgsVkEndQuery*>(stream);
+        dfn.vkCmdEndQuery(command_buffer, args.query_pool, args.query);
+      } break;
+
       case Command::kVkEndRenderPass:
         dfn.vkCmdEndRenderPass(command_buffer);
         break;
@@ -235,11 +270,49 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                                    sizeof(ArgsVkPushConstants));
       } break;
 
+      case Command::kVkPushUniformBufferDescriptorsKHR: {
+        auto& args = *reinterpret_cast<
+            const ArgsVkPushUniformBufferDescriptorsKHR*>(stream);
+        const VkDescriptorBufferInfo* buffer_infos =
+            reinterpret_cast<const VkDescriptorBufferInfo*>(
+                reinterpret_cast<const uint8_t*>(stream) +
+                xe::align(sizeof(ArgsVkPushUniformBufferDescriptorsKHR),
+                          alignof(VkDescriptorBufferInfo)));
+        VkWriteDescriptorSet
+            write_descriptor_sets[kMaxPushedUniformBufferDescriptors];
+        for (uint32_t i = 0; i < args.binding_count; ++i) {
+          VkWriteDescriptorSet& write_descriptor_set = write_descriptor_sets[i];
+          write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+          write_descriptor_set.pNext = nullptr;
+          // Ignored for push descriptors.
+          write_descriptor_set.dstSet = VK_NULL_HANDLE;
+          write_descriptor_set.dstBinding = args.first_binding + i;
+          write_descriptor_set.dstArrayElement = 0;
+          write_descriptor_set.descriptorCount = 1;
+          write_descriptor_set.descriptorType =
+              VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+          write_descriptor_set.pImageInfo = nullptr;
+          write_descriptor_set.pBufferInfo = &buffer_infos[i];
+          write_descriptor_set.pTexelBufferView = nullptr;
+        }
+        dfn.vkCmdPushDescriptorSetKHR(
+            command_buffer, args.pipeline_bind_point, args.layout, args.set,
+            args.binding_count, write_descriptor_sets);
+      } break;
+
       case Command::kVkSetBlendConstants: {
         auto& args = *reinterpret_cast<const ArgsVkSetBlendConstants*>(stream);
         dfn.vkCmdSetBlendConstants(command_buffer, args.blend_constants);
       } break;
 
+      case Command::kVkSetCullModeEXT: {
+        dfn.vkCmdSetCullModeEXT(
+            command_buffer,
+            VkCullModeFlags(
+                reinterpret_cast<const ArgsSetExtendedDynamicState*>(stream)
+                    ->value));
+      } break;
+
       case Command::kVkSetDepthBias: {
         auto& args = *reinterpret_cast<const ArgsVkSetDepthBias*>(stream);
         dfn.vkCmdSetDepthBias(command_buffer, args.depth_bias_constant_factor,
@@ -247,6 +320,38 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                               args.depth_bias_slope_factor);
       } break;
 
+      case Command::kVkSetDepthCompareOpEXT: {
+        dfn.vkCmdSetDepthCompareOpEXT(
+            command_buffer,
+            VkCompareOp(
+                reinterpret_cast<const ArgsSetExtendedDynamicState*>(stream)
+                    ->value));
+      } break;
+
+      case Command::kVkSetDepthTestEnableEXT: {
+        dfn.vkCmdSetDepthTestEnableEXT(
+            command_buffer,
+            VkBool32(
+                reinterpret_cast<const ArgsSetExtendedDynamicState*>(stream)
+                    ->value));
+      } break;
+
+      case Command::kVkSetDepthWriteEnableEXT: {
+        dfn.vkCmdSetDepthWriteEnableEXT(
+            command_buffer,
+            VkBool32(
+                reinterpret_cast<const ArgsSetExtendedDynamicState*>(stream)
+                    ->value));
+      } break;
+
+      case Command::kVkSetFrontFaceEXT: {
+        dfn.vkCmdSetFrontFaceEXT(
+            command_buffer,
+            VkFrontFace(
+                reinterpret_cast<const ArgsSetExtendedDynamicState*>(stream)
+                    ->value));
+      } break;
+
       case Command::kVkSetScissor: {
         auto& args = *reinterpret_cast<const ArgsVkSetScissor*>(stream);
         dfn.vkCmdSetScissor(
@@ -263,6 +368,13 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                                        args.mask_reference);
       } break;
 
+      case Command::kVkSetStencilOpEXT: {
+        auto& args = *reinterpret_cast<const ArgsVkSetStencilOpEXT*>(stream);
+        dfn.vkCmdSetStencilOpEXT(command_buffer, args.face_mask, args.fail_op,
+                                 args.pass_op, args.depth_fail_op,
+                                 args.compare_op);
+      } break;
+
       case Command::kVkSetStencilReference: {
         auto& args =
             *reinterpret_cast<const ArgsSetStencilMaskReference*>(stream);
@@ -270,6 +382,14 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                                      args.mask_reference);
       } break;
 
+      case Command::kVkSetStencilTestEnableEXT: {
+        dfn.vkCmdSetStencilTestEnableEXT(
+            command_buffer,
+            VkBool32(
+                reinterpret_cast<const ArgsSetExtendedDynamicState*>(stream)
+                    ->value));
+      } break;
+
       case Command::kVkSetStencilWriteMask: {
         auto& args =
             *reinterpret_cast<const ArgsSetStencilMaskReference*>(stream);
@@ -286,6 +406,12 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                 xe::align(sizeof(ArgsVkSetViewport), alignof(VkViewport))));
       } break;
 
+      case Command::kVkWriteTimestamp: {
+        auto& args = *reinterpret_cast<const ArgsVkWriteTimestamp*>(stream);
+        dfn.vkCmdWriteTimestamp(command_buffer, args.pipeline_stage,
+                                args.query_pool, args.query);
+      } break;
+
       default:
         assert_unhandled_case(header.command);
         break;
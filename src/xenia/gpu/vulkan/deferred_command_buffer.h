@@ -32,6 +32,15 @@ class DeferredCommandBuffer {
   void Reset();
   void Execute(VkCommandBuffer command_buffer);
 
+  void CmdVkBeginQuery(VkQueryPool query_pool, uint32_t query,
+                       VkQueryControlFlags flags) {
+    auto& args = *reinterpret_cast<ArgsVkBeginQuery*>(
+        WriteCommand(Command::kVkBeginQuery, sizeof(ArgsVkBeginQuery)));
+    args.query_pool = query_pool;
+    args.query = query;
+    args.flags = flags;
+  }
+
   // render_pass_begin->pNext of all barriers must be null.
   void CmdVkBeginRenderPass(const VkRenderPassBeginInfo* render_pass_begin,
                             VkSubpassContents contents) {
@@ -108,6 +117,17 @@ class DeferredCommandBuffer {
     args.pipeline = pipeline;
   }
 
+  // Binds a graphics pipeline from the pipeline cache which may still be being
+  // created - resolved in Execute, after the pipeline cache has awaited the
+  // completion of the creation. Draws are dropped until the next pipeline bind
+  // if the pipeline has failed to be created.
+  void CmdBindGraphicsPipelineHandle(const void* pipeline_handle) {
+    auto& args = *reinterpret_cast<ArgsBindGraphicsPipelineHandle*>(
+        WriteCommand(Command::kBindGraphicsPipelineHandle,
+                     sizeof(ArgsBindGraphicsPipelineHandle)));
+    args.pipeline_handle = pipeline_handle;
+  }
+
   void CmdVkBindVertexBuffers(uint32_t first_binding, uint32_t binding_count,
                               const VkBuffer* buffers,
                               const VkDeviceSize* offsets) {
@@ -262,6 +282,13 @@ class DeferredCommandBuffer {
     args.first_instance = first_instance;
   }
 
+  void CmdVkEndQuery(VkQueryPool query_pool, uint32_t query) {
+    auto& args = *reinterpret_cast<ArgsVkEndQuery*>(
+        WriteCommand(Command::kVkEndQuery, sizeof(ArgsVkEndQuery)));
+    args.query_pool = query_pool;
+    args.query = query;
+  }
+
   void CmdVkEndRenderPass() { WriteCommand(Command::kVkEndRenderPass, 0); }
 
   // pNext of all barriers must be null.
@@ -288,12 +315,43 @@ class DeferredCommandBuffer {
     std::memcpy(args_ptr + sizeof(ArgsVkPushConstants), values, size);
   }
 
+  // Requires VK_KHR_push_descriptor. Each binding is written separately as the
+  // bindings may have different stage flags.
+  void CmdVkPushUniformBufferDescriptorsKHR(
+      VkPipelineBindPoint pipeline_bind_point, VkPipelineLayout layout,
+      uint32_t set, uint32_t first_binding, uint32_t binding_count,
+      const VkDescriptorBufferInfo* buffer_infos) {
+    assert_true(binding_count <= kMaxPushedUniformBufferDescriptors);
+    size_t arguments_size =
+        xe::align(sizeof(ArgsVkPushUniformBufferDescriptorsKHR),
+                  alignof(VkDescriptorBufferInfo));
+    size_t buffer_infos_offset = arguments_size;
+    arguments_size += sizeof(VkDescriptorBufferInfo) * binding_count;
+    uint8_t* args_ptr = reinterpret_cast<uint8_t*>(WriteCommand(
+        Command::kVkPushUniformBufferDescriptorsKHR, arguments_size));
+    auto& args =
+        *reinterpret_cast<ArgsVkPushUniformBufferDescriptorsKHR*>(args_ptr);
+    args.pipeline_bind_point = pipeline_bind_point;
+    args.layout = layout;
+    args.set = set;
+    args.first_binding = first_binding;
+    args.binding_count = binding_count;
+    std::memcpy(args_ptr + buffer_infos_offset, buffer_infos,
+                sizeof(VkDescriptorBufferInfo) * binding_count);
+  }
+
   void CmdVkSetBlendConstants(const float* blend_constants) {
     auto& args = *reinterpret_cast<ArgsVkSetBlendConstants*>(WriteCommand(
         Command::kVkSetBlendConstants, sizeof(ArgsVkSetBlendConstants)));
     std::memcpy(args.blend_constants, blend_constants, sizeof(float) * 4);
   }
 
+  void CmdVkSetCullModeEXT(VkCullModeFlags cull_mode) {
+    reinterpret_cast<ArgsSetExtendedDynamicState*>(WriteCommand(
+        Command::kVkSetCullModeEXT, sizeof(ArgsSetExtendedDynamicState)))
+        ->value = uint32_t(cull_mode);
+  }
+
   void CmdVkSetDepthBias(float depth_bias_constant_factor,
                          float depth_bias_clamp,
                          float depth_bias_slope_factor) {
@@ -304,6 +362,31 @@ class DeferredCommandBuffer {
     args.depth_bias_slope_factor = depth_bias_slope_factor;
   }
 
+  void CmdVkSetDepthCompareOpEXT(VkCompareOp depth_compare_op) {
+    reinterpret_cast<ArgsSetExtendedDynamicState*>(WriteCommand(
+        Command::kVkSetDepthCompareOpEXT, sizeof(ArgsSetExtendedDynamicState)))
+        ->value = uint32_t(depth_compare_op);
+  }
+
+  void CmdVkSetDepthTestEnableEXT(VkBool32 depth_test_enable) {
+    reinterpret_cast<ArgsSetExtendedDynamicState*>(WriteCommand(
+        Command::kVkSetDepthTestEnableEXT, sizeof(ArgsSetExtendedDynamicState)))
+        ->value = uint32_t(depth_test_enable);
+  }
+
+  void CmdVkSetDepthWriteEnableEXT(VkBool32 depth_write_enable) {
+    reinterpret_cast<ArgsSetExtendedDynamicState*>(
+        WriteCommand(Command::kVkSetDepthWriteEnableEXT,
+                     sizeof(ArgsSetExtendedDynamicState)))
+        ->value = uint32_t(depth_write_enable);
+  }
+
+  void CmdVkSetFrontFaceEXT(VkFrontFace front_face) {
+    reinterpret_cast<ArgsSetExtendedDynamicState*>(WriteCommand(
+        Command::kVkSetFrontFaceEXT, sizeof(ArgsSetExtendedDynamicState)))
+        ->value = uint32_t(front_face);
+  }
+
   void CmdVkSetScissor(uint32_t first_scissor, uint32_t scissor_count,
                        const VkRect2D* scissors) {
     const size_t header_size =
@@ -327,6 +410,18 @@ class DeferredCommandBuffer {
     args.mask_reference = compare_mask;
   }
 
+  void CmdVkSetStencilOpEXT(VkStencilFaceFlags face_mask, VkStencilOp fail_op,
+                            VkStencilOp pass_op, VkStencilOp depth_fail_op,
+                            VkCompareOp compare_op) {
+    auto& args = *reinterpret_cast<ArgsVkSetStencilOpEXT*>(WriteCommand(
+        Command::kVkSetStencilOpEXT, sizeof(ArgsVkSetStencilOpEXT)));
+    args.face_mask = face_mask;
+    args.fail_op = fail_op;
+    args.pass_op = pass_op;
+    args.depth_fail_op = depth_fail_op;
+    args.compare_op = compare_op;
+  }
+
   void CmdVkSetStencilReference(VkStencilFaceFlags face_mask,
                                 uint32_t reference) {
     auto& args = *reinterpret_cast<ArgsSetStencilMaskReference*>(WriteCommand(
@@ -335,6 +430,13 @@ class DeferredCommandBuffer {
     args.mask_reference = reference;
   }
 
+  void CmdVkSetStencilTestEnableEXT(VkBool32 stencil_test_enable) {
+    reinterpret_cast<ArgsSetExtendedDynamicState*>(
+        WriteCommand(Command::kVkSetStencilTestEnableEXT,
+                     sizeof(ArgsSetExtendedDynamicState)))
+        ->value = uint32_t(stencil_test_enable);
+  }
+
   void CmdVkSetStencilWriteMask(VkStencilFaceFlags face_mask,
                                 uint32_t write_mask) {
     auto& args = *reinterpret_cast<ArgsSetStencilMaskReference*>(WriteCommand(
@@ -357,8 +459,19 @@ class DeferredCommandBuffer {
                 sizeof(VkViewport) * viewport_count);
   }
 
+  void CmdVkWriteTimestamp(VkPipelineStageFlagBits pipeline_stage,
+                           VkQueryPool query_pool, uint32_t query) {
+    auto& args = *reinterpret_cast<ArgsVkWriteTimestamp*>(WriteCommand(
+        Command::kVkWriteTimestamp, sizeof(ArgsVkWriteTimestamp)));
+    args.pipeline_stage = pipeline_stage;
+    args.query_pool = query_pool;
+    args.query = query;
+  }
+
  private:
   enum class Command {
+    kBindGraphicsPipelineHandle,
+    kVkBeginQuery,
     kVkBeginRenderPass,
     kVkBindDescriptorSets,
     kVkBindIndexBuffer,
@@ -371,16 +484,26 @@ class DeferredCommandBuffer {
     kVkDispatch,
     kVkDraw,
     kVkDrawIndexed,
+    kVkEndQuery,
     kVkEndRenderPass,
     kVkPipelineBarrier,
     kVkPushConstants,
+    kVkPushUniformBufferDescriptorsKHR,
     kVkSetBlendConstants,
+    kVkSetCullModeEXT,
     kVkSetDepthBias,
+    kVkSetDepthCompareOpEXT,
+    kVkSetDepthTestEnableEXT,
+    kVkSetDepthWriteEnableEXT,
+    kVkSetFrontFaceEXT,
     kVkSetScissor,
     kVkSetStencilCompareMask,
+    kVkSetStencilOpEXT,
     kVkSetStencilReference,
+    kVkSetStencilTestEnableEXT,
     kVkSetStencilWriteMask,
     kVkSetViewport,
+    kVkWriteTimestamp,
   };
 
   struct CommandHeader {
@@ -390,6 +513,12 @@ class DeferredCommandBuffer {
   static constexpr size_t kCommandHeaderSizeElements =
       (sizeof(CommandHeader) + sizeof(uintmax_t) - 1) / sizeof(uintmax_t);
 
+  struct ArgsVkBeginQuery {
+    VkQueryPool query_pool;
+    uint32_t query;
+    VkQueryControlFlags flags;
+  };
+
   struct ArgsVkBeginRenderPass {
     VkRenderPass render_pass;
     VkFramebuffer framebuffer;
@@ -416,6 +545,10 @@ class DeferredCommandBuffer {
     VkIndexType index_type;
   };
 
+  struct ArgsBindGraphicsPipelineHandle {
+    const void* pipeline_handle;
+  };
+
   struct ArgsVkBindPipeline {
     VkPipelineBindPoint pipeline_bind_point;
     VkPipeline pipeline;
@@ -484,6 +617,11 @@ class DeferredCommandBuffer {
     uint32_t first_instance;
   };
 
+  struct ArgsVkEndQuery {
+    VkQueryPool query_pool;
+    uint32_t query;
+  };
+
   struct ArgsVkPipelineBarrier {
     VkPipelineStageFlags src_stage_mask;
     VkPipelineStageFlags dst_stage_mask;
@@ -506,6 +644,18 @@ class DeferredCommandBuffer {
     // Followed by `size` bytes of values.
   };
 
+  static constexpr uint32_t kMaxPushedUniformBufferDescriptors = 8;
+
+  struct ArgsVkPushUniformBufferDescriptorsKHR {
+    VkPipelineBindPoint pipeline_bind_point;
+    VkPipelineLayout layout;
+    uint32_t set;
+    uint32_t first_binding;
+    uint32_t binding_count;
+    // Followed by aligned VkDescriptorBufferInfo[binding_count].
+    static_assert(alignof(VkDescriptorBufferInfo) <= alignof(uintmax_t));
+  };
+
   struct ArgsVkSetBlendConstants {
     float blend_constants[4];
   };
@@ -516,6 +666,11 @@ class DeferredCommandBuffer {
     float depth_bias_slope_factor;
   };
 
+  // VK_EXT_extended_dynamic_state state consisting of a single 32-bit value.
+  struct ArgsSetExtendedDynamicState {
+    uint32_t value;
+  };
+
   struct ArgsVkSetScissor {
     uint32_t first_scissor;
     uint32_t scissor_count;
@@ -528,6 +683,14 @@ class DeferredCommandBuffer {
     uint32_t mask_reference;
   };
 
+  struct ArgsVkSetStencilOpEXT {
+    VkStencilFaceFlags face_mask;
+    VkStencilOp fail_op;
+    VkStencilOp pass_op;
+    VkStencilOp depth_fail_op;
+    VkCompareOp compare_op;
+  };
+
   struct ArgsVkSetViewport {
     uint32_t first_viewport;
     uint32_t viewport_count;
@@ -535,6 +698,12 @@ class DeferredCommandBuffer {
     static_assert(alignof(VkViewport) <= alignof(uintmax_t));
   };
 
+  struct ArgsVkWriteTimestamp {
+    VkPipelineStageFlagBits pipeline_stage;
+    VkQueryPool query_pool;
+    uint32_t query;
+  };
+
   void* WriteCommand(Command command, size_t arguments_size_bytes);
 
   const VulkanCommandProcessor& command_processor_;
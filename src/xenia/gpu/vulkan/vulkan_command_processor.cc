@@ -19,8 +19,12 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/metrics.h"
 #include "xenia/base/profiling.h"
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/gpu_flags.h"
@@ -38,10 +42,41 @@
 #include "xenia/ui/vulkan/vulkan_presenter.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
+
+DEFINE_bool(vulkan_bindless_resources, true,
+            "Access textures and samplers through indices in persistent "
+            "descriptor arrays if VK_EXT_descriptor_indexing is supported, "
+            "instead of writing new descriptor sets when they're changed.",
+            "Vulkan");
+DEFINE_bool(vulkan_push_descriptors, true,
+            "Bind the guest draw constant buffers via VK_KHR_push_descriptor "
+            "if supported, instead of writing new descriptor sets when "
+            "they're changed.",
+            "Vulkan");
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
 
+namespace {
+metrics::Gauge vma_blocks_metric(
+    "xenia_gpu_vulkan_memory_blocks",
+    "Device memory objects allocated by the Vulkan Memory Allocator.");
+metrics::Gauge vma_allocations_metric(
+    "xenia_gpu_vulkan_memory_allocations",
+    "Render target and texture images suballocated from the blocks.");
+metrics::Gauge vma_block_bytes_metric(
+    "xenia_gpu_vulkan_memory_block_bytes",
+    "Total size of the Vulkan Memory Allocator device memory blocks.");
+metrics::Gauge vma_allocation_bytes_metric(
+    "xenia_gpu_vulkan_memory_allocation_bytes",
+    "Total size of the suballocations in the blocks.");
+metrics::Gauge vma_unused_bytes_metric(
+    "xenia_gpu_vulkan_memory_unused_bytes",
+    "Free space in the Vulkan Memory Allocator blocks, from fragmentation or "
+    "not yet used.");
+}  // namespace
+
 // Generated with `xb buildshaders`.
 namespace shaders {
 #include "xenia/gpu/shaders/bytecode/vulkan_spirv/apply_gamma_pwl_fxaa_luma_ps.h"
@@ -97,6 +132,158 @@ void VulkanCommandProcessor::ClearCaches() {
   cache_clear_requested_ = true;
 }
 
+void VulkanCommandProcessor::BeginBenchmarkStatistics() {
+  // Don't include the work done before.
+  AwaitAllQueueOperationsCompletion();
+  CommandProcessor::BeginBenchmarkStatistics();
+  pipeline_cache_->ResetPipelineLookupCounts();
+  texture_cache_->ResetTextureLookupCounts();
+  InitializeTimestampQueries();
+}
+
+CommandProcessor::BenchmarkStatistics
+VulkanCommandProcessor::EndBenchmarkStatistics() {
+  // Read back the timestamps of all the submissions.
+  AwaitAllQueueOperationsCompletion();
+  benchmark_statistics_.pipeline_lookup_count =
+      pipeline_cache_->pipeline_lookup_count();
+  benchmark_statistics_.pipeline_miss_count =
+      pipeline_cache_->pipeline_miss_count();
+  benchmark_statistics_.texture_lookup_count =
+      texture_cache_->texture_lookup_count();
+  benchmark_statistics_.texture_miss_count =
+      texture_cache_->texture_miss_count();
+  benchmark_statistics_.texture_load_bytes =
+      texture_cache_->texture_load_byte_count();
+  return CommandProcessor::EndBenchmarkStatistics();
+}
+
+GpuPass VulkanCommandProcessor::SwitchGpuPass(GpuPass pass) {
+  if (pass != GpuPass::kDraws) {
+    // Not guest draws, such as EDRAM transfers, must not be counted.
+    EndOcclusionHostQuery();
+  }
+  GpuPass previous_pass;
+  uint32_t query = gpu_pass_timestamps_.SwitchPass(pass, previous_pass);
+  if (query != UINT32_MAX) {
+    deferred_command_buffer_.CmdVkWriteTimestamp(
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool_, query);
+  }
+  return previous_pass;
+}
+
+bool VulkanCommandProcessor::InitializeTimestampQueries() {
+  if (timestamp_query_pool_ != VK_NULL_HANDLE) {
+    return true;
+  }
+  const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
+  const VkPhysicalDeviceLimits& device_limits =
+      provider.device_properties().limits;
+  if (!device_limits.timestampComputeAndGraphics ||
+      !(device_limits.timestampPeriod > 0.0f) ||
+      !provider.queue_families()[provider.queue_family_graphics_compute()]
+           .timestamp_valid_bits) {
+    XELOGW("Vulkan timestamps are not supported, not measuring the GPU time");
+    return false;
+  }
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  VkQueryPoolCreateInfo query_pool_create_info;
+  query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  query_pool_create_info.pNext = nullptr;
+  query_pool_create_info.flags = 0;
+  query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  query_pool_create_info.queryCount = GpuPassTimestamps::kTimestampCount;
+  query_pool_create_info.pipelineStatistics = 0;
+  if (dfn.vkCreateQueryPool(device, &query_pool_create_info, nullptr,
+                            &timestamp_query_pool_) != VK_SUCCESS) {
+    XELOGW("Failed to create the Vulkan timestamp query pool, not measuring "
+           "the GPU time");
+    timestamp_query_pool_ = VK_NULL_HANDLE;
+    return false;
+  }
+  return true;
+}
+
+bool VulkanCommandProcessor::InitializeOcclusionQueries() {
+  if (occlusion_query_pool_ != VK_NULL_HANDLE) {
+    return true;
+  }
+  const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  VkQueryPoolCreateInfo query_pool_create_info;
+  query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  query_pool_create_info.pNext = nullptr;
+  query_pool_create_info.flags = 0;
+  query_pool_create_info.queryType = VK_QUERY_TYPE_OCCLUSION;
+  query_pool_create_info.queryCount = OcclusionQueryTracker::kHostQueryCount;
+  query_pool_create_info.pipelineStatistics = 0;
+  if (dfn.vkCreateQueryPool(device, &query_pool_create_info, nullptr,
+                            &occlusion_query_pool_) != VK_SUCCESS) {
+    XELOGW("Failed to create the Vulkan occlusion query pool, not using host "
+           "occlusion queries");
+    occlusion_query_pool_ = VK_NULL_HANDLE;
+    return false;
+  }
+  // Without the precise flag, only whether any samples have passed is
+  // guaranteed to be reported.
+  occlusion_query_control_flags_ =
+      provider.device_features().occlusionQueryPrecise
+          ? VK_QUERY_CONTROL_PRECISE_BIT
+          : 0;
+  if (!occlusion_query_control_flags_) {
+    XELOGW("Vulkan precise occlusion queries are not supported, the reported "
+           "sample counts may be inexact");
+  }
+  return true;
+}
+
+void VulkanCommandProcessor::BeginOcclusionHostQuery() {
+  if (occlusion_query_pool_ == VK_NULL_HANDLE ||
+      occlusion_query_tracker_.is_host_query_active()) {
+    return;
+  }
+  uint32_t query =
+      occlusion_query_tracker_.BeginHostQuery(GetCurrentSubmission());
+  if (query != UINT32_MAX) {
+    deferred_command_buffer_.CmdVkBeginQuery(occlusion_query_pool_, query,
+                                             occlusion_query_control_flags_);
+  }
+}
+
+void VulkanCommandProcessor::EndOcclusionHostQuery() {
+  uint32_t query = occlusion_query_tracker_.EndHostQuery();
+  if (query != UINT32_MAX) {
+    deferred_command_buffer_.CmdVkEndQuery(occlusion_query_pool_, query);
+  }
+}
+
+void VulkanCommandProcessor::BeginOcclusionQuery() {
+  if (occlusion_query_pool_ == VK_NULL_HANDLE) {
+    return;
+  }
+  EndOcclusionHostQuery();
+  occlusion_query_tracker_.BeginGuestQuery();
+}
+
+uint32_t VulkanCommandProcessor::EndOcclusionQuery(
+    uint32_t sample_counts_address, uint32_t fallback_sample_count) {
+  if (occlusion_query_pool_ == VK_NULL_HANDLE) {
+    return fallback_sample_count;
+  }
+  EndOcclusionHostQuery();
+  return occlusion_query_tracker_.EndGuestQuery(sample_counts_address,
+                                                fallback_sample_count);
+}
+
+void VulkanCommandProcessor::InitializeShaderStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  CommandProcessor::InitializeShaderStorage(cache_root, title_id, blocking);
+  pipeline_cache_->InitializeShaderStorage(cache_root, title_id, blocking);
+  texture_cache_->InitializeDiskCache(cache_root, title_id);
+}
+
 void VulkanCommandProcessor::TracePlaybackWroteMemory(uint32_t base_ptr,
                                                       uint32_t length) {
   shared_memory_->MemoryInvalidationCallback(base_ptr, length, true);
@@ -223,9 +410,19 @@ bool VulkanCommandProcessor::SetupContext() {
       uint32_t(xe::countof(descriptor_set_layout_bindings_constants));
   descriptor_set_layout_create_info.pBindings =
       descriptor_set_layout_bindings_constants;
-  if (dfn.vkCreateDescriptorSetLayout(
-          device, &descriptor_set_layout_create_info, nullptr,
-          &descriptor_set_layout_constants_) != VK_SUCCESS) {
+  // The constants are the only push descriptor set in the pipeline layouts.
+  constants_push_descriptors_used_ =
+      cvars::vulkan_push_descriptors &&
+      provider.device_extensions().khr_push_descriptor;
+  if (constants_push_descriptors_used_) {
+    descriptor_set_layout_create_info.flags |=
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+  }
+  VkResult constants_layout_result = dfn.vkCreateDescriptorSetLayout(
+      device, &descriptor_set_layout_create_info, nullptr,
+      &descriptor_set_layout_constants_);
+  descriptor_set_layout_create_info.flags = 0;
+  if (constants_layout_result != VK_SUCCESS) {
     XELOGE(
         "Failed to create a Vulkan descriptor set layout for guest draw "
         "constant buffers");
@@ -289,6 +486,13 @@ bool VulkanCommandProcessor::SetupContext() {
   uint32_t shared_memory_binding_count = UINT32_C(1)
                                          << shared_memory_binding_count_log2;
 
+  // Render targets and textures are suballocated from the same blocks.
+  vma_allocator_ = ui::vulkan::CreateVmaAllocator(provider, true);
+  if (vma_allocator_ == VK_NULL_HANDLE) {
+    XELOGE("Failed to create the Vulkan Memory Allocator");
+    return false;
+  }
+
   // Requires the transient descriptor set layouts.
   // TODO(Triang3l): Get the actual draw resolution scale when the texture cache
   // supports resolution scaling.
@@ -347,6 +551,186 @@ bool VulkanCommandProcessor::SetupContext() {
     return false;
   }
 
+  // Bindless resources, must be set up before the pipeline cache and the
+  // texture cache.
+  bindless_resources_used_ = false;
+  if (cvars::vulkan_bindless_resources &&
+      provider.device_extensions().ext_descriptor_indexing &&
+      device_features.shaderSampledImageArrayDynamicIndexing) {
+    const VkPhysicalDeviceDescriptorIndexingFeaturesEXT&
+        descriptor_indexing_features =
+            provider.device_descriptor_indexing_features();
+    const VkPhysicalDeviceDescriptorIndexingPropertiesEXT&
+        descriptor_indexing_properties =
+            provider.device_descriptor_indexing_properties();
+    uint32_t bindless_image_count =
+        SpirvShaderTranslator::kBindlessResourceBindingDescriptorCounts
+            [SpirvShaderTranslator::kBindlessResourceBindingTextures2DArray] +
+        SpirvShaderTranslator::kBindlessResourceBindingDescriptorCounts
+            [SpirvShaderTranslator::kBindlessResourceBindingTextures3D] +
+        SpirvShaderTranslator::kBindlessResourceBindingDescriptorCounts
+            [SpirvShaderTranslator::kBindlessResourceBindingTexturesCube];
+    uint32_t bindless_sampler_count =
+        SpirvShaderTranslator::kBindlessResourceBindingDescriptorCounts
+            [SpirvShaderTranslator::kBindlessResourceBindingSamplers];
+    bindless_resources_used_ =
+        descriptor_indexing_features
+            .descriptorBindingSampledImageUpdateAfterBind &&
+        descriptor_indexing_features.descriptorBindingPartiallyBound &&
+        descriptor_indexing_features
+            .descriptorBindingUpdateUnusedWhilePending &&
+        descriptor_indexing_properties
+                .maxPerStageDescriptorUpdateAfterBindSampledImages >=
+            bindless_image_count &&
+        descriptor_indexing_properties
+                .maxDescriptorSetUpdateAfterBindSampledImages >=
+            bindless_image_count &&
+        descriptor_indexing_properties
+                .maxPerStageDescriptorUpdateAfterBindSamplers >=
+            bindless_sampler_count &&
+        descriptor_indexing_properties
+                .maxDescriptorSetUpdateAfterBindSamplers >=
+            bindless_sampler_count &&
+        descriptor_indexing_properties.maxPerStageUpdateAfterBindResources >=
+            bindless_image_count + bindless_sampler_count;
+  }
+  if (bindless_resources_used_) {
+    VkDescriptorSetLayoutBinding bindless_resources_bindings
+        [SpirvShaderTranslator::kBindlessResourceBindingCount];
+    VkDescriptorBindingFlagsEXT bindless_resources_binding_flags
+        [SpirvShaderTranslator::kBindlessResourceBindingCount];
+    VkDescriptorPoolSize bindless_resources_pool_sizes[2];
+    bindless_resources_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindless_resources_pool_sizes[0].descriptorCount = 0;
+    bindless_resources_pool_sizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindless_resources_pool_sizes[1].descriptorCount = 0;
+    for (uint32_t i = 0;
+         i < SpirvShaderTranslator::kBindlessResourceBindingCount; ++i) {
+      VkDescriptorSetLayoutBinding& bindless_resources_binding =
+          bindless_resources_bindings[i];
+      bindless_resources_binding.binding = i;
+      bool is_sampler =
+          i == SpirvShaderTranslator::kBindlessResourceBindingSamplers;
+      bindless_resources_binding.descriptorType =
+          is_sampler ? VK_DESCRIPTOR_TYPE_SAMPLER
+                     : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+      bindless_resources_binding.descriptorCount =
+          SpirvShaderTranslator::kBindlessResourceBindingDescriptorCounts[i];
+      bindless_resources_binding.stageFlags = guest_shader_stages;
+      bindless_resources_binding.pImmutableSamplers = nullptr;
+      // Descriptors for new textures and samplers are written while the set
+      // may be in use by submissions in flight, only to slots not accessed by
+      // them.
+      bindless_resources_binding_flags[i] =
+          VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+          VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+      bindless_resources_pool_sizes[is_sampler ? 1 : 0].descriptorCount +=
+          bindless_resources_binding.descriptorCount;
+    }
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT
+        bindless_resources_binding_flags_create_info;
+    bindless_resources_binding_flags_create_info.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    bindless_resources_binding_flags_create_info.pNext = nullptr;
+    bindless_resources_binding_flags_create_info.bindingCount =
+        uint32_t(xe::countof(bindless_resources_binding_flags));
+    bindless_resources_binding_flags_create_info.pBindingFlags =
+        bindless_resources_binding_flags;
+    descriptor_set_layout_create_info.pNext =
+        &bindless_resources_binding_flags_create_info;
+    descriptor_set_layout_create_info.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    descriptor_set_layout_create_info.bindingCount =
+        uint32_t(xe::countof(bindless_resources_bindings));
+    descriptor_set_layout_create_info.pBindings = bindless_resources_bindings;
+    VkResult bindless_resources_layout_create_result =
+        dfn.vkCreateDescriptorSetLayout(
+            device, &descriptor_set_layout_create_info, nullptr,
+            &descriptor_set_layout_bindless_resources_);
+    descriptor_set_layout_create_info.pNext = nullptr;
+    descriptor_set_layout_create_info.flags = 0;
+    if (bindless_resources_layout_create_result != VK_SUCCESS) {
+      XELOGE(
+          "Failed to create the Vulkan descriptor set layout for bindless "
+          "resources");
+      return false;
+    }
+    VkDescriptorSetLayoutBinding bindless_descriptor_indices_bindings
+        [SpirvShaderTranslator::kBindlessDescriptorIndicesBindingCount];
+    for (uint32_t i = 0;
+         i < SpirvShaderTranslator::kBindlessDescriptorIndicesBindingCount;
+         ++i) {
+      VkDescriptorSetLayoutBinding& bindless_descriptor_indices_binding =
+          bindless_descriptor_indices_bindings[i];
+      bindless_descriptor_indices_binding.binding = i;
+      bindless_descriptor_indices_binding.descriptorType =
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      bindless_descriptor_indices_binding.descriptorCount = 1;
+      bindless_descriptor_indices_binding.stageFlags =
+          i == SpirvShaderTranslator::kBindlessDescriptorIndicesBindingVertex
+              ? guest_shader_vertex_stages_
+              : VK_SHADER_STAGE_FRAGMENT_BIT;
+      bindless_descriptor_indices_binding.pImmutableSamplers = nullptr;
+    }
+    descriptor_set_layout_create_info.bindingCount =
+        uint32_t(xe::countof(bindless_descriptor_indices_bindings));
+    descriptor_set_layout_create_info.pBindings =
+        bindless_descriptor_indices_bindings;
+    if (dfn.vkCreateDescriptorSetLayout(
+            device, &descriptor_set_layout_create_info, nullptr,
+            &descriptor_set_layout_bindless_descriptor_indices_) !=
+        VK_SUCCESS) {
+      XELOGE(
+          "Failed to create the Vulkan descriptor set layout for bindless "
+          "descriptor indices");
+      return false;
+    }
+    VkDescriptorPoolCreateInfo bindless_resources_pool_create_info;
+    bindless_resources_pool_create_info.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    bindless_resources_pool_create_info.pNext = nullptr;
+    bindless_resources_pool_create_info.flags =
+        VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    bindless_resources_pool_create_info.maxSets = 1;
+    bindless_resources_pool_create_info.poolSizeCount =
+        uint32_t(xe::countof(bindless_resources_pool_sizes));
+    bindless_resources_pool_create_info.pPoolSizes =
+        bindless_resources_pool_sizes;
+    if (dfn.vkCreateDescriptorPool(device, &bindless_resources_pool_create_info,
+                                   nullptr,
+                                   &bindless_resources_descriptor_pool_) !=
+        VK_SUCCESS) {
+      XELOGE(
+          "Failed to create the Vulkan descriptor pool for bindless resources");
+      return false;
+    }
+    VkDescriptorSetAllocateInfo bindless_resources_set_allocate_info;
+    bindless_resources_set_allocate_info.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    bindless_resources_set_allocate_info.pNext = nullptr;
+    bindless_resources_set_allocate_info.descriptorPool =
+        bindless_resources_descriptor_pool_;
+    bindless_resources_set_allocate_info.descriptorSetCount = 1;
+    bindless_resources_set_allocate_info.pSetLayouts =
+        &descriptor_set_layout_bindless_resources_;
+    if (dfn.vkAllocateDescriptorSets(device,
+                                     &bindless_resources_set_allocate_info,
+                                     &bindless_resources_descriptor_set_) !=
+        VK_SUCCESS) {
+      XELOGE(
+          "Failed to allocate the Vulkan descriptor set for bindless "
+          "resources");
+      return false;
+    }
+    for (BindlessDescriptorArray& bindless_descriptor_array :
+         bindless_descriptor_arrays_) {
+      bindless_descriptor_array.allocated_count = 0;
+      bindless_descriptor_array.free_slots.clear();
+    }
+    XELOGGPU("VulkanCommandProcessor: Using bindless textures and samplers");
+  }
+
   pipeline_cache_ = std::make_unique<VulkanPipelineCache>(
       *this, *register_file_, *render_target_cache_,
       guest_shader_vertex_stages_);
@@ -1033,6 +1417,18 @@ bool VulkanCommandProcessor::SetupContext() {
     return false;
   }
 
+  // With the fragment shader interlock, the depth test is done in the shader,
+  // so host queries count the samples before it.
+  if (OcclusionQueryTracker::IsHostQueryingRequested()) {
+    if (render_target_cache_->GetPath() ==
+        RenderTargetCache::Path::kPixelShaderInterlock) {
+      XELOGW("Host occlusion queries are not supported with the fragment "
+             "shader interlock, reporting the fake sample count");
+    } else {
+      InitializeOcclusionQueries();
+    }
+  }
+
   // Just not to expose uninitialized memory.
   std::memset(&system_constants_, 0, sizeof(system_constants_));
 
@@ -1046,6 +1442,14 @@ void VulkanCommandProcessor::ShutdownContext() {
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
+  gpu_pass_timestamps_.Shutdown();
+  ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyQueryPool, device,
+                                         timestamp_query_pool_);
+
+  occlusion_query_tracker_.Reset();
+  ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyQueryPool, device,
+                                         occlusion_query_pool_);
+
   DestroyScratchBuffer();
 
   for (SwapFramebuffer& swap_framebuffer : swap_framebuffers_) {
@@ -1091,10 +1495,26 @@ void VulkanCommandProcessor::ShutdownContext() {
 
   texture_cache_.reset();
 
+  // After the texture cache has released its bindless descriptors.
+  ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyDescriptorPool, device,
+                                         bindless_resources_descriptor_pool_);
+  bindless_resources_descriptor_set_ = VK_NULL_HANDLE;
+  for (BindlessDescriptorArray& bindless_descriptor_array :
+       bindless_descriptor_arrays_) {
+    bindless_descriptor_array.allocated_count = 0;
+    bindless_descriptor_array.free_slots.clear();
+  }
+
   pipeline_cache_.reset();
 
   render_target_cache_.reset();
 
+  // After all the images allocated with it have been destroyed.
+  if (vma_allocator_ != VK_NULL_HANDLE) {
+    vmaDestroyAllocator(vma_allocator_);
+    vma_allocator_ = VK_NULL_HANDLE;
+  }
+
   primitive_processor_.reset();
 
   shared_memory_.reset();
@@ -1113,6 +1533,12 @@ void VulkanCommandProcessor::ShutdownContext() {
   }
   descriptor_set_layouts_textures_.clear();
 
+  ui::vulkan::util::DestroyAndNullHandle(
+      dfn.vkDestroyDescriptorSetLayout, device,
+      descriptor_set_layout_bindless_descriptor_indices_);
+  ui::vulkan::util::DestroyAndNullHandle(
+      dfn.vkDestroyDescriptorSetLayout, device,
+      descriptor_set_layout_bindless_resources_);
   ui::vulkan::util::DestroyAndNullHandle(
       dfn.vkDestroyDescriptorSetLayout, device,
       descriptor_set_layout_shared_memory_and_edram_);
@@ -1161,6 +1587,7 @@ void VulkanCommandProcessor::ShutdownContext() {
   frame_completed_ = 0;
   frame_current_ = 1;
   frame_open_ = false;
+  frames_in_flight_ = GetFramesInFlight(kMaxFramesInFlight);
 
   for (const auto& semaphore : submissions_in_flight_semaphores_) {
     dfn.vkDestroySemaphore(device, semaphore.second, nullptr);
@@ -1193,11 +1620,17 @@ void VulkanCommandProcessor::ShutdownContext() {
 }
 
 void VulkanCommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
+  // Rewriting a constant with the value it already has, as titles often do
+  // when setting a whole constant block for every draw, doesn't require the
+  // constant buffer to be uploaded again.
+  bool value_changed = index < RegisterFile::kRegisterCount &&
+                       register_file_->values[index].u32 != value;
+
   CommandProcessor::WriteRegister(index, value);
 
   if (index >= XE_GPU_REG_SHADER_CONSTANT_000_X &&
       index <= XE_GPU_REG_SHADER_CONSTANT_511_W) {
-    if (frame_open_) {
+    if (frame_open_ && value_changed) {
       uint32_t float_constant_index =
           (index - XE_GPU_REG_SHADER_CONSTANT_000_X) >> 2;
       if (float_constant_index >= 256) {
@@ -1217,25 +1650,126 @@ void VulkanCommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
     }
   } else if (index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031 &&
              index <= XE_GPU_REG_SHADER_CONSTANT_LOOP_31) {
-    current_constant_buffers_up_to_date_ &=
-        ~(UINT32_C(1) << SpirvShaderTranslator::kConstantBufferBoolLoop);
+    if (value_changed) {
+      current_constant_buffers_up_to_date_ &=
+          ~(UINT32_C(1) << SpirvShaderTranslator::kConstantBufferBoolLoop);
+    }
   } else if (index >= XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 &&
              index <= XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5) {
-    current_constant_buffers_up_to_date_ &=
-        ~(UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFetch);
-    if (texture_cache_) {
-      texture_cache_->TextureFetchConstantWritten(
-          (index - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6);
+    // Rebinding the same resources also doesn't require the texture bindings
+    // to be updated.
+    if (value_changed) {
+      current_constant_buffers_up_to_date_ &=
+          ~(UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFetch);
+      if (texture_cache_) {
+        texture_cache_->TextureFetchConstantWritten(
+            (index - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6);
+      }
     }
   }
 }
 void VulkanCommandProcessor::WriteRegistersFromMem(uint32_t start_index,
                                                    uint32_t* base,
                                                    uint32_t num_registers) {
-  for (uint32_t i = 0; i < num_registers; ++i) {
-    uint32_t data = xe::load_and_swap<uint32_t>(base + i);
-    VulkanCommandProcessor::WriteRegister(start_index + i, data);
+  uint32_t end_index = start_index + num_registers;
+  uint32_t constants_start =
+      std::max(start_index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_000_X));
+  uint32_t constants_end =
+      std::min(end_index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_LOOP_31 + 1));
+  if (constants_start >= constants_end) {
+    for (uint32_t i = 0; i < num_registers; ++i) {
+      uint32_t data = xe::load_and_swap<uint32_t>(base + i);
+      VulkanCommandProcessor::WriteRegister(start_index + i, data);
+    }
+    return;
+  }
+  for (uint32_t i = start_index; i < constants_start; ++i) {
+    VulkanCommandProcessor::WriteRegister(
+        i, xe::load_and_swap<uint32_t>(base + (i - start_index)));
+  }
+  WriteShaderConstantsFromMem(constants_start,
+                              base + (constants_start - start_index),
+                              constants_end - constants_start);
+  for (uint32_t i = constants_end; i < end_index; ++i) {
+    VulkanCommandProcessor::WriteRegister(
+        i, xe::load_and_swap<uint32_t>(base + (i - start_index)));
+  }
+}
+void VulkanCommandProcessor::WriteShaderConstantsFromMem(
+    uint32_t start_index, const uint32_t* base, uint32_t num_registers) {
+  uint32_t end_index = start_index + num_registers;
+  auto register_changed = [&](uint32_t index) {
+    return xe::load_and_swap<uint32_t>(base + (index - start_index)) !=
+           register_file_->values[index].u32;
+  };
+
+  // Float constants - only the vectors used by the current shaders.
+  auto check_float_constants = [&](uint32_t range_start, uint32_t buffer,
+                                   const uint64_t* float_constant_map) {
+    if (!(current_constant_buffers_up_to_date_ & (UINT32_C(1) << buffer))) {
+      return;
+    }
+    uint32_t first_index = std::max(start_index, range_start);
+    uint32_t last_index = std::min(end_index, range_start + 4 * 256);
+    for (uint32_t index = first_index; index < last_index; ++index) {
+      uint32_t float_constant_index = (index - range_start) >> 2;
+      if ((float_constant_map[float_constant_index >> 6] &
+           (UINT64_C(1) << (float_constant_index & 63))) &&
+          register_changed(index)) {
+        current_constant_buffers_up_to_date_ &= ~(UINT32_C(1) << buffer);
+        return;
+      }
+    }
+  };
+  if (frame_open_) {
+    check_float_constants(XE_GPU_REG_SHADER_CONSTANT_000_X,
+                          SpirvShaderTranslator::kConstantBufferFloatVertex,
+                          current_float_constant_map_vertex_);
+    check_float_constants(XE_GPU_REG_SHADER_CONSTANT_256_X,
+                          SpirvShaderTranslator::kConstantBufferFloatPixel,
+                          current_float_constant_map_pixel_);
+  }
+
+  // Fetch constants - notifying the texture cache once about all the changed
+  // ones.
+  uint32_t fetch_start_index =
+      std::max(start_index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0));
+  uint32_t fetch_end_index =
+      std::min(end_index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5 + 1));
+  uint32_t first_changed_fetch = UINT32_MAX, last_changed_fetch = 0;
+  for (uint32_t index = fetch_start_index; index < fetch_end_index; ++index) {
+    if (register_changed(index)) {
+      uint32_t fetch_index =
+          (index - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6;
+      first_changed_fetch = std::min(first_changed_fetch, fetch_index);
+      last_changed_fetch = fetch_index;
+    }
+  }
+  if (first_changed_fetch != UINT32_MAX) {
+    current_constant_buffers_up_to_date_ &=
+        ~(UINT32_C(1) << SpirvShaderTranslator::kConstantBufferFetch);
+    if (texture_cache_) {
+      texture_cache_->TextureFetchConstantsWritten(first_changed_fetch,
+                                                   last_changed_fetch);
+    }
   }
+
+  // Bool and loop constants.
+  if (current_constant_buffers_up_to_date_ &
+      (UINT32_C(1) << SpirvShaderTranslator::kConstantBufferBoolLoop)) {
+    uint32_t bool_loop_start_index = std::max(
+        start_index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031));
+    for (uint32_t index = bool_loop_start_index; index < end_index; ++index) {
+      if (register_changed(index)) {
+        current_constant_buffers_up_to_date_ &=
+            ~(UINT32_C(1) << SpirvShaderTranslator::kConstantBufferBoolLoop);
+        break;
+      }
+    }
+  }
+
+  copy_and_swap_32_unaligned(&register_file_->values[start_index], base,
+                             num_registers);
 }
 void VulkanCommandProcessor::SparseBindBuffer(
     VkBuffer buffer, uint32_t bind_count, const VkSparseMemoryBind* binds,
@@ -1243,10 +1777,21 @@ void VulkanCommandProcessor::SparseBindBuffer(
   if (!bind_count) {
     return;
   }
-  SparseBufferBind& buffer_bind = sparse_buffer_binds_.emplace_back();
-  buffer_bind.buffer = buffer;
-  buffer_bind.bind_offset = sparse_memory_binds_.size();
-  buffer_bind.bind_count = bind_count;
+  // All binds are done in one vkQueueBindSparse before the submission - append
+  // to the previous bind info for the same buffer if possible to keep a single
+  // one for bursts of binds for the shared memory buffer.
+  if (!sparse_buffer_binds_.empty() &&
+      sparse_buffer_binds_.back().buffer == buffer) {
+    SparseBufferBind& buffer_bind = sparse_buffer_binds_.back();
+    assert_true(buffer_bind.bind_offset + buffer_bind.bind_count ==
+                sparse_memory_binds_.size());
+    buffer_bind.bind_count += bind_count;
+  } else {
+    SparseBufferBind& buffer_bind = sparse_buffer_binds_.emplace_back();
+    buffer_bind.buffer = buffer;
+    buffer_bind.bind_offset = sparse_memory_binds_.size();
+    buffer_bind.bind_count = bind_count;
+  }
   sparse_memory_binds_.reserve(sparse_memory_binds_.size() + bind_count);
   sparse_memory_binds_.insert(sparse_memory_binds_.end(), binds,
                               binds + bind_count);
@@ -1513,6 +2058,9 @@ void VulkanCommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
         render_pass_begin_info.pClearValues = nullptr;
         deferred_command_buffer_.CmdVkBeginRenderPass(
             &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+        if (benchmark_statistics_enabled_) {
+          ++benchmark_statistics_.render_pass_count;
+        }
 
         VkViewport viewport;
         viewport.x = 0.0f;
@@ -1771,6 +2319,10 @@ bool VulkanCommandProcessor::SubmitBarriers(bool force_end_render_pass) {
         pending_barriers_image_memory_barriers_.data() +
             it->image_memory_barriers_offset);
   }
+  if (benchmark_statistics_enabled_) {
+    benchmark_statistics_.barrier_batch_count +=
+        uint32_t(pending_barriers_.size());
+  }
   pending_barriers_.clear();
   pending_barriers_buffer_memory_barriers_.clear();
   pending_barriers_image_memory_barriers_.clear();
@@ -1788,6 +2340,8 @@ void VulkanCommandProcessor::SubmitBarriersAndEnterRenderTargetCacheRenderPass(
     return;
   }
   if (current_render_pass_ != VK_NULL_HANDLE) {
+    // Queries can't span render passes.
+    EndOcclusionHostQuery();
     deferred_command_buffer_.CmdVkEndRenderPass();
   }
   current_render_pass_ = render_pass;
@@ -1806,6 +2360,9 @@ void VulkanCommandProcessor::SubmitBarriersAndEnterRenderTargetCacheRenderPass(
   render_pass_begin_info.pClearValues = nullptr;
   deferred_command_buffer_.CmdVkBeginRenderPass(&render_pass_begin_info,
                                                 VK_SUBPASS_CONTENTS_INLINE);
+  if (benchmark_statistics_enabled_) {
+    ++benchmark_statistics_.render_pass_count;
+  }
 }
 
 void VulkanCommandProcessor::EndRenderPass() {
@@ -1813,6 +2370,7 @@ void VulkanCommandProcessor::EndRenderPass() {
   if (current_render_pass_ == VK_NULL_HANDLE) {
     return;
   }
+  EndOcclusionHostQuery();
   deferred_command_buffer_.CmdVkEndRenderPass();
   current_render_pass_ = VK_NULL_HANDLE;
   current_framebuffer_ = nullptr;
@@ -1858,6 +2416,81 @@ VkDescriptorSet VulkanCommandProcessor::AllocateSingleTransientDescriptor(
   return descriptor_set;
 }
 
+uint32_t VulkanCommandProcessor::AllocateBindlessImageDescriptor(
+    SpirvShaderTranslator::BindlessResourceBinding binding,
+    VkImageView image_view) {
+  assert_true(binding !=
+              SpirvShaderTranslator::kBindlessResourceBindingSamplers);
+  VkDescriptorImageInfo image_info;
+  image_info.sampler = VK_NULL_HANDLE;
+  image_info.imageView = image_view;
+  image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  return AllocateBindlessDescriptor(binding, image_info);
+}
+
+uint32_t VulkanCommandProcessor::AllocateBindlessSamplerDescriptor(
+    VkSampler sampler) {
+  VkDescriptorImageInfo image_info;
+  image_info.sampler = sampler;
+  image_info.imageView = VK_NULL_HANDLE;
+  image_info.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  return AllocateBindlessDescriptor(
+      SpirvShaderTranslator::kBindlessResourceBindingSamplers, image_info);
+}
+
+void VulkanCommandProcessor::ReleaseBindlessDescriptor(
+    SpirvShaderTranslator::BindlessResourceBinding binding,
+    uint32_t descriptor_index) {
+  assert_true(bindless_resources_used_);
+  BindlessDescriptorArray& bindless_descriptor_array =
+      bindless_descriptor_arrays_[binding];
+  assert_true(descriptor_index < bindless_descriptor_array.allocated_count);
+  bindless_descriptor_array.free_slots.push_back(descriptor_index);
+}
+
+uint32_t VulkanCommandProcessor::AllocateBindlessDescriptor(
+    SpirvShaderTranslator::BindlessResourceBinding binding,
+    const VkDescriptorImageInfo& image_info) {
+  assert_true(bindless_resources_used_);
+  BindlessDescriptorArray& bindless_descriptor_array =
+      bindless_descriptor_arrays_[binding];
+  uint32_t descriptor_index;
+  if (!bindless_descriptor_array.free_slots.empty()) {
+    descriptor_index = bindless_descriptor_array.free_slots.back();
+    bindless_descriptor_array.free_slots.pop_back();
+  } else {
+    if (bindless_descriptor_array.allocated_count >=
+        SpirvShaderTranslator::kBindlessResourceBindingDescriptorCounts
+            [binding]) {
+      XELOGE(
+          "VulkanCommandProcessor: Ran out of bindless descriptors in array "
+          "{}",
+          uint32_t(binding));
+      return UINT32_MAX;
+    }
+    descriptor_index = bindless_descriptor_array.allocated_count++;
+  }
+  const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  VkWriteDescriptorSet write_descriptor_set;
+  write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write_descriptor_set.pNext = nullptr;
+  write_descriptor_set.dstSet = bindless_resources_descriptor_set_;
+  write_descriptor_set.dstBinding = uint32_t(binding);
+  write_descriptor_set.dstArrayElement = descriptor_index;
+  write_descriptor_set.descriptorCount = 1;
+  write_descriptor_set.descriptorType =
+      binding == SpirvShaderTranslator::kBindlessResourceBindingSamplers
+          ? VK_DESCRIPTOR_TYPE_SAMPLER
+          : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+  write_descriptor_set.pImageInfo = &image_info;
+  write_descriptor_set.pBufferInfo = nullptr;
+  write_descriptor_set.pTexelBufferView = nullptr;
+  dfn.vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+  return descriptor_index;
+}
+
 VkDescriptorSetLayout VulkanCommandProcessor::GetTextureDescriptorSetLayout(
     bool is_vertex, size_t texture_count, size_t sampler_count) {
   size_t binding_count = texture_count + sampler_count;
@@ -1924,6 +2557,14 @@ VulkanCommandProcessor::GetPipelineLayout(size_t texture_count_pixel,
                                           size_t sampler_count_pixel,
                                           size_t texture_count_vertex,
                                           size_t sampler_count_vertex) {
+  if (bindless_resources_used_) {
+    // The same layout for all shaders, with the bindings specified via
+    // descriptor indices.
+    texture_count_pixel = 0;
+    sampler_count_pixel = 0;
+    texture_count_vertex = 0;
+    sampler_count_vertex = 0;
+  }
   PipelineLayoutKey pipeline_layout_key;
   pipeline_layout_key.texture_count_pixel = uint16_t(texture_count_pixel);
   pipeline_layout_key.sampler_count_pixel = uint16_t(sampler_count_pixel);
@@ -1936,25 +2577,34 @@ VulkanCommandProcessor::GetPipelineLayout(size_t texture_count_pixel,
     }
   }
 
-  VkDescriptorSetLayout descriptor_set_layout_textures_vertex =
-      GetTextureDescriptorSetLayout(true, texture_count_vertex,
-                                    sampler_count_vertex);
-  if (descriptor_set_layout_textures_vertex == VK_NULL_HANDLE) {
-    XELOGE(
-        "Failed to obtain a Vulkan descriptor set layout for {} sampled images "
-        "and {} samplers for guest vertex shaders",
-        texture_count_vertex, sampler_count_vertex);
-    return nullptr;
-  }
-  VkDescriptorSetLayout descriptor_set_layout_textures_pixel =
-      GetTextureDescriptorSetLayout(false, texture_count_pixel,
-                                    sampler_count_pixel);
-  if (descriptor_set_layout_textures_pixel == VK_NULL_HANDLE) {
-    XELOGE(
-        "Failed to obtain a Vulkan descriptor set layout for {} sampled images "
-        "and {} samplers for guest pixel shaders",
-        texture_count_pixel, sampler_count_pixel);
-    return nullptr;
+  VkDescriptorSetLayout descriptor_set_layout_textures_vertex;
+  VkDescriptorSetLayout descriptor_set_layout_textures_pixel;
+  if (bindless_resources_used_) {
+    // kDescriptorSetBindlessResources and
+    // kDescriptorSetBindlessDescriptorIndices.
+    descriptor_set_layout_textures_vertex =
+        descriptor_set_layout_bindless_resources_;
+    descriptor_set_layout_textures_pixel =
+        descriptor_set_layout_bindless_descriptor_indices_;
+  } else {
+    descriptor_set_layout_textures_vertex = GetTextureDescriptorSetLayout(
+        true, texture_count_vertex, sampler_count_vertex);
+    if (descriptor_set_layout_textures_vertex == VK_NULL_HANDLE) {
+      XELOGE(
+          "Failed to obtain a Vulkan descriptor set layout for {} sampled "
+          "images and {} samplers for guest vertex shaders",
+          texture_count_vertex, sampler_count_vertex);
+      return nullptr;
+    }
+    descriptor_set_layout_textures_pixel = GetTextureDescriptorSetLayout(
+        false, texture_count_pixel, sampler_count_pixel);
+    if (descriptor_set_layout_textures_pixel == VK_NULL_HANDLE) {
+      XELOGE(
+          "Failed to obtain a Vulkan descriptor set layout for {} sampled "
+          "images and {} samplers for guest pixel shaders",
+          texture_count_pixel, sampler_count_pixel);
+      return nullptr;
+    }
   }
 
   VkDescriptorSetLayout
@@ -2097,13 +2747,14 @@ void VulkanCommandProcessor::BindExternalGraphicsPipeline(
     dynamic_stencil_reference_front_update_needed_ = true;
     dynamic_stencil_reference_back_update_needed_ = true;
   }
+  dynamic_extended_state_update_needed_ = true;
   if (current_external_graphics_pipeline_ == pipeline) {
     return;
   }
   deferred_command_buffer_.CmdVkBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS,
                                              pipeline);
   current_external_graphics_pipeline_ = pipeline;
-  current_guest_graphics_pipeline_ = VK_NULL_HANDLE;
+  current_guest_graphics_pipeline_ = nullptr;
   current_guest_graphics_pipeline_layout_ = VK_NULL_HANDLE;
 }
 
@@ -2209,9 +2860,17 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
     // cache.
     if (!memexport_used_vertex) {
       // This draw has no effect.
+      ++frame_culled_draw_count_;
       return true;
     }
   }
+  // Drop the draws that can't cover any pixels before doing anything for them.
+  if (cvars::cull_scissored_out_draws && is_rasterization_done &&
+      !memexport_used_vertex &&
+      render_target_cache_->IsDrawScissoredOut(*vertex_shader)) {
+    ++frame_culled_draw_count_;
+    return true;
+  }
   // TODO(Triang3l): Memory export.
 
   uint32_t ps_param_gen_pos = UINT32_MAX;
@@ -2245,6 +2904,7 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
     }
     if (!primitive_processing_result.host_draw_vertex_count) {
       // Nothing to draw.
+      ++frame_culled_draw_count_;
       return true;
     }
     // TODO(Triang3l): Tessellation, geometry-type-specific vertex shader,
@@ -2292,8 +2952,12 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
       std::vector<std::pair<VulkanTextureCache::SamplerParameters, VkSampler>>&
           shader_samplers =
               j ? current_samplers_pixel_ : current_samplers_vertex_;
+      std::vector<uint32_t>& shader_sampler_bindless_indices =
+          j ? current_sampler_bindless_indices_pixel_
+            : current_sampler_bindless_indices_vertex_;
       if (!i) {
         shader_samplers.clear();
+        shader_sampler_bindless_indices.clear();
       }
       const VulkanShader* shader = j ? pixel_shader : vertex_shader;
       if (!shader) {
@@ -2309,16 +2973,22 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
               texture_cache_->GetSamplerParameters(shader_sampler_binding),
               VK_NULL_HANDLE);
         }
+        if (bindless_resources_used_) {
+          shader_sampler_bindless_indices.resize(shader_samplers.size(), 0);
+        }
       }
-      for (std::pair<VulkanTextureCache::SamplerParameters, VkSampler>&
-               shader_sampler_pair : shader_samplers) {
+      for (size_t k = 0; k < shader_samplers.size(); ++k) {
+        std::pair<VulkanTextureCache::SamplerParameters, VkSampler>&
+            shader_sampler_pair = shader_samplers[k];
         // UseSampler calls are needed even on the second iteration in case the
         // submission was broken (and thus the last usage submission indices for
         // the used samplers need to be updated) due to an overflow within one
         // submission. Though sampler overflow is a very rare situation overall.
         bool sampler_overflowed;
         VkSampler shader_sampler = texture_cache_->UseSampler(
-            shader_sampler_pair.first, sampler_overflowed);
+            shader_sampler_pair.first, sampler_overflowed,
+            bindless_resources_used_ ? &shader_sampler_bindless_indices[k]
+                                     : nullptr);
         shader_sampler_pair.second = shader_sampler;
         if (shader_sampler == VK_NULL_HANDLE) {
           if (!sampler_overflowed || i) {
@@ -2367,16 +3037,24 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   // Create the pipeline (for this, need the render pass from the render target
   // cache), translating the shaders - doing this now to obtain the used
   // textures.
-  VkPipeline pipeline;
+  const void* pipeline_handle;
   const VulkanPipelineCache::PipelineLayoutProvider* pipeline_layout_provider;
+  VulkanPipelineCache::ExtendedDynamicState extended_dynamic_state;
   if (!pipeline_cache_->ConfigurePipeline(
           vertex_shader_translation, pixel_shader_translation,
           primitive_processing_result, normalized_depth_control,
           normalized_color_mask,
-          render_target_cache_->last_update_render_pass_key(), pipeline,
-          pipeline_layout_provider)) {
+          render_target_cache_->last_update_render_pass_key(),
+          pipeline_handle, pipeline_layout_provider,
+          extended_dynamic_state)) {
     return false;
   }
+  if (cvars::vulkan_skip_draws_until_pipeline_created &&
+      !pipeline_cache_->IsPipelineCreationCompleted(pipeline_handle)) {
+    // Drop the draw instead of waiting for the pipeline at the end of the
+    // submission.
+    return true;
+  }
 
   // Update the textures before most other work in the submission because
   // samplers depend on this (and in case of sampler overflow in a submission,
@@ -2391,10 +3069,9 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   // Update the graphics pipeline, and if the new graphics pipeline has a
   // different layout, invalidate incompatible descriptor sets before updating
   // current_guest_graphics_pipeline_layout_.
-  if (current_guest_graphics_pipeline_ != pipeline) {
-    deferred_command_buffer_.CmdVkBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                               pipeline);
-    current_guest_graphics_pipeline_ = pipeline;
+  if (current_guest_graphics_pipeline_ != pipeline_handle) {
+    deferred_command_buffer_.CmdBindGraphicsPipelineHandle(pipeline_handle);
+    current_guest_graphics_pipeline_ = pipeline_handle;
     current_external_graphics_pipeline_ = VK_NULL_HANDLE;
   }
   auto pipeline_layout =
@@ -2468,7 +3145,7 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
 
   // Update dynamic graphics pipeline state.
   UpdateDynamicState(viewport_info, primitive_polygonal,
-                     normalized_depth_control);
+                     normalized_depth_control, extended_dynamic_state);
 
   auto vgt_draw_initiator = regs.Get<reg::VGT_DRAW_INITIATOR>();
 
@@ -2551,6 +3228,8 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
       render_target_cache_->last_update_render_pass(),
       render_target_cache_->last_update_framebuffer());
 
+  BeginOcclusionHostQuery();
+
   // Draw.
   if (primitive_processing_result.index_buffer_type ==
           PrimitiveProcessor::ProcessedIndexBufferType::kNone ||
@@ -2656,9 +3335,11 @@ void VulkanCommandProcessor::CheckSubmissionFenceAndDeviceLoss(
     // defined by vkQueueSubmit additionally include in the first
     // synchronization scope all commands that occur earlier in submission
     // order."
+    uint64_t wait_start_tick = Clock::QueryHostTickCount();
     VkResult wait_result = dfn.vkWaitForFences(
         device, uint32_t(await_submission - submission_completed_),
         submissions_in_flight_fences_.data(), VK_TRUE, UINT64_MAX);
+    RecordSubmissionFenceWait(Clock::QueryHostTickCount() - wait_start_tick);
     if (wait_result == VK_SUCCESS) {
       fences_awaited += await_submission - submission_completed_;
     } else {
@@ -2731,6 +3412,87 @@ void VulkanCommandProcessor::CheckSubmissionFenceAndDeviceLoss(
 
   texture_cache_->CompletedSubmissionUpdated(submission_completed_);
 
+  // Report the results of the guest occlusion queries whose host queries have
+  // been completed.
+  if (occlusion_query_pool_ != VK_NULL_HANDLE) {
+    uint32_t draw_resolution_scale = texture_cache_->draw_resolution_scale_x() *
+                                     texture_cache_->draw_resolution_scale_y();
+    uint64_t host_query_results[256];
+    uint32_t host_query_first, host_query_count;
+    while (occlusion_query_tracker_.GetCompletedGuestQuery(
+        submission_completed_, host_query_first, host_query_count)) {
+      uint64_t sample_count = 0;
+      while (host_query_count) {
+        uint32_t host_query_read_count = std::min(
+            {host_query_count,
+             OcclusionQueryTracker::kHostQueryCount - host_query_first,
+             uint32_t(xe::countof(host_query_results))});
+        if (dfn.vkGetQueryPoolResults(
+                device, occlusion_query_pool_, host_query_first,
+                host_query_read_count,
+                sizeof(uint64_t) * host_query_read_count, host_query_results,
+                sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+          sample_count = UINT64_MAX;
+          break;
+        }
+        for (uint32_t i = 0; i < host_query_read_count; ++i) {
+          sample_count += host_query_results[i];
+        }
+        host_query_first = (host_query_first + host_query_read_count) %
+                           OcclusionQueryTracker::kHostQueryCount;
+        host_query_count -= host_query_read_count;
+      }
+      occlusion_query_tracker_.CompleteGuestQuery(
+          sample_count != UINT64_MAX ? sample_count / draw_resolution_scale
+                                     : UINT64_MAX,
+          *memory_);
+    }
+  }
+
+  // Gather the GPU time of the submissions whose timestamp slots haven't been
+  // reused by later submissions yet.
+  if (timestamp_query_pool_ != VK_NULL_HANDLE) {
+    uint64_t timestamp_submission_first =
+        submission_completed_ - fences_awaited + 1;
+    if (submission_completed_ >= GpuPassTimestamps::kSlotCount) {
+      timestamp_submission_first =
+          std::max(timestamp_submission_first,
+                   submission_completed_ - GpuPassTimestamps::kSlotCount + 1);
+    }
+    double timestamp_period =
+        provider.device_properties().limits.timestampPeriod;
+    // The bits above timestampValidBits are undefined, and the counter wraps
+    // around at 2^timestampValidBits.
+    uint32_t timestamp_valid_bits =
+        provider.queue_families()[provider.queue_family_graphics_compute()]
+            .timestamp_valid_bits;
+    uint64_t timestamp_mask = timestamp_valid_bits >= 64
+                                  ? UINT64_MAX
+                                  : (uint64_t(1) << timestamp_valid_bits) - 1;
+    uint64_t timestamps[GpuPassTimestamps::kTimestampsPerSlot];
+    for (uint64_t i = timestamp_submission_first; i <= submission_completed_;
+         ++i) {
+      uint32_t timestamp_query_first, timestamp_query_count;
+      if (!gpu_pass_timestamps_.GetSubmissionQueries(
+              i, timestamp_query_first, timestamp_query_count)) {
+        continue;
+      }
+      if (dfn.vkGetQueryPoolResults(
+              device, timestamp_query_pool_, timestamp_query_first,
+              timestamp_query_count, sizeof(uint64_t) * timestamp_query_count,
+              timestamps, sizeof(uint64_t),
+              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        continue;
+      }
+      uint64_t gpu_time_ns = gpu_pass_timestamps_.SubmissionCompleted(
+          i, timestamps, timestamp_mask, timestamp_period);
+      if (benchmark_statistics_enabled_) {
+        ++benchmark_statistics_.gpu_timed_submission_count;
+        benchmark_statistics_.gpu_time_ns += gpu_time_ns;
+      }
+    }
+  }
+
   // Destroy objects scheduled for destruction.
   while (!destroy_framebuffers_.empty()) {
     const auto& destroy_pair = destroy_framebuffers_.front();
@@ -2777,8 +3539,9 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
   // await the availability of the current frame. Also check whether the device
   // is still available, and whether the await was successful.
   uint64_t await_submission =
-      is_opening_frame
-          ? closed_frame_submissions_[frame_current_ % kMaxFramesInFlight]
+      is_opening_frame && frame_current_ > frames_in_flight_
+          ? closed_frame_submissions_[(frame_current_ - frames_in_flight_) %
+                                      kMaxFramesInFlight]
           : 0;
   CheckSubmissionFenceAndDeviceLoss(await_submission);
   if (device_lost_ || submission_completed_ < await_submission) {
@@ -2787,10 +3550,11 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
 
   if (is_opening_frame) {
     // Update the completed frame index, also obtaining the actual completed
-    // frame number (since the CPU may be actually less than 3 frames behind)
-    // before reclaiming resources tracked with the frame number.
-    frame_completed_ = std::max(frame_current_, uint64_t(kMaxFramesInFlight)) -
-                       kMaxFramesInFlight;
+    // frame number (since the CPU may be actually less than frames_in_flight_
+    // frames behind) before reclaiming resources tracked with the frame
+    // number.
+    frame_completed_ = std::max(frame_current_, uint64_t(frames_in_flight_)) -
+                       frames_in_flight_;
     for (uint64_t frame = frame_completed_ + 1; frame < frame_current_;
          ++frame) {
       if (closed_frame_submissions_[frame % kMaxFramesInFlight] >
@@ -2820,9 +3584,10 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
     dynamic_stencil_write_mask_back_update_needed_ = true;
     dynamic_stencil_reference_front_update_needed_ = true;
     dynamic_stencil_reference_back_update_needed_ = true;
+    dynamic_extended_state_update_needed_ = true;
     current_render_pass_ = VK_NULL_HANDLE;
     current_framebuffer_ = nullptr;
-    current_guest_graphics_pipeline_ = VK_NULL_HANDLE;
+    current_guest_graphics_pipeline_ = nullptr;
     current_external_graphics_pipeline_ = VK_NULL_HANDLE;
     current_external_compute_pipeline_ = VK_NULL_HANDLE;
     current_guest_graphics_pipeline_layout_ = nullptr;
@@ -2830,7 +3595,17 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
 
     primitive_processor_->BeginSubmission();
 
+    // Lets VMA refresh the memory budget from VK_EXT_memory_budget.
+    vmaSetCurrentFrameIndex(vma_allocator_, uint32_t(GetCurrentSubmission()));
+
     texture_cache_->BeginSubmission(GetCurrentSubmission());
+
+    bool time_passes = GpuPassTimestamps::IsPassTimingRequested();
+    if ((benchmark_statistics_enabled_ || time_passes) &&
+        InitializeTimestampQueries()) {
+      gpu_pass_timestamps_.BeginSubmission(GetCurrentSubmission(),
+                                           frame_current_, time_passes);
+    }
   }
 
   if (is_opening_frame) {
@@ -2844,6 +3619,7 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
     std::memset(current_graphics_descriptor_sets_, 0,
                 sizeof(current_graphics_descriptor_sets_));
     current_constant_buffers_up_to_date_ = 0;
+    current_bindless_descriptor_indices_up_to_date_ = 0;
     current_graphics_descriptor_sets_
         [SpirvShaderTranslator::kDescriptorSetSharedMemoryAndEdram] =
             shared_memory_and_edram_descriptor_set_;
@@ -2877,6 +3653,16 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
           used_transient_descriptor.second);
       constants_transient_descriptors_used_.pop_front();
     }
+    while (!bindless_descriptor_indices_transient_descriptors_used_.empty()) {
+      const std::pair<uint64_t, VkDescriptorSet>& used_transient_descriptor =
+          bindless_descriptor_indices_transient_descriptors_used_.front();
+      if (used_transient_descriptor.first > frame_completed_) {
+        break;
+      }
+      bindless_descriptor_indices_transient_descriptors_free_.push_back(
+          used_transient_descriptor.second);
+      bindless_descriptor_indices_transient_descriptors_used_.pop_front();
+    }
     while (!texture_transient_descriptor_sets_used_.empty()) {
       const UsedTextureTransientDescriptorSet& used_transient_descriptor_set =
           texture_transient_descriptor_sets_used_.front();
@@ -2911,6 +3697,26 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
+  if (is_swap && frame_open_) {
+    // May free sparse shared memory allocations, doing sparse binding - before
+    // creating the semaphore for it.
+    shared_memory_->EndFrame();
+
+    LiveStatistics live_statistics;
+    live_statistics.pipeline_created_count =
+        pipeline_cache_->created_pipeline_count();
+    live_statistics.texture_load_bytes =
+        texture_cache_->total_texture_load_byte_count();
+    live_statistics.pipeline_pending_count =
+        pipeline_cache_->GetPendingPipelineCount();
+    live_statistics.shared_memory_invalidation_count =
+        shared_memory_->last_frame_cpu_invalidation_count();
+    live_statistics.culled_draw_count = frame_culled_draw_count_;
+    PublishLiveStatistics(live_statistics);
+
+    PublishMemoryAllocationStatistics();
+  }
+
   // Make sure everything needed for submitting exist.
   if (submission_open_) {
     if (fences_free_.empty()) {
@@ -2983,6 +3789,8 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
 
     EndRenderPass();
 
+    pipeline_cache_->EndSubmission();
+
     render_target_cache_->EndSubmission();
 
     primitive_processor_->EndSubmission();
@@ -3063,7 +3871,39 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
       XELOGE("Failed to begin a Vulkan command buffer");
       return false;
     }
+    uint32_t timestamp_query_first, timestamp_query_count;
+    uint32_t timestamp_query_end = gpu_pass_timestamps_.EndSubmission(
+        timestamp_query_first, timestamp_query_count);
+    if (timestamp_query_end != UINT32_MAX) {
+      dfn.vkCmdResetQueryPool(command_buffer.buffer, timestamp_query_pool_,
+                              timestamp_query_first, timestamp_query_count);
+      dfn.vkCmdWriteTimestamp(command_buffer.buffer,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                              timestamp_query_pool_, timestamp_query_first);
+    }
+    // The host occlusion queries of the submission must be reset before being
+    // begun in it.
+    uint32_t occlusion_query_first;
+    uint32_t occlusion_query_count =
+        occlusion_query_tracker_.TakeSubmissionHostQueries(
+            occlusion_query_first);
+    while (occlusion_query_count) {
+      uint32_t occlusion_query_reset_count =
+          std::min(occlusion_query_count,
+                   OcclusionQueryTracker::kHostQueryCount -
+                       occlusion_query_first);
+      dfn.vkCmdResetQueryPool(command_buffer.buffer, occlusion_query_pool_,
+                              occlusion_query_first,
+                              occlusion_query_reset_count);
+      occlusion_query_first = 0;
+      occlusion_query_count -= occlusion_query_reset_count;
+    }
     deferred_command_buffer_.Execute(command_buffer.buffer);
+    if (timestamp_query_end != UINT32_MAX) {
+      dfn.vkCmdWriteTimestamp(command_buffer.buffer,
+                              VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                              timestamp_query_pool_, timestamp_query_end);
+    }
     if (dfn.vkEndCommandBuffer(command_buffer.buffer) != VK_SUCCESS) {
       XELOGE("Failed to end a Vulkan command buffer");
       return false;
@@ -3109,6 +3949,9 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
       return false;
     }
     uint64_t submission_current = GetCurrentSubmission();
+    if (benchmark_statistics_enabled_) {
+      ++benchmark_statistics_.submission_count;
+    }
     current_submission_wait_stage_masks_.clear();
     for (VkSemaphore semaphore : current_submission_wait_semaphores_) {
       submissions_in_flight_semaphores_.emplace_back(submission_current,
@@ -3122,6 +3965,7 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
     fences_free_.pop_back();
 
     submission_open_ = false;
+    ResetSubmissionScratchArena();
   }
 
   if (is_closing_frame) {
@@ -3166,6 +4010,28 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
   return true;
 }
 
+void VulkanCommandProcessor::PublishMemoryAllocationStatistics() {
+  const VkPhysicalDeviceMemoryProperties* memory_properties;
+  vmaGetMemoryProperties(vma_allocator_, &memory_properties);
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+  vmaGetHeapBudgets(vma_allocator_, budgets);
+  VmaStatistics total = {};
+  for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i) {
+    const VmaStatistics& heap_statistics = budgets[i].statistics;
+    total.blockCount += heap_statistics.blockCount;
+    total.allocationCount += heap_statistics.allocationCount;
+    total.blockBytes += heap_statistics.blockBytes;
+    total.allocationBytes += heap_statistics.allocationBytes;
+  }
+  vma_blocks_metric.Set(int64_t(total.blockCount));
+  vma_allocations_metric.Set(int64_t(total.allocationCount));
+  vma_block_bytes_metric.Set(int64_t(total.blockBytes));
+  vma_allocation_bytes_metric.Set(int64_t(total.allocationBytes));
+  vma_unused_bytes_metric.Set(
+      int64_t(total.blockBytes - std::min(total.allocationBytes,
+                                          total.blockBytes)));
+}
+
 void VulkanCommandProcessor::ClearTransientDescriptorPools() {
   texture_transient_descriptor_sets_free_.clear();
   texture_transient_descriptor_sets_used_.clear();
@@ -3173,6 +4039,8 @@ void VulkanCommandProcessor::ClearTransientDescriptorPools() {
 
   constants_transient_descriptors_free_.clear();
   constants_transient_descriptors_used_.clear();
+  bindless_descriptor_indices_transient_descriptors_free_.clear();
+  bindless_descriptor_indices_transient_descriptors_used_.clear();
   for (std::vector<VkDescriptorSet>& transient_descriptors_free :
        single_transient_descriptors_free_) {
     transient_descriptors_free.clear();
@@ -3223,7 +4091,8 @@ void VulkanCommandProcessor::DestroyScratchBuffer() {
 
 void VulkanCommandProcessor::UpdateDynamicState(
     const draw_util::ViewportInfo& viewport_info, bool primitive_polygonal,
-    reg::RB_DEPTHCONTROL normalized_depth_control) {
+    reg::RB_DEPTHCONTROL normalized_depth_control,
+    const VulkanPipelineCache::ExtendedDynamicState& extended_dynamic_state) {
 #if XE_UI_VULKAN_FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
 #endif  // XE_UI_VULKAN_FINE_GRAINED_DRAW_SCOPES
@@ -3442,7 +4311,79 @@ void VulkanCommandProcessor::UpdateDynamicState(
     }
   }
 
-  // TODO(Triang3l): VK_EXT_extended_dynamic_state and
+  // Culling and depth / stencil state, not a part of the pipelines with
+  // VK_EXT_extended_dynamic_state.
+  if (pipeline_cache_->IsExtendedDynamicStateUsed()) {
+    const VulkanPipelineCache::ExtendedDynamicState& new_state =
+        extended_dynamic_state;
+    VulkanPipelineCache::ExtendedDynamicState& old_state =
+        dynamic_extended_state_;
+    bool update_all = dynamic_extended_state_update_needed_;
+    if (update_all || old_state.cull_mode != new_state.cull_mode) {
+      deferred_command_buffer_.CmdVkSetCullModeEXT(new_state.cull_mode);
+    }
+    if (update_all || old_state.front_face != new_state.front_face) {
+      deferred_command_buffer_.CmdVkSetFrontFaceEXT(new_state.front_face);
+    }
+    if (update_all ||
+        old_state.depth_test_enable != new_state.depth_test_enable) {
+      deferred_command_buffer_.CmdVkSetDepthTestEnableEXT(
+          new_state.depth_test_enable);
+    }
+    if (update_all ||
+        old_state.depth_write_enable != new_state.depth_write_enable) {
+      deferred_command_buffer_.CmdVkSetDepthWriteEnableEXT(
+          new_state.depth_write_enable);
+    }
+    if (update_all ||
+        old_state.depth_compare_op != new_state.depth_compare_op) {
+      deferred_command_buffer_.CmdVkSetDepthCompareOpEXT(
+          new_state.depth_compare_op);
+    }
+    if (update_all ||
+        old_state.stencil_test_enable != new_state.stencil_test_enable) {
+      deferred_command_buffer_.CmdVkSetStencilTestEnableEXT(
+          new_state.stencil_test_enable);
+    }
+    auto stencil_ops_equal = [](const VkStencilOpState& a,
+                                const VkStencilOpState& b) {
+      return a.failOp == b.failOp && a.passOp == b.passOp &&
+             a.depthFailOp == b.depthFailOp && a.compareOp == b.compareOp;
+    };
+    bool stencil_front_update_needed =
+        update_all ||
+        !stencil_ops_equal(old_state.stencil_front, new_state.stencil_front);
+    bool stencil_back_update_needed =
+        update_all ||
+        !stencil_ops_equal(old_state.stencil_back, new_state.stencil_back);
+    if (stencil_front_update_needed || stencil_back_update_needed) {
+      if (stencil_ops_equal(new_state.stencil_front, new_state.stencil_back)) {
+        deferred_command_buffer_.CmdVkSetStencilOpEXT(
+            VK_STENCIL_FACE_FRONT_AND_BACK, new_state.stencil_front.failOp,
+            new_state.stencil_front.passOp, new_state.stencil_front.depthFailOp,
+            new_state.stencil_front.compareOp);
+      } else {
+        if (stencil_front_update_needed) {
+          deferred_command_buffer_.CmdVkSetStencilOpEXT(
+              VK_STENCIL_FACE_FRONT_BIT, new_state.stencil_front.failOp,
+              new_state.stencil_front.passOp,
+              new_state.stencil_front.depthFailOp,
+              new_state.stencil_front.compareOp);
+        }
+        if (stencil_back_update_needed) {
+          deferred_command_buffer_.CmdVkSetStencilOpEXT(
+              VK_STENCIL_FACE_BACK_BIT, new_state.stencil_back.failOp,
+              new_state.stencil_back.passOp, new_state.stencil_back.depthFailOp,
+              new_state.stencil_back.compareOp);
+        }
+      }
+    }
+    old_state = new_state;
+    dynamic_extended_state_update_needed_ = false;
+  }
+
+  // Primitive restart, rasterizer discard and depth bias enablement are still
+  // a part of the pipelines, they could be made dynamic with
   // VK_EXT_extended_dynamic_state2.
 }
 
@@ -3722,9 +4663,15 @@ void VulkanCommandProcessor::UpdateSystemConstantValues(
     }
   }
 
-  // Alpha test.
+  // Alpha test and, with FSI, alpha to coverage.
   dirty |= system_constants_.alpha_test_reference != rb_alpha_ref;
   system_constants_.alpha_test_reference = rb_alpha_ref;
+  uint32_t alpha_to_mask = edram_fragment_shader_interlock &&
+                                   rb_colorcontrol.alpha_to_mask_enable
+                               ? (rb_colorcontrol.value >> 24) | (1 << 8)
+                               : 0;
+  dirty |= system_constants_.alpha_to_mask != alpha_to_mask;
+  system_constants_.alpha_to_mask = alpha_to_mask;
 
   uint32_t edram_tile_dwords_scaled =
       xenos::kEdramTileWidthSamples * xenos::kEdramTileHeightSamples *
@@ -4131,10 +5078,148 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
     sampler_count_pixel = 0;
     texture_count_pixel = 0;
   }
-  // TODO(Triang3l): Reuse texture and sampler bindings if not changed.
-  current_graphics_descriptor_set_values_up_to_date_ &=
-      ~((UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex) |
-        (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel));
+  bool bindless_descriptors_needed =
+      bindless_resources_used_ &&
+      (texture_count_vertex || sampler_count_vertex || texture_count_pixel ||
+       sampler_count_pixel);
+  if (bindless_descriptors_needed) {
+    // The descriptor arrays are persistent, only the indices in them need to
+    // be updated if the bindings have changed.
+    current_graphics_descriptor_sets_
+        [SpirvShaderTranslator::kDescriptorSetBindlessResources] =
+            bindless_resources_descriptor_set_;
+    current_graphics_descriptor_set_values_up_to_date_ |=
+        UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetBindlessResources;
+    for (uint32_t i = 0;
+         i < SpirvShaderTranslator::kBindlessDescriptorIndicesBindingCount;
+         ++i) {
+      bool is_vertex =
+          i == SpirvShaderTranslator::kBindlessDescriptorIndicesBindingVertex;
+      const std::vector<VulkanShader::TextureBinding>* shader_textures =
+          is_vertex ? &textures_vertex : textures_pixel;
+      const std::vector<VulkanShader::SamplerBinding>* shader_samplers =
+          is_vertex ? &samplers_vertex : samplers_pixel;
+      const std::vector<uint32_t>& shader_sampler_bindless_indices =
+          is_vertex ? current_sampler_bindless_indices_vertex_
+                    : current_sampler_bindless_indices_pixel_;
+      uint32_t shader_texture_count =
+          is_vertex ? texture_count_vertex : texture_count_pixel;
+      uint32_t shader_sampler_count =
+          is_vertex ? sampler_count_vertex : sampler_count_pixel;
+      std::vector<uint32_t>& descriptor_indices =
+          current_bindless_descriptor_indices_[i];
+      size_t descriptor_index_count =
+          size_t(shader_texture_count) + shader_sampler_count;
+      bool descriptor_indices_changed =
+          descriptor_indices.size() != descriptor_index_count;
+      descriptor_indices.resize(descriptor_index_count, 0);
+      for (uint32_t j = 0; j < shader_texture_count; ++j) {
+        const VulkanShader::TextureBinding& texture_binding =
+            (*shader_textures)[j];
+        uint32_t descriptor_index =
+            texture_cache_->GetActiveBindingOrNullImageViewBindlessIndex(
+                texture_binding.fetch_constant, texture_binding.dimension,
+                bool(texture_binding.is_signed));
+        uint32_t& descriptor_index_ref =
+            descriptor_indices[texture_binding.bindless_descriptor_index];
+        descriptor_indices_changed |= descriptor_index_ref != descriptor_index;
+        descriptor_index_ref = descriptor_index;
+      }
+      assert_true(shader_sampler_bindless_indices.size() ==
+                  shader_sampler_count);
+      for (uint32_t j = 0; j < shader_sampler_count; ++j) {
+        uint32_t descriptor_index = shader_sampler_bindless_indices[j];
+        uint32_t& descriptor_index_ref =
+            descriptor_indices[(*shader_samplers)[j]
+                                   .bindless_descriptor_index];
+        descriptor_indices_changed |= descriptor_index_ref != descriptor_index;
+        descriptor_index_ref = descriptor_index;
+      }
+      if (!descriptor_indices_changed &&
+          (current_bindless_descriptor_indices_up_to_date_ &
+           (UINT32_C(1) << i))) {
+        continue;
+      }
+      // A buffer must be bound even if the shader has no bindings. Inside the
+      // buffer, the indices are packed as uint4 in the std140 layout.
+      size_t descriptor_indices_size =
+          sizeof(uint32_t) *
+          std::max(xe::align(descriptor_index_count, size_t(4)), size_t(4));
+      VkDescriptorBufferInfo& buffer_info =
+          current_bindless_descriptor_indices_buffer_infos_[i];
+      uint8_t* mapping = uniform_buffer_pool_->Request(
+          frame_current_, descriptor_indices_size,
+          size_t(provider.device_properties()
+                     .limits.minUniformBufferOffsetAlignment),
+          buffer_info.buffer, buffer_info.offset);
+      if (!mapping) {
+        return false;
+      }
+      buffer_info.range = VkDeviceSize(descriptor_indices_size);
+      std::memset(mapping, 0, descriptor_indices_size);
+      if (descriptor_index_count) {
+        std::memcpy(mapping, descriptor_indices.data(),
+                    sizeof(uint32_t) * descriptor_index_count);
+      }
+      current_bindless_descriptor_indices_up_to_date_ |= UINT32_C(1) << i;
+      current_graphics_descriptor_set_values_up_to_date_ &= ~(
+          UINT32_C(1)
+          << SpirvShaderTranslator::kDescriptorSetBindlessDescriptorIndices);
+    }
+  } else if (!bindless_resources_used_) {
+    // Reuse the texture descriptor sets written previously in the frame if the
+    // bindings in them are the same.
+    for (uint32_t i = 0; i < 2; ++i) {
+      bool is_vertex = !i;
+      const std::vector<VulkanShader::TextureBinding>* shader_textures =
+          is_vertex ? &textures_vertex : textures_pixel;
+      const std::vector<
+          std::pair<VulkanTextureCache::SamplerParameters, VkSampler>>&
+          shader_samplers =
+              is_vertex ? current_samplers_vertex_ : current_samplers_pixel_;
+      uint32_t shader_texture_count =
+          is_vertex ? texture_count_vertex : texture_count_pixel;
+      uint32_t shader_sampler_count =
+          is_vertex ? sampler_count_vertex : sampler_count_pixel;
+      uint32_t descriptor_set_index =
+          is_vertex ? SpirvShaderTranslator::kDescriptorSetTexturesVertex
+                    : SpirvShaderTranslator::kDescriptorSetTexturesPixel;
+      VkDescriptorSetLayout descriptor_set_layout =
+          is_vertex ? current_guest_graphics_pipeline_layout_
+                          ->descriptor_set_layout_textures_vertex_ref()
+                    : current_guest_graphics_pipeline_layout_
+                          ->descriptor_set_layout_textures_pixel_ref();
+      TextureDescriptorSetBindings& bindings =
+          current_texture_descriptor_set_bindings_[i];
+      bool bindings_changed =
+          bindings.descriptor_set_layout != descriptor_set_layout ||
+          bindings.image_views.size() != shader_texture_count ||
+          bindings.samplers.size() != shader_sampler_count;
+      bindings.descriptor_set_layout = descriptor_set_layout;
+      bindings.image_views.resize(shader_texture_count, VK_NULL_HANDLE);
+      for (uint32_t j = 0; j < shader_texture_count; ++j) {
+        const VulkanShader::TextureBinding& texture_binding =
+            (*shader_textures)[j];
+        VkImageView image_view =
+            texture_cache_->GetActiveBindingOrNullImageView(
+                texture_binding.fetch_constant, texture_binding.dimension,
+                bool(texture_binding.is_signed));
+        bindings_changed |= bindings.image_views[j] != image_view;
+        bindings.image_views[j] = image_view;
+      }
+      assert_true(shader_samplers.size() == shader_sampler_count);
+      bindings.samplers.resize(shader_sampler_count, VK_NULL_HANDLE);
+      for (uint32_t j = 0; j < shader_sampler_count; ++j) {
+        VkSampler sampler = shader_samplers[j].second;
+        bindings_changed |= bindings.samplers[j] != sampler;
+        bindings.samplers[j] = sampler;
+      }
+      if (bindings_changed) {
+        current_graphics_descriptor_set_values_up_to_date_ &=
+            ~(UINT32_C(1) << descriptor_set_index);
+      }
+    }
+  }
 
   // Make sure new descriptor sets are bound to the command buffer.
 
@@ -4144,10 +5229,12 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
   // Fill the texture and sampler write image infos.
 
   bool write_vertex_textures =
+      !bindless_resources_used_ &&
       (texture_count_vertex || sampler_count_vertex) &&
       !(current_graphics_descriptor_set_values_up_to_date_ &
         (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex));
   bool write_pixel_textures =
+      !bindless_resources_used_ &&
       (texture_count_pixel || sampler_count_pixel) &&
       !(current_graphics_descriptor_set_values_up_to_date_ &
         (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel));
@@ -4158,48 +5245,42 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
       (write_pixel_textures ? texture_count_pixel + sampler_count_pixel : 0));
   size_t vertex_texture_image_info_offset = descriptor_write_image_info_.size();
   if (write_vertex_textures && texture_count_vertex) {
-    for (const VulkanShader::TextureBinding& texture_binding :
-         textures_vertex) {
+    for (VkImageView image_view :
+         current_texture_descriptor_set_bindings_[0].image_views) {
       VkDescriptorImageInfo& descriptor_image_info =
           descriptor_write_image_info_.emplace_back();
-      descriptor_image_info.imageView =
-          texture_cache_->GetActiveBindingOrNullImageView(
-              texture_binding.fetch_constant, texture_binding.dimension,
-              bool(texture_binding.is_signed));
+      descriptor_image_info.imageView = image_view;
       descriptor_image_info.imageLayout =
           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     }
   }
   size_t vertex_sampler_image_info_offset = descriptor_write_image_info_.size();
   if (write_vertex_textures && sampler_count_vertex) {
-    for (const std::pair<VulkanTextureCache::SamplerParameters, VkSampler>&
-             sampler_pair : current_samplers_vertex_) {
+    for (VkSampler sampler :
+         current_texture_descriptor_set_bindings_[0].samplers) {
       VkDescriptorImageInfo& descriptor_image_info =
           descriptor_write_image_info_.emplace_back();
-      descriptor_image_info.sampler = sampler_pair.second;
+      descriptor_image_info.sampler = sampler;
     }
   }
   size_t pixel_texture_image_info_offset = descriptor_write_image_info_.size();
   if (write_pixel_textures && texture_count_pixel) {
-    for (const VulkanShader::TextureBinding& texture_binding :
-         *textures_pixel) {
+    for (VkImageView image_view :
+         current_texture_descriptor_set_bindings_[1].image_views) {
       VkDescriptorImageInfo& descriptor_image_info =
           descriptor_write_image_info_.emplace_back();
-      descriptor_image_info.imageView =
-          texture_cache_->GetActiveBindingOrNullImageView(
-              texture_binding.fetch_constant, texture_binding.dimension,
-              bool(texture_binding.is_signed));
+      descriptor_image_info.imageView = image_view;
       descriptor_image_info.imageLayout =
           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     }
   }
   size_t pixel_sampler_image_info_offset = descriptor_write_image_info_.size();
   if (write_pixel_textures && sampler_count_pixel) {
-    for (const std::pair<VulkanTextureCache::SamplerParameters, VkSampler>&
-             sampler_pair : current_samplers_pixel_) {
+    for (VkSampler sampler :
+         current_texture_descriptor_set_bindings_[1].samplers) {
       VkDescriptorImageInfo& descriptor_image_info =
           descriptor_write_image_info_.emplace_back();
-      descriptor_image_info.sampler = sampler_pair.second;
+      descriptor_image_info.sampler = sampler;
     }
   }
 
@@ -4218,8 +5299,28 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
       (UINT32_C(1)
        << SpirvShaderTranslator::kDescriptorSetSharedMemoryAndEdram));
   // Constant buffers.
-  if (!(current_graphics_descriptor_set_values_up_to_date_ &
-        (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetConstants))) {
+  if (constants_push_descriptors_used_) {
+    // Pushed to the command buffer directly when changed, and also after
+    // switching to an incompatible pipeline layout, which disturbs them.
+    constexpr uint32_t kConstantsDescriptorSetBit =
+        UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetConstants;
+    if (!(current_graphics_descriptor_set_values_up_to_date_ &
+          current_graphics_descriptor_sets_bound_up_to_date_ &
+          kConstantsDescriptorSetBit)) {
+      deferred_command_buffer_.CmdVkPushUniformBufferDescriptorsKHR(
+          VK_PIPELINE_BIND_POINT_GRAPHICS,
+          current_guest_graphics_pipeline_layout_->GetPipelineLayout(),
+          SpirvShaderTranslator::kDescriptorSetConstants, 0,
+          SpirvShaderTranslator::kConstantBufferCount,
+          current_constant_buffer_infos_);
+      current_graphics_descriptor_set_values_up_to_date_ |=
+          kConstantsDescriptorSetBit;
+      current_graphics_descriptor_sets_bound_up_to_date_ |=
+          kConstantsDescriptorSetBit;
+    }
+  } else if (!(current_graphics_descriptor_set_values_up_to_date_ &
+               (UINT32_C(1)
+                << SpirvShaderTranslator::kDescriptorSetConstants))) {
     VkDescriptorSet constants_descriptor_set;
     if (!constants_transient_descriptors_free_.empty()) {
       constants_descriptor_set = constants_transient_descriptors_free_.back();
@@ -4260,6 +5361,56 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
         [SpirvShaderTranslator::kDescriptorSetConstants] =
             constants_descriptor_set;
   }
+  // Bindless descriptor indices.
+  if (bindless_descriptors_needed &&
+      !(current_graphics_descriptor_set_values_up_to_date_ &
+        (UINT32_C(1)
+         << SpirvShaderTranslator::kDescriptorSetBindlessDescriptorIndices))) {
+    VkDescriptorSet indices_descriptor_set;
+    if (!bindless_descriptor_indices_transient_descriptors_free_.empty()) {
+      indices_descriptor_set =
+          bindless_descriptor_indices_transient_descriptors_free_.back();
+      bindless_descriptor_indices_transient_descriptors_free_.pop_back();
+    } else {
+      VkDescriptorPoolSize indices_descriptor_count;
+      indices_descriptor_count.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      indices_descriptor_count.descriptorCount =
+          SpirvShaderTranslator::kBindlessDescriptorIndicesBindingCount;
+      indices_descriptor_set =
+          transient_descriptor_allocator_uniform_buffer_.Allocate(
+              descriptor_set_layout_bindless_descriptor_indices_,
+              &indices_descriptor_count, 1);
+      if (indices_descriptor_set == VK_NULL_HANDLE) {
+        return false;
+      }
+    }
+    bindless_descriptor_indices_transient_descriptors_used_.emplace_back(
+        frame_current_, indices_descriptor_set);
+    // The stage flags of the bindings are different.
+    for (uint32_t i = 0;
+         i < SpirvShaderTranslator::kBindlessDescriptorIndicesBindingCount;
+         ++i) {
+      VkWriteDescriptorSet& write_indices =
+          write_descriptor_sets[write_descriptor_set_count++];
+      write_indices.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write_indices.pNext = nullptr;
+      write_indices.dstSet = indices_descriptor_set;
+      write_indices.dstBinding = i;
+      write_indices.dstArrayElement = 0;
+      write_indices.descriptorCount = 1;
+      write_indices.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      write_indices.pImageInfo = nullptr;
+      write_indices.pBufferInfo =
+          &current_bindless_descriptor_indices_buffer_infos_[i];
+      write_indices.pTexelBufferView = nullptr;
+    }
+    write_descriptor_set_bits |=
+        UINT32_C(1)
+        << SpirvShaderTranslator::kDescriptorSetBindlessDescriptorIndices;
+    current_graphics_descriptor_sets_
+        [SpirvShaderTranslator::kDescriptorSetBindlessDescriptorIndices] =
+            indices_descriptor_set;
+  }
   // Vertex shader textures and samplers.
   if (write_vertex_textures) {
     VkWriteDescriptorSet* write_textures =
@@ -4315,13 +5466,27 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
   // Bind the new descriptor sets.
   uint32_t descriptor_sets_needed =
       (UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetCount) - 1;
-  if (!texture_count_vertex && !sampler_count_vertex) {
+  if (constants_push_descriptors_used_) {
     descriptor_sets_needed &=
-        ~(UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex);
+        ~(UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetConstants);
   }
-  if (!texture_count_pixel && !sampler_count_pixel) {
-    descriptor_sets_needed &=
-        ~(UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel);
+  if (bindless_resources_used_) {
+    if (!bindless_descriptors_needed) {
+      descriptor_sets_needed &= ~(
+          (UINT32_C(1)
+           << SpirvShaderTranslator::kDescriptorSetBindlessResources) |
+          (UINT32_C(1)
+           << SpirvShaderTranslator::kDescriptorSetBindlessDescriptorIndices));
+    }
+  } else {
+    if (!texture_count_vertex && !sampler_count_vertex) {
+      descriptor_sets_needed &= ~(
+          UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesVertex);
+    }
+    if (!texture_count_pixel && !sampler_count_pixel) {
+      descriptor_sets_needed &= ~(
+          UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel);
+    }
   }
   uint32_t descriptor_sets_remaining =
       descriptor_sets_needed &
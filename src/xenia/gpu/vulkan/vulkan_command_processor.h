@@ -25,6 +25,8 @@
 #include "xenia/base/hash.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/draw_util.h"
+#include "xenia/gpu/gpu_pass_timestamps.h"
+#include "xenia/gpu/occlusion_query_tracker.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/gpu/vulkan/deferred_command_buffer.h"
@@ -38,6 +40,7 @@
 #include "xenia/gpu/xenos.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/ui/vulkan/linked_type_descriptor_set_allocator.h"
+#include "xenia/ui/vulkan/vulkan_mem_alloc.h"
 #include "xenia/ui/vulkan/vulkan_presenter.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 #include "xenia/ui/vulkan/vulkan_upload_buffer_pool.h"
@@ -143,6 +146,12 @@ class VulkanCommandProcessor final : public CommandProcessor {
 
   void ClearCaches() override;
 
+  void BeginBenchmarkStatistics() override;
+  BenchmarkStatistics EndBenchmarkStatistics() override;
+
+  void InitializeShaderStorage(const std::filesystem::path& cache_root,
+                               uint32_t title_id, bool blocking) override;
+
   void TracePlaybackWroteMemory(uint32_t base_ptr, uint32_t length) override;
 
   void RestoreEdramSnapshot(const void* snapshot) override;
@@ -152,6 +161,17 @@ class VulkanCommandProcessor final : public CommandProcessor {
         graphics_system_->provider());
   }
 
+  // Shared by the render target and the texture caches so their images are
+  // suballocated from the same device memory blocks. Externally synchronized,
+  // used only by the command processor thread.
+  VmaAllocator vma_allocator() const { return vma_allocator_; }
+
+  // Must be called only after the pipeline cache has awaited the completion
+  // of the creation of the pipelines used in the submission.
+  VkPipeline GetVulkanPipelineByHandle(const void* handle) const {
+    return pipeline_cache_->GetVulkanPipelineByHandle(handle);
+  }
+
   // Returns the deferred drawing command list for the currently open
   // submission.
   DeferredCommandBuffer& deferred_command_buffer() {
@@ -202,6 +222,10 @@ class VulkanCommandProcessor final : public CommandProcessor {
   // render pass will also be closed.
   bool SubmitBarriers(bool force_end_render_pass);
 
+  // Changes the category the GPU time of the following commands is attributed
+  // to if timing the passes, returning the previous one. Use GpuPassScope.
+  GpuPass SwitchGpuPass(GpuPass pass);
+
   // If not started yet, begins a render pass from the render target cache.
   // Submission must be open.
   void SubmitBarriersAndEnterRenderTargetCacheRenderPass(
@@ -231,6 +255,22 @@ class VulkanCommandProcessor final : public CommandProcessor {
       size_t size, SingleTransientDescriptorLayout transient_descriptor_layout,
       VkDescriptorSet& descriptor_set_out);
 
+  // Whether textures and samplers are accessed by guest shaders through
+  // indices in persistent descriptor arrays (with VK_EXT_descriptor_indexing)
+  // instead of per-draw descriptor sets.
+  bool bindless_resources_used() const { return bindless_resources_used_; }
+  // Writes the descriptor to a free slot in the persistent array for the
+  // binding, returning the index of the slot, or UINT32_MAX if the array is
+  // full. The descriptor must not be accessed by the GPU anymore by the time
+  // the slot is released.
+  uint32_t AllocateBindlessImageDescriptor(
+      SpirvShaderTranslator::BindlessResourceBinding binding,
+      VkImageView image_view);
+  uint32_t AllocateBindlessSamplerDescriptor(VkSampler sampler);
+  void ReleaseBindlessDescriptor(
+      SpirvShaderTranslator::BindlessResourceBinding binding,
+      uint32_t descriptor_index);
+
   // The returned reference is valid until a cache clear.
   VkDescriptorSetLayout GetTextureDescriptorSetLayout(bool is_vertex,
                                                       size_t texture_count,
@@ -272,6 +312,12 @@ class VulkanCommandProcessor final : public CommandProcessor {
   XE_FORCEINLINE
   virtual void WriteRegistersFromMem(uint32_t start_index, uint32_t* base,
                                      uint32_t num_registers) override;
+  // For registers from XE_GPU_REG_SHADER_CONSTANT_000_X to
+  // XE_GPU_REG_SHADER_CONSTANT_LOOP_31, which have no side effects other than
+  // invalidation, compares the whole range with the current values and
+  // invalidates the affected bindings once, then copies it in bulk.
+  void WriteShaderConstantsFromMem(uint32_t start_index, const uint32_t* base,
+                                   uint32_t num_registers);
 
   void OnGammaRamp256EntryTableValueWritten() override;
   void OnGammaRampPWLValueWritten() override;
@@ -287,6 +333,9 @@ class VulkanCommandProcessor final : public CommandProcessor {
                  IndexBufferInfo* index_buffer_info,
                  bool major_mode_explicit) override;
   bool IssueCopy() override;
+  void BeginOcclusionQuery() override;
+  uint32_t EndOcclusionQuery(uint32_t sample_counts_address,
+                             uint32_t fallback_sample_count) override;
 
   void InitializeTrace() override;
 
@@ -421,6 +470,19 @@ class VulkanCommandProcessor final : public CommandProcessor {
   // the submission to await to simply check status, or pass
   // GetCurrentSubmission() to wait for all queue operations to be completed.
   void CheckSubmissionFenceAndDeviceLoss(uint64_t await_submission);
+  // Creates the timestamp query pool if not created yet, returns whether
+  // timestamps can be written.
+  bool InitializeTimestampQueries();
+  // Creates the occlusion query pool, returns whether host occlusion queries
+  // are available.
+  bool InitializeOcclusionQueries();
+  // Begins a host occlusion query before a guest draw, in the render pass, if
+  // a guest occlusion query is active and the host query hasn't been begun
+  // yet.
+  void BeginOcclusionHostQuery();
+  // Ends the host occlusion query, if active, before leaving the render pass
+  // or commands that must not be counted in the guest occlusion query.
+  void EndOcclusionHostQuery();
   // If is_guest_command is true, a new full frame - with full cleanup of
   // resources and, if needed, starting capturing - is opened if pending (as
   // opposed to simply resuming after mid-frame synchronization). Returns
@@ -437,13 +499,18 @@ class VulkanCommandProcessor final : public CommandProcessor {
 
   void ClearTransientDescriptorPools();
 
+  // Exports the statistics of the VMA device memory blocks and suballocations
+  // of all heaps, at the end of a frame.
+  void PublishMemoryAllocationStatistics();
+
   void SplitPendingBarrier();
 
   void DestroyScratchBuffer();
 
-  void UpdateDynamicState(const draw_util::ViewportInfo& viewport_info,
-                          bool primitive_polygonal,
-                          reg::RB_DEPTHCONTROL normalized_depth_control);
+  void UpdateDynamicState(
+      const draw_util::ViewportInfo& viewport_info, bool primitive_polygonal,
+      reg::RB_DEPTHCONTROL normalized_depth_control,
+      const VulkanPipelineCache::ExtendedDynamicState& extended_dynamic_state);
   void UpdateSystemConstantValues(
       bool primitive_polygonal,
       const PrimitiveProcessor::ProcessingResult& primitive_processing_result,
@@ -467,10 +534,20 @@ class VulkanCommandProcessor final : public CommandProcessor {
       const VkDescriptorImageInfo* sampler_image_info,
       VkWriteDescriptorSet* descriptor_set_writes_out);
 
+  uint32_t AllocateBindlessDescriptor(
+      SpirvShaderTranslator::BindlessResourceBinding binding,
+      const VkDescriptorImageInfo& image_info);
+
   bool device_lost_ = false;
 
   bool cache_clear_requested_ = false;
 
+  bool bindless_resources_used_ = false;
+
+  // Whether the guest draw constant buffers are bound via
+  // VK_KHR_push_descriptor instead of transient descriptor sets.
+  bool constants_push_descriptors_used_ = false;
+
   // Host shader types that guest shaders can be translated into - they can
   // access the shared memory (via vertex fetch, memory export, or manual index
   // buffer reading) and textures.
@@ -490,6 +567,7 @@ class VulkanCommandProcessor final : public CommandProcessor {
   std::deque<std::pair<uint64_t, VkSemaphore>>
       submissions_in_flight_semaphores_;
 
+  // The size of the per-frame resource rings.
   static constexpr uint32_t kMaxFramesInFlight = 3;
   bool frame_open_ = false;
   // Guest frame index, since some transient resources can be reused across
@@ -498,6 +576,9 @@ class VulkanCommandProcessor final : public CommandProcessor {
   uint64_t frame_completed_ = 0;
   // Submission indices of frames that have already been submitted.
   uint64_t closed_frame_submissions_[kMaxFramesInFlight] = {};
+  // Guest frames that may be not completed on the GPU when opening a new one,
+  // up to kMaxFramesInFlight.
+  uint32_t frames_in_flight_ = kMaxFramesInFlight;
 
   // <Submission where last used, resource>, sorted by the submission number.
   std::deque<std::pair<uint64_t, VkDeviceMemory>> destroy_memory_;
@@ -508,6 +589,17 @@ class VulkanCommandProcessor final : public CommandProcessor {
   std::deque<std::pair<uint64_t, CommandBuffer>> command_buffers_submitted_;
   DeferredCommandBuffer deferred_command_buffer_;
 
+  // Timestamps for measuring the GPU time of the submissions for benchmarking
+  // and of the passes in them, created on demand.
+  GpuPassTimestamps gpu_pass_timestamps_;
+  VkQueryPool timestamp_query_pool_ = VK_NULL_HANDLE;
+
+  // Host occlusion queries for the guest ones, the pool is null if they're not
+  // used.
+  OcclusionQueryTracker occlusion_query_tracker_;
+  VkQueryPool occlusion_query_pool_ = VK_NULL_HANDLE;
+  VkQueryControlFlags occlusion_query_control_flags_ = 0;
+
   std::vector<VkSparseMemoryBind> sparse_memory_binds_;
   std::vector<SparseBufferBind> sparse_buffer_binds_;
   // SparseBufferBind converted to VkSparseBufferMemoryBindInfo to this buffer
@@ -574,6 +666,8 @@ class VulkanCommandProcessor final : public CommandProcessor {
 
   std::unique_ptr<VulkanPrimitiveProcessor> primitive_processor_;
 
+  VmaAllocator vma_allocator_ = VK_NULL_HANDLE;
+
   std::unique_ptr<VulkanRenderTargetCache> render_target_cache_;
 
   std::unique_ptr<VulkanPipelineCache> pipeline_cache_;
@@ -583,6 +677,31 @@ class VulkanCommandProcessor final : public CommandProcessor {
   VkDescriptorPool shared_memory_and_edram_descriptor_pool_ = VK_NULL_HANDLE;
   VkDescriptorSet shared_memory_and_edram_descriptor_set_;
 
+  // Bindless resources - persistent arrays of image and sampler descriptors,
+  // written when the images and the samplers are created, and updated after
+  // binding, so the set itself is bound once and never changes.
+  VkDescriptorSetLayout descriptor_set_layout_bindless_resources_ =
+      VK_NULL_HANDLE;
+  // Uniform buffers with the indices in the arrays for the vertex and the
+  // pixel shader.
+  VkDescriptorSetLayout descriptor_set_layout_bindless_descriptor_indices_ =
+      VK_NULL_HANDLE;
+  VkDescriptorPool bindless_resources_descriptor_pool_ = VK_NULL_HANDLE;
+  VkDescriptorSet bindless_resources_descriptor_set_ = VK_NULL_HANDLE;
+  struct BindlessDescriptorArray {
+    // Slots [0, allocated_count) have been used at least once.
+    uint32_t allocated_count = 0;
+    std::vector<uint32_t> free_slots;
+  };
+  std::array<BindlessDescriptorArray,
+             SpirvShaderTranslator::kBindlessResourceBindingCount>
+      bindless_descriptor_arrays_;
+  // <Usage frame, set>.
+  std::deque<std::pair<uint64_t, VkDescriptorSet>>
+      bindless_descriptor_indices_transient_descriptors_used_;
+  std::vector<VkDescriptorSet>
+      bindless_descriptor_indices_transient_descriptors_free_;
+
   // Bytes 0x0...0x3FF - 256-entry gamma ramp table with B10G10R10X2 data (read
   // as R10G10B10X2 with swizzle).
   // Bytes 0x400...0x9FF - 128-entry PWL R16G16 gamma ramp (R - base, G - delta,
@@ -688,12 +807,44 @@ class VulkanCommandProcessor final : public CommandProcessor {
   bool dynamic_stencil_write_mask_back_update_needed_;
   bool dynamic_stencil_reference_front_update_needed_;
   bool dynamic_stencil_reference_back_update_needed_;
+  // Culling and depth / stencil state with VK_EXT_extended_dynamic_state, for
+  // the guest pipelines. External pipelines don't have it dynamic, so binding
+  // them resets it.
+  VulkanPipelineCache::ExtendedDynamicState dynamic_extended_state_;
+  bool dynamic_extended_state_update_needed_;
 
   // Currently used samplers.
   std::vector<std::pair<VulkanTextureCache::SamplerParameters, VkSampler>>
       current_samplers_vertex_;
   std::vector<std::pair<VulkanTextureCache::SamplerParameters, VkSampler>>
       current_samplers_pixel_;
+  // Without bindless resources, the image views and the samplers written to
+  // the current texture descriptor sets for the vertex and the pixel shader,
+  // for reusing the sets within the frame while the bindings are the same.
+  struct TextureDescriptorSetBindings {
+    VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+    std::vector<VkImageView> image_views;
+    std::vector<VkSampler> samplers;
+  };
+  std::array<TextureDescriptorSetBindings, 2>
+      current_texture_descriptor_set_bindings_;
+  // Indices of current_samplers_vertex_ and current_samplers_pixel_ in the
+  // bindless sampler array.
+  std::vector<uint32_t> current_sampler_bindless_indices_vertex_;
+  std::vector<uint32_t> current_sampler_bindless_indices_pixel_;
+
+  // Descriptor indices of the last draw with bindless resources, and the
+  // uniform buffers containing them, for the vertex and the pixel shader.
+  std::array<std::vector<uint32_t>,
+             SpirvShaderTranslator::kBindlessDescriptorIndicesBindingCount>
+      current_bindless_descriptor_indices_;
+  std::array<VkDescriptorBufferInfo,
+             SpirvShaderTranslator::kBindlessDescriptorIndicesBindingCount>
+      current_bindless_descriptor_indices_buffer_infos_;
+  // Whether the buffers in current_bindless_descriptor_indices_buffer_infos_
+  // contain current_bindless_descriptor_indices_ and are usable in the current
+  // frame.
+  uint32_t current_bindless_descriptor_indices_up_to_date_;
 
   // Cache render pass currently started in the command buffer with the
   // framebuffer.
@@ -703,9 +854,8 @@ class VulkanCommandProcessor final : public CommandProcessor {
   // Currently bound graphics pipeline, either from the pipeline cache (with
   // potentially deferred creation - current_external_graphics_pipeline_ is
   // VK_NULL_HANDLE in this case) or a non-Xenos one
-  // (current_guest_graphics_pipeline_ is VK_NULL_HANDLE in this case).
-  // TODO(Triang3l): Change to a deferred compilation handle.
-  VkPipeline current_guest_graphics_pipeline_;
+  // (current_guest_graphics_pipeline_ is nullptr in this case).
+  const void* current_guest_graphics_pipeline_;
   VkPipeline current_external_graphics_pipeline_;
   VkPipeline current_external_compute_pipeline_;
 
@@ -30,11 +30,17 @@ std::string VulkanGraphicsSystem::name() const {
   return "Vulkan - HEAVILY INCOMPLETE, early development";
 }
 
+void VulkanGraphicsSystem::CreateProvider(bool is_surface_required) {
+  provider_ = xe::ui::vulkan::VulkanProvider::Create(is_surface_required);
+}
+
 X_STATUS VulkanGraphicsSystem::Setup(cpu::Processor* processor,
                                      kernel::KernelState* kernel_state,
                                      ui::WindowedAppContext* app_context,
                                      bool is_surface_required) {
-  provider_ = xe::ui::vulkan::VulkanProvider::Create(is_surface_required);
+  if (!provider_) {
+    CreateProvider(is_surface_required);
+  }
   return GraphicsSystem::Setup(processor, kernel_state, app_context,
                                is_surface_required);
 }
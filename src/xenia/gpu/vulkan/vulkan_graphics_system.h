@@ -28,6 +28,7 @@ class VulkanGraphicsSystem : public GraphicsSystem {
 
   std::string name() const override;
 
+  void CreateProvider(bool is_surface_required) override;
   X_STATUS Setup(cpu::Processor* processor, kernel::KernelState* kernel_state,
                  ui::WindowedAppContext* app_context,
                  bool is_surface_required) override;
@@ -11,14 +11,20 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <set>
 #include <utility>
 #include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/device_profile.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -34,6 +40,42 @@
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_int32(
+    vulkan_pipeline_creation_threads, -1,
+    "Number of threads used for graphics pipeline creation. -1 to calculate "
+    "automatically (75% of logical CPU cores), a positive number to specify "
+    "the number of threads explicitly (up to the number of logical CPU cores), "
+    "0 to disable multithreaded pipeline creation.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_skip_draws_until_pipeline_created, false,
+    "With multithreaded pipeline creation, skip draws using pipelines that are "
+    "still being created instead of waiting for them at the end of the "
+    "submission. Removes stuttering when new shaders or states are "
+    "encountered, at the cost of objects missing for some frames.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_graphics_pipeline_library, true,
+    "Use VK_EXT_graphics_pipeline_library if available to create graphics "
+    "pipelines by linking parts shared between pipelines (vertex shader and "
+    "rasterization state, pixel shader and depth / stencil state, blending) "
+    "instead of compiling every combination fully.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_extended_dynamic_state, true,
+    "Use VK_EXT_extended_dynamic_state if available to set culling and depth / "
+    "stencil state dynamically instead of creating separate pipelines for "
+    "them.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_spirv_optimization, false,
+    "Optimize the translated shaders with spirv-opt from SPIRV-Tools of the "
+    "Vulkan SDK in the background, after the unoptimized versions are "
+    "already used for drawing, and recreate the pipelines with them. The "
+    "optimized shaders are stored locally, so they're used from the "
+    "beginning next time.",
+    "Vulkan");
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
@@ -58,11 +100,35 @@ bool VulkanPipelineCache::Initialize() {
       render_target_cache_.GetPath() ==
       RenderTargetCache::Path::kPixelShaderInterlock;
 
+  graphics_pipeline_library_used_ =
+      cvars::vulkan_graphics_pipeline_library &&
+      provider.device_extensions().ext_graphics_pipeline_library &&
+      provider.device_graphics_pipeline_library_features()
+          .graphicsPipelineLibrary;
+  if (graphics_pipeline_library_used_) {
+    XELOGGPU(
+        "VulkanPipelineCache: Linking graphics pipelines from pipeline "
+        "libraries");
+  }
+
+  // Only the host render target path uses the fixed-function depth / stencil.
+  extended_dynamic_state_used_ =
+      cvars::vulkan_extended_dynamic_state &&
+      !edram_fragment_shader_interlock &&
+      provider.device_extensions().ext_extended_dynamic_state &&
+      provider.device_extended_dynamic_state_features().extendedDynamicState;
+  if (extended_dynamic_state_used_) {
+    XELOGGPU(
+        "VulkanPipelineCache: Setting culling and depth / stencil state "
+        "dynamically");
+  }
+
   shader_translator_ = std::make_unique<SpirvShaderTranslator>(
       SpirvShaderTranslator::Features(provider),
       render_target_cache_.msaa_2x_attachments_supported(),
       render_target_cache_.msaa_2x_no_attachments_supported(),
-      edram_fragment_shader_interlock);
+      edram_fragment_shader_interlock,
+      command_processor_.bindless_resources_used());
 
   if (edram_fragment_shader_interlock) {
     std::vector<uint8_t> depth_only_fragment_shader_code =
@@ -81,6 +147,79 @@ bool VulkanPipelineCache::Initialize() {
     }
   }
 
+  uint32_t logical_processor_count = xe::threading::logical_processor_count();
+  if (!logical_processor_count) {
+    // Pick some reasonable amount if couldn't determine the number of cores.
+    logical_processor_count = 6;
+  }
+  creation_threads_busy_ = 0;
+  creation_completion_event_ =
+      xe::threading::Event::CreateManualResetEvent(true);
+  assert_not_null(creation_completion_event_);
+  creation_completion_set_event_ = false;
+  creation_threads_shutdown_from_ = SIZE_MAX;
+  if (cvars::vulkan_pipeline_creation_threads != 0) {
+    size_t creation_thread_count;
+    if (cvars::vulkan_pipeline_creation_threads < 0) {
+      // Fewer pipelines being compiled at once with little memory.
+      creation_thread_count = std::max(
+          logical_processor_count *
+              (xe::device_profile::IsLowMemory() ? 2 : 3) / 4,
+          uint32_t(1));
+    } else {
+      creation_thread_count =
+          std::min(uint32_t(cvars::vulkan_pipeline_creation_threads),
+                   logical_processor_count);
+    }
+    for (size_t i = 0; i < creation_thread_count; ++i) {
+      std::unique_ptr<xe::threading::Thread> creation_thread =
+          xe::threading::Thread::Create({}, [this, i, creation_thread_count]() {
+            CreationThread(i, creation_thread_count);
+          });
+      assert_not_null(creation_thread);
+      creation_thread->set_name("Vulkan Pipelines");
+      creation_threads_.push_back(std::move(creation_thread));
+    }
+  }
+
+  if (cvars::parallel_shader_translation && logical_processor_count > 1) {
+    translation_thread_translator_ = std::make_unique<SpirvShaderTranslator>(
+        SpirvShaderTranslator::Features(provider),
+        render_target_cache_.msaa_2x_attachments_supported(),
+        render_target_cache_.msaa_2x_no_attachments_supported(),
+        edram_fragment_shader_interlock,
+        command_processor_.bindless_resources_used());
+    translation_request_ = nullptr;
+    translation_request_completed_ = false;
+    translation_thread_shutdown_ = false;
+    translation_thread_ =
+        xe::threading::Thread::Create({}, [this]() { TranslationThread(); });
+    assert_not_null(translation_thread_);
+    translation_thread_->set_name("Vulkan Shader Translation");
+  }
+
+  if (cvars::vulkan_spirv_optimization) {
+    optimization_spirv_tools_ =
+        std::make_unique<ui::vulkan::SpirvToolsContext>();
+    if (!optimization_spirv_tools_->Initialize(
+            SpirvShaderTranslator::Features(provider).spirv_version) ||
+        !optimization_spirv_tools_->IsOptimizerAvailable()) {
+      XELOGW(
+          "VulkanPipelineCache: The SPIR-V optimizer is not available, shaders "
+          "will not be optimized");
+      optimization_spirv_tools_.reset();
+    } else {
+      optimization_thread_shutdown_ = false;
+      optimization_thread_ =
+          xe::threading::Thread::Create({}, [this]() { OptimizationThread(); });
+      assert_not_null(optimization_thread_);
+      optimization_thread_->set_name("Vulkan Shader Optimization");
+      // Must not take the time from the threads the emulation is waiting for.
+      optimization_thread_->set_priority(
+          xe::threading::ThreadPriority::kLowest);
+    }
+  }
+
   return true;
 }
 
@@ -90,14 +229,76 @@ void VulkanPipelineCache::Shutdown() {
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
+  // Shut down all threads, before destroying the pipelines since they may be
+  // creating them.
+  if (optimization_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(optimization_request_lock_);
+      optimization_thread_shutdown_ = true;
+    }
+    optimization_request_cond_.notify_all();
+    xe::threading::Wait(optimization_thread_.get(), false);
+    optimization_thread_.reset();
+  }
+  optimization_queue_.clear();
+  optimization_results_.clear();
+  optimization_spirv_tools_.reset();
+  if (!creation_threads_.empty()) {
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      creation_threads_shutdown_from_ = 0;
+    }
+    creation_request_cond_.notify_all();
+    for (size_t i = 0; i < creation_threads_.size(); ++i) {
+      xe::threading::Wait(creation_threads_[i].get(), false);
+    }
+    creation_threads_.clear();
+  }
+  creation_queue_.clear();
+  creation_completion_event_.reset();
+  if (translation_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(translation_request_lock_);
+      translation_thread_shutdown_ = true;
+    }
+    translation_request_cond_.notify_all();
+    xe::threading::Wait(translation_thread_.get(), false);
+    translation_thread_.reset();
+  }
+  translation_thread_translator_.reset();
+
+  // Shut down the persistent shader / pipeline storage.
+  ShutdownShaderStorage();
+
   // Destroy all pipelines.
   last_pipeline_ = nullptr;
+  for (const std::unique_ptr<PipelineReplacement>& replacement :
+       replacements_created_) {
+    if (replacement->replacement.second.pipeline != VK_NULL_HANDLE) {
+      dfn.vkDestroyPipeline(device, replacement->replacement.second.pipeline,
+                            nullptr);
+    }
+  }
+  replacements_created_.clear();
+  replacement_queue_.clear();
+  for (const std::pair<VkPipeline, uint64_t>& retired_pipeline :
+       retired_pipelines_) {
+    dfn.vkDestroyPipeline(device, retired_pipeline.first, nullptr);
+  }
+  retired_pipelines_.clear();
   for (const auto& pipeline_pair : pipelines_) {
     if (pipeline_pair.second.pipeline != VK_NULL_HANDLE) {
       dfn.vkDestroyPipeline(device, pipeline_pair.second.pipeline, nullptr);
     }
   }
   pipelines_.clear();
+  // Linked pipelines don't depend on the libraries being alive.
+  for (const auto& pipeline_library_pair : pipeline_libraries_) {
+    if (pipeline_library_pair.second != VK_NULL_HANDLE) {
+      dfn.vkDestroyPipeline(device, pipeline_library_pair.second, nullptr);
+    }
+  }
+  pipeline_libraries_.clear();
 
   // Destroy all internal shaders.
   ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyShaderModule, device,
@@ -116,17 +317,587 @@ void VulkanPipelineCache::Shutdown() {
   shaders_.clear();
   texture_binding_layout_map_.clear();
   texture_binding_layouts_.clear();
+  shader_storage_index_ = 0;
 
   // Shut down shader translation.
   shader_translator_.reset();
 }
 
+void VulkanPipelineCache::InitializeShaderStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  ShutdownShaderStorage();
+
+  auto shader_storage_root = cache_root / "shaders";
+  // For files that can be moved between different hosts.
+  auto shader_storage_shareable_root = shader_storage_root / "shareable";
+  if (!std::filesystem::exists(shader_storage_shareable_root)) {
+    if (!std::filesystem::create_directories(shader_storage_shareable_root)) {
+      XELOGE(
+          "Failed to create the shareable shader storage directory, persistent "
+          "shader storage will be disabled: {}",
+          xe::path_to_utf8(shader_storage_shareable_root));
+      return;
+    }
+  }
+  // For the driver pipeline cache, which is only usable with the same device
+  // and driver.
+  auto shader_storage_local_root = shader_storage_root / "local";
+  std::error_code local_root_error;
+  if (!std::filesystem::exists(shader_storage_local_root) &&
+      !std::filesystem::create_directories(shader_storage_local_root,
+                                           local_root_error)) {
+    XELOGW(
+        "Failed to create the local shader storage directory, the Vulkan "
+        "pipeline cache will not be stored: {}",
+        xe::path_to_utf8(shader_storage_local_root));
+  }
+
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  bool edram_fragment_shader_interlock =
+      render_target_cache_.GetPath() ==
+      RenderTargetCache::Path::kPixelShaderInterlock;
+
+  LoadPipelineCacheObject(
+      shader_storage_local_root /
+      fmt::format("{:08X}.{}.vulkan.bin", title_id,
+                  edram_fragment_shader_interlock ? "fsi" : "rtv"));
+  // Before translating the stored shaders, so they can use the optimized
+  // binaries immediately.
+  if (optimization_thread_) {
+    LoadOptimizedShaderStorage(
+        shader_storage_local_root /
+        fmt::format("{:08X}.vulkan.spvopt", title_id));
+  }
+
+  // Initialize the pipeline storage stream - read pipeline descriptions and
+  // collect used shader modifications to translate.
+  std::vector<PipelineStoredDescription> pipeline_stored_descriptions;
+  // <Shader hash, modification bits>.
+  std::set<std::pair<uint64_t, uint64_t>> shader_translations_needed;
+  auto pipeline_storage_file_path =
+      shader_storage_shareable_root /
+      fmt::format("{:08X}.{}.vulkan.xpso", title_id,
+                  edram_fragment_shader_interlock ? "fsi" : "rtv");
+  pipeline_storage_file_ =
+      xe::filesystem::OpenFile(pipeline_storage_file_path, "a+b");
+  if (!pipeline_storage_file_) {
+    XELOGE(
+        "Failed to open the Vulkan pipeline description storage file for "
+        "writing, persistent shader storage will be disabled: {}",
+        xe::path_to_utf8(pipeline_storage_file_path));
+    StorePipelineCacheObject();
+    return;
+  }
+  pipeline_storage_file_flush_needed_ = false;
+  // 'XEPS'.
+  const uint32_t pipeline_storage_magic = 0x53504558;
+  // 'VKFS' or 'VKRT'.
+  const uint32_t pipeline_storage_magic_api =
+      edram_fragment_shader_interlock ? 0x53464B56 : 0x54524B56;
+  const uint32_t pipeline_storage_version_swapped =
+      xe::byte_swap(std::max(PipelineDescription::kVersion,
+                             SpirvShaderTranslator::Modification::kVersion));
+  struct {
+    uint32_t magic;
+    uint32_t magic_api;
+    uint32_t version_swapped;
+  } pipeline_storage_file_header;
+  if (fread(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+            1, pipeline_storage_file_) &&
+      pipeline_storage_file_header.magic == pipeline_storage_magic &&
+      pipeline_storage_file_header.magic_api == pipeline_storage_magic_api &&
+      pipeline_storage_file_header.version_swapped ==
+          pipeline_storage_version_swapped) {
+    xe::filesystem::Seek(pipeline_storage_file_, 0, SEEK_END);
+    int64_t pipeline_storage_told_end =
+        xe::filesystem::Tell(pipeline_storage_file_);
+    size_t pipeline_storage_told_count =
+        size_t(pipeline_storage_told_end >=
+                       int64_t(sizeof(pipeline_storage_file_header))
+                   ? (uint64_t(pipeline_storage_told_end) -
+                      sizeof(pipeline_storage_file_header)) /
+                         sizeof(PipelineStoredDescription)
+                   : 0);
+    if (pipeline_storage_told_count &&
+        xe::filesystem::Seek(pipeline_storage_file_,
+                             int64_t(sizeof(pipeline_storage_file_header)),
+                             SEEK_SET)) {
+      pipeline_stored_descriptions.resize(pipeline_storage_told_count);
+      pipeline_stored_descriptions.resize(
+          fread(pipeline_stored_descriptions.data(),
+                sizeof(PipelineStoredDescription), pipeline_storage_told_count,
+                pipeline_storage_file_));
+      size_t pipeline_storage_read_count = pipeline_stored_descriptions.size();
+      for (size_t i = 0; i < pipeline_storage_read_count; ++i) {
+        PipelineStoredDescription& pipeline_stored_description =
+            pipeline_stored_descriptions[i];
+        // Validate file integrity, stop and truncate the stream if data is
+        // corrupted.
+        if (XXH3_64bits(&pipeline_stored_description.description,
+                        sizeof(pipeline_stored_description.description)) !=
+            pipeline_stored_description.description_hash) {
+          pipeline_stored_descriptions.resize(i);
+          break;
+        }
+        // Pipelines requiring unsupported device features are kept in the
+        // file (so it stays shareable across devices), but not translated or
+        // created.
+        if (!ArePipelineRequirementsMet(
+                pipeline_stored_description.description)) {
+          continue;
+        }
+        // Descriptions stored without the extended dynamic state map to the
+        // same pipelines as with it.
+        if (extended_dynamic_state_used_ &&
+            !pipeline_stored_description.description.extended_dynamic_state) {
+          ClearExtendedDynamicState(pipeline_stored_description.description);
+        }
+        // Mark the shader modifications as needed for translation.
+        shader_translations_needed.emplace(
+            pipeline_stored_description.description.vertex_shader_hash,
+            pipeline_stored_description.description.vertex_shader_modification);
+        if (pipeline_stored_description.description.pixel_shader_hash) {
+          shader_translations_needed.emplace(
+              pipeline_stored_description.description.pixel_shader_hash,
+              pipeline_stored_description.description
+                  .pixel_shader_modification);
+        }
+      }
+    }
+  }
+
+  size_t logical_processor_count = xe::threading::logical_processor_count();
+  if (!logical_processor_count) {
+    // Pick some reasonable amount if couldn't determine the number of cores.
+    logical_processor_count = 6;
+  }
+
+  // Initialize the Xenos shader storage stream.
+  uint64_t shader_storage_initialization_start =
+      xe::Clock::QueryHostTickCount();
+  auto shader_storage_file_path =
+      shader_storage_shareable_root / fmt::format("{:08X}.xsh", title_id);
+  shader_storage_file_ =
+      xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
+  if (!shader_storage_file_) {
+    XELOGE(
+        "Failed to open the guest shader storage file for writing, persistent "
+        "shader storage will be disabled: {}",
+        xe::path_to_utf8(shader_storage_file_path));
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    StorePipelineCacheObject();
+    return;
+  }
+  ++shader_storage_index_;
+  shader_storage_file_flush_needed_ = false;
+  struct {
+    uint32_t magic;
+    uint32_t version_swapped;
+  } shader_storage_file_header;
+  // 'XESH'.
+  const uint32_t shader_storage_magic = 0x48534558;
+  if (fread(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
+            shader_storage_file_) &&
+      shader_storage_file_header.magic == shader_storage_magic &&
+      xe::byte_swap(shader_storage_file_header.version_swapped) ==
+          ShaderStoredHeader::kVersion) {
+    uint64_t shader_storage_valid_bytes = sizeof(shader_storage_file_header);
+    // Load and translate shaders written by previous Xenia executions until the
+    // end of the file or until a corrupted one is detected.
+    ShaderStoredHeader shader_header;
+    std::vector<uint32_t> ucode_dwords;
+    ucode_dwords.reserve(0xFFFF);
+    std::vector<uint8_t> ucode_analysis;
+    size_t shaders_translated = 0;
+    size_t shaders_analysis_loaded = 0;
+
+    // Threads overlapping file reading.
+    std::mutex shaders_translation_thread_mutex;
+    std::condition_variable shaders_translation_thread_cond;
+    std::deque<VulkanShader*> shaders_to_translate;
+    size_t shader_translation_threads_busy = 0;
+    bool shader_translation_threads_shutdown = false;
+    std::mutex shaders_failed_to_translate_mutex;
+    std::vector<VulkanShader::VulkanTranslation*> shaders_failed_to_translate;
+    auto shader_translation_thread_function = [&]() {
+      StringBuffer ucode_disasm_buffer;
+      SpirvShaderTranslator translator(
+          SpirvShaderTranslator::Features(provider),
+          render_target_cache_.msaa_2x_attachments_supported(),
+          render_target_cache_.msaa_2x_no_attachments_supported(),
+          edram_fragment_shader_interlock,
+          command_processor_.bindless_resources_used());
+      for (;;) {
+        VulkanShader* shader_to_translate;
+        for (;;) {
+          std::unique_lock<std::mutex> lock(shaders_translation_thread_mutex);
+          if (shaders_to_translate.empty()) {
+            if (shader_translation_threads_shutdown) {
+              return;
+            }
+            shaders_translation_thread_cond.wait(lock);
+            continue;
+          }
+          shader_to_translate = shaders_to_translate.front();
+          shaders_to_translate.pop_front();
+          ++shader_translation_threads_busy;
+          break;
+        }
+        shader_to_translate->AnalyzeUcode(ucode_disasm_buffer);
+        // Translate each needed modification on this thread after performing
+        // modification-independent analysis of the whole shader.
+        uint64_t ucode_data_hash = shader_to_translate->ucode_data_hash();
+        for (auto modification_it = shader_translations_needed.lower_bound(
+                 std::make_pair(ucode_data_hash, uint64_t(0)));
+             modification_it != shader_translations_needed.end() &&
+             modification_it->first == ucode_data_hash;
+             ++modification_it) {
+          VulkanShader::VulkanTranslation* translation =
+              static_cast<VulkanShader::VulkanTranslation*>(
+                  shader_to_translate->GetOrCreateTranslation(
+                      modification_it->second));
+          // Only try (and delete in case of failure) if it's a new translation.
+          // If it's a shader previously encountered in the game, translation of
+          // which has failed, and the shader storage is loaded later, keep it
+          // this way not to try to translate it again.
+          if (!translation->is_translated() &&
+              !TranslateAnalyzedShader(translator, *translation)) {
+            std::lock_guard<std::mutex> lock(shaders_failed_to_translate_mutex);
+            shaders_failed_to_translate.push_back(translation);
+          }
+        }
+        {
+          std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+          --shader_translation_threads_busy;
+        }
+      }
+    };
+    std::vector<std::unique_ptr<xe::threading::Thread>>
+        shader_translation_threads;
+
+    while (true) {
+      if (!fread(&shader_header, sizeof(shader_header), 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      size_t ucode_byte_count =
+          shader_header.ucode_dword_count * sizeof(uint32_t);
+      ucode_dwords.resize(shader_header.ucode_dword_count);
+      if (shader_header.ucode_dword_count &&
+          !fread(ucode_dwords.data(), ucode_byte_count, 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      uint64_t ucode_data_hash =
+          XXH3_64bits(ucode_dwords.data(), ucode_byte_count);
+      if (shader_header.ucode_data_hash != ucode_data_hash) {
+        // Validation failed.
+        break;
+      }
+      ucode_analysis.resize(shader_header.ucode_analysis_size);
+      if (shader_header.ucode_analysis_size &&
+          !fread(ucode_analysis.data(), shader_header.ucode_analysis_size, 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count +
+                                    shader_header.ucode_analysis_size;
+      VulkanShader* shader =
+          LoadShader(shader_header.type, ucode_dwords.data(),
+                     shader_header.ucode_dword_count, ucode_data_hash);
+      if (shader->ucode_storage_index() == shader_storage_index_) {
+        // Appeared twice in this file for some reason - skip, otherwise race
+        // condition will be caused by translating twice in parallel.
+        continue;
+      }
+      // Skip the analysis on the translation threads if it has been stored by
+      // a compatible build, otherwise it will be done there as usual.
+      if (!shader->is_ucode_analyzed() && shader_header.ucode_analysis_size &&
+          shader->DeserializeUcodeAnalysis(ucode_analysis.data(),
+                                           ucode_analysis.size())) {
+        ++shaders_analysis_loaded;
+      }
+      // Loaded from the current storage - don't write again.
+      shader->set_ucode_storage_index(shader_storage_index_);
+      // Create new threads if the currently existing threads can't keep up
+      // with file reading, but not more than the number of logical processors
+      // minus one.
+      size_t shader_translation_threads_needed;
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shader_translation_threads_needed =
+            std::min(shader_translation_threads_busy +
+                         shaders_to_translate.size() + size_t(1),
+                     std::max(logical_processor_count, size_t(2)) - size_t(1));
+      }
+      while (shader_translation_threads.size() <
+             shader_translation_threads_needed) {
+        auto thread = xe::threading::Thread::Create(
+            {}, shader_translation_thread_function);
+        assert_not_null(thread);
+        thread->set_name("Shader Translation");
+        shader_translation_threads.push_back(std::move(thread));
+      }
+      // Request ucode information gathering and translation of all the needed
+      // shaders.
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shaders_to_translate.push_back(shader);
+      }
+      shaders_translation_thread_cond.notify_one();
+      ++shaders_translated;
+    }
+    if (!shader_translation_threads.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shader_translation_threads_shutdown = true;
+      }
+      shaders_translation_thread_cond.notify_all();
+      for (auto& shader_translation_thread : shader_translation_threads) {
+        xe::threading::Wait(shader_translation_thread.get(), false);
+      }
+      shader_translation_threads.clear();
+      for (VulkanShader::VulkanTranslation* translation :
+           shaders_failed_to_translate) {
+        VulkanShader* shader =
+            static_cast<VulkanShader*>(&translation->shader());
+        shader->DestroyTranslation(translation->modification());
+        if (shader->translations().empty()) {
+          shaders_.erase(shader->ucode_data_hash());
+          delete shader;
+        }
+      }
+    }
+    XELOGGPU(
+        "Translated {} shaders ({} with the stored ucode analysis) from the "
+        "storage in {} milliseconds",
+        shaders_translated, shaders_analysis_loaded,
+        (xe::Clock::QueryHostTickCount() -
+         shader_storage_initialization_start) *
+            1000 / xe::Clock::QueryHostTickFrequency());
+    xe::filesystem::TruncateStdioFile(shader_storage_file_,
+                                      shader_storage_valid_bytes);
+  } else {
+    xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
+    shader_storage_file_header.magic = shader_storage_magic;
+    shader_storage_file_header.version_swapped =
+        xe::byte_swap(ShaderStoredHeader::kVersion);
+    fwrite(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
+           shader_storage_file_);
+  }
+
+  // Create the pipelines.
+  if (!pipeline_stored_descriptions.empty()) {
+    uint64_t pipeline_creation_start = xe::Clock::QueryHostTickCount();
+
+    // Everything needed from the caches is looked up on this thread, only
+    // vkCreateGraphicsPipelines is done in parallel.
+    std::vector<PipelineCreationArguments> pipelines_to_create;
+    for (const PipelineStoredDescription& pipeline_stored_description :
+         pipeline_stored_descriptions) {
+      const PipelineDescription& pipeline_description =
+          pipeline_stored_description.description;
+      // Skip already known pipelines.
+      if (pipelines_.find(pipeline_description) != pipelines_.end()) {
+        continue;
+      }
+      PipelineCreationArguments creation_arguments;
+      if (!GetStoredPipelineCreationArguments(pipeline_description,
+                                              creation_arguments)) {
+        continue;
+      }
+      pipelines_to_create.push_back(creation_arguments);
+    }
+
+    std::atomic<size_t> pipeline_creation_next_index(0);
+    auto pipeline_creation_thread_function = [&]() {
+      for (;;) {
+        size_t index = pipeline_creation_next_index.fetch_add(
+            1, std::memory_order_relaxed);
+        if (index >= pipelines_to_create.size()) {
+          return;
+        }
+        CreatePipeline(pipelines_to_create[index]);
+      }
+    };
+    // Will also be using this thread, so minus 1.
+    size_t pipeline_creation_thread_count =
+        std::min(pipelines_to_create.size(), logical_processor_count);
+    std::vector<std::unique_ptr<xe::threading::Thread>>
+        pipeline_creation_threads;
+    while (pipeline_creation_threads.size() + 1 <
+           pipeline_creation_thread_count) {
+      auto thread = xe::threading::Thread::Create(
+          {}, pipeline_creation_thread_function);
+      assert_not_null(thread);
+      thread->set_name("Vulkan Pipelines");
+      pipeline_creation_threads.push_back(std::move(thread));
+    }
+    pipeline_creation_thread_function();
+    for (auto& pipeline_creation_thread : pipeline_creation_threads) {
+      xe::threading::Wait(pipeline_creation_thread.get(), false);
+    }
+    pipeline_creation_threads.clear();
+
+    // Don't keep the failed ones, so they are retried and reported if needed in
+    // the guest.
+    size_t pipelines_created = 0;
+    for (const PipelineCreationArguments& creation_arguments :
+         pipelines_to_create) {
+      if (creation_arguments.pipeline->second.pipeline != VK_NULL_HANDLE) {
+        ++pipelines_created;
+      } else {
+        pipelines_.erase(creation_arguments.pipeline->first);
+      }
+    }
+
+    XELOGGPU(
+        "Created {} graphics pipelines (not including reading the "
+        "descriptions) from the storage in {} milliseconds",
+        pipelines_created,
+        (xe::Clock::QueryHostTickCount() - pipeline_creation_start) * 1000 /
+            xe::Clock::QueryHostTickFrequency());
+    // If any pipeline descriptions were corrupted (or the whole file has excess
+    // bytes in the end), truncate to the last valid pipeline description.
+    xe::filesystem::TruncateStdioFile(
+        pipeline_storage_file_,
+        uint64_t(sizeof(pipeline_storage_file_header) +
+                 sizeof(PipelineStoredDescription) *
+                     pipeline_stored_descriptions.size()));
+  } else {
+    xe::filesystem::TruncateStdioFile(pipeline_storage_file_, 0);
+    pipeline_storage_file_header.magic = pipeline_storage_magic;
+    pipeline_storage_file_header.magic_api = pipeline_storage_magic_api;
+    pipeline_storage_file_header.version_swapped =
+        pipeline_storage_version_swapped;
+    fwrite(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+           1, pipeline_storage_file_);
+  }
+
+  shader_storage_cache_root_ = cache_root;
+  shader_storage_title_id_ = title_id;
+
+  // Start the storage writing thread.
+  storage_write_flush_shaders_ = false;
+  storage_write_flush_pipelines_ = false;
+  storage_write_thread_shutdown_ = false;
+  storage_write_thread_ =
+      xe::threading::Thread::Create({}, [this]() { StorageWriteThread(); });
+  assert_not_null(storage_write_thread_);
+  storage_write_thread_->set_name("Vulkan Storage writer");
+}
+
+void VulkanPipelineCache::ShutdownShaderStorage() {
+  if (storage_write_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      storage_write_thread_shutdown_ = true;
+    }
+    storage_write_request_cond_.notify_all();
+    xe::threading::Wait(storage_write_thread_.get(), false);
+    storage_write_thread_.reset();
+  }
+  storage_write_shader_queue_.clear();
+  storage_write_pipeline_queue_.clear();
+
+  {
+    std::lock_guard<std::mutex> lock(optimization_storage_mutex_);
+    if (optimized_shader_storage_file_) {
+      fclose(optimized_shader_storage_file_);
+      optimized_shader_storage_file_ = nullptr;
+    }
+  }
+  optimized_shaders_stored_.clear();
+
+  if (pipeline_storage_file_) {
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    pipeline_storage_file_flush_needed_ = false;
+  }
+
+  if (shader_storage_file_) {
+    fclose(shader_storage_file_);
+    shader_storage_file_ = nullptr;
+    shader_storage_file_flush_needed_ = false;
+  }
+
+  StorePipelineCacheObject();
+
+  shader_storage_cache_root_.clear();
+  shader_storage_title_id_ = 0;
+}
+
+void VulkanPipelineCache::EndSubmission() {
+  if (shader_storage_file_flush_needed_ ||
+      pipeline_storage_file_flush_needed_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      if (shader_storage_file_flush_needed_) {
+        storage_write_flush_shaders_ = true;
+      }
+      if (pipeline_storage_file_flush_needed_) {
+        storage_write_flush_pipelines_ = true;
+      }
+    }
+    storage_write_request_cond_.notify_one();
+    shader_storage_file_flush_needed_ = false;
+    pipeline_storage_file_flush_needed_ = false;
+  }
+  if (!creation_threads_.empty()) {
+    CreateQueuedPipelinesOnProcessorThread();
+    // Await creation of all queued pipelines.
+    bool await_creation_completion_event;
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      // Assuming the creation queue is already empty (because the processor
+      // thread also worked on creating the leftover pipelines), so only check
+      // if there are threads with pipelines currently being created.
+      await_creation_completion_event = creation_threads_busy_ != 0;
+      if (await_creation_completion_event) {
+        creation_completion_event_->Reset();
+        creation_completion_set_event_ = true;
+      }
+    }
+    if (await_creation_completion_event) {
+      creation_request_cond_.notify_one();
+      xe::threading::Wait(creation_completion_event_.get(), false);
+    }
+  }
+  if (optimization_thread_) {
+    UpdateOptimizedShaders();
+  }
+}
+
+bool VulkanPipelineCache::IsCreatingPipelines() {
+  if (creation_threads_.empty()) {
+    return false;
+  }
+  std::lock_guard<xe_mutex> lock(creation_request_lock_);
+  return !creation_queue_.empty() || creation_threads_busy_ != 0;
+}
+
+uint32_t VulkanPipelineCache::GetPendingPipelineCount() {
+  if (creation_threads_.empty()) {
+    return 0;
+  }
+  std::lock_guard<xe_mutex> lock(creation_request_lock_);
+  return uint32_t(creation_queue_.size() + creation_threads_busy_);
+}
+
 VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
                                               const uint32_t* host_address,
                                               uint32_t dword_count) {
   // Hash the input memory and lookup the shader.
-  uint64_t data_hash =
-      XXH3_64bits(host_address, dword_count * sizeof(uint32_t));
+  return LoadShader(shader_type, host_address, dword_count,
+                    XXH3_64bits(host_address, dword_count * sizeof(uint32_t)));
+}
+
+VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
+                                              const uint32_t* host_address,
+                                              uint32_t dword_count,
+                                              uint64_t data_hash) {
   auto it = shaders_.find(data_hash);
   if (it != shaders_.end()) {
     // Shader has been previously loaded.
@@ -232,24 +1003,78 @@ bool VulkanPipelineCache::EnsureShadersTranslated(
               register_file_.Get<reg::SQ_PROGRAM_CNTL>().vs_export_mode !=
                   xenos::VertexShaderExportMode::kPosition2VectorsEdgeKill);
   assert_false(register_file_.Get<reg::SQ_PROGRAM_CNTL>().gen_index_vtx);
-  if (!vertex_shader->is_translated()) {
+  bool vertex_shader_translation_needed = !vertex_shader->is_translated();
+  bool pixel_shader_translation_needed =
+      pixel_shader != nullptr && !pixel_shader->is_translated();
+  bool pixel_shader_translating_on_thread = false;
+  if (vertex_shader_translation_needed && pixel_shader_translation_needed &&
+      translation_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(translation_request_lock_);
+      translation_request_ = pixel_shader;
+      translation_request_completed_ = false;
+    }
+    translation_request_cond_.notify_all();
+    pixel_shader_translating_on_thread = true;
+  }
+  bool vertex_shader_translated = true;
+  if (vertex_shader_translation_needed) {
     vertex_shader->shader().AnalyzeUcode(ucode_disasm_buffer_);
-    if (!TranslateAnalyzedShader(*shader_translator_, *vertex_shader)) {
+    vertex_shader_translated =
+        TranslateAnalyzedShader(*shader_translator_, *vertex_shader);
+  }
+  bool pixel_shader_translated = true;
+  if (pixel_shader_translating_on_thread) {
+    std::unique_lock<std::mutex> lock(translation_request_lock_);
+    while (!translation_request_completed_) {
+      translation_request_cond_.wait(lock);
+    }
+    pixel_shader_translated = translation_request_result_;
+  }
+  if (vertex_shader_translation_needed) {
+    if (!vertex_shader_translated) {
       XELOGE("Failed to translate the vertex shader!");
       return false;
     }
+    if (shader_storage_file_ && vertex_shader->shader().ucode_storage_index() !=
+                                    shader_storage_index_) {
+      vertex_shader->shader().set_ucode_storage_index(shader_storage_index_);
+      assert_not_null(storage_write_thread_);
+      shader_storage_file_flush_needed_ = true;
+      {
+        std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+        storage_write_shader_queue_.push_back(&vertex_shader->shader());
+      }
+      storage_write_request_cond_.notify_all();
+    }
   }
   if (!vertex_shader->is_valid()) {
     // Translation attempted previously, but not valid.
     return false;
   }
   if (pixel_shader != nullptr) {
-    if (!pixel_shader->is_translated()) {
-      pixel_shader->shader().AnalyzeUcode(ucode_disasm_buffer_);
-      if (!TranslateAnalyzedShader(*shader_translator_, *pixel_shader)) {
+    if (pixel_shader_translation_needed) {
+      if (!pixel_shader_translating_on_thread) {
+        pixel_shader->shader().AnalyzeUcode(ucode_disasm_buffer_);
+        pixel_shader_translated =
+            TranslateAnalyzedShader(*shader_translator_, *pixel_shader);
+      }
+      if (!pixel_shader_translated) {
         XELOGE("Failed to translate the pixel shader!");
         return false;
       }
+      if (shader_storage_file_ &&
+          pixel_shader->shader().ucode_storage_index() !=
+              shader_storage_index_) {
+        pixel_shader->shader().set_ucode_storage_index(shader_storage_index_);
+        assert_not_null(storage_write_thread_);
+        shader_storage_file_flush_needed_ = true;
+        {
+          std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+          storage_write_shader_queue_.push_back(&pixel_shader->shader());
+        }
+        storage_write_request_cond_.notify_all();
+      }
     }
     if (!pixel_shader->is_valid()) {
       // Translation attempted previously, but not valid.
@@ -266,8 +1091,9 @@ bool VulkanPipelineCache::ConfigurePipeline(
     reg::RB_DEPTHCONTROL normalized_depth_control,
     uint32_t normalized_color_mask,
     VulkanRenderTargetCache::RenderPassKey render_pass_key,
-    VkPipeline& pipeline_out,
-    const PipelineLayoutProvider*& pipeline_layout_out) {
+    const void*& pipeline_handle_out,
+    const PipelineLayoutProvider*& pipeline_layout_out,
+    ExtendedDynamicState& extended_dynamic_state_out) {
 #if XE_UI_VULKAN_FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
 #endif  // XE_UI_VULKAN_FINE_GRAINED_DRAW_SCOPES
@@ -284,20 +1110,31 @@ bool VulkanPipelineCache::ConfigurePipeline(
           description)) {
     return false;
   }
+  if (extended_dynamic_state_used_) {
+    GetExtendedDynamicState(description, extended_dynamic_state_out);
+    ClearExtendedDynamicState(description);
+  }
+  ++pipeline_lookup_count_;
   if (last_pipeline_ && last_pipeline_->first == description) {
-    pipeline_out = last_pipeline_->second.pipeline;
+    pipeline_handle_out = &last_pipeline_->second;
     pipeline_layout_out = last_pipeline_->second.pipeline_layout;
     return true;
   }
   auto it = pipelines_.find(description);
   if (it != pipelines_.end()) {
+    if (it->second.creation_completed.load(std::memory_order_acquire) &&
+        it->second.pipeline == VK_NULL_HANDLE) {
+      // Failed to create previously.
+      return false;
+    }
     last_pipeline_ = &*it;
-    pipeline_out = it->second.pipeline;
+    pipeline_handle_out = &it->second;
     pipeline_layout_out = it->second.pipeline_layout;
     return true;
   }
 
   // Create the pipeline if not the latest and not already existing.
+  ++pipeline_miss_count_;
   const PipelineLayoutProvider* pipeline_layout =
       command_processor_.GetPipelineLayout(
           pixel_shader
@@ -342,21 +1179,83 @@ bool VulkanPipelineCache::ConfigurePipeline(
     return false;
   }
   PipelineCreationArguments creation_arguments;
-  auto& pipeline =
-      *pipelines_.emplace(description, Pipeline(pipeline_layout)).first;
+  auto& pipeline = *pipelines_
+                        .emplace(std::piecewise_construct,
+                                 std::forward_as_tuple(description),
+                                 std::forward_as_tuple(pipeline_layout))
+                        .first;
   creation_arguments.pipeline = &pipeline;
   creation_arguments.vertex_shader = vertex_shader;
   creation_arguments.pixel_shader = pixel_shader;
   creation_arguments.geometry_shader = geometry_shader;
   creation_arguments.render_pass = render_pass;
-  if (!EnsurePipelineCreated(creation_arguments)) {
-    return false;
+  if (!creation_threads_.empty() && graphics_pipeline_library_used_ &&
+      EnsurePipelineCreated(creation_arguments, true)) {
+    // All the parts have already been compiled for other pipelines, and fast
+    // linking is cheap, so the pipeline can be used for drawing immediately
+    // without waiting for the creation threads.
+    pipeline.second.creation_completed.store(true, std::memory_order_release);
+  } else if (!creation_threads_.empty()) {
+    // Submit the pipeline for creation to any available thread.
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      creation_queue_.push_back(creation_arguments);
+    }
+    creation_request_cond_.notify_one();
+  } else {
+    CreatePipeline(creation_arguments);
+    if (pipeline.second.pipeline == VK_NULL_HANDLE) {
+      return false;
+    }
+  }
+
+  if (pipeline_storage_file_) {
+    assert_not_null(storage_write_thread_);
+    pipeline_storage_file_flush_needed_ = true;
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      storage_write_pipeline_queue_.emplace_back();
+      PipelineStoredDescription& stored_description =
+          storage_write_pipeline_queue_.back();
+      stored_description.description_hash = description.GetHash();
+      std::memcpy(&stored_description.description, &description,
+                  sizeof(description));
+    }
+    storage_write_request_cond_.notify_all();
   }
-  pipeline_out = pipeline.second.pipeline;
+
+  last_pipeline_ = &pipeline;
+  pipeline_handle_out = &pipeline.second;
   pipeline_layout_out = pipeline_layout;
   return true;
 }
 
+void VulkanPipelineCache::TranslationThread() {
+  while (true) {
+    VulkanShader::VulkanTranslation* translation;
+    {
+      std::unique_lock<std::mutex> lock(translation_request_lock_);
+      while (!translation_request_ && !translation_thread_shutdown_) {
+        translation_request_cond_.wait(lock);
+      }
+      if (!translation_request_) {
+        return;
+      }
+      translation = translation_request_;
+    }
+    translation->shader().AnalyzeUcode(translation_thread_ucode_disasm_buffer_);
+    bool translated =
+        TranslateAnalyzedShader(*translation_thread_translator_, *translation);
+    {
+      std::lock_guard<std::mutex> lock(translation_request_lock_);
+      translation_request_ = nullptr;
+      translation_request_result_ = translated;
+      translation_request_completed_ = true;
+    }
+    translation_request_cond_.notify_all();
+  }
+}
+
 bool VulkanPipelineCache::TranslateAnalyzedShader(
     SpirvShaderTranslator& translator,
     VulkanShader::VulkanTranslation& translation) {
@@ -369,7 +1268,21 @@ bool VulkanPipelineCache::TranslateAnalyzedShader(
            shader.ucode_data_hash());
     return false;
   }
-  if (translation.GetOrCreateShaderModule() == VK_NULL_HANDLE) {
+  if (optimization_thread_) {
+    const std::vector<uint8_t>& translated_binary =
+        translation.translated_binary();
+    uint64_t unoptimized_hash =
+        XXH3_64bits(translated_binary.data(), translated_binary.size());
+    auto optimized_it = optimized_shaders_stored_.find(unoptimized_hash);
+    if (optimized_it == optimized_shaders_stored_.end() ||
+        !translation.SetOptimizedShaderModuleCode(
+            optimized_it->second.data(), optimized_it->second.size())) {
+      if (translation.GetOrCreateShaderModule() == VK_NULL_HANDLE) {
+        return false;
+      }
+      RequestShaderOptimization(translation, unoptimized_hash);
+    }
+  } else if (translation.GetOrCreateShaderModule() == VK_NULL_HANDLE) {
     return false;
   }
 
@@ -378,6 +1291,8 @@ bool VulkanPipelineCache::TranslateAnalyzedShader(
 
   // Set up the texture binding layout.
   if (shader.EnterBindingLayoutUserUIDSetup()) {
+    // Shaders from the storage are translated on multiple threads.
+    std::lock_guard<std::mutex> layouts_lock(layouts_mutex_);
     // Obtain the unique IDs of the binding layout if there are any texture
     // bindings, for invalidation in the command processor.
     size_t texture_binding_layout_uid = kLayoutUIDEmpty;
@@ -779,6 +1694,10 @@ bool VulkanPipelineCache::ArePipelineRequirementsMet(
     return false;
   }
 
+  if (description.extended_dynamic_state && !extended_dynamic_state_used_) {
+    return false;
+  }
+
   const ui::vulkan::VulkanProvider& provider =
       command_processor_.GetVulkanProvider();
 
@@ -868,6 +1787,76 @@ bool VulkanPipelineCache::ArePipelineRequirementsMet(
   return true;
 }
 
+void VulkanPipelineCache::GetExtendedDynamicState(
+    const PipelineDescription& description, ExtendedDynamicState& state_out) {
+  std::memset(&state_out, 0, sizeof(state_out));
+  state_out.cull_mode = VK_CULL_MODE_NONE;
+  if (description.cull_front) {
+    state_out.cull_mode |= VK_CULL_MODE_FRONT_BIT;
+  }
+  if (description.cull_back) {
+    state_out.cull_mode |= VK_CULL_MODE_BACK_BIT;
+  }
+  state_out.front_face = description.front_face_clockwise
+                             ? VK_FRONT_FACE_CLOCKWISE
+                             : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  if (description.depth_write_enable ||
+      description.depth_compare_op != xenos::CompareFunction::kAlways) {
+    state_out.depth_test_enable = VK_TRUE;
+    state_out.depth_write_enable =
+        description.depth_write_enable ? VK_TRUE : VK_FALSE;
+    state_out.depth_compare_op =
+        VkCompareOp(uint32_t(VK_COMPARE_OP_NEVER) +
+                    uint32_t(description.depth_compare_op));
+  }
+  if (description.stencil_test_enable) {
+    state_out.stencil_test_enable = VK_TRUE;
+    state_out.stencil_front.failOp =
+        VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
+                    uint32_t(description.stencil_front_fail_op));
+    state_out.stencil_front.passOp =
+        VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
+                    uint32_t(description.stencil_front_pass_op));
+    state_out.stencil_front.depthFailOp =
+        VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
+                    uint32_t(description.stencil_front_depth_fail_op));
+    state_out.stencil_front.compareOp =
+        VkCompareOp(uint32_t(VK_COMPARE_OP_NEVER) +
+                    uint32_t(description.stencil_front_compare_op));
+    state_out.stencil_back.failOp =
+        VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
+                    uint32_t(description.stencil_back_fail_op));
+    state_out.stencil_back.passOp =
+        VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
+                    uint32_t(description.stencil_back_pass_op));
+    state_out.stencil_back.depthFailOp =
+        VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
+                    uint32_t(description.stencil_back_depth_fail_op));
+    state_out.stencil_back.compareOp =
+        VkCompareOp(uint32_t(VK_COMPARE_OP_NEVER) +
+                    uint32_t(description.stencil_back_compare_op));
+  }
+}
+
+void VulkanPipelineCache::ClearExtendedDynamicState(
+    PipelineDescription& description) {
+  description.cull_front = 0;
+  description.cull_back = 0;
+  description.front_face_clockwise = 0;
+  description.depth_write_enable = 0;
+  description.depth_compare_op = xenos::CompareFunction(0);
+  description.stencil_test_enable = 0;
+  description.stencil_front_fail_op = xenos::StencilOp(0);
+  description.stencil_front_pass_op = xenos::StencilOp(0);
+  description.stencil_front_depth_fail_op = xenos::StencilOp(0);
+  description.stencil_front_compare_op = xenos::CompareFunction(0);
+  description.stencil_back_fail_op = xenos::StencilOp(0);
+  description.stencil_back_pass_op = xenos::StencilOp(0);
+  description.stencil_back_depth_fail_op = xenos::StencilOp(0);
+  description.stencil_back_compare_op = xenos::CompareFunction(0);
+  description.extended_dynamic_state = 1;
+}
+
 bool VulkanPipelineCache::GetGeometryShaderKey(
     PipelineGeometryShader geometry_shader_type,
     SpirvShaderTranslator::Modification vertex_shader_modification,
@@ -1884,7 +2873,8 @@ VkShaderModule VulkanPipelineCache::GetGeometryShader(GeometryShaderKey key) {
 }
 
 bool VulkanPipelineCache::EnsurePipelineCreated(
-    const PipelineCreationArguments& creation_arguments) {
+    const PipelineCreationArguments& creation_arguments,
+    bool existing_libraries_only, bool allow_libraries) {
   if (creation_arguments.pipeline->second.pipeline != VK_NULL_HANDLE) {
     return true;
   }
@@ -2070,16 +3060,11 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
       assert_unhandled_case(description.polygon_mode);
       return false;
   }
-  rasterization_state.cullMode = VK_CULL_MODE_NONE;
-  if (description.cull_front) {
-    rasterization_state.cullMode |= VK_CULL_MODE_FRONT_BIT;
-  }
-  if (description.cull_back) {
-    rasterization_state.cullMode |= VK_CULL_MODE_BACK_BIT;
-  }
-  rasterization_state.frontFace = description.front_face_clockwise
-                                      ? VK_FRONT_FACE_CLOCKWISE
-                                      : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  // With the extended dynamic state, this is zero, and overridden anyway.
+  ExtendedDynamicState static_state;
+  GetExtendedDynamicState(description, static_state);
+  rasterization_state.cullMode = static_state.cull_mode;
+  rasterization_state.frontFace = static_state.front_face;
   // Depth bias is dynamic (even toggling - pipeline creation is expensive).
   // "If no depth attachment is present, r is undefined" in the depth bias
   // formula, though Z has no effect on anything if a depth attachment is not
@@ -2119,42 +3104,12 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
       VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
   depth_stencil_state.pNext = nullptr;
   if (!edram_fragment_shader_interlock) {
-    if (description.depth_write_enable ||
-        description.depth_compare_op != xenos::CompareFunction::kAlways) {
-      depth_stencil_state.depthTestEnable = VK_TRUE;
-      depth_stencil_state.depthWriteEnable =
-          description.depth_write_enable ? VK_TRUE : VK_FALSE;
-      depth_stencil_state.depthCompareOp =
-          VkCompareOp(uint32_t(VK_COMPARE_OP_NEVER) +
-                      uint32_t(description.depth_compare_op));
-    }
-    if (description.stencil_test_enable) {
-      depth_stencil_state.stencilTestEnable = VK_TRUE;
-      depth_stencil_state.front.failOp =
-          VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
-                      uint32_t(description.stencil_front_fail_op));
-      depth_stencil_state.front.passOp =
-          VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
-                      uint32_t(description.stencil_front_pass_op));
-      depth_stencil_state.front.depthFailOp =
-          VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
-                      uint32_t(description.stencil_front_depth_fail_op));
-      depth_stencil_state.front.compareOp =
-          VkCompareOp(uint32_t(VK_COMPARE_OP_NEVER) +
-                      uint32_t(description.stencil_front_compare_op));
-      depth_stencil_state.back.failOp =
-          VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
-                      uint32_t(description.stencil_back_fail_op));
-      depth_stencil_state.back.passOp =
-          VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
-                      uint32_t(description.stencil_back_pass_op));
-      depth_stencil_state.back.depthFailOp =
-          VkStencilOp(uint32_t(VK_STENCIL_OP_KEEP) +
-                      uint32_t(description.stencil_back_depth_fail_op));
-      depth_stencil_state.back.compareOp =
-          VkCompareOp(uint32_t(VK_COMPARE_OP_NEVER) +
-                      uint32_t(description.stencil_back_compare_op));
-    }
+    depth_stencil_state.depthTestEnable = static_state.depth_test_enable;
+    depth_stencil_state.depthWriteEnable = static_state.depth_write_enable;
+    depth_stencil_state.depthCompareOp = static_state.depth_compare_op;
+    depth_stencil_state.stencilTestEnable = static_state.stencil_test_enable;
+    depth_stencil_state.front = static_state.stencil_front;
+    depth_stencil_state.back = static_state.stencil_back;
   }
 
   VkPipelineColorBlendStateCreateInfo color_blend_state = {};
@@ -2246,7 +3201,7 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
     }
   }
 
-  std::array<VkDynamicState, 7> dynamic_states;
+  std::array<VkDynamicState, 14> dynamic_states;
   VkPipelineDynamicStateCreateInfo dynamic_state;
   dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
   dynamic_state.pNext = nullptr;
@@ -2271,6 +3226,22 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
     dynamic_states[dynamic_state.dynamicStateCount++] =
         VK_DYNAMIC_STATE_STENCIL_REFERENCE;
   }
+  if (description.extended_dynamic_state) {
+    dynamic_states[dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_CULL_MODE_EXT;
+    dynamic_states[dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_FRONT_FACE_EXT;
+    dynamic_states[dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT;
+    dynamic_states[dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT;
+    dynamic_states[dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT;
+    dynamic_states[dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE_EXT;
+    dynamic_states[dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_STENCIL_OP_EXT;
+  }
 
   VkGraphicsPipelineCreateInfo pipeline_create_info;
   pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -2294,10 +3265,23 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
   pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
   pipeline_create_info.basePipelineIndex = -1;
 
+  if (graphics_pipeline_library_used_ && allow_libraries) {
+    VkPipeline pipeline = CreatePipelineFromLibraries(
+        description, creation_arguments.pipeline->second.pipeline_layout,
+        pipeline_create_info, shader_stage_fragment.module != VK_NULL_HANDLE,
+        existing_libraries_only);
+    if (pipeline == VK_NULL_HANDLE) {
+      return false;
+    }
+    creation_arguments.pipeline->second.pipeline = pipeline;
+    created_pipeline_count_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
   VkPipeline pipeline;
-  if (dfn.vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1,
+  if (dfn.vkCreateGraphicsPipelines(device, pipeline_cache_object_, 1,
                                     &pipeline_create_info, nullptr,
                                     &pipeline) != VK_SUCCESS) {
     // TODO(Triang3l): Move these error messages outside.
@@ -2313,9 +3297,858 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
     return false;
   }
   creation_arguments.pipeline->second.pipeline = pipeline;
+  created_pipeline_count_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+VkPipeline VulkanPipelineCache::CreatePipelineFromLibraries(
+    const PipelineDescription& description,
+    const PipelineLayoutProvider* pipeline_layout_provider,
+    const VkGraphicsPipelineCreateInfo& pipeline_create_info,
+    bool has_fragment_shader_stage, bool existing_libraries_only) {
+  bool create_libraries = !existing_libraries_only;
+  // The fragment shader, if present, is the last stage.
+  uint32_t pre_rasterization_stage_count =
+      pipeline_create_info.stageCount - uint32_t(has_fragment_shader_stage);
+  uint64_t pipeline_layout_key = uint64_t(uintptr_t(pipeline_layout_provider));
+
+  VkGraphicsPipelineLibraryCreateInfoEXT library_type_create_info;
+  library_type_create_info.sType =
+      VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+  library_type_create_info.pNext = nullptr;
+  // State not belonging to the parts being created is ignored, so sharing the
+  // rest of the create info between all the parts.
+  VkGraphicsPipelineCreateInfo library_create_info = pipeline_create_info;
+  library_create_info.pNext = &library_type_create_info;
+  library_create_info.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+
+  VkPipeline libraries[3];
+  PipelineLibraryKey key;
+
+  key.description.vertex_shader_hash = description.vertex_shader_hash;
+  key.description.vertex_shader_modification =
+      description.vertex_shader_modification;
+  key.description.render_pass_key = description.render_pass_key;
+  key.description.geometry_shader = description.geometry_shader;
+  key.description.primitive_topology = description.primitive_topology;
+  key.description.primitive_restart = description.primitive_restart;
+  key.description.depth_clamp_enable = description.depth_clamp_enable;
+  key.description.polygon_mode = description.polygon_mode;
+  key.description.cull_front = description.cull_front;
+  key.description.cull_back = description.cull_back;
+  key.description.front_face_clockwise = description.front_face_clockwise;
+  key.description.extended_dynamic_state = description.extended_dynamic_state;
+  key.pipeline_layout = pipeline_layout_key;
+  key.part = PipelineLibraryPart::kPreRasterization;
+  library_type_create_info.flags =
+      VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT |
+      VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+  library_create_info.stageCount = pre_rasterization_stage_count;
+  library_create_info.pStages = pipeline_create_info.pStages;
+  libraries[0] =
+      GetPipelineLibrary(key, library_create_info, create_libraries);
+  if (libraries[0] == VK_NULL_HANDLE) {
+    return VK_NULL_HANDLE;
+  }
+
+  key.Reset();
+  key.description.pixel_shader_hash = description.pixel_shader_hash;
+  key.description.pixel_shader_modification =
+      description.pixel_shader_modification;
+  key.description.render_pass_key = description.render_pass_key;
+  key.description.depth_write_enable = description.depth_write_enable;
+  key.description.depth_compare_op = description.depth_compare_op;
+  key.description.stencil_test_enable = description.stencil_test_enable;
+  key.description.stencil_front_fail_op = description.stencil_front_fail_op;
+  key.description.stencil_front_pass_op = description.stencil_front_pass_op;
+  key.description.stencil_front_depth_fail_op =
+      description.stencil_front_depth_fail_op;
+  key.description.stencil_front_compare_op =
+      description.stencil_front_compare_op;
+  key.description.stencil_back_fail_op = description.stencil_back_fail_op;
+  key.description.stencil_back_pass_op = description.stencil_back_pass_op;
+  key.description.stencil_back_depth_fail_op =
+      description.stencil_back_depth_fail_op;
+  key.description.stencil_back_compare_op =
+      description.stencil_back_compare_op;
+  key.description.extended_dynamic_state = description.extended_dynamic_state;
+  key.pipeline_layout = pipeline_layout_key;
+  key.part = PipelineLibraryPart::kFragmentShader;
+  library_type_create_info.flags =
+      VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+  library_create_info.stageCount = uint32_t(has_fragment_shader_stage);
+  library_create_info.pStages =
+      pipeline_create_info.pStages + pre_rasterization_stage_count;
+  libraries[1] =
+      GetPipelineLibrary(key, library_create_info, create_libraries);
+  if (libraries[1] == VK_NULL_HANDLE) {
+    return VK_NULL_HANDLE;
+  }
+
+  key.Reset();
+  key.description.render_pass_key = description.render_pass_key;
+  std::memcpy(key.description.render_targets, description.render_targets,
+              sizeof(description.render_targets));
+  key.part = PipelineLibraryPart::kFragmentOutput;
+  library_type_create_info.flags =
+      VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+  library_create_info.stageCount = 0;
+  library_create_info.pStages = nullptr;
+  library_create_info.layout = VK_NULL_HANDLE;
+  libraries[2] =
+      GetPipelineLibrary(key, library_create_info, create_libraries);
+  if (libraries[2] == VK_NULL_HANDLE) {
+    return VK_NULL_HANDLE;
+  }
+
+  // Fast linking without link-time optimization, so only the state that
+  // actually changed is compiled.
+  VkPipelineLibraryCreateInfoKHR library_link_info;
+  library_link_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+  library_link_info.pNext = nullptr;
+  library_link_info.libraryCount = uint32_t(xe::countof(libraries));
+  library_link_info.pLibraries = libraries;
+  VkGraphicsPipelineCreateInfo link_create_info = {};
+  link_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  link_create_info.pNext = &library_link_info;
+  link_create_info.layout = pipeline_create_info.layout;
+  link_create_info.renderPass = pipeline_create_info.renderPass;
+  link_create_info.subpass = pipeline_create_info.subpass;
+  link_create_info.basePipelineIndex = -1;
+
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  VkPipeline pipeline;
+  if (dfn.vkCreateGraphicsPipelines(device, pipeline_cache_object_, 1,
+                                    &link_create_info, nullptr,
+                                    &pipeline) != VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+  return pipeline;
+}
+
+VkPipeline VulkanPipelineCache::GetPipelineLibrary(
+    const PipelineLibraryKey& key,
+    const VkGraphicsPipelineCreateInfo& library_create_info,
+    bool create_if_missing) {
+  {
+    std::lock_guard<std::mutex> lock(pipeline_libraries_mutex_);
+    auto it = pipeline_libraries_.find(key);
+    if (it != pipeline_libraries_.end()) {
+      return it->second;
+    }
+  }
+  if (!create_if_missing) {
+    return VK_NULL_HANDLE;
+  }
+  // Creating outside the lock so other threads can link pipelines from
+  // existing libraries meanwhile.
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  VkPipeline library;
+  if (dfn.vkCreateGraphicsPipelines(device, pipeline_cache_object_, 1,
+                                    &library_create_info, nullptr,
+                                    &library) != VK_SUCCESS) {
+    library = VK_NULL_HANDLE;
+  }
+  std::lock_guard<std::mutex> lock(pipeline_libraries_mutex_);
+  auto emplace_result = pipeline_libraries_.emplace(key, library);
+  if (!emplace_result.second) {
+    // Created by another thread meanwhile.
+    if (library != VK_NULL_HANDLE) {
+      dfn.vkDestroyPipeline(device, library, nullptr);
+    }
+    return emplace_result.first->second;
+  }
+  return library;
+}
+
+void VulkanPipelineCache::CreatePipeline(
+    const PipelineCreationArguments& creation_arguments) {
+  EnsurePipelineCreated(creation_arguments);
+  creation_arguments.pipeline->second.creation_completed.store(
+      true, std::memory_order_release);
+}
+
+void VulkanPipelineCache::CreationThread(size_t thread_index,
+                                         size_t thread_count) {
+  while (true) {
+    PipelineCreationArguments pipeline_to_create;
+
+    // Check if need to shut down or set the completion event and dequeue the
+    // pipeline if there is any.
+    {
+      std::unique_lock<xe_mutex> lock(creation_request_lock_);
+      if (thread_index >= creation_threads_shutdown_from_ ||
+          creation_queue_.empty()) {
+        if (creation_completion_set_event_ && creation_threads_busy_ == 0) {
+          // Last pipeline in the queue created - signal the event if requested.
+          creation_completion_set_event_ = false;
+          creation_completion_event_->Set();
+        }
+        if (thread_index >= creation_threads_shutdown_from_) {
+          return;
+        }
+        creation_request_cond_.wait(lock);
+        continue;
+      }
+      // Paused while the device is overheating. Sleeping rather than waiting
+      // for the condition variable not to take the notifications from the
+      // threads still allowed to run.
+      if (thread_index >=
+          xe::device_profile::GetAllowedWorkerCount(uint32_t(thread_count))) {
+        lock.unlock();
+        xe::threading::Sleep(std::chrono::milliseconds(100));
+        continue;
+      }
+      // Take the pipeline from the queue and increment the busy thread count
+      // until the pipeline is created - other threads must be able to dequeue
+      // requests, but can't set the completion event until the pipelines are
+      // fully created (rather than just started creating).
+      pipeline_to_create = creation_queue_.front();
+      creation_queue_.pop_front();
+      ++creation_threads_busy_;
+    }
+
+    CreatePipeline(pipeline_to_create);
+
+    // Pipeline created - the thread is not busy anymore, safe to set the
+    // completion event if needed (at the next iteration, or in some other
+    // thread).
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      --creation_threads_busy_;
+    }
+  }
+}
+
+void VulkanPipelineCache::CreateQueuedPipelinesOnProcessorThread() {
+  assert_false(creation_threads_.empty());
+  while (true) {
+    PipelineCreationArguments pipeline_to_create;
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      if (creation_queue_.empty()) {
+        break;
+      }
+      pipeline_to_create = creation_queue_.front();
+      creation_queue_.pop_front();
+    }
+    CreatePipeline(pipeline_to_create);
+  }
+}
+
+bool VulkanPipelineCache::GetStoredPipelineCreationArguments(
+    const PipelineDescription& description,
+    PipelineCreationArguments& creation_arguments_out) {
+  const PipelineLayoutProvider* pipeline_layout;
+  if (!LookUpPipelineCreationArguments(description, creation_arguments_out,
+                                       pipeline_layout)) {
+    return false;
+  }
+  creation_arguments_out.pipeline =
+      &*pipelines_
+            .emplace(std::piecewise_construct,
+                     std::forward_as_tuple(description),
+                     std::forward_as_tuple(pipeline_layout))
+            .first;
+  return true;
+}
+
+bool VulkanPipelineCache::LookUpPipelineCreationArguments(
+    const PipelineDescription& description,
+    PipelineCreationArguments& creation_arguments_out,
+    const PipelineLayoutProvider*& pipeline_layout_out) {
+  if (!ArePipelineRequirementsMet(description)) {
+    return false;
+  }
+  auto vertex_shader_it = shaders_.find(description.vertex_shader_hash);
+  if (vertex_shader_it == shaders_.end()) {
+    return false;
+  }
+  const VulkanShader& vertex_shader = *vertex_shader_it->second;
+  auto vertex_shader_translation =
+      static_cast<const VulkanShader::VulkanTranslation*>(
+          vertex_shader.GetTranslation(description.vertex_shader_modification));
+  if (!vertex_shader_translation ||
+      !vertex_shader_translation->is_translated() ||
+      !vertex_shader_translation->is_valid()) {
+    return false;
+  }
+  const VulkanShader* pixel_shader = nullptr;
+  const VulkanShader::VulkanTranslation* pixel_shader_translation = nullptr;
+  if (description.pixel_shader_hash) {
+    auto pixel_shader_it = shaders_.find(description.pixel_shader_hash);
+    if (pixel_shader_it == shaders_.end()) {
+      return false;
+    }
+    pixel_shader = pixel_shader_it->second;
+    pixel_shader_translation =
+        static_cast<const VulkanShader::VulkanTranslation*>(
+            pixel_shader->GetTranslation(
+                description.pixel_shader_modification));
+    if (!pixel_shader_translation ||
+        !pixel_shader_translation->is_translated() ||
+        !pixel_shader_translation->is_valid()) {
+      return false;
+    }
+  }
+
+  const PipelineLayoutProvider* pipeline_layout =
+      command_processor_.GetPipelineLayout(
+          pixel_shader
+              ? pixel_shader->GetTextureBindingsAfterTranslation().size()
+              : 0,
+          pixel_shader
+              ? pixel_shader->GetSamplerBindingsAfterTranslation().size()
+              : 0,
+          vertex_shader.GetTextureBindingsAfterTranslation().size(),
+          vertex_shader.GetSamplerBindingsAfterTranslation().size());
+  if (!pipeline_layout) {
+    return false;
+  }
+  VkShaderModule geometry_shader = VK_NULL_HANDLE;
+  GeometryShaderKey geometry_shader_key;
+  if (GetGeometryShaderKey(
+          description.geometry_shader,
+          SpirvShaderTranslator::Modification(
+              description.vertex_shader_modification),
+          SpirvShaderTranslator::Modification(
+              description.pixel_shader_modification),
+          geometry_shader_key)) {
+    geometry_shader = GetGeometryShader(geometry_shader_key);
+    if (geometry_shader == VK_NULL_HANDLE) {
+      return false;
+    }
+  }
+  VkRenderPass render_pass =
+      render_target_cache_.GetPath() ==
+              RenderTargetCache::Path::kPixelShaderInterlock
+          ? render_target_cache_.GetFragmentShaderInterlockRenderPass()
+          : render_target_cache_.GetHostRenderTargetsRenderPass(
+                description.render_pass_key);
+  if (render_pass == VK_NULL_HANDLE) {
+    return false;
+  }
+
+  creation_arguments_out.pipeline = nullptr;
+  creation_arguments_out.vertex_shader = vertex_shader_translation;
+  creation_arguments_out.pixel_shader = pixel_shader_translation;
+  creation_arguments_out.geometry_shader = geometry_shader;
+  creation_arguments_out.render_pass = render_pass;
+  pipeline_layout_out = pipeline_layout;
   return true;
 }
 
+void VulkanPipelineCache::LoadOptimizedShaderStorage(
+    const std::filesystem::path& file_path) {
+  std::lock_guard<std::mutex> lock(optimization_storage_mutex_);
+  assert_null(optimized_shader_storage_file_);
+  FILE* file = xe::filesystem::OpenFile(file_path, "a+b");
+  if (!file) {
+    XELOGW(
+        "Failed to open the optimized shader storage file, the optimized "
+        "shaders will not be stored: {}",
+        xe::path_to_utf8(file_path));
+    return;
+  }
+  uint64_t valid_bytes = 0;
+  OptimizedShaderStorageFileHeader file_header;
+  if (fread(&file_header, sizeof(file_header), 1, file) &&
+      file_header.magic == OptimizedShaderStorageFileHeader::kMagic &&
+      file_header.version == OptimizedShaderStorageFileHeader::kVersion) {
+    valid_bytes = sizeof(file_header);
+    OptimizedShaderStoredHeader shader_header;
+    std::vector<uint32_t> optimized_code;
+    while (fread(&shader_header, sizeof(shader_header), 1, file)) {
+      // Not loading anything unreasonably large if the file is corrupted.
+      if (!shader_header.optimized_word_count ||
+          shader_header.optimized_word_count > (UINT32_C(1) << 24)) {
+        break;
+      }
+      optimized_code.resize(shader_header.optimized_word_count);
+      if (!fread(optimized_code.data(),
+                 sizeof(uint32_t) * optimized_code.size(), 1, file) ||
+          XXH3_64bits(optimized_code.data(),
+                      sizeof(uint32_t) * optimized_code.size()) !=
+              shader_header.optimized_hash) {
+        break;
+      }
+      valid_bytes += sizeof(shader_header) +
+                     sizeof(uint32_t) * shader_header.optimized_word_count;
+      optimized_shaders_stored_[shader_header.unoptimized_hash] =
+          std::move(optimized_code);
+    }
+  }
+  // Drop the corrupted or the incompletely written tail, or start a new file.
+  xe::filesystem::TruncateStdioFile(file, valid_bytes);
+  if (!valid_bytes) {
+    file_header.magic = OptimizedShaderStorageFileHeader::kMagic;
+    file_header.version = OptimizedShaderStorageFileHeader::kVersion;
+    fwrite(&file_header, sizeof(file_header), 1, file);
+    fflush(file);
+  }
+  optimized_shader_storage_file_ = file;
+  if (!optimized_shaders_stored_.empty()) {
+    XELOGGPU("Loaded {} optimized shaders from the storage",
+             optimized_shaders_stored_.size());
+  }
+}
+
+void VulkanPipelineCache::RequestShaderOptimization(
+    VulkanShader::VulkanTranslation& translation, uint64_t unoptimized_hash) {
+  assert_not_null(optimization_thread_);
+  {
+    std::lock_guard<std::mutex> lock(optimization_request_lock_);
+    optimization_queue_.push_back({&translation, unoptimized_hash});
+  }
+  optimization_request_cond_.notify_all();
+}
+
+void VulkanPipelineCache::UpdateOptimizedShaders() {
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+
+  uint64_t completed_submission = command_processor_.GetCompletedSubmission();
+  while (!retired_pipelines_.empty() &&
+         retired_pipelines_.front().second <= completed_submission) {
+    dfn.vkDestroyPipeline(device, retired_pipelines_.front().first, nullptr);
+    retired_pipelines_.pop_front();
+  }
+
+  std::vector<std::unique_ptr<PipelineReplacement>> replacements_created;
+  std::vector<ShaderOptimizationResult> optimization_results;
+  {
+    std::lock_guard<std::mutex> lock(optimization_request_lock_);
+    replacements_created.swap(replacements_created_);
+    optimization_results.swap(optimization_results_);
+  }
+
+  // The pipelines may still be referenced by the command buffers of the
+  // current submission, which has just been ended.
+  uint64_t current_submission = command_processor_.GetCurrentSubmission();
+  for (const std::unique_ptr<PipelineReplacement>& replacement :
+       replacements_created) {
+    VkPipeline optimized_pipeline = replacement->replacement.second.pipeline;
+    if (optimized_pipeline == VK_NULL_HANDLE) {
+      continue;
+    }
+    Pipeline& target = replacement->target->second;
+    retired_pipelines_.emplace_back(target.pipeline, current_submission);
+    target.pipeline = optimized_pipeline;
+  }
+
+  if (optimization_results.empty()) {
+    return;
+  }
+  std::vector<const VulkanShader::VulkanTranslation*> optimized_translations;
+  for (const ShaderOptimizationResult& result : optimization_results) {
+    if (result.translation->SetOptimizedShaderModuleCode(
+            result.optimized_code.data(), result.optimized_code.size())) {
+      optimized_translations.push_back(result.translation);
+    }
+  }
+  if (optimized_translations.empty()) {
+    return;
+  }
+  auto is_optimized_shader = [&](uint64_t shader_hash,
+                                 uint64_t shader_modification) {
+    for (const VulkanShader::VulkanTranslation* translation :
+         optimized_translations) {
+      if (translation->shader().ucode_data_hash() == shader_hash &&
+          translation->modification() == shader_modification) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // New pipelines must not be linked from the libraries with the unoptimized
+  // shaders. No pipelines are being linked from them currently, and the
+  // linked pipelines don't depend on the libraries being alive.
+  if (graphics_pipeline_library_used_) {
+    std::lock_guard<std::mutex> lock(pipeline_libraries_mutex_);
+    for (auto it = pipeline_libraries_.begin();
+         it != pipeline_libraries_.end();) {
+      const PipelineDescription& library_description = it->first.description;
+      bool library_shader_optimized = false;
+      switch (it->first.part) {
+        case PipelineLibraryPart::kPreRasterization:
+          library_shader_optimized = is_optimized_shader(
+              library_description.vertex_shader_hash,
+              library_description.vertex_shader_modification);
+          break;
+        case PipelineLibraryPart::kFragmentShader:
+          library_shader_optimized =
+              library_description.pixel_shader_hash &&
+              is_optimized_shader(
+                  library_description.pixel_shader_hash,
+                  library_description.pixel_shader_modification);
+          break;
+        default:
+          break;
+      }
+      if (!library_shader_optimized) {
+        ++it;
+        continue;
+      }
+      if (it->second != VK_NULL_HANDLE) {
+        dfn.vkDestroyPipeline(device, it->second, nullptr);
+      }
+      it = pipeline_libraries_.erase(it);
+    }
+  }
+
+  // Recreate the existing pipelines with the optimized shaders.
+  std::vector<std::unique_ptr<PipelineReplacement>> replacements;
+  for (auto& pipeline_pair : pipelines_) {
+    const PipelineDescription& description = pipeline_pair.first;
+    if (!pipeline_pair.second.creation_completed.load(
+            std::memory_order_acquire) ||
+        pipeline_pair.second.pipeline == VK_NULL_HANDLE) {
+      continue;
+    }
+    if (!is_optimized_shader(description.vertex_shader_hash,
+                             description.vertex_shader_modification) &&
+        (!description.pixel_shader_hash ||
+         !is_optimized_shader(description.pixel_shader_hash,
+                              description.pixel_shader_modification))) {
+      continue;
+    }
+    PipelineCreationArguments creation_arguments;
+    const PipelineLayoutProvider* pipeline_layout;
+    if (!LookUpPipelineCreationArguments(description, creation_arguments,
+                                         pipeline_layout)) {
+      continue;
+    }
+    replacements.push_back(std::make_unique<PipelineReplacement>(
+        pipeline_pair, creation_arguments));
+  }
+  if (replacements.empty()) {
+    return;
+  }
+  XELOGGPU("Recreating {} graphics pipelines with optimized shaders",
+           replacements.size());
+  {
+    std::lock_guard<std::mutex> lock(optimization_request_lock_);
+    for (std::unique_ptr<PipelineReplacement>& replacement : replacements) {
+      replacement_queue_.push_back(std::move(replacement));
+    }
+  }
+  optimization_request_cond_.notify_all();
+}
+
+void VulkanPipelineCache::OptimizationThread() {
+  while (true) {
+    std::unique_ptr<PipelineReplacement> replacement;
+    ShaderOptimizationRequest request;
+    {
+      std::unique_lock<std::mutex> lock(optimization_request_lock_);
+      if (optimization_thread_shutdown_) {
+        return;
+      }
+      // Replacing the pipelines first for the results of the optimization to
+      // be visible sooner.
+      if (!replacement_queue_.empty()) {
+        replacement = std::move(replacement_queue_.front());
+        replacement_queue_.pop_front();
+      } else if (!optimization_queue_.empty()) {
+        request = optimization_queue_.front();
+        optimization_queue_.pop_front();
+      } else {
+        optimization_request_cond_.wait(lock);
+        continue;
+      }
+    }
+
+    if (replacement) {
+      {
+        std::lock_guard<std::mutex> lock(optimization_storage_mutex_);
+        // Not from the libraries, which are linked without link-time
+        // optimization, and with the pipeline libraries not being created
+        // while the command processor thread may be awaiting them.
+        EnsurePipelineCreated(replacement->creation_arguments, false, false);
+      }
+      replacement->replacement.second.creation_completed.store(
+          true, std::memory_order_release);
+      std::lock_guard<std::mutex> lock(optimization_request_lock_);
+      replacements_created_.push_back(std::move(replacement));
+      continue;
+    }
+
+    const std::vector<uint8_t>& translated_binary =
+        request.translation->translated_binary();
+    std::vector<uint32_t> optimized_code;
+    if (optimization_spirv_tools_->Optimize(
+            reinterpret_cast<const uint32_t*>(translated_binary.data()),
+            translated_binary.size() / sizeof(uint32_t),
+            optimized_code) != SPV_SUCCESS ||
+        optimized_code.empty()) {
+      XELOGW(
+          "Failed to optimize shader {:016X} modification {:016X}, keeping it "
+          "unoptimized",
+          request.translation->shader().ucode_data_hash(),
+          request.translation->modification());
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(optimization_storage_mutex_);
+      if (optimized_shader_storage_file_) {
+        OptimizedShaderStoredHeader shader_header;
+        shader_header.unoptimized_hash = request.unoptimized_hash;
+        shader_header.optimized_hash = XXH3_64bits(
+            optimized_code.data(), sizeof(uint32_t) * optimized_code.size());
+        shader_header.optimized_word_count = uint32_t(optimized_code.size());
+        shader_header.reserved = 0;
+        fwrite(&shader_header, sizeof(shader_header), 1,
+               optimized_shader_storage_file_);
+        fwrite(optimized_code.data(), sizeof(uint32_t) * optimized_code.size(),
+               1, optimized_shader_storage_file_);
+        fflush(optimized_shader_storage_file_);
+      }
+    }
+    std::lock_guard<std::mutex> lock(optimization_request_lock_);
+    optimization_results_.push_back(
+        {request.translation, std::move(optimized_code)});
+  }
+}
+
+void VulkanPipelineCache::LoadPipelineCacheObject(
+    const std::filesystem::path& file_path) {
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  const VkPhysicalDeviceProperties& device_properties =
+      provider.device_properties();
+
+  // The optimization thread may be creating pipelines with it.
+  std::lock_guard<std::mutex> lock(optimization_storage_mutex_);
+  assert_true(pipeline_cache_object_ == VK_NULL_HANDLE);
+  pipeline_cache_object_file_path_ = file_path;
+
+  // The data is passed to the driver only if it was written for this device by
+  // this driver version, as not all drivers validate it reliably.
+  std::vector<uint8_t> data;
+  FILE* file = xe::filesystem::OpenFile(file_path, "rb");
+  if (file) {
+    PipelineCacheObjectFileHeader file_header;
+    if (fread(&file_header, sizeof(file_header), 1, file) &&
+        file_header.magic == PipelineCacheObjectFileHeader::kMagic &&
+        file_header.data_size >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+        file_header.data_size <= PipelineCacheObjectFileHeader::kMaxDataSize) {
+      data.resize(size_t(file_header.data_size));
+      if (!fread(data.data(), data.size(), 1, file) ||
+          XXH3_64bits(data.data(), data.size()) != file_header.data_hash) {
+        data.clear();
+      }
+    }
+    fclose(file);
+  }
+  if (!data.empty()) {
+    VkPipelineCacheHeaderVersionOne data_header;
+    std::memcpy(&data_header, data.data(), sizeof(data_header));
+    if (data_header.headerSize < sizeof(data_header) ||
+        data_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        data_header.vendorID != device_properties.vendorID ||
+        data_header.deviceID != device_properties.deviceID ||
+        std::memcmp(data_header.pipelineCacheUUID,
+                    device_properties.pipelineCacheUUID, VK_UUID_SIZE)) {
+      XELOGGPU(
+          "Discarding the Vulkan pipeline cache created for a different device "
+          "or driver version");
+      data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo pipeline_cache_create_info;
+  pipeline_cache_create_info.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  pipeline_cache_create_info.pNext = nullptr;
+  pipeline_cache_create_info.flags = 0;
+  pipeline_cache_create_info.initialDataSize = data.size();
+  pipeline_cache_create_info.pInitialData = data.data();
+  if (dfn.vkCreatePipelineCache(device, &pipeline_cache_create_info, nullptr,
+                                &pipeline_cache_object_) != VK_SUCCESS) {
+    pipeline_cache_object_ = VK_NULL_HANDLE;
+    if (!data.empty()) {
+      pipeline_cache_create_info.initialDataSize = 0;
+      pipeline_cache_create_info.pInitialData = nullptr;
+      if (dfn.vkCreatePipelineCache(device, &pipeline_cache_create_info,
+                                    nullptr, &pipeline_cache_object_) !=
+          VK_SUCCESS) {
+        pipeline_cache_object_ = VK_NULL_HANDLE;
+      }
+    }
+  }
+  if (pipeline_cache_object_ == VK_NULL_HANDLE) {
+    XELOGW("Failed to create the Vulkan pipeline cache object");
+    pipeline_cache_object_file_path_.clear();
+    return;
+  }
+  if (!data.empty()) {
+    XELOGGPU("Loaded {} bytes of the Vulkan pipeline cache", data.size());
+  }
+}
+
+void VulkanPipelineCache::StorePipelineCacheObject() {
+  if (pipeline_cache_object_ == VK_NULL_HANDLE) {
+    return;
+  }
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+
+  // The optimization thread may be creating pipelines with it.
+  std::lock_guard<std::mutex> lock(optimization_storage_mutex_);
+  std::vector<uint8_t> data;
+  size_t data_size = 0;
+  if (!pipeline_cache_object_file_path_.empty() &&
+      dfn.vkGetPipelineCacheData(device, pipeline_cache_object_, &data_size,
+                                 nullptr) == VK_SUCCESS &&
+      data_size >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+      data_size <= PipelineCacheObjectFileHeader::kMaxDataSize) {
+    data.resize(data_size);
+    if (dfn.vkGetPipelineCacheData(device, pipeline_cache_object_, &data_size,
+                                   data.data()) != VK_SUCCESS) {
+      data.clear();
+    } else {
+      data.resize(data_size);
+    }
+  }
+  ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyPipelineCache, device,
+                                         pipeline_cache_object_);
+
+  if (!data.empty()) {
+    // Written to a temporary file first not to leave a partially written cache
+    // if the emulator is terminated.
+    std::filesystem::path temp_file_path = pipeline_cache_object_file_path_;
+    temp_file_path += ".tmp";
+    FILE* file = xe::filesystem::OpenFile(temp_file_path, "wb");
+    if (file) {
+      PipelineCacheObjectFileHeader file_header;
+      file_header.magic = PipelineCacheObjectFileHeader::kMagic;
+      file_header.reserved = 0;
+      file_header.data_size = data.size();
+      file_header.data_hash = XXH3_64bits(data.data(), data.size());
+      bool written =
+          fwrite(&file_header, sizeof(file_header), 1, file) &&
+          fwrite(data.data(), data.size(), 1, file);
+      fclose(file);
+      std::error_code error_code;
+      if (written) {
+        std::filesystem::rename(temp_file_path,
+                                pipeline_cache_object_file_path_, error_code);
+      }
+      if (!written || error_code) {
+        XELOGW("Failed to write the Vulkan pipeline cache to {}",
+               xe::path_to_utf8(pipeline_cache_object_file_path_));
+        std::filesystem::remove(temp_file_path, error_code);
+      }
+    }
+  }
+  pipeline_cache_object_file_path_.clear();
+}
+
+void VulkanPipelineCache::StorageWriteThread() {
+  ShaderStoredHeader shader_header;
+  // Don't leak anything in unused bits.
+  std::memset(&shader_header, 0, sizeof(shader_header));
+
+  std::vector<uint32_t> ucode_guest_endian;
+  ucode_guest_endian.reserve(0xFFFF);
+  std::vector<uint8_t> ucode_analysis;
+
+  bool flush_shaders = false;
+  bool flush_pipelines = false;
+
+  while (true) {
+    if (flush_shaders) {
+      flush_shaders = false;
+      assert_not_null(shader_storage_file_);
+      fflush(shader_storage_file_);
+    }
+    if (flush_pipelines) {
+      flush_pipelines = false;
+      assert_not_null(pipeline_storage_file_);
+      fflush(pipeline_storage_file_);
+    }
+
+    const Shader* shader = nullptr;
+    PipelineStoredDescription pipeline_description;
+    bool write_pipeline = false;
+    {
+      std::unique_lock<std::mutex> lock(storage_write_request_lock_);
+      if (storage_write_thread_shutdown_) {
+        return;
+      }
+      if (!storage_write_shader_queue_.empty()) {
+        shader = storage_write_shader_queue_.front();
+        storage_write_shader_queue_.pop_front();
+      } else if (storage_write_flush_shaders_) {
+        storage_write_flush_shaders_ = false;
+        flush_shaders = true;
+      }
+      if (!storage_write_pipeline_queue_.empty()) {
+        std::memcpy(&pipeline_description,
+                    &storage_write_pipeline_queue_.front(),
+                    sizeof(pipeline_description));
+        storage_write_pipeline_queue_.pop_front();
+        write_pipeline = true;
+      } else if (storage_write_flush_pipelines_) {
+        storage_write_flush_pipelines_ = false;
+        flush_pipelines = true;
+      }
+      if (!shader && !write_pipeline) {
+        storage_write_request_cond_.wait(lock);
+        continue;
+      }
+    }
+
+    if (shader) {
+      shader_header.ucode_data_hash = shader->ucode_data_hash();
+      shader_header.ucode_dword_count = shader->ucode_dword_count();
+      shader_header.type = shader->type();
+      // Shaders are queued for writing after being analyzed, and the analysis
+      // results aren't modified afterwards.
+      ucode_analysis.clear();
+      if (shader->is_ucode_analyzed()) {
+        shader->SerializeUcodeAnalysis(ucode_analysis);
+      }
+      shader_header.ucode_analysis_size = uint32_t(ucode_analysis.size());
+      assert_not_null(shader_storage_file_);
+      fwrite(&shader_header, sizeof(shader_header), 1, shader_storage_file_);
+      if (shader_header.ucode_dword_count) {
+        ucode_guest_endian.resize(shader_header.ucode_dword_count);
+        // Need to swap because the hash is calculated for the shader with guest
+        // endianness.
+        xe::copy_and_swap(ucode_guest_endian.data(), shader->ucode_dwords(),
+                          shader_header.ucode_dword_count);
+        fwrite(ucode_guest_endian.data(),
+               shader_header.ucode_dword_count * sizeof(uint32_t), 1,
+               shader_storage_file_);
+      }
+      if (shader_header.ucode_analysis_size) {
+        fwrite(ucode_analysis.data(), shader_header.ucode_analysis_size, 1,
+               shader_storage_file_);
+      }
+    }
+
+    if (write_pipeline) {
+      assert_not_null(pipeline_storage_file_);
+      fwrite(&pipeline_description, sizeof(pipeline_description), 1,
+             pipeline_storage_file_);
+    }
+  }
+}
+
 }  // namespace vulkan
 }  // namespace gpu
 }  // namespace xe
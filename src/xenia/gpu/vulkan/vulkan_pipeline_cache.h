@@ -10,15 +10,26 @@
 #ifndef XENIA_GPU_VULKAN_VULKAN_PIPELINE_STATE_CACHE_H_
 #define XENIA_GPU_VULKAN_VULKAN_PIPELINE_STATE_CACHE_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <filesystem>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/hash.h"
+#include "xenia/base/mutex.h"
 #include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
 #include "xenia/base/xxhash.h"
 #include "xenia/gpu/primitive_processor.h"
 #include "xenia/gpu/register_file.h"
@@ -27,8 +38,11 @@
 #include "xenia/gpu/vulkan/vulkan_render_target_cache.h"
 #include "xenia/gpu/vulkan/vulkan_shader.h"
 #include "xenia/gpu/xenos.h"
+#include "xenia/ui/vulkan/spirv_tools_context.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 
+DECLARE_bool(vulkan_skip_draws_until_pipeline_created);
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
@@ -59,6 +73,19 @@ class VulkanPipelineCache {
   bool Initialize();
   void Shutdown();
 
+  void InitializeShaderStorage(const std::filesystem::path& cache_root,
+                               uint32_t title_id, bool blocking);
+  void ShutdownShaderStorage();
+
+  void EndSubmission();
+  bool IsCreatingPipelines();
+  // Pipelines queued or being created by the creation threads.
+  uint32_t GetPendingPipelineCount();
+  // Pipelines created since the cache was set up, by any thread.
+  uint64_t created_pipeline_count() const {
+    return created_pipeline_count_.load(std::memory_order_relaxed);
+  }
+
   VulkanShader* LoadShader(xenos::ShaderType shader_type,
                            const uint32_t* host_address, uint32_t dword_count);
   // Analyze shader microcode on the translator thread.
@@ -76,9 +103,31 @@ class VulkanPipelineCache {
       const Shader& shader, uint32_t interpolator_mask,
       uint32_t param_gen_pos) const;
 
+  // Culling and depth / stencil state set dynamically with
+  // VK_EXT_extended_dynamic_state instead of being baked into the pipelines.
+  struct ExtendedDynamicState {
+    VkCullModeFlags cull_mode;
+    VkFrontFace front_face;
+    VkBool32 depth_test_enable;
+    VkBool32 depth_write_enable;
+    VkCompareOp depth_compare_op;
+    VkBool32 stencil_test_enable;
+    // Only the operations and the compare function, the masks and the
+    // reference are set separately.
+    VkStencilOpState stencil_front;
+    VkStencilOpState stencil_back;
+  };
+
+  bool IsExtendedDynamicStateUsed() const {
+    return extended_dynamic_state_used_;
+  }
+
   bool EnsureShadersTranslated(VulkanShader::VulkanTranslation* vertex_shader,
                                VulkanShader::VulkanTranslation* pixel_shader);
-  // TODO(Triang3l): Return a deferred creation handle.
+  // Returns a handle of a pipeline with potentially deferred creation - with
+  // creation threads, the pipeline is only guaranteed to be created (or to
+  // have failed to be created) after EndSubmission. The extended dynamic state
+  // is written only if it's used.
   bool ConfigurePipeline(
       VulkanShader::VulkanTranslation* vertex_shader,
       VulkanShader::VulkanTranslation* pixel_shader,
@@ -86,10 +135,50 @@ class VulkanPipelineCache {
       reg::RB_DEPTHCONTROL normalized_depth_control,
       uint32_t normalized_color_mask,
       VulkanRenderTargetCache::RenderPassKey render_pass_key,
-      VkPipeline& pipeline_out,
-      const PipelineLayoutProvider*& pipeline_layout_out);
+      const void*& pipeline_handle_out,
+      const PipelineLayoutProvider*& pipeline_layout_out,
+      ExtendedDynamicState& extended_dynamic_state_out);
+
+  // Pipeline lookups, and those that needed a new pipeline to be created, since
+  // the last reset, for benchmarking.
+  uint32_t pipeline_lookup_count() const { return pipeline_lookup_count_; }
+  uint32_t pipeline_miss_count() const { return pipeline_miss_count_; }
+  void ResetPipelineLookupCounts() {
+    pipeline_lookup_count_ = 0;
+    pipeline_miss_count_ = 0;
+  }
+
+  // Returns a pipeline with deferred creation by its handle. May return
+  // VK_NULL_HANDLE if failed to create the pipeline. Must not be called before
+  // the creation is completed.
+  VkPipeline GetVulkanPipelineByHandle(const void* handle) const {
+    const Pipeline& pipeline = *static_cast<const Pipeline*>(handle);
+    assert_true(pipeline.creation_completed.load(std::memory_order_relaxed));
+    return pipeline.pipeline;
+  }
+  // Whether the pipeline has been created or has failed to be created, thus
+  // drawing with it in the current submission doesn't need waiting.
+  bool IsPipelineCreationCompleted(const void* handle) const {
+    return static_cast<const Pipeline*>(handle)->creation_completed.load(
+        std::memory_order_acquire);
+  }
 
  private:
+  // Same as in the Direct3D 12 pipeline cache, the guest shader storage file is
+  // shared between the backends.
+  XEPACKEDSTRUCT(ShaderStoredHeader, {
+    uint64_t ucode_data_hash;
+
+    uint32_t ucode_dword_count : 31;
+    xenos::ShaderType type : 1;
+
+    // Size of the Shader::SerializeUcodeAnalysis data following the ucode, or
+    // 0 if not stored.
+    uint32_t ucode_analysis_size;
+
+    static constexpr uint32_t kVersion = 0x20241016;
+  });
+
   enum class PipelineGeometryShader : uint32_t {
     kNone,
     kPointList,
@@ -175,6 +264,9 @@ class VulkanPipelineCache {
     xenos::StencilOp stencil_back_pass_op : 3;           // 3
     xenos::StencilOp stencil_back_depth_fail_op : 3;     // 6
     xenos::CompareFunction stencil_back_compare_op : 3;  // 9
+    // If set, culling and depth / stencil state are dynamic, and their fields
+    // are zero.
+    uint32_t extended_dynamic_state : 1;  // 10
 
     // Filled only for the attachments present in the render pass object.
     PipelineRenderTarget render_targets[xenos::kMaxColorRenderTargets];
@@ -198,6 +290,80 @@ class VulkanPipelineCache {
         return size_t(description.GetHash());
       }
     };
+
+    static constexpr uint32_t kVersion = 0x20241015;
+  });
+
+  XEPACKEDSTRUCT(PipelineStoredDescription, {
+    uint64_t description_hash;
+    PipelineDescription description;
+  });
+
+  // Header of the local file containing the optimized versions of the
+  // translated shaders, identified by the hashes of the unoptimized binaries,
+  // so they're used only if the translation is still the same.
+  struct OptimizedShaderStorageFileHeader {
+    // 'XESO'.
+    static constexpr uint32_t kMagic = 0x4F534558;
+    static constexpr uint32_t kVersion = 0x20241101;
+    uint32_t magic;
+    uint32_t version;
+  };
+  struct OptimizedShaderStoredHeader {
+    uint64_t unoptimized_hash;
+    uint64_t optimized_hash;
+    uint32_t optimized_word_count;
+    uint32_t reserved;
+  };
+
+  // Header of the local file containing the VkPipelineCache data.
+  struct PipelineCacheObjectFileHeader {
+    // 'XEVC'.
+    static constexpr uint32_t kMagic = 0x43564558;
+    static constexpr uint64_t kMaxDataSize = uint64_t(256) << 20;
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t data_size;
+    uint64_t data_hash;
+  };
+
+  // With VK_EXT_graphics_pipeline_library, pipelines are linked from parts
+  // created for subsets of the state, reused between pipelines.
+  enum class PipelineLibraryPart : uint32_t {
+    // Vertex input interface (only input assembly since vertex fetching is
+    // done in the shaders) and pre-rasterization shaders.
+    kPreRasterization,
+    kFragmentShader,
+    kFragmentOutput,
+  };
+
+  XEPACKEDSTRUCT(PipelineLibraryKey, {
+    // Only the fields of the description relevant to the part, others are
+    // zero.
+    PipelineDescription description;
+    // Pre-rasterization and fragment shader parts must be linked with the
+    // same layout, 0 for the fragment output interface.
+    uint64_t pipeline_layout;
+    PipelineLibraryPart part;
+    uint32_t padding;
+
+    PipelineLibraryKey() { Reset(); }
+    PipelineLibraryKey(const PipelineLibraryKey& key) {
+      std::memcpy(this, &key, sizeof(*this));
+    }
+    PipelineLibraryKey& operator=(const PipelineLibraryKey& key) {
+      std::memcpy(this, &key, sizeof(*this));
+      return *this;
+    }
+    bool operator==(const PipelineLibraryKey& key) const {
+      return std::memcmp(this, &key, sizeof(*this)) == 0;
+    }
+    void Reset() { std::memset(this, 0, sizeof(*this)); }
+    struct Hasher {
+      size_t operator()(const PipelineLibraryKey& key) const {
+        return size_t(XXH3_64bits(&key, sizeof(key)));
+      }
+    };
   });
 
   struct Pipeline {
@@ -205,6 +371,11 @@ class VulkanPipelineCache {
     // The layouts are owned by the VulkanCommandProcessor, and must not be
     // destroyed by it while the pipeline cache is active.
     const PipelineLayoutProvider* pipeline_layout;
+    // Set with release ordering by the thread that has attempted to create the
+    // pipeline, after which `pipeline` is modified only on the command
+    // processor thread when no pipelines are being created, to switch to the
+    // one with the optimized shaders.
+    std::atomic<bool> creation_completed{false};
     Pipeline(const PipelineLayoutProvider* pipeline_layout_provider)
         : pipeline_layout(pipeline_layout_provider) {}
   };
@@ -246,6 +417,10 @@ class VulkanPipelineCache {
     }
   };
 
+  VulkanShader* LoadShader(xenos::ShaderType shader_type,
+                           const uint32_t* host_address, uint32_t dword_count,
+                           uint64_t data_hash);
+
   // Can be called from multiple threads.
   bool TranslateAnalyzedShader(SpirvShaderTranslator& translator,
                                VulkanShader::VulkanTranslation& translation);
@@ -265,6 +440,12 @@ class VulkanPipelineCache {
   // Whether the pipeline for the given description is supported by the device.
   bool ArePipelineRequirementsMet(const PipelineDescription& description) const;
 
+  static void GetExtendedDynamicState(const PipelineDescription& description,
+                                      ExtendedDynamicState& state_out);
+  // Clears the fields of the state set dynamically, so pipelines differing
+  // only by it are shared.
+  static void ClearExtendedDynamicState(PipelineDescription& description);
+
   static bool GetGeometryShaderKey(
       PipelineGeometryShader geometry_shader_type,
       SpirvShaderTranslator::Modification vertex_shader_modification,
@@ -274,9 +455,67 @@ class VulkanPipelineCache {
 
   // Can be called from creation threads - all needed data must be fully set up
   // at the point of the call: shaders must be translated, pipeline layout and
-  // render pass objects must be available.
+  // render pass objects must be available. With existing_libraries_only, only
+  // links the pipeline if all the pipeline libraries for it already exist, and
+  // returns false otherwise. Without allow_libraries, creates a whole pipeline,
+  // even with VK_EXT_graphics_pipeline_library.
   bool EnsurePipelineCreated(
-      const PipelineCreationArguments& creation_arguments);
+      const PipelineCreationArguments& creation_arguments,
+      bool existing_libraries_only = false, bool allow_libraries = true);
+  // Links the pipeline from libraries for the parts of the state, creating the
+  // libraries not created yet unless existing_libraries_only is true.
+  // pipeline_create_info must contain the state for all the parts.
+  VkPipeline CreatePipelineFromLibraries(
+      const PipelineDescription& description,
+      const PipelineLayoutProvider* pipeline_layout_provider,
+      const VkGraphicsPipelineCreateInfo& pipeline_create_info,
+      bool has_fragment_shader_stage, bool existing_libraries_only);
+  // Can be called from multiple threads. Returns VK_NULL_HANDLE if failed to
+  // create the library, or if it doesn't exist yet and create_if_missing is
+  // false.
+  VkPipeline GetPipelineLibrary(
+      const PipelineLibraryKey& key,
+      const VkGraphicsPipelineCreateInfo& library_create_info,
+      bool create_if_missing);
+  // EnsurePipelineCreated marking the creation as completed.
+  void CreatePipeline(const PipelineCreationArguments& creation_arguments);
+
+  void CreationThread(size_t thread_index, size_t thread_count);
+  void CreateQueuedPipelinesOnProcessorThread();
+
+  void TranslationThread();
+
+  // Looks up everything needed for creating a pipeline from the storage, on
+  // the thread owning the caches. Returns false if the pipeline can't be
+  // created with the current device or if any of its shaders is unavailable.
+  bool GetStoredPipelineCreationArguments(
+      const PipelineDescription& description,
+      PipelineCreationArguments& creation_arguments_out);
+  // The same without adding the pipeline to the cache, with `pipeline` in the
+  // arguments not set.
+  bool LookUpPipelineCreationArguments(
+      const PipelineDescription& description,
+      PipelineCreationArguments& creation_arguments_out,
+      const PipelineLayoutProvider*& pipeline_layout_out);
+
+  // Loads the optimized shaders stored for the currently open storage.
+  void LoadOptimizedShaderStorage(const std::filesystem::path& file_path);
+  // Queues a newly translated shader for optimization. Can be called from
+  // multiple threads.
+  void RequestShaderOptimization(VulkanShader::VulkanTranslation& translation,
+                                 uint64_t unoptimized_hash);
+  // On the command processor thread when no pipelines are being created,
+  // switches to the optimized shaders and the pipelines recreated with them.
+  void UpdateOptimizedShaders();
+  void OptimizationThread();
+
+  // The VkPipelineCache contents are specific to the device and the driver, so
+  // they are validated against the current ones before being passed to the
+  // driver.
+  void LoadPipelineCacheObject(const std::filesystem::path& file_path);
+  void StorePipelineCacheObject();
+
+  void StorageWriteThread();
 
   VulkanCommandProcessor& command_processor_;
   const RegisterFile& register_file_;
@@ -288,6 +527,21 @@ class VulkanPipelineCache {
   // Reusable shader translator on the command processor thread.
   std::unique_ptr<SpirvShaderTranslator> shader_translator_;
 
+  // Thread translating the pixel shader in parallel with the vertex shader
+  // translated on the command processor thread if both are new, with its own
+  // translator and disassembly buffer.
+  std::unique_ptr<xe::threading::Thread> translation_thread_;
+  StringBuffer translation_thread_ucode_disasm_buffer_;
+  std::unique_ptr<SpirvShaderTranslator> translation_thread_translator_;
+  std::mutex translation_request_lock_;
+  std::condition_variable translation_request_cond_;
+  // Protected with translation_request_lock_, notify_all
+  // translation_request_cond_ when changed.
+  VulkanShader::VulkanTranslation* translation_request_ = nullptr;
+  bool translation_request_completed_ = false;
+  bool translation_request_result_ = false;
+  bool translation_thread_shutdown_ = false;
+
   struct LayoutUID {
     size_t uid;
     size_t vector_span_offset;
@@ -321,9 +575,126 @@ class VulkanPipelineCache {
   std::unordered_map<PipelineDescription, Pipeline, PipelineDescription::Hasher>
       pipelines_;
 
+  // Whether pipelines are linked from libraries of their parts.
+  bool graphics_pipeline_library_used_ = false;
+  // Whether culling and depth / stencil state are not a part of the pipelines.
+  bool extended_dynamic_state_used_ = false;
+  std::mutex pipeline_libraries_mutex_;
+  // Stores VK_NULL_HANDLE if failed to create.
+  std::unordered_map<PipelineLibraryKey, VkPipeline, PipelineLibraryKey::Hasher>
+      pipeline_libraries_;
+
   // Previously used pipeline, to avoid lookups if the state wasn't changed.
   const std::pair<const PipelineDescription, Pipeline>* last_pipeline_ =
       nullptr;
+
+  uint32_t pipeline_lookup_count_ = 0;
+  uint32_t pipeline_miss_count_ = 0;
+  std::atomic<uint64_t> created_pipeline_count_ = {0};
+
+  // Pipeline creation threads.
+  xe_mutex creation_request_lock_;
+  std::condition_variable_any creation_request_cond_;
+  // Protected with creation_request_lock_, notify_one creation_request_cond_
+  // when set.
+  std::deque<PipelineCreationArguments> creation_queue_;
+  // Number of threads that are currently creating a pipeline - incremented when
+  // a pipeline is dequeued (the completion event can't be triggered before this
+  // is zero). Protected with creation_request_lock_.
+  size_t creation_threads_busy_ = 0;
+  // Manual-reset event set when the last queued pipeline is created and there
+  // are no more pipelines to create. This is triggered by the thread creating
+  // the last pipeline.
+  std::unique_ptr<xe::threading::Event> creation_completion_event_;
+  // Whether setting the event on completion is queued. Protected with
+  // creation_request_lock_, notify_one creation_request_cond_ when set.
+  bool creation_completion_set_event_ = false;
+  // Creation threads with this index or above need to be shut down as soon as
+  // possible. Protected with creation_request_lock_, notify_all
+  // creation_request_cond_ when set.
+  size_t creation_threads_shutdown_from_ = SIZE_MAX;
+  std::vector<std::unique_ptr<xe::threading::Thread>> creation_threads_;
+
+  // Driver pipeline cache used for creating all pipelines while the shader
+  // storage is open, along with the local file it's loaded from and saved to.
+  VkPipelineCache pipeline_cache_object_ = VK_NULL_HANDLE;
+  std::filesystem::path pipeline_cache_object_file_path_;
+
+  // Currently open shader storage path.
+  std::filesystem::path shader_storage_cache_root_;
+  uint32_t shader_storage_title_id_ = 0;
+
+  // Shader storage output stream, for preload in the next emulator runs.
+  FILE* shader_storage_file_ = nullptr;
+  // For only writing shaders to the currently open storage once, incremented
+  // when switching the storage.
+  uint32_t shader_storage_index_ = 0;
+  bool shader_storage_file_flush_needed_ = false;
+
+  // Pipeline storage output stream, for preload in the next emulator runs.
+  FILE* pipeline_storage_file_ = nullptr;
+  bool pipeline_storage_file_flush_needed_ = false;
+
+  // Background optimization of the translated shaders with spirv-opt.
+  struct ShaderOptimizationRequest {
+    VulkanShader::VulkanTranslation* translation;
+    uint64_t unoptimized_hash;
+  };
+  struct ShaderOptimizationResult {
+    VulkanShader::VulkanTranslation* translation;
+    std::vector<uint32_t> optimized_code;
+  };
+  // A pipeline created again with the optimized shaders on the optimization
+  // thread, to replace the one drawn with at the end of a submission.
+  struct PipelineReplacement {
+    std::pair<const PipelineDescription, Pipeline>* target;
+    std::pair<const PipelineDescription, Pipeline> replacement;
+    PipelineCreationArguments creation_arguments;
+    PipelineReplacement(std::pair<const PipelineDescription, Pipeline>& target,
+                        const PipelineCreationArguments& creation_arguments)
+        : target(&target),
+          replacement(std::piecewise_construct,
+                      std::forward_as_tuple(target.first),
+                      std::forward_as_tuple(target.second.pipeline_layout)),
+          creation_arguments(creation_arguments) {
+      this->creation_arguments.pipeline = &replacement;
+    }
+  };
+  std::unique_ptr<ui::vulkan::SpirvToolsContext> optimization_spirv_tools_;
+  std::unique_ptr<xe::threading::Thread> optimization_thread_;
+  // Protected with optimization_request_lock_, notify_all
+  // optimization_request_cond_ when the requests are added.
+  std::mutex optimization_request_lock_;
+  std::condition_variable optimization_request_cond_;
+  std::deque<ShaderOptimizationRequest> optimization_queue_;
+  std::deque<std::unique_ptr<PipelineReplacement>> replacement_queue_;
+  std::vector<ShaderOptimizationResult> optimization_results_;
+  std::vector<std::unique_ptr<PipelineReplacement>> replacements_created_;
+  bool optimization_thread_shutdown_ = false;
+  // Replaced pipelines with the submission they were last used in, on the
+  // command processor thread.
+  std::deque<std::pair<VkPipeline, uint64_t>> retired_pipelines_;
+  // Unoptimized binary hash -> optimized binary, loaded from the storage and
+  // not modified while shaders are translated.
+  std::unordered_map<uint64_t, std::vector<uint32_t>,
+                     xe::hash::IdentityHasher<uint64_t>>
+      optimized_shaders_stored_;
+  // Held by the optimization thread while writing the optimized shaders and
+  // creating pipelines with pipeline_cache_object_, and on the command
+  // processor thread while replacing either of them.
+  std::mutex optimization_storage_mutex_;
+  FILE* optimized_shader_storage_file_ = nullptr;
+
+  std::mutex storage_write_request_lock_;
+  std::condition_variable storage_write_request_cond_;
+  // Storage thread input is protected with storage_write_request_lock_, and the
+  // thread is notified about its change via storage_write_request_cond_.
+  std::deque<const Shader*> storage_write_shader_queue_;
+  std::deque<PipelineStoredDescription> storage_write_pipeline_queue_;
+  bool storage_write_flush_shaders_ = false;
+  bool storage_write_flush_pipelines_ = false;
+  bool storage_write_thread_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> storage_write_thread_;
 };
 
 }  // namespace vulkan
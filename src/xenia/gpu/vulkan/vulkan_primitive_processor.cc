@@ -14,12 +14,29 @@
 #include <memory>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/gpu/vulkan/deferred_command_buffer.h"
 #include "xenia/gpu/vulkan/vulkan_command_processor.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_string(
+    vulkan_point_sprite_expansion, "",
+    "Where to expand guest point sprites to host triangles on Vulkan.\n"
+    "Use: [any, gs, vs]\n"
+    " gs:\n"
+    "  In a geometry shader, requiring the geometryShader feature.\n"
+    " vs:\n"
+    "  In the vertex shader, drawing every point as a two-triangle strip with "
+    "the vertex shader invoked for each of its vertices, avoiding geometry "
+    "shaders and their pipeline permutations.\n"
+    " Any other value:\n"
+    "  Choose what is faster on the device - the vertex shader on tile-based "
+    "GPUs, where geometry shaders are especially slow, and if geometry shaders "
+    "are not supported.",
+    "Vulkan");
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
@@ -33,12 +50,29 @@ bool VulkanPrimitiveProcessor::Initialize() {
   const VkPhysicalDevicePortabilitySubsetFeaturesKHR*
       device_portability_subset_features =
           provider.device_portability_subset_features();
+  bool point_sprites_in_gs = false;
+  if (device_features.geometryShader) {
+    if (cvars::vulkan_point_sprite_expansion == "gs") {
+      point_sprites_in_gs = true;
+    } else if (cvars::vulkan_point_sprite_expansion != "vs") {
+      ui::GraphicsProvider::GpuVendorID vendor_id =
+          ui::GraphicsProvider::GpuVendorID(
+              provider.device_properties().vendorID);
+      point_sprites_in_gs =
+          vendor_id != ui::GraphicsProvider::GpuVendorID::kArm &&
+          vendor_id != ui::GraphicsProvider::GpuVendorID::kImagination &&
+          vendor_id != ui::GraphicsProvider::GpuVendorID::kQualcomm;
+    }
+  }
+  XELOGGPU("Vulkan primitive processor: Expanding point sprites in the {}",
+           point_sprites_in_gs ? "geometry shader" : "vertex shader");
+  // Rectangle lists can be expanded only in the geometry shader by the SPIR-V
+  // shader translator currently.
   if (!InitializeCommon(device_features.fullDrawIndexUint32,
                         !device_portability_subset_features ||
                             device_portability_subset_features->triangleFans,
                         false, device_features.geometryShader,
-                        device_features.geometryShader,
-                        device_features.geometryShader)) {
+                        point_sprites_in_gs, device_features.geometryShader)) {
     Shutdown();
     return false;
   }
@@ -25,6 +25,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/gpu/draw_util.h"
+#include "xenia/gpu/gpu_pass_timestamps.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/spirv_builder.h"
 #include "xenia/gpu/spirv_shader_translator.h"
@@ -52,7 +53,10 @@ DEFINE_string(
     "  Performance limited primarily by overdraw.\n"
     " Any other value:\n"
     "  Choose what is considered the most optimal for the system (currently "
-    "always FB because the FSI path is much slower now).",
+    "FSI on AMD and Nvidia GPUs supporting sample-granularity interlock and "
+    "demotion to helper invocations, where it avoids copying between render "
+    "targets without serializing overlapping fragments too coarsely, FBO "
+    "otherwise).",
     "GPU");
 
 namespace xe {
@@ -216,19 +220,37 @@ bool VulkanRenderTargetCache::Initialize(uint32_t shared_memory_binding_count) {
   const VkPhysicalDeviceLimits& device_limits =
       provider.device_properties().limits;
 
-  if (cvars::render_target_path_vulkan == "fsi") {
+  const VkPhysicalDeviceFragmentShaderInterlockFeaturesEXT&
+      device_fragment_shader_interlock_features =
+          provider.device_fragment_shader_interlock_features();
+  if (cvars::render_target_path_vulkan == "fbo") {
+    path_ = Path::kHostRenderTargets;
+  } else if (cvars::render_target_path_vulkan == "fsi") {
     path_ = Path::kPixelShaderInterlock;
   } else {
-    path_ = Path::kHostRenderTargets;
+    // Pixel-granularity interlock also orders fragments not covering the same
+    // samples, which is much slower with MSAA, and without demotion to helper
+    // invocations, discarding has to be deferred in the shader. The remaining
+    // cost of the FSI path is primarily overdraw, which is acceptable on the
+    // desktop GPUs of these vendors compared to copying between render targets
+    // on every layout change.
+    ui::GraphicsProvider::GpuVendorID vendor_id =
+        ui::GraphicsProvider::GpuVendorID(
+            provider.device_properties().vendorID);
+    path_ = ((vendor_id == ui::GraphicsProvider::GpuVendorID::kAMD ||
+              vendor_id == ui::GraphicsProvider::GpuVendorID::kNvidia) &&
+             device_fragment_shader_interlock_features
+                 .fragmentShaderSampleInterlock &&
+             provider.device_shader_demote_to_helper_invocation_features()
+                 .shaderDemoteToHelperInvocation)
+                ? Path::kPixelShaderInterlock
+                : Path::kHostRenderTargets;
   }
   // Fragment shader interlock is a feature implemented by pretty advanced GPUs,
   // closer to Direct3D 11 / OpenGL ES 3.2 level mainly, not Direct3D 10 /
   // OpenGL ES 3.1. Thus, it's fine to demand a wide range of other optional
   // features for the fragment shader interlock backend to work.
   if (path_ == Path::kPixelShaderInterlock) {
-    const VkPhysicalDeviceFragmentShaderInterlockFeaturesEXT&
-        device_fragment_shader_interlock_features =
-            provider.device_fragment_shader_interlock_features();
     const VkPhysicalDeviceFeatures& device_features =
         provider.device_features();
     // Interlocking between fragments with common sample coverage is enough, but
@@ -261,6 +283,8 @@ bool VulkanRenderTargetCache::Initialize(uint32_t shared_memory_binding_count) {
       path_ = Path::kHostRenderTargets;
     }
   }
+  XELOGI("Vulkan render target path: {}",
+         path_ == Path::kPixelShaderInterlock ? "FSI" : "FBO");
 
   // Format support.
   constexpr VkFormatFeatureFlags kUsedDepthFormatFeatures =
@@ -1063,6 +1087,11 @@ bool VulkanRenderTargetCache::Resolve(const Memory& memory,
   // Copying.
   bool copied = false;
   if (resolve_info.copy_dest_extent_length) {
+    // Dumping the render targets is timed as a part of the copy.
+    GpuPassScope<VulkanCommandProcessor> copy_gpu_pass_scope(
+        command_processor_, resolve_info.IsCopyBitwise()
+                                ? GpuPass::kResolveCopiesBitwise
+                                : GpuPass::kResolveCopiesConverting);
     if (GetPath() == Path::kHostRenderTargets) {
       // Dump the current contents of the render targets owning the affected
       // range to edram_buffer_.
@@ -1189,6 +1218,8 @@ bool VulkanRenderTargetCache::Resolve(const Memory& memory,
   bool clear_depth = resolve_info.IsClearingDepth();
   bool clear_color = resolve_info.IsClearingColor();
   if (clear_depth || clear_color) {
+    GpuPassScope<VulkanCommandProcessor> clear_gpu_pass_scope(
+        command_processor_, GpuPass::kResolveClears);
     switch (GetPath()) {
       case Path::kHostRenderTargets: {
         Transfer::Rectangle clear_rectangle;
@@ -1675,8 +1706,8 @@ VulkanRenderTargetCache::VulkanRenderTarget::~VulkanRenderTarget() {
     dfn.vkDestroyImageView(device, view_depth_stencil_, nullptr);
   }
   dfn.vkDestroyImageView(device, view_depth_color_, nullptr);
-  dfn.vkDestroyImage(device, image_, nullptr);
-  dfn.vkFreeMemory(device, memory_, nullptr);
+  vmaDestroyImage(render_target_cache_.command_processor_.vma_allocator(),
+                  image_, allocation_);
 }
 
 uint32_t VulkanRenderTargetCache::GetMaxRenderTargetWidth() const {
@@ -1751,11 +1782,17 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
            key.is_depth ? "depth" : "color", key.resource_format);
     return nullptr;
   }
+  // Suballocated from the blocks shared with the textures rather than
+  // allocated as a separate device memory object, as there may be many small
+  // render targets, and drivers limit the number of device memory objects.
+  VmaAllocator vma_allocator = command_processor_.vma_allocator();
+  VmaAllocationCreateInfo allocation_create_info = {};
+  allocation_create_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
   VkImage image;
-  VkDeviceMemory memory;
-  if (!ui::vulkan::util::CreateDedicatedAllocationImage(
-          provider, image_create_info,
-          ui::vulkan::util::MemoryPurpose::kDeviceLocal, image, memory)) {
+  VmaAllocation allocation;
+  if (vmaCreateImage(vma_allocator, &image_create_info,
+                     &allocation_create_info, &image, &allocation,
+                     nullptr) != VK_SUCCESS) {
     XELOGE(
         "VulkanRenderTarget: Failed to create a {}x{} {}xMSAA {} render target "
         "image",
@@ -1789,8 +1826,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
         key.is_depth ? "depth" : "color", image_create_info.extent.width,
         image_create_info.extent.height,
         uint32_t(1) << uint32_t(key.msaa_samples), key.GetFormatName());
-    dfn.vkDestroyImage(device, image, nullptr);
-    dfn.vkFreeMemory(device, memory, nullptr);
+    vmaDestroyImage(vma_allocator, image, allocation);
     return nullptr;
   }
   VkImageView view_depth_stencil = VK_NULL_HANDLE;
@@ -1809,8 +1845,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
           uint32_t(1) << uint32_t(key.msaa_samples),
           xenos::GetDepthRenderTargetFormatName(key.GetDepthFormat()));
       dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-      dfn.vkDestroyImage(device, image, nullptr);
-      dfn.vkFreeMemory(device, memory, nullptr);
+      vmaDestroyImage(vma_allocator, image, allocation);
       return nullptr;
     }
     view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_STENCIL_BIT;
@@ -1824,8 +1859,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
           xenos::GetDepthRenderTargetFormatName(key.GetDepthFormat()));
       dfn.vkDestroyImageView(device, view_depth_stencil, nullptr);
       dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-      dfn.vkDestroyImage(device, image, nullptr);
-      dfn.vkFreeMemory(device, memory, nullptr);
+      vmaDestroyImage(vma_allocator, image, allocation);
       return nullptr;
     }
   } else {
@@ -1840,8 +1874,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
             uint32_t(1) << uint32_t(key.msaa_samples),
             xenos::GetColorRenderTargetFormatName(key.GetColorFormat()));
         dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-        dfn.vkDestroyImage(device, image, nullptr);
-        dfn.vkFreeMemory(device, memory, nullptr);
+        vmaDestroyImage(vma_allocator, image, allocation);
         return nullptr;
       }
     }
@@ -1858,8 +1891,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
           dfn.vkDestroyImageView(device, view_srgb, nullptr);
         }
         dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-        dfn.vkDestroyImage(device, image, nullptr);
-        dfn.vkFreeMemory(device, memory, nullptr);
+        vmaDestroyImage(vma_allocator, image, allocation);
         return nullptr;
       }
     }
@@ -1881,8 +1913,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
       dfn.vkDestroyImageView(device, view_srgb, nullptr);
     }
     dfn.vkDestroyImageView(device, view_depth_color, nullptr);
-    dfn.vkDestroyImage(device, image, nullptr);
-    dfn.vkFreeMemory(device, memory, nullptr);
+    vmaDestroyImage(vma_allocator, image, allocation);
     return nullptr;
   }
   VkDescriptorSet descriptor_set_transfer_source =
@@ -1926,7 +1957,7 @@ RenderTargetCache::RenderTarget* VulkanRenderTargetCache::CreateRenderTarget(
   dfn.vkUpdateDescriptorSets(device, key.is_depth ? 2 : 1, descriptor_set_write,
                              0, nullptr);
 
-  return new VulkanRenderTarget(key, *this, image, memory, view_depth_color,
+  return new VulkanRenderTarget(key, *this, image, allocation, view_depth_color,
                                 view_depth_stencil, view_stencil, view_srgb,
                                 view_color_transfer_separate,
                                 descriptor_set_index_transfer_source);
@@ -4515,6 +4546,17 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
   uint64_t current_submission = command_processor_.GetCurrentSubmission();
   DeferredCommandBuffer& command_buffer =
       command_processor_.deferred_command_buffer();
+  // Called for every draw, only switching the pass if there's anything to
+  // transfer.
+  bool transfers_needed = false;
+  for (uint32_t i = 0; i < render_target_count; ++i) {
+    if (render_targets[i] && !render_target_transfers[i].empty()) {
+      transfers_needed = true;
+      break;
+    }
+  }
+  GpuPassScope<VulkanCommandProcessor> gpu_pass_scope(
+      command_processor_, GpuPass::kEdramTransfers, transfers_needed);
 
   bool resolve_clear_needed =
       render_target_resolve_clear_values && resolve_clear_rectangle;
@@ -4553,6 +4595,7 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
         continue;
       }
       if (!host_depth_store_set_up) {
+        command_processor_.SwitchGpuPass(GpuPass::kHostDepthStores);
         // Pipeline.
         command_processor_.BindExternalComputePipeline(
             host_depth_store_pipelines_[size_t(dest_rt_key.msaa_samples)]);
@@ -4623,6 +4666,9 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
     }
     break;
   }
+  if (host_depth_store_set_up) {
+    command_processor_.SwitchGpuPass(GpuPass::kEdramTransfers);
+  }
 
   constexpr VkPipelineStageFlags kSourceStageMask =
       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
@@ -331,7 +331,7 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
     // Takes ownership of the Vulkan objects passed to the constructor.
     VulkanRenderTarget(RenderTargetKey key,
                        VulkanRenderTargetCache& render_target_cache,
-                       VkImage image, VkDeviceMemory memory,
+                       VkImage image, VmaAllocation allocation,
                        VkImageView view_depth_color,
                        VkImageView view_depth_stencil, VkImageView view_stencil,
                        VkImageView view_srgb,
@@ -340,7 +340,7 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
         : RenderTarget(key),
           render_target_cache_(render_target_cache),
           image_(image),
-          memory_(memory),
+          allocation_(allocation),
           view_depth_color_(view_depth_color),
           view_depth_stencil_(view_depth_stencil),
           view_stencil_(view_stencil),
@@ -411,7 +411,7 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
     VulkanRenderTargetCache& render_target_cache_;
 
     VkImage image_;
-    VkDeviceMemory memory_;
+    VmaAllocation allocation_;
 
     // TODO(Triang3l): Per-format drawing views for mutable formats with EDRAM
     // aliasing without transfers.
@@ -19,41 +19,75 @@ namespace gpu {
 namespace vulkan {
 
 VulkanShader::VulkanTranslation::~VulkanTranslation() {
-  if (shader_module_) {
-    const ui::vulkan::VulkanProvider& provider =
-        static_cast<const VulkanShader&>(shader()).provider_;
-    provider.dfn().vkDestroyShaderModule(provider.device(), shader_module_,
+  const ui::vulkan::VulkanProvider& provider =
+      static_cast<const VulkanShader&>(shader()).provider_;
+  VkShaderModule shader_module = shader_module_.load(std::memory_order_relaxed);
+  if (shader_module != VK_NULL_HANDLE) {
+    provider.dfn().vkDestroyShaderModule(provider.device(), shader_module,
                                          nullptr);
   }
+  if (unoptimized_shader_module_ != VK_NULL_HANDLE) {
+    provider.dfn().vkDestroyShaderModule(provider.device(),
+                                         unoptimized_shader_module_, nullptr);
+  }
 }
 
 VkShaderModule VulkanShader::VulkanTranslation::GetOrCreateShaderModule() {
   if (!is_valid()) {
     return VK_NULL_HANDLE;
   }
-  if (shader_module_ != VK_NULL_HANDLE) {
-    return shader_module_;
+  VkShaderModule shader_module = shader_module_.load(std::memory_order_relaxed);
+  if (shader_module != VK_NULL_HANDLE) {
+    return shader_module;
   }
+  shader_module = CreateShaderModule(
+      reinterpret_cast<const uint32_t*>(translated_binary().data()),
+      translated_binary().size());
+  if (shader_module == VK_NULL_HANDLE) {
+    MakeInvalid();
+    return VK_NULL_HANDLE;
+  }
+  shader_module_.store(shader_module, std::memory_order_release);
+  return shader_module;
+}
+
+bool VulkanShader::VulkanTranslation::SetOptimizedShaderModuleCode(
+    const uint32_t* code, size_t code_word_count) {
+  if (!is_valid() || optimized_shader_module_created_) {
+    return false;
+  }
+  VkShaderModule optimized_shader_module =
+      CreateShaderModule(code, code_word_count * sizeof(uint32_t));
+  if (optimized_shader_module == VK_NULL_HANDLE) {
+    return false;
+  }
+  optimized_shader_module_created_ = true;
+  unoptimized_shader_module_ = shader_module_.exchange(
+      optimized_shader_module, std::memory_order_acq_rel);
+  return true;
+}
+
+VkShaderModule VulkanShader::VulkanTranslation::CreateShaderModule(
+    const uint32_t* code, size_t code_size) const {
   const ui::vulkan::VulkanProvider& provider =
       static_cast<const VulkanShader&>(shader()).provider_;
   VkShaderModuleCreateInfo shader_module_create_info;
   shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
   shader_module_create_info.pNext = nullptr;
   shader_module_create_info.flags = 0;
-  shader_module_create_info.codeSize = translated_binary().size();
-  shader_module_create_info.pCode =
-      reinterpret_cast<const uint32_t*>(translated_binary().data());
+  shader_module_create_info.codeSize = code_size;
+  shader_module_create_info.pCode = code;
+  VkShaderModule shader_module;
   if (provider.dfn().vkCreateShaderModule(provider.device(),
                                           &shader_module_create_info, nullptr,
-                                          &shader_module_) != VK_SUCCESS) {
+                                          &shader_module) != VK_SUCCESS) {
     XELOGE(
         "VulkanShader::VulkanTranslation: Failed to create a Vulkan shader "
         "module for shader {:016X} modification {:016X}",
         shader().ucode_data_hash(), modification());
-    MakeInvalid();
     return VK_NULL_HANDLE;
   }
-  return shader_module_;
+  return shader_module;
 }
 
 VulkanShader::VulkanShader(const ui::vulkan::VulkanProvider& provider,
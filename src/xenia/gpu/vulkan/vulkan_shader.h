@@ -10,6 +10,8 @@
 #ifndef XENIA_GPU_VULKAN_VULKAN_SHADER_H_
 #define XENIA_GPU_VULKAN_VULKAN_SHADER_H_
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 
 #include "xenia/gpu/spirv_shader.h"
@@ -29,10 +31,29 @@ class VulkanShader : public SpirvShader {
     ~VulkanTranslation() override;
 
     VkShaderModule GetOrCreateShaderModule();
-    VkShaderModule shader_module() const { return shader_module_; }
+    // May be switched to the optimized module while the pipelines are being
+    // created on other threads.
+    VkShaderModule shader_module() const {
+      return shader_module_.load(std::memory_order_acquire);
+    }
+
+    // Makes the pipelines created from now on use a module from the optimized
+    // version of the translated binary, which itself is kept unoptimized. The
+    // unoptimized module, if already created, is kept until the translation is
+    // destroyed since pipelines may still be being created with it. Returns
+    // false and keeps the current module if failed.
+    bool SetOptimizedShaderModuleCode(const uint32_t* code,
+                                      size_t code_word_count);
+    bool is_optimized() const { return optimized_shader_module_created_; }
 
    private:
-    VkShaderModule shader_module_ = VK_NULL_HANDLE;
+    VkShaderModule CreateShaderModule(const uint32_t* code,
+                                      size_t code_size) const;
+
+    std::atomic<VkShaderModule> shader_module_{VK_NULL_HANDLE};
+    // The one replaced by the optimized module.
+    VkShaderModule unoptimized_shader_module_ = VK_NULL_HANDLE;
+    bool optimized_shader_module_created_ = false;
   };
 
   explicit VulkanShader(const ui::vulkan::VulkanProvider& provider,
@@ -206,6 +206,17 @@ void VulkanSharedMemory::Shutdown(bool from_destructor) {
     dfn.vkFreeMemory(device, memory, nullptr);
   }
   buffer_memory_.clear();
+  for (VkDeviceMemory memory : buffer_sparse_memory_) {
+    if (memory != VK_NULL_HANDLE) {
+      dfn.vkFreeMemory(device, memory, nullptr);
+    }
+  }
+  buffer_sparse_memory_.clear();
+  for (const std::pair<uint64_t, VkDeviceMemory>& freed_memory :
+       buffer_sparse_memory_freed_) {
+    dfn.vkFreeMemory(device, freed_memory.second, nullptr);
+  }
+  buffer_sparse_memory_freed_.clear();
 
   // If calling from the destructor, the SharedMemory destructor will call
   // ShutdownCommon.
@@ -215,7 +226,20 @@ void VulkanSharedMemory::Shutdown(bool from_destructor) {
 }
 
 void VulkanSharedMemory::CompletedSubmissionUpdated() {
-  upload_buffer_pool_->Reclaim(command_processor_.GetCompletedSubmission());
+  uint64_t completed_submission = command_processor_.GetCompletedSubmission();
+  upload_buffer_pool_->Reclaim(completed_submission);
+  if (!buffer_sparse_memory_freed_.empty()) {
+    const ui::vulkan::VulkanProvider& provider =
+        command_processor_.GetVulkanProvider();
+    const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+    VkDevice device = provider.device();
+    while (!buffer_sparse_memory_freed_.empty() &&
+           buffer_sparse_memory_freed_.front().first <= completed_submission) {
+      dfn.vkFreeMemory(device, buffer_sparse_memory_freed_.front().second,
+                       nullptr);
+      buffer_sparse_memory_freed_.pop_front();
+    }
+  }
 }
 
 void VulkanSharedMemory::EndSubmission() { upload_buffer_pool_->FlushWrites(); }
@@ -341,27 +365,80 @@ bool VulkanSharedMemory::AllocateSparseHostGpuMemoryRange(
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
+  VkDeviceSize allocation_size = VkDeviceSize(1)
+                                 << host_gpu_memory_sparse_granularity_log2();
+  if (buffer_sparse_memory_.empty()) {
+    buffer_sparse_memory_.resize(kBufferSize / allocation_size,
+                                 VK_NULL_HANDLE);
+  }
+
+  // A separate memory object for every allocation so they can be freed
+  // individually.
   VkMemoryAllocateInfo memory_allocate_info;
   memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
   memory_allocate_info.pNext = nullptr;
-  memory_allocate_info.allocationSize =
-      length_allocations << host_gpu_memory_sparse_granularity_log2();
+  memory_allocate_info.allocationSize = allocation_size;
   memory_allocate_info.memoryTypeIndex = buffer_memory_type_;
-  VkDeviceMemory memory;
-  if (dfn.vkAllocateMemory(device, &memory_allocate_info, nullptr, &memory) !=
-      VK_SUCCESS) {
-    XELOGE("Shared memory: Failed to allocate sparse buffer memory");
-    return false;
+  sparse_binds_temp_.clear();
+  bool successful = true;
+  for (uint32_t i = offset_allocations;
+       i < offset_allocations + length_allocations; ++i) {
+    if (buffer_sparse_memory_[i] != VK_NULL_HANDLE) {
+      // Allocated before a failure in an earlier call.
+      continue;
+    }
+    VkDeviceMemory memory;
+    if (dfn.vkAllocateMemory(device, &memory_allocate_info, nullptr,
+                             &memory) != VK_SUCCESS) {
+      XELOGE("Shared memory: Failed to allocate sparse buffer memory");
+      successful = false;
+      break;
+    }
+    buffer_sparse_memory_[i] = memory;
+    VkSparseMemoryBind& bind = sparse_binds_temp_.emplace_back();
+    bind.resourceOffset = VkDeviceSize(i) * allocation_size;
+    bind.size = allocation_size;
+    bind.memory = memory;
+    bind.memoryOffset = 0;
+    bind.flags = 0;
+  }
+  SparseBind();
+  return successful;
+}
+
+bool VulkanSharedMemory::FreeSparseHostGpuMemoryRange(
+    uint32_t offset_allocations, uint32_t length_allocations) {
+  VkDeviceSize allocation_size = VkDeviceSize(1)
+                                 << host_gpu_memory_sparse_granularity_log2();
+  uint64_t submission_current = command_processor_.GetCurrentSubmission();
+  sparse_binds_temp_.clear();
+  for (uint32_t i = offset_allocations;
+       i < offset_allocations + length_allocations; ++i) {
+    VkDeviceMemory memory = buffer_sparse_memory_[i];
+    if (memory == VK_NULL_HANDLE) {
+      continue;
+    }
+    VkSparseMemoryBind& bind = sparse_binds_temp_.emplace_back();
+    bind.resourceOffset = VkDeviceSize(i) * allocation_size;
+    bind.size = allocation_size;
+    bind.memory = VK_NULL_HANDLE;
+    bind.memoryOffset = 0;
+    bind.flags = 0;
+    // Unbound before the current submission, but may still be accessed by the
+    // submissions before it.
+    buffer_sparse_memory_freed_.emplace_back(submission_current, memory);
+    buffer_sparse_memory_[i] = VK_NULL_HANDLE;
+  }
+  SparseBind();
+  return true;
+}
+
+void VulkanSharedMemory::SparseBind() {
+  if (sparse_binds_temp_.empty()) {
+    return;
   }
-  buffer_memory_.push_back(memory);
-
-  VkSparseMemoryBind bind;
-  bind.resourceOffset = offset_allocations
-                        << host_gpu_memory_sparse_granularity_log2();
-  bind.size = memory_allocate_info.allocationSize;
-  bind.memory = memory;
-  bind.memoryOffset = 0;
-  bind.flags = 0;
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
   VkPipelineStageFlags bind_wait_stage_mask =
       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
@@ -370,9 +447,9 @@ bool VulkanSharedMemory::AllocateSparseHostGpuMemoryRange(
     bind_wait_stage_mask |=
         VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT;
   }
-  command_processor_.SparseBindBuffer(buffer_, 1, &bind, bind_wait_stage_mask);
-
-  return true;
+  command_processor_.SparseBindBuffer(
+      buffer_, uint32_t(sparse_binds_temp_.size()), sparse_binds_temp_.data(),
+      bind_wait_stage_mask);
 }
 
 bool VulkanSharedMemory::UploadRanges(
@@ -11,6 +11,7 @@
 #define XENIA_GPU_VULKAN_VULKAN_SHARED_MEMORY_H_
 
 #include <algorithm>
+#include <deque>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -61,6 +62,8 @@ class VulkanSharedMemory : public SharedMemory {
  protected:
   bool AllocateSparseHostGpuMemoryRange(uint32_t offset_allocations,
                                         uint32_t length_allocations) override;
+  bool FreeSparseHostGpuMemoryRange(uint32_t offset_allocations,
+                                    uint32_t length_allocations) override;
 
   bool UploadRanges(const std::pair<uint32_t, uint32_t>* upload_page_ranges,
                     uint32_t num_ranges) override;
@@ -69,14 +72,22 @@ class VulkanSharedMemory : public SharedMemory {
   void GetUsageMasks(Usage usage, VkPipelineStageFlags& stage_mask,
                      VkAccessFlags& access_mask) const;
 
+  // Submits sparse_binds_temp_ for the buffer.
+  void SparseBind();
+  std::vector<VkSparseMemoryBind> sparse_binds_temp_;
+
   VulkanCommandProcessor& command_processor_;
   TraceWriter& trace_writer_;
   VkPipelineStageFlags guest_shader_pipeline_stages_;
 
   VkBuffer buffer_ = VK_NULL_HANDLE;
   uint32_t buffer_memory_type_;
-  // Single for non-sparse, every allocation so far for sparse.
+  // Single for non-sparse, empty for sparse.
   std::vector<VkDeviceMemory> buffer_memory_;
+  // One per sparse allocation, VK_NULL_HANDLE if not allocated.
+  std::vector<VkDeviceMemory> buffer_sparse_memory_;
+  // <Submission where unbound, memory>, sorted by the submission number.
+  std::deque<std::pair<uint64_t, VkDeviceMemory>> buffer_sparse_memory_freed_;
 
   Usage last_usage_;
   std::pair<uint32_t, uint32_t> last_written_range_;
@@ -11,12 +11,15 @@
 
 #include <algorithm>
 #include <array>
+#include <cstring>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
+#include "xenia/gpu/gpu_pass_timestamps.h"
 #include "xenia/gpu/texture_info.h"
 #include "xenia/gpu/texture_util.h"
 #include "xenia/gpu/vulkan/deferred_command_buffer.h"
@@ -430,12 +433,32 @@ VulkanTextureCache::~VulkanTextureCache() {
   for (const std::pair<const SamplerParameters, Sampler>& sampler_pair :
        samplers_) {
     dfn.vkDestroySampler(device, sampler_pair.second.sampler, nullptr);
+    if (sampler_pair.second.bindless_descriptor_index != UINT32_MAX) {
+      command_processor_.ReleaseBindlessDescriptor(
+          SpirvShaderTranslator::kBindlessResourceBindingSamplers,
+          sampler_pair.second.bindless_descriptor_index);
+    }
   }
   samplers_.clear();
   COUNT_profile_set("gpu/texture_cache/vulkan/samplers", 0);
   sampler_used_last_ = nullptr;
   sampler_used_first_ = nullptr;
 
+  if (null_image_view_3d_bindless_descriptor_index_ != UINT32_MAX) {
+    command_processor_.ReleaseBindlessDescriptor(
+        SpirvShaderTranslator::kBindlessResourceBindingTextures3D,
+        null_image_view_3d_bindless_descriptor_index_);
+  }
+  if (null_image_view_cube_bindless_descriptor_index_ != UINT32_MAX) {
+    command_processor_.ReleaseBindlessDescriptor(
+        SpirvShaderTranslator::kBindlessResourceBindingTexturesCube,
+        null_image_view_cube_bindless_descriptor_index_);
+  }
+  if (null_image_view_2d_array_bindless_descriptor_index_ != UINT32_MAX) {
+    command_processor_.ReleaseBindlessDescriptor(
+        SpirvShaderTranslator::kBindlessResourceBindingTextures2DArray,
+        null_image_view_2d_array_bindless_descriptor_index_);
+  }
   if (null_image_view_3d_ != VK_NULL_HANDLE) {
     dfn.vkDestroyImageView(device, null_image_view_3d_, nullptr);
   }
@@ -470,13 +493,15 @@ VulkanTextureCache::~VulkanTextureCache() {
     dfn.vkDestroyPipelineLayout(device, load_pipeline_layout_, nullptr);
   }
 
-  // Textures memory is allocated using the Vulkan Memory Allocator, destroy all
-  // textures before destroying VMA.
-  DestroyAllTextures(true);
+  disk_cache_upload_buffer_pool_.reset();
 
-  if (vma_allocator_ != VK_NULL_HANDLE) {
-    vmaDestroyAllocator(vma_allocator_);
+  // Textures memory is allocated using the Vulkan Memory Allocator of the
+  // command processor, destroy all textures and buffers before it destroys VMA.
+  DestroyAllTextures(true);
+  for (const DiskCacheReadback& readback : disk_cache_readbacks_) {
+    vmaDestroyBuffer(vma_allocator_, readback.buffer, readback.allocation);
   }
+  disk_cache_readbacks_.clear();
 }
 
 void VulkanTextureCache::BeginSubmission(uint64_t new_submission_index) {
@@ -608,6 +633,31 @@ VkImageView VulkanTextureCache::GetActiveBindingOrNullImageView(
   }
 }
 
+uint32_t VulkanTextureCache::GetActiveBindingOrNullImageViewBindlessIndex(
+    uint32_t fetch_constant_index, xenos::FetchOpDimension dimension,
+    bool is_signed) const {
+  uint32_t descriptor_index = UINT32_MAX;
+  const TextureBinding* binding = GetValidTextureBinding(fetch_constant_index);
+  if (binding && AreDimensionsCompatible(dimension, binding->key.dimension)) {
+    const VulkanTextureBinding& vulkan_binding =
+        vulkan_texture_bindings_[fetch_constant_index];
+    descriptor_index = is_signed
+                           ? vulkan_binding.bindless_descriptor_index_signed
+                           : vulkan_binding.bindless_descriptor_index_unsigned;
+  }
+  if (descriptor_index != UINT32_MAX) {
+    return descriptor_index;
+  }
+  switch (dimension) {
+    case xenos::FetchOpDimension::k3DOrStacked:
+      return null_image_view_3d_bindless_descriptor_index_;
+    case xenos::FetchOpDimension::kCube:
+      return null_image_view_cube_bindless_descriptor_index_;
+    default:
+      return null_image_view_2d_array_bindless_descriptor_index_;
+  }
+}
+
 VulkanTextureCache::SamplerParameters VulkanTextureCache::GetSamplerParameters(
     const VulkanShader::SamplerBinding& binding) const {
   const auto& regs = register_file();
@@ -684,8 +734,9 @@ VulkanTextureCache::SamplerParameters VulkanTextureCache::GetSamplerParameters(
   return parameters;
 }
 
-VkSampler VulkanTextureCache::UseSampler(SamplerParameters parameters,
-                                         bool& has_overflown_out) {
+VkSampler VulkanTextureCache::UseSampler(
+    SamplerParameters parameters, bool& has_overflown_out,
+    uint32_t* bindless_descriptor_index_out) {
   assert_true(command_processor_.submission_open());
   uint64_t submission_current = command_processor_.GetCurrentSubmission();
 
@@ -714,6 +765,9 @@ VkSampler VulkanTextureCache::UseSampler(SamplerParameters parameters,
       }
     }
     has_overflown_out = false;
+    if (bindless_descriptor_index_out) {
+      *bindless_descriptor_index_out = sampler.second.bindless_descriptor_index;
+    }
     return sampler.second.sampler;
   }
 
@@ -737,6 +791,11 @@ VkSampler VulkanTextureCache::UseSampler(SamplerParameters parameters,
     }
     auto it_reuse = samplers_.find(sampler_used_first_->first);
     dfn.vkDestroySampler(device, sampler_used_first_->second.sampler, nullptr);
+    if (sampler_used_first_->second.bindless_descriptor_index != UINT32_MAX) {
+      command_processor_.ReleaseBindlessDescriptor(
+          SpirvShaderTranslator::kBindlessResourceBindingSamplers,
+          sampler_used_first_->second.bindless_descriptor_index);
+    }
     if (sampler_used_first_->second.used_next) {
       sampler_used_first_->second.used_next->second.used_previous =
           sampler_used_first_->second.used_previous;
@@ -827,6 +886,16 @@ VkSampler VulkanTextureCache::UseSampler(SamplerParameters parameters,
     has_overflown_out = false;
     return VK_NULL_HANDLE;
   }
+  uint32_t sampler_bindless_descriptor_index = UINT32_MAX;
+  if (command_processor_.bindless_resources_used()) {
+    sampler_bindless_descriptor_index =
+        command_processor_.AllocateBindlessSamplerDescriptor(vulkan_sampler);
+    if (sampler_bindless_descriptor_index == UINT32_MAX) {
+      dfn.vkDestroySampler(device, vulkan_sampler, nullptr);
+      has_overflown_out = false;
+      return VK_NULL_HANDLE;
+    }
+  }
   std::pair<const SamplerParameters, Sampler>& new_sampler =
       *(samplers_
             .emplace(std::piecewise_construct,
@@ -834,6 +903,8 @@ VkSampler VulkanTextureCache::UseSampler(SamplerParameters parameters,
             .first);
   COUNT_profile_set("gpu/texture_cache/vulkan/samplers", samplers_.size());
   new_sampler.second.sampler = vulkan_sampler;
+  new_sampler.second.bindless_descriptor_index =
+      sampler_bindless_descriptor_index;
   new_sampler.second.last_usage_submission = submission_current;
   new_sampler.second.used_previous = sampler_used_last_;
   new_sampler.second.used_next = nullptr;
@@ -843,6 +914,9 @@ VkSampler VulkanTextureCache::UseSampler(SamplerParameters parameters,
     sampler_used_first_ = &new_sampler;
   }
   sampler_used_last_ = &new_sampler;
+  if (bindless_descriptor_index_out) {
+    *bindless_descriptor_index_out = sampler_bindless_descriptor_index;
+  }
   return vulkan_sampler;
 }
 
@@ -980,6 +1054,32 @@ uint32_t VulkanTextureCache::GetMaxHostTextureDepthOrArraySize(
   }
 }
 
+bool VulkanTextureCache::GetHostMemoryBudget(uint64_t& budget_out,
+                                             uint64_t& usage_out) const {
+  // Without VK_EXT_memory_budget, VMA only estimates the budget and knows only
+  // about its own allocations.
+  if (!command_processor_.GetVulkanProvider()
+           .device_extensions()
+           .ext_memory_budget) {
+    return false;
+  }
+  const VkPhysicalDeviceMemoryProperties* memory_properties;
+  vmaGetMemoryProperties(vma_allocator_, &memory_properties);
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+  vmaGetHeapBudgets(vma_allocator_, budgets);
+  budget_out = 0;
+  usage_out = 0;
+  for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i) {
+    if (!(memory_properties->memoryHeaps[i].flags &
+          VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+      continue;
+    }
+    budget_out += budgets[i].budget;
+    usage_out += budgets[i].usage;
+  }
+  return budget_out != 0;
+}
+
 std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
     TextureKey key) {
   VkFormat formats[] = {VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED};
@@ -1076,12 +1176,56 @@ std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
       new VulkanTexture(*this, key, image, allocation));
 }
 
-bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
-                                                               bool load_base,
-                                                               bool load_mips) {
+uint64_t VulkanTextureCache::GetDiskCacheHostFormat(TextureKey key) const {
+  if (key.scaled_resolve) {
+    return 0;
+  }
+  const HostFormatPair& host_format_pair = GetHostFormatPair(key);
+  bool host_format_is_signed;
+  if (IsSignedVersionSeparateForFormat(key)) {
+    host_format_is_signed = bool(key.signed_separate);
+  } else {
+    host_format_is_signed =
+        host_format_pair.format_unsigned.load_shader == kLoadShaderIndexUnknown;
+  }
+  const HostFormat& host_format = host_format_is_signed
+                                      ? host_format_pair.format_signed
+                                      : host_format_pair.format_unsigned;
+  if (host_format.load_shader == kLoadShaderIndexUnknown) {
+    return 0;
+  }
+  // 'VK' in the upper bits, so the identifier is never 0 and different from
+  // other backends.
+  return (UINT64_C(0x564B) << 48) | (uint64_t(host_format_is_signed) << 40) |
+         (uint64_t(host_format.load_shader) << 32) |
+         uint64_t(host_format.format);
+}
+
+bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(
+    Texture& texture, bool load_base, bool load_mips,
+    uint64_t disk_cache_hash) {
+  return LoadTextureDataImpl(texture, load_base, load_mips, disk_cache_hash,
+                             nullptr, 0);
+}
+
+bool VulkanTextureCache::LoadTextureDataFromHostDataImpl(
+    Texture& texture, bool load_base, bool load_mips, const uint8_t* host_data,
+    size_t host_data_size) {
+  return LoadTextureDataImpl(texture, load_base, load_mips, 0, host_data,
+                             host_data_size);
+}
+
+bool VulkanTextureCache::LoadTextureDataImpl(Texture& texture, bool load_base,
+                                             bool load_mips,
+                                             uint64_t disk_cache_hash,
+                                             const uint8_t* host_data,
+                                             size_t host_data_size) {
   VulkanTexture& vulkan_texture = static_cast<VulkanTexture&>(texture);
   TextureKey texture_key = vulkan_texture.key();
 
+  GpuPassScope<VulkanCommandProcessor> gpu_pass_scope(command_processor_,
+                                                      GpuPass::kTextureLoads);
+
   // Get the pipeline.
   const HostFormatPair& host_format_pair = GetHostFormatPair(texture_key);
   bool host_format_is_signed;
@@ -1214,6 +1358,109 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
         level_guest_z_extent_texels;
     host_buffer_size += level_host_layout.slice_size_bytes * array_size;
   }
+
+  // Copies the data in the host layout from the buffer to the texture.
+  auto copy_host_buffer_to_texture = [&](VkBuffer source_buffer,
+                                         VkDeviceSize source_offset) -> bool {
+    vulkan_texture.MarkAsUsed();
+    VulkanTexture::Usage texture_old_usage =
+        vulkan_texture.SetUsage(VulkanTexture::Usage::kTransferDestination);
+    if (texture_old_usage != VulkanTexture::Usage::kTransferDestination) {
+      VkPipelineStageFlags texture_src_stage_mask, texture_dst_stage_mask;
+      VkAccessFlags texture_src_access_mask, texture_dst_access_mask;
+      VkImageLayout texture_old_layout, texture_new_layout;
+      GetTextureUsageMasks(texture_old_usage, texture_src_stage_mask,
+                           texture_src_access_mask, texture_old_layout);
+      GetTextureUsageMasks(VulkanTexture::Usage::kTransferDestination,
+                           texture_dst_stage_mask, texture_dst_access_mask,
+                           texture_new_layout);
+      command_processor_.PushImageMemoryBarrier(
+          vulkan_texture.image(),
+          ui::vulkan::util::InitializeSubresourceRange(),
+          texture_src_stage_mask, texture_dst_stage_mask,
+          texture_src_access_mask, texture_dst_access_mask, texture_old_layout,
+          texture_new_layout);
+    }
+    command_processor_.SubmitBarriers(true);
+    VkBufferImageCopy* copy_regions =
+        command_processor_.deferred_command_buffer()
+            .CmdCopyBufferToImageEmplace(
+                source_buffer, vulkan_texture.image(),
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                level_last - level_first + 1);
+    for (uint32_t level = level_first; level <= level_last; ++level) {
+      VkBufferImageCopy& copy_region = copy_regions[level - level_first];
+      const HostLayout& level_host_layout =
+          level != 0 ? host_layout_mips[std::min(level, level_packed)]
+                     : host_layout_base;
+      copy_region.bufferOffset = source_offset + level_host_layout.offset_bytes;
+      if (level >= level_packed) {
+        uint32_t level_offset_blocks_x, level_offset_blocks_y, level_offset_z;
+        texture_util::GetPackedMipOffset(width, height, depth, guest_format,
+                                         level, level_offset_blocks_x,
+                                         level_offset_blocks_y, level_offset_z);
+        uint32_t level_offset_host_blocks_x =
+            texture_resolution_scale_x * level_offset_blocks_x;
+        uint32_t level_offset_host_blocks_y =
+            texture_resolution_scale_y * level_offset_blocks_y;
+        if (!host_format.block_compressed) {
+          level_offset_host_blocks_x *= block_width;
+          level_offset_host_blocks_y *= block_height;
+        }
+        copy_region.bufferOffset +=
+            load_shader_info.bytes_per_host_block *
+            (level_offset_host_blocks_x +
+             level_host_layout.x_pitch_blocks *
+                 (level_offset_host_blocks_y +
+                  level_host_layout.y_pitch_blocks *
+                      VkDeviceSize(level_offset_z)));
+      }
+      copy_region.bufferRowLength =
+          level_host_layout.x_pitch_blocks * host_block_width;
+      copy_region.bufferImageHeight =
+          level_host_layout.y_pitch_blocks * host_block_height;
+      copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      copy_region.imageSubresource.mipLevel = level;
+      copy_region.imageSubresource.baseArrayLayer = 0;
+      copy_region.imageSubresource.layerCount = array_size;
+      copy_region.imageOffset.x = 0;
+      copy_region.imageOffset.y = 0;
+      copy_region.imageOffset.z = 0;
+      copy_region.imageExtent.width =
+          std::max((width * texture_resolution_scale_x) >> level, UINT32_C(1));
+      copy_region.imageExtent.height =
+          std::max((height * texture_resolution_scale_y) >> level, UINT32_C(1));
+      copy_region.imageExtent.depth = std::max(depth >> level, UINT32_C(1));
+    }
+    return true;
+  };
+
+  if (host_data) {
+    // Loading the data stored in the disk cache by the same code earlier.
+    if (host_data_size != host_buffer_size) {
+      return false;
+    }
+    if (!disk_cache_upload_buffer_pool_) {
+      disk_cache_upload_buffer_pool_ =
+          std::make_unique<ui::vulkan::VulkanUploadBufferPool>(
+              command_processor_.GetVulkanProvider(),
+              VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+              TextureDiskCache::kMaxHostDataSize);
+    }
+    VkBuffer upload_buffer;
+    VkDeviceSize upload_buffer_offset;
+    uint8_t* upload_buffer_mapping = disk_cache_upload_buffer_pool_->Request(
+        command_processor_.GetCurrentSubmission(), host_data_size,
+        // Suitable for copying to textures of any format.
+        16, upload_buffer, upload_buffer_offset);
+    if (!upload_buffer_mapping) {
+      return false;
+    }
+    std::memcpy(upload_buffer_mapping, host_data, host_data_size);
+    disk_cache_upload_buffer_pool_->FlushWrites();
+    return copy_host_buffer_to_texture(upload_buffer, upload_buffer_offset);
+  }
+
   VulkanCommandProcessor::ScratchBufferAcquisition scratch_buffer_acquisition(
       command_processor_.AcquireScratchGpuBuffer(
           host_buffer_size, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
@@ -1469,72 +1716,76 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
       VK_PIPELINE_STAGE_TRANSFER_BIT,
       scratch_buffer_acquisition.SetAccessMask(VK_ACCESS_TRANSFER_READ_BIT),
       VK_ACCESS_TRANSFER_READ_BIT);
-  vulkan_texture.MarkAsUsed();
-  VulkanTexture::Usage texture_old_usage =
-      vulkan_texture.SetUsage(VulkanTexture::Usage::kTransferDestination);
-  if (texture_old_usage != VulkanTexture::Usage::kTransferDestination) {
-    VkPipelineStageFlags texture_src_stage_mask, texture_dst_stage_mask;
-    VkAccessFlags texture_src_access_mask, texture_dst_access_mask;
-    VkImageLayout texture_old_layout, texture_new_layout;
-    GetTextureUsageMasks(texture_old_usage, texture_src_stage_mask,
-                         texture_src_access_mask, texture_old_layout);
-    GetTextureUsageMasks(VulkanTexture::Usage::kTransferDestination,
-                         texture_dst_stage_mask, texture_dst_access_mask,
-                         texture_new_layout);
-    command_processor_.PushImageMemoryBarrier(
-        vulkan_texture.image(), ui::vulkan::util::InitializeSubresourceRange(),
-        texture_src_stage_mask, texture_dst_stage_mask, texture_src_access_mask,
-        texture_dst_access_mask, texture_old_layout, texture_new_layout);
-  }
-  command_processor_.SubmitBarriers(true);
-  VkBufferImageCopy* copy_regions = command_buffer.CmdCopyBufferToImageEmplace(
-      scratch_buffer, vulkan_texture.image(),
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level_last - level_first + 1);
-  for (uint32_t level = level_first; level <= level_last; ++level) {
-    VkBufferImageCopy& copy_region = copy_regions[level - level_first];
-    const HostLayout& level_host_layout =
-        level != 0 ? host_layout_mips[std::min(level, level_packed)]
-                   : host_layout_base;
-    copy_region.bufferOffset = level_host_layout.offset_bytes;
-    if (level >= level_packed) {
-      uint32_t level_offset_blocks_x, level_offset_blocks_y, level_offset_z;
-      texture_util::GetPackedMipOffset(width, height, depth, guest_format,
-                                       level, level_offset_blocks_x,
-                                       level_offset_blocks_y, level_offset_z);
-      uint32_t level_offset_host_blocks_x =
-          texture_resolution_scale_x * level_offset_blocks_x;
-      uint32_t level_offset_host_blocks_y =
-          texture_resolution_scale_y * level_offset_blocks_y;
-      if (!host_format.block_compressed) {
-        level_offset_host_blocks_x *= block_width;
-        level_offset_host_blocks_y *= block_height;
-      }
-      copy_region.bufferOffset +=
-          load_shader_info.bytes_per_host_block *
-          (level_offset_host_blocks_x +
-           level_host_layout.x_pitch_blocks *
-               (level_offset_host_blocks_y + level_host_layout.y_pitch_blocks *
-                                                 VkDeviceSize(level_offset_z)));
-    }
-    copy_region.bufferRowLength =
-        level_host_layout.x_pitch_blocks * host_block_width;
-    copy_region.bufferImageHeight =
-        level_host_layout.y_pitch_blocks * host_block_height;
-    copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    copy_region.imageSubresource.mipLevel = level;
-    copy_region.imageSubresource.baseArrayLayer = 0;
-    copy_region.imageSubresource.layerCount = array_size;
-    copy_region.imageOffset.x = 0;
-    copy_region.imageOffset.y = 0;
-    copy_region.imageOffset.z = 0;
-    copy_region.imageExtent.width =
-        std::max((width * texture_resolution_scale_x) >> level, UINT32_C(1));
-    copy_region.imageExtent.height =
-        std::max((height * texture_resolution_scale_y) >> level, UINT32_C(1));
-    copy_region.imageExtent.depth = std::max(depth >> level, UINT32_C(1));
+  if (disk_cache_hash &&
+      host_buffer_size <= TextureDiskCache::kMaxHostDataSize) {
+    // Read the converted data back to store it in the disk cache when the
+    // submission is completed.
+    VkBufferCreateInfo readback_buffer_create_info;
+    readback_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    readback_buffer_create_info.pNext = nullptr;
+    readback_buffer_create_info.flags = 0;
+    readback_buffer_create_info.size = host_buffer_size;
+    readback_buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    readback_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    readback_buffer_create_info.queueFamilyIndexCount = 0;
+    readback_buffer_create_info.pQueueFamilyIndices = nullptr;
+    VmaAllocationCreateInfo readback_allocation_create_info = {};
+    readback_allocation_create_info.flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+        VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    readback_allocation_create_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+    DiskCacheReadback readback;
+    VmaAllocationInfo readback_allocation_info;
+    if (vmaCreateBuffer(vma_allocator_, &readback_buffer_create_info,
+                        &readback_allocation_create_info, &readback.buffer,
+                        &readback.allocation,
+                        &readback_allocation_info) == VK_SUCCESS) {
+      readback.submission_index = command_processor_.GetCurrentSubmission();
+      readback.hash = disk_cache_hash;
+      readback.size = size_t(host_buffer_size);
+      readback.mapping = readback_allocation_info.pMappedData;
+      command_processor_.SubmitBarriers(true);
+      VkBufferCopy* readback_copy_region = command_buffer.CmdCopyBufferEmplace(
+          scratch_buffer, readback.buffer, 1);
+      readback_copy_region->srcOffset = 0;
+      readback_copy_region->dstOffset = 0;
+      readback_copy_region->size = host_buffer_size;
+      command_processor_.PushBufferMemoryBarrier(
+          readback.buffer, 0, VK_WHOLE_SIZE, VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+          VK_ACCESS_HOST_READ_BIT);
+      disk_cache_readbacks_.push_back(readback);
+    }
   }
 
-  return true;
+  return copy_host_buffer_to_texture(scratch_buffer, 0);
+}
+
+void VulkanTextureCache::CompletedSubmissionUpdated(
+    uint64_t completed_submission_index) {
+  TextureCache::CompletedSubmissionUpdated(completed_submission_index);
+
+  while (!disk_cache_readbacks_.empty()) {
+    const DiskCacheReadback& readback = disk_cache_readbacks_.front();
+    if (readback.submission_index > completed_submission_index) {
+      break;
+    }
+    if (vmaInvalidateAllocation(vma_allocator_, readback.allocation, 0,
+                                VK_WHOLE_SIZE) == VK_SUCCESS) {
+      const uint8_t* readback_mapping =
+          reinterpret_cast<const uint8_t*>(readback.mapping);
+      StoreTextureHostDataInDiskCache(
+          readback.hash,
+          std::vector<uint8_t>(readback_mapping,
+                               readback_mapping + readback.size));
+    }
+    vmaDestroyBuffer(vma_allocator_, readback.buffer, readback.allocation);
+    disk_cache_readbacks_.pop_front();
+  }
+
+  if (disk_cache_upload_buffer_pool_) {
+    disk_cache_upload_buffer_pool_->Reclaim(completed_submission_index);
+  }
 }
 
 void VulkanTextureCache::UpdateTextureBindingsImpl(
@@ -1555,24 +1806,28 @@ void VulkanTextureCache::UpdateTextureBindingsImpl(
           texture_util::IsAnySignNotSigned(binding->swizzled_signs)) {
         vulkan_binding.image_view_unsigned =
             static_cast<VulkanTexture*>(binding->texture)
-                ->GetView(false, binding->host_swizzle);
+                ->GetView(false, binding->host_swizzle, true,
+                          &vulkan_binding.bindless_descriptor_index_unsigned);
       }
       if (binding->texture_signed &&
           texture_util::IsAnySignSigned(binding->swizzled_signs)) {
         vulkan_binding.image_view_signed =
             static_cast<VulkanTexture*>(binding->texture_signed)
-                ->GetView(true, binding->host_swizzle);
+                ->GetView(true, binding->host_swizzle, true,
+                          &vulkan_binding.bindless_descriptor_index_signed);
       }
     } else {
       VulkanTexture* texture = static_cast<VulkanTexture*>(binding->texture);
       if (texture) {
         if (texture_util::IsAnySignNotSigned(binding->swizzled_signs)) {
-          vulkan_binding.image_view_unsigned =
-              texture->GetView(false, binding->host_swizzle);
+          vulkan_binding.image_view_unsigned = texture->GetView(
+              false, binding->host_swizzle, true,
+              &vulkan_binding.bindless_descriptor_index_unsigned);
         }
         if (texture_util::IsAnySignSigned(binding->swizzled_signs)) {
-          vulkan_binding.image_view_signed =
-              texture->GetView(true, binding->host_swizzle);
+          vulkan_binding.image_view_signed = texture->GetView(
+              true, binding->host_swizzle, true,
+              &vulkan_binding.bindless_descriptor_index_signed);
         }
       }
     }
@@ -1596,15 +1851,26 @@ VulkanTextureCache::VulkanTexture::~VulkanTexture() {
       vulkan_texture_cache.command_processor_.GetVulkanProvider();
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
+  SpirvShaderTranslator::BindlessResourceBinding bindless_resource_binding =
+      GetBindlessResourceBinding(key().dimension);
   for (const auto& view_pair : views_) {
-    dfn.vkDestroyImageView(device, view_pair.second, nullptr);
+    dfn.vkDestroyImageView(device, view_pair.second.view, nullptr);
+    if (view_pair.second.bindless_descriptor_index != UINT32_MAX) {
+      // The texture is destroyed only when it's not used by the GPU anymore.
+      vulkan_texture_cache.command_processor_.ReleaseBindlessDescriptor(
+          bindless_resource_binding,
+          view_pair.second.bindless_descriptor_index);
+    }
   }
   vmaDestroyImage(vulkan_texture_cache.vma_allocator_, image_, allocation_);
 }
 
-VkImageView VulkanTextureCache::VulkanTexture::GetView(bool is_signed,
-                                                       uint32_t host_swizzle,
-                                                       bool is_array) {
+VkImageView VulkanTextureCache::VulkanTexture::GetView(
+    bool is_signed, uint32_t host_swizzle, bool is_array,
+    uint32_t* bindless_descriptor_index_out) {
+  if (bindless_descriptor_index_out) {
+    *bindless_descriptor_index_out = UINT32_MAX;
+  }
   xenos::DataDimension dimension = key().dimension;
   if (dimension == xenos::DataDimension::k3D ||
       dimension == xenos::DataDimension::kCube) {
@@ -1649,7 +1915,10 @@ VkImageView VulkanTextureCache::VulkanTexture::GetView(bool is_signed,
   // Try to find an existing view.
   auto it = views_.find(view_key);
   if (it != views_.end()) {
-    return it->second;
+    if (bindless_descriptor_index_out) {
+      *bindless_descriptor_index_out = it->second.bindless_descriptor_index;
+    }
+    return it->second.view;
   }
 
   // Create a new view.
@@ -1692,7 +1961,21 @@ VkImageView VulkanTextureCache::VulkanTexture::GetView(bool is_signed,
         uint32_t(format), is_signed ? "" : "un", host_swizzle);
     return VK_NULL_HANDLE;
   }
-  views_.emplace(view_key, view);
+  View& new_view = views_.emplace(view_key, View()).first->second;
+  new_view.view = view;
+  new_view.bindless_descriptor_index = UINT32_MAX;
+  // Non-array 2D views are only used outside guest shaders.
+  if (vulkan_texture_cache.command_processor_.bindless_resources_used() &&
+      (is_array || dimension == xenos::DataDimension::k3D ||
+       dimension == xenos::DataDimension::kCube)) {
+    new_view.bindless_descriptor_index =
+        vulkan_texture_cache.command_processor_
+            .AllocateBindlessImageDescriptor(
+                GetBindlessResourceBinding(dimension), view);
+  }
+  if (bindless_descriptor_index_out) {
+    *bindless_descriptor_index_out = new_view.bindless_descriptor_index;
+  }
   return view;
 }
 
@@ -1720,9 +2003,9 @@ bool VulkanTextureCache::Initialize() {
       device_portability_subset_features =
           provider.device_portability_subset_features();
 
-  // Vulkan Memory Allocator.
+  // Vulkan Memory Allocator, shared with the render targets.
 
-  vma_allocator_ = ui::vulkan::CreateVmaAllocator(provider, true);
+  vma_allocator_ = command_processor_.vma_allocator();
   if (vma_allocator_ == VK_NULL_HANDLE) {
     return false;
   }
@@ -2569,6 +2852,28 @@ bool VulkanTextureCache::Initialize() {
     XELOGE("VulkanTextureCache: Failed to create the null 3D image view");
     return false;
   }
+  if (command_processor_.bindless_resources_used()) {
+    null_image_view_2d_array_bindless_descriptor_index_ =
+        command_processor_.AllocateBindlessImageDescriptor(
+            SpirvShaderTranslator::kBindlessResourceBindingTextures2DArray,
+            null_image_view_2d_array_);
+    null_image_view_cube_bindless_descriptor_index_ =
+        command_processor_.AllocateBindlessImageDescriptor(
+            SpirvShaderTranslator::kBindlessResourceBindingTexturesCube,
+            null_image_view_cube_);
+    null_image_view_3d_bindless_descriptor_index_ =
+        command_processor_.AllocateBindlessImageDescriptor(
+            SpirvShaderTranslator::kBindlessResourceBindingTextures3D,
+            null_image_view_3d_);
+    if (null_image_view_2d_array_bindless_descriptor_index_ == UINT32_MAX ||
+        null_image_view_cube_bindless_descriptor_index_ == UINT32_MAX ||
+        null_image_view_3d_bindless_descriptor_index_ == UINT32_MAX) {
+      XELOGE(
+          "VulkanTextureCache: Failed to allocate the bindless descriptors for "
+          "the null image views");
+      return false;
+    }
+  }
 
   null_images_cleared_ = false;
 
@@ -2587,6 +2892,13 @@ bool VulkanTextureCache::Initialize() {
   sampler_max_count_ =
       device_limits.maxSamplerAllocationCount -
       uint32_t(ui::vulkan::VulkanProvider::HostSampler::kCount) - 16;
+  if (command_processor_.bindless_resources_used()) {
+    // Every sampler occupies a slot in the bindless sampler array.
+    sampler_max_count_ = std::min(
+        sampler_max_count_,
+        SpirvShaderTranslator::kBindlessResourceBindingDescriptorCounts
+            [SpirvShaderTranslator::kBindlessResourceBindingSamplers]);
+  }
 
   if (device_features.samplerAnisotropy) {
     max_anisotropy_ = xenos::AnisoFilter(
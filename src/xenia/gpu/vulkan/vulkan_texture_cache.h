@@ -11,16 +11,19 @@
 #define XENIA_GPU_VULKAN_VULKAN_TEXTURE_CACHE_H_
 
 #include <array>
+#include <deque>
 #include <memory>
 #include <unordered_map>
 #include <utility>
 
 #include "xenia/base/hash.h"
+#include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/gpu/texture_cache.h"
 #include "xenia/gpu/vulkan/vulkan_shader.h"
 #include "xenia/gpu/vulkan/vulkan_shared_memory.h"
 #include "xenia/ui/vulkan/vulkan_mem_alloc.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
+#include "xenia/ui/vulkan/vulkan_upload_buffer_pool.h"
 
 namespace xe {
 namespace gpu {
@@ -83,6 +86,7 @@ class VulkanTextureCache final : public TextureCache {
   ~VulkanTextureCache();
 
   void BeginSubmission(uint64_t new_submission_index) override;
+  void CompletedSubmissionUpdated(uint64_t completed_submission_index) override;
 
   // Must be called within a frame - creates and untiles textures needed by
   // shaders, and enqueues transitioning them into the sampled usage. This may
@@ -94,6 +98,11 @@ class VulkanTextureCache final : public TextureCache {
   VkImageView GetActiveBindingOrNullImageView(uint32_t fetch_constant_index,
                                               xenos::FetchOpDimension dimension,
                                               bool is_signed) const;
+  // With bindless resources, the index of the same view in the descriptor
+  // array for the dimension.
+  uint32_t GetActiveBindingOrNullImageViewBindlessIndex(
+      uint32_t fetch_constant_index, xenos::FetchOpDimension dimension,
+      bool is_signed) const;
 
   SamplerParameters GetSamplerParameters(
       const VulkanShader::SamplerBinding& binding) const;
@@ -107,7 +116,10 @@ class VulkanTextureCache final : public TextureCache {
   //   count overflow in a submission that potentially hasn't completed yet.
   // - VK_NULL_HANDLE and has_overflown_out = false in case of a general failure
   //   to create a sampler.
-  VkSampler UseSampler(SamplerParameters parameters, bool& has_overflown_out);
+  // With bindless resources, bindless_descriptor_index_out receives the index
+  // of the sampler in the descriptor array if it's obtained successfully.
+  VkSampler UseSampler(SamplerParameters parameters, bool& has_overflown_out,
+                       uint32_t* bindless_descriptor_index_out = nullptr);
   // Returns the submission index to await (may be the current submission in
   // case of an overflow within a single submission - in this case, it must be
   // ended, and a new one must be started) in case of sampler count overflow, so
@@ -131,10 +143,19 @@ class VulkanTextureCache final : public TextureCache {
   uint32_t GetMaxHostTextureDepthOrArraySize(
       xenos::DataDimension dimension) const override;
 
+  bool GetHostMemoryBudget(uint64_t& budget_out,
+                           uint64_t& usage_out) const override;
+
   std::unique_ptr<Texture> CreateTexture(TextureKey key) override;
 
-  bool LoadTextureDataFromResidentMemoryImpl(Texture& texture, bool load_base,
-                                             bool load_mips) override;
+  bool LoadTextureDataFromResidentMemoryImpl(
+      Texture& texture, bool load_base, bool load_mips,
+      uint64_t disk_cache_hash) override;
+
+  uint64_t GetDiskCacheHostFormat(TextureKey key) const override;
+  bool LoadTextureDataFromHostDataImpl(Texture& texture, bool load_base,
+                                       bool load_mips, const uint8_t* host_data,
+                                       size_t host_data_size) override;
 
   void UpdateTextureBindingsImpl(uint32_t fetch_constant_mask) override;
 
@@ -198,8 +219,12 @@ class VulkanTextureCache final : public TextureCache {
       return old_usage;
     }
 
+    // With bindless resources, bindless_descriptor_index_out receives the
+    // index of the view in the descriptor array for its dimension (array, 3D
+    // and cube views only).
     VkImageView GetView(bool is_signed, uint32_t host_swizzle,
-                        bool is_array = true);
+                        bool is_array = true,
+                        uint32_t* bindless_descriptor_index_out = nullptr);
 
    private:
     union ViewKey {
@@ -260,28 +285,51 @@ class VulkanTextureCache final : public TextureCache {
 
     Usage usage_ = Usage::kUndefined;
 
-    std::unordered_map<ViewKey, VkImageView, ViewKey::Hasher> views_;
+    struct View {
+      VkImageView view;
+      // UINT32_MAX if not in the bindless descriptor arrays.
+      uint32_t bindless_descriptor_index;
+    };
+    std::unordered_map<ViewKey, View, ViewKey::Hasher> views_;
   };
 
   struct VulkanTextureBinding {
     VkImageView image_view_unsigned;
     VkImageView image_view_signed;
+    uint32_t bindless_descriptor_index_unsigned;
+    uint32_t bindless_descriptor_index_signed;
 
     VulkanTextureBinding() { Reset(); }
 
     void Reset() {
       image_view_unsigned = VK_NULL_HANDLE;
       image_view_signed = VK_NULL_HANDLE;
+      bindless_descriptor_index_unsigned = UINT32_MAX;
+      bindless_descriptor_index_signed = UINT32_MAX;
     }
   };
 
   struct Sampler {
     VkSampler sampler;
+    // UINT32_MAX if bindless resources are not used.
+    uint32_t bindless_descriptor_index;
     uint64_t last_usage_submission;
     std::pair<const SamplerParameters, Sampler>* used_previous;
     std::pair<const SamplerParameters, Sampler>* used_next;
   };
 
+  static constexpr SpirvShaderTranslator::BindlessResourceBinding
+  GetBindlessResourceBinding(xenos::DataDimension dimension) {
+    switch (dimension) {
+      case xenos::DataDimension::k3D:
+        return SpirvShaderTranslator::kBindlessResourceBindingTextures3D;
+      case xenos::DataDimension::kCube:
+        return SpirvShaderTranslator::kBindlessResourceBindingTexturesCube;
+      default:
+        return SpirvShaderTranslator::kBindlessResourceBindingTextures2DArray;
+    }
+  }
+
   static constexpr bool AreDimensionsCompatible(
       xenos::FetchOpDimension binding_dimension,
       xenos::DataDimension resource_dimension) {
@@ -315,6 +363,12 @@ class VulkanTextureCache final : public TextureCache {
 
   xenos::ClampMode NormalizeClampMode(xenos::ClampMode clamp_mode) const;
 
+  // Converts the guest data with the load shaders if host_data is null, or
+  // copies the previously converted host_data to the texture otherwise.
+  bool LoadTextureDataImpl(Texture& texture, bool load_base, bool load_mips,
+                           uint64_t disk_cache_hash, const uint8_t* host_data,
+                           size_t host_data_size);
+
   VulkanCommandProcessor& command_processor_;
   VkPipelineStageFlags guest_shader_pipeline_stages_;
 
@@ -324,6 +378,21 @@ class VulkanTextureCache final : public TextureCache {
   // 4096.
   VmaAllocator vma_allocator_ = VK_NULL_HANDLE;
 
+  // Converted texture data being copied to the host for storing in the disk
+  // cache, in submission order.
+  struct DiskCacheReadback {
+    uint64_t submission_index;
+    uint64_t hash;
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    void* mapping;
+    size_t size;
+  };
+  std::deque<DiskCacheReadback> disk_cache_readbacks_;
+  // Created on the first load from the disk cache.
+  std::unique_ptr<ui::vulkan::VulkanUploadBufferPool>
+      disk_cache_upload_buffer_pool_;
+
   static const HostFormatPair kBestHostFormats[64];
   static const HostFormatPair kHostFormatGBGRUnaligned;
   static const HostFormatPair kHostFormatBGRGUnaligned;
@@ -341,6 +410,10 @@ class VulkanTextureCache final : public TextureCache {
   VkImageView null_image_view_2d_array_ = VK_NULL_HANDLE;
   VkImageView null_image_view_cube_ = VK_NULL_HANDLE;
   VkImageView null_image_view_3d_ = VK_NULL_HANDLE;
+  // With bindless resources.
+  uint32_t null_image_view_2d_array_bindless_descriptor_index_ = UINT32_MAX;
+  uint32_t null_image_view_cube_bindless_descriptor_index_ = UINT32_MAX;
+  uint32_t null_image_view_3d_bindless_descriptor_index_ = UINT32_MAX;
   bool null_images_cleared_ = false;
 
   std::array<VulkanTextureBinding, xenos::kTextureFetchConstantCount>
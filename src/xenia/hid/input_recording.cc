@@ -0,0 +1,233 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/hid/input_recording.h"
+
+#include <cstring>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+
+namespace xe {
+namespace hid {
+
+namespace {
+
+struct InputRecordingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entry_size;
+  uint32_t reserved;
+};
+
+constexpr fourcc_t kInputRecordingMagic = make_fourcc("XINR");
+constexpr uint32_t kInputRecordingVersion = 1;
+
+}  // namespace
+
+std::unique_ptr<InputRecorder> InputRecorder::Create(
+    const std::filesystem::path& path) {
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Failed to create the input recording {}", xe::path_to_utf8(path));
+    return nullptr;
+  }
+  InputRecordingHeader header = {};
+  header.magic = kInputRecordingMagic;
+  header.version = kInputRecordingVersion;
+  header.entry_size = uint32_t(sizeof(InputRecordEntry));
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    XELOGE("Failed to write the input recording header");
+    fclose(file);
+    return nullptr;
+  }
+  XELOGI("Recording the input to {}", xe::path_to_utf8(path));
+  return std::unique_ptr<InputRecorder>(new InputRecorder(file));
+}
+
+InputRecorder::~InputRecorder() { fclose(file_); }
+
+void InputRecorder::RecordCapabilities(uint32_t user_index, uint32_t flags,
+                                       X_RESULT result,
+                                       const X_INPUT_CAPABILITIES* caps) {
+  InputRecordEntry entry = {};
+  entry.kind = InputRecordEntry::Kind::kCapabilities;
+  entry.user_index = uint8_t(user_index);
+  entry.flags = flags;
+  entry.result = result;
+  Write(entry, caps, sizeof(*caps));
+}
+
+void InputRecorder::RecordState(uint32_t user_index, X_RESULT result,
+                                const X_INPUT_STATE* state) {
+  InputRecordEntry entry = {};
+  entry.kind = InputRecordEntry::Kind::kState;
+  entry.user_index = uint8_t(user_index);
+  entry.result = result;
+  Write(entry, state, sizeof(*state));
+}
+
+void InputRecorder::RecordKeystroke(uint32_t user_index, uint32_t flags,
+                                    X_RESULT result,
+                                    const X_INPUT_KEYSTROKE* keystroke) {
+  InputRecordEntry entry = {};
+  entry.kind = InputRecordEntry::Kind::kKeystroke;
+  entry.user_index = uint8_t(user_index);
+  entry.flags = flags;
+  entry.result = result;
+  Write(entry, keystroke, sizeof(*keystroke));
+}
+
+void InputRecorder::Write(InputRecordEntry& entry, const void* payload,
+                          size_t payload_size) {
+  static_assert(sizeof(X_INPUT_CAPABILITIES) <= sizeof(entry.payload));
+  static_assert(sizeof(X_INPUT_STATE) <= sizeof(entry.payload));
+  static_assert(sizeof(X_INPUT_KEYSTROKE) <= sizeof(entry.payload));
+  entry.guest_tick_count = Clock::QueryGuestTickCount();
+  // The output is only meaningful on success, but copying it anyway so the
+  // replayed output is the same in all cases.
+  if (payload) {
+    std::memcpy(entry.payload, payload, payload_size);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  fwrite(&entry, sizeof(entry), 1, file_);
+}
+
+std::unique_ptr<ReplayInputDriver> ReplayInputDriver::Load(
+    const std::filesystem::path& path, xe::ui::Window* window,
+    size_t window_z_order) {
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("Failed to open the input recording {}", xe::path_to_utf8(path));
+    return nullptr;
+  }
+  InputRecordingHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != kInputRecordingMagic ||
+      header.version != kInputRecordingVersion ||
+      header.entry_size != sizeof(InputRecordEntry)) {
+    XELOGE("{} is not a supported input recording", xe::path_to_utf8(path));
+    fclose(file);
+    return nullptr;
+  }
+  auto driver = std::unique_ptr<ReplayInputDriver>(
+      new ReplayInputDriver(window, window_z_order));
+  size_t entry_count = 0;
+  InputRecordEntry entry;
+  while (fread(&entry, sizeof(entry), 1, file) == 1) {
+    if (entry.user_index >= kUserCount ||
+        size_t(entry.kind) >= kKindCount) {
+      continue;
+    }
+    driver->streams_[entry.user_index][size_t(entry.kind)].entries.push_back(
+        entry);
+    ++entry_count;
+  }
+  fclose(file);
+  XELOGI("Replaying {} input polls from {}", entry_count,
+         xe::path_to_utf8(path));
+  return driver;
+}
+
+ReplayInputDriver::~ReplayInputDriver() = default;
+
+X_STATUS ReplayInputDriver::Setup() { return X_STATUS_SUCCESS; }
+
+const InputRecordEntry* ReplayInputDriver::Next(uint32_t user_index,
+                                                InputRecordEntry::Kind kind,
+                                                bool& exhausted) {
+  exhausted = false;
+  if (user_index >= kUserCount) {
+    return nullptr;
+  }
+  Stream& stream = streams_[user_index][size_t(kind)];
+  if (stream.entries.empty()) {
+    return nullptr;
+  }
+  if (stream.next >= stream.entries.size()) {
+    if (!exhausted_reported_) {
+      exhausted_reported_ = true;
+      XELOGW(
+          "The input recording has ended, the guest made more polls than "
+          "recorded");
+    }
+    exhausted = true;
+    return &stream.entries.back();
+  }
+  return &stream.entries[stream.next++];
+}
+
+X_RESULT ReplayInputDriver::GetCapabilities(uint32_t user_index,
+                                            uint32_t flags,
+                                            X_INPUT_CAPABILITIES* out_caps) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool exhausted;
+  const InputRecordEntry* entry =
+      Next(user_index, InputRecordEntry::Kind::kCapabilities, exhausted);
+  if (!entry) {
+    return X_ERROR_DEVICE_NOT_CONNECTED;
+  }
+  if (out_caps) {
+    std::memcpy(out_caps, entry->payload, sizeof(*out_caps));
+  }
+  return entry->result;
+}
+
+X_RESULT ReplayInputDriver::GetState(uint32_t user_index,
+                                     X_INPUT_STATE* out_state) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool exhausted;
+  const InputRecordEntry* entry =
+      Next(user_index, InputRecordEntry::Kind::kState, exhausted);
+  if (!entry) {
+    return X_ERROR_DEVICE_NOT_CONNECTED;
+  }
+  if (out_state) {
+    std::memcpy(out_state, entry->payload, sizeof(*out_state));
+  }
+  return entry->result;
+}
+
+X_RESULT ReplayInputDriver::SetState(uint32_t user_index,
+                                     X_INPUT_VIBRATION* vibration) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (user_index >= kUserCount) {
+    return X_ERROR_DEVICE_NOT_CONNECTED;
+  }
+  for (const Stream& stream : streams_[user_index]) {
+    if (!stream.entries.empty()) {
+      return X_ERROR_SUCCESS;
+    }
+  }
+  return X_ERROR_DEVICE_NOT_CONNECTED;
+}
+
+X_RESULT ReplayInputDriver::GetKeystroke(uint32_t user_index, uint32_t flags,
+                                         X_INPUT_KEYSTROKE* out_keystroke) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool exhausted;
+  const InputRecordEntry* entry =
+      Next(user_index, InputRecordEntry::Kind::kKeystroke, exhausted);
+  if (!entry) {
+    return X_ERROR_DEVICE_NOT_CONNECTED;
+  }
+  if (exhausted) {
+    // Not repeating the last key event.
+    return X_ERROR_EMPTY;
+  }
+  if (out_keystroke) {
+    std::memcpy(out_keystroke, entry->payload, sizeof(*out_keystroke));
+  }
+  return entry->result;
+}
+
+}  // namespace hid
+}  // namespace xe
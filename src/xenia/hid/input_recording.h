@@ -0,0 +1,118 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_HID_INPUT_RECORDING_H_
+#define XENIA_HID_INPUT_RECORDING_H_
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/hid/input.h"
+#include "xenia/hid/input_driver.h"
+#include "xenia/xbox.h"
+
+namespace xe {
+namespace hid {
+
+// Results of the guest input polls, in the order the guest made them. The
+// payloads are stored in the guest layout.
+struct InputRecordEntry {
+  enum class Kind : uint8_t {
+    kCapabilities,
+    kState,
+    kKeystroke,
+  };
+
+  // Guest tick count at the poll, for inspecting when the recording diverged.
+  uint64_t guest_tick_count;
+  Kind kind;
+  uint8_t user_index;
+  uint16_t reserved;
+  uint32_t flags;
+  X_RESULT result;
+  uint32_t reserved2;
+  // X_INPUT_CAPABILITIES, X_INPUT_STATE or X_INPUT_KEYSTROKE.
+  uint8_t payload[24];
+};
+static_assert_size(InputRecordEntry, 48);
+
+// Writes the results of the polls to a file as they're made.
+class InputRecorder {
+ public:
+  static std::unique_ptr<InputRecorder> Create(
+      const std::filesystem::path& path);
+  ~InputRecorder();
+
+  void RecordCapabilities(uint32_t user_index, uint32_t flags,
+                          X_RESULT result, const X_INPUT_CAPABILITIES* caps);
+  void RecordState(uint32_t user_index, X_RESULT result,
+                   const X_INPUT_STATE* state);
+  void RecordKeystroke(uint32_t user_index, uint32_t flags, X_RESULT result,
+                       const X_INPUT_KEYSTROKE* keystroke);
+
+ private:
+  explicit InputRecorder(FILE* file) : file_(file) {}
+
+  void Write(InputRecordEntry& entry, const void* payload,
+             size_t payload_size);
+
+  std::mutex mutex_;
+  FILE* file_;
+};
+
+// Returns the recorded results for each user in the order of the polls,
+// without touching the host devices. Deterministic as long as the guest polls
+// in the same order, which requires fixed timing.
+class ReplayInputDriver final : public InputDriver {
+ public:
+  static std::unique_ptr<ReplayInputDriver> Load(
+      const std::filesystem::path& path, xe::ui::Window* window,
+      size_t window_z_order);
+  ~ReplayInputDriver() override;
+
+  X_STATUS Setup() override;
+
+  X_RESULT GetCapabilities(uint32_t user_index, uint32_t flags,
+                           X_INPUT_CAPABILITIES* out_caps) override;
+  X_RESULT GetState(uint32_t user_index, X_INPUT_STATE* out_state) override;
+  X_RESULT SetState(uint32_t user_index, X_INPUT_VIBRATION* vibration) override;
+  X_RESULT GetKeystroke(uint32_t user_index, uint32_t flags,
+                        X_INPUT_KEYSTROKE* out_keystroke) override;
+
+ private:
+  static constexpr uint32_t kUserCount = 4;
+  static constexpr size_t kKindCount = 3;
+
+  struct Stream {
+    std::vector<InputRecordEntry> entries;
+    size_t next = 0;
+  };
+
+  ReplayInputDriver(xe::ui::Window* window, size_t window_z_order)
+      : InputDriver(window, window_z_order) {}
+
+  // Null if the user has no recorded polls of the kind. Past the end of the
+  // stream, the last entry is returned again with exhausted set.
+  const InputRecordEntry* Next(uint32_t user_index,
+                               InputRecordEntry::Kind kind, bool& exhausted);
+
+  std::mutex mutex_;
+  std::array<std::array<Stream, kKindCount>, kUserCount> streams_;
+  bool exhausted_reported_ = false;
+};
+
+}  // namespace hid
+}  // namespace xe
+
+#endif  // XENIA_HID_INPUT_RECORDING_H_
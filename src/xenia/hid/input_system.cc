@@ -9,6 +9,10 @@
 
 #include "xenia/hid/input_system.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/logging.h"
 #include "xenia/base/profiling.h"
 #include "xenia/hid/hid_flags.h"
 #include "xenia/hid/input_driver.h"
@@ -17,12 +21,92 @@ namespace xe {
 namespace hid {
 
 DEFINE_bool(vibration, true, "Toggle controller vibration.", "HID");
+DEFINE_path(input_record_path, "",
+            "File to record the results of the guest input polls to, for "
+            "replaying them with input_replay_path.",
+            "HID");
+DEFINE_path(input_replay_path, "",
+            "Input recording to return the results of the guest input polls "
+            "from in the recorded order instead of using the input devices. "
+            "Best combined with fixed timing for the guest to poll the same "
+            "way as while recording.",
+            "HID");
+DEFINE_uint32(input_poll_rate, 0,
+              "Rate in Hz at which a dedicated thread polls the controller "
+              "state from the input devices. The guest state queries return "
+              "the last polled state without waiting for the devices. 0 to "
+              "poll the devices on every query.",
+              "HID");
 
 InputSystem::InputSystem(xe::ui::Window* window) : window_(window) {}
 
-InputSystem::~InputSystem() = default;
+InputSystem::~InputSystem() {
+  if (poll_thread_) {
+    poll_thread_running_.store(false, std::memory_order_relaxed);
+    threading::Wait(poll_thread_.get(), false);
+    poll_thread_.reset();
+  }
+}
+
+X_STATUS InputSystem::Setup() {
+  if (!cvars::input_replay_path.empty()) {
+    auto replay_driver =
+        ReplayInputDriver::Load(cvars::input_replay_path, window_, 0);
+    if (replay_driver) {
+      host_drivers_ = std::move(drivers_);
+      drivers_.clear();
+      drivers_.push_back(std::move(replay_driver));
+    }
+  }
+  if (!cvars::input_record_path.empty()) {
+    recorder_ = InputRecorder::Create(cvars::input_record_path);
+  }
+  if (cvars::input_poll_rate && !is_replaying()) {
+    // Having a valid state before the first guest query.
+    PollStates();
+    poll_thread_running_.store(true, std::memory_order_relaxed);
+    auto interval = std::chrono::microseconds(
+        std::max(uint32_t(1000000 / cvars::input_poll_rate), uint32_t(1)));
+    threading::Thread::CreationParameters params;
+    poll_thread_ = threading::Thread::Create(
+        params, [this, interval]() { PollThreadMain(interval); });
+    if (poll_thread_) {
+      poll_thread_->set_name("Input Polling");
+    }
+  }
+  return X_STATUS_SUCCESS;
+}
+
+void InputSystem::PollStates() {
+  SCOPE_profile_cpu_f("hid");
 
-X_STATUS InputSystem::Setup() { return X_STATUS_SUCCESS; }
+  for (uint32_t user_index = 0; user_index < kPolledUserCount; ++user_index) {
+    uint32_t words[PolledState::kWordCount];
+    X_INPUT_STATE state = {};
+    X_RESULT result;
+    {
+      auto input_lock = lock();
+      result = GetDriverState(drivers_, user_index, &state, true);
+    }
+    std::memcpy(&words[0], &result, sizeof(result));
+    std::memcpy(&words[1], &state, sizeof(state));
+    PolledState& polled_state = polled_states_[user_index];
+    uint32_t sequence = polled_state.sequence.load(std::memory_order_relaxed);
+    polled_state.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < PolledState::kWordCount; ++i) {
+      polled_state.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    polled_state.sequence.store(sequence + 2, std::memory_order_release);
+  }
+}
+
+void InputSystem::PollThreadMain(std::chrono::microseconds interval) {
+  while (poll_thread_running_.load(std::memory_order_relaxed)) {
+    PollStates();
+    threading::Sleep(interval);
+  }
+}
 
 void InputSystem::AddDriver(std::unique_ptr<InputDriver> driver) {
   drivers_.push_back(std::move(driver));
@@ -44,36 +128,87 @@ X_RESULT InputSystem::GetCapabilities(uint32_t user_index, uint32_t flags,
                                       X_INPUT_CAPABILITIES* out_caps) {
   SCOPE_profile_cpu_f("hid");
 
+  X_RESULT result = X_ERROR_DEVICE_NOT_CONNECTED;
   bool any_connected = false;
   for (auto& driver : drivers_) {
-    X_RESULT result = driver->GetCapabilities(user_index, flags, out_caps);
+    result = driver->GetCapabilities(user_index, flags, out_caps);
     if (result != X_ERROR_DEVICE_NOT_CONNECTED) {
       any_connected = true;
     }
     if (result == X_ERROR_SUCCESS) {
-      UpdateUsedSlot(user_index, any_connected);
-      return result;
+      break;
     }
   }
   UpdateUsedSlot(user_index, any_connected);
-  return any_connected ? X_ERROR_EMPTY : X_ERROR_DEVICE_NOT_CONNECTED;
+  if (result != X_ERROR_SUCCESS) {
+    result = any_connected ? X_ERROR_EMPTY : X_ERROR_DEVICE_NOT_CONNECTED;
+  }
+  if (recorder_) {
+    recorder_->RecordCapabilities(user_index, flags, result, out_caps);
+  }
+  return result;
 }
 
 X_RESULT InputSystem::GetState(uint32_t user_index, X_INPUT_STATE* out_state) {
   SCOPE_profile_cpu_f("hid");
 
+  X_RESULT result;
+  if (poll_thread_ && user_index < kPolledUserCount) {
+    const PolledState& polled_state = polled_states_[user_index];
+    uint32_t words[PolledState::kWordCount];
+    uint32_t sequence;
+    do {
+      sequence = polled_state.sequence.load(std::memory_order_acquire);
+      for (size_t i = 0; i < PolledState::kWordCount; ++i) {
+        words[i] = polled_state.words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1) ||
+             polled_state.sequence.load(std::memory_order_relaxed) !=
+                 sequence);
+    std::memcpy(&result, &words[0], sizeof(result));
+    if (out_state) {
+      std::memcpy(out_state, &words[1], sizeof(*out_state));
+    }
+  } else {
+    result = GetDriverState(drivers_, user_index, out_state, true);
+  }
+  if (recorder_) {
+    recorder_->RecordState(user_index, result, out_state);
+  }
+  return result;
+}
+
+X_RESULT InputSystem::GetHostState(uint32_t user_index,
+                                   X_INPUT_STATE* out_state) {
+  SCOPE_profile_cpu_f("hid");
+
+  if (is_replaying()) {
+    // The connected slots are of the replayed users.
+    return GetDriverState(host_drivers_, user_index, out_state, false);
+  }
+  return GetDriverState(drivers_, user_index, out_state, true);
+}
+
+X_RESULT InputSystem::GetDriverState(
+    const std::vector<std::unique_ptr<InputDriver>>& drivers,
+    uint32_t user_index, X_INPUT_STATE* out_state, bool update_used_slot) {
   bool any_connected = false;
-  for (auto& driver : drivers_) {
+  for (auto& driver : drivers) {
     X_RESULT result = driver->GetState(user_index, out_state);
     if (result != X_ERROR_DEVICE_NOT_CONNECTED) {
       any_connected = true;
     }
     if (result == X_ERROR_SUCCESS) {
-      UpdateUsedSlot(user_index, any_connected);
+      if (update_used_slot) {
+        UpdateUsedSlot(user_index, any_connected);
+      }
       return result;
     }
   }
-  UpdateUsedSlot(user_index, any_connected);
+  if (update_used_slot) {
+    UpdateUsedSlot(user_index, any_connected);
+  }
   return any_connected ? X_ERROR_EMPTY : X_ERROR_DEVICE_NOT_CONNECTED;
 }
 
@@ -100,19 +235,25 @@ X_RESULT InputSystem::GetKeystroke(uint32_t user_index, uint32_t flags,
                                    X_INPUT_KEYSTROKE* out_keystroke) {
   SCOPE_profile_cpu_f("hid");
 
+  X_RESULT result = X_ERROR_DEVICE_NOT_CONNECTED;
   bool any_connected = false;
   for (auto& driver : drivers_) {
-    X_RESULT result = driver->GetKeystroke(user_index, flags, out_keystroke);
+    result = driver->GetKeystroke(user_index, flags, out_keystroke);
     if (result != X_ERROR_DEVICE_NOT_CONNECTED) {
       any_connected = true;
     }
     if (result == X_ERROR_SUCCESS || result == X_ERROR_EMPTY) {
-      UpdateUsedSlot(user_index, any_connected);
-      return result;
+      break;
     }
   }
   UpdateUsedSlot(user_index, any_connected);
-  return any_connected ? X_ERROR_EMPTY : X_ERROR_DEVICE_NOT_CONNECTED;
+  if (result != X_ERROR_SUCCESS && result != X_ERROR_EMPTY) {
+    result = any_connected ? X_ERROR_EMPTY : X_ERROR_DEVICE_NOT_CONNECTED;
+  }
+  if (recorder_) {
+    recorder_->RecordKeystroke(user_index, flags, result, out_keystroke);
+  }
+  return result;
 }
 
 void InputSystem::ToggleVibration() {
@@ -10,11 +10,15 @@
 #ifndef XENIA_HID_INPUT_SYSTEM_H_
 #define XENIA_HID_INPUT_SYSTEM_H_
 
+#include <array>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/hid/input.h"
 #include "xenia/hid/input_driver.h"
+#include "xenia/hid/input_recording.h"
 #include "xenia/xbox.h"
 
 namespace xe {
@@ -43,6 +47,14 @@ class InputSystem {
   X_RESULT SetState(uint32_t user_index, X_INPUT_VIBRATION* vibration);
   X_RESULT GetKeystroke(uint32_t user_index, uint32_t flags,
                         X_INPUT_KEYSTROKE* out_keystroke);
+  // For the polls made by the emulator itself rather than the guest, such as
+  // for the hotkeys. Not recorded, and uses the host devices while replaying.
+  X_RESULT GetHostState(uint32_t user_index, X_INPUT_STATE* out_state);
+
+  bool is_replaying() const { return !host_drivers_.empty(); }
+  // Whether GetState returns the state polled by the input thread, without
+  // needing the lock.
+  bool is_polling() const { return poll_thread_ != nullptr; }
 
   void ToggleVibration();
   void UpdateUsedSlot(uint8_t slot, bool connected);
@@ -54,6 +66,30 @@ class InputSystem {
   xe::ui::Window* window_ = nullptr;
 
   std::vector<std::unique_ptr<InputDriver>> drivers_;
+  // The drivers replaced by the replay driver, for the host polls.
+  std::vector<std::unique_ptr<InputDriver>> host_drivers_;
+  std::unique_ptr<InputRecorder> recorder_;
+
+  X_RESULT GetDriverState(
+      const std::vector<std::unique_ptr<InputDriver>>& drivers,
+      uint32_t user_index, X_INPUT_STATE* out_state, bool update_used_slot);
+
+  static constexpr uint32_t kPolledUserCount = 4;
+  // Written only by the input thread, read as a sequence lock: odd sequence
+  // numbers while being written, and the readers retry if the sequence number
+  // has changed while reading.
+  struct PolledState {
+    static constexpr size_t kWordCount =
+        (sizeof(X_RESULT) + sizeof(X_INPUT_STATE)) / sizeof(uint32_t);
+    std::atomic<uint32_t> sequence{0};
+    std::array<std::atomic<uint32_t>, kWordCount> words{};
+  };
+  void PollStates();
+  void PollThreadMain(std::chrono::microseconds interval);
+
+  std::array<PolledState, kPolledUserCount> polled_states_;
+  std::atomic<bool> poll_thread_running_{false};
+  std::unique_ptr<threading::Thread> poll_thread_;
 
   X_INPUT_VIBRATION ModifyVibrationLevel(X_INPUT_VIBRATION* vibration);
   uint8_t connected_slot = 0b0001;
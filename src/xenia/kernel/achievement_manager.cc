@@ -32,35 +32,32 @@ void AchievementManager::EarnAchievement(uint64_t xuid, uint32_t title_id,
   ui::ImGuiDrawer* imgui_drawer = emulator->imgui_drawer();
 
   const util::XdbfGameData title_xdbf = kernel_state()->title_xdbf();
-  const std::vector<util::XdbfAchievementTableEntry> achievements =
-      title_xdbf.GetAchievements();
+  const util::XdbfAchievementTableEntry* entry =
+      title_xdbf.GetAchievement(uint16_t(achievement_id));
+  if (!entry) {
+    return;
+  }
   const XLanguage title_language = title_xdbf.GetExistingLanguage(
       static_cast<XLanguage>(cvars::user_language));
 
-  for (const util::XdbfAchievementTableEntry& entry : achievements) {
-    if (entry.id == achievement_id) {
-      const std::string label =
-          title_xdbf.GetStringTableEntry(title_language, entry.label_id);
-      const std::string desc =
-          title_xdbf.GetStringTableEntry(title_language, entry.description_id);
-
-      XELOGI("Achievement unlocked: {}", label);
-      const std::string description =
-          fmt::format("{}G - {}", entry.gamerscore, label);
+  const std::string label =
+      title_xdbf.GetStringTableEntry(title_language, entry->label_id);
 
-      // Even if we disable popup we still should store info that this
-      // achievement was earned.
-      if (!cvars::show_achievement_notification) {
-        continue;
-      }
+  XELOGI("Achievement unlocked: {}", label);
+  const std::string description =
+      fmt::format("{}G - {}", entry->gamerscore, label);
 
-      app_context.CallInUIThread([imgui_drawer, description]() {
-        new xe::ui::AchievementNotificationWindow(
-            imgui_drawer, "Achievement unlocked", description, 0,
-            kernel_state()->notification_position_);
-      });
-    }
+  // Even if we disable popup we still should store info that this
+  // achievement was earned.
+  if (!cvars::show_achievement_notification) {
+    return;
   }
+
+  app_context.CallInUIThread([imgui_drawer, description]() {
+    new xe::ui::AchievementNotificationWindow(
+        imgui_drawer, "Achievement unlocked", description, 0,
+        kernel_state()->notification_position_);
+  });
 }
 
 }  // namespace kernel
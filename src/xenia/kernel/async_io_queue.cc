@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/async_io_queue.h"
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/metrics.h"
+
+DEFINE_uint32(async_io_threads, 2,
+              "Number of host threads to perform the guest file reads and "
+              "writes on, for the files opened for asynchronous I/O, so the "
+              "guest can do other work while waiting for them. 0 to perform "
+              "all the I/O synchronously in the guest thread requesting it.",
+              "Kernel");
+
+namespace xe {
+namespace kernel {
+
+namespace {
+metrics::Counter async_io_requests_metric(
+    "xenia_kernel_async_io_requests_total",
+    "Guest file operations performed on the asynchronous I/O threads.");
+metrics::Gauge async_io_requests_pending_metric(
+    "xenia_kernel_async_io_requests_pending",
+    "Guest file operations queued or being performed asynchronously.");
+}  // namespace
+
+uint32_t AsyncIOQueue::GetConfiguredThreadCount() {
+  return cvars::async_io_threads;
+}
+
+AsyncIOQueue::AsyncIOQueue(uint32_t thread_count) {
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threading::Thread::CreationParameters params;
+    auto thread = threading::Thread::Create(params, [this]() { ThreadMain(); });
+    if (!thread) {
+      XELOGE("Failed to create asynchronous I/O thread {}", i);
+      break;
+    }
+    thread->set_name(fmt::format("Async I/O Worker {}", i));
+    threads_.push_back(std::move(thread));
+  }
+}
+
+AsyncIOQueue::~AsyncIOQueue() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  cond_.notify_all();
+  for (auto& thread : threads_) {
+    threading::Wait(thread.get(), false);
+  }
+  threads_.clear();
+}
+
+void AsyncIOQueue::Queue(std::function<void()> request) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(std::move(request));
+  }
+  async_io_requests_metric.Add();
+  async_io_requests_pending_metric.Add(1);
+  cond_.notify_one();
+}
+
+void AsyncIOQueue::ThreadMain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this]() { return shutdown_ || !requests_.empty(); });
+    if (requests_.empty()) {
+      // Shutting down, with all the requests completed.
+      return;
+    }
+    {
+      // Releasing the references to the objects without the lock.
+      std::function<void()> request = std::move(requests_.front());
+      requests_.pop_front();
+      lock.unlock();
+      request();
+    }
+    async_io_requests_pending_metric.Add(-1);
+    lock.lock();
+  }
+}
+
+}  // namespace kernel
+}  // namespace xe
@@ -0,0 +1,59 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_ASYNC_IO_QUEUE_H_
+#define XENIA_KERNEL_ASYNC_IO_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace kernel {
+
+// Performs the guest file reads and writes on files opened for asynchronous
+// I/O on host threads, so the guest thread issuing them can do other work, such
+// as decompressing the previously loaded data, while waiting for the event,
+// the APC or the I/O completion port notification.
+class AsyncIOQueue {
+ public:
+  // Returns 0 if the asynchronous I/O is disabled.
+  static uint32_t GetConfiguredThreadCount();
+
+  explicit AsyncIOQueue(uint32_t thread_count);
+  AsyncIOQueue(const AsyncIOQueue& queue) = delete;
+  AsyncIOQueue& operator=(const AsyncIOQueue& queue) = delete;
+  // Completes the requests already queued.
+  ~AsyncIOQueue();
+
+  bool has_threads() const { return !threads_.empty(); }
+
+  // The request must keep references to the objects it uses.
+  void Queue(std::function<void()> request);
+
+ private:
+  void ThreadMain();
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::function<void()>> requests_;
+  bool shutdown_ = false;
+
+  std::vector<std::unique_ptr<threading::Thread>> threads_;
+};
+
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_ASYNC_IO_QUEUE_H_
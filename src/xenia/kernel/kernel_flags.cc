@@ -14,3 +14,20 @@ DEFINE_bool(headless, false,
             "UI");
 DEFINE_bool(log_high_frequency_kernel_calls, false,
             "Log kernel calls with the kHighFrequency tag.", "Kernel");
+DEFINE_bool(low_power_mode, false,
+            "Reduce how often the emulator wakes up the host processors when "
+            "the title is idle, for running many instances, such as headless "
+            "ones, on one host. Timers are coalesced and the guest timestamps "
+            "are updated less often. The timer wake-up rate is logged "
+            "periodically.",
+            "Kernel");
+DEFINE_bool(kernel_export_profiling, false,
+            "Count the calls, the host time and the guest callers of each "
+            "kernel export, and log a report of the most frequently called "
+            "exports on exit.",
+            "Kernel");
+DEFINE_string(kernel_export_direct_dispatch, "",
+              "Comma-separated names of the kernel exports to call without "
+              "logging, in addition to the ones tagged as high frequency, such "
+              "as the ones suggested by the kernel_export_profiling report.",
+              "Kernel");
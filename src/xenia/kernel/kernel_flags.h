@@ -13,5 +13,8 @@
 
 DECLARE_bool(headless);
 DECLARE_bool(log_high_frequency_kernel_calls);
+DECLARE_bool(low_power_mode);
+DECLARE_bool(kernel_export_profiling);
+DECLARE_string(kernel_export_direct_dispatch);
 
 #endif  // XENIA_KERNEL_KERNEL_FLAGS_H_
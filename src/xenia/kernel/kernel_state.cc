@@ -13,12 +13,14 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/emulator.h"
 #include "xenia/hid/input_system.h"
+#include "xenia/kernel/kernel_flags.h"
 #include "xenia/kernel/user_module.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xam/xam_module.h"
@@ -30,12 +32,22 @@
 #include "xenia/kernel/xthread.h"
 
 DEFINE_bool(apply_title_update, true, "Apply title updates.", "Kernel");
+DEFINE_uint32(thread_stack_pool_size, 32,
+              "Maximum number of guest stacks of the destroyed threads kept "
+              "for the new threads, for titles continuously creating short "
+              "lived threads. 0 to release the stacks immediately.",
+              "Kernel");
 
 namespace xe {
 namespace kernel {
 
 constexpr uint32_t kDeferredOverlappedDelayMillis = 100;
 
+// low_power_mode timings.
+constexpr auto kLowPowerTimerSlack = std::chrono::milliseconds(4);
+constexpr auto kLowPowerTimestampInterval = std::chrono::milliseconds(4);
+constexpr auto kLowPowerReportInterval = std::chrono::seconds(60);
+
 // This is a global object initialized with the XboxkrnlModule.
 // It references the current kernel state object that all kernel methods should
 // be using to stash their variables.
@@ -53,6 +65,14 @@ KernelState::KernelState(Emulator* emulator)
 
   app_manager_ = std::make_unique<xam::AppManager>();
   achievement_manager_ = std::make_unique<AchievementManager>();
+  uint32_t async_io_thread_count = AsyncIOQueue::GetConfiguredThreadCount();
+  if (async_io_thread_count) {
+    async_io_queue_ = std::make_unique<AsyncIOQueue>(async_io_thread_count);
+    if (!async_io_queue_->has_threads()) {
+      async_io_queue_.reset();
+    }
+  }
+  timer_wheel_ = std::make_unique<TimerWheel>();
   user_profiles_.emplace(0, std::make_unique<xam::UserProfile>(0));
 
   auto content_root = emulator_->content_root();
@@ -76,17 +96,59 @@ KernelState::KernelState(Emulator* emulator)
   xenia_assert(fixed_alloc_worked);
 
   xam::AppManager::RegisterApps(this, app_manager_.get());
+
+  if (cvars::low_power_mode) {
+    xe::threading::SetTimerQueueSlack(kLowPowerTimerSlack);
+    // The first callback is executed immediately, taking the initial counts.
+    wake_up_report_timer_ = xe::threading::HighResolutionTimer::CreateRepeating(
+        kLowPowerReportInterval,
+        [statistics_last = xe::threading::TimerQueueStatistics{},
+         first = true]() mutable {
+          xe::threading::TimerQueueStatistics statistics =
+              xe::threading::GetTimerQueueStatistics();
+          if (first) {
+            first = false;
+            statistics_last = statistics;
+            return;
+          }
+          uint64_t seconds = uint64_t(
+              std::chrono::duration_cast<std::chrono::seconds>(
+                  kLowPowerReportInterval)
+                  .count());
+          XELOGI(
+              "Timer thread: {} wake-ups per second, {} callbacks per second",
+              (statistics.wake_up_count - statistics_last.wake_up_count) /
+                  seconds,
+              (statistics.callback_count - statistics_last.callback_count) /
+                  seconds);
+          statistics_last = statistics;
+        });
+  }
 }
 
 KernelState::~KernelState() {
+  wake_up_report_timer_.reset();
   SetExecutableModule(nullptr);
 
+  if (cvars::kernel_export_profiling) {
+    shim::ReportExportStatistics();
+  }
+
   if (dispatch_thread_running_) {
     dispatch_thread_running_ = false;
     dispatch_cond_.notify_all();
     dispatch_thread_->Wait(0, 0, 0, nullptr);
   }
 
+  // Complete the pending I/O while the objects it references still exist.
+  async_io_queue_.reset();
+  {
+    std::lock_guard<std::mutex> lock(socket_multiplexer_mutex_);
+    // Not recreated when the sockets are closed later.
+    socket_multiplexer_created_ = true;
+    socket_multiplexer_.reset();
+  }
+
   executable_module_.reset();
   user_modules_.clear();
   kernel_modules_.clear();
@@ -94,6 +156,12 @@ KernelState::~KernelState() {
   // Delete all objects.
   object_table_.Reset();
 
+  for (const auto& free_thread_stack : free_thread_stacks_) {
+    memory_->LookupHeap(free_thread_stack.first)
+        ->Release(free_thread_stack.first);
+  }
+  free_thread_stacks_.clear();
+
   // Shutdown apps.
   app_manager_.reset();
 
@@ -117,7 +185,11 @@ uint32_t KernelState::title_id() const {
 }
 
 util::XdbfGameData KernelState::title_xdbf() const {
-  return module_xdbf(executable_module_);
+  std::lock_guard<std::mutex> lock(title_xdbf_mutex_);
+  if (!title_xdbf_) {
+    title_xdbf_ = module_xdbf(executable_module_);
+  }
+  return *title_xdbf_;
 }
 
 util::XdbfGameData KernelState::module_xdbf(
@@ -136,6 +208,18 @@ util::XdbfGameData KernelState::module_xdbf(
   return util::XdbfGameData(nullptr, resource_size);
 }
 
+SocketMultiplexer* KernelState::socket_multiplexer() {
+  std::lock_guard<std::mutex> lock(socket_multiplexer_mutex_);
+  if (!socket_multiplexer_created_) {
+    socket_multiplexer_created_ = true;
+    socket_multiplexer_ = std::make_unique<SocketMultiplexer>();
+    if (!socket_multiplexer_->is_initialized()) {
+      socket_multiplexer_.reset();
+    }
+  }
+  return socket_multiplexer_.get();
+}
+
 uint32_t KernelState::process_type() const {
   auto pib =
       memory_->TranslateVirtual<ProcessInfoBlock*>(process_info_block_address_);
@@ -162,6 +246,30 @@ void KernelState::FreeTLS(uint32_t slot) {
   tls_bitmap_.Release(slot);
 }
 
+uint32_t KernelState::TakeFreeThreadStack(uint32_t alloc_size) {
+  std::lock_guard<std::mutex> lock(free_thread_stacks_mutex_);
+  // The most recently freed first, as it's the most likely to be in the cache.
+  for (auto it = free_thread_stacks_.rbegin(); it != free_thread_stacks_.rend();
+       ++it) {
+    if (it->second == alloc_size) {
+      uint32_t alloc_base = it->first;
+      free_thread_stacks_.erase(std::next(it).base());
+      return alloc_base;
+    }
+  }
+  return 0;
+}
+
+bool KernelState::KeepFreeThreadStack(uint32_t alloc_base,
+                                      uint32_t alloc_size) {
+  std::lock_guard<std::mutex> lock(free_thread_stacks_mutex_);
+  if (free_thread_stacks_.size() >= cvars::thread_stack_pool_size) {
+    return false;
+  }
+  free_thread_stacks_.emplace_back(alloc_base, alloc_size);
+  return true;
+}
+
 void KernelState::RegisterTitleTerminateNotification(uint32_t routine,
                                                      uint32_t priority) {
   TerminateNotification notify;
@@ -319,6 +427,10 @@ void KernelState::SetExecutableModule(object_ref<UserModule> module) {
   if (module.get() == executable_module_.get()) {
     return;
   }
+  {
+    std::lock_guard<std::mutex> lock(title_xdbf_mutex_);
+    title_xdbf_.reset();
+  }
   executable_module_ = std::move(module);
   if (!executable_module_) {
     return;
@@ -458,7 +570,7 @@ X_RESULT KernelState::FinishLoadingUserModule(
   }
   module->Dump();
   emulator_->patcher()->ApplyPatchesForTitle(memory_, module->title_id(),
-                                             module->hash());
+                                             module->hash(), processor_);
   emulator_->on_patch_apply();
   if (module->xex_module()) {
     module->xex_module()->Precompile();
@@ -532,6 +644,10 @@ X_RESULT KernelState::ApplyTitleUpdate(const object_ref<UserModule> module) {
 
 void KernelState::UnloadUserModule(const object_ref<UserModule>& module,
                                    bool call_entry) {
+  if (module->xex_module()) {
+    processor()->CancelFunctionTranslations(module->xex_module());
+  }
+
   auto global_lock = global_critical_region_.Acquire();
 
   if (module->is_dll_module() && module->entry_point() && call_entry) {
@@ -565,6 +681,9 @@ void KernelState::UnloadUserModule(const object_ref<UserModule>& module,
 
 void KernelState::TerminateTitle() {
   XELOGD("KernelState::TerminateTitle");
+  // Stop background translation before the code goes away.
+  processor_->CancelFunctionTranslations(nullptr);
+
   auto global_lock = global_critical_region_.Acquire();
 
   // Call terminate routines.
@@ -951,15 +1070,62 @@ bool KernelState::Save(ByteStream* stream) {
 
 // this only gets triggered once per ms at most, so fields other than tick count
 // will probably not be updated in a timely manner for guest code that uses them
-void KernelState::UpdateKeTimestampBundle() {
-  X_TIME_STAMP_BUNDLE* lpKeTimeStampBundle =
+// through pointers - loads from the constant address of the bundle are done
+// through ReadKeTimestampBundle32/64 instead
+void KernelState::UpdateKeTimestampBundle() { PublishKeTimestampBundle(); }
+
+X_TIME_STAMP_BUNDLE KernelState::PublishKeTimestampBundle() {
+  // Both the timer and the inline reads store the times they see in the guest
+  // memory, and only ever forward, so a read through a pointer after an inline
+  // read (or the other way around) never goes back in time, even if the timer
+  // callback computed its times before the inline read.
+  X_TIME_STAMP_BUNDLE* guest_bundle =
       memory_->TranslateVirtual<X_TIME_STAMP_BUNDLE*>(ke_timestamp_bundle_ptr_);
-  uint32_t uptime_ms = Clock::QueryGuestUptimeMillis();
-  xe::store_and_swap<uint64_t>(&lpKeTimeStampBundle->interrupt_time,
+  X_TIME_STAMP_BUNDLE bundle = {};
+  xe::store_and_swap<uint64_t>(
+      &bundle.interrupt_time,
+      xe::atomic_store_max_be<uint64_t>(Clock::QueryGuestInterruptTime(),
+                                        &guest_bundle->interrupt_time));
+  xe::store_and_swap<uint64_t>(
+      &bundle.system_time,
+      xe::atomic_store_max_be<uint64_t>(Clock::QueryGuestSystemTime(),
+                                        &guest_bundle->system_time));
+  xe::store_and_swap<uint32_t>(
+      &bundle.tick_count,
+      xe::atomic_store_max_be<uint32_t>(Clock::QueryGuestUptimeMillis(),
+                                        &guest_bundle->tick_count));
+  return bundle;
+}
+
+void KernelState::QueryKeTimestampBundle(X_TIME_STAMP_BUNDLE* bundle) {
+  xe::store_and_swap<uint64_t>(&bundle->interrupt_time,
                                Clock::QueryGuestInterruptTime());
-  xe::store_and_swap<uint64_t>(&lpKeTimeStampBundle->system_time,
+  xe::store_and_swap<uint64_t>(&bundle->system_time,
                                Clock::QueryGuestSystemTime());
-  xe::store_and_swap<uint32_t>(&lpKeTimeStampBundle->tick_count, uptime_ms);
+  xe::store_and_swap<uint32_t>(&bundle->tick_count,
+                               Clock::QueryGuestUptimeMillis());
+  xe::store_and_swap<uint32_t>(&bundle->padding, 0);
+}
+
+uint32_t KernelState::ReadKeTimestampBundle32(void* ppc_context,
+                                              void* callback_context,
+                                              uint32_t addr) {
+  auto kernel_state = reinterpret_cast<KernelState*>(callback_context);
+  X_TIME_STAMP_BUNDLE bundle = kernel_state->PublishKeTimestampBundle();
+  // The caller swaps the value back to the guest byte order.
+  uint32_t offset = addr - kernel_state->ke_timestamp_bundle_ptr_;
+  return xe::load_and_swap<uint32_t>(reinterpret_cast<const uint8_t*>(&bundle) +
+                                offset);
+}
+
+uint64_t KernelState::ReadKeTimestampBundle64(void* ppc_context,
+                                              void* callback_context,
+                                              uint32_t addr) {
+  auto kernel_state = reinterpret_cast<KernelState*>(callback_context);
+  X_TIME_STAMP_BUNDLE bundle = kernel_state->PublishKeTimestampBundle();
+  uint32_t offset = addr - kernel_state->ke_timestamp_bundle_ptr_;
+  return xe::load_and_swap<uint64_t>(reinterpret_cast<const uint8_t*>(&bundle) +
+                                offset);
 }
 
 uint32_t KernelState::GetKeTimestampBundle() {
@@ -980,21 +1146,19 @@ uint32_t KernelState::CreateKeTimestampBundle() {
   X_TIME_STAMP_BUNDLE* lpKeTimeStampBundle =
       memory_->TranslateVirtual<X_TIME_STAMP_BUNDLE*>(pKeTimeStampBundle);
 
-  xe::store_and_swap<uint64_t>(&lpKeTimeStampBundle->interrupt_time,
-                               Clock::QueryGuestInterruptTime());
+  QueryKeTimestampBundle(lpKeTimeStampBundle);
 
-  xe::store_and_swap<uint64_t>(&lpKeTimeStampBundle->system_time,
-                               Clock::QueryGuestSystemTime());
-
-  xe::store_and_swap<uint32_t>(&lpKeTimeStampBundle->tick_count,
-                               Clock::QueryGuestUptimeMillis());
-
-  xe::store_and_swap<uint32_t>(&lpKeTimeStampBundle->padding, 0);
+  // The import of the bundle is resolved before any guest code is translated,
+  // so the loads from its address can always be replaced.
+  ke_timestamp_bundle_ptr_ = pKeTimeStampBundle;
+  memory_->AddInlineReadRange(pKeTimeStampBundle, sizeof(X_TIME_STAMP_BUNDLE),
+                              this, ReadKeTimestampBundle32,
+                              ReadKeTimestampBundle64);
 
   timestamp_timer_ = xe::threading::HighResolutionTimer::CreateRepeating(
-      std::chrono::milliseconds(1),
+      cvars::low_power_mode ? kLowPowerTimestampInterval
+                            : std::chrono::milliseconds(1),
       [this]() { this->UpdateKeTimestampBundle(); });
-  ke_timestamp_bundle_ptr_ = pKeTimeStampBundle;
   return pKeTimeStampBundle;
 }
 
@@ -1004,6 +1168,13 @@ bool KernelState::Restore(ByteStream* stream) {
     return false;
   }
 
+  // The kept stacks are not in the saved state, and their memory may now
+  // belong to the restored threads.
+  {
+    std::lock_guard<std::mutex> lock(free_thread_stacks_mutex_);
+    free_thread_stacks_.clear();
+  }
+
   // Restore the object table
   object_table_.Restore(stream);
 
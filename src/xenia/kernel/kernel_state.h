@@ -15,6 +15,9 @@
 #include <functional>
 #include <list>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
 #include <vector>
 
 #include "achievement_manager.h"
@@ -22,6 +25,9 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/export_resolver.h"
+#include "xenia/kernel/async_io_queue.h"
+#include "xenia/kernel/socket_multiplexer.h"
+#include "xenia/kernel/timer_wheel.h"
 #include "xenia/kernel/util/kernel_fwd.h"
 #include "xenia/kernel/util/native_list.h"
 #include "xenia/kernel/util/object_table.h"
@@ -105,9 +111,17 @@ class KernelState {
   vfs::VirtualFileSystem* file_system() const { return file_system_; }
 
   uint32_t title_id() const;
+  // Indexed once for the executable module.
   util::XdbfGameData title_xdbf() const;
   util::XdbfGameData module_xdbf(object_ref<UserModule> exec_module) const;
 
+  // nullptr if the asynchronous I/O is disabled.
+  AsyncIOQueue* async_io_queue() const { return async_io_queue_.get(); }
+  TimerWheel* timer_wheel() const { return timer_wheel_.get(); }
+  // Created on the first use, after the guest has initialized the networking.
+  // nullptr if it couldn't be created.
+  SocketMultiplexer* socket_multiplexer();
+
   AchievementManager* achievement_manager() const {
     return achievement_manager_.get();
   }
@@ -156,6 +170,13 @@ class KernelState {
   uint32_t AllocateTLS();
   void FreeTLS(uint32_t slot);
 
+  // Guest stacks of the destroyed threads are kept for reuse, as allocating
+  // and protecting them is the most expensive guest part of thread creation.
+  // Returns the base of a kept allocation of exactly the size, or 0.
+  uint32_t TakeFreeThreadStack(uint32_t alloc_size);
+  // Returns false if the stack must be released instead.
+  bool KeepFreeThreadStack(uint32_t alloc_base, uint32_t alloc_size);
+
   void RegisterTitleTerminateNotification(uint32_t routine, uint32_t priority);
   void RemoveTitleTerminateNotification(uint32_t routine);
 
@@ -247,6 +268,19 @@ class KernelState {
   void UpdateKeTimestampBundle();
 
  private:
+  // Fills the bundle with the current times in the guest byte order.
+  static void QueryKeTimestampBundle(X_TIME_STAMP_BUNDLE* bundle);
+  // Advances the times in the guest bundle to the current ones, returning the
+  // resulting times in the guest byte order.
+  X_TIME_STAMP_BUNDLE PublishKeTimestampBundle();
+  // For the inline reads of the bundle by the translated code.
+  static uint32_t ReadKeTimestampBundle32(void* ppc_context,
+                                          void* callback_context,
+                                          uint32_t addr);
+  static uint64_t ReadKeTimestampBundle64(void* ppc_context,
+                                          void* callback_context,
+                                          uint32_t addr);
+
   void LoadKernelModule(object_ref<KernelModule> kernel_module);
 
   Emulator* emulator_;
@@ -258,6 +292,20 @@ class KernelState {
   std::unique_ptr<xam::ContentManager> content_manager_;
   std::map<uint8_t, std::unique_ptr<xam::UserProfile>> user_profiles_;
   std::unique_ptr<AchievementManager> achievement_manager_;
+  std::unique_ptr<AsyncIOQueue> async_io_queue_;
+  // Outlives the timer objects in the object table.
+  std::unique_ptr<TimerWheel> timer_wheel_;
+  std::mutex socket_multiplexer_mutex_;
+  bool socket_multiplexer_created_ = false;
+  std::unique_ptr<SocketMultiplexer> socket_multiplexer_;
+
+  mutable std::mutex title_xdbf_mutex_;
+  // Reset when the executable module is changed.
+  mutable std::optional<util::XdbfGameData> title_xdbf_;
+
+  std::mutex free_thread_stacks_mutex_;
+  // Base and size of each allocation including the guard pages.
+  std::vector<std::pair<uint32_t, uint32_t>> free_thread_stacks_;
 
   xe::global_critical_region global_critical_region_;
 
@@ -285,6 +333,7 @@ class KernelState {
   BitMap tls_bitmap_;
   uint32_t ke_timestamp_bundle_ptr_ = 0;
   std::unique_ptr<xe::threading::HighResolutionTimer> timestamp_timer_;
+  std::unique_ptr<xe::threading::HighResolutionTimer> wake_up_report_timer_;
   //fixed address referenced by dashboards. Data is currently unknown
   uint32_t strange_hardcoded_page_ = 0x8E038634 & (~0xFFFF);
   uint32_t strange_hardcoded_location_ = 0x8E038634;
@@ -0,0 +1,250 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/socket_multiplexer.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
+
+#ifdef XE_PLATFORM_WIN32
+// clang-format off
+#include "xenia/base/platform_win.h"
+#include <WS2tcpip.h>
+#include <WinSock2.h>
+// clang-format on
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace xe {
+namespace kernel {
+
+namespace {
+
+#ifdef XE_PLATFORM_WIN32
+using PollDescriptor = WSAPOLLFD;
+using NativeSocket = SOCKET;
+
+int PollSockets(PollDescriptor* descriptors, size_t count) {
+  return WSAPoll(descriptors, ULONG(count), -1);
+}
+
+void CloseSocket(uint64_t native_handle) {
+  closesocket(NativeSocket(native_handle));
+}
+#else
+using PollDescriptor = pollfd;
+using NativeSocket = int;
+
+int PollSockets(PollDescriptor* descriptors, size_t count) {
+  return poll(descriptors, nfds_t(count), -1);
+}
+
+void CloseSocket(uint64_t native_handle) { close(NativeSocket(native_handle)); }
+#endif
+
+uint64_t CreateWakeUpSocket() {
+  NativeSocket native_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  uint64_t native_handle = uint64_t(native_socket);
+  if (native_handle == uint64_t(-1)) {
+    return native_handle;
+  }
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t address_length = sizeof(address);
+  if (bind(native_socket, reinterpret_cast<const sockaddr*>(&address),
+           sizeof(address)) < 0 ||
+      getsockname(native_socket, reinterpret_cast<sockaddr*>(&address),
+                  &address_length) < 0 ||
+      connect(native_socket, reinterpret_cast<const sockaddr*>(&address),
+              address_length) < 0) {
+    CloseSocket(native_handle);
+    return uint64_t(-1);
+  }
+  return native_handle;
+}
+
+}  // namespace
+
+SocketMultiplexer::SocketMultiplexer() {
+  wake_up_socket_ = CreateWakeUpSocket();
+  if (wake_up_socket_ == uint64_t(-1)) {
+    XELOGE("Failed to create the socket for waking up the socket multiplexer");
+    return;
+  }
+  threading::Thread::CreationParameters params;
+  thread_ = threading::Thread::Create(params, [this]() { ThreadMain(); });
+  if (!thread_) {
+    XELOGE("Failed to create the socket multiplexer thread");
+    return;
+  }
+  thread_->set_name("Kernel Socket Multiplexer");
+}
+
+SocketMultiplexer::~SocketMultiplexer() {
+  if (thread_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+      WakeUp();
+    }
+    threading::Wait(thread_.get(), false);
+  }
+  for (PendingOperation& operation : operations_) {
+    operation.operation(true);
+  }
+  operations_.clear();
+  if (wake_up_socket_ != uint64_t(-1)) {
+    CloseSocket(wake_up_socket_);
+  }
+}
+
+void SocketMultiplexer::Submit(uint64_t native_handle, Direction direction,
+                               Operation operation) {
+  assert_true(is_initialized());
+  std::lock_guard<std::mutex> lock(mutex_);
+  PendingOperation& pending_operation = operations_.emplace_back();
+  pending_operation.id = next_id_++;
+  pending_operation.native_handle = native_handle;
+  pending_operation.direction = direction;
+  pending_operation.operation = std::move(operation);
+  WakeUp();
+}
+
+void SocketMultiplexer::Cancel(uint64_t native_handle) {
+  std::unique_lock<std::mutex> operation_lock(operation_mutex_,
+                                              std::defer_lock);
+  if (threading::Thread::GetCurrentThread() != thread_.get()) {
+    // Await the operations being performed currently.
+    operation_lock.lock();
+  }
+  std::vector<PendingOperation> canceled_operations;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::stable_partition(
+        operations_.begin(), operations_.end(),
+        [native_handle](const PendingOperation& operation) {
+          return operation.native_handle != native_handle;
+        });
+    if (it == operations_.end()) {
+      return;
+    }
+    std::move(it, operations_.end(), std::back_inserter(canceled_operations));
+    operations_.erase(it, operations_.end());
+    WakeUp();
+  }
+  for (PendingOperation& operation : canceled_operations) {
+    operation.operation(true);
+  }
+}
+
+void SocketMultiplexer::WakeUp() {
+  // Only one byte is needed to make the socket readable.
+  if (wake_up_pending_) {
+    return;
+  }
+  char wake_up_byte = 0;
+  if (send(NativeSocket(wake_up_socket_), &wake_up_byte, 1, 0) == 1) {
+    wake_up_pending_ = true;
+  }
+}
+
+void SocketMultiplexer::ThreadMain() {
+  std::vector<PollDescriptor> descriptors;
+  std::vector<uint64_t> descriptor_operation_ids;
+  std::vector<PendingOperation> ready_operations;
+  std::vector<PendingOperation> unready_operations;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!shutdown_) {
+    descriptors.clear();
+    descriptor_operation_ids.clear();
+    PollDescriptor& wake_up_descriptor = descriptors.emplace_back();
+    wake_up_descriptor = {};
+    wake_up_descriptor.fd = NativeSocket(wake_up_socket_);
+    wake_up_descriptor.events = POLLIN;
+    descriptor_operation_ids.push_back(0);
+    for (const PendingOperation& operation : operations_) {
+      PollDescriptor& descriptor = descriptors.emplace_back();
+      descriptor = {};
+      descriptor.fd = NativeSocket(operation.native_handle);
+      descriptor.events =
+          operation.direction == Direction::kReceive ? POLLIN : POLLOUT;
+      descriptor_operation_ids.push_back(operation.id);
+    }
+    lock.unlock();
+    int poll_result = PollSockets(descriptors.data(), descriptors.size());
+    if (poll_result <= 0) {
+      // Interrupted, try again with the current operations.
+      lock.lock();
+      continue;
+    }
+    std::lock_guard<std::mutex> operation_lock(operation_mutex_);
+    lock.lock();
+    if (descriptors[0].revents & POLLIN) {
+      char wake_up_byte;
+      recv(NativeSocket(wake_up_socket_), &wake_up_byte, 1, 0);
+      wake_up_pending_ = false;
+    }
+    // The operations canceled while polling are not in the list anymore.
+    for (size_t i = 1; i < descriptors.size(); ++i) {
+      if (!descriptors[i].revents) {
+        continue;
+      }
+      auto it = std::find_if(operations_.begin(), operations_.end(),
+                             [&](const PendingOperation& operation) {
+                               return operation.id ==
+                                      descriptor_operation_ids[i];
+                             });
+      if (it == operations_.end()) {
+        continue;
+      }
+      // Only the first operation in each direction for the readiness, the
+      // other ones may block if it has consumed the received data.
+      if (std::find_if(ready_operations.begin(), ready_operations.end(),
+                       [&](const PendingOperation& operation) {
+                         return operation.native_handle == it->native_handle &&
+                                operation.direction == it->direction;
+                       }) != ready_operations.end()) {
+        continue;
+      }
+      ready_operations.push_back(std::move(*it));
+      operations_.erase(it);
+    }
+    if (ready_operations.empty()) {
+      continue;
+    }
+    lock.unlock();
+    for (PendingOperation& operation : ready_operations) {
+      if (!operation.operation(false)) {
+        unready_operations.push_back(std::move(operation));
+      }
+    }
+    ready_operations.clear();
+    lock.lock();
+    // Before the operations submitted later, and not canceled as the operation
+    // mutex is still held.
+    operations_.insert(operations_.begin(),
+                       std::make_move_iterator(unready_operations.begin()),
+                       std::make_move_iterator(unready_operations.end()));
+    unready_operations.clear();
+  }
+}
+
+}  // namespace kernel
+}  // namespace xe
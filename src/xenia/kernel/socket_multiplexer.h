@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_SOCKET_MULTIPLEXER_H_
+#define XENIA_KERNEL_SOCKET_MULTIPLEXER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace kernel {
+
+// Waits for the host sockets of the guest overlapped socket operations to
+// become ready on a single host thread for all the sockets, and performs the
+// operations on it, so the guest threads only wait for the guest events of the
+// operations instead of each being blocked in the host socket functions.
+class SocketMultiplexer {
+ public:
+  enum class Direction {
+    kReceive,
+    kSend,
+  };
+
+  // Invoked on the multiplexer thread once the socket is ready, returns false
+  // if the socket turned out not to be ready and the operation needs to wait
+  // more. Invoked with canceled set instead, on the thread closing the socket,
+  // if it's closed before that. Must keep references to the objects it uses.
+  using Operation = std::function<bool(bool canceled)>;
+
+  // The host networking must be initialized.
+  SocketMultiplexer();
+  SocketMultiplexer(const SocketMultiplexer& multiplexer) = delete;
+  SocketMultiplexer& operator=(const SocketMultiplexer& multiplexer) = delete;
+  // Cancels the pending operations.
+  ~SocketMultiplexer();
+
+  // False if the host socket for waking up the thread couldn't be created.
+  bool is_initialized() const { return thread_ != nullptr; }
+
+  // The operations of the socket in the same direction are performed in the
+  // order of the submission.
+  void Submit(uint64_t native_handle, Direction direction,
+              Operation operation);
+  // No operations of the socket will be running after this call, unless called
+  // from an operation.
+  void Cancel(uint64_t native_handle);
+
+ private:
+  struct PendingOperation {
+    uint64_t id;
+    uint64_t native_handle;
+    Direction direction;
+    Operation operation;
+  };
+
+  // With the mutex locked.
+  void WakeUp();
+  void ThreadMain();
+
+  // A UDP socket connected to itself, readable when the set of the operations
+  // has been changed.
+  uint64_t wake_up_socket_ = uint64_t(-1);
+
+  std::mutex mutex_;
+  bool shutdown_ = false;
+  bool wake_up_pending_ = false;
+  uint64_t next_id_ = 1;
+  std::vector<PendingOperation> operations_;
+
+  // Held while performing the operations, for waiting for them in Cancel. Must
+  // be locked before the mutex if both are needed.
+  std::mutex operation_mutex_;
+  std::unique_ptr<threading::Thread> thread_;
+};
+
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_SOCKET_MULTIPLEXER_H_
@@ -0,0 +1,263 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/timer_wheel.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/math.h"
+
+namespace xe {
+namespace kernel {
+
+TimerWheel::TimerWheel() : origin_(clock::now()) {
+  threading::Thread::CreationParameters params;
+  thread_ = threading::Thread::Create(params, [this]() { ThreadMain(); });
+  assert_not_null(thread_);
+  thread_->set_name("Kernel Timer Wheel");
+}
+
+TimerWheel::~TimerWheel() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  cond_.notify_all();
+  threading::Wait(thread_.get(), false);
+}
+
+uint64_t TimerWheel::Schedule(clock::time_point due, clock::duration period,
+                              std::function<void()> callback) {
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (timers_.empty()) {
+      // The thread hasn't been advancing the ticks while idle.
+      ClearLevels();
+      current_tick_ = std::max(current_tick_, GetElapsedTick(clock::now()));
+    }
+    id = next_id_++;
+    Timer& timer = timers_[id];
+    // The current tick has already been processed.
+    timer.due_tick = std::max(GetDueTick(due), current_tick_ + 1);
+    timer.period_ticks =
+        period > clock::duration::zero()
+            ? std::max(uint64_t(1), uint64_t((period + kTickDuration -
+                                              clock::duration(1)) /
+                                             kTickDuration))
+            : 0;
+    timer.callback = std::move(callback);
+    Insert(id, timer.due_tick);
+  }
+  cond_.notify_one();
+  return id;
+}
+
+bool TimerWheel::Cancel(uint64_t id) {
+  bool was_scheduled;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The ID stays in its slot until the slot is visited.
+    was_scheduled = timers_.erase(id) != 0;
+  }
+  if (threading::Thread::GetCurrentThread() != thread_.get()) {
+    // Await the callbacks being invoked currently.
+    std::lock_guard<std::mutex> callback_lock(callback_mutex_);
+  }
+  return was_scheduled;
+}
+
+uint64_t TimerWheel::GetDueTick(clock::time_point time) const {
+  if (time <= origin_) {
+    return 0;
+  }
+  return uint64_t((time - origin_ + kTickDuration - clock::duration(1)) /
+                  kTickDuration);
+}
+
+uint64_t TimerWheel::GetElapsedTick(clock::time_point time) const {
+  if (time <= origin_) {
+    return 0;
+  }
+  return uint64_t((time - origin_) / kTickDuration);
+}
+
+void TimerWheel::ClearLevels() {
+  for (Level& level : levels_) {
+    uint64_t occupied_slots = level.occupied_slots;
+    uint32_t slot_index;
+    while (xe::bit_scan_forward(occupied_slots, &slot_index)) {
+      occupied_slots &= ~(uint64_t(1) << slot_index);
+      level.slots[slot_index].clear();
+    }
+    level.occupied_slots = 0;
+  }
+  overflow_.clear();
+}
+
+void TimerWheel::Insert(uint64_t id, uint64_t due_tick) {
+  assert_true(due_tick >= current_tick_);
+  // The first level sharing the slot of the next level with the current tick.
+  uint64_t different_bits = due_tick ^ current_tick_;
+  uint32_t level_index = 0;
+  while (level_index < kLevelCount &&
+         (different_bits >> (kLevelBits * (level_index + 1)))) {
+    ++level_index;
+  }
+  if (level_index >= kLevelCount) {
+    overflow_.push_back(id);
+    return;
+  }
+  uint32_t slot_index =
+      uint32_t(due_tick >> (kLevelBits * level_index)) & kSlotMask;
+  Level& level = levels_[level_index];
+  level.slots[slot_index].push_back(id);
+  level.occupied_slots |= uint64_t(1) << slot_index;
+}
+
+void TimerWheel::Reinsert(std::vector<uint64_t>& ids) {
+  for (uint64_t id : ids) {
+    auto it = timers_.find(id);
+    if (it != timers_.end()) {
+      Insert(id, std::max(it->second.due_tick, current_tick_));
+    }
+  }
+}
+
+void TimerWheel::Cascade(uint32_t level_index) {
+  Level& level = levels_[level_index];
+  uint32_t slot_index =
+      uint32_t(current_tick_ >> (kLevelBits * level_index)) & kSlotMask;
+  if (!(level.occupied_slots & (uint64_t(1) << slot_index))) {
+    return;
+  }
+  level.occupied_slots &= ~(uint64_t(1) << slot_index);
+  // The timers in the slot are all due in the range of the slot, so they go
+  // to the finer levels, not back to the same slot.
+  std::vector<uint64_t> ids;
+  ids.swap(level.slots[slot_index]);
+  Reinsert(ids);
+  // Keeping the allocated storage for the slot.
+  ids.clear();
+  if (level.slots[slot_index].empty()) {
+    level.slots[slot_index].swap(ids);
+  }
+}
+
+void TimerWheel::Advance(
+    std::vector<std::function<void()>>& expired_callbacks) {
+  uint64_t tick = ++current_tick_;
+  if (!(tick & ((uint64_t(1) << (kLevelBits * kLevelCount)) - 1)) &&
+      !overflow_.empty()) {
+    std::vector<uint64_t> ids;
+    ids.swap(overflow_);
+    Reinsert(ids);
+  }
+  // From the coarsest level, as the timers from it may be moved to the slots
+  // of the finer levels being entered at this tick.
+  for (uint32_t level_index = kLevelCount - 1; level_index; --level_index) {
+    if (!(tick & ((uint64_t(1) << (kLevelBits * level_index)) - 1))) {
+      Cascade(level_index);
+    }
+  }
+  Level& level = levels_[0];
+  uint32_t slot_index = uint32_t(tick) & kSlotMask;
+  if (!(level.occupied_slots & (uint64_t(1) << slot_index))) {
+    return;
+  }
+  level.occupied_slots &= ~(uint64_t(1) << slot_index);
+  std::vector<uint64_t> ids;
+  ids.swap(level.slots[slot_index]);
+  for (uint64_t id : ids) {
+    auto it = timers_.find(id);
+    if (it == timers_.end()) {
+      // Canceled.
+      continue;
+    }
+    Timer& timer = it->second;
+    assert_true(timer.due_tick <= tick);
+    if (timer.period_ticks) {
+      expired_callbacks.push_back(timer.callback);
+      // Not trying to catch up with the missed periods.
+      timer.due_tick = std::max(timer.due_tick + timer.period_ticks,
+                                tick + 1);
+      Insert(id, timer.due_tick);
+    } else {
+      expired_callbacks.push_back(std::move(timer.callback));
+      timers_.erase(it);
+    }
+  }
+  ids.clear();
+  if (level.slots[slot_index].empty()) {
+    level.slots[slot_index].swap(ids);
+  }
+}
+
+uint64_t TimerWheel::GetNextWakeUpTick() const {
+  if (timers_.empty()) {
+    return UINT64_MAX;
+  }
+  // The occupied slots of each level are all after the slot of the current
+  // tick in it, and in the same slot of the next level, so the lowest one is
+  // the next to expire or to be cascaded.
+  for (uint32_t level_index = 0; level_index < kLevelCount; ++level_index) {
+    uint32_t slot_index;
+    if (xe::bit_scan_forward(levels_[level_index].occupied_slots,
+                             &slot_index)) {
+      uint32_t level_shift = kLevelBits * level_index;
+      uint32_t next_level_shift = level_shift + kLevelBits;
+      return ((current_tick_ >> next_level_shift) << next_level_shift) |
+             (uint64_t(slot_index) << level_shift);
+    }
+  }
+  if (!overflow_.empty()) {
+    uint32_t wheel_shift = kLevelBits * kLevelCount;
+    return ((current_tick_ >> wheel_shift) + 1) << wheel_shift;
+  }
+  // Only canceled timers remaining until the next Schedule.
+  return UINT64_MAX;
+}
+
+void TimerWheel::ThreadMain() {
+  std::vector<std::function<void()>> expired_callbacks;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!shutdown_) {
+    uint64_t elapsed_tick = GetElapsedTick(clock::now());
+    if (timers_.empty()) {
+      current_tick_ = std::max(current_tick_, elapsed_tick);
+    }
+    while (current_tick_ < elapsed_tick) {
+      Advance(expired_callbacks);
+    }
+    if (!expired_callbacks.empty()) {
+      // Locking the callback mutex before unlocking the timers, so Cancel
+      // can't return between them.
+      std::unique_lock<std::mutex> callback_lock(callback_mutex_);
+      lock.unlock();
+      for (std::function<void()>& callback : expired_callbacks) {
+        callback();
+      }
+      expired_callbacks.clear();
+      callback_lock.unlock();
+      lock.lock();
+      continue;
+    }
+    uint64_t wake_up_tick = GetNextWakeUpTick();
+    if (wake_up_tick == UINT64_MAX) {
+      cond_.wait(lock);
+    } else {
+      cond_.wait_until(lock, origin_ + wake_up_tick * kTickDuration);
+    }
+  }
+}
+
+}  // namespace kernel
+}  // namespace xe
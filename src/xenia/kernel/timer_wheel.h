@@ -0,0 +1,110 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_TIMER_WHEEL_H_
+#define XENIA_KERNEL_TIMER_WHEEL_H_
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace kernel {
+
+// Hierarchical timer wheel expiring the guest timers on a single host thread
+// instead of a host timer for each, with 1 ms ticks. All the timers expiring at
+// the same tick have their callbacks invoked together in one wake-up, and the
+// thread only wakes up for the ticks with expirations or for moving the timers
+// from the coarser levels to the finer ones.
+class TimerWheel {
+ public:
+  using clock = std::chrono::steady_clock;
+  static constexpr auto kTickDuration = std::chrono::milliseconds(1);
+
+  TimerWheel();
+  TimerWheel(const TimerWheel& wheel) = delete;
+  TimerWheel& operator=(const TimerWheel& wheel) = delete;
+  ~TimerWheel();
+
+  // Returns the nonzero ID of the timer. The callback is invoked on the wheel
+  // thread, at or after the due time, and then every period if it's nonzero.
+  uint64_t Schedule(clock::time_point due, clock::duration period,
+                    std::function<void()> callback);
+  // No callbacks of the timer will be running after this call, unless called
+  // from a callback. Returns whether the timer was scheduled.
+  bool Cancel(uint64_t id);
+
+ private:
+  static constexpr uint32_t kLevelBits = 6;
+  static constexpr uint32_t kSlotCount = uint32_t(1) << kLevelBits;
+  static constexpr uint32_t kSlotMask = kSlotCount - 1;
+  static constexpr uint32_t kLevelCount = 4;
+
+  struct Timer {
+    uint64_t due_tick;
+    uint64_t period_ticks;
+    std::function<void()> callback;
+  };
+
+  struct Level {
+    std::array<std::vector<uint64_t>, kSlotCount> slots;
+    // Bits of the slots containing timer IDs, possibly of canceled timers.
+    uint64_t occupied_slots = 0;
+  };
+
+  // The first tick not before the time.
+  uint64_t GetDueTick(clock::time_point time) const;
+  // The last tick not after the time.
+  uint64_t GetElapsedTick(clock::time_point time) const;
+  // With the mutex locked.
+  void ClearLevels();
+  // The due tick must not be before the current one, and must be after it
+  // unless cascading while advancing to the current tick.
+  void Insert(uint64_t id, uint64_t due_tick);
+  void Reinsert(std::vector<uint64_t>& ids);
+  void Cascade(uint32_t level_index);
+  // Moves to the next tick, appending the callbacks of the expired timers.
+  void Advance(std::vector<std::function<void()>>& expired_callbacks);
+  // The tick at which the thread needs to wake up next, or UINT64_MAX.
+  uint64_t GetNextWakeUpTick() const;
+
+  void ThreadMain();
+
+  clock::time_point origin_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool shutdown_ = false;
+  uint64_t current_tick_ = 0;
+  uint64_t next_id_ = 1;
+  std::unordered_map<uint64_t, Timer> timers_;
+  // Each level only contains the timers with the due ticks in the same slot of
+  // the next level as the current tick.
+  std::array<Level, kLevelCount> levels_;
+  // Timers beyond the last level, inserted again when the current tick moves
+  // to the next slot of the nonexistent level after the last.
+  std::vector<uint64_t> overflow_;
+
+  // Held while invoking the callbacks, for waiting for them in Cancel.
+  std::mutex callback_mutex_;
+  std::unique_ptr<threading::Thread> thread_;
+};
+
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_TIMER_WHEEL_H_
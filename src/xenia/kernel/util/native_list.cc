@@ -69,6 +69,15 @@ uint32_t NativeList::Shift() {
 
 bool NativeList::HasPending() { return head_ != kInvalidPointer; }
 
+uint32_t NativeList::CountPending() {
+  uint32_t count = 0;
+  for (uint32_t ptr = head_; ptr && ptr != kInvalidPointer;
+       ptr = xe::load_and_swap<uint32_t>(memory_->TranslateVirtual(ptr + 0))) {
+    ++count;
+  }
+  return count;
+}
+
 }  // namespace util
 }  // namespace kernel
 }  // namespace xe
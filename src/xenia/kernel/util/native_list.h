@@ -37,6 +37,8 @@ class NativeList {
   void Remove(uint32_t list_entry_ptr);
   uint32_t Shift();
   bool HasPending();
+  // Walks the whole list in the guest memory.
+  uint32_t CountPending();
 
   uint32_t head() const { return head_; }
   void set_head(uint32_t head) { head_ = head; }
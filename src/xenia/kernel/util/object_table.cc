@@ -10,7 +10,7 @@
 #include "xenia/kernel/util/object_table.h"
 
 #include <algorithm>
-#include <cstring>
+#include <new>
 
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
@@ -26,40 +26,67 @@ ObjectTable::ObjectTable() {}
 ObjectTable::~ObjectTable() { Reset(); }
 
 void ObjectTable::Reset() {
-  auto global_lock = global_critical_region_.Acquire();
+  std::vector<XObject*> removed_objects;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Release all objects.
+    for (Table* table : {&table_, &host_table_}) {
+      for (uint32_t n = 0; n < table->capacity; n++) {
+        XObject* object =
+            GetEntry(*table, n)->object.exchange(nullptr,
+                                                 std::memory_order_seq_cst);
+        if (object) {
+          removed_objects.push_back(object);
+        }
+      }
+    }
+    WaitForLookups();
 
-  // Release all objects.
-  for (uint32_t n = 0; n < table_capacity_; n++) {
-    ObjectTableEntry& entry = table_[n];
-    if (entry.object) {
-      entry.object->Release();
+    for (Table* table : {&table_, &host_table_}) {
+      for (std::atomic<ObjectTableEntry*>& segment : table->segments) {
+        delete[] segment.exchange(nullptr, std::memory_order_relaxed);
+      }
+      table->capacity = 0;
+      table->last_free_entry = 0;
     }
   }
-  for (uint32_t n = 0; n < host_table_capacity_; n++) {
-    ObjectTableEntry& entry = host_table_[n];
-    if (entry.object) {
-      entry.object->Release();
-    }
+  ReleaseRemovedObjects(removed_objects);
+}
+
+ObjectTable::ObjectTableEntry* ObjectTable::GetEntry(const Table& table,
+                                                     uint32_t slot) {
+  uint32_t segment_index = slot >> kSegmentEntryCountLog2;
+  if (segment_index >= kMaxSegmentCount) {
+    return nullptr;
   }
+  ObjectTableEntry* segment =
+      table.segments[segment_index].load(std::memory_order_acquire);
+  if (!segment) {
+    return nullptr;
+  }
+  return &segment[slot & (kSegmentEntryCount - 1)];
+}
 
-  table_capacity_ = 0;
-  host_table_capacity_ = 0;
-  last_free_entry_ = 0;
-  last_free_host_entry_ = 0;
-  free(table_);
-  table_ = nullptr;
-  free(host_table_);
-  host_table_ = nullptr;
+void ObjectTable::WaitForLookups() { readers_.WaitForReaders(); }
+
+void ObjectTable::ReleaseRemovedObjects(std::vector<XObject*>& objects) {
+  for (XObject* object : objects) {
+    object->Release();
+  }
+  objects.clear();
 }
 
 X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot, bool host) {
+  Table& table = GetTable(host);
+
   // Find a free slot.
-  uint32_t slot = host ? last_free_host_entry_ : last_free_entry_;
-  uint32_t capacity = host ? host_table_capacity_ : table_capacity_;
+  uint32_t slot = table.last_free_entry;
+  uint32_t capacity = table.capacity;
   uint32_t scan_count = 0;
   while (scan_count < capacity) {
-    ObjectTableEntry& entry = host ? host_table_[slot] : table_[slot];
-    if (!entry.object) {
+    ObjectTableEntry& entry = *GetEntry(table, slot);
+    if (!entry.object.load(std::memory_order_relaxed)) {
       *out_slot = slot;
       return X_STATUS_SUCCESS;
     }
@@ -79,36 +106,32 @@ X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot, bool host) {
   }
 
   // Never allow 0 handles on host.
-  slot = host ? ++last_free_host_entry_ : last_free_entry_++;
+  slot = host ? ++table.last_free_entry : table.last_free_entry++;
   *out_slot = slot;
 
   return X_STATUS_SUCCESS;
 }
 
 bool ObjectTable::Resize(uint32_t new_capacity, bool host) {
-  uint32_t capacity = host ? host_table_capacity_ : table_capacity_;
-  uint32_t new_size = new_capacity * sizeof(ObjectTableEntry);
-  uint32_t old_size = capacity * sizeof(ObjectTableEntry);
-  auto new_table = reinterpret_cast<ObjectTableEntry*>(
-      realloc(host ? host_table_ : table_, new_size));
-  if (!new_table) {
+  Table& table = GetTable(host);
+  uint32_t capacity = table.capacity;
+  // Only growing, in whole segments.
+  uint32_t new_segment_count =
+      (new_capacity + (kSegmentEntryCount - 1)) >> kSegmentEntryCountLog2;
+  if (new_segment_count > kMaxSegmentCount) {
     return false;
   }
-
-  // Zero out new entries.
-  if (new_size > old_size) {
-    std::memset(reinterpret_cast<uint8_t*>(new_table) + old_size, 0,
-                new_size - old_size);
+  for (uint32_t i = capacity >> kSegmentEntryCountLog2; i < new_segment_count;
+       ++i) {
+    auto segment = new (std::nothrow) ObjectTableEntry[kSegmentEntryCount];
+    if (!segment) {
+      return false;
+    }
+    table.segments[i].store(segment, std::memory_order_release);
+    table.capacity = (i + 1) << kSegmentEntryCountLog2;
   }
-
-  if (host) {
-    last_free_host_entry_ = capacity;
-    host_table_capacity_ = new_capacity;
-    host_table_ = new_table;
-  } else {
-    last_free_entry_ = capacity;
-    table_capacity_ = new_capacity;
-    table_ = new_table;
+  if (table.capacity > capacity) {
+    table.last_free_entry = capacity;
   }
 
   return true;
@@ -119,7 +142,7 @@ X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
 
   uint32_t handle = 0;
   {
-    auto global_lock = global_critical_region_.Acquire();
+    std::lock_guard<std::mutex> lock(mutex_);
 
     // Find a free slot.
     uint32_t slot = 0;
@@ -128,8 +151,7 @@ X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
 
     // Stash.
     if (XSUCCEEDED(result)) {
-      ObjectTableEntry& entry = host_object ? host_table_[slot] : table_[slot];
-      entry.object = object;
+      ObjectTableEntry& entry = *GetEntry(GetTable(host_object), slot);
       entry.handle_ref_count = 1;
       handle = slot << 2;
       if (!host_object) {
@@ -143,6 +165,7 @@ X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
 
       // Retain so long as the object is in the table.
       object->Retain();
+      entry.object.store(object, std::memory_order_release);
 
       XELOGI("Added handle:{:08X} for {}", handle, typeid(*object).name());
     }
@@ -173,7 +196,7 @@ X_STATUS ObjectTable::DuplicateHandle(X_HANDLE handle, X_HANDLE* out_handle) {
 }
 
 X_STATUS ObjectTable::RetainHandle(X_HANDLE handle) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
 
   ObjectTableEntry* entry = LookupTableInLock(handle);
   if (!entry) {
@@ -185,83 +208,115 @@ X_STATUS ObjectTable::RetainHandle(X_HANDLE handle) {
 }
 
 X_STATUS ObjectTable::ReleaseHandle(X_HANDLE handle) {
-  auto global_lock = global_critical_region_.Acquire();
-
-  return ReleaseHandleInLock(handle);
+  X_STATUS result;
+  XObject* removed_object;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    removed_object = ReleaseHandleInTableLock(handle, result);
+    if (removed_object) {
+      WaitForLookups();
+    }
+  }
+  if (removed_object) {
+    // Release now that the object has been removed from the table.
+    removed_object->Release();
+  }
+  return result;
 }
+
 X_STATUS ObjectTable::ReleaseHandleInLock(X_HANDLE handle) {
+  // The table has its own lock now, the global critical region that the caller
+  // holds doesn't protect it.
+  return ReleaseHandle(handle);
+}
+
+XObject* ObjectTable::ReleaseHandleInTableLock(X_HANDLE handle,
+                                               X_STATUS& result_out) {
   ObjectTableEntry* entry = LookupTableInLock(handle);
   if (!entry) {
-    return X_STATUS_INVALID_HANDLE;
+    result_out = X_STATUS_INVALID_HANDLE;
+    return nullptr;
   }
 
   if (--entry->handle_ref_count == 0) {
     // No more references. Remove it from the table.
-    return RemoveHandle(handle);
+    return RemoveHandleInTableLock(handle, result_out);
   }
 
   // FIXME: Return a status code telling the caller it wasn't released
   // (but not a failure code)
-  return X_STATUS_SUCCESS;
+  result_out = X_STATUS_SUCCESS;
+  return nullptr;
 }
-X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
-  X_STATUS result = X_STATUS_SUCCESS;
 
+X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
   handle = TranslateHandle(handle);
   if (!handle) {
     return X_STATUS_INVALID_HANDLE;
   }
-  auto global_lock = global_critical_region_.Acquire();
 
+  X_STATUS result;
+  XObject* removed_object;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    removed_object = RemoveHandleInTableLock(handle, result);
+    if (removed_object) {
+      WaitForLookups();
+    }
+  }
+  if (removed_object) {
+    // Release now that the object has been removed from the table.
+    removed_object->Release();
+  }
+  return result;
+}
+
+XObject* ObjectTable::RemoveHandleInTableLock(X_HANDLE handle,
+                                              X_STATUS& result_out) {
+  handle = TranslateHandle(handle);
   ObjectTableEntry* entry = LookupTableInLock(handle);
   if (!entry) {
-    return X_STATUS_INVALID_HANDLE;
+    result_out = X_STATUS_INVALID_HANDLE;
+    return nullptr;
   }
 
-  if (entry->object) {
-    auto object = entry->object;
-    entry->object = nullptr;
-    assert_zero(entry->handle_ref_count);
-    entry->handle_ref_count = 0;
+  result_out = X_STATUS_SUCCESS;
+  XObject* object = entry->object.exchange(nullptr, std::memory_order_seq_cst);
+  if (!object) {
+    return nullptr;
+  }
+  assert_zero(entry->handle_ref_count);
+  entry->handle_ref_count = 0;
 
-    // Walk the object's handles and remove this one.
-    auto handle_entry =
-        std::find(object->handles().begin(), object->handles().end(), handle);
-    if (handle_entry != object->handles().end()) {
-      object->handles().erase(handle_entry);
-    }
+  // Walk the object's handles and remove this one.
+  auto handle_entry =
+      std::find(object->handles().begin(), object->handles().end(), handle);
+  if (handle_entry != object->handles().end()) {
+    object->handles().erase(handle_entry);
+  }
 
-    XELOGI("Removed handle:{:08X} for {}", handle, typeid(*object).name());
+  XELOGI("Removed handle:{:08X} for {}", handle, typeid(*object).name());
 
-    // Remove object name from mapping to prevent naming collision.
-    if (!object->name().empty()) {
-      RemoveNameMapping(object->name());
-    }
-    // Release now that the object has been removed from the table.
-    object->Release();
+  // Remove object name from mapping to prevent naming collision.
+  if (!object->name().empty()) {
+    RemoveNameMappingInTableLock(object->name());
   }
-
-  return X_STATUS_SUCCESS;
+  return object;
 }
 
 std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
-  auto lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
   std::vector<object_ref<XObject>> results;
 
-  for (uint32_t slot = 0; slot < host_table_capacity_; slot++) {
-    auto& entry = host_table_[slot];
-    if (entry.object && std::find(results.begin(), results.end(),
-                                  entry.object) == results.end()) {
-      entry.object->Retain();
-      results.push_back(object_ref<XObject>(entry.object));
-    }
-  }
-  for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && std::find(results.begin(), results.end(),
-                                  entry.object) == results.end()) {
-      entry.object->Retain();
-      results.push_back(object_ref<XObject>(entry.object));
+  for (const Table* table : {&host_table_, &table_}) {
+    for (uint32_t slot = 0; slot < table->capacity; slot++) {
+      XObject* object =
+          GetEntry(*table, slot)->object.load(std::memory_order_relaxed);
+      if (object && std::find(results.begin(), results.end(), object) ==
+                        results.end()) {
+        object->Retain();
+        results.push_back(object_ref<XObject>(object));
+      }
     }
   }
 
@@ -269,21 +324,21 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
 }
 
 void ObjectTable::PurgeAllObjects() {
-  auto lock = global_critical_region_.Acquire();
-  for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object) {
-      entry.handle_ref_count = 0;
-      entry.object->Release();
-
-      entry.object = nullptr;
+  std::vector<XObject*> removed_objects;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t slot = 0; slot < table_.capacity; slot++) {
+      ObjectTableEntry& entry = *GetEntry(table_, slot);
+      XObject* object =
+          entry.object.exchange(nullptr, std::memory_order_seq_cst);
+      if (object) {
+        entry.handle_ref_count = 0;
+        removed_objects.push_back(object);
+      }
     }
+    WaitForLookups();
   }
-}
-
-ObjectTable::ObjectTableEntry* ObjectTable::LookupTable(X_HANDLE handle) {
-  auto global_lock = global_critical_region_.Acquire();
-  return LookupTableInLock(handle);
+  ReleaseRemovedObjects(removed_objects);
 }
 
 ObjectTable::ObjectTableEntry* ObjectTable::LookupTableInLock(X_HANDLE handle) {
@@ -294,12 +349,9 @@ ObjectTable::ObjectTableEntry* ObjectTable::LookupTableInLock(X_HANDLE handle) {
 
   const bool is_host_object = XObject::is_handle_host_object(handle);
   uint32_t slot = GetHandleSlot(handle, is_host_object);
-  if (is_host_object) {
-    if (slot <= host_table_capacity_) {
-      return &host_table_[slot];
-    }
-  } else if (slot <= table_capacity_) {
-    return &table_[slot];
+  const Table& table = GetTable(is_host_object);
+  if (slot < table.capacity) {
+    return GetEntry(table, slot);
   }
 
   return nullptr;
@@ -315,32 +367,23 @@ object_ref<XObject> ObjectTable::LookupObject<XObject>(X_HANDLE handle,
 }
 
 XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
+  // Doesn't lock, so it doesn't matter whether the caller has locked the
+  // global critical region.
   handle = TranslateHandle(handle);
   if (!handle) {
     return nullptr;
   }
 
-  XObject* object = nullptr;
-  if (!already_locked) {
-    global_critical_region_.mutex().lock();
-  }
+  // Until the read is ended, the object seen in the entry is not released by
+  // the table, so it can be retained.
+  uint32_t read_token = readers_.BeginRead();
 
+  XObject* object = nullptr;
   const bool is_host_object = XObject::is_handle_host_object(handle);
-  uint32_t slot = GetHandleSlot(handle, is_host_object);
-
-  // Verify slot.
-  if (is_host_object) {
-    if (slot < host_table_capacity_) {
-      ObjectTableEntry& entry = host_table_[slot];
-      if (entry.object) {
-        object = entry.object;
-      }
-    }
-  } else if (slot < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (entry.object) {
-      object = entry.object;
-    }
+  ObjectTableEntry* entry = GetEntry(GetTable(is_host_object),
+                                     GetHandleSlot(handle, is_host_object));
+  if (entry) {
+    object = entry->object.load(std::memory_order_seq_cst);
   }
 
   // Retain the object pointer.
@@ -348,31 +391,23 @@ XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
     object->Retain();
   }
 
-  if (!already_locked) {
-    global_critical_region_.mutex().unlock();
-  }
+  readers_.EndRead(read_token);
 
   return object;
 }
 
 void ObjectTable::GetObjectsByType(XObject::Type type,
                                    std::vector<object_ref<XObject>>* results) {
-  auto global_lock = global_critical_region_.Acquire();
-  for (uint32_t slot = 0; slot < host_table_capacity_; ++slot) {
-    auto& entry = host_table_[slot];
-    if (entry.object) {
-      if (entry.object->type() == type) {
-        entry.object->Retain();
-        results->push_back(object_ref<XObject>(entry.object));
-      }
-    }
-  }
-  for (uint32_t slot = 0; slot < table_capacity_; ++slot) {
-    auto& entry = table_[slot];
-    if (entry.object) {
-      if (entry.object->type() == type) {
-        entry.object->Retain();
-        results->push_back(object_ref<XObject>(entry.object));
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const Table* table : {&host_table_, &table_}) {
+    for (uint32_t slot = 0; slot < table->capacity; ++slot) {
+      XObject* object =
+          GetEntry(*table, slot)->object.load(std::memory_order_relaxed);
+      if (object) {
+        if (object->type() == type) {
+          object->Retain();
+          results->push_back(object_ref<XObject>(object));
+        }
       }
     }
   }
@@ -392,7 +427,7 @@ X_HANDLE ObjectTable::TranslateHandle(X_HANDLE handle) {
 
 X_STATUS ObjectTable::AddNameMapping(const std::string_view name,
                                      X_HANDLE handle) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(mutex_);
   if (name_table_.count(string_key_case(name))) {
     return X_STATUS_OBJECT_NAME_COLLISION;
   }
@@ -401,8 +436,12 @@ X_STATUS ObjectTable::AddNameMapping(const std::string_view name,
 }
 
 void ObjectTable::RemoveNameMapping(const std::string_view name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  RemoveNameMappingInTableLock(name);
+}
+
+void ObjectTable::RemoveNameMappingInTableLock(const std::string_view name) {
   // Names are case-insensitive.
-  auto global_lock = global_critical_region_.Acquire();
   auto it = name_table_.find(string_key_case(name));
   if (it != name_table_.end()) {
     name_table_.erase(it);
@@ -411,17 +450,21 @@ void ObjectTable::RemoveNameMapping(const std::string_view name) {
 
 X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
                                       X_HANDLE* out_handle) {
-  // Names are case-insensitive.
-  auto global_lock = global_critical_region_.Acquire();
-  auto it = name_table_.find(string_key_case(name));
-  if (it == name_table_.end()) {
-    *out_handle = X_INVALID_HANDLE_VALUE;
-    return X_STATUS_OBJECT_NAME_NOT_FOUND;
+  X_HANDLE handle;
+  {
+    // Names are case-insensitive.
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = name_table_.find(string_key_case(name));
+    if (it == name_table_.end()) {
+      *out_handle = X_INVALID_HANDLE_VALUE;
+      return X_STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+    handle = it->second;
   }
-  *out_handle = it->second;
+  *out_handle = handle;
 
   // We need to ref the handle. I think.
-  auto obj = LookupObject(it->second, true);
+  auto obj = LookupObject(handle, false);
   if (obj) {
     obj->RetainHandle();
     obj->Release();
@@ -431,49 +474,45 @@ X_STATUS ObjectTable::GetObjectByName(const std::string_view name,
 }
 
 bool ObjectTable::Save(ByteStream* stream) {
-  stream->Write<uint32_t>(host_table_capacity_);
-  for (uint32_t i = 0; i < host_table_capacity_; i++) {
-    auto& entry = host_table_[i];
-    stream->Write<int32_t>(entry.handle_ref_count);
-  }
-
-  stream->Write<uint32_t>(table_capacity_);
-  for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
-    stream->Write<int32_t>(entry.handle_ref_count);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const Table* table : {&host_table_, &table_}) {
+    stream->Write<uint32_t>(table->capacity);
+    for (uint32_t i = 0; i < table->capacity; i++) {
+      stream->Write<int32_t>(GetEntry(*table, i)->handle_ref_count);
+    }
   }
 
   return true;
 }
 
 bool ObjectTable::Restore(ByteStream* stream) {
-  Resize(stream->Read<uint32_t>(), true);
-  for (uint32_t i = 0; i < host_table_capacity_; i++) {
-    auto& entry = host_table_[i];
-    // entry.object = nullptr;
-    entry.handle_ref_count = stream->Read<int32_t>();
-  }
-
-  Resize(stream->Read<uint32_t>(), false);
-  for (uint32_t i = 0; i < table_capacity_; i++) {
-    auto& entry = table_[i];
-    // entry.object = nullptr;
-    entry.handle_ref_count = stream->Read<int32_t>();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (bool host : {true, false}) {
+    uint32_t capacity = stream->Read<uint32_t>();
+    Resize(capacity, host);
+    const Table& table = GetTable(host);
+    for (uint32_t i = 0; i < capacity; i++) {
+      int32_t handle_ref_count = stream->Read<int32_t>();
+      if (i < table.capacity) {
+        // entry.object = nullptr;
+        GetEntry(table, i)->handle_ref_count = handle_ref_count;
+      }
+    }
   }
 
   return true;
 }
 
 X_STATUS ObjectTable::RestoreHandle(X_HANDLE handle, XObject* object) {
+  std::lock_guard<std::mutex> lock(mutex_);
   const bool is_host_object = XObject::is_handle_host_object(handle);
   uint32_t slot = GetHandleSlot(handle, is_host_object);
-  uint32_t capacity = is_host_object ? host_table_capacity_ : table_capacity_;
-  assert_true(capacity >= slot);
+  const Table& table = GetTable(is_host_object);
+  assert_true(slot < table.capacity);
 
-  if (capacity >= slot) {
-    auto& entry = is_host_object ? host_table_[slot] : table_[slot];
-    entry.object = object;
+  if (slot < table.capacity) {
     object->Retain();
+    GetEntry(table, slot)->object.store(object, std::memory_order_release);
   }
 
   return X_STATUS_SUCCESS;
@@ -10,11 +10,15 @@
 #ifndef XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 #define XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "xenia/base/epoch_readers.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/string_key.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/xbox.h"
@@ -82,14 +86,42 @@ class ObjectTable {
 
  private:
   struct ObjectTableEntry {
+    // Protected by mutex_.
     int handle_ref_count = 0;
-    XObject* object = nullptr;
+    // Modified with mutex_ locked, but read by the lookups without locking.
+    std::atomic<XObject*> object = {nullptr};
   };
+  // The entries are allocated in segments that are not moved or freed while
+  // the table is in use, so the lookups can access them without locking.
+  static constexpr uint32_t kSegmentEntryCountLog2 = 14;
+  static constexpr uint32_t kSegmentEntryCount = uint32_t(1)
+                                                 << kSegmentEntryCountLog2;
+  // All the guest handles below kHandleBase.
+  static constexpr uint32_t kMaxSegmentCount =
+      ((~XObject::kHandleBase >> 2) + 1) >> kSegmentEntryCountLog2;
+  struct Table {
+    std::atomic<ObjectTableEntry*> segments[kMaxSegmentCount] = {};
+    // Protected by mutex_.
+    uint32_t capacity = 0;
+    uint32_t last_free_entry = 0;
+  };
+  // Lookups in progress, sharded between the threads to avoid contention, and
+  // split by the parity of the reader epoch, so the lookups started after an
+  // object has been removed don't delay the release of it.
+  Table& GetTable(bool host) { return host ? host_table_ : table_; }
+  static ObjectTableEntry* GetEntry(const Table& table, uint32_t slot);
   ObjectTableEntry* LookupTableInLock(X_HANDLE handle);
-  ObjectTableEntry* LookupTable(X_HANDLE handle);
   XObject* LookupObject(X_HANDLE handle, bool already_locked);
   void GetObjectsByType(XObject::Type type,
                         std::vector<object_ref<XObject>>* results);
+  // Returns the object to release after unlocking mutex_ and waiting for the
+  // lookups.
+  XObject* ReleaseHandleInTableLock(X_HANDLE handle, X_STATUS& result_out);
+  XObject* RemoveHandleInTableLock(X_HANDLE handle, X_STATUS& result_out);
+  void RemoveNameMappingInTableLock(const std::string_view name);
+  // Waits for the lookups that may have seen the entries removed before.
+  void WaitForLookups();
+  static void ReleaseRemovedObjects(std::vector<XObject*>& objects);
 
   X_HANDLE TranslateHandle(X_HANDLE handle);
   static constexpr uint32_t GetHandleSlot(X_HANDLE handle, bool host) {
@@ -99,14 +131,15 @@ class ObjectTable {
   X_STATUS FindFreeSlot(uint32_t* out_slot, bool host);
   bool Resize(uint32_t new_capacity, bool host);
 
-  xe::global_critical_region global_critical_region_;
-  uint32_t table_capacity_ = 0;
-  uint32_t host_table_capacity_ = 0;
-  ObjectTableEntry* table_ = nullptr;
-  ObjectTableEntry* host_table_ = nullptr;
-  uint32_t last_free_entry_ = 0;
-  uint32_t last_free_host_entry_ = 0;
+  // Protects the modifications of the tables, not the lookups. Objects must
+  // not be released with it locked, as their destruction may take other locks,
+  // and must not lock it itself.
+  std::mutex mutex_;
+  Table table_;
+  Table host_table_;
   std::unordered_map<string_key_case, X_HANDLE> name_table_;
+
+  EpochReaders readers_;
 };
 
 // Generic lookup
@@ -8,11 +8,148 @@
  */
 
 #include "xenia/kernel/util/shim_utils.h"
+
+#include <algorithm>
+
+#include "xenia/base/utf8.h"
 #include "xenia/kernel/xthread.h"
 namespace xe {
 namespace kernel {
 namespace shim {
 
+// Function-local, as the exports are registered during the static
+// initialization.
+static std::mutex& export_statistics_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+static std::vector<ExportStatistics*>& export_statistics() {
+  static std::vector<ExportStatistics*> statistics;
+  return statistics;
+}
+
+ExportStatistics::ExportStatistics(cpu::Export* export_entry)
+    : export_entry_(export_entry) {
+  std::lock_guard<std::mutex> lock(export_statistics_mutex());
+  export_statistics().push_back(this);
+}
+
+std::vector<std::pair<uint32_t, uint64_t>> ExportStatistics::GetCallers() {
+  std::lock_guard<std::mutex> lock(callers_mutex_);
+  return std::vector<std::pair<uint32_t, uint64_t>>(
+      caller_call_counts_.cbegin(), caller_call_counts_.cend());
+}
+
+void ExportStatistics::RecordCall(uint32_t caller, uint64_t host_ticks) {
+  call_count_.fetch_add(1, std::memory_order_relaxed);
+  host_ticks_.fetch_add(host_ticks, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(callers_mutex_);
+  ++caller_call_counts_[caller];
+}
+
+void ReportExportStatistics() {
+  // Only the most frequent ones, the rest are not interesting for dispatch.
+  constexpr size_t kMaxReportedExports = 40;
+  constexpr size_t kMaxSuggestedExports = 16;
+  constexpr size_t kMaxReportedCallers = 3;
+  // Too rare to benefit from bypassing the logging.
+  constexpr uint64_t kMinSuggestedCallCount = 1000;
+
+  std::vector<ExportStatistics*> statistics;
+  {
+    std::lock_guard<std::mutex> lock(export_statistics_mutex());
+    statistics = export_statistics();
+  }
+  statistics.erase(
+      std::remove_if(statistics.begin(), statistics.end(),
+                     [](const ExportStatistics* export_statistics) {
+                       return !export_statistics->call_count();
+                     }),
+      statistics.end());
+  std::sort(statistics.begin(), statistics.end(),
+            [](const ExportStatistics* a, const ExportStatistics* b) {
+              return a->call_count() > b->call_count();
+            });
+  uint64_t total_call_count = 0;
+  for (const ExportStatistics* export_statistics : statistics) {
+    total_call_count += export_statistics->call_count();
+  }
+  XELOGI("Kernel export statistics: {} calls of {} exports", total_call_count,
+         statistics.size());
+  double ns_per_tick = 1000000000.0 / double(Clock::QueryHostTickFrequency());
+  std::string suggested;
+  size_t suggested_count = 0;
+  for (size_t i = 0; i < statistics.size(); ++i) {
+    ExportStatistics& export_statistics = *statistics[i];
+    cpu::Export* export_entry = export_statistics.export_entry();
+    uint64_t call_count = export_statistics.call_count();
+    if (i < kMaxReportedExports) {
+      std::vector<std::pair<uint32_t, uint64_t>> callers =
+          export_statistics.GetCallers();
+      std::sort(callers.begin(), callers.end(),
+                [](const auto& a, const auto& b) {
+                  return a.second > b.second;
+                });
+      std::string top_callers;
+      for (size_t j = 0; j < std::min(callers.size(), kMaxReportedCallers);
+           ++j) {
+        top_callers +=
+            fmt::format(" {:08X} ({})", callers[j].first, callers[j].second);
+      }
+      XELOGI(
+          "  {}{}: {} calls, {:.0f} ns average, {:.3f} ms total, {} callers:{}",
+          export_entry->name,
+          (export_entry->tags & cpu::ExportTag::kHighFrequency)
+              ? " (high frequency)"
+              : "",
+          call_count,
+          double(export_statistics.host_ticks()) * ns_per_tick / call_count,
+          double(export_statistics.host_ticks()) * ns_per_tick / 1000000.0,
+          callers.size(), top_callers);
+    }
+    if (suggested_count < kMaxSuggestedExports &&
+        call_count >= kMinSuggestedCallCount &&
+        !(export_entry->tags & cpu::ExportTag::kHighFrequency)) {
+      if (suggested_count) {
+        suggested += ',';
+      }
+      suggested += export_entry->name;
+      ++suggested_count;
+    }
+  }
+  if (suggested_count) {
+    XELOGI("Suggested kernel_export_direct_dispatch: \"{}\"", suggested);
+  }
+}
+
+void SelectExportTrampolines(const std::vector<cpu::Export*>& exports) {
+  if (cvars::kernel_export_profiling) {
+    return;
+  }
+  std::vector<std::string_view> direct_names;
+  if (!cvars::kernel_export_direct_dispatch.empty()) {
+    direct_names = xe::utf8::split(cvars::kernel_export_direct_dispatch, ",");
+  }
+  for (cpu::Export* export_entry : exports) {
+    if (!export_entry ||
+        export_entry->get_type() != cpu::Export::Type::kFunction ||
+        !export_entry->function_data.direct_trampoline) {
+      continue;
+    }
+    bool direct = (export_entry->tags & cpu::ExportTag::kHighFrequency) &&
+                  !cvars::log_high_frequency_kernel_calls;
+    if (!direct) {
+      direct = std::find(direct_names.cbegin(), direct_names.cend(),
+                         std::string_view(export_entry->name)) !=
+               direct_names.cend();
+    }
+    if (direct) {
+      export_entry->function_data.trampoline =
+          export_entry->function_data.direct_trampoline;
+    }
+  }
+}
+
 thread_local StringBuffer string_buffer_;
 
 StringBuffer* thread_local_string_buffer() { return &string_buffer_; }
@@ -10,12 +10,17 @@
 #ifndef XENIA_KERNEL_UTIL_SHIM_UTILS_H_
 #define XENIA_KERNEL_UTIL_SHIM_UTILS_H_
 
+#include <atomic>
 #include <cstring>
+#include <mutex>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/string_buffer.h"
@@ -545,6 +550,43 @@ XE_NOALIAS void PrintKernelCall(cpu::Export* export_entry,
    always turned into strings except if kHighFrequency)
 
 */
+// Gathered with kernel_export_profiling for every export declared with
+// DECLARE_EXPORT.
+class ExportStatistics {
+ public:
+  explicit ExportStatistics(cpu::Export* export_entry);
+  ExportStatistics(const ExportStatistics& statistics) = delete;
+  ExportStatistics& operator=(const ExportStatistics& statistics) = delete;
+
+  cpu::Export* export_entry() const { return export_entry_; }
+  uint64_t call_count() const {
+    return call_count_.load(std::memory_order_relaxed);
+  }
+  uint64_t host_ticks() const {
+    return host_ticks_.load(std::memory_order_relaxed);
+  }
+  // Guest return addresses and the number of calls from each.
+  std::vector<std::pair<uint32_t, uint64_t>> GetCallers();
+
+  XE_NOINLINE void RecordCall(uint32_t caller, uint64_t host_ticks);
+
+ private:
+  cpu::Export* export_entry_;
+  std::atomic<uint64_t> call_count_{0};
+  std::atomic<uint64_t> host_ticks_{0};
+  std::mutex callers_mutex_;
+  std::unordered_map<uint32_t, uint64_t> caller_call_counts_;
+};
+
+// Logs the most frequently called exports, and suggests the ones to add to
+// kernel_export_direct_dispatch.
+void ReportExportStatistics();
+
+// Switches the exports tagged with kHighFrequency or listed in
+// kernel_export_direct_dispatch to their direct trampolines, unless logging or
+// profiling them. Must be called before the exports are resolved.
+void SelectExportTrampolines(const std::vector<cpu::Export*>& exports);
+
 template <typename F, typename Tuple, std::size_t... I>
 XE_FORCEINLINE static auto KernelTrampoline(F&& f, Tuple&& t,
                                             std::index_sequence<I...>) {
@@ -565,6 +607,7 @@ struct ExportRegistrerHelper {
 
     static const auto export_entry =
         new cpu::Export(ORDINAL, xe::cpu::Export::Type::kFunction, name, TAGS);
+    static ExportStatistics statistics(export_entry);
     struct X {
       static void Trampoline(PPCContext* ppc_context) {
         Param::Init init = {
@@ -581,6 +624,10 @@ struct ExportRegistrerHelper {
              cvars::log_high_frequency_kernel_calls)) {
           PrintKernelCall(export_entry, params);
         }
+        // The return address, as the call may change the link register.
+        uint32_t caller = uint32_t(ppc_context->lr);
+        bool profile = cvars::kernel_export_profiling;
+        uint64_t start_ticks = profile ? Clock::QueryHostTickCount() : 0;
         if constexpr (std::is_void<R>::value) {
           KernelTrampoline(fn, std::forward<std::tuple<Ps...>>(params),
                            std::make_index_sequence<sizeof...(Ps)>());
@@ -594,6 +641,10 @@ struct ExportRegistrerHelper {
             // TODO(benvanik): log result.
           }
         }
+        if (profile) {
+          statistics.RecordCall(caller,
+                                Clock::QueryHostTickCount() - start_ticks);
+        }
       }
     };
     struct Y {
@@ -615,6 +666,7 @@ struct ExportRegistrerHelper {
       }
     };
     export_entry->function_data.trampoline = &X::Trampoline;
+    export_entry->function_data.direct_trampoline = &Y::Trampoline;
     return export_entry;
   }
 };
@@ -653,6 +705,10 @@ using xe::cpu::ExportTag;
 #define DECLARE_XAM_EXPORT2(name, category, tag1, tag2) \
   DECLARE_EXPORT(xam, name, category,                   \
                  xe::cpu::ExportTag::tag1 | xe::cpu::ExportTag::tag2)
+#define DECLARE_XAM_EXPORT3(name, category, tag1, tag2, tag3)          \
+  DECLARE_EXPORT(xam, name, category,                                  \
+                 xe::cpu::ExportTag::tag1 | xe::cpu::ExportTag::tag2 | \
+                     xe::cpu::ExportTag::tag3)
 
 #define DECLARE_XAM_EMPTY_REGISTER_EXPORTS(group_name) \
   DECLARE_EMPTY_REGISTER_EXPORTS(xam, group_name)
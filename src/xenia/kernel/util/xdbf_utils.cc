@@ -9,6 +9,11 @@
 
 #include "xenia/kernel/util/xdbf_utils.h"
 
+#include <algorithm>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
 namespace xe {
 namespace kernel {
 namespace util {
@@ -22,6 +27,31 @@ constexpr uint64_t kXdbfIdTitle = 0x8000;
 constexpr uint64_t kXdbfIdXstc = 0x58535443;
 constexpr uint64_t kXdbfIdXach = 0x58414348;
 
+struct XdbfWrapper::Index {
+  struct EntryKey {
+    uint16_t section;
+    uint64_t id;
+
+    bool operator==(const EntryKey& other) const {
+      return section == other.section && id == other.id;
+    }
+  };
+  struct EntryKeyHasher {
+    size_t operator()(const EntryKey& key) const {
+      return std::hash<uint64_t>()(key.id ^ (uint64_t(key.section) << 48));
+    }
+  };
+  std::unordered_map<EntryKey, XdbfBlock, EntryKeyHasher> entries;
+
+  std::mutex mutex;
+  // Decoded on the first access, pointing to the strings in the data.
+  std::unordered_map<uint32_t, std::unordered_map<uint16_t, std::string_view>>
+      string_tables;
+  bool achievements_decoded = false;
+  std::vector<XdbfAchievementTableEntry> achievements;
+  std::unordered_map<uint16_t, size_t> achievement_indices;
+};
+
 XdbfWrapper::XdbfWrapper(const uint8_t* data, size_t data_size)
     : data_(data), data_size_(data_size) {
   if (!data || data_size <= sizeof(XbdfHeader)) {
@@ -45,53 +75,93 @@ XdbfWrapper::XdbfWrapper(const uint8_t* data, size_t data_size)
   ptr += sizeof(XbdfFileLoc) * header_->free_count;
 
   content_offset_ = ptr;
-}
 
-XdbfBlock XdbfWrapper::GetEntry(XdbfSection section, uint64_t id) const {
+  index_ = std::make_shared<Index>();
+  size_t content_size = data_size_ - std::min(data_size_, size_t(ptr - data_));
   for (uint32_t i = 0; i < header_->entry_used; ++i) {
     auto& entry = entries_[i];
-    if (entry.section == static_cast<uint16_t>(section) && entry.id == id) {
-      XdbfBlock block;
-      block.buffer = content_offset_ + entry.offset;
-      block.size = entry.size;
-      return block;
+    if (uint64_t(entry.offset) + entry.size > content_size) {
+      continue;
     }
+    XdbfBlock block;
+    block.buffer = content_offset_ + entry.offset;
+    block.size = entry.size;
+    // The first one if there are duplicates, like in a linear search.
+    index_->entries.emplace(Index::EntryKey{entry.section, entry.id}, block);
   }
-  return {0};
+}
+
+XdbfBlock XdbfWrapper::GetEntry(XdbfSection section, uint64_t id) const {
+  if (!index_) {
+    return {0};
+  }
+  auto it = index_->entries.find(
+      Index::EntryKey{static_cast<uint16_t>(section), id});
+  if (it == index_->entries.end()) {
+    return {0};
+  }
+  return it->second;
 }
 
 std::string XdbfWrapper::GetStringTableEntry(XLanguage language,
                                              uint16_t string_id) const {
-  auto language_block =
-      GetEntry(XdbfSection::kStringTable, static_cast<uint64_t>(language));
-  if (!language_block) {
+  if (!index_) {
     return "";
   }
-
-  auto xstr_head =
-      reinterpret_cast<const XdbfSectionHeader*>(language_block.buffer);
-  assert_true(xstr_head->magic == kXdbfSignatureXstr);
-  assert_true(xstr_head->version == 1);
-
-  const uint8_t* ptr = language_block.buffer + sizeof(XdbfSectionHeader);
-  for (uint16_t i = 0; i < xstr_head->count; ++i) {
-    auto entry = reinterpret_cast<const XdbfStringTableEntry*>(ptr);
-    ptr += sizeof(XdbfStringTableEntry);
-    if (entry->id == string_id) {
-      return std::string(reinterpret_cast<const char*>(ptr),
-                         entry->string_length);
+  std::lock_guard<std::mutex> lock(index_->mutex);
+  auto table_it = index_->string_tables.find(static_cast<uint32_t>(language));
+  if (table_it == index_->string_tables.end()) {
+    auto& table = index_->string_tables[static_cast<uint32_t>(language)];
+    auto language_block =
+        GetEntry(XdbfSection::kStringTable, static_cast<uint64_t>(language));
+    if (language_block && language_block.size >= sizeof(XdbfSectionHeader)) {
+      auto xstr_head =
+          reinterpret_cast<const XdbfSectionHeader*>(language_block.buffer);
+      assert_true(xstr_head->magic == kXdbfSignatureXstr);
+      assert_true(xstr_head->version == 1);
+
+      const uint8_t* ptr = language_block.buffer + sizeof(XdbfSectionHeader);
+      const uint8_t* end = language_block.buffer + language_block.size;
+      for (uint16_t i = 0; i < xstr_head->count; ++i) {
+        if (size_t(end - ptr) < sizeof(XdbfStringTableEntry)) {
+          break;
+        }
+        auto entry = reinterpret_cast<const XdbfStringTableEntry*>(ptr);
+        ptr += sizeof(XdbfStringTableEntry);
+        if (size_t(end - ptr) < entry->string_length) {
+          break;
+        }
+        table.emplace(entry->id,
+                      std::string_view(reinterpret_cast<const char*>(ptr),
+                                       entry->string_length));
+        ptr += entry->string_length;
+      }
     }
-    ptr += entry->string_length;
+    table_it = index_->string_tables.find(static_cast<uint32_t>(language));
+  }
+  auto string_it = table_it->second.find(string_id);
+  if (string_it == table_it->second.end()) {
+    return "";
   }
-  return "";
+  return std::string(string_it->second);
 }
 
-std::vector<XdbfAchievementTableEntry> XdbfWrapper::GetAchievements() const {
-  std::vector<XdbfAchievementTableEntry> achievements;
+const std::vector<XdbfAchievementTableEntry>& XdbfWrapper::GetAchievements()
+    const {
+  static const std::vector<XdbfAchievementTableEntry> kNoAchievements;
+  if (!index_) {
+    return kNoAchievements;
+  }
+  std::lock_guard<std::mutex> lock(index_->mutex);
+  if (index_->achievements_decoded) {
+    return index_->achievements;
+  }
+  index_->achievements_decoded = true;
 
   auto achievement_table = GetEntry(XdbfSection::kMetadata, kXdbfIdXach);
-  if (!achievement_table) {
-    return achievements;
+  if (!achievement_table ||
+      achievement_table.size < sizeof(XdbfSectionHeader)) {
+    return index_->achievements;
   }
 
   auto xach_head =
@@ -99,13 +169,32 @@ std::vector<XdbfAchievementTableEntry> XdbfWrapper::GetAchievements() const {
   assert_true(xach_head->magic == kXdbfSignatureXach);
   assert_true(xach_head->version == 1);
 
-  const uint8_t* ptr = achievement_table.buffer + sizeof(XdbfSectionHeader);
-  for (uint16_t i = 0; i < xach_head->count; ++i) {
-    auto entry = reinterpret_cast<const XdbfAchievementTableEntry*>(ptr);
-    ptr += sizeof(XdbfAchievementTableEntry);
-    achievements.push_back(*entry);
+  size_t count = std::min(
+      size_t(xach_head->count),
+      (achievement_table.size - sizeof(XdbfSectionHeader)) /
+          sizeof(XdbfAchievementTableEntry));
+  auto entries = reinterpret_cast<const XdbfAchievementTableEntry*>(
+      achievement_table.buffer + sizeof(XdbfSectionHeader));
+  index_->achievements.assign(entries, entries + count);
+  for (size_t i = 0; i < index_->achievements.size(); ++i) {
+    index_->achievement_indices.emplace(index_->achievements[i].id, i);
+  }
+  return index_->achievements;
+}
+
+const XdbfAchievementTableEntry* XdbfWrapper::GetAchievement(
+    uint16_t achievement_id) const {
+  const std::vector<XdbfAchievementTableEntry>& achievements =
+      GetAchievements();
+  if (achievements.empty()) {
+    return nullptr;
+  }
+  // Immutable after decoding.
+  auto it = index_->achievement_indices.find(achievement_id);
+  if (it == index_->achievement_indices.end()) {
+    return nullptr;
   }
-  return achievements;
+  return &achievements[it->second];
 }
 
 XLanguage XdbfGameData::GetExistingLanguage(XLanguage language_to_check) const {
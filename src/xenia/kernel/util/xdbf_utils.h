@@ -10,6 +10,7 @@
 #ifndef XENIA_KERNEL_UTIL_XDBF_UTILS_H_
 #define XENIA_KERNEL_UTIL_XDBF_UTILS_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -102,6 +103,9 @@ struct XdbfBlock {
 
 // Wraps an XBDF (XboxDataBaseFormat) in-memory database.
 // https://free60project.github.io/wiki/XDBF.html
+// The entries are indexed on construction, and the string tables and the
+// achievements are decoded on the first access, with the index shared between
+// the copies of the wrapper. The data must outlive the wrapper and its copies.
 class XdbfWrapper {
  public:
   XdbfWrapper(const uint8_t* data, size_t data_size);
@@ -116,9 +120,14 @@ class XdbfWrapper {
   // Gets a string from the string table in the given language.
   // Returns the empty string if the entry is not found.
   std::string GetStringTableEntry(XLanguage language, uint16_t string_id) const;
-  std::vector<XdbfAchievementTableEntry> GetAchievements() const;
+  const std::vector<XdbfAchievementTableEntry>& GetAchievements() const;
+  // Returns nullptr if the achievement is not found.
+  const XdbfAchievementTableEntry* GetAchievement(
+      uint16_t achievement_id) const;
 
  private:
+  struct Index;
+
   const uint8_t* data_ = nullptr;
   size_t data_size_ = 0;
   const uint8_t* content_offset_ = nullptr;
@@ -126,6 +135,8 @@ class XdbfWrapper {
   const XbdfHeader* header_ = nullptr;
   const XbdfEntry* entries_ = nullptr;
   const XbdfFileLoc* files_ = nullptr;
+
+  std::shared_ptr<Index> index_;
 };
 
 class XdbfGameData : public XdbfWrapper {
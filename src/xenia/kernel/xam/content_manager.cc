@@ -9,18 +9,30 @@
 
 #include "xenia/kernel/xam/content_manager.h"
 
+#include <algorithm>
 #include <array>
 #include <string>
+#include <utility>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/string.h"
+#include "xenia/kernel/async_io_queue.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/xam/user_profile.h"
 #include "xenia/kernel/xfile.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/vfs/devices/host_path_device.h"
 
+DEFINE_bool(
+    stage_save_game_writes, true,
+    "Keep the data written to the save game files in memory while the save "
+    "game is open, and write it to the host files when it's closed, to avoid "
+    "stuttering when titles save the game. What has been written since the "
+    "save game has been opened is lost if the emulator crashes.",
+    "Content");
+
 namespace xe {
 namespace kernel {
 namespace xam {
@@ -36,7 +48,9 @@ ContentPackage::ContentPackage(KernelState* kernel_state,
                                const std::string_view root_name,
                                const XCONTENT_AGGREGATE_DATA& data,
                                const std::filesystem::path& package_path)
-    : kernel_state_(kernel_state), root_name_(root_name) {
+    : kernel_state_(kernel_state),
+      root_name_(root_name),
+      package_path_(package_path) {
   device_path_ = fmt::format("\\Device\\Content\\{0}\\", ++content_device_id_);
   content_data_ = data;
 
@@ -44,6 +58,11 @@ ContentPackage::ContentPackage(KernelState* kernel_state,
   auto device =
       std::make_unique<vfs::HostPathDevice>(device_path_, package_path, false);
   device->Initialize();
+  if (cvars::stage_save_game_writes &&
+      data.content_type == XContentType::kSavedGame) {
+    device->EnableWriteStaging();
+  }
+  device_ = device.get();
   fs->RegisterDevice(std::move(device));
   fs->RegisterSymbolicLink(root_name_ + ":", device_path_);
 }
@@ -56,9 +75,16 @@ ContentPackage::~ContentPackage() {
 
 ContentManager::ContentManager(KernelState* kernel_state,
                                const std::filesystem::path& root_path)
-    : kernel_state_(kernel_state), root_path_(root_path) {}
-
-ContentManager::~ContentManager() = default;
+    : kernel_state_(kernel_state),
+      root_path_(root_path),
+      staged_file_commits_(std::make_shared<StagedFileCommits>()) {}
+
+ContentManager::~ContentManager() {
+  // Not losing the data of the content still open on shutdown.
+  for (const auto& open_package : open_packages_) {
+    CommitStagedFiles(*open_package.second, false);
+  }
+}
 
 std::filesystem::path ContentManager::ResolvePackageRoot(
     XContentType content_type, uint32_t title_id) {
@@ -90,12 +116,47 @@ std::filesystem::path ContentManager::ResolvePackagePath(
 
 std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
     uint32_t device_id, XContentType content_type, uint32_t title_id) {
-  std::vector<XCONTENT_AGGREGATE_DATA> result;
-
   if (title_id == kCurrentlyRunningTitleId) {
     title_id = kernel_state_->title_id();
   }
 
+  // Adding or removing packages or headers changes the modification time of
+  // the directories containing them.
+  std::error_code error_code;
+  auto package_root_time = std::filesystem::last_write_time(
+      ResolvePackageRoot(content_type, title_id), error_code);
+  if (error_code) {
+    return {};
+  }
+  auto header_root_time = std::filesystem::last_write_time(
+      root_path_ / fmt::format("{:08X}", title_id) /
+          kGameContentHeaderDirName /
+          fmt::format("{:08X}", uint32_t(content_type)),
+      error_code);
+  if (error_code) {
+    header_root_time = {};
+  }
+
+  auto global_lock = global_critical_region_.Acquire();
+  std::string catalog_key = fmt::format("{:08X}_{:08X}_{:08X}", device_id,
+                                        title_id, uint32_t(content_type));
+  auto catalog_it = content_catalogs_.find(catalog_key);
+  if (catalog_it != content_catalogs_.end() &&
+      catalog_it->second.package_root_time == package_root_time &&
+      catalog_it->second.header_root_time == header_root_time) {
+    return catalog_it->second.content;
+  }
+  ContentCatalog& catalog = content_catalogs_[catalog_key];
+  catalog.package_root_time = package_root_time;
+  catalog.header_root_time = header_root_time;
+  catalog.content = ScanContent(device_id, content_type, title_id);
+  return catalog.content;
+}
+
+std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ScanContent(
+    uint32_t device_id, XContentType content_type, uint32_t title_id) {
+  std::vector<XCONTENT_AGGREGATE_DATA> result;
+
   // Search path:
   // content_root/title_id/type_name/*
   auto package_root = ResolvePackageRoot(content_type, title_id);
@@ -123,10 +184,63 @@ std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
   return result;
 }
 
+void ContentManager::InvalidateContentCatalog() {
+  auto global_lock = global_critical_region_.Acquire();
+  content_catalogs_.clear();
+}
+
+void ContentManager::CommitStagedFiles(ContentPackage& package,
+                                       bool allow_asynchronous) {
+  std::vector<vfs::HostPathDevice::StagedFile> staged_files =
+      package.TakeStagedFiles();
+  if (staged_files.empty()) {
+    return;
+  }
+  AsyncIOQueue* async_io_queue =
+      allow_asynchronous ? kernel_state_->async_io_queue() : nullptr;
+  if (!async_io_queue) {
+    for (const vfs::HostPathDevice::StagedFile& staged_file : staged_files) {
+      vfs::HostPathDevice::CommitStagedFile(staged_file);
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(staged_file_commits_->mutex);
+    staged_file_commits_->package_paths.push_back(package.package_path());
+  }
+  async_io_queue->Queue([commits = staged_file_commits_,
+                         package_path = package.package_path(),
+                         staged_files = std::move(staged_files)]() {
+    for (const vfs::HostPathDevice::StagedFile& staged_file : staged_files) {
+      vfs::HostPathDevice::CommitStagedFile(staged_file);
+    }
+    {
+      std::lock_guard<std::mutex> lock(commits->mutex);
+      auto it = std::find(commits->package_paths.begin(),
+                          commits->package_paths.end(), package_path);
+      assert_true(it != commits->package_paths.end());
+      commits->package_paths.erase(it);
+    }
+    commits->cond.notify_all();
+  });
+}
+
+void ContentManager::AwaitStagedFileCommits(
+    const std::filesystem::path& package_path) {
+  StagedFileCommits& commits = *staged_file_commits_;
+  std::unique_lock<std::mutex> lock(commits.mutex);
+  commits.cond.wait(lock, [&]() {
+    return std::find(commits.package_paths.cbegin(),
+                     commits.package_paths.cend(), package_path) ==
+           commits.package_paths.cend();
+  });
+}
+
 std::unique_ptr<ContentPackage> ContentManager::ResolvePackage(
     const std::string_view root_name, const XCONTENT_AGGREGATE_DATA& data,
     const uint32_t disc_number) {
   auto package_path = ResolvePackagePath(data, disc_number);
+  AwaitStagedFileCommits(package_path);
   if (!std::filesystem::exists(package_path)) {
     return nullptr;
   }
@@ -157,6 +271,8 @@ X_RESULT ContentManager::WriteContentHeaderFile(
     }
   }
   auto header_filename = data->file_name() + ".header";
+  // Rewriting a header doesn't change the modification time of the directory.
+  InvalidateContentCatalog();
 
   xe::filesystem::CreateEmptyFile(header_path / header_filename);
 
@@ -230,6 +346,7 @@ X_RESULT ContentManager::CreateContent(const std::string_view root_name,
   if (!std::filesystem::create_directories(package_path)) {
     return X_ERROR_ACCESS_DENIED;
   }
+  InvalidateContentCatalog();
 
   auto package = ResolvePackage(root_name, data);
   assert_not_null(package);
@@ -275,6 +392,8 @@ X_RESULT ContentManager::CloseContent(const std::string_view root_name) {
 
   auto package = it->second;
   open_packages_.erase(it);
+  // The guest doesn't wait for the host files to be written.
+  CommitStagedFiles(*package, true);
   delete package;
 
   return X_ERROR_SUCCESS;
@@ -324,6 +443,8 @@ X_RESULT ContentManager::DeleteContent(const XCONTENT_AGGREGATE_DATA& data) {
   }
 
   auto package_path = ResolvePackagePath(data);
+  AwaitStagedFileCommits(package_path);
+  InvalidateContentCatalog();
   if (std::filesystem::remove_all(package_path) > 0) {
     return X_ERROR_SUCCESS;
   } else {
@@ -10,7 +10,10 @@
 #ifndef XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 #define XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 
+#include <condition_variable>
+#include <filesystem>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -19,6 +22,7 @@
 #include "xenia/base/mutex.h"
 #include "xenia/base/string_key.h"
 #include "xenia/base/string_util.h"
+#include "xenia/vfs/devices/host_path_device.h"
 #include "xenia/xbox.h"
 
 namespace xe {
@@ -127,12 +131,22 @@ class ContentPackage {
   const XCONTENT_AGGREGATE_DATA& GetPackageContentData() const {
     return content_data_;
   }
+  const std::filesystem::path& package_path() const { return package_path_; }
+
+  // The data written to the files of the package that is not on the host
+  // file system yet, to be committed when the package is closed.
+  std::vector<vfs::HostPathDevice::StagedFile> TakeStagedFiles() {
+    return device_->TakeStagedFiles();
+  }
 
  private:
   KernelState* kernel_state_;
   std::string root_name_;
   std::string device_path_;
+  std::filesystem::path package_path_;
   XCONTENT_AGGREGATE_DATA content_data_;
+  // Owned by the file system.
+  vfs::HostPathDevice* device_;
 };
 
 class ContentManager {
@@ -175,6 +189,25 @@ class ContentManager {
                                            uint32_t title_id = -1);
   std::filesystem::path ResolvePackagePath(const XCONTENT_AGGREGATE_DATA& data,
                                            const uint32_t disc_number = -1);
+  std::vector<XCONTENT_AGGREGATE_DATA> ScanContent(uint32_t device_id,
+                                                   XContentType content_type,
+                                                   uint32_t title_id);
+  void InvalidateContentCatalog();
+  // Writes the staged data of the package on the asynchronous I/O threads if
+  // available, or immediately otherwise.
+  void CommitStagedFiles(ContentPackage& package, bool allow_asynchronous);
+  // Waits for the staged data of the package at the path to be written, before
+  // accessing the host files of the package.
+  void AwaitStagedFileCommits(const std::filesystem::path& package_path);
+
+  // Enumerated packages of a title and a content type, reused while neither
+  // the package directory nor the header directory has been modified, so
+  // repeated enumeration doesn't read every package header again.
+  struct ContentCatalog {
+    std::filesystem::file_time_type package_root_time;
+    std::filesystem::file_time_type header_root_time;
+    std::vector<XCONTENT_AGGREGATE_DATA> content;
+  };
 
   KernelState* kernel_state_;
   std::filesystem::path root_path_;
@@ -182,6 +215,17 @@ class ContentManager {
   // TODO(benvanik): remove use of global lock, it's bad here!
   xe::global_critical_region global_critical_region_;
   std::unordered_map<string_key, ContentPackage*> open_packages_;
+  // Keyed by device ID, title ID and content type.
+  std::unordered_map<std::string, ContentCatalog> content_catalogs_;
+
+  // Shared with the commit requests on the asynchronous I/O threads.
+  struct StagedFileCommits {
+    std::mutex mutex;
+    std::condition_variable cond;
+    // The package path for each request in flight.
+    std::vector<std::filesystem::path> package_paths;
+  };
+  std::shared_ptr<StagedFileCommits> staged_file_commits_;
 };
 
 }  // namespace xam
@@ -115,10 +115,15 @@ dword_result_t XamInputGetState_entry(dword_t user_index, dword_t flags,
   }
 
   auto input_system = kernel_state()->emulator()->input_system();
+  if (input_system->is_polling()) {
+    // Only reading the state polled by the input thread.
+    return input_system->GetState(user_index, input_state);
+  }
   auto lock = input_system->lock();
   return input_system->GetState(user_index, input_state);
 }
-DECLARE_XAM_EXPORT2(XamInputGetState, kInput, kImplemented, kHighFrequency);
+DECLARE_XAM_EXPORT3(XamInputGetState, kInput, kImplemented, kHighFrequency,
+                    kLeaf);
 
 // https://msdn.microsoft.com/en-us/library/windows/desktop/microsoft.directx_sdk.reference.xinputsetstate(v=vs.85).aspx
 dword_result_t XamInputSetState_entry(
@@ -7,7 +7,9 @@
  ******************************************************************************
  */
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
@@ -115,6 +117,80 @@ struct XWSAOVERLAPPED {
   xe::be<uint32_t> event_handle;
 };
 
+uint32_t GetWSABuffersSize(const XWSABUF* buffers, uint32_t buffer_count) {
+  uint32_t size = 0;
+  for (uint32_t i = 0; i < buffer_count; ++i) {
+    size += buffers[i].len;
+  }
+  return size;
+}
+
+// Our sockets implementation doesn't support multiple buffers, so the buffers
+// the game has given us are combined.
+std::vector<uint8_t> GatherFromWSABuffers(const XWSABUF* buffers,
+                                          uint32_t buffer_count) {
+  std::vector<uint8_t> data;
+  data.reserve(GetWSABuffersSize(buffers, buffer_count));
+  for (uint32_t i = 0; i < buffer_count; ++i) {
+    const uint8_t* buffer =
+        kernel_memory()->TranslateVirtual<const uint8_t*>(buffers[i].buf_ptr);
+    data.insert(data.end(), buffer, buffer + buffers[i].len);
+  }
+  return data;
+}
+
+void ScatterToWSABuffers(const uint8_t* data, uint32_t size,
+                         const XWSABUF* buffers, uint32_t buffer_count) {
+  for (uint32_t i = 0; i < buffer_count && size; ++i) {
+    uint32_t buffer_size = std::min(size, uint32_t(buffers[i].len));
+    std::memcpy(kernel_memory()->TranslateVirtual(buffers[i].buf_ptr), data,
+                buffer_size);
+    data += buffer_size;
+    size -= buffer_size;
+  }
+}
+
+void StoreRecvFromAddress(const N_XSOCKADDR_IN& from, uint32_t from_len,
+                          uint32_t from_ptr, uint32_t from_len_ptr) {
+  if (from_ptr) {
+    auto guest_from =
+        kernel_memory()->TranslateVirtual<XSOCKADDR_IN*>(from_ptr);
+    guest_from->sin_family = from.sin_family;
+    guest_from->sin_port = from.sin_port;
+    guest_from->sin_addr = from.sin_addr;
+    std::memset(guest_from->x_sin_zero, 0, sizeof(guest_from->x_sin_zero));
+  }
+  if (from_len_ptr) {
+    xe::store_and_swap<uint32_t>(
+        kernel_memory()->TranslateVirtual(from_len_ptr), from_len);
+  }
+}
+
+object_ref<XEvent> BeginOverlapped(XWSAOVERLAPPED* overlapped) {
+  overlapped->internal = X_STATUS_PENDING;
+  overlapped->internal_high = 0;
+  auto ev = kernel_state()->object_table()->LookupObject<XEvent>(
+      overlapped->event_handle);
+  if (ev) {
+    ev->Reset();
+  }
+  return ev;
+}
+
+// Called on the socket multiplexer thread for the asynchronous completion.
+void CompleteOverlapped(uint32_t overlapped_ptr, XEvent* ev, int result,
+                        uint32_t error) {
+  auto overlapped =
+      kernel_memory()->TranslateVirtual<XWSAOVERLAPPED*>(overlapped_ptr);
+  overlapped->internal_high = result >= 0 ? uint32_t(result) : 0;
+  // The guest only compares the status to STATUS_PENDING, the error is kept
+  // for WSAGetOverlappedResult.
+  overlapped->internal = result >= 0 ? X_STATUS_SUCCESS : error;
+  if (ev) {
+    ev->Set(0, false);
+  }
+}
+
 void LoadSockaddr(const uint8_t* ptr, sockaddr* out_addr) {
   out_addr->sa_family = xe::load_and_swap<uint16_t>(ptr + 0);
   switch (out_addr->sa_family) {
@@ -315,24 +391,83 @@ dword_result_t NetDll_WSAGetLastError_entry() {
 DECLARE_XAM_EXPORT1(NetDll_WSAGetLastError, kNetworking, kImplemented);
 
 dword_result_t NetDll_WSARecvFrom_entry(
-    dword_t caller, dword_t socket, pointer_t<XWSABUF> buffers_ptr,
+    dword_t caller, dword_t socket_handle, pointer_t<XWSABUF> buffers_ptr,
     dword_t buffer_count, lpdword_t num_bytes_recv, lpdword_t flags_ptr,
-    pointer_t<XSOCKADDR_IN> from_addr, pointer_t<XWSAOVERLAPPED> overlapped_ptr,
-    lpvoid_t completion_routine_ptr) {
-  if (overlapped_ptr) {
-    // auto evt = kernel_state()->object_table()->LookupObject<XEvent>(
-    //    overlapped_ptr->event_handle);
+    pointer_t<XSOCKADDR_IN> from_ptr, lpdword_t from_len_ptr,
+    pointer_t<XWSAOVERLAPPED> overlapped_ptr, lpvoid_t completion_routine_ptr) {
+  auto socket =
+      kernel_state()->object_table()->LookupObject<XSocket>(socket_handle);
+  if (!socket) {
+    XThread::SetLastError(uint32_t(X_WSAError::X_WSAENOTSOCK));
+    return -1;
+  }
+  if (completion_routine_ptr) {
+    XELOGW("NetDll_WSARecvFrom: Completion routines are not supported");
+  }
+
+  uint32_t buffers_size = GetWSABuffersSize(buffers_ptr, buffer_count);
+  uint32_t flags = flags_ptr ? uint32_t(*flags_ptr) : 0;
 
-    // if (evt) {
-    //  //evt->Set(0, false);
-    //}
+  object_ref<XEvent> ev;
+  if (overlapped_ptr) {
+    ev = BeginOverlapped(overlapped_ptr);
+    // Completed on the multiplexer thread when the data arrives, the guest
+    // thread only needs to wait for the event.
+    if (socket->RecvFromAsync(
+            buffers_size, flags,
+            [buffers = buffers_ptr.guest_address(),
+             buffer_count = uint32_t(buffer_count),
+             from = from_ptr.guest_address(),
+             from_len = from_len_ptr.guest_address(),
+             overlapped = overlapped_ptr.guest_address(),
+             ev](int result, uint32_t error, const uint8_t* data,
+                 const N_XSOCKADDR_IN& native_from, uint32_t native_from_len) {
+              if (result >= 0) {
+                ScatterToWSABuffers(
+                    data, uint32_t(result),
+                    kernel_memory()->TranslateVirtual<const XWSABUF*>(buffers),
+                    buffer_count);
+                StoreRecvFromAddress(native_from, native_from_len, from,
+                                     from_len);
+              }
+              CompleteOverlapped(overlapped, ev.get(), result, error);
+            })) {
+      XThread::SetLastError(uint32_t(X_WSAError::X_WSA_IO_PENDING));
+      return -1;
+    }
+    // Without the multiplexer, completing the operation immediately.
   }
 
-  // we're not going to be receiving packets any time soon
-  // return error so we don't wait on that - Cancerous
-  return -1;
+  std::vector<uint8_t> data(buffers_size);
+  N_XSOCKADDR_IN native_from;
+  std::memset(&native_from, 0, sizeof(native_from));
+  uint32_t native_from_len = 0;
+  int ret = socket->RecvFrom(data.data(), buffers_size, flags, &native_from,
+                             &native_from_len);
+  if (ret == -1) {
+    uint32_t error = socket->GetLastWSAError();
+    if (overlapped_ptr) {
+      CompleteOverlapped(overlapped_ptr.guest_address(), ev.get(), ret, error);
+    }
+    XThread::SetLastError(error);
+    return -1;
+  }
+  ScatterToWSABuffers(data.data(), uint32_t(ret), buffers_ptr, buffer_count);
+  StoreRecvFromAddress(native_from, native_from_len, from_ptr.guest_address(),
+                       from_len_ptr.guest_address());
+  if (num_bytes_recv) {
+    *num_bytes_recv = uint32_t(ret);
+  }
+  if (flags_ptr) {
+    *flags_ptr = 0;
+  }
+  if (overlapped_ptr) {
+    CompleteOverlapped(overlapped_ptr.guest_address(), ev.get(), ret, 0);
+  }
+  return 0;
 }
-DECLARE_XAM_EXPORT2(NetDll_WSARecvFrom, kNetworking, kStub, kHighFrequency);
+DECLARE_XAM_EXPORT2(NetDll_WSARecvFrom, kNetworking, kImplemented,
+                    kHighFrequency);
 
 // If the socket is a VDP socket, buffer 0 is the game data length, and buffer 1
 // is the unencrypted game data.
@@ -341,42 +476,95 @@ dword_result_t NetDll_WSASendTo_entry(
     dword_t num_buffers, lpdword_t num_bytes_sent, dword_t flags,
     pointer_t<XSOCKADDR_IN> to_ptr, dword_t to_len,
     pointer_t<XWSAOVERLAPPED> overlapped, lpvoid_t completion_routine) {
-  assert(!overlapped);
-  assert(!completion_routine);
-
   auto socket =
       kernel_state()->object_table()->LookupObject<XSocket>(socket_handle);
   if (!socket) {
     XThread::SetLastError(uint32_t(X_WSAError::X_WSAENOTSOCK));
     return -1;
   }
-
-  // Our sockets implementation doesn't support multiple buffers, so we need
-  // to combine the buffers the game has given us!
-  std::vector<uint8_t> combined_buffer_mem;
-  uint32_t combined_buffer_size = 0;
-  uint32_t combined_buffer_offset = 0;
-  for (uint32_t i = 0; i < num_buffers; i++) {
-    combined_buffer_size += buffers[i].len;
-    combined_buffer_mem.resize(combined_buffer_size);
-    uint8_t* combined_buffer = combined_buffer_mem.data();
-
-    std::memcpy(combined_buffer + combined_buffer_offset,
-                kernel_memory()->TranslateVirtual(buffers[i].buf_ptr),
-                buffers[i].len);
-    combined_buffer_offset += buffers[i].len;
+  if (completion_routine) {
+    XELOGW("NetDll_WSASendTo: Completion routines are not supported");
   }
 
-  N_XSOCKADDR_IN native_to(to_ptr);
-  socket->SendTo(combined_buffer_mem.data(), combined_buffer_size, flags,
-                 &native_to, to_len);
+  std::vector<uint8_t> data = GatherFromWSABuffers(buffers, num_buffers);
+  N_XSOCKADDR_IN native_to;
+  if (to_ptr) {
+    native_to = *to_ptr;
+  }
 
-  // TODO: Instantly complete overlapped
+  object_ref<XEvent> ev;
+  if (overlapped) {
+    ev = BeginOverlapped(overlapped);
+    if (socket->SendToAsync(
+            std::move(data), flags, to_ptr ? &native_to : nullptr, to_len,
+            [overlapped = overlapped.guest_address(), ev](int result,
+                                                          uint32_t error) {
+              CompleteOverlapped(overlapped, ev.get(), result, error);
+            })) {
+      XThread::SetLastError(uint32_t(X_WSAError::X_WSA_IO_PENDING));
+      return -1;
+    }
+    // Without the multiplexer, completing the operation immediately.
+  }
 
+  int ret = socket->SendTo(data.data(), uint32_t(data.size()), flags,
+                           to_ptr ? &native_to : nullptr, to_len);
+  if (ret == -1) {
+    uint32_t error = socket->GetLastWSAError();
+    if (overlapped) {
+      CompleteOverlapped(overlapped.guest_address(), ev.get(), ret, error);
+    }
+    XThread::SetLastError(error);
+    return -1;
+  }
+  if (num_bytes_sent) {
+    *num_bytes_sent = uint32_t(ret);
+  }
+  if (overlapped) {
+    CompleteOverlapped(overlapped.guest_address(), ev.get(), ret, 0);
+  }
   return 0;
 }
 DECLARE_XAM_EXPORT1(NetDll_WSASendTo, kNetworking, kImplemented);
 
+dword_result_t NetDll_WSAGetOverlappedResult_entry(
+    dword_t caller, dword_t socket_handle,
+    pointer_t<XWSAOVERLAPPED> overlapped_ptr, lpdword_t bytes_transferred_ptr,
+    dword_t wait, lpdword_t flags_ptr) {
+  if (!overlapped_ptr) {
+    XThread::SetLastError(uint32_t(X_WSAError::X_WSAEFAULT));
+    return 0;
+  }
+  if (overlapped_ptr->internal == X_STATUS_PENDING) {
+    uint32_t event_handle = overlapped_ptr->event_handle;
+    if (!wait || !event_handle) {
+      XThread::SetLastError(uint32_t(X_WSAError::X_WSA_IO_INCOMPLETE));
+      return 0;
+    }
+    X_STATUS result =
+        xboxkrnl::NtWaitForSingleObjectEx(event_handle, 1, 0, nullptr);
+    if (XFAILED(result)) {
+      XThread::SetLastError(xboxkrnl::xeRtlNtStatusToDosError(result));
+      return 0;
+    }
+  }
+  if (bytes_transferred_ptr) {
+    *bytes_transferred_ptr = overlapped_ptr->internal_high;
+  }
+  if (flags_ptr) {
+    *flags_ptr = 0;
+  }
+  uint32_t status = overlapped_ptr->internal;
+  if (status != X_STATUS_SUCCESS) {
+    // The WSA error stored on completion.
+    XThread::SetLastError(status);
+    return 0;
+  }
+  return 1;
+}
+DECLARE_XAM_EXPORT2(NetDll_WSAGetOverlappedResult, kNetworking, kImplemented,
+                    kBlocking);
+
 dword_result_t NetDll_WSAWaitForMultipleEvents_entry(dword_t num_events,
                                                      lpdword_t events,
                                                      dword_t wait_all,
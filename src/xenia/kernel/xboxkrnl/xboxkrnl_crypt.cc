@@ -9,6 +9,7 @@
 
 #include <algorithm>
 
+#include "xenia/base/crypto.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 #include "xenia/kernel/kernel_state.h"
@@ -94,6 +95,38 @@ typedef struct {
 } XECRYPT_SHA_STATE;
 static_assert_size(XECRYPT_SHA_STATE, 0x58);
 
+// Common for SHA-1 and SHA-256 with the host instructions, updating the guest
+// state directly, hashing whole blocks from the input in place.
+template <size_t kStateWords>
+void UpdateShaStateAccelerated(
+    xe::be<uint32_t>& count, xe::be<uint32_t> (&guest_state)[kStateWords],
+    uint8_t* buffer, const uint8_t* input, uint32_t input_size,
+    void (*process_blocks)(uint32_t* state, const uint8_t* data,
+                           size_t block_count)) {
+  uint32_t buffered_size = count & (xe::crypto::kShaBlockSize - 1);
+  count = count + input_size;
+  if (buffered_size) {
+    uint32_t buffer_fill_size = std::min(
+        uint32_t(xe::crypto::kShaBlockSize) - buffered_size, input_size);
+    std::memcpy(buffer + buffered_size, input, buffer_fill_size);
+    if (buffered_size + buffer_fill_size < xe::crypto::kShaBlockSize) {
+      return;
+    }
+    input += buffer_fill_size;
+    input_size -= buffer_fill_size;
+  }
+  uint32_t state[kStateWords];
+  std::copy_n(guest_state, kStateWords, state);
+  if (buffered_size) {
+    process_blocks(state, buffer, 1);
+  }
+  size_t block_count = input_size / xe::crypto::kShaBlockSize;
+  process_blocks(state, input, block_count);
+  std::copy_n(state, kStateWords, guest_state);
+  input += xe::crypto::kShaBlockSize * block_count;
+  std::memcpy(buffer, input, input_size & (xe::crypto::kShaBlockSize - 1));
+}
+
 void InitSha1(sha1::SHA1* sha, const XECRYPT_SHA_STATE* state) {
   uint32_t digest[5];
   std::copy(std::begin(state->state), std::end(state->state), digest);
@@ -121,6 +154,13 @@ DECLARE_XBOXKRNL_EXPORT1(XeCryptShaInit, kNone, kImplemented);
 
 void XeCryptShaUpdate_entry(pointer_t<XECRYPT_SHA_STATE> sha_state,
                             lpvoid_t input, dword_t input_size) {
+  if (xe::crypto::IsShaAccelerated()) {
+    UpdateShaStateAccelerated(
+        sha_state->count, sha_state->state, sha_state->buffer,
+        input.as<const uint8_t*>(), input_size,
+        xe::crypto::Sha1ProcessBlocks);
+    return;
+  }
   sha1::SHA1 sha;
   InitSha1(&sha, sha_state);
 
@@ -190,6 +230,13 @@ DECLARE_XBOXKRNL_EXPORT1(XeCryptSha256Init, kNone, kImplemented);
 
 void XeCryptSha256Update_entry(pointer_t<XECRYPT_SHA256_STATE> sha_state,
                                lpvoid_t input, dword_t input_size) {
+  if (xe::crypto::IsShaAccelerated()) {
+    UpdateShaStateAccelerated(
+        sha_state->count, sha_state->state, sha_state->buffer,
+        input.as<const uint8_t*>(), input_size,
+        xe::crypto::Sha256ProcessBlocks);
+    return;
+  }
   sha256::SHA256 sha;
   std::copy(std::begin(sha_state->state), std::end(sha_state->state),
             sha.getHashValues());
@@ -501,6 +548,16 @@ void XeCryptAesEcb_entry(pointer_t<XECRYPT_AES_STATE> state_ptr,
                          lpvoid_t inp_ptr, lpvoid_t out_ptr, dword_t encrypt) {
   const uint8_t* keytab =
       reinterpret_cast<const uint8_t*>(state_ptr->keytabenc);
+  if (xe::crypto::IsAesAccelerated()) {
+    if (encrypt) {
+      xe::crypto::Aes128EncryptEcb(keytab, inp_ptr.as<const uint8_t*>(),
+                                   out_ptr.as<uint8_t*>(), 1);
+    } else {
+      xe::crypto::Aes128DecryptEcb(keytab, inp_ptr.as<const uint8_t*>(),
+                                   out_ptr.as<uint8_t*>(), 1);
+    }
+    return;
+  }
   if (encrypt) {
     aes_encrypt_128(keytab, inp_ptr, out_ptr);
   } else {
@@ -517,6 +574,18 @@ void XeCryptAesCbc_entry(pointer_t<XECRYPT_AES_STATE> state_ptr,
   const uint8_t* inp = inp_ptr.as<const uint8_t*>();
   uint8_t* out = out_ptr.as<uint8_t*>();
   uint8_t* feed = feed_ptr.as<uint8_t*>();
+  if (xe::crypto::IsAesAccelerated()) {
+    // Like the loops below, including the partial last block if there is one.
+    size_t block_count =
+        (uint32_t(inp_size) + (xe::crypto::kAesBlockSize - 1)) /
+        xe::crypto::kAesBlockSize;
+    if (encrypt) {
+      xe::crypto::Aes128EncryptCbc(keytab, inp, out, block_count, feed);
+    } else {
+      xe::crypto::Aes128DecryptCbc(keytab, inp, out, block_count, feed);
+    }
+    return;
+  }
   if (encrypt) {
     for (uint32_t i = 0; i < inp_size; i += 16) {
       for (uint32_t j = 0; j < 16; ++j) {
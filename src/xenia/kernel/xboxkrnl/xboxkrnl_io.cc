@@ -11,6 +11,7 @@
 #include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/kernel/async_io_queue.h"
 #include "xenia/kernel/info/file.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/util/shim_utils.h"
@@ -181,6 +182,45 @@ dword_result_t NtOpenFile_entry(
 }
 DECLARE_XBOXKRNL_EXPORT1(NtOpenFile, kFileSystem, kImplemented);
 
+// Returns the queue to perform the I/O on asynchronously, or nullptr if it must
+// be done synchronously. The asynchronous I/O must specify the offset, the
+// current file position is used only for the synchronous I/O.
+static AsyncIOQueue* GetAsyncIOQueue(const XFile& file,
+                                     lpqword_t byte_offset_ptr) {
+  if (file.is_synchronous() || !byte_offset_ptr) {
+    return nullptr;
+  }
+  uint64_t byte_offset = *byte_offset_ptr;
+  if (byte_offset == uint64_t(-1) || byte_offset == uint64_t(-2)) {
+    return nullptr;
+  }
+  return kernel_state()->async_io_queue();
+}
+
+// Called on the asynchronous I/O thread after the file operation.
+static void CompleteAsyncIO(X_STATUS status, uint32_t information,
+                            uint32_t io_status_block_ptr, XEvent* ev,
+                            XThread* thread, uint32_t apc_routine,
+                            uint32_t apc_context) {
+  if (io_status_block_ptr) {
+    auto io_status_block =
+        kernel_memory()->TranslateVirtual<X_IO_STATUS_BLOCK*>(
+            io_status_block_ptr);
+    io_status_block->status = status;
+    io_status_block->information = information;
+  }
+
+  // Queue the APC callback to the thread that requested the I/O.
+  // Low bit probably means do not queue to IO ports.
+  if ((apc_routine & ~1u) && apc_context) {
+    thread->EnqueueApc(apc_routine & ~1u, apc_context, io_status_block_ptr, 0);
+  }
+
+  if (ev) {
+    ev->Set(0, false);
+  }
+}
+
 dword_result_t NtReadFile_entry(dword_t file_handle, dword_t event_handle,
                                 lpvoid_t apc_routine_ptr, lpvoid_t apc_context,
                                 pointer_t<X_IO_STATUS_BLOCK> io_status_block,
@@ -200,7 +240,8 @@ dword_result_t NtReadFile_entry(dword_t file_handle, dword_t event_handle,
   }
 
   if (XSUCCEEDED(result)) {
-    if (true || file->is_synchronous()) {
+    AsyncIOQueue* async_io_queue = GetAsyncIOQueue(*file, byte_offset_ptr);
+    if (!async_io_queue) {
       // Synchronous.
       uint32_t bytes_read = 0;
       result = file->Read(
@@ -231,23 +272,30 @@ dword_result_t NtReadFile_entry(dword_t file_handle, dword_t event_handle,
       // we have written the info out.
       signal_event = true;
     } else {
-      // TODO(benvanik): async.
-
-      // X_STATUS_PENDING if not returning immediately.
-      // XFile is waitable and signalled after each async req completes.
-      // reset the input event (->Reset())
-      /*xeNtReadFileState* call_state = new xeNtReadFileState();
-      XAsyncRequest* request = new XAsyncRequest(
-      state, file,
-      (XAsyncRequest::CompletionCallback)xeNtReadFileCompleted,
-      call_state);*/
-      // result = file->Read(buffer.guest_address(), buffer_length, byte_offset,
-      //                     request);
+      // Asynchronous. The event is signaled, the APC is queued, and the I/O
+      // completion ports and the file itself are notified when the read is
+      // completed on the asynchronous I/O thread.
+      if (ev) {
+        ev->Reset();
+      }
       if (io_status_block) {
         io_status_block->status = X_STATUS_PENDING;
         io_status_block->information = 0;
       }
-
+      async_io_queue->Queue(
+          [file, ev, thread = retain_object(XThread::GetCurrentThread()),
+           buffer_address = buffer.guest_address(),
+           buffer_length = uint32_t(buffer_length),
+           byte_offset = uint64_t(*byte_offset_ptr),
+           io_status_block_ptr = io_status_block.guest_address(),
+           apc_routine = uint32_t(apc_routine_ptr),
+           apc_context = apc_context.guest_address()]() {
+            uint32_t bytes_read = 0;
+            X_STATUS status = file->Read(buffer_address, buffer_length,
+                                         byte_offset, &bytes_read, apc_context);
+            CompleteAsyncIO(status, bytes_read, io_status_block_ptr, ev.get(),
+                            thread.get(), apc_routine, apc_context);
+          });
       result = X_STATUS_PENDING;
     }
   }
@@ -373,8 +421,8 @@ dword_result_t NtWriteFile_entry(dword_t file_handle, dword_t event_handle,
 
   // Execute write.
   if (XSUCCEEDED(result)) {
-    // TODO(benvanik): async path.
-    if (true || file->is_synchronous()) {
+    AsyncIOQueue* async_io_queue = GetAsyncIOQueue(*file, byte_offset_ptr);
+    if (!async_io_queue) {
       // Synchronous request.
       uint32_t bytes_written = 0;
       result = file->Write(
@@ -406,13 +454,30 @@ dword_result_t NtWriteFile_entry(dword_t file_handle, dword_t event_handle,
       // we have written the info out.
       signal_event = true;
     } else {
-      // X_STATUS_PENDING if not returning immediately.
-      result = X_STATUS_PENDING;
-
+      // Asynchronous, completed like the reads.
+      if (ev) {
+        ev->Reset();
+      }
       if (io_status_block) {
         io_status_block->status = X_STATUS_PENDING;
         io_status_block->information = 0;
       }
+      async_io_queue->Queue(
+          [file, ev, thread = retain_object(XThread::GetCurrentThread()),
+           buffer_address = buffer.guest_address(),
+           buffer_length = uint32_t(buffer_length),
+           byte_offset = uint64_t(*byte_offset_ptr),
+           io_status_block_ptr = io_status_block.guest_address(),
+           apc_routine = uint32_t(apc_routine),
+           apc_context = apc_context.guest_address()]() {
+            uint32_t bytes_written = 0;
+            X_STATUS status =
+                file->Write(buffer_address, buffer_length, byte_offset,
+                            &bytes_written, apc_context);
+            CompleteAsyncIO(status, bytes_written, io_status_block_ptr,
+                            ev.get(), thread.get(), apc_routine, apc_context);
+          });
+      result = X_STATUS_PENDING;
     }
   }
 
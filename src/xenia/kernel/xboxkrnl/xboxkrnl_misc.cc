@@ -7,6 +7,7 @@
  ******************************************************************************
  */
 
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/processor.h"
@@ -120,12 +121,8 @@ void KeSaveFloatingPointState_entry(ppc_context_t& ctx) {
 DECLARE_XBOXKRNL_EXPORT1(KeSaveFloatingPointState, kNone, kImplemented);
 #endif
 static qword_result_t KeQueryInterruptTime_entry(const ppc_context_t& ctx) {
-  auto kstate = ctx->kernel_state;
-  uint32_t ts_bundle = kstate->GetKeTimestampBundle();
-  X_TIME_STAMP_BUNDLE* bundle =
-      ctx->TranslateVirtual<X_TIME_STAMP_BUNDLE*>(ts_bundle);
-
-  return xe::load_and_swap<uint64_t>(&bundle->interrupt_time);
+  // Not from KeTimeStampBundle, which is updated only periodically.
+  return Clock::QueryGuestInterruptTime();
 }
 DECLARE_XBOXKRNL_EXPORT1(KeQueryInterruptTime, kNone, kImplemented);
 }  // namespace xboxkrnl
@@ -21,6 +21,7 @@
 #include "xenia/emulator.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/user_module.h"
+#include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xboxkrnl/cert_monitor.h"
 #include "xenia/kernel/xboxkrnl/debug_monitor.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_private.h"
@@ -250,6 +251,7 @@ void XboxkrnlModule::RegisterExportTable(
       xboxkrnl_exports[export_entry.ordinal] = &export_entry;
     }
   }
+  xe::kernel::shim::SelectExportTrampolines(xboxkrnl_exports);
   export_resolver->RegisterTable("xboxkrnl.exe", &xboxkrnl_exports);
 }
 
@@ -10,12 +10,14 @@
 #include "xenia/kernel/xboxkrnl/xboxkrnl_rtl.h"
 
 #include <algorithm>
+#include <cstring>
 #include <string>
 
 #include "third_party/pe/pe_image.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/chrono.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/string.h"
 #include "xenia/base/threading.h"
 #include "xenia/kernel/kernel_state.h"
@@ -41,36 +43,17 @@ dword_result_t RtlCompareMemory_entry(lpvoid_t source1, lpvoid_t source2,
 
   // Note that the return value is the number of bytes that match, so it's best
   // we just do this ourselves vs. using memcmp.
-  // On Windows we could use the builtin function.
-
-  uint32_t c = 0;
-  for (uint32_t n = 0; n < length; n++, p1++, p2++) {
-    if (*p1 == *p2) {
-      c++;
-    }
-  }
-
-  return c;
+  return uint32_t(xe::count_equal_bytes(p1, p2, length));
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemory, kMemory, kImplemented);
 
 // https://msdn.microsoft.com/en-us/library/ff552123
 dword_result_t RtlCompareMemoryUlong_entry(lpvoid_t source, dword_t length,
                                            dword_t pattern) {
-  uint32_t num_compared_bytes = 0;
-
   uint32_t swapped_pattern = xe::byte_swap(pattern.value());
-
-  char* host_source = (char*)source.host_address();
-
-  for (uint32_t aligned_length = length & 0xFFFFFFFCU; aligned_length;
-       num_compared_bytes += 4) {
-    if (*(uint32_t*)(host_source + num_compared_bytes) != swapped_pattern) {
-      break;
-    }
-    aligned_length = aligned_length - 4;
-  }
-  return num_compared_bytes;
+  const uint32_t* p = source.as<const uint32_t*>();
+  return uint32_t(sizeof(uint32_t) *
+                  xe::count_leading_equal_32(p, swapped_pattern, length >> 2));
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemoryUlong, kMemory, kImplemented);
 
@@ -78,13 +61,8 @@ DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemoryUlong, kMemory, kImplemented);
 void RtlFillMemoryUlong_entry(lpvoid_t destination, dword_t length,
                               dword_t pattern) {
   // NOTE: length must be % 4, so we can work on uint32s.
-  uint32_t count = length >> 2;
-
-  uint32_t* p = destination.as<uint32_t*>();
-  uint32_t swapped_pattern = xe::byte_swap(pattern.value());
-  for (uint32_t n = 0; n < count; n++, p++) {
-    *p = swapped_pattern;
-  }
+  xe::fill_32(destination.as<uint32_t*>(), xe::byte_swap(pattern.value()),
+              length >> 2);
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlFillMemoryUlong, kMemory, kImplemented);
 
@@ -150,18 +128,12 @@ static int RtlCompareStringN_impl(uint8_t* string_1, unsigned int string_1_len,
                                   uint8_t* string_2, unsigned int string_2_len,
                                   int case_insensitive) {
   if (string_1_len == 0xFFFFFFFF) {
-    uint8_t* string1_strlen_iter = string_1;
-    while (*string1_strlen_iter++)
-      ;
-    string_1_len =
-        static_cast<unsigned int>(string1_strlen_iter - string_1 - 1);
+    string_1_len = static_cast<unsigned int>(
+        std::strlen(reinterpret_cast<const char*>(string_1)));
   }
   if (string_2_len == 0xFFFFFFFF) {
-    uint8_t* string2_strlen_iter = string_2;
-    while (*string2_strlen_iter++)
-      ;
-    string_2_len =
-        static_cast<unsigned int>(string2_strlen_iter - string_2 - 1);
+    string_2_len = static_cast<unsigned int>(
+        std::strlen(reinterpret_cast<const char*>(string_2)));
   }
   uint8_t* string1_end = &string_1[std::min(string_2_len, string_1_len)];
   if (case_insensitive) {
@@ -255,8 +227,12 @@ DECLARE_XBOXKRNL_EXPORT1(RtlFreeAnsiString, kNone, kImplemented);
 pointer_result_t RtlInitUnicodeString_entry(
     pointer_t<X_UNICODE_STRING> destination, lpu16string_t source) {
   if (source) {
-    destination->length = (uint16_t)source.value().size() * 2;
-    destination->maximum_length = (uint16_t)(source.value().size() + 1) * 2;
+    // Scanning the guest string in place rather than copying it to the host.
+    // Limited so the maximum length, including the terminator, fits in 16 bits.
+    uint16_t length = uint16_t(xe::find_zero_16(
+        reinterpret_cast<const void*>(source.host_address()), 0xFFFF / 2 - 1));
+    destination->length = length * 2;
+    destination->maximum_length = (length + 1) * 2;
     destination->pointer = source.guest_address();
   } else {
     destination->reset();
@@ -365,9 +341,9 @@ dword_result_t RtlMultiByteToUnicodeN_entry(lpword_t destination_ptr,
   // TODO(benvanik): maybe use MultiByteToUnicode on Win32? would require
   // swapping.
 
-  for (uint32_t i = 0; i < copy_len; i++) {
-    destination_ptr[i] = source_ptr[i];
-  }
+  xe::widen_8_to_16_swapped(
+      reinterpret_cast<void*>(destination_ptr.host_address()),
+      reinterpret_cast<const void*>(source_ptr.host_address()), copy_len);
 
   if (written_ptr.guest_address() != 0) {
     *written_ptr = copy_len << 1;
@@ -388,10 +364,9 @@ dword_result_t RtlUnicodeToMultiByteN_entry(pointer_t<uint8_t> destination_ptr,
   copy_len = copy_len < destination_len ? copy_len : destination_len.value();
 
   // TODO(benvanik): maybe use UnicodeToMultiByte on Win32?
-  for (uint32_t i = 0; i < copy_len; i++) {
-    uint16_t c = source_ptr[i];
-    destination_ptr[i] = c < 256 ? (uint8_t)c : '?';
-  }
+  xe::narrow_16_swapped_to_8(
+      reinterpret_cast<void*>(destination_ptr.host_address()),
+      reinterpret_cast<const void*>(source_ptr.host_address()), copy_len, '?');
 
   if (written_ptr.guest_address() != 0) {
     *written_ptr = copy_len;
@@ -652,8 +627,8 @@ dword_result_t RtlTryEnterCriticalSection_entry(
   // Failed to acquire lock.
   return 0;
 }
-DECLARE_XBOXKRNL_EXPORT2(RtlTryEnterCriticalSection, kNone, kImplemented,
-                         kHighFrequency);
+DECLARE_XBOXKRNL_EXPORT3(RtlTryEnterCriticalSection, kNone, kImplemented,
+                         kHighFrequency, kLeaf);
 
 void RtlLeaveCriticalSection_entry(pointer_t<X_RTL_CRITICAL_SECTION> cs) {
   if (!cs.guest_address()) {
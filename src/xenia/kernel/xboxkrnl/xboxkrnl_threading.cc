@@ -359,8 +359,8 @@ DECLARE_XBOXKRNL_EXPORT1(KeSetDisableBoostThread, kThreading, kImplemented);
 dword_result_t KeGetCurrentProcessType_entry() {
   return kernel_state()->process_type();
 }
-DECLARE_XBOXKRNL_EXPORT2(KeGetCurrentProcessType, kThreading, kImplemented,
-                         kHighFrequency);
+DECLARE_XBOXKRNL_EXPORT3(KeGetCurrentProcessType, kThreading, kImplemented,
+                         kHighFrequency, kLeaf);
 
 void KeSetCurrentProcessType_entry(dword_t type) {
   // One of X_PROCTYPE_?
@@ -452,8 +452,8 @@ dword_result_t KeTlsGetValue_entry(dword_t tls_index) {
 
   return 0;
 }
-DECLARE_XBOXKRNL_EXPORT2(KeTlsGetValue, kThreading, kImplemented,
-                         kHighFrequency);
+DECLARE_XBOXKRNL_EXPORT3(KeTlsGetValue, kThreading, kImplemented,
+                         kHighFrequency, kLeaf);
 
 // https://msdn.microsoft.com/en-us/library/ms686818
 dword_result_t KeTlsSetValue_entry(dword_t tls_index, dword_t tls_value) {
@@ -1265,10 +1265,7 @@ dword_result_t KeInsertQueueApc_entry(pointer_t<XAPC> apc, lpvoid_t arg1,
   apc->arg2 = arg2.guest_address();
   apc->enqueued = 1;
 
-  auto apc_list = thread->apc_list();
-
-  uint32_t list_entry_ptr = apc.guest_address() + 8;
-  apc_list->Insert(list_entry_ptr);
+  thread->InsertApc(apc.guest_address() + 8);
 
   // Unlock thread.
   thread->UnlockApc(true);
@@ -1294,12 +1291,7 @@ dword_result_t KeRemoveQueueApc_entry(pointer_t<XAPC> apc) {
     return 0;
   }
 
-  auto apc_list = thread->apc_list();
-  uint32_t list_entry_ptr = apc.guest_address() + 8;
-  if (apc_list->IsQueued(list_entry_ptr)) {
-    apc_list->Remove(list_entry_ptr);
-    result = true;
-  }
+  result = thread->RemoveApc(apc.guest_address() + 8);
 
   thread->UnlockApc(true);
 
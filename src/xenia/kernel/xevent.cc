@@ -16,7 +16,9 @@ namespace xe {
 namespace kernel {
 
 XEvent::XEvent(KernelState* kernel_state)
-    : XObject(kernel_state, kObjectType) {}
+    : XObject(kernel_state, kObjectType) {
+  tracks_signal_hint_ = true;
+}
 
 XEvent::~XEvent() = default;
 
@@ -59,10 +61,13 @@ void XEvent::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
 
 int32_t XEvent::Set(uint32_t priority_increment, bool wait) {
   event_->Set();
+  SetSignalHint();
   return 1;
 }
 
 int32_t XEvent::Pulse(uint32_t priority_increment, bool wait) {
+  // Releases only the threads already blocked in the host wait, the ones still
+  // spinning will miss the pulse, as if they have not started waiting yet.
   event_->Pulse();
   return 1;
 }
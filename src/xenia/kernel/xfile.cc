@@ -45,6 +45,33 @@ X_STATUS XFile::QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info,
                                bool restart) {
   assert_not_null(out_info);
 
+  vfs::Entry* directory = file_->entry();
+  // Matches the children after the last returned one, resuming the search if
+  // the children have been changed since it was started.
+  auto find_matches = [this, directory]() {
+    find_matches_.clear();
+    find_match_position_ = 0;
+    find_children_version_ =
+        directory->FindChildren(find_engine_, find_index_, find_matches_);
+  };
+  auto next_match = [this, directory, &find_matches]() -> vfs::Entry* {
+    for (uint32_t attempt = 0; attempt < 2; ++attempt) {
+      if (find_match_position_ >= find_matches_.size()) {
+        return nullptr;
+      }
+      size_t child_index = find_matches_[find_match_position_];
+      vfs::Entry* child =
+          directory->GetFoundChild(child_index, find_children_version_);
+      if (child) {
+        ++find_match_position_;
+        find_index_ = child_index + 1;
+        return child;
+      }
+      find_matches();
+    }
+    return nullptr;
+  };
+
   vfs::Entry* entry = nullptr;
 
   if (!file_name.empty()) {
@@ -55,16 +82,18 @@ X_STATUS XFile::QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info,
 
     // Always restart the search?
     find_index_ = 0;
-    entry = file_->entry()->IterateChildren(find_engine_, &find_index_);
+    find_matches();
+    entry = next_match();
     if (!entry) {
       return X_STATUS_NO_SUCH_FILE;
     }
   } else {
     if (restart) {
       find_index_ = 0;
+      find_matches();
     }
 
-    entry = file_->entry()->IterateChildren(find_engine_, &find_index_);
+    entry = next_match();
     if (!entry) {
       return X_STATUS_NO_MORE_FILES;
     }
@@ -142,6 +171,11 @@ X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
                 memory::PageAccess::kReadWrite) {
           result = X_STATUS_ACCESS_VIOLATION;
         } else {
+          if (!buffer_physical_heap) {
+            // The host file read fails instead of faulting on watched code.
+            memory()->TriggerCodeWriteWatches(buffer_guest_address,
+                                              buffer_length);
+          }
           result = file_->ReadSync(
               buffer_physical_heap
                   ? memory()->TranslatePhysical(
@@ -155,6 +189,8 @@ X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
                   xe::global_critical_region::AcquireDirect(),
                   buffer_guest_address, buffer_length, true, true);
             }
+            kernel_state()->file_system()->access_prefetcher().OnRead(
+                file_->entry(), byte_offset, bytes_read);
             position_ += bytes_read;
           }
         }
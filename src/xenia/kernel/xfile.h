@@ -142,6 +142,11 @@ class XFile : public XObject {
 
   xe::filesystem::WildcardEngine find_engine_;
   size_t find_index_ = 0;
+  // Indices of the children matching find_engine_ from when the search was
+  // started, so every query only advances through them.
+  std::vector<size_t> find_matches_;
+  size_t find_match_position_ = 0;
+  uint64_t find_children_version_ = 0;
 
   bool is_synchronous_ = false;
 };
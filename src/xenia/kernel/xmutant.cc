@@ -18,9 +18,11 @@ namespace xe {
 namespace kernel {
 
 XMutant::XMutant(KernelState* kernel_state)
-    : XObject(kernel_state, kObjectType) {}
+    : XObject(kernel_state, kObjectType) {
+  tracks_signal_hint_ = true;
+}
 
-XMutant::XMutant() : XObject(kObjectType) {}
+XMutant::XMutant() : XObject(kObjectType) { tracks_signal_hint_ = true; }
 
 XMutant::~XMutant() = default;
 
@@ -48,6 +50,7 @@ X_STATUS XMutant::ReleaseMutant(uint32_t priority_increment, bool abandon,
   // TODO(benvanik): abandoning.
   assert_false(abandon);
   if (mutant_->Release()) {
+    SetSignalHint();
     return X_STATUS_SUCCESS;
   } else {
     return X_STATUS_MUTANT_NOT_OWNED;
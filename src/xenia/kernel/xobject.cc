@@ -11,8 +11,14 @@
 
 #include <vector>
 
+#if XE_ARCH_AMD64
+#include <xmmintrin.h>
+#endif
+
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/platform.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_private.h"
@@ -26,6 +32,20 @@
 #include "xenia/kernel/xsymboliclink.h"
 #include "xenia/kernel/xthread.h"
 
+// Each check is followed by a pause, which takes up to about 140 clocks on
+// recent x86 cores, so by default, the spinning lasts up to a few microseconds,
+// around the cost of the host thread blocking and being woken up, and doesn't
+// take much time from other guest threads if there are more of them than
+// logical processors.
+DEFINE_uint32(kernel_wait_spin_count, 64,
+              "Maximum number of times to check whether a guest event, "
+              "semaphore or mutant has been signaled before blocking the "
+              "thread waiting for it on the host, to avoid the host thread "
+              "sleeping and waking up for short waits. Adjusted for each "
+              "object depending on whether spinning was useful. 0 to always "
+              "block immediately.",
+              "Kernel");
+
 namespace xe {
 namespace kernel {
 
@@ -205,8 +225,12 @@ X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
                         TimeoutTicksToMs(*opt_timeout)))
                   : std::chrono::milliseconds::max();
 
-  auto result =
-      xe::threading::Wait(wait_handle, alertable ? true : false, timeout_ms);
+  xe::threading::WaitResult result;
+  if (!timeout_ms.count() ||
+      !SpinForSignal(wait_handle, alertable ? true : false, result)) {
+    result =
+        xe::threading::Wait(wait_handle, alertable ? true : false, timeout_ms);
+  }
   switch (result) {
     case xe::threading::WaitResult::kSuccess:
       WaitCallback();
@@ -224,6 +248,42 @@ X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
   }
 }
 
+bool XObject::SpinForSignal(xe::threading::WaitHandle* wait_handle,
+                            bool alertable,
+                            xe::threading::WaitResult& result_out) {
+  // Spinning less if it was not useful recently, but not stopping completely,
+  // so it can become useful again.
+  constexpr uint32_t kMinWaitSpinCount = 8;
+  uint32_t max_spin_count = cvars::kernel_wait_spin_count;
+  if (!tracks_signal_hint_ || !max_spin_count) {
+    return false;
+  }
+  uint32_t spin_count = wait_spin_count_.load(std::memory_order_relaxed);
+  spin_count = spin_count ? std::min(spin_count, max_spin_count)
+                          : max_spin_count;
+  for (uint32_t i = 0; i < spin_count; ++i) {
+    if (signal_hint_.load(std::memory_order_acquire)) {
+      result_out = xe::threading::Wait(wait_handle, alertable,
+                                       std::chrono::milliseconds(0));
+      if (result_out != xe::threading::WaitResult::kTimeout) {
+        wait_spin_count_.store(std::min(spin_count * 2, max_spin_count),
+                               std::memory_order_relaxed);
+        return true;
+      }
+      // Taken by another thread. If it's signaled again in the meantime, the
+      // hint will be lost, but the host wait will still take the signal.
+      signal_hint_.store(false, std::memory_order_relaxed);
+    }
+#if XE_ARCH_AMD64
+    _mm_pause();
+#endif
+  }
+  wait_spin_count_.store(
+      std::max(spin_count / 2, std::min(kMinWaitSpinCount, max_spin_count)),
+      std::memory_order_relaxed);
+  return false;
+}
+
 X_STATUS XObject::SignalAndWait(XObject* signal_object, XObject* wait_object,
                                 uint32_t wait_reason, uint32_t processor_mode,
                                 uint32_t alertable, uint64_t* opt_timeout) {
@@ -235,6 +295,7 @@ X_STATUS XObject::SignalAndWait(XObject* signal_object, XObject* wait_object,
   auto result = xe::threading::SignalAndWait(
       signal_object->GetWaitHandle(), wait_object->GetWaitHandle(),
       alertable ? true : false, timeout_ms);
+  signal_object->SetSignalHint();
   switch (result) {
     case xe::threading::WaitResult::kSuccess:
       wait_object->WaitCallback();
@@ -212,6 +212,16 @@ class XObject {
   virtual void WaitCallback() {}
   virtual xe::threading::WaitHandle* GetWaitHandle() { return nullptr; }
 
+  // For the objects that track whether they may have been signaled, to poll
+  // them for a short time before blocking in the host wait, so the host thread
+  // doesn't go to sleep and wake up for waits that end quickly. Must be called
+  // every time the object is signaled. Only a hint, the signal is still taken
+  // through the host wait.
+  void SetSignalHint() {
+    signal_hint_.store(true, std::memory_order_release);
+  }
+  bool tracks_signal_hint_ = false;
+
   // Creates the kernel object for guest code to use. Typically not needed.
   uint8_t* CreateNative(uint32_t size);
   void SetNativePointer(uint32_t native_ptr, bool uninitialized = false);
@@ -235,8 +245,16 @@ class XObject {
   bool host_object_ = false;
 
  private:
+  bool SpinForSignal(xe::threading::WaitHandle* wait_handle, bool alertable,
+                     xe::threading::WaitResult& result_out);
+
   std::atomic<int32_t> pointer_ref_count_;
 
+  std::atomic<bool> signal_hint_ = {true};
+  // Adjusted depending on whether spinning helped in the previous waits, 0 if
+  // not initialized.
+  std::atomic<uint32_t> wait_spin_count_ = {0};
+
   Type type_;
   std::vector<X_HANDLE> handles_;
   std::string name_;  // May be zero length.
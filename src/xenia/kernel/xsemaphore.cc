@@ -16,7 +16,9 @@ namespace xe {
 namespace kernel {
 
 XSemaphore::XSemaphore(KernelState* kernel_state)
-    : XObject(kernel_state, kObjectType) {}
+    : XObject(kernel_state, kObjectType) {
+  tracks_signal_hint_ = true;
+}
 
 XSemaphore::~XSemaphore() = default;
 
@@ -43,6 +45,7 @@ bool XSemaphore::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
 int32_t XSemaphore::ReleaseSemaphore(int32_t release_count) {
   int32_t previous_count = 0;
   semaphore_->Release(release_count, &previous_count);
+  SetSignalHint();
   return previous_count;
 }
 
@@ -10,9 +10,11 @@
 #include "src/xenia/kernel/xsocket.h"
 
 #include <cstring>
+#include <utility>
 
 #include "xenia/base/platform.h"
 #include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/socket_multiplexer.h"
 #include "xenia/kernel/xam/xam_module.h"
 // #include "xenia/kernel/xnet.h"
 
@@ -33,6 +35,25 @@
 namespace xe {
 namespace kernel {
 
+namespace {
+
+// The operations performed on the multiplexer thread must not block it if
+// another operation or a guest thread has consumed what has made the socket
+// ready.
+#ifdef XE_PLATFORM_WIN32
+// Without a per-call flag, relying on the multiplexer performing only one
+// operation in each direction of a socket for its readiness.
+constexpr uint32_t kNonBlockingFlags = 0;
+bool IsWouldBlockError(uint32_t error) { return error == WSAEWOULDBLOCK; }
+#else
+constexpr uint32_t kNonBlockingFlags = MSG_DONTWAIT;
+bool IsWouldBlockError(uint32_t error) {
+  return error == EAGAIN || error == EWOULDBLOCK;
+}
+#endif
+
+}  // namespace
+
 XSocket::XSocket(KernelState* kernel_state)
     : XObject(kernel_state, kObjectType) {}
 
@@ -60,11 +81,24 @@ X_STATUS XSocket::Initialize(AddressFamily af, Type type, Protocol proto) {
 }
 
 X_STATUS XSocket::Close() {
+  if (native_handle_ == uint64_t(-1)) {
+    return X_STATUS_SUCCESS;
+  }
+
+  if (has_async_operations_) {
+    // Before the host handle may be reused for another socket.
+    SocketMultiplexer* multiplexer = kernel_state_->socket_multiplexer();
+    if (multiplexer) {
+      multiplexer->Cancel(native_handle_);
+    }
+  }
+
 #if XE_PLATFORM_WIN32
   int ret = closesocket(native_handle_);
 #elif XE_PLATFORM_LINUX
   int ret = close(native_handle_);
 #endif
+  native_handle_ = uint64_t(-1);
 
   if (ret != 0) {
     return X_STATUS_UNSUCCESSFUL;
@@ -251,6 +285,78 @@ int XSocket::SendTo(uint8_t* buf, uint32_t buf_len, uint32_t flags,
                 to ? (sockaddr*)&nto : nullptr, to_len);
 }
 
+bool XSocket::RecvFromAsync(uint32_t buf_len, uint32_t flags,
+                            RecvFromCompletion completion) {
+  SocketMultiplexer* multiplexer = kernel_state_->socket_multiplexer();
+  if (!multiplexer) {
+    return false;
+  }
+  has_async_operations_ = true;
+  multiplexer->Submit(
+      native_handle_, SocketMultiplexer::Direction::kReceive,
+      [socket = retain_object(this), buffer = std::vector<uint8_t>(buf_len),
+       flags, completion = std::move(completion)](bool canceled) mutable {
+        N_XSOCKADDR_IN from;
+        std::memset(&from, 0, sizeof(from));
+        if (canceled) {
+          completion(-1, uint32_t(X_WSAError::X_WSA_OPERATION_ABORTED),
+                     nullptr, from, 0);
+          return true;
+        }
+        uint32_t from_len = 0;
+        int ret = socket->RecvFrom(buffer.data(), uint32_t(buffer.size()),
+                                   flags | kNonBlockingFlags, &from, &from_len);
+        uint32_t error = 0;
+        if (ret == -1) {
+          error = socket->GetLastWSAError();
+          if (IsWouldBlockError(error)) {
+            return false;
+          }
+        }
+        completion(ret, error, buffer.data(), from, from_len);
+        return true;
+      });
+  return true;
+}
+
+bool XSocket::SendToAsync(std::vector<uint8_t>&& data, uint32_t flags,
+                          const N_XSOCKADDR_IN* to, uint32_t to_len,
+                          SendToCompletion completion) {
+  SocketMultiplexer* multiplexer = kernel_state_->socket_multiplexer();
+  if (!multiplexer) {
+    return false;
+  }
+  has_async_operations_ = true;
+  N_XSOCKADDR_IN to_copy;
+  std::memset(&to_copy, 0, sizeof(to_copy));
+  if (to) {
+    to_copy = *to;
+  }
+  multiplexer->Submit(
+      native_handle_, SocketMultiplexer::Direction::kSend,
+      [socket = retain_object(this), data = std::move(data), flags,
+       has_to = to != nullptr, to_copy, to_len,
+       completion = std::move(completion)](bool canceled) mutable {
+        if (canceled) {
+          completion(-1, uint32_t(X_WSAError::X_WSA_OPERATION_ABORTED));
+          return true;
+        }
+        int ret = socket->SendTo(data.data(), uint32_t(data.size()),
+                                 flags | kNonBlockingFlags,
+                                 has_to ? &to_copy : nullptr, to_len);
+        uint32_t error = 0;
+        if (ret == -1) {
+          error = socket->GetLastWSAError();
+          if (IsWouldBlockError(error)) {
+            return false;
+          }
+        }
+        completion(ret, error);
+        return true;
+      });
+  return true;
+}
+
 bool XSocket::QueuePacket(uint32_t src_ip, uint16_t src_port,
                           const uint8_t* buf, size_t len) {
   packet* pkt = reinterpret_cast<packet*>(new uint8_t[sizeof(packet) + len]);
@@ -10,8 +10,11 @@
 #ifndef XENIA_KERNEL_XSOCKET_H_
 #define XENIA_KERNEL_XSOCKET_H_
 
+#include <atomic>
 #include <cstring>
+#include <functional>
 #include <queue>
+#include <vector>
 
 #include "xenia/base/byte_order.h"
 #include "xenia/base/math.h"
@@ -21,6 +24,9 @@ namespace xe {
 namespace kernel {
 enum class X_WSAError : uint32_t {
   X_WSA_INVALID_PARAMETER = 0x0057,
+  X_WSA_OPERATION_ABORTED = 0x03E3,
+  X_WSA_IO_INCOMPLETE = 0x03E4,
+  X_WSA_IO_PENDING = 0x03E5,
   X_WSAEFAULT = 0x271E,
   X_WSAEINVAL = 0x2726,
   X_WSAENOTSOCK = 0x2736,
@@ -128,6 +134,22 @@ class XSocket : public XObject {
   int SendTo(uint8_t* buf, uint32_t buf_len, uint32_t flags, N_XSOCKADDR_IN* to,
              uint32_t to_len);
 
+  // Overlapped operations, performed on the socket multiplexer thread once the
+  // host socket is ready, invoking the completion there with the return value
+  // of the host function and the error if it's -1. If the socket is closed
+  // earlier, the completion is invoked on the closing thread with -1 and
+  // X_WSA_OPERATION_ABORTED. False if the multiplexer is not available.
+  using RecvFromCompletion =
+      std::function<void(int result, uint32_t error, const uint8_t* data,
+                         const N_XSOCKADDR_IN& from, uint32_t from_len)>;
+  bool RecvFromAsync(uint32_t buf_len, uint32_t flags,
+                     RecvFromCompletion completion);
+  using SendToCompletion = std::function<void(int result, uint32_t error)>;
+  // The data is moved only if the operation is submitted.
+  bool SendToAsync(std::vector<uint8_t>&& data, uint32_t flags,
+                   const N_XSOCKADDR_IN* to, uint32_t to_len,
+                   SendToCompletion completion);
+
   uint32_t GetLastWSAError() const;
 
   struct packet {
@@ -157,6 +179,9 @@ class XSocket : public XObject {
 
   bool broadcast_socket_ = false;
 
+  // Whether the operations may need to be canceled in the multiplexer.
+  std::atomic<bool> has_async_operations_ = {false};
+
   std::unique_ptr<xe::threading::Event> event_;
   std::mutex incoming_packet_mutex_;
   std::queue<uint8_t*> incoming_packets_;
@@ -9,7 +9,10 @@
 
 #include "xenia/kernel/xthread.h"
 
+#include <algorithm>
+#include <charconv>
 #include <cstring>
+#include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
@@ -19,6 +22,7 @@
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/utf8.h"
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/processor.h"
@@ -32,6 +36,22 @@ DEFINE_bool(ignore_thread_priorities, true,
             "Ignores game-specified thread priorities.", "Kernel");
 DEFINE_bool(ignore_thread_affinities, true,
             "Ignores game-specified thread affinities.", "Kernel");
+DEFINE_string(
+    guest_thread_host_cpus, "",
+    "Comma-separated host logical processor indices to pin the threads running "
+    "on each of the 6 guest hardware threads to, such as \"2,3,4,5,6,7\" for "
+    "guest hardware thread 0 on host processor 2 and so on (repeated if fewer "
+    "than 6 are specified). Overrides ignore_thread_affinities, for "
+    "reproducible timing when running multiple instances on the same machine. "
+    "Empty to let the host schedule the guest threads.",
+    "Kernel");
+DEFINE_string(
+    host_thread_host_cpus, "",
+    "Comma-separated host logical processor indices to run the emulator's "
+    "kernel-visible host threads, such as the GPU command processor, the XMA "
+    "decoder and the audio worker, on, preferably separate from the ones in "
+    "guest_thread_host_cpus. Empty to let the host schedule them.",
+    "Kernel");
 
 
 #if 0
@@ -53,6 +73,98 @@ using namespace xe::literals;
 
 uint32_t next_xthread_id_ = 0;
 
+namespace {
+
+// Parses a comma-separated list of the host logical processor indices,
+// dropping the ones the host doesn't have.
+std::vector<uint8_t> ParseHostCpuList(const std::string_view list,
+                                      const char* cvar_name) {
+  std::vector<uint8_t> host_cpus;
+  uint32_t host_cpu_count =
+      std::min(xe::threading::logical_processor_count(), uint32_t(64));
+  for (std::string_view entry : xe::utf8::split(list, ", ", true)) {
+    uint32_t host_cpu;
+    auto [entry_end, error] =
+        std::from_chars(entry.data(), entry.data() + entry.size(), host_cpu);
+    if (error != std::errc() || entry_end != entry.data() + entry.size() ||
+        host_cpu >= host_cpu_count) {
+      XELOGW("{}: '{}' is not a host logical processor index, ignoring",
+             cvar_name, entry);
+      continue;
+    }
+    host_cpus.push_back(uint8_t(host_cpu));
+  }
+  return host_cpus;
+}
+
+struct HostCpuAssignment {
+  // Nonzero if the guest hardware threads are pinned to host processors.
+  uint64_t guest_cpu_masks[6] = {};
+  // Nonzero if the host threads are restricted to host processors.
+  uint64_t host_thread_mask = 0;
+};
+
+const HostCpuAssignment& GetHostCpuAssignment() {
+  static const HostCpuAssignment assignment = []() {
+    HostCpuAssignment new_assignment;
+    std::vector<uint8_t> guest_host_cpus = ParseHostCpuList(
+        cvars::guest_thread_host_cpus, "guest_thread_host_cpus");
+    if (!guest_host_cpus.empty()) {
+      for (size_t i = 0; i < xe::countof(new_assignment.guest_cpu_masks);
+           ++i) {
+        new_assignment.guest_cpu_masks[i] =
+            uint64_t(1) << guest_host_cpus[i % guest_host_cpus.size()];
+      }
+    }
+    for (uint8_t host_cpu : ParseHostCpuList(cvars::host_thread_host_cpus,
+                                             "host_thread_host_cpus")) {
+      new_assignment.host_thread_mask |= uint64_t(1) << host_cpu;
+    }
+    // Keep the threads not assigned explicitly on the NUMA node of the guest
+    // memory.
+    uint32_t numa_node = Memory::GetHostNumaNode();
+    if (numa_node != xe::memory::kNumaNodeAny) {
+      uint64_t numa_node_mask =
+          xe::threading::GetNumaNodeProcessorMask(numa_node);
+      if (numa_node_mask) {
+        for (uint64_t& guest_cpu_mask : new_assignment.guest_cpu_masks) {
+          if (!guest_cpu_mask) {
+            guest_cpu_mask = numa_node_mask;
+          }
+        }
+        if (!new_assignment.host_thread_mask) {
+          new_assignment.host_thread_mask = numa_node_mask;
+        }
+      } else {
+        XELOGW("No processors found for host NUMA node {}", numa_node);
+      }
+    }
+    return new_assignment;
+  }();
+  return assignment;
+}
+
+// Maps the guest priority increment to the host thread priority, the same way
+// for the creation flags and for the later changes, so the relative priorities
+// of the guest threads are consistent on the host.
+int32_t GetHostThreadPriority(int32_t increment) {
+  if (increment > 0x22) {
+    return xe::threading::ThreadPriority::kHighest;
+  }
+  if (increment > 0x11) {
+    return xe::threading::ThreadPriority::kAboveNormal;
+  }
+  if (increment < -0x22) {
+    return xe::threading::ThreadPriority::kLowest;
+  }
+  if (increment < -0x11) {
+    return xe::threading::ThreadPriority::kBelowNormal;
+  }
+  return xe::threading::ThreadPriority::kNormal;
+}
+
+}  // namespace
+
 XThread::XThread(KernelState* kernel_state)
     : XObject(kernel_state, kObjectType), guest_thread_(true) {}
 
@@ -236,7 +348,18 @@ bool XThread::AllocateStack(uint32_t size) {
   size = xe::round_up(size, alignment);
   auto actual_size = size + padding;
 
-  uint32_t address = 0;
+  // A stack of a destroyed thread already has the guard pages.
+  uint32_t address = kernel_state()->TakeFreeThreadStack(actual_size);
+  if (address) {
+    stack_alloc_base_ = address;
+    stack_alloc_size_ = actual_size;
+    stack_limit_ = address + (padding / 2);
+    stack_base_ = stack_limit_ + size;
+    // Initialize the stack with junk, like a new one, skipping the guard pages.
+    memory()->Fill(stack_limit_, size, 0xBE);
+    return true;
+  }
+
   if (!heap->AllocRange(
           kStackAddressRangeBegin, kStackAddressRangeEnd, actual_size,
           alignment, kMemoryAllocationReserve | kMemoryAllocationCommit,
@@ -261,8 +384,11 @@ bool XThread::AllocateStack(uint32_t size) {
 
 void XThread::FreeStack() {
   if (stack_alloc_base_) {
-    auto heap = memory()->LookupHeap(kStackAddressRangeBegin);
-    heap->Release(stack_alloc_base_);
+    if (!kernel_state()->KeepFreeThreadStack(stack_alloc_base_,
+                                             stack_alloc_size_)) {
+      auto heap = memory()->LookupHeap(kStackAddressRangeBegin);
+      heap->Release(stack_alloc_base_);
+    }
 
     stack_alloc_base_ = 0;
     stack_alloc_size_ = 0;
@@ -430,8 +556,11 @@ X_STATUS XThread::Create() {
     set_name(fmt::format("XThread{:04X}", thread_->system_id()));
   }
 
-  if (creation_params_.creation_flags & 0x60) {
-    thread_->set_priority(creation_params_.creation_flags & 0x20 ? 1 : 0);
+  if ((creation_params_.creation_flags & 0x60) &&
+      !cvars::ignore_thread_priorities) {
+    thread_->set_priority(creation_params_.creation_flags & 0x20
+                              ? xe::threading::ThreadPriority::kAboveNormal
+                              : xe::threading::ThreadPriority::kNormal);
   }
 
   // Assign the newly created thread to the logical processor, and also set up
@@ -602,12 +731,16 @@ uint32_t XThread::RaiseIrql(uint32_t new_irql) {
 
 void XThread::LowerIrql(uint32_t new_irql) { irql_ = new_irql; }
 
-void XThread::CheckApcs() { DeliverAPCs(); }
+void XThread::CheckApcs() {
+  if (HasPendingApcs()) {
+    DeliverAPCs();
+  }
+}
 
 void XThread::LockApc() { global_critical_region_.mutex().lock(); }
 
 void XThread::UnlockApc(bool queue_delivery) {
-  bool needs_apc = apc_list_.HasPending();
+  bool needs_apc = HasPendingApcs();
   global_critical_region_.mutex().unlock();
   if (needs_apc && queue_delivery) {
     thread_->QueueUserCallback([this]() { DeliverAPCs(); });
@@ -632,75 +765,126 @@ void XThread::EnqueueApc(uint32_t normal_routine, uint32_t normal_context,
   apc->arg2 = arg2;
   apc->enqueued = 1;
 
-  uint32_t list_entry_ptr = apc_ptr + 8;
-  apc_list_.Insert(list_entry_ptr);
+  InsertApc(apc_ptr + 8);
 
   UnlockApc(true);
 }
 
+void XThread::InsertApc(uint32_t list_entry_ptr) {
+  apc_list_.Insert(list_entry_ptr);
+  pending_apc_count_.fetch_add(1, std::memory_order_release);
+}
+
+bool XThread::RemoveApc(uint32_t list_entry_ptr) {
+  if (!apc_list_.IsQueued(list_entry_ptr)) {
+    return false;
+  }
+  apc_list_.Remove(list_entry_ptr);
+  assert_not_zero(pending_apc_count_.load(std::memory_order_relaxed));
+  pending_apc_count_.fetch_sub(1, std::memory_order_release);
+  return true;
+}
+
+uint32_t XThread::ShiftApc() {
+  assert_not_zero(pending_apc_count_.load(std::memory_order_relaxed));
+  pending_apc_count_.fetch_sub(1, std::memory_order_release);
+  return apc_list_.Shift();
+}
+
 void XThread::DeliverAPCs() {
   // https://www.drdobbs.com/inside-nts-asynchronous-procedure-call/184416590?pgno=1
   // https://www.drdobbs.com/inside-nts-asynchronous-procedure-call/184416590?pgno=7
+  if (!HasPendingApcs()) {
+    return;
+  }
   auto processor = kernel_state()->processor();
-  LockApc();
   auto kthread = guest_object<X_KTHREAD>();
-  while (apc_list_.HasPending() && kthread->apc_disable_count == 0) {
-    // Get APC entry (offset for LIST_ENTRY offset) and cache what we need.
-    // Calling the routine may delete the memory/overwrite it.
-    uint32_t apc_ptr = apc_list_.Shift() - 8;
-    auto apc = reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
-    bool needs_freeing = apc->kernel_routine == XAPC::kDummyKernelRoutine;
-
-    XELOGD("Delivering APC to {:08X}", uint32_t(apc->normal_routine));
-
-    // Mark as uninserted so that it can be reinserted again by the routine.
-    apc->enqueued = 0;
-
-    // Call kernel routine.
-    // The routine can modify all of its arguments before passing it on.
-    // Since we need to give guest accessible pointers over, we copy things
-    // into and out of scratch.
-    uint8_t* scratch_ptr = memory()->TranslateVirtual(scratch_address_);
-    xe::store_and_swap<uint32_t>(scratch_ptr + 0, apc->normal_routine);
-    xe::store_and_swap<uint32_t>(scratch_ptr + 4, apc->normal_context);
-    xe::store_and_swap<uint32_t>(scratch_ptr + 8, apc->arg1);
-    xe::store_and_swap<uint32_t>(scratch_ptr + 12, apc->arg2);
-    if (apc->kernel_routine != XAPC::kDummyKernelRoutine) {
-      // kernel_routine(apc_address, &normal_routine, &normal_context,
-      // &system_arg1, &system_arg2)
-      uint64_t kernel_args[] = {
-          apc_ptr,
-          scratch_address_ + 0,
-          scratch_address_ + 4,
-          scratch_address_ + 8,
-          scratch_address_ + 12,
-      };
-      processor->Execute(thread_state_, apc->kernel_routine, kernel_args,
-                         xe::countof(kernel_args));
-    }
-    uint32_t normal_routine = xe::load_and_swap<uint32_t>(scratch_ptr + 0);
-    uint32_t normal_context = xe::load_and_swap<uint32_t>(scratch_ptr + 4);
-    uint32_t arg1 = xe::load_and_swap<uint32_t>(scratch_ptr + 8);
-    uint32_t arg2 = xe::load_and_swap<uint32_t>(scratch_ptr + 12);
-
-    // Call the normal routine. Note that it may have been killed by the kernel
-    // routine.
-    if (normal_routine) {
-      UnlockApc(false);
-      // normal_routine(normal_context, system_arg1, system_arg2)
-      uint64_t normal_args[] = {normal_context, arg1, arg2};
-      processor->Execute(thread_state_, normal_routine, normal_args,
-                         xe::countof(normal_args));
-      LockApc();
+  std::vector<uint32_t> apc_ptrs;
+  LockApc();
+  while (HasPendingApcs() && kthread->apc_disable_count == 0) {
+    // Take all the pending APCs in one pass, in the order they would be
+    // shifted, so the lock is not reacquired for each of them.
+    apc_ptrs.clear();
+    while (HasPendingApcs()) {
+      uint32_t apc_ptr = ShiftApc() - 8;
+      auto apc = reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
+      // Mark as uninserted so that it can be reinserted again by the routine.
+      apc->enqueued = 0;
+      apc_ptrs.push_back(apc_ptr);
     }
+    UnlockApc(false);
+
+    for (size_t i = 0; i < apc_ptrs.size(); ++i) {
+      if (kthread->apc_disable_count != 0) {
+        // A routine has entered a critical region - requeue the rest so
+        // they're shifted in the same order later.
+        LockApc();
+        for (size_t j = apc_ptrs.size(); j > i; --j) {
+          uint32_t apc_ptr = apc_ptrs[j - 1];
+          auto apc =
+              reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
+          apc->enqueued = 1;
+          InsertApc(apc_ptr + 8);
+        }
+        UnlockApc(false);
+        break;
+      }
 
-    XELOGD("Completed delivery of APC to {:08X} ({:08X}, {:08X}, {:08X})",
-           normal_routine, normal_context, arg1, arg2);
+      // Calling the routine may delete the memory/overwrite it.
+      uint32_t apc_ptr = apc_ptrs[i];
+      auto apc = reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
+      bool needs_freeing = apc->kernel_routine == XAPC::kDummyKernelRoutine;
+
+      XELOGD("Delivering APC to {:08X}", uint32_t(apc->normal_routine));
+
+      // Call kernel routine.
+      // The routine can modify all of its arguments before passing it on.
+      // Since we need to give guest accessible pointers over, we copy things
+      // into and out of scratch.
+      uint8_t* scratch_ptr = memory()->TranslateVirtual(scratch_address_);
+      xe::store_and_swap<uint32_t>(scratch_ptr + 0, apc->normal_routine);
+      xe::store_and_swap<uint32_t>(scratch_ptr + 4, apc->normal_context);
+      xe::store_and_swap<uint32_t>(scratch_ptr + 8, apc->arg1);
+      xe::store_and_swap<uint32_t>(scratch_ptr + 12, apc->arg2);
+      if (apc->kernel_routine != XAPC::kDummyKernelRoutine) {
+        // kernel_routine(apc_address, &normal_routine, &normal_context,
+        // &system_arg1, &system_arg2)
+        uint64_t kernel_args[] = {
+            apc_ptr,
+            scratch_address_ + 0,
+            scratch_address_ + 4,
+            scratch_address_ + 8,
+            scratch_address_ + 12,
+        };
+        // Kernel routines are called with the lock held.
+        LockApc();
+        processor->Execute(thread_state_, apc->kernel_routine, kernel_args,
+                           xe::countof(kernel_args));
+        UnlockApc(false);
+      }
+      uint32_t normal_routine = xe::load_and_swap<uint32_t>(scratch_ptr + 0);
+      uint32_t normal_context = xe::load_and_swap<uint32_t>(scratch_ptr + 4);
+      uint32_t arg1 = xe::load_and_swap<uint32_t>(scratch_ptr + 8);
+      uint32_t arg2 = xe::load_and_swap<uint32_t>(scratch_ptr + 12);
+
+      // Call the normal routine. Note that it may have been killed by the
+      // kernel routine.
+      if (normal_routine) {
+        // normal_routine(normal_context, system_arg1, system_arg2)
+        uint64_t normal_args[] = {normal_context, arg1, arg2};
+        processor->Execute(thread_state_, normal_routine, normal_args,
+                           xe::countof(normal_args));
+      }
 
-    // If special, free it.
-    if (needs_freeing) {
-      memory()->SystemHeapFree(apc_ptr);
+      XELOGD("Completed delivery of APC to {:08X} ({:08X}, {:08X}, {:08X})",
+             normal_routine, normal_context, arg1, arg2);
+
+      // If special, free it.
+      if (needs_freeing) {
+        memory()->SystemHeapFree(apc_ptr);
+      }
     }
+    LockApc();
   }
   UnlockApc(true);
 }
@@ -708,10 +892,10 @@ void XThread::DeliverAPCs() {
 void XThread::RundownAPCs() {
   assert_true(XThread::GetCurrentThread() == this);
   LockApc();
-  while (apc_list_.HasPending()) {
+  while (HasPendingApcs()) {
     // Get APC entry (offset for LIST_ENTRY offset) and cache what we need.
     // Calling the routine may delete the memory/overwrite it.
-    uint32_t apc_ptr = apc_list_.Shift() - 8;
+    uint32_t apc_ptr = ShiftApc() - 8;
     auto apc = reinterpret_cast<XAPC*>(memory()->TranslateVirtual(apc_ptr));
     bool needs_freeing = apc->kernel_routine == XAPC::kDummyKernelRoutine;
 
@@ -743,20 +927,8 @@ void XThread::SetPriority(int32_t increment) {
     guest_object<X_KTHREAD>()->priority = static_cast<uint8_t>(increment);
   }
   priority_ = increment;
-  int32_t target_priority = 0;
-  if (increment > 0x22) {
-    target_priority = xe::threading::ThreadPriority::kHighest;
-  } else if (increment > 0x11) {
-    target_priority = xe::threading::ThreadPriority::kAboveNormal;
-  } else if (increment < -0x22) {
-    target_priority = xe::threading::ThreadPriority::kLowest;
-  } else if (increment < -0x11) {
-    target_priority = xe::threading::ThreadPriority::kBelowNormal;
-  } else {
-    target_priority = xe::threading::ThreadPriority::kNormal;
-  }
   if (!cvars::ignore_thread_priorities) {
-    thread_->set_priority(target_priority);
+    thread_->set_priority(GetHostThreadPriority(increment));
   }
 }
 
@@ -783,7 +955,14 @@ void XThread::SetActiveCpu(uint8_t cpu_index) {
     thread_object.current_cpu = cpu_index;
   }
 
-  if (xe::threading::logical_processor_count() >= 6) {
+  const HostCpuAssignment& host_cpu_assignment = GetHostCpuAssignment();
+  if (!is_guest_thread()) {
+    if (host_cpu_assignment.host_thread_mask) {
+      thread_->set_affinity_mask(host_cpu_assignment.host_thread_mask);
+    }
+  } else if (host_cpu_assignment.guest_cpu_masks[cpu_index]) {
+    thread_->set_affinity_mask(host_cpu_assignment.guest_cpu_masks[cpu_index]);
+  } else if (xe::threading::logical_processor_count() >= 6) {
     if (!cvars::ignore_thread_affinities) {
       thread_->set_affinity_mask(uint64_t(1) << cpu_index);
     }
@@ -1012,6 +1191,7 @@ object_ref<XThread> XThread::Restore(KernelState* kernel_state,
   thread->stack_alloc_size_ = state.stack_alloc_size;
 
   thread->apc_list_.set_memory(kernel_state->memory());
+  thread->pending_apc_count_ = thread->apc_list_.CountPending();
 
   // Register now that we know our thread ID.
   kernel_state->RegisterThread(thread);
@@ -218,10 +218,17 @@ class XThread : public XObject, public cpu::Thread {
   uint32_t RaiseIrql(uint32_t new_irql);
   void LowerIrql(uint32_t new_irql);
 
+  // Only locks and delivers if any APCs are pending.
   void CheckApcs();
   void LockApc();
   void UnlockApc(bool queue_delivery);
-  util::NativeList* apc_list() { return &apc_list_; }
+  // Must be called with the APC lock held.
+  void InsertApc(uint32_t list_entry_ptr);
+  // Must be called with the APC lock held, returns whether it was queued.
+  bool RemoveApc(uint32_t list_entry_ptr);
+  bool HasPendingApcs() const {
+    return pending_apc_count_.load(std::memory_order_acquire) != 0;
+  }
   void EnqueueApc(uint32_t normal_routine, uint32_t normal_context,
                   uint32_t arg1, uint32_t arg2);
 
@@ -265,6 +272,8 @@ class XThread : public XObject, public cpu::Thread {
   void FreeStack();
   void InitializeGuestObject();
 
+  // Takes the next APC from the list, with the APC lock held.
+  uint32_t ShiftApc();
   void DeliverAPCs();
   void RundownAPCs();
 
@@ -294,6 +303,9 @@ class XThread : public XObject, public cpu::Thread {
   xe::global_critical_region global_critical_region_;
   std::atomic<uint32_t> irql_ = {0};
   util::NativeList apc_list_;
+  // Number of the APCs in apc_list_, modified with the APC lock held, so no
+  // pending APCs can be detected without locking and reading the guest list.
+  std::atomic<uint32_t> pending_apc_count_ = {0};
 };
 
 class XHostThread : public XThread {
@@ -12,6 +12,8 @@
 #include "xenia/base/chrono.h"
 #include "xenia/base/logging.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/timer_wheel.h"
 #include "xenia/kernel/xthread.h"
 
 namespace xe {
@@ -20,22 +22,22 @@ namespace kernel {
 XTimer::XTimer(KernelState* kernel_state)
     : XObject(kernel_state, kObjectType) {}
 
-XTimer::~XTimer() = default;
+XTimer::~XTimer() { Cancel(); }
 
 void XTimer::Initialize(uint32_t timer_type) {
-  assert_false(timer_);
+  assert_false(event_);
   switch (timer_type) {
     case 0:  // NotificationTimer
-      timer_ = xe::threading::Timer::CreateManualResetTimer();
+      event_ = xe::threading::Event::CreateManualResetEvent(false);
       break;
     case 1:  // SynchronizationTimer
-      timer_ = xe::threading::Timer::CreateSynchronizationTimer();
+      event_ = xe::threading::Event::CreateAutoResetEvent(false);
       break;
     default:
       assert_always();
       break;
   }
-  assert_not_null(timer_);
+  assert_not_null(event_);
 }
 
 X_STATUS XTimer::SetTimer(int64_t due_time, uint32_t period_ms,
@@ -59,41 +61,53 @@ X_STATUS XTimer::SetTimer(int64_t due_time, uint32_t period_ms,
         XSystemClock::from_file_time(due_time));
   }
 
-  // Stash routine for callback.
-  callback_thread_ = XThread::GetCurrentThread();
-  callback_routine_ = routine;
-  callback_routine_arg_ = routine_arg;
+  // The wheel runs on the steady clock, which doesn't jump with the system
+  // time.
+  auto steady_due_tp =
+      TimerWheel::clock::now() +
+      std::chrono::duration_cast<TimerWheel::clock::duration>(
+          due_tp - WinSystemClock::now());
 
-  // This callback will only be issued when the timer is fired.
-  std::function<void()> callback = nullptr;
-  if (callback_routine_) {
-    callback = [this]() {
-      // Queue APC to call back routine with (arg, low, high).
-      // It'll be executed on the thread that requested the timer.
-      uint64_t time = xe::Clock::QueryGuestSystemTime();
-      uint32_t time_low = static_cast<uint32_t>(time);
-      uint32_t time_high = static_cast<uint32_t>(time >> 32);
-      XELOGI(
-          "XTimer enqueuing timer callback to {:08X}({:08X}, {:08X}, {:08X})",
-          callback_routine_, callback_routine_arg_, time_low, time_high);
-      callback_thread_->EnqueueApc(callback_routine_, callback_routine_arg_,
-                                   time_low, time_high);
-    };
-  }
+  XThread* callback_thread = XThread::GetCurrentThread();
+  xe::threading::Event* event = event_.get();
+  // Invoked on the timer wheel thread, along with the other timers expiring at
+  // the same tick.
+  std::function<void()> callback = [event, callback_thread, routine,
+                                    routine_arg]() {
+    event->Set();
+    if (!routine) {
+      return;
+    }
+    // Queue APC to call back routine with (arg, low, high).
+    // It'll be executed on the thread that requested the timer.
+    uint64_t time = xe::Clock::QueryGuestSystemTime();
+    uint32_t time_low = static_cast<uint32_t>(time);
+    uint32_t time_high = static_cast<uint32_t>(time >> 32);
+    XELOGI("XTimer enqueuing timer callback to {:08X}({:08X}, {:08X}, {:08X})",
+           routine, routine_arg, time_low, time_high);
+    callback_thread->EnqueueApc(routine, routine_arg, time_low, time_high);
+  };
 
-  bool result;
-  if (!period_ms) {
-    result = timer_->SetOnceAt(due_tp, std::move(callback));
-  } else {
-    result = timer_->SetRepeatingAt(
-        due_tp, std::chrono::milliseconds(period_ms), std::move(callback));
+  TimerWheel* timer_wheel = kernel_state()->timer_wheel();
+  std::lock_guard<std::mutex> lock(wheel_timer_mutex_);
+  if (wheel_timer_id_) {
+    timer_wheel->Cancel(wheel_timer_id_);
   }
-
-  return result ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
+  // Setting the timer makes it non-signaled, like SetWaitableTimer.
+  event_->Reset();
+  wheel_timer_id_ = timer_wheel->Schedule(
+      steady_due_tp, std::chrono::milliseconds(period_ms), std::move(callback));
+  return X_STATUS_SUCCESS;
 }
 
 X_STATUS XTimer::Cancel() {
-  return timer_->Cancel() ? X_STATUS_SUCCESS : X_STATUS_UNSUCCESSFUL;
+  std::lock_guard<std::mutex> lock(wheel_timer_mutex_);
+  if (!wheel_timer_id_) {
+    return X_STATUS_SUCCESS;
+  }
+  kernel_state()->timer_wheel()->Cancel(wheel_timer_id_);
+  wheel_timer_id_ = 0;
+  return X_STATUS_SUCCESS;
 }
 
 }  // namespace kernel
@@ -10,6 +10,9 @@
 #ifndef XENIA_KERNEL_XTIMER_H_
 #define XENIA_KERNEL_XTIMER_H_
 
+#include <memory>
+#include <mutex>
+
 #include "xenia/base/threading.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/xbox.h"
@@ -33,14 +36,15 @@ class XTimer : public XObject {
   X_STATUS Cancel();
 
  protected:
-  xe::threading::WaitHandle* GetWaitHandle() override { return timer_.get(); }
+  xe::threading::WaitHandle* GetWaitHandle() override { return event_.get(); }
 
  private:
-  std::unique_ptr<xe::threading::Timer> timer_;
+  // Signaled by the kernel timer wheel when the timer expires.
+  std::unique_ptr<xe::threading::Event> event_;
 
-  XThread* callback_thread_ = nullptr;
-  uint32_t callback_routine_ = 0;
-  uint32_t callback_routine_arg_ = 0;
+  std::mutex wheel_timer_mutex_;
+  // 0 if not set.
+  uint64_t wheel_timer_id_ = 0;
 };
 
 }  // namespace kernel
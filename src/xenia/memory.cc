@@ -10,17 +10,25 @@
 #include "xenia/memory.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <functional>
+#include <memory>
 #include <utility>
+#include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/snappy/snappy.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/mmio_handler.h"
 
 // TODO(benvanik): move xbox.h out
@@ -32,6 +40,39 @@ DEFINE_bool(protect_on_release, false,
             "Protect released memory to prevent accesses.", "Memory");
 DEFINE_bool(scribble_heap, false,
             "Scribble 0xCD into all allocated heap memory.", "Memory");
+DEFINE_bool(physical_memory_write_tracking, false,
+            "Detect writes by the CPU to the memory used by the GPU with host "
+            "write tracking, collected in batches before draws, instead of "
+            "write protection and an access violation on every written page. "
+            "Requires Linux 6.7 or newer (asynchronous userfaultfd write "
+            "protection), otherwise access violations are used.",
+            "Memory");
+DEFINE_bool(memory_access_sampling, false,
+            "Periodically make random guest virtual memory pages inaccessible "
+            "to sample the accesses to them, and count write watch faults, "
+            "writing a report of the most accessed allocations and guest "
+            "functions and a heatmap of the pages. Slow, and may break host "
+            "file reads into the sampled memory, for diagnostics only.",
+            "Memory");
+DEFINE_string(memory_access_sampling_report, "memory_access_report.txt",
+              "File the memory_access_sampling report is written to.",
+              "Memory");
+DEFINE_bool(system_heap_pool, true,
+            "Allocate small system heap objects, such as kernel objects, from "
+            "shared pages rather than a page for each.",
+            "Memory");
+DEFINE_bool(guest_memory_huge_pages, false,
+            "Back the guest memory with large (2 MB) host pages where the host "
+            "supports that along with the per-page protection used for the "
+            "guest memory, to reduce TLB misses on guest memory accesses. "
+            "Currently only with transparent huge pages on Linux.",
+            "Memory");
+DEFINE_int32(numa_node, -1,
+             "Host NUMA node to allocate the guest memory and the generated "
+             "code from and to run the guest hardware threads and the host "
+             "emulator threads on, or -1 for no preference. Useful for "
+             "running an instance per node on multi-socket hosts.",
+             "Memory");
 
 namespace xe {
 uint32_t get_page_count(uint32_t value, uint32_t page_size) {
@@ -87,6 +128,8 @@ Memory::Memory() {
   system_page_size_ = uint32_t(xe::memory::page_size());
   system_allocation_granularity_ =
       uint32_t(xe::memory::allocation_granularity());
+  code_watch_bits_.resize(
+      (kCodeWatchAddressEnd / system_page_size_ + 63) / 64);
   assert_zero(active_memory_);
   active_memory_ = this;
 }
@@ -99,6 +142,9 @@ Memory::~Memory() {
   // requests.
   mmio_handler_.reset();
 
+  // Restore the access to the sampled pages before the heaps are disposed.
+  access_sampler_.reset();
+
   for (auto invalidation_callback : physical_memory_invalidation_callbacks_) {
     delete invalidation_callback;
   }
@@ -124,6 +170,11 @@ Memory::~Memory() {
   physical_membase_ = nullptr;
 }
 
+uint32_t Memory::GetHostNumaNode() {
+  return cvars::numa_node >= 0 ? uint32_t(cvars::numa_node)
+                               : xe::memory::kNumaNodeAny;
+}
+
 bool Memory::Initialize() {
   file_name_ = fmt::format("xenia_memory_{}", Clock::QueryHostTickCount());
 
@@ -132,7 +183,8 @@ bool Memory::Initialize() {
   mapping_ = xe::memory::CreateFileMappingHandle(
       file_name_,
       // entire 4gb space + 512mb physical:
-      0x11FFFFFFF, xe::memory::PageAccess::kReadWrite, false);
+      0x11FFFFFFF, xe::memory::PageAccess::kReadWrite, false,
+      GetHostNumaNode());
   if (mapping_ == xe::memory::kFileMappingHandleInvalid) {
     XELOGE("Unable to reserve the 4gb guest address space.");
     assert_always();
@@ -195,6 +247,19 @@ bool Memory::Initialize() {
       kMemoryAllocationReserve | kMemoryAllocationCommit,
       kMemoryProtectRead | kMemoryProtectWrite);
 
+  if (cvars::physical_memory_write_tracking) {
+    physical_memory_write_tracking_ = heaps_.vA0000000.EnableWriteTracking() &&
+                                      heaps_.vC0000000.EnableWriteTracking() &&
+                                      heaps_.vE0000000.EnableWriteTracking();
+    if (physical_memory_write_tracking_) {
+      XELOGI("Using host write tracking for the physical memory");
+    } else {
+      XELOGW(
+          "Host write tracking is not supported, using access violations for "
+          "detecting writes to the physical memory");
+    }
+  }
+
   // Add handlers for MMIO.
   mmio_handler_ = cpu::MMIOHandler::Install(
       virtual_membase_, physical_membase_, physical_membase_ + 0x1FFFFFFF,
@@ -211,6 +276,21 @@ bool Memory::Initialize() {
   heaps_.vA0000000.Alloc(0x340000, 64 * 1024, kMemoryAllocationReserve,
                          kMemoryProtectNoAccess, true, &unk_phys_alloc);
 
+  system_heap_pool_ =
+      std::make_unique<SystemHeapPool>(this, LookupHeapByType(false, 4096));
+
+  if (cvars::memory_access_sampling) {
+    // Only the virtual heaps, the physical ones have write watches.
+    access_sampler_ = std::make_unique<MemoryAccessSampler>(
+        this,
+        std::vector<BaseHeap*>{&heaps_.v00000000, &heaps_.v40000000,
+                               &heaps_.v80000000, &heaps_.v90000000},
+        cvars::memory_access_sampling_report);
+    if (!access_sampler_->Start()) {
+      access_sampler_.reset();
+    }
+  }
+
   return true;
 }
 
@@ -219,6 +299,13 @@ void Memory::SetMMIOExceptionRecordingCallback(
   mmio_handler_->SetMMIOExceptionRecordingCallback(callback, context);
 }
 
+void Memory::SetGuestFunctionLookupCallback(
+    MemoryAccessSampler::GuestFunctionLookupCallback callback, void* context) {
+  if (access_sampler_) {
+    access_sampler_->SetGuestFunctionLookupCallback(callback, context);
+  }
+}
+
 static const struct {
   uint64_t virtual_address_start;
   uint64_t virtual_address_end;
@@ -296,6 +383,19 @@ int Memory::MapViews(uint8_t* mapping_base) {
       return 1;
     }
   }
+  if (cvars::guest_memory_huge_pages) {
+    bool huge_pages_advised = true;
+    for (size_t n = 0; n < xe::countof(map_info); n++) {
+      huge_pages_advised &= xe::memory::AdviseHugePages(
+          views_.all_views[n], map_info[n].virtual_address_end -
+                                   map_info[n].virtual_address_start + 1);
+    }
+    if (huge_pages_advised) {
+      XELOGI("Requested huge pages for the guest memory");
+    } else {
+      XELOGW("Huge pages are not available for all of the guest memory");
+    }
+  }
   return 0;
 }
 
@@ -315,6 +415,7 @@ void Memory::Reset() {
   heaps_.v80000000.Reset();
   heaps_.v90000000.Reset();
   heaps_.physical.Reset();
+  system_heap_pool_->Reset();
 }
 // clang does not like non-standard layout offsetof
 #if XE_COMPILER_MSVC == 1 && XE_COMPILER_CLANG_CL == 0
@@ -467,24 +568,12 @@ uint32_t Memory::SearchAligned(uint32_t start, uint32_t end,
                                const uint32_t* values, size_t value_count) {
   assert_true(start <= end);
   auto p = TranslateVirtual<const uint32_t*>(start);
-  auto pe = TranslateVirtual<const uint32_t*>(end);
-  while (p != pe) {
-    if (*p == values[0]) {
-      const uint32_t* pc = p + 1;
-      size_t matched = 1;
-      for (size_t n = 1; n < value_count; n++, pc++) {
-        if (*pc != values[n]) {
-          break;
-        }
-        matched++;
-      }
-      if (matched == value_count) {
-        return HostToGuestVirtual(p);
-      }
-    }
-    p++;
+  size_t count = (end - start) / sizeof(uint32_t);
+  size_t index = xe::find_32(p, count, values, value_count);
+  if (index >= count) {
+    return 0;
   }
-  return 0;
+  return HostToGuestVirtual(p + index);
 }
 
 bool Memory::AddVirtualMappedRange(uint32_t virtual_address, uint32_t mask,
@@ -505,9 +594,38 @@ cpu::MMIORange* Memory::LookupVirtualMappedRange(uint32_t virtual_address) {
   return mmio_handler_->LookupRange(virtual_address);
 }
 
+void Memory::AddInlineReadRange(uint32_t virtual_address, uint32_t size,
+                                void* context,
+                                cpu::MMIOReadCallback read_callback,
+                                cpu::MMIORead64Callback read64_callback) {
+  auto range = std::make_unique<cpu::MMIORange>();
+  range->address = virtual_address;
+  range->mask = 0xFFFFFFFF;
+  range->size = size;
+  range->callback_context = context;
+  range->read = read_callback;
+  range->write = nullptr;
+  range->read64 = read64_callback;
+  std::lock_guard<std::mutex> lock(inline_read_ranges_mutex_);
+  inline_read_ranges_.push_back(std::move(range));
+}
+
+cpu::MMIORange* Memory::LookupInlineReadRange(uint32_t virtual_address,
+                                              uint32_t size) {
+  std::lock_guard<std::mutex> lock(inline_read_ranges_mutex_);
+  for (const std::unique_ptr<cpu::MMIORange>& range : inline_read_ranges_) {
+    if (virtual_address >= range->address &&
+        virtual_address - range->address < range->size &&
+        range->size - (virtual_address - range->address) >= size) {
+      return range.get();
+    }
+  }
+  return nullptr;
+}
+
 bool Memory::AccessViolationCallback(
-    global_unique_lock_type global_lock_locked_once, void* host_address,
-    bool is_write) {
+    global_unique_lock_type global_lock_deferred, void* host_address,
+    bool is_write, void* host_insn_address) {
   // Access via physical_membase_ is special, when need to bypass everything
   // (for instance, for a data provider to actually write the data) so only
   // triggering callbacks on virtual memory regions.
@@ -520,24 +638,66 @@ bool Memory::AccessViolationCallback(
   uint32_t virtual_address = HostToGuestVirtual(host_address);
   BaseHeap* heap = LookupHeap(virtual_address);
   if (heap->heap_type() != HeapType::kGuestPhysical) {
+    if (is_write && IsCodeWriteWatched(virtual_address)) {
+      global_lock_deferred.lock();
+      // If another thread has already cleared the watch, retrying is enough,
+      // and if the guest can't write to the page, it faults again, not
+      // watched anymore.
+      TriggerCodeWriteWatchesLocked(virtual_address, 1, true);
+      return true;
+    }
+    if (access_sampler_) {
+      global_lock_deferred.lock();
+      return access_sampler_->OnAccessViolation(heap, virtual_address, is_write,
+                                                host_insn_address);
+    }
     return false;
   }
 
+  auto physical_heap = static_cast<PhysicalHeap*>(heap);
+
+  // Multiple threads writing to the same watched page - only one needs to do
+  // the work, and the others only need to retry the write after it's done, not
+  // waiting for the lock to be able to find that out.
+  if (is_write &&
+      physical_heap->IsWriteWatchAlreadyTriggered(virtual_address)) {
+    return true;
+  }
+
   // Access violation callbacks from the guest are triggered when the global
   // critical region mutex is locked once.
-  //
+  global_lock_deferred.lock();
+
+  // Recheck if the pages are still protected (race condition - another thread
+  // clears the watch we just hit).
+  // Do this under the lock so we don't introduce another race condition.
+  memory::PageAccess cur_access;
+  size_t page_length = memory::page_size();
+  if (memory::QueryProtect(host_address, page_length, cur_access) &&
+      cur_access != memory::PageAccess::kNoAccess &&
+      (!is_write || cur_access != memory::PageAccess::kReadOnly)) {
+    // Another thread has cleared this watch. Abort.
+    XELOGD("Race condition on watch, was already cleared by another thread!");
+    return true;
+  }
+
+  if (access_sampler_) {
+    access_sampler_->OnWriteWatchFault(heap, virtual_address,
+                                       host_insn_address);
+  }
+
   // Will be rounded to physical page boundaries internally, so just pass 1 as
   // the length - guranteed not to cross page boundaries also.
-  auto physical_heap = static_cast<PhysicalHeap*>(heap);
-  return physical_heap->TriggerCallbacks(std::move(global_lock_locked_once),
+  return physical_heap->TriggerCallbacks(std::move(global_lock_deferred),
                                          virtual_address, 1, is_write, false);
 }
 
 bool Memory::AccessViolationCallbackThunk(
-    global_unique_lock_type global_lock_locked_once, void* context,
-    void* host_address, bool is_write) {
+    global_unique_lock_type global_lock_deferred, void* context,
+    void* host_address, bool is_write, void* host_insn_address) {
   return reinterpret_cast<Memory*>(context)->AccessViolationCallback(
-      std::move(global_lock_locked_once), host_address, is_write);
+      std::move(global_lock_deferred), host_address, is_write,
+      host_insn_address);
 }
 
 bool Memory::TriggerPhysicalMemoryCallbacks(
@@ -593,12 +753,38 @@ void Memory::EnablePhysicalMemoryAccessCallbacks(
                                          enable_data_providers);
 }
 
+void Memory::CollectPhysicalMemoryWrites() {
+  if (!physical_memory_write_tracking_) {
+    return;
+  }
+  PhysicalHeap* heaps[] = {&heaps_.vA0000000, &heaps_.vC0000000,
+                           &heaps_.vE0000000};
+  std::vector<std::pair<uint32_t, uint32_t>> written_ranges;
+  for (PhysicalHeap* heap : heaps) {
+    written_ranges.clear();
+    heap->CollectWrittenWatchedRanges(written_ranges);
+    for (const std::pair<uint32_t, uint32_t>& range : written_ranges) {
+      // The pages were not protected, so nothing to unprotect.
+      heap->TriggerCallbacks(global_critical_region_.Acquire(), range.first,
+                             range.second, true, true, false);
+    }
+  }
+}
+
 uint32_t Memory::SystemHeapAlloc(uint32_t size, uint32_t alignment,
                                  uint32_t system_heap_flags) {
-  // TODO(benvanik): lightweight pool.
   bool is_physical = !!(system_heap_flags & kSystemHeapPhysical);
-  auto heap = LookupHeapByType(is_physical, 4096);
+  // Physical allocations are left out of the pool because sharing pages would
+  // make their write watches trigger for unrelated objects.
   uint32_t address;
+  if (!is_physical && cvars::system_heap_pool) {
+    address = system_heap_pool_->Alloc(size, alignment);
+    if (address) {
+      Zero(address, size);
+      return address;
+    }
+  }
+  auto heap = LookupHeapByType(is_physical, 4096);
   if (!heap->AllocSystemHeap(
           size, alignment, kMemoryAllocationReserve | kMemoryAllocationCommit,
           kMemoryProtectRead | kMemoryProtectWrite, false, &address)) {
@@ -612,7 +798,9 @@ void Memory::SystemHeapFree(uint32_t address) {
   if (!address) {
     return;
   }
-  // TODO(benvanik): lightweight pool.
+  if (system_heap_pool_->Free(address)) {
+    return;
+  }
   auto heap = LookupHeap(address);
   heap->Release(address);
 }
@@ -647,24 +835,61 @@ void Memory::DumpMap() {
   XELOGE("");
 }
 
-bool Memory::Save(ByteStream* stream) {
+bool Memory::Save(ByteStream* stream, const std::filesystem::path& path,
+                  bool incremental) {
   XELOGD("Serializing memory...");
-  heaps_.v00000000.Save(stream);
-  heaps_.v40000000.Save(stream);
-  heaps_.v80000000.Save(stream);
-  heaps_.v90000000.Save(stream);
-  heaps_.physical.Save(stream);
+  std::error_code error_code;
+  std::filesystem::path absolute_path =
+      std::filesystem::absolute(path, error_code);
+  // Overwriting the base file would lose the data referenced by the save.
+  incremental = incremental && !save_state_base_path_.empty() &&
+                save_state_base_path_ != absolute_path &&
+                std::filesystem::exists(save_state_base_path_, error_code);
+  std::string base_path =
+      incremental ? xe::path_to_utf8(save_state_base_path_) : std::string();
+  stream->Write(std::string_view(base_path));
+  heaps_.v00000000.Save(stream, incremental);
+  heaps_.v40000000.Save(stream, incremental);
+  heaps_.v80000000.Save(stream, incremental);
+  heaps_.v90000000.Save(stream, incremental);
+  heaps_.physical.Save(stream, incremental);
+  system_heap_pool_->Save(stream);
+  if (!incremental) {
+    save_state_base_path_ = absolute_path;
+  }
 
   return true;
 }
 
-bool Memory::Restore(ByteStream* stream) {
+bool Memory::Restore(ByteStream* stream, const std::filesystem::path& path) {
   XELOGD("Restoring memory...");
-  heaps_.v00000000.Restore(stream);
-  heaps_.v40000000.Restore(stream);
-  heaps_.v80000000.Restore(stream);
-  heaps_.v90000000.Restore(stream);
-  heaps_.physical.Restore(stream);
+  std::filesystem::path base_path = xe::to_path(stream->Read<std::string>());
+  std::unique_ptr<MappedMemory> base_map;
+  if (!base_path.empty()) {
+    base_map = MappedMemory::Open(base_path, MappedMemory::Mode::kRead);
+    if (!base_map) {
+      XELOGE("Failed to open the base file {} of the incremental save",
+             xe::path_to_utf8(base_path));
+      return false;
+    }
+  }
+  const uint8_t* base_data = base_map ? base_map->data() : nullptr;
+  size_t base_data_size = base_map ? base_map->size() : 0;
+  if (!heaps_.v00000000.Restore(stream, base_data, base_data_size) ||
+      !heaps_.v40000000.Restore(stream, base_data, base_data_size) ||
+      !heaps_.v80000000.Restore(stream, base_data, base_data_size) ||
+      !heaps_.v90000000.Restore(stream, base_data, base_data_size) ||
+      !heaps_.physical.Restore(stream, base_data, base_data_size) ||
+      !system_heap_pool_->Restore(stream)) {
+    save_state_base_path_.clear();
+    return false;
+  }
+  if (base_path.empty()) {
+    std::error_code error_code;
+    save_state_base_path_ = std::filesystem::absolute(path, error_code);
+  } else {
+    save_state_base_path_ = base_path;
+  }
 
   return true;
 }
@@ -701,6 +926,107 @@ uint32_t FromPageAccess(xe::memory::PageAccess protect) {
   return kMemoryProtectNoAccess;
 }
 
+void Memory::SetCodeWriteCallback(CodeWriteCallback callback, void* context) {
+  auto global_lock = global_critical_region_.Acquire();
+  code_write_callback_ = callback;
+  code_write_callback_context_ = context;
+}
+
+void Memory::WatchCodeRange(uint32_t address, uint32_t length) {
+  if (!length || address >= kCodeWatchAddressEnd) {
+    return;
+  }
+  length = std::min(length, kCodeWatchAddressEnd - address);
+  uint32_t page_first = address / system_page_size_;
+  uint32_t page_last = (address + length - 1) / system_page_size_;
+  auto global_lock = global_critical_region_.Acquire();
+  for (uint32_t page = page_first; page <= page_last; ++page) {
+    uint64_t& bits = code_watch_bits_[page >> 6];
+    uint64_t bit = uint64_t(1) << (page & 63);
+    if (bits & bit) {
+      continue;
+    }
+    uint32_t page_address = page * system_page_size_;
+    BaseHeap* heap = LookupHeap(page_address);
+    uint32_t protect;
+    if (!heap || heap->heap_type() == HeapType::kGuestPhysical ||
+        !heap->QueryProtect(page_address, &protect) ||
+        !(protect & kMemoryProtectRead)) {
+      continue;
+    }
+    if ((protect & kMemoryProtectWrite) &&
+        !xe::memory::Protect(TranslateVirtual(page_address), system_page_size_,
+                             xe::memory::PageAccess::kReadOnly, nullptr)) {
+      continue;
+    }
+    bits |= bit;
+  }
+}
+
+void Memory::TriggerCodeWriteWatches(uint32_t address, uint32_t length) {
+  if (!length || address >= kCodeWatchAddressEnd) {
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  TriggerCodeWriteWatchesLocked(
+      address, std::min(length, kCodeWatchAddressEnd - address), true);
+}
+
+void Memory::TriggerCodeWriteWatchesLocked(uint32_t address, uint32_t length,
+                                           bool unprotect) {
+  uint32_t page_first = address / system_page_size_;
+  uint32_t page_last = (address + length - 1) / system_page_size_;
+  // Contiguous runs of the triggered pages for the callback.
+  uint32_t run_first = UINT32_MAX;
+  for (uint32_t page = page_first; page <= page_last + 1; ++page) {
+    bool watched = false;
+    if (page <= page_last) {
+      uint64_t& bits = code_watch_bits_[page >> 6];
+      uint64_t bit = uint64_t(1) << (page & 63);
+      if (bits & bit) {
+        watched = true;
+        bits &= ~bit;
+        uint32_t page_address = page * system_page_size_;
+        uint32_t protect;
+        if (unprotect &&
+            LookupHeap(page_address)->QueryProtect(page_address, &protect) &&
+            (protect & kMemoryProtectWrite)) {
+          xe::memory::Protect(TranslateVirtual(page_address), system_page_size_,
+                              ToPageAccess(protect), nullptr);
+        }
+      }
+    }
+    if (watched) {
+      if (run_first == UINT32_MAX) {
+        run_first = page;
+      }
+    } else if (run_first != UINT32_MAX) {
+      if (code_write_callback_) {
+        code_write_callback_(code_write_callback_context_,
+                             run_first * system_page_size_,
+                             (page - run_first) * system_page_size_);
+      }
+      run_first = UINT32_MAX;
+    }
+  }
+}
+
+void Memory::ReprotectCodeWatches(uint32_t address, uint32_t length) {
+  if (!length || address >= kCodeWatchAddressEnd) {
+    return;
+  }
+  length = std::min(length, kCodeWatchAddressEnd - address);
+  uint32_t page_first = address / system_page_size_;
+  uint32_t page_last = (address + length - 1) / system_page_size_;
+  for (uint32_t page = page_first; page <= page_last; ++page) {
+    if (code_watch_bits_[page >> 6] & (uint64_t(1) << (page & 63))) {
+      xe::memory::Protect(TranslateVirtual(page * system_page_size_),
+                          system_page_size_, xe::memory::PageAccess::kReadOnly,
+                          nullptr);
+    }
+  }
+}
+
 BaseHeap::BaseHeap()
     : membase_(nullptr), heap_base_(0), heap_size_(0), page_size_(0) {}
 
@@ -720,6 +1046,78 @@ void BaseHeap::Initialize(Memory* memory, uint8_t* membase, HeapType heap_type,
   host_address_offset_ = host_address_offset;
   page_table_.resize(heap_size / page_size);
   unreserved_page_count_ = uint32_t(page_table_.size());
+  RebuildFreePageRuns();
+}
+
+void BaseHeap::RebuildFreePageRuns() {
+  free_page_runs_.clear();
+  uint32_t page_count = uint32_t(page_table_.size());
+  uint32_t page_number = 0;
+  while (page_number < page_count) {
+    if (page_table_[page_number].state) {
+      ++page_number;
+      continue;
+    }
+    uint32_t run_start = page_number;
+    while (page_number < page_count && !page_table_[page_number].state) {
+      ++page_number;
+    }
+    free_page_runs_.emplace_hint(free_page_runs_.end(), run_start,
+                                 page_number - run_start);
+  }
+}
+
+void BaseHeap::AddFreePages(uint32_t start_page_number, uint32_t page_count) {
+  if (!page_count) {
+    return;
+  }
+  uint32_t end_page_number = start_page_number + page_count;
+  auto next_it = free_page_runs_.lower_bound(start_page_number);
+  // Merge with the adjacent runs.
+  if (next_it != free_page_runs_.begin()) {
+    auto previous_it = std::prev(next_it);
+    assert_true(previous_it->first + previous_it->second <= start_page_number);
+    if (previous_it->first + previous_it->second == start_page_number) {
+      start_page_number = previous_it->first;
+      free_page_runs_.erase(previous_it);
+    }
+  }
+  if (next_it != free_page_runs_.end()) {
+    assert_true(next_it->first >= end_page_number);
+    if (next_it->first == end_page_number) {
+      end_page_number += next_it->second;
+      next_it = free_page_runs_.erase(next_it);
+    }
+  }
+  free_page_runs_.emplace_hint(next_it, start_page_number,
+                               end_page_number - start_page_number);
+}
+
+void BaseHeap::RemoveFreePages(uint32_t start_page_number,
+                               uint32_t page_count) {
+  uint32_t end_page_number = start_page_number + page_count;
+  // The range may span multiple free runs and pages that are already used.
+  auto it = free_page_runs_.upper_bound(start_page_number);
+  if (it != free_page_runs_.begin()) {
+    auto previous_it = std::prev(it);
+    if (previous_it->first + previous_it->second > start_page_number) {
+      it = previous_it;
+    }
+  }
+  while (it != free_page_runs_.end() && it->first < end_page_number) {
+    uint32_t run_start = it->first;
+    uint32_t run_end = run_start + it->second;
+    it = free_page_runs_.erase(it);
+    if (run_start < start_page_number) {
+      free_page_runs_.emplace_hint(it, run_start,
+                                   start_page_number - run_start);
+    }
+    if (run_end > end_page_number) {
+      free_page_runs_.emplace_hint(it, end_page_number,
+                                   run_end - end_page_number);
+      break;
+    }
+  }
 }
 
 void BaseHeap::Dispose() {
@@ -786,74 +1184,271 @@ void BaseHeap::DumpMap() {
   }
 }
 
-bool BaseHeap::Save(ByteStream* stream) {
-  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
-
-  for (size_t i = 0; i < page_table_.size(); i++) {
-    auto& page = page_table_[i];
-    stream->Write(page.qword);
-    if (!page.state) {
-      // Unallocated.
-      continue;
+namespace {
+// Runs the function for every index on multiple threads.
+void ParallelForEach(uint32_t count,
+                     const std::function<void(uint32_t index)>& function) {
+  uint32_t thread_count =
+      std::min(xe::threading::logical_processor_count(), count);
+  if (thread_count <= 1) {
+    for (uint32_t i = 0; i < count; ++i) {
+      function(i);
     }
+    return;
+  }
+  std::atomic<uint32_t> next_index{0};
+  auto thread_main = [&]() {
+    for (uint32_t i = next_index++; i < count; i = next_index++) {
+      function(i);
+    }
+  };
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  xe::threading::Thread::CreationParameters params;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    auto thread = xe::threading::Thread::Create(params, thread_main);
+    if (!thread) {
+      break;
+    }
+    thread->set_name("Save State Worker");
+    threads.push_back(std::move(thread));
+  }
+  thread_main();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+}
+}  // namespace
 
-    // TODO(DrChat): write compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
-
-      memory::PageAccess old_access;
-      memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
-                      &old_access);
+bool BaseHeap::Save(ByteStream* stream, bool incremental) {
+  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
-      stream->Write(addr, page_size_);
+  // Layout:
+  // - PageEntry page_table[page_count].
+  // - uint32_t chunk_count.
+  // - SaveStateChunk chunks[chunk_count].
+  // - uint64_t data_size, followed by the data of the chunks stored here.
+  uint32_t page_count = uint32_t(page_table_.size());
+  stream->Write(page_table_.data(), sizeof(PageEntry) * page_count);
+
+  uint32_t chunk_page_count = save_state_chunk_page_count();
+  uint32_t chunk_count = (page_count + chunk_page_count - 1) / chunk_page_count;
+  if (base_save_state_chunks_.size() != chunk_count) {
+    incremental = false;
+  }
+  // Compressing on multiple threads, the emulator is paused, so the pages don't
+  // change.
+  std::vector<SaveStateChunk> chunks(chunk_count);
+  std::vector<std::vector<char>> chunk_data(chunk_count);
+  ParallelForEach(chunk_count, [&](uint32_t chunk_index) {
+    uint32_t first_page = chunk_index * chunk_page_count;
+    uint32_t end_page = std::min(first_page + chunk_page_count, page_count);
+    std::vector<uint8_t> uncompressed;
+    uncompressed.reserve(size_t(end_page - first_page) << page_size_shift_);
+    for (uint32_t i = first_page; i < end_page; ++i) {
+      const PageEntry& page = page_table_[i];
+      if (!(page.state & kMemoryAllocationCommit)) {
+        continue;
+      }
+      auto addr = reinterpret_cast<const uint8_t*>(
+          TranslateRelative(i << page_size_shift_));
+      // Inaccessible pages need to be made readable temporarily.
+      xe::memory::PageAccess page_access = ToPageAccess(page.current_protect);
+      if (page_access == xe::memory::PageAccess::kNoAccess) {
+        xe::memory::Protect(const_cast<uint8_t*>(addr), page_size_,
+                            xe::memory::PageAccess::kReadOnly, nullptr);
+      }
+      uncompressed.insert(uncompressed.end(), addr, addr + page_size_);
+      if (page_access == xe::memory::PageAccess::kNoAccess) {
+        xe::memory::Protect(const_cast<uint8_t*>(addr), page_size_,
+                            page_access, nullptr);
+      }
+    }
+    SaveStateChunk& chunk = chunks[chunk_index];
+    chunk.hash = XXH3_64bits(uncompressed.data(), uncompressed.size());
+    if (incremental) {
+      const SaveStateChunk& base_chunk = base_save_state_chunks_[chunk_index];
+      if ((base_chunk.flags & SaveStateChunk::kFlagInBase) &&
+          base_chunk.hash == chunk.hash) {
+        chunk.data_offset = base_chunk.data_offset;
+        chunk.data_size = base_chunk.data_size;
+        chunk.flags = SaveStateChunk::kFlagInBase;
+        return;
+      }
+    }
+    std::vector<char>& compressed = chunk_data[chunk_index];
+    compressed.resize(snappy::MaxCompressedLength(uncompressed.size()));
+    size_t compressed_size;
+    snappy::RawCompress(reinterpret_cast<const char*>(uncompressed.data()),
+                        uncompressed.size(), compressed.data(),
+                        &compressed_size);
+    compressed.resize(compressed_size);
+    chunk.data_size = uint32_t(compressed_size);
+    chunk.flags = 0;
+  });
+
+  stream->Write(chunk_count);
+  size_t data_offset = stream->offset() +
+                       sizeof(SaveStateChunk) * chunk_count + sizeof(uint64_t);
+  uint64_t data_size = 0;
+  for (SaveStateChunk& chunk : chunks) {
+    if (!(chunk.flags & SaveStateChunk::kFlagInBase)) {
+      chunk.data_offset = data_offset + data_size;
+      data_size += chunk.data_size;
+    }
+  }
+  stream->Write(chunks.data(), sizeof(SaveStateChunk) * chunk_count);
+  stream->Write(data_size);
+  for (const std::vector<char>& compressed : chunk_data) {
+    stream->Write(compressed.data(), compressed.size());
+  }
 
-      memory::Protect(addr, page_size_, old_access, nullptr);
+  if (!incremental) {
+    // All the chunks are in this file now.
+    for (SaveStateChunk& chunk : chunks) {
+      chunk.flags = SaveStateChunk::kFlagInBase;
     }
+    base_save_state_chunks_ = std::move(chunks);
   }
 
   return true;
 }
 
-bool BaseHeap::Restore(ByteStream* stream) {
+bool BaseHeap::Restore(ByteStream* stream, const uint8_t* base_data,
+                       size_t base_data_size) {
   XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
-  for (size_t i = 0; i < page_table_.size(); i++) {
-    auto& page = page_table_[i];
-    page.qword = stream->Read<uint64_t>();
-    if (!page.state) {
-      // Unallocated.
+  uint32_t page_count = uint32_t(page_table_.size());
+  stream->Read(page_table_.data(), sizeof(PageEntry) * page_count);
+
+  uint32_t chunk_page_count = save_state_chunk_page_count();
+  uint32_t chunk_count = (page_count + chunk_page_count - 1) / chunk_page_count;
+  if (stream->Read<uint32_t>() != chunk_count) {
+    XELOGE("Invalid save state chunk count for the heap");
+    return false;
+  }
+  std::vector<SaveStateChunk> chunks(chunk_count);
+  stream->Read(chunks.data(), sizeof(SaveStateChunk) * chunk_count);
+  uint64_t data_size = stream->Read<uint64_t>();
+  const uint8_t* data = stream->data();
+  size_t data_end = stream->offset() + size_t(data_size);
+  if (data_end > stream->data_length()) {
+    XELOGE("Save state heap data is out of bounds");
+    return false;
+  }
+  stream->Advance(size_t(data_size));
+
+  // Commit the memory if it isn't already, writable for restoring the contents.
+  // We do not need to reserve any memory, as the mapping has already taken
+  // care of that.
+  unreserved_page_count_ = 0;
+  for (uint32_t i = 0; i < page_count;) {
+    if (!page_table_[i].state) {
+      ++unreserved_page_count_;
+    }
+    if (!(page_table_[i].state & kMemoryAllocationCommit)) {
+      ++i;
       continue;
     }
-
-    memory::PageAccess page_access = memory::PageAccess::kNoAccess;
-    if ((page.current_protect & kMemoryProtectRead) &&
-        (page.current_protect & kMemoryProtectWrite)) {
-      page_access = memory::PageAccess::kReadWrite;
-    } else if (page.current_protect & kMemoryProtectRead) {
-      page_access = memory::PageAccess::kReadOnly;
+    uint32_t run_end = i + 1;
+    while (run_end < page_count &&
+           (page_table_[run_end].state & kMemoryAllocationCommit)) {
+      ++run_end;
     }
-
-    // Commit the memory if it isn't already. We do not need to reserve any
-    // memory, as the mapping has already taken care of that.
-    if (page.state & kMemoryAllocationCommit) {
-      xe::memory::AllocFixed(TranslateRelative(i * page_size_), page_size_,
-                             memory::AllocationType::kCommit,
-                             memory::PageAccess::kReadWrite);
+    xe::memory::AllocFixed(TranslateRelative(i << page_size_shift_),
+                           size_t(run_end - i) << page_size_shift_,
+                           xe::memory::AllocationType::kCommit,
+                           xe::memory::PageAccess::kReadWrite);
+    xe::memory::Protect(TranslateRelative(i << page_size_shift_),
+                        size_t(run_end - i) << page_size_shift_,
+                        xe::memory::PageAccess::kReadWrite, nullptr);
+    i = run_end;
+  }
+
+  std::atomic<bool> chunks_valid{true};
+  ParallelForEach(chunk_count, [&](uint32_t chunk_index) {
+    const SaveStateChunk& chunk = chunks[chunk_index];
+    uint32_t first_page = chunk_index * chunk_page_count;
+    uint32_t end_page = std::min(first_page + chunk_page_count, page_count);
+    size_t uncompressed_size = 0;
+    for (uint32_t i = first_page; i < end_page; ++i) {
+      if (page_table_[i].state & kMemoryAllocationCommit) {
+        uncompressed_size += page_size_;
+      }
     }
+    const uint8_t* source_data = data;
+    size_t source_data_size = stream->data_length();
+    if (chunk.flags & SaveStateChunk::kFlagInBase) {
+      source_data = base_data;
+      source_data_size = base_data_size;
+    }
+    size_t chunk_uncompressed_size;
+    auto compressed =
+        reinterpret_cast<const char*>(source_data + chunk.data_offset);
+    if (!source_data || chunk.data_offset > source_data_size ||
+        chunk.data_size > source_data_size - chunk.data_offset ||
+        !snappy::GetUncompressedLength(compressed, chunk.data_size,
+                                       &chunk_uncompressed_size) ||
+        chunk_uncompressed_size != uncompressed_size) {
+      chunks_valid = false;
+      return;
+    }
+    if (!uncompressed_size) {
+      return;
+    }
+    std::vector<char> uncompressed(uncompressed_size);
+    if (!snappy::RawUncompress(compressed, chunk.data_size,
+                               uncompressed.data())) {
+      chunks_valid = false;
+      return;
+    }
+    const char* page_data = uncompressed.data();
+    for (uint32_t i = first_page; i < end_page; ++i) {
+      if (page_table_[i].state & kMemoryAllocationCommit) {
+        std::memcpy(TranslateRelative(i << page_size_shift_), page_data,
+                    page_size_);
+        page_data += page_size_;
+      }
+    }
+  });
+  if (!chunks_valid) {
+    XELOGE("Save state heap data is damaged");
+    base_save_state_chunks_.clear();
+    return false;
+  }
 
-    // Now read into memory. We'll set R/W protection first, then set the
-    // protection back to its previous state.
-    // TODO(DrChat): read compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
-      xe::memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
+  // Set the protection back to its previous state.
+  for (uint32_t i = 0; i < page_count;) {
+    if (!(page_table_[i].state & kMemoryAllocationCommit)) {
+      ++i;
+      continue;
+    }
+    xe::memory::PageAccess page_access =
+        ToPageAccess(page_table_[i].current_protect);
+    uint32_t run_end = i + 1;
+    while (run_end < page_count &&
+           (page_table_[run_end].state & kMemoryAllocationCommit) &&
+           ToPageAccess(page_table_[run_end].current_protect) == page_access) {
+      ++run_end;
+    }
+    if (page_access != xe::memory::PageAccess::kReadWrite) {
+      xe::memory::Protect(TranslateRelative(i << page_size_shift_),
+                          size_t(run_end - i) << page_size_shift_, page_access,
                           nullptr);
+    }
+    i = run_end;
+  }
+  RebuildFreePageRuns();
 
-      stream->Read(addr, page_size_);
-
-      xe::memory::Protect(addr, page_size_, page_access, nullptr);
+  // For a full save, everything is in this file, for an incremental one, only
+  // the chunks still in the base file can be referenced by later saves.
+  for (SaveStateChunk& chunk : chunks) {
+    if (!base_data) {
+      chunk.flags = SaveStateChunk::kFlagInBase;
+    } else if (!(chunk.flags & SaveStateChunk::kFlagInBase)) {
+      chunk.hash = 0;
     }
   }
+  base_save_state_chunks_ = std::move(chunks);
 
   return true;
 }
@@ -861,6 +1456,7 @@ bool BaseHeap::Restore(ByteStream* stream) {
 void BaseHeap::Reset() {
   // TODO(DrChat): protect pages.
   std::memset(page_table_.data(), 0, sizeof(PageEntry) * page_table_.size());
+  RebuildFreePageRuns();
   // TODO(Triang3l): Remove access callbacks from pages if this is a physical
   // memory heap.
 }
@@ -960,6 +1556,7 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
     }
     page_entry.state = kMemoryAllocationReserve | allocation_type;
   }
+  RemoveFreePages(start_page_number, page_count);
 
   return true;
 }
@@ -998,9 +1595,10 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   auto global_lock = global_critical_region_.Acquire();
 
   // Find a free page range.
-  // The base page must match the requested alignment, so we first scan for
-  // a free aligned page and only then check for continuous free pages.
-  // TODO(benvanik): optimized searching (free list buckets, bitmap, etc).
+  // The base page must match the requested alignment - taking the lowest or,
+  // for top-down allocation, the highest aligned base page from which
+  // page_count pages are free within the range, looking at the free runs
+  // overlapping the range, closest to where the search starts first.
   uint32_t start_page_number = UINT_MAX;
   uint32_t end_page_number = UINT_MAX;
   // chrispy:todo, page_scan_stride is probably always a power of two...
@@ -1008,77 +1606,48 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   high_page_number =
       high_page_number - QuickMod(high_page_number, page_scan_stride);
   if (top_down) {
-    for (int64_t base_page_number =
-             high_page_number - xe::round_up(page_count, page_scan_stride);
-         base_page_number >= low_page_number;
-         base_page_number -= page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
+    // The pages up to high_page_number, exclusive.
+    auto it = free_page_runs_.lower_bound(high_page_number);
+    while (it != free_page_runs_.begin()) {
+      --it;
+      uint32_t run_end = std::min(it->first + it->second, high_page_number);
+      if (run_end < page_count) {
+        break;
       }
-      // Check requested range to ensure free.
-      start_page_number = uint32_t(base_page_number);
-      end_page_number = uint32_t(base_page_number) + page_count - 1;
-      assert_true(end_page_number < page_table_.size());
-      bool any_taken = false;
-      for (uint32_t page_number = uint32_t(base_page_number);
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least before this page.
-          any_taken = true;
-          if (page_count > page_number) {
-            // Not enough space left to fit entire page range. Breaks outer
-            // loop.
-            base_page_number = -1;
-          } else {
-            base_page_number = page_number - page_count;
-            base_page_number -= QuickMod(base_page_number, page_scan_stride);
-            base_page_number += page_scan_stride;  // cancel out loop logic
-          }
-          break;
-        }
+      uint32_t base_page_number = run_end - page_count;
+      base_page_number -= QuickMod(base_page_number, page_scan_stride);
+      if (base_page_number < low_page_number) {
+        break;
       }
-      if (!any_taken) {
-        // Found our place.
+      if (base_page_number >= it->first) {
+        start_page_number = base_page_number;
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
     }
   } else {
-    for (uint32_t base_page_number = low_page_number;
-         base_page_number <= high_page_number - page_count;
-         base_page_number += page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
+    auto it = free_page_runs_.upper_bound(low_page_number);
+    if (it != free_page_runs_.begin()) {
+      auto previous_it = std::prev(it);
+      if (previous_it->first + previous_it->second > low_page_number) {
+        it = previous_it;
       }
-      // Check requested range to ensure free.
-      start_page_number = base_page_number;
-      end_page_number = base_page_number + page_count - 1;
-      bool any_taken = false;
-      for (uint32_t page_number = base_page_number;
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least after this page.
-          any_taken = true;
-          base_page_number = xe::round_up(page_number + 1, page_scan_stride);
-          base_page_number -= page_scan_stride;  // cancel out loop logic
-          break;
-        }
+    }
+    for (; it != free_page_runs_.end(); ++it) {
+      uint32_t base_page_number = std::max(it->first, low_page_number);
+      base_page_number =
+          xe::round_up(base_page_number, page_scan_stride, false);
+      if (base_page_number > high_page_number - page_count) {
+        break;
       }
-      if (!any_taken) {
-        // Found our place.
+      if (base_page_number + page_count <= it->first + it->second) {
+        start_page_number = base_page_number;
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
     }
   }
+  if (start_page_number != UINT_MAX) {
+    end_page_number = start_page_number + page_count - 1;
+  }
   if (start_page_number == UINT_MAX || end_page_number == UINT_MAX) {
     // Out of memory.
     XELOGE("BaseHeap::Alloc failed to find contiguous range");
@@ -1117,6 +1686,7 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
     page_entry.state = kMemoryAllocationReserve | allocation_type;
     unreserved_page_count_--;
   }
+  RemoveFreePages(start_page_number, page_count);
 
   *out_address = heap_base_ + (start_page_number << page_size_shift_);
   return true;
@@ -1226,6 +1796,7 @@ bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
     page_entry.qword = 0;
     unreserved_page_count_++;
   }
+  AddFreePages(base_page_number, base_page_entry.region_page_count);
 
   return true;
 }
@@ -1317,6 +1888,10 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
     page_entry.current_protect = protect;
   }
 
+  if (protect & kMemoryProtectWrite) {
+    memory_->ReprotectCodeWatches(address, size);
+  }
+
   return true;
 }
 
@@ -1435,6 +2010,19 @@ xe::memory::PageAccess BaseHeap::QueryRangeAccess(uint32_t low_address,
   return ToPageAccess(protect);
 }
 
+xe::memory::PageAccess BaseHeap::QueryPageAccess(uint32_t address) {
+  uint32_t page_number = (address - heap_base_) >> page_size_shift_;
+  if (page_number >= page_table_.size()) {
+    return xe::memory::PageAccess::kNoAccess;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  const PageEntry& page_entry = page_table_[page_number];
+  if (!(page_entry.state & kMemoryAllocationCommit)) {
+    return xe::memory::PageAccess::kNoAccess;
+  }
+  return ToPageAccess(page_entry.current_protect);
+}
+
 VirtualHeap::VirtualHeap() = default;
 
 VirtualHeap::~VirtualHeap() = default;
@@ -1472,7 +2060,8 @@ void PhysicalHeap::Initialize(Memory* memory, uint8_t* membase,
   system_page_count_ =
       (size_t(heap_size_) + host_address_offset + (system_page_size_ - 1)) /
       system_page_size_;
-  system_page_flags_.resize((system_page_count_ + 63) / 64);
+  system_page_flags_ = std::unique_ptr<SystemPageFlagsBlock[]>(
+      new SystemPageFlagsBlock[(system_page_count_ + 63) / 64]);
 }
 
 bool PhysicalHeap::Alloc(uint32_t size, uint32_t alignment,
@@ -1512,6 +2101,7 @@ bool PhysicalHeap::Alloc(uint32_t size, uint32_t alignment,
     // TODO(benvanik): don't leak parent memory.
     return false;
   }
+  UnwatchRemappedRange(address, size, allocation_type);
   *out_address = address;
   return true;
 }
@@ -1548,6 +2138,7 @@ bool PhysicalHeap::AllocFixed(uint32_t base_address, uint32_t size,
     // TODO(benvanik): don't leak parent memory.
     return false;
   }
+  UnwatchRemappedRange(address, size, allocation_type);
 
   return true;
 }
@@ -1589,10 +2180,21 @@ bool PhysicalHeap::AllocRange(uint32_t low_address, uint32_t high_address,
     // TODO(benvanik): don't leak parent memory.
     return false;
   }
+  UnwatchRemappedRange(address, size, allocation_type);
   *out_address = address;
   return true;
 }
 
+void PhysicalHeap::UnwatchRemappedRange(uint32_t address, uint32_t size,
+                                        uint32_t allocation_type) {
+  if (!write_tracking_ || allocation_type == kMemoryAllocationReserve) {
+    // Reserving doesn't map the pages.
+    return;
+  }
+  TriggerCallbacks(global_critical_region_.Acquire(), address, size, true,
+                   true, false);
+}
+
 bool PhysicalHeap::AllocSystemHeap(uint32_t size, uint32_t alignment,
                                    uint32_t allocation_type, uint32_t protect,
                                    bool top_down, uint32_t* out_address) {
@@ -1715,10 +2317,9 @@ template <bool enable_invalidation_notifications>
 XE_NOINLINE void PhysicalHeap::EnableAccessCallbacksInner(
     const uint32_t system_page_first, const uint32_t system_page_last,
     xe::memory::PageAccess protect_access) XE_RESTRICT {
-  uint8_t* protect_base = membase_ + heap_base_;
   uint32_t protect_system_page_first = UINT32_MAX;
 
-  SystemPageFlagsBlock* XE_RESTRICT sys_page_flags = system_page_flags_.data();
+  SystemPageFlagsBlock* XE_RESTRICT sys_page_flags = system_page_flags_.get();
   PageEntry* XE_RESTRICT page_table_ptr = page_table_.data();
 
   // chrispy: a lot of time is spent in this loop, and i think some of the work
@@ -1775,12 +2376,17 @@ XE_NOINLINE void PhysicalHeap::EnableAccessCallbacksInner(
       // TODO(Triang3l): Enable data providers.
       if constexpr (enable_invalidation_notifications) {
         if (current_page_access != xe::memory::PageAccess::kReadOnly &&
-            (page_flags_block.notify_on_invalidation & page_flags_bit) == 0) {
+            (page_flags_block.notify_on_invalidation.load(
+                 std::memory_order_relaxed) &
+             page_flags_bit) == 0) {
           // TODO(Triang3l): Check if data providers are already enabled.
           // If data providers are already enabled for the page, it has even
           // stricter protection.
           protect_system_page = true;
-          page_flags_block.notify_on_invalidation |= page_flags_bit;
+          // Set before protecting, so a fault can't see the page as not
+          // watched.
+          page_flags_block.notify_on_invalidation.fetch_or(
+              page_flags_bit, std::memory_order_relaxed);
         }
       }
     }
@@ -1790,23 +2396,111 @@ XE_NOINLINE void PhysicalHeap::EnableAccessCallbacksInner(
       }
     } else {
       if (protect_system_page_first != UINT32_MAX) {
-        xe::memory::Protect(
-            protect_base + (protect_system_page_first << system_page_shift_),
-            (i - protect_system_page_first) << system_page_shift_,
-            protect_access);
+        WatchSystemPages(protect_system_page_first,
+                         i - protect_system_page_first, protect_access);
         protect_system_page_first = UINT32_MAX;
       }
     }
   }
 
   if (protect_system_page_first != UINT32_MAX) {
-    xe::memory::Protect(
-        protect_base + (protect_system_page_first << system_page_shift_),
-        (system_page_last + 1 - protect_system_page_first)
-            << system_page_shift_,
-        protect_access);
+    WatchSystemPages(protect_system_page_first,
+                     system_page_last + 1 - protect_system_page_first,
+                     protect_access);
   }
 }
+
+void PhysicalHeap::WatchSystemPages(uint32_t system_page_first,
+                                    uint32_t system_page_count,
+                                    xe::memory::PageAccess protect_access) {
+  uint8_t* address = membase_ + heap_base_ +
+                     (size_t(system_page_first) << system_page_shift_);
+  size_t length = size_t(system_page_count) << system_page_shift_;
+  // Data providers need reads to be intercepted too.
+  if (write_tracking_ && protect_access == xe::memory::PageAccess::kReadOnly &&
+      xe::memory::StartWriteTracking(address, length)) {
+    return;
+  }
+  xe::memory::Protect(address, length, protect_access);
+}
+
+bool PhysicalHeap::EnableWriteTracking() {
+  write_tracking_ = xe::memory::IsWriteTrackingSupported();
+  return write_tracking_;
+}
+
+void PhysicalHeap::CollectWrittenWatchedRanges(
+    std::vector<std::pair<uint32_t, uint32_t>>& ranges_out) {
+  if (!write_tracking_) {
+    return;
+  }
+  uint8_t* protect_base = membase_ + heap_base_;
+  std::vector<std::pair<size_t, size_t>> written_ranges;
+  uint32_t block_count = (system_page_count_ + 63) / 64;
+  // Only scanning the blocks containing watched pages.
+  for (uint32_t block_first = 0; block_first < block_count;) {
+    if (!system_page_flags_[block_first].notify_on_invalidation.load(
+            std::memory_order_relaxed)) {
+      ++block_first;
+      continue;
+    }
+    uint32_t block_end = block_first + 1;
+    while (block_end < block_count &&
+           system_page_flags_[block_end].notify_on_invalidation.load(
+               std::memory_order_relaxed)) {
+      ++block_end;
+    }
+    uint32_t system_page_first = block_first * 64;
+    uint32_t system_page_end = std::min(block_end * 64, system_page_count_);
+    written_ranges.clear();
+    xe::memory::CollectWrittenRanges(
+        protect_base + (size_t(system_page_first) << system_page_shift_),
+        size_t(system_page_end - system_page_first) << system_page_shift_,
+        written_ranges);
+    for (const std::pair<size_t, size_t>& range : written_ranges) {
+      uint32_t heap_relative_address = xe::sat_sub(
+          uint32_t((size_t(system_page_first) << system_page_shift_) +
+                   range.first),
+          host_address_offset());
+      if (heap_relative_address >= heap_size_) {
+        continue;
+      }
+      ranges_out.emplace_back(
+          heap_base_ + heap_relative_address,
+          std::min(uint32_t(range.second), heap_size_ - heap_relative_address));
+    }
+    block_first = block_end;
+  }
+}
+bool PhysicalHeap::IsWriteWatchAlreadyTriggered(
+    uint32_t virtual_address) const {
+  if (virtual_address < heap_base_ ||
+      virtual_address - heap_base_ >= heap_size_) {
+    return false;
+  }
+  uint32_t heap_relative_address = virtual_address - heap_base_;
+  uint32_t system_page =
+      (heap_relative_address + host_address_offset()) >> system_page_shift_;
+  if (system_page >= system_page_count_) {
+    return false;
+  }
+  if (system_page_flags_[system_page >> 6].notify_on_invalidation.load(
+          std::memory_order_acquire) &
+      (uint64_t(1) << (system_page & 63))) {
+    // Still watched, the callbacks need to be triggered under the lock.
+    return false;
+  }
+  // Not watched anymore - if the guest can write to the page, the fault was
+  // caused by the watch that has been removed since then, otherwise it's a real
+  // access violation. Read without the lock, if the protection is being
+  // changed concurrently, it's a race in the guest itself.
+  PageEntry page_entry;
+  page_entry.qword = reinterpret_cast<const volatile uint64_t&>(
+      page_table_[heap_relative_address >> page_size_shift_].qword);
+  return ToPageAccess(page_entry.current_protect) ==
+         xe::memory::PageAccess::kReadWrite;
+}
+
 bool PhysicalHeap::TriggerCallbacks(
     global_unique_lock_type global_lock_locked_once, uint32_t virtual_address,
     uint32_t length, bool is_write, bool unwatch_exact_range, bool unprotect) {
@@ -1845,7 +2539,9 @@ bool PhysicalHeap::TriggerCallbacks(
   // Check if watching any page, whether need to call the callback at all.
   bool any_watched = false;
   for (uint32_t i = block_index_first; i <= block_index_last; ++i) {
-    uint64_t block = system_page_flags_[i].notify_on_invalidation;
+    uint64_t block =
+        system_page_flags_[i].notify_on_invalidation.load(
+            std::memory_order_relaxed);
     if (i == block_index_first) {
       block &= ~((uint64_t(1) << (system_page_first & 63)) - 1);
     }
@@ -1929,8 +2625,10 @@ bool PhysicalHeap::TriggerCallbacks(
     uint32_t unprotect_system_page_first = UINT32_MAX;
     for (uint32_t i = system_page_first; i <= system_page_last; ++i) {
       // Check if need to allow writing to this page.
-      bool unprotect_page = (system_page_flags_[i >> 6].notify_on_invalidation &
-                             (uint64_t(1) << (i & 63))) != 0;
+      bool unprotect_page =
+          (system_page_flags_[i >> 6].notify_on_invalidation.load(
+               std::memory_order_relaxed) &
+           (uint64_t(1) << (i & 63))) != 0;
       if (unprotect_page) {
         uint32_t guest_page_number =
             xe::sat_sub(i << system_page_shift_, host_address_offset()) >>
@@ -1964,7 +2662,8 @@ bool PhysicalHeap::TriggerCallbacks(
     }
   }
 
-  // Mark pages as not write-watched.
+  // Mark pages as not write-watched. Only after unprotecting them, for
+  // IsWriteWatchAlreadyTriggered.
   for (uint32_t i = block_index_first; i <= block_index_last; ++i) {
     uint64_t mask = 0;
     if (i == block_index_first) {
@@ -1973,7 +2672,8 @@ bool PhysicalHeap::TriggerCallbacks(
     if (i == block_index_last && (system_page_last & 63) != 63) {
       mask |= ~((uint64_t(1) << ((system_page_last & 63) + 1)) - 1);
     }
-    system_page_flags_[i].notify_on_invalidation &= mask;
+    system_page_flags_[i].notify_on_invalidation.fetch_and(
+        mask, std::memory_order_release);
   }
 
   return true;
@@ -10,7 +10,11 @@
 #ifndef XENIA_MEMORY_H_
 #define XENIA_MEMORY_H_
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <filesystem>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -20,6 +24,8 @@
 #include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/mmio_handler.h"
+#include "xenia/memory_access_sampler.h"
+#include "xenia/system_heap_pool.h"
 
 namespace xe {
 class ByteStream;
@@ -198,8 +204,18 @@ class BaseHeap {
   xe::memory::PageAccess QueryRangeAccess(uint32_t low_address,
                                           uint32_t high_address);
 
-  bool Save(ByteStream* stream);
-  bool Restore(ByteStream* stream);
+  // Queries the host access of the page containing the given address, which is
+  // kNoAccess if the page is not committed.
+  xe::memory::PageAccess QueryPageAccess(uint32_t address);
+
+  // Writes the page table and the contents of the committed pages. If
+  // incremental, the chunks of the pages not modified since the last full save
+  // or restore are referenced in that file instead of being stored.
+  bool Save(ByteStream* stream, bool incremental);
+  // The base data is the file of the last full save that an incremental save
+  // references, or nullptr if the stream is for a full save.
+  bool Restore(ByteStream* stream, const uint8_t* base_data,
+               size_t base_data_size);
 
   void Reset();
 
@@ -210,6 +226,32 @@ class BaseHeap {
                   uint32_t heap_base, uint32_t heap_size, uint32_t page_size,
                   uint32_t host_address_offset = 0);
 
+  // Keeping free_page_runs_ in sync with the states in page_table_.
+  void RebuildFreePageRuns();
+  void AddFreePages(uint32_t start_page_number, uint32_t page_count);
+  void RemoveFreePages(uint32_t start_page_number, uint32_t page_count);
+
+  // Contents of the committed pages in a kSaveStateChunkSize range of the heap
+  // in a save state file.
+  struct SaveStateChunk {
+    enum Flags : uint32_t {
+      // Stored in the base file of an incremental save, not in this one.
+      kFlagInBase = 1 << 0,
+    };
+    // XXH3 of the uncompressed data.
+    uint64_t hash;
+    // Offset of the Snappy-compressed data from the beginning of the file.
+    uint64_t data_offset;
+    uint32_t data_size;
+    uint32_t flags;
+  };
+  static_assert(sizeof(SaveStateChunk) == 24);
+  static constexpr uint32_t kSaveStateChunkSize = 4 * 1024 * 1024;
+
+  uint32_t save_state_chunk_page_count() const {
+    return std::max(kSaveStateChunkSize >> page_size_shift_, uint32_t(1));
+  }
+
   Memory* memory_;
   uint8_t* membase_;
   HeapType heap_type_;
@@ -221,6 +263,12 @@ class BaseHeap {
   uint32_t unreserved_page_count_;
   xe::global_critical_region global_critical_region_;
   std::vector<PageEntry> page_table_;
+  // Maximal runs of unreserved pages in page_table_, first page number to page
+  // count, so finding free ranges doesn't have to scan every page.
+  std::map<uint32_t, uint32_t> free_page_runs_;
+  // Chunks in the file of the last full save or restore that incremental saves
+  // can reference, the flags are kFlagInBase if the chunk is usable.
+  std::vector<SaveStateChunk> base_save_state_chunks_;
 };
 
 // Normal heap allowing allocations from guest virtual address ranges.
@@ -276,6 +324,22 @@ class PhysicalHeap : public BaseHeap {
       const uint32_t system_page_first, const uint32_t system_page_last,
       xe::memory::PageAccess protect_access) XE_RESTRICT;
 
+  // Checks without locking whether a write to the address has faulted only
+  // because another thread was handling the watch of its page concurrently,
+  // not yet having unprotected the page when the write happened. Because the
+  // page is unprotected before the watch is cleared, if this returns true, the
+  // write can be retried.
+  bool IsWriteWatchAlreadyTriggered(uint32_t virtual_address) const;
+
+  // Switches from write protection to host write tracking for detecting writes
+  // to the watched pages, returns false if not supported.
+  bool EnableWriteTracking();
+  bool write_tracking() const { return write_tracking_; }
+  // With write tracking, appends the virtual address ranges of the pages
+  // written since the last call (possibly including pages not watched).
+  void CollectWrittenWatchedRanges(
+      std::vector<std::pair<uint32_t, uint32_t>>& ranges_out);
+
   // Returns true if any page in the range was watched.
   bool TriggerCallbacks(global_unique_lock_type global_lock_locked_once,
                         uint32_t virtual_address, uint32_t length,
@@ -297,7 +361,17 @@ class PhysicalHeap : public BaseHeap {
   }
 
  protected:
+  // Starts detecting writes to the system pages by protecting them or by
+  // tracking writes to them.
+  void WatchSystemPages(uint32_t system_page_first, uint32_t system_page_count,
+                        xe::memory::PageAccess protect_access);
+  // Mapping pages again stops tracking writes to them, so with write tracking,
+  // notifies about the potential modification and unwatches them.
+  void UnwatchRemappedRange(uint32_t address, uint32_t size,
+                            uint32_t allocation_type);
+
   VirtualHeap* parent_heap_;
+  bool write_tracking_ = false;
 
   uint32_t system_page_size_;
   uint32_t system_page_count_;
@@ -307,11 +381,12 @@ class PhysicalHeap : public BaseHeap {
   struct SystemPageFlagsBlock {
     // Whether writing to each page should result trigger invalidation
     // callbacks.
-    uint64_t notify_on_invalidation;
+    std::atomic<uint64_t> notify_on_invalidation{0};
   };
-  // Protected by global_critical_region. Flags for each 64 system pages,
-  // interleaved as blocks, so bit scan can be used to quickly extract ranges.
-  std::vector<SystemPageFlagsBlock> system_page_flags_;
+  // Flags for each 64 system pages, interleaved as blocks, so bit scan can be
+  // used to quickly extract ranges. Modified with atomic operations, with
+  // global_critical_region locked, but may be read without the lock.
+  std::unique_ptr<SystemPageFlagsBlock[]> system_page_flags_;
 };
 
 // Models the entire guest memory system on the console.
@@ -341,6 +416,10 @@ class Memory {
   // Resets all memory to zero and resets all allocations.
   void Reset();
 
+  // Host NUMA node for the guest memory, the generated code and the threads
+  // using them, or xe::memory::kNumaNodeAny.
+  static uint32_t GetHostNumaNode();
+
   // Full file name and path of the memory-mapped file backing all memory.
   const std::filesystem::path& file_name() const { return file_name_; }
 
@@ -415,6 +494,20 @@ class Memory {
   // Gets the defined MMIO range for the given virtual address, if any.
   cpu::MMIORange* LookupVirtualMappedRange(uint32_t virtual_address);
 
+  // Defines a range of normal guest memory containing values maintained by the
+  // host, such as the kernel clocks. Dword and qword loads from it at constant
+  // addresses are replaced at translation time with the calls to the read
+  // callbacks returning the current values, while other accesses use the
+  // contents of the memory. Must be added before translating the code reading
+  // it.
+  void AddInlineReadRange(uint32_t virtual_address, uint32_t size,
+                          void* context, cpu::MMIOReadCallback read_callback,
+                          cpu::MMIORead64Callback read64_callback);
+
+  // Gets the inline read range containing the whole access, if any.
+  cpu::MMIORange* LookupInlineReadRange(uint32_t virtual_address,
+                                        uint32_t size);
+
   // Physical memory access callbacks, two types of them.
   //
   // This is simple per-system-page protection without reference counting or
@@ -482,6 +575,17 @@ class Memory {
       uint32_t physical_address, uint32_t length,
       bool enable_invalidation_notifications, bool enable_data_providers);
 
+  // Whether writes to the physical memory are detected using host write
+  // tracking (physical_memory_write_tracking) rather than access violations.
+  bool physical_memory_write_tracking() const {
+    return physical_memory_write_tracking_;
+  }
+  // With host write tracking, triggers the invalidation callbacks for the
+  // pages written since the last call, in a batch. Must be called before the
+  // GPU uses the guest memory. Does nothing without write tracking, as writes
+  // trigger the callbacks immediately then.
+  void CollectPhysicalMemoryWrites();
+
   // Forces triggering of watch callbacks for a virtual address range if pages
   // are watched there and unwatching them. Returns whether any page was
   // watched. Must be called with global critical region locking depth of 1.
@@ -492,6 +596,23 @@ class Memory {
       uint32_t length, bool is_write, bool unwatch_exact_range,
       bool unprotect = true);
 
+  // Called with the global lock held, before the guest or the host writes to
+  // the watched code in the range (rounded to host pages), after unwatching it.
+  // Must not access the guest memory, as the write has not happened yet.
+  typedef void (*CodeWriteCallback)(void* context, uint32_t address,
+                                    uint32_t length);
+  void SetCodeWriteCallback(CodeWriteCallback callback, void* context);
+  // Detects writes to the host pages containing the guest code in the range,
+  // which must be below the physical memory heaps, by write-protecting the
+  // pages writable by the guest, until the next write to each. The watch is
+  // kept if the guest makes the pages writable later.
+  void WatchCodeRange(uint32_t address, uint32_t length);
+  // For the host writes to the guest memory not through the memory views, such
+  // as with file I/O, which would fail instead of faulting on the watched
+  // pages. Unwatches (and unprotects if needed) the pages in the range and
+  // invokes the code write callback for them.
+  void TriggerCodeWriteWatches(uint32_t address, uint32_t length);
+
   // Allocates virtual memory from the 'system' heap.
   // System memory is kept separate from game memory but is still accessible
   // using normal guest virtual addresses. Kernel structures and other internal
@@ -525,12 +646,22 @@ class Memory {
   // Dumps a map of all allocated memory to the log.
   void DumpMap();
 
-  bool Save(ByteStream* stream);
-  bool Restore(ByteStream* stream);
+  // The path is of the file the stream is for. Incremental saves reference the
+  // file of the last full save or restore for the unmodified data, which must
+  // be kept for restoring them.
+  bool Save(ByteStream* stream, const std::filesystem::path& path,
+            bool incremental);
+  bool Restore(ByteStream* stream, const std::filesystem::path& path);
 
   void SetMMIOExceptionRecordingCallback(cpu::MmioAccessRecordCallback callback,
                                          void* context);
 
+  // For attributing the accesses to guest functions with
+  // memory_access_sampling.
+  void SetGuestFunctionLookupCallback(
+      MemoryAccessSampler::GuestFunctionLookupCallback callback,
+      void* context);
+
  private:
   int MapViews(uint8_t* mapping_base);
   void UnmapViews();
@@ -538,11 +669,27 @@ class Memory {
   static uint32_t HostToGuestVirtualThunk(const void* context,
                                           const void* host_address);
 
-  bool AccessViolationCallback(global_unique_lock_type global_lock_locked_once,
-                               void* host_address, bool is_write);
+  bool AccessViolationCallback(global_unique_lock_type global_lock_deferred,
+                               void* host_address, bool is_write,
+                               void* host_insn_address);
   static bool AccessViolationCallbackThunk(
-      global_unique_lock_type global_lock_locked_once, void* context,
-      void* host_address, bool is_write);
+      global_unique_lock_type global_lock_deferred, void* context,
+      void* host_address, bool is_write, void* host_insn_address);
+
+  // Code write watches are only below the physical memory heaps.
+  static constexpr uint32_t kCodeWatchAddressEnd = 0xA0000000;
+  // Checks without locking, the watch may be cleared concurrently.
+  bool IsCodeWriteWatched(uint32_t virtual_address) const {
+    uint32_t page = virtual_address / system_page_size_;
+    return virtual_address < kCodeWatchAddressEnd &&
+           (code_watch_bits_[page >> 6] & (uint64_t(1) << (page & 63)));
+  }
+  // With the global lock held. Unwatches the pages and, if unprotect is true,
+  // restores their guest protection, then invokes the callback for them.
+  void TriggerCodeWriteWatchesLocked(uint32_t address, uint32_t length,
+                                     bool unprotect);
+  // With the global lock held, after a guest protection change.
+  void ReprotectCodeWatches(uint32_t address, uint32_t length);
 
   std::filesystem::path file_name_;
   uint32_t system_page_size_ = 0;
@@ -570,6 +717,16 @@ class Memory {
 
   std::unique_ptr<cpu::MMIOHandler> mmio_handler_;
 
+  // Referenced by the translated code.
+  std::vector<std::unique_ptr<cpu::MMIORange>> inline_read_ranges_;
+  std::mutex inline_read_ranges_mutex_;
+
+  std::unique_ptr<MemoryAccessSampler> access_sampler_;
+
+  // Small virtual system heap allocations if system_heap_pool is enabled, but
+  // always present to free the allocations restored from a save state.
+  std::unique_ptr<SystemHeapPool> system_heap_pool_;
+
   struct {
     VirtualHeap v00000000;
     VirtualHeap v40000000;
@@ -586,8 +743,18 @@ class Memory {
 
   friend class PhysicalHeap;
   xe::global_critical_region global_critical_region_;
+  bool physical_memory_write_tracking_ = false;
+
+  // File of the last full save or restore, the base for incremental saves.
+  std::filesystem::path save_state_base_path_;
   std::vector<std::pair<PhysicalMemoryInvalidationCallback, void*>*>
       physical_memory_invalidation_callbacks_;
+
+  // Bits of the host pages with guest code write watches, guarded by the
+  // global lock for modification.
+  std::vector<uint64_t> code_watch_bits_;
+  CodeWriteCallback code_write_callback_ = nullptr;
+  void* code_write_callback_context_ = nullptr;
 };
 
 }  // namespace xe
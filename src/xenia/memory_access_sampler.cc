@@ -0,0 +1,285 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/memory_access_sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <utility>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/memory.h"
+
+DEFINE_uint32(memory_access_sampling_interval_ms, 10,
+              "Interval in milliseconds between the rounds of guest memory "
+              "access sampling (memory_access_sampling).",
+              "Memory");
+DEFINE_uint32(memory_access_sampling_pages, 64,
+              "Number of guest pages made inaccessible in every round of "
+              "guest memory access sampling (memory_access_sampling).",
+              "Memory");
+DEFINE_uint32(memory_access_sampling_report_top_count, 32,
+              "Number of the most accessed allocations and guest functions to "
+              "list in the guest memory access sampling report.",
+              "Memory");
+
+namespace xe {
+
+namespace {
+constexpr auto kReportInterval = std::chrono::seconds(30);
+// Most attempts to pick a page in a heap hit unallocated memory.
+constexpr uint32_t kPickAttemptsPerPage = 16;
+}  // namespace
+
+MemoryAccessSampler::MemoryAccessSampler(
+    Memory* memory, std::vector<BaseHeap*> heaps,
+    const std::filesystem::path& report_path)
+    : memory_(memory), heaps_(std::move(heaps)), report_path_(report_path) {}
+
+MemoryAccessSampler::~MemoryAccessSampler() { Stop(); }
+
+bool MemoryAccessSampler::Start() {
+  if (thread_ || heaps_.empty()) {
+    return false;
+  }
+  stop_ = false;
+  threading::Thread::CreationParameters params;
+  thread_ = threading::Thread::Create(params, [this]() { ThreadMain(); });
+  if (!thread_) {
+    XELOGE("Failed to create the guest memory access sampling thread");
+    return false;
+  }
+  thread_->set_name("Memory Access Sampler");
+  XELOGI("Sampling guest memory accesses, reporting to {}",
+         xe::path_to_utf8(report_path_));
+  return true;
+}
+
+void MemoryAccessSampler::Stop() {
+  if (!thread_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    stop_ = true;
+  }
+  thread_cond_.notify_all();
+  threading::Wait(thread_.get(), false);
+  thread_.reset();
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    RestoreSampledPages();
+  }
+  WriteReport();
+}
+
+void MemoryAccessSampler::SetGuestFunctionLookupCallback(
+    GuestFunctionLookupCallback callback, void* context) {
+  auto global_lock = global_critical_region_.Acquire();
+  guest_function_lookup_callback_ = callback;
+  guest_function_lookup_context_ = context;
+}
+
+bool MemoryAccessSampler::OnAccessViolation(BaseHeap* heap,
+                                            uint32_t virtual_address,
+                                            bool is_write,
+                                            void* host_code_address) {
+  uint32_t page_address = virtual_address & ~(heap->page_size() - 1);
+  auto it = sampled_pages_.find(page_address);
+  if (it == sampled_pages_.end()) {
+    // Another thread may have restored the access to the page already.
+    xe::memory::PageAccess page_access = heap->QueryPageAccess(page_address);
+    return is_write ? page_access == xe::memory::PageAccess::kReadWrite
+                    : page_access != xe::memory::PageAccess::kNoAccess;
+  }
+  sampled_pages_.erase(it);
+  xe::memory::Protect(
+      heap->TranslateRelative(page_address - heap->heap_base()),
+      heap->page_size(), heap->QueryPageAccess(page_address), nullptr);
+  PageStats& stats = page_stats_[page_address];
+  ++(is_write ? stats.writes : stats.reads);
+  ++function_access_counts_[LookupGuestFunction(host_code_address)];
+  return true;
+}
+
+void MemoryAccessSampler::OnWriteWatchFault(BaseHeap* heap,
+                                            uint32_t virtual_address,
+                                            void* host_code_address) {
+  ++page_stats_[virtual_address & ~(heap->page_size() - 1)].watch_faults;
+  ++function_access_counts_[LookupGuestFunction(host_code_address)];
+}
+
+void MemoryAccessSampler::ThreadMain() {
+  auto interval = std::chrono::milliseconds(
+      std::max(cvars::memory_access_sampling_interval_ms, uint32_t(1)));
+  auto next_report_time = std::chrono::steady_clock::now() + kReportInterval;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(thread_mutex_);
+      if (thread_cond_.wait_for(lock, interval, [this]() { return stop_; })) {
+        break;
+      }
+    }
+    {
+      auto global_lock = global_critical_region_.Acquire();
+      RestoreSampledPages();
+      SamplePages();
+    }
+    if (std::chrono::steady_clock::now() >= next_report_time) {
+      WriteReport();
+      next_report_time = std::chrono::steady_clock::now() + kReportInterval;
+    }
+  }
+}
+
+void MemoryAccessSampler::RestoreSampledPages() {
+  // Pages not accessed during the interval. The guest may have changed the
+  // protection meanwhile, so it's taken from the page table.
+  for (const auto& sampled_page : sampled_pages_) {
+    BaseHeap* heap = sampled_page.second.heap;
+    uint32_t address = sampled_page.second.address;
+    xe::memory::Protect(heap->TranslateRelative(address - heap->heap_base()),
+                        heap->page_size(), heap->QueryPageAccess(address),
+                        nullptr);
+  }
+  sampled_pages_.clear();
+}
+
+void MemoryAccessSampler::SamplePages() {
+  thread_local std::minstd_rand random_engine(std::random_device{}());
+  uint32_t page_count = cvars::memory_access_sampling_pages;
+  for (uint32_t i = 0; i < page_count; ++i) {
+    for (uint32_t attempt = 0; attempt < kPickAttemptsPerPage; ++attempt) {
+      BaseHeap* heap = heaps_[random_engine() % heaps_.size()];
+      uint32_t heap_page_count = heap->heap_size() / heap->page_size();
+      uint32_t address =
+          heap->heap_base() + (uint32_t(random_engine() % heap_page_count) *
+                               heap->page_size());
+      if (sampled_pages_.find(address) != sampled_pages_.end() ||
+          heap->QueryPageAccess(address) ==
+              xe::memory::PageAccess::kNoAccess) {
+        continue;
+      }
+      if (!xe::memory::Protect(
+              heap->TranslateRelative(address - heap->heap_base()),
+              heap->page_size(), xe::memory::PageAccess::kNoAccess, nullptr)) {
+        continue;
+      }
+      sampled_pages_.emplace(address, SampledPage{heap, address});
+      ++sampled_page_count_;
+      break;
+    }
+  }
+}
+
+uint32_t MemoryAccessSampler::LookupGuestFunction(
+    void* host_code_address) const {
+  if (!guest_function_lookup_callback_ || !host_code_address) {
+    return 0;
+  }
+  return guest_function_lookup_callback_(guest_function_lookup_context_,
+                                         host_code_address);
+}
+
+std::string MemoryAccessSampler::BuildReport() {
+  struct AllocationStats {
+    uint32_t size = 0;
+    uint64_t accesses = 0;
+    uint64_t watch_faults = 0;
+  };
+  std::unordered_map<uint32_t, AllocationStats> allocation_stats;
+  std::vector<std::pair<uint32_t, PageStats>> pages;
+  std::vector<std::pair<uint32_t, uint64_t>> functions;
+  uint64_t read_count = 0, write_count = 0, watch_fault_count = 0;
+  uint64_t sampled_page_count;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    sampled_page_count = sampled_page_count_;
+    pages.assign(page_stats_.begin(), page_stats_.end());
+    functions.assign(function_access_counts_.begin(),
+                     function_access_counts_.end());
+    // Attributing to the allocations existing currently.
+    for (const auto& page : pages) {
+      read_count += page.second.reads;
+      write_count += page.second.writes;
+      watch_fault_count += page.second.watch_faults;
+      uint32_t allocation_base = page.first;
+      uint32_t allocation_size = 0;
+      BaseHeap* heap = memory_->LookupHeap(page.first);
+      HeapAllocationInfo info;
+      if (heap && heap->QueryRegionInfo(page.first, &info) &&
+          info.allocation_base) {
+        allocation_base = info.allocation_base;
+        allocation_size = info.allocation_size;
+      }
+      AllocationStats& stats = allocation_stats[allocation_base];
+      stats.size = std::max(stats.size, allocation_size);
+      stats.accesses += page.second.reads + page.second.writes;
+      stats.watch_faults += page.second.watch_faults;
+    }
+  }
+
+  std::vector<std::pair<uint32_t, AllocationStats>> allocations(
+      allocation_stats.begin(), allocation_stats.end());
+  size_t top_count = cvars::memory_access_sampling_report_top_count;
+  std::sort(allocations.begin(), allocations.end(),
+            [](const auto& a, const auto& b) {
+              return a.second.accesses + a.second.watch_faults >
+                     b.second.accesses + b.second.watch_faults;
+            });
+  allocations.resize(std::min(allocations.size(), top_count));
+  std::sort(functions.begin(), functions.end(),
+            [](const auto& a, const auto& b) { return a.second > b.second; });
+  functions.resize(std::min(functions.size(), top_count));
+  std::sort(pages.begin(), pages.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  std::string report;
+  auto out = std::back_inserter(report);
+  fmt::format_to(out,
+                 "Sampled pages: {}\nSampled reads: {}\nSampled writes: {}\n"
+                 "Write watch faults: {}\n",
+                 sampled_page_count, read_count, write_count,
+                 watch_fault_count);
+  fmt::format_to(out, "\nTop allocations (base size accesses watch_faults):\n");
+  for (const auto& allocation : allocations) {
+    fmt::format_to(out, "{:08X} {:08X} {} {}\n", allocation.first,
+                   allocation.second.size, allocation.second.accesses,
+                   allocation.second.watch_faults);
+  }
+  fmt::format_to(out, "\nTop guest functions (address accesses), 0 for host "
+                 "code:\n");
+  for (const auto& function : functions) {
+    fmt::format_to(out, "{:08X} {}\n", function.first, function.second);
+  }
+  fmt::format_to(out, "\nPages (address reads writes watch_faults):\n");
+  for (const auto& page : pages) {
+    fmt::format_to(out, "{:08X} {} {} {}\n", page.first, page.second.reads,
+                   page.second.writes, page.second.watch_faults);
+  }
+  return report;
+}
+
+void MemoryAccessSampler::WriteReport() {
+  std::string report = BuildReport();
+  FILE* report_file = xe::filesystem::OpenFile(report_path_, "wb");
+  if (!report_file) {
+    XELOGE("Failed to write the guest memory access report {}",
+           xe::path_to_utf8(report_path_));
+    return;
+  }
+  fwrite(report.data(), 1, report.size(), report_file);
+  fclose(report_file);
+}
+
+}  // namespace xe
@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_MEMORY_ACCESS_SAMPLER_H_
+#define XENIA_MEMORY_ACCESS_SAMPLER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
+
+namespace xe {
+
+class BaseHeap;
+class Memory;
+
+// Instrumentation estimating which guest memory is accessed the most, for
+// finding the buffers that cause cache misses and write watch faults.
+//
+// Periodically, a random set of committed pages of the given heaps is made
+// inaccessible, and the first access to each of them during the interval is
+// attributed to the page, the allocation containing it and the guest function
+// performing it, after which the page access is restored. Write watch faults
+// are counted as well. A report with the top allocations and functions and a
+// heatmap of the pages is written periodically.
+//
+// Accesses to sampled pages by the host operating system, such as reading a
+// file into them, fail rather than fault, so this is for diagnostics only.
+class MemoryAccessSampler {
+ public:
+  // Returns the guest address of the function containing the host code, or 0
+  // if it's not guest code.
+  typedef uint32_t (*GuestFunctionLookupCallback)(void* context,
+                                                  void* host_code_address);
+
+  // Pages of the heaps are sampled, they must not have write watches.
+  MemoryAccessSampler(Memory* memory, std::vector<BaseHeap*> heaps,
+                      const std::filesystem::path& report_path);
+  MemoryAccessSampler(const MemoryAccessSampler& sampler) = delete;
+  MemoryAccessSampler& operator=(const MemoryAccessSampler& sampler) = delete;
+  ~MemoryAccessSampler();
+
+  bool Start();
+  // Stops sampling, restores the access of the sampled pages and writes the
+  // report.
+  void Stop();
+
+  void SetGuestFunctionLookupCallback(GuestFunctionLookupCallback callback,
+                                      void* context);
+
+  // With the global critical region locked. Returns whether the access
+  // violation was caused by sampling, and the access can be retried.
+  bool OnAccessViolation(BaseHeap* heap, uint32_t virtual_address,
+                         bool is_write, void* host_code_address);
+  // With the global critical region locked.
+  void OnWriteWatchFault(BaseHeap* heap, uint32_t virtual_address,
+                         void* host_code_address);
+
+ private:
+  struct PageStats {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t watch_faults = 0;
+  };
+
+  struct SampledPage {
+    BaseHeap* heap;
+    uint32_t address;
+  };
+
+  void ThreadMain();
+  // With the global critical region locked.
+  void RestoreSampledPages();
+  void SamplePages();
+  uint32_t LookupGuestFunction(void* host_code_address) const;
+  std::string BuildReport();
+  void WriteReport();
+
+  Memory* memory_;
+  std::vector<BaseHeap*> heaps_;
+  std::filesystem::path report_path_;
+  xe::global_critical_region global_critical_region_;
+
+  std::unique_ptr<threading::Thread> thread_;
+  std::mutex thread_mutex_;
+  std::condition_variable thread_cond_;
+  bool stop_ = false;
+
+  // Protected by the global critical region.
+  GuestFunctionLookupCallback guest_function_lookup_callback_ = nullptr;
+  void* guest_function_lookup_context_ = nullptr;
+  std::unordered_map<uint32_t, SampledPage> sampled_pages_;
+  uint64_t sampled_page_count_ = 0;
+  std::unordered_map<uint32_t, PageStats> page_stats_;
+  std::unordered_map<uint32_t, uint64_t> function_access_counts_;
+};
+
+}  // namespace xe
+
+#endif  // XENIA_MEMORY_ACCESS_SAMPLER_H_
@@ -7,11 +7,13 @@
  ******************************************************************************
  */
 #include <regex>
+#include <unordered_map>
 
 #include "xenia/config.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/memory.h"
 
 #include "xenia/patcher/patch_db.h"
@@ -22,6 +24,38 @@ DEFINE_bool(apply_patches, true, "Enables custom patching functionality",
 namespace xe {
 namespace patcher {
 
+namespace {
+
+constexpr uint32_t kPatchIndexVersion = 1;
+
+struct PatchIndexHeader {
+  xe::fourcc_t magic;
+  uint32_t version;
+  uint32_t entry_count;
+};
+
+constexpr xe::fourcc_t kPatchIndexMagic = xe::make_fourcc("XPIX");
+
+template <typename T>
+bool ReadIndexValue(FILE* file, T& value) {
+  return fread(&value, sizeof(value), 1, file) == 1;
+}
+
+template <typename T>
+void WriteIndexValue(FILE* file, const T& value) {
+  fwrite(&value, sizeof(value), 1, file);
+}
+
+bool IsForModule(const uint32_t patch_title_id,
+                 const std::vector<uint64_t>& patch_hashes,
+                 const uint32_t title_id, const std::optional<uint64_t> hash) {
+  bool hash_exist = std::find(patch_hashes.cbegin(), patch_hashes.cend(),
+                              hash) != patch_hashes.cend();
+  return patch_title_id == title_id && (patch_hashes.empty() || hash_exist);
+}
+
+}  // namespace
+
 PatchDB::PatchDB(const std::filesystem::path patches_root) {
   patches_root_ = patches_root;
   LoadPatches();
@@ -38,6 +72,17 @@ void PatchDB::LoadPatches() {
   const std::vector<xe::filesystem::FileInfo> patch_files =
       filesystem::ListFiles(patches_directory);
 
+  // Only parsing the files that are new or have changed since the last launch,
+  // and the rest only when a module they can be applied to is loaded.
+  std::unordered_map<std::string, PatchIndexEntry> indexed_files;
+  std::vector<PatchIndexEntry> stored_index = ReadIndex();
+  for (PatchIndexEntry& entry : stored_index) {
+    std::string file_name = entry.file_name;
+    indexed_files.emplace(std::move(file_name), std::move(entry));
+  }
+  bool index_changed = false;
+  size_t parsed_file_count = 0;
+
   for (const xe::filesystem::FileInfo& patch_file : patch_files) {
     // Skip files that doesn't have only title_id as name and .patch as
     // extension
@@ -48,13 +93,105 @@ void PatchDB::LoadPatches() {
       continue;
     }
 
+    std::string file_name = path_to_utf8(patch_file.name);
+    auto indexed_file = indexed_files.find(file_name);
+    if (indexed_file != indexed_files.end() &&
+        indexed_file->second.file_size == patch_file.total_size &&
+        indexed_file->second.write_timestamp == patch_file.write_timestamp) {
+      index_.push_back(std::move(indexed_file->second));
+      continue;
+    }
+
     const PatchFileEntry loaded_title_patches =
         ReadPatchFile(patch_file.path / patch_file.name);
-    if (loaded_title_patches.title_id != -1) {
-      loaded_patches_.push_back(loaded_title_patches);
+    ++parsed_file_count;
+    PatchIndexEntry& entry = index_.emplace_back();
+    entry.file_name = std::move(file_name);
+    entry.file_size = patch_file.total_size;
+    entry.write_timestamp = patch_file.write_timestamp;
+    // Broken files are indexed too, to not parse them again on every launch.
+    entry.title_id = loaded_title_patches.title_id;
+    entry.hashes = loaded_title_patches.hashes;
+    index_changed = true;
+  }
+  if (index_changed || index_.size() != stored_index.size()) {
+    WriteIndex();
+  }
+  XELOGI("PatchDB: Indexed {} patch files, parsed {} new or changed",
+         index_.size(), parsed_file_count);
+}
+
+std::filesystem::path PatchDB::GetIndexPath() const {
+  return patches_root_ / "patches.index";
+}
+
+std::vector<PatchIndexEntry> PatchDB::ReadIndex() const {
+  std::vector<PatchIndexEntry> entries;
+  FILE* file = xe::filesystem::OpenFile(GetIndexPath(), "rb");
+  if (!file) {
+    return entries;
+  }
+  PatchIndexHeader header;
+  bool valid = ReadIndexValue(file, header) &&
+               header.magic == kPatchIndexMagic &&
+               header.version == kPatchIndexVersion;
+  if (valid) {
+    entries.reserve(header.entry_count);
+    for (uint32_t i = 0; i < header.entry_count; ++i) {
+      PatchIndexEntry& entry = entries.emplace_back();
+      uint32_t file_name_length, hash_count;
+      if (!ReadIndexValue(file, file_name_length) ||
+          file_name_length > UINT16_MAX) {
+        valid = false;
+        break;
+      }
+      entry.file_name.resize(file_name_length);
+      if (fread(entry.file_name.data(), 1, file_name_length, file) !=
+              file_name_length ||
+          !ReadIndexValue(file, entry.file_size) ||
+          !ReadIndexValue(file, entry.write_timestamp) ||
+          !ReadIndexValue(file, entry.title_id) ||
+          !ReadIndexValue(file, hash_count) || hash_count > UINT16_MAX) {
+        valid = false;
+        break;
+      }
+      entry.hashes.resize(hash_count);
+      if (fread(entry.hashes.data(), sizeof(uint64_t), hash_count, file) !=
+          hash_count) {
+        valid = false;
+        break;
+      }
     }
   }
-  XELOGI("PatchDB: Loaded patches for {} titles", loaded_patches_.size());
+  fclose(file);
+  if (!valid) {
+    XELOGW("PatchDB: Ignoring the invalid patch index");
+    entries.clear();
+  }
+  return entries;
+}
+
+void PatchDB::WriteIndex() const {
+  FILE* file = xe::filesystem::OpenFile(GetIndexPath(), "wb");
+  if (!file) {
+    XELOGW("PatchDB: Failed to write the patch index");
+    return;
+  }
+  PatchIndexHeader header;
+  header.magic = kPatchIndexMagic;
+  header.version = kPatchIndexVersion;
+  header.entry_count = uint32_t(index_.size());
+  WriteIndexValue(file, header);
+  for (const PatchIndexEntry& entry : index_) {
+    WriteIndexValue(file, uint32_t(entry.file_name.size()));
+    fwrite(entry.file_name.data(), 1, entry.file_name.size(), file);
+    WriteIndexValue(file, entry.file_size);
+    WriteIndexValue(file, entry.write_timestamp);
+    WriteIndexValue(file, entry.title_id);
+    WriteIndexValue(file, uint32_t(entry.hashes.size()));
+    fwrite(entry.hashes.data(), sizeof(uint64_t), entry.hashes.size(), file);
+  }
+  fclose(file);
 }
 
 PatchFileEntry PatchDB::ReadPatchFile(const std::filesystem::path& file_path) {
@@ -194,20 +331,50 @@ bool PatchDB::ReadPatchData(
 std::vector<PatchFileEntry> PatchDB::GetTitlePatches(
     const uint32_t title_id, const std::optional<uint64_t> hash) {
   std::vector<PatchFileEntry> title_patches;
+  if (all_patches_loaded_) {
+    std::copy_if(loaded_patches_.cbegin(), loaded_patches_.cend(),
+                 std::back_inserter(title_patches),
+                 [=](const PatchFileEntry& entry) {
+                   return IsForModule(entry.title_id, entry.hashes, title_id,
+                                      hash);
+                 });
+    return title_patches;
+  }
 
-  std::copy_if(
-      loaded_patches_.cbegin(), loaded_patches_.cend(),
-      std::back_inserter(title_patches), [=](const PatchFileEntry entry) {
-        bool hash_exist = std::find(entry.hashes.cbegin(), entry.hashes.cend(),
-                                    hash) != entry.hashes.cend();
-
-        return entry.title_id == title_id &&
-               (entry.hashes.empty() || hash_exist);
-      });
-
+  const std::filesystem::path patches_directory = patches_root_ / "patches";
+  for (const PatchIndexEntry& index_entry : index_) {
+    if (!IsForModule(index_entry.title_id, index_entry.hashes, title_id,
+                     hash)) {
+      continue;
+    }
+    PatchFileEntry patch_file =
+        ReadPatchFile(patches_directory / xe::to_path(index_entry.file_name));
+    // Could have been changed after indexing.
+    if (IsForModule(patch_file.title_id, patch_file.hashes, title_id, hash)) {
+      title_patches.push_back(std::move(patch_file));
+    }
+  }
   return title_patches;
 }
 
+std::vector<PatchFileEntry>& PatchDB::GetAllPatches() {
+  if (!all_patches_loaded_) {
+    all_patches_loaded_ = true;
+    const std::filesystem::path patches_directory = patches_root_ / "patches";
+    for (const PatchIndexEntry& index_entry : index_) {
+      if (index_entry.title_id == -1) {
+        continue;
+      }
+      PatchFileEntry patch_file =
+          ReadPatchFile(patches_directory / xe::to_path(index_entry.file_name));
+      if (patch_file.title_id != -1) {
+        loaded_patches_.push_back(std::move(patch_file));
+      }
+    }
+  }
+  return loaded_patches_;
+}
+
 void PatchDB::ReadHashes(PatchFileEntry& patch_entry,
                          std::shared_ptr<cpptoml::table> patch_toml_fields) {
   auto title_hashes = patch_toml_fields->get_array_of<std::string>("hash");
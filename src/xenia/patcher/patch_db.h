@@ -11,6 +11,7 @@
 #define XENIA_PATCH_DB_H_
 
 #include <cstring>
+#include <filesystem>
 #include <map>
 #include <optional>
 #include <regex>
@@ -82,6 +83,18 @@ enum class PatchDataType {
   kByteArray
 };
 
+// What's needed from a patch file to know whether it's for a module, to parse
+// only the files for the title being launched.
+struct PatchIndexEntry {
+  std::string file_name;
+  // For detecting changes to the file since it was indexed.
+  uint64_t file_size;
+  uint64_t write_timestamp;
+  // -1 if the file couldn't be parsed.
+  uint32_t title_id;
+  std::vector<uint64_t> hashes;
+};
+
 struct PatchData {
   uint8_t size;
   PatchDataType type;
@@ -101,14 +114,22 @@ class PatchDB {
                      const std::pair<std::string, PatchData> data_type,
                      const std::shared_ptr<cpptoml::table>& patch_table);
 
+  // Parses the patch files for the module.
   std::vector<PatchFileEntry> GetTitlePatches(
       const uint32_t title_id, const std::optional<uint64_t> hash);
-  std::vector<PatchFileEntry>& GetAllPatches() { return loaded_patches_; }
+  // Parses all the patch files on the first call.
+  std::vector<PatchFileEntry>& GetAllPatches();
 
  private:
   void ReadHashes(PatchFileEntry& patch_entry,
                   std::shared_ptr<cpptoml::table> patch_toml_fields);
 
+  std::filesystem::path GetIndexPath() const;
+  // Returns the entries stored in the index file, or an empty vector if it's
+  // missing or invalid.
+  std::vector<PatchIndexEntry> ReadIndex() const;
+  void WriteIndex() const;
+
   inline static const std::regex patch_filename_regex_ =
       std::regex("^[A-Fa-f0-9]{8}.*\\.patch\\.toml$");
 
@@ -123,6 +144,8 @@ class PatchDB {
       {"be16", PatchData(sizeof(uint16_t), PatchDataType::kBE16)},
       {"be8", PatchData(sizeof(uint8_t), PatchDataType::kBE8)}};
 
+  std::vector<PatchIndexEntry> index_;
+  bool all_patches_loaded_ = false;
   std::vector<PatchFileEntry> loaded_patches_;
   std::filesystem::path patches_root_;
 };
@@ -9,6 +9,7 @@
 #include <cstring>
 
 #include "xenia/base/logging.h"
+#include "xenia/cpu/processor.h"
 #include "xenia/patcher/patcher.h"
 
 namespace xe {
@@ -20,7 +21,8 @@ Patcher::Patcher(const std::filesystem::path patches_root) {
 }
 
 void Patcher::ApplyPatchesForTitle(Memory* memory, const uint32_t title_id,
-                                   const std::optional<uint64_t> hash) {
+                                   const std::optional<uint64_t> hash,
+                                   cpu::Processor* processor) {
   const auto title_patches = patch_db_->GetTitlePatches(title_id, hash);
 
   for (const PatchFileEntry& patchFile : title_patches) {
@@ -30,12 +32,13 @@ void Patcher::ApplyPatchesForTitle(Memory* memory, const uint32_t title_id,
       }
       XELOGE("Patcher: Applying patch for: {}({:08X}) - {}",
              patchFile.title_name, patchFile.title_id, patchEntry.patch_name);
-      ApplyPatch(memory, &patchEntry);
+      ApplyPatch(memory, &patchEntry, processor);
     }
   }
 }
 
-void Patcher::ApplyPatch(Memory* memory, const PatchInfoEntry* patch) {
+void Patcher::ApplyPatch(Memory* memory, const PatchInfoEntry* patch,
+                         cpu::Processor* processor) {
   for (const PatchDataEntry& patch_data_entry : patch->patch_data) {
     uint32_t old_address_protect = 0;
     uint8_t* address = memory->TranslateVirtual(patch_data_entry.address);
@@ -58,6 +61,16 @@ void Patcher::ApplyPatch(Memory* memory, const PatchInfoEntry* patch) {
                   (uint32_t)patch_data_entry.data.alloc_size,
                   old_address_protect);
 
+    if (processor) {
+      size_t invalidated_count = processor->InvalidateFunctionsInRange(
+          patch_data_entry.address,
+          uint32_t(patch_data_entry.data.alloc_size));
+      if (invalidated_count) {
+        XELOGI("Patcher: Retranslated {} functions patched at {:08X}",
+               invalidated_count, patch_data_entry.address);
+      }
+    }
+
     is_any_patch_applied_ = true;
   }
 }
@@ -13,6 +13,12 @@
 #include "xenia/memory.h"
 #include "xenia/patcher/patch_db.h"
 
+namespace xe {
+namespace cpu {
+class Processor;
+}  // namespace cpu
+}  // namespace xe
+
 namespace xe {
 namespace patcher {
 
@@ -20,9 +26,13 @@ class Patcher {
  public:
   Patcher(const std::filesystem::path patches_root);
 
-  void ApplyPatch(Memory* memory, const PatchInfoEntry* patch);
+  // If the processor is provided, the functions already translated from the
+  // patched code are retranslated.
+  void ApplyPatch(Memory* memory, const PatchInfoEntry* patch,
+                  cpu::Processor* processor = nullptr);
   void ApplyPatchesForTitle(Memory* memory, const uint32_t title_id,
-                            const std::optional<uint64_t> hash);
+                            const std::optional<uint64_t> hash,
+                            cpu::Processor* processor = nullptr);
 
   bool IsAnyPatchApplied() { return is_any_patch_applied_; }
 
@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/system_heap_pool.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_stream.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/memory.h"
+
+namespace xe {
+
+SystemHeapPool::SystemHeapPool(Memory* memory, BaseHeap* heap)
+    : memory_(memory), heap_(heap) {}
+
+uint32_t SystemHeapPool::Alloc(uint32_t size, uint32_t alignment) {
+  uint32_t object_size = std::max(std::max(size, alignment), uint32_t(1));
+  uint32_t object_size_log2 =
+      std::max(kMinObjectSizeLog2, xe::log2_ceil(object_size));
+  if (object_size_log2 > kMaxObjectSizeLog2) {
+    return 0;
+  }
+  uint32_t size_class_index = object_size_log2 - kMinObjectSizeLog2;
+  object_size = uint32_t(1) << object_size_log2;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  SizeClass& size_class = size_classes_[size_class_index];
+  if (size_class.partial_slabs.empty()) {
+    uint32_t slab_base;
+    if (!heap_->AllocSystemHeap(
+            kSlabSize, kSlabSize,
+            kMemoryAllocationReserve | kMemoryAllocationCommit,
+            kMemoryProtectRead | kMemoryProtectWrite, false, &slab_base)) {
+      return 0;
+    }
+    slabs_.emplace(slab_base, Slab{size_class_index, 0, 0, 0});
+    size_class.partial_slabs.push_back(slab_base);
+  }
+  uint32_t slab_base = size_class.partial_slabs.back();
+  Slab& slab = slabs_[slab_base];
+  uint32_t address;
+  if (slab.free_head) {
+    address = slab.free_head;
+    slab.free_head = *memory_->TranslateVirtual<uint32_t*>(address);
+  } else {
+    assert_true(slab.bump_offset + object_size <= kSlabSize);
+    address = slab_base + slab.bump_offset;
+    slab.bump_offset += object_size;
+  }
+  ++slab.used_count;
+  if (!slab.free_head && slab.bump_offset >= kSlabSize) {
+    size_class.partial_slabs.pop_back();
+  }
+  return address;
+}
+
+bool SystemHeapPool::Free(uint32_t address) {
+  uint32_t slab_base = address & ~(kSlabSize - 1);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto slab_it = slabs_.find(slab_base);
+  if (slab_it == slabs_.end()) {
+    return false;
+  }
+  Slab& slab = slab_it->second;
+  assert_not_zero(slab.used_count);
+  SizeClass& size_class = size_classes_[slab.size_class];
+  bool was_full = !slab.free_head && slab.bump_offset >= kSlabSize;
+  if (!--slab.used_count && (was_full || size_class.partial_slabs.size() > 1)) {
+    if (!was_full) {
+      auto partial_it = std::find(size_class.partial_slabs.begin(),
+                                  size_class.partial_slabs.end(), slab_base);
+      assert_true(partial_it != size_class.partial_slabs.end());
+      size_class.partial_slabs.erase(partial_it);
+    }
+    slabs_.erase(slab_it);
+    heap_->Release(slab_base);
+    return true;
+  }
+  *memory_->TranslateVirtual<uint32_t*>(address) = slab.free_head;
+  slab.free_head = address;
+  if (was_full) {
+    size_class.partial_slabs.push_back(slab_base);
+  }
+  return true;
+}
+
+void SystemHeapPool::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (SizeClass& size_class : size_classes_) {
+    size_class.partial_slabs.clear();
+  }
+  slabs_.clear();
+}
+
+void SystemHeapPool::Save(ByteStream* stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stream->Write(uint32_t(slabs_.size()));
+  for (const auto& slab : slabs_) {
+    stream->Write(slab.first);
+    stream->Write(slab.second);
+  }
+}
+
+bool SystemHeapPool::Restore(ByteStream* stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (SizeClass& size_class : size_classes_) {
+    size_class.partial_slabs.clear();
+  }
+  slabs_.clear();
+  uint32_t slab_count = stream->Read<uint32_t>();
+  for (uint32_t i = 0; i < slab_count; ++i) {
+    uint32_t slab_base = stream->Read<uint32_t>();
+    Slab slab = stream->Read<Slab>();
+    if (slab.size_class >= kSizeClassCount) {
+      XELOGE("Invalid system heap pool slab size class {}", slab.size_class);
+      return false;
+    }
+    slabs_.emplace(slab_base, slab);
+    if (slab.free_head || slab.bump_offset < kSlabSize) {
+      size_classes_[slab.size_class].partial_slabs.push_back(slab_base);
+    }
+  }
+  return true;
+}
+
+}  // namespace xe
@@ -0,0 +1,85 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_SYSTEM_HEAP_POOL_H_
+#define XENIA_SYSTEM_HEAP_POOL_H_
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace xe {
+
+class BaseHeap;
+class ByteStream;
+class Memory;
+
+// Slab allocator for the small system heap allocations, such as kernel
+// objects, which otherwise would take a whole page each, and would need a
+// search in the page table of the heap for every allocation.
+//
+// Slabs of kSlabSize are allocated from the heap for every power-of-two size
+// class, and objects are bump-allocated from them, with the freed ones kept in
+// a list in each slab like in SimpleFreelist. The next free object address is
+// stored in the first bytes of each free object in the guest memory, which is
+// zeroed on allocation. Slabs are returned to the heap once they're empty,
+// unless it's the last slab with free space in the class.
+class SystemHeapPool {
+ public:
+  static constexpr uint32_t kSlabSize = 64 * 1024;
+  static constexpr uint32_t kMinObjectSizeLog2 = 4;
+  static constexpr uint32_t kMaxObjectSizeLog2 = 11;
+
+  SystemHeapPool(Memory* memory, BaseHeap* heap);
+  SystemHeapPool(const SystemHeapPool& pool) = delete;
+  SystemHeapPool& operator=(const SystemHeapPool& pool) = delete;
+
+  // Returns 0 if the allocation is too large for the pool or the heap is full,
+  // the memory is not zeroed.
+  uint32_t Alloc(uint32_t size, uint32_t alignment);
+  // Returns false if the address was not allocated from the pool.
+  bool Free(uint32_t address);
+
+  // Forgets all slabs, for when the heap has been reset.
+  void Reset();
+
+  void Save(ByteStream* stream);
+  bool Restore(ByteStream* stream);
+
+ private:
+  struct Slab {
+    uint32_t size_class;
+    uint32_t used_count;
+    // Guest address of the first object in the free list, or 0.
+    uint32_t free_head;
+    // Offset of the first object never allocated.
+    uint32_t bump_offset;
+  };
+
+  struct SizeClass {
+    // Bases of the slabs with free space.
+    std::vector<uint32_t> partial_slabs;
+  };
+
+  static constexpr uint32_t kSizeClassCount =
+      kMaxObjectSizeLog2 - kMinObjectSizeLog2 + 1;
+
+  Memory* memory_;
+  BaseHeap* heap_;
+
+  std::mutex mutex_;
+  std::array<SizeClass, kSizeClassCount> size_classes_;
+  std::unordered_map<uint32_t, Slab> slabs_;
+};
+
+}  // namespace xe
+
+#endif  // XENIA_SYSTEM_HEAP_POOL_H_
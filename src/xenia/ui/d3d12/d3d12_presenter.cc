@@ -18,6 +18,7 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/string.h"
 #include "xenia/ui/d3d12/d3d12_provider.h"
 #include "xenia/ui/d3d12/d3d12_util.h"
 #include "xenia/ui/surface_win.h"
@@ -52,6 +53,17 @@ D3D12Presenter::~D3D12Presenter() {
   // From most likely the latest to most likely the earliest to be signaled, so
   // just one sleep will likely be needed.
   paint_context_.AwaitSwapChainUsageCompletion();
+  ShutdownSharedGuestOutputImages();
+  if (shared_guest_output_fence_handle_) {
+    CloseHandle(shared_guest_output_fence_handle_);
+  }
+  for (const GuestOutputAsyncRefresh& guest_output_async_refresh :
+       guest_output_async_refreshes_) {
+    if (guest_output_async_refresh.fence) {
+      guest_output_async_refresh.fence->SetEventOnCompletion(
+          guest_output_async_refresh.fence_value, nullptr);
+    }
+  }
   guest_output_resource_refresher_submission_tracker_.Shutdown();
   ui_submission_tracker_.Shutdown();
 }
@@ -66,6 +78,9 @@ Surface::TypeFlags D3D12Presenter::GetSupportedSurfaceTypes() const {
 
 bool D3D12Presenter::CaptureGuestOutput(RawImage& image_out) {
   Microsoft::WRL::ComPtr<ID3D12Resource> guest_output_resource;
+  // Not taking the ownership of the state transition, leaving the texture in
+  // the same state for painting.
+  GuestOutputAsyncRefresh guest_output_async_refresh;
   {
     uint32_t guest_output_mailbox_index;
     std::unique_lock<std::mutex> guest_output_consumer_lock(
@@ -73,6 +88,8 @@ bool D3D12Presenter::CaptureGuestOutput(RawImage& image_out) {
     if (guest_output_mailbox_index != UINT32_MAX) {
       guest_output_resource =
           guest_output_resources_[guest_output_mailbox_index].second;
+      guest_output_async_refresh =
+          guest_output_async_refreshes_[guest_output_mailbox_index];
     }
     // Incremented the reference count of the guest output resource - safe to
     // leave the consumer critical section now.
@@ -127,10 +144,11 @@ bool D3D12Presenter::CaptureGuestOutput(RawImage& image_out) {
     barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
     barrier.Transition.pResource = guest_output_resource.Get();
     barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-    barrier.Transition.StateBefore = kGuestOutputInternalState;
+    barrier.Transition.StateBefore =
+        guest_output_async_refresh.fence ? D3D12_RESOURCE_STATE_UNORDERED_ACCESS
+                                         : kGuestOutputInternalState;
     barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
-    if constexpr (kGuestOutputInternalState !=
-                  D3D12_RESOURCE_STATE_COPY_SOURCE) {
+    if (barrier.Transition.StateBefore != barrier.Transition.StateAfter) {
       command_list->ResourceBarrier(1, &barrier);
     }
     copy_dest.pResource = buffer.Get();
@@ -140,8 +158,7 @@ bool D3D12Presenter::CaptureGuestOutput(RawImage& image_out) {
     copy_source.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
     copy_source.SubresourceIndex = 0;
     command_list->CopyTextureRegion(&copy_dest, 0, 0, 0, &copy_source, nullptr);
-    if constexpr (kGuestOutputInternalState !=
-                  D3D12_RESOURCE_STATE_COPY_SOURCE) {
+    if (barrier.Transition.StateBefore != barrier.Transition.StateAfter) {
       std::swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
       command_list->ResourceBarrier(1, &barrier);
     }
@@ -163,6 +180,10 @@ bool D3D12Presenter::CaptureGuestOutput(RawImage& image_out) {
     if (!submission_tracker.Initialize(device, direct_queue)) {
       return false;
     }
+    if (guest_output_async_refresh.fence) {
+      direct_queue->Wait(guest_output_async_refresh.fence.Get(),
+                         guest_output_async_refresh.fence_value);
+    }
     ID3D12CommandList* execute_command_list = command_list.Get();
     direct_queue->ExecuteCommandLists(1, &execute_command_list);
     if (!submission_tracker.NextSubmission()) {
@@ -206,6 +227,222 @@ bool D3D12Presenter::CaptureGuestOutput(RawImage& image_out) {
   return true;
 }
 
+bool D3D12Presenter::ExportGuestOutput(SharedGuestOutputFrame& frame_out) {
+  Microsoft::WRL::ComPtr<ID3D12Resource> guest_output_resource;
+  // Not taking the ownership of the state transition, leaving the texture in
+  // the same state for painting, like in CaptureGuestOutput.
+  GuestOutputAsyncRefresh guest_output_async_refresh;
+  {
+    uint32_t guest_output_mailbox_index;
+    std::unique_lock<std::mutex> guest_output_consumer_lock(
+        ConsumeGuestOutput(guest_output_mailbox_index, nullptr, nullptr));
+    if (guest_output_mailbox_index != UINT32_MAX) {
+      guest_output_resource =
+          guest_output_resources_[guest_output_mailbox_index].second;
+      guest_output_async_refresh =
+          guest_output_async_refreshes_[guest_output_mailbox_index];
+    }
+  }
+  if (!guest_output_resource) {
+    return false;
+  }
+
+  ID3D12Device* device = provider_.GetDevice();
+  D3D12_RESOURCE_DESC texture_desc = guest_output_resource->GetDesc();
+  uint32_t width = uint32_t(texture_desc.Width);
+  uint32_t height = uint32_t(texture_desc.Height);
+
+  std::lock_guard<std::mutex> shared_lock(shared_guest_output_mutex_);
+
+  if (!shared_guest_output_fence_) {
+    if (FAILED(device->CreateFence(
+            0, D3D12_FENCE_FLAG_SHARED,
+            IID_PPV_ARGS(&shared_guest_output_fence_)))) {
+      XELOGE("D3D12Presenter: Failed to create the guest output export fence");
+      return false;
+    }
+    shared_guest_output_fence_name_ =
+        fmt::format("Local\\XeniaGuestOutputFence{}", GetCurrentProcessId());
+    if (FAILED(device->CreateSharedHandle(
+            shared_guest_output_fence_.Get(), nullptr, GENERIC_ALL,
+            reinterpret_cast<LPCWSTR>(
+                xe::to_utf16(shared_guest_output_fence_name_).c_str()),
+            &shared_guest_output_fence_handle_))) {
+      XELOGE(
+          "D3D12Presenter: Failed to share the guest output export fence");
+      shared_guest_output_fence_.Reset();
+      return false;
+    }
+  }
+
+  if (shared_guest_output_width_ != width ||
+      shared_guest_output_height_ != height) {
+    ShutdownSharedGuestOutputImages();
+    ++shared_guest_output_generation_;
+    // Same as the guest output texture, but without UAV usage, which is not
+    // needed for copying.
+    D3D12_RESOURCE_DESC shared_desc = texture_desc;
+    shared_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    for (uint32_t i = 0; i < kSharedGuestOutputImageCount; ++i) {
+      SharedGuestOutputImage& image = shared_guest_output_images_[i];
+      if (FAILED(device->CreateCommittedResource(
+              &util::kHeapPropertiesDefault, D3D12_HEAP_FLAG_SHARED,
+              &shared_desc, D3D12_RESOURCE_STATE_COMMON, nullptr,
+              IID_PPV_ARGS(&image.resource)))) {
+        XELOGE(
+            "D3D12Presenter: Failed to create a {}x{} guest output export "
+            "image",
+            width, height);
+        ShutdownSharedGuestOutputImages();
+        return false;
+      }
+      image.name = fmt::format("Local\\XeniaGuestOutput{}_{}_{}",
+                               GetCurrentProcessId(),
+                               shared_guest_output_generation_, i);
+      if (FAILED(device->CreateSharedHandle(
+              image.resource.Get(), nullptr, GENERIC_ALL,
+              reinterpret_cast<LPCWSTR>(xe::to_utf16(image.name).c_str()),
+              &image.handle))) {
+        XELOGE("D3D12Presenter: Failed to share a guest output export image");
+        ShutdownSharedGuestOutputImages();
+        return false;
+      }
+      if (FAILED(device->CreateCommandAllocator(
+              D3D12_COMMAND_LIST_TYPE_DIRECT,
+              IID_PPV_ARGS(&image.command_allocator)))) {
+        XELOGE(
+            "D3D12Presenter: Failed to create a guest output export command "
+            "allocator");
+        ShutdownSharedGuestOutputImages();
+        return false;
+      }
+    }
+    shared_guest_output_width_ = width;
+    shared_guest_output_height_ = height;
+    shared_guest_output_next_image_ = 0;
+  }
+
+  uint32_t image_index = shared_guest_output_next_image_;
+  SharedGuestOutputImage& image = shared_guest_output_images_[image_index];
+  // The only CPU wait, for reusing the command allocator, which happens only if
+  // the GPU is behind by the whole ring.
+  if (shared_guest_output_fence_->GetCompletedValue() < image.fence_value) {
+    shared_guest_output_fence_->SetEventOnCompletion(image.fence_value,
+                                                     nullptr);
+  }
+  if (FAILED(image.command_allocator->Reset())) {
+    XELOGE(
+        "D3D12Presenter: Failed to reset a guest output export command "
+        "allocator");
+    return false;
+  }
+  if (!shared_guest_output_command_list_) {
+    if (FAILED(device->CreateCommandList(
+            0, D3D12_COMMAND_LIST_TYPE_DIRECT, image.command_allocator.Get(),
+            nullptr, IID_PPV_ARGS(&shared_guest_output_command_list_)))) {
+      XELOGE(
+          "D3D12Presenter: Failed to create the guest output export command "
+          "list");
+      return false;
+    }
+  } else if (FAILED(shared_guest_output_command_list_->Reset(
+                 image.command_allocator.Get(), nullptr))) {
+    XELOGE(
+        "D3D12Presenter: Failed to reset the guest output export command list");
+    return false;
+  }
+  ID3D12GraphicsCommandList* command_list =
+      shared_guest_output_command_list_.Get();
+
+  D3D12_RESOURCE_BARRIER barriers[2];
+  UINT barrier_count = 0;
+  D3D12_RESOURCE_BARRIER& source_barrier = barriers[barrier_count];
+  source_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+  source_barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+  source_barrier.Transition.pResource = guest_output_resource.Get();
+  source_barrier.Transition.Subresource =
+      D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+  source_barrier.Transition.StateBefore =
+      guest_output_async_refresh.fence ? D3D12_RESOURCE_STATE_UNORDERED_ACCESS
+                                       : kGuestOutputInternalState;
+  source_barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+  bool source_transition = source_barrier.Transition.StateBefore !=
+                           source_barrier.Transition.StateAfter;
+  if (source_transition) {
+    ++barrier_count;
+  }
+  D3D12_RESOURCE_BARRIER& dest_barrier = barriers[barrier_count++];
+  dest_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+  dest_barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+  dest_barrier.Transition.pResource = image.resource.Get();
+  dest_barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+  dest_barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COMMON;
+  dest_barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
+  command_list->ResourceBarrier(barrier_count, barriers);
+  command_list->CopyResource(image.resource.Get(),
+                             guest_output_resource.Get());
+  // Returning the shared image to the common state for the consumer's queue.
+  for (UINT i = 0; i < barrier_count; ++i) {
+    std::swap(barriers[i].Transition.StateBefore,
+              barriers[i].Transition.StateAfter);
+  }
+  command_list->ResourceBarrier(barrier_count, barriers);
+  if (FAILED(command_list->Close())) {
+    XELOGE(
+        "D3D12Presenter: Failed to close the guest output export command list");
+    return false;
+  }
+
+  ID3D12CommandQueue* direct_queue = provider_.GetDirectQueue();
+  if (guest_output_async_refresh.fence) {
+    direct_queue->Wait(guest_output_async_refresh.fence.Get(),
+                       guest_output_async_refresh.fence_value);
+  }
+  ID3D12CommandList* execute_command_list = command_list;
+  direct_queue->ExecuteCommandLists(1, &execute_command_list);
+  UINT64 fence_value = shared_guest_output_fence_value_ + 1;
+  if (FAILED(direct_queue->Signal(shared_guest_output_fence_.Get(),
+                                  fence_value))) {
+    XELOGE("D3D12Presenter: Failed to signal the guest output export fence");
+    return false;
+  }
+  shared_guest_output_fence_value_ = fence_value;
+  image.fence_value = fence_value;
+  shared_guest_output_next_image_ =
+      (image_index + 1) % kSharedGuestOutputImageCount;
+
+  frame_out.width = width;
+  frame_out.height = height;
+  frame_out.format = uint32_t(kGuestOutputFormat);
+  frame_out.image_name = image.name;
+  frame_out.image_index = image_index;
+  frame_out.image_generation = shared_guest_output_generation_;
+  frame_out.fence_name = shared_guest_output_fence_name_;
+  frame_out.fence_value = fence_value;
+  return true;
+}
+
+void D3D12Presenter::ShutdownSharedGuestOutputImages() {
+  if (shared_guest_output_fence_ &&
+      shared_guest_output_fence_->GetCompletedValue() <
+          shared_guest_output_fence_value_) {
+    shared_guest_output_fence_->SetEventOnCompletion(
+        shared_guest_output_fence_value_, nullptr);
+  }
+  for (SharedGuestOutputImage& image : shared_guest_output_images_) {
+    if (image.handle) {
+      CloseHandle(image.handle);
+      image.handle = nullptr;
+    }
+    image.resource.Reset();
+    image.name.clear();
+    image.command_allocator.Reset();
+    image.fence_value = 0;
+  }
+  shared_guest_output_width_ = 0;
+  shared_guest_output_height_ = 0;
+}
+
 Presenter::SurfacePaintConnectResult
 D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
     Surface& new_surface, uint32_t new_surface_width,
@@ -234,13 +471,18 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
          paint_context_.swap_chain_buffers) {
       swap_chain_buffer_ref.Reset();
     }
+    // The waitable object flag can't be toggled by ResizeBuffers either.
+    UINT swap_chain_flags = 0;
+    if (paint_context_.swap_chain_allows_tearing) {
+      swap_chain_flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+    }
+    if (paint_context_.swap_chain_frame_latency_waitable_object) {
+      swap_chain_flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    }
     bool swap_chain_resized =
         SUCCEEDED(paint_context_.swap_chain->ResizeBuffers(
             0, UINT(new_swap_chain_width), UINT(new_swap_chain_height),
-            DXGI_FORMAT_UNKNOWN,
-            paint_context_.swap_chain_allows_tearing
-                ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING
-                : 0));
+            DXGI_FORMAT_UNKNOWN, swap_chain_flags));
     if (swap_chain_resized) {
       for (uint32_t i = 0; i < PaintContext::kSwapChainBufferCount; ++i) {
         if (FAILED(paint_context_.swap_chain->GetBuffer(
@@ -291,6 +533,12 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
       // rate.
       swap_chain_desc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
     }
+    if (cvars::present_low_latency) {
+      // Wait for the swap chain to be able to accept a frame before painting
+      // rather than having frames queued.
+      swap_chain_desc.Flags |=
+          DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    }
     IDXGIFactory2* dxgi_factory = provider_.GetDXGIFactory();
     ID3D12CommandQueue* direct_queue = provider_.GetDirectQueue();
     Microsoft::WRL::ComPtr<IDXGISwapChain1> swap_chain_1;
@@ -333,6 +581,14 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
     paint_context_.swap_chain_height = new_swap_chain_height;
     paint_context_.swap_chain_allows_tearing =
         (swap_chain_desc.Flags & DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING) != 0;
+    if (swap_chain_desc.Flags &
+        DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) {
+      if (FAILED(paint_context_.swap_chain->SetMaximumFrameLatency(1))) {
+        XELOGW("D3D12Presenter: Failed to set the maximum frame latency of 1");
+      }
+      paint_context_.swap_chain_frame_latency_waitable_object =
+          paint_context_.swap_chain->GetFrameLatencyWaitableObject();
+    }
     for (uint32_t i = 0; i < PaintContext::kSwapChainBufferCount; ++i) {
       if (FAILED(paint_context_.swap_chain->GetBuffer(
               i, IID_PPV_ARGS(&paint_context_.swap_chain_buffers[i])))) {
@@ -390,6 +646,13 @@ bool D3D12Presenter::RefreshGuestOutputImpl(
       // in its own submission tracker timeline, safe to release here.
       guest_output_resource_refresher_submission_tracker_
           .AwaitSubmissionCompletion(guest_output_resource_ref.first);
+      GuestOutputAsyncRefresh& guest_output_async_refresh =
+          guest_output_async_refreshes_[mailbox_index];
+      if (guest_output_async_refresh.fence) {
+        guest_output_async_refresh.fence->SetEventOnCompletion(
+            guest_output_async_refresh.fence_value, nullptr);
+        guest_output_async_refresh.fence.Reset();
+      }
       guest_output_resource_ref.second.Reset();
     }
   }
@@ -419,9 +682,18 @@ bool D3D12Presenter::RefreshGuestOutputImpl(
       return false;
     }
   }
+  GuestOutputAsyncRefresh& guest_output_async_refresh =
+      guest_output_async_refreshes_[mailbox_index];
   D3D12GuestOutputRefreshContext context(
-      is_8bpc_out_ref, guest_output_resource_ref.second.Get());
+      is_8bpc_out_ref, guest_output_resource_ref.second.Get(),
+      guest_output_async_refresh.fence ? D3D12_RESOURCE_STATE_UNORDERED_ACCESS
+                                       : kGuestOutputInternalState);
   bool refresher_succeeded = refresher(context);
+  // The refresher must order its writes after the previous asynchronous
+  // refresh, if it hasn't been painted.
+  guest_output_async_refresh.fence = context.async_completion_fence();
+  guest_output_async_refresh.fence_value =
+      context.async_completion_fence_value();
   // Even if the refresher has returned false, it still might have submitted
   // some commands referencing the resource. It's better to put an excessive
   // signal and wait slightly longer, for nothing important, while shutting down
@@ -442,6 +714,10 @@ void D3D12Presenter::PaintContext::DestroySwapChain() {
        swap_chain_buffers) {
     swap_chain_buffer_ref.Reset();
   }
+  if (swap_chain_frame_latency_waitable_object) {
+    CloseHandle(swap_chain_frame_latency_waitable_object);
+    swap_chain_frame_latency_waitable_object = nullptr;
+  }
   swap_chain.Reset();
   swap_chain_allows_tearing = false;
   swap_chain_height = 0;
@@ -450,6 +726,14 @@ void D3D12Presenter::PaintContext::DestroySwapChain() {
 
 Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
     bool execute_ui_drawers) {
+  // For low-latency presentation, wait until the swap chain can take a new
+  // frame before painting it, so it's painted from the latest guest output.
+  // With a timeout in case the presentation gets stuck for some reason.
+  if (paint_context_.swap_chain_frame_latency_waitable_object) {
+    WaitForSingleObjectEx(
+        paint_context_.swap_chain_frame_latency_waitable_object, 1000, TRUE);
+  }
+
   // Begin the command list with the command allocator not currently potentially
   // used on the GPU.
   UINT64 current_paint_submission =
@@ -491,6 +775,9 @@ Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
   GuestOutputProperties guest_output_properties;
   GuestOutputPaintConfig guest_output_paint_config;
   Microsoft::WRL::ComPtr<ID3D12Resource> guest_output_resource;
+  // Taking the ownership of the transition to kGuestOutputInternalState if
+  // refreshed asynchronously.
+  GuestOutputAsyncRefresh guest_output_async_refresh;
   {
     uint32_t guest_output_mailbox_index;
     std::unique_lock<std::mutex> guest_output_consumer_lock(
@@ -499,6 +786,8 @@ Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
     if (guest_output_mailbox_index != UINT32_MAX) {
       guest_output_resource =
           guest_output_resources_[guest_output_mailbox_index].second;
+      guest_output_async_refresh = std::move(
+          guest_output_async_refreshes_[guest_output_mailbox_index]);
     }
     // Incremented the reference count of the guest output resource - safe to
     // leave the consumer critical section now as everything here either will be
@@ -506,6 +795,19 @@ Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
     // (and multiple threads can't paint the main target at the same time).
   }
 
+  if (guest_output_async_refresh.fence) {
+    D3D12_RESOURCE_BARRIER guest_output_barrier;
+    guest_output_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    guest_output_barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    guest_output_barrier.Transition.pResource = guest_output_resource.Get();
+    guest_output_barrier.Transition.Subresource =
+        D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    guest_output_barrier.Transition.StateBefore =
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    guest_output_barrier.Transition.StateAfter = kGuestOutputInternalState;
+    command_list->ResourceBarrier(1, &guest_output_barrier);
+  }
+
   if (guest_output_resource) {
     GuestOutputPaintFlow guest_output_flow = GetGuestOutputPaintFlow(
         guest_output_properties, paint_context_.swap_chain_width,
@@ -1053,8 +1355,13 @@ Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
 
   // Execute and present.
   command_list->Close();
+  ID3D12CommandQueue* direct_queue = provider_.GetDirectQueue();
+  if (guest_output_async_refresh.fence) {
+    direct_queue->Wait(guest_output_async_refresh.fence.Get(),
+                       guest_output_async_refresh.fence_value);
+  }
   ID3D12CommandList* execute_command_list = command_list;
-  provider_.GetDirectQueue()->ExecuteCommandLists(1, &execute_command_list);
+  direct_queue->ExecuteCommandLists(1, &execute_command_list);
   if (execute_ui_drawers) {
     ui_submission_tracker_.NextSubmission();
   }
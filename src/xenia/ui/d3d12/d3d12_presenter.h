@@ -12,6 +12,8 @@
 
 #include <array>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <utility>
 
 #include "xenia/base/math.h"
@@ -63,21 +65,48 @@ class D3D12Presenter final : public Presenter {
   // The format used internally by Windows composition.
   static constexpr DXGI_FORMAT kSwapChainFormat = DXGI_FORMAT_B8G8R8A8_UNORM;
 
-  // The callback must use the main direct queue of the provider.
+  // The callback must use the main direct queue of the provider, unless it
+  // calls SetAsyncCompletion.
   class D3D12GuestOutputRefreshContext final
       : public GuestOutputRefreshContext {
    public:
     D3D12GuestOutputRefreshContext(bool& is_8bpc_out_ref,
-                                   ID3D12Resource* resource)
-        : GuestOutputRefreshContext(is_8bpc_out_ref), resource_(resource) {}
+                                   ID3D12Resource* resource,
+                                   D3D12_RESOURCE_STATES resource_state)
+        : GuestOutputRefreshContext(is_8bpc_out_ref),
+          resource_(resource),
+          resource_state_(resource_state) {}
 
     // kGuestOutputFormat, supports UAV. The initial state in the callback is
-    // kGuestOutputInternalState, and the callback must also transition it back
-    // to kGuestOutputInternalState before finishing.
+    // resource_state(), and the callback must transition it to
+    // kGuestOutputInternalState before finishing, unless it calls
+    // SetAsyncCompletion.
     ID3D12Resource* resource_uav_capable() const { return resource_.Get(); }
+    // kGuestOutputInternalState, or D3D12_RESOURCE_STATE_UNORDERED_ACCESS if
+    // it was refreshed asynchronously previously, but not painted since then.
+    D3D12_RESOURCE_STATES resource_state() const { return resource_state_; }
+
+    // For writing the resource on a compute queue, where
+    // kGuestOutputInternalState is not a valid state. The callback must leave
+    // the resource in D3D12_RESOURCE_STATE_UNORDERED_ACCESS instead, and the
+    // fence must reach the value after the writing is completed. Usage of the
+    // resource in the presenter will await the fence on the direct queue.
+    void SetAsyncCompletion(ID3D12Fence* fence, UINT64 fence_value) {
+      async_completion_fence_ = fence;
+      async_completion_fence_value_ = fence_value;
+    }
+    ID3D12Fence* async_completion_fence() const {
+      return async_completion_fence_.Get();
+    }
+    UINT64 async_completion_fence_value() const {
+      return async_completion_fence_value_;
+    }
 
    private:
     Microsoft::WRL::ComPtr<ID3D12Resource> resource_;
+    D3D12_RESOURCE_STATES resource_state_;
+    Microsoft::WRL::ComPtr<ID3D12Fence> async_completion_fence_;
+    UINT64 async_completion_fence_value_ = 0;
   };
 
   static std::unique_ptr<D3D12Presenter> Create(
@@ -98,6 +127,7 @@ class D3D12Presenter final : public Presenter {
   Surface::TypeFlags GetSupportedSurfaceTypes() const override;
 
   bool CaptureGuestOutput(RawImage& image_out) override;
+  bool ExportGuestOutput(SharedGuestOutputFrame& frame_out) override;
 
   void AwaitUISubmissionCompletionFromUIThread(UINT64 submission_index) {
     ui_submission_tracker_.AwaitSubmissionCompletion(submission_index);
@@ -269,6 +299,10 @@ class D3D12Presenter final : public Presenter {
     uint32_t swap_chain_height = 0;
     bool swap_chain_allows_tearing = false;
     Microsoft::WRL::ComPtr<IDXGISwapChain3> swap_chain;
+    // For the low-latency presentation, signaled when the swap chain is ready
+    // to accept a new frame, in which case the swap chain has
+    // DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT.
+    HANDLE swap_chain_frame_latency_waitable_object = nullptr;
     std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, kSwapChainBufferCount>
         swap_chain_buffers;
   };
@@ -307,6 +341,18 @@ class D3D12Presenter final : public Presenter {
   std::array<std::pair<UINT64, Microsoft::WRL::ComPtr<ID3D12Resource>>,
              kGuestOutputMailboxSize>
       guest_output_resources_;
+  // For the guest output textures refreshed on a queue other than the direct
+  // queue, the fence to await before using the texture on the direct queue. If
+  // the fence is not null, the texture is in
+  // D3D12_RESOURCE_STATE_UNORDERED_ACCESS rather than
+  // kGuestOutputInternalState. The indices are the mailbox indices, reset when
+  // the texture is painted.
+  struct GuestOutputAsyncRefresh {
+    Microsoft::WRL::ComPtr<ID3D12Fence> fence;
+    UINT64 fence_value = 0;
+  };
+  std::array<GuestOutputAsyncRefresh, kGuestOutputMailboxSize>
+      guest_output_async_refreshes_;
   // The guest output resources are protected by two submission trackers - the
   // refresher ones (for writing to them via the guest_output_resources_
   // references) and the paint one (for presenting it via the
@@ -314,6 +360,32 @@ class D3D12Presenter final : public Presenter {
   // guest_output_resources_).
   D3D12SubmissionTracker guest_output_resource_refresher_submission_tracker_;
 
+  // Guest output export to other processes, protected by the mutex.
+  static constexpr uint32_t kSharedGuestOutputImageCount = 3;
+  struct SharedGuestOutputImage {
+    Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+    HANDLE handle = nullptr;
+    std::string name;
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> command_allocator;
+    // The value of the shared fence signaled after the last copy to the image.
+    UINT64 fence_value = 0;
+  };
+  // Awaits the completion of the copying and releases the images.
+  void ShutdownSharedGuestOutputImages();
+  std::mutex shared_guest_output_mutex_;
+  std::array<SharedGuestOutputImage, kSharedGuestOutputImageCount>
+      shared_guest_output_images_;
+  uint32_t shared_guest_output_width_ = 0;
+  uint32_t shared_guest_output_height_ = 0;
+  uint32_t shared_guest_output_generation_ = 0;
+  uint32_t shared_guest_output_next_image_ = 0;
+  Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>
+      shared_guest_output_command_list_;
+  Microsoft::WRL::ComPtr<ID3D12Fence> shared_guest_output_fence_;
+  HANDLE shared_guest_output_fence_handle_ = nullptr;
+  std::string shared_guest_output_fence_name_;
+  UINT64 shared_guest_output_fence_value_ = 0;
+
   // UI submission tracker with the submission index that can be given to UI
   // drawers (accessible from the UI thread only, at any time).
   D3D12SubmissionTracker ui_submission_tracker_;
@@ -77,6 +77,9 @@ D3D12Provider::~D3D12Provider() {
   if (device_ != nullptr) {
     device_->Release();
   }
+  if (dxgi_adapter3_ != nullptr) {
+    dxgi_adapter3_->Release();
+  }
   if (dxgi_factory_ != nullptr) {
     dxgi_factory_->Release();
   }
@@ -315,6 +318,10 @@ bool D3D12Provider::Initialize() {
     dxgi_factory->Release();
     return false;
   }
+  // For querying the video memory budget.
+  if (FAILED(adapter->QueryInterface(IID_PPV_ARGS(&dxgi_adapter3_)))) {
+    dxgi_adapter3_ = nullptr;
+  }
   adapter->Release();
 
   // Configure the Direct3D 12 debug info queue.
@@ -75,6 +75,29 @@ uint8_t* D3D12UploadBufferPool::RequestPartial(
   return reinterpret_cast<uint8_t*>(page->mapping_) + offset;
 }
 
+uint8_t* D3D12UploadBufferPool::Request(
+    ThreadContext& context, uint64_t submission_index, size_t size,
+    size_t alignment, ID3D12Resource** buffer_out, size_t* offset_out,
+    D3D12_GPU_VIRTUAL_ADDRESS* gpu_address_out) {
+  size_t offset;
+  const D3D12Page* page =
+      static_cast<const D3D12Page*>(GraphicsUploadBufferPool::Request(
+          context, submission_index, size, alignment, offset));
+  if (!page) {
+    return nullptr;
+  }
+  if (buffer_out) {
+    *buffer_out = page->buffer_.Get();
+  }
+  if (offset_out) {
+    *offset_out = offset;
+  }
+  if (gpu_address_out) {
+    *gpu_address_out = page->gpu_address_ + offset;
+  }
+  return reinterpret_cast<uint8_t*>(page->mapping_) + offset;
+}
+
 GraphicsUploadBufferPool::Page*
 D3D12UploadBufferPool::CreatePageImplementation() {
   D3D12_RESOURCE_DESC buffer_desc;
@@ -29,6 +29,11 @@ class D3D12UploadBufferPool : public GraphicsUploadBufferPool {
                           size_t alignment, ID3D12Resource** buffer_out,
                           size_t* offset_out, size_t* size_out,
                           D3D12_GPU_VIRTUAL_ADDRESS* gpu_address_out);
+  // Thread-safe.
+  uint8_t* Request(ThreadContext& context, uint64_t submission_index,
+                   size_t size, size_t alignment, ID3D12Resource** buffer_out,
+                   size_t* offset_out,
+                   D3D12_GPU_VIRTUAL_ADDRESS* gpu_address_out);
 
  protected:
   Page* CreatePageImplementation() override;
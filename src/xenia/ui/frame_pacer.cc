@@ -0,0 +1,210 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/ui/frame_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+
+DEFINE_bool(
+    present_frame_pacing, false,
+    "Present the guest frames at even intervals following the cadence of the "
+    "guest swaps, delaying the frames that are ready earlier than expected by "
+    "up to a half of the frame time, instead of presenting every frame as "
+    "soon as it's ready.",
+    "Display");
+
+namespace xe {
+namespace ui {
+
+namespace {
+// The cadence is estimated from the median of the latest guest frame times,
+// which is not affected by occasional hitches unlike the mean.
+constexpr uint32_t kCadenceFrameCount = 16;
+// Not pacing rates outside this range - likely loading screens or menus
+// updated on demand, or presentation faster than any display.
+constexpr double kCadenceMinMs = 4.0;
+constexpr double kCadenceMaxMs = 100.0;
+// Waits shorter than this are within the imprecision of sleeping anyway.
+constexpr double kWaitMinMs = 0.5;
+// Spinning instead of sleeping for the end of the wait, as sleep granularity
+// may be around 1 ms.
+constexpr std::chrono::microseconds kSpinDuration(1000);
+
+double DurationMs(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+}  // namespace
+
+bool FramePacer::IsPacingRequested() { return cvars::present_frame_pacing; }
+
+void FramePacer::History::GetMeanAndStddev(double& mean_out,
+                                           double& stddev_out) const {
+  if (!count) {
+    mean_out = 0.0;
+    stddev_out = 0.0;
+    return;
+  }
+  double sum = 0.0;
+  for (uint32_t i = 0; i < count; ++i) {
+    sum += values_ms[i];
+  }
+  double mean = sum / double(count);
+  double variance_sum = 0.0;
+  for (uint32_t i = 0; i < count; ++i) {
+    double deviation = values_ms[i] - mean;
+    variance_sum += deviation * deviation;
+  }
+  mean_out = mean;
+  stddev_out = std::sqrt(variance_sum / double(count));
+}
+
+double FramePacer::History::GetPercentile(double fraction) const {
+  if (!count) {
+    return 0.0;
+  }
+  std::array<float, kHistoryLength> sorted;
+  std::copy_n(values_ms.cbegin(), count, sorted.begin());
+  auto percentile = sorted.begin() +
+                    std::min(uint32_t(fraction * double(count)), count - 1);
+  std::nth_element(sorted.begin(), percentile, sorted.begin() + count);
+  return *percentile;
+}
+
+void FramePacer::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  guest_frame_times_.Reset();
+  present_intervals_.Reset();
+  present_delays_.Reset();
+  guest_frame_last_valid_ = false;
+  guest_frame_pending_ = false;
+  present_last_valid_ = false;
+}
+
+void FramePacer::OnGuestFrame() {
+  Clock::time_point now = Clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (guest_frame_last_valid_) {
+    guest_frame_times_.Push(float(DurationMs(now - guest_frame_last_)));
+  }
+  guest_frame_last_ = now;
+  guest_frame_last_valid_ = true;
+  guest_frame_pending_ = true;
+}
+
+double FramePacer::GetCadenceMs() const {
+  if (guest_frame_times_.count < kCadenceFrameCount) {
+    return 0.0;
+  }
+  std::array<float, kCadenceFrameCount> latest;
+  for (uint32_t i = 0; i < kCadenceFrameCount; ++i) {
+    uint32_t index =
+        (guest_frame_times_.next + kHistoryLength - 1 - i) % kHistoryLength;
+    latest[i] = guest_frame_times_.values_ms[index];
+  }
+  auto median = latest.begin() + kCadenceFrameCount / 2;
+  std::nth_element(latest.begin(), median, latest.end());
+  return *median;
+}
+
+void FramePacer::WaitForPresentTime() {
+  if (!IsPacingRequested()) {
+    return;
+  }
+  Clock::time_point present_time;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!guest_frame_pending_ || !present_last_valid_) {
+      return;
+    }
+    double cadence_ms = GetCadenceMs();
+    if (cadence_ms < kCadenceMinMs || cadence_ms > kCadenceMaxMs) {
+      return;
+    }
+    Clock::time_point now = Clock::now();
+    double since_present_ms = DurationMs(now - present_last_);
+    // After a hitch, present immediately to catch up.
+    if (since_present_ms >= cadence_ms) {
+      return;
+    }
+    double wait_ms = std::min(cadence_ms - since_present_ms, cadence_ms * 0.5);
+    if (wait_ms < kWaitMinMs) {
+      return;
+    }
+    present_time =
+        now + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double, std::milli>(wait_ms));
+  }
+  SCOPE_profile_cpu_f("gpu");
+  Clock::time_point sleep_end = present_time - kSpinDuration;
+  if (Clock::now() < sleep_end) {
+    std::this_thread::sleep_until(sleep_end);
+  }
+  while (Clock::now() < present_time) {
+    std::this_thread::yield();
+  }
+}
+
+void FramePacer::OnPresented() {
+  Clock::time_point now = Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!guest_frame_pending_) {
+      return;
+    }
+    guest_frame_pending_ = false;
+    if (present_last_valid_) {
+      present_intervals_.Push(float(DurationMs(now - present_last_)));
+    }
+    present_last_ = now;
+    present_last_valid_ = true;
+    present_delays_.Push(float(DurationMs(now - guest_frame_last_)));
+  }
+  PublishStatistics();
+}
+
+FramePacer::Statistics FramePacer::GetStatistics() const {
+  Statistics statistics;
+  std::lock_guard<std::mutex> lock(mutex_);
+  statistics.frame_count = present_intervals_.count;
+  guest_frame_times_.GetMeanAndStddev(statistics.guest_frame_time_mean_ms,
+                                      statistics.guest_frame_time_stddev_ms);
+  present_intervals_.GetMeanAndStddev(statistics.present_interval_mean_ms,
+                                      statistics.present_interval_stddev_ms);
+  statistics.present_interval_p50_ms = present_intervals_.GetPercentile(0.5);
+  statistics.present_interval_p99_ms = present_intervals_.GetPercentile(0.99);
+  double present_delay_stddev_ms;
+  present_delays_.GetMeanAndStddev(statistics.present_delay_mean_ms,
+                                   present_delay_stddev_ms);
+  return statistics;
+}
+
+void FramePacer::PublishStatistics() const {
+#if XE_OPTION_PROFILING
+  Statistics statistics = GetStatistics();
+  // The counter names must be literals.
+  COUNT_profile_set("display/guest_frame_time_mean_us",
+                    int64_t(statistics.guest_frame_time_mean_ms * 1000.0));
+  COUNT_profile_set("display/guest_frame_time_stddev_us",
+                    int64_t(statistics.guest_frame_time_stddev_ms * 1000.0));
+  COUNT_profile_set("display/present_interval_mean_us",
+                    int64_t(statistics.present_interval_mean_ms * 1000.0));
+  COUNT_profile_set("display/present_interval_stddev_us",
+                    int64_t(statistics.present_interval_stddev_ms * 1000.0));
+  COUNT_profile_set("display/present_delay_mean_us",
+                    int64_t(statistics.present_delay_mean_ms * 1000.0));
+#endif  // XE_OPTION_PROFILING
+}
+
+}  // namespace ui
+}  // namespace xe
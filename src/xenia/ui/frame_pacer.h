@@ -0,0 +1,115 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_UI_FRAME_PACER_H_
+#define XENIA_UI_FRAME_PACER_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace xe {
+namespace ui {
+
+// Tracks the cadence of the guest frames (the guest output refreshes done on
+// XE_SWAP) and of their presentation on the host, and, if frame pacing is
+// enabled, delays presenting the frames that arrive earlier than expected from
+// the cadence so they're shown at even intervals instead of passing the jitter
+// of the guest frame times to the display. A frame is delayed by no more than a
+// half of the cadence, and not at all after a hitch, so pacing can't
+// accumulate latency. May be used from multiple threads.
+class FramePacer {
+ public:
+  // The number of the latest frames the cadence and the statistics are
+  // calculated from.
+  static constexpr uint32_t kHistoryLength = 128;
+
+  struct Statistics {
+    // The number of the frames the statistics were gathered from.
+    uint32_t frame_count;
+    // Between the consecutive guest frames.
+    double guest_frame_time_mean_ms;
+    double guest_frame_time_stddev_ms;
+    // Between the consecutive presentations of guest frames.
+    double present_interval_mean_ms;
+    double present_interval_stddev_ms;
+    double present_interval_p50_ms;
+    double present_interval_p99_ms;
+    // From the guest frame becoming available to its presentation.
+    double present_delay_mean_ms;
+  };
+
+  // Whether presentation should be paced (--present_frame_pacing).
+  static bool IsPacingRequested();
+
+  FramePacer() = default;
+  FramePacer(const FramePacer& pacer) = delete;
+  FramePacer& operator=(const FramePacer& pacer) = delete;
+
+  void Reset();
+
+  // Call when a new guest frame is ready to be presented.
+  void OnGuestFrame();
+  // Call before presenting the latest guest frame, blocks until the time it
+  // should be presented at if pacing.
+  void WaitForPresentTime();
+  // Call after the latest guest frame has been sent to the host presentation.
+  // Presentations without a new guest frame (such as UI repaints) are ignored.
+  void OnPresented();
+
+  Statistics GetStatistics() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct History {
+    std::array<float, kHistoryLength> values_ms;
+    uint32_t count = 0;
+    uint32_t next = 0;
+
+    void Reset() {
+      count = 0;
+      next = 0;
+    }
+    void Push(float value_ms) {
+      values_ms[next] = value_ms;
+      next = (next + 1) % kHistoryLength;
+      if (count < kHistoryLength) {
+        ++count;
+      }
+    }
+    void GetMeanAndStddev(double& mean_out, double& stddev_out) const;
+    // Fraction from 0 to 1, 0 if there are no values.
+    double GetPercentile(double fraction) const;
+  };
+
+  // The expected interval between the guest frames, or 0 if not known yet.
+  double GetCadenceMs() const;
+  void PublishStatistics() const;
+
+  mutable std::mutex mutex_;
+
+  History guest_frame_times_;
+  History present_intervals_;
+  History present_delays_;
+
+  Clock::time_point guest_frame_last_;
+  bool guest_frame_last_valid_ = false;
+  // Whether the latest guest frame hasn't been presented yet.
+  bool guest_frame_pending_ = false;
+
+  Clock::time_point present_last_;
+  bool present_last_valid_ = false;
+};
+
+}  // namespace ui
+}  // namespace xe
+
+#endif  // XENIA_UI_FRAME_PACER_H_
@@ -20,6 +20,38 @@ namespace ui {
 GraphicsUploadBufferPool::~GraphicsUploadBufferPool() { ClearCache(); }
 
 void GraphicsUploadBufferPool::Reclaim(uint64_t completed_submission_index) {
+  uint64_t pages_reclaimed = 0;
+
+  // Take the pages submitted by the thread contexts since the last time.
+  Page* concurrent_submitted =
+      concurrent_submitted_.exchange(nullptr, std::memory_order_acquire);
+  while (concurrent_submitted) {
+    Page* next = concurrent_submitted->next_;
+    concurrent_submitted->next_ = concurrent_pending_;
+    concurrent_pending_ = concurrent_submitted;
+    concurrent_submitted = next;
+  }
+  Page* reclaimed_first = nullptr;
+  Page* reclaimed_last = nullptr;
+  Page** concurrent_pending_link = &concurrent_pending_;
+  while (*concurrent_pending_link) {
+    Page* page = *concurrent_pending_link;
+    if (page->last_submission_index_ > completed_submission_index) {
+      concurrent_pending_link = &page->next_;
+      continue;
+    }
+    *concurrent_pending_link = page->next_;
+    page->next_ = reclaimed_first;
+    reclaimed_first = page;
+    if (!reclaimed_last) {
+      reclaimed_last = page;
+    }
+    ++pages_reclaimed;
+  }
+  if (reclaimed_first) {
+    PushPages(concurrent_free_, reclaimed_first, reclaimed_last);
+  }
+
   while (submitted_first_) {
     if (submitted_first_->last_submission_index_ > completed_submission_index) {
       break;
@@ -32,10 +64,16 @@ void GraphicsUploadBufferPool::Reclaim(uint64_t completed_submission_index) {
     writable_last_ = submitted_first_;
     submitted_first_ = submitted_first_->next_;
     writable_last_->next_ = nullptr;
+    ++pages_reclaimed;
   }
   if (!submitted_first_) {
     submitted_last_ = nullptr;
   }
+
+  if (pages_reclaimed) {
+    statistics_pages_reclaimed_.fetch_add(pages_reclaimed,
+                                          std::memory_order_relaxed);
+  }
 }
 
 void GraphicsUploadBufferPool::ChangeSubmissionTimeline() {
@@ -55,6 +93,14 @@ void GraphicsUploadBufferPool::ChangeSubmissionTimeline() {
     page->last_submission_index_ = 0;
     page = page->next_;
   }
+
+  // Same for the thread context pages.
+  Reclaim(UINT64_MAX);
+  page = concurrent_free_.load(std::memory_order_acquire);
+  while (page) {
+    page->last_submission_index_ = 0;
+    page = page->next_;
+  }
 }
 
 void GraphicsUploadBufferPool::ClearCache() {
@@ -73,10 +119,160 @@ void GraphicsUploadBufferPool::ClearCache() {
     writable_first_ = next_;
   }
   writable_last_ = nullptr;
+  Page* concurrent_page =
+      concurrent_submitted_.exchange(nullptr, std::memory_order_acquire);
+  while (concurrent_page) {
+    Page* next_ = concurrent_page->next_;
+    delete concurrent_page;
+    concurrent_page = next_;
+  }
+  while (concurrent_pending_) {
+    Page* next_ = concurrent_pending_->next_;
+    delete concurrent_pending_;
+    concurrent_pending_ = next_;
+  }
+  concurrent_page =
+      concurrent_free_.exchange(nullptr, std::memory_order_acquire);
+  while (concurrent_page) {
+    Page* next_ = concurrent_page->next_;
+    delete concurrent_page;
+    concurrent_page = next_;
+  }
 }
 
 GraphicsUploadBufferPool::Page::~Page() {}
 
+GraphicsUploadBufferPool::Statistics GraphicsUploadBufferPool::GetStatistics()
+    const {
+  Statistics statistics;
+  statistics.pages_created =
+      statistics_pages_created_.load(std::memory_order_relaxed);
+  statistics.requests = statistics_requests_.load(std::memory_order_relaxed);
+  statistics.bytes_requested =
+      statistics_bytes_requested_.load(std::memory_order_relaxed);
+  statistics.pages_submitted =
+      statistics_pages_submitted_.load(std::memory_order_relaxed);
+  statistics.pages_reclaimed =
+      statistics_pages_reclaimed_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+GraphicsUploadBufferPool::Page* GraphicsUploadBufferPool::CreatePage(
+    uint64_t submission_index) {
+  Page* page;
+  {
+    std::lock_guard<std::mutex> lock(page_creation_mutex_);
+    page = CreatePageImplementation();
+  }
+  if (!page) {
+    return nullptr;
+  }
+  page->last_submission_index_ = submission_index;
+  page->next_ = nullptr;
+  statistics_pages_created_.fetch_add(1, std::memory_order_relaxed);
+  return page;
+}
+
+void GraphicsUploadBufferPool::PushPages(std::atomic<Page*>& stack, Page* first,
+                                         Page* last) {
+  Page* head = stack.load(std::memory_order_relaxed);
+  do {
+    last->next_ = head;
+  } while (!stack.compare_exchange_weak(head, first, std::memory_order_release,
+                                        std::memory_order_relaxed));
+}
+
+GraphicsUploadBufferPool::Page*
+GraphicsUploadBufferPool::AcquireConcurrentPage(uint64_t submission_index) {
+  // Taking the whole stack and returning the rest, as popping one page with a
+  // compare-exchange may be broken by the page being taken and returned by
+  // others in between. Other threads may see no free pages meanwhile and
+  // create a new one, but that's rare and harmless.
+  Page* page = concurrent_free_.exchange(nullptr, std::memory_order_acquire);
+  if (!page) {
+    return CreatePage(submission_index);
+  }
+  Page* rest_first = page->next_;
+  if (rest_first) {
+    Page* rest_last = rest_first;
+    while (rest_last->next_) {
+      rest_last = rest_last->next_;
+    }
+    PushPages(concurrent_free_, rest_first, rest_last);
+  }
+  page->last_submission_index_ = submission_index;
+  page->next_ = nullptr;
+  return page;
+}
+
+void GraphicsUploadBufferPool::SubmitConcurrentPage(Page* page) {
+  PushPages(concurrent_submitted_, page, page);
+  statistics_pages_submitted_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void GraphicsUploadBufferPool::FlushWrites(ThreadContext& context) {
+  if (!context.page_ || context.page_flushed_ >= context.page_used_) {
+    return;
+  }
+  FlushPageWrites(context.page_, context.page_flushed_,
+                  context.page_used_ - context.page_flushed_);
+  context.page_flushed_ = context.page_used_;
+}
+
+void GraphicsUploadBufferPool::ReleaseThreadContext(ThreadContext& context) {
+  if (!context.page_) {
+    return;
+  }
+  FlushWrites(context);
+  SubmitConcurrentPage(context.page_);
+  context.page_ = nullptr;
+  context.page_used_ = 0;
+  context.page_flushed_ = 0;
+}
+
+GraphicsUploadBufferPool::Page* GraphicsUploadBufferPool::Request(
+    ThreadContext& context, uint64_t submission_index, size_t size,
+    size_t alignment, size_t& offset_out) {
+  alignment = std::max(alignment, size_t(1));
+  assert_true(xe::is_pow2(alignment));
+  size = xe::align(size, alignment);
+  size_t page_used_aligned = xe::align(context.page_used_, alignment);
+  if (!context.page_ || page_used_aligned + size > context.page_size_) {
+    if (context.page_) {
+      if (size > context.page_size_) {
+        // Wouldn't fit in a new page either.
+        assert_always();
+        return nullptr;
+      }
+      ReleaseThreadContext(context);
+    }
+    Page* page = AcquireConcurrentPage(submission_index);
+    if (!page) {
+      return nullptr;
+    }
+    {
+      // May have been increased by the creation of the page.
+      std::lock_guard<std::mutex> lock(page_creation_mutex_);
+      context.page_size_ = page_size_;
+    }
+    context.page_ = page;
+    context.page_used_ = 0;
+    context.page_flushed_ = 0;
+    page_used_aligned = 0;
+    if (size > context.page_size_) {
+      assert_always();
+      return nullptr;
+    }
+  }
+  assert_true(submission_index >= context.page_->last_submission_index_);
+  context.page_->last_submission_index_ = submission_index;
+  offset_out = page_used_aligned;
+  context.page_used_ = page_used_aligned + size;
+  statistics_requests_.fetch_add(1, std::memory_order_relaxed);
+  statistics_bytes_requested_.fetch_add(size, std::memory_order_relaxed);
+  return context.page_;
+}
+
 void GraphicsUploadBufferPool::FlushWrites() {
   if (current_page_flushed_ >= current_page_used_) {
     return;
@@ -118,16 +314,15 @@ GraphicsUploadBufferPool::Page* GraphicsUploadBufferPool::Request(
       if (!writable_first_) {
         writable_last_ = nullptr;
       }
+      statistics_pages_submitted_.fetch_add(1, std::memory_order_relaxed);
     }
     if (!writable_first_) {
       // Create a new page if none available.
-      writable_first_ = CreatePageImplementation();
+      writable_first_ = CreatePage(submission_index);
       if (!writable_first_) {
         // Failed to create.
         return nullptr;
       }
-      writable_first_->last_submission_index_ = submission_index;
-      writable_first_->next_ = nullptr;
       writable_last_ = writable_first_;
       // After CreatePageImplementation (more specifically, the first successful
       // call), page_size_ may grow - but this doesn't matter here.
@@ -139,6 +334,8 @@ GraphicsUploadBufferPool::Page* GraphicsUploadBufferPool::Request(
   writable_first_->last_submission_index_ = submission_index;
   offset_out = current_page_used_aligned;
   current_page_used_ = current_page_used_aligned + size;
+  statistics_requests_.fetch_add(1, std::memory_order_relaxed);
+  statistics_bytes_requested_.fetch_add(size, std::memory_order_relaxed);
   return writable_first_;
 }
 
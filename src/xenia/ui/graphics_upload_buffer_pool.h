@@ -10,9 +10,12 @@
 #ifndef XENIA_UI_GRAPHICS_UPLOAD_BUFFER_POOL_H_
 #define XENIA_UI_GRAPHICS_UPLOAD_BUFFER_POOL_H_
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <mutex>
 
+#include "xenia/base/assert.h"
 #include "xenia/base/literals.h"
 
 namespace xe {
@@ -29,9 +32,22 @@ class GraphicsUploadBufferPool {
   // kCpuAllocatorPageSize). Large enough for most cases.
   static constexpr size_t kDefaultPageSize = 2_MiB;
 
+  struct Statistics {
+    uint64_t pages_created;
+    uint64_t requests;
+    uint64_t bytes_requested;
+    // Pages filled (or released by a thread context) and submitted.
+    uint64_t pages_submitted;
+    uint64_t pages_reclaimed;
+  };
+
   virtual ~GraphicsUploadBufferPool();
 
+  // Reclaims the pages from both the single-threaded and the thread context
+  // requests. Must be called from one thread at a time, but concurrently with
+  // the thread context requests.
   void Reclaim(uint64_t completed_submission_index);
+  // These must not be called while any thread context has a page.
   void ChangeSubmissionTimeline();
   void ClearCache();
 
@@ -39,6 +55,8 @@ class GraphicsUploadBufferPool {
   // implementation doesn't require explicit flushing.
   void FlushWrites();
 
+  Statistics GetStatistics() const;
+
  protected:
   // Extended by the implementation.
   struct Page {
@@ -47,6 +65,39 @@ class GraphicsUploadBufferPool {
     Page* next_;
   };
 
+ public:
+  // Current page of a thread writing to the pool concurrently with other
+  // threads, such as a texture loading worker. The single-threaded requests
+  // must still be made from one thread at a time, but may be concurrent with
+  // the thread context requests.
+  class ThreadContext {
+   public:
+    ThreadContext() = default;
+    ThreadContext(const ThreadContext& context) = delete;
+    ThreadContext& operator=(const ThreadContext& context) = delete;
+    ~ThreadContext() {
+      // Must be released to the pool it was used with.
+      assert_null(page_);
+    }
+
+   private:
+    friend class GraphicsUploadBufferPool;
+    Page* page_ = nullptr;
+    size_t page_size_ = 0;
+    size_t page_used_ = 0;
+    size_t page_flushed_ = 0;
+  };
+
+  // Flushes the writes made through the context, must be called before
+  // submitting anything using them, unless the implementation doesn't require
+  // explicit flushing.
+  void FlushWrites(ThreadContext& context);
+  // Submits the current page of the context, with the writes flushed, for
+  // reclamation. Must be called before the context is destroyed.
+  void ReleaseThreadContext(ThreadContext& context);
+
+ protected:
+
   GraphicsUploadBufferPool(size_t page_size) : page_size_(page_size) {}
 
   // Request to write data in a single piece, creating a new page if the current
@@ -57,6 +108,13 @@ class GraphicsUploadBufferPool {
   Page* RequestPartial(uint64_t submission_index, size_t size, size_t alignment,
                        size_t& offset_out, size_t& size_out);
 
+  // Thread-safe with other thread context requests, the single-thread
+  // requests and Reclaim.
+  Page* Request(ThreadContext& context, uint64_t submission_index, size_t size,
+                size_t alignment, size_t& offset_out);
+
+  // Called with the page creation mutex locked, so the implementation may
+  // modify its state (and page_size_) here even with concurrent requests.
   virtual Page* CreatePageImplementation() = 0;
 
   virtual void FlushPageWrites(Page* page, size_t offset, size_t size);
@@ -77,6 +135,30 @@ class GraphicsUploadBufferPool {
 
   size_t current_page_used_ = 0;
   size_t current_page_flushed_ = 0;
+
+ private:
+  Page* CreatePage(uint64_t submission_index);
+  // Lock-free stack pushes - pushing doesn't have the ABA problem, and pages
+  // are only taken by exchanging the whole stack.
+  static void PushPages(std::atomic<Page*>& stack, Page* first, Page* last);
+  Page* AcquireConcurrentPage(uint64_t submission_index);
+  void SubmitConcurrentPage(Page* page);
+
+  std::mutex page_creation_mutex_;
+
+  // Pages full or released by the thread contexts, pushed in any order.
+  std::atomic<Page*> concurrent_submitted_{nullptr};
+  // Pages from concurrent_submitted_ owned by the reclaiming thread, waiting
+  // for their submissions to be completed, not sorted.
+  Page* concurrent_pending_ = nullptr;
+  // Reclaimed pages for the thread contexts.
+  std::atomic<Page*> concurrent_free_{nullptr};
+
+  std::atomic<uint64_t> statistics_pages_created_{0};
+  std::atomic<uint64_t> statistics_requests_{0};
+  std::atomic<uint64_t> statistics_bytes_requested_{0};
+  std::atomic<uint64_t> statistics_pages_submitted_{0};
+  std::atomic<uint64_t> statistics_pages_reclaimed_{0};
 };
 
 }  // namespace ui
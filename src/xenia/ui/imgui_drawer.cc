@@ -506,39 +506,81 @@ void ImGuiDrawer::RenderDrawLists(ImDrawData* data,
 
   immediate_drawer_->Begin(ui_draw_context, io.DisplaySize.x, io.DisplaySize.y);
 
+  // Merging all the command lists into one vertex and index upload, and the
+  // consecutive commands with the same texture and clip rectangle (usually
+  // most of them, as windows and notifications share the font texture) into
+  // one draw, as long as 16-bit indices can address all the vertices.
   for (int i = 0; i < data->CmdListsCount; ++i) {
     const auto cmd_list = data->CmdLists[i];
-
-    ImmediateDrawBatch batch;
-    batch.vertices =
-        reinterpret_cast<ImmediateVertex*>(cmd_list->VtxBuffer.Data);
-    batch.vertex_count = cmd_list->VtxBuffer.size();
-    batch.indices = cmd_list->IdxBuffer.Data;
-    batch.index_count = cmd_list->IdxBuffer.size();
-    immediate_drawer_->BeginDrawBatch(batch);
+    size_t list_vertex_count = size_t(cmd_list->VtxBuffer.size());
+    if (batch_vertices_.size() + list_vertex_count > size_t(UINT16_MAX) + 1) {
+      FlushDrawBatch();
+    }
+    uint16_t list_base_vertex = uint16_t(batch_vertices_.size());
+    size_t list_base_index = batch_indices_.size();
+    const auto* list_vertices =
+        reinterpret_cast<const ImmediateVertex*>(cmd_list->VtxBuffer.Data);
+    batch_vertices_.insert(batch_vertices_.end(), list_vertices,
+                           list_vertices + list_vertex_count);
+    for (int j = 0; j < cmd_list->IdxBuffer.size(); ++j) {
+      batch_indices_.push_back(
+          uint16_t(list_base_vertex + cmd_list->IdxBuffer.Data[j]));
+    }
 
     for (int j = 0; j < cmd_list->CmdBuffer.size(); ++j) {
       const auto& cmd = cmd_list->CmdBuffer[j];
-
-      ImmediateDraw draw;
+      if (!cmd.ElemCount) {
+        continue;
+      }
+      auto texture = reinterpret_cast<ImmediateTexture*>(cmd.TextureId);
+      int index_offset = int(list_base_index + cmd.IdxOffset);
+      if (!batch_draws_.empty()) {
+        ImmediateDraw& last_draw = batch_draws_.back();
+        if (last_draw.texture == texture &&
+            last_draw.index_offset + last_draw.count == index_offset &&
+            last_draw.scissor_left == cmd.ClipRect.x &&
+            last_draw.scissor_top == cmd.ClipRect.y &&
+            last_draw.scissor_right == cmd.ClipRect.z &&
+            last_draw.scissor_bottom == cmd.ClipRect.w) {
+          last_draw.count += int(cmd.ElemCount);
+          continue;
+        }
+      }
+      ImmediateDraw& draw = batch_draws_.emplace_back();
       draw.primitive_type = ImmediatePrimitiveType::kTriangles;
-      draw.count = cmd.ElemCount;
-      draw.index_offset = cmd.IdxOffset;
-      draw.texture = reinterpret_cast<ImmediateTexture*>(cmd.TextureId);
+      draw.count = int(cmd.ElemCount);
+      draw.index_offset = index_offset;
+      draw.texture = texture;
       draw.scissor = true;
       draw.scissor_left = cmd.ClipRect.x;
       draw.scissor_top = cmd.ClipRect.y;
       draw.scissor_right = cmd.ClipRect.z;
       draw.scissor_bottom = cmd.ClipRect.w;
-      immediate_drawer_->Draw(draw);
     }
-
-    immediate_drawer_->EndDrawBatch();
   }
+  FlushDrawBatch();
 
   immediate_drawer_->End();
 }
 
+void ImGuiDrawer::FlushDrawBatch() {
+  if (!batch_draws_.empty()) {
+    ImmediateDrawBatch batch;
+    batch.vertices = batch_vertices_.data();
+    batch.vertex_count = int(batch_vertices_.size());
+    batch.indices = batch_indices_.data();
+    batch.index_count = int(batch_indices_.size());
+    immediate_drawer_->BeginDrawBatch(batch);
+    for (const ImmediateDraw& draw : batch_draws_) {
+      immediate_drawer_->Draw(draw);
+    }
+    immediate_drawer_->EndDrawBatch();
+  }
+  batch_vertices_.clear();
+  batch_indices_.clear();
+  batch_draws_.clear();
+}
+
 ImGuiIO& ImGuiDrawer::GetIO() {
   ImGui::SetCurrentContext(internal_state_);
   return ImGui::GetIO();
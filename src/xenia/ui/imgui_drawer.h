@@ -89,6 +89,7 @@ class ImGuiDrawer : public WindowInputListener, public UIDrawer {
   void SetupFontTexture();
 
   void RenderDrawLists(ImDrawData* data, UIDrawContext& ui_draw_context);
+  void FlushDrawBatch();
 
   void ClearInput();
   void OnKey(KeyEvent& e, bool is_down);
@@ -125,6 +126,13 @@ class ImGuiDrawer : public WindowInputListener, public UIDrawer {
   std::unique_ptr<ImmediateTexture> font_texture_;
 
   std::vector<std::unique_ptr<ImmediateTexture>> notification_icon_textures_;
+
+  // The command lists merged into as few batches and draws as possible, with
+  // the storage reused between frames.
+  std::vector<ImmediateVertex> batch_vertices_;
+  std::vector<uint16_t> batch_indices_;
+  std::vector<ImmediateDraw> batch_draws_;
+
   // If there's an active pointer, the ImGui mouse is controlled by this touch.
   // If it's TouchEvent::kPointerIDNone, the ImGui mouse is controlled by the
   // mouse.
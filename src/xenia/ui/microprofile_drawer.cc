@@ -189,11 +189,18 @@ void MicroprofileDrawer::End() {
 
 ImmediateVertex* MicroprofileDrawer::BeginVertices(
     ImmediatePrimitiveType primitive_type, int count) {
-  if (vertex_count_ + count > vertices_.size() ||
-      primitive_type != current_primitive_type_) {
+  if (vertex_count_ + count > vertices_.size()) {
     Flush();
   }
-  current_primitive_type_ = primitive_type;
+  // Switching between lines and triangles all the time, so not flushing the
+  // batch on that, only starting a new draw in it.
+  if (draws_.empty() || draws_.back().primitive_type != primitive_type) {
+    ImmediateDraw& draw = draws_.emplace_back();
+    draw.primitive_type = primitive_type;
+    draw.base_vertex = vertex_count_;
+    draw.texture = font_texture_.get();
+  }
+  draws_.back().count += count;
   auto ptr = vertices_.data() + vertex_count_;
   vertex_count_ += count;
   return ptr;
@@ -210,16 +217,13 @@ void MicroprofileDrawer::Flush() {
   batch.vertices = vertices_.data();
   batch.vertex_count = vertex_count_;
   immediate_drawer_->BeginDrawBatch(batch);
-
-  ImmediateDraw draw;
-  draw.primitive_type = current_primitive_type_;
-  draw.count = vertex_count_;
-  draw.texture = font_texture_.get();
-  immediate_drawer_->Draw(draw);
-
+  for (const ImmediateDraw& draw : draws_) {
+    immediate_drawer_->Draw(draw);
+  }
   immediate_drawer_->EndDrawBatch();
 
   vertex_count_ = 0;
+  draws_.clear();
 }
 
 #define Q0(d, member, v) d[0].member = v
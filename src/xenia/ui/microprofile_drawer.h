@@ -50,7 +50,8 @@ class MicroprofileDrawer {
 
   std::vector<ImmediateVertex> vertices_;
   int vertex_count_ = 0;
-  ImmediatePrimitiveType current_primitive_type_;
+  // Ranges of vertices_ of the same primitive type, drawn in one batch.
+  std::vector<ImmediateDraw> draws_;
 
   std::unique_ptr<ImmediateTexture> font_texture_;
   struct {
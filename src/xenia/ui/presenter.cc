@@ -40,6 +40,14 @@ DEFINE_bool(
     "host window system.",
     "Display");
 
+DEFINE_bool(
+    present_low_latency, false,
+    "Keep the host presentation queue as short as possible to reduce the "
+    "latency between the guest frame and it being displayed, at the cost of "
+    "less overlapping of the CPU and the GPU work. On Direct3D 12, uses a "
+    "waitable swap chain with the maximum frame latency of 1.",
+    "Display");
+
 DEFINE_bool(
     present_render_pass_clear, true,
     "On graphics backends where this is supported, use the clear render pass "
@@ -422,7 +430,10 @@ bool Presenter::RefreshGuestOutput(
         (3 - last_acquired - guest_output_mailbox_writable_) % 3;
   }
 
-  // Trigger the presentation on the host.
+  // Trigger the presentation on the host, at an even interval from the
+  // previous one if pacing.
+  frame_pacer_.OnGuestFrame();
+  frame_pacer_.WaitForPresentTime();
   PaintResult paint_result = PaintResult::kNotPresented;
   {
     std::lock_guard<std::mutex> paint_mode_mutex_lock(paint_mode_mutex_);
@@ -1279,6 +1290,10 @@ Presenter::PaintResult Presenter::PaintAndPresent(bool execute_ui_drawers) {
   assert_true(surface_paint_connection_state_ ==
               SurfacePaintConnectionState::kConnectedPaintable);
   PaintResult result = PaintAndPresentImpl(execute_ui_drawers);
+  if (result == PaintResult::kPresented ||
+      result == PaintResult::kPresentedSuboptimal) {
+    frame_pacer_.OnPresented();
+  }
   switch (result) {
     case PaintResult::kPresented:
       surface_paint_connection_was_optimal_at_successful_paint_ = true;
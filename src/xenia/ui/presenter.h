@@ -22,6 +22,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -31,6 +32,7 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/math.h"
 #include "xenia/base/platform.h"
+#include "xenia/ui/frame_pacer.h"
 #include "xenia/ui/surface.h"
 #include "xenia/ui/ui_drawer.h"
 
@@ -44,6 +46,7 @@
 #endif  // XE_PLATFORM
 
 // For implementation use.
+DECLARE_bool(present_low_latency);
 DECLARE_bool(present_render_pass_clear);
 
 namespace xe {
@@ -88,6 +91,27 @@ struct RawImage {
   std::vector<uint8_t> data;
 };
 
+// A guest output frame copied into a host GPU image shareable with another
+// process (such as a video encoder) without reading it back to the CPU. The
+// images are reused in a ring, and the consumer must await the fence reaching
+// the value before reading the image, and must be done reading it before the
+// same image index is exported again.
+struct SharedGuestOutputFrame {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  // Host API-specific format of the image (DXGI_FORMAT on Direct3D 12).
+  uint32_t format = 0;
+  // Name of the shareable image to open in the consumer process.
+  std::string image_name;
+  uint32_t image_index = 0;
+  // Incremented when the images are recreated, such as when the guest output
+  // size is changed, so the consumer knows when to reopen them.
+  uint32_t image_generation = 0;
+  // Name of the shareable fence signaled when the frame has been copied.
+  std::string fence_name;
+  uint64_t fence_value = 0;
+};
+
 // The presenter displays up to two layers of content on a host surface:
 // - Guest output image, focusing on lowering latency and maintaining stable
 //   frame pacing, with various scaling and sharpening methods and letterboxing;
@@ -322,6 +346,18 @@ class Presenter {
   // multiple at the same time, and it should acquire the latest guest output
   // image via ConsumeGuestOutput.
   virtual bool CaptureGuestOutput(RawImage& image_out) = 0;
+  // Copies the latest guest output image to the next shared image without
+  // awaiting the completion of the copying on the CPU. Like
+  // CaptureGuestOutput, may be called from any thread. Returns false if there's
+  // no guest output yet or if not supported by the implementation.
+  virtual bool ExportGuestOutput(SharedGuestOutputFrame& frame_out) {
+    return false;
+  }
+  // Frame time variance of the guest output refreshes and of their
+  // presentation. May be called from any thread.
+  FramePacer::Statistics GetFramePacingStatistics() const {
+    return frame_pacer_.GetStatistics();
+  }
   const GuestOutputPaintConfig& GetGuestOutputPaintConfigFromUIThread() const {
     return guest_output_paint_config_;
   }
@@ -960,6 +996,10 @@ class Presenter {
   // rather than being blank.
   bool guest_output_active_last_refresh_ = false;
 
+  // Measures the cadence of the guest output refreshes and their presentation,
+  // and optionally evens out the presentation intervals.
+  FramePacer frame_pacer_;
+
   // Ordered by the Z order, and then by the time of addition.
   // Note: All the iteration logic involving this Z ordering must be the same as
   // in input handling (in the input listeners in the Window), but in reverse.
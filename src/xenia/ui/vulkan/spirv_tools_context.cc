@@ -79,10 +79,41 @@ bool SpirvToolsContext::Initialize(unsigned int spirv_version) {
     Shutdown();
     return false;
   }
+  // Optional, validation is usable without it.
+  if (LoadLibraryFunction(fn_spvBinaryDestroy_, "spvBinaryDestroy") &&
+      LoadLibraryFunction(fn_spvOptimizerCreate_, "spvOptimizerCreate") &&
+      LoadLibraryFunction(fn_spvOptimizerDestroy_, "spvOptimizerDestroy") &&
+      LoadLibraryFunction(fn_spvOptimizerRegisterPerformancePasses_,
+                          "spvOptimizerRegisterPerformancePasses") &&
+      LoadLibraryFunction(fn_spvOptimizerRun_, "spvOptimizerRun") &&
+      LoadLibraryFunction(fn_spvOptimizerOptionsCreate_,
+                          "spvOptimizerOptionsCreate") &&
+      LoadLibraryFunction(fn_spvOptimizerOptionsDestroy_,
+                          "spvOptimizerOptionsDestroy")) {
+    optimizer_options_ = fn_spvOptimizerOptionsCreate_();
+    optimizer_ = fn_spvOptimizerCreate_(target_env);
+    if (optimizer_ && optimizer_options_) {
+      fn_spvOptimizerRegisterPerformancePasses_(optimizer_);
+    } else {
+      XELOGW("SPIRV-Tools: Failed to create the optimizer");
+      if (optimizer_) {
+        fn_spvOptimizerDestroy_(optimizer_);
+        optimizer_ = nullptr;
+      }
+    }
+  }
   return true;
 }
 
 void SpirvToolsContext::Shutdown() {
+  if (optimizer_) {
+    fn_spvOptimizerDestroy_(optimizer_);
+    optimizer_ = nullptr;
+  }
+  if (optimizer_options_) {
+    fn_spvOptimizerOptionsDestroy_(optimizer_options_);
+    optimizer_options_ = nullptr;
+  }
   if (context_) {
     fn_spvContextDestroy_(context_);
     context_ = nullptr;
@@ -118,6 +149,27 @@ spv_result_t SpirvToolsContext::Validate(const uint32_t* words,
   return result;
 }
 
+spv_result_t SpirvToolsContext::Optimize(
+    const uint32_t* words, size_t num_words,
+    std::vector<uint32_t>& optimized_words_out) const {
+  optimized_words_out.clear();
+  if (!optimizer_) {
+    return SPV_UNSUPPORTED;
+  }
+  spv_binary optimized_binary = nullptr;
+  spv_result_t result = fn_spvOptimizerRun_(
+      optimizer_, words, num_words, &optimized_binary, optimizer_options_);
+  if (optimized_binary) {
+    if (result == SPV_SUCCESS) {
+      optimized_words_out.assign(
+          optimized_binary->code,
+          optimized_binary->code + optimized_binary->wordCount);
+    }
+    fn_spvBinaryDestroy_(optimized_binary);
+  }
+  return result;
+}
+
 }  // namespace vulkan
 }  // namespace ui
 }  // namespace xe
@@ -1364,6 +1364,14 @@ Presenter::PaintResult VulkanPresenter::PaintAndPresentImpl(
     paint_context_.submission_tracker.AwaitSubmissionCompletion(
         current_paint_submission_index - paint_submission_count);
   }
+  // For low-latency presentation, don't have more than one frame in flight, so
+  // the frame is painted from the latest guest output. VK_KHR_present_wait
+  // would allow awaiting the actual presentation, but it requires
+  // VK_KHR_present_id and the presentWait feature, not enabled by the provider.
+  if (cvars::present_low_latency && current_paint_submission_index) {
+    paint_context_.submission_tracker.AwaitSubmissionCompletion(
+        current_paint_submission_index - 1);
+  }
   const PaintContext::Submission& paint_submission =
       *paint_context_.submissions[current_paint_submission_index %
                                   paint_submission_count];
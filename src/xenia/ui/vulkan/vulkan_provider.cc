@@ -9,6 +9,7 @@
 
 #include "xenia/ui/vulkan/vulkan_provider.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cstddef>
 #include <cstring>
@@ -567,6 +568,10 @@ bool VulkanProvider::Initialize() {
     // Initialize all queue families to unused.
     queue_families_.clear();
     queue_families_.resize(queue_family_count);
+    for (uint32_t j = 0; j < queue_family_count; ++j) {
+      queue_families_[j].timestamp_valid_bits =
+          queue_families_properties[j].timestampValidBits;
+    }
     // First, try to obtain a graphics and compute queue. Preferably find a
     // queue with sparse binding support as well.
     // The family indices here are listed from the best to the worst.
@@ -690,8 +695,10 @@ bool VulkanProvider::Initialize() {
       device_extensions_.khr_bind_memory2 = true;
       device_extensions_.khr_dedicated_allocation = true;
       device_extensions_.khr_get_memory_requirements2 = true;
+      device_extensions_.khr_maintenance3 = true;
       device_extensions_.khr_sampler_ycbcr_conversion = true;
       if (device_properties_.apiVersion >= VK_MAKE_API_VERSION(0, 1, 2, 0)) {
+        device_extensions_.ext_descriptor_indexing = true;
         device_extensions_.khr_image_format_list = true;
         device_extensions_.khr_shader_float_controls = true;
         device_extensions_.khr_spirv_1_4 = true;
@@ -707,8 +714,14 @@ bool VulkanProvider::Initialize() {
     // core to device_extensions_enabled. Adding literals to
     // device_extensions_enabled for the most C string lifetime safety.
     static const std::pair<const char*, size_t> kUsedDeviceExtensions[] = {
+        {"VK_EXT_descriptor_indexing",
+         offsetof(DeviceExtensions, ext_descriptor_indexing)},
+        {"VK_EXT_extended_dynamic_state",
+         offsetof(DeviceExtensions, ext_extended_dynamic_state)},
         {"VK_EXT_fragment_shader_interlock",
          offsetof(DeviceExtensions, ext_fragment_shader_interlock)},
+        {"VK_EXT_graphics_pipeline_library",
+         offsetof(DeviceExtensions, ext_graphics_pipeline_library)},
         {"VK_EXT_memory_budget", offsetof(DeviceExtensions, ext_memory_budget)},
         {"VK_EXT_shader_demote_to_helper_invocation",
          offsetof(DeviceExtensions, ext_shader_demote_to_helper_invocation)},
@@ -721,9 +734,14 @@ bool VulkanProvider::Initialize() {
          offsetof(DeviceExtensions, khr_get_memory_requirements2)},
         {"VK_KHR_image_format_list",
          offsetof(DeviceExtensions, khr_image_format_list)},
+        {"VK_KHR_maintenance3", offsetof(DeviceExtensions, khr_maintenance3)},
         {"VK_KHR_maintenance4", offsetof(DeviceExtensions, khr_maintenance4)},
+        {"VK_KHR_pipeline_library",
+         offsetof(DeviceExtensions, khr_pipeline_library)},
         {"VK_KHR_portability_subset",
          offsetof(DeviceExtensions, khr_portability_subset)},
+        {"VK_KHR_push_descriptor",
+         offsetof(DeviceExtensions, khr_push_descriptor)},
         // While vkGetPhysicalDeviceFormatProperties should be used to check the
         // format support (device support for Y'CbCr formats is not required by
         // this extension or by Vulkan 1.1), still adding
@@ -754,6 +772,35 @@ bool VulkanProvider::Initialize() {
     if (is_surface_required_ && !device_extensions_.khr_swapchain) {
       continue;
     }
+    if (device_extensions_.ext_graphics_pipeline_library &&
+        !device_extensions_.khr_pipeline_library) {
+      // Dependency not satisfied, the extension must not be enabled.
+      device_extensions_enabled.erase(std::find_if(
+          device_extensions_enabled.begin(), device_extensions_enabled.end(),
+          [](const char* extension_name) {
+            return !std::strcmp(extension_name,
+                                "VK_EXT_graphics_pipeline_library");
+          }));
+      device_extensions_.ext_graphics_pipeline_library = false;
+    }
+    if (device_extensions_.ext_descriptor_indexing &&
+        !device_extensions_.khr_maintenance3) {
+      device_extensions_enabled.erase(std::find_if(
+          device_extensions_enabled.begin(), device_extensions_enabled.end(),
+          [](const char* extension_name) {
+            return !std::strcmp(extension_name, "VK_EXT_descriptor_indexing");
+          }));
+      device_extensions_.ext_descriptor_indexing = false;
+    }
+    if (device_extensions_.khr_push_descriptor &&
+        !instance_extensions_.khr_get_physical_device_properties2) {
+      device_extensions_enabled.erase(std::find_if(
+          device_extensions_enabled.begin(), device_extensions_enabled.end(),
+          [](const char* extension_name) {
+            return !std::strcmp(extension_name, "VK_KHR_push_descriptor");
+          }));
+      device_extensions_.khr_push_descriptor = false;
+    }
 
     // Get portability subset features.
     // VK_KHR_portability_subset reduces, not increases, the capabilities, skip
@@ -817,14 +864,30 @@ bool VulkanProvider::Initialize() {
   }
 
   // Get additional device properties.
+  std::memset(&device_descriptor_indexing_properties_, 0,
+              sizeof(device_descriptor_indexing_properties_));
+  device_descriptor_indexing_properties_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
   std::memset(&device_float_controls_properties_, 0,
               sizeof(device_float_controls_properties_));
   device_float_controls_properties_.sType =
       VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FLOAT_CONTROLS_PROPERTIES_KHR;
+  std::memset(&device_descriptor_indexing_features_, 0,
+              sizeof(device_descriptor_indexing_features_));
+  device_descriptor_indexing_features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  std::memset(&device_extended_dynamic_state_features_, 0,
+              sizeof(device_extended_dynamic_state_features_));
+  device_extended_dynamic_state_features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
   std::memset(&device_fragment_shader_interlock_features_, 0,
               sizeof(device_fragment_shader_interlock_features_));
   device_fragment_shader_interlock_features_.sType =
       VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADER_INTERLOCK_FEATURES_EXT;
+  std::memset(&device_graphics_pipeline_library_features_, 0,
+              sizeof(device_graphics_pipeline_library_features_));
+  device_graphics_pipeline_library_features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
   std::memset(&device_shader_demote_to_helper_invocation_features_, 0,
               sizeof(device_shader_demote_to_helper_invocation_features_));
   device_shader_demote_to_helper_invocation_features_.sType =
@@ -836,6 +899,13 @@ bool VulkanProvider::Initialize() {
     device_properties_2.pNext = nullptr;
     VkPhysicalDeviceProperties2KHR* device_properties_2_last =
         &device_properties_2;
+    if (device_extensions_.ext_descriptor_indexing) {
+      device_descriptor_indexing_properties_.pNext = nullptr;
+      device_properties_2_last->pNext = &device_descriptor_indexing_properties_;
+      device_properties_2_last =
+          reinterpret_cast<VkPhysicalDeviceProperties2KHR*>(
+              &device_descriptor_indexing_properties_);
+    }
     if (device_extensions_.khr_shader_float_controls) {
       device_float_controls_properties_.pNext = nullptr;
       device_properties_2_last->pNext = &device_float_controls_properties_;
@@ -851,6 +921,18 @@ bool VulkanProvider::Initialize() {
     device_features_2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
     device_features_2.pNext = nullptr;
     VkPhysicalDeviceFeatures2KHR* device_features_2_last = &device_features_2;
+    if (device_extensions_.ext_descriptor_indexing) {
+      device_descriptor_indexing_features_.pNext = nullptr;
+      device_features_2_last->pNext = &device_descriptor_indexing_features_;
+      device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
+          &device_descriptor_indexing_features_);
+    }
+    if (device_extensions_.ext_extended_dynamic_state) {
+      device_extended_dynamic_state_features_.pNext = nullptr;
+      device_features_2_last->pNext = &device_extended_dynamic_state_features_;
+      device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
+          &device_extended_dynamic_state_features_);
+    }
     if (device_extensions_.ext_fragment_shader_interlock) {
       device_fragment_shader_interlock_features_.pNext = nullptr;
       device_features_2_last->pNext =
@@ -858,6 +940,13 @@ bool VulkanProvider::Initialize() {
       device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
           &device_fragment_shader_interlock_features_);
     }
+    if (device_extensions_.ext_graphics_pipeline_library) {
+      device_graphics_pipeline_library_features_.pNext = nullptr;
+      device_features_2_last->pNext =
+          &device_graphics_pipeline_library_features_;
+      device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
+          &device_graphics_pipeline_library_features_);
+    }
     if (device_extensions_.ext_shader_demote_to_helper_invocation) {
       device_shader_demote_to_helper_invocation_features_.pNext = nullptr;
       device_features_2_last->pNext =
@@ -921,6 +1010,35 @@ bool VulkanProvider::Initialize() {
     device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
         &device_portability_subset_features_);
   }
+  if (device_extensions_.ext_descriptor_indexing) {
+    // Only what the bindless resources use - fixed-size arrays with
+    // dynamically uniform indices, written while the sets may be in use. Also
+    // what device_descriptor_indexing_features reports from now on.
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported_features =
+        device_descriptor_indexing_features_;
+    std::memset(&device_descriptor_indexing_features_, 0,
+                sizeof(device_descriptor_indexing_features_));
+    device_descriptor_indexing_features_.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    device_descriptor_indexing_features_
+        .descriptorBindingSampledImageUpdateAfterBind =
+        supported_features.descriptorBindingSampledImageUpdateAfterBind;
+    device_descriptor_indexing_features_
+        .descriptorBindingUpdateUnusedWhilePending =
+        supported_features.descriptorBindingUpdateUnusedWhilePending;
+    device_descriptor_indexing_features_.descriptorBindingPartiallyBound =
+        supported_features.descriptorBindingPartiallyBound;
+    device_descriptor_indexing_features_.pNext = nullptr;
+    device_create_info_last->pNext = &device_descriptor_indexing_features_;
+    device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
+        &device_descriptor_indexing_features_);
+  }
+  if (device_extensions_.ext_extended_dynamic_state) {
+    device_extended_dynamic_state_features_.pNext = nullptr;
+    device_create_info_last->pNext = &device_extended_dynamic_state_features_;
+    device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
+        &device_extended_dynamic_state_features_);
+  }
   if (device_extensions_.ext_fragment_shader_interlock) {
     // TODO(Triang3l): Enable only needed fragment shader interlock features.
     device_fragment_shader_interlock_features_.pNext = nullptr;
@@ -929,6 +1047,13 @@ bool VulkanProvider::Initialize() {
     device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
         &device_fragment_shader_interlock_features_);
   }
+  if (device_extensions_.ext_graphics_pipeline_library) {
+    device_graphics_pipeline_library_features_.pNext = nullptr;
+    device_create_info_last->pNext =
+        &device_graphics_pipeline_library_features_;
+    device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
+        &device_graphics_pipeline_library_features_);
+  }
   if (device_extensions_.ext_shader_demote_to_helper_invocation) {
     device_shader_demote_to_helper_invocation_features_.pNext = nullptr;
     device_create_info_last->pNext =
@@ -967,6 +1092,11 @@ bool VulkanProvider::Initialize() {
     }
   }
   // Extensions - disable the specific extension if failed to get its functions.
+  if (device_extensions_.ext_extended_dynamic_state) {
+    bool functions_loaded = true;
+#include "xenia/ui/vulkan/functions/device_ext_extended_dynamic_state.inc"
+    device_extensions_.ext_extended_dynamic_state = functions_loaded;
+  }
   if (device_extensions_.khr_bind_memory2) {
     bool functions_loaded = true;
     if (device_properties_.apiVersion >= VK_MAKE_API_VERSION(0, 1, 1, 0)) {
@@ -1009,6 +1139,11 @@ bool VulkanProvider::Initialize() {
     }
     device_extensions_.khr_maintenance4 = functions_loaded;
   }
+  if (device_extensions_.khr_push_descriptor) {
+    bool functions_loaded = true;
+#include "xenia/ui/vulkan/functions/device_khr_push_descriptor.inc"
+    device_extensions_.khr_push_descriptor = functions_loaded;
+  }
   if (device_extensions_.khr_swapchain) {
     bool functions_loaded = true;
 #include "xenia/ui/vulkan/functions/device_khr_swapchain.inc"
@@ -1041,6 +1176,33 @@ bool VulkanProvider::Initialize() {
       VK_VERSION_MINOR(device_properties_.apiVersion),
       VK_VERSION_PATCH(device_properties_.apiVersion));
   XELOGVK("Vulkan device extensions:");
+  XELOGVK("* VK_EXT_descriptor_indexing: {}",
+          device_extensions_.ext_descriptor_indexing ? "yes" : "no");
+  if (device_extensions_.ext_descriptor_indexing) {
+    XELOGVK("  * Sampled image update after bind: {}",
+            device_descriptor_indexing_features_
+                    .descriptorBindingSampledImageUpdateAfterBind
+                ? "yes"
+                : "no");
+    XELOGVK("  * Update unused while pending: {}",
+            device_descriptor_indexing_features_
+                    .descriptorBindingUpdateUnusedWhilePending
+                ? "yes"
+                : "no");
+    XELOGVK(
+        "  * Partially bound: {}",
+        device_descriptor_indexing_features_.descriptorBindingPartiallyBound
+            ? "yes"
+            : "no");
+  }
+  XELOGVK("* VK_EXT_extended_dynamic_state: {}",
+          device_extensions_.ext_extended_dynamic_state ? "yes" : "no");
+  if (device_extensions_.ext_extended_dynamic_state) {
+    XELOGVK("  * Extended dynamic state: {}",
+            device_extended_dynamic_state_features_.extendedDynamicState
+                ? "yes"
+                : "no");
+  }
   XELOGVK("* VK_EXT_fragment_shader_interlock: {}",
           device_extensions_.ext_fragment_shader_interlock ? "yes" : "no");
   if (device_extensions_.ext_fragment_shader_interlock) {
@@ -1055,6 +1217,14 @@ bool VulkanProvider::Initialize() {
             ? "yes"
             : "no");
   }
+  XELOGVK("* VK_EXT_graphics_pipeline_library: {}",
+          device_extensions_.ext_graphics_pipeline_library ? "yes" : "no");
+  if (device_extensions_.ext_graphics_pipeline_library) {
+    XELOGVK("  * Graphics pipeline library: {}",
+            device_graphics_pipeline_library_features_.graphicsPipelineLibrary
+                ? "yes"
+                : "no");
+  }
   XELOGVK("* VK_EXT_memory_budget: {}",
           device_extensions_.ext_memory_budget ? "yes" : "no");
   XELOGVK(
@@ -1077,8 +1247,12 @@ bool VulkanProvider::Initialize() {
           device_extensions_.khr_get_memory_requirements2 ? "yes" : "no");
   XELOGVK("* VK_KHR_image_format_list: {}",
           device_extensions_.khr_image_format_list ? "yes" : "no");
+  XELOGVK("* VK_KHR_maintenance3: {}",
+          device_extensions_.khr_maintenance3 ? "yes" : "no");
   XELOGVK("* VK_KHR_maintenance4: {}",
           device_extensions_.khr_maintenance4 ? "yes" : "no");
+  XELOGVK("* VK_KHR_pipeline_library: {}",
+          device_extensions_.khr_pipeline_library ? "yes" : "no");
   XELOGVK("* VK_KHR_portability_subset: {}",
           device_extensions_.khr_portability_subset ? "yes" : "no");
   if (device_extensions_.khr_portability_subset) {
@@ -1107,6 +1281,8 @@ bool VulkanProvider::Initialize() {
     XELOGVK("  * Triangle fans: {}",
             device_portability_subset_features_.triangleFans ? "yes" : "no");
   }
+  XELOGVK("* VK_KHR_push_descriptor: {}",
+          device_extensions_.khr_push_descriptor ? "yes" : "no");
   XELOGVK("* VK_KHR_sampler_ycbcr_conversion: {}",
           device_extensions_.khr_sampler_ycbcr_conversion ? "yes" : "no");
   XELOGVK("* VK_KHR_shader_float_controls: {}",
@@ -131,7 +131,12 @@ class VulkanProvider : public GraphicsProvider {
     return device_features_;
   }
   struct DeviceExtensions {
+    // Core since 1.2.0. Requires VK_KHR_maintenance3.
+    bool ext_descriptor_indexing;
+    bool ext_extended_dynamic_state;
     bool ext_fragment_shader_interlock;
+    // Requires VK_KHR_pipeline_library.
+    bool ext_graphics_pipeline_library;
     bool ext_memory_budget;
     // Core since 1.3.0.
     bool ext_shader_demote_to_helper_invocation;
@@ -144,10 +149,15 @@ class VulkanProvider : public GraphicsProvider {
     bool khr_get_memory_requirements2;
     // Core since 1.2.0.
     bool khr_image_format_list;
+    // Core since 1.1.0.
+    bool khr_maintenance3;
     // Core since 1.3.0.
     bool khr_maintenance4;
+    bool khr_pipeline_library;
     // Requires the VK_KHR_get_physical_device_properties2 instance extension.
     bool khr_portability_subset;
+    // Requires the VK_KHR_get_physical_device_properties2 instance extension.
+    bool khr_push_descriptor;
     // Core since 1.1.0.
     bool khr_sampler_ycbcr_conversion;
     // Core since 1.2.0.
@@ -183,6 +193,8 @@ class VulkanProvider : public GraphicsProvider {
     uint32_t queue_first_index = 0;
     uint32_t queue_count = 0;
     bool potentially_supports_present = false;
+    // 0 if timestamps are not supported, otherwise 36 to 64.
+    uint32_t timestamp_valid_bits = 0;
   };
   const std::vector<QueueFamily>& queue_families() const {
     return queue_families_;
@@ -196,14 +208,30 @@ class VulkanProvider : public GraphicsProvider {
   uint32_t queue_family_sparse_binding() const {
     return queue_family_sparse_binding_;
   }
+  const VkPhysicalDeviceDescriptorIndexingPropertiesEXT&
+  device_descriptor_indexing_properties() const {
+    return device_descriptor_indexing_properties_;
+  }
   const VkPhysicalDeviceFloatControlsPropertiesKHR&
   device_float_controls_properties() const {
     return device_float_controls_properties_;
   }
+  const VkPhysicalDeviceDescriptorIndexingFeaturesEXT&
+  device_descriptor_indexing_features() const {
+    return device_descriptor_indexing_features_;
+  }
+  const VkPhysicalDeviceExtendedDynamicStateFeaturesEXT&
+  device_extended_dynamic_state_features() const {
+    return device_extended_dynamic_state_features_;
+  }
   const VkPhysicalDeviceFragmentShaderInterlockFeaturesEXT&
   device_fragment_shader_interlock_features() const {
     return device_fragment_shader_interlock_features_;
   }
+  const VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT&
+  device_graphics_pipeline_library_features() const {
+    return device_graphics_pipeline_library_features_;
+  }
   const VkPhysicalDeviceShaderDemoteToHelperInvocationFeaturesEXT&
   device_shader_demote_to_helper_invocation_features() const {
     return device_shader_demote_to_helper_invocation_features_;
@@ -237,9 +265,11 @@ class VulkanProvider : public GraphicsProvider {
 #define XE_UI_VULKAN_FUNCTION_PROMOTED(extension_name, core_name) \
   PFN_##extension_name extension_name;
 #include "xenia/ui/vulkan/functions/device_1_0.inc"
+#include "xenia/ui/vulkan/functions/device_ext_extended_dynamic_state.inc"
 #include "xenia/ui/vulkan/functions/device_khr_bind_memory2.inc"
 #include "xenia/ui/vulkan/functions/device_khr_get_memory_requirements2.inc"
 #include "xenia/ui/vulkan/functions/device_khr_maintenance4.inc"
+#include "xenia/ui/vulkan/functions/device_khr_push_descriptor.inc"
 #include "xenia/ui/vulkan/functions/device_khr_swapchain.inc"
 #undef XE_UI_VULKAN_FUNCTION_PROMOTED
 #undef XE_UI_VULKAN_FUNCTION
@@ -329,9 +359,17 @@ class VulkanProvider : public GraphicsProvider {
   std::vector<QueueFamily> queue_families_;
   uint32_t queue_family_graphics_compute_;
   uint32_t queue_family_sparse_binding_;
+  VkPhysicalDeviceDescriptorIndexingPropertiesEXT
+      device_descriptor_indexing_properties_;
   VkPhysicalDeviceFloatControlsPropertiesKHR device_float_controls_properties_;
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT
+      device_descriptor_indexing_features_;
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT
+      device_extended_dynamic_state_features_;
   VkPhysicalDeviceFragmentShaderInterlockFeaturesEXT
       device_fragment_shader_interlock_features_;
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT
+      device_graphics_pipeline_library_features_;
   VkPhysicalDeviceShaderDemoteToHelperInvocationFeaturesEXT
       device_shader_demote_to_helper_invocation_features_;
 
@@ -65,6 +65,22 @@ uint8_t* VulkanUploadBufferPool::RequestPartial(uint64_t submission_index,
   return reinterpret_cast<uint8_t*>(page->mapping_) + offset;
 }
 
+uint8_t* VulkanUploadBufferPool::Request(ThreadContext& context,
+                                         uint64_t submission_index, size_t size,
+                                         size_t alignment, VkBuffer& buffer_out,
+                                         VkDeviceSize& offset_out) {
+  size_t offset;
+  const VulkanPage* page =
+      static_cast<const VulkanPage*>(GraphicsUploadBufferPool::Request(
+          context, submission_index, size, alignment, offset));
+  if (!page) {
+    return nullptr;
+  }
+  buffer_out = page->buffer_;
+  offset_out = VkDeviceSize(offset);
+  return reinterpret_cast<uint8_t*>(page->mapping_) + offset;
+}
+
 GraphicsUploadBufferPool::Page*
 VulkanUploadBufferPool::CreatePageImplementation() {
   if (memory_type_ == kMemoryTypeUnavailable) {
@@ -28,6 +28,10 @@ class VulkanUploadBufferPool : public GraphicsUploadBufferPool {
   uint8_t* RequestPartial(uint64_t submission_index, size_t size,
                           size_t alignment, VkBuffer& buffer_out,
                           VkDeviceSize& offset_out, VkDeviceSize& size_out);
+  // Thread-safe.
+  uint8_t* Request(ThreadContext& context, uint64_t submission_index,
+                   size_t size, size_t alignment, VkBuffer& buffer_out,
+                   VkDeviceSize& offset_out);
 
  protected:
   Page* CreatePageImplementation() override;
@@ -0,0 +1,430 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "third_party/snappy/snappy.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/literals.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/vfs/devices/compressed_disc_image_entry.h"
+
+DEFINE_uint32(compressed_disc_image_cache_size_mb, 64,
+              "Size of the cache of decompressed blocks of compressed disc "
+              "images (.xcz), in megabytes.",
+              "Storage");
+
+namespace xe {
+namespace vfs {
+
+using namespace xe::literals;
+
+namespace {
+const size_t kXESectorSize = 2_KiB;
+// How many blocks after a sequential read to ask the OS to load from the
+// storage device in the background.
+constexpr uint32_t kPrefetchBlockCount = 16;
+}  // namespace
+
+CompressedDiscImageDevice::CompressedDiscImageDevice(
+    const std::string_view mount_path, const std::filesystem::path& host_path)
+    : Device(mount_path), name_("GDFX"), host_path_(host_path) {}
+
+CompressedDiscImageDevice::~CompressedDiscImageDevice() = default;
+
+bool CompressedDiscImageDevice::Compress(
+    const std::filesystem::path& source_path,
+    const std::filesystem::path& target_path, uint32_t block_size) {
+  if (!xe::is_pow2(block_size) || block_size < kXESectorSize) {
+    XELOGE("Invalid compressed disc image block size {}", block_size);
+    return false;
+  }
+  auto source = MappedMemory::Open(source_path, MappedMemory::Mode::kRead);
+  if (!source) {
+    XELOGE("Failed to open disc image {}", xe::path_to_utf8(source_path));
+    return false;
+  }
+  uint64_t block_count = xe::round_up(source->size(), size_t(block_size)) /
+                         size_t(block_size);
+  if (block_count > UINT32_MAX) {
+    XELOGE("Disc image {} is too large", xe::path_to_utf8(source_path));
+    return false;
+  }
+  FILE* target = xe::filesystem::OpenFile(target_path, "wb");
+  if (!target) {
+    XELOGE("Failed to create {}", xe::path_to_utf8(target_path));
+    return false;
+  }
+
+  CompressedDiscImageHeader header;
+  header.magic = CompressedDiscImageHeader::kMagic;
+  header.version = CompressedDiscImageHeader::kVersion;
+  header.block_size = block_size;
+  header.block_count = uint32_t(block_count);
+  header.image_size = source->size();
+  std::vector<uint64_t> block_offsets(block_count + 1);
+  uint64_t offset = sizeof(header) + sizeof(uint64_t) * block_offsets.size();
+  bool written = fwrite(&header, sizeof(header), 1, target) == 1;
+  if (written) {
+    // Written again after compressing when it's known.
+    written = fwrite(block_offsets.data(), sizeof(uint64_t),
+                     block_offsets.size(),
+                     target) == block_offsets.size();
+  }
+  std::vector<char> compressed(snappy::MaxCompressedLength(block_size));
+  for (uint64_t i = 0; written && i < block_count; ++i) {
+    block_offsets[i] = offset;
+    const char* block =
+        reinterpret_cast<const char*>(source->data()) + i * block_size;
+    size_t block_length =
+        std::min(size_t(block_size), source->size() - size_t(i * block_size));
+    size_t compressed_length;
+    snappy::RawCompress(block, block_length, compressed.data(),
+                        &compressed_length);
+    if (compressed_length < block_length) {
+      written = fwrite(compressed.data(), 1, compressed_length, target) ==
+                compressed_length;
+      offset += compressed_length;
+    } else {
+      written = fwrite(block, 1, block_length, target) == block_length;
+      offset += block_length;
+    }
+  }
+  block_offsets[block_count] = offset;
+  if (written) {
+    xe::filesystem::Seek(target, sizeof(header), SEEK_SET);
+    written = fwrite(block_offsets.data(), sizeof(uint64_t),
+                     block_offsets.size(),
+                     target) == block_offsets.size();
+  }
+  if (fclose(target) != 0) {
+    written = false;
+  }
+  if (!written) {
+    XELOGE("Failed to write {}", xe::path_to_utf8(target_path));
+    return false;
+  }
+  XELOGI("Compressed disc image {} from {} to {} bytes",
+         xe::path_to_utf8(source_path), source->size(), offset);
+  return true;
+}
+
+bool CompressedDiscImageDevice::Initialize() {
+  mmap_ = MappedMemory::Open(host_path_, MappedMemory::Mode::kRead);
+  if (!mmap_) {
+    XELOGE("Compressed disc image could not be mapped");
+    return false;
+  } else {
+    XELOGFS("CompressedDiscImageDevice::Initialize");
+  }
+  if (!ReadIndex()) {
+    XELOGE("Compressed disc image header or block index is damaged");
+    return false;
+  }
+  max_cache_size_ = size_t(cvars::compressed_disc_image_cache_size_mb) << 20;
+
+  ParseState state = {};
+  auto result = Verify(&state);
+  if (result != Error::kSuccess) {
+    XELOGE("Failed to verify disc image header: {}", result);
+    return false;
+  }
+
+  std::vector<uint8_t> root_buffer;
+  if (!ReadImageRange(state.root_offset, state.root_size, root_buffer)) {
+    XELOGE("Failed to read the GDFX root directory");
+    return false;
+  }
+  auto root_entry = new CompressedDiscImageEntry(this, nullptr, "");
+  root_entry->attributes_ = kFileAttributeDirectory;
+  root_entry_ = std::unique_ptr<Entry>(root_entry);
+  if (!ReadEntry(&state, root_buffer, 0, root_entry)) {
+    XELOGE("Failed to read all GDFX entries");
+    return false;
+  }
+
+  return true;
+}
+
+bool CompressedDiscImageDevice::ReadIndex() {
+  if (mmap_->size() < sizeof(CompressedDiscImageHeader)) {
+    return false;
+  }
+  CompressedDiscImageHeader header;
+  std::memcpy(&header, mmap_->data(), sizeof(header));
+  if (header.magic != CompressedDiscImageHeader::kMagic ||
+      header.version != CompressedDiscImageHeader::kVersion ||
+      !xe::is_pow2(header.block_size) || header.block_size < kXESectorSize) {
+    return false;
+  }
+  size_t index_size = sizeof(uint64_t) * (size_t(header.block_count) + 1);
+  if (mmap_->size() - sizeof(header) < index_size ||
+      uint64_t(header.block_count) * header.block_size < header.image_size ||
+      uint64_t(header.block_count) * header.block_size - header.image_size >=
+          header.block_size) {
+    return false;
+  }
+  block_offsets_ =
+      reinterpret_cast<const uint64_t*>(mmap_->data() + sizeof(header));
+  // The stored blocks must be in order after the index, and not longer than
+  // their decompressed size.
+  uint64_t previous_offset = sizeof(header) + index_size;
+  for (uint32_t i = 0; i <= header.block_count; ++i) {
+    uint64_t offset = block_offsets_[i];
+    if (offset < previous_offset || offset > mmap_->size() ||
+        (i && offset - previous_offset > header.block_size)) {
+      return false;
+    }
+    previous_offset = offset;
+  }
+  block_size_log2_ = xe::log2_floor(header.block_size);
+  block_count_ = header.block_count;
+  image_size_ = size_t(header.image_size);
+  return true;
+}
+
+void CompressedDiscImageDevice::Dump(StringBuffer* string_buffer) {
+  auto global_lock = global_critical_region_.Acquire();
+  root_entry_->Dump(string_buffer, 0);
+}
+
+Entry* CompressedDiscImageDevice::ResolvePath(const std::string_view path) {
+  // The filesystem will have stripped our prefix off already, so the path will
+  // be in the form:
+  // some\PATH.foo
+  XELOGFS("CompressedDiscImageDevice::ResolvePath({})", path);
+  return root_entry_->ResolvePath(path);
+}
+
+size_t CompressedDiscImageDevice::GetBlockSize(uint32_t block_index) const {
+  return std::min(size_t(1) << block_size_log2_,
+                  image_size_ - (size_t(block_index) << block_size_log2_));
+}
+
+std::shared_ptr<const std::vector<uint8_t>>
+CompressedDiscImageDevice::GetDecompressedBlock(uint32_t block_index) {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = cached_block_map_.find(block_index);
+    if (it != cached_block_map_.end()) {
+      cached_blocks_.splice(cached_blocks_.begin(), cached_blocks_,
+                            it->second);
+      return it->second->second;
+    }
+  }
+
+  // Decompress without holding the lock so other threads aren't stalled.
+  const char* compressed = reinterpret_cast<const char*>(
+      mmap_->data() + block_offsets_[block_index]);
+  size_t compressed_length =
+      size_t(block_offsets_[block_index + 1] - block_offsets_[block_index]);
+  size_t block_size = GetBlockSize(block_index);
+  size_t decompressed_length;
+  if (!snappy::GetUncompressedLength(compressed, compressed_length,
+                                     &decompressed_length) ||
+      decompressed_length != block_size) {
+    return nullptr;
+  }
+  auto block = std::make_shared<std::vector<uint8_t>>(block_size);
+  if (!snappy::RawUncompress(compressed, compressed_length,
+                             reinterpret_cast<char*>(block->data()))) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  auto it = cached_block_map_.find(block_index);
+  if (it != cached_block_map_.end()) {
+    // Another thread has decompressed it at the same time.
+    return it->second->second;
+  }
+  cached_blocks_.emplace_front(block_index, block);
+  cached_block_map_.emplace(block_index, cached_blocks_.begin());
+  cache_size_ += block_size;
+  // Always keep the new block, even if the cache is smaller.
+  while (cache_size_ > max_cache_size_ && cached_blocks_.size() > 1) {
+    const CachedBlock& evicted_block = cached_blocks_.back();
+    cache_size_ -= evicted_block.second->size();
+    cached_block_map_.erase(evicted_block.first);
+    cached_blocks_.pop_back();
+  }
+  return block;
+}
+
+void CompressedDiscImageDevice::PrefetchBlocks(uint32_t first_block_index) {
+  if (first_block_index >= block_count_) {
+    return;
+  }
+  uint32_t end_block_index =
+      std::min(first_block_index + kPrefetchBlockCount, block_count_);
+  size_t offset = size_t(block_offsets_[first_block_index]);
+  mmap_->Prefetch(offset, size_t(block_offsets_[end_block_index]) - offset);
+}
+
+size_t CompressedDiscImageDevice::ReadData(size_t offset, void* buffer,
+                                           size_t length) {
+  if (offset >= image_size_) {
+    return 0;
+  }
+  length = std::min(length, image_size_ - offset);
+  if (!length) {
+    return 0;
+  }
+  uint32_t first_block_index = uint32_t(offset >> block_size_log2_);
+  uint32_t last_block_index =
+      uint32_t((offset + length - 1) >> block_size_log2_);
+  // Load the compressed data following sequential reads in the background.
+  if (next_sequential_block_.exchange(last_block_index + 1,
+                                      std::memory_order_relaxed) ==
+          first_block_index ||
+      first_block_index != last_block_index) {
+    PrefetchBlocks(last_block_index + 1);
+  }
+
+  uint8_t* p = static_cast<uint8_t*>(buffer);
+  size_t bytes_read = 0;
+  for (uint32_t i = first_block_index; i <= last_block_index; ++i) {
+    size_t block_start = size_t(i) << block_size_log2_;
+    size_t block_size = GetBlockSize(i);
+    size_t copy_offset = std::max(offset, block_start) - block_start;
+    size_t copy_length =
+        std::min(block_size - copy_offset, length - bytes_read);
+    if (block_offsets_[i + 1] - block_offsets_[i] == block_size) {
+      // Stored uncompressed.
+      std::memcpy(p, mmap_->data() + block_offsets_[i] + copy_offset,
+                  copy_length);
+    } else {
+      auto block = GetDecompressedBlock(i);
+      if (!block) {
+        XELOGE("Compressed disc image block {} is damaged", i);
+        break;
+      }
+      std::memcpy(p, block->data() + copy_offset, copy_length);
+    }
+    p += copy_length;
+    bytes_read += copy_length;
+  }
+  return bytes_read;
+}
+
+bool CompressedDiscImageDevice::ReadImageRange(size_t offset, size_t length,
+                                               std::vector<uint8_t>& buffer) {
+  buffer.resize(length);
+  return ReadData(offset, buffer.data(), length) == length;
+}
+
+CompressedDiscImageDevice::Error CompressedDiscImageDevice::Verify(
+    ParseState* state) {
+  // Find sector 32 of the game partition - try at a few points.
+  static const size_t likely_offsets[] = {
+      0x00000000, 0x0000FB20, 0x00020600, 0x02080000, 0x0FD90000,
+  };
+  std::vector<uint8_t> fs_buffer;
+  bool magic_found = false;
+  for (size_t n = 0; n < xe::countof(likely_offsets); n++) {
+    state->game_offset = likely_offsets[n];
+    if (ReadImageRange(state->game_offset + (32 * kXESectorSize), 28,
+                       fs_buffer) &&
+        std::memcmp(fs_buffer.data(), "MICROSOFT*XBOX*MEDIA", 20) == 0) {
+      magic_found = true;
+      break;
+    }
+  }
+  if (!magic_found) {
+    // File doesn't have the magic values - likely not a real GDFX source.
+    return Error::kErrorFileMismatch;
+  }
+
+  size_t root_sector = xe::load<uint32_t>(fs_buffer.data() + 20);
+  state->root_size = xe::load<uint32_t>(fs_buffer.data() + 24);
+  state->root_offset = state->game_offset + (root_sector * kXESectorSize);
+  if (state->root_size < 13 || state->root_size > 32_MiB) {
+    return Error::kErrorDamagedFile;
+  }
+
+  return Error::kSuccess;
+}
+
+bool CompressedDiscImageDevice::ReadEntry(ParseState* state,
+                                          const std::vector<uint8_t>& buffer,
+                                          uint16_t entry_ordinal,
+                                          CompressedDiscImageEntry* parent) {
+  size_t entry_offset = size_t(entry_ordinal) * 4;
+  if (entry_offset + 14 > buffer.size()) {
+    return false;
+  }
+  const uint8_t* p = buffer.data() + entry_offset;
+
+  uint16_t node_l = xe::load<uint16_t>(p + 0);
+  uint16_t node_r = xe::load<uint16_t>(p + 2);
+  size_t sector = xe::load<uint32_t>(p + 4);
+  size_t length = xe::load<uint32_t>(p + 8);
+  uint8_t attributes = xe::load<uint8_t>(p + 12);
+  uint8_t name_length = xe::load<uint8_t>(p + 13);
+  auto name_buffer = reinterpret_cast<const char*>(p + 14);
+  if (entry_offset + 14 + name_length > buffer.size()) {
+    return false;
+  }
+
+  if (node_l && !ReadEntry(state, buffer, node_l, parent)) {
+    return false;
+  }
+
+  auto name = std::string(name_buffer, name_length);
+
+  auto entry = CompressedDiscImageEntry::Create(this, parent, name);
+  entry->attributes_ = attributes | kFileAttributeReadOnly;
+  entry->size_ = length;
+  entry->allocation_size_ = xe::round_up(length, bytes_per_sector());
+
+  // Set to January 1, 1970 (UTC) in 100-nanosecond intervals
+  entry->create_timestamp_ = 10000 * 11644473600000LL;
+  entry->access_timestamp_ = 10000 * 11644473600000LL;
+  entry->write_timestamp_ = 10000 * 11644473600000LL;
+
+  if (attributes & kFileAttributeDirectory) {
+    // Folder.
+    entry->data_offset_ = 0;
+    entry->data_size_ = 0;
+    if (length) {
+      // Not a leaf - read in children.
+      std::vector<uint8_t> folder_buffer;
+      if (!ReadImageRange(state->game_offset + (sector * kXESectorSize),
+                          length, folder_buffer)) {
+        // Out of bounds read.
+        return false;
+      }
+      if (!ReadEntry(state, folder_buffer, 0, entry.get())) {
+        return false;
+      }
+    }
+  } else {
+    // File.
+    entry->data_offset_ = state->game_offset + (sector * kXESectorSize);
+    entry->data_size_ = length;
+  }
+
+  // Add to parent.
+  parent->children_.emplace_back(std::move(entry));
+
+  // Read next file in the list.
+  if (node_r && !ReadEntry(state, buffer, node_r, parent)) {
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,141 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
+#define XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mapped_memory.h"
+#include "xenia/vfs/device.h"
+
+namespace xe {
+namespace vfs {
+
+class CompressedDiscImageEntry;
+
+// Disc image (GDFX) stored as fixed-size blocks compressed independently with
+// Snappy, so any part of it can be read without decompressing everything
+// before it. The file (.xcz) consists of, all little-endian:
+// - CompressedDiscImageHeader.
+// - uint64_t block_offsets[block_count + 1] - where the stored blocks are in
+//   the file, block i takes block_offsets[i + 1] - block_offsets[i] bytes. A
+//   block is stored uncompressed if that's equal to its decompressed size.
+// - Block data.
+struct CompressedDiscImageHeader {
+  static constexpr uint32_t kMagic = 0x315A4358;  // 'XCZ1'
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  // Decompressed size of every block except for possibly the last one, a power
+  // of two.
+  uint32_t block_size;
+  uint32_t block_count;
+  uint64_t image_size;
+};
+static_assert(sizeof(CompressedDiscImageHeader) == 24);
+
+class CompressedDiscImageDevice : public Device {
+ public:
+  static constexpr uint32_t kDefaultBlockSize = 64 * 1024;
+
+  CompressedDiscImageDevice(const std::string_view mount_path,
+                            const std::filesystem::path& host_path);
+  ~CompressedDiscImageDevice() override;
+
+  // Writes a compressed copy of a raw disc image.
+  static bool Compress(const std::filesystem::path& source_path,
+                       const std::filesystem::path& target_path,
+                       uint32_t block_size = kDefaultBlockSize);
+
+  bool Initialize() override;
+  void Dump(StringBuffer* string_buffer) override;
+  Entry* ResolvePath(const std::string_view path) override;
+
+  const std::string& name() const override { return name_; }
+  uint32_t attributes() const override { return 0; }
+  uint32_t component_name_max_length() const override { return 255; }
+
+  uint32_t total_allocation_units() const override {
+    return uint32_t(image_size_ / sectors_per_allocation_unit() /
+                    bytes_per_sector());
+  }
+  uint32_t available_allocation_units() const override { return 0; }
+  uint32_t sectors_per_allocation_unit() const override { return 1; }
+  uint32_t bytes_per_sector() const override { return 0x200; }
+
+  // Reads from the decompressed image, can be called from any thread, returns
+  // the number of bytes read.
+  size_t ReadData(size_t offset, void* buffer, size_t length);
+
+ private:
+  enum class Error {
+    kSuccess = 0,
+    kErrorOutOfMemory = -1,
+    kErrorReadError = -10,
+    kErrorFileMismatch = -30,
+    kErrorDamagedFile = -31,
+  };
+
+  struct ParseState {
+    size_t game_offset;  // Offset (bytes) of game partition.
+    size_t root_offset;  // Offset (bytes) of root.
+    size_t root_size;    // Size (bytes) of root.
+  };
+
+  bool ReadIndex();
+  Error Verify(ParseState* state);
+  bool ReadImageRange(size_t offset, size_t length,
+                      std::vector<uint8_t>& buffer);
+  bool ReadEntry(ParseState* state, const std::vector<uint8_t>& buffer,
+                 uint16_t entry_ordinal, CompressedDiscImageEntry* parent);
+
+  size_t GetBlockSize(uint32_t block_index) const;
+  // Returns the decompressed data of a compressed block, from the cache if
+  // possible, nullptr if it's damaged.
+  std::shared_ptr<const std::vector<uint8_t>> GetDecompressedBlock(
+      uint32_t block_index);
+  void PrefetchBlocks(uint32_t first_block_index);
+
+  std::string name_;
+  std::filesystem::path host_path_;
+  std::unique_ptr<Entry> root_entry_;
+  std::unique_ptr<MappedMemory> mmap_;
+
+  uint32_t block_size_log2_ = 0;
+  uint32_t block_count_ = 0;
+  size_t image_size_ = 0;
+  const uint64_t* block_offsets_ = nullptr;
+
+  // The first block after the last read, to detect sequential reads.
+  std::atomic<uint32_t> next_sequential_block_{0};
+
+  // Least recently used decompressed blocks.
+  std::mutex cache_mutex_;
+  using CachedBlock =
+      std::pair<uint32_t, std::shared_ptr<const std::vector<uint8_t>>>;
+  std::list<CachedBlock> cached_blocks_;
+  std::unordered_map<uint32_t, std::list<CachedBlock>::iterator>
+      cached_block_map_;
+  size_t cache_size_ = 0;
+  size_t max_cache_size_ = 0;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DEVICES_COMPRESSED_DISC_IMAGE_DEVICE_H_
@@ -10,12 +10,53 @@
 #include "xenia/vfs/devices/disc_image_file.h"
 
 #include <algorithm>
+#include <cstring>
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
 #include "xenia/vfs/devices/disc_image_entry.h"
+
+DEFINE_uint32(disc_image_readahead_kb, 4096,
+              "On large reads from disc images, how many kilobytes after the "
+              "read range to ask the OS to start loading from the storage "
+              "device in the background. 0 to disable.",
+              "Storage");
+
 namespace xe {
 namespace vfs {
 
+namespace {
+// Reads of this size and larger are usually bulk loads of assets - the data
+// is likely to be followed by more, and it's consumed by the guest, not by the
+// host thread copying it, so it's not worth keeping it in the host caches.
+constexpr size_t kLargeReadSize = 64 * 1024;
+
+void CopyLargeRead(uint8_t* dest, const uint8_t* src, size_t length) {
+#if XE_ARCH_AMD64
+  // Non-temporal stores for the cache line multiple if both sides are aligned.
+  if (!((uintptr_t(dest) | uintptr_t(src)) & (XE_HOST_CACHE_LINE_SIZE - 1))) {
+    constexpr size_t kMaxStreamedLength =
+        UINT32_MAX & ~size_t(XE_HOST_CACHE_LINE_SIZE - 1);
+    while (length >= XE_HOST_CACHE_LINE_SIZE) {
+      size_t streamed_length =
+          std::min(length & ~size_t(XE_HOST_CACHE_LINE_SIZE - 1),
+                   kMaxStreamedLength);
+      memory::vastcpy(dest, const_cast<uint8_t*>(src),
+                      uint32_t(streamed_length));
+      dest += streamed_length;
+      src += streamed_length;
+      length -= streamed_length;
+    }
+    // The completion of the read may be observed by other threads.
+    swcache::WriteFence();
+  }
+#endif  // XE_ARCH_AMD64
+  std::memcpy(dest, src, length);
+}
+}  // namespace
+
 DiscImageFile::DiscImageFile(uint32_t file_access, DiscImageEntry* entry)
     : File(file_access, entry), entry_(entry) {}
 
@@ -37,7 +78,15 @@ X_STATUS DiscImageFile::ReadSync(void* buffer, size_t buffer_length,
   size_t real_offset = entry_->data_offset() + byte_offset;
   size_t real_length =
       std::min(buffer_length, entry_->data_size() - byte_offset);
-  std::memcpy(buffer, entry_->mmap()->data() + real_offset, real_length);
+  if (real_length >= kLargeReadSize) {
+    entry_->mmap()->Prefetch(
+        real_offset,
+        real_length + size_t(cvars::disc_image_readahead_kb) * 1024);
+    CopyLargeRead(static_cast<uint8_t*>(buffer),
+                  entry_->mmap()->data() + real_offset, real_length);
+  } else {
+    std::memcpy(buffer, entry_->mmap()->data() + real_offset, real_length);
+  }
   *out_bytes_read = real_length;
   return X_STATUS_SUCCESS;
 }
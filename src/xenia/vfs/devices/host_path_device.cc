@@ -12,6 +12,7 @@
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/string.h"
 #include "xenia/kernel/xfile.h"
 #include "xenia/vfs/devices/host_path_entry.h"
 
@@ -42,12 +43,12 @@ bool HostPathDevice::Initialize() {
   auto root_entry = new HostPathEntry(this, nullptr, "", host_path_);
   root_entry->attributes_ = kFileAttributeDirectory;
   root_entry_ = std::unique_ptr<Entry>(root_entry);
-  PopulateEntry(root_entry);
 
   return true;
 }
 
 void HostPathDevice::Dump(StringBuffer* string_buffer) {
+  EnsurePopulated();
   auto global_lock = global_critical_region_.Acquire();
   root_entry_->Dump(string_buffer, 0);
 }
@@ -57,9 +58,73 @@ Entry* HostPathDevice::ResolvePath(const std::string_view path) {
   // be in the form:
   // some\PATH.foo
   XELOGFS("HostPathDevice::ResolvePath({})", path);
+  EnsurePopulated();
   return root_entry_->ResolvePath(path);
 }
 
+void HostPathDevice::EnsurePopulated() {
+  std::call_once(populate_once_, [this]() {
+    PopulateEntry(static_cast<HostPathEntry*>(root_entry_.get()));
+  });
+}
+
+std::vector<HostPathDevice::StagedFile> HostPathDevice::TakeStagedFiles() {
+  std::vector<StagedFile> staged_files;
+  if (!root_entry_) {
+    return staged_files;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  std::vector<HostPathEntry*> entries;
+  entries.push_back(static_cast<HostPathEntry*>(root_entry_.get()));
+  while (!entries.empty()) {
+    HostPathEntry* entry = entries.back();
+    entries.pop_back();
+    for (const std::unique_ptr<Entry>& child : entry->children()) {
+      entries.push_back(static_cast<HostPathEntry*>(child.get()));
+    }
+    std::lock_guard<std::mutex> staging_lock(entry->staging_mutex_);
+    if (!entry->staged_data_) {
+      continue;
+    }
+    StagedFile& staged_file = staged_files.emplace_back();
+    staged_file.host_path = entry->host_path();
+    staged_file.data = std::move(*entry->staged_data_);
+    entry->staged_data_.reset();
+  }
+  return staged_files;
+}
+
+bool HostPathDevice::CommitStagedFile(const StagedFile& staged_file) {
+  std::filesystem::path temp_path = staged_file.host_path;
+  temp_path += ".staged";
+  bool written = false;
+  if (xe::filesystem::CreateEmptyFile(temp_path)) {
+    auto file_handle = xe::filesystem::FileHandle::OpenExisting(
+        temp_path, xe::filesystem::FileAccess::kGenericWrite);
+    if (file_handle) {
+      size_t bytes_written = 0;
+      written = staged_file.data.empty() ||
+                (file_handle->Write(0, staged_file.data.data(),
+                                    staged_file.data.size(), &bytes_written) &&
+                 bytes_written == staged_file.data.size());
+      if (written) {
+        file_handle->Flush();
+      }
+    }
+  }
+  std::error_code error_code;
+  if (written) {
+    std::filesystem::rename(temp_path, staged_file.host_path, error_code);
+  }
+  if (!written || error_code) {
+    std::filesystem::remove(temp_path, error_code);
+    XELOGE("Failed to write the staged data to {}",
+           xe::path_to_utf8(staged_file.host_path));
+    return false;
+  }
+  return true;
+}
+
 void HostPathDevice::PopulateEntry(HostPathEntry* parent_entry) {
   auto child_infos = xe::filesystem::ListFiles(parent_entry->host_path());
   for (auto& child_info : child_infos) {
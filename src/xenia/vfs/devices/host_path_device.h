@@ -10,7 +10,10 @@
 #ifndef XENIA_VFS_DEVICES_HOST_PATH_DEVICE_H_
 #define XENIA_VFS_DEVICES_HOST_PATH_DEVICE_H_
 
+#include <filesystem>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "xenia/vfs/device.h"
 
@@ -40,13 +43,37 @@ class HostPathDevice : public Device {
   uint32_t sectors_per_allocation_unit() const override { return 1; }
   uint32_t bytes_per_sector() const override { return 0x200; }
 
+  // Makes the writes to the files go to copies of their data in memory until
+  // TakeStagedFiles, so the guest doesn't wait for the host file system on
+  // every write. Must be enabled before opening any files.
+  void EnableWriteStaging() { write_staging_enabled_ = true; }
+  bool is_write_staging_enabled() const { return write_staging_enabled_; }
+
+  struct StagedFile {
+    std::filesystem::path host_path;
+    std::vector<uint8_t> data;
+  };
+  // Removes the staged data of the modified files for writing it with
+  // CommitStagedFile. The files must not be accessed through the device
+  // afterwards, as the host files may still contain the old data.
+  std::vector<StagedFile> TakeStagedFiles();
+  // Writes to a temporary file and replaces the host file with it, so the old
+  // data stays intact if writing fails or is interrupted.
+  static bool CommitStagedFile(const StagedFile& staged_file);
+
  private:
   void PopulateEntry(HostPathEntry* parent_entry);
+  // Scanning the host directory tree is deferred until the first lookup, so
+  // mounting a large package doesn't stall the guest if it never opens any
+  // files in it, or until it actually does.
+  void EnsurePopulated();
 
   std::string name_;
   std::filesystem::path host_path_;
   std::unique_ptr<Entry> root_entry_;
+  std::once_flag populate_once_;
   bool read_only_;
+  bool write_staging_enabled_ = false;
 };
 
 }  // namespace vfs
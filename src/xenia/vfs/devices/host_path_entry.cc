@@ -9,17 +9,24 @@
 
 #include "xenia/vfs/devices/host_path_entry.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
 #include "xenia/base/string.h"
 #include "xenia/vfs/device.h"
+#include "xenia/vfs/devices/host_path_device.h"
 #include "xenia/vfs/devices/host_path_file.h"
 
 namespace xe {
 namespace vfs {
 
+// Bigger files are written to the host directly rather than copied to memory.
+constexpr size_t kMaxStagedFileSize = 64 * 1024 * 1024;
+
 HostPathEntry::HostPathEntry(Device* device, Entry* parent,
                              const std::string_view path,
                              const std::filesystem::path& host_path)
@@ -67,6 +74,12 @@ X_STATUS HostPathEntry::Open(uint32_t desired_access, File** out_file) {
   return X_STATUS_SUCCESS;
 }
 
+bool HostPathEntry::can_map() const {
+  // Mapping would bypass the staged data.
+  return !static_cast<const HostPathDevice*>(device_)
+              ->is_write_staging_enabled();
+}
+
 std::unique_ptr<MappedMemory> HostPathEntry::OpenMapped(MappedMemory::Mode mode,
                                                         size_t offset,
                                                         size_t length) {
@@ -111,6 +124,13 @@ bool HostPathEntry::DeleteEntryInternal(Entry* entry) {
 }
 
 void HostPathEntry::update() {
+  {
+    std::lock_guard<std::mutex> lock(staging_mutex_);
+    if (staged_data_) {
+      UpdateStagedSizeLocked();
+      return;
+    }
+  }
   xe::filesystem::FileInfo file_info;
   if (!xe::filesystem::GetInfo(host_path_, &file_info)) {
     return;
@@ -122,5 +142,78 @@ void HostPathEntry::update() {
   }
 }
 
+bool HostPathEntry::ReadStaged(void* buffer, size_t buffer_length,
+                               size_t byte_offset, size_t* out_bytes_read) {
+  std::lock_guard<std::mutex> lock(staging_mutex_);
+  if (!staged_data_) {
+    return false;
+  }
+  size_t bytes_read = 0;
+  if (byte_offset < staged_data_->size()) {
+    bytes_read = std::min(buffer_length, staged_data_->size() - byte_offset);
+    std::memcpy(buffer, staged_data_->data() + byte_offset, bytes_read);
+  }
+  *out_bytes_read = bytes_read;
+  return true;
+}
+
+bool HostPathEntry::WriteStaged(const void* buffer, size_t buffer_length,
+                                size_t byte_offset,
+                                size_t* out_bytes_written) {
+  std::lock_guard<std::mutex> lock(staging_mutex_);
+  if (!StageLocked()) {
+    return false;
+  }
+  if (byte_offset + buffer_length > staged_data_->size()) {
+    staged_data_->resize(byte_offset + buffer_length);
+  }
+  std::memcpy(staged_data_->data() + byte_offset, buffer, buffer_length);
+  UpdateStagedSizeLocked();
+  *out_bytes_written = buffer_length;
+  return true;
+}
+
+bool HostPathEntry::SetStagedLength(size_t length) {
+  std::lock_guard<std::mutex> lock(staging_mutex_);
+  if (!StageLocked()) {
+    return false;
+  }
+  staged_data_->resize(length);
+  UpdateStagedSizeLocked();
+  return true;
+}
+
+bool HostPathEntry::StageLocked() {
+  if (staged_data_) {
+    return true;
+  }
+  if (!static_cast<HostPathDevice*>(device_)->is_write_staging_enabled()) {
+    return false;
+  }
+  std::error_code error_code;
+  uintmax_t file_size = std::filesystem::file_size(host_path_, error_code);
+  if (error_code || file_size > kMaxStagedFileSize) {
+    return false;
+  }
+  std::vector<uint8_t> data(static_cast<size_t>(file_size));
+  if (!data.empty()) {
+    auto file_handle = xe::filesystem::FileHandle::OpenExisting(
+        host_path_, xe::filesystem::FileAccess::kGenericRead);
+    size_t bytes_read = 0;
+    if (!file_handle ||
+        !file_handle->Read(0, data.data(), data.size(), &bytes_read) ||
+        bytes_read != data.size()) {
+      return false;
+    }
+  }
+  staged_data_ = std::move(data);
+  return true;
+}
+
+void HostPathEntry::UpdateStagedSizeLocked() {
+  size_ = staged_data_->size();
+  allocation_size_ = xe::round_up(size_, device_->bytes_per_sector());
+}
+
 }  // namespace vfs
 }  // namespace xe
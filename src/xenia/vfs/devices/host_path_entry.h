@@ -10,7 +10,10 @@
 #ifndef XENIA_VFS_DEVICES_HOST_PATH_ENTRY_H_
 #define XENIA_VFS_DEVICES_HOST_PATH_ENTRY_H_
 
+#include <mutex>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "xenia/base/filesystem.h"
 #include "xenia/vfs/entry.h"
@@ -34,20 +37,36 @@ class HostPathEntry : public Entry {
 
   X_STATUS Open(uint32_t desired_access, File** out_file) override;
 
-  bool can_map() const override { return true; }
+  bool can_map() const override;
   std::unique_ptr<MappedMemory> OpenMapped(MappedMemory::Mode mode,
                                            size_t offset,
                                            size_t length) override;
   void update() override;
 
+  // With the write staging enabled on the device, the file is accessed in
+  // memory after it has been modified for the first time. False is returned
+  // if the file is not staged, and the host file needs to be accessed instead.
+  bool ReadStaged(void* buffer, size_t buffer_length, size_t byte_offset,
+                  size_t* out_bytes_read);
+  bool WriteStaged(const void* buffer, size_t buffer_length,
+                   size_t byte_offset, size_t* out_bytes_written);
+  bool SetStagedLength(size_t length);
+
  private:
   friend class HostPathDevice;
 
+  // With the staging mutex locked.
+  bool StageLocked();
+  void UpdateStagedSizeLocked();
+
   std::unique_ptr<Entry> CreateEntryInternal(const std::string_view name,
                                              uint32_t attributes) override;
   bool DeleteEntryInternal(Entry* entry) override;
 
   std::filesystem::path host_path_;
+
+  std::mutex staging_mutex_;
+  std::optional<std::vector<uint8_t>> staged_data_;
 };
 
 }  // namespace vfs
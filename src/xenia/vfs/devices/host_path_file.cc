@@ -9,11 +9,22 @@
 
 #include "xenia/vfs/devices/host_path_file.h"
 
+#include "xenia/base/metrics.h"
 #include "xenia/vfs/devices/host_path_entry.h"
 
 namespace xe {
 namespace vfs {
 
+namespace {
+metrics::Counter read_bytes_metric("xenia_vfs_host_file_read_bytes_total",
+                                   "Bytes read from the host files by the "
+                                   "guest, including the staged writes.");
+metrics::Counter written_bytes_metric(
+    "xenia_vfs_host_file_written_bytes_total",
+    "Bytes written to the host files by the guest, including the staged "
+    "writes.");
+}  // namespace
+
 HostPathFile::HostPathFile(
     uint32_t file_access, HostPathEntry* entry,
     std::unique_ptr<xe::filesystem::FileHandle> file_handle)
@@ -30,7 +41,10 @@ X_STATUS HostPathFile::ReadSync(void* buffer, size_t buffer_length,
     return X_STATUS_ACCESS_DENIED;
   }
 
-  if (file_handle_->Read(byte_offset, buffer, buffer_length, out_bytes_read)) {
+  if (static_cast<HostPathEntry*>(entry_)->ReadStaged(
+          buffer, buffer_length, byte_offset, out_bytes_read) ||
+      file_handle_->Read(byte_offset, buffer, buffer_length, out_bytes_read)) {
+    read_bytes_metric.Add(*out_bytes_read);
     return X_STATUS_SUCCESS;
   } else {
     return X_STATUS_END_OF_FILE;
@@ -45,8 +59,11 @@ X_STATUS HostPathFile::WriteSync(const void* buffer, size_t buffer_length,
     return X_STATUS_ACCESS_DENIED;
   }
 
-  if (file_handle_->Write(byte_offset, buffer, buffer_length,
+  if (static_cast<HostPathEntry*>(entry_)->WriteStaged(
+          buffer, buffer_length, byte_offset, out_bytes_written) ||
+      file_handle_->Write(byte_offset, buffer, buffer_length,
                           out_bytes_written)) {
+    written_bytes_metric.Add(*out_bytes_written);
     return X_STATUS_SUCCESS;
   } else {
     return X_STATUS_END_OF_FILE;
@@ -59,6 +76,10 @@ X_STATUS HostPathFile::SetLength(size_t length) {
     return X_STATUS_ACCESS_DENIED;
   }
 
+  if (static_cast<HostPathEntry*>(entry_)->SetStagedLength(length)) {
+    return X_STATUS_SUCCESS;
+  }
+
   if (file_handle_->SetLength(length)) {
     return X_STATUS_SUCCESS;
   } else {
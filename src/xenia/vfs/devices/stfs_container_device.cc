@@ -10,13 +10,21 @@
 #include "xenia/vfs/devices/stfs_container_device.h"
 
 #include <algorithm>
+#include <cstring>
 #include <queue>
 #include <vector>
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/vfs/devices/stfs_container_entry.h"
 
+DEFINE_bool(stfs_map_files, true,
+            "Memory-map the files of STFS and SVOD packages (such as DLC and "
+            "XBLA titles) for reading the contents instead of reading them "
+            "through file handles, a lock and a seek per block run.",
+            "Storage");
+
 #if XE_PLATFORM_WIN32
 #include "xenia/base/platform_win.h"
 #define timegm _mkgmtime
@@ -119,6 +127,7 @@ StfsContainerDevice::Error StfsContainerDevice::OpenFiles() {
   if (header_.metadata.data_file_count <= 1) {
     XELOGI("STFS container is a single file.");
     files_.emplace(std::make_pair(0, header_file));
+    MapFile(0, host_path_);
     return Error::kSuccess;
   }
 
@@ -159,12 +168,14 @@ StfsContainerDevice::Error StfsContainerDevice::OpenFiles() {
     files_total_size_ += xe::filesystem::Tell(file);
     // no need to seek back, any reads from this file will seek first anyway
     files_.emplace(std::make_pair(i, file));
+    MapFile(i, path);
   }
   XELOGI("SVOD successfully mapped {} files.", fragment_files.size());
   return Error::kSuccess;
 }
 
 void StfsContainerDevice::CloseFiles() {
+  mapped_files_.clear();
   for (auto& file : files_) {
     fclose(file.second);
   }
@@ -172,6 +183,42 @@ void StfsContainerDevice::CloseFiles() {
   files_total_size_ = 0;
 }
 
+void StfsContainerDevice::MapFile(size_t file_index,
+                                  const std::filesystem::path& path) {
+  if (!cvars::stfs_map_files) {
+    return;
+  }
+  auto mapped_file = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!mapped_file) {
+    // Not fatal, the file handle is used instead.
+    XELOGW("Failed to memory-map STFS package file {}.",
+           xe::path_to_utf8(path));
+    return;
+  }
+  mapped_files_.emplace(file_index, std::move(mapped_file));
+}
+
+size_t StfsContainerDevice::ReadData(size_t file_index, size_t offset,
+                                     void* buffer, size_t length) {
+  auto mapped_file_it = mapped_files_.find(file_index);
+  if (mapped_file_it != mapped_files_.end()) {
+    const MappedMemory& mapped_file = *mapped_file_it->second;
+    if (offset >= mapped_file.size()) {
+      return 0;
+    }
+    length = std::min(length, mapped_file.size() - offset);
+    std::memcpy(buffer, mapped_file.data() + offset, length);
+    return length;
+  }
+  auto file_it = files_.find(file_index);
+  if (file_it == files_.end()) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(files_mutex_);
+  xe::filesystem::Seek(file_it->second, offset, SEEK_SET);
+  return fread(buffer, 1, length, file_it->second);
+}
+
 void StfsContainerDevice::Dump(StringBuffer* string_buffer) {
   auto global_lock = global_critical_region_.Acquire();
   root_entry_->Dump(string_buffer, 0);
@@ -445,8 +492,6 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
       uint32_t block_index = dir_entry.data_block;
       size_t remaining_size = xe::round_up(dir_entry.length, 0x800);
 
-      size_t last_record = -1;
-      size_t last_offset = -1;
       while (remaining_size) {
         const size_t BLOCK_SIZE = 0x800;
 
@@ -456,16 +501,7 @@ StfsContainerDevice::Error StfsContainerDevice::ReadEntrySVOD(
         block_index++;
         remaining_size -= BLOCK_SIZE;
 
-        if (offset - last_offset == 0x800) {
-          // Consecutive, so append to last entry.
-          entry->block_list_[last_record].length += BLOCK_SIZE;
-          last_offset = offset;
-          continue;
-        }
-
-        entry->block_list_.push_back({file_index, offset, BLOCK_SIZE});
-        last_record = entry->block_list_.size() - 1;
-        last_offset = offset;
+        entry->AppendBlock(file_index, offset, BLOCK_SIZE);
       }
     }
   }
@@ -613,11 +649,13 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
       if (entry->attributes() & X_FILE_ATTRIBUTE_NORMAL) {
         uint32_t block_index = dir_entry.start_block_number();
         size_t remaining_size = dir_entry.length;
+        uint32_t block_count = 0;
         while (remaining_size && block_index != kEndOfChain) {
           size_t block_size =
               std::min(static_cast<size_t>(kBlockSize), remaining_size);
           size_t offset = BlockToOffsetSTFS(block_index);
-          entry->block_list_.push_back({0, offset, block_size});
+          entry->AppendBlock(0, offset, block_size);
+          ++block_count;
           remaining_size -= block_size;
           auto block_hash = GetBlockHash(block_index);
           block_index = block_hash->level0_next_block();
@@ -635,12 +673,11 @@ StfsContainerDevice::Error StfsContainerDevice::ReadSTFS() {
 
         // Check that the number of blocks retrieved from hash entries matches
         // the block count read from the file entry
-        if (entry->block_list_.size() != dir_entry.allocated_data_blocks()) {
+        if (block_count != dir_entry.allocated_data_blocks()) {
           XELOGW(
               "STFS failed to read correct block-chain for entry {}, read {} "
               "blocks, expected {}",
-              entry->name_, entry->block_list_.size(),
-              dir_entry.allocated_data_blocks());
+              entry->name_, block_count, dir_entry.allocated_data_blocks());
           assert_always();
         }
       }
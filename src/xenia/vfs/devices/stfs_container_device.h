@@ -12,9 +12,11 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
 #include "xenia/base/string_util.h"
 #include "xenia/kernel/util/xex2_info.h"
@@ -89,6 +91,11 @@ class StfsContainerDevice : public Device {
 
   kernel::xam::XCONTENT_AGGREGATE_DATA content_header() const;
 
+  // Reads from one of the package files, can be called from any thread,
+  // returns the number of bytes read.
+  size_t ReadData(size_t file_index, size_t offset, void* buffer,
+                  size_t length);
+
  private:
   const uint32_t kBlocksPerHashLevel[3] = {170, 28900, 4913000};
   const uint32_t kEndOfChain = 0xFFFFFF;
@@ -116,6 +123,7 @@ class StfsContainerDevice : public Device {
 
   Error OpenFiles();
   void CloseFiles();
+  void MapFile(size_t file_index, const std::filesystem::path& path);
 
   Error ReadHeaderAndVerify(FILE* header_file);
 
@@ -138,6 +146,11 @@ class StfsContainerDevice : public Device {
 
   std::map<size_t, FILE*> files_;
   size_t files_total_size_;
+  // Used instead of the file handles for reading the data if mapping is
+  // enabled.
+  std::map<size_t, std::unique_ptr<MappedMemory>> mapped_files_;
+  // Protects the file positions when reading through the handles.
+  std::mutex files_mutex_;
 
   size_t svod_base_offset_;
   uint32_t component_name_max_length_;
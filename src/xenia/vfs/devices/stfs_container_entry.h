@@ -45,12 +45,19 @@ class StfsContainerEntry : public Entry {
     size_t file;
     size_t offset;
     size_t length;
+    // Where the record starts in the data of the entry.
+    size_t entry_offset;
   };
+  // Runs of blocks contiguous in the package files, sorted by entry_offset.
   const std::vector<BlockRecord>& block_list() const { return block_list_; }
 
  private:
   friend class StfsContainerDevice;
 
+  // Appends a block to the block list, merging it into the last record if it
+  // directly follows it in the same file.
+  void AppendBlock(size_t file, size_t offset, size_t length);
+
   MultiFileHandles* files_;
   size_t data_offset_;
   size_t data_size_;
@@ -13,6 +13,7 @@
 #include <cmath>
 
 #include "xenia/base/math.h"
+#include "xenia/vfs/devices/stfs_container_device.h"
 #include "xenia/vfs/devices/stfs_container_entry.h"
 
 namespace xe {
@@ -33,34 +34,41 @@ X_STATUS StfsContainerFile::ReadSync(void* buffer, size_t buffer_length,
     return X_STATUS_END_OF_FILE;
   }
 
-  size_t src_offset = 0;
+  auto device = static_cast<StfsContainerDevice*>(entry_->device());
   uint8_t* p = reinterpret_cast<uint8_t*>(buffer);
   size_t remaining_length =
       std::min(buffer_length, entry_->size() - byte_offset);
 
   *out_bytes_read = 0;
-  for (size_t i = 0; i < entry_->block_list().size(); i++) {
-    auto& record = entry_->block_list()[i];
-    if (src_offset + record.length <= byte_offset) {
-      // Doesn't begin in this region. Skip it.
-      src_offset += record.length;
-      continue;
+  // Find the record containing the start of the read.
+  const auto& block_list = entry_->block_list();
+  auto record_it = std::upper_bound(
+      block_list.cbegin(), block_list.cend(), byte_offset,
+      [](size_t offset, const StfsContainerEntry::BlockRecord& record) {
+        return offset < record.entry_offset;
+      });
+  if (record_it == block_list.cbegin()) {
+    return X_STATUS_SUCCESS;
+  }
+  --record_it;
+  for (; record_it != block_list.cend() && remaining_length; ++record_it) {
+    const StfsContainerEntry::BlockRecord& record = *record_it;
+    size_t read_offset = (byte_offset > record.entry_offset)
+                             ? byte_offset - record.entry_offset
+                             : 0;
+    if (read_offset >= record.length) {
+      break;
     }
-
-    size_t read_offset =
-        (byte_offset > src_offset) ? byte_offset - src_offset : 0;
     size_t read_length =
         std::min(record.length - read_offset, remaining_length);
 
-    auto& file = entry_->files()->at(record.file);
-    xe::filesystem::Seek(file, record.offset + read_offset, SEEK_SET);
-    auto num_read = fread(p, 1, read_length, file);
+    size_t num_read = device->ReadData(record.file, record.offset + read_offset,
+                                       p, read_length);
 
     *out_bytes_read += num_read;
     p += num_read;
-    src_offset += record.length;
     remaining_length -= read_length;
-    if (remaining_length == 0) {
+    if (num_read != read_length) {
       break;
     }
   }
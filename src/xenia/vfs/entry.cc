@@ -16,6 +16,11 @@
 namespace xe {
 namespace vfs {
 
+namespace {
+// Directories smaller than this are searched linearly.
+constexpr size_t kMinIndexedChildCount = 16;
+}  // namespace
+
 Entry::Entry(Device* device, Entry* parent, const std::string_view path)
     : device_(device),
       parent_(parent),
@@ -48,6 +53,15 @@ bool Entry::is_read_only() const { return device_->is_read_only(); }
 
 Entry* Entry::GetChild(const std::string_view name) {
   auto global_lock = global_critical_region_.Acquire();
+  if (children_.size() >= kMinIndexedChildCount) {
+    for (; indexed_child_count_ < children_.size(); ++indexed_child_count_) {
+      Entry* child = children_[indexed_child_count_].get();
+      // Like the linear search, the first child with the name takes priority.
+      child_index_.emplace(xe::utf8::lower_ascii(child->name()), child);
+    }
+    auto index_it = child_index_.find(xe::utf8::lower_ascii(name));
+    return index_it != child_index_.end() ? index_it->second : nullptr;
+  }
   auto it = std::find_if(children_.cbegin(), children_.cend(),
                          [&](const auto& child) {
                            return xe::utf8::equal_case(child->name(), name);
@@ -84,6 +98,28 @@ Entry* Entry::IterateChildren(const xe::filesystem::WildcardEngine& engine,
   return nullptr;
 }
 
+uint64_t Entry::FindChildren(const xe::filesystem::WildcardEngine& engine,
+                             size_t start_index,
+                             std::vector<size_t>& indices_out) {
+  auto global_lock = global_critical_region_.Acquire();
+  for (size_t i = start_index; i < children_.size(); ++i) {
+    if (engine.Match(children_[i]->name())) {
+      indices_out.push_back(i);
+    }
+  }
+  return children_version_;
+}
+
+Entry* Entry::GetFoundChild(size_t index, uint64_t children_version) {
+  auto global_lock = global_critical_region_.Acquire();
+  // The devices only append to children_ directly, which doesn't move the
+  // existing children.
+  if (children_version != children_version_ || index >= children_.size()) {
+    return nullptr;
+  }
+  return children_[index].get();
+}
+
 Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
   auto global_lock = global_critical_region_.Acquire();
   if (is_read_only()) {
@@ -98,6 +134,7 @@ Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
     return nullptr;
   }
   children_.push_back(std::move(entry));
+  ++children_version_;
   // TODO(benvanik): resort? would break iteration?
   Touch();
   return children_.back().get();
@@ -120,6 +157,10 @@ bool Entry::Delete(Entry* entry) {
       break;
     }
   }
+  // Rebuilt on the next lookup.
+  child_index_.clear();
+  indexed_child_count_ = 0;
+  ++children_version_;
   Touch();
   return true;
 }
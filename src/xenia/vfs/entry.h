@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/filesystem.h"
@@ -105,6 +106,14 @@ class Entry {
   size_t child_count() const { return children_.size(); }
   Entry* IterateChildren(const xe::filesystem::WildcardEngine& engine,
                          size_t* current_index);
+  // Appends the indices of the children starting from start_index matching the
+  // engine, for enumerating them without matching again on every step.
+  // Returns the version of the children the indices are valid for.
+  uint64_t FindChildren(const xe::filesystem::WildcardEngine& engine,
+                        size_t start_index, std::vector<size_t>& indices_out);
+  // Returns the child at the index found by FindChildren, or nullptr if the
+  // children have been created or deleted since.
+  Entry* GetFoundChild(size_t index, uint64_t children_version);
 
   Entry* CreateEntry(const std::string_view name, uint32_t attributes);
   bool Delete(Entry* entry);
@@ -145,6 +154,15 @@ class Entry {
   uint64_t access_timestamp_;
   uint64_t write_timestamp_;
   std::vector<std::unique_ptr<Entry>> children_;
+
+ private:
+  // Case-folded names of the first indexed_child_count_ children, for the
+  // lookups in big directories. The devices append to children_ directly, so
+  // the new children are indexed lazily.
+  std::unordered_map<std::string, Entry*> child_index_;
+  size_t indexed_child_count_ = 0;
+  // Incremented when children are created or deleted through the entry.
+  uint64_t children_version_ = 0;
 };
 
 }  // namespace vfs
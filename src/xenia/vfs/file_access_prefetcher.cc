@@ -0,0 +1,236 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/file_access_prefetcher.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/vfs/device.h"
+#include "xenia/vfs/entry.h"
+#include "xenia/vfs/file.h"
+
+DEFINE_bool(prefetch_file_access, true,
+            "Record the reads of the game files by the title, and on the next "
+            "launches, read the same data in the background ahead of the "
+            "title to take the storage device latency out of loading.",
+            "Storage");
+DEFINE_uint32(prefetch_file_access_window_mb, 64,
+              "How many megabytes of the recorded reads the background "
+              "prefetching may be ahead of the title.",
+              "Storage");
+
+namespace xe {
+namespace vfs {
+
+namespace {
+constexpr size_t kMaxRecordedReadCount = 1 << 20;
+constexpr size_t kPrefetchChunkSize = 1024 * 1024;
+}  // namespace
+
+FileAccessPrefetcher::~FileAccessPrefetcher() { End(); }
+
+void FileAccessPrefetcher::Begin(Device* device,
+                                 const std::filesystem::path& trace_path) {
+  End();
+  if (!cvars::prefetch_file_access || !device) {
+    return;
+  }
+  device_ = device;
+  trace_path_ = trace_path;
+  begin_time_ = std::chrono::steady_clock::now();
+  LoadTrace();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = false;
+    recording_ = true;
+    guest_read_length_ = 0;
+    recorded_reads_.clear();
+    last_recorded_entry_ = nullptr;
+  }
+  if (planned_reads_.empty()) {
+    return;
+  }
+  threading::Thread::CreationParameters params;
+  thread_ = threading::Thread::Create(params, [this]() { ThreadMain(); });
+  if (!thread_) {
+    XELOGE("Failed to create the file access prefetching thread");
+    return;
+  }
+  thread_->set_name("File Access Prefetcher");
+}
+
+void FileAccessPrefetcher::End() {
+  if (!device_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    recording_ = false;
+  }
+  wake_cond_.notify_all();
+  if (thread_) {
+    threading::Wait(thread_.get(), false);
+    thread_.reset();
+  }
+  planned_reads_.clear();
+  WriteTrace();
+  recorded_reads_.clear();
+  last_recorded_entry_ = nullptr;
+  device_ = nullptr;
+}
+
+void FileAccessPrefetcher::OnRead(const Entry* entry, uint64_t offset,
+                                  size_t length) {
+  if (!length || !entry || entry->device() != device_) {
+    return;
+  }
+  uint64_t time = uint64_t(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - begin_time_)
+          .count());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!recording_) {
+      return;
+    }
+    guest_read_length_ += length;
+    // Merge sequential reads of a file.
+    if (last_recorded_entry_ == entry && !recorded_reads_.empty() &&
+        recorded_reads_.back().offset + recorded_reads_.back().length ==
+            offset) {
+      recorded_reads_.back().length += length;
+    } else if (recorded_reads_.size() < kMaxRecordedReadCount) {
+      recorded_reads_.push_back({time, offset, length, entry->path()});
+      last_recorded_entry_ = entry;
+    }
+  }
+  wake_cond_.notify_one();
+}
+
+void FileAccessPrefetcher::LoadTrace() {
+  planned_reads_.clear();
+  std::ifstream trace_file(trace_path_);
+  if (!trace_file) {
+    return;
+  }
+  // Lines of "time_ms offset length path", the path is last as it may contain
+  // spaces.
+  std::string line;
+  while (std::getline(trace_file, line)) {
+    uint64_t values[3];
+    const char* position = line.data();
+    const char* end = line.data() + line.size();
+    bool parsed = true;
+    for (uint64_t& value : values) {
+      auto result = std::from_chars(position, end, value);
+      if (result.ec != std::errc() || result.ptr == end ||
+          *result.ptr != ' ') {
+        parsed = false;
+        break;
+      }
+      position = result.ptr + 1;
+    }
+    if (!parsed) {
+      XELOGW("Invalid line in the file access trace {}",
+             xe::path_to_utf8(trace_path_));
+      break;
+    }
+    // Resolving now so the thread doesn't need the file system lock.
+    std::string_view path(position, size_t(end - position));
+    Entry* entry = device_->ResolvePath(path);
+    if (!entry || values[2] == 0) {
+      continue;
+    }
+    planned_reads_.push_back({entry, values[1], values[2]});
+  }
+  XELOGI("Prefetching {} file read ranges recorded in {}",
+         planned_reads_.size(), xe::path_to_utf8(trace_path_));
+}
+
+void FileAccessPrefetcher::WriteTrace() {
+  if (recorded_reads_.empty()) {
+    return;
+  }
+  std::error_code error_code;
+  std::filesystem::create_directories(trace_path_.parent_path(), error_code);
+  FILE* trace_file = xe::filesystem::OpenFile(trace_path_, "wb");
+  if (!trace_file) {
+    XELOGE("Failed to write the file access trace {}",
+           xe::path_to_utf8(trace_path_));
+    return;
+  }
+  for (const RecordedRead& read : recorded_reads_) {
+    std::string line = fmt::format("{} {} {} {}\n", read.time, read.offset,
+                                   read.length, read.path);
+    fwrite(line.data(), 1, line.size(), trace_file);
+  }
+  fclose(trace_file);
+}
+
+void FileAccessPrefetcher::ThreadMain() {
+  std::vector<uint8_t> buffer(kPrefetchChunkSize);
+  uint64_t window = uint64_t(cvars::prefetch_file_access_window_mb) << 20;
+  uint64_t planned_read_length = 0;
+  Entry* file_entry = nullptr;
+  File* file = nullptr;
+  for (const PlannedRead& read : planned_reads_) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_cond_.wait(lock, [&]() {
+        return stop_ || planned_read_length <= guest_read_length_ + window;
+      });
+      if (stop_) {
+        break;
+      }
+    }
+    planned_read_length += read.length;
+    if (file_entry != read.entry) {
+      if (file) {
+        file->Destroy();
+        file = nullptr;
+      }
+      file_entry = read.entry;
+      if (file_entry->Open(FileAccess::kGenericRead | FileAccess::kFileReadData,
+                           &file) != X_STATUS_SUCCESS) {
+        file = nullptr;
+        continue;
+      }
+    }
+    if (!file) {
+      continue;
+    }
+    // Reading through the device warms up both the host page cache and the
+    // caches of the device itself.
+    for (uint64_t offset = 0; offset < read.length;) {
+      size_t chunk_length = size_t(
+          std::min(read.length - offset, uint64_t(kPrefetchChunkSize)));
+      size_t bytes_read = 0;
+      if (file->ReadSync(buffer.data(), chunk_length,
+                         size_t(read.offset + offset),
+                         &bytes_read) != X_STATUS_SUCCESS ||
+          !bytes_read) {
+        break;
+      }
+      offset += bytes_read;
+    }
+  }
+  if (file) {
+    file->Destroy();
+  }
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,95 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_FILE_ACCESS_PREFETCHER_H_
+#define XENIA_VFS_FILE_ACCESS_PREFETCHER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace vfs {
+
+class Device;
+class Entry;
+
+// Records the reads of the files of a title from its device, and on the next
+// launches of the title, reads the same ranges in the background somewhat
+// ahead of the guest, so the data is already in the host page cache and in the
+// caches of the device when the guest requests it. Titles usually load their
+// levels in the same order every time.
+class FileAccessPrefetcher {
+ public:
+  FileAccessPrefetcher() = default;
+  FileAccessPrefetcher(const FileAccessPrefetcher& prefetcher) = delete;
+  FileAccessPrefetcher& operator=(const FileAccessPrefetcher& prefetcher) =
+      delete;
+  ~FileAccessPrefetcher();
+
+  // Starts replaying the reads recorded in the trace file, and recording the
+  // reads from the device anew. The device must stay registered until End.
+  void Begin(Device* device, const std::filesystem::path& trace_path);
+  // Stops replaying, and writes the recorded reads to the trace file.
+  void End();
+
+  Device* device() const { return device_; }
+
+  // Called after the guest has read from a file.
+  void OnRead(const Entry* entry, uint64_t offset, size_t length);
+
+ private:
+  struct RecordedRead {
+    // In milliseconds since Begin.
+    uint64_t time;
+    uint64_t offset;
+    uint64_t length;
+    std::string path;
+  };
+
+  struct PlannedRead {
+    Entry* entry;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  void LoadTrace();
+  void WriteTrace();
+  void ThreadMain();
+
+  Device* device_ = nullptr;
+  std::filesystem::path trace_path_;
+  std::chrono::steady_clock::time_point begin_time_;
+
+  // Written only by the thread calling Begin, before the thread is started.
+  std::vector<PlannedRead> planned_reads_;
+  std::unique_ptr<threading::Thread> thread_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_cond_;
+  bool stop_ = false;
+  bool recording_ = false;
+  // Total length of the reads from the device by the guest since Begin, for
+  // keeping the prefetching within a window ahead of the guest.
+  uint64_t guest_read_length_ = 0;
+  std::vector<RecordedRead> recorded_reads_;
+  const Entry* last_recorded_entry_ = nullptr;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_FILE_ACCESS_PREFETCHER_H_
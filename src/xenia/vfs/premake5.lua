@@ -7,6 +7,7 @@ project("xenia-vfs")
   kind("StaticLib")
   language("C++")
   links({
+    "snappy",
     "xenia-base",
   })
   defines({
@@ -27,6 +28,7 @@ project("xenia-vfs-dump")
   language("C++")
   links({
     "fmt",
+    "snappy",
     "xenia-base",
     "xenia-vfs",
   })
@@ -17,6 +17,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 
+#include "xenia/vfs/devices/compressed_disc_image_device.h"
 #include "xenia/vfs/devices/stfs_container_device.h"
 #include "xenia/vfs/file.h"
 #include "xenia/vfs/virtual_file_system.h"
@@ -30,6 +31,12 @@ DEFINE_transient_path(source, "", "Specifies the file to dump from.",
 DEFINE_transient_path(dump_path, "",
                       "Specifies the directory to dump files to.", "General");
 
+DEFINE_transient_bool(compress_disc_image, false,
+                      "Instead of dumping the files, writes the source disc "
+                      "image compressed to the dump_path file, which can be "
+                      "run in place of the image if named *.xcz.",
+                      "General");
+
 int vfs_dump_main(const std::vector<std::string>& args) {
   if (cvars::source.empty() || cvars::dump_path.empty()) {
     XELOGE("Usage: {} [source] [dump_path]", xe::path_to_utf8(args[0]));
@@ -37,6 +44,11 @@ int vfs_dump_main(const std::vector<std::string>& args) {
   }
 
   std::filesystem::path base_path = cvars::dump_path;
+  if (cvars::compress_disc_image) {
+    return vfs::CompressedDiscImageDevice::Compress(cvars::source, base_path)
+               ? 0
+               : 1;
+  }
   std::unique_ptr<vfs::Device> device;
 
   // TODO: Flags specifying the type of device.
@@ -22,11 +22,18 @@ namespace vfs {
 
 using namespace xe::literals;
 
+namespace {
+// Titles normally open far fewer distinct paths, this only bounds the memory
+// usage in case of something like a recursive directory scan.
+constexpr size_t kMaxResolvedPathCacheSize = 16384;
+}  // namespace
+
 VirtualFileSystem::VirtualFileSystem() {}
 
 VirtualFileSystem::~VirtualFileSystem() {
   // Delete all devices.
   // This will explode if anyone is still using data from them.
+  access_prefetcher_.End();
   devices_.clear();
   symlinks_.clear();
 }
@@ -34,14 +41,21 @@ VirtualFileSystem::~VirtualFileSystem() {
 bool VirtualFileSystem::RegisterDevice(std::unique_ptr<Device> device) {
   auto global_lock = global_critical_region_.Acquire();
   devices_.emplace_back(std::move(device));
+  InvalidateResolvedPathCache();
   return true;
 }
 
 bool VirtualFileSystem::UnregisterDevice(const std::string_view path) {
+  // The prefetching thread may be reading from the device.
+  Device* prefetched_device = access_prefetcher_.device();
+  if (prefetched_device && prefetched_device->mount_path() == path) {
+    access_prefetcher_.End();
+  }
   auto global_lock = global_critical_region_.Acquire();
   for (auto it = devices_.begin(); it != devices_.end(); ++it) {
     if ((*it)->mount_path() == path) {
       XELOGD("Unregistered device: {}", (*it)->mount_path());
+      InvalidateResolvedPathCache();
       devices_.erase(it);
       return true;
     }
@@ -53,6 +67,7 @@ bool VirtualFileSystem::RegisterSymbolicLink(const std::string_view path,
                                              const std::string_view target) {
   auto global_lock = global_critical_region_.Acquire();
   symlinks_.insert({std::string(path), std::string(target)});
+  InvalidateResolvedPathCache();
   XELOGD("Registered symbolic link: {} => {}", path, target);
 
   return true;
@@ -69,6 +84,7 @@ bool VirtualFileSystem::UnregisterSymbolicLink(const std::string_view path) {
   XELOGD("Unregistered symbolic link: {} => {}", it->first, it->second);
 
   symlinks_.erase(it);
+  InvalidateResolvedPathCache();
   return true;
 }
 
@@ -105,9 +121,20 @@ bool VirtualFileSystem::ResolveSymbolicLink(const std::string_view path,
   return was_resolved;
 }
 
+void VirtualFileSystem::InvalidateResolvedPathCache() {
+  auto global_lock = global_critical_region_.Acquire();
+  resolved_path_cache_.clear();
+}
+
 Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
   auto global_lock = global_critical_region_.Acquire();
 
+  std::string cache_key = xe::utf8::lower_ascii(path);
+  auto cache_it = resolved_path_cache_.find(cache_key);
+  if (cache_it != resolved_path_cache_.end()) {
+    return cache_it->second;
+  }
+
   // Resolve relative paths
   auto normalized_path(xe::utf8::canonicalize_guest_path(path));
 
@@ -133,7 +160,16 @@ Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
 
   const auto& device = *it;
   auto relative_path = normalized_path.substr(device->mount_path().size());
-  return device->ResolvePath(relative_path);
+  Entry* entry = device->ResolvePath(relative_path);
+  // Only the existing entries are cached, creating new ones doesn't need to
+  // invalidate anything.
+  if (entry) {
+    if (resolved_path_cache_.size() >= kMaxResolvedPathCacheSize) {
+      resolved_path_cache_.clear();
+    }
+    resolved_path_cache_.emplace(std::move(cache_key), entry);
+  }
+  return entry;
 }
 
 Entry* VirtualFileSystem::CreatePath(const std::string_view path,
@@ -175,6 +211,7 @@ bool VirtualFileSystem::DeletePath(const std::string_view path) {
     // Can't delete root.
     return false;
   }
+  InvalidateResolvedPathCache();
   return parent->Delete(entry);
 }
 
@@ -228,11 +265,14 @@ X_STATUS VirtualFileSystem::OpenFile(Entry* root_entry,
       const xe::vfs::HostPathEntry* host_Path =
           dynamic_cast<const xe::vfs::HostPathEntry*>(parent_entry);
 
-      if (host_Path) {
+      // The guest can't remove files from read-only host directories, skip
+      // the host filesystem access.
+      if (host_Path && !host_Path->is_read_only()) {
         auto const file_path = host_Path->host_path() / entry->name();
 
         if (!std::filesystem::exists(file_path)) {
           // Remove cached entry
+          InvalidateResolvedPathCache();
           entry->Delete();
           entry = nullptr;
         }
@@ -290,6 +330,7 @@ X_STATUS VirtualFileSystem::OpenFile(Entry* root_entry,
         return X_STATUS_ACCESS_DENIED;
       case FileDisposition::kSuperscede:
         // Replace (by delete + recreate).
+        InvalidateResolvedPathCache();
         if (!entry->Delete()) {
           return X_STATUS_ACCESS_DENIED;
         }
@@ -304,6 +345,7 @@ X_STATUS VirtualFileSystem::OpenFile(Entry* root_entry,
       case FileDisposition::kOverwrite:
       case FileDisposition::kOverwriteIf:
         // Overwrite (we do by delete + recreate).
+        InvalidateResolvedPathCache();
         if (!entry->Delete()) {
           return X_STATUS_ACCESS_DENIED;
         }
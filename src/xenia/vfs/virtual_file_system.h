@@ -19,6 +19,7 @@
 #include "xenia/vfs/device.h"
 #include "xenia/vfs/entry.h"
 #include "xenia/vfs/file.h"
+#include "xenia/vfs/file_access_prefetcher.h"
 
 namespace xe {
 namespace vfs {
@@ -52,12 +53,20 @@ class VirtualFileSystem {
   static void ExtractContentHeader(Device* device,
                                    std::filesystem::path base_path);
 
+  FileAccessPrefetcher& access_prefetcher() { return access_prefetcher_; }
+
  private:
   xe::global_critical_region global_critical_region_;
   std::vector<std::unique_ptr<Device>> devices_;
   std::unordered_map<std::string, std::string> symlinks_;
+  // Case-folded paths as requested, before resolving the symbolic links, to
+  // the entries they refer to. Cleared when entries are deleted or when the
+  // devices or the symbolic links change.
+  std::unordered_map<std::string, Entry*> resolved_path_cache_;
+  FileAccessPrefetcher access_prefetcher_;
 
   bool ResolveSymbolicLink(const std::string_view path, std::string& result);
+  void InvalidateResolvedPathCache();
 };
 
 }  // namespace vfs